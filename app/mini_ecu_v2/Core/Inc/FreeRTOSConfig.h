@@ -52,6 +52,13 @@
   #include <stdint.h>
   extern uint32_t SystemCoreClock;
   void xPortSysTickHandler(void);
+/* USER CODE BEGIN 0 */
+  void configureTimerForRunTimeStats(void);
+  unsigned long getRunTimeCounterValue(void);
+  void LowPower_PreSleep(uint32_t *expected);
+  void LowPower_PostSleep(uint32_t expected);
+  void CrashDump_Assert(void);
+/* USER CODE END 0 */
 #endif
 #ifndef CMSIS_device_header
 #define CMSIS_device_header "stm32f4xx.h"
@@ -72,6 +79,7 @@
 #define configTOTAL_HEAP_SIZE                    ((size_t)15360)
 #define configMAX_TASK_NAME_LEN                  ( 16 )
 #define configUSE_TRACE_FACILITY                 1
+#define configGENERATE_RUN_TIME_STATS            1
 #define configUSE_16_BIT_TICKS                   0
 #define configUSE_MUTEXES                        1
 #define configQUEUE_REGISTRY_SIZE                8
@@ -120,6 +128,7 @@ to exclude the API function. */
 #define INCLUDE_uxTaskGetStackHighWaterMark  1
 #define INCLUDE_xTaskGetCurrentTaskHandle    1
 #define INCLUDE_eTaskGetState                1
+#define INCLUDE_xTaskGetIdleTaskHandle       1
 
 /*
  * The CMSIS-RTOS V2 FreeRTOS wrapper is dependent on the heap implementation used
@@ -155,9 +164,30 @@ See http://www.FreeRTOS.org/RTOS-Cortex-M3-M4.html. */
 /* Normal assert() semantics without relying on the provision of an assert.h
 header file. */
 /* USER CODE BEGIN 1 */
-#define configASSERT( x ) if ((x) == 0) {taskDISABLE_INTERRUPTS(); for( ;; );}
+/* A failed assertion records a crash dump and resets (crash_dump.h). */
+#define configASSERT( x ) if ((x) == 0) {taskDISABLE_INTERRUPTS(); CrashDump_Assert();}
 /* USER CODE END 1 */
 
+/* USER CODE BEGIN 2 */
+/* Run-time stats count DWT CYCCNT core cycles (freertos.c). The 32-bit
+ * counters wrap after 2^32 cycles (~24 s at 180 MHz); rtos_stats.c only
+ * uses differences over much shorter windows. */
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS configureTimerForRunTimeStats
+#define portGET_RUN_TIME_COUNTER_VALUE getRunTimeCounterValue
+
+/* Tickless idle: 2 = vPortSuppressTicksAndSleep() comes from low_power.c,
+ * which times the sleep on the RTC wakeup timer and calls the hooks below
+ * around the WFI. */
+#define configUSE_TICKLESS_IDLE                2
+#define configEXPECTED_IDLE_TIME_BEFORE_SLEEP  3
+#define configPRE_SLEEP_PROCESSING(x)          LowPower_PreSleep(&(x))
+#define configPOST_SLEEP_PROCESSING(x)         LowPower_PostSleep(x)
+
+/* Idle hook: one flash scrub slice per idle loop (flash_scrub.h). */
+#undef  configUSE_IDLE_HOOK
+#define configUSE_IDLE_HOOK                    1
+/* USER CODE END 2 */
+
 /* Definitions that map the FreeRTOS port interrupt handlers to their CMSIS
 standard names. */
 #define vPortSVCHandler    SVC_Handler
@@ -169,6 +199,82 @@ standard names. */
 
 /* USER CODE BEGIN Defines */
 /* Section where parameter definitions can be added (for instance, to override default ones in FreeRTOS.h) */
+
+/* Static-only build (-DRTOS_STATIC_ALLOC=1): every RTOS object already gets
+ * its memory from the application (main.c, vehicle_shared.c, cmsis_os2.c
+ * idle/timer callbacks); this also removes the heap_4 pool. heap_4.c must be
+ * excluded from the build in this mode (it #errors without dynamic
+ * allocation); freertos.c provides trapping pvPortMalloc()/vPortFree(). */
+#ifndef RTOS_STATIC_ALLOC
+#define RTOS_STATIC_ALLOC                        0
+#endif
+
+/* Heap implementation (-DRTOS_HEAP_TLSF=1, "make RTOS_HEAP_TLSF=1"):
+ * heap_tlsf.c, O(1) malloc/free by size class, in place of heap_4's
+ * first-fit walk. It fails the build unless configTOTAL_HEAP_SIZE holds
+ * the plan below: the most the application expects to have allocated at
+ * once, in bytes and blocks. Nothing of it allocates today (section 8.1
+ * of the architecture notes); the plan covers DEFAULT_TASK_MODE 1's
+ * defaultTask (512 B stack and TCB) and ISO-TP/UDS buffers should they
+ * move to the heap. */
+#ifndef RTOS_HEAP_TLSF
+#define RTOS_HEAP_TLSF                           0
+#endif
+#ifndef RTOS_HEAP_PLAN_BYTES
+#define RTOS_HEAP_PLAN_BYTES                     8192U
+#endif
+#ifndef RTOS_HEAP_PLAN_BLOCKS
+#define RTOS_HEAP_PLAN_BLOCKS                    16U
+#endif
+
+#if RTOS_HEAP_TLSF && RTOS_STATIC_ALLOC
+#error "RTOS_HEAP_TLSF needs the heap that RTOS_STATIC_ALLOC removes"
+#endif
+
+#if RTOS_STATIC_ALLOC
+#undef  configSUPPORT_DYNAMIC_ALLOCATION
+#define configSUPPORT_DYNAMIC_ALLOCATION         0
+#undef  configTOTAL_HEAP_SIZE
+#define configTOTAL_HEAP_SIZE                    ((size_t)0)
+#endif
+
+/* FMT_PRINTF=1 (fmt.h) formats without newlib's printf, the only newlib
+ * code that several tasks ran; no task then needs its own struct _reent
+ * (newlib's shared one serves strtof() in CliTask). */
+#ifndef FMT_PRINTF
+#define FMT_PRINTF                               0
+#endif
+
+#if FMT_PRINTF
+#undef  configUSE_NEWLIB_REENTRANT
+#define configUSE_NEWLIB_REENTRANT               0
+#endif
+
+/* Stack overruns: at each switch the kernel checks the task's SP and the
+ * 0xA5 fill at the end of its stack, and vApplicationStackOverflowHook()
+ * (freertos.c) records the task in the crash dump. With -DRTOS_STACK_GUARD=1
+ * ("make RTOS_STACK_GUARD=1") an MPU region write-protects the end of the
+ * running task's stack instead (rtos_stack.h): the overrunning store
+ * faults at once and the switch does no check. The stack end is kept in
+ * the TCB for the sizes shown by "stack". */
+#ifndef RTOS_STACK_GUARD
+#define RTOS_STACK_GUARD                         0
+#endif
+
+#if RTOS_STACK_GUARD
+#define configCHECK_FOR_STACK_OVERFLOW           0
+#else
+#define configCHECK_FOR_STACK_OVERFLOW           2
+#endif
+#define configRECORD_STACK_HIGH_ADDRESS          1
+
+/* Kernel trace hooks (traceTASK_SWITCHED_IN etc.) recording into the
+ * "rtos trace" ring; RTOS_TRACE_ENABLE=0 leaves the FreeRTOS defaults.
+ * traceTASK_CREATE keeps the stack sizes. */
+#if defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__)
+  #include "rtos_trace.h"
+  #include "rtos_stack.h"
+#endif
 /* USER CODE END Defines */
 
 #endif /* FREERTOS_CONFIG_H */
@@ -0,0 +1,153 @@
+/**
+ * @file    angle_sched.h
+ * @brief   Crank-angle event scheduler: pulses at crank angles, fired by the
+ *          TIM4 output compare channels from the decoded tooth times.
+ *
+ * Each event of ANGLE_SCHED_EVENT_TABLE is a pulse of a given width that
+ * starts at a crank angle (0..360 degrees from tooth 0, crank.h), once per
+ * revolution: the simulated injection and ignition outputs. An event owns
+ * one compare channel of TIM4, the 1 MHz counter the tooth edges are
+ * captured on, so angle and output share one time base:
+ *
+ *   CH2  PB7  (AF2)   INJ, on the pin
+ *   CH3  -            IGN, compare only: PB8 is the fan PWM (fan_ctrl.h)
+ *
+ * Scheduling, in the tooth capture interrupt (Crank_CaptureIRQHandler()):
+ * each event is converted once, when the last present tooth before its
+ * angle comes, to
+ *
+ *   CCR = tooth edge + (angle - tooth angle) / 6 deg * tooth time
+ *
+ * with the tooth time of that edge (1 to 3 teeth ahead, so across the gap
+ * as well). The compare sets the output in hardware at CCR ("active on
+ * match"), its interrupt puts the end of the pulse into the same CCR
+ * ("inactive on match"), and the second one parks the channel. A CCR that
+ * the counter has already passed when it is written fires at once, forced,
+ * and counts as late.
+ *
+ * Jitter: the tooth edge after each firing gives the angle the crank
+ * really had at CCR, interpolated between the two edges around it. The
+ * difference to the event angle is the error of the prediction (speed
+ * change over the extrapolated teeth, 1 us steps); per event its mean,
+ * standard deviation and extremes are kept in hundredths of a degree.
+ *
+ * "angle" shows the events and their error, "angle set <event> <deg>
+ * [<us>]" moves one. "bench angle start [<ms>]" runs the crank generator
+ * through ANGLE_SCHED_SWEEP_TABLE, constant speeds and ramps, <ms> per step
+ * after 200 ms at its first speed, and "bench angle" shows the error per
+ * step and event.
+ */
+
+#ifndef ANGLE_SCHED_H
+#define ANGLE_SCHED_H
+
+#include "main.h"
+#include "crank.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = angle scheduler; needs the crank decoder. */
+#ifndef ANGLE_SCHED_ENABLE
+#define ANGLE_SCHED_ENABLE      CRANK_ENABLE
+#endif
+
+/**
+ * X(name, ch, pin, deg10, us): events. ch: TIM4 channel 2..4 (CH1 is the
+ * tooth capture); pin: 1 = drive its TIM4 pin (CH2 PB7, CH3 PB8, CH4 PB9);
+ * deg10: start angle in 0.1 degrees; us: pulse width.
+ */
+#define ANGLE_SCHED_EVENT_TABLE(X)          \
+    X(INJ, 2U, 1U, 3000U, 2000U)            \
+    X(IGN, 3U, 0U, 3500U,  200U)
+
+/** X(fromRpm, toRpm): steps of "bench angle"; equal = constant speed. */
+#define ANGLE_SCHED_SWEEP_TABLE(X) \
+    X(1000U, 1000U) X(3000U, 3000U) X(6000U, 6000U) X(1000U, 6000U) X(6000U, 1000U)
+
+/** Duration of a step of "bench angle" (ms). */
+#ifndef ANGLE_SCHED_BENCH_MS
+#define ANGLE_SCHED_BENCH_MS    2000U
+#endif
+
+/** Widths "angle set" takes (us). */
+#define ANGLE_SCHED_WIDTH_MIN   10U
+#define ANGLE_SCHED_WIDTH_MAX   20000U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+#define ANGLE_SCHED_ID_(name, ch, pin, deg10, us)   ANGLE_SCHED_##name,
+typedef enum
+{
+    ANGLE_SCHED_EVENT_TABLE(ANGLE_SCHED_ID_)
+    ANGLE_SCHED_EVENTS
+} AngleSched_Id_t;
+#undef ANGLE_SCHED_ID_
+
+/**
+ * @brief One event and its angle error since boot.
+ */
+typedef struct
+{
+    uint16_t deg10;         /**< Start angle, 0.1 degrees. */
+    uint16_t widthUs;
+    uint32_t fired;
+    uint32_t late;          /**< Fired forced, the CCR already passed. */
+    uint32_t overlaps;      /**< Skipped, the last pulse still running. */
+    uint32_t measured;      /**< Firings with an angle error. */
+    float    errMeanDeg;
+    float    errStdDeg;     /**< The jitter. */
+    float    errMinDeg;
+    float    errMaxDeg;
+} AngleSched_Event_t;
+
+/**
+ * @brief Set up the TIM4 compare channels and their pins and register
+ *        "angle" and "bench angle". Call once after Crank_Init().
+ */
+HAL_StatusTypeDef AngleSched_Init(void);
+
+/**
+ * @brief Run the benchmark sweep (10 ms raster runnable).
+ */
+void AngleSched_Event10ms(void);
+
+/**
+ * @brief A tooth edge (Crank_CaptureIRQHandler()): measure the events that
+ *        fired since the last edge, schedule those due from this tooth.
+ * @param sync   Crank_Sync_t after the edge.
+ * @param tooth  Tooth of the edge.
+ * @param t      Capture of the edge.
+ * @param dt     Time since the previous edge (the gap before tooth 0).
+ */
+void AngleSched_ToothIRQ(uint32_t sync, uint32_t tooth, uint16_t t, uint32_t dt);
+
+/**
+ * @brief TIM4 compare interrupt (TIM4_IRQHandler): pulse start and end.
+ */
+void AngleSched_CompareIRQHandler(void);
+
+/**
+ * @brief Event @p id as of now; 0 if there is none.
+ */
+uint32_t AngleSched_Get(uint32_t id, AngleSched_Event_t *out);
+
+/**
+ * @brief The clocks changed (clock_gov.h, after Crank_ClockChanged()):
+ *        park all channels, the pending pulses are void.
+ */
+void AngleSched_ClockChanged(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ANGLE_SCHED_H */
@@ -0,0 +1,152 @@
+/**
+ * @file    audit.h
+ * @brief   Audit ring: state-changing commands as fixed 16-byte events.
+ *
+ * A command that changes how the ECU behaves ("veh speed", "log off",
+ * "cal set", a UDS routine, ...) calls Audit_Record() with its command ID
+ * and up to two arguments once it took effect. The event goes into a RAM
+ * ring of AUDIT_DEPTH events, the oldest overwritten:
+ *
+ *   | Offset | Size | Field                                        |
+ *   |--------|------|----------------------------------------------|
+ *   |      0 |    4 | HAL_GetTick() at the change (ms)             |
+ *   |      4 |    2 | sequence number, +1 per event (wraps)        |
+ *   |      6 |    1 | command, Audit_Cmd_t (AUDIT_CMD_TABLE)       |
+ *   |      7 |    1 | source, Audit_Src_t                          |
+ *   |      8 |    4 | argument 0                                   |
+ *   |     12 |    4 | argument 1                                   |
+ *
+ * Recording is a 16-byte copy under PRIMASK: no formatting and no UART,
+ * so it costs the same with the console log off or its level at error,
+ * and the record survives "log off". A gap in the sequence numbers shows
+ * events lost to the ring wrap.
+ *
+ * "audit" prints the ring decoded; UDS routine UDS_RID_AUDIT (uds.h) reads
+ * it in the layout above, big-endian.
+ *
+ *   audit [<n>]             the newest n events (default all)
+ */
+
+#ifndef AUDIT_H
+#define AUDIT_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Events held (a power of two), 16 bytes each. */
+#ifndef AUDIT_DEPTH
+#define AUDIT_DEPTH             64U
+#endif
+
+/**
+ * @brief Recorded commands. X(name, command, argument 0, argument 1); "audit"
+ *        prints an argument as 'u' unsigned, 'x' hex, 'f' float bits, 's'
+ *        up to four characters (Audit_Text()) or not at all ('-').
+ *
+ *   VEH_SPEED, VEH_COOL_HOT  target / forced value (km/h, C)
+ *   LOG_LEVEL                module (255: all), level
+ *   SENSOR_FAULT             channel, VSensor_Fault_t
+ *   FAULT_ADD                id | kind << 8 | chance << 16, target
+ *   FAULT_DEL                id
+ *   CAN_BITRATE, CAN_MODE    bit/s, mode bits (can_if.h)
+ *   CAL_SET                  Cal_Id_t, value bits
+ *   CAL_MAP_SET              map | row << 8 | col << 16, value
+ *   CAL_COMMIT               values queued
+ *   SCENARIO_PLAY            name, scale
+ *   SIM_SCALE                scale
+ *   FAN_DUTY                 held duty (%)
+ *   VEH_CRUISE               set speed (km/h, 0: off)
+ */
+#define AUDIT_CMD_TABLE(X)                              \
+    X(VEH_SPEED,     "veh speed",     'f', '-')         \
+    X(VEH_COOL_HOT,  "veh cool-hot",  'f', '-')         \
+    X(LOG_ON,        "log on",        '-', '-')         \
+    X(LOG_OFF,       "log off",       '-', '-')         \
+    X(LOG_LEVEL,     "log level",     'u', 'u')         \
+    X(SENSOR_FAULT,  "sensor fault",  'u', 'u')         \
+    X(FAULT_ADD,     "fault add",     'x', 'x')         \
+    X(FAULT_DEL,     "fault del",     'u', '-')         \
+    X(FAULT_CLEAR,   "fault clear",   '-', '-')         \
+    X(CAN_BITRATE,   "can bitrate",   'u', 'x')         \
+    X(CAN_MODE,      "can mode",      'x', '-')         \
+    X(CAL_SET,       "cal set",       'u', 'x')         \
+    X(CAL_MAP_SET,   "cal map set",   'x', 'f')         \
+    X(CAL_COMMIT,    "cal commit",    'u', '-')         \
+    X(SCENARIO_PLAY, "scenario play", 's', 'u')         \
+    X(SCENARIO_STOP, "scenario stop", '-', '-')         \
+    X(SIM_SCALE,     "sim scale",     'u', '-')         \
+    X(DTC_CLEAR,     "dtc clear",     '-', '-')         \
+    X(FAN_DUTY,      "fan duty",      'f', '-')         \
+    X(FAN_AUTO,      "fan auto",      '-', '-')         \
+    X(VEH_CRUISE,    "veh cruise",    'f', '-')
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+#define AUDIT_CMD_ENUM_(name, cmd, a0, a1) AUDIT_CMD_##name,
+    AUDIT_CMD_TABLE(AUDIT_CMD_ENUM_)
+#undef AUDIT_CMD_ENUM_
+    AUDIT_CMD_COUNT
+} Audit_Cmd_t;
+
+typedef enum
+{
+    AUDIT_SRC_CLI = 0,      /**< Console, CLI script or RPC. */
+    AUDIT_SRC_UDS,          /**< Diagnostic request. */
+    AUDIT_SRC_COUNT
+} Audit_Src_t;
+
+/**
+ * @brief One event, the layout above (little-endian in RAM).
+ */
+typedef struct
+{
+    uint32_t timeMs;
+    uint16_t seq;
+    uint8_t  cmd;           /**< Audit_Cmd_t */
+    uint8_t  src;           /**< Audit_Src_t */
+    uint32_t arg[2];
+} Audit_Event_t;
+
+/**
+ * @brief Register "audit". Call once before the scheduler starts; events
+ *        recorded before are kept.
+ */
+void Audit_Init(void);
+
+/**
+ * @brief Record a change (any task or interrupt).
+ */
+void Audit_Record(Audit_Cmd_t cmd, Audit_Src_t src, uint32_t arg0, uint32_t arg1);
+
+/** Audit_Record() of a float argument 0, kept as its bits. */
+void Audit_RecordF(Audit_Cmd_t cmd, Audit_Src_t src, float arg0, uint32_t arg1);
+
+/**
+ * @brief Copy events, newest first.
+ *
+ * @param back  Newest events to skip.
+ * @param count Room in @p out.
+ * @return Events copied.
+ */
+uint32_t Audit_Read(uint32_t back, uint32_t count, Audit_Event_t *out);
+
+/** Up to the first four characters of @p s as one argument ('s'). */
+uint32_t Audit_Text(const char *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AUDIT_H */
@@ -0,0 +1,102 @@
+/**
+ * @file    boot_handoff.h
+ * @brief   Hand-off block the bootloader leaves in no-init RAM.
+ *
+ * The last 64 bytes of SRAM (BOOT_HANDOFF_ADDR) are the HANDOFF region of
+ * STM32F446RETX_FLASH.ld, reserved by a NOLOAD section, so startup code
+ * never clears them. On every
+ * boot the bootloader records what it did there:
+ *
+ *   - resetCause: RCC->CSR reset flags (the bootloader clears them in RCC),
+ *   - clock: the CLOCK_PROFILE_xxx the core already runs with; when it is
+ *     the selected one SystemClock_Config() adopts it instead of switching,
+ *   - bootUs, flags, slot, attempt: boot time from reset to the jump, fast
+ *     or logged path, slot and trial attempt,
+ *   - updateStatus/updateVersion: outcome of the last update session.
+ *
+ * In the other direction BootHandoff_RequestUpdate() asks the next boot to
+ * stay in update mode. The block is valid when magic, version and check
+ * match.
+ *
+ * The bootloader has its own copy of this layout in boot_handoff.h; keep
+ * the two in sync.
+ */
+
+#ifndef BOOT_HANDOFF_H
+#define BOOT_HANDOFF_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BOOT_HANDOFF_ADDR        0x2001FFC0U   /* last 64 B of SRAM */
+#define BOOT_HANDOFF_MAGIC       0x46464F48U   /* "HOFF" */
+#define BOOT_HANDOFF_VERSION     1U
+
+/** clock: reset state, or a CLOCK_PROFILE_xxx (clock_cfg.h). */
+#define BOOT_HANDOFF_CLOCK_NONE  0xFFFFFFFFU
+#define BOOT_HANDOFF_CLOCK_HSI16 0U
+
+/** flags */
+#define BOOT_HANDOFF_FAST        0x01U         /**< Bootloader fast path. */
+
+/** updateStatus */
+#define BOOT_HANDOFF_UPDATE_NONE      0U
+#define BOOT_HANDOFF_UPDATE_INSTALLED 1U       /**< This image came from an update. */
+#define BOOT_HANDOFF_UPDATE_ABORTED   2U       /**< A session was abandoned. */
+#define BOOT_HANDOFF_UPDATE_IDLE      3U       /**< Update mode timed out unused. */
+
+/** request */
+#define BOOT_HANDOFF_REQ_NONE    0U
+#define BOOT_HANDOFF_REQ_UPDATE  0x54445055U   /* "UPDT" */
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t resetCause;     /**< RCC->CSR bits 31..24 at reset */
+    uint32_t clock;          /**< BOOT_HANDOFF_CLOCK_xxx */
+    uint32_t bootUs;         /**< Bootloader time, reset to jump */
+    uint32_t flags;
+    uint32_t slot;           /**< 'A' or 'B' */
+    uint32_t attempt;        /**< Trial boot number, 0 if not on trial */
+    uint32_t updateStatus;
+    uint32_t updateVersion;
+    uint32_t request;
+    uint32_t check;          /**< ~XOR of the words above */
+} BootHandoff_t;
+
+/**
+ * @brief The block of this boot, or NULL without a bootloader that wrote
+ *        one (e.g. started by the debugger at the slot address).
+ */
+const BootHandoff_t *BootHandoff_Get(void);
+
+/**
+ * @brief Log the boot (slot, path, time, reset cause) and the update
+ *        status, then clear the latter so it is reported once.
+ *
+ * Call after Log_Init().
+ */
+void BootHandoff_Report(void);
+
+/**
+ * @brief Make the next boot stay in the bootloader's update mode.
+ *
+ * Takes effect over a reset (NVIC_SystemReset()), not a power cycle.
+ */
+void BootHandoff_RequestUpdate(void);
+
+/**
+ * @brief Names of the reset flags in @p resetCause, e.g. "IWDG, PIN".
+ */
+const char *BootHandoff_ResetCauseName(uint32_t resetCause, char *buf, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOOT_HANDOFF_H */
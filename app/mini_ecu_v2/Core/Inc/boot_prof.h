@@ -0,0 +1,125 @@
+/**
+ * @file    boot_prof.h
+ * @brief   Boot-time profile: time from reset to each start-up point.
+ *
+ * The DWT cycle counter runs from reset: the bootloader starts it in
+ * BootHandoff_Begin() and leaves it running over the jump; without a
+ * bootloader (debugger) BootProf_Begin() starts it. BootProf_Mark() turns
+ * the cycles since the previous point into microseconds at the core clock
+ * read back from RCC at that point, and records the time since reset once
+ * per boot. A stage that switches the clock at its end (the clock stages)
+ * is exact; one that switches in the middle counts at its old clock. The
+ * state is NOINIT (sram_layout.h): the first points are marked from
+ * Reset_Handler, before .data and .bss exist.
+ *
+ * The kernel restarts the counter for the run-time stats
+ * (configureTimerForRunTimeStats()); BootProf_Rebase() carries the time
+ * over, so the points after osKernelStart() stay on the same scale.
+ *
+ *   boot times            every point: time since reset and since the last
+ */
+
+#ifndef BOOT_PROF_H
+#define BOOT_PROF_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Points in start-up order. X(name, label). Reset_Handler marks
+ *        DATA, BSS and MAIN by number (startup_stm32f446retx.s); keep
+ *        these first.
+ *
+ *   ENTRY        application Reset_Handler (bootloader time included)
+ *   CLOCK_EARLY  the clock profile running (ClockCfg_EarlyInit())
+ *   DATA         .data and .ramfunc copied
+ *   BSS          .bss and .sram2 zeroed
+ *   MAIN         constructors run, main() entered
+ *   ...          after each init call in main()
+ *   KERNEL       osKernelStart() called
+ *   TELEMETRY    first telemetry frame queued (CAN_IF_SendTelemetryId())
+ *   CLI          console up, in CliTask (DeferredInit() in main.c)
+ *   DEFERRED     the rest of the non-critical init done
+ *
+ * TELEMETRY comes from CanTxTask and normally precedes the CliTask points;
+ * "boot times" shows no step for a point reached before the one above it.
+ */
+#define BOOT_PROF_POINT_TABLE(X)                            \
+    X(ENTRY,       "Reset_Handler")                         \
+    X(CLOCK_EARLY, "early clock")                           \
+    X(DATA,        ".data copied")                          \
+    X(BSS,         ".bss zeroed")                           \
+    X(MAIN,        "main()")                                \
+    X(HAL,         "HAL_Init")                              \
+    X(CLOCK,       "SystemClock_Config")                    \
+    X(MX_GPIO,     "MX_GPIO_Init")                          \
+    X(MX_DMA,      "MX_DMA_Init")                           \
+    X(MX_CAN,      "MX_CANx_Init")                          \
+    X(MX_UART,     "MX_USART2_UART_Init")                   \
+    X(LOG,         "Log_Init")                              \
+    X(CAN_IF,      "CAN_IF_Init")                           \
+    X(KERNEL,      "osKernelStart")                         \
+    X(TELEMETRY,   "first telemetry")                       \
+    X(CLI,         "CLI_IF_Init")                           \
+    X(DEFERRED,    "deferred init done")
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+#define BOOT_PROF_ENUM_(name, label)  BOOT_PROF_##name,
+
+typedef enum
+{
+    BOOT_PROF_POINT_TABLE(BOOT_PROF_ENUM_)
+    BOOT_PROF_COUNT
+} BootProf_Point_t;
+
+_Static_assert(BOOT_PROF_COUNT <= 32U, "one bit per point in a word");
+
+/**
+ * @brief Start the profile and mark ENTRY.
+ *
+ * Called from Startup_EarlyInit() (startup.h) only, before .data and .bss
+ * exist.
+ */
+void BootProf_Begin(void);
+
+/**
+ * @brief Record @p point (BootProf_Point_t) unless it was already recorded
+ *        this boot; afterwards a load and a bit test.
+ *
+ * Any task (TELEMETRY comes from CanTxTask while CliTask marks its
+ * points); the update runs under PRIMASK. Also called from Reset_Handler.
+ */
+void BootProf_Mark(uint32_t point);
+
+/**
+ * @brief Carry the elapsed time over a restart of the cycle counter; call
+ *        right before DWT->CYCCNT is set to 0.
+ */
+void BootProf_Rebase(void);
+
+/**
+ * @brief Microseconds from reset to @p point, or 0 if not reached yet.
+ */
+uint32_t BootProf_Us(BootProf_Point_t point);
+
+/**
+ * @brief Register "boot times".
+ */
+void BootProf_Init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOOT_PROF_H */
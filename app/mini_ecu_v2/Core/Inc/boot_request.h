@@ -0,0 +1,84 @@
+/**
+ * @file    boot_request.h
+ * @brief   Hand-over to the bootloader for a firmware update.
+ *
+ * The UDS server (uds.h) answers a DiagnosticSessionControl
+ * (programmingSession) request, 0x10 0x02, with 0x50 0x02 and calls
+ * BootRequest_EnterUpdate(): it leaves an update request in the bootloader
+ * hand-off block (boot_handoff.h) and resets; the bootloader serves the
+ * update over CAN and UART and returns to this image if no host starts a
+ * session.
+ *
+ * Sent on the functional ID 0x7DF the request moves every ECU on the bus
+ * into its bootloader, ready for a multicast update (tools/can_update.py).
+ * The CLI command "boot update" does the same locally.
+ *
+ * A freshly updated image is on trial (image_header.h). BOOT_REQUEST_CONFIRM_MS
+ * after BootRequest_Init() it confirms itself; "boot confirm" does so at once
+ * and "boot rollback" revokes the running image so the bootloader starts the
+ * other slot. "boot slots" shows both headers.
+ *
+ * An image staged into the other slot while this one runs (stage.h) is
+ * activated the same way as the bootloader's update does it, by its
+ * generation word, and started by BootRequest_Restart().
+ */
+
+#ifndef BOOT_REQUEST_H
+#define BOOT_REQUEST_H
+
+#include "main.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Time for the response, the log and the trip counters (trip.h) to drain
+ *  before the reset (ms). */
+#ifndef BOOT_REQUEST_RESET_DELAY_MS
+#define BOOT_REQUEST_RESET_DELAY_MS  50U
+#endif
+
+/** Uptime after which a trial image confirms itself (ms); 0 disables. */
+#ifndef BOOT_REQUEST_CONFIRM_MS
+#define BOOT_REQUEST_CONFIRM_MS      10000U
+#endif
+
+/**
+ * @brief Register the "boot" commands and start the confirmation timer.
+ *
+ * Call after CLI_IF_Init().
+ *
+ * @return HAL_OK, or HAL_ERROR if the timer could not be started.
+ */
+HAL_StatusTypeDef BootRequest_Init(void);
+
+/**
+ * @brief Set the update request and reset into the bootloader.
+ *
+ * Call from a task: it waits BOOT_REQUEST_RESET_DELAY_MS first. Does not
+ * return.
+ */
+void BootRequest_EnterUpdate(void);
+
+/**
+ * @brief Confirm the running image so the bootloader stops counting its
+ *        boots. A no-op for an image that is confirmed or not on trial.
+ *
+ * @return HAL_OK, or HAL_ERROR if the flash program failed.
+ */
+HAL_StatusTypeDef BootRequest_ConfirmImage(void);
+
+/**
+ * @brief Save the trip counters and reset; the bootloader then starts the
+ *        slot with the highest generation.
+ *
+ * Call from a task: it waits BOOT_REQUEST_RESET_DELAY_MS first. Does not
+ * return.
+ */
+void BootRequest_Restart(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOOT_REQUEST_H */
@@ -0,0 +1,245 @@
+/**
+ * @file    cal.h
+ * @brief   Calibration parameters: RAM shadow of key/value records in flash.
+ *
+ * Tuning constants of the vehicle model, the CAN telemetry and the log
+ * live in CAL_TABLE instead of the code. Each has a RAM shadow value in
+ * g_calValues[], initialised with the table default and overwritten at
+ * boot by the committed value from the flash log (nvm_log.h, one pass
+ * before any task runs). Users read it with CAL_F()/CAL_U(): a plain load,
+ * no lookup, no lock.
+ *
+ *   - "cal set <name> <value>" (Cal_Set()) changes the shadow at once, so
+ *     the model picks the value up on its next step. Parameters marked
+ *     "at boot" are read once at init and take effect after a reset.
+ *   - Sets stay in RAM until "cal commit" (Cal_Commit()): the changed
+ *     values are then written by NvmTask in the background, one 16-byte
+ *     record each. A reset before the commit restores the last committed
+ *     values.
+ *   - A value back at its table default needs no record: the next sector
+ *     copy drops it.
+ *
+ * Maps (CAL_MAP_TABLE) are tables of floats for Lut_*() (lut.h), read in
+ * place from the calibration image in flash (cal_image.h); a table the
+ * image lacks, or one out of range, uses the built-in default below.
+ * Nothing is copied at boot. The first cell a map changes, set or
+ * restored, takes an overlay for it from a pool of CAL_OVERLAY_CELLS: the
+ * live cells, which CAL_MAP() then points at, and the committed ones. The
+ * pool is sized for the maps tuned at a time, not for all of them; when
+ * it is out, the set is refused. "cal map page" switches a map between
+ * its flash table and its overlay by swapping the one pointer readers
+ * load once per lookup, so a lookup sees either page, never a mix. Each
+ * cell is one record, set and committed like a parameter ("cal map set",
+ * then "cal commit"); a record is kept only while the cell differs from
+ * the flash table.
+ *
+ *   cal                                  parameters
+ *   cal get <name>                       one parameter
+ *   cal set <name> <value>               set a parameter
+ *   cal map [<name>]                     maps, or one map as a grid
+ *   cal map set <name> <row> <col> <v>   set a map cell
+ *   cal map page <name> flash|ram        which page a map reads
+ *   cal image                            image, tables and overlay pool
+ *   cal commit                           write parameters and cells
+ */
+
+#ifndef CAL_H
+#define CAL_H
+
+#include "main.h"
+#include "can_if.h"
+#include "log.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Parameters. X(name, key, type, default, min, max, help): type F
+ *        (float) or U (unsigned integer); the key identifies the record
+ *        in flash and must never be reused for another meaning.
+ */
+#define CAL_TABLE(X)                                                                    \
+    X(VEH_DECAY,       0x0101U, F, 0.98f,  0.50f, 1.00f,   "speed kept per 0.1 s (coasting)")      \
+    X(VEH_RPM_PER_KPH, 0x0102U, F, 50.0f,  10.0f, 100.0f,  "rpm per km/h (no powertrain)")         \
+    X(VEH_RPM_LAG,     0x0103U, F, 0.30f,  0.01f, 1.00f,   "rpm convergence per 0.1 s (inertia)")  \
+    X(VEH_WARMUP_C,    0x0104U, F, 90.0f,  40.0f, 105.0f,  "coolant operating temperature (C)")    \
+    X(CAN_TELEM_CYCLE, 0x0201U, U, CAN_IF_TELEM_CYCLE_MS,   10U, 1000U, "telemetry cycle (ms, at boot)")   \
+    X(CAN_TELEM_GAP,   0x0202U, U, CAN_IF_TELEM_MIN_GAP_MS, 0U,  1000U, "telemetry minimum gap (ms, at boot)") \
+    X(LOG_LEVEL,       0x0301U, U, LOG_LEVEL_INFO, LOG_LEVEL_ERROR, LOG_LEVEL_DEBUG, "log level (0 error .. 3 debug, at boot)") \
+    X(TRIP_SAVE_MIN,   0x0401U, U, 5U,     1U,    60U,     "trip counter save interval (min)")      \
+    X(TRIP_HOT_C,      0x0402U, F, 100.0f, 60.0f, 130.0f,  "trip hot coolant threshold (C)")       \
+    X(PT_FINAL_DRIVE,  0x0501U, F, 3.90f,  2.00f, 6.00f,   "final drive ratio")                    \
+    X(PT_MASS_KG,      0x0502U, F, 1300.0f, 500.0f, 3000.0f, "vehicle mass (kg)")                  \
+    X(PT_SHIFT_HYST,   0x0503U, F, 8.0f,   0.0f,  40.0f,   "downshift below the upshift (km/h)")   \
+    X(FAN_SETPOINT_C,  0x0601U, F, 90.0f,  60.0f, 105.0f,  "fan coolant set point (C)")            \
+    X(FAN_KP,          0x0602U, F, 0.20f,  0.0f,  2.0f,    "fan proportional gain (duty per C)")   \
+    X(FAN_KI,          0x0603U, F, 0.10f,  0.0f,  2.0f,    "fan integral gain (duty per C s)")   \
+    X(ALARM_COOLANT_C, 0x0701U, F, 110.0f, 60.0f, 130.0f,  "coolant alarm threshold (C)")          \
+    X(ALARM_RPM,       0x0702U, F, 5800.0f, 1000.0f, 8000.0f, "engine speed alarm threshold (rpm)") \
+    X(ALARM_SPEED_KPH, 0x0703U, F, 200.0f, 20.0f, 300.0f,  "vehicle speed alarm threshold (km/h)") \
+    X(CRUISE_KP,       0x0801U, F, 0.10f,  0.0f,  1.0f,    "cruise proportional gain (throttle per km/h)") \
+    X(CRUISE_KI,       0x0802U, F, 0.05f,  0.0f,  1.0f,    "cruise integral gain (throttle per km/h s)")
+
+/**
+ * @brief Maps. X(name, key, rows, cols, min, max, help): rows x cols
+ *        floats, row by row, default CAL_MAP_<name>_DEFAULT. Cell (r, c)
+ *        has record key key + r * cols + c; the keys of two maps or a map
+ *        and a parameter must never overlap.
+ */
+#define CAL_MAP_TABLE(X)                                                                \
+    X(PT_GEAR_RATIO, 0x1000U, 1U, 6U, 0.30f,  6.00f,   "gear ratio, 1st .. 6th")                  \
+    X(PT_SHIFT_UP,   0x1100U, 5U, 5U, 5.0f,   200.0f,  "upshift (km/h), gear 1..5 x throttle")    \
+    X(PT_TORQUE,     0x1200U, 5U, 8U, -50.0f, 500.0f,  "engine torque (Nm), throttle x rpm")
+
+/** Overlay pool, in cells: a map of n cells takes 2 n while tuned. */
+#ifndef CAL_OVERLAY_CELLS
+#define CAL_OVERLAY_CELLS   96U
+#endif
+
+/* Map defaults (powertrain.h has the axes); the linked calibration image
+ * carries them too (cal_image.c). */
+#define CAL_MAP_PT_GEAR_RATIO_DEFAULT                                       \
+    3.60f, 2.19f, 1.41f, 1.12f, 0.87f, 0.69f
+
+/* Throttle 0, 25, 50, 75, 100 %. */
+#define CAL_MAP_PT_SHIFT_UP_DEFAULT                                         \
+    15.0f, 18.0f, 25.0f,  35.0f,  45.0f,    /* 1 -> 2 */                    \
+    25.0f, 30.0f, 42.0f,  55.0f,  70.0f,    /* 2 -> 3 */                    \
+    35.0f, 45.0f, 60.0f,  80.0f,  100.0f,   /* 3 -> 4 */                    \
+    45.0f, 60.0f, 80.0f,  105.0f, 130.0f,   /* 4 -> 5 */                    \
+    55.0f, 75.0f, 100.0f, 130.0f, 160.0f    /* 5 -> 6 */
+
+/* Rows throttle 0 .. 100 %, columns 800, 1500, 2000, 2500, 3000, 4000,
+ * 5000, 6000 rpm. */
+#define CAL_MAP_PT_TORQUE_DEFAULT                                           \
+    0.0f,   0.0f,   0.0f,   0.0f,   0.0f,   0.0f,   0.0f,   0.0f,           \
+    40.0f,  55.0f,  60.0f,  60.0f,  55.0f,  45.0f,  35.0f,  20.0f,          \
+    70.0f,  100.0f, 115.0f, 120.0f, 118.0f, 105.0f, 90.0f,  60.0f,          \
+    90.0f,  135.0f, 160.0f, 170.0f, 172.0f, 160.0f, 140.0f, 100.0f,         \
+    100.0f, 160.0f, 190.0f, 205.0f, 210.0f, 200.0f, 180.0f, 140.0f
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+#define CAL_ENUM_(name, key, type, def, min, max, help)   CAL_##name,
+typedef enum
+{
+    CAL_TABLE(CAL_ENUM_)
+    CAL_COUNT
+} Cal_Id_t;
+
+/**
+ * @brief One parameter value; the member is given by the table type.
+ */
+typedef union
+{
+    float    f;
+    uint32_t u;
+} Cal_Value_t;
+
+/** Shadow values, indexed by Cal_Id_t. Written only by the cal module. */
+extern Cal_Value_t g_calValues[CAL_COUNT];
+
+/** Current value of a parameter, by table name. */
+#define CAL_F(name)   (g_calValues[CAL_##name].f)
+#define CAL_U(name)   (g_calValues[CAL_##name].u)
+
+#define CAL_MAP_ENUM_(name, key, rows, cols, min, max, help)   CAL_MAP_##name,
+typedef enum
+{
+    CAL_MAP_TABLE(CAL_MAP_ENUM_)
+    CAL_MAP_COUNT
+} Cal_MapId_t;
+
+/* First and last cell of each map in one array of all cells. */
+#define CAL_MAP_CELLS_(name, key, rows, cols, min, max, help) \
+    CAL_MAP_BASE_##name, CAL_MAP_LAST_##name = CAL_MAP_BASE_##name + ((rows) * (cols)) - 1U,
+enum
+{
+    CAL_MAP_TABLE(CAL_MAP_CELLS_)
+    CAL_MAP_CELLS
+};
+
+/** Current cells of each map (flash table or overlay), by Cal_MapId_t. */
+extern const float *g_calMaps[CAL_MAP_COUNT];
+
+/** Current cells of a map, by table name; load once per lookup. */
+#define CAL_MAP(name)       (g_calMaps[CAL_MAP_##name])
+#define CAL_MAP_SIZE(name)  ((uint32_t)CAL_MAP_LAST_##name - (uint32_t)CAL_MAP_BASE_##name + 1U)
+
+/**
+ * @brief Take the maps from the calibration image, join the flash log and
+ *        register the "cal" commands. Call once before NvmLog_Init(),
+ *        which restores the committed values.
+ */
+void Cal_Init(void);
+
+/**
+ * @brief Parameter called @p name (as in CAL_TABLE).
+ *
+ * @return Its Cal_Id_t, or -1 if there is none.
+ */
+int32_t Cal_Find(const char *name);
+
+/**
+ * @brief Parameter with record key @p key (as in CAL_TABLE).
+ *
+ * @return Its Cal_Id_t, or -1 if there is none.
+ */
+int32_t Cal_FindKey(uint16_t key);
+
+/**
+ * @brief Set the shadow value (any task); kept over a reset only after
+ *        Cal_Commit().
+ *
+ * @return HAL_OK, or HAL_ERROR for an unknown id or a value out of range.
+ */
+HAL_StatusTypeDef Cal_Set(Cal_Id_t id, Cal_Value_t value);
+
+/**
+ * @brief Map called @p name (as in CAL_MAP_TABLE).
+ *
+ * @return Its Cal_MapId_t, or -1 if there is none.
+ */
+int32_t Cal_MapFind(const char *name);
+
+/**
+ * @brief Set cell (@p row, @p col) of a map (any task) in its overlay,
+ *        taking one first, and switch the map to the RAM page; kept over
+ *        a reset only after Cal_Commit().
+ *
+ * @return HAL_OK, HAL_ERROR for an unknown map or cell or a value out of
+ *         range, or HAL_BUSY when the overlay pool is out.
+ */
+HAL_StatusTypeDef Cal_MapSet(Cal_MapId_t id, uint32_t row, uint32_t col, float value);
+
+/**
+ * @brief Let readers of a map see its flash table (@p ram 0) or its RAM
+ *        overlay (1, taken with the flash cells if it has none); one
+ *        pointer store (any task). Uncommitted cells stay in the overlay.
+ *
+ * @return HAL_OK, HAL_ERROR for an unknown map, or HAL_BUSY when the
+ *         overlay pool is out.
+ */
+HAL_StatusTypeDef Cal_MapPage(Cal_MapId_t id, uint8_t ram);
+
+/**
+ * @brief Queue every value changed since the last commit for writing
+ *        (any task); NvmTask writes them in the background.
+ *
+ * @return Number of values (parameters and map cells) queued.
+ */
+uint32_t Cal_Commit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAL_H */
@@ -0,0 +1,129 @@
+/**
+ * @file    cal_image.h
+ * @brief   Calibration image: the map tables in flash, read in place.
+ *
+ * The maps of CAL_MAP_TABLE (cal.h) are linked as one image in section
+ * ".cal_image", at a fixed offset in the slot (CAL_IMAGE_OFFSET, see
+ * STM32F446RETX_FLASH.ld), in an area of CAL_IMAGE_SIZE bytes:
+ *
+ *   header     magic, layout, entry count, dataset version, length, CRC
+ *   directory  per table: name, record key, rows, cols, offset of the cells
+ *   cells      float, row by row, each table 4-byte aligned
+ *
+ * cal.c checks the image once at boot and points CAL_MAP() straight at its
+ * cells; nothing is copied to RAM. A table is taken when its key, rows and
+ * columns match CAL_MAP_TABLE and every cell is within the map's range, so
+ * an image made for another table layout is used as far as it fits and
+ * cal.h's built-in defaults fill in the rest.
+ *
+ * The fixed offset lets tools/cal_image.py put another dataset into a
+ * built .bin (a calibration release without a rebuild); image_stamp.py
+ * then stamps the calibration CRC before the image CRC and signature,
+ * which cover the area as well. The CRC is the STM32 CRC unit's
+ * (image_header.h) over the image from its start to length, without the
+ * CRC word. Linked, the CRC is erased: an image loaded from the ELF (a
+ * debugger, the SIL build) is taken unchecked, and "cal image" says so.
+ *
+ * The layout number changes with the header or directory format, never
+ * with the tables; tools/cal_image.py has its own copy of the format.
+ */
+
+#ifndef CAL_IMAGE_H
+#define CAL_IMAGE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Offset of the image from the slot base, behind the image header. */
+#define CAL_IMAGE_OFFSET        0x240U
+
+/** Bytes reserved for the image (header, directory and cells). */
+#define CAL_IMAGE_SIZE          0x800U
+
+/** Dataset version of the linked image; tools/cal_image.py sets others. */
+#ifndef CAL_IMAGE_VERSION
+#define CAL_IMAGE_VERSION       1U
+#endif
+
+#define CAL_IMAGE_MAGIC         0x494C4143U   /* "CALI" */
+#define CAL_IMAGE_LAYOUT        1U
+
+/** Characters of a table name, NUL padded. */
+#define CAL_IMAGE_NAME_LEN      16U
+
+/* -------------------------------------------------------------------------- */
+/* Image format                                                               */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    uint32_t magic;       /**< CAL_IMAGE_MAGIC. */
+    uint16_t layout;      /**< CAL_IMAGE_LAYOUT. */
+    uint16_t count;       /**< Directory entries. */
+    uint32_t version;     /**< Dataset version. */
+    uint32_t length;      /**< Bytes from the header, multiple of 4. */
+    uint32_t crc32;       /**< STM32 CRC without this word; erased: not stamped. */
+} CalImage_Header_t;
+
+typedef struct
+{
+    char     name[CAL_IMAGE_NAME_LEN];   /**< As in CAL_MAP_TABLE. */
+    uint16_t key;         /**< First record key (CAL_MAP_TABLE). */
+    uint8_t  rows;
+    uint8_t  cols;
+    uint32_t offset;      /**< Of the first cell from the header. */
+} CalImage_Entry_t;
+
+typedef enum
+{
+    CAL_IMAGE_OK = 0,
+    CAL_IMAGE_UNSTAMPED,  /**< CRC erased: linked, not stamped; taken. */
+    CAL_IMAGE_NO_IMAGE,   /**< Magic missing. */
+    CAL_IMAGE_BAD_LAYOUT, /**< Another header or directory format. */
+    CAL_IMAGE_BAD_LENGTH, /**< Length or directory outside the area. */
+    CAL_IMAGE_BAD_CRC
+} CalImage_Status_t;
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/** The image of this slot (the linked one, or what was put there). */
+const CalImage_Header_t *CalImage_Get(void);
+
+/**
+ * @brief Check header, bounds and CRC of @p img (about 40 us per KB at
+ *        180 MHz, once at boot).
+ */
+CalImage_Status_t CalImage_Check(const CalImage_Header_t *img);
+
+/** @return 1 for a status whose tables may be used. */
+static inline uint8_t CalImage_Usable(CalImage_Status_t status)
+{
+    return ((status == CAL_IMAGE_OK) || (status == CAL_IMAGE_UNSTAMPED)) ? 1U : 0U;
+}
+
+/**
+ * @brief Cells of the table with record key @p key in a usable image.
+ *
+ * @return The cells in flash, or NULL if there is no such table of
+ *         @p rows x @p cols inside the image.
+ */
+const float *CalImage_Table(const CalImage_Header_t *img, uint16_t key, uint32_t rows,
+                            uint32_t cols);
+
+/** Short text for @p status ("ok", "not stamped", ...). */
+const char *CalImage_StatusName(CalImage_Status_t status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAL_IMAGE_H */
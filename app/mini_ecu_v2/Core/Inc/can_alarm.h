@@ -0,0 +1,147 @@
+/**
+ * @file    can_alarm.h
+ * @brief   Threshold alarms on the vehicle state, sent through CAN1's
+ *          urgent mailbox with their detection-to-bus latency measured.
+ *
+ * CanAlarm_Check() runs after every model step (VehicleTask, at
+ * CTRL_LOOP_HZ) and compares each signal of CAN_ALARM_TABLE with its
+ * calibrated threshold. A crossing, or the return below the threshold less
+ * the hysteresis, packs the Alarm frame (Core/mini_ecu.dbc, ID 0x020, in
+ * the high-priority range) and loads it at once into the mailbox
+ * CAN_IF_TX_URGENT keeps out of the queue refill (CAN_IF_TransmitUrgent()):
+ * no submission slot, no queue, no wait for the TX interrupt, and the
+ * cyclic frames in mailboxes 0 and 1 cannot hold it back.
+ *
+ * The mailbox holds one frame. A crossing while it is still taken leaves
+ * its frame pending, one per alarm (a newer edge of the same alarm
+ * replaces it); the mailbox-complete interrupt loads the next pending one,
+ * lowest table entry first, and so does the next check.
+ *
+ * Every edge is stamped on the DWT cycle counter when it is detected.
+ * "alarm" shows, over all frames sent,
+ *
+ *   - detect -> mailbox: detection to the frame being in arbitration,
+ *     which includes the wait of a pending frame,
+ *   - detect -> bus: detection to the TX-complete interrupt of the
+ *     mailbox, i.e. the frame sent and acknowledged,
+ *
+ * each as count, mean and max in microseconds. The SIL shim raises no
+ * TX-complete interrupt: there a frame found sent by the next load counts
+ * as unconfirmed and only the first figure is measured.
+ *
+ *   alarm                   thresholds, states and latencies
+ *   alarm reset             clear the counters
+ *
+ * Thresholds are the ALARM_* calibration parameters (cal.h), read on each
+ * check, so "cal set" moves them at once.
+ */
+
+#ifndef CAN_ALARM_H
+#define CAN_ALARM_H
+
+#include "main.h"
+#include "can_if.h"
+#include "vehicle.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = threshold alarms; needs the urgent mailbox. */
+#ifndef CAN_ALARM_ENABLE
+#define CAN_ALARM_ENABLE    CAN_IF_TX_URGENT
+#endif
+
+#if CAN_ALARM_ENABLE && !CAN_IF_TX_URGENT
+#error "CAN_ALARM_ENABLE needs CAN_IF_TX_URGENT"
+#endif
+
+/** Direction of a CAN_ALARM_TABLE entry. */
+#define CAN_ALARM_ABOVE     1
+#define CAN_ALARM_BELOW     0
+
+/**
+ * Alarms. X(name, field, dir, cal, hyst, text): VehicleState_t @p field
+ * against calibration parameter @p cal, raised when it goes past in
+ * direction @p dir and cleared once it is @p hyst back. At most 32.
+ */
+#ifndef CAN_ALARM_TABLE
+#define CAN_ALARM_TABLE(X)                                                                  \
+    X(COOLANT_HOT, coolant_temp_c, CAN_ALARM_ABOVE, ALARM_COOLANT_C, 3.0f,   "coolant temperature (C)") \
+    X(RPM_HIGH,    engine_rpm,     CAN_ALARM_ABOVE, ALARM_RPM,       250.0f, "engine speed (rpm)")      \
+    X(SPEED_HIGH,  speed_kph,      CAN_ALARM_ABOVE, ALARM_SPEED_KPH, 5.0f,   "vehicle speed (km/h)")
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+#define CAN_ALARM_ENUM_(name, field, dir, cal, hyst, text)  CAN_ALARM_##name,
+typedef enum
+{
+    CAN_ALARM_TABLE(CAN_ALARM_ENUM_)
+    CAN_ALARM_COUNT
+} CanAlarm_Id_t;
+
+/**
+ * @brief One latency figure, microseconds.
+ */
+typedef struct
+{
+    uint32_t count;
+    uint32_t maxUs;
+    uint64_t sumUs;
+} CanAlarm_Lat_t;
+
+/**
+ * @brief Counters over all alarms.
+ */
+typedef struct
+{
+    uint32_t       edges;        /**< Crossings detected (raised and cleared). */
+    uint32_t       waited;       /**< Edges that found the mailbox taken. */
+    uint32_t       replaced;     /**< Pending frames overtaken by a newer edge. */
+    uint32_t       lost;         /**< Frames aborted or refused by CAN1. */
+    uint32_t       unconfirmed;  /**< Sent without a TX-complete interrupt. */
+    CanAlarm_Lat_t load;         /**< Detect -> mailbox. */
+    CanAlarm_Lat_t bus;          /**< Detect -> TX complete. */
+} CanAlarm_Stats_t;
+
+/**
+ * @brief Build the frame template and register "alarm". Call after
+ *        CAN_IF_Init().
+ */
+void CanAlarm_Init(void);
+
+/**
+ * @brief Compare @p vs with the thresholds and send the edges (VehicleTask,
+ *        after each model step).
+ */
+void CanAlarm_Check(const VehicleState_t *vs);
+
+/**
+ * @brief The urgent mailbox completed (@p ok) or was aborted; from the CAN1
+ *        TX interrupt.
+ */
+void CanAlarm_OnTxDone(uint8_t ok);
+
+/**
+ * @brief Non-zero while alarm @p id is raised.
+ */
+uint8_t CanAlarm_IsActive(CanAlarm_Id_t id);
+
+/**
+ * @brief Consistent copy of the counters.
+ */
+void CanAlarm_GetStats(CanAlarm_Stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_ALARM_H */
@@ -0,0 +1,90 @@
+/**
+ * @file    can_bench.h
+ * @brief   CAN loopback self-benchmark: throughput, losses, ISR cost,
+ *          latency and CPU load of the CAN stack ("bench can").
+ *
+ * In a loopback mode every frame CAN1 sends comes back through the whole
+ * RX path, so the board can measure its own stack. "bench can" runs a
+ * series of steps from CliTask, each CAN_BENCH_STEP_MS long: paced steps
+ * at 10, 25, 50, 75, 90 and 100 % of the nominal frame rate of the
+ * bitrate (8-byte standard frames without stuff bits), then a flood step
+ * that keeps the TX queue full. Frames go through CAN_IF_Transmit() like
+ * any other traffic, on CAN_BENCH_ID:
+ *
+ *   byte 0     step tag (frames of an earlier step are ignored)
+ *   bytes 1-3  sequence number (24 bits, little-endian)
+ *   bytes 4-7  DWT cycle count just before CAN_IF_Transmit()
+ *
+ * The handler in CanRxTask checks the sequence (gaps are lost frames,
+ * repeats out of order) and records the latency from TX request to the
+ * handler in a CAN_BENCH_BIN_US histogram, from which the percentiles are
+ * taken. Per step the table shows the target rate, frames sent and
+ * refused by the full TX queue, frames received per second, lost frames,
+ * RX ring overflows, cycles of the RX interrupt per received frame
+ * (PERF_CAN_RX_ISR, "-" without PERF_ENABLE), latency p50 / p90 / p99 /
+ * max and the CPU load (cycles outside the idle task over the wall time,
+ * so tickless sleep does not skew it).
+ *
+ * A paced step is sustained when every frame was accepted and came back
+ * in order; the highest such receive rate is printed as the sustained
+ * rate, the flood step's as the saturation rate.
+ *
+ * The bench refuses to run outside CAN_MODE_LOOPBACK /
+ * CAN_MODE_SILENT_LOOPBACK. In plain loopback the frames also appear on
+ * the TX pin: use silent-loopback ("can mode silent-loopback") on a board
+ * wired to a bus. The other CAN traffic keeps running and is part of the
+ * figures, which is what a regression number for can_if.c should include.
+ */
+
+#ifndef CAN_BENCH_H
+#define CAN_BENCH_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Standard ID of the bench frames; needs its exact CAN_FILTER_TABLE entry. */
+#ifndef CAN_BENCH_ID
+#define CAN_BENCH_ID        0x7F0U
+#endif
+
+/** Default length of one step (ms), "bench can <ms>" overrides it. */
+#ifndef CAN_BENCH_STEP_MS
+#define CAN_BENCH_STEP_MS   1000U
+#endif
+
+/** Latency histogram: CAN_BENCH_BINS bins of CAN_BENCH_BIN_US each, the
+ *  last one everything above. */
+#ifndef CAN_BENCH_BIN_US
+#define CAN_BENCH_BIN_US    16U
+#endif
+
+#ifndef CAN_BENCH_BINS
+#define CAN_BENCH_BINS      256U
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Register the handler for CAN_BENCH_ID and "bench can".
+ *
+ * Call after CAN_IF_Init().
+ *
+ * @return HAL_OK, or HAL_ERROR if the handler table is full.
+ */
+HAL_StatusTypeDef CanBench_Init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_BENCH_H */
@@ -0,0 +1,134 @@
+/**
+ * @file    can_busoff.h
+ * @brief   Bus-off recovery with fast and slow retries.
+ *
+ * CAN1 runs with AutoBusOff disabled, so after bus-off the controller stays
+ * silent until software leaves and re-enters initialization mode. This
+ * module does that from CanTxTask:
+ *
+ *   1. The bus-off interrupt (HAL_CAN_ErrorCallback()) only sets
+ *      CAN_BUSOFF_FLAG on CanTxTask.
+ *   2. CanBusOff_Run() waits CAN_BUSOFF_FAST_MS for the first
+ *      CAN_BUSOFF_FAST_RETRIES attempts, then CAN_BUSOFF_SLOW_MS, and
+ *      restarts CAN1 with CAN_IF_Restart() (HAL_CAN_Stop()/HAL_CAN_Start(),
+ *      bounded by the HAL's 10 ms init-mode timeouts).
+ *   3. bxCAN then needs 128 x 11 recessive bits to leave bus-off. The next
+ *      run checks CAN->ESR after that time; still bus-off counts as a failed
+ *      attempt and the back-off continues.
+ *
+ * CAN_BUSOFF_FLUSH_TXQ chooses what happens to frames waiting for the bus:
+ * 1 drops the software queue and aborts the mailboxes before the restart
+ * (their data is old by then), 0 keeps them to go out after recovery.
+ * Scheduled frames (can_sched.h) are not run while bus-off.
+ *
+ * A bus-off within CAN_BUSOFF_STABLE_MS of a recovery continues the retry
+ * count instead of starting with fast retries again, so a broken bus is
+ * not hammered. Downtime (bus-off interrupt to recovery confirmed) is kept
+ * per episode; "can busoff" shows it.
+ *
+ * Only CanTxTask waits; no other task is blocked and nothing is logged in
+ * interrupt context. The worst-case recovery latency is the back-off delay
+ * plus the restart plus the verify time.
+ */
+
+#ifndef CAN_BUSOFF_H
+#define CAN_BUSOFF_H
+
+#include "main.h"
+#include "cmsis_os2.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Attempts made after the short delay before falling back to the long one. */
+#ifndef CAN_BUSOFF_FAST_RETRIES
+#define CAN_BUSOFF_FAST_RETRIES  5U
+#endif
+
+/** Delay before a fast retry (ms). */
+#ifndef CAN_BUSOFF_FAST_MS
+#define CAN_BUSOFF_FAST_MS       10U
+#endif
+
+/** Delay before a slow retry (ms). */
+#ifndef CAN_BUSOFF_SLOW_MS
+#define CAN_BUSOFF_SLOW_MS       1000U
+#endif
+
+/** A bus-off this soon after a recovery continues its retry count (ms). */
+#ifndef CAN_BUSOFF_STABLE_MS
+#define CAN_BUSOFF_STABLE_MS     1000U
+#endif
+
+/** 1 = drop queued TX frames on recovery, 0 = send them afterwards. */
+#ifndef CAN_BUSOFF_FLUSH_TXQ
+#define CAN_BUSOFF_FLUSH_TXQ     1U
+#endif
+
+/** Thread flag set on CanTxTask by the bus-off interrupt. */
+#define CAN_BUSOFF_FLAG          0x0002U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Recovery counters.
+ */
+typedef struct
+{
+    uint32_t events;            /**< Bus-off episodes. */
+    uint32_t recoveries;        /**< Episodes ended by a confirmed recovery. */
+    uint32_t attempts;          /**< Restarts of CAN1. */
+    uint32_t failed;            /**< Restarts still bus-off afterwards (or refused). */
+    uint32_t flushed;           /**< TX frames dropped by CAN_BUSOFF_FLUSH_TXQ. */
+    uint32_t lastDowntimeMs;    /**< Downtime of the last recovered episode. */
+    uint32_t maxDowntimeMs;     /**< Longest recovered episode. */
+    uint32_t totalDowntimeMs;   /**< Sum over recovered episodes. */
+    uint32_t downNowMs;         /**< Time in the current episode; 0 if on the bus. */
+} CanBusOff_Stats_t;
+
+/**
+ * @brief Reset the state machine and register "can busoff". Called by
+ *        CAN_IF_Init().
+ */
+void CanBusOff_Init(void);
+
+/**
+ * @brief Register the task that runs CanBusOff_Run() (CanTxTask).
+ */
+void CanBusOff_SetConsumer(osThreadId_t thread);
+
+/**
+ * @brief Bus-off interrupt: start an episode (ISR-safe, no logging).
+ */
+void CanBusOff_OnBusOff(void);
+
+/**
+ * @brief Advance the recovery at @p nowMs (kernel tick; CanTxTask only).
+ *
+ * @return Milliseconds until the next step (osWaitForever if on the bus).
+ */
+uint32_t CanBusOff_Run(uint32_t nowMs);
+
+/**
+ * @brief Non-zero while a bus-off episode is being recovered.
+ */
+uint8_t CanBusOff_IsActive(void);
+
+/**
+ * @brief Copy the recovery counters.
+ */
+void CanBusOff_GetStats(CanBusOff_Stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_BUSOFF_H */
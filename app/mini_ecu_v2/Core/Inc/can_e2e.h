@@ -0,0 +1,157 @@
+/**
+ * @file    can_e2e.h
+ * @brief   End-to-end protection of CAN frames: alive counter and CRC8.
+ *
+ * Each frame of CAN_E2E_TABLE carries, in the style of AUTOSAR E2E profile
+ * 01, a 4-bit alive counter in the low nibble of byte dlc - 2 and a CRC8 in
+ * byte dlc - 1 (both are DBC signals, Core/mini_ecu.dbc):
+ *
+ *   - CRC8 SAE J1850 (polynomial 0x1D, start and final XOR 0xFF) over the
+ *     16-bit data ID, low byte first, then bytes 0 .. dlc - 2; one lookup
+ *     per byte in a 256-entry table in flash. The data ID is not sent, so
+ *     a frame under the wrong identifier fails the check too.
+ *   - The counter runs 0..14 and wraps; 15 is never sent.
+ *
+ * CAN_IF_TransmitBus() protects a frame of the table on its way into the
+ * TX queue, inside the critical section that queues it, so every sender
+ * (the TX scheduler for the telemetry frame) gets it without doing
+ * anything and the counter only moves for frames that were queued.
+ * CAN_IF_Forward() passes frames through as they are, so a gateway leaves
+ * the protection of the sender intact.
+ *
+ * CAN_IF_ProcessRxMsg() checks a received frame of the table before its
+ * handler sees it:
+ *
+ *   | Result    | Meaning                                   | Handler |
+ *   |-----------|-------------------------------------------|---------|
+ *   | ok        | counter + 1                               | yes     |
+ *   | lost      | counter + 2 .. CAN_E2E_MAX_DELTA          | yes     |
+ *   | wrong seq | counter jumped further; resynchronised    | yes     |
+ *   | repeated  | same counter as the last frame            | no      |
+ *   | error     | CRC mismatch, short frame or counter 15   | no      |
+ *
+ * The first good frame after boot or "can e2e reset" synchronises. The
+ * frames missed are counted from the counter jumps.
+ *
+ * Both directions cost one table lookup per byte (8 for the telemetry
+ * frame) and a few compares; "bench micro" times them.
+ *
+ *   can e2e              per ID: frames sent, received, missed, repeated,
+ *                        out of sequence and failed
+ *   can e2e reset        clear the RX figures and resynchronise
+ */
+
+#ifndef CAN_E2E_H
+#define CAN_E2E_H
+
+#include "main.h"
+#include "can_signals.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Protected frames. X(name, id, dlc, data ID): id in the CAN_IF
+ *        format (CAN_IF_ID_EXT for 29-bit), dlc of the frame with the
+ *        counter and CRC bytes.
+ */
+#ifndef CAN_E2E_TABLE
+#define CAN_E2E_TABLE(X)                                                        \
+    X(TELEMETRY, CANSIG_VEHICLE_TELEMETRY_ID, CANSIG_VEHICLE_TELEMETRY_DLC, 0x0100U)
+#endif
+
+/** Largest counter step still taken as frames lost, not out of sequence. */
+#ifndef CAN_E2E_MAX_DELTA
+#define CAN_E2E_MAX_DELTA   3U
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+#define CAN_E2E_ENUM_(name, id, dlc, dataId)   CAN_E2E_##name,
+typedef enum
+{
+    CAN_E2E_TABLE(CAN_E2E_ENUM_)
+    CAN_E2E_COUNT
+} CanE2E_Id_t;
+
+/** CanE2E_Find() of an identifier without protection. */
+#define CAN_E2E_NONE        0xFFU
+
+/** Counter values: 0..CAN_E2E_COUNTER_MAX. */
+#define CAN_E2E_COUNTER_MAX 14U
+
+/** Result of CanE2E_Check(). */
+typedef enum
+{
+    CAN_E2E_OK = 0,
+    CAN_E2E_LOST,           /**< Accepted; frames missed before it. */
+    CAN_E2E_WRONG_SEQ,      /**< Accepted; the counter is resynchronised. */
+    CAN_E2E_REPEATED,       /**< Dropped. */
+    CAN_E2E_ERROR           /**< Dropped. */
+} CanE2E_Result_t;
+
+/**
+ * @brief Figures of one protected identifier.
+ */
+typedef struct
+{
+    uint32_t sent;          /**< Frames protected and queued. */
+    uint32_t received;      /**< Frames passed on: ok, lost, wrong seq. */
+    uint32_t lost;          /**< Frames missed, from the counter steps. */
+    uint32_t repeated;
+    uint32_t wrongSeq;
+    uint32_t errors;        /**< CRC, length or counter value. */
+} CanE2E_Stats_t;
+
+/**
+ * @brief Reset the counters and figures and register "can e2e". Called by
+ *        CAN_IF_Init().
+ */
+void CanE2E_Init(void);
+
+/**
+ * @brief Entry of @p key (CAN_IF_MSG_KEY() format), CAN_E2E_NONE if it
+ *        is not protected.
+ */
+uint8_t CanE2E_Find(uint32_t key);
+
+/**
+ * @brief Write the next counter and the CRC into @p data of entry @p e.
+ *        Does not advance the counter; call CanE2E_Sent() once the frame
+ *        is queued. Caller holds PRIMASK.
+ *
+ * @return Non-zero if protected; 0 if @p dlc is shorter than the entry's,
+ *         the frame is then sent as it is (and fails the check).
+ */
+uint8_t CanE2E_Protect(uint8_t e, uint8_t *data, uint8_t dlc);
+
+/** The frame protected last for @p e was queued: advance its counter. */
+void CanE2E_Sent(uint8_t e);
+
+/**
+ * @brief Check a received frame of entry @p e (@p data: 8 bytes, @p dlc
+ *        received) and update the figures (CanRxTask, or the RX interrupt
+ *        for an ISR-decoded ID; RAMFUNC).
+ */
+CanE2E_Result_t CanE2E_Check(uint8_t e, const uint8_t *data, uint8_t dlc);
+
+/**
+ * @brief Copy the figures of entry @p e.
+ *
+ * @return HAL_OK, or HAL_ERROR past the last entry.
+ */
+HAL_StatusTypeDef CanE2E_GetStats(uint8_t e, CanE2E_Stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_E2E_H */
@@ -0,0 +1,281 @@
+/**
+ * @file    can_filters.h
+ * @brief   Declarative CAN acceptance filter table for the Mini ECU.
+ *
+ * The IDs this ECU cares about are listed once in CAN_FILTER_TABLE().
+ * CanFilters_Apply() packs the table into bxCAN filter banks using the
+ * densest mode for each entry:
+ *
+ *   | Entry kind                   | Bank mode       | Entries per bank |
+ *   |------------------------------|-----------------|------------------|
+ *   | Standard ID, exact match     | 16-bit list     | 4                |
+ *   | Standard ID, masked range    | 16-bit mask     | 2                |
+ *   | Extended ID, exact match     | 32-bit list     | 2                |
+ *   | Extended ID, masked range    | 32-bit mask     | 1                |
+ *
+ * Banks are homogeneous per FIFO, so each (kind, FIFO) pair is packed
+ * separately. The number of banks needed is computed by the preprocessor
+ * and checked with a static assertion, so a table that does not fit into
+ * the hardware fails the build instead of silently dropping IDs.
+ *
+ * Frames that do not match any entry are discarded in silicon and never
+ * raise an RX interrupt.
+ */
+
+#ifndef CAN_FILTERS_H
+#define CAN_FILTERS_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief First filter bank owned by CAN2 (CAN1 owns banks below it).
+ *
+ * The 28 banks are shared: CAN1 takes 0..13 for CAN_FILTER_TABLE, CAN2
+ * 14..27 for the gateway routes it receives (CanFilters_ApplySlave()).
+ */
+#ifndef CAN_FILTERS_SLAVE_START_BANK
+#define CAN_FILTERS_SLAVE_START_BANK  14U
+#endif
+
+/** Filter banks of both controllers together. */
+#define CAN_FILTERS_TOTAL_BANKS       28U
+
+_Static_assert(CAN_FILTERS_SLAVE_START_BANK <= CAN_FILTERS_TOTAL_BANKS,
+               "CAN_FILTERS_SLAVE_START_BANK out of range");
+
+/** Number of filter banks available to CAN1. */
+#define CAN_FILTERS_MAX_BANKS         CAN_FILTERS_SLAVE_START_BANK
+
+/**
+ * @brief Append a catch-all bank on FIFO0 (accept every frame).
+ *
+ * Meant for bring-up and bus sniffing only; it defeats the purpose of the
+ * table on a busy bus.
+ */
+#ifndef CAN_FILTERS_ACCEPT_ALL
+#define CAN_FILTERS_ACCEPT_ALL        0
+#endif
+
+/**
+ * @brief Node number on the bus (0..7).
+ *
+ * Selects the physical diagnostic IDs: requests on 0x7E0 + node, responses
+ * on 0x7E8 + node. Must match the bootloader's BOOT_CAN_NODE.
+ */
+#ifndef CAN_NODE_ID
+#define CAN_NODE_ID                   0U
+#endif
+
+/** Mask value meaning "all 11 bits must match" for standard IDs. */
+#define CAN_FILTER_STD_EXACT          0x7FFU
+
+/** Mask value meaning "all 29 bits must match" for extended IDs. */
+#define CAN_FILTER_EXT_EXACT          0x1FFFFFFFU
+
+/**
+ * @brief The acceptance table.
+ *
+ * Each line is one of:
+ *   STD(arg, id, mask, fifo)  - 11-bit identifier
+ *   EXT(arg, id, mask, fifo)  - 29-bit identifier
+ *
+ * A bit set in @c mask must match in the received ID; use
+ * CAN_FILTER_STD_EXACT / CAN_FILTER_EXT_EXACT for single IDs.
+ * @c fifo is CAN_FILTER_FIFO0 (bulk) or CAN_FILTER_FIFO1 (high priority).
+ * @c arg is reserved for the expansion helpers; pass it through unchanged.
+ */
+#define CAN_FILTER_TABLE(STD, EXT, arg)                                        \
+    /* High-priority range 0x000..0x0FF (diagnostics, commands) */             \
+    STD(arg, 0x000U, 0x700U,               CAN_FILTER_FIFO1)                   \
+    /* Vehicle telemetry */                                                    \
+    STD(arg, 0x100U, CAN_FILTER_STD_EXACT, CAN_FILTER_FIFO0)                   \
+    /* Odometer, authenticated (can_secoc.h) */                                \
+    STD(arg, 0x110U, CAN_FILTER_STD_EXACT, CAN_FILTER_FIFO0)                   \
+    /* Network management 0x500..0x53F (can_nm.h) */                          \
+    STD(arg, 0x500U, 0x7C0U,               CAN_FILTER_FIFO0)                   \
+    /* Diagnostic requests: functional, physical (uds.h) */                    \
+    STD(arg, 0x7DFU, CAN_FILTER_STD_EXACT, CAN_FILTER_FIFO1)                   \
+    STD(arg, 0x7E0U + CAN_NODE_ID, CAN_FILTER_STD_EXACT, CAN_FILTER_FIFO1)   \
+    /* XCP commands (xcp.h) */                                                 \
+    STD(arg, 0x600U + CAN_NODE_ID, CAN_FILTER_STD_EXACT, CAN_FILTER_FIFO0)     \
+    /* Loopback self-benchmark (can_bench.h) */                               \
+    STD(arg, 0x7F0U, CAN_FILTER_STD_EXACT, CAN_FILTER_FIFO0)                   \
+    /* J1939 PDU1 to global and to addresses 0x80..0x87 (j1939.h) */           \
+    EXT(arg, 0x0000FF00U, 0x0000FF00U, CAN_FILTER_FIFO0)                       \
+    EXT(arg, 0x00008000U, 0x0000F800U, CAN_FILTER_FIFO0)
+
+/* -------------------------------------------------------------------------- */
+/* Compile-time bank budget                                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Entry class used for packing: (fifo * 2) + exact.
+ *
+ * Classes 0/2 are masked entries on FIFO0/FIFO1, 1/3 are exact entries.
+ */
+#define CAN_FILTER_CLASS_STD(id, mask, fifo) \
+    (((uint32_t)(fifo) * 2U) + ((((mask) & 0x7FFU) == 0x7FFU) ? 1U : 0U))
+#define CAN_FILTER_CLASS_EXT(id, mask, fifo) \
+    (((uint32_t)(fifo) * 2U) + ((((mask) & 0x1FFFFFFFU) == 0x1FFFFFFFU) ? 1U : 0U))
+
+#define CAN_FILTER_COUNT_STD(sel, id, mask, fifo) \
+    + ((CAN_FILTER_CLASS_STD(id, mask, fifo) == (sel)) ? 1U : 0U)
+#define CAN_FILTER_COUNT_EXT(sel, id, mask, fifo) \
+    + ((CAN_FILTER_CLASS_EXT(id, mask, fifo) == (sel)) ? 1U : 0U)
+#define CAN_FILTER_COUNT_NONE(sel, id, mask, fifo)
+
+/** Number of standard / extended entries in a given class. */
+#define CAN_FILTER_N_STD(sel) \
+    (0U CAN_FILTER_TABLE(CAN_FILTER_COUNT_STD, CAN_FILTER_COUNT_NONE, sel))
+#define CAN_FILTER_N_EXT(sel) \
+    (0U CAN_FILTER_TABLE(CAN_FILTER_COUNT_NONE, CAN_FILTER_COUNT_EXT, sel))
+
+#define CAN_FILTER_DIV_UP(n, d)  (((n) + (d) - 1U) / (d))
+
+/** Total number of entries in the table. */
+#define CAN_FILTER_N_ENTRIES \
+    (CAN_FILTER_N_STD(0U) + CAN_FILTER_N_STD(1U) + \
+     CAN_FILTER_N_STD(2U) + CAN_FILTER_N_STD(3U) + \
+     CAN_FILTER_N_EXT(0U) + CAN_FILTER_N_EXT(1U) + \
+     CAN_FILTER_N_EXT(2U) + CAN_FILTER_N_EXT(3U))
+
+/** Filter banks consumed by the table (including the optional catch-all). */
+#define CAN_FILTER_BANKS_USED                                         \
+    (CAN_FILTER_DIV_UP(CAN_FILTER_N_STD(1U), 4U) +   /* 16-bit list */ \
+     CAN_FILTER_DIV_UP(CAN_FILTER_N_STD(3U), 4U) +                     \
+     CAN_FILTER_DIV_UP(CAN_FILTER_N_STD(0U), 2U) +   /* 16-bit mask */ \
+     CAN_FILTER_DIV_UP(CAN_FILTER_N_STD(2U), 2U) +                     \
+     CAN_FILTER_DIV_UP(CAN_FILTER_N_EXT(1U), 2U) +   /* 32-bit list */ \
+     CAN_FILTER_DIV_UP(CAN_FILTER_N_EXT(3U), 2U) +                     \
+     CAN_FILTER_N_EXT(0U) + CAN_FILTER_N_EXT(2U) +   /* 32-bit mask */ \
+     ((CAN_FILTERS_ACCEPT_ALL != 0) ? 1U : 0U))
+
+_Static_assert(CAN_FILTER_BANKS_USED <= CAN_FILTERS_MAX_BANKS,
+               "CAN_FILTER_TABLE does not fit into the CAN1 filter banks");
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief One entry of the acceptance table, as seen at runtime.
+ */
+typedef struct
+{
+    uint32_t id;     /**< 11- or 29-bit identifier. */
+    uint32_t mask;   /**< Bits of @c id that must match. */
+    uint8_t  fifo;   /**< CAN_FILTER_FIFO0 or CAN_FILTER_FIFO1. */
+    uint8_t  ext;    /**< 1 for a 29-bit identifier. */
+} CanFilter_Entry_t;
+
+/**
+ * @brief Program the acceptance table into the CAN1 filter banks.
+ *
+ * Must be called while CAN1 is in READY state (before HAL_CAN_Start()).
+ * Banks not used by the table are deactivated.
+ *
+ * @param[in] hcan CAN1 handle.
+ * @return HAL_OK on success, or the first HAL error encountered.
+ */
+HAL_StatusTypeDef CanFilters_Apply(CAN_HandleTypeDef *hcan);
+
+/**
+ * @brief Program a single catch-all bank on FIFO0 in place of the table
+ *        (listen-only sniffing, can_if.h).
+ *
+ * No frame then maps back to a table entry (CanFilters_EntryFromMatch()
+ * returns -1); CanFilters_Apply() restores the table. Same state
+ * requirement as CanFilters_Apply().
+ *
+ * @param[in] hcan CAN1 handle.
+ * @return HAL_OK on success, or the first HAL error encountered.
+ */
+HAL_StatusTypeDef CanFilters_ApplyAcceptAll(CAN_HandleTypeDef *hcan);
+
+/**
+ * @brief Program CAN2's banks (from CAN_FILTERS_SLAVE_START_BANK) with one
+ *        32-bit mask filter per entry.
+ *
+ * CAN2 only receives gateway traffic, so it gets a plain list instead of
+ * the packed table, and its frames are not traced back by match index.
+ * Its remaining banks are deactivated. CAN2 must be in READY state.
+ *
+ * @param[in] hcan  CAN2 handle.
+ * @param[in] table Entries to accept.
+ * @param[in] count Number of entries.
+ * @return HAL_OK, HAL_ERROR if they do not fit, or the first HAL error.
+ */
+HAL_StatusTypeDef CanFilters_ApplySlave(CAN_HandleTypeDef *hcan,
+                                        const CanFilter_Entry_t *table, uint32_t count);
+
+/** Upper bound on filter match indices per FIFO (4 per 16-bit list bank). */
+#define CAN_FILTERS_MAX_FMI  (CAN_FILTERS_MAX_BANKS * 4U)
+
+/**
+ * @brief Map a hardware filter match index back to its table entry.
+ *
+ * bxCAN reports, per received frame, the index of the filter that accepted
+ * it (CAN_RxHeaderTypeDef.FilterMatchIndex), numbered per FIFO. This
+ * returns the table entry that produced that filter.
+ *
+ * @param[in] fifo CAN_FILTER_FIFO0 or CAN_FILTER_FIFO1.
+ * @param[in] fmi  Filter match index reported by the hardware.
+ * @return Index into CanFilters_GetTable(), or -1 if the filter is not
+ *         backed by a table entry (catch-all, unused).
+ */
+int32_t CanFilters_EntryFromMatch(uint32_t fifo, uint32_t fmi);
+
+/**
+ * @brief Stop or resume accepting one table entry while CAN1 runs.
+ *
+ * The entry's slots are overwritten with another entry of the same bank,
+ * or the bank is deactivated if the entry is all it holds; the other
+ * entries keep being received. Unmuting restores the bank as programmed.
+ * Every CanFilters_Apply() / CanFilters_ApplyAcceptAll() unmutes all.
+ * Task context, not concurrently with an apply.
+ *
+ * @param[in] hcan  CAN1 handle.
+ * @param[in] entry Index into CanFilters_GetTable().
+ * @param[in] muted 1 to mute, 0 to resume.
+ * @return HAL_OK, or HAL_ERROR for an unknown entry.
+ */
+HAL_StatusTypeDef CanFilters_SetMuted(CAN_HandleTypeDef *hcan, uint32_t entry, uint8_t muted);
+
+/**
+ * @brief Muted table entries (bit n = entry n).
+ */
+uint32_t CanFilters_GetMuted(void);
+
+/**
+ * @brief Access the runtime copy of the acceptance table.
+ *
+ * @param[out] count Number of entries (may be NULL).
+ * @return Pointer to the first entry.
+ */
+const CanFilter_Entry_t *CanFilters_GetTable(uint32_t *count);
+
+/**
+ * @brief Does one entry of the table accept every identifier matching
+ *        @p id / @p mask?
+ *
+ * @param[in] ext  1 for 29-bit identifiers.
+ * @param[in] id   Identifier (without CAN_IF_ID_EXT).
+ * @param[in] mask Bits of @p id that are fixed.
+ * @return 1 if covered (always with CAN_FILTERS_ACCEPT_ALL), else 0.
+ */
+uint8_t CanFilters_Covers(uint8_t ext, uint32_t id, uint32_t mask);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_FILTERS_H */
@@ -0,0 +1,114 @@
+/**
+ * @file    can_gw.h
+ * @brief   CAN1 <-> CAN2 gateway: table-driven forwarding from the RX
+ *          interrupt.
+ *
+ * CAN_GW_ROUTE_TABLE lists the routes. A frame received on a bus is
+ * compared with that bus's routes in table order; the first one whose
+ * ID/mask matches sends it on the destination bus, with the masked ID
+ * bits replaced by those of dstId (dstId = id keeps the identifier).
+ * A route with a minimum gap drops frames that follow its last
+ * forwarded one more closely (counted as limited), which caps what a
+ * chatty bus can push onto the other one. Remote frames are not
+ * forwarded.
+ *
+ * The forwarding runs in the source bus's RX interrupt: the payload goes
+ * from the RX slot straight into a submission slot of the destination
+ * (CAN_IF_Forward()), whose TX interrupt queues it as soon as the RX
+ * interrupt returns, with no ring and no task in between. The gateway
+ * latency is therefore two interrupts plus the destination's arbitration,
+ * independent of the task load. With
+ * CAN_IF_RX_FAST_IRQ that interrupt runs above the kernel, so nothing
+ * here calls it.
+ *
+ * CAN2 accepts exactly the IDs of the routes from CAN2, one filter bank
+ * each (CanFilters_ApplySlave(), banks from CAN_FILTERS_SLAVE_START_BANK),
+ * plus one bank for the bootloader responses 0x7E8..0x7EF, which go to
+ * the flashing proxy (fw_proxy.h) instead; its frames go nowhere else. A route from CAN1 needs its IDs in
+ * CAN_FILTER_TABLE, which CanGw_Init() checks; CAN1 frames are forwarded
+ * and still handled locally. CAN2 runs at the bit timing CAN1 starts
+ * with ("can bitrate" changes CAN1 only) and recovers from bus-off in
+ * hardware (can_busoff.h handles CAN1).
+ *
+ * Two routes must not feed each other back: in loopback each bus also
+ * receives what it sends.
+ *
+ * "can gw" shows the routes with their counters and the TX side of both
+ * buses.
+ */
+
+#ifndef CAN_GW_H
+#define CAN_GW_H
+
+#include "can_if.h"
+#include "can_filters.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief The routing table.
+ *
+ * X(src, id, mask, dst, dstId, minGapMs):
+ *   src, dst  CAN_IF_BUS1 or CAN_IF_BUS2
+ *   id        CAN_IF_Msg_t key (| CAN_IF_ID_EXT for 29-bit IDs)
+ *   mask      identifier bits that must match (CAN_FILTER_STD_EXACT /
+ *             CAN_FILTER_EXT_EXACT for one ID)
+ *   dstId     identifier on @c dst; its masked bits replace the frame's,
+ *             CAN_IF_ID_EXT selects the frame type sent
+ *   minGapMs  least time between two forwarded frames, 0 = no limit
+ *
+ * At most CAN_FILTERS_TOTAL_BANKS - CAN_FILTERS_SLAVE_START_BANK routes
+ * from CAN2.
+ */
+#ifndef CAN_GW_ROUTE_TABLE
+#define CAN_GW_ROUTE_TABLE(X)                                                  \
+    /* Vehicle telemetry to the body bus as 0x500, at most 10 Hz */            \
+    X(CAN_IF_BUS1, 0x100U, CAN_FILTER_STD_EXACT, CAN_IF_BUS2, 0x500U, 100U)    \
+    /* Body bus commands 0x200..0x2FF to the ECU bus unchanged */              \
+    X(CAN_IF_BUS2, 0x200U, 0x700U,               CAN_IF_BUS1, 0x200U, 0U)
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Check the routes against CAN_FILTER_TABLE and register "can gw".
+ *
+ * Called by CAN_IF_Init() before CAN2 is started.
+ */
+void CanGw_Init(void);
+
+/**
+ * @brief Acceptance filters @p bus needs for its routes (CAN2).
+ *
+ * @param[in]  bus Source bus.
+ * @param[out] out Entries, one per route from @p bus.
+ * @param[in]  max Capacity of @p out.
+ * @return Number of entries needed (may exceed @p max: they do not fit).
+ */
+uint32_t CanGw_GetFilters(uint32_t bus, CanFilter_Entry_t *out, uint32_t max);
+
+/**
+ * @brief Forward one received frame by the first matching route (RX
+ *        interrupt of @p bus, no kernel call).
+ *
+ * @param[in] bus  Bus the frame arrived on.
+ * @param[in] key  Identifier | CAN_IF_ID_EXT | CAN_IF_ID_RTR.
+ * @param[in] dlc  Data length code.
+ * @param[in] data Payload, 8 bytes readable.
+ */
+void CanGw_OnRx(uint32_t bus, uint32_t key, uint8_t dlc, const uint8_t *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_GW_H */
@@ -5,14 +5,37 @@
  * This module wraps the STM32 HAL CAN driver behind a small API that is
  * easy to test and reason about. It:
  *
- *   - Configures CAN1 (filter, notifications, start).
- *   - Owns an RX message queue consumed by CanRxTask.
+ *   - Configures CAN1 (filter, notifications, start), and CAN2 for the
+ *     gateway (can_gw.h) when CAN_IF_NUM_BUSES is 2.
+ *   - Owns a lock-free RX ring (can_ring) consumed by CanRxTask, and one
+ *     latest-value slot per cyclic status ID (CAN_IF_LATEST_TABLE); a few
+ *     latency-critical IDs skip both and are decoded in the RX interrupt
+ *     (CAN_IF_RegisterIsrDecoder()).
  *   - Encodes VehicleState_t into a compact telemetry frame.
+ *   - Hands reassembled multi-frame messages (PDUs) to their consumer by
+ *     pointer, in mem_pool blocks.
  *   - Provides optional logging of received frames over UART via Log_*.
  *
- * In this project CAN is configured in LOOPBACK mode, so every transmitted
+ * CAN1 starts in CAN_IF_MODE, LOOPBACK by default, so every transmitted
  * frame is received back by the same node. This makes it ideal as a
- * self-contained demo or "virtual ECU" without extra hardware.
+ * self-contained demo or "virtual ECU" without extra hardware. "can mode"
+ * switches between normal, loopback, silent and silent-loopback at
+ * runtime.
+ *
+ * Silent (listen-only) mode turns the node into a passive bus logger: the
+ * controller never drives the bus, not even an ACK or an error flag, and
+ * CAN1 accepts every frame through one catch-all filter bank instead of
+ * CAN_FILTER_TABLE. Frames go through the same path as always - drained
+ * from the FIFO in the interrupt, counted (can_stats), recorded
+ * (can_trace), queued in the ring and logged by CanRxTask with "log on" -
+ * but are not handed to the registered handlers, and CAN_IF_Transmit()
+ * refuses frames for CAN1 (counted as dropped), since nothing could answer
+ * anyway. The interrupt costs a few hundred cycles per frame, so the
+ * trace keeps up with a fully loaded 1 Mbit/s bus (about 21000 frames/s
+ * at the shortest frames); the UART log does not, and at that rate the
+ * ring relies on CanRxTask being scheduled every ~3 ms
+ * (CAN_IF_RX_RING_SIZE frames). CAN_IF_RX_FAST_IRQ keeps the 3-frame
+ * hardware FIFO from overrunning behind kernel critical sections.
  */
 
 #ifndef CAN_IF_H
@@ -20,6 +43,11 @@
 
 #include "main.h"
 #include "cmsis_os2.h"
+#include "can_ring.h"
+#include "can_txq.h"
+#include "can_timing.h"
+#include "can_lat.h"
+#include "can_signals.h"
 #include "vehicle.h"
 #include <stdint.h>
 
@@ -28,47 +56,675 @@ extern "C" {
 #endif
 
 /**
- * @brief Simple container for received CAN frames.
+ * Controllers driven by CAN_IF: 1 = CAN1, 2 = CAN1 and CAN2. CAN1 is the
+ * ECU's own bus (RX ring, handlers, scheduler, bus-off recovery, stats).
+ * CAN2 only carries gateway traffic: its frames are forwarded by the
+ * routes in can_gw.h from the RX interrupt and never reach CanRxTask.
+ * Each controller has its own TX queue, mailbox refill and counters.
+ */
+#ifndef CAN_IF_NUM_BUSES
+#define CAN_IF_NUM_BUSES     2U
+#endif
+
+/** Bus numbers for CAN_IF_TransmitBus() and the gateway routes. */
+#define CAN_IF_BUS1          0U
+#define CAN_IF_BUS2          1U
+
+/** Number of slots in the CAN RX ring (must be a power of two). */
+#ifndef CAN_IF_RX_RING_SIZE
+#define CAN_IF_RX_RING_SIZE  64U
+#endif
+
+/** Thread flag set on the RX consumer when the ring becomes non-empty. */
+#define CAN_IF_RX_FLAG       0x0001U
+
+/**
+ * RX above the kernel (1): the CAN1 RX0/RX1 interrupts run at
+ * CAN_IF_RX_IRQ_PRIO, above configMAX_SYSCALL_INTERRUPT_PRIORITY, so no
+ * kernel critical section delays emptying the 3-frame hardware FIFOs.
+ * They only fill the RX ring and pend CAN_IF_RX_SWI_IRQn at the kernel
+ * priority, whose handler wakes CanRxTask. 0: the RX interrupts run at
+ * the kernel priority and wake CanRxTask themselves.
+ */
+#ifndef CAN_IF_RX_FAST_IRQ
+#define CAN_IF_RX_FAST_IRQ   0
+#endif
+
+/**
+ * RX straight from the registers (1): the drain reads each frame from the
+ * FIFO output mailbox (RIR, RDTR, RDLR, RDHR) into its ring slot and
+ * releases it with RFOM, without HAL_CAN_GetRxMessage() decoding it into
+ * a header first. HAL_CAN_IRQHandler() still handles errors and
+ * overruns. 0: through HAL; the SIL build, whose shim has no FIFO
+ * registers, uses this.
+ */
+#ifndef CAN_IF_RX_DIRECT
+#define CAN_IF_RX_DIRECT     1
+#endif
+
+/**
+ * TX straight to the registers (1): the TX interrupt writes a queued frame,
+ * kept as a mailbox image, into the free mailbox TSR points at. 0: through
+ * HAL_CAN_AddTxMessage(); the SIL build, whose shim cannot see a mailbox
+ * being loaded, uses this.
+ */
+#ifndef CAN_IF_TX_DIRECT
+#define CAN_IF_TX_DIRECT     1
+#endif
+
+/** NVIC priority of the RX interrupts with CAN_IF_RX_FAST_IRQ. */
+#ifndef CAN_IF_RX_IRQ_PRIO
+#define CAN_IF_RX_IRQ_PRIO   4U
+#endif
+
+/** Hand-off interrupt: the vector of HDMI-CEC, which is not used. */
+#define CAN_IF_RX_SWI_IRQn   CEC_IRQn
+
+/**
+ * Mailbox arbitration CAN_IF_Init() starts with (CAN_IF_SetTxFifo()): 0
+ * lets the identifier decide between loaded mailboxes (TXFP clear), 1
+ * sends them in the order they were loaded.
+ */
+#ifndef CAN_IF_TX_FIFO
+#define CAN_IF_TX_FIFO       0
+#endif
+
+/** Mailboxes CAN_IF_TX_IN_ORDER frames may hold at once (1..3); the rest
+ *  stay free for other frames, so a cyclic frame queued behind a transfer
+ *  still finds a mailbox. */
+#ifndef CAN_IF_TX_IN_ORDER_MAILBOXES
+#define CAN_IF_TX_IN_ORDER_MAILBOXES  2U
+#endif
+
+/**
+ * Urgent mailbox (1): CAN1's TX mailbox 2 is kept out of the queue refill
+ * for CAN_IF_TransmitUrgent(), so a frame that must not wait behind the
+ * software queue (threshold alarms, can_alarm.h) always finds a mailbox
+ * and is loaded by its sender. Queued frames share mailboxes 0 and 1.
+ */
+#ifndef CAN_IF_TX_URGENT
+#define CAN_IF_TX_URGENT     1
+#endif
+
+/** The mailbox CAN_IF_TX_URGENT reserves. */
+#define CAN_IF_TX_URGENT_MAILBOX  2U
+
+#if (CAN_IF_TX_IN_ORDER_MAILBOXES == 0U) || \
+    (CAN_IF_TX_IN_ORDER_MAILBOXES > (3U - CAN_IF_TX_URGENT))
+#error "CAN_IF_TX_IN_ORDER_MAILBOXES must be 1..3, 1..2 with CAN_IF_TX_URGENT"
+#endif
+
+/** Bitrate programmed by CAN_IF_Init() (bit/s). */
+#ifndef CAN_IF_BITRATE
+#define CAN_IF_BITRATE       500000U
+#endif
+
+/** Operating mode CAN_IF_Init() starts CAN1 in (CAN_MODE_xxx); the mode in
+ *  MX_CAN1_Init() only applies until then. */
+#ifndef CAN_IF_MODE
+#define CAN_IF_MODE          CAN_MODE_LOOPBACK
+#endif
+
+/** Telemetry frame schedule (can_sched.h): cycle, least gap and phase in ms.
+ *  Cycle and gap are the defaults of CAN_TELEM_CYCLE / _GAP in cal.h. */
+#ifndef CAN_IF_TELEM_CYCLE_MS
+#define CAN_IF_TELEM_CYCLE_MS    100U
+#endif
+#ifndef CAN_IF_TELEM_MIN_GAP_MS
+#define CAN_IF_TELEM_MIN_GAP_MS  20U
+#endif
+#ifndef CAN_IF_TELEM_OFFSET_MS
+#define CAN_IF_TELEM_OFFSET_MS   0U
+#endif
+
+/** Change since the last telemetry frame that sends the next one early. */
+#ifndef CAN_IF_TELEM_DB_SPEED_KPH
+#define CAN_IF_TELEM_DB_SPEED_KPH  1.0f
+#endif
+#ifndef CAN_IF_TELEM_DB_RPM
+#define CAN_IF_TELEM_DB_RPM        100U
+#endif
+#ifndef CAN_IF_TELEM_DB_TEMP_C
+#define CAN_IF_TELEM_DB_TEMP_C     1.0f
+#endif
+
+/**
+ * Latest-value IDs: cyclic status frames of which only the newest value
+ * matters. X(id) takes the CAN_IF_Msg_t::Id key (| CAN_IF_ID_EXT for
+ * 29-bit IDs). Each ID gets one slot that the RX interrupt overwrites,
+ * plus a dirty bit, and takes no ring space. CanRxTask handles the dirty
+ * slots after the ring (CAN_IF_ProcessLatest()). Under overload it
+ * therefore handles each such ID once, with its current value, rather
+ * than a backlog of stale frames: the work is bounded by the number of
+ * IDs, not by the frame rate. All other IDs stay in FIFO order in the
+ * ring. An ID needs an exact entry in CAN_FILTER_TABLE, because its
+ * filter match index finds the slot. At most 32.
+ */
+#ifndef CAN_IF_LATEST_TABLE
+#define CAN_IF_LATEST_TABLE(X)                                              \
+    X(0x100U)   /* vehicle telemetry, unless ISR-decoded (can_sigcache.c) */
+#endif
+
+/**
+ * ISR decoders (CAN_IF_RegisterIsrDecoder()): latency-critical IDs whose
+ * frames are decoded in the CAN1 RX interrupt itself, right after they are
+ * counted and traced, instead of going through the ring or a latest-value
+ * slot to CanRxTask. The frame-to-value time is then the interrupt's, not
+ * the scheduler's. At most this many IDs, looked up by a compare each per
+ * frame; 0 removes the path.
+ */
+#ifndef CAN_IF_ISR_DECODERS
+#define CAN_IF_ISR_DECODERS  2U
+#endif
+
+/** Frames CanRxTask takes from the ring per batch (one tail update each). */
+#ifndef CAN_IF_RX_BATCH
+#define CAN_IF_RX_BATCH      8U
+#endif
+
+/** OR into an identifier passed to CAN_IF_RegisterHandler() for 29-bit IDs. */
+#define CAN_IF_ID_EXT            0x80000000U
+
+/** Set in CAN_IF_Msg_t::Id for a remote frame. */
+#define CAN_IF_ID_RTR            0x40000000U
+
+/** Identifier bits of CAN_IF_Msg_t::Id. */
+#define CAN_IF_ID_MASK           0x1FFFFFFFU
+
+/**
+ * OR into the identifier given to CAN_IF_Transmit() for a frame of a
+ * segmented transfer (ISO-TP, J1939 TP data, XCP DAQ): it leaves after the
+ * frames of its identifier submitted before it. Not part of the ID.
+ */
+#define CAN_IF_TX_IN_ORDER       0x20000000U
+
+/**
+ * CAN FD payloads (1): the RX ring and latest-value slots, the handlers
+ * and CAN_IF_InjectRx() carry up to 64 bytes, with the DLC codes 9..15
+ * standing for 12..64 bytes and the FD format and bit rate switch flags
+ * in CAN_IF_Msg_t::Info. Code above the controller reads the payload
+ * length with CAN_IF_MSG_LEN() and sends with CAN_IF_Transmit() and a
+ * length, so it runs unchanged on an FD controller.
+ *
+ * Limitation: this is payload carriage only. There is no FDCAN backend;
+ * the only controller driver is bxCAN, which sends and receives classic
+ * frames. FD frames come from CAN_IF_InjectRx() alone (SIL, replay,
+ * tests), and CAN_IF_Transmit() refuses a payload of more than 8 bytes.
+ * An FDCAN part (G4, H7) needs its own backend below this interface.
+ *
+ * Each slot grows from 16 to 72 bytes. 0: classic frames, 8-byte slots.
+ */
+#ifndef CAN_IF_FD
+#define CAN_IF_FD            0
+#endif
+
+/** Largest payload a frame carries (bytes). */
+#if CAN_IF_FD
+#define CAN_IF_MAX_DLEN      64U
+#else
+#define CAN_IF_MAX_DLEN      8U
+#endif
+
+/** Largest payload the bxCAN controller sends (bytes). */
+#define CAN_IF_CLASSIC_DLEN  8U
+
+/**
+ * @brief Received CAN frame, as stored in the RX ring.
  *
- * This is the payload type stored in the RX message queue.
- * It mirrors the STM32 HAL RX structures but is decoupled so
- * the application layer does not depend on HAL types directly.
+ * 16 bytes in four aligned words (72 with CAN_IF_FD) so the RX interrupt
+ * and the consumer move it with word accesses. Info follows the bxCAN
+ * RDTR register: DLC in bits 0..3, filter match index in 8..15 and the
+ * SOF timestamp (time-triggered mode, CAN bit times, 16-bit wrap) in
+ * 16..31; bits 4..6, reserved in RDTR, hold the RX FIFO and the FD format
+ * and bit rate switch flags. Use the CAN_IF_MSG_* accessors.
+ *
+ * With CAN_LAT_ENABLE a further word carries the DWT stamp of the RX
+ * interrupt for the latency statistics (can_lat.h).
  */
 typedef struct
 {
-    uint32_t StdId;   /**< 11-bit standard identifier (if IDE == 0). */
-    uint32_t ExtId;   /**< 29-bit extended identifier (if IDE == 1). */
-    uint8_t  IDE;     /**< Identifier type: 0 = standard, 1 = extended. */
-    uint8_t  RTR;     /**< Frame type: 0 = data, 1 = remote. */
-    uint8_t  DLC;     /**< Data length code (0..8). */
-    uint8_t  Data[8]; /**< Payload bytes (unused bytes undefined). */
+    uint32_t Id;             /**< Identifier | CAN_IF_ID_EXT | CAN_IF_ID_RTR. */
+    uint32_t Info;           /**< DLC, FIFO, FD flags, FMI and timestamp (see above). */
+    union
+    {
+        uint8_t  Data[CAN_IF_MAX_DLEN];         /**< Payload bytes (unused bytes undefined). */
+        uint32_t Data32[CAN_IF_MAX_DLEN / 4U];  /**< Same, as words (RDLR/RDHR). */
+    };
+#if CAN_LAT_ENABLE
+    uint32_t EnqCycles;      /**< DWT cycle count when the RX ISR filled the slot. */
+#endif
 } CAN_IF_Msg_t;
 
+#define CAN_IF_MSG_INFO_FIFO_POS 4U
+#define CAN_IF_MSG_INFO_FDF      0x20U   /**< FD frame format. */
+#define CAN_IF_MSG_INFO_BRS      0x40U   /**< FD data phase at the fast bit rate. */
+
+/**
+ * @brief Payload bytes of DLC code @p dlc: 0..8 as is; 9..15 mean 8 in a
+ *        classic frame and 12, 16, 20, 24, 32, 48, 64 in an FD one.
+ */
+static inline uint8_t CAN_IF_DlcToLen(uint8_t dlc, uint8_t fd)
+{
+    dlc &= 0x0FU;
+    if (dlc <= 8U)
+        return dlc;
+    if (fd == 0U)
+        return 8U;
+    if (dlc <= 12U)
+        return (uint8_t)(8U + ((dlc - 8U) * 4U));
+    return (uint8_t)((dlc - 11U) * 16U);
+}
+
+/**
+ * @brief Smallest DLC code whose payload holds @p len bytes (FD codes
+ *        above 8); 15 for anything above 48.
+ */
+static inline uint8_t CAN_IF_LenToDlc(uint8_t len)
+{
+    if (len <= 8U)
+        return len;
+    if (len <= 24U)
+        return (uint8_t)(8U + ((len - 5U) / 4U));
+    if (len <= 32U)
+        return 13U;
+    return (len <= 48U) ? 14U : 15U;
+}
+
+/** Identifier without the RTR flag, in the CAN_IF_RegisterHandler() format. */
+#define CAN_IF_MSG_KEY(m)   ((m)->Id & ~CAN_IF_ID_RTR)
+#define CAN_IF_MSG_IS_EXT(m) (((m)->Id & CAN_IF_ID_EXT) != 0U)
+#define CAN_IF_MSG_IS_RTR(m) (((m)->Id & CAN_IF_ID_RTR) != 0U)
+#define CAN_IF_MSG_DLC(m)   ((uint8_t)((m)->Info & 0x0FU))
+#define CAN_IF_MSG_IS_FD(m) (((m)->Info & CAN_IF_MSG_INFO_FDF) != 0U)
+/** Payload bytes: the DLC decoded for the frame format. */
+#define CAN_IF_MSG_LEN(m)   CAN_IF_DlcToLen(CAN_IF_MSG_DLC(m), CAN_IF_MSG_IS_FD(m) ? 1U : 0U)
+#define CAN_IF_MSG_FIFO(m)  ((uint8_t)(((m)->Info >> CAN_IF_MSG_INFO_FIFO_POS) & 0x01U))
+#define CAN_IF_MSG_FMI(m)   ((uint8_t)((m)->Info >> 8))
+#define CAN_IF_MSG_TIME(m)  ((uint16_t)((m)->Info >> 16))
+
+/** Filter match index of a frame put back by CAN_IF_ReinjectRx(). */
+#define CAN_IF_FMI_REINJECTED 0xFEU
+
+/** Standard ID of the vehicle telemetry frame (Core/mini_ecu.dbc). */
+#define CAN_IF_TELEMETRY_ID      CANSIG_VEHICLE_TELEMETRY_ID
+
+/** Maximum number of registered RX handlers (all ID kinds). */
+#ifndef CAN_IF_MAX_HANDLERS
+#define CAN_IF_MAX_HANDLERS      16U
+#endif
+
+/** Maximum number of 29-bit ID registrations. */
+#ifndef CAN_IF_MAX_EXT_HANDLERS
+#define CAN_IF_MAX_EXT_HANDLERS  8U
+#endif
+
+/** Maximum number of registered PDU (multi-frame message) handlers. */
+#ifndef CAN_IF_MAX_PDU_HANDLERS
+#define CAN_IF_MAX_PDU_HANDLERS  4U
+#endif
+
+/**
+ * @brief RX handler invoked from CanRxTask for a matching frame.
+ *
+ * @param[in] msg Received frame (valid only for the duration of the call).
+ * @param[in] ctx Opaque pointer given at registration.
+ */
+typedef void (*CAN_IF_RxHandler_t)(const CAN_IF_Msg_t *msg, void *ctx);
+
+/**
+ * @brief Decoder run in the CAN1 RX interrupt (CAN_IF_RegisterIsrDecoder()).
+ *
+ * Runs from SRAM (RAMFUNC) above the kernel with CAN_IF_RX_FAST_IRQ, so it
+ * may not call it: it stores and returns, and asks for its wake function
+ * instead.
+ *
+ * @param[in] key      CAN_IF_Msg_t::Id of the frame.
+ * @param[in] dlc      Its DLC.
+ * @param[in] data     Its 8 payload bytes.
+ * @param[in] rxCycles DWT->CYCCNT when it was read from the FIFO.
+ * @param[in] ctx      Opaque pointer given at registration.
+ * @return Non-zero to have the wake function called.
+ */
+typedef uint8_t (*CAN_IF_IsrDecoder_t)(uint32_t key, uint8_t dlc, const uint8_t *data,
+                                       uint32_t rxCycles, void *ctx);
+
+/**
+ * @brief Called at the kernel interrupt priority after a decoder asked for
+ *        it: at the end of the RX interrupt, or in the hand-off interrupt
+ *        with CAN_IF_RX_FAST_IRQ. Wakes the consumers (osThreadFlagsSet()).
+ */
+typedef void (*CAN_IF_IsrWake_t)(void *ctx);
+
+/**
+ * @brief Consumer of a reassembled message.
+ *
+ * @param[in] id   Identifier the message arrived on (CAN_IF_ID_EXT for 29-bit).
+ * @param[in] data Payload in a mem_pool block; the handler takes ownership
+ *                 and must release it with MemPool_Free() (it may keep it,
+ *                 e.g. post the pointer to another task, until then).
+ * @param[in] len  Payload length in bytes.
+ * @param[in] ctx  Opaque pointer given at registration.
+ */
+typedef void (*CAN_IF_PduHandler_t)(uint32_t id, uint8_t *data, uint16_t len, void *ctx);
+
 /**
  * @brief Initialize the CAN interface module.
  *
  * Responsibilities:
- *   - Configure a permissive filter (accept all IDs into FIFO0).
+ *   - Program CAN_IF_BITRATE bit timing for the current APB1 clock.
+ *   - Program the acceptance filters from CAN_FILTER_TABLE (can_filters.h).
  *   - Start CAN1 peripheral.
  *   - Enable RX and error-related interrupts.
- *   - Create the RX message queue for CanRxTask.
+ *   - Initialize the RX ring for CanRxTask.
  *
  * @return HAL_OK on success, or a HAL error code if any HAL call fails.
  */
 HAL_StatusTypeDef CAN_IF_Init(void);
 
+/**
+ * @brief Change bitrate and/or operating mode at runtime.
+ *
+ * Computes the bit timing from the current APB1 clock (can_timing),
+ * stops CAN1, rewrites the bit timing register and restarts it. Filters,
+ * notifications and queued TX frames are kept. Use it e.g. to leave
+ * loopback for a real bus.
+ *
+ * Entering CAN_MODE_SILENT drops the queued TX frames and aborts the
+ * mailboxes (they could never be sent) and programs the catch-all filter;
+ * leaving it restores CAN_FILTER_TABLE.
+ *
+ * @param[in] bitrate Bit/s (e.g. 500000, 1000000).
+ * @param[in] mode    CAN_MODE_NORMAL, CAN_MODE_LOOPBACK, CAN_MODE_SILENT
+ *                    or CAN_MODE_SILENT_LOOPBACK.
+ * @return HAL_OK, HAL_ERROR if the bitrate cannot be reached from the
+ *         current clock or @p mode is unknown (nothing is changed in that
+ *         case), or HAL_BUSY while a bus-off restart is in progress.
+ */
+HAL_StatusTypeDef CAN_IF_SetBitrate(uint32_t bitrate, uint32_t mode);
+
+/**
+ * @brief Change the operating mode at the current bitrate
+ *        (CAN_IF_SetBitrate()).
+ */
+HAL_StatusTypeDef CAN_IF_SetMode(uint32_t mode);
+
+/**
+ * @brief Leave bus-off: stop and restart CAN1 with the same configuration.
+ *
+ * Task context only (can_busoff). Takes at most the HAL's two 10 ms
+ * init-mode timeouts.
+ *
+ * @param[in]  flushTx Non-zero drops the software TX queue and aborts the
+ *                     mailboxes first (counted in CAN_IF_TxStats_t.dropped).
+ * @param[out] flushed Frames dropped (may be NULL).
+ * @return HAL_OK, HAL_BUSY if a bitrate change is in progress, or the HAL
+ *         error of HAL_CAN_Stop()/HAL_CAN_Start().
+ */
+HAL_StatusTypeDef CAN_IF_Restart(uint8_t flushTx, uint32_t *flushed);
+
+/**
+ * @brief Put CAN1 into the bxCAN sleep mode for bus sleep (can_nm.h).
+ *
+ * The TX queue and the mailboxes are emptied and CAN_IF_Transmit() on CAN1
+ * returns HAL_BUSY until CAN_IF_WakeUp(). The controller enters sleep once
+ * the bus is idle and leaves it by itself on the next start of frame
+ * (AutoWakeUp, reported by HAL_CAN_WakeUpFromRxMsgCallback()); that first
+ * frame is lost. Task context.
+ *
+ * @return HAL_OK, HAL_BUSY if a bitrate change is in progress, or the HAL
+ *         error.
+ */
+HAL_StatusTypeDef CAN_IF_Sleep(void);
+
+/**
+ * @brief Leave the sleep mode and accept sends again (task context).
+ *
+ * @return HAL_OK, HAL_BUSY if a bitrate change is in progress, or the HAL
+ *         error of HAL_CAN_WakeUp().
+ */
+HAL_StatusTypeDef CAN_IF_WakeUp(void);
+
+/**
+ * @brief Interrupt context: take CAN1 out of the sleep mode at once, ahead
+ *        of CAN_IF_WakeUp().
+ *
+ * For the bus wake-up EXTI handler (can_nm.h): after a wake-up from Stop
+ * the controller otherwise stays asleep until AutoWakeUp sees the next
+ * start of frame, and loses that frame as well. Sends stay refused until
+ * CAN_IF_WakeUp().
+ */
+void CAN_IF_WakeUpFromIsr(void);
+
+/**
+ * @brief Non-zero between CAN_IF_Sleep() and CAN_IF_WakeUp().
+ */
+uint8_t CAN_IF_IsAsleep(void);
+
+/**
+ * @brief 1 if the current bitrate can be timed from a @p pclk1Hz APB1
+ *        clock at CAN_TIMING_SAMPLE_POINT.
+ */
+uint8_t CAN_IF_ClockFits(uint32_t pclk1Hz);
+
+/**
+ * @brief Before an APB1 clock change (clock_gov.h): stop the running
+ *        controllers so none samples the bus with a stale prescaler.
+ *
+ * Queued frames stay queued; a frame being sent is finished first. Task
+ * context; CAN_IF_ClockResume() must follow on HAL_OK.
+ *
+ * @return HAL_OK, HAL_BUSY if a bitrate change is in progress or CAN1 is
+ *         asleep, or HAL_ERROR if CAN1 did not stop (then still running).
+ */
+HAL_StatusTypeDef CAN_IF_ClockPrepare(void);
+
+/**
+ * @brief After the clock change: recompute the bit timing for the new
+ *        PCLK1 and restart the controllers CAN_IF_ClockPrepare() stopped.
+ *
+ * @return HAL_OK, or the first error of the timing or HAL_CAN_Start().
+ */
+HAL_StatusTypeDef CAN_IF_ClockResume(void);
+
+/**
+ * @brief Mute or resume one CAN_FILTER_TABLE entry while CAN1 runs
+ *        (CanFilters_SetMuted(), for can_rxlimit.h). Task context.
+ *
+ * @param[in] entry Index into CanFilters_GetTable().
+ * @param[in] muted 1 to mute, 0 to resume.
+ * @return HAL_OK, HAL_BUSY if a reconfiguration is in progress (its
+ *         filter apply unmutes everything anyway), or HAL_ERROR.
+ */
+HAL_StatusTypeDef CAN_IF_MuteFilter(uint32_t entry, uint8_t muted);
+
+/**
+ * @brief Non-zero while CAN1 is bus-off (CAN->ESR BOFF).
+ */
+uint8_t CAN_IF_IsBusOff(void);
+
+/**
+ * @brief Bit timing and mode currently programmed.
+ *
+ * @param[out] timing Active timing (may be NULL).
+ * @return Active CAN_MODE_xxx.
+ */
+uint32_t CAN_IF_GetBitTiming(CanTiming_t *timing);
+
+/**
+ * @brief TX path counters.
+ */
+typedef struct
+{
+    uint32_t queued;     /**< Frames taken into the queue by the TX interrupt. */
+    uint32_t sent;       /**< Frames confirmed by a mailbox-complete interrupt. */
+    uint32_t dropped;    /**< Frames rejected (no slot, TX off) or aborted. */
+    uint32_t depth;      /**< Frames currently waiting in the software queue. */
+    uint32_t highWater;  /**< Peak software queue depth. */
+} CAN_IF_TxStats_t;
+
+/**
+ * @brief Submit a frame for transmission (non-blocking, lock-free).
+ *
+ * The frame goes into a submission slot (can_txq.h) and the TX interrupt
+ * is pended. That interrupt, the only one to touch the priority-ordered
+ * software queue and the mailboxes, queues it and moves the queue into
+ * free mailboxes, highest arbitration priority first; called from a task,
+ * the frame is in a mailbox when this returns if one was free. A frame of
+ * the E2E table gets its counter and CRC (can_e2e.h), one of the SecOC
+ * table its freshness value and MAC (can_secoc.h) on the way.
+ *
+ * Safe to call from any task at once, without a lock and without masking
+ * interrupts. An E2E-protected identifier must have a single sender.
+ *
+ * With ID priority between the mailboxes (CAN_IF_SetTxFifo()), two loaded
+ * frames of one identifier leave in mailbox order, not in submission
+ * order. A CAN_IF_TX_IN_ORDER frame therefore waits in the queue while its
+ * identifier is in a mailbox, and such frames take at most
+ * CAN_IF_TX_IN_ORDER_MAILBOXES of them.
+ *
+ * @param[in] id   Identifier; OR with CAN_IF_ID_EXT for a 29-bit ID and
+ *                 with CAN_IF_TX_IN_ORDER for a segmented transfer.
+ * @param[in] data Payload (may be NULL when @p dlc is 0).
+ * @param[in] dlc  Payload bytes, 0..CAN_IF_CLASSIC_DLEN: bxCAN sends
+ *                 classic frames only (CAN_IF_FD).
+ *
+ * @return HAL_OK if accepted, HAL_BUSY if every submission slot is taken
+ *         (frame dropped and counted) or an authenticated frame waits for
+ *         its freshness value to be stored or CAN1 is asleep (not
+ *         counted), HAL_ERROR on invalid arguments, an FD payload or in
+ *         silent mode (counted as dropped).
+ */
+HAL_StatusTypeDef CAN_IF_Transmit(uint32_t id, const uint8_t *data, uint8_t dlc);
+
+/**
+ * @brief CAN_IF_Transmit() on a given controller.
+ *
+ * @param[in] bus CAN_IF_BUS1 or CAN_IF_BUS2.
+ * @return As CAN_IF_Transmit(), HAL_ERROR for a bus that is not driven.
+ */
+HAL_StatusTypeDef CAN_IF_TransmitBus(uint32_t bus, uint32_t id, const uint8_t *data, uint8_t dlc);
+
+/**
+ * @brief Prebuilt TX frame: identifier and length as the mailbox registers
+ *        take them, with the E2E and SecOC table entries already looked up.
+ *
+ * Filled once by CAN_IF_TxTemplateInit() for a frame sent over and over;
+ * CAN_IF_TransmitTemplate() then only copies the payload, and the TX
+ * interrupt writes the image straight into a free mailbox.
+ */
+typedef struct
+{
+    uint32_t tir;   /**< CAN_TIxR image (STID/EXID, IDE), TXRQ clear. */
+    uint32_t tdtr;  /**< CAN_TDTxR image: DLC, and CAN_TXQ_IN_ORDER. */
+    uint32_t key;   /**< Identifier | CAN_IF_ID_EXT. */
+    uint8_t  e2e;   /**< CanE2E_Find() of key. */
+    uint8_t  sec;   /**< CanSecOC_Find() of key. */
+} CAN_IF_TxTemplate_t;
+
+/**
+ * @brief Build the template of frame @p id (| CAN_IF_ID_EXT,
+ *        | CAN_IF_TX_IN_ORDER) with @p dlc bytes (clamped to 8).
+ */
+void CAN_IF_TxTemplateInit(CAN_IF_TxTemplate_t *t, uint32_t id, uint8_t dlc);
+
+/**
+ * @brief CAN_IF_TransmitBus() of a prebuilt frame: no header to encode
+ *        and no table to search.
+ *
+ * @param[in] data Payload of t->tdtr bytes (may be NULL for 0).
+ * @return As CAN_IF_TransmitBus().
+ */
+HAL_StatusTypeDef CAN_IF_TransmitTemplate(uint32_t bus, const CAN_IF_TxTemplate_t *t,
+                                          const uint8_t *data);
+
+/**
+ * @brief Load a prebuilt frame straight into CAN1's urgent mailbox
+ *        (CAN_IF_TX_URGENT), past the submission slots and the queue.
+ *
+ * The mailbox registers are written with interrupts masked (with the CRC
+ * of an E2E entry, a few hundred cycles at most), so the frame is in arbitration when this returns, whatever the
+ * queue holds. With ID priority (CAN_IF_SetTxFifo()) it leaves ahead of
+ * the loaded mailboxes of higher identifiers; in load order it waits for
+ * the two frames loaded before it at most. An E2E entry of the template is applied; a SecOC one is
+ * refused, since its MAC would cost more than the rest of the path. Its TX
+ * confirmation goes to CanAlarm_OnTxDone(). Any context.
+ *
+ * @param[in] data Payload of t->tdtr bytes (may be NULL for 0).
+ * @return HAL_OK, HAL_BUSY while the mailbox still holds the previous
+ *         frame or CAN1 is asleep, HAL_ERROR without CAN_IF_TX_URGENT, in
+ *         silent mode, before CAN_IF_Init() or for a SecOC identifier.
+ */
+HAL_StatusTypeDef CAN_IF_TransmitUrgent(const CAN_IF_TxTemplate_t *t, const uint8_t *data);
+
+/**
+ * @brief Gateway fast path: queue a received frame on another controller,
+ *        from the RX interrupt (any priority, no kernel call).
+ *
+ * The payload goes from the RX slot into a submission slot of the
+ * destination, without masking; its TX interrupt queues it once the RX
+ * interrupt returns.
+ *
+ * @param[in] bus  Destination bus.
+ * @param[in] id   Identifier (| CAN_IF_ID_EXT).
+ * @param[in] data Payload, 8 bytes readable.
+ * @param[in] dlc  Data length code (0..8).
+ * @return HAL_OK, HAL_BUSY if every submission slot is taken (counted as dropped),
+ *         HAL_ERROR for a bus that is not running.
+ */
+HAL_StatusTypeDef CAN_IF_Forward(uint32_t bus, uint32_t id, const uint8_t *data, uint8_t dlc);
+
+/**
+ * @brief Choose the arbitration between loaded mailboxes of @p bus.
+ *
+ * @param[in] fifo 1: in load order (TXFP), which is queue order, so a
+ *                 frame loaded later waits even if its ID is higher in
+ *                 priority; 0: by identifier. The software queue is
+ *                 priority-ordered either way.
+ * @return HAL_OK, HAL_ERROR for a bus that is not driven.
+ */
+HAL_StatusTypeDef CAN_IF_SetTxFifo(uint32_t bus, uint8_t fifo);
+
+/** 1 if the mailboxes of @p bus leave in load order (CAN_IF_SetTxFifo()). */
+uint8_t CAN_IF_GetTxFifo(uint32_t bus);
+
+/**
+ * @brief Copy the TX path counters of CAN1.
+ */
+void CAN_IF_GetTxStats(CAN_IF_TxStats_t *stats);
+
+/**
+ * @brief Copy the TX path counters of @p bus (zeros for a bus not driven).
+ */
+void CAN_IF_GetBusTxStats(uint32_t bus, CAN_IF_TxStats_t *stats);
+
 /**
  * @brief Encode and transmit a telemetry frame based on vehicle state.
  *
- * Frame format (StdId = 0x100, DLC = 6):
+ * Frame format (StdId = 0x100, DLC = 8):
  *   Byte 0-1 : speed in 0.1 km/h units (uint16, little-endian).
  *   Byte 2-3 : engine RPM (uint16, little-endian).
  *   Byte 4-5 : coolant temperature in 0.1 °C (int16, little-endian).
+ *   Byte 6   : E2E alive counter (bits 0..3), byte 7 : E2E CRC8; both
+ *              filled in by CAN_IF_Transmit() (can_e2e.h).
+ *
+ * Sent from a template built by CAN_IF_Init() (CAN_IF_TransmitTemplate()),
+ * so it never blocks or logs on a busy bus.
  *
  * @param[in] vs Pointer to the current "true" VehicleState_t.
  */
 void CAN_IF_SendTelemetry(const VehicleState_t *vs);
 
+/**
+ * @brief Telemetry frame as CAN_IF_SendTelemetry(), with a caller-chosen ID.
+ *
+ * Used by simulated fleets where every vehicle has its own identifier.
+ *
+ * @param[in] id Identifier (OR CAN_IF_ID_EXT for 29-bit).
+ * @param[in] vs Vehicle state to encode.
+ * @return Result of CAN_IF_Transmit() (HAL_BUSY if the TX queue is full).
+ */
+HAL_StatusTypeDef CAN_IF_SendTelemetryId(uint32_t id, const VehicleState_t *vs);
+
 /**
  * @brief Enable or disable CAN RX logging.
  *
@@ -80,21 +736,173 @@ void CAN_IF_SendTelemetry(const VehicleState_t *vs);
 void CAN_IF_SetLogging(uint8_t enable);
 
 /**
- * @brief Get the handle of the RX message queue used by CanRxTask.
+ * @brief Get the RX ring consumed by CanRxTask.
+ *
+ * The consumer peeks CAN_IF_Msg_t slots in place, up to CAN_IF_RX_BATCH
+ * at a time with CanRing_PeekBatch(), and releases them after
+ * processing. It should register itself with CanRing_SetConsumer() using
+ * CAN_IF_RX_FLAG and wait on that flag while the ring is empty.
  *
- * @return osMessageQueueId_t of the RX queue, or NULL if init failed.
+ * @return Pointer to the RX ring, or NULL if init failed.
  */
-osMessageQueueId_t CAN_IF_GetRxQueueHandle(void);
+CanRing_t *CAN_IF_GetRxRing(void);
+
+/**
+ * @brief Put a frame into the RX pipeline as if CAN1 had received it
+ *        (trace replay, can_replay.h).
+ *
+ * Runs the RX interrupt's bookkeeping (bus statistics, then the RX ring)
+ * with interrupts masked for the copy, so the ring keeps one producer at a
+ * time. The frame bypasses the acceptance filters, the gateway, the trace
+ * recorder and the latest-value slots; it carries no filter match index,
+ * so dispatch takes the ID lookup.
+ *
+ * A payload of more than 8 bytes (CAN_IF_FD) makes an FD frame with bit
+ * rate switch: the DLC code that holds it (CAN_IF_LenToDlc()), the bytes
+ * up to that length zero-filled past @p len.
+ *
+ * @param[in] key  Identifier in CAN_IF_Msg_t::Id format.
+ * @param[in] len  Payload bytes, 0..CAN_IF_MAX_DLEN (longer is cut).
+ * @param[in] fifo CAN_RX_FIFO0 or CAN_RX_FIFO1, as the filters would pick.
+ * @param[in] data @p len payload bytes.
+ *
+ * @return HAL_OK, HAL_BUSY if the ring was full (counted as an overflow,
+ *         as in the interrupt), HAL_ERROR before CAN_IF_Init().
+ */
+HAL_StatusTypeDef CAN_IF_InjectRx(uint32_t key, uint8_t len, uint32_t fifo, const uint8_t *data);
+
+/**
+ * @brief Put a frame taken out of the RX path back into the RX ring
+ *        (delay faults, fault_inj.h).
+ *
+ * As CAN_IF_InjectRx(), but the frame keeps its FIFO, DLC and timestamp
+ * and is not counted in the bus statistics again; its filter match index
+ * becomes CAN_IF_FMI_REINJECTED, so dispatch takes the ID lookup and the
+ * fault engine lets it through.
+ *
+ * @return HAL_OK, HAL_BUSY if the ring was full, HAL_ERROR before
+ *         CAN_IF_Init().
+ */
+HAL_StatusTypeDef CAN_IF_ReinjectRx(const CAN_IF_Msg_t *msg);
+
+/**
+ * @brief Process the latest-value slots written since the last call
+ *        (CanRxTask, after draining the ring).
+ *
+ * Takes the dirty slots highest bit first, each copied out under a short
+ * PRIMASK section, and runs CAN_IF_ProcessRxMsg() on the copy. A slot
+ * that the interrupt rewrites meanwhile comes up again in the same call.
+ * The ring's consumer flag is set again when a slot turns dirty.
+ *
+ * @return Number of frames processed.
+ */
+uint32_t CAN_IF_ProcessLatest(void);
+
+/**
+ * @brief Register a handler for an identifier or identifier range.
+ *
+ * A frame matches when (frameId & mask) == (id & mask). For standard IDs
+ * the registration is expanded into a direct-mapped 2048-entry table, so
+ * dispatch is a single array lookup. Extended IDs live in a small table:
+ * exact IDs are kept sorted and binary-searched, masked ones are scanned.
+ * Later registrations override earlier ones for overlapping standard IDs.
+ *
+ * Call during initialization, before CAN traffic is processed.
+ *
+ * @param[in] id   Identifier; OR with CAN_IF_ID_EXT for a 29-bit ID.
+ * @param[in] mask Bits of @p id that must match (0x7FF / 0x1FFFFFFF = exact).
+ * @param[in] fn   Handler function.
+ * @param[in] ctx  Opaque pointer passed to @p fn.
+ *
+ * @return HAL_OK, or HAL_ERROR if @p fn is NULL or the tables are full.
+ */
+HAL_StatusTypeDef CAN_IF_RegisterHandler(uint32_t id, uint32_t mask,
+                                         CAN_IF_RxHandler_t fn, void *ctx);
+
+/**
+ * @brief Decode the frames of one identifier in the RX interrupt.
+ *
+ * A frame of @p id (not a remote frame) is counted, traced and logged as
+ * any other, then handed to @p decode and dropped: it takes no ring slot
+ * or latest-value slot, is not seen by CanRxTask, its handlers or the
+ * fault engine, and is not decoded in CAN_MODE_SILENT. Several calls of
+ * @p wake can fold into one. Call during initialization.
+ *
+ * @param[in] id     Identifier; OR with CAN_IF_ID_EXT for a 29-bit ID.
+ * @param[in] decode Decoder, RAMFUNC.
+ * @param[in] wake   Its wake function, RAMFUNC; NULL for none.
+ * @param[in] ctx    Opaque pointer passed to both.
+ *
+ * @return HAL_OK, or HAL_ERROR if @p decode is NULL, the table is full or
+ *         CAN_IF_ISR_DECODERS is 0: the caller then handles the ID in
+ *         CanRxTask as before.
+ */
+HAL_StatusTypeDef CAN_IF_RegisterIsrDecoder(uint32_t id, CAN_IF_IsrDecoder_t decode,
+                                            CAN_IF_IsrWake_t wake, void *ctx);
+
+/**
+ * @brief Register the consumer of reassembled messages for an identifier.
+ *
+ * A later registration for the same @p id replaces the earlier one.
+ * Call during initialization.
+ *
+ * @return HAL_OK, or HAL_ERROR if @p fn is NULL or the table is full.
+ */
+HAL_StatusTypeDef CAN_IF_RegisterPduHandler(uint32_t id, CAN_IF_PduHandler_t fn, void *ctx);
+
+/**
+ * @brief Hand a reassembled message to its consumer without copying.
+ *
+ * Called by transport layers (running in CanRxTask) once a multi-frame
+ * message is complete. @p data must come from MemPool_Alloc(); ownership
+ * passes to the handler, or the block is freed here if no handler is
+ * registered for @p id.
+ *
+ * @return HAL_OK if a handler took the message, HAL_ERROR otherwise.
+ */
+HAL_StatusTypeDef CAN_IF_DeliverPdu(uint32_t id, uint8_t *data, uint16_t len);
 
 /**
  * @brief Process a received CAN message at thread level.
  *
- * Called by CanRxTask after popping a message from the queue.
+ * Called by CanRxTask for each slot taken from the RX ring. Logs the frame
+ * (when enabled) and dispatches it to the registered handler. Frames that
+ * were accepted by an exact-ID hardware filter are dispatched through the
+ * filter match index without an ID lookup.
+ *
+ * Also records the frame's latency (see can_lat.h).
  *
  * @param[in] msg Pointer to a valid CAN_IF_Msg_t instance.
  */
 void CAN_IF_ProcessRxMsg(const CAN_IF_Msg_t *msg);
 
+/**
+ * @brief CAN1/CAN2 TX interrupt body, after HAL_CAN_IRQHandler(): queues the
+ *        frames submitted since the last run and fills the free mailboxes.
+ *
+ * The TX interrupt is the single owner of the software queue and the
+ * mailboxes; CAN_IF_Transmit() and CAN_IF_Forward() pend it.
+ *
+ * @param[in] bus CAN_IF_BUS1 or CAN_IF_BUS2.
+ */
+void CAN_IF_TxIRQHandler(uint32_t bus);
+
+/**
+ * @brief CAN1/CAN2 RX0/RX1 interrupt body with CAN_IF_RX_FAST_IRQ, in place
+ *        of HAL_CAN_IRQHandler(): moves the FIFO into the ring (CAN1) or
+ *        through the gateway (CAN2), no kernel call.
+ *
+ * @param[in] bus  CAN_IF_BUS1 or CAN_IF_BUS2.
+ * @param[in] fifo CAN_RX_FIFO0 or CAN_RX_FIFO1.
+ */
+void CAN_IF_RxIRQHandler(uint32_t bus, uint32_t fifo);
+
+/**
+ * @brief CAN_IF_RX_SWI_IRQn body with CAN_IF_RX_FAST_IRQ: wakes CanRxTask,
+ *        reports a failed FIFO read.
+ */
+void CAN_IF_RxSwiIRQHandler(void);
+
 #ifdef __cplusplus
 }
 #endif
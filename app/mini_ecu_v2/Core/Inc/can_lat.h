@@ -0,0 +1,129 @@
+/**
+ * @file    can_lat.h
+ * @brief   Per-ID CAN latency histograms on the DWT cycle counter.
+ *
+ * Two paths are measured for every identifier seen, up to CAN_LAT_MAX_IDS:
+ *
+ *   - ISR -> task: from the FIFO interrupt putting the frame into the RX
+ *     ring (CAN_IF_Msg_t::EnqCycles) to CanRxTask taking it out,
+ *     i.e. ring wait plus scheduling.
+ *   - TX -> RX: from CAN_IF_Transmit() accepting a frame to its loopback
+ *     copy arriving in the RX interrupt, i.e. software queue, arbitration
+ *     and the frame on the wire. Only measured in a loopback mode; with
+ *     several frames of one ID in flight only the first is timed.
+ *
+ * Each path keeps count, mean, max, the number over CAN_LAT_BUDGET_US and a
+ * log2 histogram in microseconds. "can lat" shows them, "can lat reset"
+ * clears them.
+ *
+ * The bxCAN SOF timestamp (TTCM, CAN_IF_MSG_TIME()) counts bit times
+ * on a 16-bit counter with no relation to CYCCNT, so it is carried with the
+ * frame and logged but not mixed into these figures. CYCCNT stops while the
+ * core sleeps (low_power.h); a TX -> RX interval that spans a tickless sleep
+ * would read short, which does not happen for a frame already on the wire
+ * since the sleep needs several idle ticks.
+ *
+ * RX recording runs in CanRxTask only, TX stamps inside CAN_IF_Transmit()'s
+ * critical section.
+ *
+ * Compiled out with CAN_LAT_ENABLE = 0 (default when NDEBUG is defined),
+ * which also drops the stamp word from the RX ring slots.
+ */
+
+#ifndef CAN_LAT_H
+#define CAN_LAT_H
+
+#include "main.h"
+#include "perf.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Stamp and record latencies; follows the perf probes by default. */
+#ifndef CAN_LAT_ENABLE
+#define CAN_LAT_ENABLE      PERF_ENABLE
+#endif
+
+/** Identifiers tracked; frames of further IDs are not measured. */
+#ifndef CAN_LAT_MAX_IDS
+#define CAN_LAT_MAX_IDS     8U
+#endif
+
+/** Latency budget (us); samples above it are counted per path. */
+#ifndef CAN_LAT_BUDGET_US
+#define CAN_LAT_BUDGET_US   1000U
+#endif
+
+/** Bucket b counts latencies in [2^(b-1), 2^b) us, the last everything above. */
+#define CAN_LAT_BUCKETS     14U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    CAN_LAT_ISR_TO_TASK = 0,
+    CAN_LAT_TX_TO_RX,
+    CAN_LAT_PATHS
+} CanLat_Path_t;
+
+/**
+ * @brief Statistics of one path of one identifier.
+ */
+typedef struct
+{
+    uint32_t count;
+    uint32_t overBudget;
+    uint32_t maxUs;
+    uint64_t sumUs;
+    uint32_t hist[CAN_LAT_BUCKETS];
+} CanLat_Stats_t;
+
+/**
+ * @brief Register the "can lat" commands. Called by CAN_IF_Init().
+ */
+void CanLat_Init(void);
+
+/**
+ * @brief A frame for @p id was accepted for transmission at @p cycles.
+ *
+ * @param[in] id CAN_IF identifier (CAN_IF_ID_EXT for 29-bit).
+ */
+void CanLat_TxRequest(uint32_t id, uint32_t cycles);
+
+/**
+ * @brief A frame for @p id was dequeued: record both paths.
+ *
+ * @param[in] id          CAN_IF identifier.
+ * @param[in] enqCycles   DWT stamp of the RX interrupt.
+ * @param[in] deqCycles   DWT stamp of CanRxTask taking the frame.
+ * @param[in] loopback    Non-zero if the frame may be our own echo.
+ */
+void CanLat_Rx(uint32_t id, uint32_t enqCycles, uint32_t deqCycles, uint8_t loopback);
+
+/**
+ * @brief Copy the statistics of the @p index-th tracked identifier.
+ *
+ * @param[out] id    Identifier.
+ * @param[out] stats CAN_LAT_PATHS entries.
+ * @return HAL_OK, or HAL_ERROR past the last tracked identifier.
+ */
+HAL_StatusTypeDef CanLat_Get(uint32_t index, uint32_t *id, CanLat_Stats_t *stats);
+
+/**
+ * @brief Forget all identifiers and their statistics.
+ */
+void CanLat_Reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_LAT_H */
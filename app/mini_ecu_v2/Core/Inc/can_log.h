@@ -0,0 +1,124 @@
+/**
+ * @file    can_log.h
+ * @brief   Log streams over CAN: the "can" log transport for boards with
+ *          no UART cable, capped to a share of the bus.
+ *
+ * A stream moved to the "can" transport (log.h, "log transport") is sent
+ * as frames on CAN_LOG_ID: log lines or their tokenized frames, CLI
+ * output (including the "rtos trace dump" records, rtos_trace.h) and the
+ * binary telemetry stream. Each frame carries up to 7 bytes of one stream:
+ *
+ *   | Byte | Content                                              |
+ *   |------|------------------------------------------------------|
+ *   |    0 | bits 7..6 Log_Stream_t, bits 5..0 sequence number    |
+ *   | 1..7 | stream bytes (DLC - 1 of them)                       |
+ *
+ * The sequence number counts every frame on CAN_LOG_ID modulo 64, and
+ * also the frames of bytes dropped here, so a gap on the receiver shows
+ * lost data; tools/can_log.py splits a candump log back into the streams.
+ *
+ * LogTask only copies a chunk into a CAN_LOG_RING_SIZE ring (records of
+ * stream, length and bytes) and never waits for the bus: a chunk that does
+ * not fit is dropped and counted, as with "rtt". The frames go out from
+ * the TX scheduler (can_sched.h), as one more entry registered after the
+ * cyclic frames, so in every run the cyclic frames take the burst first:
+ *
+ *   - every CAN_LOG_PERIOD_MS while bytes are queued it sends up to
+ *     CAN_LOG_BURST frames, as far as a token bucket of
+ *     CAN_LOG_LOAD_PCT % of the bitrate allows (CAN_LOG_FRAME_BITS per
+ *     frame, the stuffed worst case), so the log never takes more of the
+ *     bus than that however much is logged,
+ *   - CAN_LOG_ID (0x7F8 + node) is above every other ID this ECU sends,
+ *     the diagnostic responses included, so the TX queue and the bus
+ *     arbitration let the other frames pass first as well.
+ *
+ *   can log                         queue, budget and counters
+ */
+
+#ifndef CAN_LOG_H
+#define CAN_LOG_H
+
+#include "main.h"
+#include "can_filters.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = "can" log transport built in. */
+#ifndef CAN_LOG_ENABLE
+#define CAN_LOG_ENABLE          1
+#endif
+
+/** Standard ID of the log frames; the lowest priority on the bus. */
+#ifndef CAN_LOG_ID
+#define CAN_LOG_ID              (0x7F8U + CAN_NODE_ID)
+#endif
+
+/** Share of the bitrate the log frames may take (percent). */
+#ifndef CAN_LOG_LOAD_PCT
+#define CAN_LOG_LOAD_PCT        5U
+#endif
+
+/** Scheduler gap between two sends, and the frames one send may queue. */
+#ifndef CAN_LOG_PERIOD_MS
+#define CAN_LOG_PERIOD_MS       10U
+#endif
+#ifndef CAN_LOG_BURST
+#define CAN_LOG_BURST           2U
+#endif
+
+/** Bits one 8-byte standard frame takes at most, stuffing and IFS included. */
+#define CAN_LOG_FRAME_BITS      135U
+
+/** Bytes held for the bus (power of two). */
+#ifndef CAN_LOG_RING_SIZE
+#define CAN_LOG_RING_SIZE       1024U
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Counters of the transport.
+ */
+typedef struct
+{
+    uint32_t frames;        /**< Frames queued for the bus. */
+    uint32_t bytes;         /**< Stream bytes in them. */
+    uint32_t dropped;       /**< Stream bytes dropped: ring full. */
+    uint32_t throttled;     /**< Sends the bus-load budget held back. */
+    uint32_t busy;          /**< Frames refused by a full TX queue (retried). */
+    uint32_t queued;        /**< Bytes in the ring now. */
+    uint32_t peak;          /**< Most bytes in the ring. */
+} CanLog_Stats_t;
+
+/**
+ * @brief Add the log frame to the TX scheduler and register "can log".
+ *        Call after the cyclic frames are registered (CanSched_Add()).
+ */
+HAL_StatusTypeDef CanLog_Init(void);
+
+/**
+ * @brief Queue @p len bytes of @p stream for the bus (LogTask, or the
+ *        early-boot drain; one writer). Drops the whole chunk if the ring
+ *        has no room for it. Never blocks.
+ */
+void CanLog_Write(uint8_t stream, const uint8_t *data, uint32_t len);
+
+/**
+ * @brief Copy the counters.
+ */
+void CanLog_GetStats(CanLog_Stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_LOG_H */
@@ -0,0 +1,201 @@
+/**
+ * @file    can_nm.h
+ * @brief   CAN network management in the style of AUTOSAR CanNm: NM PDUs
+ *          broadcast while awake, coordinated bus sleep, Stop mode asleep.
+ *
+ * Every node that needs the bus sends an NM PDU every CAN_NM_MSG_CYCLE_MS
+ * on CAN_NM_BASE_ID + its node ID (NmPdu, Core/mini_ecu.dbc). A node that
+ * no longer needs the bus stops sending but stays awake while it hears
+ * others; once no NM PDU has been on the bus for CAN_NM_TIMEOUT_MS every
+ * node knows that no node needs it any more. All of them count from the
+ * same last PDU, so they stop their application frames and go to sleep
+ * together, CAN_NM_WAIT_SLEEP_MS later, to within one 100 ms raster.
+ *
+ *   BUS_SLEEP ---- wake-up -----> REPEAT_MESSAGE (CAN_NM_REPEAT_MS)
+ *       ^                           |          ^
+ *       |                    needed |          | repeat request
+ *       |                           v          |
+ *       |                         NORMAL <---> READY_SLEEP
+ *       |                           (needed / released)
+ *       |                                      | no NM PDU for CAN_NM_TIMEOUT_MS
+ *       |                                      v
+ *       +--- CAN_NM_WAIT_SLEEP_MS ------- PREPARE_BUS_SLEEP
+ *
+ *   - REPEAT_MESSAGE: sends CAN_NM_IMMEDIATE_TX PDUs at once (one per
+ *     pass), then cyclic ones, so every node learns about the new one.
+ *   - NORMAL: the bus is needed here; cyclic PDUs.
+ *   - READY_SLEEP: not needed here; no PDUs, awake while others send.
+ *   - PREPARE_BUS_SLEEP: the TX scheduler is suspended (can_sched.h), the
+ *     bus goes quiet; an NM PDU or a local need goes back to REPEAT.
+ *   - BUS_SLEEP: CAN1 in its sleep mode (CAN_IF_Sleep()), its RX pin
+ *     armed as an EXTI line and the idle task allowed into Stop mode
+ *     (LowPower_SetStop()).
+ *
+ * The bus is needed here while "nm request" (the default at boot, the
+ * bench's key on) is set, while the vehicle moves and for one pass after
+ * a press of B1 (pedal.h). A node that measures or needs the other nodes
+ * awake sets the Repeat Message Request bit ("nm repeat"); every awake
+ * node then goes to REPEAT_MESSAGE and announces itself again.
+ *
+ * Wake-up from BUS_SLEEP: any frame on the bus. The RX pin's falling edge
+ * (EXTI line 11) ends Stop mode; the core is on the PLL again within about
+ * half a millisecond (low_power.h), but the frame that woke it is lost,
+ * as CanNm allows. The EXTI handler takes the controller out of its sleep
+ * mode at once (CAN_IF_WakeUpFromIsr()), so it receives from the next frame
+ * on; "power" shows the time from the wake-up to that frame. Sends wait for
+ * the next 100 ms pass, which completes the wake-up and sends the first PDU
+ * of this node, so local and bus wake-ups are on the bus within 100 ms plus
+ * the Stop exit. "nm" shows both delays, the last and the
+ * worst since boot.
+ *
+ * This is the broadcast scheme of CanNm, not the logical ring of OSEK NM:
+ * no token is passed and a lost PDU only delays the sleep by one cycle.
+ *
+ *   nm                   state, request, PDU counters, wake-up delays
+ *                        and the nodes heard
+ *   nm request           the bus is needed here (key on)
+ *   nm release           not needed here any more (key off)
+ *   nm repeat            send a Repeat Message Request
+ */
+
+#ifndef CAN_NM_H
+#define CAN_NM_H
+
+#include "main.h"
+#include "can_filters.h"
+#include "can_signals.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** First NM PDU identifier; node n sends on CAN_NM_BASE_ID + n. */
+#define CAN_NM_BASE_ID          CANSIG_NM_PDU_ID
+
+/** Node IDs in use: 0x500..0x53F, one acceptance filter (can_filters.h). */
+#define CAN_NM_NODE_MAX         63U
+#define CAN_NM_ID_MASK          0x7C0U
+
+/** Node ID of this ECU. */
+#ifndef CAN_NM_NODE
+#define CAN_NM_NODE             CAN_NODE_ID
+#endif
+
+/** Cycle of the NM PDU in REPEAT_MESSAGE and NORMAL (ms). */
+#ifndef CAN_NM_MSG_CYCLE_MS
+#define CAN_NM_MSG_CYCLE_MS     1000U
+#endif
+
+/** No NM PDU for this long in READY_SLEEP: prepare bus sleep (ms). */
+#ifndef CAN_NM_TIMEOUT_MS
+#define CAN_NM_TIMEOUT_MS       2000U
+#endif
+
+/** Time in REPEAT_MESSAGE (ms). */
+#ifndef CAN_NM_REPEAT_MS
+#define CAN_NM_REPEAT_MS        1500U
+#endif
+
+/** Quiet bus in PREPARE_BUS_SLEEP before bus sleep (ms). */
+#ifndef CAN_NM_WAIT_SLEEP_MS
+#define CAN_NM_WAIT_SLEEP_MS    1500U
+#endif
+
+/** PDUs sent at once, one per pass, on entering REPEAT_MESSAGE. */
+#ifndef CAN_NM_IMMEDIATE_TX
+#define CAN_NM_IMMEDIATE_TX     3U
+#endif
+
+/** Bus needed at boot ("nm request"); 0 lets the bus sleep unless driven. */
+#ifndef CAN_NM_REQUEST_AT_BOOT
+#define CAN_NM_REQUEST_AT_BOOT  1
+#endif
+
+/** Let the core stop (Stop mode) in BUS_SLEEP; 0 keeps it in Sleep mode. */
+#ifndef CAN_NM_STOP
+#define CAN_NM_STOP             1
+#endif
+
+_Static_assert(CAN_NM_NODE <= CAN_NM_NODE_MAX, "CAN_NM_NODE must be 0..63");
+_Static_assert((CAN_NM_BASE_ID & CAN_NM_ID_MASK) == CAN_NM_BASE_ID,
+               "CAN_NM_BASE_ID must be aligned to the node range");
+_Static_assert(CAN_NM_TIMEOUT_MS > CAN_NM_MSG_CYCLE_MS,
+               "CAN_NM_TIMEOUT_MS must exceed the PDU cycle");
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/** NM states; also the nm_state signal of the PDU. */
+typedef enum
+{
+    CAN_NM_BUS_SLEEP = 0,
+    CAN_NM_REPEAT_MESSAGE,
+    CAN_NM_NORMAL,
+    CAN_NM_READY_SLEEP,
+    CAN_NM_PREPARE_BUS_SLEEP
+} CanNm_State_t;
+
+/**
+ * @brief Network management figures since boot.
+ */
+typedef struct
+{
+    CanNm_State_t state;
+    uint8_t  requested;      /**< Bus needed here at the last pass. */
+    uint32_t txPdus;         /**< NM PDUs sent. */
+    uint32_t rxPdus;         /**< NM PDUs of other nodes received. */
+    uint32_t sleeps;         /**< Bus sleeps entered. */
+    uint32_t busWakes;       /**< Woken by the bus. */
+    uint32_t localWakes;     /**< Woken by a local need. */
+    uint32_t wakeRxMs;       /**< Last wake-up to the first NM PDU received. */
+    uint32_t wakeRxMaxMs;
+    uint32_t wakeTxMs;       /**< Last wake-up to the first own NM PDU sent. */
+    uint32_t wakeTxMaxMs;
+    uint64_t nodes;          /**< Node IDs heard since boot, bit n = node n. */
+} CanNm_Stats_t;
+
+/**
+ * @brief Take the NM PDU range, set up the wake-up EXTI line and register
+ *        "nm". Call once after CAN_IF_Init(), before the scheduler starts.
+ *
+ * @return HAL_OK, or HAL_ERROR if the RX handler cannot be registered.
+ */
+HAL_StatusTypeDef CanNm_Init(void);
+
+/**
+ * @brief 100 ms runnable (raster.h): the state machine and the PDUs.
+ */
+void CanNm_Event100ms(void);
+
+/**
+ * @brief Need the bus here (@p on != 0) or release it (any task).
+ */
+void CanNm_Request(uint8_t on);
+
+/**
+ * @brief Send a Repeat Message Request with the next PDU and go to
+ *        REPEAT_MESSAGE (waking the bus if it sleeps).
+ */
+void CanNm_RepeatMessageRequest(void);
+
+/**
+ * @brief EXTI15_10 interrupt (CAN1_RX on line 11 while the bus sleeps).
+ */
+void CanNm_ExtiIRQHandler(void);
+
+/**
+ * @brief Copy the figures.
+ */
+void CanNm_GetStats(CanNm_Stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_NM_H */
@@ -0,0 +1,126 @@
+/**
+ * @file    can_replay.h
+ * @brief   CAN trace replay into the RX pipeline ("can replay", SIL --replay).
+ *
+ * A recorded trace is fed back through the acceptance filter table and
+ * CAN_IF_InjectRx() into the RX ring, so CanRxTask, the dispatch table and
+ * every handler see the frames as on the bus, with the bus statistics
+ * counting them. Frames the filters would reject are left out; the FIFO
+ * of the first matching entry is recorded in the frame.
+ *
+ * Timing:
+ *
+ *   - paced (speed > 0): each record is injected when the time since its
+ *     first record, divided by the speed in 1/1000 (1000 = original), has
+ *     passed. Records are taken per kernel tick, so frames less than a
+ *     millisecond apart arrive as a burst, as they would from the FIFO
+ *     interrupt after a busy millisecond. A full ring drops the frame and
+ *     counts it, as the interrupt does.
+ *   - fast (CAN_REPLAY_FAST): as fast as the consumer takes them; the
+ *     engine waits while the ring is full, so nothing is dropped and the
+ *     rate is that of the RX path.
+ *
+ * The engine is source-agnostic and clocked by its caller: the target's
+ * "can replay" pulls the records held by the trace recorder (can_trace.h,
+ * recorded on the ECU or loaded by tools/can_replay.py with "can trace
+ * add"), and the SIL build (sil/bench.c --replay) streams a candump log
+ * through the same code in simulated time.
+ *
+ *   can replay [<speed>|fast]     replay the trace ring; <speed> is a
+ *                                 factor (1 = original, 10 = 10x, 0.5)
+ *
+ * The command blocks CliTask until the trace is through and prints the
+ * frames replayed, those the filters rejected, ring drops or waits, the
+ * worst lateness behind the schedule and the rate achieved.
+ */
+
+#ifndef CAN_REPLAY_H
+#define CAN_REPLAY_H
+
+#include "main.h"
+#include "can_trace.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Frames one CanReplay_Poll() injects at most in fast mode. */
+#ifndef CAN_REPLAY_BATCH
+#define CAN_REPLAY_BATCH        32U
+#endif
+
+/** "can replay fast" gives up when the ring has not moved for this long (ms). */
+#ifndef CAN_REPLAY_STALL_MS
+#define CAN_REPLAY_STALL_MS     1000U
+#endif
+
+/** Speed value of the fast mode. */
+#define CAN_REPLAY_FAST         0U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Record source: fill @p rec with the next record.
+ *
+ * @return 1 if a record was written, 0 at the end of the trace.
+ */
+typedef uint8_t (*CanReplay_Next_t)(void *ctx, CanTrace_Rec_t *rec);
+
+/**
+ * @brief Counters of the current or last replay.
+ */
+typedef struct
+{
+    uint32_t frames;        /**< Injected into the RX ring. */
+    uint32_t filtered;      /**< Rejected by the acceptance filter table. */
+    uint32_t ringFull;      /**< Paced: dropped by the full RX ring. */
+    uint32_t waits;         /**< Fast: polls that found the ring full. */
+    uint32_t traceMs;       /**< Span of the records so far. */
+    uint32_t elapsedMs;     /**< Time the replay took (done) or has taken. */
+    uint32_t maxLateMs;     /**< Paced: worst delay behind the schedule. */
+    uint8_t  done;          /**< Source exhausted. */
+} CanReplay_Stats_t;
+
+/**
+ * @brief Register "can replay". Call after CAN_IF_Init() and CLI_IF_Init().
+ *
+ * @return HAL_OK.
+ */
+HAL_StatusTypeDef CanReplay_Init(void);
+
+/**
+ * @brief Start a replay from @p next at @p nowMs.
+ *
+ * @param[in] next  Record source.
+ * @param[in] ctx   Passed to @p next.
+ * @param[in] speed 1/1000 of the original rate (1000 = original), or
+ *                  CAN_REPLAY_FAST.
+ * @param[in] nowMs Current time in ms (HAL tick, or the SIL clock).
+ */
+void CanReplay_Begin(CanReplay_Next_t next, void *ctx, uint32_t speed, uint32_t nowMs);
+
+/**
+ * @brief Inject every record due at @p nowMs (paced), or up to
+ *        CAN_REPLAY_BATCH while the ring has room (fast).
+ *
+ * @return 1 while records remain, 0 once the source is exhausted.
+ */
+uint8_t CanReplay_Poll(uint32_t nowMs);
+
+/**
+ * @brief Copy the counters of the current or last replay.
+ */
+void CanReplay_GetStats(CanReplay_Stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_REPLAY_H */
@@ -0,0 +1,187 @@
+/**
+ * @file    can_ring.h
+ * @brief   Lock-free single-producer / single-consumer ring buffer.
+ *
+ * Used to hand CAN frames from the RX interrupt to CanRxTask without
+ * going through an RTOS queue. Properties:
+ *
+ *   - Capacity is a power of two, indices are free-running and masked.
+ *   - Zero-copy: the producer reserves a slot, fills it in place and
+ *     commits it; the consumer peeks a slot, uses it in place and
+ *     releases it.
+ *   - The consumer thread is woken with a thread flag (task notification
+ *     underneath) only when the ring goes from empty to non-empty. A
+ *     producer that must not call the kernel (an interrupt above
+ *     configMAX_SYSCALL_INTERRUPT_PRIORITY) installs a hook instead,
+ *     which pends an interrupt that calls CanRing_Notify().
+ *   - High-water mark and overflow counters are kept per ring.
+ *
+ * Exactly one producer context and one consumer context are allowed.
+ * Storage is provided by the caller so each ring can be statically sized.
+ */
+
+#ifndef CAN_RING_H
+#define CAN_RING_H
+
+#include "main.h"
+#include "cmsis_os2.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Alignment applied to ring control blocks and slot storage.
+ *
+ * The F4 has no data cache, but keeping head/tail on separate 32-byte
+ * lines makes the layout safe to carry over to cached cores (M7).
+ */
+#define CAN_RING_ALIGN  32U
+
+/** Attribute used for ring storage arrays declared by users of this module. */
+#define CAN_RING_ALIGNED __attribute__((aligned(CAN_RING_ALIGN)))
+
+/**
+ * @brief Ring control block.
+ *
+ * @note Do not access fields directly; use the CanRing_* API.
+ */
+typedef struct
+{
+    volatile uint32_t head CAN_RING_ALIGNED; /**< Written by producer only. */
+    uint32_t          highWater;             /**< Peak fill level observed. */
+    uint32_t          overflows;             /**< Reserve attempts on a full ring. */
+
+    volatile uint32_t tail CAN_RING_ALIGNED; /**< Written by consumer only. */
+
+    uint8_t          *storage;               /**< Slot storage (capacity * elemSize). */
+    uint32_t          elemSize;              /**< Size of one slot in bytes. */
+    uint32_t          mask;                  /**< capacity - 1. */
+    osThreadId_t      consumer;              /**< Thread to notify, may be NULL. */
+    uint32_t          notifyFlags;           /**< Thread flags set on empty -> non-empty. */
+    void            (*notifyHook)(void);     /**< Called instead when set. */
+} CanRing_t;
+
+/**
+ * @brief Snapshot of ring statistics.
+ */
+typedef struct
+{
+    uint32_t capacity;   /**< Number of slots. */
+    uint32_t count;      /**< Current fill level. */
+    uint32_t highWater;  /**< Peak fill level since init / last reset. */
+    uint32_t overflows;  /**< Frames dropped because the ring was full. */
+} CanRing_Stats_t;
+
+/**
+ * @brief Initialize a ring over caller-provided storage.
+ *
+ * @param[out] ring     Ring control block.
+ * @param[in]  storage  Slot storage, at least capacity * elemSize bytes.
+ * @param[in]  elemSize Size of one slot in bytes.
+ * @param[in]  capacity Number of slots; must be a power of two >= 2.
+ *
+ * @return HAL_OK on success, HAL_ERROR on invalid arguments.
+ */
+HAL_StatusTypeDef CanRing_Init(CanRing_t *ring, void *storage,
+                               uint32_t elemSize, uint32_t capacity);
+
+/**
+ * @brief Register the thread woken when the ring becomes non-empty.
+ *
+ * @param[in,out] ring   Ring control block.
+ * @param[in]     thread Consumer thread (NULL disables notification).
+ * @param[in]     flags  Thread flags to set on the consumer.
+ */
+void CanRing_SetConsumer(CanRing_t *ring, osThreadId_t thread, uint32_t flags);
+
+/**
+ * @brief Call @p hook on empty -> non-empty instead of setting the flags.
+ *
+ * For a producer running above configMAX_SYSCALL_INTERRUPT_PRIORITY: the
+ * hook pends a lower-priority interrupt, and that interrupt calls
+ * CanRing_Notify(). The hook runs in the producer's context and must not
+ * call the kernel.
+ *
+ * @param[in,out] ring Ring control block.
+ * @param[in]     hook Hook, or NULL to set the flags directly again.
+ */
+void CanRing_SetNotifyHook(CanRing_t *ring, void (*hook)(void));
+
+/**
+ * @brief Set the consumer's thread flags (interrupt or task context at or
+ *        below configMAX_SYSCALL_INTERRUPT_PRIORITY).
+ */
+void CanRing_Notify(CanRing_t *ring);
+
+/**
+ * @brief Reserve the next free slot (producer side).
+ *
+ * The slot is not visible to the consumer until CanRing_Commit().
+ *
+ * @return Pointer to the slot, or NULL if the ring is full (counted as overflow).
+ */
+void *CanRing_Reserve(CanRing_t *ring);
+
+/**
+ * @brief Publish the slot obtained from the last CanRing_Reserve().
+ *
+ * Notifies the consumer if the ring was empty before this commit.
+ */
+void CanRing_Commit(CanRing_t *ring);
+
+/**
+ * @brief Get the oldest committed slot (consumer side).
+ *
+ * @return Pointer to the slot, or NULL if the ring is empty.
+ */
+void *CanRing_Peek(CanRing_t *ring);
+
+/**
+ * @brief Return the slot obtained from the last CanRing_Peek() to the producer.
+ */
+void CanRing_Release(CanRing_t *ring);
+
+/**
+ * @brief Get up to @p max committed slots at once (consumer side).
+ *
+ * The slots are contiguous, so the run stops at the end of the storage;
+ * the next call continues from the start.
+ *
+ * @param[in]  ring  Ring control block.
+ * @param[out] first First slot of the run.
+ * @param[in]  max   Largest run wanted.
+ * @return Number of slots in the run, 0 if the ring is empty.
+ */
+uint32_t CanRing_PeekBatch(CanRing_t *ring, void **first, uint32_t max);
+
+/**
+ * @brief Return @p count slots from the last CanRing_PeekBatch() with one
+ *        tail update.
+ */
+void CanRing_ReleaseBatch(CanRing_t *ring, uint32_t count);
+
+/**
+ * @brief Current number of committed, unreleased slots.
+ */
+uint32_t CanRing_Count(const CanRing_t *ring);
+
+/**
+ * @brief Copy ring statistics.
+ *
+ * @param[in]  ring  Ring control block.
+ * @param[out] stats Destination for the snapshot.
+ */
+void CanRing_GetStats(const CanRing_t *ring, CanRing_Stats_t *stats);
+
+/**
+ * @brief Reset high-water mark and overflow counters.
+ */
+void CanRing_ResetStats(CanRing_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_RING_H */
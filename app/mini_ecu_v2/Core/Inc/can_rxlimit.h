@@ -0,0 +1,151 @@
+/**
+ * @file    can_rxlimit.h
+ * @brief   Per-filter RX rate limiting and flood protection.
+ *
+ * A node that floods one ID would otherwise fill the RX ring and keep
+ * CanRxTask busy with it, starving every other ID. Each entry of
+ * CAN_FILTER_TABLE gets a token bucket instead, checked by the RX
+ * interrupt right after the frame is read (can_drain_fifo()):
+ *
+ *   1. The filter match index leads to the entry's bucket. The bucket
+ *      refills at CAN_RXLIMIT_RATE frames/s (or the entry's line in
+ *      CAN_RXLIMIT_TABLE) up to its burst; a frame takes one token.
+ *   2. A frame without a token is dropped before the ring: it takes no
+ *      slot and no CanRxTask time. It is still counted by can_stats
+ *      ("can stats" shows the offender's rate) and forwarded by the
+ *      gateway, which has its own queue.
+ *   3. When an entry keeps dropping for CAN_RXLIMIT_FLOOD_MS (no gap
+ *      longer than CAN_RXLIMIT_QUIET_MS), the interrupt flags CanTxTask,
+ *      and CanRxLimit_Run() mutes the entry's hardware filter
+ *      (CanFilters_SetMuted()) for CAN_RXLIMIT_MUTE_MS. The flood then
+ *      costs no interrupts at all; the other entries of the bank stay.
+ *
+ * All of it is bounded per frame: an array lookup, HAL_GetTick() and a
+ * multiply, no divide, from SRAM. Entries with rate 0 are not limited.
+ * "can rxlimit" lists the limits, drops per entry with the last dropped
+ * ID (a masked entry covers many), and the muted entries.
+ */
+
+#ifndef CAN_RXLIMIT_H
+#define CAN_RXLIMIT_H
+
+#include "main.h"
+#include "cmsis_os2.h"
+#include "can_filters.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Default sustained rate per table entry (frames/s); 0 = not limited. */
+#ifndef CAN_RXLIMIT_RATE
+#define CAN_RXLIMIT_RATE      1000U
+#endif
+
+/** Default burst per table entry (frames accepted back to back). */
+#ifndef CAN_RXLIMIT_BURST
+#define CAN_RXLIMIT_BURST     32U
+#endif
+
+/**
+ * Entries with their own limit: X(id, rate, burst), @c id as in
+ * CAN_FILTER_TABLE (the entry's id field, | CAN_IF_ID_EXT for 29-bit).
+ * The physical diagnostic requests stay unlimited, since uds_stage.py
+ * streams TransferData with block size 0 and one lost Consecutive Frame
+ * fails the block. The loopback bench (can_bench.h) counts its own losses.
+ */
+#ifndef CAN_RXLIMIT_TABLE
+#define CAN_RXLIMIT_TABLE(X)                                                \
+    X(0x7E0U + CAN_NODE_ID, 0U, 0U)   /* UDS physical requests (uds.h) */    \
+    X(0x7F0U,               0U, 0U)   /* loopback bench (can_bench.h) */
+#endif
+
+/** Drops for this long without a pause make a flood (ms). */
+#ifndef CAN_RXLIMIT_FLOOD_MS
+#define CAN_RXLIMIT_FLOOD_MS  1000U
+#endif
+
+/** A pause this long between drops ends a flood (ms). */
+#ifndef CAN_RXLIMIT_QUIET_MS
+#define CAN_RXLIMIT_QUIET_MS  100U
+#endif
+
+/** How long a flooding entry's filter is muted (ms); 0 = never mute. */
+#ifndef CAN_RXLIMIT_MUTE_MS
+#define CAN_RXLIMIT_MUTE_MS   5000U
+#endif
+
+/** Thread flag set on CanTxTask by the interrupt when a flood is found. */
+#define CAN_RXLIMIT_FLAG      0x0010U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Counters of one table entry.
+ */
+typedef struct
+{
+    uint32_t rate;        /**< Frames/s; 0 = not limited. */
+    uint32_t burst;       /**< Bucket size in frames. */
+    uint32_t dropped;     /**< Frames dropped by the bucket. */
+    uint32_t lastKey;     /**< CAN_IF_Msg_t::Id of the last dropped frame. */
+    uint32_t floods;      /**< Floods found (CAN_RXLIMIT_FLOOD_MS of drops). */
+    uint32_t mutes;       /**< Times the filter was muted. */
+    uint32_t mutedMs;     /**< Time left muted; 0 if accepting. */
+} CanRxLimit_Stats_t;
+
+/**
+ * @brief Set the limits from CAN_RXLIMIT_TABLE and register "can rxlimit".
+ *        Called by CAN_IF_Init() before the filters are applied.
+ */
+void CanRxLimit_Init(void);
+
+/**
+ * @brief Map the filter match indices to their buckets again and forget
+ *        all mutes. Called after every filter apply, with CAN1 stopped.
+ */
+void CanRxLimit_Rebuild(void);
+
+/**
+ * @brief Register the task that runs CanRxLimit_Run() (CanTxTask).
+ */
+void CanRxLimit_SetConsumer(osThreadId_t thread);
+
+/**
+ * @brief RX interrupt: may this frame go on?
+ *
+ * @param[in] fifo CAN_RX_FIFO0 or CAN_RX_FIFO1.
+ * @param[in] fmi  Filter match index of the frame.
+ * @param[in] key  CAN_IF_Msg_t::Id of the frame, kept for the stats.
+ * @return 1 to accept, 0 to drop.
+ */
+uint8_t CanRxLimit_Admit(uint32_t fifo, uint32_t fmi, uint32_t key);
+
+/**
+ * @brief Mute flooding entries and resume them when their time is up
+ *        (CanTxTask only).
+ *
+ * @param[in] nowMs Kernel tick.
+ * @return Milliseconds until the next resume (osWaitForever if none).
+ */
+uint32_t CanRxLimit_Run(uint32_t nowMs);
+
+/**
+ * @brief Copy the counters of table entry @p entry.
+ *
+ * @return 0 on success, -1 for an unknown entry.
+ */
+int CanRxLimit_GetStats(uint32_t entry, CanRxLimit_Stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_RXLIMIT_H */
@@ -0,0 +1,138 @@
+/**
+ * @file    can_sched.h
+ * @brief   Cyclic and on-change CAN TX scheduler.
+ *
+ * Periodic frames are not sent by the tasks that own their data but by one
+ * scheduler task (CanTxTask in main.c) from a table of frames. Each frame has:
+ *
+ *   - a cycle time: sent every cycleMs (0 = only on change),
+ *   - an optional on-change trigger: changed() is asked whenever the
+ *     scheduler runs and a frame whose data moved beyond its deadband is
+ *     sent early,
+ *   - a minimum gap between two sends, which rate-limits the on-change
+ *     trigger,
+ *   - a phase offset, so frames with the same cycle do not all become due
+ *     in the same tick.
+ *
+ * At most CAN_SCHED_BURST frames are handed to CAN_IF_Transmit() per run;
+ * the rest follow 1 ms later, which keeps the TX queue and the bus load
+ * smooth. A frame refused by a full TX queue stays due and is retried.
+ *
+ * The scheduler sleeps until the next frame is due. Data owners call
+ * CanSched_Notify() after they update their state so on-change frames go
+ * out without polling. "can sched" shows the table and its counters.
+ *
+ * CanSched_Suspend() stops all sends while the bus prepares to sleep
+ * (can_nm.h); on resume the offsets apply again, as after boot.
+ */
+
+#ifndef CAN_SCHED_H
+#define CAN_SCHED_H
+
+#include "main.h"
+#include "cmsis_os2.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Frames that can be registered. */
+#ifndef CAN_SCHED_MAX_FRAMES
+#define CAN_SCHED_MAX_FRAMES  12U
+#endif
+
+/** Frames sent per scheduler run (one per TX mailbox). */
+#ifndef CAN_SCHED_BURST
+#define CAN_SCHED_BURST       3U
+#endif
+
+/** Thread flag set on the scheduler task by CanSched_Notify(). */
+#define CAN_SCHED_FLAG        0x0001U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief One scheduled frame. Registered by pointer; must stay valid.
+ */
+typedef struct
+{
+    const char *name;                         /**< Shown by "can sched". */
+    uint32_t    id;                           /**< Shown by "can sched" (CAN_IF format). */
+    uint16_t    cycleMs;                      /**< Period; 0 = on change only. */
+    uint16_t    minGapMs;                     /**< Least time between two sends. */
+    uint16_t    offsetMs;                     /**< Phase of the first cyclic send. */
+    uint8_t   (*changed)(void *ctx);          /**< Non-zero to send now; may be NULL. */
+    HAL_StatusTypeDef (*send)(void *ctx);     /**< Encode and queue the frame. */
+    void       *ctx;
+} CanSched_Frame_t;
+
+/**
+ * @brief Counters of one frame.
+ */
+typedef struct
+{
+    uint32_t cyclic;      /**< Sends because the cycle time elapsed. */
+    uint32_t onChange;    /**< Early sends because changed() fired. */
+    uint32_t gapHeld;     /**< Runs in which the minimum gap held a send back. */
+    uint32_t busy;        /**< Sends refused by a full TX queue (retried). */
+} CanSched_Stats_t;
+
+/**
+ * @brief Clear the frame table and register "can sched". Called by
+ *        CAN_IF_Init().
+ */
+void CanSched_Init(void);
+
+/**
+ * @brief Add a frame to the table.
+ *
+ * @return HAL_OK, or HAL_ERROR if the table is full or @p frame has no
+ *         send() or neither a cycle time nor changed().
+ */
+HAL_StatusTypeDef CanSched_Add(const CanSched_Frame_t *frame);
+
+/**
+ * @brief Register the scheduler task, woken by CanSched_Notify().
+ */
+void CanSched_SetConsumer(osThreadId_t thread);
+
+/**
+ * @brief Ask the scheduler to check the on-change triggers now.
+ */
+void CanSched_Notify(void);
+
+/**
+ * @brief Stop (@p on != 0) or resume all scheduled sends. While stopped
+ *        CanSched_Run() sends nothing and returns osWaitForever; resuming
+ *        wakes the scheduler, which restarts the cycles at their offsets.
+ *        Any task; resume is not called from an interrupt.
+ */
+void CanSched_Suspend(uint8_t on);
+
+/**
+ * @brief Send whatever is due at @p nowMs (scheduler task only).
+ *
+ * @return Milliseconds until the next frame is due (osWaitForever if none);
+ *         wait that long, or for CAN_SCHED_FLAG, before the next call.
+ */
+uint32_t CanSched_Run(uint32_t nowMs);
+
+/**
+ * @brief Copy the counters of the @p index-th frame.
+ *
+ * @return HAL_OK, or HAL_ERROR past the last frame.
+ */
+HAL_StatusTypeDef CanSched_GetStats(uint32_t index, CanSched_Stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_SCHED_H */
@@ -0,0 +1,171 @@
+/**
+ * @file    can_secoc.h
+ * @brief   Authenticated CAN frames in the style of AUTOSAR SecOC: a
+ *          freshness value and a truncated AES-CMAC in the frame.
+ *
+ * The frames of CAN_SECOC_TABLE, the per-ID policy, carry after their
+ * payload the low bytes of a 32-bit freshness value (FV) and the first
+ * bytes of a MAC:
+ *
+ *   | payload (n bytes) | FV, low fv bytes, LE | MAC bytes 0 .. mac - 1 |
+ *
+ * The MAC is AES-128-CMAC (aes_cmac.h) with the key CAN_SECOC_KEY over
+ * the data ID (2 bytes, MSB first), the payload and the whole FV (4
+ * bytes, MSB first). That is at most 13 bytes, one AES block: with the
+ * key schedule and the CMAC subkeys expanded by CanSecOC_Init(), a frame
+ * costs one block encryption to send and one to check.
+ *
+ * Sending: CAN_IF_TransmitBus() calls CanSecOC_Protect() before it queues
+ * a frame of the table, so every sender gets the protection without doing
+ * anything. The FV is taken under PRIMASK, the MAC computed outside it;
+ * an ID should have one sending task, as a frame overtaken by a later one
+ * of its ID is rejected as stale. CAN_IF_Forward() passes frames through
+ * as they are.
+ *
+ * Receiving: CAN_IF_ProcessRxMsg() calls CanSecOC_Verify() before the
+ * handler. The full FV is rebuilt from the low bytes as the smallest
+ * value above the last one accepted; the frame is authentic if the MAC
+ * over that value matches, and only then reaches the handler. A replayed
+ * or older frame rebuilds to a value it was not signed with and fails like
+ * a forged one. Up to 2^(8 * fv) - 1 lost frames in a row are tolerated;
+ * after more (or a sender that jumped ahead at its boot) each rejected
+ * frame is also tried one window of 2^(8 * fv) further ahead than the
+ * last, so the receiver catches up within a few frames. A frame thus
+ * costs at most two MACs, and a forger gets two guesses of the truncated
+ * MAC per frame.
+ *
+ * Freshness over a reset: the TX FV must never be reused and the RX FV
+ * must not go back, so both live in the flash log (one record per ID).
+ * The TX side reserves CAN_SECOC_FV_RESERVE values at a time and renews
+ * the reservation when half of it is used; it sends nothing above the
+ * reservation NvmTask has taken for writing, so each boot holds the first
+ * frame back until the record is on its way (the sender gets HAL_BUSY and
+ * retries). The RX side stores its FV every CAN_SECOC_FV_RESERVE / 2
+ * frames, so after a reset at most that many old frames could be replayed.
+ * A larger reserve means fewer flash records but a longer catch-up after
+ * a boot and a wider replay window.
+ * Without the flash log (no client slot) both start over at every boot.
+ *
+ * An ID is in this table or in the E2E table (can_e2e.h), not in both.
+ *
+ *   can secoc            per ID: FVs, frames authenticated, held, verified,
+ *                        rejected, and the MAC time per frame
+ */
+
+#ifndef CAN_SECOC_H
+#define CAN_SECOC_H
+
+#include "main.h"
+#include "can_signals.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Authenticated frames. X(name, id, payload, fv, mac, data ID): id
+ *        in the CAN_IF format (CAN_IF_ID_EXT for 29-bit), payload, FV and
+ *        MAC bytes (payload + fv + mac = the frame's DLC, fv 1..4, mac
+ *        3..8).
+ */
+#ifndef CAN_SECOC_TABLE
+#define CAN_SECOC_TABLE(X)                                                      \
+    X(ODOMETER, CANSIG_ODOMETER_ID, 4U, 1U, 3U, 0x0110U)
+#endif
+
+/**
+ * @brief The AES-128 key, 16 bytes. The default is the RFC 4493 example
+ *        key, for the bench only; a vehicle build passes its own.
+ */
+#ifndef CAN_SECOC_KEY
+#define CAN_SECOC_KEY                                                           \
+    { 0x2BU, 0x7EU, 0x15U, 0x16U, 0x28U, 0xAEU, 0xD2U, 0xA6U,                   \
+      0xABU, 0xF7U, 0x15U, 0x88U, 0x09U, 0xCFU, 0x4FU, 0x3CU }
+#endif
+
+/** TX freshness values reserved per flash record (even, >= 4): a record
+ *  every 128 frames, about two minutes of the 1 s odometer frame. */
+#ifndef CAN_SECOC_FV_RESERVE
+#define CAN_SECOC_FV_RESERVE    256U
+#endif
+
+_Static_assert(((CAN_SECOC_FV_RESERVE % 2U) == 0U) && (CAN_SECOC_FV_RESERVE >= 4U),
+               "CAN_SECOC_FV_RESERVE must be even and at least 4");
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+#define CAN_SECOC_ENUM_(name, id, payload, fv, mac, dataId)   CAN_SECOC_##name,
+typedef enum
+{
+    CAN_SECOC_TABLE(CAN_SECOC_ENUM_)
+    CAN_SECOC_COUNT
+} CanSecOC_Id_t;
+
+/** CanSecOC_Find() of an identifier without authentication. */
+#define CAN_SECOC_NONE          0xFFU
+
+/**
+ * @brief Figures of one authenticated identifier.
+ */
+typedef struct
+{
+    uint32_t txFv;          /**< Next FV to send. */
+    uint32_t rxFv;          /**< Last FV accepted. */
+    uint32_t sent;          /**< Frames authenticated for sending. */
+    uint32_t held;          /**< Sends held back until the FV was stored. */
+    uint32_t verified;      /**< Frames received authentic and fresh. */
+    uint32_t failed;        /**< Frames rejected: MAC, replayed or stale. */
+    uint32_t errors;        /**< Short frames; sends with the FV exhausted. */
+    uint32_t macCycles;     /**< DWT cycles of the MAC(s) of the last frame. */
+    uint32_t macMax;        /**< Most cycles of one frame. */
+} CanSecOC_Stats_t;
+
+/**
+ * @brief Check the cipher (AesCmac_SelfTest()), expand the key, join the
+ *        flash log and register "can secoc". Call once before
+ *        NvmLog_Init(), which restores the freshness values.
+ */
+void CanSecOC_Init(void);
+
+/**
+ * @brief Entry of @p key (CAN_IF_MSG_KEY() format), CAN_SECOC_NONE if
+ *        it is not authenticated.
+ */
+uint8_t CanSecOC_Find(uint32_t key);
+
+/**
+ * @brief Write the FV and the MAC of the payload into @p data (8 bytes)
+ *        of entry @p e, using up one FV (any task, not an interrupt).
+ *
+ * @return HAL_OK; HAL_BUSY while the next FV is not yet reserved in flash
+ *         (retry); HAL_ERROR if @p dlc is short or the FVs are used up.
+ */
+HAL_StatusTypeDef CanSecOC_Protect(uint8_t e, uint8_t *data, uint8_t dlc);
+
+/**
+ * @brief Check a received frame of entry @p e (@p data: 8 bytes, @p dlc
+ *        received) and move the RX FV on if it passes (CanRxTask).
+ *
+ * @return HAL_OK if authentic and fresh, HAL_ERROR otherwise.
+ */
+HAL_StatusTypeDef CanSecOC_Verify(uint8_t e, const uint8_t *data, uint8_t dlc);
+
+/**
+ * @brief Copy the figures of entry @p e.
+ *
+ * @return HAL_OK, or HAL_ERROR past the last entry.
+ */
+HAL_StatusTypeDef CanSecOC_GetStats(uint8_t e, CanSecOC_Stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_SECOC_H */
@@ -0,0 +1,186 @@
+/**
+ * @file    can_sigcache.h
+ * @brief   Last-value cache of the signals decoded from received CAN frames
+ *          and measured by the virtual sensors.
+ *
+ * CanRxTask decodes every frame it has a decoder for (today the telemetry
+ * frame 0x100, with the generated CanSig_VehicleTelemetry_Unpack()) into a
+ * flat array indexed by CanSigCache_Signal_t. SensorTask stores the
+ * conditioned sensor values (vsensor.h) into the same array with
+ * CanSigCache_Update(), once per sample block. Each entry holds the last
+ * value, the HAL tick it was received and a sequence counter that counts
+ * the updates, so a consumer can tell "new sample" from "same sample" and
+ * "stale" from "fresh" without a queue of its own. The frame signals are
+ * stored as their raw bus values and scaled when read, so CanRxTask
+ * decodes without the FPU (rtos_fpu.h).
+ *
+ * Consumers that want to be woken call CanSigCache_Subscribe() with the set
+ * of signals they care about and a thread flag. The decoder sets that flag
+ * only when one of those signals changed value; re-receiving the same value
+ * updates the timestamp and sequence but wakes nobody.
+ *
+ * With CAN_SIGCACHE_ISR_DECODE the telemetry frame is not queued for
+ * CanRxTask at all: it is an ISR decoder (CAN_IF_RegisterIsrDecoder()),
+ * unpacked and stored in the CAN1 RX interrupt, and the subscribers are
+ * woken from there at the kernel priority. Its values are in the cache
+ * microseconds after the frame, whatever CanRxTask is waiting behind. So
+ * that a reader does not hold that interrupt off, the entries are a
+ * seqlock: a writer (RX interrupt, CanRxTask, SensorTask) stores with
+ * interrupts masked, which also orders the writers, and bumps the lock
+ * word to odd before and even after; a reader copies without masking and
+ * copies again if the word moved meanwhile.
+ *
+ * The cache also counts frames and times each one from the RX interrupt to
+ * its values being stored (CAN_IF_Msg_t::EnqCycles, or the decoder's own
+ * stamp, only with CAN_LAT_ENABLE). The dashboard renders from here with
+ * "dash src can"; "can sig" lists the entries.
+ */
+
+#ifndef CAN_SIGCACHE_H
+#define CAN_SIGCACHE_H
+
+#include "main.h"
+#include "cmsis_os2.h"
+#include "can_signals.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Threads that can subscribe. */
+#ifndef CAN_SIGCACHE_MAX_SUBS
+#define CAN_SIGCACHE_MAX_SUBS   4U
+#endif
+
+/** A signal not received for this long is stale (3 telemetry cycles). */
+#ifndef CAN_SIGCACHE_STALE_MS
+#define CAN_SIGCACHE_STALE_MS   300U
+#endif
+
+/**
+ * 1 = decode the telemetry frame in the CAN1 RX interrupt; 0 = in
+ * CanRxTask, as it also is when the ISR decoder table is full.
+ */
+#ifndef CAN_SIGCACHE_ISR_DECODE
+#define CAN_SIGCACHE_ISR_DECODE 1
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/** Signal IDs, the index into the cache. */
+typedef enum
+{
+    CAN_SIG_SPEED = 0,      /**< km/h */
+    CAN_SIG_RPM,            /**< rpm */
+    CAN_SIG_COOLANT,        /**< degC */
+    CAN_SIG_SENS_SPEED,     /**< km/h, virtual sensor */
+    CAN_SIG_SENS_RPM,       /**< rpm, virtual sensor */
+    CAN_SIG_SENS_COOLANT,   /**< degC, virtual sensor */
+    CAN_SIG_COUNT
+} CanSigCache_Signal_t;
+
+/** Signals decoded from the telemetry frame (the first entries). */
+#define CAN_SIG_FRAME_COUNT     3U
+
+/** Bit of @p sig in a CanSigCache_Subscribe() mask. */
+#define CAN_SIG_BIT(sig)        (1UL << (sig))
+
+/**
+ * @brief One cache entry.
+ */
+typedef struct
+{
+    float    value;         /**< Physical value of the last update. */
+    uint32_t timeMs;        /**< HAL tick of the last update. */
+    uint32_t seq;           /**< Updates since boot; 0 = never received. */
+} CanSigCache_Entry_t;
+
+/**
+ * @brief Decoder counters.
+ */
+typedef struct
+{
+    uint32_t frames;        /**< Frames decoded since boot. */
+    uint32_t lastLatUs;     /**< RX interrupt -> cache, last frame. */
+    uint32_t maxLatUs;      /**< RX interrupt -> cache, worst frame. */
+    uint32_t retries;       /**< Reads copied again after a write. */
+    uint8_t  inIsr;         /**< 1: the frame is decoded in the RX interrupt. */
+} CanSigCache_Stats_t;
+
+/**
+ * @brief Clear the cache, route the decoded frames to it (in the RX
+ *        interrupt with CAN_SIGCACHE_ISR_DECODE) and register "can sig".
+ *        Called after CAN_IF_Init().
+ *
+ * @return HAL_OK, or HAL_ERROR if no RX handler slot was free.
+ */
+HAL_StatusTypeDef CanSigCache_Init(void);
+
+/**
+ * @brief Copy one entry; never blocks (any task).
+ *
+ * @return HAL_OK, or HAL_ERROR for an unknown @p sig.
+ */
+HAL_StatusTypeDef CanSigCache_Read(CanSigCache_Signal_t sig, CanSigCache_Entry_t *out);
+
+/**
+ * @brief Updates of @p sig since boot (the entry's seq), 0 for an unknown
+ *        one; one load, no copy or scaling, for a reader that keeps its
+ *        own form of the value and only needs to know it is out of date.
+ */
+uint32_t CanSigCache_Seq(CanSigCache_Signal_t sig);
+
+/**
+ * @brief Copy every entry in one step, so the values belong together;
+ *        one seqlock read, any context including interrupts. The frame
+ *        signals are scaled after the copy, by the caller's task.
+ */
+void CanSigCache_Snapshot(CanSigCache_Entry_t out[CAN_SIG_COUNT]);
+
+/** Name of @p sig as "can sig" shows it, "?" for an unknown one. */
+const char *CanSigCache_Name(CanSigCache_Signal_t sig);
+
+/**
+ * @brief Non-zero if @p e was never received or is older than
+ *        CAN_SIGCACHE_STALE_MS at @p nowMs (HAL tick).
+ */
+uint8_t CanSigCache_IsStale(const CanSigCache_Entry_t *e, uint32_t nowMs);
+
+/**
+ * @brief Store new samples of the signals in @p sigMask (CAN_SIG_BIT()s)
+ *        in one step and wake their subscribers once.
+ *
+ * @param values Indexed by CanSigCache_Signal_t; entries outside
+ *               @p sigMask are not read.
+ * @return HAL_OK, or HAL_ERROR for an unknown signal or NULL @p values.
+ */
+HAL_StatusTypeDef CanSigCache_Update(uint32_t sigMask, const float *values);
+
+/**
+ * @brief Copy the decoder counters.
+ */
+void CanSigCache_GetStats(CanSigCache_Stats_t *out);
+
+/**
+ * @brief Wake @p thread with @p flags whenever a signal in @p sigMask
+ *        (CAN_SIG_BIT()s) changes value.
+ *
+ * Subscribing the same thread again replaces its mask and flags; a zero
+ * @p sigMask removes it.
+ *
+ * @return HAL_OK, or HAL_ERROR if the table is full or an argument is 0.
+ */
+HAL_StatusTypeDef CanSigCache_Subscribe(osThreadId_t thread, uint32_t sigMask, uint32_t flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_SIGCACHE_H */
@@ -0,0 +1,336 @@
+/**
+ * @file    can_signal.hpp
+ * @brief   C++17 frame layouts as type lists of signals, with pack/unpack
+ *          expanded at compile time and the layout checked by the
+ *          compiler.
+ *
+ * Optional, header-only, for C++ code next to the C API of can_signals.h.
+ * A frame is declared as
+ *
+ *   using Telemetry = cansig::Frame<8U,
+ *       cansig::Signal<0U, 16U, cansig::ByteOrder::Intel, false, std::ratio<1, 10>>,
+ *       cansig::Signal<16U, 16U>,
+ *       cansig::Signal<32U, 16U, cansig::ByteOrder::Intel, true, std::ratio<1, 10>>>;
+ *
+ *   Telemetry::pack(data, 87.5f, 2450U, 88.2f);
+ *   float temp = Telemetry::get<2>(data);
+ *
+ * Signal<start bit, length, byte order, signed, factor, offset, min, max>
+ * takes the DBC fields; factor, offset and the optional physical range
+ * are std::ratio, since C++17 has no float template parameters. A signal
+ * with factor 1 and offset 0 has an integer value_type (the smallest
+ * that holds its raw width), any other one float. Start bit and byte
+ * order follow the DBC: Intel from the LSB up, Motorola from the MSB with
+ * the sawtooth bit numbering.
+ *
+ * Every check dbc_gen.py makes is a static_assert here: length 1..32, a
+ * signal running past the DLC, two signals sharing a bit, a range the raw
+ * width cannot hold. The placement of each signal in each byte is worked
+ * out in constexpr functions, so pack and unpack compile to one store or
+ * load per byte with constant shifts and masks, the code of the generated
+ * C functions. Rounding is the same as well (to nearest, halves away from
+ * zero; copysignf), so both pack the same bytes.
+ *
+ * dbc_gen.py declares the non-multiplexed messages of the DBC as Frames at
+ * the end of can_signals.h for C++17 code; "make hpp-check" compiles that
+ * header as C++ and so re-checks the DBC layout against these templates.
+ * Multiplexed messages stay with the C API.
+ */
+
+#ifndef CAN_SIGNAL_HPP
+#define CAN_SIGNAL_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <ratio>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace cansig
+{
+
+enum class ByteOrder : std::uint8_t
+{
+    Intel,      /**< DBC @1, little-endian */
+    Motorola    /**< DBC @0, big-endian */
+};
+
+namespace detail
+{
+
+constexpr std::uint32_t mask(unsigned bits)
+{
+    return (bits >= 32U) ? 0xFFFFFFFFU : ((1UL << bits) - 1U);
+}
+
+/** Payload bit (byte * 8 + bit) of raw bit @p i, LSB = 0. */
+constexpr unsigned bit_pos(unsigned start, unsigned len, ByteOrder order, unsigned i)
+{
+    if (order == ByteOrder::Intel)
+        return start + i;
+
+    /* Motorola: start is the MSB; down within a byte, then on at bit 7
+     * of the next one. */
+    unsigned pos = start;
+    for (unsigned k = len - 1U; k > i; --k)
+        pos = ((pos % 8U) == 0U) ? (pos + 15U) : (pos - 1U);
+    return pos;
+}
+
+/** The raw bits of a signal in one payload byte: raw bits
+ *  first .. first + count - 1 at bit .. bit + count - 1. */
+struct Run
+{
+    unsigned first;
+    unsigned count;     /**< 0: the signal has no bit in the byte */
+    unsigned bit;
+};
+
+constexpr Run run(unsigned start, unsigned len, ByteOrder order, unsigned byte)
+{
+    Run r = { 0U, 0U, 0U };
+
+    for (unsigned i = 0U; i < len; ++i)
+    {
+        unsigned pos = bit_pos(start, len, order, i);
+        if ((pos / 8U) != byte)
+            continue;
+        if (r.count == 0U)
+        {
+            r.first = i;
+            r.bit   = pos % 8U;
+        }
+        r.count++;
+    }
+    return r;
+}
+
+/** Payload bits of a signal as a mask; 0 if one lies past @p dlc. */
+constexpr std::uint64_t occupancy(unsigned start, unsigned len, ByteOrder order, unsigned dlc)
+{
+    std::uint64_t bits = 0U;
+
+    for (unsigned i = 0U; i < len; ++i)
+    {
+        unsigned pos = bit_pos(start, len, order, i);
+        if (pos >= (dlc * 8U))
+            return 0U;
+        bits |= (std::uint64_t)1U << pos;
+    }
+    return bits;
+}
+
+constexpr unsigned popcount(std::uint64_t v)
+{
+    unsigned n = 0U;
+    for (; v != 0U; v &= v - 1U)
+        n++;
+    return n;
+}
+
+template <bool Signed, unsigned Len>
+using raw_int = std::conditional_t<(Len <= 8U),  std::conditional_t<Signed, std::int8_t,  std::uint8_t>,
+                std::conditional_t<(Len <= 16U), std::conditional_t<Signed, std::int16_t, std::uint16_t>,
+                                                 std::conditional_t<Signed, std::int32_t, std::uint32_t>>>;
+
+/** Physical @p R within the raw limits; void: no range declared. */
+template <class R, class Factor, class Offset, std::intmax_t Lo, std::intmax_t Hi>
+struct in_raw_range
+{
+    using raw = std::ratio_divide<std::ratio_subtract<R, Offset>, Factor>;
+    static constexpr bool value = std::ratio_greater_equal<raw, std::ratio<Lo>>::value &&
+                                  std::ratio_less_equal<raw, std::ratio<Hi>>::value;
+};
+
+template <class Factor, class Offset, std::intmax_t Lo, std::intmax_t Hi>
+struct in_raw_range<void, Factor, Offset, Lo, Hi>
+{
+    static constexpr bool value = true;
+};
+
+template <class R>
+constexpr float to_float()
+{
+    return (float)R::num / (float)R::den;
+}
+
+template <class>
+using u32 = std::uint32_t;
+
+} /* namespace detail */
+
+/**
+ * @brief One signal: DBC start bit, length, byte order, sign, factor,
+ *        offset and an optional physical range (std::ratio each).
+ */
+template <unsigned Start, unsigned Len, ByteOrder Order = ByteOrder::Intel, bool Signed = false,
+          class Factor = std::ratio<1>, class Offset = std::ratio<0>,
+          class Min = void, class Max = void>
+struct Signal
+{
+    static_assert((Len >= 1U) && (Len <= 32U), "cansig::Signal: length must be 1..32 bits");
+    static_assert(Factor::num > 0, "cansig::Signal: factor must be positive");
+
+    static constexpr unsigned  start = Start;
+    static constexpr unsigned  length = Len;
+    static constexpr ByteOrder order = Order;
+    static constexpr bool      is_signed = Signed;
+    static constexpr bool      is_integer = (Factor::num == 1) && (Factor::den == 1) && (Offset::num == 0);
+
+    static constexpr std::intmax_t raw_min = Signed ? -((std::intmax_t)1 << (Len - 1U)) : 0;
+    static constexpr std::intmax_t raw_max = Signed ? (((std::intmax_t)1 << (Len - 1U)) - 1)
+                                                    : (((std::intmax_t)1 << Len) - 1);
+
+    static_assert(detail::in_raw_range<Min, Factor, Offset, raw_min, raw_max>::value,
+                  "cansig::Signal: minimum outside what the raw width holds");
+    static_assert(detail::in_raw_range<Max, Factor, Offset, raw_min, raw_max>::value,
+                  "cansig::Signal: maximum outside what the raw width holds");
+
+    using raw_type   = detail::raw_int<Signed, Len>;
+    using value_type = std::conditional_t<is_integer, raw_type, float>;
+
+    static constexpr float factor = detail::to_float<Factor>();
+    static constexpr float scale  = (float)Factor::den / (float)Factor::num;
+    static constexpr float offset = detail::to_float<Offset>();
+
+    /** Raw bits of @p v, not masked; rounded as the generated Pack. */
+    static inline std::uint32_t to_raw(value_type v)
+    {
+        if constexpr (is_integer)
+        {
+            return Signed ? (std::uint32_t)(std::int32_t)v : (std::uint32_t)v;
+        }
+        else
+        {
+            float r = (Offset::num != 0) ? ((v - offset) * scale) : (v * scale);
+            return Signed ? (std::uint32_t)(std::int32_t)(r + std::copysign(0.5f, r))
+                          : (std::uint32_t)(r + 0.5f);
+        }
+    }
+
+    /** Physical value of the raw bits @p bits (the low Len bits). */
+    static inline value_type from_raw(std::uint32_t bits)
+    {
+        std::int32_t raw = (std::int32_t)bits;
+
+        if constexpr (Signed && (Len < 32U))
+        {
+            constexpr std::uint32_t sign = 1UL << (Len - 1U);
+            raw = (std::int32_t)((bits ^ sign) - sign);
+        }
+
+        if constexpr (is_integer)
+        {
+            return Signed ? (value_type)raw : (value_type)bits;
+        }
+        else
+        {
+            float v = Signed ? (float)raw : (float)bits;
+            return (Offset::num != 0) ? ((v * factor) + offset) : (v * factor);
+        }
+    }
+
+    static constexpr detail::Run run(unsigned byte)
+    {
+        return detail::run(Start, Len, Order, byte);
+    }
+};
+
+/**
+ * @brief A frame of @p Dlc bytes holding @p Sigs, in declaration order.
+ */
+template <unsigned Dlc, class... Sigs>
+struct Frame
+{
+    static_assert((Dlc >= 1U) && (Dlc <= 8U), "cansig::Frame: DLC must be 1..8");
+    static_assert(((detail::occupancy(Sigs::start, Sigs::length, Sigs::order, Dlc) != 0U) && ...),
+                  "cansig::Frame: a signal runs past the DLC");
+    static_assert(detail::popcount((detail::occupancy(Sigs::start, Sigs::length, Sigs::order, Dlc) | ... | 0U)) ==
+                  (Sigs::length + ... + 0U),
+                  "cansig::Frame: two signals share a bit");
+
+    static constexpr unsigned    dlc   = Dlc;
+    static constexpr std::size_t count = sizeof...(Sigs);
+
+    template <std::size_t I>
+    using signal = std::tuple_element_t<I, std::tuple<Sigs...>>;
+
+    /** Encode the physical values, one per signal, into @p data[0..Dlc). */
+    static inline void pack(std::uint8_t *data, typename Sigs::value_type... v)
+    {
+        pack_raw(data, Sigs::to_raw(v)...);
+    }
+
+    /** Encode raw values (masked here) into @p data[0..Dlc); integers only. */
+    static constexpr void pack_raw(std::uint8_t *data, detail::u32<Sigs>... raw)
+    {
+        store(data, std::make_index_sequence<Dlc>{}, raw...);
+    }
+
+    /** Decode every signal of @p data into @p out, in declaration order. */
+    static inline void unpack(const std::uint8_t *data, typename Sigs::value_type &... out)
+    {
+        ((out = Sigs::from_raw(extract<Sigs>(data, std::make_index_sequence<Dlc>{}))), ...);
+    }
+
+    /** Physical value of signal @p I in @p data. */
+    template <std::size_t I>
+    static inline typename signal<I>::value_type get(const std::uint8_t *data)
+    {
+        return signal<I>::from_raw(get_raw<I>(data));
+    }
+
+    /** Raw bits of signal @p I in @p data, not sign-extended. */
+    template <std::size_t I>
+    static constexpr std::uint32_t get_raw(const std::uint8_t *data)
+    {
+        return extract<signal<I>>(data, std::make_index_sequence<Dlc>{});
+    }
+
+private:
+    template <class S, unsigned B>
+    static constexpr std::uint32_t term(std::uint32_t raw)
+    {
+        constexpr detail::Run r = S::run(B);
+
+        if constexpr (r.count == 0U)
+            return 0U;
+        else
+            return ((raw >> r.first) & detail::mask(r.count)) << r.bit;
+    }
+
+    template <unsigned B>
+    static constexpr std::uint8_t byte(detail::u32<Sigs>... raw)
+    {
+        return (std::uint8_t)(term<Sigs, B>(raw) | ... | 0U);
+    }
+
+    template <std::size_t... B>
+    static constexpr void store(std::uint8_t *data, std::index_sequence<B...>, detail::u32<Sigs>... raw)
+    {
+        ((data[B] = byte<(unsigned)B>(raw...)), ...);
+    }
+
+    template <class S, unsigned B>
+    static constexpr std::uint32_t gather(const std::uint8_t *data)
+    {
+        constexpr detail::Run r = S::run(B);
+
+        if constexpr (r.count == 0U)
+            return 0U;
+        else
+            return (((std::uint32_t)data[B] >> r.bit) & detail::mask(r.count)) << r.first;
+    }
+
+    template <class S, std::size_t... B>
+    static constexpr std::uint32_t extract(const std::uint8_t *data, std::index_sequence<B...>)
+    {
+        return (gather<S, (unsigned)B>(data) | ... | 0U);
+    }
+};
+
+} /* namespace cansig */
+
+#endif /* CAN_SIGNAL_HPP */
@@ -0,0 +1,1083 @@
+/**
+ * @file    can_signals.h
+ * @brief   CAN signal pack/unpack generated from mini_ecu.dbc.
+ *
+ * GENERATED by tools/dbc_gen.py - do not edit. Change the DBC file and run
+ * "make dbc".
+ *
+ * Pack converts physical values to raw with a constant multiply, rounded
+ * to nearest; Unpack multiplies by the factor. Values outside a signal's
+ * _MIN/_MAX are not clamped.
+ *
+ * A message with scaled signals also has a _Raw_t struct of the integers
+ * on the bus: ToRaw rounds a physical struct into it once, PackRaw and
+ * UnpackRaw move it without floating point (rtos_fpu.h).
+ *
+ * A multiplexed message has one struct for all its groups; Pack and Unpack
+ * switch once on the selector and handle only the group it names.
+ */
+
+#ifndef CAN_SIGNALS_H
+#define CAN_SIGNALS_H
+
+#include <math.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#define CANSIG_STATIC_ASSERT(cond, msg)     static_assert(cond, msg)
+#else
+#define CANSIG_STATIC_ASSERT(cond, msg)     _Static_assert(cond, msg)
+#endif
+
+/** Round to nearest, halves away from zero, without a branch. */
+static inline int32_t cansig_round(float v)
+{
+    return (int32_t)(v + copysignf(0.5f, v));
+}
+
+/* -------------------------------------------------------------------------- */
+/* Alarm (0x20, 8 bytes)                                                      */
+/* -------------------------------------------------------------------------- */
+
+/* Threshold alarm, sent on each crossing through the reserved TX mailbox (can_alarm.h). */
+#define CANSIG_ALARM_ID                   0x20U
+#define CANSIG_ALARM_DLC                  8U
+
+/* alarm_index: Entry of CAN_ALARM_TABLE, 8-bit unsigned, LE from bit 0 */
+#define CANSIG_ALARM_ALARM_INDEX_MIN      0.0f
+#define CANSIG_ALARM_ALARM_INDEX_MAX      255.0f
+#define CANSIG_ALARM_ALARM_INDEX_RAW_MIN  (0)
+#define CANSIG_ALARM_ALARM_INDEX_RAW_MAX  (255U)
+
+/* alarm_active: 1 crossed the threshold, 0 back inside the hysteresis, 1-bit unsigned, LE from bit 8 */
+#define CANSIG_ALARM_ALARM_ACTIVE_MIN     0.0f
+#define CANSIG_ALARM_ALARM_ACTIVE_MAX     1.0f
+#define CANSIG_ALARM_ALARM_ACTIVE_RAW_MIN (0)
+#define CANSIG_ALARM_ALARM_ACTIVE_RAW_MAX (1U)
+
+/* alarm_seq: Counts every alarm frame, 4-bit unsigned, LE from bit 12 */
+#define CANSIG_ALARM_ALARM_SEQ_MIN        0.0f
+#define CANSIG_ALARM_ALARM_SEQ_MAX        15.0f
+#define CANSIG_ALARM_ALARM_SEQ_RAW_MIN    (0)
+#define CANSIG_ALARM_ALARM_SEQ_RAW_MAX    (15U)
+
+/* alarm_value: Signal value at the crossing, in the signal's unit, 32-bit signed, LE from bit 32 */
+#define CANSIG_ALARM_ALARM_VALUE_FACTOR   0.01f
+#define CANSIG_ALARM_ALARM_VALUE_SCALE    100.0f
+#define CANSIG_ALARM_ALARM_VALUE_OFFSET   0.0f
+#define CANSIG_ALARM_ALARM_VALUE_MIN      -21474836.5f
+#define CANSIG_ALARM_ALARM_VALUE_MAX      21474836.5f
+#define CANSIG_ALARM_ALARM_VALUE_RAW_MIN  (-2147483648)
+#define CANSIG_ALARM_ALARM_VALUE_RAW_MAX  (2147483647)
+
+CANSIG_STATIC_ASSERT((CANSIG_ALARM_ALARM_INDEX_RAW_MIN == 0) &&
+                     (CANSIG_ALARM_ALARM_INDEX_RAW_MAX == 0xFFU),
+                     "Alarm.alarm_index: raw range does not match 8 bits");
+CANSIG_STATIC_ASSERT((CANSIG_ALARM_ALARM_ACTIVE_RAW_MIN == 0) &&
+                     (CANSIG_ALARM_ALARM_ACTIVE_RAW_MAX == 0x1U),
+                     "Alarm.alarm_active: raw range does not match 1 bits");
+CANSIG_STATIC_ASSERT((CANSIG_ALARM_ALARM_SEQ_RAW_MIN == 0) &&
+                     (CANSIG_ALARM_ALARM_SEQ_RAW_MAX == 0xFU),
+                     "Alarm.alarm_seq: raw range does not match 4 bits");
+CANSIG_STATIC_ASSERT((CANSIG_ALARM_ALARM_VALUE_RAW_MIN == -2147483648) &&
+                     (CANSIG_ALARM_ALARM_VALUE_RAW_MAX == 0x7FFFFFFF),
+                     "Alarm.alarm_value: raw range does not match 32 bits");
+
+typedef struct
+{
+    uint8_t alarm_index;  /**< -, 0 .. 255 */
+    uint8_t alarm_active; /**< -, 0 .. 1 */
+    uint8_t alarm_seq;    /**< -, 0 .. 15 */
+    float   alarm_value;  /**< -, -2.14748e+07 .. 2.14748e+07 */
+} CanSig_Alarm_t;
+
+/** Encode @p m into the first CANSIG_ALARM_DLC bytes of @p data. */
+static inline void CanSig_Alarm_Pack(uint8_t *data, const CanSig_Alarm_t *m)
+{
+    uint32_t alarm_index  = (uint32_t)(m->alarm_index) & 0xFFU;
+    uint32_t alarm_active = (uint32_t)(m->alarm_active) & 0x1U;
+    uint32_t alarm_seq    = (uint32_t)(m->alarm_seq) & 0xFU;
+    uint32_t alarm_value  = (uint32_t)cansig_round(m->alarm_value * CANSIG_ALARM_ALARM_VALUE_SCALE);
+
+    data[0] = (uint8_t)(alarm_index);
+    data[1] = (uint8_t)(alarm_active | (alarm_seq << 4));
+    data[2] = 0U;
+    data[3] = 0U;
+    data[4] = (uint8_t)(alarm_value);
+    data[5] = (uint8_t)(alarm_value >> 8);
+    data[6] = (uint8_t)(alarm_value >> 16);
+    data[7] = (uint8_t)(alarm_value >> 24);
+}
+
+/** Decode @p data (at least CANSIG_ALARM_DLC bytes) into @p m. */
+static inline void CanSig_Alarm_Unpack(const uint8_t *data, CanSig_Alarm_t *m)
+{
+    uint32_t alarm_index  = (uint32_t)data[0];
+    uint32_t alarm_active = ((uint32_t)data[1] & 0x1U);
+    uint32_t alarm_seq    = ((uint32_t)data[1] >> 4);
+    uint32_t alarm_value  = (uint32_t)data[4] |
+                            ((uint32_t)data[5] << 8) |
+                            ((uint32_t)data[6] << 16) |
+                            ((uint32_t)data[7] << 24);
+
+    m->alarm_index  = (uint8_t)alarm_index;
+    m->alarm_active = (uint8_t)alarm_active;
+    m->alarm_seq    = (uint8_t)alarm_seq;
+    m->alarm_value  = (float)(int32_t)alarm_value * CANSIG_ALARM_ALARM_VALUE_FACTOR;
+}
+
+/** Raw values of Alarm, as on the bus. */
+typedef struct
+{
+    uint8_t alarm_index;  /**< raw */
+    uint8_t alarm_active; /**< raw */
+    uint8_t alarm_seq;    /**< raw */
+    int32_t alarm_value;  /**< x CANSIG_ALARM_ALARM_VALUE_FACTOR */
+} CanSig_Alarm_Raw_t;
+
+/** Raw values of @p m, rounded as CanSig_Alarm_Pack() rounds them. */
+static inline void CanSig_Alarm_ToRaw(const CanSig_Alarm_t *m,
+                                      CanSig_Alarm_Raw_t *r)
+{
+    r->alarm_index  = m->alarm_index;
+    r->alarm_active = m->alarm_active;
+    r->alarm_seq    = m->alarm_seq;
+    r->alarm_value  = (int32_t)cansig_round(m->alarm_value * CANSIG_ALARM_ALARM_VALUE_SCALE);
+}
+
+/** Encode raw @p m into the first CANSIG_ALARM_DLC bytes of @p data. */
+static inline void CanSig_Alarm_PackRaw(uint8_t *data, const CanSig_Alarm_Raw_t *m)
+{
+    uint32_t alarm_index  = (uint32_t)(m->alarm_index) & 0xFFU;
+    uint32_t alarm_active = (uint32_t)(m->alarm_active) & 0x1U;
+    uint32_t alarm_seq    = (uint32_t)(m->alarm_seq) & 0xFU;
+    uint32_t alarm_value  = (uint32_t)(int32_t)(m->alarm_value);
+
+    data[0] = (uint8_t)(alarm_index);
+    data[1] = (uint8_t)(alarm_active | (alarm_seq << 4));
+    data[2] = 0U;
+    data[3] = 0U;
+    data[4] = (uint8_t)(alarm_value);
+    data[5] = (uint8_t)(alarm_value >> 8);
+    data[6] = (uint8_t)(alarm_value >> 16);
+    data[7] = (uint8_t)(alarm_value >> 24);
+}
+
+/** Decode @p data (at least CANSIG_ALARM_DLC bytes) into raw @p m. */
+static inline void CanSig_Alarm_UnpackRaw(const uint8_t *data, CanSig_Alarm_Raw_t *m)
+{
+    uint32_t alarm_index  = (uint32_t)data[0];
+    uint32_t alarm_active = ((uint32_t)data[1] & 0x1U);
+    uint32_t alarm_seq    = ((uint32_t)data[1] >> 4);
+    uint32_t alarm_value  = (uint32_t)data[4] |
+                            ((uint32_t)data[5] << 8) |
+                            ((uint32_t)data[6] << 16) |
+                            ((uint32_t)data[7] << 24);
+
+    m->alarm_index  = (uint8_t)alarm_index;
+    m->alarm_active = (uint8_t)alarm_active;
+    m->alarm_seq    = (uint8_t)alarm_seq;
+    m->alarm_value  = (int32_t)(int32_t)alarm_value;
+}
+
+/* -------------------------------------------------------------------------- */
+/* TimeSync (0xA0, 8 bytes)                                                   */
+/* -------------------------------------------------------------------------- */
+
+/* Time synchronization from the time master, SYNC then FUP every 500 ms (time_sync.h). */
+#define CANSIG_TIME_SYNC_ID                  0xA0U
+#define CANSIG_TIME_SYNC_DLC                 8U
+#define CANSIG_TIME_SYNC_GROUP_COUNT         2U
+#define CANSIG_TIME_SYNC_GROUP_MAX           24U
+
+/* tsyn_type: 0x10 SYNC, 0x18 FUP (follow-up), as AUTOSAR CanTSyn, 8-bit unsigned, LE from bit 0, multiplexer */
+#define CANSIG_TIME_SYNC_TSYN_TYPE_MIN       16.0f
+#define CANSIG_TIME_SYNC_TSYN_TYPE_MAX       24.0f
+#define CANSIG_TIME_SYNC_TSYN_TYPE_RAW_MIN   (0)
+#define CANSIG_TIME_SYNC_TSYN_TYPE_RAW_MAX   (255U)
+
+/* tsyn_domain: Time domain, 4-bit unsigned, LE from bit 8 */
+#define CANSIG_TIME_SYNC_TSYN_DOMAIN_MIN     0.0f
+#define CANSIG_TIME_SYNC_TSYN_DOMAIN_MAX     15.0f
+#define CANSIG_TIME_SYNC_TSYN_DOMAIN_RAW_MIN (0)
+#define CANSIG_TIME_SYNC_TSYN_DOMAIN_RAW_MAX (15U)
+
+/* tsyn_seq: Sequence counter; the FUP repeats the counter of its SYNC, 4-bit unsigned, LE from bit 12 */
+#define CANSIG_TIME_SYNC_TSYN_SEQ_MIN        0.0f
+#define CANSIG_TIME_SYNC_TSYN_SEQ_MAX        15.0f
+#define CANSIG_TIME_SYNC_TSYN_SEQ_RAW_MIN    (0)
+#define CANSIG_TIME_SYNC_TSYN_SEQ_RAW_MAX    (15U)
+
+/* tsyn_sec: Seconds of the master time when the SYNC was queued, 32-bit unsigned, LE from bit 32, group 16 */
+#define CANSIG_TIME_SYNC_TSYN_SEC_MIN        0.0f
+#define CANSIG_TIME_SYNC_TSYN_SEC_MAX        4.2949673e+09f
+#define CANSIG_TIME_SYNC_TSYN_SEC_RAW_MIN    (0)
+#define CANSIG_TIME_SYNC_TSYN_SEC_RAW_MAX    (4294967295U)
+
+/* tsyn_ovs: Seconds to add to tsyn_sec of the SYNC, 2-bit unsigned, LE from bit 16, group 24 */
+#define CANSIG_TIME_SYNC_TSYN_OVS_MIN        0.0f
+#define CANSIG_TIME_SYNC_TSYN_OVS_MAX        3.0f
+#define CANSIG_TIME_SYNC_TSYN_OVS_RAW_MIN    (0)
+#define CANSIG_TIME_SYNC_TSYN_OVS_RAW_MAX    (3U)
+
+/* tsyn_usec: Master time at the SYNC send confirmation, microseconds into that second, 20-bit unsigned, LE from bit 32, group 24 */
+#define CANSIG_TIME_SYNC_TSYN_USEC_MIN       0.0f
+#define CANSIG_TIME_SYNC_TSYN_USEC_MAX       999999.0f
+#define CANSIG_TIME_SYNC_TSYN_USEC_RAW_MIN   (0)
+#define CANSIG_TIME_SYNC_TSYN_USEC_RAW_MAX   (1048575U)
+
+CANSIG_STATIC_ASSERT((CANSIG_TIME_SYNC_TSYN_TYPE_RAW_MIN == 0) &&
+                     (CANSIG_TIME_SYNC_TSYN_TYPE_RAW_MAX == 0xFFU),
+                     "TimeSync.tsyn_type: raw range does not match 8 bits");
+CANSIG_STATIC_ASSERT((CANSIG_TIME_SYNC_TSYN_DOMAIN_RAW_MIN == 0) &&
+                     (CANSIG_TIME_SYNC_TSYN_DOMAIN_RAW_MAX == 0xFU),
+                     "TimeSync.tsyn_domain: raw range does not match 4 bits");
+CANSIG_STATIC_ASSERT((CANSIG_TIME_SYNC_TSYN_SEQ_RAW_MIN == 0) &&
+                     (CANSIG_TIME_SYNC_TSYN_SEQ_RAW_MAX == 0xFU),
+                     "TimeSync.tsyn_seq: raw range does not match 4 bits");
+CANSIG_STATIC_ASSERT((CANSIG_TIME_SYNC_TSYN_SEC_RAW_MIN == 0) &&
+                     (CANSIG_TIME_SYNC_TSYN_SEC_RAW_MAX == 0xFFFFFFFFU),
+                     "TimeSync.tsyn_sec: raw range does not match 32 bits");
+CANSIG_STATIC_ASSERT((CANSIG_TIME_SYNC_TSYN_OVS_RAW_MIN == 0) &&
+                     (CANSIG_TIME_SYNC_TSYN_OVS_RAW_MAX == 0x3U),
+                     "TimeSync.tsyn_ovs: raw range does not match 2 bits");
+CANSIG_STATIC_ASSERT((CANSIG_TIME_SYNC_TSYN_USEC_RAW_MIN == 0) &&
+                     (CANSIG_TIME_SYNC_TSYN_USEC_RAW_MAX == 0xFFFFFU),
+                     "TimeSync.tsyn_usec: raw range does not match 20 bits");
+
+typedef struct
+{
+    uint8_t  tsyn_type;   /**< -, 16 .. 24 */
+    uint8_t  tsyn_domain; /**< -, 0 .. 15 */
+    uint8_t  tsyn_seq;    /**< -, 0 .. 15 */
+    uint32_t tsyn_sec;    /**< s, 0 .. 4.29497e+09, group 16 */
+    uint8_t  tsyn_ovs;    /**< s, 0 .. 3, group 24 */
+    uint32_t tsyn_usec;   /**< us, 0 .. 999999, group 24 */
+} CanSig_TimeSync_t;
+
+/**
+ * @brief Encode @p m into the first CANSIG_TIME_SYNC_DLC bytes of @p data: the
+ *        ungrouped signals and the group m->tsyn_type selects.
+ *
+ * @return 1, or 0 if tsyn_type selects no group (the rest is encoded).
+ */
+static inline uint8_t CanSig_TimeSync_Pack(uint8_t *data, const CanSig_TimeSync_t *m)
+{
+    uint32_t tsyn_type   = (uint32_t)(m->tsyn_type) & 0xFFU;
+    uint32_t tsyn_domain = (uint32_t)(m->tsyn_domain) & 0xFU;
+    uint32_t tsyn_seq    = (uint32_t)(m->tsyn_seq) & 0xFU;
+
+    switch (tsyn_type)
+    {
+    case 16U:
+    {
+        uint32_t tsyn_sec    = (uint32_t)(m->tsyn_sec);
+
+        data[0] = (uint8_t)(tsyn_type);
+        data[1] = (uint8_t)(tsyn_domain | (tsyn_seq << 4));
+        data[2] = 0U;
+        data[3] = 0U;
+        data[4] = (uint8_t)(tsyn_sec);
+        data[5] = (uint8_t)(tsyn_sec >> 8);
+        data[6] = (uint8_t)(tsyn_sec >> 16);
+        data[7] = (uint8_t)(tsyn_sec >> 24);
+        return 1U;
+    }
+    case 24U:
+    {
+        uint32_t tsyn_ovs    = (uint32_t)(m->tsyn_ovs) & 0x3U;
+        uint32_t tsyn_usec   = (uint32_t)(m->tsyn_usec) & 0xFFFFFU;
+
+        data[0] = (uint8_t)(tsyn_type);
+        data[1] = (uint8_t)(tsyn_domain | (tsyn_seq << 4));
+        data[2] = (uint8_t)(tsyn_ovs);
+        data[3] = 0U;
+        data[4] = (uint8_t)(tsyn_usec);
+        data[5] = (uint8_t)(tsyn_usec >> 8);
+        data[6] = (uint8_t)(tsyn_usec >> 16);
+        data[7] = 0U;
+        return 1U;
+    }
+    default:
+        break;
+    }
+
+    data[0] = (uint8_t)(tsyn_type);
+    data[1] = (uint8_t)(tsyn_domain | (tsyn_seq << 4));
+    data[2] = 0U;
+    data[3] = 0U;
+    data[4] = 0U;
+    data[5] = 0U;
+    data[6] = 0U;
+    data[7] = 0U;
+    return 0U;
+}
+
+/**
+ * @brief Decode @p data (at least CANSIG_TIME_SYNC_DLC bytes) into @p m: the
+ *        ungrouped signals and the group tsyn_type selects. The fields of
+ *        the other groups keep their values.
+ *
+ * @return 1, or 0 if tsyn_type selects no group.
+ */
+static inline uint8_t CanSig_TimeSync_Unpack(const uint8_t *data, CanSig_TimeSync_t *m)
+{
+    uint32_t tsyn_type   = (uint32_t)data[0];
+    uint32_t tsyn_domain = ((uint32_t)data[1] & 0xFU);
+    uint32_t tsyn_seq    = ((uint32_t)data[1] >> 4);
+
+    m->tsyn_type   = (uint8_t)tsyn_type;
+    m->tsyn_domain = (uint8_t)tsyn_domain;
+    m->tsyn_seq    = (uint8_t)tsyn_seq;
+
+    switch (tsyn_type)
+    {
+    case 16U:
+    {
+        uint32_t tsyn_sec    = (uint32_t)data[4] |
+                               ((uint32_t)data[5] << 8) |
+                               ((uint32_t)data[6] << 16) |
+                               ((uint32_t)data[7] << 24);
+
+        m->tsyn_sec    = (uint32_t)tsyn_sec;
+        return 1U;
+    }
+    case 24U:
+    {
+        uint32_t tsyn_ovs    = ((uint32_t)data[2] & 0x3U);
+        uint32_t tsyn_usec   = (uint32_t)data[4] |
+                               ((uint32_t)data[5] << 8) |
+                               (((uint32_t)data[6] & 0xFU) << 16);
+
+        m->tsyn_ovs    = (uint8_t)tsyn_ovs;
+        m->tsyn_usec   = (uint32_t)tsyn_usec;
+        return 1U;
+    }
+    default:
+        return 0U;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* VehicleTelemetry (0x100, 8 bytes)                                          */
+/* -------------------------------------------------------------------------- */
+
+/* Vehicle state, sent every 100 ms and on change (docs/can-protocol.md). */
+#define CANSIG_VEHICLE_TELEMETRY_ID                     0x100U
+#define CANSIG_VEHICLE_TELEMETRY_DLC                    8U
+
+/* speed_kph: 16-bit unsigned, LE from bit 0 */
+#define CANSIG_VEHICLE_TELEMETRY_SPEED_KPH_FACTOR       0.1f
+#define CANSIG_VEHICLE_TELEMETRY_SPEED_KPH_SCALE        10.0f
+#define CANSIG_VEHICLE_TELEMETRY_SPEED_KPH_OFFSET       0.0f
+#define CANSIG_VEHICLE_TELEMETRY_SPEED_KPH_MIN          0.0f
+#define CANSIG_VEHICLE_TELEMETRY_SPEED_KPH_MAX          6553.5f
+#define CANSIG_VEHICLE_TELEMETRY_SPEED_KPH_RAW_MIN      (0)
+#define CANSIG_VEHICLE_TELEMETRY_SPEED_KPH_RAW_MAX      (65535U)
+
+/* engine_rpm: 16-bit unsigned, LE from bit 16 */
+#define CANSIG_VEHICLE_TELEMETRY_ENGINE_RPM_MIN         0.0f
+#define CANSIG_VEHICLE_TELEMETRY_ENGINE_RPM_MAX         65535.0f
+#define CANSIG_VEHICLE_TELEMETRY_ENGINE_RPM_RAW_MIN     (0)
+#define CANSIG_VEHICLE_TELEMETRY_ENGINE_RPM_RAW_MAX     (65535U)
+
+/* coolant_temp_c: Coolant temperature, 16-bit signed, LE from bit 32 */
+#define CANSIG_VEHICLE_TELEMETRY_COOLANT_TEMP_C_FACTOR  0.1f
+#define CANSIG_VEHICLE_TELEMETRY_COOLANT_TEMP_C_SCALE   10.0f
+#define CANSIG_VEHICLE_TELEMETRY_COOLANT_TEMP_C_OFFSET  0.0f
+#define CANSIG_VEHICLE_TELEMETRY_COOLANT_TEMP_C_MIN     -3276.8f
+#define CANSIG_VEHICLE_TELEMETRY_COOLANT_TEMP_C_MAX     3276.7f
+#define CANSIG_VEHICLE_TELEMETRY_COOLANT_TEMP_C_RAW_MIN (-32768)
+#define CANSIG_VEHICLE_TELEMETRY_COOLANT_TEMP_C_RAW_MAX (32767)
+
+/* e2e_counter: E2E alive counter, 0..14 (can_e2e.h), 4-bit unsigned, LE from bit 48 */
+#define CANSIG_VEHICLE_TELEMETRY_E2E_COUNTER_MIN        0.0f
+#define CANSIG_VEHICLE_TELEMETRY_E2E_COUNTER_MAX        14.0f
+#define CANSIG_VEHICLE_TELEMETRY_E2E_COUNTER_RAW_MIN    (0)
+#define CANSIG_VEHICLE_TELEMETRY_E2E_COUNTER_RAW_MAX    (15U)
+
+/* e2e_crc: E2E CRC8 SAE J1850 over data ID and bytes 0..6 (can_e2e.h), 8-bit unsigned, LE from bit 56 */
+#define CANSIG_VEHICLE_TELEMETRY_E2E_CRC_MIN            0.0f
+#define CANSIG_VEHICLE_TELEMETRY_E2E_CRC_MAX            255.0f
+#define CANSIG_VEHICLE_TELEMETRY_E2E_CRC_RAW_MIN        (0)
+#define CANSIG_VEHICLE_TELEMETRY_E2E_CRC_RAW_MAX        (255U)
+
+CANSIG_STATIC_ASSERT((CANSIG_VEHICLE_TELEMETRY_SPEED_KPH_RAW_MIN == 0) &&
+                     (CANSIG_VEHICLE_TELEMETRY_SPEED_KPH_RAW_MAX == 0xFFFFU),
+                     "VehicleTelemetry.speed_kph: raw range does not match 16 bits");
+CANSIG_STATIC_ASSERT((CANSIG_VEHICLE_TELEMETRY_ENGINE_RPM_RAW_MIN == 0) &&
+                     (CANSIG_VEHICLE_TELEMETRY_ENGINE_RPM_RAW_MAX == 0xFFFFU),
+                     "VehicleTelemetry.engine_rpm: raw range does not match 16 bits");
+CANSIG_STATIC_ASSERT((CANSIG_VEHICLE_TELEMETRY_COOLANT_TEMP_C_RAW_MIN == -32768) &&
+                     (CANSIG_VEHICLE_TELEMETRY_COOLANT_TEMP_C_RAW_MAX == 0x7FFF),
+                     "VehicleTelemetry.coolant_temp_c: raw range does not match 16 bits");
+CANSIG_STATIC_ASSERT((CANSIG_VEHICLE_TELEMETRY_E2E_COUNTER_RAW_MIN == 0) &&
+                     (CANSIG_VEHICLE_TELEMETRY_E2E_COUNTER_RAW_MAX == 0xFU),
+                     "VehicleTelemetry.e2e_counter: raw range does not match 4 bits");
+CANSIG_STATIC_ASSERT((CANSIG_VEHICLE_TELEMETRY_E2E_CRC_RAW_MIN == 0) &&
+                     (CANSIG_VEHICLE_TELEMETRY_E2E_CRC_RAW_MAX == 0xFFU),
+                     "VehicleTelemetry.e2e_crc: raw range does not match 8 bits");
+
+typedef struct
+{
+    float    speed_kph;      /**< km/h, 0 .. 6553.5 */
+    uint16_t engine_rpm;     /**< rpm, 0 .. 65535 */
+    float    coolant_temp_c; /**< degC, -3276.8 .. 3276.7 */
+    uint8_t  e2e_counter;    /**< -, 0 .. 14 */
+    uint8_t  e2e_crc;        /**< -, 0 .. 255 */
+} CanSig_VehicleTelemetry_t;
+
+/** Encode @p m into the first CANSIG_VEHICLE_TELEMETRY_DLC bytes of @p data. */
+static inline void CanSig_VehicleTelemetry_Pack(uint8_t *data, const CanSig_VehicleTelemetry_t *m)
+{
+    uint32_t speed_kph =
+        (uint32_t)(m->speed_kph * CANSIG_VEHICLE_TELEMETRY_SPEED_KPH_SCALE + 0.5f) & 0xFFFFU;
+    uint32_t engine_rpm     = (uint32_t)(m->engine_rpm) & 0xFFFFU;
+    uint32_t coolant_temp_c =
+        (uint32_t)cansig_round(m->coolant_temp_c * CANSIG_VEHICLE_TELEMETRY_COOLANT_TEMP_C_SCALE) & 0xFFFFU;
+    uint32_t e2e_counter    = (uint32_t)(m->e2e_counter) & 0xFU;
+    uint32_t e2e_crc        = (uint32_t)(m->e2e_crc) & 0xFFU;
+
+    data[0] = (uint8_t)(speed_kph);
+    data[1] = (uint8_t)(speed_kph >> 8);
+    data[2] = (uint8_t)(engine_rpm);
+    data[3] = (uint8_t)(engine_rpm >> 8);
+    data[4] = (uint8_t)(coolant_temp_c);
+    data[5] = (uint8_t)(coolant_temp_c >> 8);
+    data[6] = (uint8_t)(e2e_counter);
+    data[7] = (uint8_t)(e2e_crc);
+}
+
+/** Decode @p data (at least CANSIG_VEHICLE_TELEMETRY_DLC bytes) into @p m. */
+static inline void CanSig_VehicleTelemetry_Unpack(const uint8_t *data, CanSig_VehicleTelemetry_t *m)
+{
+    uint32_t speed_kph      = (uint32_t)data[0] | ((uint32_t)data[1] << 8);
+    uint32_t engine_rpm     = (uint32_t)data[2] | ((uint32_t)data[3] << 8);
+    uint32_t coolant_temp_c = (uint32_t)data[4] | ((uint32_t)data[5] << 8);
+    uint32_t e2e_counter    = ((uint32_t)data[6] & 0xFU);
+    uint32_t e2e_crc        = (uint32_t)data[7];
+
+    m->speed_kph      = (float)speed_kph * CANSIG_VEHICLE_TELEMETRY_SPEED_KPH_FACTOR;
+    m->engine_rpm     = (uint16_t)engine_rpm;
+    m->coolant_temp_c = (float)(int32_t)((coolant_temp_c ^ 0x8000U) - 0x8000U) *
+                        CANSIG_VEHICLE_TELEMETRY_COOLANT_TEMP_C_FACTOR;
+    m->e2e_counter    = (uint8_t)e2e_counter;
+    m->e2e_crc        = (uint8_t)e2e_crc;
+}
+
+/** Raw values of VehicleTelemetry, as on the bus. */
+typedef struct
+{
+    uint16_t speed_kph;      /**< x CANSIG_VEHICLE_TELEMETRY_SPEED_KPH_FACTOR */
+    uint16_t engine_rpm;     /**< raw */
+    int16_t  coolant_temp_c; /**< x CANSIG_VEHICLE_TELEMETRY_COOLANT_TEMP_C_FACTOR */
+    uint8_t  e2e_counter;    /**< raw */
+    uint8_t  e2e_crc;        /**< raw */
+} CanSig_VehicleTelemetry_Raw_t;
+
+/** Raw values of @p m, rounded as CanSig_VehicleTelemetry_Pack() rounds them. */
+static inline void CanSig_VehicleTelemetry_ToRaw(const CanSig_VehicleTelemetry_t *m,
+                                                 CanSig_VehicleTelemetry_Raw_t *r)
+{
+    r->speed_kph =
+        (uint16_t)(uint32_t)(m->speed_kph * CANSIG_VEHICLE_TELEMETRY_SPEED_KPH_SCALE + 0.5f);
+    r->engine_rpm     = m->engine_rpm;
+    r->coolant_temp_c =
+        (int16_t)cansig_round(m->coolant_temp_c * CANSIG_VEHICLE_TELEMETRY_COOLANT_TEMP_C_SCALE);
+    r->e2e_counter    = m->e2e_counter;
+    r->e2e_crc        = m->e2e_crc;
+}
+
+/** Encode raw @p m into the first CANSIG_VEHICLE_TELEMETRY_DLC bytes of @p data. */
+static inline void CanSig_VehicleTelemetry_PackRaw(uint8_t *data, const CanSig_VehicleTelemetry_Raw_t *m)
+{
+    uint32_t speed_kph      = (uint32_t)(m->speed_kph) & 0xFFFFU;
+    uint32_t engine_rpm     = (uint32_t)(m->engine_rpm) & 0xFFFFU;
+    uint32_t coolant_temp_c = (uint32_t)(int32_t)(m->coolant_temp_c) & 0xFFFFU;
+    uint32_t e2e_counter    = (uint32_t)(m->e2e_counter) & 0xFU;
+    uint32_t e2e_crc        = (uint32_t)(m->e2e_crc) & 0xFFU;
+
+    data[0] = (uint8_t)(speed_kph);
+    data[1] = (uint8_t)(speed_kph >> 8);
+    data[2] = (uint8_t)(engine_rpm);
+    data[3] = (uint8_t)(engine_rpm >> 8);
+    data[4] = (uint8_t)(coolant_temp_c);
+    data[5] = (uint8_t)(coolant_temp_c >> 8);
+    data[6] = (uint8_t)(e2e_counter);
+    data[7] = (uint8_t)(e2e_crc);
+}
+
+/** Decode @p data (at least CANSIG_VEHICLE_TELEMETRY_DLC bytes) into raw @p m. */
+static inline void CanSig_VehicleTelemetry_UnpackRaw(const uint8_t *data, CanSig_VehicleTelemetry_Raw_t *m)
+{
+    uint32_t speed_kph      = (uint32_t)data[0] | ((uint32_t)data[1] << 8);
+    uint32_t engine_rpm     = (uint32_t)data[2] | ((uint32_t)data[3] << 8);
+    uint32_t coolant_temp_c = (uint32_t)data[4] | ((uint32_t)data[5] << 8);
+    uint32_t e2e_counter    = ((uint32_t)data[6] & 0xFU);
+    uint32_t e2e_crc        = (uint32_t)data[7];
+
+    m->speed_kph      = (uint16_t)speed_kph;
+    m->engine_rpm     = (uint16_t)engine_rpm;
+    m->coolant_temp_c = (int16_t)(int32_t)((coolant_temp_c ^ 0x8000U) - 0x8000U);
+    m->e2e_counter    = (uint8_t)e2e_counter;
+    m->e2e_crc        = (uint8_t)e2e_crc;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Odometer (0x110, 8 bytes)                                                  */
+/* -------------------------------------------------------------------------- */
+
+/* Odometer, sent every second and authenticated (can_secoc.h). */
+#define CANSIG_ODOMETER_ID                 0x110U
+#define CANSIG_ODOMETER_DLC                8U
+
+/* odometer_m: Distance since the flash log was formatted, 32-bit unsigned, LE from bit 0 */
+#define CANSIG_ODOMETER_ODOMETER_M_MIN     0.0f
+#define CANSIG_ODOMETER_ODOMETER_M_MAX     4.2949673e+09f
+#define CANSIG_ODOMETER_ODOMETER_M_RAW_MIN (0)
+#define CANSIG_ODOMETER_ODOMETER_M_RAW_MAX (4294967295U)
+
+/* secoc_fv: SecOC freshness value, low 8 bits (can_secoc.h), 8-bit unsigned, LE from bit 32 */
+#define CANSIG_ODOMETER_SECOC_FV_MIN       0.0f
+#define CANSIG_ODOMETER_SECOC_FV_MAX       255.0f
+#define CANSIG_ODOMETER_SECOC_FV_RAW_MIN   (0)
+#define CANSIG_ODOMETER_SECOC_FV_RAW_MAX   (255U)
+
+/* secoc_mac: SecOC AES-CMAC, first 3 bytes; bytes 5..7 are MAC bytes 0..2, 24-bit unsigned, LE from bit 40 */
+#define CANSIG_ODOMETER_SECOC_MAC_MIN      0.0f
+#define CANSIG_ODOMETER_SECOC_MAC_MAX      16777215.0f
+#define CANSIG_ODOMETER_SECOC_MAC_RAW_MIN  (0)
+#define CANSIG_ODOMETER_SECOC_MAC_RAW_MAX  (16777215U)
+
+CANSIG_STATIC_ASSERT((CANSIG_ODOMETER_ODOMETER_M_RAW_MIN == 0) &&
+                     (CANSIG_ODOMETER_ODOMETER_M_RAW_MAX == 0xFFFFFFFFU),
+                     "Odometer.odometer_m: raw range does not match 32 bits");
+CANSIG_STATIC_ASSERT((CANSIG_ODOMETER_SECOC_FV_RAW_MIN == 0) &&
+                     (CANSIG_ODOMETER_SECOC_FV_RAW_MAX == 0xFFU),
+                     "Odometer.secoc_fv: raw range does not match 8 bits");
+CANSIG_STATIC_ASSERT((CANSIG_ODOMETER_SECOC_MAC_RAW_MIN == 0) &&
+                     (CANSIG_ODOMETER_SECOC_MAC_RAW_MAX == 0xFFFFFFU),
+                     "Odometer.secoc_mac: raw range does not match 24 bits");
+
+typedef struct
+{
+    uint32_t odometer_m; /**< m, 0 .. 4.29497e+09 */
+    uint8_t  secoc_fv;   /**< -, 0 .. 255 */
+    uint32_t secoc_mac;  /**< -, 0 .. 1.67772e+07 */
+} CanSig_Odometer_t;
+
+/** Encode @p m into the first CANSIG_ODOMETER_DLC bytes of @p data. */
+static inline void CanSig_Odometer_Pack(uint8_t *data, const CanSig_Odometer_t *m)
+{
+    uint32_t odometer_m = (uint32_t)(m->odometer_m);
+    uint32_t secoc_fv   = (uint32_t)(m->secoc_fv) & 0xFFU;
+    uint32_t secoc_mac  = (uint32_t)(m->secoc_mac) & 0xFFFFFFU;
+
+    data[0] = (uint8_t)(odometer_m);
+    data[1] = (uint8_t)(odometer_m >> 8);
+    data[2] = (uint8_t)(odometer_m >> 16);
+    data[3] = (uint8_t)(odometer_m >> 24);
+    data[4] = (uint8_t)(secoc_fv);
+    data[5] = (uint8_t)(secoc_mac);
+    data[6] = (uint8_t)(secoc_mac >> 8);
+    data[7] = (uint8_t)(secoc_mac >> 16);
+}
+
+/** Decode @p data (at least CANSIG_ODOMETER_DLC bytes) into @p m. */
+static inline void CanSig_Odometer_Unpack(const uint8_t *data, CanSig_Odometer_t *m)
+{
+    uint32_t odometer_m = (uint32_t)data[0] |
+                          ((uint32_t)data[1] << 8) |
+                          ((uint32_t)data[2] << 16) |
+                          ((uint32_t)data[3] << 24);
+    uint32_t secoc_fv   = (uint32_t)data[4];
+    uint32_t secoc_mac  = (uint32_t)data[5] | ((uint32_t)data[6] << 8) | ((uint32_t)data[7] << 16);
+
+    m->odometer_m = (uint32_t)odometer_m;
+    m->secoc_fv   = (uint8_t)secoc_fv;
+    m->secoc_mac  = (uint32_t)secoc_mac;
+}
+
+/* -------------------------------------------------------------------------- */
+/* TripData (0x111, 8 bytes)                                                  */
+/* -------------------------------------------------------------------------- */
+
+/* Trip computer, two groups sent in turn every 500 ms (trip.h). */
+#define CANSIG_TRIP_DATA_ID                    0x111U
+#define CANSIG_TRIP_DATA_DLC                   8U
+#define CANSIG_TRIP_DATA_GROUP_COUNT           2U
+#define CANSIG_TRIP_DATA_GROUP_MAX             1U
+
+/* trip_mux: Group selector: 0 trip, 1 totals and averages, 8-bit unsigned, LE from bit 0, multiplexer */
+#define CANSIG_TRIP_DATA_TRIP_MUX_MIN          0.0f
+#define CANSIG_TRIP_DATA_TRIP_MUX_MAX          1.0f
+#define CANSIG_TRIP_DATA_TRIP_MUX_RAW_MIN      (0)
+#define CANSIG_TRIP_DATA_TRIP_MUX_RAW_MAX      (255U)
+
+/* trip_km: 20-bit unsigned, LE from bit 8, group 0 */
+#define CANSIG_TRIP_DATA_TRIP_KM_FACTOR        0.1f
+#define CANSIG_TRIP_DATA_TRIP_KM_SCALE         10.0f
+#define CANSIG_TRIP_DATA_TRIP_KM_OFFSET        0.0f
+#define CANSIG_TRIP_DATA_TRIP_KM_MIN           0.0f
+#define CANSIG_TRIP_DATA_TRIP_KM_MAX           104857.5f
+#define CANSIG_TRIP_DATA_TRIP_KM_RAW_MIN       (0)
+#define CANSIG_TRIP_DATA_TRIP_KM_RAW_MAX       (1048575U)
+
+/* trip_drive_s: 20-bit unsigned, LE from bit 28, group 0 */
+#define CANSIG_TRIP_DATA_TRIP_DRIVE_S_MIN      0.0f
+#define CANSIG_TRIP_DATA_TRIP_DRIVE_S_MAX      1048575.0f
+#define CANSIG_TRIP_DATA_TRIP_DRIVE_S_RAW_MIN  (0)
+#define CANSIG_TRIP_DATA_TRIP_DRIVE_S_RAW_MAX  (1048575U)
+
+/* trip_max_rpm: 13-bit unsigned, LE from bit 48, group 0 */
+#define CANSIG_TRIP_DATA_TRIP_MAX_RPM_MIN      0.0f
+#define CANSIG_TRIP_DATA_TRIP_MAX_RPM_MAX      8191.0f
+#define CANSIG_TRIP_DATA_TRIP_MAX_RPM_RAW_MIN  (0)
+#define CANSIG_TRIP_DATA_TRIP_MAX_RPM_RAW_MAX  (8191U)
+
+/* total_drive_h: 20-bit unsigned, LE from bit 8, group 1 */
+#define CANSIG_TRIP_DATA_TOTAL_DRIVE_H_FACTOR  0.1f
+#define CANSIG_TRIP_DATA_TOTAL_DRIVE_H_SCALE   10.0f
+#define CANSIG_TRIP_DATA_TOTAL_DRIVE_H_OFFSET  0.0f
+#define CANSIG_TRIP_DATA_TOTAL_DRIVE_H_MIN     0.0f
+#define CANSIG_TRIP_DATA_TOTAL_DRIVE_H_MAX     104857.5f
+#define CANSIG_TRIP_DATA_TOTAL_DRIVE_H_RAW_MIN (0)
+#define CANSIG_TRIP_DATA_TOTAL_DRIVE_H_RAW_MAX (1048575U)
+
+/* trip_hot_s: Coolant above CAL TRIP_HOT_C this trip, 20-bit unsigned, LE from bit 28, group 1 */
+#define CANSIG_TRIP_DATA_TRIP_HOT_S_MIN        0.0f
+#define CANSIG_TRIP_DATA_TRIP_HOT_S_MAX        1048575.0f
+#define CANSIG_TRIP_DATA_TRIP_HOT_S_RAW_MIN    (0)
+#define CANSIG_TRIP_DATA_TRIP_HOT_S_RAW_MAX    (1048575U)
+
+/* trip_avg_kph: Trip distance over trip driving time, 12-bit unsigned, LE from bit 48, group 1 */
+#define CANSIG_TRIP_DATA_TRIP_AVG_KPH_FACTOR   0.1f
+#define CANSIG_TRIP_DATA_TRIP_AVG_KPH_SCALE    10.0f
+#define CANSIG_TRIP_DATA_TRIP_AVG_KPH_OFFSET   0.0f
+#define CANSIG_TRIP_DATA_TRIP_AVG_KPH_MIN      0.0f
+#define CANSIG_TRIP_DATA_TRIP_AVG_KPH_MAX      409.5f
+#define CANSIG_TRIP_DATA_TRIP_AVG_KPH_RAW_MIN  (0)
+#define CANSIG_TRIP_DATA_TRIP_AVG_KPH_RAW_MAX  (4095U)
+
+CANSIG_STATIC_ASSERT((CANSIG_TRIP_DATA_TRIP_MUX_RAW_MIN == 0) &&
+                     (CANSIG_TRIP_DATA_TRIP_MUX_RAW_MAX == 0xFFU),
+                     "TripData.trip_mux: raw range does not match 8 bits");
+CANSIG_STATIC_ASSERT((CANSIG_TRIP_DATA_TRIP_KM_RAW_MIN == 0) &&
+                     (CANSIG_TRIP_DATA_TRIP_KM_RAW_MAX == 0xFFFFFU),
+                     "TripData.trip_km: raw range does not match 20 bits");
+CANSIG_STATIC_ASSERT((CANSIG_TRIP_DATA_TRIP_DRIVE_S_RAW_MIN == 0) &&
+                     (CANSIG_TRIP_DATA_TRIP_DRIVE_S_RAW_MAX == 0xFFFFFU),
+                     "TripData.trip_drive_s: raw range does not match 20 bits");
+CANSIG_STATIC_ASSERT((CANSIG_TRIP_DATA_TRIP_MAX_RPM_RAW_MIN == 0) &&
+                     (CANSIG_TRIP_DATA_TRIP_MAX_RPM_RAW_MAX == 0x1FFFU),
+                     "TripData.trip_max_rpm: raw range does not match 13 bits");
+CANSIG_STATIC_ASSERT((CANSIG_TRIP_DATA_TOTAL_DRIVE_H_RAW_MIN == 0) &&
+                     (CANSIG_TRIP_DATA_TOTAL_DRIVE_H_RAW_MAX == 0xFFFFFU),
+                     "TripData.total_drive_h: raw range does not match 20 bits");
+CANSIG_STATIC_ASSERT((CANSIG_TRIP_DATA_TRIP_HOT_S_RAW_MIN == 0) &&
+                     (CANSIG_TRIP_DATA_TRIP_HOT_S_RAW_MAX == 0xFFFFFU),
+                     "TripData.trip_hot_s: raw range does not match 20 bits");
+CANSIG_STATIC_ASSERT((CANSIG_TRIP_DATA_TRIP_AVG_KPH_RAW_MIN == 0) &&
+                     (CANSIG_TRIP_DATA_TRIP_AVG_KPH_RAW_MAX == 0xFFFU),
+                     "TripData.trip_avg_kph: raw range does not match 12 bits");
+
+typedef struct
+{
+    uint8_t  trip_mux;      /**< -, 0 .. 1 */
+    float    trip_km;       /**< km, 0 .. 104858, group 0 */
+    uint32_t trip_drive_s;  /**< s, 0 .. 1.04858e+06, group 0 */
+    uint16_t trip_max_rpm;  /**< rpm, 0 .. 8191, group 0 */
+    float    total_drive_h; /**< h, 0 .. 104858, group 1 */
+    uint32_t trip_hot_s;    /**< s, 0 .. 1.04858e+06, group 1 */
+    float    trip_avg_kph;  /**< km/h, 0 .. 409.5, group 1 */
+} CanSig_TripData_t;
+
+/**
+ * @brief Encode @p m into the first CANSIG_TRIP_DATA_DLC bytes of @p data: the
+ *        ungrouped signals and the group m->trip_mux selects.
+ *
+ * @return 1, or 0 if trip_mux selects no group (the rest is encoded).
+ */
+static inline uint8_t CanSig_TripData_Pack(uint8_t *data, const CanSig_TripData_t *m)
+{
+    uint32_t trip_mux      = (uint32_t)(m->trip_mux) & 0xFFU;
+
+    switch (trip_mux)
+    {
+    case 0U:
+    {
+        uint32_t trip_km =
+            (uint32_t)(m->trip_km * CANSIG_TRIP_DATA_TRIP_KM_SCALE + 0.5f) & 0xFFFFFU;
+        uint32_t trip_drive_s  = (uint32_t)(m->trip_drive_s) & 0xFFFFFU;
+        uint32_t trip_max_rpm  = (uint32_t)(m->trip_max_rpm) & 0x1FFFU;
+
+        data[0] = (uint8_t)(trip_mux);
+        data[1] = (uint8_t)(trip_km);
+        data[2] = (uint8_t)(trip_km >> 8);
+        data[3] = (uint8_t)((trip_km >> 16) | (trip_drive_s << 4));
+        data[4] = (uint8_t)(trip_drive_s >> 4);
+        data[5] = (uint8_t)(trip_drive_s >> 12);
+        data[6] = (uint8_t)(trip_max_rpm);
+        data[7] = (uint8_t)(trip_max_rpm >> 8);
+        return 1U;
+    }
+    case 1U:
+    {
+        uint32_t total_drive_h =
+            (uint32_t)(m->total_drive_h * CANSIG_TRIP_DATA_TOTAL_DRIVE_H_SCALE + 0.5f) & 0xFFFFFU;
+        uint32_t trip_hot_s    = (uint32_t)(m->trip_hot_s) & 0xFFFFFU;
+        uint32_t trip_avg_kph =
+            (uint32_t)(m->trip_avg_kph * CANSIG_TRIP_DATA_TRIP_AVG_KPH_SCALE + 0.5f) & 0xFFFU;
+
+        data[0] = (uint8_t)(trip_mux);
+        data[1] = (uint8_t)(total_drive_h);
+        data[2] = (uint8_t)(total_drive_h >> 8);
+        data[3] = (uint8_t)((total_drive_h >> 16) | (trip_hot_s << 4));
+        data[4] = (uint8_t)(trip_hot_s >> 4);
+        data[5] = (uint8_t)(trip_hot_s >> 12);
+        data[6] = (uint8_t)(trip_avg_kph);
+        data[7] = (uint8_t)(trip_avg_kph >> 8);
+        return 1U;
+    }
+    default:
+        break;
+    }
+
+    data[0] = (uint8_t)(trip_mux);
+    data[1] = 0U;
+    data[2] = 0U;
+    data[3] = 0U;
+    data[4] = 0U;
+    data[5] = 0U;
+    data[6] = 0U;
+    data[7] = 0U;
+    return 0U;
+}
+
+/**
+ * @brief Decode @p data (at least CANSIG_TRIP_DATA_DLC bytes) into @p m: the
+ *        ungrouped signals and the group trip_mux selects. The fields of
+ *        the other groups keep their values.
+ *
+ * @return 1, or 0 if trip_mux selects no group.
+ */
+static inline uint8_t CanSig_TripData_Unpack(const uint8_t *data, CanSig_TripData_t *m)
+{
+    uint32_t trip_mux      = (uint32_t)data[0];
+
+    m->trip_mux      = (uint8_t)trip_mux;
+
+    switch (trip_mux)
+    {
+    case 0U:
+    {
+        uint32_t trip_km       = (uint32_t)data[1] |
+                                 ((uint32_t)data[2] << 8) |
+                                 (((uint32_t)data[3] & 0xFU) << 16);
+        uint32_t trip_drive_s  = ((uint32_t)data[3] >> 4) |
+                                 ((uint32_t)data[4] << 4) |
+                                 ((uint32_t)data[5] << 12);
+        uint32_t trip_max_rpm  = (uint32_t)data[6] | (((uint32_t)data[7] & 0x1FU) << 8);
+
+        m->trip_km       = (float)trip_km * CANSIG_TRIP_DATA_TRIP_KM_FACTOR;
+        m->trip_drive_s  = (uint32_t)trip_drive_s;
+        m->trip_max_rpm  = (uint16_t)trip_max_rpm;
+        return 1U;
+    }
+    case 1U:
+    {
+        uint32_t total_drive_h = (uint32_t)data[1] |
+                                 ((uint32_t)data[2] << 8) |
+                                 (((uint32_t)data[3] & 0xFU) << 16);
+        uint32_t trip_hot_s    = ((uint32_t)data[3] >> 4) |
+                                 ((uint32_t)data[4] << 4) |
+                                 ((uint32_t)data[5] << 12);
+        uint32_t trip_avg_kph  = (uint32_t)data[6] | (((uint32_t)data[7] & 0xFU) << 8);
+
+        m->total_drive_h = (float)total_drive_h * CANSIG_TRIP_DATA_TOTAL_DRIVE_H_FACTOR;
+        m->trip_hot_s    = (uint32_t)trip_hot_s;
+        m->trip_avg_kph  = (float)trip_avg_kph * CANSIG_TRIP_DATA_TRIP_AVG_KPH_FACTOR;
+        return 1U;
+    }
+    default:
+        return 0U;
+    }
+}
+
+/** Raw values of TripData, as on the bus. */
+typedef struct
+{
+    uint8_t  trip_mux;      /**< raw */
+    uint32_t trip_km;       /**< x CANSIG_TRIP_DATA_TRIP_KM_FACTOR, group 0 */
+    uint32_t trip_drive_s;  /**< raw, group 0 */
+    uint16_t trip_max_rpm;  /**< raw, group 0 */
+    uint32_t total_drive_h; /**< x CANSIG_TRIP_DATA_TOTAL_DRIVE_H_FACTOR, group 1 */
+    uint32_t trip_hot_s;    /**< raw, group 1 */
+    uint16_t trip_avg_kph;  /**< x CANSIG_TRIP_DATA_TRIP_AVG_KPH_FACTOR, group 1 */
+} CanSig_TripData_Raw_t;
+
+/** Raw values of @p m, rounded as CanSig_TripData_Pack() rounds them. */
+static inline void CanSig_TripData_ToRaw(const CanSig_TripData_t *m,
+                                         CanSig_TripData_Raw_t *r)
+{
+    r->trip_mux      = m->trip_mux;
+    r->trip_km       = (uint32_t)(m->trip_km * CANSIG_TRIP_DATA_TRIP_KM_SCALE + 0.5f);
+    r->trip_drive_s  = m->trip_drive_s;
+    r->trip_max_rpm  = m->trip_max_rpm;
+    r->total_drive_h = (uint32_t)(m->total_drive_h * CANSIG_TRIP_DATA_TOTAL_DRIVE_H_SCALE + 0.5f);
+    r->trip_hot_s    = m->trip_hot_s;
+    r->trip_avg_kph =
+        (uint16_t)(uint32_t)(m->trip_avg_kph * CANSIG_TRIP_DATA_TRIP_AVG_KPH_SCALE + 0.5f);
+}
+
+/**
+ * @brief Encode raw @p m into the first CANSIG_TRIP_DATA_DLC bytes of @p data: the
+ *        ungrouped signals and the group m->trip_mux selects.
+ *
+ * @return 1, or 0 if trip_mux selects no group (the rest is encoded).
+ */
+static inline uint8_t CanSig_TripData_PackRaw(uint8_t *data, const CanSig_TripData_Raw_t *m)
+{
+    uint32_t trip_mux      = (uint32_t)(m->trip_mux) & 0xFFU;
+
+    switch (trip_mux)
+    {
+    case 0U:
+    {
+        uint32_t trip_km       = (uint32_t)(m->trip_km) & 0xFFFFFU;
+        uint32_t trip_drive_s  = (uint32_t)(m->trip_drive_s) & 0xFFFFFU;
+        uint32_t trip_max_rpm  = (uint32_t)(m->trip_max_rpm) & 0x1FFFU;
+
+        data[0] = (uint8_t)(trip_mux);
+        data[1] = (uint8_t)(trip_km);
+        data[2] = (uint8_t)(trip_km >> 8);
+        data[3] = (uint8_t)((trip_km >> 16) | (trip_drive_s << 4));
+        data[4] = (uint8_t)(trip_drive_s >> 4);
+        data[5] = (uint8_t)(trip_drive_s >> 12);
+        data[6] = (uint8_t)(trip_max_rpm);
+        data[7] = (uint8_t)(trip_max_rpm >> 8);
+        return 1U;
+    }
+    case 1U:
+    {
+        uint32_t total_drive_h = (uint32_t)(m->total_drive_h) & 0xFFFFFU;
+        uint32_t trip_hot_s    = (uint32_t)(m->trip_hot_s) & 0xFFFFFU;
+        uint32_t trip_avg_kph  = (uint32_t)(m->trip_avg_kph) & 0xFFFU;
+
+        data[0] = (uint8_t)(trip_mux);
+        data[1] = (uint8_t)(total_drive_h);
+        data[2] = (uint8_t)(total_drive_h >> 8);
+        data[3] = (uint8_t)((total_drive_h >> 16) | (trip_hot_s << 4));
+        data[4] = (uint8_t)(trip_hot_s >> 4);
+        data[5] = (uint8_t)(trip_hot_s >> 12);
+        data[6] = (uint8_t)(trip_avg_kph);
+        data[7] = (uint8_t)(trip_avg_kph >> 8);
+        return 1U;
+    }
+    default:
+        break;
+    }
+
+    data[0] = (uint8_t)(trip_mux);
+    data[1] = 0U;
+    data[2] = 0U;
+    data[3] = 0U;
+    data[4] = 0U;
+    data[5] = 0U;
+    data[6] = 0U;
+    data[7] = 0U;
+    return 0U;
+}
+
+/**
+ * @brief Decode @p data (at least CANSIG_TRIP_DATA_DLC bytes) into raw @p m: the
+ *        ungrouped signals and the group trip_mux selects. The fields of
+ *        the other groups keep their values.
+ *
+ * @return 1, or 0 if trip_mux selects no group.
+ */
+static inline uint8_t CanSig_TripData_UnpackRaw(const uint8_t *data, CanSig_TripData_Raw_t *m)
+{
+    uint32_t trip_mux      = (uint32_t)data[0];
+
+    m->trip_mux      = (uint8_t)trip_mux;
+
+    switch (trip_mux)
+    {
+    case 0U:
+    {
+        uint32_t trip_km       = (uint32_t)data[1] |
+                                 ((uint32_t)data[2] << 8) |
+                                 (((uint32_t)data[3] & 0xFU) << 16);
+        uint32_t trip_drive_s  = ((uint32_t)data[3] >> 4) |
+                                 ((uint32_t)data[4] << 4) |
+                                 ((uint32_t)data[5] << 12);
+        uint32_t trip_max_rpm  = (uint32_t)data[6] | (((uint32_t)data[7] & 0x1FU) << 8);
+
+        m->trip_km       = (uint32_t)trip_km;
+        m->trip_drive_s  = (uint32_t)trip_drive_s;
+        m->trip_max_rpm  = (uint16_t)trip_max_rpm;
+        return 1U;
+    }
+    case 1U:
+    {
+        uint32_t total_drive_h = (uint32_t)data[1] |
+                                 ((uint32_t)data[2] << 8) |
+                                 (((uint32_t)data[3] & 0xFU) << 16);
+        uint32_t trip_hot_s    = ((uint32_t)data[3] >> 4) |
+                                 ((uint32_t)data[4] << 4) |
+                                 ((uint32_t)data[5] << 12);
+        uint32_t trip_avg_kph  = (uint32_t)data[6] | (((uint32_t)data[7] & 0xFU) << 8);
+
+        m->total_drive_h = (uint32_t)total_drive_h;
+        m->trip_hot_s    = (uint32_t)trip_hot_s;
+        m->trip_avg_kph  = (uint16_t)trip_avg_kph;
+        return 1U;
+    }
+    default:
+        return 0U;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* NmPdu (0x500, 8 bytes)                                                     */
+/* -------------------------------------------------------------------------- */
+
+/* Network management, sent on 0x500 + node ID every second while awake (can_nm.h). */
+#define CANSIG_NM_PDU_ID                        0x500U
+#define CANSIG_NM_PDU_DLC                       8U
+
+/* nm_source: Source node ID, 8-bit unsigned, LE from bit 0 */
+#define CANSIG_NM_PDU_NM_SOURCE_MIN             0.0f
+#define CANSIG_NM_PDU_NM_SOURCE_MAX             63.0f
+#define CANSIG_NM_PDU_NM_SOURCE_RAW_MIN         (0)
+#define CANSIG_NM_PDU_NM_SOURCE_RAW_MAX         (255U)
+
+/* nm_repeat_request: Repeat Message Request: all nodes to Repeat Message, 1-bit unsigned, LE from bit 8 */
+#define CANSIG_NM_PDU_NM_REPEAT_REQUEST_MIN     0.0f
+#define CANSIG_NM_PDU_NM_REPEAT_REQUEST_MAX     1.0f
+#define CANSIG_NM_PDU_NM_REPEAT_REQUEST_RAW_MIN (0)
+#define CANSIG_NM_PDU_NM_REPEAT_REQUEST_RAW_MAX (1U)
+
+/* nm_active_wakeup: The sender woke the bus itself, 1-bit unsigned, LE from bit 12 */
+#define CANSIG_NM_PDU_NM_ACTIVE_WAKEUP_MIN      0.0f
+#define CANSIG_NM_PDU_NM_ACTIVE_WAKEUP_MAX      1.0f
+#define CANSIG_NM_PDU_NM_ACTIVE_WAKEUP_RAW_MIN  (0)
+#define CANSIG_NM_PDU_NM_ACTIVE_WAKEUP_RAW_MAX  (1U)
+
+/* nm_state: Sender NM state: 1 repeat, 2 normal, 3 ready sleep, 8-bit unsigned, LE from bit 16 */
+#define CANSIG_NM_PDU_NM_STATE_MIN              0.0f
+#define CANSIG_NM_PDU_NM_STATE_MAX              4.0f
+#define CANSIG_NM_PDU_NM_STATE_RAW_MIN          (0)
+#define CANSIG_NM_PDU_NM_STATE_RAW_MAX          (255U)
+
+CANSIG_STATIC_ASSERT((CANSIG_NM_PDU_NM_SOURCE_RAW_MIN == 0) &&
+                     (CANSIG_NM_PDU_NM_SOURCE_RAW_MAX == 0xFFU),
+                     "NmPdu.nm_source: raw range does not match 8 bits");
+CANSIG_STATIC_ASSERT((CANSIG_NM_PDU_NM_REPEAT_REQUEST_RAW_MIN == 0) &&
+                     (CANSIG_NM_PDU_NM_REPEAT_REQUEST_RAW_MAX == 0x1U),
+                     "NmPdu.nm_repeat_request: raw range does not match 1 bits");
+CANSIG_STATIC_ASSERT((CANSIG_NM_PDU_NM_ACTIVE_WAKEUP_RAW_MIN == 0) &&
+                     (CANSIG_NM_PDU_NM_ACTIVE_WAKEUP_RAW_MAX == 0x1U),
+                     "NmPdu.nm_active_wakeup: raw range does not match 1 bits");
+CANSIG_STATIC_ASSERT((CANSIG_NM_PDU_NM_STATE_RAW_MIN == 0) &&
+                     (CANSIG_NM_PDU_NM_STATE_RAW_MAX == 0xFFU),
+                     "NmPdu.nm_state: raw range does not match 8 bits");
+
+typedef struct
+{
+    uint8_t nm_source;         /**< -, 0 .. 63 */
+    uint8_t nm_repeat_request; /**< -, 0 .. 1 */
+    uint8_t nm_active_wakeup;  /**< -, 0 .. 1 */
+    uint8_t nm_state;          /**< -, 0 .. 4 */
+} CanSig_NmPdu_t;
+
+/** Encode @p m into the first CANSIG_NM_PDU_DLC bytes of @p data. */
+static inline void CanSig_NmPdu_Pack(uint8_t *data, const CanSig_NmPdu_t *m)
+{
+    uint32_t nm_source         = (uint32_t)(m->nm_source) & 0xFFU;
+    uint32_t nm_repeat_request = (uint32_t)(m->nm_repeat_request) & 0x1U;
+    uint32_t nm_active_wakeup  = (uint32_t)(m->nm_active_wakeup) & 0x1U;
+    uint32_t nm_state          = (uint32_t)(m->nm_state) & 0xFFU;
+
+    data[0] = (uint8_t)(nm_source);
+    data[1] = (uint8_t)(nm_repeat_request | (nm_active_wakeup << 4));
+    data[2] = (uint8_t)(nm_state);
+    data[3] = 0U;
+    data[4] = 0U;
+    data[5] = 0U;
+    data[6] = 0U;
+    data[7] = 0U;
+}
+
+/** Decode @p data (at least CANSIG_NM_PDU_DLC bytes) into @p m. */
+static inline void CanSig_NmPdu_Unpack(const uint8_t *data, CanSig_NmPdu_t *m)
+{
+    uint32_t nm_source         = (uint32_t)data[0];
+    uint32_t nm_repeat_request = ((uint32_t)data[1] & 0x1U);
+    uint32_t nm_active_wakeup  = (((uint32_t)data[1] >> 4) & 0x1U);
+    uint32_t nm_state          = (uint32_t)data[2];
+
+    m->nm_source         = (uint8_t)nm_source;
+    m->nm_repeat_request = (uint8_t)nm_repeat_request;
+    m->nm_active_wakeup  = (uint8_t)nm_active_wakeup;
+    m->nm_state          = (uint8_t)nm_state;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(__cplusplus) && (__cplusplus >= 201703L)
+
+#include "can_signal.hpp"
+
+namespace cansig
+{
+
+/** Alarm (0x20), the layout of CanSig_Alarm_Pack(). */
+struct Alarm : Frame<CANSIG_ALARM_DLC,
+    Signal<0U, 8U, ByteOrder::Intel, false, std::ratio<1>, std::ratio<0>, std::ratio<0>, std::ratio<255>>,
+    Signal<8U, 1U, ByteOrder::Intel, false, std::ratio<1>, std::ratio<0>, std::ratio<0>, std::ratio<1>>,
+    Signal<12U, 4U, ByteOrder::Intel, false, std::ratio<1>, std::ratio<0>, std::ratio<0>, std::ratio<15>>,
+    Signal<32U, 32U, ByteOrder::Intel, true, std::ratio<1, 100>, std::ratio<0>, std::ratio<-536870912, 25>, std::ratio<2147483647, 100>>>
+{
+    enum Sig : std::size_t { alarm_index, alarm_active, alarm_seq, alarm_value };
+};
+
+/** VehicleTelemetry (0x100), the layout of CanSig_VehicleTelemetry_Pack(). */
+struct VehicleTelemetry : Frame<CANSIG_VEHICLE_TELEMETRY_DLC,
+    Signal<0U, 16U, ByteOrder::Intel, false, std::ratio<1, 10>, std::ratio<0>, std::ratio<0>, std::ratio<13107, 2>>,
+    Signal<16U, 16U, ByteOrder::Intel, false, std::ratio<1>, std::ratio<0>, std::ratio<0>, std::ratio<65535>>,
+    Signal<32U, 16U, ByteOrder::Intel, true, std::ratio<1, 10>, std::ratio<0>, std::ratio<-16384, 5>, std::ratio<32767, 10>>,
+    Signal<48U, 4U, ByteOrder::Intel, false, std::ratio<1>, std::ratio<0>, std::ratio<0>, std::ratio<14>>,
+    Signal<56U, 8U, ByteOrder::Intel, false, std::ratio<1>, std::ratio<0>, std::ratio<0>, std::ratio<255>>>
+{
+    enum Sig : std::size_t { speed_kph, engine_rpm, coolant_temp_c, e2e_counter, e2e_crc };
+};
+
+/** Odometer (0x110), the layout of CanSig_Odometer_Pack(). */
+struct Odometer : Frame<CANSIG_ODOMETER_DLC,
+    Signal<0U, 32U, ByteOrder::Intel, false, std::ratio<1>, std::ratio<0>, std::ratio<0>, std::ratio<4294967295>>,
+    Signal<32U, 8U, ByteOrder::Intel, false, std::ratio<1>, std::ratio<0>, std::ratio<0>, std::ratio<255>>,
+    Signal<40U, 24U, ByteOrder::Intel, false, std::ratio<1>, std::ratio<0>, std::ratio<0>, std::ratio<16777215>>>
+{
+    enum Sig : std::size_t { odometer_m, secoc_fv, secoc_mac };
+};
+
+/** NmPdu (0x500), the layout of CanSig_NmPdu_Pack(). */
+struct NmPdu : Frame<CANSIG_NM_PDU_DLC,
+    Signal<0U, 8U, ByteOrder::Intel, false, std::ratio<1>, std::ratio<0>, std::ratio<0>, std::ratio<63>>,
+    Signal<8U, 1U, ByteOrder::Intel, false, std::ratio<1>, std::ratio<0>, std::ratio<0>, std::ratio<1>>,
+    Signal<12U, 1U, ByteOrder::Intel, false, std::ratio<1>, std::ratio<0>, std::ratio<0>, std::ratio<1>>,
+    Signal<16U, 8U, ByteOrder::Intel, false, std::ratio<1>, std::ratio<0>, std::ratio<0>, std::ratio<4>>>
+{
+    enum Sig : std::size_t { nm_source, nm_repeat_request, nm_active_wakeup, nm_state };
+};
+
+} /* namespace cansig */
+
+#endif /* __cplusplus >= 201703L */
+
+#endif /* CAN_SIGNALS_H */
@@ -0,0 +1,142 @@
+/**
+ * @file    can_stats.h
+ * @brief   CAN bus load, frame rate and error statistics.
+ *
+ * The CAN interrupts only count; nothing is logged or formatted there:
+ *
+ *   - RX (FIFO interrupts): frames per identifier, up to CAN_STATS_MAX_IDS,
+ *     and the bits they occupied on the bus.
+ *   - TX (CAN_IF_Transmit() / TX interrupt): frames and bits handed to a
+ *     mailbox.
+ *   - Errors (SCE interrupt): a histogram of the last error code (stuff,
+ *     form, ACK, bit, CRC), RX FIFO overruns, the peak TEC/REC from
+ *     CAN->ESR and the transitions between error active, warning, passive
+ *     and bus-off.
+ *
+ * A static software timer (timer service task) turns the counters into
+ * per-second rates and a bus load every CAN_STATS_PERIOD_MS. Load is the
+ * nominal frame length (SOF to intermission, no stuff bits, so a lower
+ * bound) over the current bitrate; in loopback the RX copies of our own
+ * frames are not counted twice. The timer also polls CAN->ESR, because
+ * bxCAN raises no interrupt when the error counters fall back below a
+ * threshold, and logs one summary line when errors occurred, at most every
+ * CAN_STATS_REPORT_MS, so an error storm cannot flood the log.
+ *
+ * "can stats" prints the latest window, "can stats reset" clears it.
+ */
+
+#ifndef CAN_STATS_H
+#define CAN_STATS_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Identifiers counted separately; frames of further IDs are only summed. */
+#ifndef CAN_STATS_MAX_IDS
+#define CAN_STATS_MAX_IDS       16U
+#endif
+
+/** Rate and load window (ms). */
+#ifndef CAN_STATS_PERIOD_MS
+#define CAN_STATS_PERIOD_MS     1000U
+#endif
+
+/** Least time between two error summaries in the log (ms). */
+#ifndef CAN_STATS_REPORT_MS
+#define CAN_STATS_REPORT_MS     5000U
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/** Fault confinement state, from CAN->ESR. */
+typedef enum
+{
+    CAN_STATS_ACTIVE = 0,   /**< TEC and REC below 96. */
+    CAN_STATS_WARNING,      /**< A counter at or above 96. */
+    CAN_STATS_PASSIVE,      /**< A counter above 127. */
+    CAN_STATS_BUSOFF,       /**< TEC above 255. */
+    CAN_STATS_STATES
+} CanStats_State_t;
+
+/** Last error codes, as in CAN->ESR LEC (0 = none, 7 = unused). */
+#define CAN_STATS_LEC_COUNT     8U
+
+/**
+ * @brief Per-identifier counters.
+ */
+typedef struct
+{
+    uint32_t id;            /**< CAN_IF format (CAN_IF_ID_EXT / _RTR folded in). */
+    uint32_t frames;        /**< Received since the last reset. */
+    uint32_t perSec;        /**< Received in the last window, per second. */
+} CanStats_Id_t;
+
+/**
+ * @brief Bus-wide counters of the last window and since the last reset.
+ */
+typedef struct
+{
+    uint32_t windows;                       /**< Windows completed. */
+    uint16_t loadPermille;                  /**< Bus load of the last window. */
+    uint16_t peakLoadPermille;              /**< Highest window load. */
+    uint32_t rxPerSec;                      /**< RX frames in the last window, per second. */
+    uint32_t txPerSec;                      /**< TX frames in the last window, per second. */
+    uint32_t rxFrames;                      /**< RX frames, all IDs. */
+    uint32_t txFrames;                      /**< TX frames handed to a mailbox. */
+    uint32_t otherFrames;                   /**< RX frames of IDs past the table. */
+    uint8_t  tec;                           /**< Transmit error counter, at the last window. */
+    uint8_t  rec;                           /**< Receive error counter, at the last window. */
+    uint8_t  tecPeak;                       /**< Highest TEC seen in the SCE interrupt. */
+    uint8_t  recPeak;                       /**< Highest REC seen in the SCE interrupt. */
+    uint8_t  state;                         /**< CanStats_State_t now. */
+    uint32_t entered[CAN_STATS_STATES];     /**< Transitions into each state. */
+    uint32_t lec[CAN_STATS_LEC_COUNT];      /**< Error frames by last error code. */
+    uint32_t errorIrqs;                     /**< SCE interrupts taken. */
+    uint32_t fifoOverruns;                  /**< RX frames lost by a full hardware FIFO. */
+} CanStats_Summary_t;
+
+/**
+ * @brief Start the sampling timer and register "can stats". Counting runs
+ *        from boot; call after osKernelInitialize().
+ *
+ * @return HAL_OK, or HAL_ERROR if the timer could not be started.
+ */
+HAL_StatusTypeDef CanStats_Init(void);
+
+/** RX interrupt: one frame with identifier @p key and @p dlc bytes. */
+void CanStats_OnRx(uint32_t key, uint8_t dlc);
+
+/** A frame went into a TX mailbox (from the TX interrupt). */
+void CanStats_OnTx(uint32_t key, uint8_t dlc);
+
+/**
+ * @brief SCE interrupt: account @p halError (HAL_CAN_ERROR_* bits gathered
+ *        by HAL_CAN_IRQHandler()) and the error register @p esr.
+ */
+void CanStats_OnError(uint32_t halError, uint32_t esr);
+
+/**
+ * @brief Copy the summary and up to @p max per-ID entries.
+ *
+ * @return Number of entries written to @p ids.
+ */
+uint32_t CanStats_Get(CanStats_Summary_t *sum, CanStats_Id_t *ids, uint32_t max);
+
+/** Clear all counters (the current state is kept). */
+void CanStats_Reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_STATS_H */
@@ -0,0 +1,89 @@
+/**
+ * @file    can_timing.h
+ * @brief   bxCAN bit-timing calculator.
+ *
+ * A CAN bit is split into time quanta (TQ):
+ *
+ *   | SYNC (1 TQ) | BS1 (1..16 TQ) | BS2 (1..8 TQ) |
+ *                                  ^ sample point
+ *
+ *   bitrate      = PCLK1 / (prescaler * (1 + BS1 + BS2))
+ *   sample point = (1 + BS1) / (1 + BS1 + BS2)
+ *
+ * CanTiming_Compute() searches every legal quanta count for the requested
+ * bitrate, keeps the combinations whose bitrate error is within
+ * CAN_TIMING_MAX_ERR_PPM, and prefers those whose sample point is within
+ * CAN_TIMING_SP_TOL of the request. Among these the smallest bitrate error
+ * wins, then the most quanta per bit (finer resynchronisation).
+ */
+
+#ifndef CAN_TIMING_H
+#define CAN_TIMING_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Largest accepted bitrate error in parts per million (0.5 %). */
+#ifndef CAN_TIMING_MAX_ERR_PPM
+#define CAN_TIMING_MAX_ERR_PPM   5000U
+#endif
+
+/** Default sample point in permille (CiA 301 recommends 87.5 %). */
+#ifndef CAN_TIMING_SAMPLE_POINT
+#define CAN_TIMING_SAMPLE_POINT  875U
+#endif
+
+/** Sample point deviation (permille) still considered a good match. */
+#ifndef CAN_TIMING_SP_TOL
+#define CAN_TIMING_SP_TOL        20U
+#endif
+
+/**
+ * @brief One bit-timing solution.
+ */
+typedef struct
+{
+    uint32_t prescaler;     /**< 1..1024. */
+    uint8_t  bs1;           /**< Time segment 1 in TQ (1..16). */
+    uint8_t  bs2;           /**< Time segment 2 in TQ (1..8). */
+    uint8_t  sjw;           /**< Resync jump width in TQ (1..4). */
+    uint8_t  tqPerBit;      /**< 1 + bs1 + bs2. */
+    uint32_t bitrate;       /**< Achieved bitrate in bit/s. */
+    uint16_t samplePoint;   /**< Achieved sample point in permille. */
+} CanTiming_t;
+
+/**
+ * @brief Compute bit timing for a bitrate from a CAN kernel clock.
+ *
+ * @param[in]  pclkHz          APB1 clock (HAL_RCC_GetPCLK1Freq()).
+ * @param[in]  bitrate         Requested bitrate in bit/s.
+ * @param[in]  samplePermille  Requested sample point (e.g. 875).
+ * @param[out] out             Best solution.
+ * @return HAL_OK, or HAL_ERROR if no combination is within tolerance.
+ */
+HAL_StatusTypeDef CanTiming_Compute(uint32_t pclkHz, uint32_t bitrate,
+                                    uint32_t samplePermille, CanTiming_t *out);
+
+/**
+ * @brief Copy a solution into a HAL CAN init structure.
+ *
+ * Only Prescaler, SyncJumpWidth, TimeSeg1 and TimeSeg2 are written.
+ */
+void CanTiming_ToInit(const CanTiming_t *t, CAN_InitTypeDef *init);
+
+/**
+ * @brief BTR register value for a solution and HAL CAN mode.
+ *
+ * @param[in] mode CAN_MODE_NORMAL / _LOOPBACK / _SILENT / _SILENT_LOOPBACK.
+ */
+uint32_t CanTiming_ToBtr(const CanTiming_t *t, uint32_t mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_TIMING_H */
@@ -0,0 +1,181 @@
+/**
+ * @file    can_trace.h
+ * @brief   CAN RX trace recorder in a RAM ring, dumped in bulk over the UART.
+ *
+ * "log on" formats every frame as it arrives, about 30 UART bytes per
+ * frame, which a busy bus outruns. The recorder instead copies each frame
+ * raw into a CAN_TRACE_DEPTH record ring from the RX FIFO interrupt: no
+ * formatting, one 20-byte copy, and frames the RX ring had to drop are
+ * still recorded (flagged CAN_TRACE_F_RING_FULL). When the ring is full the
+ * oldest records are overwritten.
+ *
+ * Recording is controlled from the CLI:
+ *
+ *   can trace start [<id>[:<mask>]]     record now, or from the first frame
+ *                                       matching <id> (trigger)
+ *   can trace stop [<id>[:<mask>] [<n>]]
+ *                                       stop now, or set a stop condition:
+ *                                       <n> more frames after one matching
+ *                                       <id>
+ *   can trace dump [text|bin|pack]      stop and stream the ring
+ *   can trace add <sec>.<usec> <id>#<data>
+ *                                       append a record (stopped only):
+ *                                       loads a trace for "can replay"
+ *
+ * IDs are hex as in candump: 3 digits for 11-bit, 8 digits for 29-bit
+ * identifiers. Without a mask the ID must match exactly.
+ *
+ * "dump text" writes candump log lines, "(sec.usec) can0 123#11223344",
+ * which can-utils (canplayer, log2asc) read directly. "dump bin" sends the
+ * records as they are in RAM, in frames that survive interleaved log
+ * output:
+ *
+ *   0xFD | len | type | payload
+ *
+ *   type 'H': version (u8), record size (u16), records (u32),
+ *             overwritten (u32), bitrate (u32)
+ *   type 'R': CanTrace_Rec_t records, back to back
+ *   type 'E': records sent (u32)
+ *
+ * "dump pack" sends the same frames with header version 2, record size 0
+ * and one more byte, CAN_TRACE_DICT_SIZE - 1, and the records in 'P'
+ * frames instead of 'R', each record packed as
+ *
+ *   tag (u8)        DLC (bits 0-3), RTR (4), flags (5-6), new ID (7)
+ *   time delta      varint, zigzag: us since the previous record (the
+ *                   first: since 0)
+ *   ID              new ID: varint of (identifier << 1 | 29-bit), which
+ *                   takes the next dictionary slot (round robin once all
+ *                   are used); otherwise its slot (u8)
+ *   data            DLC bytes, none for a remote frame
+ *
+ * An 8-byte frame on a known ID takes 11 or 12 bytes instead of 20, short
+ * frames less; the dump time shrinks with it. The dictionary and time carry
+ * over from 'P' frame to 'P' frame, records never straddle two.
+ *
+ * All words are little-endian; tools/can_trace.py turns a capture into a
+ * candump log. Both dumps pace themselves on the free space of the log
+ * ring, so nothing is dropped, and block only CliTask.
+ *
+ * The ring is also the source of "can replay" (can_replay.h), recorded here
+ * or loaded with "can trace add" by tools/can_replay.py.
+ */
+
+#ifndef CAN_TRACE_H
+#define CAN_TRACE_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Records in the trace ring (power of two; 20 bytes each). */
+#ifndef CAN_TRACE_DEPTH
+#define CAN_TRACE_DEPTH     1024U
+#endif
+
+/** ID dictionary slots of the packed dump (1..256). */
+#ifndef CAN_TRACE_DICT_SIZE
+#define CAN_TRACE_DICT_SIZE 64U
+#endif
+
+/** Interface name in the candump text dump. */
+#ifndef CAN_TRACE_IFNAME
+#define CAN_TRACE_IFNAME    "can0"
+#endif
+
+/** A dump gives up when the UART makes no progress for this long (ms). */
+#ifndef CAN_TRACE_DUMP_TIMEOUT_MS
+#define CAN_TRACE_DUMP_TIMEOUT_MS  1000U
+#endif
+
+/** Sync byte of a binary dump frame. */
+#define CAN_TRACE_SYNC      0xFDU
+
+/** Room for the longest candump line, "(4294967.295999) can0 1FFFFFFF#"
+ *  + 16 data digits + CRLF + NUL (50). */
+#define CAN_TRACE_LINE_MAX  52U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/** CanTrace_Rec_t::flags. */
+#define CAN_TRACE_F_FIFO1       0x01U   /**< Received in RX FIFO1. */
+#define CAN_TRACE_F_RING_FULL   0x02U   /**< Dropped by the RX ring (not seen by CanRxTask). */
+
+/**
+ * @brief One recorded frame (20 bytes, the layout of the binary dump).
+ */
+typedef struct
+{
+    uint32_t timeMs;    /**< Global time at the RX interrupt (time_sync.h), ms. */
+    uint16_t timeUs;    /**< Microseconds into that tick (0..999). */
+    uint8_t  dlc;       /**< Data length code. */
+    uint8_t  flags;     /**< CAN_TRACE_F_*. */
+    uint32_t id;        /**< Identifier | CAN_IF_ID_EXT | CAN_IF_ID_RTR. */
+    uint8_t  data[8];   /**< Payload (bytes past the DLC are zero). */
+} CanTrace_Rec_t;
+
+/**
+ * @brief Reset the recorder (stopped, empty) and register "can trace".
+ *        Called by CAN_IF_Init().
+ */
+void CanTrace_Init(void);
+
+/**
+ * @brief RX interrupt: record one frame if recording.
+ *
+ * @param[in] key   Identifier in CAN_IF_Msg_t::Id format.
+ * @param[in] dlc   Data length code.
+ * @param[in] flags CAN_TRACE_F_*.
+ * @param[in] data  8 payload bytes as read from the FIFO.
+ */
+void CanTrace_OnRx(uint32_t key, uint8_t dlc, uint8_t flags, const uint8_t *data);
+
+/**
+ * @brief Stop recording; the records held stay stable until the next
+ *        "can trace start".
+ *
+ * @return Number of records held.
+ */
+uint32_t CanTrace_Stop(void);
+
+/**
+ * @brief Record @p i of those held, oldest first. Only while stopped.
+ *
+ * @return The record, or NULL if @p i is past the last one.
+ */
+const CanTrace_Rec_t *CanTrace_Get(uint32_t i);
+
+/**
+ * @brief Parse the time and frame fields of a candump log line,
+ *        "<sec>.<usec>" (parentheses optional) and "<id>#<data>" or
+ *        "<id>#R". 8 ID digits or an ID above 0x7FF mean 29 bits. A
+ *        field ends at its NUL or at whitespace, so both may point into
+ *        a line in place (the SIL replay parses a mapped file).
+ *
+ * @param[out] rec Filled in, flags 0.
+ * @return 1 on success, 0 if a field is malformed.
+ */
+uint8_t CanTrace_ParseLine(const char *time, const char *frame, CanTrace_Rec_t *rec);
+
+/**
+ * @brief Write the candump log line of @p rec, CRLF-terminated, to @p out
+ *        (at least CAN_TRACE_LINE_MAX bytes; not NUL-terminated).
+ *
+ * @return Characters written.
+ */
+uint32_t CanTrace_FormatLine(const CanTrace_Rec_t *rec, char *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_TRACE_H */
@@ -0,0 +1,152 @@
+/**
+ * @file    can_txq.h
+ * @brief   Priority-ordered software TX queue for CAN frames.
+ *
+ * A binary min-heap keyed by CAN arbitration priority: the frame that
+ * would win arbitration on the bus is always popped first, so a burst of
+ * low-priority traffic cannot park in front of an urgent frame while the
+ * three hardware mailboxes are busy. Frames with the same identifier
+ * leave in submission order.
+ *
+ * The queue itself is not thread-safe: it has one owner, the CAN TX
+ * interrupt (CAN_IF), and tasks touch it only with interrupts masked.
+ *
+ * Frames reach it through the submission slots (CanTxSub_t): any task or
+ * interrupt claims a free slot, fills it and publishes it, with one
+ * LDREX/STREX loop per step on a bit mask and never a masked interrupt;
+ * the owner takes every published slot into the heap in submission order.
+ * A producer preempted between claim and publish holds up nothing but its
+ * own slot, since the owner takes the other slots around it. A STREX only
+ * fails when another context wrote the same mask in between, so a retry
+ * is rare and nobody ever waits on a preempted context.
+ */
+
+#ifndef CAN_TXQ_H
+#define CAN_TXQ_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of frames the software TX queue can hold. */
+#ifndef CAN_TXQ_SIZE
+#define CAN_TXQ_SIZE  16U
+#endif
+
+/** Submission slots, claimed and published by bit in a 32-bit mask. */
+#ifndef CAN_TXSUB_SIZE
+#define CAN_TXSUB_SIZE  16U
+#endif
+
+#if (CAN_TXSUB_SIZE == 0U) || (CAN_TXSUB_SIZE > 32U)
+#error "CAN_TXSUB_SIZE must be 1..32"
+#endif
+
+/**
+ * @brief Frame waiting for a hardware mailbox, in the layout of the
+ *        mailbox registers: handing it over is four register writes.
+ */
+typedef struct
+{
+    uint32_t tir;      /**< CAN_TIxR: STID/EXID and IDE, TXRQ clear. */
+    uint32_t tdtr;     /**< CAN_TDTxR: data length code (0..8), CAN_TXQ_IN_ORDER. */
+    uint32_t data[2];  /**< CAN_TDLxR/TDHxR: byte 0 in bits 7:0 of data[0]. */
+} CanTxFrame_t;
+
+/** Bit of CanTxFrame_t::tdtr, reserved in the register: the frame must not
+ *  pass an earlier one of its identifier (masked when written). */
+#define CAN_TXQ_IN_ORDER  (1UL << 4)
+
+/**
+ * @brief Heap storage and ordering state.
+ */
+typedef struct
+{
+    CanTxFrame_t frame[CAN_TXQ_SIZE];
+    uint32_t     key[CAN_TXQ_SIZE];   /**< Arbitration key, lower = higher priority. */
+    uint32_t     seq[CAN_TXQ_SIZE];   /**< Submission order for equal keys. */
+    uint32_t     count;
+    uint32_t     nextSeq;
+} CanTxQueue_t;
+
+/**
+ * @brief Submission slots in front of one queue.
+ */
+typedef struct
+{
+    CanTxFrame_t      frame[CAN_TXSUB_SIZE];
+    uint32_t          ticket[CAN_TXSUB_SIZE];  /**< Submission order of the slot. */
+    volatile uint32_t free;                    /**< Bit n: slot n unclaimed. */
+    volatile uint32_t ready;                   /**< Bit n: slot n published. */
+    volatile uint32_t nextTicket;
+} CanTxSub_t;
+
+/** Empty the queue. */
+void CanTxQ_Init(CanTxQueue_t *q);
+
+/**
+ * @brief Insert a frame.
+ *
+ * @return 1 on success, 0 if the queue is full.
+ */
+uint8_t CanTxQ_Push(CanTxQueue_t *q, const CanTxFrame_t *frame);
+
+/**
+ * @brief Insert a frame that was submitted as number @p seq; frames with
+ *        the same identifier leave in @p seq order (wrap-safe). Do not
+ *        mix with CanTxQ_Push() on one queue.
+ *
+ * @return 1 on success, 0 if the queue is full.
+ */
+uint8_t CanTxQ_PushSeq(CanTxQueue_t *q, const CanTxFrame_t *frame, uint32_t seq);
+
+/**
+ * @brief Remove the highest-priority frame.
+ *
+ * @return 1 if a frame was copied to @p out, 0 if the queue is empty.
+ */
+uint8_t CanTxQ_Pop(CanTxQueue_t *q, CanTxFrame_t *out);
+
+/** The frame CanTxQ_Pop() would return, NULL if the queue is empty. */
+const CanTxFrame_t *CanTxQ_Peek(const CanTxQueue_t *q);
+
+/** Number of frames currently queued. */
+uint32_t CanTxQ_Count(const CanTxQueue_t *q);
+
+/** All slots free. Not while a producer may be in CanTxSub_Claim(). */
+void CanTxSub_Init(CanTxSub_t *s);
+
+/**
+ * @brief Claim a slot to fill; any context, lock-free.
+ *
+ * @return The slot's frame, NULL if every slot is claimed.
+ */
+CanTxFrame_t *CanTxSub_Claim(CanTxSub_t *s);
+
+/**
+ * @brief Hand the filled slot @p frame (from CanTxSub_Claim()) to the owner.
+ */
+void CanTxSub_Publish(CanTxSub_t *s, CanTxFrame_t *frame);
+
+/**
+ * @brief Owner: move published slots into @p q, oldest first, as far as
+ *        it has room; the rest stay published for the next call.
+ *
+ * @return Frames moved.
+ */
+uint32_t CanTxSub_Take(CanTxSub_t *s, CanTxQueue_t *q);
+
+/**
+ * @brief Owner: free every published slot without queuing it.
+ *
+ * @return Frames discarded.
+ */
+uint32_t CanTxSub_Discard(CanTxSub_t *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_TXQ_H */
@@ -3,42 +3,213 @@
  * @brief   UART-based command line interface for Mini ECU.
  *
  * This CLI provides:
- *   - Interrupt-driven RX into a ring buffer.
- *   - A simple line-based command parser.
- *   - A live "dashboard" line showing speed/RPM/temp.
+ *   - Circular DMA RX with IDLE-line detection (no per-byte interrupt).
+ *   - A table-driven command dispatcher; other modules register their
+ *     commands with CLI_IF_Register().
+ *   - A live "dashboard" line showing speed/RPM/temp, from the vehicle
+ *     model or decoded from CAN RX.
+ *   - A second input from the RTT down buffer (rtt.h), for a debug probe
+ *     without the UART; the replies follow "log transport cli".
  */
 
 #ifndef CLI_IF_H
 #define CLI_IF_H
 
 #include "main.h"
-#include "vehicle.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/** Size of the circular DMA RX buffer (bytes). */
+#ifndef CLI_RX_DMA_SIZE
+#define CLI_RX_DMA_SIZE     512U
+#endif
+
+/** RTT input poll period (ms); 0 = no RTT input. The probe raises no
+ *  interrupt, so CliTask wakes this often while idle. */
+#ifndef CLI_RTT_POLL_MS
+#define CLI_RTT_POLL_MS     20U
+#endif
+
+/** Default dashboard refresh period in ms (runtime: "dash rate <ms>"). */
+#ifndef CLI_DASH_PERIOD_MS
+#define CLI_DASH_PERIOD_MS  500U
+#endif
+
+/** Shortest accepted runtime refresh period (ms). */
+#ifndef CLI_DASH_MIN_PERIOD_MS
+#define CLI_DASH_MIN_PERIOD_MS  50U
+#endif
+
+/** Dashboard pauses after this long without input (ms; 0 = never;
+ *  runtime: "dash idle <s>"). Any received byte resumes it. */
+#ifndef CLI_DASH_IDLE_MS
+#define CLI_DASH_IDLE_MS    60000U
+#endif
+
+/** The refresh period doubles for each this many percent of the CLI
+ *  transport's rings queued (0 = fixed period). */
+#ifndef CLI_DASH_BACKLOG_PCT
+#define CLI_DASH_BACKLOG_PCT  25U
+#endif
+
+/** Longest period the backlog stretches the refresh to (ms). */
+#ifndef CLI_DASH_MAX_PERIOD_MS
+#define CLI_DASH_MAX_PERIOD_MS  4000U
+#endif
+
+/** Dashboard source at boot: 0 = vehicle model, 1 = decoded CAN RX
+ *  (runtime: "dash src model|can"). */
+#ifndef CLI_DASH_FROM_CAN
+#define CLI_DASH_FROM_CAN  0U
+#endif
+
+/** Full dashboard redraw every N refreshes; in between only changed
+ *  values are sent. */
+#ifndef CLI_DASH_FULL_EVERY
+#define CLI_DASH_FULL_EVERY  20U
+#endif
+
+/** Longest input line (bytes, including the terminator). */
+#ifndef CLI_LINE_MAX
+#define CLI_LINE_MAX        96U
+#endif
+
+/** Most words per line (command name words included). */
+#ifndef CLI_MAX_ARGS
+#define CLI_MAX_ARGS        8U
+#endif
+
+/** Capacity of the command registry (the full build registers ~180). */
+#ifndef CLI_MAX_COMMANDS
+#define CLI_MAX_COMMANDS    256U
+#endif
+
+/** Longest command name ("log level"), including the terminator. */
+#define CLI_NAME_MAX        24U
+
+/** Largest single CLI_IF_Printf() output. */
+#ifndef CLI_PRINTF_MAX
+#define CLI_PRINTF_MAX      128U
+#endif
+
+/**
+ * @brief Command handler.
+ *
+ * @param[in] argc Number of words after the command name.
+ * @param[in] argv Those words (NUL-terminated, writable).
+ *
+ * The handler prints its reply with CLI_IF_Print()/CLI_IF_Printf(), each
+ * line ending in "\r\n"; the dispatcher adds the prompt afterwards.
+ */
+typedef void (*CliHandler_t)(int argc, char *argv[]);
+
+/**
+ * @brief One command table entry.
+ */
+typedef struct
+{
+    const char  *name;     /**< One to three words, e.g. "dash" or "log level". */
+    const char  *args;     /**< Argument synopsis for help/usage, e.g. "<ms>". */
+    uint8_t      minArgs;  /**< Fewer words after the name print the usage. */
+    CliHandler_t handler;
+    const char  *help;     /**< One-line description; NULL hides an alias. */
+} CliCommand_t;
+
+/**
+ * @brief Register a table of commands.
+ *
+ * The table must stay valid for the program lifetime (normally a static
+ * const array in the owning module). Call during initialization: before
+ * the scheduler starts or from CliTask itself (DeferredInit() in main.c);
+ * the registry is not locked against CliTask.
+ *
+ * @return HAL_OK, or HAL_ERROR on a duplicate name, invalid entry or full
+ *         registry (entries before the failing one stay registered).
+ */
+HAL_StatusTypeDef CLI_IF_Register(const CliCommand_t *cmds, uint32_t count);
+
+/**
+ * @brief Register the static table @p cmds of a module's Init().
+ *
+ * A module table that does not register is a build error (registry full,
+ * a name taken twice), not a run-time condition: the image stops in
+ * Error_Handler(), whose crash dump names the caller, at the first boot
+ * and in the SIL run instead of shipping without the commands.
+ */
+#define CLI_IF_REGISTER_TABLE(cmds)                                                          \
+    do                                                                                       \
+    {                                                                                        \
+        if (CLI_IF_Register((cmds), (uint32_t)(sizeof(cmds) / sizeof((cmds)[0]))) != HAL_OK) \
+            Error_Handler();                                                                 \
+    } while (0)
+
+/**
+ * @brief Run one command line as if typed, without echo or prompt
+ *        (CliTask only; the CLI scripts of cli_script.h).
+ *
+ * @param[in,out] line Command text; split into words in place.
+ */
+void CLI_IF_Execute(char *line);
+
+/**
+ * @brief CLI_IF_Execute() with the command's CLI output into @p out instead
+ *        of the console (CliTask only; the EXEC request of cli_rpc.h).
+ *
+ * @param[in,out] line Command text; split into words in place.
+ * @param[out]    out  Output, not terminated.
+ * @param[in]     size Capacity of @p out.
+ * @param[out]    cut  Output bytes that did not fit (may be NULL).
+ * @return Bytes written to @p out.
+ */
+uint32_t CLI_IF_ExecuteCapture(char *line, char *out, uint32_t size, uint32_t *cut);
+
+/**
+ * @brief Print a string on the CLI (queued, non-blocking).
+ */
+void CLI_IF_Print(const char *s);
+
+/**
+ * @brief printf-style CLI output (up to CLI_PRINTF_MAX bytes).
+ */
+void CLI_IF_Printf(const char *fmt, ...);
+
 /**
  * @brief Initialize the CLI interface.
  *
+ * The dashboard reads Vehicle_GetSnapshot() and the "veh" commands post to
+ * the vehicle mailbox, so the CLI holds no pointer into VehicleTask state.
+ *
  * @param[in] huart   UART handle used for CLI I/O (e.g., &huart2).
- * @param[in] vehicle Pointer to the main VehicleState_t instance
- *                    whose values will be shown on the live dashboard.
  */
-void CLI_IF_Init(UART_HandleTypeDef *huart, VehicleState_t *vehicle);
+void CLI_IF_Init(UART_HandleTypeDef *huart);
 
 /**
- * @brief Periodic CLI processing; to be called from a dedicated RTOS task.
+ * @brief CLI processing; to be called in a loop from a dedicated RTOS task.
  *
  * Responsibilities:
- *   - Drain RX ring buffer and feed characters into the line parser.
- *   - Periodically refresh the live "speedometer" line.
+ *   - Sleep until the RX DMA reports new input (IDLE line / buffer wrap)
+ *     or the dashboard is due.
+ *   - Feed received characters into the line parser.
+ *   - Refresh the live "speedometer" line every dashboard period
+ *     (CLI_DASH_PERIOD_MS by default, longer while the output is backed
+ *     up), sending only values that changed.
+ *   - Pause the dashboard after CLI_DASH_IDLE_MS without input, resume
+ *     it with a full redraw on the next received byte.
  *
- * This function is non-blocking and should be called regularly, e.g.
- * every 10 ms from a task that also calls osDelay(10).
+ * Blocks for at most one dashboard period (indefinitely while the
+ * dashboard is off or paused); no extra delay is needed in the calling
+ * task.
  */
 void CLI_IF_Task(void);
 
+/**
+ * @brief The core left Stop mode (low_power.h): have the CLI task check
+ *        the RX DMA and re-arm it if it stopped. Any task context.
+ */
+void CLI_IF_Resume(void);
+
 #ifdef __cplusplus
 }
 #endif
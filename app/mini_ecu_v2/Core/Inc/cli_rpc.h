@@ -0,0 +1,150 @@
+/**
+ * @file    cli_rpc.h
+ * @brief   Binary request/response RPC on the CLI console ("rpc",
+ *          tools/cli_rpc.py).
+ *
+ * Test automation that types commands has to pick the reply out of the
+ * echo, the prompt, log lines and the dashboard's escape sequences. An RPC
+ * client sends one frame per request instead and gets one frame back, on
+ * the same console and next to the text CLI:
+ *
+ *   request   0x00 | COBS('Q' | seq | cmd | TLV... | CRC-16) | 0x00
+ *   response  0x00 | COBS('P' | seq | cmd | status | TLV... | CRC-16) | 0x00
+ *
+ * framed as the telemetry (tlm_stream.h): COBS leaves a zero only at both
+ * ends, CRC-16/CCITT-FALSE (little-endian) covers everything before it. A
+ * zero byte, which typing never produces, starts a frame ahead of the line
+ * editor: no echo, no prompt, the dashboard is not woken. The request is
+ * handled in CliTask when its closing zero arrives and the response goes
+ * out in the CLI stream as one record, so nothing lands inside it; a
+ * client drops every byte outside the zeros. A frame that stalls for
+ * CLI_RPC_RX_TIMEOUT_MS is discarded. seq is echoed back for matching;
+ * frames with a bad CRC or size get no answer and are counted.
+ *
+ * Arguments and results are TLVs: tag (u8), length (u8), value; numbers
+ * little-endian, text without a terminator. Unknown tags are ignored.
+ *
+ *   cmd            request tags                 response tags
+ *   0x01 PING      -                            1 uptime ms u32, 2 version u8
+ *   0x02 EXEC      1 command line               1 output text, 2 bytes cut u32
+ *   0x10 VEH_GET   -                            1 speed km/h f32, 2 rpm u16,
+ *                                               3 coolant C f32, 4 throttle f32,
+ *                                               5 gear u8
+ *   0x11 VEH_SPEED 1 target km/h f32            -
+ *   0x20 LOG_LEVEL [1 module text] [2 level u8] 2 level u8
+ *   0x21 STATS     -                            1 uptime ms u32, 2..4 records
+ *                                               dropped u32 (lines, cli, tlm),
+ *                                               5 CAN RX u32, 6 CAN TX u32,
+ *                                               7 CAN state u8, 8 TEC u8,
+ *                                               9 REC u8, 10 FIFO overruns u32
+ *   0x30 CAL_GET   1 name text | 2 key u16      2 key u16, 3 f32 | 4 u32 value
+ *   0x31 CAL_SET   1 name | 2 key, 3 f32 | 4 u32 -
+ *   0x32 CAL_COMMIT -                           1 values queued u32
+ *   0x40 STAGE_BEGIN [1 length u32]             1 slot base u32
+ *   0x41 STAGE_DATA 1 offset u32, 2 bytes       1 bytes received u32
+ *   0x42 STAGE_END -                            1 bytes programmed u32
+ *
+ * EXEC runs any text command through the CLI's own dispatch and returns
+ * what it printed (up to CLI_RPC_OUT_MAX bytes), so every handler of
+ * "help" is reachable; the typed commands above skip the text on both
+ * sides. Status: 0 ok, 1 unknown cmd, 2 bad or missing argument, 3 refused
+ * (queue full, value out of range).
+ *
+ * The STAGE_* requests hand an image to stage.h at the console's rate, for
+ * the flashing proxy (fw_proxy.h, tools/fw_proxy.py). STAGE_BEGIN without
+ * a length only names the slot, so the client can pick the image linked
+ * for it. STAGE_DATA takes the bytes at the offset received so far; a
+ * repeated earlier one is answered without writing it again, a later one
+ * is bad, and 3 means the ring is full (retry). STAGE_END returns 3 while
+ * the staging is still programming, 2 once the staging has failed. Staging
+ * has one producer: not over UDS at the same time.
+ */
+
+#ifndef CLI_RPC_H
+#define CLI_RPC_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Largest request before COBS, CRC included (bytes): a STAGE_DATA of
+ *  248 bytes fits. */
+#ifndef CLI_RPC_REQ_MAX
+#define CLI_RPC_REQ_MAX         272U
+#endif
+
+/** Most EXEC output returned (bytes); the rest is counted in tag 2. */
+#ifndef CLI_RPC_OUT_MAX
+#define CLI_RPC_OUT_MAX         480U
+#endif
+
+/** A request frame pausing this long is discarded (ms). */
+#ifndef CLI_RPC_RX_TIMEOUT_MS
+#define CLI_RPC_RX_TIMEOUT_MS   100U
+#endif
+
+/** Protocol version, PING tag 2. */
+#define CLI_RPC_VERSION         2U
+
+/** Frame types. */
+#define CLI_RPC_FRAME_REQ       'Q'
+#define CLI_RPC_FRAME_RESP      'P'
+
+/** X(name, id, handler suffix); the ids are the protocol, never reuse one. */
+#define CLI_RPC_TABLE(X)                        \
+    X(PING,        0x01U, ping)                 \
+    X(EXEC,        0x02U, exec)                 \
+    X(VEH_GET,     0x10U, veh_get)              \
+    X(VEH_SPEED,   0x11U, veh_speed)            \
+    X(LOG_LEVEL,   0x20U, log_level)            \
+    X(STATS,       0x21U, stats)                \
+    X(CAL_GET,     0x30U, cal_get)              \
+    X(CAL_SET,     0x31U, cal_set)              \
+    X(CAL_COMMIT,  0x32U, cal_commit)           \
+    X(STAGE_BEGIN, 0x40U, stage_begin)          \
+    X(STAGE_DATA,  0x41U, stage_data)           \
+    X(STAGE_END,   0x42U, stage_end)
+
+#define CLI_RPC_ENUM_(name, id, fn)   CLI_RPC_##name = (id),
+
+typedef enum
+{
+    CLI_RPC_TABLE(CLI_RPC_ENUM_)
+} CliRpc_Cmd_t;
+
+typedef enum
+{
+    CLI_RPC_OK = 0,
+    CLI_RPC_E_CMD,
+    CLI_RPC_E_ARG,
+    CLI_RPC_E_REFUSED
+} CliRpc_Status_t;
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Register "rpc". Called by CLI_IF_Init().
+ */
+void CliRpc_Init(void);
+
+/**
+ * @brief A received byte, before the line editor (CliTask).
+ *
+ * @return 1 if it belongs to a request frame, 0 if it is for the editor.
+ */
+uint8_t CliRpc_RxByte(uint8_t c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLI_RPC_H */
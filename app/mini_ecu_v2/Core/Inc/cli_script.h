@@ -0,0 +1,108 @@
+/**
+ * @file    cli_script.h
+ * @brief   CLI scripts: uploaded once, run by CliTask with timing
+ *          directives and a latency per command.
+ *
+ * A test rig that pastes its commands depends on the line editor keeping
+ * up and pays for the echo of every byte. A script is uploaded as one
+ * framed block instead and then runs inside CliTask:
+ *
+ *   script load <bytes> [<crc>]
+ *
+ * takes the next @c bytes bytes as they are, without echo or line
+ * editing (a '\n' right after the command's '\r' is dropped), into a RAM
+ * buffer of CLI_SCRIPT_SIZE bytes. With @c crc (CRC-16/CCITT-FALSE, hex,
+ * the one of tlm_stream.h) a corrupted upload is rejected. A pause of
+ * CLI_SCRIPT_LOAD_TIMEOUT_MS aborts it. tools/cli_script.py uploads a
+ * file, runs it and prints the report.
+ *
+ * One line per command; blank lines and lines starting with '#' are
+ * skipped. Besides the commands of "help" a script knows
+ *
+ *   wait <n>[ms|s]     continue after n ms (or s); CliTask sleeps
+ *   repeat <n>         run the lines up to the matching "end" n times
+ *   end                (0 = until "script stop"), nested CLI_SCRIPT_DEPTH
+ *
+ * The script is checked when it arrives: a bad wait or repeat, a line
+ * too long and unbalanced repeat/end are reported with their line number.
+ *
+ * "script run" starts it. Commands run back to back, without echo or
+ * prompt, until a wait; after CLI_SCRIPT_BURST of them without one the
+ * script yields a tick so the lower priority tasks keep running. Input
+ * is still read between steps, so "script stop" ends a run. Each command
+ * is timed with the DWT cycle counter: "script report" lists per line the
+ * runs and the last, mean and largest time. A run ends with its total
+ * time and its slowest line.
+ *
+ * The script lives in RAM only and is lost at a reset.
+ */
+
+#ifndef CLI_SCRIPT_H
+#define CLI_SCRIPT_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Script buffer (bytes). */
+#ifndef CLI_SCRIPT_SIZE
+#define CLI_SCRIPT_SIZE             2048U
+#endif
+
+/** Most steps of a script; comments and blank lines do not count. */
+#ifndef CLI_SCRIPT_MAX_LINES
+#define CLI_SCRIPT_MAX_LINES        128U
+#endif
+
+/** Deepest repeat nesting. */
+#ifndef CLI_SCRIPT_DEPTH
+#define CLI_SCRIPT_DEPTH            4U
+#endif
+
+/** Commands run without a wait before the script yields a tick. */
+#ifndef CLI_SCRIPT_BURST
+#define CLI_SCRIPT_BURST            16U
+#endif
+
+/** An upload pausing this long is aborted (ms). */
+#ifndef CLI_SCRIPT_LOAD_TIMEOUT_MS
+#define CLI_SCRIPT_LOAD_TIMEOUT_MS  2000U
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Register the "script" commands. Called by CLI_IF_Init().
+ */
+void CliScript_Init(void);
+
+/**
+ * @brief A received byte, before the line editor (CliTask).
+ *
+ * @return 1 if an upload took it, 0 if it is for the line editor.
+ */
+uint8_t CliScript_RxByte(uint8_t c);
+
+/**
+ * @brief Run the steps that are due and time out a stalled upload
+ *        (CliTask, every pass of CLI_IF_Task()).
+ *
+ * @param[in] nowMs Kernel tick.
+ * @return Milliseconds until the next step (osWaitForever if none).
+ */
+uint32_t CliScript_Run(uint32_t nowMs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLI_SCRIPT_H */
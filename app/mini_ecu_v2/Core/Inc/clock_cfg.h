@@ -0,0 +1,163 @@
+/**
+ * @file    clock_cfg.h
+ * @brief   Selectable system clock profiles for the Mini ECU application.
+ *
+ * Profiles (all derived from the 16 MHz HSI, so no board solder bridges
+ * are needed for an HSE):
+ *
+ *   | Profile               | SYSCLK  | APB1   | APB2   | VOS     | Flash WS |
+ *   |-----------------------|---------|--------|--------|---------|----------|
+ *   | CLOCK_PROFILE_HSI16   | 16 MHz  | 8 MHz  | 16 MHz | Scale 3 | 0        |
+ *   | CLOCK_PROFILE_84MHZ   | 84 MHz  | 42 MHz | 84 MHz | Scale 3 | 2        |
+ *   | CLOCK_PROFILE_180MHZ  | 180 MHz | 45 MHz | 90 MHz | Scale 1 + over-drive | 5 |
+ *
+ * The profile is chosen at build time (CLOCK_PROFILE) and can be
+ * overridden by a boot configuration word in flash (CLOCK_BOOT_CFG_ADDR).
+ *
+ * Peripheral timing follows the clock automatically: CAN bit timing is
+ * computed from the APB1 frequency (can_timing.c) and HAL_UART_Init()
+ * derives BRR from the PCLK frequency; both run after the clock switch.
+ * At run time the governor (clock_gov.h) switches between the profiles and
+ * has every clock-derived setting re-derived; ClockCfg_RetimeTimer() does
+ * it for the APB1 timers.
+ */
+
+#ifndef CLOCK_CFG_H
+#define CLOCK_CFG_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+#define CLOCK_PROFILE_HSI16    0U   /**< 16 MHz HSI, PLL off (lowest power). */
+#define CLOCK_PROFILE_84MHZ    1U   /**< 84 MHz from PLL. */
+#define CLOCK_PROFILE_180MHZ   2U   /**< 180 MHz from PLL with over-drive. */
+#define CLOCK_PROFILE_COUNT    3U
+
+/** Build-time clock profile. */
+#ifndef CLOCK_PROFILE
+#define CLOCK_PROFILE          CLOCK_PROFILE_180MHZ
+#endif
+
+/**
+ * @brief Optional flash address of a boot configuration word.
+ *
+ * When defined, a word of the form 0xC10Cxxxx selects the profile in its
+ * low byte (e.g. 0xC10C0001 = 84 MHz) and overrides CLOCK_PROFILE. Any
+ * other value (erased flash reads 0xFFFFFFFF) keeps the build-time choice.
+ */
+/* #define CLOCK_BOOT_CFG_ADDR  0x0800C000U */
+
+#define CLOCK_BOOT_CFG_MAGIC   0xC10C0000U
+#define CLOCK_BOOT_CFG_MASK    0xFFFF0000U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Static description of one clock profile.
+ */
+typedef struct
+{
+    const char *name;
+    uint32_t    sysclkHz;
+    uint32_t    apb1Hz;
+} ClockCfg_Profile_t;
+
+/**
+ * @brief Profile selected by the boot config word or CLOCK_PROFILE.
+ */
+uint32_t ClockCfg_Select(void);
+
+/**
+ * @brief Switch the system clock to a profile.
+ *
+ * Sets the voltage scale (and over-drive), PLL, bus dividers and flash wait
+ * states in the order required for raising or lowering the frequency, then
+ * enables the ART accelerator (prefetch, instruction and data caches).
+ * Updates SystemCoreClock and the HAL tick.
+ *
+ * @param[in] profile CLOCK_PROFILE_xxx.
+ * @return HAL_OK, or HAL_ERROR for an unknown profile / failed RCC step.
+ */
+HAL_StatusTypeDef ClockCfg_Apply(uint32_t profile);
+
+/**
+ * @brief Bring up the selected profile straight out of reset.
+ *
+ * Called from Startup_EarlyInit() (startup.h), before .data and .bss
+ * exist: register writes only, const data and the stack, no HAL tick.
+ * Does nothing unless the core still runs on the reset HSI with the PLL
+ * off, or for CLOCK_PROFILE_HSI16. Leaves SystemCoreClock and the HAL
+ * tick to ClockCfg_Adopt(), which then finds the profile running; gives up
+ * on a ready flag that never comes, for ClockCfg_Apply() to retry.
+ */
+void ClockCfg_EarlyInit(void);
+
+/**
+ * @brief Take over a profile the bootloader or ClockCfg_EarlyInit()
+ *        already set up.
+ *
+ * Checks that the RCC, PWR and flash registers match the profile and, if
+ * they do, only enables the ART accelerator and updates SystemCoreClock and
+ * the HAL tick, skipping the oscillator and bus sequencing of
+ * ClockCfg_Apply().
+ *
+ * @param[in] profile CLOCK_PROFILE_xxx from the hand-off block (boot_handoff.h).
+ * @return HAL_OK, or HAL_ERROR if the hardware is in another state (the
+ *         caller then falls back to ClockCfg_Apply()).
+ */
+HAL_StatusTypeDef ClockCfg_Adopt(uint32_t profile);
+
+/**
+ * @brief Profile currently applied (valid after ClockCfg_Apply() or
+ *        ClockCfg_Adopt()).
+ */
+const ClockCfg_Profile_t *ClockCfg_GetActive(void);
+
+/**
+ * @brief CLOCK_PROFILE_xxx of ClockCfg_GetActive().
+ */
+uint32_t ClockCfg_GetActiveId(void);
+
+/**
+ * @brief Description of @p profile, or NULL for an unknown one.
+ */
+const ClockCfg_Profile_t *ClockCfg_GetProfile(uint32_t profile);
+
+/**
+ * @brief Clock of the APB1 timers (TIM2..7, TIM12..14) now: PCLK1,
+ *        doubled when APB1 is divided.
+ */
+uint32_t ClockCfg_TimerHz(void);
+
+/**
+ * @brief Clock of the APB2 timers (TIM1, TIM8..11) now: PCLK2, doubled
+ *        when APB2 is divided.
+ */
+uint32_t ClockCfg_Apb2TimerHz(void);
+
+/**
+ * @brief Give a timer a new prescaler and period after a clock switch
+ *        without restarting its period.
+ *
+ * The counter keeps its position in the period, scaled to @p arr. A new
+ * prescaler is loaded at once by an update event that raises no update
+ * interrupt (URS); it does reach TRGO. For timers without auto-reload
+ * preload (ARPE = 0). Any context.
+ */
+void ClockCfg_RetimeTimer(TIM_TypeDef *tim, uint32_t psc, uint32_t arr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLOCK_CFG_H */
@@ -0,0 +1,187 @@
+/**
+ * @file    clock_gov.h
+ * @brief   Clock governor: clock profile from the measured CPU load ("clk").
+ *
+ * The build-time profile (clock_cfg.h) is sized for the worst case: the
+ * fleet, a bulk dump and a full CAN bus at once. Most of the time the load
+ * is a fraction of that, and a lower profile does the same work in more
+ * of the period for much less current. A 100 ms runnable (raster.h)
+ * measures the load over CLOCK_GOV_WINDOW_MS and steps the profile:
+ *
+ *   - up one profile after CLOCK_GOV_UP_WINDOWS windows at or above
+ *     CLOCK_GOV_UP_PERMILLE;
+ *   - down one profile after CLOCK_GOV_DOWN_WINDOWS windows in which the
+ *     load, scaled to the lower profile's clock, stays at or below
+ *     CLOCK_GOV_DOWN_PERMILLE. The gap between the two thresholds keeps
+ *     the governor from toggling between two profiles;
+ *   - straight to the top profile for a while after ClockGov_Boost(), which
+ *     the bulk transfers call ("can trace dump", "xlog dump", "trace dump")
+ *     so a dump does not wait for the load windows.
+ * The profiles stay between CLOCK_GOV_MIN_PROFILE and the profile the
+ * peripherals were set up at in main(): the QSPI prescaler is not
+ * re-derived, so the governor never goes above it.
+ *
+ * Load is the time not spent in the idle task: DWT cycles minus the idle
+ * task's run-time counter, over the window's wall time at the current
+ * clock. Sleep (low_power.h) stops the cycle counter and so counts as
+ * idle. Interrupts taken while the idle task ran are charged to it, so
+ * the figure is a little low under a heavy interrupt load.
+ *
+ * A switch runs in the 100 ms raster task with the scheduler suspended:
+ *   1. refused when CAN (the current bitrate) or the console UART (the
+ *      current rate) cannot be timed from the new APB1 clock;
+ *   2. deferred to the next 100 ms while LogTask holds a chunk, the UART
+ *      still shifts a byte out, a CAN reconfiguration is in progress or
+ *      the CAN network sleeps;
+ *   3. CAN1 (and CAN2) leave the bus, ClockCfg_Apply() relocks the PLL
+ *      (falls back to the old profile if it fails), and every
+ *      clock-derived setting is re-derived: the timebase (time_sync.h,
+ *      continuous across the switch), the TIM5 control loop, the TIM2 ADC
+ *      trigger, the TIM7 debounce timer, the console BRR, the SWO
+ *      prescaler, the USB turnaround and the CAN bit timing; CAN rejoins.
+ * The switch takes a few hundred microseconds ("clk" shows the last and
+ * the longest): task releases in that time are late by as much, CAN frames
+ * are neither sent nor received and a byte arriving on the console may be
+ * lost. SysTick keeps the kernel tick at 1 ms at every clock.
+ *
+ * Benchmarks ("bench ...") measure at one clock: pin it with "clk <profile>"
+ * first and give it back with "clk auto".
+ *
+ *   clk                   profile, load, switches, latency, time per profile
+ *   clk auto              let the load choose the profile
+ *   clk <profile>         pin HSI16, 84MHz or 180MHz
+ *   clk reset             clear the counters
+ */
+
+#ifndef CLOCK_GOV_H
+#define CLOCK_GOV_H
+
+#include "main.h"
+#include "clock_cfg.h"
+#include "uart_baud.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = governor, its runnable and "clk" built in. */
+#ifndef CLOCK_GOV_ENABLE
+#define CLOCK_GOV_ENABLE          UART_BAUD_ENABLE
+#endif
+
+/** Load measurement window (ms), a multiple of the 100 ms raster. */
+#ifndef CLOCK_GOV_WINDOW_MS
+#define CLOCK_GOV_WINDOW_MS       500U
+#endif
+
+/** Step up after this many windows at or above this load (1/1000). */
+#ifndef CLOCK_GOV_UP_PERMILLE
+#define CLOCK_GOV_UP_PERMILLE     700U
+#endif
+#ifndef CLOCK_GOV_UP_WINDOWS
+#define CLOCK_GOV_UP_WINDOWS      2U
+#endif
+
+/** Step down after this many windows whose load at the next lower clock
+ *  would be at or below this (1/1000). */
+#ifndef CLOCK_GOV_DOWN_PERMILLE
+#define CLOCK_GOV_DOWN_PERMILLE   400U
+#endif
+#ifndef CLOCK_GOV_DOWN_WINDOWS
+#define CLOCK_GOV_DOWN_WINDOWS    6U
+#endif
+
+/** Lowest profile the governor uses. */
+#ifndef CLOCK_GOV_MIN_PROFILE
+#define CLOCK_GOV_MIN_PROFILE     CLOCK_PROFILE_HSI16
+#endif
+
+/** Highest profile; never above the one main() started with. */
+#ifndef CLOCK_GOV_MAX_PROFILE
+#define CLOCK_GOV_MAX_PROFILE     CLOCK_PROFILE
+#endif
+
+/** Default boost length for the bulk transfers (ms). */
+#ifndef CLOCK_GOV_BOOST_MS
+#define CLOCK_GOV_BOOST_MS        5000U
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief How the profile is chosen.
+ */
+typedef enum
+{
+    CLOCK_GOV_AUTO = 0,     /**< From the load (and boosts). */
+    CLOCK_GOV_MANUAL,       /**< Pinned by "clk <profile>". */
+} ClockGov_Mode_t;
+
+/**
+ * @brief Governor figures since start or the last ClockGov_ResetStats().
+ */
+typedef struct
+{
+    uint32_t        profile;            /**< CLOCK_PROFILE_xxx now. */
+    ClockGov_Mode_t mode;
+    uint8_t         boosting;           /**< ClockGov_Boost() in force. */
+    uint16_t        loadPermille;       /**< Last window's load, 0..1000. */
+    uint32_t        switches;
+    uint32_t        deferred;           /**< Switches put off to the next 100 ms. */
+    uint32_t        refused;            /**< Profiles CAN or the UART cannot use. */
+    uint32_t        failed;             /**< ClockCfg_Apply() errors. */
+    uint32_t        lastUs;             /**< Last switch, scheduler suspended. */
+    uint32_t        maxUs;
+    uint32_t        atMs[CLOCK_PROFILE_COUNT];  /**< Time at each profile. */
+} ClockGov_Stats_t;
+
+/**
+ * @brief Start in auto mode at the current profile and register "clk".
+ *
+ * @param[in] console UART whose transmission holds off a switch (USART2).
+ * @return HAL_OK, or HAL_ERROR for a NULL @p console.
+ */
+HAL_StatusTypeDef ClockGov_Init(UART_HandleTypeDef *console);
+
+/**
+ * @brief 100 ms runnable (raster.h): close a load window when due and
+ *        switch to the profile wanted, or try again in 100 ms.
+ */
+void ClockGov_Event100ms(void);
+
+/**
+ * @brief Run at the top profile for the next @p ms (0 = CLOCK_GOV_BOOST_MS).
+ *
+ * Any task. Takes effect at the next 100 ms; a later boost extends an
+ * earlier one. No effect while the profile is pinned.
+ */
+void ClockGov_Boost(uint32_t ms);
+
+/**
+ * @brief Pin @p profile (CLOCK_GOV_MANUAL), applied by the next 100 ms.
+ *
+ * @return HAL_OK, or HAL_ERROR for a profile outside the governor's range
+ *         or one CAN or the UART cannot use.
+ */
+HAL_StatusTypeDef ClockGov_SetProfile(uint32_t profile);
+
+/**
+ * @brief Back to CLOCK_GOV_AUTO from the current profile.
+ */
+void ClockGov_SetAuto(void);
+
+void ClockGov_GetStats(ClockGov_Stats_t *stats);
+void ClockGov_ResetStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLOCK_GOV_H */
@@ -0,0 +1,126 @@
+/**
+ * @file    coop.h
+ * @brief   Stackless coroutines: the low-priority services of BgTask share
+ *          its one stack.
+ *
+ * A coroutine is a function that runs from the top of COOP_BEGIN() to its
+ * next wait and returns; the host (Coop_Run(), BgTask) calls it again once
+ * the wait is over, and a switch on the line number of that wait resumes it
+ * right behind it (a protothread). Its state between two turns is the
+ * Coop_t and the module's statics, so the coroutines of the host need the
+ * stack of their deepest call only, one after the other, and one TCB in all.
+ *
+ *   void Foo_Coop(Coop_t *c)
+ *   {
+ *       COOP_BEGIN(c);
+ *       for (;;)
+ *       {
+ *           COOP_WAIT_FLAGS(c, FOO_FLAG, COOP_FOREVER);
+ *           ...
+ *       }
+ *       COOP_END(c);
+ *   }
+ *
+ * Rules of the switch:
+ *   - locals do not survive a wait; keep what must in statics,
+ *   - one wait per source line, and none inside a switch of the coroutine,
+ *   - a blocking call inside a turn (a DMA transfer waited for, a flash
+ *     program) holds every other coroutine for its length; long work is
+ *     split into turns with COOP_YIELD().
+ *
+ * Waits are on thread flags of the host, one set per coroutine: the
+ * services keep setting their own flags on the thread that first called
+ * them (Log_Service(), NvmLog_Service()), which is now the host, and
+ * modules without a thread of their own wake theirs with Coop_Notify().
+ * The coroutines are the lines of COOP_TABLE (sys_config.h, next to
+ * BgTask); their flag sets must not overlap (checked at compile time).
+ *
+ * "coop" lists the coroutines: turns, what each waits for, longest turn.
+ */
+
+#ifndef COOP_H
+#define COOP_H
+
+#include "main.h"
+#include "cmsis_os2.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/** Timeout of a wait without one. */
+#define COOP_FOREVER        0xFFFFFFFFU
+
+/**
+ * @brief One coroutine's state; the host's, the coroutine only passes it
+ *        to the macros.
+ */
+typedef struct Coop_s
+{
+    uint32_t lc;        /**< Resume point: line of the last wait, 0 = top. */
+    uint32_t wait;      /**< Flags that end the wait. */
+    uint32_t until;     /**< Tick the wait times out at ... */
+    uint8_t  timed;     /**< ... if set. */
+    uint8_t  done;      /**< Ran past COOP_END(). */
+    uint32_t got;       /**< Flags that ended the wait; 0 for a timeout. */
+} Coop_t;
+
+#define COOP_BEGIN(c)       switch ((c)->lc) { case 0U:
+
+#define COOP_END(c)         } (c)->done = 1U; return
+
+/**
+ * @brief Return to the host until one of @p flags is set or @p ms have
+ *        passed (COOP_FOREVER: no timeout); (c)->got tells which.
+ */
+#define COOP_WAIT_FLAGS(c, flags, ms)                                               \
+    do                                                                              \
+    {                                                                               \
+        Coop_Arm((c), (flags), (ms));                                               \
+        (c)->lc = __LINE__;                                                         \
+        return;                                                                     \
+    case __LINE__:;                                                                 \
+    } while (0)
+
+/** @brief Return to the host for @p ms. */
+#define COOP_SLEEP(c, ms)   COOP_WAIT_FLAGS((c), 0U, (ms))
+
+/** @brief Let the other coroutines have a turn, then go on. */
+#define COOP_YIELD(c)       COOP_WAIT_FLAGS((c), 0U, 0U)
+
+/**
+ * @brief Register "coop". Call once before the scheduler starts.
+ */
+void Coop_Init(void);
+
+/**
+ * @brief Run COOP_TABLE in the calling thread (BgTask); never returns.
+ *
+ * Every coroutine gets a first turn at once, then only when its wait ends.
+ */
+void Coop_Run(void);
+
+/**
+ * @brief Set @p flags on the host (any task or interrupt); nothing before
+ *        the host runs, whose first turns look at every coroutine anyway.
+ */
+void Coop_Notify(uint32_t flags);
+
+/** @brief Used by COOP_WAIT_FLAGS(). */
+static inline void Coop_Arm(Coop_t *c, uint32_t flags, uint32_t ms)
+{
+    c->wait  = flags;
+    c->timed = (ms != COOP_FOREVER) ? 1U : 0U;
+    c->until = osKernelGetTickCount() + ((ms != COOP_FOREVER) ? ms : 0U);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COOP_H */
@@ -0,0 +1,186 @@
+/**
+ * @file    crank.h
+ * @brief   60-2 crank wheel: generated on TIM8 from the engine speed,
+ *          decoded from tooth-time captures on TIM4.
+ *
+ * A 60-2 wheel has CRANK_TEETH tooth positions of 6 degrees each with
+ * CRANK_MISSING teeth left out; the long tooth time over the gap marks the
+ * revolution. One tooth per 1/rpm s: 6000 teeth/s at 6000 rpm.
+ *
+ * Pins (jumper PC6 to PB6 on the board):
+ *
+ *   PC6  TIM8_CH1 (AF3)    crank signal out, a pulse per present tooth
+ *   PB6  TIM4_CH1 (AF2)    tooth capture, rising edge
+ *
+ * Generator: TIM8 counts one tooth period (ARR from engine_rpm, vehicle.h;
+ * off below CRANK_MIN_RPM) in PWM mode 1. On every update DMA2 Stream2
+ * (channel 7, TIM8_CH1 with CCDS) loads CCR1 from a circular table of one
+ * revolution: a 40 us pulse for a tooth, 0 for a missing one. The wheel
+ * turns without the CPU; Crank_Event10ms() only retunes the preloaded ARR
+ * (the table depends on the prescaler alone, fixed per clock).
+ *
+ * Decoder: TIM4 is the free-running 1 MHz counter of the local time
+ * (time_sync.h); its CH1 latches each tooth edge, and the capture interrupt
+ * (Crank_CaptureIRQHandler(), RAMFUNC, at CRANK_IRQ_PRIO) does the whole
+ * decode on registers and integers, no FPU, no HAL, no RTOS call:
+ *
+ *   dt = capture - last capture           (16 bits, wraps every 65.5 ms)
+ *   gap = 2 * dt > (MISSING + 2) * ref    (ref: last normal tooth time)
+ *
+ *   NOSYNC  -> first edge                  -> SEEK
+ *   SEEK    -> gap                         -> SYNC, tooth 0
+ *   SYNC    -> tooth 1..TEETH-MISSING-1 counted; the edge after the last
+ *              must be a gap (tooth 0, one revolution more); no gap there,
+ *              or a gap anywhere else, is a sync loss -> SEEK
+ *
+ * Every edge then goes to the angle scheduler (AngleSched_ToothIRQ(),
+ * angle_sched.h), which shares the interrupt and the TIM4 time base.
+ *
+ * The 10 ms runnable treats CRANK_STALL_MS without an edge as a stall:
+ * back to NOSYNC before the tooth counter can wrap, and rpm 0.
+ *
+ * Estimates (any task, Crank_Get()): instantaneous rpm from the last tooth
+ * time (1e6 / us per tooth for 60 positions), revolution rpm from the sum
+ * over the last revolution, and the crank angle: 6 degrees per tooth since
+ * tooth 0 plus the elapsed part of the current tooth, from TIM4 now.
+ *
+ * "crank" shows generator, sync state and estimates. "bench crank start
+ * [<ms>]" sweeps the generator over CRANK_BENCH_RPM_TABLE, <ms> per speed
+ * after 200 ms to settle, and takes the cycles of the capture interrupt
+ * body (DWT) per edge; "bench crank" shows per speed the teeth per second,
+ * mean and longest body, the CPU load with exception entry and return
+ * counted, and the sync losses.
+ */
+
+#ifndef CRANK_H
+#define CRANK_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = crank generator and decoder. */
+#ifndef CRANK_ENABLE
+#define CRANK_ENABLE            1
+#endif
+
+/** Tooth positions per revolution, missing teeth included. */
+#ifndef CRANK_TEETH
+#define CRANK_TEETH             60U
+#endif
+
+/** Missing teeth, consecutive, before tooth 0. */
+#ifndef CRANK_MISSING
+#define CRANK_MISSING           2U
+#endif
+
+/** Generator off below this (cranking starts above). */
+#ifndef CRANK_MIN_RPM
+#define CRANK_MIN_RPM           100U
+#endif
+
+/** No edge for this long: stall. */
+#ifndef CRANK_STALL_MS
+#define CRANK_STALL_MS          50U
+#endif
+
+/** NVIC priority of the capture interrupt; it makes no RTOS call. */
+#ifndef CRANK_IRQ_PRIO
+#define CRANK_IRQ_PRIO          2U
+#endif
+
+/** Measuring time per speed of "bench crank" (ms). */
+#ifndef CRANK_BENCH_MS
+#define CRANK_BENCH_MS          1000U
+#endif
+
+/** X(rpm): speeds of "bench crank". */
+#define CRANK_BENCH_RPM_TABLE(X) \
+    X(500U) X(1000U) X(2000U) X(3000U) X(4000U) X(6000U) X(8000U)
+
+/* The gap at the lowest speed must end before the stall check; the stall
+ * check (10 ms raster) before the 16-bit microsecond counter wraps. */
+_Static_assert(((CRANK_MISSING + 1U) * 60000U) / (CRANK_TEETH * CRANK_MIN_RPM) < CRANK_STALL_MS,
+               "CRANK_MIN_RPM: the gap is longer than CRANK_STALL_MS");
+_Static_assert((CRANK_STALL_MS + 10U) < 65U,
+               "CRANK_STALL_MS must leave the stall check within one TIM4 wrap");
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    CRANK_NOSYNC = 0,       /**< Stalled or just started. */
+    CRANK_SEEK,             /**< Edges, looking for the gap. */
+    CRANK_SYNC              /**< Tooth count valid. */
+} Crank_Sync_t;
+
+/**
+ * @brief Decoder state and estimates.
+ */
+typedef struct
+{
+    uint8_t  sync;          /**< Crank_Sync_t. */
+    uint8_t  tooth;         /**< Positions since the gap, 0 = first after it. */
+    float    angleDeg;      /**< 0..360 from tooth 0; valid in SYNC. */
+    float    rpm;           /**< Instantaneous, last tooth. */
+    float    revRpm;        /**< Over the last full revolution. */
+    uint16_t genRpm;        /**< Speed the generator runs at, 0 = off. */
+    uint32_t edges;         /**< Capture interrupts. */
+    uint32_t revs;          /**< Gaps found in sync. */
+    uint32_t syncs;         /**< SEEK -> SYNC. */
+    uint32_t losses;        /**< Gap missing or out of place. */
+    uint32_t stalls;
+    uint32_t overcaptures;  /**< Edges that came before the last was read. */
+    uint32_t cyclesMax;     /**< Longest capture interrupt body (DWT). */
+} Crank_State_t;
+
+/**
+ * @brief Set up TIM8, DMA2 Stream2 and the TIM4 capture, and register
+ *        "crank" and "bench crank". Call once after TimeSync_Init(),
+ *        before the scheduler starts.
+ */
+HAL_StatusTypeDef Crank_Init(void);
+
+/**
+ * @brief Follow engine_rpm with the generator, detect stalls, run the
+ *        benchmark (10 ms raster runnable).
+ */
+void Crank_Event10ms(void);
+
+/**
+ * @brief TIM4 capture interrupt (TIM4_IRQHandler, on CC1IF).
+ */
+void Crank_CaptureIRQHandler(void);
+
+/**
+ * @brief Hold the generator at @p rpm instead of following engine_rpm
+ *        (angle_sched.h's benchmark); 0 = follow again. "bench crank
+ *        start" takes precedence while it runs.
+ */
+void Crank_SetGeneratorRpm(uint16_t rpm);
+
+/**
+ * @brief Decoder state with the angle and rpm as of now.
+ */
+void Crank_Get(Crank_State_t *out);
+
+/**
+ * @brief The clocks changed (clock_gov.h, after TimeSync_ClockChanged()):
+ *        retime TIM8 and start the decode over.
+ */
+void Crank_ClockChanged(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CRANK_H */
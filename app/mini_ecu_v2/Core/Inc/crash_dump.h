@@ -0,0 +1,222 @@
+/**
+ * @file    crash_dump.h
+ * @brief   Fault capture into no-init RAM, reported on the next boot.
+ *
+ * HardFault, MemManage, BusFault and UsageFault (stm32f4xx_it.c),
+ * Error_Handler() and configASSERT() end here instead of spinning, as does
+ * a task that misses its watchdog deadline (watchdog.h) or overruns its
+ * stack (configCHECK_FOR_STACK_OVERFLOW, freertos.c; with RTOS_STACK_GUARD
+ * the MemManage on its guard, rtos_stack.h). With interrupts off, one pass
+ * of plain stores records:
+ *
+ *   - the cause, R0-R12, SP, LR, PC, xPSR and EXC_RETURN (from the
+ *     exception frame; software stops only have PC, LR and SP),
+ *   - CFSR, HFSR, MMFAR and BFAR,
+ *   - the running task, or the interrupted exception number (for the
+ *     watchdog and a stack overflow: the late or overflowing task and the
+ *     registers it was switched out with),
+ *   - CRASH_DUMP_STACK_WORDS words from the faulting SP up,
+ *   - the last CRASH_DUMP_LOG_BYTES of log lines from the post-mortem ring
+ *     (log.h), including those never sent; without it (LOG_PM_SIZE 0) of
+ *     the log output sent and still queued,
+ *   - the uptime and the number of crashes since power-on or the last
+ *     "crash clear".
+ *
+ * The record is NOINIT (sram_layout.h) and sealed with a check word, so
+ * capture costs a few microseconds and survives the reset that follows
+ * it, a watchdog reset or the bootloader. With a debugger attached the
+ * core stops at a breakpoint instead of resetting.
+ *
+ * CrashDump_Init() logs a summary of a record on the first boot after the
+ * crash. "crash" decodes it, "crash raw" prints it in hex for
+ * tools/crash_decode.py (which symbolises it with the ELF), "crash clear"
+ * discards it; UDS DID 0x0120 carries the summary and ClearDiagnostic-
+ * Information clears it with the DTCs (uds.h).
+ */
+
+#ifndef CRASH_DUMP_H
+#define CRASH_DUMP_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Stack words kept from the faulting SP up. */
+#ifndef CRASH_DUMP_STACK_WORDS
+#define CRASH_DUMP_STACK_WORDS   32U
+#endif
+
+/** Log output kept (bytes, newest last). */
+#ifndef CRASH_DUMP_LOG_BYTES
+#define CRASH_DUMP_LOG_BYTES     512U
+#endif
+
+/** 1 = reset after the capture (no debugger attached), 0 = spin. */
+#ifndef CRASH_DUMP_RESET
+#define CRASH_DUMP_RESET         1
+#endif
+
+#define CRASH_DUMP_MAGIC         0x48535243U   /* "CRSH" */
+#define CRASH_DUMP_VERSION       1U
+#define CRASH_DUMP_TASK_LEN      16U           /* configMAX_TASK_NAME_LEN */
+
+/**
+ * @brief Causes. X(name, text): CRASH_DUMP_CAUSE_<name>.
+ */
+#define CRASH_DUMP_CAUSE_TABLE(X)          \
+    X(NONE,       "none")                  \
+    X(HARDFAULT,  "HardFault")             \
+    X(MEMMANAGE,  "MemManage")             \
+    X(BUSFAULT,   "BusFault")              \
+    X(USAGEFAULT, "UsageFault")            \
+    X(ERROR,      "Error_Handler")         \
+    X(ASSERT,     "configASSERT")          \
+    X(WATCHDOG,   "Watchdog")              \
+    X(STACK,      "StackOverflow")
+
+#define CRASH_DUMP_CAUSE_ENUM_(name, text)   CRASH_DUMP_CAUSE_##name,
+typedef enum
+{
+    CRASH_DUMP_CAUSE_TABLE(CRASH_DUMP_CAUSE_ENUM_)
+    CRASH_DUMP_CAUSE_COUNT
+} CrashDump_Cause_t;
+
+/** flags */
+#define CRASH_DUMP_FRAME         0x01U   /**< R0-R3, R12, xPSR from an exception frame. */
+#define CRASH_DUMP_IN_HANDLER    0x02U   /**< Stopped in an interrupt, not a task. */
+#define CRASH_DUMP_FP_FRAME      0x04U   /**< The frame included the FPU registers. */
+
+/**
+ * @brief The record; tools/crash_decode.py reads the same layout.
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t cause;          /**< CrashDump_Cause_t */
+    uint32_t flags;
+    uint32_t count;          /**< Crashes since power-on or "crash clear". */
+    uint32_t bootsSince;     /**< Boots since this crash (0 until reported). */
+    uint32_t uptimeMs;
+    uint32_t r[13];          /**< R0-R12 */
+    uint32_t sp;
+    uint32_t lr;
+    uint32_t pc;
+    uint32_t xpsr;
+    uint32_t excReturn;
+    uint32_t cfsr;
+    uint32_t hfsr;
+    uint32_t mmfar;
+    uint32_t bfar;
+    char     task[CRASH_DUMP_TASK_LEN];
+    uint32_t stackWords;     /**< Valid words in stack[]. */
+    uint32_t stack[CRASH_DUMP_STACK_WORDS];
+    uint32_t logLen;
+    char     log[CRASH_DUMP_LOG_BYTES];
+    uint32_t check;          /**< ~XOR of the words above */
+} CrashDump_t;
+
+_Static_assert((sizeof(CrashDump_t) % 4U) == 0U, "CrashDump_t is checked word by word");
+
+/**
+ * @brief Fault handler body: passes the exception frame, EXC_RETURN and
+ *        R4-R11 to CrashDump_Fault(). Use as the only statement of a naked
+ *        handler.
+ */
+#define CRASH_DUMP_FAULT_ENTRY()            \
+    __asm volatile                          \
+    (                                       \
+        "tst   lr, #4          \n"          \
+        "ite   eq              \n"          \
+        "mrseq r0, msp         \n"          \
+        "mrsne r0, psp         \n"          \
+        "mov   r1, lr          \n"          \
+        "push  {r4-r11}        \n"          \
+        "mov   r2, sp          \n"          \
+        "b     CrashDump_Fault \n"          \
+    )
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Enable the MemManage, BusFault and UsageFault exceptions, report
+ *        a new record and register the "crash" commands.
+ *
+ * Call after Log_Init().
+ */
+void CrashDump_Init(void);
+
+/**
+ * @brief The record of the last crash, or NULL if there is none.
+ */
+const CrashDump_t *CrashDump_Get(void);
+
+/**
+ * @brief Discard the record.
+ */
+void CrashDump_Clear(void);
+
+/**
+ * @brief Name of @p cause, e.g. "BusFault".
+ */
+const char *CrashDump_CauseName(uint32_t cause);
+
+/**
+ * @brief Record a fault and reset. Reached from CRASH_DUMP_FAULT_ENTRY().
+ *
+ * @param[in] frame     Exception frame (R0-R3, R12, LR, PC, xPSR).
+ * @param[in] excReturn EXC_RETURN of the fault.
+ * @param[in] r4r11     R4-R11 as at the fault.
+ */
+void CrashDump_Fault(const uint32_t *frame, uint32_t excReturn, const uint32_t *r4r11)
+    __attribute__((noreturn));
+
+/**
+ * @brief Record a software stop and reset.
+ *
+ * @param[in] cause CRASH_DUMP_CAUSE_ERROR or CRASH_DUMP_CAUSE_ASSERT.
+ * @param[in] pc    Where it stopped, e.g. __builtin_return_address(0).
+ */
+void CrashDump_Halt(CrashDump_Cause_t cause, uint32_t pc) __attribute__((noreturn));
+
+/**
+ * @brief Record a task that missed its watchdog deadline and reset.
+ *
+ * The registers and stack are the ones @p task was last switched out
+ * with, so PC and LR show where it waits or spins.
+ *
+ * @param[in] task FreeRTOS handle of the task; not the running one.
+ */
+void CrashDump_Watchdog(void *task) __attribute__((noreturn));
+
+/**
+ * @brief Record a task that overran its stack and reset. Reached from
+ *        vApplicationStackOverflowHook() during a context switch.
+ *
+ * As for CrashDump_Watchdog(), the registers and stack are the ones the
+ * task was just switched out with; SP below the stack start shows by how
+ * much it overran.
+ *
+ * @param[in] task FreeRTOS handle of the task.
+ */
+void CrashDump_StackOverflow(void *task) __attribute__((noreturn));
+
+/**
+ * @brief configASSERT() failure: CrashDump_Halt() with the caller's PC.
+ */
+void CrashDump_Assert(void) __attribute__((noreturn, noinline));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CRASH_DUMP_H */
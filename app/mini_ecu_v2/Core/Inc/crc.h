@@ -0,0 +1,56 @@
+/**
+ * @file    crc.h
+ * @brief   Software CRCs: CRC-16/CCITT-FALSE of the host-facing frames and
+ *          records, CRC-32/MPEG-2 of the images.
+ *
+ * Crc_Ccitt16() covers every byte stream a host tool checks: the
+ * telemetry and "metrics dump" frames (tlm_stream.h), the CLI RPC frames
+ * (cli_rpc.h), uploaded CLI scripts (cli_script.h) and the external log
+ * pages (ext_log.h). Poly 0x1021, init 0xFFFF, no reflection, no final
+ * XOR, as tools/tlm_plot.py computes it.
+ *
+ * Crc_Mpeg32() is the STM32 CRC unit's result over whole words (poly
+ * 0x04C11DB7, init 0xFFFFFFFF, no reflection, no final XOR), as
+ * tools/image_stamp.py stamps it: the staged firmware image (stage.c) and
+ * the calibration image (cal_image.c) are checked with it, and the
+ * lifetime performance block (perf_life.c) is sealed with it.
+ *
+ * Nibble tables (32 and 64 bytes of flash) instead of 256-entry ones: two
+ * lookups per byte. The data is short or checked once, and the CRC unit
+ * is the flash scrubber's (flash_scrub.h).
+ *
+ * Pure functions of their arguments: safe from any task or ISR.
+ */
+
+#ifndef CRC_H
+#define CRC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Start value of a CRC-16/CCITT-FALSE. */
+#define CRC16_INIT          0xFFFFU
+
+/** Start value of a CRC-32/MPEG-2. */
+#define CRC32_INIT          0xFFFFFFFFU
+
+/**
+ * @brief Continue the CRC @p crc (CRC16_INIT for a new one) over @p len
+ *        bytes at @p data.
+ */
+uint16_t Crc_Ccitt16(uint16_t crc, const uint8_t *data, uint32_t len);
+
+/**
+ * @brief Continue the CRC @p crc (CRC32_INIT for a new one) over @p count
+ *        32-bit words at @p words, as the CRC unit fed one word at a time.
+ */
+uint32_t Crc_Mpeg32(uint32_t crc, const uint32_t *words, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CRC_H */
@@ -0,0 +1,133 @@
+/**
+ * @file    cruise.h
+ * @brief   Cruise control: fixed-point PI from the speed estimate to the
+ *          throttle, rate limited, as a raster runnable.
+ *
+ * "veh cruise <kph>" engages the controller at a set speed; it then holds
+ * it through the same throttle input the pedal drives, so the model
+ * accelerates and coasts through the torque map and gearbox (powertrain.h)
+ * instead of jumping like "veh speed" (Vehicle_SetTargetSpeed()). The
+ * controller is a runnable of the 10 ms raster, or of the 1 ms one with
+ * CRUISE_HZ = 1000 (raster.h). Per step it
+ *
+ *   1. reads the estimated vehicle speed (speed_est.h); an invalid
+ *      estimate disengages the controller (throttle 0, logged), as losing
+ *      the speed signal does in a car,
+ *   2. runs a PI on the error from the set speed in fixed point, as the
+ *      fan loop does (fan_ctrl.h): error Q16 km/h, throttle and
+ *      integrator Q24, gains Q24 per km/h (Kp) and per km/h and step
+ *      (Ki / CRUISE_HZ), 64-bit products,
+ *   3. limits the throttle change to CRUISE_SLEW_PER_S. The integrator
+ *      is clamped to 0..100 % and stops while the output is held by the
+ *      clamp or the rate limit in the direction of the error
+ *      (anti-windup), so a set speed the car cannot reach does not wind
+ *      it up.
+ *
+ * Engaging starts the integrator at the throttle the model runs with, so
+ * taking over from the pedal at speed does not bump. VehicleTask applies
+ * the larger of the pedal and the controller (Cruise_GetThrottle()): a
+ * pressed pedal overrides without disengaging, and the integrator holds
+ * meanwhile. A playing scenario (scenario.h) drives the model instead.
+ *
+ * Gains are calibration parameters (CRUISE_KP, CRUISE_KI, cal.h),
+ * converted to fixed point when they change.
+ *
+ *   veh cruise            the loop: set speed, speed, PI terms, throttle
+ *   veh cruise <kph>      engage at CRUISE_MIN_KPH .. CRUISE_MAX_KPH
+ *   veh cruise off        disengage, the car coasts
+ */
+
+#ifndef CRUISE_H
+#define CRUISE_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = cruise controller and "veh cruise". */
+#ifndef CRUISE_ENABLE
+#define CRUISE_ENABLE           1
+#endif
+
+/** Control steps per second: 100 (10 ms raster) or 1000 (1 ms raster). */
+#ifndef CRUISE_HZ
+#define CRUISE_HZ               100U
+#endif
+
+/** Largest throttle change, full travel per second (0..1 per s). */
+#ifndef CRUISE_SLEW_PER_S
+#define CRUISE_SLEW_PER_S       0.5f
+#endif
+
+/** Set speed range (km/h). */
+#ifndef CRUISE_MIN_KPH
+#define CRUISE_MIN_KPH          20.0f
+#endif
+
+#ifndef CRUISE_MAX_KPH
+#define CRUISE_MAX_KPH          200.0f
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Loop state, as of the last step.
+ */
+typedef struct
+{
+    uint8_t  engaged;
+    uint8_t  override;      /**< Pedal above the controller. */
+    float    setpoint;      /**< km/h. */
+    float    measured;      /**< km/h, speed estimate. */
+    float    error;         /**< setpoint - measured, km/h. */
+    float    p;             /**< Proportional part of the throttle. */
+    float    i;             /**< Integrator. */
+    float    throttle;      /**< Commanded throttle 0..1. */
+    uint32_t steps;         /**< Engaged steps. */
+    uint32_t saturated;     /**< Steps with the output clamped. */
+    uint32_t limited;       /**< Steps held by the rate limit. */
+    uint32_t overrides;     /**< Steps the pedal overrode. */
+    uint32_t cancels;       /**< Disengaged by an invalid speed estimate. */
+} Cruise_Status_t;
+
+/**
+ * @brief Register "veh cruise". Call once before the scheduler starts.
+ */
+void Cruise_Init(void);
+
+/**
+ * @brief One control step (raster runnable at CRUISE_HZ).
+ */
+void Cruise_Step(void);
+
+/**
+ * @brief Throttle the controller commands, 0..1; 0 while disengaged
+ *        (any task).
+ */
+float Cruise_GetThrottle(void);
+
+/**
+ * @brief Consistent copy of the loop state (any task).
+ */
+void Cruise_GetStatus(Cruise_Status_t *out);
+
+/**
+ * @brief Engage at @p kph (clamped to the set speed range), or disengage
+ *        for a negative one; the next step takes it.
+ */
+void Cruise_Set(float kph);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CRUISE_H */
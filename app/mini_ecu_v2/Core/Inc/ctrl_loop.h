@@ -0,0 +1,155 @@
+/**
+ * @file    ctrl_loop.h
+ * @brief   Control loop pacing with start jitter and execution time histograms.
+ *
+ * VehicleTask runs one control step per cycle:
+ *
+ *   CtrlLoop_Start();
+ *   for (;;) { CtrlLoop_Wait(); step(); CtrlLoop_Done(); }
+ *
+ * The cycle is released by one of two sources (CTRL_LOOP_SOURCE):
+ *
+ *   - CTRL_LOOP_SOURCE_RTOS: osDelayUntil() on the kernel tick, at the task
+ *     priority the other tasks have; a blocking UART write in CliTask
+ *     (AboveNormal) delays the step by as long as it takes.
+ *   - CTRL_LOOP_SOURCE_TIM5: the TIM5 update interrupt sets CTRL_LOOP_FLAG
+ *     on the control task, which then runs at CTRL_LOOP_PRIORITY (High),
+ *     above CLI, CAN and the sensors. TIM5 counts microseconds, so the
+ *     counter read at the start of the step is the release latency itself.
+ *     The interrupt and its handler run from SRAM (ramfunc.h).
+ *
+ * Per cycle two figures go into log2 histograms in microseconds:
+ *
+ *   - start jitter: from the release (timer update, or the tick the task
+ *     was due on, read from SysTick) to the first instruction of the step;
+ *   - execution time: from CtrlLoop_Wait() returning to CtrlLoop_Done(), on
+ *     the DWT cycle counter, preemption included.
+ *
+ * A release that comes while the previous one is still pending counts as
+ * missed, a step longer than the period as an overrun. "loop" shows the
+ * figures, "loop reset" clears them.
+ */
+
+#ifndef CTRL_LOOP_H
+#define CTRL_LOOP_H
+
+#include "main.h"
+#include "cmsis_os2.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+#define CTRL_LOOP_SOURCE_RTOS   0U  /**< osDelayUntil() on the kernel tick. */
+#define CTRL_LOOP_SOURCE_TIM5   1U  /**< TIM5 update interrupt, high-priority task. */
+
+#ifndef CTRL_LOOP_SOURCE
+#define CTRL_LOOP_SOURCE        CTRL_LOOP_SOURCE_RTOS
+#endif
+
+/** Control steps per second: 10..1000, a multiple of the 10 Hz telemetry. */
+#ifndef CTRL_LOOP_HZ
+#define CTRL_LOOP_HZ            10U
+#endif
+
+#define CTRL_LOOP_PERIOD_US     (1000000U / CTRL_LOOP_HZ)
+
+/** Priority of the control task. */
+#ifndef CTRL_LOOP_PRIORITY
+#if CTRL_LOOP_SOURCE == CTRL_LOOP_SOURCE_TIM5
+#define CTRL_LOOP_PRIORITY      osPriorityHigh
+#else
+#define CTRL_LOOP_PRIORITY      osPriorityNormal
+#endif
+#endif
+
+/** Thread flag set on the control task by the TIM5 interrupt. */
+#define CTRL_LOOP_FLAG          0x0001U
+
+/** Bucket b counts times in [2^(b-1), 2^b) us, the last everything above. */
+#define CTRL_LOOP_BUCKETS       16U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief One histogram with its count, mean and maximum.
+ */
+typedef struct
+{
+    uint32_t count;
+    uint32_t maxUs;
+    uint64_t sumUs;
+    uint32_t hist[CTRL_LOOP_BUCKETS];
+} CtrlLoop_Hist_t;
+
+/**
+ * @brief Loop figures since start or the last CtrlLoop_ResetStats().
+ */
+typedef struct
+{
+    uint32_t        cycles;     /**< Steps completed. */
+    uint32_t        missed;     /**< Releases lost because the task was late. */
+    uint32_t        overruns;   /**< Steps longer than the period. */
+    CtrlLoop_Hist_t jitter;     /**< Release -> start of the step. */
+    CtrlLoop_Hist_t exec;       /**< Start -> end of the step. */
+} CtrlLoop_Stats_t;
+
+/**
+ * @brief Set up the release source and register the "loop" commands.
+ *        Call once before the scheduler starts.
+ */
+HAL_StatusTypeDef CtrlLoop_Init(void);
+
+/**
+ * @brief Start releasing the calling task, one cycle per period.
+ */
+HAL_StatusTypeDef CtrlLoop_Start(void);
+
+/**
+ * @brief Block until the next cycle is released and record its jitter.
+ */
+void CtrlLoop_Wait(void);
+
+/**
+ * @brief Time since CtrlLoop_Wait() returned (us, control task only).
+ */
+uint32_t CtrlLoop_ElapsedUs(void);
+
+/**
+ * @brief End of the step: record its execution time.
+ */
+void CtrlLoop_Done(void);
+
+/**
+ * @brief Consistent copy of the loop figures (any task).
+ */
+void CtrlLoop_GetStats(CtrlLoop_Stats_t *out);
+
+/**
+ * @brief Clear the loop figures.
+ */
+void CtrlLoop_ResetStats(void);
+
+/**
+ * @brief The APB1 clock changed (clock_gov.h): keep TIM5 at 1 MHz, in the
+ *        same place of its period (TIM5 source; nothing to do otherwise).
+ */
+void CtrlLoop_ClockChanged(void);
+
+/**
+ * @brief TIM5 interrupt (TIM5 source; nothing to do otherwise).
+ */
+void CtrlLoop_TimerIRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CTRL_LOOP_H */
@@ -0,0 +1,136 @@
+/**
+ * @file    dma_copy.h
+ * @brief   Memory-to-memory copies and fills on DMA2 Stream1.
+ *
+ * Only DMA2 can move memory to memory on the F4; its streams 0 (ADC1,
+ * vsensor.h) and 7 (QUADSPI, qspi_flash.h) are taken, stream 1 is this
+ * service's. A copy runs on the bus matrix while the CPU runs other code:
+ *
+ *   DmaCopy_Start(dst, src, len, done, ctx)   start, return at once
+ *   DmaCopy_Fill(dst, value, len, done, ctx)  memset() the same way
+ *   DmaCopy_Wait(timeoutMs)                   block the starting task
+ *   DmaCopy_Memcpy(dst, src, len)             start and wait, or memcpy()
+ *
+ * Completion calls @p done from the stream interrupt, or, with @p done
+ * NULL, sets DMA_COPY_FLAG on the task that started the copy, which
+ * DmaCopy_Wait() waits for; the caller computes in between. One transfer
+ * runs at a time: a start while the stream is busy returns HAL_BUSY and
+ * the caller copies itself (DmaCopy_Memcpy() does).
+ *
+ * Below DMA_COPY_MIN_BYTES the set-up and the interrupt cost more than a
+ * CPU copy, so shorter requests are done with memcpy() / memset() in the
+ * call, @p done included. Word-aligned source and destination move in
+ * words, anything else in bytes; the bytes of a word transfer past the
+ * last whole word are copied by the CPU before the stream starts. A
+ * transfer over 65535 items goes in several stream runs.
+ *
+ * Neither buffer may be touched until completion, and both must stay
+ * valid (no stack buffer of a task that returns). SRAM1, SRAM2 and flash
+ * are all reachable; the two SRAMs are separate bus-matrix slaves
+ * (sram_layout.h), so a copy between SRAM2 buffers leaves the CPU's SRAM1
+ * accesses unhindered.
+ *
+ * On a part with a data cache the service cleans the source and
+ * invalidates the destination around the transfer (platform_dma.h), and
+ * the CPU copies the partial cache lines at both ends of the destination,
+ * so memory next to it stays the CPU's. Callers need no cache maintenance.
+ *
+ * "dma" shows the transfers; the bench image times a 1 KB copy against
+ * memcpy() (micro_bench.h, dma_copy_1k).
+ */
+
+#ifndef DMA_COPY_H
+#define DMA_COPY_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Shorter requests are copied by the CPU in the call. */
+#ifndef DMA_COPY_MIN_BYTES
+#define DMA_COPY_MIN_BYTES      256U
+#endif
+
+/** Thread flag set on the starting task when a copy without callback ends. */
+#define DMA_COPY_FLAG           0x4000U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/** Completion of a transfer, in interrupt context (or the caller's, for a
+ *  CPU copy); @p status HAL_OK or HAL_ERROR (a DMA transfer error). */
+typedef void (*DmaCopy_Done_t)(void *ctx, HAL_StatusTypeDef status);
+
+/**
+ * @brief Transfer figures since boot.
+ */
+typedef struct
+{
+    uint32_t dmaCopies;     /**< Transfers run by the stream. */
+    uint32_t cpuCopies;     /**< Starts below DMA_COPY_MIN_BYTES. */
+    uint32_t busy;          /**< Starts refused while a transfer ran. */
+    uint32_t errors;        /**< Transfer errors. */
+    uint64_t dmaBytes;
+} DmaCopy_Stats_t;
+
+/**
+ * @brief Enable the DMA2 clock and the stream interrupt and register the
+ *        "dma" commands. Call once before the scheduler starts.
+ */
+void DmaCopy_Init(void);
+
+/**
+ * @brief Copy @p len bytes from @p src to @p dst (not overlapping).
+ *
+ * @param done Completion callback, or NULL to be woken by DMA_COPY_FLAG
+ *             (task context only).
+ * @return HAL_OK (started, or done by the CPU), HAL_BUSY while another
+ *         transfer runs, HAL_ERROR for NULL buffers.
+ */
+HAL_StatusTypeDef DmaCopy_Start(void *dst, const void *src, uint32_t len, DmaCopy_Done_t done,
+                                void *ctx);
+
+/**
+ * @brief Fill @p len bytes at @p dst with @p value; as DmaCopy_Start().
+ */
+HAL_StatusTypeDef DmaCopy_Fill(void *dst, uint8_t value, uint32_t len, DmaCopy_Done_t done,
+                               void *ctx);
+
+/**
+ * @brief Wait for the transfer this task started without a callback.
+ *
+ * @return HAL_OK when done (at once after a CPU copy), HAL_ERROR after a
+ *         transfer error, HAL_TIMEOUT.
+ */
+HAL_StatusTypeDef DmaCopy_Wait(uint32_t timeoutMs);
+
+/**
+ * @brief memcpy() that hands a long copy to the stream and waits for it
+ *        (the task blocks, others run), or copies on the CPU while the
+ *        stream is busy. Task context.
+ */
+void DmaCopy_Memcpy(void *dst, const void *src, uint32_t len);
+
+/** @return 1 while a transfer runs. */
+uint8_t DmaCopy_Busy(void);
+
+void DmaCopy_GetStats(DmaCopy_Stats_t *out);
+
+/**
+ * @brief Stream 1 interrupt: continues a long transfer, completes it.
+ */
+void DmaCopy_IRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DMA_COPY_H */
@@ -0,0 +1,168 @@
+/**
+ * @file    dsp.h
+ * @brief   Block FIR and biquad filters and small matrix kernels in single
+ *          precision.
+ *
+ * The kernels follow the CMSIS-DSP arm_fir_f32() / arm_biquad_cascade_df2T_f32()
+ * interface: instance struct, caller-owned state in the same layout, one
+ * call per block. With DSP_USE_CMSIS = 1 they forward to those functions;
+ * this needs CMSIS-DSP (arm_math.h + libarm_cortexM4lf_math) in the build,
+ * as VEHICLE_FLEET_USE_DSP does. Filtering a block per call keeps the
+ * coefficients and state in registers across samples: the FIR computes
+ * four outputs per pass over the taps, the biquad runs a whole block
+ * through one stage before loading the next.
+ *
+ * Coefficient layout, as in CMSIS-DSP:
+ *
+ *   FIR     b[numTaps-1] .. b[0] (time-reversed; same for symmetric designs)
+ *   biquad  {b0, b1, b2, a1, a2} per stage, with
+ *           y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] + a1 y[n-1] + a2 y[n-2]
+ *           (a1, a2 are the negated denominator coefficients)
+ *
+ * An instance is used by one task at a time; in and out may be the same
+ * buffer.
+ *
+ * The matrix kernels follow arm_mat_*_f32() the same way: a Dsp_MatF32_t
+ * has the arm_matrix_instance_f32 layout (row-major data the caller owns,
+ * typically static), each call checks the dimensions and returns the
+ * arm_status value. They are for the few-state estimators (speed_est.h),
+ * so the plain loops are as good as the vector code for their sizes.
+ * Add, sub and scale may write over an operand; mult, trans and inverse
+ * need a destination of their own.
+ */
+
+#ifndef DSP_H
+#define DSP_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = run the filters on the CMSIS-DSP kernels. */
+#ifndef DSP_USE_CMSIS
+#define DSP_USE_CMSIS       0
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/** arm_status values of the matrix kernels. */
+typedef enum
+{
+    DSP_OK            = 0,      /**< ARM_MATH_SUCCESS */
+    DSP_SIZE_MISMATCH = -3,     /**< ARM_MATH_SIZE_MISMATCH */
+    DSP_SINGULAR      = -5      /**< ARM_MATH_SINGULAR */
+} Dsp_Status_t;
+
+/** Matrix, row-major (arm_matrix_instance_f32). */
+typedef struct
+{
+    uint16_t numRows;
+    uint16_t numCols;
+    float   *pData;     /**< numRows * numCols floats. */
+} Dsp_MatF32_t;
+
+/** Coefficients per biquad stage. */
+#define DSP_BIQUAD_COEFFS   5U
+
+/** Direct-form FIR. */
+typedef struct
+{
+    uint16_t     numTaps;
+    float       *state;     /**< numTaps + blockSize - 1 floats. */
+    const float *coeffs;    /**< numTaps floats, time-reversed. */
+} Dsp_FirF32_t;
+
+/** Cascade of biquads, direct form II transposed. */
+typedef struct
+{
+    uint8_t      numStages;
+    float       *state;     /**< 2 * numStages floats. */
+    const float *coeffs;    /**< DSP_BIQUAD_COEFFS * numStages floats. */
+} Dsp_BiquadF32_t;
+
+/**
+ * @brief Set up a FIR and clear its state (arm_fir_init_f32()).
+ *
+ * @param blockSize Largest block later passed to Dsp_FirF32().
+ */
+void Dsp_FirInitF32(Dsp_FirF32_t *s, uint16_t numTaps, const float *coeffs,
+                    float *state, uint32_t blockSize);
+
+/**
+ * @brief Filter @p blockSize samples (arm_fir_f32()).
+ */
+void Dsp_FirF32(Dsp_FirF32_t *s, const float *in, float *out, uint32_t blockSize);
+
+/**
+ * @brief Set up a biquad cascade and clear its state
+ *        (arm_biquad_cascade_df2T_init_f32()).
+ */
+void Dsp_BiquadInitF32(Dsp_BiquadF32_t *s, uint8_t numStages, const float *coeffs,
+                       float *state);
+
+/**
+ * @brief Filter @p blockSize samples (arm_biquad_cascade_df2T_f32()).
+ */
+void Dsp_BiquadF32(Dsp_BiquadF32_t *s, const float *in, float *out, uint32_t blockSize);
+
+/**
+ * @brief Preload the filter state with its steady state for a constant
+ *        input @p x, so a start-up or a restart does not ramp from zero.
+ */
+void Dsp_FirSettleF32(Dsp_FirF32_t *s, float x);
+void Dsp_BiquadSettleF32(Dsp_BiquadF32_t *s, float x);
+
+/**
+ * @brief Low-pass FIR design: Hamming-windowed sinc, unity DC gain.
+ *
+ * @param coeffs  numTaps floats (symmetric, so the order does not matter).
+ */
+void Dsp_FirLowpassF32(float *coeffs, uint16_t numTaps, float cutoffHz, float sampleHz);
+
+/**
+ * @brief Second-order low-pass stage (bilinear transform, RBJ cookbook).
+ *
+ * @param coeffs  DSP_BIQUAD_COEFFS floats in the layout above.
+ * @param q       0.7071 for Butterworth.
+ */
+void Dsp_BiquadLowpassF32(float *coeffs, float cutoffHz, float sampleHz, float q);
+
+/**
+ * @brief Set up a matrix on @p data (arm_mat_init_f32()).
+ */
+void Dsp_MatInitF32(Dsp_MatF32_t *m, uint16_t numRows, uint16_t numCols, float *data);
+
+/** @brief dst = a + b (arm_mat_add_f32()). */
+Dsp_Status_t Dsp_MatAddF32(const Dsp_MatF32_t *a, const Dsp_MatF32_t *b, Dsp_MatF32_t *dst);
+
+/** @brief dst = a - b (arm_mat_sub_f32()). */
+Dsp_Status_t Dsp_MatSubF32(const Dsp_MatF32_t *a, const Dsp_MatF32_t *b, Dsp_MatF32_t *dst);
+
+/** @brief dst = a * b (arm_mat_mult_f32()); @p dst may not be @p a or @p b. */
+Dsp_Status_t Dsp_MatMultF32(const Dsp_MatF32_t *a, const Dsp_MatF32_t *b, Dsp_MatF32_t *dst);
+
+/** @brief dst = a' (arm_mat_trans_f32()); @p dst may not be @p a. */
+Dsp_Status_t Dsp_MatTransF32(const Dsp_MatF32_t *a, Dsp_MatF32_t *dst);
+
+/** @brief dst = a * k (arm_mat_scale_f32()). */
+Dsp_Status_t Dsp_MatScaleF32(const Dsp_MatF32_t *a, float k, Dsp_MatF32_t *dst);
+
+/**
+ * @brief dst = a^-1 (arm_mat_inverse_f32()): Gauss-Jordan with partial
+ *        pivoting. @p a is overwritten, as CMSIS-DSP does.
+ */
+Dsp_Status_t Dsp_MatInverseF32(Dsp_MatF32_t *a, Dsp_MatF32_t *dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DSP_H */
@@ -0,0 +1,115 @@
+/**
+ * @file    dtc.h
+ * @brief   Diagnostic trouble codes kept across resets in a flash log.
+ *
+ * Each DTC of DTC_TABLE has a RAM entry, indexed by its Dtc_Id_t, so a
+ * report or a lookup is one array access. Monitors call Dtc_Set() with the
+ * current test result as often as they like: only a change of state
+ * (pass -> fail counts an occurrence and takes a freeze frame of the
+ * vehicle state, fail -> pass clears the active bit) marks the entry for
+ * writing, and further changes before the write coalesce into it.
+ *
+ * The entries persist as records of the flash log (nvm_log.h): Dtc_Init()
+ * joins it, NvmLog_Init() restores the entries at boot and NvmTask writes
+ * the marked ones in the background, so a monitor never waits for flash.
+ *
+ * The first occurrence also captures a freeze frame of the signal cache
+ * and the seconds before (freeze_frame.h), inside the same critical
+ * section; Dtc_Clear() frees those too.
+ *
+ * "dtc" lists the stored codes, "dtc clear" clears them, "dtc frame <code>"
+ * shows the freeze frame of one.
+ */
+
+#ifndef DTC_H
+#define DTC_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Trouble codes. X(name, code, text): code in the SAE J2012 2-byte
+ *        form (bits 15..14: P/C/B/U, then four hex digits, P0500 = 0x0500,
+ *        U0073 = 0xC073).
+ */
+#define DTC_TABLE(X)                                                        \
+    X(SPEED_CIRCUIT,   0x0500U, "vehicle speed sensor circuit")             \
+    X(SPEED_RANGE,     0x0501U, "vehicle speed sensor range/performance")   \
+    X(RPM_CIRCUIT,     0x0335U, "engine speed sensor circuit")              \
+    X(RPM_RANGE,       0x0336U, "engine speed sensor range/performance")    \
+    X(COOLANT_CIRCUIT, 0x0115U, "coolant temperature sensor circuit")       \
+    X(COOLANT_RANGE,   0x0116U, "coolant temperature sensor range/performance") \
+    X(PEDAL_CIRCUIT,   0x0120U, "accelerator pedal position sensor circuit") \
+    X(PEDAL_RANGE,     0x0121U, "accelerator pedal position sensor range/performance") \
+    X(ENGINE_OVERTEMP, 0x0217U, "engine over temperature")                  \
+    X(CAN_BUSOFF,      0xC073U, "CAN bus off")                              \
+    X(RUNTIME_BUDGET,  0x0606U, "control module processor: runnable over budget") \
+    X(ROM_CHECKSUM,    0x0601U, "internal control module memory checksum error") \
+    X(CAL_CHECKSUM,    0x0602U, "control module programming error (calibration checksum)")
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+#define DTC_ENUM_(name, code, text)   DTC_##name,
+typedef enum
+{
+    DTC_TABLE(DTC_ENUM_)
+    DTC_COUNT
+} Dtc_Id_t;
+
+#define DTC_ST_ACTIVE           0x01U   /**< Failing now (UDS testFailed). */
+#define DTC_ST_CONFIRMED        0x08U   /**< Failed since the last clear (UDS confirmedDTC). */
+
+/**
+ * @brief State of one DTC.
+ */
+typedef struct
+{
+    uint16_t    code;
+    uint8_t     status;         /**< DTC_ST_* bits. */
+    uint16_t    occurrences;    /**< Pass -> fail changes since the last clear. */
+    const char *text;
+    /* Freeze frame: the vehicle at the first occurrence. */
+    uint8_t     speedKph;
+    int8_t      coolantC;
+    uint16_t    rpm;
+} Dtc_Info_t;
+
+/**
+ * @brief Join the flash log and register the "dtc" commands. Call once
+ *        before NvmLog_Init(), which restores the entries.
+ */
+void Dtc_Init(void);
+
+/**
+ * @brief Report the result of a monitor (any task): @p failing non-zero
+ *        if the fault is present.
+ */
+void Dtc_Set(Dtc_Id_t id, uint8_t failing);
+
+/**
+ * @brief Clear all DTCs (any task); written as empty records.
+ */
+void Dtc_Clear(void);
+
+/**
+ * @brief Copy the state of a DTC.
+ *
+ * @return HAL_OK, or HAL_ERROR for an unknown id.
+ */
+HAL_StatusTypeDef Dtc_Get(Dtc_Id_t id, Dtc_Info_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DTC_H */
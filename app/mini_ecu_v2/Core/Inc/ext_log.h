@@ -0,0 +1,198 @@
+/**
+ * @file    ext_log.h
+ * @brief   Long-duration recorder on the QSPI flash: CAN frames and log
+ *          streams in a circular, log-structured page store.
+ *
+ * The RAM trace (can_trace.h) holds about a second of a busy bus; this
+ * store keeps recording to the external NOR flash (qspi_flash.h) for as
+ * long as the chip holds, overwriting the oldest data when it wraps:
+ *
+ *   - every CAN1 frame, from the RX FIFO interrupt (ExtLog_OnCanRx(), next
+ *     to the RAM trace), whether or not the RX ring had room
+ *   - any log stream moved to the "xlog" transport (log.h): log lines or
+ *     their tokenized frames, CLI output, the binary telemetry stream
+ *     (tlm_stream.h, the signal time series)
+ *
+ * Flash layout: a ring of 256-byte pages over the whole chip; page n of
+ * the recording (its sequence number) is at (n mod pages) x 256. A page is
+ *
+ *   ExtLog_PageHdr_t (16 B) | records ...
+ *
+ * and a record is type (u8) | len (u8) | dt (u16) | len payload bytes,
+ * with dt the microseconds since the previous record in the page (the
+ * first one: since the page time). Types:
+ *
+ *   EXT_LOG_REC_TIME     time (u32 ms, u16 us), when dt would not fit
+ *   EXT_LOG_REC_CAN      id (u32, CAN_IF_Msg_t::Id format), dlc (u8),
+ *                        data (dlc bytes, none for a remote frame)
+ *   EXT_LOG_REC_STREAM   + Log_Stream_t: a chunk of that stream's bytes
+ *
+ * A frame with 8 data bytes takes 17 bytes; at full load on 500 kbit/s
+ * (about 4000 frames/s) that is 68 KB/s, an hour per 256 MB of flash.
+ *
+ * Write path: producers never wait on the flash. Records are appended, in
+ * a short PRIMASK section, to the open page of a ring of
+ * EXT_LOG_STAGE_PAGES page buffers in RAM; a full page is closed and the
+ * QUADSPI interrupt (QspiFlash_Kick()) starts its program by DMA while the
+ * next page fills. The writer erases the next 4 KB sector ahead of the
+ * first page that lands in it, which is where the oldest data goes; the
+ * depth of the ring covers a sector erase (tens of ms) at full bus load.
+ * With every buffer waiting for the flash, a record is dropped and
+ * counted. A page left open for EXT_LOG_FLUSH_MS is closed by the 100 ms
+ * raster (ExtLog_Event100ms()), so a quiet bus still reaches the flash.
+ *
+ * At init the store is found again: the newest valid page (magic, CRC)
+ * continues the sequence, so recording resumes across resets and power
+ * cycles, losing at most the pages still in RAM.
+ *
+ *   xlog                        chip, store and drop counters
+ *   xlog start | stop           recording on / off
+ *   xlog dump [can|bin]         stop, then send the store: candump text of
+ *                               the CAN records, or every page in frames
+ *                               EXT_LOG_SYNC | len | type | payload:
+ *                                 'H' version (u8), page size (u16),
+ *                                     pages (u32), first sequence (u32)
+ *                                 'P' sequence (u32), offset (u8: 0 or
+ *                                     128), 128 page bytes
+ *                                 'E' pages sent (u32)
+ *                               (tools/xlog.py splits a capture into a
+ *                               candump log and one file per stream)
+ *   xlog erase                  erase the whole chip (in the background)
+ */
+
+#ifndef EXT_LOG_H
+#define EXT_LOG_H
+
+#include "main.h"
+#include "qspi_flash.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = recorder built in (needs QSPI_FLASH_ENABLE). */
+#ifndef EXT_LOG_ENABLE
+#define EXT_LOG_ENABLE          QSPI_FLASH_ENABLE
+#endif
+
+#if EXT_LOG_ENABLE && !QSPI_FLASH_ENABLE
+#error "EXT_LOG_ENABLE needs QSPI_FLASH_ENABLE"
+#endif
+
+/** Page buffers between the producers and the flash (power of two). */
+#ifndef EXT_LOG_STAGE_PAGES
+#define EXT_LOG_STAGE_PAGES     16U
+#endif
+
+/** 1 = record from boot; 0 = after "xlog start". */
+#ifndef EXT_LOG_AUTOSTART
+#define EXT_LOG_AUTOSTART       1
+#endif
+
+/** An open page older than this is written anyway (ms). */
+#ifndef EXT_LOG_FLUSH_MS
+#define EXT_LOG_FLUSH_MS        1000U
+#endif
+
+/** A program or sector erase still running after this is aborted and
+ *  recording stops (ms; the chip's worst case sector erase is 400 ms). */
+#ifndef EXT_LOG_OP_TIMEOUT_MS
+#define EXT_LOG_OP_TIMEOUT_MS   3000U
+#endif
+
+/** A dump gives up when the console makes no progress for this long (ms). */
+#ifndef EXT_LOG_DUMP_TIMEOUT_MS
+#define EXT_LOG_DUMP_TIMEOUT_MS 1000U
+#endif
+
+/** Sync byte of a binary dump frame. */
+#define EXT_LOG_SYNC            0xFBU
+
+/** ExtLog_PageHdr_t::magic ("XL"). */
+#define EXT_LOG_PAGE_MAGIC      0x4C58U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/** Record types. */
+#define EXT_LOG_REC_TIME        0x01U
+#define EXT_LOG_REC_CAN         0x02U
+#define EXT_LOG_REC_STREAM      0x10U   /**< + Log_Stream_t. */
+
+/**
+ * @brief Start of each flash page (16 bytes, little-endian).
+ */
+typedef struct
+{
+    uint16_t magic;     /**< EXT_LOG_PAGE_MAGIC. */
+    uint16_t used;      /**< Record bytes after the header. */
+    uint32_t seq;       /**< Page number since the store was erased. */
+    uint32_t timeMs;    /**< Global time of the first record (time_sync.h), ms. */
+    uint16_t timeUs;    /**< Microseconds into that millisecond. */
+    uint16_t crc;       /**< CRC-16/CCITT-FALSE of the header up to here
+                             and the used record bytes. */
+} ExtLog_PageHdr_t;
+
+/**
+ * @brief Counters since init.
+ */
+typedef struct
+{
+    uint8_t  recording;
+    uint8_t  erasing;       /**< "xlog erase" running. */
+    uint32_t firstSeq;      /**< Oldest page in flash. */
+    uint32_t nextSeq;       /**< Next page to open. */
+    uint32_t pages;         /**< Pages of the chip. */
+    uint32_t staged;        /**< Closed pages waiting for the flash. */
+    uint32_t stagedMax;
+    uint32_t records;
+    uint32_t bytes;         /**< Record bytes, headers included. */
+    uint32_t dropped;       /**< Records lost, every staging page waiting. */
+    uint32_t pageErrors;    /**< Programs that failed, pages lost. */
+    uint32_t timeouts;      /**< Operations aborted by EXT_LOG_OP_TIMEOUT_MS. */
+} ExtLog_Stats_t;
+
+/**
+ * @brief Find the newest page, continue its sequence, register "xlog"
+ *        and start recording if EXT_LOG_AUTOSTART.
+ *
+ * Call after QspiFlash_Init() succeeded, before osKernelStart().
+ *
+ * @return HAL_OK, or HAL_ERROR if the flash cannot be mapped.
+ */
+HAL_StatusTypeDef ExtLog_Init(void);
+
+/**
+ * @brief RX interrupt: record one CAN frame if recording.
+ *
+ * @param[in] key  Identifier in CAN_IF_Msg_t::Id format.
+ * @param[in] dlc  Data length code.
+ * @param[in] data 8 payload bytes as read from the FIFO.
+ */
+void ExtLog_OnCanRx(uint32_t key, uint8_t dlc, const uint8_t *data);
+
+/**
+ * @brief Record @p len bytes of log stream @p stream (the "xlog"
+ *        transport, log.c); from any context.
+ */
+void ExtLog_WriteStream(uint8_t stream, const uint8_t *data, uint32_t len);
+
+/** Recording on (1) or off (0); off closes the open page. */
+void ExtLog_SetRecording(uint8_t on);
+
+void ExtLog_GetStats(ExtLog_Stats_t *st);
+
+/** 100 ms raster: flush an old open page, watch the flash operation. */
+void ExtLog_Event100ms(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EXT_LOG_H */
@@ -0,0 +1,129 @@
+/**
+ * @file    fan_ctrl.h
+ * @brief   Closed-loop radiator fan: fixed-point PI on the coolant sensor,
+ *          PWM on TIM10.
+ *
+ * The controller is a runnable of the 10 ms raster, or of the 1 ms one
+ * with FAN_CTRL_HZ = 1000 (raster.h). Per step it
+ *
+ *   1. reads the conditioned coolant measurement (vsensor.h); while the
+ *      channel is invalid (open, shorted, stuck, implausible) the fan runs
+ *      at FAN_CTRL_FAILSAFE and the integrator holds,
+ *   2. runs a PI on the error to FAN_SETPOINT_C (cal.h) in fixed point:
+ *      error Q16 °C, duty and integrator Q24, gains Q24 per °C (Kp) and
+ *      per °C and step (Ki / FAN_CTRL_HZ), 64-bit products. The integrator
+ *      is clamped to 0..100 % and stops while the output saturates in the
+ *      direction of the error (anti-windup),
+ *   3. writes the duty into TIM10 CCR1.
+ *
+ * TIM10 CH1 drives the fan on PB8 (AF3) at FAN_CTRL_PWM_HZ, edge aligned.
+ * CCR1 and ARR are preloaded, so a new duty takes effect at the next PWM
+ * period boundary without a glitch and nothing interrupts per period; the
+ * duty changes at most once per control step, so DMA would add nothing.
+ *
+ * The plant reads the duty back from the timer (FanCtrl_GetDuty(), what
+ * the pin carries), VehicleTask feeds it to Vehicle_SetFan() and the
+ * coolant model cools by it (vehicle.h, VEHICLE_FAN), which closes the
+ * loop through the measured coolant temperature.
+ *
+ * Gains and set point are calibration parameters, converted to fixed
+ * point when they change. "fan" shows the loop, "fan duty <pct>" holds a
+ * manual duty, "fan auto" returns to the controller.
+ */
+
+#ifndef FAN_CTRL_H
+#define FAN_CTRL_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = fan controller and TIM10 PWM. */
+#ifndef FAN_CTRL_ENABLE
+#define FAN_CTRL_ENABLE         1
+#endif
+
+/** Control steps per second: 100 (10 ms raster) or 1000 (1 ms raster). */
+#ifndef FAN_CTRL_HZ
+#define FAN_CTRL_HZ             100U
+#endif
+
+/** PWM frequency (Hz); 25 kHz is the 4-wire fan standard. */
+#ifndef FAN_CTRL_PWM_HZ
+#define FAN_CTRL_PWM_HZ         25000U
+#endif
+
+/** Duty while the coolant sensor is invalid (0..1). */
+#ifndef FAN_CTRL_FAILSAFE
+#define FAN_CTRL_FAILSAFE       1.0f
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Loop state, as of the last step.
+ */
+typedef struct
+{
+    float    setpoint;      /**< °C. */
+    float    measured;      /**< °C, conditioned coolant sensor. */
+    float    error;         /**< measured - setpoint, °C. */
+    float    p;             /**< Proportional part of the duty. */
+    float    i;             /**< Integrator. */
+    float    duty;          /**< Commanded duty 0..1. */
+    uint8_t  manual;        /**< "fan duty" holds the duty. */
+    uint8_t  failsafe;      /**< Sensor invalid: FAN_CTRL_FAILSAFE. */
+    uint32_t steps;
+    uint32_t saturated;     /**< Steps with the output clamped. */
+    uint32_t failsafeSteps;
+    uint32_t ccr;           /**< TIM10 CCR1 ... */
+    uint32_t arr;           /**< ... of ARR + 1 counts. */
+} FanCtrl_Status_t;
+
+/**
+ * @brief Set up TIM10 CH1 (PWM, 0 %) on PB8 and register "fan". Call once
+ *        before the scheduler starts.
+ */
+HAL_StatusTypeDef FanCtrl_Init(void);
+
+/**
+ * @brief One control step (raster runnable at FAN_CTRL_HZ).
+ */
+void FanCtrl_Step(void);
+
+/**
+ * @brief Duty the PWM output carries now, 0..1 (any task).
+ */
+float FanCtrl_GetDuty(void);
+
+/**
+ * @brief Consistent copy of the loop state (any task).
+ */
+void FanCtrl_GetStatus(FanCtrl_Status_t *out);
+
+/**
+ * @brief Hold @p duty (0..1), or return to the controller for a negative
+ *        one; it restarts from the held duty without a bump.
+ */
+void FanCtrl_SetManual(float duty);
+
+/**
+ * @brief The APB2 clock changed (clock_gov.h): keep FAN_CTRL_PWM_HZ and
+ *        the duty.
+ */
+void FanCtrl_ClockChanged(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FAN_CTRL_H */
@@ -0,0 +1,199 @@
+/**
+ * @file    fault_inj.h
+ * @brief   Fault engine: scheduled and random sensor and CAN faults.
+ *
+ * "sensor fault" and Vehicle_Force() ("veh cool-hot", scenario events)
+ * inject one fault by hand. The engine holds up to FAULT_INJ_MAX_FAULTS
+ * faults, each a kind, a target, a trigger and a duration (in quotes the
+ * "sensor fault" a sensor kind sets):
+ *
+ *   | Kind    | Target         | While active                             |
+ *   |---------|----------------|------------------------------------------|
+ *   | stuck   | sensor channel | repeats its last count ("stuck")         |
+ *   | noise   | sensor channel | noise burst ("noisy")                    |
+ *   | dropout | sensor channel | reads 0, open circuit ("open")           |
+ *   | drop    | CAN identifier | received frames are lost                 |
+ *   | delay   | CAN identifier | received frames arrive param ms later    |
+ *   | corrupt | CAN identifier | payload bit param flips (or a random one)|
+ *
+ * Triggers:
+ *
+ *   - scheduled: the fault starts at a time after it was added, once;
+ *   - random: the fault starts with a probability per tick, and, once it
+ *     has ended, may start again, until it is removed.
+ *
+ * A tick is the 10 ms runnable (raster.h, FaultInj_Event10ms()). Waiting
+ * faults are a list sorted by start time and active ones a list sorted by
+ * end time, so a tick looks at the two heads and costs O(1) without an
+ * event, O(active faults) with one. A random fault does not draw every
+ * tick: "first success after n ticks" of per-tick probability p is
+ * geometric, so the gap is drawn once from the xorshift32 generator
+ * (n = 1 + ln(u) / ln(1 - p)) and the fault waits in the timeline like a
+ * scheduled one, with the same distribution as a draw per tick. The
+ * generator is seeded with FAULT_INJ_SEED, or "fault seed", so a run can
+ * be repeated.
+ *
+ * Sensor faults are applied with VSensor_SetFault() on the tick after a
+ * change; the first active fault of a channel wins, and the channel goes
+ * back to none when its last one ends (a fault set by hand with "sensor
+ * fault" stays until the engine changes that channel).
+ *
+ * CAN faults act in CanRxTask, on entry to CAN_IF_ProcessRxMsg(), so the
+ * handlers, the E2E and SecOC checks and the console log see the faulty
+ * frame. Without an active CAN fault the hook is one load. Delayed frames
+ * wait in a FIFO of FAULT_INJ_DELAY_DEPTH frames, in arrival order, and
+ * are put back into the RX ring by the tick (CAN_IF_ReinjectRx(), 10 ms
+ * resolution) marked with CAN_IF_FMI_REINJECTED, so no delay fault takes
+ * them a second time. A frame finding the FIFO full goes through on time
+ * and is counted.
+ *
+ *   fault                                    faults and counters
+ *   fault add <kind> <target> <at> <dur> [param]
+ *                                            at: ms from now, or p<N> for N
+ *                                            per mille per tick; dur: ms,
+ *                                            0 until deleted
+ *   fault del <id>                           remove one fault
+ *   fault clear                              remove all
+ *   fault seed <n>                           reseed the generator
+ */
+
+#ifndef FAULT_INJ_H
+#define FAULT_INJ_H
+
+#include "main.h"
+#include "can_if.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = fault engine, its runnable and the CAN RX hook built in. */
+#ifndef FAULT_INJ_ENABLE
+#define FAULT_INJ_ENABLE        1
+#endif
+
+/** Faults held at a time (at most 254). */
+#ifndef FAULT_INJ_MAX_FAULTS
+#define FAULT_INJ_MAX_FAULTS    16U
+#endif
+
+/** Frames a delay fault can hold at a time. */
+#ifndef FAULT_INJ_DELAY_DEPTH
+#define FAULT_INJ_DELAY_DEPTH   16U
+#endif
+
+/** Delay of a delay fault added without param (ms). */
+#ifndef FAULT_INJ_DELAY_MS
+#define FAULT_INJ_DELAY_MS      50U
+#endif
+
+/** Generator seed at boot (non-zero). */
+#ifndef FAULT_INJ_SEED
+#define FAULT_INJ_SEED          0x6C078965U
+#endif
+
+/** Period of FaultInj_Event10ms() (ms). */
+#define FAULT_INJ_TICK_MS       10U
+
+/** Corrupt param: flip a random bit of the payload. */
+#define FAULT_INJ_BIT_RANDOM    0xFFU
+
+/** Fault kinds. X(name, command word, 1 for a CAN target) */
+#define FAULT_INJ_KIND_TABLE(X)             \
+    X(STUCK,   "stuck",   0U)               \
+    X(NOISE,   "noise",   0U)               \
+    X(DROPOUT, "dropout", 0U)               \
+    X(DROP,    "drop",    1U)               \
+    X(DELAY,   "delay",   1U)               \
+    X(CORRUPT, "corrupt", 1U)
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+#define FAULT_INJ_KIND_ENUM_(name, word, can) FAULT_INJ_##name,
+    FAULT_INJ_KIND_TABLE(FAULT_INJ_KIND_ENUM_)
+#undef FAULT_INJ_KIND_ENUM_
+    FAULT_INJ_KIND_COUNT
+} FaultInj_Kind_t;
+
+/**
+ * @brief One fault to add.
+ */
+typedef struct
+{
+    uint8_t  kind;          /**< FaultInj_Kind_t. */
+    uint16_t chance;        /**< Per mille per tick (1..1000), 0 = scheduled. */
+    uint32_t target;        /**< VSensor_Ch_t, or CAN_IF_Msg_t::Id key. */
+    uint32_t atMs;          /**< Scheduled: start, ms after FaultInj_Add(). */
+    uint32_t durMs;         /**< Active time per start, 0 = until removed. */
+    uint32_t param;         /**< Delay: ms. Corrupt: bit 0..63 or FAULT_INJ_BIT_RANDOM. */
+} FaultInj_Spec_t;
+
+/**
+ * @brief Counters since boot.
+ */
+typedef struct
+{
+    uint32_t starts;        /**< Faults that became active. */
+    uint32_t dropped;       /**< Frames lost to drop faults. */
+    uint32_t delayed;       /**< Frames held by delay faults. */
+    uint32_t corrupted;     /**< Frames with a flipped bit. */
+    uint32_t delayFull;     /**< Frames not delayed: FIFO full. */
+    uint32_t reinjectFail;  /**< Delayed frames lost: RX ring full. */
+} FaultInj_Stats_t;
+
+/**
+ * @brief Register the "fault" commands. Call once before the scheduler
+ *        starts.
+ */
+HAL_StatusTypeDef FaultInj_Init(void);
+
+/**
+ * @brief Add a fault (any task); it waits for its trigger.
+ *
+ * @param[out] id Fault number for FaultInj_Remove(), may be NULL.
+ * @return HAL_OK, HAL_BUSY with all faults in use, HAL_ERROR for a bad
+ *         kind, target or chance.
+ */
+HAL_StatusTypeDef FaultInj_Add(const FaultInj_Spec_t *spec, uint8_t *id);
+
+/** Remove fault @p id, active or not; HAL_ERROR if there is none. */
+HAL_StatusTypeDef FaultInj_Remove(uint8_t id);
+
+/** Remove all faults and drop the delayed frames. */
+void FaultInj_Clear(void);
+
+/** Restart the generator (0 takes FAULT_INJ_SEED). */
+void FaultInj_Seed(uint32_t seed);
+
+void FaultInj_GetStats(FaultInj_Stats_t *out);
+
+/**
+ * @brief Start and end the due faults, release the due delayed frames
+ *        (10 ms runnable).
+ */
+void FaultInj_Event10ms(void);
+
+/**
+ * @brief CAN faults on a received frame (CanRxTask, CAN_IF_ProcessRxMsg()).
+ *
+ * @param[in]  msg     Frame from the RX path.
+ * @param[out] scratch Room for a corrupted copy.
+ * @return @p msg as it is, @p scratch when corrupted, NULL when the frame
+ *         is dropped or delayed.
+ */
+const CAN_IF_Msg_t *FaultInj_CanRx(const CAN_IF_Msg_t *msg, CAN_IF_Msg_t *scratch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FAULT_INJ_H */
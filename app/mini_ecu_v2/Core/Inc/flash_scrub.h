@@ -0,0 +1,110 @@
+/**
+ * @file    flash_scrub.h
+ * @brief   Flash scrubbing: the CRCs of the running image and of the
+ *          calibration image, checked again in idle time.
+ *
+ * The bootloader checks the image CRC once per start (image_header.h) and
+ * cal.c the calibration image CRC once at boot (cal_image.h); an ECU that
+ * runs for months without a reset would not see a cell that degrades in
+ * between. The scrubber recomputes both CRCs from flash, over and over:
+ *
+ *   - every FLASH_SCRUB_PERIOD_S the 100 ms runnable starts a pass over
+ *     the regions (FlashScrub_Event100ms(), raster.h);
+ *   - the FreeRTOS idle hook then feeds FLASH_SCRUB_SLICE_BYTES per call
+ *     to the CRC unit (FlashScrub_Idle()), which keeps the running CRC
+ *     between slices, so a region takes as many idle slices as it needs;
+ *   - at the end of a region the runnable compares the result with the
+ *     stamped CRC, logs a change and reports it to its DTC: P0601 for the
+ *     image, P0602 for the calibration.
+ *
+ * The idle task runs only when every task is blocked, and the slice runs
+ * with interrupts enabled, so any interrupt or task that becomes ready
+ * preempts it at once and the scrubber adds no latency to either; a slice
+ * of 4 KB takes some 10 us of otherwise idle CPU, which "top" counts as
+ * idle. The idle hook touches nothing but the CRC unit and this module's
+ * state: the DTC, log and freeze frame work runs in the raster task, off
+ * the idle task's small stack. The idle task is the CRC unit's only user.
+ *
+ * A region runs as its stamp defines it: the image from the slot base to
+ * its length without the header, the calibration image to its length
+ * without its CRC word. An unstamped image (loaded by a debugger) is not
+ * scrubbed. The flash log (nvm_log.h) is not a region: its records change
+ * at run time and each carries its own check word.
+ *
+ *   scrub                 regions, passes, mismatches, slice figures
+ *   scrub now             start a pass now
+ */
+
+#ifndef FLASH_SCRUB_H
+#define FLASH_SCRUB_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = idle-time flash scrubber and its 100 ms runnable built in. */
+#ifndef FLASH_SCRUB_ENABLE
+#define FLASH_SCRUB_ENABLE      1
+#endif
+
+/** Bytes fed to the CRC unit per idle hook call (multiple of 4). */
+#ifndef FLASH_SCRUB_SLICE_BYTES
+#define FLASH_SCRUB_SLICE_BYTES 4096U
+#endif
+
+/** Time from the start of one pass to the start of the next (s). */
+#ifndef FLASH_SCRUB_PERIOD_S
+#define FLASH_SCRUB_PERIOD_S    60U
+#endif
+
+_Static_assert((FLASH_SCRUB_SLICE_BYTES % 4U) == 0U, "FLASH_SCRUB_SLICE_BYTES: whole words");
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Scrubber figures.
+ */
+typedef struct
+{
+    uint32_t passes;        /**< Passes over every region completed. */
+    uint32_t slices;        /**< Idle hook calls that fed the CRC unit. */
+    uint32_t sliceMax;      /**< Longest slice (core cycles). */
+    uint32_t passMs;        /**< Length of the last pass (ms). */
+    uint32_t mismatches;    /**< Region checks that failed, all regions. */
+} FlashScrub_Stats_t;
+
+/**
+ * @brief Take the regions from the image and calibration headers, clock
+ *        the CRC unit and register "scrub". Call once before the
+ *        scheduler starts.
+ */
+void FlashScrub_Init(void);
+
+/**
+ * @brief One slice of the running pass; from vApplicationIdleHook() only.
+ */
+void FlashScrub_Idle(void);
+
+/**
+ * @brief Start a pass when one is due and report the regions checked
+ *        (100 ms raster runnable).
+ */
+void FlashScrub_Event100ms(void);
+
+/** Copy the scrubber figures. */
+void FlashScrub_GetStats(FlashScrub_Stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FLASH_SCRUB_H */
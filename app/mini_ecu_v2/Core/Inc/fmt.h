@@ -0,0 +1,142 @@
+/**
+ * @file    fmt.h
+ * @brief   Small text formatters for hot output paths (no varargs, no printf).
+ *
+ * newlib's snprintf() parses the format string, walks va_args and, for
+ * floats, pulls in the double-precision library: thousands of cycles and a
+ * few hundred bytes of stack per call. These functions each do one
+ * conversion with lookup tables instead: a nibble table for hex, a
+ * two-digit table for decimal (one division per two digits) and a scaled
+ * integer for fixed point.
+ *
+ * Every function writes at @p out, appends a NUL that is not counted and
+ * returns the number of characters written, so calls chain:
+ *
+ *   n  = Fmt_Str(buf, "RPM ", 0U);
+ *   n += Fmt_Dec(&buf[n], rpm, 5U);
+ *
+ * A non-zero @p width pads with spaces on the left to at least that many
+ * characters, like "%5u"; longer values are never cut. The caller sizes
+ * the buffer (the FMT_*_MAX values plus the width and the NUL).
+ *
+ * Pure functions of their arguments: safe from any task or ISR.
+ *
+ * Fmt_Snprintf() / Fmt_Vsnprintf() are a printf subset on the same
+ * tables, for format strings that stay: %d %i %u %o %x %X %c %s %p %f %e
+ * %g and %%, with the '-', '0', '+', ' ' and '#' flags ('#': "0x" on %x,
+ * a leading 0 on %o, the point kept on floats), width and precision (also
+ * as '*') and the hh, h, l, ll, j, z, t lengths. 64-bit integers print in
+ * full; only values beyond 32 bits take 64-bit divisions. Floats are
+ * converted in single precision (the FPU's; doubles are narrowed), at
+ * most FMT_PRINTF_MAX_PREC decimals, and ties round up, so the last digit
+ * can differ from newlib's double-precision result ("%.1f" of 123.45
+ * gives 123.4); %f switches to %e beyond 2^32. No locale, no _reent, no
+ * malloc.
+ *
+ * With FMT_PRINTF = 1 ("make FMT_PRINTF=1") every formatting call of the
+ * application goes through FMT_SNPRINTF / FMT_VSNPRINTF to these instead
+ * of newlib's, and newlib's float printf is not linked. newlib's printf
+ * then runs nowhere, which is what needed its locks and a struct _reent
+ * in every TCB (configUSE_NEWLIB_REENTRANT = 0; FreeRTOSConfig.h).
+ */
+
+#ifndef FMT_H
+#define FMT_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Route the application's snprintf()/vsnprintf() calls to Fmt_Snprintf(). */
+#ifndef FMT_PRINTF
+#define FMT_PRINTF          0
+#endif
+
+#if FMT_PRINTF
+#define FMT_SNPRINTF        Fmt_Snprintf
+#define FMT_VSNPRINTF       Fmt_Vsnprintf
+#else
+#define FMT_SNPRINTF        snprintf
+#define FMT_VSNPRINTF       vsnprintf
+#endif
+
+/** Most decimals of a float conversion in Fmt_Vsnprintf(). */
+#define FMT_PRINTF_MAX_PREC 9U
+
+/** Longest Fmt_Dec() / Fmt_Int() output without padding ("-2147483648"). */
+#define FMT_DEC_MAX         11U
+
+/** Most decimals Fmt_Fixed() produces; more are reduced to this. */
+#define FMT_FIXED_MAX_DEC   4U
+
+/**
+ * @brief Uppercase hex, exactly @p digits digits (1..8), zero-filled.
+ */
+uint32_t Fmt_Hex(char *out, uint32_t value, uint8_t digits);
+
+/**
+ * @brief Bytes as uppercase hex pairs, separated by @p sep ('\0' = none).
+ *
+ * Writes 2 * @p len characters, plus @p len - 1 separators.
+ */
+uint32_t Fmt_HexBytes(char *out, const uint8_t *data, uint32_t len, char sep);
+
+/**
+ * @brief Unsigned decimal, like "%*u".
+ */
+uint32_t Fmt_Dec(char *out, uint32_t value, uint8_t width);
+
+/**
+ * @brief Unsigned decimal zero-filled to @p width digits, like "%0*u".
+ */
+uint32_t Fmt_DecZ(char *out, uint32_t value, uint8_t width);
+
+/**
+ * @brief Signed decimal, like "%*d".
+ */
+uint32_t Fmt_Int(char *out, int32_t value, uint8_t width);
+
+/**
+ * @brief Fixed point with @p decimals digits after the point, like "%*.*f".
+ *
+ * Rounded to nearest in single precision, so a value just below a tie
+ * may round up where printf's double arithmetic rounds down. |value| *
+ * 10^decimals saturates at 2^32 - 1; NaN prints "nan".
+ */
+uint32_t Fmt_Fixed(char *out, float value, uint8_t decimals, uint8_t width);
+
+/**
+ * @brief Copy a string, right-aligned in @p width, like "%*s".
+ */
+uint32_t Fmt_Str(char *out, const char *s, uint8_t width);
+
+/**
+ * @brief Copy a string, left-aligned in @p width, like "%-*s".
+ */
+uint32_t Fmt_StrLeft(char *out, const char *s, uint8_t width);
+
+/**
+ * @brief vsnprintf() subset (see the top of this file).
+ *
+ * @return Characters the whole output takes, without the NUL; at most
+ *         @p size - 1 of them are stored, always NUL-terminated if @p size
+ *         is not 0.
+ */
+int Fmt_Vsnprintf(char *out, size_t size, const char *fmt, va_list ap);
+
+/**
+ * @brief snprintf() subset, as Fmt_Vsnprintf().
+ */
+int Fmt_Snprintf(char *out, size_t size, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FMT_H */
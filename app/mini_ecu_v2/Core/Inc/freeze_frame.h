@@ -0,0 +1,149 @@
+/**
+ * @file    freeze_frame.h
+ * @brief   DTC freeze frames: the signal cache and the seconds before a
+ *          fault, captured with memcpy() where the fault is reported.
+ *
+ * The first occurrence of a DTC (Dtc_Set(), under its PRIMASK section)
+ * calls FreezeFrame_Capture(), which takes a free slot of a preallocated
+ * table and fills it with two copies and nothing else:
+ *
+ *   - every entry of the CAN signal cache (can_sigcache.h) as it is now,
+ *     value, receive time and sequence (CanSigCache_Snapshot());
+ *   - the pre-trigger ring: FREEZE_FRAME_ROWS rows of the signals of
+ *     FREEZE_FRAME_SIGNAL_TABLE, one every FREEZE_FRAME_ROW_MS, filled by
+ *     the 100 ms runnable (raster.h, FreezeFrame_Event100ms()), copied
+ *     oldest first in at most two pieces.
+ *
+ * A slot is about 330 bytes and a capture takes a few hundred cycles, so
+ * it is safe from an interrupt or with interrupts masked; no formatting,
+ * scaling or flash access happens there. The slot is marked for the flash
+ * log (nvm_log.h) and NvmTask writes it later as FREEZE_FRAME_CHUNKS
+ * records, the header last, so a reset in the middle leaves the slot
+ * free rather than half written. The sequence counters of the cache
+ * entries are not kept over a reset, only whether a signal had been
+ * received. With all slots taken a new fault keeps only the three-value
+ * freeze frame of its DTC entry and is counted as dropped. Dtc_Clear()
+ * frees the slots.
+ *
+ * UDS 0x19 04 returns a frame as snapshot records (uds.h), "dtc frame"
+ * (dtc.h) prints it.
+ */
+
+#ifndef FREEZE_FRAME_H
+#define FREEZE_FRAME_H
+
+#include "main.h"
+#include "can_sigcache.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Frames kept (flash log records: FREEZE_FRAME_CHUNKS each). */
+#ifndef FREEZE_FRAME_SLOTS
+#define FREEZE_FRAME_SLOTS      4U
+#endif
+
+/** Pre-trigger rows and their spacing (a multiple of 100 ms): 5 s. */
+#ifndef FREEZE_FRAME_ROWS
+#define FREEZE_FRAME_ROWS       10U
+#endif
+#ifndef FREEZE_FRAME_ROW_MS
+#define FREEZE_FRAME_ROW_MS     500U
+#endif
+
+/**
+ * @brief Signals of a pre-trigger row. X(name): CAN_SIG_<name>.
+ */
+#ifndef FREEZE_FRAME_SIGNAL_TABLE
+#define FREEZE_FRAME_SIGNAL_TABLE(X)                        \
+    X(SPEED)                                                \
+    X(RPM)                                                  \
+    X(COOLANT)                                              \
+    X(SENS_SPEED)                                           \
+    X(SENS_RPM)                                             \
+    X(SENS_COOLANT)
+#endif
+
+_Static_assert((FREEZE_FRAME_SLOTS > 0U) && (FREEZE_FRAME_SLOTS <= 255U), "FREEZE_FRAME_SLOTS out of range");
+_Static_assert((FREEZE_FRAME_ROWS > 0U) && (FREEZE_FRAME_ROWS <= 255U), "FREEZE_FRAME_ROWS out of range");
+_Static_assert((FREEZE_FRAME_ROW_MS % 100U) == 0U, "FREEZE_FRAME_ROW_MS must be a multiple of 100");
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+#define FREEZE_FRAME_COUNT_(name)   + 1U
+
+/** Signals per row. */
+#define FREEZE_FRAME_SIGNALS    (0U FREEZE_FRAME_SIGNAL_TABLE(FREEZE_FRAME_COUNT_))
+
+/** Flash log records of one slot: header, cache entries, row pairs. */
+#define FREEZE_FRAME_CHUNKS     (1U + CAN_SIG_COUNT + \
+                                 (((FREEZE_FRAME_ROWS * FREEZE_FRAME_SIGNALS) + 1U) / 2U))
+
+/**
+ * @brief One captured frame.
+ */
+typedef struct
+{
+    uint16_t            code;       /**< DTC (SAE J2012 2-byte form). */
+    uint8_t             rows;       /**< Valid rows of hist (fewer soon after boot). */
+    uint32_t            timeMs;     /**< HAL tick of the capture. */
+    CanSigCache_Entry_t cache[CAN_SIG_COUNT];
+    /** Pre-trigger rows, oldest first: hist[rows - 1] is the last one
+     *  before the capture. */
+    float               hist[FREEZE_FRAME_ROWS][FREEZE_FRAME_SIGNALS];
+} FreezeFrame_t;
+
+/** Figures. */
+typedef struct
+{
+    uint32_t used;          /**< Slots holding a frame. */
+    uint32_t captured;      /**< Frames captured since boot. */
+    uint32_t dropped;       /**< Faults with no free slot. */
+} FreezeFrame_Stats_t;
+
+/** CAN signal of row column @p col (CanSigCache_Signal_t). */
+uint32_t FreezeFrame_Signal(uint32_t col);
+
+/**
+ * @brief Join the flash log. Call once before NvmLog_Init(), which
+ *        restores the stored frames.
+ */
+void FreezeFrame_Init(void);
+
+/**
+ * @brief Capture a frame for DTC @p code into a free slot: memcpy() only,
+ *        any context. The caller wakes NvmTask (NvmLog_Notify()).
+ *
+ * @return HAL_OK, HAL_BUSY if @p code already has a frame, HAL_ERROR if
+ *         no slot was free.
+ */
+HAL_StatusTypeDef FreezeFrame_Capture(uint16_t code);
+
+/** Free every slot (any task); written as empty records. */
+void FreezeFrame_Clear(void);
+
+/**
+ * @brief Copy the frame of DTC @p code.
+ *
+ * @return HAL_OK, or HAL_ERROR if it has none.
+ */
+HAL_StatusTypeDef FreezeFrame_Get(uint16_t code, FreezeFrame_t *out);
+
+void FreezeFrame_GetStats(FreezeFrame_Stats_t *out);
+
+/** 100 ms runnable: adds a pre-trigger row every FREEZE_FRAME_ROW_MS. */
+void FreezeFrame_Event100ms(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREEZE_FRAME_H */
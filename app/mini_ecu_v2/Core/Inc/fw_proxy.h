@@ -0,0 +1,199 @@
+/**
+ * @file    fw_proxy.h
+ * @brief   Flashing proxy: this ECU updates the bootloaders of the nodes on
+ *          CAN2 from an image staged in its other slot.
+ *
+ * A tester on the console hands the image over once, at the console's rate
+ * (tools/fw_proxy.py, the STAGE_* requests of cli_rpc.h), into the
+ * slot this ECU is not running from (stage.h); it is verified there and
+ * never activated. FwProxyTask then talks to the bootloaders on CAN2 with
+ * the protocol of bootloader/mini_ecu_boot (boot_can.h, boot_update.h),
+ * as tools/can_update.py does from a PC, but keeping every node busy at
+ * once:
+ *
+ *   1. optionally a programming session request (UDS 0x10 0x02) to each
+ *      running application, then INFO to all nodes together,
+ *   2. ERASE to all of them together: the erases run in parallel,
+ *   3. every chunk once on the functional ID 0x7DF (no flow control, CFs
+ *      every FW_PROXY_MC_STMIN_MS, FW_PROXY_MC_GAP_MS after each chunk so
+ *      the polled bootloaders program it): all nodes take the same frames,
+ *   4. DONE to all nodes together; a node that missed a chunk names it and
+ *      gets it resent physically, while the others carry on,
+ *   5. GO to each verified node unless told not to.
+ *
+ * Only the multicast takes bus time per chunk, so N nodes take about the
+ * time of one plus the DONE round trips. The physical requests of
+ * different nodes use different identifiers and overlap freely; each node
+ * has one request outstanding, as its polled bootloader needs.
+ *
+ * The image is linked for one slot: a node is flashed only if the slot its
+ * bootloader writes (INFO) is the one the image was staged in, otherwise
+ * it is skipped ("linked for the other slot"). The other image of the pair
+ * is staged and sent in a second run.
+ *
+ * Responses come in on 0x7E8 + node, one CAN2 filter bank for all eight
+ * (can_gw.c hands them over from the CAN2 RX interrupt); requests go out
+ * on 0x7E0 + node, so nodes 0..7 can be addressed.
+ *
+ *   fwp                               job state and every node
+ *   fwp start <n>[,<n>...] [req] [nogo]
+ *                                     flash the staged image into the
+ *                                     nodes; req: ask the applications to
+ *                                     enter their bootloaders first; nogo:
+ *                                     leave them in the bootloader
+ *   fwp abort                         stop after the frame in progress
+ */
+
+#ifndef FW_PROXY_H
+#define FW_PROXY_H
+
+#include "main.h"
+#include "can_if.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = FwProxyTask and "fwp" built in; needs CAN2 (CAN_IF_NUM_BUSES 2). */
+#ifndef FW_PROXY_ENABLE
+#if CAN_IF_NUM_BUSES > 1U
+#define FW_PROXY_ENABLE         1
+#else
+#define FW_PROXY_ENABLE         0
+#endif
+#endif
+
+/** Bootloader identifiers, as boot_can.h. */
+#define FW_PROXY_REQ_ID         0x7E0U
+#define FW_PROXY_RESP_ID        0x7E8U
+#define FW_PROXY_FUNC_ID        0x7DFU
+
+/** Nodes that can be addressed: 0x7E0..0x7E7. */
+#define FW_PROXY_MAX_NODES      8U
+
+/** Pause between the consecutive frames of a multicast chunk (ms). */
+#ifndef FW_PROXY_MC_STMIN_MS
+#define FW_PROXY_MC_STMIN_MS    0U
+#endif
+
+/** Pause after each multicast chunk while the nodes program it (ms). */
+#ifndef FW_PROXY_MC_GAP_MS
+#define FW_PROXY_MC_GAP_MS      10U
+#endif
+
+/** Wait for a reply, and tries, of INFO, DONE, WRITE and GO (ms). */
+#ifndef FW_PROXY_REPLY_MS
+#define FW_PROXY_REPLY_MS       1000U
+#endif
+#define FW_PROXY_TRIES          3U
+
+/** Wait for the ERASE reply (ms); sent once. */
+#ifndef FW_PROXY_ERASE_MS
+#define FW_PROXY_ERASE_MS       15000U
+#endif
+
+/** After the session requests: settle time, and INFO tries while the
+ *  nodes reset into their bootloaders. */
+#define FW_PROXY_REQUEST_MS     500U
+#define FW_PROXY_REQUEST_TRIES  10U
+
+/** Missed chunks resent to one node before it is given up. */
+#ifndef FW_PROXY_RESENDS
+#define FW_PROXY_RESENDS        64U
+#endif
+
+/** Frames received on CAN2 and not yet taken by FwProxyTask. */
+#ifndef FW_PROXY_RX_FRAMES
+#define FW_PROXY_RX_FRAMES      64U
+#endif
+
+/** Consecutive frames queued per node and task pass, as ISOTP_TX_BURST. */
+#ifndef FW_PROXY_TX_BURST
+#define FW_PROXY_TX_BURST       8U
+#endif
+
+/** Thread flag that wakes FwProxyTask. */
+#define FW_PROXY_FLAG           0x0001U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/** fwp start options. */
+#define FW_PROXY_OPT_REQUEST    0x01U   /**< Session request to the applications first. */
+#define FW_PROXY_OPT_NO_GO      0x02U   /**< No GO: stay in the bootloaders. */
+
+typedef enum
+{
+    FW_PROXY_IDLE = 0,      /**< No job since boot. */
+    FW_PROXY_REQUEST,       /**< Session requests sent, nodes resetting. */
+    FW_PROXY_INFO,
+    FW_PROXY_ERASE,
+    FW_PROXY_WRITE,         /**< Multicasting the chunks. */
+    FW_PROXY_VERIFY,        /**< DONE and resends. */
+    FW_PROXY_GO,
+    FW_PROXY_FINISHED       /**< Every node verified, skipped or failed. */
+} FwProxy_State_t;
+
+/**
+ * @brief Job figures.
+ */
+typedef struct
+{
+    FwProxy_State_t state;
+    uint32_t        nodes;       /**< Node mask of the job. */
+    uint32_t        ok;          /**< Nodes verified (and started). */
+    uint32_t        failed;      /**< Nodes given up or skipped. */
+    uint32_t        base;        /**< Slot the image is linked for. */
+    uint32_t        length;
+    uint32_t        chunks;
+    uint32_t        sent;        /**< Chunks multicast. */
+    uint32_t        resent;      /**< Chunks resent physically, all nodes. */
+    uint32_t        startMs;
+    uint32_t        elapsedMs;   /**< Whole job, up to now while running. */
+} FwProxy_Stats_t;
+
+/**
+ * @brief Create FwProxyTask and register "fwp".
+ *
+ * Call after Stage_Init(), before the scheduler starts.
+ *
+ * @return HAL_OK, or HAL_ERROR if FwProxyTask could not be created.
+ */
+HAL_StatusTypeDef FwProxy_Init(void);
+
+/**
+ * @brief Flash the staged image into the nodes of @p nodeMask
+ *        (bit n = node n) with FW_PROXY_OPT_* @p options.
+ *
+ * @return HAL_OK once the job is started; HAL_BUSY while one runs;
+ *         HAL_ERROR if no verified image is staged or the mask is empty.
+ */
+HAL_StatusTypeDef FwProxy_Start(uint32_t nodeMask, uint32_t options);
+
+/**
+ * @brief Give the job up; the nodes stay in their bootloaders.
+ */
+void FwProxy_Abort(void);
+
+/**
+ * @brief Copy the job figures.
+ */
+void FwProxy_GetStats(FwProxy_Stats_t *out);
+
+/**
+ * @brief A CAN2 frame on 0x7E8..0x7EF, from the CAN2 RX interrupt
+ *        (can_gw.c).
+ */
+void FwProxy_OnRx(uint32_t key, uint8_t dlc, const uint8_t *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FW_PROXY_H */
@@ -0,0 +1,77 @@
+/**
+ * @file    image_header.h
+ * @brief   Application image header checked by the bootloader.
+ *
+ * The header sits at a fixed offset behind the vector table (slot base +
+ * IMAGE_HEADER_OFFSET, section ".image_header" in STM32F446RETX_FLASH.ld).
+ * The build links it with the magic and version filled in and everything
+ * else erased (0xFFFFFFFF); tools/image_stamp.py then writes length and
+ * CRC into the .bin that gets flashed. The boot-control words stay erased
+ * in the .bin and are programmed in place on the device.
+ *
+ * The CRC is the one the STM32 CRC unit computes (CRC-32/MPEG-2: poly
+ * 0x04C11DB7, init 0xFFFFFFFF, fed 32-bit little-endian words, no
+ * reflection, no final XOR) over the image from the slot base to base +
+ * length, skipping the header itself.
+ *
+ * The image is linked for one of the bootloader's two slots (boot_slot.h):
+ * A at IMAGE_SLOT_A_ADDR (mini_ecu_v2.bin) or B at IMAGE_SLOT_B_ADDR
+ * (mini_ecu_v2_b.bin). An update is written to the slot that is not running
+ * and activated by its generation word. Until the new image programs
+ * its confirmed word (BootRequest_ConfirmImage()) it is on trial: after
+ * BOOT_MAX_ATTEMPTS boots without confirmation the bootloader revokes it
+ * and starts the previous image again.
+ *
+ * The bootloader has its own copy of this layout in boot_image.h; keep the
+ * two in sync.
+ */
+
+#ifndef IMAGE_HEADER_H
+#define IMAGE_HEADER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Offset of the header from the image start (vector table is 0x1C4 B). */
+#define IMAGE_HEADER_OFFSET    0x200U
+
+#define IMAGE_HEADER_MAGIC     0x5543454DU   /* "MECU" */
+
+/** Firmware version, 0x00MMmmpp (major, minor, patch). */
+#ifndef APP_FW_VERSION
+#define APP_FW_VERSION         0x00000300U   /* v0.3.0 */
+#endif
+
+/** Application slots of the bootloader. */
+#define IMAGE_SLOT_A_ADDR      0x08010000U   /* sectors 4..5, 192 KB */
+#define IMAGE_SLOT_B_ADDR      0x08040000U   /* sectors 6..7, 256 KB */
+
+/** Erased flash word: field not stamped / flag not set. */
+#define IMAGE_ERASED           0xFFFFFFFFU
+
+typedef struct
+{
+    uint32_t magic;       /**< IMAGE_HEADER_MAGIC. */
+    uint32_t version;     /**< APP_FW_VERSION. */
+    uint32_t length;      /**< Image bytes from the slot base, multiple of 4. */
+    uint32_t crc32;       /**< STM32 CRC of the image without this header. */
+
+    /* Boot control: linked erased, each programmed once in place. */
+    uint32_t generation;  /**< Activation count, set by the bootloader. */
+    uint32_t confirmed;   /**< 0 once this image accepted itself. */
+    uint32_t revoked;     /**< 0 once the image was rolled back. */
+} ImageHeader_t;
+
+#define IMAGE_HEADER_AT(base)  ((const ImageHeader_t *)((base) + IMAGE_HEADER_OFFSET))
+
+/** The application's own header (read-only, in flash). */
+extern const ImageHeader_t g_imageHeader;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IMAGE_HEADER_H */
@@ -0,0 +1,184 @@
+/**
+ * @file    irq_bench.h
+ * @brief   Interrupt and wake-up latency benchmark on TIM3 input capture
+ *          ("bench irq"), built with IRQ_BENCH_ENABLE = 1.
+ *
+ * Software time stamps cannot see the time before the first instruction of
+ * a handler, and they cost the path they measure. Here the start and the
+ * end of a path are edges on two pins, time-stamped by TIM3 input capture
+ * in hardware:
+ *
+ *   PB4  start marker   jumper to PB1 (TIM3_CH4, capture "start")
+ *   PB5  end marker     jumper to PB0 (TIM3_CH3, capture "end")
+ *
+ * Three paths are measured, one at a time:
+ *
+ *   - exti: PB4 is switched to TIM3_CH1, which raises it on a compare
+ *     match at a pseudo-random time; the pin also drives EXTI4, and the
+ *     first statement of EXTI4_IRQHandler raises PB5. Hardware edge to
+ *     first ISR instruction, at IRQ_BENCH_EXTI_PRIO.
+ *   - can: the first statement of the CAN1 RX interrupts raises PB4,
+ *     CanRxTask raises PB5 when it next runs its loop. Any received frame
+ *     counts: the fleet telemetry in a loopback mode, or bus traffic.
+ *   - uart: the first statement of the USART2 and its RX DMA interrupts
+ *     raises PB4, CliTask raises PB5 when it wakes. The samples come from
+ *     console input, so type or stream characters during those phases.
+ *
+ * The markers are level, not toggle: a pin goes high once per sample, so
+ * a second event before the bench reads the captures cannot overwrite
+ * them. A marker is a compare of g_irqBenchArm and one BSRR store, and
+ * compiles to nothing with IRQ_BENCH_ENABLE = 0.
+ *
+ * TIM3 runs one-pulse from 0 for each sample: for exti at the full timer
+ * clock (11 ns at 90 MHz, window 728 us), for the task paths at
+ * IRQ_BENCH_TASK_HZ (100 ns, window 6.5 ms). A start without an end
+ * inside the window is counted as "over".
+ *
+ * "bench irq start [<ms>]" runs IRQ_BENCH_STEP_TABLE in IrqBenchTask:
+ * each step burns a share of every tick on the FPU and flash at low
+ * priority, optionally adds a logging storm, and gives each path a third
+ * of the step. "bench irq" shows per step and path the samples, "over",
+ * min / mean / max in ns, the measured CPU load and a log2 histogram;
+ * "bench irq stop" ends a run. Keep the build otherwise the same as the
+ * one being judged (VEHICLE_FLEET_SIZE, clock profile, RAM placement).
+ *
+ * While a run is going IrqBenchTask wakes every tick, so the kernel never
+ * enters tickless sleep and TIM3 and GPIOB keep their clocks.
+ */
+
+#ifndef IRQ_BENCH_H
+#define IRQ_BENCH_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Build the markers, IrqBenchTask and "bench irq" (make IRQ_BENCH=1). */
+#ifndef IRQ_BENCH_ENABLE
+#define IRQ_BENCH_ENABLE        0
+#endif
+
+/** Default length of one step (ms), "bench irq start <ms>" overrides it. */
+#ifndef IRQ_BENCH_STEP_MS
+#define IRQ_BENCH_STEP_MS       3000U
+#endif
+
+/** EXTI4 priority; the default is the highest that may use the RTOS API,
+ *  so the figure includes the kernel's critical sections. */
+#ifndef IRQ_BENCH_EXTI_PRIO
+#define IRQ_BENCH_EXTI_PRIO     5U
+#endif
+
+/** TIM3 count rate for the task paths (Hz). */
+#ifndef IRQ_BENCH_TASK_HZ
+#define IRQ_BENCH_TASK_HZ       10000000U
+#endif
+
+/** Log lines written per tick during a storm step. */
+#ifndef IRQ_BENCH_STORM_LINES
+#define IRQ_BENCH_STORM_LINES   4U
+#endif
+
+/**
+ * @brief Steps of a run. X(load, storm): share of every tick IrqBenchTask
+ *        burns (%), and whether it writes IRQ_BENCH_STORM_LINES per tick.
+ */
+#ifndef IRQ_BENCH_STEP_TABLE
+#define IRQ_BENCH_STEP_TABLE(X) \
+    X( 0U, 0U)                  \
+    X(50U, 0U)                  \
+    X(90U, 0U)                  \
+    X( 0U, 1U)                  \
+    X(50U, 1U)                  \
+    X(90U, 1U)
+#endif
+
+/** Bucket 0 counts latencies below 32 ns, bucket b in [16 << b, 32 << b) ns,
+ *  the last everything above. */
+#define IRQ_BENCH_BUCKETS       20U
+
+/** Marker and capture pins (fixed: they are the TIM3 channels). */
+#define IRQ_BENCH_GPIO          GPIOB
+#define IRQ_BENCH_START_PIN     GPIO_PIN_4      /* also TIM3_CH1, EXTI4 */
+#define IRQ_BENCH_END_PIN       GPIO_PIN_5
+#define IRQ_BENCH_CAP_END_PIN   GPIO_PIN_0      /* TIM3_CH3 */
+#define IRQ_BENCH_CAP_START_PIN GPIO_PIN_1      /* TIM3_CH4 */
+
+/* -------------------------------------------------------------------------- */
+/* Markers                                                                    */
+/* -------------------------------------------------------------------------- */
+
+/** What the next marker is waiting for (g_irqBenchArm). */
+typedef enum
+{
+    IRQ_BENCH_ARM_IDLE = 0,
+    IRQ_BENCH_ARM_EXTI_END,
+    IRQ_BENCH_ARM_CAN,
+    IRQ_BENCH_ARM_CAN_END,
+    IRQ_BENCH_ARM_UART,
+    IRQ_BENCH_ARM_UART_END
+} IrqBench_Arm_t;
+
+#if IRQ_BENCH_ENABLE
+
+/** Written by IrqBenchTask to arm a sample, advanced by the markers. */
+extern volatile uint8_t g_irqBenchArm;
+
+/** Start of path @p p (CAN, UART): first statement of its interrupt. */
+#define IRQ_BENCH_START(p)                                                  \
+    do {                                                                    \
+        if (g_irqBenchArm == (uint8_t)IRQ_BENCH_ARM_##p) {                  \
+            IRQ_BENCH_GPIO->BSRR = IRQ_BENCH_START_PIN;                     \
+            g_irqBenchArm = (uint8_t)IRQ_BENCH_ARM_##p##_END;               \
+        }                                                                   \
+    } while (0)
+
+/** End of path @p p (EXTI, CAN, UART): the ISR entry or the task waking. */
+#define IRQ_BENCH_END(p)                                                    \
+    do {                                                                    \
+        if (g_irqBenchArm == (uint8_t)IRQ_BENCH_ARM_##p##_END) {            \
+            IRQ_BENCH_GPIO->BSRR = IRQ_BENCH_END_PIN;                       \
+            g_irqBenchArm = (uint8_t)IRQ_BENCH_ARM_IDLE;                    \
+        }                                                                   \
+    } while (0)
+
+#else
+#define IRQ_BENCH_START(p)  do { } while (0)
+#define IRQ_BENCH_END(p)    do { } while (0)
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Set up the pins, TIM3 and EXTI4 and register "bench irq".
+ *        Call once before the scheduler starts.
+ *
+ * @return HAL_OK.
+ */
+HAL_StatusTypeDef IrqBench_Init(void);
+
+/**
+ * @brief Body of IrqBenchTask: waits for "bench irq start" and runs the
+ *        steps. Never returns.
+ */
+void IrqBench_Task(void);
+
+/**
+ * @brief EXTI4 interrupt, after IRQ_BENCH_END(EXTI).
+ */
+void IrqBench_ExtiIRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IRQ_BENCH_H */
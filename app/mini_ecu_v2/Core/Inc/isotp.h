@@ -0,0 +1,169 @@
+/**
+ * @file    isotp.h
+ * @brief   ISO 15765-2 (ISO-TP) transport on top of can_if.
+ *
+ * A channel is one normal-addressing connection: frames on @c rxId (and,
+ * for single frames, on an optional functional @c funcId) are reassembled
+ * into a mem_pool block and handed to the consumer registered for that ID
+ * with CAN_IF_RegisterPduHandler(), via CAN_IF_DeliverPdu(). Flow-control
+ * frames go out on @c txId with the channel's block size and STmin.
+ *
+ * Reception runs in CanRxTask as a CAN_IF_RegisterHandler() handler; the
+ * remote must route the IDs through CAN_FILTER_TABLE. PDUs are limited to
+ * MEM_POOL_MAX_BLOCK bytes (longer First Frames get FC overflow).
+ *
+ * Transmission takes a mem_pool block by pointer (IsoTp_SendBlock()), so a
+ * response built in place is never copied before the CAN frames: up to 7
+ * bytes leave at once as a Single Frame, longer PDUs as a First Frame and,
+ * paced by the receiver's flow control (block size, STmin), Consecutive
+ * Frames sent by IsoTp_Run() in CanTxTask. A channel sends one PDU at a
+ * time.
+ *
+ * N_Cr and N_Bs are timers of the channel on the timer wheel
+ * (timer_wheel.h), restarted by every frame that keeps a PDU alive. When
+ * one runs out it wakes the channel's task, which checks the deadline
+ * and drops the PDU; neither task polls or wakes for them otherwise.
+ */
+
+#ifndef ISOTP_H
+#define ISOTP_H
+
+#include "main.h"
+#include "cmsis_os2.h"
+#include "timer_wheel.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** N_Cr: a started PDU whose next frame is later than this is dropped (ms). */
+#ifndef ISOTP_TIMEOUT_MS
+#define ISOTP_TIMEOUT_MS   1000U
+#endif
+
+/** N_Bs: a First Frame or block without flow control for this long is
+ *  abandoned (ms). */
+#ifndef ISOTP_FC_TIMEOUT_MS
+#define ISOTP_FC_TIMEOUT_MS  1000U
+#endif
+
+/** Consecutive Frames queued per IsoTp_Run() and channel, so a long
+ *  response leaves room in the TX queue for the other traffic. */
+#ifndef ISOTP_TX_BURST
+#define ISOTP_TX_BURST     8U
+#endif
+
+/** Channels that can be opened. */
+#ifndef ISOTP_MAX_CHANNELS
+#define ISOTP_MAX_CHANNELS 2U
+#endif
+
+/** Thread flag set on the IsoTp_Run() task when flow control arrives or
+ *  N_Bs runs out. */
+#define ISOTP_TX_FLAG      0x0004U
+
+/** Thread flag set on the IsoTp_RxRun() task when N_Cr runs out. */
+#define ISOTP_RX_FLAG      0x0002U
+
+/** Padding of unused bytes; all frames are sent with DLC 8. */
+#define ISOTP_PAD          0xCCU
+
+/** @c funcId value for "no functional address". */
+#define ISOTP_NO_ID        0xFFFFFFFFU
+
+/**
+ * @brief One ISO-TP connection. Fill in the configuration, then IsoTp_Open().
+ */
+typedef struct
+{
+    /* Configuration */
+    uint32_t rxId;     /**< Physical ID we receive on (CAN_IF_ID_EXT for 29-bit). */
+    uint32_t txId;     /**< ID for our FC and response frames. */
+    uint32_t funcId;   /**< Functional ID (single frames), or ISOTP_NO_ID. */
+    uint8_t  bs;       /**< Block size we grant in FC (0 = no further FC). */
+    uint8_t  stmin;    /**< STmin we ask for in FC (ISO-TP encoding). */
+
+    /* Receiver state (owned by the channel) */
+    uint8_t *buf;
+    uint16_t len;
+    uint16_t pos;
+    uint8_t  sn;
+    uint8_t  block;
+    uint32_t tick;
+    TimerWheel_Timer_t rxTimer;   /**< N_Cr. */
+    uint32_t dropped;  /**< PDUs abandoned (timeout, sequence error, no block). */
+
+    /* Sender state (owned by the channel) */
+    uint8_t *txBuf;
+    uint16_t txLen;
+    uint16_t txPos;
+    uint8_t  txState;
+    uint8_t  txSn;
+    uint8_t  txBlock;  /**< CFs left before the next FC, 0 = no limit. */
+    uint8_t  txStmin;  /**< Ticks between CFs. */
+    uint32_t txTick;   /**< FC deadline, or when the next CF is due. */
+    TimerWheel_Timer_t txTimer;   /**< N_Bs. */
+    uint32_t txAborted;/**< PDUs abandoned (no FC, overflow, busy). */
+} IsoTp_Channel_t;
+
+/**
+ * @brief Register the channel's RX handlers with can_if.
+ *
+ * Call during initialization, after CAN_IF_Init(). The channel must stay
+ * valid for the lifetime of the program.
+ *
+ * @return HAL_OK, or HAL_ERROR if the handler tables are full.
+ */
+HAL_StatusTypeDef IsoTp_Open(IsoTp_Channel_t *ch);
+
+/**
+ * @brief Send a short PDU (up to 7 bytes) on @c txId as a Single Frame.
+ *
+ * @return HAL_OK, HAL_BUSY if the TX queue is full, HAL_ERROR if @p len
+ *         does not fit a single frame.
+ */
+HAL_StatusTypeDef IsoTp_Send(IsoTp_Channel_t *ch, const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Send the PDU in mem_pool @p block on @c txId (any length up to
+ *        4095 bytes). The block passes to the channel in every case and is
+ *        freed when the PDU is sent or abandoned.
+ *
+ * @return HAL_OK, HAL_BUSY if the channel is still sending or the TX queue
+ *         is full, HAL_ERROR for a bad argument.
+ */
+HAL_StatusTypeDef IsoTp_SendBlock(IsoTp_Channel_t *ch, uint8_t *block, uint16_t len);
+
+/**
+ * @brief Tell IsoTp_Run()'s task to wake (ISOTP_TX_FLAG) on flow control
+ *        and on N_Bs.
+ */
+void IsoTp_SetConsumer(osThreadId_t thread);
+
+/**
+ * @brief Tell IsoTp_RxRun()'s task to wake (ISOTP_RX_FLAG) on N_Cr.
+ */
+void IsoTp_SetRxConsumer(osThreadId_t thread);
+
+/**
+ * @brief Send the Consecutive Frames that are due on all channels and drop
+ *        PDUs whose flow control timed out. Call from CanTxTask.
+ *
+ * @return Ticks until the next Consecutive Frame is due, or osWaitForever
+ *         (N_Bs wakes the task by ISOTP_TX_FLAG).
+ */
+uint32_t IsoTp_Run(void);
+
+/**
+ * @brief Drop the PDUs being received whose next frame is overdue (N_Cr),
+ *        so their pool blocks return without another frame on the
+ *        channel. Call from CanRxTask when ISOTP_RX_FLAG is set.
+ */
+void IsoTp_RxRun(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ISOTP_H */
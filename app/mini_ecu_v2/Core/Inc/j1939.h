@@ -0,0 +1,274 @@
+/**
+ * @file    j1939.h
+ * @brief   SAE J1939 on CAN1: PGN dispatch, address claim, requests and
+ *          the BAM / RTS-CTS transport protocol.
+ *
+ * A 29-bit identifier carries priority, PGN and source address; for PDU1
+ * PGNs (PF < 240) the PDU-specific byte is the destination address, for
+ * PDU2 PGNs it is part of the PGN and the frame is a broadcast. Every
+ * 29-bit frame can_if has no other handler for comes here in CanRxTask
+ * and is decoded once into a J1939_Msg_t: the network-management and
+ * transport PGNs are handled in place, all others are looked up in a hash
+ * table of the PGNs registered with J1939_RegisterPgn(), one hash and
+ * usually one probe per frame, however many PGNs are registered.
+ *
+ * Address claim (J1939-81): J1939_Run() claims J1939_PREFERRED_ADDRESS
+ * with the NAME built from the J1939_NAME_* fields and the MCU unique ID
+ * as identity number, and uses it once J1939_CLAIM_WAIT_MS pass without
+ * contention. A claim for our address with a lower NAME takes it: being
+ * arbitrary-address capable, the ECU moves to the next address of its
+ * window not claimed by others, and sends Cannot Claim when none is left.
+ * Requests for Address Claimed are answered in every state.
+ *
+ * Requests (PGN 59904) go to the registered PGN's request callback, which
+ * answers with J1939_Send() or J1939_SendBlock(); a destination-specific
+ * request nobody answers gets a NACK.
+ *
+ * Transport (J1939-21): messages of 9 up to MEM_POOL_MAX_BLOCK bytes are
+ * reassembled from BAM broadcasts and from RTS/CTS connections to us,
+ * J1939_MAX_RX_SESSIONS at a time (one of each kind per sender), straight
+ * into a mem_pool block, then dispatched like a single frame. The
+ * receiver side grants J1939_CTS_PACKETS packets per CTS and confirms
+ * with End of Message Ack; T1 / T2 timeouts are checked on the next J1939
+ * frame and by J1939_RxRun() when no frame comes. J1939_SendBlock() sends one message at a time the same way: BAM
+ * to the global address, paced by J1939_BAM_GAP_MS, or RTS/CTS to one
+ * node, with the TP.DT frames queued by J1939_Run() in CanTxTask.
+ *
+ * The acceptance filters (CAN_FILTER_TABLE) let through PDU1 frames to
+ * the global address and to the address window J1939_ADDRESS_FIRST ..
+ * + J1939_ADDRESS_COUNT - 1; a PDU2 PGN a consumer registers needs its
+ * own EXT entry (mask 0x03FFFF00, any priority and sender), so broadcasts
+ * nobody reads never reach the CPU. Frames from our own address are
+ * ignored, apart from Address Claimed (contention), which also keeps the
+ * loopback echo out.
+ *
+ * "j1939" shows the address, the counters and the registered PGNs;
+ * "j1939 request" sends a request.
+ */
+
+#ifndef J1939_H
+#define J1939_H
+
+#include "main.h"
+#include "cmsis_os2.h"
+#include "can_filters.h"
+#include "mem_pool.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = J1939 stack built in. */
+#ifndef J1939_ENABLE
+#define J1939_ENABLE            1
+#endif
+
+/** Source addresses this ECU may claim; must match the PDU1 window of
+ *  CAN_FILTER_TABLE (self-configurable range 128..247). */
+#ifndef J1939_ADDRESS_FIRST
+#define J1939_ADDRESS_FIRST     0x80U
+#endif
+
+#ifndef J1939_ADDRESS_COUNT
+#define J1939_ADDRESS_COUNT     8U
+#endif
+
+/** Address claimed first. */
+#ifndef J1939_PREFERRED_ADDRESS
+#define J1939_PREFERRED_ADDRESS (J1939_ADDRESS_FIRST + CAN_NODE_ID)
+#endif
+
+_Static_assert((J1939_PREFERRED_ADDRESS >= J1939_ADDRESS_FIRST) &&
+               (J1939_PREFERRED_ADDRESS < J1939_ADDRESS_FIRST + J1939_ADDRESS_COUNT) &&
+               (J1939_ADDRESS_FIRST + J1939_ADDRESS_COUNT <= 0xFEU),
+               "J1939_PREFERRED_ADDRESS outside the address window");
+
+/** NAME fields (J1939-81) besides the identity number, which is taken
+ *  from the MCU unique ID. 0 / 255 = not assigned. */
+#ifndef J1939_NAME_MANUFACTURER
+#define J1939_NAME_MANUFACTURER 0U      /* 11 bits */
+#endif
+
+#ifndef J1939_NAME_FUNCTION
+#define J1939_NAME_FUNCTION     255U    /* 8 bits */
+#endif
+
+#ifndef J1939_NAME_INDUSTRY
+#define J1939_NAME_INDUSTRY     0U      /* 3 bits, 0 = global */
+#endif
+
+/** Registered PGNs, and the slots of their hash table (power of two, at
+ *  least twice as many, so a lookup rarely probes more than once). */
+#ifndef J1939_MAX_PGNS
+#define J1939_MAX_PGNS          16U
+#endif
+
+#define J1939_PGN_SLOTS         32U
+
+_Static_assert(((J1939_PGN_SLOTS & (J1939_PGN_SLOTS - 1U)) == 0U) &&
+               (J1939_PGN_SLOTS >= 2U * J1939_MAX_PGNS),
+               "J1939_PGN_SLOTS must be a power of two >= 2 * J1939_MAX_PGNS");
+
+/** Transport messages received at the same time (BAM and RTS/CTS). */
+#ifndef J1939_MAX_RX_SESSIONS
+#define J1939_MAX_RX_SESSIONS   4U
+#endif
+
+/** Packets granted per CTS when receiving. */
+#ifndef J1939_CTS_PACKETS
+#define J1939_CTS_PACKETS       16U
+#endif
+
+/** Gap between the TP.DT frames of a BAM we send (50..200 ms). */
+#ifndef J1939_BAM_GAP_MS
+#define J1939_BAM_GAP_MS        50U
+#endif
+
+/** TP.DT frames queued per J1939_Run() of an RTS/CTS connection. */
+#ifndef J1939_TX_BURST
+#define J1939_TX_BURST          8U
+#endif
+
+/** Wait after our Address Claimed before the address is used (ms). */
+#define J1939_CLAIM_WAIT_MS     250U
+
+/** Thread flag set on the J1939_Run() task when there is work. */
+#define J1939_TX_FLAG           0x0008U
+
+/** Addresses with a fixed meaning. */
+#define J1939_ADDR_NULL         0xFEU   /* no address claimed */
+#define J1939_ADDR_GLOBAL       0xFFU
+
+/** Default priorities: control 3, everything else 6 (J1939-21). */
+#define J1939_PRIO_CONTROL      3U
+#define J1939_PRIO_DEFAULT      6U
+
+/** Longest message for J1939_SendBlock(). */
+#define J1939_TP_MAX            MEM_POOL_MAX_BLOCK
+
+/** PGNs of the stack (J1939-21, -81) and answered by it. */
+#define J1939_PGN_ACK           0x0E800U
+#define J1939_PGN_REQUEST       0x0EA00U
+#define J1939_PGN_TP_DT         0x0EB00U
+#define J1939_PGN_TP_CM         0x0EC00U
+#define J1939_PGN_ADDRESS_CLAIM 0x0EE00U
+#define J1939_PGN_SOFT_ID       0x0FEDAU
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief A received J1939 message (single frame or reassembled).
+ */
+typedef struct
+{
+    uint32_t       pgn;   /**< Parameter group number (PS = 0 for PDU1). */
+    uint8_t        sa;    /**< Source address. */
+    uint8_t        da;    /**< Destination, J1939_ADDR_GLOBAL for broadcasts. */
+    uint8_t        prio;  /**< Priority 0..7 (7 for transport messages). */
+    uint16_t       len;   /**< Payload bytes. */
+    const uint8_t *data;  /**< Payload, valid only for the duration of the call. */
+} J1939_Msg_t;
+
+/**
+ * @brief Consumer of a PGN, called in CanRxTask.
+ */
+typedef void (*J1939_RxFn_t)(const J1939_Msg_t *msg, void *ctx);
+
+/**
+ * @brief Answer a request for a PGN, called in CanRxTask.
+ *
+ * @param[in] pgn Requested PGN.
+ * @param[in] da  Where the answer goes (requester, or J1939_ADDR_GLOBAL).
+ * @param[in] ctx Opaque pointer given at registration.
+ * @return HAL_OK if answered, HAL_BUSY if it cannot be now, HAL_ERROR if
+ *         the PGN has no data to give.
+ */
+typedef HAL_StatusTypeDef (*J1939_RequestFn_t)(uint32_t pgn, uint8_t da, void *ctx);
+
+/**
+ * @brief Register the CAN handler, the stack's own PGNs and "j1939".
+ *
+ * Call during initialization, after CAN_IF_Init() and after any other
+ * 29-bit handler (those are looked up first).
+ *
+ * @return HAL_OK, or HAL_ERROR if the can_if tables are full.
+ */
+HAL_StatusTypeDef J1939_Init(void);
+
+/**
+ * @brief Register the consumer and / or request callback of a PGN.
+ *
+ * A later registration for the same PGN replaces the earlier one. Call
+ * during initialization.
+ *
+ * @return HAL_OK, or HAL_ERROR if both callbacks are NULL or
+ *         J1939_MAX_PGNS are registered.
+ */
+HAL_StatusTypeDef J1939_RegisterPgn(uint32_t pgn, J1939_RxFn_t onRx,
+                                    J1939_RequestFn_t onRequest, void *ctx);
+
+/**
+ * @brief Send up to 8 bytes as one frame from our address.
+ *
+ * @param[in] da Destination for PDU1 PGNs (ignored for PDU2).
+ * @return HAL_OK, HAL_BUSY if the TX queue is full, HAL_ERROR without a
+ *         claimed address or for a bad argument.
+ */
+HAL_StatusTypeDef J1939_Send(uint32_t pgn, uint8_t da, uint8_t prio,
+                             const uint8_t *data, uint8_t len);
+
+/**
+ * @brief Send the message in mem_pool @p block: up to 8 bytes at once,
+ *        longer ones by BAM (@p da global) or RTS/CTS. The block passes
+ *        to the stack in every case and is freed when sent or abandoned.
+ *
+ * @p prio applies to a single frame; transport frames go at priority 7.
+ *
+ * @return HAL_OK, HAL_BUSY if a transport message is still being sent or
+ *         the TX queue is full, HAL_ERROR without a claimed address or for
+ *         a bad argument.
+ */
+HAL_StatusTypeDef J1939_SendBlock(uint32_t pgn, uint8_t da, uint8_t prio,
+                                  uint8_t *block, uint16_t len);
+
+/**
+ * @brief Our claimed address, J1939_ADDR_NULL while claiming or after
+ *        losing all addresses.
+ */
+uint8_t J1939_GetAddress(void);
+
+/**
+ * @brief Tell J1939_Run()'s task to wake (J1939_TX_FLAG) when a claim or
+ *        transport message needs it.
+ */
+void J1939_SetConsumer(osThreadId_t thread);
+
+/**
+ * @brief Run the address claim and the transport message being sent.
+ *        Call from CanTxTask.
+ *
+ * @return Ticks until the next call is needed, or osWaitForever.
+ */
+uint32_t J1939_Run(void);
+
+/**
+ * @brief End the transport sessions being received whose sender went
+ *        quiet (T1 / T2, with a TP.Conn_Abort for RTS/CTS), so their pool
+ *        blocks return without another J1939 frame. Call from CanRxTask.
+ *
+ * @return Ticks until the next session can expire, or osWaitForever.
+ */
+uint32_t J1939_RxRun(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* J1939_H */
@@ -0,0 +1,139 @@
+/**
+ * @file    load_coll.h
+ * @brief   Load collectives: time spent in engine speed x vehicle speed
+ *          and coolant temperature bins, kept across resets.
+ *
+ * VehicleTask calls LoadColl_Update() once per model step. The step adds
+ * one to the cell of the rpm x speed matrix and to the coolant bin the
+ * state falls in, so a cell holds model steps (CTRL_LOOP_HZ per second)
+ * and the whole collective costs the same O(1) update however long the
+ * vehicle has run:
+ *
+ *   - rpm:     rpm >> LOAD_COLL_RPM_SHIFT, a shift
+ *   - speed:   km/h x the reciprocal of LOAD_COLL_SPEED_BIN_KPH
+ *   - coolant: (C - LOAD_COLL_TEMP_MIN_C) x the reciprocal of
+ *              LOAD_COLL_TEMP_BIN_C
+ *
+ * The reciprocals are compile-time constants, so an update has no
+ * division. The first and last bin of each axis are open (below the
+ * lowest and above the highest edge). Cells are uint32 and saturate:
+ * at 10 Hz one cell takes 13 years to fill.
+ *
+ * The cells persist in the flash log (nvm_log.h) as records of two cells
+ * each, in batches as the trip counters do (trip.h): every
+ * LOAD_COLL_SAVE_MIN minutes of uptime, on "load save" and before a reset
+ * into the bootloader (boot_request.c); only records whose cells changed
+ * since the last batch are written, so a steady drive costs a few records
+ * a batch. A reset loses at most the time since the last one.
+ *
+ * UDS reads them as DIDs (uds.h): UDS_DID_LOAD_BASE + rpm bin is one row
+ * of the matrix, UDS_DID_LOAD_TEMP the coolant bins, u32 steps each.
+ *
+ *   load                 matrix and coolant bins (seconds)
+ *   load save            write the changed cells now
+ *   load reset           clear the collectives
+ */
+
+#ifndef LOAD_COLL_H
+#define LOAD_COLL_H
+
+#include "main.h"
+#include "vehicle.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Engine speed bins of 2^LOAD_COLL_RPM_SHIFT rpm (1024: 0 .. 7168+). */
+#ifndef LOAD_COLL_RPM_BINS
+#define LOAD_COLL_RPM_BINS      8U
+#endif
+#ifndef LOAD_COLL_RPM_SHIFT
+#define LOAD_COLL_RPM_SHIFT     10U
+#endif
+
+/** Vehicle speed bins of LOAD_COLL_SPEED_BIN_KPH (0 .. 175+ km/h). */
+#ifndef LOAD_COLL_SPEED_BINS
+#define LOAD_COLL_SPEED_BINS    8U
+#endif
+#ifndef LOAD_COLL_SPEED_BIN_KPH
+#define LOAD_COLL_SPEED_BIN_KPH 25.0f
+#endif
+
+/** Coolant bins of LOAD_COLL_TEMP_BIN_C from LOAD_COLL_TEMP_MIN_C
+ *  (below 0 .. 120+ C). */
+#ifndef LOAD_COLL_TEMP_BINS
+#define LOAD_COLL_TEMP_BINS     8U
+#endif
+#ifndef LOAD_COLL_TEMP_MIN_C
+#define LOAD_COLL_TEMP_MIN_C    (-20.0f)
+#endif
+#ifndef LOAD_COLL_TEMP_BIN_C
+#define LOAD_COLL_TEMP_BIN_C    20.0f
+#endif
+
+/** Uptime between two batches while the cells change (minutes). */
+#ifndef LOAD_COLL_SAVE_MIN
+#define LOAD_COLL_SAVE_MIN      10U
+#endif
+
+#define LOAD_COLL_CELLS \
+    ((LOAD_COLL_RPM_BINS * LOAD_COLL_SPEED_BINS) + LOAD_COLL_TEMP_BINS)
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Consistent copy of the collectives, in model steps.
+ */
+typedef struct
+{
+    uint32_t rpmSpeed[LOAD_COLL_RPM_BINS][LOAD_COLL_SPEED_BINS];
+    uint32_t temp[LOAD_COLL_TEMP_BINS];
+} LoadColl_t;
+
+/**
+ * @brief Join the flash log and register "load". Call once before
+ *        NvmLog_Init(), which restores the cells.
+ */
+void LoadColl_Init(void);
+
+/**
+ * @brief Count one model step of the state @p vs (VehicleTask); queues a
+ *        batch when one is due.
+ */
+void LoadColl_Update(const VehicleState_t *vs);
+
+/**
+ * @brief Queue the changed cells for writing now (any task); NvmTask
+ *        writes them in the background.
+ *
+ * @return Records queued.
+ */
+uint32_t LoadColl_Save(void);
+
+/** Clear the collectives and save. */
+void LoadColl_Reset(void);
+
+void LoadColl_Get(LoadColl_t *out);
+
+/**
+ * @brief One matrix row (@p rpmBin < LOAD_COLL_RPM_BINS) or, for
+ *        @p rpmBin == LOAD_COLL_RPM_BINS, the coolant bins.
+ *
+ * @param[out] out    Room for LOAD_COLL_SPEED_BINS or LOAD_COLL_TEMP_BINS.
+ * @return Cells copied, 0 for a bin past the coolant row.
+ */
+uint32_t LoadColl_GetRow(uint32_t rpmBin, uint32_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOAD_COLL_H */
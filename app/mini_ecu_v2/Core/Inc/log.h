@@ -2,21 +2,241 @@
  * @file    log.h
  * @brief   Lightweight logging framework for Mini ECU.
  *
- * Logs messages over a UART (typically USART2) with levels and module tags.
+ * Logs messages over a UART (typically USART2), or SWO, with levels and
+ * module tags.
  * Format:
- *   [I][CLI] CLI initialized
+ *   [12.345678][I][CLI] CLI initialized
+ *
+ * Every record is stamped on entry to Log_Write(), Log_WriteText() and
+ * Log_WriteTok(), before the budget and any formatting, with the local
+ * time (TimeSync_LocalUs(), time_sync.h): microseconds since boot, 64
+ * bits, monotonic and unaffected by clock changes or the global time's
+ * steps. It costs one PRIMASK-guarded read of the TIM4/TIM12 counter and
+ * its wrap check. Text lines render it as seconds (LOG_TEXT_STAMP; before
+ * TimeSync_Init() in whole milliseconds), tokenized frames carry it raw.
+ *
+ * Modules are declared once in LOG_MODULE_TABLE and passed to the macros as
+ * bare identifiers: LOG_INFO(CLI, "CLI initialized"). Each module has its
+ * own runtime level; the LOG_* macros compare against it inline, so a
+ * filtered call costs one byte load and compare, and its arguments are
+ * never evaluated. LOG_COMPILE_LEVEL removes calls above a floor from the
+ * image altogether.
+ *
+ * Output is deferred: Log_Write() only formats the line and queues it in a
+ * lock-free ring, and Log_Task() streams the ring to a transport. Logging
+ * is therefore cheap from any task or ISR (priority at or below
+ * configMAX_SYSCALL_INTERRUPT_PRIORITY). Lines are dropped, and counted,
+ * when the ring is full. Before the scheduler starts, output is blocking.
+ *
+ * Log storms are cut before anything is formatted, in two stages:
+ *   - per call site: each LOG_* call site has a token bucket (a static
+ *     Log_Site_t the macro declares) of LOG_SITE_BURST lines, one more
+ *     coming back every LOG_SITE_PERIOD_MS. Calls beyond that are counted,
+ *     and the site's next line is preceded by "<n> suppressed like:";
+ *   - globally: log lines share a budget of LOG_BUDGET_BPS bytes/s (up to
+ *     LOG_BUDGET_BURST saved up). As it runs low DEBUG lines are shed
+ *     first (below half the burst), then INFO (below a quarter), then
+ *     WARN (when it is spent); ERROR lines always pass.
+ * Both apply once LogTask runs: the blocking output before it cannot be
+ * flooded, and the boot messages all go out. A shed or suppressed call
+ * costs a compare and a few instructions under PRIMASK. "log limit off"
+ * lets everything through, "log stats" counts what was held back.
+ *
+ * The log backend owns the UART TX path; other modules that print to the
+ * same UART go through Log_WriteRaw() (CLI) or Log_WriteStream() (binary
+ * telemetry) so output never interleaves. Bulk output that already sits in
+ * a buffer is submitted by reference instead (Log_Submit()): the ring
+ * takes a small request record, in order with the stream's other records,
+ * and LogTask sends the bytes from the caller's buffer in chunk-sized
+ * pieces, then sets the thread flags the caller asked for. Log_Send()
+ * submits and waits, for dumps that reuse one buffer.
+ *
+ * Each stream has its own ring, and LogTask sends one stream per chunk
+ * (at most LOG_TX_CHUNK_SIZE bytes), taking the CLI first, then the log
+ * lines, then telemetry: a log burst or a telemetry stream delays a CLI
+ * reply by one chunk at most, and a full ring drops only its own stream.
+ *
+ * Transports (LOG_TRANSPORT_TABLE) are chosen per stream: log lines, CLI
+ * output and telemetry each go to one of
+ *   - "uart":     blocking HAL_UART_Transmit() from LogTask,
+ *   - "uart-dma": one DMA transfer per chunk (default for both),
+ *   - "itm":      ITM stimulus port LOG_ITM_PORT, out on SWO (PB3) at
+ *                 LOG_ITM_SWO_HZ for the ST-LINK's SWV console; words of
+ *                 4 bytes, a few cycles each while the ITM FIFO has room,
+ *   - "ram":      a LOG_RAM_SIZE capture buffer only, read back with
+ *                 "log ram" or the debugger,
+ *   - "rtt":      the RTT up buffer (rtt.h), read by a debug probe over
+ *                 SWD at memory speed; never blocks, drops when full,
+ *   - "usb":      the USB CDC-ACM port (usb_cdc.h, USB_CDC_ENABLE), one
+ *                 bulk transfer per chunk straight from the staging buffer;
+ *                 dropped while the host has the port closed,
+ *   - "xlog":     the QSPI flash recorder (ext_log.h, EXT_LOG_ENABLE), as
+ *                 stream records next to the CAN frames; dropped while it
+ *                 is not recording,
+ *   - "can":      frames on CAN_LOG_ID (can_log.h, CAN_LOG_ENABLE), sent
+ *                 by the TX scheduler within a bus-load cap; never blocks,
+ *                 drops when its ring is full.
+ * With log lines on "itm" the UART carries the CLI alone.
+ *
+ * Post-mortem ring: every log line (tokenized frames too) is also copied
+ * into a LOG_PM_SIZE ring that no startup code clears, so it holds the
+ * lines before a watchdog or fault reset. The copy is one exclusive claim
+ * and a memcpy, cheaper than any transport, and happens before the line
+ * is queued: lines the stream ring drops or a slow transport never sends
+ * are kept as well. Lines held back by the rate limits are not. Log_Init()
+ * keeps a valid ring and marks the reset in it with "--- reset ---".
+ * "log dump [n]" prints it, and the crash record (crash_dump.h) takes its
+ * tail. Records keep
+ * their order within a stream; "log transport" shows and sets them.
+ *
+ * Channel mux ("log mux on", tools/uart_mux.py): every chunk for "uart" or
+ * "uart-dma" is sent as one frame
+ *
+ *   0x00 | COBS(stream (u8) | data) | 0x00
+ *
+ * with the stream as Log_Stream_t (0 lines, 1 cli, 2 tlm), so a host can
+ * split the channels again. Off by default, where a plain terminal shows
+ * the text streams as they are.
+ *
+ * Tokenized mode (LOG_TOKENIZED = 1):
+ *   The LOG_* macros no longer format on the target. The level, module tag
+ *   and format string are placed in the non-loaded ".log_fmt" ELF section;
+ *   at runtime only a small binary frame is queued:
+ *
+ *     0xFE | len | token (u32) | local time us (u64, time_sync.h) | args...
+ *
+ *   The token is the string's offset in ".log_fmt". Integer, pointer and
+ *   float arguments are sent as 32-bit little-endian words (doubles are
+ *   narrowed to float, 64-bit integers are truncated); strings are sent
+ *   inline as a length byte followed by at most LOG_TOK_STR_MAX bytes.
+ *   tools/log_decode.py rebuilds the "[12.345678][I][CAN] ..." text from
+ *   the ELF, which marks this frame layout with a "V\x1fLOG\x1fstamp-us64"
+ *   record in ".log_fmt".
+ *   Format strings must be string literals in this mode.
+ *   CLI output is still plain text and passes through the decoder as is.
  */
 
 #ifndef LOG_H
 #define LOG_H
 
 #include "main.h"
+#include "can_log.h"
+#include "ext_log.h"
+#include "usb_cdc.h"
+#include "cmsis_os2.h"
+#include "coop.h"
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/** Size of the log lines ring in bytes (power of two). */
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE       2048U
+#endif
+
+/** Rings of the CLI output and of the telemetry stream (power of two). */
+#ifndef LOG_CLI_RING_SIZE
+#define LOG_CLI_RING_SIZE   1024U
+#endif
+#ifndef LOG_TLM_RING_SIZE
+#define LOG_TLM_RING_SIZE   1024U
+#endif
+
+/** Maximum length of one formatted log line, including "\r\n". */
+#ifndef LOG_LINE_MAX
+#define LOG_LINE_MAX        160U
+#endif
+
+/** Size of the DMA staging buffer (bytes sent per UART transfer). */
+#ifndef LOG_TX_CHUNK_SIZE
+#define LOG_TX_CHUNK_SIZE   384U
+#endif
+
+/** Lines per call site at once, and the time for one more (ms); 0 = no
+ *  per-site limit (and no Log_Site_t per call site). */
+#ifndef LOG_SITE_BURST
+#define LOG_SITE_BURST      5U
+#endif
+#ifndef LOG_SITE_PERIOD_MS
+#define LOG_SITE_PERIOD_MS  1000U
+#endif
+
+/** Log lines budget (bytes/s) and how much of it can be saved up (bytes);
+ *  0 = no budget. */
+#ifndef LOG_BUDGET_BPS
+#define LOG_BUDGET_BPS      2048U
+#endif
+#ifndef LOG_BUDGET_BURST
+#define LOG_BUDGET_BURST    LOG_RING_SIZE
+#endif
+
+/** 1 = tokenized binary log frames, 0 = formatted text lines. */
+#ifndef LOG_TOKENIZED
+#define LOG_TOKENIZED       0
+#endif
+
+/** 1 = text lines start with their stamp, "[<s>.<us>]"; 0 = without. */
+#ifndef LOG_TEXT_STAMP
+#define LOG_TEXT_STAMP      1
+#endif
+
+/** Longest string argument copied into a tokenized frame. */
+#ifndef LOG_TOK_STR_MAX
+#define LOG_TOK_STR_MAX     24U
+#endif
+
+/** Transport of each stream at start (Log_Init()). */
+#ifndef LOG_LINES_TRANSPORT
+#define LOG_LINES_TRANSPORT LOG_TRANSPORT_UART_DMA
+#endif
+#ifndef LOG_CLI_TRANSPORT
+#define LOG_CLI_TRANSPORT   LOG_TRANSPORT_UART_DMA
+#endif
+#ifndef LOG_TLM_TRANSPORT
+#define LOG_TLM_TRANSPORT   LOG_TRANSPORT_UART_DMA
+#endif
+
+/** 1 = channel mux framing on the UART from start ("log mux"). */
+#ifndef LOG_MUX_DEFAULT
+#define LOG_MUX_DEFAULT     0U
+#endif
+
+/** ITM stimulus port and SWO bit rate of the "itm" transport. */
+#ifndef LOG_ITM_PORT
+#define LOG_ITM_PORT        0U
+#endif
+#ifndef LOG_ITM_SWO_HZ
+#define LOG_ITM_SWO_HZ      2000000U
+#endif
+
+/** Capture buffer of the "ram" transport (bytes, power of two). */
+#ifndef LOG_RAM_SIZE
+#define LOG_RAM_SIZE        2048U
+#endif
+
+/**
+ * Post-mortem ring in NOINIT SRAM2 (bytes, power of two; 0 leaves it out).
+ * Every log line or tokenized frame is copied in, whatever the transport.
+ */
+#ifndef LOG_PM_SIZE
+#define LOG_PM_SIZE         4096U
+#endif
+
+/** First byte of a tokenized frame (never appears in CLI text). */
+#define LOG_TOK_SYNC        0xFEU
+
+/** Thread flags of the thread running Log_Task() / Log_Service(): new
+ *  data in the ring, transfer complete. */
+#define LOG_FLAG_DATA       0x0001U
+#define LOG_FLAG_TX_DONE    0x0002U
+
+/** Thread flag Log_Send() waits on in the calling thread; keep it free in
+ *  threads that call Log_Send(). */
+#define LOG_FLAG_SENT       0x0100U
+
 typedef enum
 {
     LOG_LEVEL_ERROR = 0,
@@ -25,6 +245,89 @@ typedef enum
     LOG_LEVEL_DEBUG
 } log_level_t;
 
+/**
+ * @brief Highest level compiled into the image (0 = ERROR .. 3 = DEBUG).
+ *
+ * Calls above it expand to nothing. Defaults to DEBUG, or INFO when NDEBUG
+ * is defined (release builds).
+ */
+#ifndef LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILE_LEVEL   2
+#else
+#define LOG_COMPILE_LEVEL   3
+#endif
+#endif
+
+/**
+ * @brief Log modules. X(name): the tag printed is the name itself.
+ */
+#define LOG_MODULE_TABLE(X) \
+    X(MAIN)                 \
+    X(CAN)                  \
+    X(CANRX)                \
+    X(CLI)                  \
+    X(VEH)
+
+#define LOG_MOD_ENUM_(name)  LOG_MOD_##name,
+
+typedef enum
+{
+    LOG_MODULE_TABLE(LOG_MOD_ENUM_)
+    LOG_MOD_COUNT
+} log_module_t;
+
+#if USB_CDC_ENABLE
+#define LOG_TRANSPORT_USB_(X)   X(USB, "usb")
+#else
+#define LOG_TRANSPORT_USB_(X)
+#endif
+
+#if EXT_LOG_ENABLE
+#define LOG_TRANSPORT_XLOG_(X)  X(XLOG, "xlog")
+#else
+#define LOG_TRANSPORT_XLOG_(X)
+#endif
+
+#if CAN_LOG_ENABLE
+#define LOG_TRANSPORT_CAN_(X)   X(CAN, "can")
+#else
+#define LOG_TRANSPORT_CAN_(X)
+#endif
+
+/**
+ * @brief Output transports. X(name, text): LOG_TRANSPORT_<name>.
+ */
+#define LOG_TRANSPORT_TABLE(X)  \
+    X(UART,     "uart")         \
+    X(UART_DMA, "uart-dma")     \
+    X(ITM,      "itm")          \
+    X(RAM,      "ram")          \
+    X(RTT,      "rtt")          \
+    LOG_TRANSPORT_USB_(X)       \
+    LOG_TRANSPORT_XLOG_(X)      \
+    LOG_TRANSPORT_CAN_(X)
+
+#define LOG_TRANSPORT_ENUM_(name, text)  LOG_TRANSPORT_##name,
+
+typedef enum
+{
+    LOG_TRANSPORT_TABLE(LOG_TRANSPORT_ENUM_)
+    LOG_TRANSPORT_COUNT
+} Log_TransportId_t;
+
+/** What a transport carries; also the channel byte of a mux frame. */
+typedef enum
+{
+    LOG_STREAM_LINES = 0,   /**< Log_Write(), Log_WriteText(), tokenized frames. */
+    LOG_STREAM_CLI,         /**< Log_WriteRaw(): prompts, replies, dashboard. */
+    LOG_STREAM_TLM,         /**< Binary telemetry frames (tlm_stream.h). */
+    LOG_STREAM_COUNT
+} Log_Stream_t;
+
+/** Runtime level per module (indexed by log_module_t). */
+extern uint8_t g_logLevels[LOG_MOD_COUNT];
+
 /**
  * @brief Initialize the logging system with a UART handle.
  *
@@ -33,19 +336,42 @@ typedef enum
 void Log_Init(UART_HandleTypeDef *huart);
 
 /**
- * @brief Set the global log level. Messages below this level are dropped.
+ * @brief Set the level of every module. Messages above it are dropped.
  */
 void Log_SetLevel(log_level_t level);
 
 /**
- * @brief Get the current global log level.
+ * @brief Get the level last set with Log_SetLevel().
  */
 log_level_t Log_GetLevel(void);
 
+/**
+ * @brief Set the level of a single module.
+ */
+void Log_SetModuleLevel(log_module_t mod, log_level_t level);
+
+/**
+ * @brief Get the level of a single module.
+ */
+log_level_t Log_GetModuleLevel(log_module_t mod);
+
+/**
+ * @brief Look up a module by its tag (case-sensitive, e.g. "CANRX").
+ *
+ * @return Module index, or -1 if unknown.
+ */
+int32_t Log_FindModule(const char *name);
+
+/**
+ * @brief Tag of a module, or NULL if @p mod is out of range.
+ */
+const char *Log_ModuleName(log_module_t mod);
+
 /**
  * @brief Core logging function (printf-style).
  *
  * Most code should use LOG_ERROR/LOG_WARN/LOG_INFO/LOG_DEBUG macros.
+ * Level filtering is done by the macros; this function always emits.
  *
  * @param[in] level  Severity.
  * @param[in] module Short module tag (e.g., "CLI", "CAN").
@@ -54,18 +380,467 @@ log_level_t Log_GetLevel(void);
  */
 void Log_Write(log_level_t level, const char *module, const char *fmt, ...);
 
-/* Convenience macros */
+/**
+ * @brief Queue an already formatted line: "[<stamp>][L][MOD] " + @p text
+ *        + "\r\n".
+ *
+ * For hot paths that build their text with fmt.h instead of a format
+ * string. Level filtering is the caller's (LOG_ENABLED()); the text is
+ * sent as plain text in tokenized mode too. Cut at LOG_LINE_MAX.
+ *
+ * @param[in] level  Severity.
+ * @param[in] module Short module tag (e.g., "CAN").
+ * @param[in] text   Line body, no line ending.
+ * @param[in] len    Length of @p text.
+ */
+void Log_WriteText(log_level_t level, const char *module, const char *text, size_t len);
+
+/**
+ * @brief Queue raw bytes for output (no prefix, no line ending).
+ *
+ * Used by the CLI for prompts, echo and the dashboard so that all UART
+ * output is serialized through the log backend.
+ *
+ * @param[in] data Bytes to send.
+ * @param[in] len  Number of bytes.
+ * @return HAL_OK, HAL_BUSY if (part of) the data was dropped because the
+ *         ring was full, or HAL_ERROR if logging is not initialized.
+ */
+HAL_StatusTypeDef Log_WriteRaw(const char *data, size_t len);
+
+/**
+ * @brief Queue raw bytes on @p stream; Log_WriteRaw() is the CLI stream.
+ *
+ * @return As Log_WriteRaw(); HAL_ERROR also for an unknown stream.
+ */
+HAL_StatusTypeDef Log_WriteStream(Log_Stream_t stream, const char *data, size_t len);
+
+/**
+ * @brief Queue @p len bytes at @p data on @p stream by reference: no copy.
+ *
+ * Non-blocking, any task. The bytes go out after what the stream already
+ * holds, LOG_TX_CHUNK_SIZE at a time (other streams still come first by
+ * priority between pieces), straight from @p data for DMA and USB. The
+ * buffer (any RAM or flash) must stay as it is until @p notify is woken.
+ *
+ * @param[in] notify Thread to get @p flags once the last byte has been
+ *                   handed over and the transfer is complete, or NULL.
+ * @return HAL_OK, HAL_BUSY if the ring had no room for the request (not
+ *         queued, no notification), or HAL_ERROR for bad arguments or
+ *         before Log_Init().
+ */
+HAL_StatusTypeDef Log_Submit(Log_Stream_t stream, const void *data, uint32_t len,
+                             osThreadId_t notify, uint32_t flags);
+
+/**
+ * @brief Log_Submit() and wait for LOG_FLAG_SENT: @p data is free again on
+ *        return. Not from the log thread.
+ *
+ * Retries every 1 ms while the ring has no room, for up to @p timeoutMs.
+ * Once queued it waits for the transfer, which always ends (DMA has no
+ * flow control; the USB transport aborts a stalled one). Before the
+ * scheduler runs the bytes are sent synchronously.
+ *
+ * @return HAL_OK, HAL_TIMEOUT if the request was never queued, or
+ *         HAL_ERROR as Log_Submit().
+ */
+HAL_StatusTypeDef Log_Send(Log_Stream_t stream, const void *data, uint32_t len,
+                           uint32_t timeoutMs);
+
+/**
+ * @brief Log output pump; to be called in a loop from a dedicated RTOS task.
+ *
+ * Moves queued records of one transport into the staging buffer and hands
+ * them over; for "uart-dma" it blocks until the transfer completes. Sleeps
+ * while the ring is empty.
+ */
+void Log_Task(void);
+
+/**
+ * @brief Log_Task() without the sleep: hand over one chunk if there is one.
+ *
+ * For a thread that serves the log with other work: when it returns 0 the
+ * caller waits for LOG_FLAG_DATA (with its own flags) before calling
+ * again. The first call makes the calling thread the log thread.
+ *
+ * @return Bytes handed over; 0 if the ring is empty.
+ */
+uint32_t Log_Service(void);
+
+/**
+ * @brief Log_Service() as a coroutine of BgTask (coop.h): one chunk a
+ *        turn while there are any, then a wait for LOG_FLAG_DATA.
+ */
+void Log_Coop(Coop_t *c);
+
+/**
+ * @brief 1 when every ring is empty, every submitted buffer is sent and
+ *        LogTask holds no chunk: the last byte has been handed to the
+ *        transport (the UART may still be
+ *        shifting it out, see UART_FLAG_TC).
+ *
+ * A task above LogTask's priority that sees 1 knows no transfer starts
+ * before it blocks; uart_baud.c reprograms the UART in that gap.
+ */
+uint8_t Log_TxIdle(void);
+
+/**
+ * @brief 1 while LogTask holds a chunk: a transfer of it may be running.
+ *
+ * Unlike Log_TxIdle() the rings may hold more. A task that sees 0 with the
+ * scheduler suspended knows no transfer starts until it resumes it;
+ * clock_gov.c switches the clocks in that gap.
+ */
+uint8_t Log_TxBusy(void);
+
+/**
+ * @brief After a core clock change: re-derive the SWO prescaler if a
+ *        stream uses the "itm" transport. No effect otherwise.
+ */
+void Log_ClockChanged(void);
+
+/**
+ * @brief Copy the latest log output into @p dst, oldest first: the last
+ *        chunk handed to a transport, then the log lines and the CLI
+ *        output still queued.
+ *
+ * Takes no locks and changes nothing, so a fault handler can call it
+ * (crash_dump.h).
+ *
+ * @return Bytes written, at most @p size; the newest ones if there are more.
+ */
+uint32_t Log_CopyRecent(char *dst, uint32_t size);
+
+/**
+ * @brief Send @p stream over @p transport from the next chunk on. Selecting
+ *        "itm" sets up the ITM, the TPIU and SWO.
+ *
+ * @return HAL_OK, or HAL_ERROR for an unknown stream or transport.
+ */
+HAL_StatusTypeDef Log_SetTransport(Log_Stream_t stream, Log_TransportId_t transport);
+
+/**
+ * @brief Transport of @p stream.
+ */
+Log_TransportId_t Log_GetTransport(Log_Stream_t stream);
+
+/**
+ * @brief Look up a stream by name ("lines", "cli", "tlm").
+ *
+ * @return Stream, or -1 if unknown.
+ */
+int32_t Log_FindStream(const char *name);
+
+/**
+ * @brief Name of @p stream, or NULL if out of range.
+ */
+const char *Log_StreamName(Log_Stream_t stream);
+
+/**
+ * @brief Frame the UART output as mux frames (1) or send it as is (0),
+ *        from the next chunk on.
+ */
+void Log_SetMux(uint8_t on);
+
+/** 1 while the UART output is mux framed. */
+uint8_t Log_GetMux(void);
+
+/**
+ * @brief Look up a transport by name ("uart", "uart-dma", "itm", "ram").
+ *
+ * @return Transport, or -1 if unknown.
+ */
+int32_t Log_FindTransport(const char *name);
+
+/**
+ * @brief Name of @p transport, or NULL if out of range.
+ */
+const char *Log_TransportName(Log_TransportId_t transport);
+
+/**
+ * @brief Bytes the "ram" transport has taken since start; the end of its
+ *        capture as an absolute offset.
+ */
+uint32_t Log_RamWritten(void);
+
+/**
+ * @brief Copy "ram" capture bytes from absolute offset @p *pos up to @p end.
+ *
+ * An offset older than the capture still holds moves to its oldest byte.
+ *
+ * @param[in,out] pos  Offset to read from; advanced past the bytes copied.
+ * @param[in]     end  Stop here, e.g. Log_RamWritten() taken before.
+ * @return Bytes copied, at most @p size; 0 at @p end.
+ */
+uint32_t Log_ReadRam(uint32_t *pos, uint32_t end, char *dst, uint32_t size);
+
+/**
+ * @brief Bytes written into the post-mortem ring since it was set up (over
+ *        resets); its end as an absolute offset. 0 if LOG_PM_SIZE is 0.
+ */
+uint32_t Log_PmWritten(void);
+
+/**
+ * @brief Log_PmWritten() at Log_Init(): bytes before it are from earlier
+ *        runs.
+ */
+uint32_t Log_PmBoot(void);
+
+/**
+ * @brief Copy post-mortem bytes from absolute offset @p *pos up to @p end,
+ *        as Log_ReadRam().
+ */
+uint32_t Log_ReadPm(uint32_t *pos, uint32_t end, char *dst, uint32_t size);
+
+/**
+ * @brief Offset of the first of the newest @p lines lines in the
+ *        post-mortem ring (its oldest byte if it holds fewer).
+ */
+uint32_t Log_PmLineStart(uint32_t lines);
+
+/**
+ * @brief Copy the newest post-mortem bytes, at most @p size, oldest first.
+ *
+ * Lock-free like Log_CopyRecent(); a line written at the same moment may
+ * be torn.
+ *
+ * @return Bytes copied.
+ */
+uint32_t Log_PmTail(char *dst, uint32_t size);
+
+/**
+ * @brief Log backend statistics of one stream's ring.
+ */
+typedef struct
+{
+    uint32_t ringSize;       /**< Ring capacity in bytes. */
+    uint32_t fill;           /**< Bytes currently queued. */
+    uint32_t peakFill;       /**< Highest fill level seen. */
+    uint32_t droppedLines;   /**< Records lost because the ring was full. */
+    uint32_t itmDropped;     /**< Bytes the "itm" transport dropped (ITM off). */
+} Log_Stats_t;
+
+/**
+ * @brief Snapshot the statistics of the log lines ring.
+ */
+void Log_GetStats(Log_Stats_t *stats);
+
+/**
+ * @brief Rate limit state of one call site (LOG_EMIT_); zero = full bucket.
+ */
+typedef struct
+{
+    uint32_t stamp;         /**< HAL tick the bucket was last topped up. */
+    uint16_t spent;         /**< Lines taken from the bucket. */
+    uint16_t suppressed;    /**< Calls held back since the last line. */
+} Log_Site_t;
+
+/**
+ * @brief What the rate limits held back since start.
+ */
+typedef struct
+{
+    uint8_t  on;            /**< Limits applied (Log_SetLimit()). */
+    uint32_t suppressed;    /**< Calls stopped by their site's bucket. */
+    uint32_t shed[4];       /**< Lines shed by the budget, per level. */
+    uint32_t budget;        /**< Bytes left in the budget now. */
+} Log_LimitStats_t;
+
+/**
+ * @brief Take a line from @p site's bucket (LOG_* macros).
+ *
+ * If lines were suppressed since the site's last one, queues
+ * "<n> suppressed like:" first. Any context.
+ *
+ * @return 1 to emit the line, 0 if the site is over its rate.
+ */
+uint8_t Log_SiteAdmit(Log_Site_t *site, log_level_t level, const char *module);
+
+/**
+ * @brief Apply (1, default) or lift (0) the per-site limit and the budget.
+ */
+void Log_SetLimit(uint8_t on);
+
+void Log_GetLimitStats(Log_LimitStats_t *stats);
+
+/**
+ * @brief Snapshot the statistics of @p stream's ring; a writer pacing long
+ *        output waits for ringSize - fill to have room.
+ */
+void Log_GetStreamStats(Log_Stream_t stream, Log_Stats_t *stats);
+
+/* -------------------------------------------------------------------------- */
+/* Tokenized logging                                                          */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief One captured argument of a tokenized log call.
+ *
+ * @c str is non-NULL for string arguments; otherwise @c word holds the
+ * raw value.
+ */
+typedef struct
+{
+    uint32_t    word;
+    const char *str;
+} Log_Arg_t;
+
+/**
+ * @brief Queue a tokenized log frame (called by the LOG_* macros).
+ *
+ * @param[in] level Severity (already filtered by the macro).
+ * @param[in] token Offset of the format record in ".log_fmt".
+ * @param[in] args  Captured arguments.
+ * @param[in] nargs Number of arguments.
+ */
+void Log_WriteTok(log_level_t level, uint32_t token,
+                  const Log_Arg_t *args, uint32_t nargs);
+
+static inline Log_Arg_t log_tok_u(uint32_t v)    { Log_Arg_t a = { v, NULL }; return a; }
+static inline Log_Arg_t log_tok_p(const void *p) { Log_Arg_t a = { (uint32_t)(uintptr_t)p, NULL }; return a; }
+static inline Log_Arg_t log_tok_f(double v)
+{
+    union { float f; uint32_t u; } conv;
+    conv.f = (float)v;
+    Log_Arg_t a = { conv.u, NULL };
+    return a;
+}
+static inline Log_Arg_t log_tok_s(const char *s)
+{
+    Log_Arg_t a = { 0U, (s != NULL) ? s : "(null)" };
+    return a;
+}
+
+/** Capture one argument according to its static type. */
+#define LOG_TOK_ARG(x)                      \
+    _Generic((x),                           \
+             float:        log_tok_f,       \
+             double:       log_tok_f,       \
+             char *:       log_tok_s,       \
+             const char *: log_tok_s,       \
+             void *:       log_tok_p,       \
+             const void *: log_tok_p,       \
+             default:      log_tok_u)(x)
+
+/* Argument counting / mapping, up to 8 arguments. */
+#define LOG_TOK_NARGS(...)  LOG_TOK_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_TOK_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...)  N
+#define LOG_TOK_CAT(a, b)   LOG_TOK_CAT_(a, b)
+#define LOG_TOK_CAT_(a, b)  a##b
+
+#define LOG_TOK_ARGS(...) \
+    LOG_TOK_CAT(LOG_TOK_ARGS_, LOG_TOK_NARGS(__VA_ARGS__))(__VA_ARGS__)
+#define LOG_TOK_ARGS_0()
+#define LOG_TOK_ARGS_1(a)                    , LOG_TOK_ARG(a)
+#define LOG_TOK_ARGS_2(a, b)                 LOG_TOK_ARGS_1(a) LOG_TOK_ARGS_1(b)
+#define LOG_TOK_ARGS_3(a, b, c)              LOG_TOK_ARGS_2(a, b) LOG_TOK_ARGS_1(c)
+#define LOG_TOK_ARGS_4(a, b, c, d)           LOG_TOK_ARGS_3(a, b, c) LOG_TOK_ARGS_1(d)
+#define LOG_TOK_ARGS_5(a, b, c, d, e)        LOG_TOK_ARGS_4(a, b, c, d) LOG_TOK_ARGS_1(e)
+#define LOG_TOK_ARGS_6(a, b, c, d, e, f)     LOG_TOK_ARGS_5(a, b, c, d, e) LOG_TOK_ARGS_1(f)
+#define LOG_TOK_ARGS_7(a, b, c, d, e, f, g)  LOG_TOK_ARGS_6(a, b, c, d, e, f) LOG_TOK_ARGS_1(g)
+#define LOG_TOK_ARGS_8(a, b, c, d, e, f, g, h) \
+    LOG_TOK_ARGS_7(a, b, c, d, e, f, g) LOG_TOK_ARGS_1(h)
+
+/**
+ * @brief Emit a tokenized log call.
+ *
+ * The format record "<L>\x1f<mod>\x1f<fmt>" lives in ".log_fmt", which
+ * the linker script maps as INFO (kept in the ELF, never flashed).
+ */
+#define LOG_TOK(level, lvlch, mod, fmt, ...)                                  \
+    do                                                                        \
+    {                                                                         \
+        static const char log_tok_fmt_[]                                      \
+            __attribute__((section(".log_fmt"), used)) =                      \
+            lvlch "\x1f" mod "\x1f" fmt;                                      \
+        const Log_Arg_t log_tok_args_[] =                                     \
+            { { 0U, NULL } LOG_TOK_ARGS(__VA_ARGS__) };                       \
+        const uint32_t log_tok_n_ =                                           \
+            (uint32_t)(sizeof(log_tok_args_) / sizeof(log_tok_args_[0])) - 1U; \
+        Log_WriteTok((level), (uint32_t)(uintptr_t)log_tok_fmt_,              \
+                     &log_tok_args_[1], log_tok_n_);                          \
+    } while (0)
+
+/* -------------------------------------------------------------------------- */
+/* Convenience macros                                                         */
+/* -------------------------------------------------------------------------- */
+
+#if (LOG_TOKENIZED != 0)
+#define LOG_OUT_(level, lvlch, tag, fmt, ...) \
+    LOG_TOK((level), lvlch, tag, fmt, ##__VA_ARGS__)
+#else
+#define LOG_OUT_(level, lvlch, tag, fmt, ...) \
+    Log_Write((level), tag, (fmt), ##__VA_ARGS__)
+#endif
+
+#if (LOG_SITE_BURST > 0U)
+#define LOG_SITE_(site)                     static Log_Site_t site
+#define LOG_SITE_ADMIT_(site, level, tag)   Log_SiteAdmit(&(site), (level), tag)
+#else
+#define LOG_SITE_(site)                     (void)0
+#define LOG_SITE_ADMIT_(site, level, tag)   1U
+#endif
+
+/** Inline runtime filter, then the call site's rate limit; arguments are
+ *  only evaluated when both pass. */
+#define LOG_EMIT_(level, lvlch, idx, tag, fmt, ...)                           \
+    do                                                                        \
+    {                                                                         \
+        if ((uint8_t)(level) <= g_logLevels[(idx)])                           \
+        {                                                                     \
+            LOG_SITE_(log_site_);                                             \
+            if (LOG_SITE_ADMIT_(log_site_, (level), tag) != 0U)               \
+            {                                                                 \
+                LOG_OUT_((level), lvlch, tag, fmt, ##__VA_ARGS__);            \
+            }                                                                 \
+        }                                                                     \
+    } while (0)
+
+/**
+ * @brief Stand-in for calls above LOG_COMPILE_LEVEL.
+ *
+ * The dead branch is removed by the compiler but keeps arguments "used",
+ * so variables that only feed a log call do not raise warnings.
+ */
+#define LOG_NOP_(tag, fmt, ...)                                               \
+    do                                                                        \
+    {                                                                         \
+        if (0)                                                                \
+        {                                                                     \
+            Log_Write(LOG_LEVEL_DEBUG, tag, (fmt), ##__VA_ARGS__);            \
+        }                                                                     \
+    } while (0)
+
+/**
+ * @brief Non-zero if LOG_<level>(mod, ...) would emit, for callers that only
+ *        build their text when it is wanted (Log_WriteText()).
+ */
+#define LOG_ENABLED(level, mod) \
+    (((int)(level) <= LOG_COMPILE_LEVEL) && ((uint8_t)(level) <= g_logLevels[LOG_MOD_##mod]))
+
 #define LOG_ERROR(mod, fmt, ...) \
-    Log_Write(LOG_LEVEL_ERROR, (mod), (fmt), ##__VA_ARGS__)
+    LOG_EMIT_(LOG_LEVEL_ERROR, "E", LOG_MOD_##mod, #mod, fmt, ##__VA_ARGS__)
 
+#if (LOG_COMPILE_LEVEL >= 1)
 #define LOG_WARN(mod, fmt, ...) \
-    Log_Write(LOG_LEVEL_WARN,  (mod), (fmt), ##__VA_ARGS__)
+    LOG_EMIT_(LOG_LEVEL_WARN,  "W", LOG_MOD_##mod, #mod, fmt, ##__VA_ARGS__)
+#else
+#define LOG_WARN(mod, fmt, ...)   LOG_NOP_(#mod, fmt, ##__VA_ARGS__)
+#endif
 
+#if (LOG_COMPILE_LEVEL >= 2)
 #define LOG_INFO(mod, fmt, ...) \
-    Log_Write(LOG_LEVEL_INFO,  (mod), (fmt), ##__VA_ARGS__)
+    LOG_EMIT_(LOG_LEVEL_INFO,  "I", LOG_MOD_##mod, #mod, fmt, ##__VA_ARGS__)
+#else
+#define LOG_INFO(mod, fmt, ...)   LOG_NOP_(#mod, fmt, ##__VA_ARGS__)
+#endif
 
+#if (LOG_COMPILE_LEVEL >= 3)
 #define LOG_DEBUG(mod, fmt, ...) \
-    Log_Write(LOG_LEVEL_DEBUG, (mod), (fmt), ##__VA_ARGS__)
+    LOG_EMIT_(LOG_LEVEL_DEBUG, "D", LOG_MOD_##mod, #mod, fmt, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(mod, fmt, ...)  LOG_NOP_(#mod, fmt, ##__VA_ARGS__)
+#endif
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,209 @@
+/**
+ * @file    low_power.h
+ * @brief   Tickless idle on the RTC wakeup timer: run, sleep and stop
+ *          residency, Stop wake-up sources and latency.
+ *
+ * Between the VehicleTask periods every task is blocked on an event or a
+ * timeout, so the kernel knows how long nothing will run. With
+ * configUSE_TICKLESS_IDLE = 2 the idle task calls this module's
+ * vPortSuppressTicksAndSleep() instead of the port's: it stops SysTick
+ * (which HAL and the kernel share), arms the RTC wakeup timer for the
+ * expected idle time and sleeps with WFI. On wake-up, whether by the RTC or
+ * by a CAN, UART/DMA or button interrupt, the time actually slept is read
+ * from the RTC sub-second counter and both tick counts are stepped forward
+ * by it.
+ *
+ * The RTC runs from the 32.768 kHz LSE (X2 on the NUCLEO-F446RE). Until it
+ * has started, or if it never does, the idle task still sleeps with WFI but
+ * SysTick keeps running.
+ *
+ * The sleep hooks (configPRE/POST_SLEEP_PROCESSING) load the RCC sleep
+ * enable registers so only the wake sources and their DMA keep a clock
+ * while the core sleeps. The core normally stays in Sleep mode, not Stop:
+ * bxCAN and USART2 cannot wake the F446 from Stop without losing the first
+ * frame. Stop is used only while the CAN network sleeps (can_nm.h calls
+ * LowPower_SetStop()): a frame then wakes the core through the EXTI line
+ * of CAN1_RX and is lost, as network management expects; B1 and the RTC
+ * wake it as ever. In Stop the CLI UART is deaf and the TIM5 control loop,
+ * the ADC and the microsecond timebase (time_sync.h) pause. Leaving Stop
+ * and relocking the PLL (and over-drive) takes well under a millisecond,
+ * done before any handler runs.
+ *
+ * Resume from Stop, in order:
+ *   - the PLL clock profile comes back with interrupts still off; the
+ *     time from the WFI to that point is the wake-to-ready latency;
+ *   - the pending EXTI line tells the wake source: CAN1_RX, B1 or the RTC;
+ *   - once interrupts are enabled, the can_nm.h EXTI handler takes bxCAN
+ *     out of its sleep mode (CAN_IF_WakeUpFromIsr()), so the frame after
+ *     the waking one is received, and CLI_IF_Resume() has the CLI task
+ *     check its circular RX DMA and re-arm it if Stop broke it off;
+ *   - after a CAN wake-up, the first frame CanRxTask processes
+ *     (LowPower_OnCanRx()) ends the wake-to-frame latency, target
+ *     LOW_POWER_FRAME_TARGET_US. It includes the wait for that frame on
+ *     the bus.
+ * A Stop requested while the CLI UART still sends is taken as a Sleep
+ * instead, so the line does not stop mid-byte.
+ *
+ * The DWT cycle counter, and with it the run-time stats behind "top",
+ * stops while the core sleeps; "power" shows the time spent running, in
+ * Sleep and in Stop, and the wake-up figures.
+ */
+
+#ifndef LOW_POWER_H
+#define LOW_POWER_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Longest single sleep (ms); the 16-bit wakeup counter at 16384 Hz ends at 4 s. */
+#ifndef LOW_POWER_MAX_SLEEP_MS
+#define LOW_POWER_MAX_SLEEP_MS   3000U
+#endif
+
+/** How often and how long to wait for the LSE after a power loss (ms). */
+#ifndef LOW_POWER_LSE_POLL_MS
+#define LOW_POWER_LSE_POLL_MS    100U
+#endif
+#ifndef LOW_POWER_LSE_TIMEOUT_MS
+#define LOW_POWER_LSE_TIMEOUT_MS 5000U
+#endif
+
+/** Clocks kept during sleep: the wake sources (CAN1, USART2 and its DMA,
+ *  B1 on GPIOC and its debounce timer TIM7, the control loop's TIM5), the
+ *  microsecond timebase TIM4/TIM12 (time_sync.h), the SRAM the DMA writes
+ *  and GPIOA for their pins. A sleep bit has no effect on a peripheral not
+ *  clocked. */
+#ifndef LOW_POWER_SLEEP_AHB1
+#define LOW_POWER_SLEEP_AHB1     (RCC_AHB1LPENR_GPIOALPEN | RCC_AHB1LPENR_GPIOCLPEN | \
+                                  RCC_AHB1LPENR_DMA1LPEN | RCC_AHB1LPENR_SRAM1LPEN |  \
+                                  RCC_AHB1LPENR_SRAM2LPEN)
+#endif
+#ifndef LOW_POWER_SLEEP_APB1
+#define LOW_POWER_SLEEP_APB1     (RCC_APB1LPENR_CAN1LPEN | RCC_APB1LPENR_USART2LPEN | \
+                                  RCC_APB1LPENR_TIM4LPEN | RCC_APB1LPENR_TIM5LPEN | \
+                                  RCC_APB1LPENR_TIM7LPEN | RCC_APB1LPENR_TIM12LPEN | \
+                                  RCC_APB1LPENR_PWRLPEN)
+#endif
+#ifndef LOW_POWER_SLEEP_APB2
+#define LOW_POWER_SLEEP_APB2     RCC_APB2LPENR_SYSCFGLPEN
+#endif
+
+/** Stop with the regulator in low-power mode (1, LPDS) or the main regulator
+ *  (0): less current against a longer regulator start on each wake-up. */
+#ifndef LOW_POWER_STOP_LPDS
+#define LOW_POWER_STOP_LPDS      1
+#endif
+
+/** Wake-to-first-frame target after a CAN wake-up from Stop (us). */
+#ifndef LOW_POWER_FRAME_TARGET_US
+#define LOW_POWER_FRAME_TARGET_US 2000U
+#endif
+
+/** UART whose transmission holds off Stop (the CLI and log output). */
+#ifndef LOW_POWER_STOP_UART
+#define LOW_POWER_STOP_UART      USART2
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Sleep figures since start or the last LowPower_ResetStats().
+ */
+typedef struct
+{
+    uint8_t  tickless;           /**< RTC timebase running. */
+    uint32_t sleeps;             /**< Tickless sleeps entered. */
+    uint32_t earlyWakes;         /**< Ended by an interrupt before the RTC. */
+    uint32_t aborted;            /**< Abandoned, a task became ready. */
+    uint8_t  stopAllowed;        /**< LowPower_SetStop() in force. */
+    uint32_t stops;              /**< Sleeps taken in Stop mode. */
+    uint32_t stopVetoes;         /**< Stop allowed, Sleep taken: UART busy. */
+    uint32_t clockErrors;        /**< PLL or over-drive not back after Stop. */
+    uint32_t sleptMs;            /**< Time asleep, measured on the RTC. */
+    uint32_t sleepMs;            /**< Of it in Sleep mode. */
+    uint32_t stopMs;             /**< Of it in Stop mode. */
+    uint32_t runMs;              /**< windowMs - sleptMs. */
+    uint32_t longestMs;          /**< Longest single sleep. */
+    uint32_t windowMs;           /**< Time the figures cover. */
+    uint16_t residencyPermille;  /**< sleptMs / windowMs, 0..1000. */
+    uint32_t wakeCan;            /**< Stops ended by CAN1_RX (EXTI11). */
+    uint32_t wakeButton;         /**< By B1 (EXTI13). */
+    uint32_t wakeRtc;            /**< By the wakeup timer (EXTI22). */
+    uint32_t wakeOther;          /**< By any other interrupt. */
+    uint32_t readyUs;            /**< Last wake-to-ready: WFI to clocks back. */
+    uint32_t readyMaxUs;
+    uint32_t frames;             /**< CAN wake-ups that saw a frame processed. */
+    uint32_t frameUs;            /**< Last wake-to-first-processed-frame. */
+    uint32_t frameMaxUs;
+    uint32_t frameLate;          /**< Of them above LOW_POWER_FRAME_TARGET_US. */
+} LowPower_Stats_t;
+
+/**
+ * @brief Start the LSE and the RTC wakeup timer and register "power".
+ *
+ * After a system reset the LSE is still running and the timebase is ready
+ * at once; after a power loss a timer polls the LSE and enables tickless
+ * idle once it is stable. Call after osKernelInitialize().
+ *
+ * @return HAL_OK, or HAL_ERROR if the RTC or the poll timer cannot start.
+ */
+HAL_StatusTypeDef LowPower_Init(void);
+
+/**
+ * @brief configPRE_SLEEP_PROCESSING(): gate the clocks of everything that
+ *        is not a wake source for the coming sleep.
+ *
+ * @param[in,out] expected Idle ticks; set to 0 to skip the WFI.
+ */
+void LowPower_PreSleep(uint32_t *expected);
+
+/**
+ * @brief configPOST_SLEEP_PROCESSING(): give back the sleep clock gates.
+ */
+void LowPower_PostSleep(uint32_t expected);
+
+/**
+ * @brief RTC_WKUP_IRQHandler body: acknowledge the wakeup timer.
+ */
+void LowPower_WakeupIRQHandler(void);
+
+/**
+ * @brief Let the tickless sleeps use Stop mode (@p allow != 0) or keep them
+ *        in Sleep mode (0, the default). Any task or interrupt; takes
+ *        effect from the next sleep. Stop needs the RTC timebase: without
+ *        it the idle task keeps to Sleep mode.
+ */
+void LowPower_SetStop(uint8_t allow);
+
+/**
+ * @brief CanRxTask, before each frame (the RX interrupt for an ISR-decoded
+ *        ID): after a CAN wake-up from Stop the first call ends the
+ *        wake-to-frame latency. Cheap otherwise; RAMFUNC.
+ */
+void LowPower_OnCanRx(void);
+
+/**
+ * @brief Copy the sleep figures.
+ */
+void LowPower_GetStats(LowPower_Stats_t *stats);
+
+/**
+ * @brief Start a new residency window.
+ */
+void LowPower_ResetStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOW_POWER_H */
@@ -0,0 +1,110 @@
+/**
+ * @file    lut.h
+ * @brief   1D / 2D lookup table interpolation, float and Q15.
+ *
+ * A table is sampled over one or two axes of strictly increasing
+ * breakpoints. An axis carries the reciprocals of its breakpoint spacing,
+ * worked out once by Lut_AxisInitF32() / Lut_AxisInitQ15(), so a lookup
+ * multiplies instead of dividing. Finding the segment is a binary search
+ * with a fixed number of halvings, ceil(log2(n - 1)), each a compare and a
+ * conditional select and no early exit, so every input costs the same.
+ * Inputs outside the axis are clamped to its ends; the tables do not
+ * extrapolate.
+ *
+ * A lookup is split in two steps so that an axis position can be shared:
+ * Lut_Locate*() turns an input into a segment and a fraction, Lut_*At*()
+ * interpolates a table there. The tables of one axis (a torque and an
+ * efficiency map over the same rpm breakpoints, say) then pay for one
+ * search. Lut_Interp1*() / Lut_Interp2*() do both steps.
+ *
+ *   float  breakpoints float, table float, fraction float 0..1
+ *   Q15    breakpoints int16 in any unit, table int16 (Q15 or raw), fraction
+ *          Q15 0..32768 (1.0 included) from one 32 x 32 -> 64 bit multiply
+ *
+ * 2D tables are stored row by row: z[iy * nx + ix], x across, y down.
+ * Axes and tables are read only, so one may be shared by any number of
+ * tasks; the axis reciprocals live wherever the caller puts them.
+ */
+
+#ifndef LUT_H
+#define LUT_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/** Q15 fraction of the end of a segment. */
+#define LUT_Q15_ONE         32768U
+
+/** Float axis of n breakpoints. */
+typedef struct
+{
+    const float *bp;        /**< n breakpoints, strictly increasing. */
+    float       *inv;       /**< n - 1 floats: 1 / (bp[i + 1] - bp[i]). */
+    uint32_t     n;
+} Lut_AxisF32_t;
+
+/** Q15 axis of n breakpoints. */
+typedef struct
+{
+    const int16_t *bp;      /**< n breakpoints, strictly increasing. */
+    uint32_t      *inv;     /**< n - 1 words: 2^31 / (bp[i + 1] - bp[i]). */
+    uint32_t       n;
+} Lut_AxisQ15_t;
+
+/** Position on an axis: segment i (bp[i] .. bp[i + 1]) and fraction f. */
+typedef struct
+{
+    uint32_t i;
+    float    f;             /**< 0..1. */
+} Lut_PosF32_t;
+
+typedef struct
+{
+    uint32_t i;
+    uint32_t f;             /**< 0..LUT_Q15_ONE. */
+} Lut_PosQ15_t;
+
+/**
+ * @brief Set up an axis and work out its reciprocals into @p inv.
+ *
+ * @return HAL_OK, or HAL_ERROR if @p n < 2 or the breakpoints do not
+ *         increase strictly (the axis is then unusable).
+ */
+HAL_StatusTypeDef Lut_AxisInitF32(Lut_AxisF32_t *a, const float *bp, float *inv, uint32_t n);
+HAL_StatusTypeDef Lut_AxisInitQ15(Lut_AxisQ15_t *a, const int16_t *bp, uint32_t *inv, uint32_t n);
+
+/** Segment and fraction of @p x, clamped to the axis. */
+void Lut_LocateF32(const Lut_AxisF32_t *a, float x, Lut_PosF32_t *pos);
+void Lut_LocateQ15(const Lut_AxisQ15_t *a, int16_t x, Lut_PosQ15_t *pos);
+
+/** Table of the axis length at @p pos. */
+float   Lut_Interp1AtF32(const float *y, const Lut_PosF32_t *pos);
+int16_t Lut_Interp1AtQ15(const int16_t *y, const Lut_PosQ15_t *pos);
+
+/** Row-by-row table of @p nx columns, bilinear at @p px, @p py. */
+float   Lut_Interp2AtF32(const float *z, uint32_t nx, const Lut_PosF32_t *px,
+                         const Lut_PosF32_t *py);
+int16_t Lut_Interp2AtQ15(const int16_t *z, uint32_t nx, const Lut_PosQ15_t *px,
+                         const Lut_PosQ15_t *py);
+
+/** Locate and interpolate in one call. */
+float   Lut_Interp1F32(const Lut_AxisF32_t *a, const float *y, float x);
+int16_t Lut_Interp1Q15(const Lut_AxisQ15_t *a, const int16_t *y, int16_t x);
+float   Lut_Interp2F32(const Lut_AxisF32_t *ax, const Lut_AxisF32_t *ay, const float *z,
+                       float x, float y);
+int16_t Lut_Interp2Q15(const Lut_AxisQ15_t *ax, const Lut_AxisQ15_t *ay, const int16_t *z,
+                       int16_t x, int16_t y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LUT_H */
@@ -0,0 +1,105 @@
+/**
+ * @file    mem_pool.h
+ * @brief   Fixed-size block pools with O(1), lock-free alloc/free.
+ *
+ * Three size classes are backed by static arrays:
+ *
+ *   | Class | Block  | Blocks (default)       | Typical use                 |
+ *   |-------|--------|------------------------|-----------------------------|
+ *   | 0     | 16 B   | MEM_POOL_16_BLOCKS  32 | small command / event data  |
+ *   | 1     | 64 B   | MEM_POOL_64_BLOCKS  16 | short multi-frame messages  |
+ *   | 2     | 256 B  | MEM_POOL_256_BLOCKS  8 | ISO-TP / update payloads    |
+ *
+ * MemPool_Alloc() takes a block from the smallest class that fits, falling
+ * back to larger classes when that one is empty. Each class is a singly
+ * linked free list updated with LDREX/STREX, so both calls are safe from
+ * tasks and from ISRs of any priority and never block. Ownership of a block
+ * is passed by pointer (e.g. CAN_IF_DeliverPdu()).
+ */
+
+#ifndef MEM_POOL_H
+#define MEM_POOL_H
+
+#include "main.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+#ifndef MEM_POOL_16_BLOCKS
+#define MEM_POOL_16_BLOCKS     32U
+#endif
+
+#ifndef MEM_POOL_64_BLOCKS
+#define MEM_POOL_64_BLOCKS     16U
+#endif
+
+#ifndef MEM_POOL_256_BLOCKS
+#define MEM_POOL_256_BLOCKS    8U
+#endif
+
+#define MEM_POOL_CLASS_COUNT   3U
+
+/** Largest size MemPool_Alloc() can satisfy. */
+#define MEM_POOL_MAX_BLOCK     256U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Per-class usage counters.
+ */
+typedef struct
+{
+    uint32_t blockSize;   /**< Bytes per block. */
+    uint32_t blocks;      /**< Blocks in the class. */
+    uint32_t inUse;       /**< Blocks currently allocated. */
+    uint32_t peak;        /**< Highest inUse seen. */
+    uint32_t allocs;      /**< Successful allocations from this class. */
+    uint32_t failures;    /**< Requests for this class no class could serve. */
+} MemPool_Stats_t;
+
+/**
+ * @brief Build the free lists; call once before any allocation.
+ */
+void MemPool_Init(void);
+
+/**
+ * @brief Allocate a block of at least @p size bytes (4-byte aligned).
+ *
+ * @return Block, or NULL if @p size is 0 / too large or all fitting
+ *         classes are exhausted.
+ */
+void *MemPool_Alloc(size_t size);
+
+/**
+ * @brief Return a block to its pool.
+ *
+ * @return HAL_OK, or HAL_ERROR if @p block did not come from MemPool_Alloc().
+ */
+HAL_StatusTypeDef MemPool_Free(void *block);
+
+/**
+ * @brief Usable size of an allocated block (0 if not a pool block).
+ */
+size_t MemPool_BlockSize(const void *block);
+
+/**
+ * @brief Copy the counters of one size class.
+ *
+ * @return HAL_OK, or HAL_ERROR for an invalid class.
+ */
+HAL_StatusTypeDef MemPool_GetStats(uint32_t cls, MemPool_Stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MEM_POOL_H */
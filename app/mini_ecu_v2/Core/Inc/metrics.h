@@ -0,0 +1,222 @@
+/**
+ * @file    metrics.h
+ * @brief   Metrics registry: counters, gauges and histograms in one array,
+ *          exported by "metrics", a binary dump and UDS.
+ *
+ * A metric is one line of METRICS_TABLE and one macro where it happens:
+ *
+ *     X(CAN_RX_WAKE_FRAMES, HIST, "frames", 0U)      in the table
+ *     METRIC_HIST(CAN_RX_WAKE_FRAMES, n);             in the code
+ *
+ * Every metric is a run of words in g_metrics, laid out at compile time
+ * in table order:
+ *
+ *   COUNTER  1 word, METRIC_ADD() / METRIC_INC()
+ *   GAUGE    2 words, the last METRIC_SET() value and its peak
+ *   HIST     METRICS_HIST_BUCKETS words, METRIC_HIST(): bucket 0 counts
+ *            values below 2^shift, bucket b those in [2^(shift+b-1),
+ *            2^(shift+b)), the last one everything above
+ *
+ * The updates are inline LDREX/STREX loops on one word (a gauge: a store
+ * and a loop while the peak grows), some 5 to 10 cycles, with no lock and
+ * no interrupt masking, so any task or ISR may update any metric. A macro
+ * used on a metric of another kind does not compile.
+ *
+ * Metrics_Snapshot() copies the array, one consistent word at a time, for
+ * the three exports:
+ *
+ *   metrics               each metric with its kind, value(s) and unit
+ *   metrics reset         clear them (an update racing it may survive)
+ *   metrics dump          the snapshot as binary frames on the telemetry
+ *                         stream (tlm_stream.h), tools/metrics_dump.py
+ *
+ * and UDS reads metric i as DID UDS_DID_METRICS_BASE + i, its words as
+ * big-endian u32 (uds.h). Append new metrics at the end of the table:
+ * the index is the DID.
+ *
+ * The macros compile to nothing with METRICS_ENABLE = 0 (the SIL build).
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+#ifndef METRICS_ENABLE
+#define METRICS_ENABLE          1
+#endif
+
+/** Buckets of a histogram; 8 words fill one UDS DID. */
+#define METRICS_HIST_BUCKETS    8U
+
+/**
+ * @brief Metrics. X(name, kind, unit, shift): METRIC_<name>, kind COUNTER,
+ *        GAUGE or HIST; @p shift is the log2 width of the first histogram
+ *        bucket (0 for the other kinds).
+ */
+#define METRICS_TABLE(X)                                        \
+    X(CAN_RX_WAKE_FRAMES,  HIST,    "frames", 0U)               \
+    X(CAN_SCHED_LATE_MS,   GAUGE,   "ms",     0U)               \
+    X(LOG_RECORD_BYTES,    HIST,    "bytes",  3U)               \
+    X(UDS_PERIODIC_FRAMES, COUNTER, "frames", 0U)
+
+/* -------------------------------------------------------------------------- */
+/* Layout                                                                     */
+/* -------------------------------------------------------------------------- */
+
+#define METRICS_KIND_COUNTER    0U
+#define METRICS_KIND_GAUGE      1U
+#define METRICS_KIND_HIST       2U
+
+#define METRICS_WORDS_COUNTER   1U
+#define METRICS_WORDS_GAUGE     2U
+#define METRICS_WORDS_HIST      METRICS_HIST_BUCKETS
+
+#define METRICS_ID_(name, kind, unit, shift)  METRIC_##name,
+
+typedef enum
+{
+    METRICS_TABLE(METRICS_ID_)
+    METRICS_COUNT
+} Metrics_Id_t;
+
+/* METRIC_SLOT_<name>: its first word; METRIC_END_<name>: its last. */
+#define METRICS_SLOT_(name, kind, unit, shift)                                    \
+    METRIC_SLOT_##name,                                                           \
+    METRIC_END_##name = METRIC_SLOT_##name + METRICS_WORDS_##kind - 1U,
+
+typedef enum
+{
+    METRICS_TABLE(METRICS_SLOT_)
+    METRICS_WORDS
+} Metrics_Slot_t;
+
+#define METRICS_CONST_(name, kind, unit, shift)                                   \
+    METRIC_KIND_##name  = METRICS_KIND_##kind,                                    \
+    METRIC_SHIFT_##name = (shift),
+
+enum
+{
+    METRICS_TABLE(METRICS_CONST_)
+};
+
+/** The metric words; updated through the macros below only. */
+extern volatile uint32_t g_metrics[METRICS_WORDS];
+
+/* -------------------------------------------------------------------------- */
+/* Update macros                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Does not compile unless metric @p name is of @p kind. */
+#define METRICS_IS_(name, kind)                                                   \
+    ((void)sizeof(char[(METRIC_KIND_##name == METRICS_KIND_##kind) ? 1 : -1]))
+
+static inline void Metrics_Add(uint32_t slot, uint32_t n)
+{
+    uint32_t v;
+
+    do
+    {
+        v = __LDREXW(&g_metrics[slot]) + n;
+    } while (__STREXW(v, &g_metrics[slot]) != 0U);
+}
+
+static inline void Metrics_Set(uint32_t slot, uint32_t v)
+{
+    g_metrics[slot] = v;
+
+    uint32_t peak;
+    do
+    {
+        peak = __LDREXW(&g_metrics[slot + 1U]);
+        if (v <= peak)
+        {
+            __CLREX();
+            return;
+        }
+    } while (__STREXW(v, &g_metrics[slot + 1U]) != 0U);
+}
+
+/** Bucket of @p v in a histogram whose first bucket is 2^@p shift wide. */
+static inline uint32_t Metrics_Bucket(uint32_t v, uint32_t shift)
+{
+    uint32_t b = 32U - __CLZ(v >> shift);
+    return (b < METRICS_HIST_BUCKETS) ? b : (METRICS_HIST_BUCKETS - 1U);
+}
+
+#if METRICS_ENABLE
+#define METRIC_ADD(name, n)                                                       \
+    do { METRICS_IS_(name, COUNTER); Metrics_Add(METRIC_SLOT_##name, (n)); } while (0)
+#define METRIC_INC(name)        METRIC_ADD(name, 1U)
+#define METRIC_SET(name, v)                                                       \
+    do { METRICS_IS_(name, GAUGE); Metrics_Set(METRIC_SLOT_##name, (v)); } while (0)
+#define METRIC_HIST(name, v)                                                      \
+    do                                                                            \
+    {                                                                             \
+        METRICS_IS_(name, HIST);                                                  \
+        Metrics_Add(METRIC_SLOT_##name + Metrics_Bucket((v), METRIC_SHIFT_##name), 1U); \
+    } while (0)
+#else
+#define METRIC_ADD(name, n)     do { } while (0)
+#define METRIC_INC(name)        do { } while (0)
+#define METRIC_SET(name, v)     do { } while (0)
+#define METRIC_HIST(name, v)    do { } while (0)
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief One row of METRICS_TABLE.
+ */
+typedef struct
+{
+    const char *name;
+    const char *unit;
+    uint8_t     kind;       /**< METRICS_KIND_*. */
+    uint8_t     words;
+    uint8_t     shift;
+    uint16_t    slot;       /**< First word in g_metrics. */
+} Metrics_Info_t;
+
+/**
+ * @brief Register the "metrics" commands.
+ */
+void Metrics_Init(void);
+
+/** Row of metric @p id, or NULL past the table. */
+const Metrics_Info_t *Metrics_GetInfo(uint32_t id);
+
+/**
+ * @brief Copy every metric word into @p out (METRICS_WORDS words); each
+ *        word is read whole, the set is not frozen.
+ */
+void Metrics_Snapshot(uint32_t *out);
+
+/**
+ * @brief Words of metric @p id into @p out, big-endian (the UDS DID).
+ *
+ * @return Bytes written, 0 for an unknown id.
+ */
+uint16_t Metrics_Read(uint32_t id, uint8_t *out);
+
+/**
+ * @brief Clear every metric.
+ */
+void Metrics_Reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* METRICS_H */
@@ -0,0 +1,111 @@
+/**
+ * @file    micro_bench.h
+ * @brief   On-target microbenchmarks in DWT cycles ("make bench", "bench micro").
+ *
+ * The SIL benchmarks (sil/bench.c) time the application core on the host;
+ * this is their counterpart on the board, where flash wait states, the ART
+ * accelerator, the FPU and the bus matrix decide the figures. The bench
+ * image (MICRO_BENCH_ENABLE = 1, release options) starts MicroBenchTask,
+ * which runs the registry once MICRO_BENCH_START_MS after boot and again
+ * on "bench micro":
+ *
+ *   empty               loop overhead, for reference
+ *   log_const           Log_Write() of a constant line
+ *   log_int             Log_Write() with three unsigned integers
+ *   log_str             Log_Write() with a string
+ *   log_float           Log_Write() with a float (%.2f)
+ *   snprintf_newlib     newlib snprintf() of a line with two integers and
+ *                       a float (not in FMT_PRINTF builds)
+ *   snprintf_fmt        the same line with Fmt_Snprintf() (fmt.h)
+ *   vehicle_update      Vehicle_Update() at 100 ms steps
+ *   lut_interp2_f32     Powertrain_Torque(): float 5 x 8 map (lut.h)
+ *   lut_interp2_q15     Lut_Interp2Q15() of a 3 x 4 map
+ *   telemetry_pack      CanSig_VehicleTelemetry_Pack()
+ *   telemetry_unpack    CanSig_VehicleTelemetry_Unpack()
+ *   tripdata_unpack     CanSig_TripData_Unpack() of both groups in turn:
+ *                       the multiplexed decode
+ *   e2e_protect         CanE2E_Protect() of the telemetry frame (can_e2e.h)
+ *   e2e_round_trip      CanE2E_Protect() + Sent() + Check(): one frame each
+ *                       way, counted in "can e2e" as sent and received
+ *   aes128_block        AesCmac_Encrypt() of one block (aes_cmac.h)
+ *   cmac_frame          AesCmac_Compute() of the 10 bytes a SecOC odometer
+ *                       frame authenticates: the MAC cost per frame and
+ *                       direction (can_secoc.h)
+ *   ring_push_pop       CanRing_Reserve/Commit + Peek/Release of a CAN frame
+ *   memcpy_8 / _64 / _64u / _1k
+ *                       memcpy() of 8, 64 (aligned and unaligned source)
+ *                       and 1024 bytes
+ *   dma_copy_1k         DmaCopy_Memcpy() of 1024 bytes: start, transfer,
+ *                       completion interrupt and wake-up (dma_copy.h)
+ *   pool_alloc_free     MemPool_Alloc(64) + MemPool_Free()
+ *   queue_put_get       osMessageQueuePut() + osMessageQueueGet() of a word
+ *   notify_give_take    xTaskNotifyGive() + ulTaskNotifyTake() on itself
+ *   flags_set_wait      osThreadFlagsSet() + osThreadFlagsWait() on itself
+ *
+ * Each runs MICRO_BENCH_BATCHES batches and reports the best batch, least
+ * disturbed by interrupts, and the mean, in cycles per operation
+ * including the loop. Between batches the task sleeps a tick, so lower
+ * priority tasks and the watchdog keep running. The log benchmarks move
+ * the log lines to the "ram" transport for the run and let the ring drain
+ * between batches, so every call takes the normal queueing path.
+ *
+ * The report goes out on the CLI stream, one line per benchmark, and is
+ * meant to be captured and compared (tools/bench_compare.py):
+ *
+ *   # micro bench v1
+ *   # fw 0.3.0 dev 0x421 rev 0x1000 core 180000000 profile 180MHz ws 5
+ *   bench <name> <best cycles/op> <mean cycles/op> <ops per batch>
+ *   # end 17 benchmarks, 0 log lines dropped
+ */
+
+#ifndef MICRO_BENCH_H
+#define MICRO_BENCH_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Build MicroBenchTask and "bench micro" (the "bench" make target). */
+#ifndef MICRO_BENCH_ENABLE
+#define MICRO_BENCH_ENABLE      0
+#endif
+
+/** Delay after boot before the first run, so the start-up log is out (ms). */
+#ifndef MICRO_BENCH_START_MS
+#define MICRO_BENCH_START_MS    1000U
+#endif
+
+/** Batches per benchmark; the best and the mean are reported. */
+#ifndef MICRO_BENCH_BATCHES
+#define MICRO_BENCH_BATCHES     7U
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Register "bench micro". Call once before the scheduler starts.
+ *
+ * @return HAL_OK, or HAL_ERROR if the benchmark queue cannot be created.
+ */
+HAL_StatusTypeDef MicroBench_Init(void);
+
+/**
+ * @brief Body of MicroBenchTask: runs the registry after boot and on
+ *        every "bench micro". Never returns.
+ */
+void MicroBench_Task(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MICRO_BENCH_H */
@@ -0,0 +1,172 @@
+/**
+ * @file    msg_bus.h
+ * @brief   Topic-based publish/subscribe between tasks and interrupts.
+ *
+ * Data owned by one task and wanted by others goes through a topic instead
+ * of a shared variable or a call into the owner. Topics are fixed at build
+ * time (MSG_BUS_TOPIC_TABLE below); each has a message type, a number of
+ * slots of that type (statically allocated, a power of two) and one of
+ * two kinds:
+ *
+ *   - MSG_BUS_LATEST: readers get the newest message (MsgBus_Read()), as
+ *     often as they like; older ones are gone. For state.
+ *   - MSG_BUS_QUEUED: each subscriber receives every message in order
+ *     (MsgBus_Receive()) from its own read position, up to the slot count
+ *     behind the publisher; a subscriber further behind loses the oldest
+ *     ones (counted). For events.
+ *
+ * Publishing is zero-copy: the single publisher of a topic (a task or an
+ * interrupt) borrows the next slot with MsgBus_Loan(), fills it in place
+ * and hands it over with MsgBus_Publish(). The slot is never the one
+ * readers are taking, so a publish never waits for them and never takes a
+ * lock. A reader copies the message out and checks afterwards that the
+ * publisher has not come round to its slot in the meantime; it copies
+ * again in the rare case it has (a latch seqlock with more than two
+ * copies). With N slots a latest-value read survives N - 2 publishes while
+ * it copies.
+ *
+ * A subscriber names a thread and thread flags to be set on every publish
+ * (a task notification underneath), or none to poll. A publish costs one
+ * osThreadFlagsSet() per waking subscriber and nothing else: no allocation,
+ * no queue copy.
+ *
+ *   bus                   topics, publishes, subscribers and their losses
+ */
+
+#ifndef MSG_BUS_H
+#define MSG_BUS_H
+
+#include "main.h"
+#include "cmsis_os2.h"
+#include "pedal.h"
+#include "vehicle.h"
+#include "can_signals.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Subscribers per topic. */
+#ifndef MSG_BUS_MAX_SUBS
+#define MSG_BUS_MAX_SUBS        4U
+#endif
+
+#define MSG_BUS_LATEST          0U  /**< Newest message only. */
+#define MSG_BUS_QUEUED          1U  /**< Every message, per subscriber. */
+
+/**
+ * @brief Topics. X(name, message type, kind, slots); slots a power of two,
+ *        at least 2.
+ *
+ *   VEHICLE    VehicleTask's model state after each step (vehicle_shared.h)
+ *   TELEMETRY  the same state as raw telemetry signals, for CanTxTask
+ *              without the FPU (rtos_fpu.h)
+ *   PEDAL      debounced accelerator edges from the TIM7 interrupt (pedal.h)
+ */
+#define MSG_BUS_TOPIC_TABLE(X)                                                  \
+    X(VEHICLE,   VehicleState_t,                MSG_BUS_LATEST, 4U)             \
+    X(TELEMETRY, CanSig_VehicleTelemetry_Raw_t, MSG_BUS_LATEST, 4U)             \
+    X(PEDAL,     Pedal_Event_t,                 MSG_BUS_QUEUED, 8U)
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+#define MSG_BUS_TOPIC_ENUM_(name, type, kind, slots)  MSG_TOPIC_##name,
+
+typedef enum
+{
+    MSG_BUS_TOPIC_TABLE(MSG_BUS_TOPIC_ENUM_)
+    MSG_TOPIC_COUNT
+} MsgBus_Topic_t;
+
+/**
+ * @brief Figures of one topic.
+ */
+typedef struct
+{
+    const char *name;
+    uint32_t    kind;           /**< MSG_BUS_LATEST or MSG_BUS_QUEUED. */
+    uint32_t    size;           /**< Message size in bytes. */
+    uint32_t    slots;
+    uint32_t    published;      /**< Messages since start. */
+    uint32_t    subscribers;
+    uint32_t    wakeups;        /**< Thread flags set by publishes. */
+    uint32_t    retries;        /**< Reads copied again (publisher came round). */
+} MsgBus_Stats_t;
+
+/**
+ * @brief Register "bus". The topics need no set-up; call once before the
+ *        scheduler starts.
+ */
+void MsgBus_Init(void);
+
+/**
+ * @brief Borrow the slot the next message of @p topic goes into.
+ *
+ * Publisher only: each topic has one publishing context. The slot holds
+ * stale data; fill it completely, then MsgBus_Publish(). Interrupt-safe.
+ */
+void *MsgBus_Loan(MsgBus_Topic_t topic);
+
+/**
+ * @brief Hand the loaned slot over and wake the subscribers that asked
+ *        for it. Interrupt-safe.
+ */
+void MsgBus_Publish(MsgBus_Topic_t topic);
+
+/**
+ * @brief MsgBus_Loan(), copy @p msg in and MsgBus_Publish().
+ */
+void MsgBus_Write(MsgBus_Topic_t topic, const void *msg);
+
+/**
+ * @brief Subscribe to @p topic.
+ *
+ * @param[in] thread Thread to wake on each publish, or NULL to poll.
+ * @param[in] flags  Thread flags to set on it.
+ * @return Subscriber number for MsgBus_Receive(), or -1 if the topic has
+ *         MSG_BUS_MAX_SUBS subscribers. Queued topics: receives what is
+ *         published from now on.
+ */
+int32_t MsgBus_Subscribe(MsgBus_Topic_t topic, osThreadId_t thread, uint32_t flags);
+
+/**
+ * @brief Copy the newest message of @p topic (any kind, any task).
+ *
+ * @return HAL_OK, or HAL_BUSY if nothing was published yet (@p dst zeroed).
+ */
+HAL_StatusTypeDef MsgBus_Read(MsgBus_Topic_t topic, void *dst);
+
+/**
+ * @brief Copy the next message for subscriber @p sub: on a queued @p topic
+ *        the oldest it has not received, on a latest-value one the newest
+ *        if it is new since the last call. The subscriber's own task only.
+ *
+ * @return HAL_OK, HAL_BUSY if there is nothing new, HAL_ERROR for an
+ *         unknown subscriber.
+ */
+HAL_StatusTypeDef MsgBus_Receive(MsgBus_Topic_t topic, int32_t sub, void *dst);
+
+/**
+ * @brief Messages subscriber @p sub lost by falling behind.
+ */
+uint32_t MsgBus_Lost(MsgBus_Topic_t topic, int32_t sub);
+
+/**
+ * @brief Copy the figures of @p topic.
+ *
+ * @return HAL_OK, or HAL_ERROR for an unknown topic.
+ */
+HAL_StatusTypeDef MsgBus_GetStats(MsgBus_Topic_t topic, MsgBus_Stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MSG_BUS_H */
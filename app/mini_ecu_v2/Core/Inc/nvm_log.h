@@ -0,0 +1,182 @@
+/**
+ * @file    nvm_log.h
+ * @brief   Two-sector flash log of keyed records (EEPROM emulation).
+ *
+ * The non-volatile state of several modules (DTCs, calibration, trip
+ * counters, freeze frames, SecOC freshness values, load collectives,
+ * lifetime performance counters) lives in
+ * one log in flash sectors 2 and 3 (2 x 16 KB at 0x08008000, below
+ * application slot A). Each module is a client: it keeps its entries in
+ * RAM, indexed however it likes, and hands the log a record per changed
+ * entry.
+ *
+ *   - A sector starts with a header (magic, generation); the one with the
+ *     valid header and the highest generation is active.
+ *   - Every write appends one 16-byte record (client tag, key, one byte and
+ *     two words of data, check word) to the active sector: four word
+ *     programs, no erase. The last record of a key wins. The check word
+ *     is programmed last, so a record torn by a reset is skipped.
+ *   - When the active sector is full, or NVM_LOG_GC_IDLE_PCT full while the
+ *     vehicle stands still, the live entries of every client are copied to
+ *     the other sector after erasing it, and its header (generation + 1) is
+ *     programmed last. A reset in between leaves the old sector active.
+ *
+ * NvmLog_Init() reads the active sector once at boot and hands each record
+ * to its client, so the RAM entries are complete before any task runs. The
+ * flash work runs in NvmTask at low priority: a record costs ~60 us of
+ * flash programming with the scheduler suspended, the erase of a 16 KB
+ * sector ~250 ms (once per NVM_LOG_SECTOR_RECORDS records), during which
+ * only code in SRAM runs (ramfunc.h).
+ *
+ * "nvm" shows the log state.
+ */
+
+#ifndef NVM_LOG_H
+#define NVM_LOG_H
+
+#include "main.h"
+#include "coop.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Log sectors: two 16 KB sectors between the bootloader and slot A. */
+#define NVM_LOG_SECTOR_0        FLASH_SECTOR_2
+#define NVM_LOG_SECTOR_0_ADDR   0x08008000U
+#define NVM_LOG_SECTOR_1        FLASH_SECTOR_3
+#define NVM_LOG_SECTOR_1_ADDR   0x0800C000U
+#define NVM_LOG_SECTOR_SIZE     (16U * 1024U)
+
+#define NVM_LOG_RECORD_SIZE     16U
+/** Records per sector, behind the 16-byte header. */
+#define NVM_LOG_SECTOR_RECORDS  ((NVM_LOG_SECTOR_SIZE / NVM_LOG_RECORD_SIZE) - 1U)
+
+/** Fill level at which a stationary vehicle triggers the copy (%). */
+#ifndef NVM_LOG_GC_IDLE_PCT
+#define NVM_LOG_GC_IDLE_PCT     75U
+#endif
+
+/** Clients that can be registered. */
+#ifndef NVM_LOG_MAX_CLIENTS
+#define NVM_LOG_MAX_CLIENTS     7U
+#endif
+
+/** Thread flag set on NvmTask by NvmLog_Notify(); apart from the log
+ *  flags (log.h) so one thread can serve both. */
+#define NVM_LOG_FLAG            0x0004U
+
+/** Client tags (bits 31..24 of the first record word). */
+#define NVM_LOG_TAG_DTC         0xA5U
+#define NVM_LOG_TAG_CAL         0x5AU
+#define NVM_LOG_TAG_TRIP        0x3CU
+#define NVM_LOG_TAG_FF          0xC3U
+#define NVM_LOG_TAG_SECOC       0x96U
+#define NVM_LOG_TAG_LOAD        0x69U
+#define NVM_LOG_TAG_PERF        0xE1U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Payload of one record.
+ */
+typedef struct
+{
+    uint16_t key;
+    uint8_t  aux;
+    uint32_t data[2];
+} NvmLog_Record_t;
+
+/**
+ * @brief A module whose entries live in the log. Registered by pointer;
+ *        must stay valid.
+ *
+ * The callbacks run in NvmTask, except restore() (NvmLog_Init()).
+ */
+typedef struct
+{
+    uint8_t  tag;                     /**< NVM_LOG_TAG_*, unique. */
+    uint32_t count;                   /**< Entries, indexed 0..count-1. */
+    /** A valid record of this client from the boot scan, in log order. */
+    void   (*restore)(const NvmLog_Record_t *rec);
+    /**
+     * Fill @p rec for entry @p i and clear its pending mark, atomically
+     * against the writers. @p all = 0: only if the entry is pending;
+     * @p all = 1 (sector copy): only if the entry is live (an entry at its
+     * default needs no record). Returns non-zero if @p rec is to be written.
+     */
+    uint8_t (*take)(uint32_t i, uint8_t all, NvmLog_Record_t *rec);
+    /** The write of entry @p i failed: mark it pending again. */
+    void   (*retry)(uint32_t i);
+} NvmLog_Client_t;
+
+/**
+ * @brief Log figures.
+ */
+typedef struct
+{
+    uint8_t  sector;        /**< Active sector (0, 1), 0xFF before the format. */
+    uint32_t generation;
+    uint32_t records;       /**< Used record slots of the active sector. */
+    uint32_t written;       /**< Records written since boot. */
+    uint32_t copies;        /**< Sector copies (erases) since boot. */
+    uint32_t torn;          /**< Invalid records skipped at boot. */
+    uint32_t errors;        /**< Failed programs or erases. */
+} NvmLog_Stats_t;
+
+/**
+ * @brief Add a client. Call before NvmLog_Init().
+ *
+ * @return HAL_OK, or HAL_ERROR if the table is full, the tag is taken or
+ *         the entries of all clients would not fit one sector.
+ */
+HAL_StatusTypeDef NvmLog_Register(const NvmLog_Client_t *client);
+
+/**
+ * @brief Find the active sector, restore its records into the clients and
+ *        register the "nvm" command. Call once before the scheduler starts.
+ */
+void NvmLog_Init(void);
+
+/**
+ * @brief Wake NvmTask to write the pending entries (any task).
+ */
+void NvmLog_Notify(void);
+
+/**
+ * @brief Copy the log figures.
+ */
+void NvmLog_GetStats(NvmLog_Stats_t *out);
+
+/**
+ * @brief NvmTask body: writes the pending entries, copies the log when
+ *        needed, then blocks until NVM_LOG_FLAG. Call in a loop.
+ */
+void NvmLog_Task(void);
+
+/**
+ * @brief One pass of NvmLog_Task() without the wait, for a thread that
+ *        also serves other work: call it once at start and then whenever
+ *        NVM_LOG_FLAG is set. The first call makes the calling thread the
+ *        one NvmLog_Notify() wakes.
+ */
+void NvmLog_Service(void);
+
+/**
+ * @brief NvmLog_Service() as a coroutine of BgTask (coop.h): a pass at
+ *        once, then one per NVM_LOG_FLAG.
+ */
+void NvmLog_Coop(Coop_t *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NVM_LOG_H */
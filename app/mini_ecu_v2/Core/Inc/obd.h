@@ -0,0 +1,93 @@
+/**
+ * @file    obd.h
+ * @brief   OBD-II service 01 (current powertrain data) from the signal cache.
+ *
+ * Scan tools send 01 <PID> [<PID> ...] (up to OBD_MAX_PIDS) on the
+ * functional ID 0x7DF or the physical ID 0x7E0 + CAN_NODE_ID. Service 01
+ * does not clash with a UDS service, so the requests come in on the UDS
+ * channel (uds.h) and are answered by it on 0x7E8 + CAN_NODE_ID, in
+ * CanRxTask as soon as ISO-TP has them: 41 <PID> <data> [<PID> <data> ...],
+ * a response of several PIDs as an ISO-TP multi-frame.
+ *
+ *   | PID  | Signal (can_sigcache.h) | Data                             |
+ *   |------|-------------------------|----------------------------------|
+ *   | 0x00 | -                       | PIDs 0x01..0x20 supported (u32)  |
+ *   | 0x05 | CAN_SIG_COOLANT         | A - 40 = degC                    |
+ *   | 0x0C | CAN_SIG_RPM             | (256 A + B) / 4 = rpm            |
+ *   | 0x0D | CAN_SIG_SPEED           | A = km/h                         |
+ *
+ * Each PID keeps its data bytes already encoded, with the cache sequence
+ * number they were made from (CanSigCache_Seq()). A request compares the
+ * sequence numbers and re-encodes a PID only after its signal was
+ * received again (at most once per telemetry frame), so a tester polling
+ * as fast as the bus allows costs a compare and a copy per PID. A PID
+ * never received, or stale (CAN_SIGCACHE_STALE_MS), is left out; a
+ * request without any PID answered gets NRC 0x31, which a functional
+ * request never sees (no reply).
+ *
+ * "obd" shows the encoded PIDs and the request counts.
+ */
+
+#ifndef OBD_H
+#define OBD_H
+
+#include "main.h"
+#include "can_sigcache.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = service 01 answered on the UDS channel. */
+#ifndef OBD_ENABLE
+#define OBD_ENABLE           1
+#endif
+
+/** Service 01 request / positive response SID. */
+#define OBD_SID_CURRENT_DATA 0x01U
+
+/** PIDs one request may carry (SAE J1979). */
+#define OBD_MAX_PIDS         6U
+
+/** Longest data of one PID (bytes). */
+#define OBD_PID_MAX_LEN      4U
+
+/**
+ * @brief Signal PIDs. X(pid, signal, bytes, scale, offset): the data is
+ *        (physical + offset) * scale, clamped to the bytes, big-endian.
+ */
+#define OBD_PID_TABLE(X)                                      \
+    X(0x05U, CAN_SIG_COOLANT, 1U, 1.0f, 40.0f)   /* degC + 40 */ \
+    X(0x0CU, CAN_SIG_RPM,     2U, 4.0f, 0.0f)    /* rpm / 4 */   \
+    X(0x0DU, CAN_SIG_SPEED,   1U, 1.0f, 0.0f)    /* km/h */
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Register "obd". Called by Uds_Init().
+ */
+void Obd_Init(void);
+
+/**
+ * @brief Answer the PIDs of a service 01 request (CanRxTask).
+ *
+ * @param[in]  pids  Requested PIDs (the request after its SID).
+ * @param[in]  count 1..OBD_MAX_PIDS.
+ * @param[out] out   <PID> <data> per PID answered, in request order; room
+ *                   for count * (1 + OBD_PID_MAX_LEN) bytes.
+ * @return Bytes written, 0 if no PID could be answered.
+ */
+uint16_t Obd_CurrentData(const uint8_t *pids, uint16_t count, uint8_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OBD_H */
@@ -0,0 +1,157 @@
+/**
+ * @file    pc_prof.h
+ * @brief   Statistical profiler: TIM6 samples the interrupted PC into a
+ *          histogram of code address ranges.
+ *
+ * "perf dump" answers how long the probed paths take; this answers where
+ * the CPU actually goes, HAL, FreeRTOS and the idle loop included. While
+ * running, TIM6 interrupts every PC_PROF_PERIOD_US at PC_PROF_IRQ_PRIO,
+ * above every other interrupt, and its handler takes the PC from the
+ * stacked exception frame and counts it in a bin:
+ *
+ *   - "text": the vector table to _etext, in PC_PROF_TEXT_BINS bins,
+ *   - "ramfunc": the code in SRAM (ramfunc.h, _sramfunc.._eramfunc), in
+ *     PC_PROF_RAM_BINS bins; the hot ISRs and kernel paths live here,
+ *   - anything else (the system ROM, a wild PC) counts as "other".
+ *
+ * The bin width is the smallest power of two of at least
+ * 1 << PC_PROF_MIN_SHIFT bytes that covers the region with its bins.
+ * Each sample also counts the exception number of the interrupted code
+ * (0 = a task), so the share of every interrupt shows as well.
+ *
+ * The period is a prime number of microseconds, so the samples do not lock
+ * onto the 1 ms tick or the control loop. At 10 kHz a sample costs about
+ * 40 cycles, 0.3 % of the CPU at 168 MHz. Interrupts and kernel critical
+ * sections (BASEPRI) are sampled in place; a PRIMASK section is not: the
+ * samples that fall into it land on the instruction after it ends.
+ *
+ * The target has no symbols: "prof" shows the hottest bins by address,
+ * "prof dump" prints the bins as text lines that tools/pc_prof.py
+ * symbolizes against the ELF into a flat profile per function.
+ *
+ *   prof                             state, where the samples went, the
+ *                                    hottest bins
+ *   prof start [<period us>]         clear the bins and sample
+ *   prof stop                        stop sampling, keep the bins
+ *   prof dump                        every bin, for tools/pc_prof.py
+ */
+
+#ifndef PC_PROF_H
+#define PC_PROF_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = "prof" and its TIM6 handler built in. */
+#ifndef PC_PROF_ENABLE
+#define PC_PROF_ENABLE          1
+#endif
+
+/** Default sample period (us); prime, about 10.3 kHz. */
+#ifndef PC_PROF_PERIOD_US
+#define PC_PROF_PERIOD_US       97U
+#endif
+
+/** Sample periods "prof start" accepts (us; TIM6 counts 16 bits at 1 MHz). */
+#define PC_PROF_MIN_US          20U
+#define PC_PROF_MAX_US          65535U
+
+/** Bins for the flash code and for the SRAM code. */
+#ifndef PC_PROF_TEXT_BINS
+#define PC_PROF_TEXT_BINS       1024U
+#endif
+#ifndef PC_PROF_RAM_BINS
+#define PC_PROF_RAM_BINS        128U
+#endif
+
+/** Narrowest bin: 1 << PC_PROF_MIN_SHIFT bytes. */
+#ifndef PC_PROF_MIN_SHIFT
+#define PC_PROF_MIN_SHIFT       4U
+#endif
+
+/** TIM6 priority: above every interrupt, so interrupts are sampled too. */
+#ifndef PC_PROF_IRQ_PRIO
+#define PC_PROF_IRQ_PRIO        0U
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Counters of the current or last run.
+ */
+typedef struct
+{
+    uint32_t samples;           /**< All samples. */
+    uint32_t thread;            /**< Samples in a task (exception number 0). */
+    uint32_t other;             /**< PC outside both regions. */
+    uint32_t periodUs;
+    uint32_t startMs;           /**< Tick the run started on. */
+    uint32_t stopMs;            /**< Tick it stopped on; 0 while running. */
+    uint8_t  running;
+} PcProf_Stats_t;
+
+/**
+ * @brief Size the bins from the linker symbols, set up TIM6 (stopped) and
+ *        register "prof".
+ */
+HAL_StatusTypeDef PcProf_Init(void);
+
+/**
+ * @brief Clear the bins and sample every @p periodUs.
+ *
+ * @return HAL_OK, or HAL_ERROR for a period outside
+ *         PC_PROF_MIN_US..PC_PROF_MAX_US.
+ */
+HAL_StatusTypeDef PcProf_Start(uint32_t periodUs);
+
+/**
+ * @brief Stop sampling; the bins stay for "prof" and "prof dump".
+ */
+void PcProf_Stop(void);
+
+/**
+ * @brief Copy the counters.
+ */
+void PcProf_GetStats(PcProf_Stats_t *stats);
+
+/**
+ * @brief The APB1 clock changed (clock_gov.h): keep the sample period.
+ */
+void PcProf_ClockChanged(void);
+
+/**
+ * @brief TIM6 body, from PC_PROF_TIM6_ENTRY() with the stacked exception
+ *        frame.
+ */
+void PcProf_Sample(const uint32_t *frame);
+
+/**
+ * @brief TIM6 handler body: passes the exception frame of the interrupted
+ *        code to PcProf_Sample(). Use as the only statement of a naked
+ *        handler.
+ */
+#define PC_PROF_TIM6_ENTRY()                \
+    __asm volatile                          \
+    (                                       \
+        "tst   lr, #4          \n"          \
+        "ite   eq              \n"          \
+        "mrseq r0, msp         \n"          \
+        "mrsne r0, psp         \n"          \
+        "b     PcProf_Sample   \n"          \
+    )
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PC_PROF_H */
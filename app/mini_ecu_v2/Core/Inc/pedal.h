@@ -0,0 +1,159 @@
+/**
+ * @file    pedal.h
+ * @brief   Accelerator pedal on B1: EXTI edges, TIM7 debounce, throttle ramp;
+ *          or an analogue pedal sensor on ADC1.
+ *
+ * PEDAL_SOURCE_B1 (default): the blue user button (B1, PC13, active low) is the accelerator pedal.
+ * Nothing polls it:
+ *
+ *   1. Either edge raises EXTI line 13. The handler stamps the kernel tick,
+ *      masks the line and starts TIM7 in one-pulse mode for
+ *      PEDAL_DEBOUNCE_MS.
+ *   2. The TIM7 update samples the pin. If it differs from the debounced
+ *      state the edge is taken, dated to the first EXTI of the bounce
+ *      burst; otherwise it was a bounce (counted). The line is unmasked,
+ *      and a change that came while it was masked restarts step 1.
+ *
+ * Both steps run in interrupt context, so a press is taken
+ * PEDAL_DEBOUNCE_MS after the edge whatever the tasks are doing, and
+ * presses shorter than a control cycle are no longer missed.
+ *
+ * Press duration maps to a pedal position: while held the throttle rises
+ * from where it was to 100 % over PEDAL_RAMP_UP_MS, after release it falls
+ * to 0 over PEDAL_RAMP_DOWN_MS. The position is computed from the edge
+ * timestamps when it is read, so Pedal_Get() is exact at any call rate.
+ *
+ * PEDAL_SOURCE_ADC: a potentiometer pedal sensor (5 % .. 95 % of the
+ * supply over the pedal travel) on PC0, ADC1 IN10, is a fourth channel of
+ * the virtual sensor scan (vsensor.h). It shares that scan's TIM2 trigger
+ * and DMA2 Stream0 double buffer, so it costs no CPU per sample; the
+ * consumer oversamples it (the mean of 8 scans, sigcond.h AVERAGE) to
+ * 125 Hz, despikes it and range checks it, and hands the result to
+ * Pedal_OnSensor() once per block. The throttle is that position; the
+ * pedal counts as pressed above PEDAL_ADC_PRESS_PCT and released again
+ * below PEDAL_ADC_RELEASE_PCT. An open, shorted, stuck or implausible
+ * sensor (DTC PEDAL_CIRCUIT / PEDAL_RANGE) forces the throttle to 0 and
+ * releases the pedal until the sensor reads valid again. B1 and TIM7 are
+ * left alone.
+ *
+ * Each debounced edge is also published on the PEDAL topic (msg_bus.h),
+ * so a task that wants the edges themselves subscribes instead of polling
+ * Pedal_Get() for a change; VehicleTask logs them from there.
+ *
+ * "pedal" shows the state and the edge counters.
+ */
+
+#ifndef PEDAL_H
+#define PEDAL_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+#define PEDAL_SOURCE_B1         0U  /**< B1 press duration ramp. */
+#define PEDAL_SOURCE_ADC        1U  /**< Analogue pedal sensor on ADC1 (vsensor.h). */
+
+#ifndef PEDAL_SOURCE
+#define PEDAL_SOURCE            PEDAL_SOURCE_B1
+#endif
+
+/** ADC source: position (%) at which the pedal counts as pressed ... */
+#ifndef PEDAL_ADC_PRESS_PCT
+#define PEDAL_ADC_PRESS_PCT     5.0f
+#endif
+
+/** ... and below which it is released again. */
+#ifndef PEDAL_ADC_RELEASE_PCT
+#define PEDAL_ADC_RELEASE_PCT   2.0f
+#endif
+
+/** Time the pin must settle after an edge (ms, 1..6000). */
+#ifndef PEDAL_DEBOUNCE_MS
+#define PEDAL_DEBOUNCE_MS       20U
+#endif
+
+/** Hold time from 0 to 100 % throttle (ms). */
+#ifndef PEDAL_RAMP_UP_MS
+#define PEDAL_RAMP_UP_MS        1000U
+#endif
+
+/** Time from 100 % back to 0 after release (ms). */
+#ifndef PEDAL_RAMP_DOWN_MS
+#define PEDAL_RAMP_DOWN_MS      500U
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Debounced pedal state.
+ */
+typedef struct
+{
+    uint8_t  pressed;       /**< Debounced level. */
+    float    throttle;      /**< Pedal position 0..1 at the time of the call. */
+    uint32_t presses;       /**< Debounced presses since start. */
+    uint32_t bounces;       /**< Edges rejected by the debounce (B1). */
+    uint32_t edgeTick;      /**< Kernel tick of the last debounced edge. */
+    uint32_t lastPressMs;   /**< Duration of the last completed press. */
+    uint8_t  sensorFault;   /**< ADC: sensor invalid, throttle forced to 0. */
+} Pedal_State_t;
+
+/**
+ * @brief One debounced edge (PEDAL topic, msg_bus.h).
+ */
+typedef struct
+{
+    uint8_t  pressed;       /**< Level after the edge. */
+    uint32_t tick;          /**< Kernel tick of the edge (first bounce). */
+    uint32_t heldMs;        /**< Release: how long it was held. */
+} Pedal_Event_t;
+
+/**
+ * @brief Take over B1 (both edges), set up TIM7 and register "pedal"
+ *        (ADC source: only "pedal"). Call once before the scheduler starts.
+ */
+HAL_StatusTypeDef Pedal_Init(void);
+
+/**
+ * @brief Consistent copy of the pedal state (any task).
+ */
+void Pedal_Get(Pedal_State_t *out);
+
+/**
+ * @brief New conditioned pedal position (ADC source), once per sensor
+ *        block from the vsensor consumer task, the only caller.
+ *
+ * @param pct    Position 0..100 %, clamped.
+ * @param valid  0 while the sensor is open, shorted, stuck or implausible.
+ */
+void Pedal_OnSensor(float pct, uint8_t valid);
+
+/**
+ * @brief The APB1 clock changed (clock_gov.h): keep the debounce time.
+ */
+void Pedal_ClockChanged(void);
+
+/**
+ * @brief EXTI15_10 interrupt (B1 on line 13).
+ */
+void Pedal_ExtiIRQHandler(void);
+
+/**
+ * @brief TIM7 interrupt (debounce elapsed).
+ */
+void Pedal_TimerIRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PEDAL_H */
@@ -0,0 +1,132 @@
+/**
+ * @file    perf.h
+ * @brief   Cycle-accurate hot-path probes on the DWT cycle counter.
+ *
+ * Usage, inside one block:
+ *
+ *     PERF_BEGIN(CAN_RX_ISR);
+ *     ... measured code ...
+ *     PERF_END(CAN_RX_ISR);
+ *
+ * PERF_BEGIN() reads CYCCNT into a local; PERF_END() reads it again and
+ * folds the difference into the probe's count / min / max / sum and a
+ * log2 histogram. The update runs with interrupts masked for a few cycles
+ * (probes are used from ISRs and tasks alike); no allocation, no printing.
+ * "perf dump" / "perf reset" on the CLI read and clear the table.
+ *
+ * Probes compile to nothing with PERF_ENABLE = 0 (default when NDEBUG is
+ * defined).
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+#ifndef PERF_ENABLE
+#ifdef NDEBUG
+#define PERF_ENABLE         0
+#else
+#define PERF_ENABLE         1
+#endif
+#endif
+
+/** Histogram buckets: bucket b counts durations in [2^(b-1), 2^b) cycles,
+ *  the last one everything above. */
+#define PERF_HIST_BUCKETS   16U
+
+/**
+ * @brief Probe points. X(name): PERF_BEGIN(name) / PERF_END(name).
+ */
+#define PERF_PROBE_TABLE(X) \
+    X(CAN_RX_ISR)           \
+    X(CAN_RX_PROCESS)       \
+    X(CAN_TX_TELEM)         \
+    X(LOG_WRITE)            \
+    X(VEH_UPDATE)           \
+    X(CLI_DASH)             \
+    X(SENSOR_BLOCK)
+
+#define PERF_ID_ENUM_(name)  PERF_##name,
+
+typedef enum
+{
+    PERF_PROBE_TABLE(PERF_ID_ENUM_)
+    PERF_PROBE_COUNT
+} perf_id_t;
+
+/* -------------------------------------------------------------------------- */
+/* Probe macros                                                               */
+/* -------------------------------------------------------------------------- */
+
+#if PERF_ENABLE
+#define PERF_BEGIN(id)  uint32_t perf_t0_##id = DWT->CYCCNT
+#define PERF_END(id)    Perf_Record(PERF_##id, DWT->CYCCNT - perf_t0_##id)
+#else
+#define PERF_BEGIN(id)  do { } while (0)
+#define PERF_END(id)    do { } while (0)
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Statistics of one probe.
+ */
+typedef struct
+{
+    uint32_t count;
+    uint32_t min;                       /**< Cycles (UINT32_MAX if count == 0). */
+    uint32_t max;
+    uint64_t sum;
+    uint32_t hist[PERF_HIST_BUCKETS];
+} Perf_Stats_t;
+
+/**
+ * @brief Start the cycle counter, clear the table, measure the probe
+ *        overhead and register the "perf" commands. Call once from main().
+ */
+void Perf_Init(void);
+
+/**
+ * @brief Fold one measurement into a probe (used by PERF_END()).
+ */
+void Perf_Record(perf_id_t id, uint32_t cycles);
+
+/**
+ * @brief Clear all probes.
+ */
+void Perf_Reset(void);
+
+/**
+ * @brief Consistent copy of one probe.
+ *
+ * @return HAL_OK, or HAL_ERROR for an invalid id.
+ */
+HAL_StatusTypeDef Perf_Get(perf_id_t id, Perf_Stats_t *out);
+
+/**
+ * @brief Name of a probe as written in PERF_PROBE_TABLE (NULL if invalid).
+ */
+const char *Perf_Name(perf_id_t id);
+
+/**
+ * @brief Cycles an empty PERF_BEGIN()/PERF_END() pair adds to a measurement.
+ */
+uint32_t Perf_Overhead(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PERF_H */
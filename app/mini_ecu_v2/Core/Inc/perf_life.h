@@ -0,0 +1,130 @@
+/**
+ * @file    perf_life.h
+ * @brief   Lifetime performance counters: totals and extremes of the
+ *          run-time figures, kept over resets.
+ *
+ * The figures of raster.h, ctrl_loop.h, rtos_stats.h, log.h, can_stats.h,
+ * can_ring.h, can_if.h and crank.h count from boot (or their last reset
+ * command), so an overload in the field is gone after the next reset.
+ * PerfLife_Event100ms() samples them and folds each into a lifetime value
+ * of PERF_LIFE_COUNTER_TABLE:
+ *
+ *   SUM   adds what the figure grew by since the last sample (all of it if
+ *         it went down: it was reset)
+ *   MAX   keeps the highest value seen, MIN the lowest
+ *   BOOT  counts starts: COLD_STARTS without a valid block (power-on,
+ *         first boot), WARM_RESETS with one
+ *
+ * The lifetime values are one NOINIT block (sram_layout.h) with magic,
+ * layout word and CRC-32, rewritten with its CRC after every sample, so a
+ * reset of any kind (watchdog, crash, software, bootloader) keeps them up
+ * to the last 100 ms. A power loss does not: for that the values persist
+ * in the flash log (nvm_log.h), two per record, every PERF_LIFE_SAVE_MIN
+ * minutes, on "perf life save" and before a reset into the bootloader,
+ * only the records that changed. The first sample after boot merges the
+ * two: a valid block where it is ahead of the log, the log otherwise.
+ *
+ * UDS reads each value as DID UDS_DID_PERF_LIFE_BASE + counter (u32, uds.h).
+ *
+ *   perf life             lifetime values and this boot's figures
+ *   perf life save        write the changed values to flash now
+ *   perf life clear       clear the lifetime values
+ */
+
+#ifndef PERF_LIFE_H
+#define PERF_LIFE_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Uptime between two batches to the flash log while values change
+ *  (minutes). */
+#ifndef PERF_LIFE_SAVE_MIN
+#define PERF_LIFE_SAVE_MIN      10U
+#endif
+
+#define PERF_LIFE_MAGIC         0x4546494CU   /* "LIFE" */
+
+/**
+ * @brief Counters. X(name, kind, unit): PERF_LIFE_<name>, kind SUM, MAX,
+ *        MIN or BOOT. Append only: the index is the flash record key and
+ *        the DID; a change in count drops the NOINIT block once.
+ */
+#define PERF_LIFE_COUNTER_TABLE(X)                              \
+    X(COLD_STARTS,       BOOT, "starts")                        \
+    X(WARM_RESETS,       BOOT, "resets")                        \
+    X(UPTIME,            SUM,  "s")                             \
+    X(RASTER_OVERRUNS,   SUM,  "cycles")                        \
+    X(RASTER_MAX,        MAX,  "us")                            \
+    X(BUDGET_OVERS,      SUM,  "runs")                          \
+    X(CTRL_MISSED,       SUM,  "steps")                         \
+    X(CTRL_OVERRUNS,     SUM,  "steps")                         \
+    X(CTRL_EXEC_MAX,     MAX,  "us")                            \
+    X(CPU_PEAK,          MAX,  "permille")                      \
+    X(STACK_FREE_MIN,    MIN,  "bytes")                         \
+    X(LOG_DROPPED,       SUM,  "lines")                         \
+    X(LOG_PEAK_FILL,     MAX,  "bytes")                         \
+    X(CAN_FIFO_OVERRUNS, SUM,  "frames")                        \
+    X(CAN_RX_RING_DROPS, SUM,  "frames")                        \
+    X(CAN_RX_RING_PEAK,  MAX,  "frames")                        \
+    X(CAN_TX_DROPPED,    SUM,  "frames")                        \
+    X(CAN_TX_PEAK,       MAX,  "frames")                        \
+    X(CRANK_ISR_MAX,     MAX,  "cycles")
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+#define PERF_LIFE_ENUM_(name, kind, unit)  PERF_LIFE_##name,
+
+typedef enum
+{
+    PERF_LIFE_COUNTER_TABLE(PERF_LIFE_ENUM_)
+    PERF_LIFE_COUNT
+} PerfLife_Id_t;
+
+/**
+ * @brief Join the flash log and register "perf life". Call once before
+ *        NvmLog_Init(), which restores the values.
+ */
+void PerfLife_Init(void);
+
+/**
+ * @brief Sample the figures into the NOINIT block, the first call merges
+ *        it with the flash log; queues a batch when one is due (100 ms
+ *        raster runnable).
+ */
+void PerfLife_Event100ms(void);
+
+/**
+ * @brief Queue the values that changed since the last batch for the flash
+ *        log (any task).
+ * @return Records queued.
+ */
+uint32_t PerfLife_Save(void);
+
+/**
+ * @brief Clear the lifetime values, in the block and in the flash log.
+ */
+void PerfLife_Clear(void);
+
+/**
+ * @brief Lifetime value of counter @p id into @p value.
+ * @return 1, or 0 for an unknown id or before the first sample;
+ *         a MIN counter without a sample reads UINT32_MAX.
+ */
+uint32_t PerfLife_Get(uint32_t id, uint32_t *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PERF_LIFE_H */
@@ -0,0 +1,130 @@
+/**
+ * @file    platform_dma.h
+ * @brief   DMA buffers and data cache maintenance, for parts with and
+ *          without a data cache.
+ *
+ * The F446 (Cortex-M4) has no data cache: a DMA stream and the CPU see the
+ * same SRAM, and every call below compiles to nothing. A Cortex-M7 part
+ * (F7, H7) caches SRAM, so a DMA write stays invisible behind a cached
+ * line and a CPU write can sit in the cache while the stream reads stale
+ * memory. The DMA paths handle that through this layer instead of through
+ * part-specific code:
+ *
+ *   - PLATFORM_DMA_BUFFER places a buffer with the other DMA buffers
+ *     (SRAM2_DMA, sram_layout.h), aligned to a cache line, on every part,
+ *     so a layout that fits the F446 fits the M7 as it is;
+ *   - PlatformDma_Init() maps that section as a non-cacheable MPU region
+ *     (PLATFORM_DMA_MPU_REGION) and then enables the caches. The buffers
+ *     then need no maintenance, and the calls below return at once for
+ *     them. With PLATFORM_DMA_NOCACHE = 0 the section stays cached and
+ *     the calls maintain it by address;
+ *   - PlatformDma_Clean() before a stream reads memory the CPU wrote (UART
+ *     TX, the crank table, QSPI program, a copy source);
+ *   - PlatformDma_Invalidate() after a stream wrote memory, before the CPU
+ *     reads it (UART RX, ADC, input capture, a copy destination).
+ *
+ * Both calls act on whole cache lines. Cleaning more than asked only
+ * writes lines back, so PlatformDma_Clean() takes any memory. Invalidating
+ * throws away whatever else the lines hold, so PlatformDma_Invalidate()
+ * takes only lines that belong to the buffer: a PLATFORM_DMA_BUFFER object
+ * whose size is a multiple of PLATFORM_DMA_ALIGN. DmaCopy_Start() copies
+ * the partial lines at the ends of a destination on the CPU for the same
+ * reason (dma_copy.h).
+ *
+ * The M7 linker script aligns the DMA section (_ssram2 .. _esram2) to its
+ * size rounded up to a power of two, as the MPU requires. If it is not
+ * aligned, PlatformDma_Init() leaves the section cached, and the calls
+ * maintain it by address as with PLATFORM_DMA_NOCACHE = 0.
+ */
+
+#ifndef PLATFORM_DMA_H
+#define PLATFORM_DMA_H
+
+#include "main.h"
+#include "sram_layout.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = the core has a data cache; taken from the CMSIS device header. */
+#ifndef PLATFORM_DCACHE
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+#define PLATFORM_DCACHE         1
+#else
+#define PLATFORM_DCACHE         0
+#endif
+#endif
+
+/** 1 = the MPU maps the DMA buffer section non-cacheable; 0 = cached,
+ *  maintained by address. Parts without a data cache ignore it. */
+#ifndef PLATFORM_DMA_NOCACHE
+#define PLATFORM_DMA_NOCACHE    1
+#endif
+
+/** MPU region of the DMA buffer section (0 and 1: stack guards, rtos_stack.h). */
+#ifndef PLATFORM_DMA_MPU_REGION
+#define PLATFORM_DMA_MPU_REGION 2U
+#endif
+
+/** Cortex-M7 cache line (bytes): alignment of every DMA buffer, on any part. */
+#define PLATFORM_DMA_ALIGN      32U
+
+/** DMA buffer in the DMA section, aligned to a cache line. */
+#define PLATFORM_DMA_BUFFER     SRAM2_DMA __attribute__((aligned(PLATFORM_DMA_ALIGN)))
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Map the DMA section non-cacheable and enable the caches (M7);
+ *        nothing on a part without a data cache. Call first in main(),
+ *        before any DMA runs.
+ */
+void PlatformDma_Init(void);
+
+#if PLATFORM_DCACHE
+void PlatformDma_CleanLines(const void *addr, uint32_t len);
+void PlatformDma_InvalidateLines(void *addr, uint32_t len);
+#endif
+
+/**
+ * @brief Write the CPU's data in @p len bytes at @p addr back to memory
+ *        before a DMA stream reads them. Any memory; any context.
+ */
+static inline void PlatformDma_Clean(const void *addr, uint32_t len)
+{
+#if PLATFORM_DCACHE
+    PlatformDma_CleanLines(addr, len);
+#else
+    (void)addr;
+    (void)len;
+#endif
+}
+
+/**
+ * @brief Drop the cached copy of @p len bytes at @p addr after a DMA
+ *        stream wrote them, before the CPU reads them. Lines of a
+ *        PLATFORM_DMA_BUFFER object only; any context.
+ */
+static inline void PlatformDma_Invalidate(void *addr, uint32_t len)
+{
+#if PLATFORM_DCACHE
+    PlatformDma_InvalidateLines(addr, len);
+#else
+    (void)addr;
+    (void)len;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PLATFORM_DMA_H */
@@ -0,0 +1,101 @@
+/**
+ * @file    powertrain.h
+ * @brief   Engine and gearbox of the vehicle model, from calibration maps.
+ *
+ * With VEHICLE_POWERTRAIN (vehicle.h) Vehicle_Update() drives the car
+ * through these functions in place of a fixed RPM line:
+ *
+ *   1. engine torque from CAL map PT_TORQUE over throttle x engine rpm,
+ *      bilinear (Lut_Interp2F32());
+ *   2. wheel force = torque x gear ratio (PT_GEAR_RATIO) x PT_FINAL_DRIVE x
+ *      POWERTRAIN_EFFICIENCY / wheel radius, and the acceleration it gives
+ *      PT_MASS_KG; coasting (VEH_DECAY) stays the model's drag;
+ *   3. the gearbox shifts up once the speed reaches PT_SHIFT_UP for the
+ *      gear at this throttle, and down once it falls PT_SHIFT_HYST below
+ *      the upshift of the gear below, one gear per step; flooring the
+ *      pedal raises the upshift points and so kicks down;
+ *   4. the engine turns at wheel speed x gear ratio x final drive, at
+ *      least POWERTRAIN_IDLE_RPM (the clutch slips below); the model's
+ *      RPM lag follows it.
+ *
+ * The axes are fixed here (POWERTRAIN_*_AXIS); the maps and scalars are
+ * calibration (cal.h), so "cal map set" changes the car on the next step.
+ * The axis reciprocals are worked out by Powertrain_Init().
+ *
+ *   pt                   gear, torque and the shift points now
+ */
+
+#ifndef POWERTRAIN_H
+#define POWERTRAIN_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Forward gears (PT_GEAR_RATIO columns, PT_SHIFT_UP rows + 1). */
+#define POWERTRAIN_GEARS            6U
+
+/** Throttle breakpoints (0..1): PT_SHIFT_UP columns, PT_TORQUE rows. */
+#define POWERTRAIN_THROTTLE_POINTS  5U
+#define POWERTRAIN_THROTTLE_AXIS    0.0f, 0.25f, 0.5f, 0.75f, 1.0f
+
+/** Engine speed breakpoints (rpm): PT_TORQUE columns. */
+#define POWERTRAIN_RPM_POINTS       8U
+#define POWERTRAIN_RPM_AXIS         800.0f, 1500.0f, 2000.0f, 2500.0f, \
+                                    3000.0f, 4000.0f, 5000.0f, 6000.0f
+
+/** Lowest engine speed in gear (rpm): the clutch slips below it. */
+#ifndef POWERTRAIN_IDLE_RPM
+#define POWERTRAIN_IDLE_RPM         800.0f
+#endif
+
+/** Rolling circumference of a driven wheel (m). */
+#ifndef POWERTRAIN_WHEEL_CIRC_M
+#define POWERTRAIN_WHEEL_CIRC_M     1.95f
+#endif
+
+/** Share of the engine torque that reaches the wheels. */
+#ifndef POWERTRAIN_EFFICIENCY
+#define POWERTRAIN_EFFICIENCY       0.90f
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Set up the map axes and register "pt". Call once before the
+ *        first Vehicle_Update().
+ */
+void Powertrain_Init(void);
+
+/** Engine torque (Nm) at @p rpm and @p throttle (0..1). */
+float Powertrain_Torque(float rpm, float throttle);
+
+/**
+ * @brief Acceleration (km/h per second) the engine gives at @p rpm and
+ *        @p throttle in @p gear (1..POWERTRAIN_GEARS), before drag.
+ */
+float Powertrain_AccelKph(uint8_t gear, float rpm, float throttle);
+
+/**
+ * @brief Gear after this step at @p speed_kph and @p throttle: @p gear,
+ *        one up or one down.
+ */
+uint8_t Powertrain_Shift(uint8_t gear, float speed_kph, float throttle);
+
+/** Engine speed (rpm) that @p speed_kph turns it at in @p gear. */
+float Powertrain_EngineRpm(uint8_t gear, float speed_kph);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* POWERTRAIN_H */
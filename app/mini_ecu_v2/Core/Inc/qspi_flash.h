@@ -0,0 +1,175 @@
+/**
+ * @file    qspi_flash.h
+ * @brief   Quad-SPI NOR flash: DMA page programs, sector erase and
+ *          memory-mapped reads.
+ *
+ * A register-level driver for the QUADSPI peripheral (no HAL QSPI module
+ * in this tree) and a serial NOR flash with the common command set
+ * (W25Q, MT25Q, IS25LP, ...): 256-byte pages, 4 KB sectors.
+ *
+ * Pins: on the 64-pin F446RE, bank 1 has no IO2 and CAN1 / the vsensor ADC
+ * use the others, so the flash sits on bank 2 (CR.FSEL):
+ *
+ *   PB2  CLK  (AF9)      PC11 BK2_NCS (AF9, pull-up)
+ *   PA6  IO0  (AF10)     PA7  IO1     (AF10)
+ *   PC4  IO2  (AF10)     PC5  IO3     (AF10)
+ *
+ * The QSPI clock is HCLK / n, the smallest n that stays at or below
+ * QSPI_FLASH_MAX_HZ (60 MHz at the 180 MHz profile).
+ *
+ * Reads: the flash is mapped at QSPI_FLASH_MAP_BASE (quad output fast
+ * read, 0x6B) whenever no command runs, so a reader takes a pointer from
+ * QspiFlash_Map() and reads it like memory.
+ *
+ * Writes and erases run in the background, driven by the QUADSPI
+ * interrupt:
+ *
+ *   program: WREN, quad page program (0x32) with DMA2 Stream7 feeding the
+ *            FIFO from the caller's buffer, then automatic status polling
+ *            until WIP clears
+ *   erase:   WREN, sector (0x20) or chip (0xC7) erase, status polling
+ *
+ * The CPU only sets each step up; the poll runs in the peripheral. When
+ * the operation ends QspiFlash_DoneCallback() runs in the interrupt, which
+ * is where the next one is started (ext_log.c). QspiFlash_Kick() runs it
+ * from the interrupt without an operation, so a task or an ISR of any
+ * priority can start one by pending the interrupt.
+ *
+ * A part above 16 MB is put in 4-byte address mode (0xB7) at init; the
+ * mapped window limits it to 256 MB.
+ */
+
+#ifndef QSPI_FLASH_H
+#define QSPI_FLASH_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = QSPI flash driver built in (needs the chip wired as above). */
+#ifndef QSPI_FLASH_ENABLE
+#define QSPI_FLASH_ENABLE       0
+#endif
+
+/** log2 of the flash size in bytes (24 = 16 MB, W25Q128JV). */
+#ifndef QSPI_FLASH_SIZE_LOG2
+#define QSPI_FLASH_SIZE_LOG2    24U
+#endif
+
+/** Highest QSPI clock; quad output fast read with 8 dummy cycles. */
+#ifndef QSPI_FLASH_MAX_HZ
+#define QSPI_FLASH_MAX_HZ       80000000U
+#endif
+
+/** 1 = quad enable is bit 1 of status register 2 (Winbond, 0x35 / 0x31). */
+#ifndef QSPI_FLASH_QE_SR2
+#define QSPI_FLASH_QE_SR2       1
+#endif
+
+/** NVIC priority of the QUADSPI interrupt (may use FreeRTOS FromISR calls). */
+#ifndef QSPI_FLASH_IRQ_PRIO
+#define QSPI_FLASH_IRQ_PRIO     7U
+#endif
+
+#define QSPI_FLASH_SIZE         (1UL << QSPI_FLASH_SIZE_LOG2)
+#define QSPI_FLASH_PAGE_SIZE    256U
+#define QSPI_FLASH_SECTOR_SIZE  4096U
+#define QSPI_FLASH_MAP_BASE     0x90000000UL
+
+/** QspiFlash_StartErase() size for the whole chip. */
+#define QSPI_FLASH_CHIP         0U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    QSPI_FLASH_OP_NONE = 0,     /**< QspiFlash_Kick(). */
+    QSPI_FLASH_OP_PROGRAM,
+    QSPI_FLASH_OP_ERASE
+} QspiFlash_Op_t;
+
+/**
+ * @brief Counters since init.
+ */
+typedef struct
+{
+    uint32_t jedecId;       /**< Manufacturer, type, capacity (0x9F). */
+    uint32_t clockHz;
+    uint32_t programs;
+    uint32_t erases;
+    uint32_t errors;        /**< Transfer errors and aborted operations. */
+    uint32_t lastOpUs;      /**< Duration of the last program or erase. */
+    uint32_t maxProgramUs;
+    uint32_t maxEraseUs;
+} QspiFlash_Stats_t;
+
+/**
+ * @brief Pins, clock, chip reset and JEDEC ID, quad enable, address mode;
+ *        ends mapped.
+ *
+ * @return HAL_OK, or HAL_ERROR if no flash answers (ID 0 or all ones).
+ */
+HAL_StatusTypeDef QspiFlash_Init(void);
+
+/**
+ * @brief Start programming @p len bytes (within one page) at @p addr.
+ *
+ * @p data is read by DMA until QspiFlash_DoneCallback(), so it must stay
+ * untouched until then.
+ *
+ * @return HAL_OK, HAL_BUSY while an operation runs, HAL_ERROR for a range
+ *         that crosses a page or the end of the flash.
+ */
+HAL_StatusTypeDef QspiFlash_StartProgram(uint32_t addr, const uint8_t *data, uint32_t len);
+
+/**
+ * @brief Start erasing the 4 KB sector at @p addr, or the whole chip when
+ *        @p size is QSPI_FLASH_CHIP (tens of seconds).
+ *
+ * @return As QspiFlash_StartProgram().
+ */
+HAL_StatusTypeDef QspiFlash_StartErase(uint32_t addr, uint32_t size);
+
+/** 1 while a program or erase runs. */
+uint8_t QspiFlash_Busy(void);
+
+/** Stop the running operation without a callback (counted as an error);
+ *  the chip may still finish it internally. */
+void QspiFlash_Abort(void);
+
+/**
+ * @brief Map the flash for reading.
+ *
+ * @return QSPI_FLASH_MAP_BASE as a pointer, or NULL while an operation runs.
+ */
+const uint8_t *QspiFlash_Map(void);
+
+/** Run QspiFlash_DoneCallback(QSPI_FLASH_OP_NONE, HAL_OK) from the
+ *  interrupt (safe from any context). */
+void QspiFlash_Kick(void);
+
+void QspiFlash_GetStats(QspiFlash_Stats_t *st);
+
+/** QUADSPI interrupt (stm32f4xx_it.c). */
+void QspiFlash_IRQHandler(void);
+
+/**
+ * @brief From the QUADSPI interrupt, with the driver idle: @p op finished
+ *        with @p status, or QspiFlash_Kick(). Weak; ext_log.c overrides it.
+ */
+void QspiFlash_DoneCallback(QspiFlash_Op_t op, HAL_StatusTypeDef status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QSPI_FLASH_H */
@@ -0,0 +1,85 @@
+/**
+ * @file    ramfunc.h
+ * @brief   Interrupt hot paths executed from SRAM.
+ *
+ * The F446 has a single flash bank: while a sector is erased (up to 2 s for
+ * a 128 KB sector) or a word is programmed, every read from flash stalls the
+ * bus, and at 180 MHz a fetch that misses the ART cache costs 5 wait states.
+ * Code in the .ramfunc section is copied to SRAM by the startup code and
+ * runs from there with a fixed fetch time, flash busy or not.
+ *
+ * RamFunc_Init() also copies the vector table to SRAM and points VTOR at
+ * it, so the exception entry itself does not read flash either. In SRAM
+ * are:
+ *
+ *   - CAN RX: CAN1_RX0/RX1_IRQHandler, HAL_CAN_IRQHandler, the FIFO drain
+ *     and the RX ring push, CanRxLimit_Admit(), CanStats_OnRx(),
+ *     CanTrace_OnRx() and ExtLog_OnCanRx() with its page staging and
+ *     QspiFlash_Kick(),
+ *     TimeSync_OnCanRx() and the global time behind their stamps
+ *     (time_sync.h), the ISR decoders (CAN_IF_RegisterIsrDecoder(), the
+ *     signal cache's) with CanE2E_Check() and LowPower_OnCanRx(), and the
+ *     CEC_IRQHandler hand-off of CAN_IF_RX_FAST_IRQ
+ *   - the gateway: CAN2_RX0_IRQHandler, the routes (can_gw.c) and the TX
+ *     submit into the other bus (mailbox, can_txq, CanStats_OnTx())
+ *   - CAN TX: CAN1/CAN2_TX_IRQHandler, the mailbox callbacks and the
+ *     refill from can_txq, TimeSync_OnTxConfirm() and CanSched_Notify(),
+ *     so frames queued before a flash operation keep leaving during it
+ *   - UART RX: USART2_IRQHandler and DMA1_Stream5_IRQHandler with their
+ *     HAL handlers and the CLI wake-up
+ *   - the control loop release: TIM5_IRQHandler and
+ *     CtrlLoop_TimerIRQHandler()
+ *   - the crank tooth capture and angle events: TIM4_IRQHandler,
+ *     Crank_CaptureIRQHandler() (crank.h), AngleSched_ToothIRQ() and
+ *     AngleSched_CompareIRQHandler() (angle_sched.h)
+ *   - SysTick_Handler, and the kernel's tick, PendSV context switch and
+ *     the task notification behind osThreadFlagsSet() from an ISR
+ *   - the HAL flash program/erase functions and their busy wait
+ *   - RtosTrace_Record(), which the kernel trace hooks call from the
+ *     paths above (rtos_trace.h), and RtosStack_GuardSwitch() of the
+ *     switch-in hook (rtos_stack.h)
+ *
+ * Own code is marked RAMFUNC; generated and vendor code (stm32f4xx_it.c,
+ * HAL, FreeRTOS) is placed by function name in STM32F446RETX_FLASH.ld, so
+ * its sources stay untouched. A function called from these paths must be
+ * in the list as well, or it stalls on the first fetch during a flash
+ * operation; calls between flash and SRAM go through linker veneers.
+ *
+ * For CAN RX to continue through an erase or program, the task doing it
+ * suspends the scheduler around the operation (vTaskSuspendAll()): the
+ * interrupts keep running from SRAM, frames queue in the RX ring, and no
+ * flash-resident task is switched in until the flash is idle again.
+ */
+
+#ifndef RAMFUNC_H
+#define RAMFUNC_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Place a function in the .ramfunc section (executed from SRAM). */
+#ifndef RAMFUNC
+#define RAMFUNC  __attribute__((section(".ramfunc")))
+#endif
+
+/**
+ * @brief Copy the vector table to SRAM and switch VTOR to it.
+ *
+ * Call first in main(), before HAL_Init() enables SysTick.
+ */
+void RamFunc_Init(void);
+
+/**
+ * @brief Bytes of code copied to SRAM by the startup code.
+ */
+uint32_t RamFunc_CodeSize(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAMFUNC_H */
@@ -0,0 +1,280 @@
+/**
+ * @file    raster.h
+ * @brief   Fixed-raster scheduler: runnables in 1 / 10 / 100 ms slots.
+ *
+ * Periodic features are runnables, void functions registered at compile
+ * time in RASTER_RUNNABLE_TABLE below, instead of tasks of their own. Each
+ * raster with at least one runnable gets one task, which calls its
+ * runnables in table order once per period:
+ *
+ *   | Raster | Period | Task priority          |
+ *   |--------|--------|------------------------|
+ *   | 1MS    |   1 ms | osPriorityAboveNormal2 |
+ *   | 10MS   |  10 ms | osPriorityAboveNormal1 |
+ *   | 100MS  | 100 ms | osPriorityNormal1      |
+ *
+ * Shorter rasters preempt longer ones (rate monotonic) and CliTask; the
+ * timer-released control loop (ctrl_loop.h) stays above all of them. A
+ * raster without runnables creates no task and reserves no stack, so a
+ * feature costs a table entry and its stack depth, not a task control
+ * block, a stack and its context switches.
+ *
+ * All rasters are released from the same kernel tick, so the 10 and
+ * 100 ms slots stay in phase with the 1 ms one. A runnable must not block.
+ *
+ * Per runnable the scheduler records calls, mean and max execution time
+ * (DWT cycles, preemption included), a log2 histogram of the activations
+ * and the runs over its budget; per raster the releases and the overruns,
+ * i.e. cycles that ended after the next release was due. "raster" shows
+ * them, "raster hist" the histograms, "raster reset" clears them.
+ *
+ * Budget monitor: the budget of a runnable is its worst-case execution
+ * time. A run over it fails DTC_RUNTIME_BUDGET (dtc.h), which passes again
+ * after RASTER_BUDGET_PASS_MS without one, and with RASTER_BUDGET_LOG
+ * writes a warning naming the runnable, held to the call site's rate
+ * limit (log.h) so a runnable that overruns every cycle cannot flood the
+ * log.
+ */
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#include "main.h"
+#include "angle_sched.h"
+#include "can_nm.h"
+#include "clock_gov.h"
+#include "crank.h"
+#include "cruise.h"
+#include "ext_log.h"
+#include "fan_ctrl.h"
+#include "fault_inj.h"
+#include "flash_scrub.h"
+#include "freeze_frame.h"
+#include "perf_life.h"
+#include "sig_hist.h"
+#include "vehicle_fleet.h"
+#include "time_sync.h"
+#include "timer_wheel.h"
+#include "tlm_stream.h"
+#include "uart_baud.h"
+#include "xcp.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Histogram buckets: bucket b counts runs of [2^(b-1), 2^b) us, bucket 0
+ *  those under 1 us, the last one everything above. */
+#define RASTER_HIST_BUCKETS     12U
+
+/** Time without a run over budget before DTC_RUNTIME_BUDGET passes. */
+#ifndef RASTER_BUDGET_PASS_MS
+#define RASTER_BUDGET_PASS_MS   10000U
+#endif
+
+/** 1: log a warning (rate limited) for a run over budget. */
+#ifndef RASTER_BUDGET_LOG
+#define RASTER_BUDGET_LOG       1
+#endif
+
+#if VEHICLE_FLEET_SIZE > 0U
+#define RASTER_FLEET_(X)        X(100MS, App_Fleet100ms, 2000U)
+#else
+#define RASTER_FLEET_(X)
+#endif
+
+/* XCP DAQ event channels (xcp.h); an idle event returns at once. */
+#if XCP_ENABLE
+#define RASTER_XCP_(X)                                  \
+    X(1MS,   Xcp_Event1ms,   100U)                      \
+    X(10MS,  Xcp_Event10ms,  200U)                      \
+    X(100MS, Xcp_Event100ms, 200U)
+#else
+#define RASTER_XCP_(X)
+#endif
+
+/* Telemetry stream (tlm_stream.h); returns at once while stopped. */
+#if TLM_STREAM_ENABLE
+#define RASTER_TLM_(X)          X(1MS, TlmStream_Event1ms, 100U)
+#else
+#define RASTER_TLM_(X)
+#endif
+
+/* Console baud switch timeout (uart_baud.h); returns at once unless pending. */
+#if UART_BAUD_ENABLE
+#define RASTER_BAUD_(X)         X(100MS, UartBaud_Event100ms, 50U)
+#else
+#define RASTER_BAUD_(X)
+#endif
+
+/* Clock governor (clock_gov.h): load window, and a profile switch when due. */
+#if CLOCK_GOV_ENABLE
+#define RASTER_CLKGOV_(X)       X(100MS, ClockGov_Event100ms, 1000U)
+#else
+#define RASTER_CLKGOV_(X)
+#endif
+
+/* QSPI flash recorder (ext_log.h): closes a stale page, watches the flash. */
+#if EXT_LOG_ENABLE
+#define RASTER_XLOG_(X)         X(100MS, ExtLog_Event100ms, 50U)
+#else
+#define RASTER_XLOG_(X)
+#endif
+
+/* Signal history (sig_hist.h): one sample per signal, closes due buckets. */
+#if SIG_HIST_ENABLE
+#define RASTER_HIST_(X)         X(100MS, SigHist_Event100ms, 100U)
+#else
+#define RASTER_HIST_(X)
+#endif
+
+/* Fault engine (fault_inj.h): heads of its timeline, delayed frames. */
+#if FAULT_INJ_ENABLE
+#define RASTER_FAULT_(X)        X(10MS, FaultInj_Event10ms, 50U)
+#else
+#define RASTER_FAULT_(X)
+#endif
+
+/* Radiator fan PI (fan_ctrl.h) at FAN_CTRL_HZ. */
+#if FAN_CTRL_ENABLE && (FAN_CTRL_HZ == 1000U)
+#define RASTER_FAN_(X)          X(1MS, FanCtrl_Step, 30U)
+#elif FAN_CTRL_ENABLE
+#define RASTER_FAN_(X)          X(10MS, FanCtrl_Step, 30U)
+#else
+#define RASTER_FAN_(X)
+#endif
+
+/* Cruise control PI (cruise.h) at CRUISE_HZ; returns at once while off. */
+#if CRUISE_ENABLE && (CRUISE_HZ == 1000U)
+#define RASTER_CRUISE_(X)       X(1MS, Cruise_Step, 50U)
+#elif CRUISE_ENABLE
+#define RASTER_CRUISE_(X)       X(10MS, Cruise_Step, 50U)
+#else
+#define RASTER_CRUISE_(X)
+#endif
+
+/* Crank wheel (crank.h): generator speed, stall check, benchmark. */
+#if CRANK_ENABLE
+#define RASTER_CRANK_(X)        X(10MS, Crank_Event10ms, 20U)
+#else
+#define RASTER_CRANK_(X)
+#endif
+
+/* Crank-angle events (angle_sched.h): the benchmark sweep. */
+#if ANGLE_SCHED_ENABLE
+#define RASTER_ANGLE_(X)        X(10MS, AngleSched_Event10ms, 10U)
+#else
+#define RASTER_ANGLE_(X)
+#endif
+
+/* Flash scrubber (flash_scrub.h): pass start and the DTC report. */
+#if FLASH_SCRUB_ENABLE
+#define RASTER_SCRUB_(X)        X(100MS, FlashScrub_Event100ms, 30U)
+#else
+#define RASTER_SCRUB_(X)
+#endif
+
+/**
+ * @brief Registered runnables. X(raster, function, budget us), called in
+ *        this order within a raster; the budget is the runnable's WCET.
+ */
+#define RASTER_RUNNABLE_TABLE(X)                        \
+    X(1MS,   TimerWheel_Event1ms, 50U)                  \
+    X(100MS, App_Heartbeat100ms, 50U)                   \
+    X(100MS, FreezeFrame_Event100ms, 30U)               \
+    X(100MS, CanNm_Event100ms, 50U)                     \
+    X(100MS, TimeSync_Event100ms, 20U)                  \
+    X(100MS, PerfLife_Event100ms, 200U)                 \
+    RASTER_FLEET_(X)                                    \
+    RASTER_XCP_(X)                                      \
+    RASTER_TLM_(X)                                      \
+    RASTER_BAUD_(X)                                     \
+    RASTER_CLKGOV_(X)                                   \
+    RASTER_XLOG_(X)                                     \
+    RASTER_HIST_(X)                                     \
+    RASTER_FAULT_(X)                                    \
+    RASTER_FAN_(X)                                      \
+    RASTER_CRUISE_(X)                                   \
+    RASTER_CRANK_(X)                                    \
+    RASTER_ANGLE_(X)                                    \
+    RASTER_SCRUB_(X)
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    RASTER_1MS = 0,
+    RASTER_10MS,
+    RASTER_100MS,
+    RASTER_COUNT
+} Raster_Id_t;
+
+#define RASTER_DECLARE_(raster, fn, budgetUs)   void fn(void);
+RASTER_RUNNABLE_TABLE(RASTER_DECLARE_)
+
+#define RASTER_COUNT_(raster, fn, budgetUs)     + 1U
+/** Runnables in the table. */
+#define RASTER_RUNNABLES        (0U RASTER_RUNNABLE_TABLE(RASTER_COUNT_))
+
+/**
+ * @brief Figures of one runnable.
+ */
+typedef struct
+{
+    uint32_t calls;
+    uint32_t overBudget;    /**< Runs longer than the budget. */
+    uint32_t maxUs;
+    uint64_t sumUs;
+    uint32_t hist[RASTER_HIST_BUCKETS];     /**< Runs per execution time. */
+} Raster_RunStats_t;
+
+/**
+ * @brief Figures of one raster.
+ */
+typedef struct
+{
+    uint32_t releases;      /**< Cycles run. */
+    uint32_t overruns;      /**< Cycles that ended after the next release. */
+    uint32_t maxUs;         /**< Longest cycle (all runnables). */
+} Raster_Stats_t;
+
+/**
+ * @brief Create the raster tasks and register the "raster" commands.
+ *        Call after osKernelInitialize().
+ *
+ * @return HAL_OK, or HAL_ERROR if a task cannot be created.
+ */
+HAL_StatusTypeDef Raster_Init(void);
+
+/**
+ * @brief Copy the figures of the @p index-th runnable of the table.
+ *
+ * @param[out] raster Its raster, may be NULL.
+ * @param[out] name   Its function name, may be NULL.
+ * @return HAL_OK, or HAL_ERROR past the last runnable.
+ */
+HAL_StatusTypeDef Raster_GetRunnable(uint32_t index, Raster_Id_t *raster, const char **name,
+                                     Raster_RunStats_t *stats);
+
+/**
+ * @brief Copy the figures of a raster.
+ */
+HAL_StatusTypeDef Raster_GetStats(Raster_Id_t raster, Raster_Stats_t *stats);
+
+/**
+ * @brief Clear all raster and runnable figures.
+ */
+void Raster_ResetStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RASTER_H */
@@ -0,0 +1,92 @@
+/**
+ * @file    rtos_fpu.h
+ * @brief   Which tasks use the FPU, and what it costs them at a context
+ *          switch.
+ *
+ * The Cortex-M4F stacks the FPU registers only for a thread that has used
+ * them: the first floating-point instruction sets CONTROL.FPCA, and from
+ * then on every exception entry of that thread reserves the extended frame
+ * (s0-s15 and FPSCR, 72 B more) and the port's PendSV saves s16-s31 as
+ * well (64 B more). Lazy stacking defers the hardware half until a handler
+ * touches the FPU, but PendSV does; a switch away from such a task moves
+ * 34 more words each way and needs 136 B more of its stack. FPCA is never
+ * cleared by the hardware, so one float in a rarely taken path makes every
+ * later switch of that task an extended one.
+ *
+ * Policy: float math belongs to the control path, VehicleTask, SensorTask
+ * and the rasters, which switch with the FPU context anyway. CanRxTask
+ * and CanTxTask run on integers: the telemetry frame is packed from the
+ * raw image VehicleTask publishes (MSG_TOPIC_TELEMETRY, the generated
+ * CanSig_*_Raw_t), decoded into the signal cache as raw values that
+ * readers scale, and the trip frames are computed in fixed point. The log
+ * tasks never format: a float argument is formatted, or tokenized, by the
+ * task that logs it.
+ *
+ * What is left (UDS scaling, also of the 0x2A periodic DIDs CanTxTask
+ * streams, an XCP write of a float calibration value) runs on request or
+ * subscription only, so those tasks call RtosFpu_Release() just before
+ * they block: the next switch saves the basic frame unless they touched
+ * the FPU again. "top" shows each task's switches per second and the
+ * share that carried the FPU context (traceTASK_SWITCHED_OUT,
+ * rtos_trace.h), so a float that slips back into one of them shows up.
+ */
+
+#ifndef RTOS_FPU_H
+#define RTOS_FPU_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 0: RtosFpu_Release() does nothing; every task that ever used the FPU
+ *  keeps switching with its context. */
+#ifndef RTOS_FPU_RELEASE
+#define RTOS_FPU_RELEASE        1
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Drop the running task's FPU context at a blocking point.
+ *
+ * Clears CONTROL.FPCA, so the switch that blocks the task stacks the basic
+ * frame; the next floating-point instruction sets it again and starts from
+ * FPDSCR's FPSCR. Safe in any thread code: the asm clobbers s0-s31, so the
+ * compiler keeps no float live across it, and reloading one is an FPU
+ * instruction that restores FPCA before the switch. Thread mode only, and
+ * in the task's own loop: a function that returns restores s16-s31 for
+ * its caller on the way out, which sets FPCA again.
+ */
+static inline void RtosFpu_Release(void)
+{
+#if RTOS_FPU_RELEASE && defined(__FPU_USED) && (__FPU_USED == 1U)
+    uint32_t control;
+
+    __asm volatile ("mrs %0, control\n\t"
+                    "bic %0, %0, %1\n\t"
+                    "msr control, %0\n\t"
+                    "isb"
+                    : "=&r" (control)
+                    : "i" (CONTROL_FPCA_Msk)
+                    : "memory",
+                      "s0",  "s1",  "s2",  "s3",  "s4",  "s5",  "s6",  "s7",
+                      "s8",  "s9",  "s10", "s11", "s12", "s13", "s14", "s15",
+                      "s16", "s17", "s18", "s19", "s20", "s21", "s22", "s23",
+                      "s24", "s25", "s26", "s27", "s28", "s29", "s30", "s31");
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RTOS_FPU_H */
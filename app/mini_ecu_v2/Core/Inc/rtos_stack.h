@@ -0,0 +1,134 @@
+/**
+ * @file    rtos_stack.h
+ * @brief   Stack sizes and high-water marks of every task and of the
+ *          interrupt (main) stack: "stack".
+ *
+ * Sizing a stack takes two numbers: the worst case the code can reach and
+ * what it has reached so far. tools/stack_report.py gives the first from
+ * the compiler's per-function stack use and call graph ("make debug"
+ * writes build/debug/mini_ecu_v2.stack.txt); "stack" gives the second:
+ *
+ *   Task             Size B  Peak B  Free B  Used
+ *   CliTask            1024     612     412   59%
+ *   ...
+ *   MSP (ISRs)         1024     288     736   28%
+ *
+ * The kernel fills every new task stack with 0xA5, so the peak is the
+ * part no longer filled (uxTaskGetSystemState's high-water mark); the
+ * size is taken from the TCB by the traceTASK_CREATE hook below, which
+ * needs configRECORD_STACK_HIGH_ADDRESS. The main stack (_Min_Stack_Size
+ * below _estack) is filled the same way by RtosStack_Init(); it holds
+ * the startup code and, once the scheduler runs, only the interrupts.
+ * Lines with less than RTOS_STACK_WARN_BYTES left are marked.
+ *
+ * "heap" shows the FreeRTOS heap (heap_4, or heap_tlsf.c with
+ * RTOS_HEAP_TLSF): free bytes now and at the lowest, the largest free
+ * block and the fragmentation, the share of the free bytes outside it.
+ * Not in the static-only build, which has no heap.
+ *
+ * Overruns are caught by configCHECK_FOR_STACK_OVERFLOW at each context
+ * switch and recorded by the crash dump (crash_dump.h). That check reads
+ * 16 bytes of fill on every switch and only sees an overrun once the task
+ * is switched out, after it may already have corrupted what lies below.
+ *
+ * RTOS_STACK_GUARD=1 (FreeRTOSConfig.h) replaces it with the MPU: region
+ * RTOS_STACK_GUARD_REGION covers the lowest RTOS_STACK_GUARD_SIZE bytes
+ * of the running task's stack (rounded up to the region alignment) and
+ * RTOS_STACK_GUARD_MSP_REGION those of the main stack, both read-only and
+ * never executed. The switch-in hook moves the task region to the next
+ * task with one register write, so the steady state costs nothing; the
+ * first store into a guard raises MemManage, and the crash dump records
+ * it as a stack overflow of the running task or the interrupts. The
+ * guards keep the fill, so the high-water marks still work; "stack"
+ * counts the guard bytes as neither size nor free. An overrun that skips
+ * the guard (a frame larger than it, written at its far end first) is
+ * not caught: raise RTOS_STACK_GUARD_SIZE for such tasks.
+ *
+ * Like rtos_trace.h this header is read by the kernel sources (it is
+ * included at the end of FreeRTOSConfig.h) and includes no HAL headers.
+ */
+
+#ifndef RTOS_STACK_H
+#define RTOS_STACK_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Highest task number whose stack size is kept (idle and timer included). */
+#ifndef RTOS_STACK_MAX_TASKS
+#define RTOS_STACK_MAX_TASKS    16U
+#endif
+
+/** "stack" marks stacks with less free: one exception frame with the FPU
+ *  state (104 B) and a little. */
+#ifndef RTOS_STACK_WARN_BYTES
+#define RTOS_STACK_WARN_BYTES   128U
+#endif
+
+/** Bytes of each stack the guard covers: a power of two, 32 at least. */
+#ifndef RTOS_STACK_GUARD_SIZE
+#define RTOS_STACK_GUARD_SIZE   32U
+#endif
+
+/** MPU regions of the running task's guard and of the main stack's. */
+#define RTOS_STACK_GUARD_REGION      0U
+#define RTOS_STACK_GUARD_MSP_REGION  1U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Fill the unused main stack, set up the guards (RTOS_STACK_GUARD)
+ *        and register "stack".
+ *
+ * Call from main() before osKernelStart().
+ */
+void RtosStack_Init(void);
+
+/**
+ * @brief traceTASK_CREATE: remember the stack size of task @p number.
+ *
+ * @param[in] number uxTCBNumber, from 1.
+ * @param[in] base   Lowest word of the stack (pxStack).
+ * @param[in] end    Highest word of the stack (pxEndOfStack).
+ */
+void RtosStack_TaskCreate(uint32_t number, const void *base, const void *end);
+
+/**
+ * @brief traceTASK_SWITCHED_IN: move the task guard to the stack at
+ *        @p base. From the context switch, in SRAM (ramfunc.h).
+ */
+void RtosStack_GuardSwitch(const void *base);
+
+/**
+ * @brief Whether a MemManage (or the HardFault it escalated to) with these
+ *        CFSR and MMFAR values hit a stack guard; 0 without RTOS_STACK_GUARD.
+ */
+uint8_t RtosStack_GuardHit(uint32_t cfsr, uint32_t mmfar);
+
+/* ---- FreeRTOS hooks (expanded in tasks.c) ---- */
+
+#define traceTASK_CREATE(pxNewTCB)                                        \
+    RtosStack_TaskCreate((pxNewTCB)->uxTCBNumber, (pxNewTCB)->pxStack,    \
+                         (pxNewTCB)->pxEndOfStack)
+
+/* Part of traceTASK_SWITCHED_IN (rtos_trace.h). */
+#if RTOS_STACK_GUARD
+#define RTOS_STACK_GUARD_SWITCH_()  RtosStack_GuardSwitch(pxCurrentTCB->pxStack)
+#else
+#define RTOS_STACK_GUARD_SWITCH_()
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RTOS_STACK_H */
@@ -0,0 +1,107 @@
+/**
+ * @file    rtos_stats.h
+ * @brief   Per-task CPU load, stack and idle-time statistics.
+ *
+ * FreeRTOS run-time stats are clocked by the DWT cycle counter (see the
+ * run-time stats hooks in freertos.c), so every task accumulates the exact
+ * number of core cycles it ran. A static software timer samples all tasks
+ * every RTOS_STATS_PERIOD_MS and turns the counter differences into a CPU
+ * share for that window; the idle share is also averaged over the last
+ * RTOS_STATS_IDLE_WINDOW windows.
+ *
+ * Interrupt time is charged to the task that was running when the
+ * interrupt fired.
+ *
+ * The window also counts, per task, the switches away from it and how
+ * many of them carried the FPU context (traceTASK_SWITCHED_OUT,
+ * rtos_fpu.h): a task outside the control path should show none.
+ *
+ * The "top" CLI command prints the latest sample.
+ */
+
+#ifndef RTOS_STATS_H
+#define RTOS_STATS_H
+
+#include "main.h"
+#include "sys_config.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Sampling window (ms); must stay well below the ~24 s CYCCNT wrap. */
+#ifndef RTOS_STATS_PERIOD_MS
+#define RTOS_STATS_PERIOD_MS    1000U
+#endif
+
+/** Windows averaged into the rolling idle percentage. */
+#ifndef RTOS_STATS_IDLE_WINDOW
+#define RTOS_STATS_IDLE_WINDOW  10U
+#endif
+
+/** Most tasks tracked (application tasks + idle + timer service); with
+ *  more tasks than this uxTaskGetSystemState() reports none at all. By
+ *  default SYS_TASK_TABLE, the kernel's two and the defaultTask. */
+#ifndef RTOS_STATS_MAX_TASKS
+#define RTOS_STATS_MAX_TASKS    (SYS_TASKS + 3U)
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief One task in the latest sample.
+ */
+typedef struct
+{
+    const char *name;
+    uint8_t     state;         /**< eTaskState (running, ready, blocked, ...). */
+    uint8_t     priority;      /**< Current FreeRTOS priority. */
+    uint16_t    cpuPermille;   /**< Share of the last window, 0..1000. */
+    uint32_t    stackFree;     /**< Lowest free stack ever seen, in bytes. */
+    uint32_t    frames;        /**< Switched away from in the last window. */
+    uint32_t    fpuFrames;     /**< Of those, with the FPU context stacked. */
+} RtosStats_Task_t;
+
+/**
+ * @brief Whole-system figures of the latest sample.
+ */
+typedef struct
+{
+    uint32_t windows;          /**< Samples taken since start. */
+    uint32_t windowCycles;     /**< Length of the last window in core cycles. */
+    uint16_t idlePermille;     /**< Idle share of the last window. */
+    uint16_t idleAvgPermille;  /**< Idle share over RTOS_STATS_IDLE_WINDOW windows. */
+    uint32_t switches;         /**< Context switches in the last window. */
+    uint32_t fpuFrames;        /**< Switches that stacked the FPU context. */
+} RtosStats_Summary_t;
+
+/**
+ * @brief Create the sampling timer and register the "top" command.
+ *
+ * Call after osKernelInitialize() and before osKernelStart().
+ *
+ * @return HAL_OK, or HAL_ERROR if the timer cannot be created or started.
+ */
+HAL_StatusTypeDef RtosStats_Init(void);
+
+/**
+ * @brief Copy the latest per-task sample.
+ *
+ * @param[out] tasks Array of @p max entries.
+ * @param[out] sum   System figures (may be NULL).
+ * @return Number of entries written (0 before the first window ends).
+ */
+uint32_t RtosStats_Get(RtosStats_Task_t *tasks, uint32_t max, RtosStats_Summary_t *sum);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RTOS_STATS_H */
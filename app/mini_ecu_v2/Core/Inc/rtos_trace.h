@@ -0,0 +1,314 @@
+/**
+ * @file    rtos_trace.h
+ * @brief   Kernel event recorder: FreeRTOS trace hooks into a RAM ring with
+ *          DWT cycle timestamps, dumped over the log transport.
+ *
+ * "top" (rtos_stats.h) tells how much each task ran; to tune priorities one
+ * also needs to see when: which task preempted which, how long an
+ * interrupt held the core, how long a task sat ready, who filled a queue.
+ * This header defines the FreeRTOS trace hook macros (it is included at
+ * the end of FreeRTOSConfig.h) so that, while recording, the kernel writes
+ * an 8-byte record for
+ *
+ *   - every context switch (task in, with its priority),
+ *   - a task made ready, starting a delay, blocking on a notification,
+ *   - task notifications from tasks and ISRs (CMSIS thread flags),
+ *   - queue, semaphore and mutex send/receive from tasks and ISRs,
+ *     blocking on them and failed attempts (with the fill level before),
+ *   - entry and exit of the interrupt handlers in stm32f4xx_it.c
+ *     (RTOS_TRACE_ISR_ENTER / RTOS_TRACE_ISR_EXIT),
+ *   - optionally the tick (RTOS_TRACE_TICKS).
+ *
+ * A record is one store of DWT->CYCCNT and one word under PRIMASK (about
+ * 20 cycles); while stopped a hook is a load and a branch. The recorder
+ * keeps the newest RTOS_TRACE_DEPTH records, or with "once" stops when the
+ * ring is full.
+ *
+ *   rtos trace                      recorder state
+ *   rtos trace start [once]         record, overwriting or until full
+ *   rtos trace stop                 stop
+ *   rtos trace dump                 stop and send the ring
+ *   rtos trace clear                empty the ring
+ *
+ * The dump is sent through Log_WriteRaw(), so it goes over whichever
+ * transport carries the CLI stream (UART, SWO or the RAM capture, see
+ * log.h), in frames that survive interleaved log output:
+ *
+ *   0xFC | len | type | payload
+ *
+ *   type 'H': version (u8), record size (u16), records (u32),
+ *             overwritten (u32), core clock Hz (u32), tick Hz (u32)
+ *   type 'T': task number (u8), priority (u8), name
+ *   type 'Q': queue number (u8), queueQUEUE_TYPE_* (u8), length (u16), name
+ *   type 'R': RtosTrace_Rec_t records, back to back
+ *   type 'E': records sent (u32)
+ *
+ * All words are little-endian. tools/rtos_trace.py turns a capture into
+ * Chrome trace event JSON, which Perfetto (ui.perfetto.dev) and
+ * chrome://tracing display as a timeline, and prints per-task and
+ * per-interrupt figures.
+ *
+ * This header is read by the kernel sources and includes no HAL headers;
+ * the ISR macros need CMSIS (__get_IPSR) where they are used.
+ */
+
+#ifndef RTOS_TRACE_H
+#define RTOS_TRACE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = trace hooks compiled into the kernel, 0 = the FreeRTOS defaults. */
+#ifndef RTOS_TRACE_ENABLE
+#define RTOS_TRACE_ENABLE       1
+#endif
+
+/** Records in the ring (power of two; 8 bytes each). */
+#ifndef RTOS_TRACE_DEPTH
+#define RTOS_TRACE_DEPTH        1024U
+#endif
+
+/** 1 = record every tick as well (1000 records/s). */
+#ifndef RTOS_TRACE_TICKS
+#define RTOS_TRACE_TICKS        0
+#endif
+
+/** Queues, semaphores and mutexes numbered for the trace; later ones
+ *  are recorded as number 0. */
+#ifndef RTOS_TRACE_MAX_QUEUES
+#define RTOS_TRACE_MAX_QUEUES   24U
+#endif
+
+/** Tasks named in the dump. */
+#ifndef RTOS_TRACE_MAX_TASKS
+#define RTOS_TRACE_MAX_TASKS    16U
+#endif
+
+/** A dump gives up when the output makes no progress for this long (ms). */
+#ifndef RTOS_TRACE_DUMP_TIMEOUT_MS
+#define RTOS_TRACE_DUMP_TIMEOUT_MS  1000U
+#endif
+
+/** Sync byte of a dump frame. */
+#define RTOS_TRACE_SYNC         0xFCU
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Events. X(name): RTOS_TRACE_EV_<name>; tools/rtos_trace.py has
+ *        the same list.
+ *
+ *   obj is the task number (uxTCBNumber), the queue number or the
+ *   exception number; arg the priority, delay ticks or queue fill.
+ */
+#define RTOS_TRACE_EVENT_TABLE(X)                                        \
+    X(SWITCH_IN)        /* obj task, arg priority */                      \
+    X(READY)            /* obj task, arg priority */                      \
+    X(DELAY)            /* obj task, arg ticks */                         \
+    X(NOTIFY)           /* obj task notified */                           \
+    X(NOTIFY_ISR)       /* obj task notified */                           \
+    X(NOTIFY_WAIT)      /* obj task blocking on its notification */       \
+    X(QUEUE_SEND)       /* obj queue, arg items before */                 \
+    X(QUEUE_SEND_ISR)                                                     \
+    X(QUEUE_RECV)       /* obj queue, arg items before */                 \
+    X(QUEUE_RECV_ISR)                                                     \
+    X(QUEUE_BLOCK_SEND) /* obj queue: the running task blocks */          \
+    X(QUEUE_BLOCK_RECV)                                                   \
+    X(QUEUE_FAIL)       /* obj queue: send or receive gave up */          \
+    X(ISR_ENTER)        /* obj exception number */                        \
+    X(ISR_EXIT)                                                           \
+    X(TICK)             /* arg tick count, low 16 bits */
+
+#define RTOS_TRACE_EV_ENUM_(name)   RTOS_TRACE_EV_##name,
+typedef enum
+{
+    RTOS_TRACE_EVENT_TABLE(RTOS_TRACE_EV_ENUM_)
+    RTOS_TRACE_EV_COUNT
+} RtosTrace_Event_t;
+
+/**
+ * @brief One record (8 bytes, the layout of the dump).
+ */
+typedef struct
+{
+    uint32_t cycles;    /**< DWT->CYCCNT; wraps every 2^32 cycles. */
+    uint8_t  event;     /**< RtosTrace_Event_t */
+    uint8_t  obj;
+    uint16_t arg;
+} RtosTrace_Rec_t;
+
+/** Nonzero while recording; tested inline by the hooks. */
+extern volatile uint8_t g_rtosTraceOn;
+
+/** Context switches since start: a different task switched in. Counted
+ *  by traceTASK_SWITCHED_IN whether or not the trace is built; read by
+ *  "top". */
+extern volatile uint32_t g_rtosSwitches;
+extern void             *g_rtosSwitchLast;
+
+/** Switches away from each task by task number (uxTCBNumber, 0 for the
+ *  tasks above RTOS_TRACE_MAX_TASKS), and how many of those stacked the
+ *  FPU context (rtos_fpu.h). Counted by traceTASK_SWITCHED_OUT whether or
+ *  not the trace is built; read by "top". */
+extern volatile uint32_t g_rtosFrames[RTOS_TRACE_MAX_TASKS + 1U];
+extern volatile uint32_t g_rtosFpuFrames[RTOS_TRACE_MAX_TASKS + 1U];
+
+/**
+ * @brief Reset the recorder (stopped, empty) and register "rtos trace".
+ *
+ * Queue numbering runs from reset, so the queues created before this call
+ * keep their numbers.
+ */
+void RtosTrace_Init(void);
+
+/**
+ * @brief Append one record if recording. Any context, runs from SRAM.
+ */
+void RtosTrace_Record(uint32_t event, uint32_t obj, uint32_t arg);
+
+/**
+ * @brief traceQUEUE_CREATE: number a new queue.
+ *
+ * @return Its number (1..RTOS_TRACE_MAX_QUEUES), 0 if the table is full.
+ */
+uint8_t RtosTrace_QueueCreate(const void *queue, uint8_t type, uint32_t length);
+
+/**
+ * @brief traceQUEUE_REGISTRY_ADD: remember the name of @p queue.
+ */
+void RtosTrace_QueueName(const void *queue, const char *name);
+
+#define RTOS_TRACE_(ev, obj, arg)                                         \
+    do                                                                    \
+    {                                                                     \
+        if (g_rtosTraceOn != 0U)                                          \
+            RtosTrace_Record((uint32_t)RTOS_TRACE_EV_##ev, (uint32_t)(obj), \
+                             (uint32_t)(arg));                            \
+    } while (0)
+
+/* Runs in PendSV (vTaskSwitchContext), so no lock. A context switch that
+ * picks the same task again is not counted. */
+#define RTOS_TRACE_COUNT_SWITCH_()                                        \
+    do                                                                    \
+    {                                                                     \
+        if ((void *)pxCurrentTCB != g_rtosSwitchLast)                     \
+        {                                                                 \
+            g_rtosSwitchLast = (void *)pxCurrentTCB;                      \
+            g_rtosSwitches++;                                             \
+        }                                                                 \
+    } while (0)
+
+/* Runs in PendSV after the port (ARM_CM4F) stacked the task: r4-r11 and
+ * then EXC_RETURN at pxTopOfStack, where bit 4 clear means the exception
+ * frame holds the FPU context. A switch back to the same task counts. */
+#if defined(__VFP_FP__) && !defined(__SOFTFP__)
+#define RTOS_TRACE_FPU_FRAME_(n)                                          \
+    do                                                                    \
+    {                                                                     \
+        if ((((const volatile uint32_t *)pxCurrentTCB->pxTopOfStack)[8] & 0x10U) == 0U) \
+            g_rtosFpuFrames[n]++;                                         \
+    } while (0)
+#else
+#define RTOS_TRACE_FPU_FRAME_(n)
+#endif
+
+#define traceTASK_SWITCHED_OUT()                                          \
+    do                                                                    \
+    {                                                                     \
+        uint32_t n_ = (uint32_t)pxCurrentTCB->uxTCBNumber;                \
+        if (n_ > RTOS_TRACE_MAX_TASKS)                                    \
+            n_ = 0U;                                                      \
+        g_rtosFrames[n_]++;                                               \
+        RTOS_TRACE_FPU_FRAME_(n_);                                        \
+    } while (0)
+
+#if RTOS_TRACE_ENABLE
+
+/** First and last statement of an interrupt handler. */
+#define RTOS_TRACE_ISR_ENTER()   RTOS_TRACE_(ISR_ENTER, __get_IPSR(), 0U)
+#define RTOS_TRACE_ISR_EXIT()    RTOS_TRACE_(ISR_EXIT, __get_IPSR(), 0U)
+
+/* ---- FreeRTOS hooks (expanded in tasks.c and queue.c) ---- */
+
+#define traceTASK_SWITCHED_IN()                                           \
+    do                                                                    \
+    {                                                                     \
+        RTOS_TRACE_COUNT_SWITCH_();                                       \
+        RTOS_STACK_GUARD_SWITCH_();                                       \
+        RTOS_TRACE_(SWITCH_IN, pxCurrentTCB->uxTCBNumber, pxCurrentTCB->uxPriority); \
+    } while (0)
+#define traceMOVED_TASK_TO_READY_STATE(pxTCB)                             \
+    RTOS_TRACE_(READY, (pxTCB)->uxTCBNumber, (pxTCB)->uxPriority)
+#define traceTASK_DELAY()                                                 \
+    RTOS_TRACE_(DELAY, pxCurrentTCB->uxTCBNumber, xTicksToDelay)
+#define traceTASK_DELAY_UNTIL(xTimeToWake)                                \
+    RTOS_TRACE_(DELAY, pxCurrentTCB->uxTCBNumber, (xTimeToWake) - xTickCount)
+#define traceTASK_NOTIFY()                                                \
+    RTOS_TRACE_(NOTIFY, pxTCB->uxTCBNumber, 0U)
+#define traceTASK_NOTIFY_FROM_ISR()                                       \
+    RTOS_TRACE_(NOTIFY_ISR, pxTCB->uxTCBNumber, 0U)
+#define traceTASK_NOTIFY_GIVE_FROM_ISR()                                  \
+    RTOS_TRACE_(NOTIFY_ISR, pxTCB->uxTCBNumber, 0U)
+#define traceTASK_NOTIFY_WAIT_BLOCK()                                     \
+    RTOS_TRACE_(NOTIFY_WAIT, pxCurrentTCB->uxTCBNumber, 0U)
+#define traceTASK_NOTIFY_TAKE_BLOCK()                                     \
+    RTOS_TRACE_(NOTIFY_WAIT, pxCurrentTCB->uxTCBNumber, 0U)
+
+#define traceQUEUE_CREATE(pxNewQueue)                                     \
+    ((pxNewQueue)->uxQueueNumber = RtosTrace_QueueCreate((pxNewQueue),    \
+        (pxNewQueue)->ucQueueType, (pxNewQueue)->uxLength))
+#define traceQUEUE_REGISTRY_ADD(xQueue, pcQueueName)                      \
+    RtosTrace_QueueName((xQueue), (pcQueueName))
+
+#define traceQUEUE_SEND(pxQueue)                                          \
+    RTOS_TRACE_(QUEUE_SEND, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_SEND_FROM_ISR(pxQueue)                                 \
+    RTOS_TRACE_(QUEUE_SEND_ISR, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_RECEIVE(pxQueue)                                       \
+    RTOS_TRACE_(QUEUE_RECV, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_RECEIVE_FROM_ISR(pxQueue)                              \
+    RTOS_TRACE_(QUEUE_RECV_ISR, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceBLOCKING_ON_QUEUE_SEND(pxQueue)                              \
+    RTOS_TRACE_(QUEUE_BLOCK_SEND, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceBLOCKING_ON_QUEUE_RECEIVE(pxQueue)                           \
+    RTOS_TRACE_(QUEUE_BLOCK_RECV, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_SEND_FAILED(pxQueue)                                   \
+    RTOS_TRACE_(QUEUE_FAIL, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_SEND_FROM_ISR_FAILED(pxQueue)                          \
+    RTOS_TRACE_(QUEUE_FAIL, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_RECEIVE_FAILED(pxQueue)                                \
+    RTOS_TRACE_(QUEUE_FAIL, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+
+#if RTOS_TRACE_TICKS
+#define traceTASK_INCREMENT_TICK(xTickCount)                              \
+    RTOS_TRACE_(TICK, 0U, (xTickCount) & 0xFFFFU)
+#endif
+
+#else /* !RTOS_TRACE_ENABLE */
+
+#define RTOS_TRACE_ISR_ENTER()
+#define RTOS_TRACE_ISR_EXIT()
+
+#define traceTASK_SWITCHED_IN()                                           \
+    do                                                                    \
+    {                                                                     \
+        RTOS_TRACE_COUNT_SWITCH_();                                       \
+        RTOS_STACK_GUARD_SWITCH_();                                       \
+    } while (0)
+
+#endif /* RTOS_TRACE_ENABLE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RTOS_TRACE_H */
@@ -0,0 +1,108 @@
+/**
+ * @file    rtt.h
+ * @brief   RTT channel: ring buffers in RAM that a debug probe reads and
+ *          writes over SWD while the core runs.
+ *
+ * The control block has the SEGGER RTT layout, so J-Link (RTT Viewer,
+ * JLinkRTTClient), OpenOCD ("rtt setup" / "rtt server"), pyOCD and
+ * probe-rs find it by its "SEGGER RTT" ID in RAM, or by the ELF symbol
+ * _SEGGER_RTT:
+ *
+ *   acID[16], MaxNumUpBuffers, MaxNumDownBuffers,
+ *   up[]   { sName, pBuffer, SizeOfBuffer, WrOff, RdOff, Flags },
+ *   down[] { the same }
+ *
+ * Channel 0 "Terminal" is the only one. The target writes the up buffer
+ * and moves WrOff, the probe reads and moves RdOff; the down buffer works
+ * the other way round. Each side writes only its own offset, so no lock
+ * is needed, only a barrier between the data and the offset.
+ *
+ * Up writes never block: what does not fit is dropped and counted
+ * (RTT_MODE_NO_BLOCK_TRIM), so a unit without a probe loses nothing but
+ * the copy. Output goes through the log ring like every other transport
+ * and is written by LogTask ("log transport lines rtt", log.h); input is
+ * polled by CliTask (CLI_RTT_POLL_MS, cli_if.h).
+ *
+ * "rtt" shows the buffer fill and the byte counts.
+ */
+
+#ifndef RTT_H
+#define RTT_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Target -> host buffer (bytes). */
+#ifndef RTT_UP_SIZE
+#define RTT_UP_SIZE         1024U
+#endif
+
+/** Host -> target buffer (bytes). */
+#ifndef RTT_DOWN_SIZE
+#define RTT_DOWN_SIZE       64U
+#endif
+
+/** Up buffer Flags: what a write does when the buffer is full. */
+#define RTT_MODE_NO_BLOCK_SKIP   0U   /**< Drop the whole write. */
+#define RTT_MODE_NO_BLOCK_TRIM   1U   /**< Write what fits, drop the rest. */
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Counters since start.
+ */
+typedef struct
+{
+    uint32_t upSize;         /**< Up buffer capacity (one byte stays free). */
+    uint32_t upFill;         /**< Bytes the probe has not read yet. */
+    uint32_t upBytes;        /**< Bytes written to the up buffer. */
+    uint32_t upDropped;      /**< Bytes dropped, up buffer full. */
+    uint32_t downBytes;      /**< Bytes read from the down buffer. */
+} Rtt_Stats_t;
+
+/**
+ * @brief Set up the control block and register "rtt". Later calls do
+ *        nothing.
+ *
+ * Call before osKernelStart() (Log_Init(), CLI_IF_Init()).
+ */
+void Rtt_Init(void);
+
+/**
+ * @brief Copy @p len bytes into the up buffer; never blocks.
+ *
+ * One writer at a time (LogTask).
+ *
+ * @return Bytes written; the rest is dropped and counted.
+ */
+uint32_t Rtt_Write(const uint8_t *data, uint32_t len);
+
+/**
+ * @brief Take up to @p size bytes the probe has written.
+ *
+ * One reader at a time (CliTask).
+ *
+ * @return Bytes copied, 0 if none.
+ */
+uint32_t Rtt_Read(uint8_t *dst, uint32_t size);
+
+/**
+ * @brief Buffer fill and counters.
+ */
+void Rtt_GetStats(Rtt_Stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RTT_H */
@@ -0,0 +1,126 @@
+/**
+ * @file    scenario.h
+ * @brief   Drive-cycle and fault-injection playback for the vehicle model.
+ *
+ * A scenario is a speed profile plus a timeline of forced values, both
+ * const tables in flash:
+ *
+ *   - The profile is a list of linear segments, 2 bytes each: a duration
+ *     in seconds and the speed change per second in 0.25 km/h steps
+ *     (Scenario_Seg_t). Parts of segments can repeat, so NEDC-like is the
+ *     urban part 4 times plus the extra-urban part. The speed is integrated
+ *     in integer steps, so it is exact and ends where the table says.
+ *   - Events apply Vehicle_Force() to the masked fields at a given time
+ *     (coolant overheat, RPM spike, speed dropout); the model relaxes from
+ *     there on the following steps.
+ *
+ * Playback runs in VehicleTask (Scenario_Step(), instead of its own
+ * Vehicle_Update()) in fixed SCENARIO_STEP_MS model steps: per step the
+ * model is updated, its speed set to the profile and the due events
+ * applied. With a time scale of N, N times as many steps run per control
+ * cycle, so a 20-minute cycle plays in 12 s at 100x, with the same
+ * sequence of states at any scale and on every run. The pedal is ignored
+ * during playback.
+ *
+ * "scenario" lists the scenarios and the playback state,
+ * "scenario play <name> [scale]" starts one, "scenario stop" ends it.
+ */
+
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include "main.h"
+#include "vehicle.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Model step of the playback (ms); the vehicle model's native 100 ms. */
+#define SCENARIO_STEP_MS        100U
+
+/** Largest time scale. */
+#ifndef SCENARIO_MAX_SCALE
+#define SCENARIO_MAX_SCALE      100U
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief One linear profile segment.
+ */
+typedef struct
+{
+    uint8_t seconds;        /**< Duration. */
+    int8_t  delta;          /**< Speed change per second, 0.25 km/h units. */
+} Scenario_Seg_t;
+
+/**
+ * @brief Forced values at a point of the timeline (Vehicle_Force()).
+ */
+typedef struct
+{
+    uint16_t atDs;          /**< Time from the start, 0.1 s units. */
+    uint8_t  mask;          /**< VEHICLE_FORCE_xxx (vehicle_shared.h). */
+    int8_t   coolantC;
+    uint16_t rpm;
+    uint16_t speedKph;
+} Scenario_Event_t;
+
+/**
+ * @brief Playback state.
+ */
+typedef struct
+{
+    uint8_t     playing;
+    uint8_t     scale;
+    const char *name;       /**< Last scenario started, NULL if none. */
+    uint32_t    timeMs;     /**< Scenario time. */
+    uint32_t    lengthMs;
+    uint32_t    events;     /**< Events applied. */
+    float       speedKph;   /**< Profile speed. */
+} Scenario_Status_t;
+
+/**
+ * @brief Register the "scenario" commands.
+ */
+void Scenario_Init(void);
+
+/**
+ * @brief Start scenario @p name at time scale @p scale (any task).
+ *
+ * @return HAL_OK, or HAL_ERROR for an unknown name or a scale outside
+ *         1..SCENARIO_MAX_SCALE.
+ */
+HAL_StatusTypeDef Scenario_Play(const char *name, uint32_t scale);
+
+/**
+ * @brief Stop the playback (any task); the model coasts from there.
+ */
+void Scenario_Stop(void);
+
+/**
+ * @brief Advance the playback by one control cycle of @p cycleMs
+ *        (VehicleTask only, in place of Vehicle_Update()).
+ *
+ * @return 1 if a scenario drove the model, 0 if none is playing.
+ */
+uint8_t Scenario_Step(VehicleState_t *vs, uint32_t cycleMs);
+
+/**
+ * @brief Consistent copy of the playback state (any task).
+ */
+void Scenario_GetStatus(Scenario_Status_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCENARIO_H */
@@ -0,0 +1,170 @@
+/**
+ * @file    sig_hist.h
+ * @brief   Multi-resolution history of vehicle signals: raw samples,
+ *          1 s and 1 min min / max / mean buckets in fixed RAM.
+ *
+ * Each signal of SIG_HIST_SIGNAL_TABLE (a TLM_SIGNAL_TABLE signal,
+ * tlm_stream.h, stored in its raw int16 scaling) keeps three rings:
+ *
+ *   tier   bucket    depth (default)            RAM per signal
+ *   raw    100 ms    SIG_HIST_RAW_DEPTH   600   (1 min)    2 B a sample
+ *   sec    1 s       SIG_HIST_SEC_DEPTH  3600   (1 h)      6 B a bucket
+ *   min    1 min     SIG_HIST_MIN_DEPTH  1440   (1 day)    6 B a bucket
+ *
+ * about 31 KB per signal with the defaults, which is why the module is off
+ * unless SIG_HIST_ENABLE is set and the table holds one signal.
+ *
+ * The 100 ms runnable (raster.h, SigHist_Event100ms()) reads the signals
+ * once (TlmStream_ReadSignals()), pushes each sample into the raw ring and
+ * folds it into the open second bucket: a running sum, min and max. The
+ * tenth sample closes the bucket into the sec ring and folds its sum into
+ * the open minute, whose sixtieth closes into the min ring; every step is
+ * O(1) and the means are exact (the sum of the raw samples, rounded once).
+ * The runnable publishes with a seqlock (as vehicle_shared.c), so a reader
+ * that the writer overtook copies again.
+ *
+ * Queries read buckets, never the raw samples behind them:
+ * SigHist_Read() copies one tier, SigHist_Range() combines the last n
+ * seconds as whole minutes from the min ring plus the seconds of the
+ * partial minutes at both ends from the sec ring (at most 1440 + 2 x 59
+ * buckets for a day). UDS routine UDS_RID_SIG_HIST (uds.h) returns a tier
+ * to a tester.
+ *
+ *   hist                              signals, held buckets, RAM
+ *   hist show <sig> <raw|sec|min> [<n>] the newest n buckets (default 10)
+ *   hist range <sig> <seconds>        min / max / mean of the last seconds
+ */
+
+#ifndef SIG_HIST_H
+#define SIG_HIST_H
+
+#include "main.h"
+#include "tlm_stream.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = signal history and its 100 ms runnable built in (needs
+ *  TLM_STREAM_ENABLE and the RAM above). */
+#ifndef SIG_HIST_ENABLE
+#define SIG_HIST_ENABLE         0
+#endif
+
+#if SIG_HIST_ENABLE && !TLM_STREAM_ENABLE
+#error "SIG_HIST_ENABLE needs TLM_STREAM_ENABLE"
+#endif
+
+/**
+ * @brief Signals with a history. X(name): TLM_SIG_<name>, history
+ *        SIG_HIST_<name>.
+ */
+#ifndef SIG_HIST_SIGNAL_TABLE
+#define SIG_HIST_SIGNAL_TABLE(X)                            \
+    X(SPEED)
+#endif
+
+/** Ring depths: raw samples (100 ms), 1 s and 1 min buckets. */
+#ifndef SIG_HIST_RAW_DEPTH
+#define SIG_HIST_RAW_DEPTH      600U
+#endif
+#ifndef SIG_HIST_SEC_DEPTH
+#define SIG_HIST_SEC_DEPTH      3600U
+#endif
+#ifndef SIG_HIST_MIN_DEPTH
+#define SIG_HIST_MIN_DEPTH      1440U
+#endif
+
+/** Bucket widths (ms); the runnable samples every SIG_HIST_RAW_MS. */
+#define SIG_HIST_RAW_MS         100U
+#define SIG_HIST_SEC_MS         1000U
+#define SIG_HIST_MIN_MS         60000U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+#define SIG_HIST_ENUM_(name)    SIG_HIST_##name,
+
+typedef enum
+{
+    SIG_HIST_SIGNAL_TABLE(SIG_HIST_ENUM_)
+    SIG_HIST_COUNT
+} SigHist_Signal_t;
+
+typedef enum
+{
+    SIG_HIST_TIER_RAW = 0,
+    SIG_HIST_TIER_SEC,
+    SIG_HIST_TIER_MIN,
+    SIG_HIST_TIERS
+} SigHist_Tier_t;
+
+/**
+ * @brief One bucket, in the raw scaling of the TLM signal (physical =
+ *        raw * TlmStream_SigInfo_t::scale). A raw sample has all three
+ *        equal.
+ */
+typedef struct
+{
+    int16_t min;
+    int16_t max;
+    int16_t mean;
+} SigHist_Bucket_t;
+
+/**
+ * @brief Register "hist"; the rings start empty.
+ *
+ * @return HAL_OK.
+ */
+HAL_StatusTypeDef SigHist_Init(void);
+
+/** History of TLM signal @p tlmSig (TlmStream_Signal_t), or -1. */
+int32_t SigHist_Find(uint32_t tlmSig);
+
+/** TLM signal of history @p hist. */
+uint32_t SigHist_Signal(uint32_t hist);
+
+/** Buckets @p tier holds (up to its depth). */
+uint32_t SigHist_Held(SigHist_Tier_t tier);
+
+/** Milliseconds since the newest bucket of @p tier closed. */
+uint32_t SigHist_Age(SigHist_Tier_t tier);
+
+/**
+ * @brief Copy up to @p count buckets of @p tier, newest first, skipping the
+ *        @p back newest.
+ *
+ * @param[out] got Buckets copied (fewer once the ring runs out).
+ *
+ * @return HAL_OK, HAL_ERROR for a bad @p hist or @p tier, HAL_BUSY if the
+ *         writer kept overtaking the copy.
+ */
+HAL_StatusTypeDef SigHist_Read(uint32_t hist, SigHist_Tier_t tier, uint32_t back,
+                               uint32_t count, SigHist_Bucket_t *out, uint32_t *got);
+
+/**
+ * @brief Min, max and sample-weighted mean of the last @p seconds closed
+ *        seconds.
+ *
+ * @param[out] covered Seconds the buckets covered (fewer once the history
+ *                     runs out, 0 with none yet).
+ *
+ * @return As SigHist_Read().
+ */
+HAL_StatusTypeDef SigHist_Range(uint32_t hist, uint32_t seconds, SigHist_Bucket_t *out,
+                                uint32_t *covered);
+
+/** 100 ms runnable: sample, close the buckets that are due. */
+void SigHist_Event100ms(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIG_HIST_H */
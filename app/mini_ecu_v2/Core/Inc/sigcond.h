@@ -0,0 +1,146 @@
+/**
+ * @file    sigcond.h
+ * @brief   Block-wise signal conditioning pipelines for sensor channels.
+ *
+ * A pipeline is a per-channel list of stages, configured by a const table
+ * and run over a whole block of samples with one SigCond_Run() call. Each
+ * stage works on the buffer in place and hands the (possibly shorter)
+ * block to the next one:
+ *
+ *   | Stage       | Parameters              | Does                                    |
+ *   |-------------|-------------------------|-----------------------------------------|
+ *   | FIR         | taps, cutoff Hz         | windowed-sinc low-pass (Dsp_FirF32)     |
+ *   | BIQUAD      | stages, cutoff Hz       | Butterworth low-pass (Dsp_BiquadF32)    |
+ *   | DECIMATE    | factor                  | keeps every n-th sample                 |
+ *   | AVERAGE     | factor                  | mean of every n samples (oversampling)  |
+ *   | MEDIAN      | window (odd, <= 7)      | sliding median, removes spikes          |
+ *   | RATE_LIMIT  | units per second        | slew limit, SIGCOND_ST_RATE when active |
+ *   | RANGE       | min, max, debounce      | plausibility: holds the last good value |
+ *
+ * Put the low-pass ahead of DECIMATE (it is the anti-alias filter): every
+ * stage after it runs at the reduced rate, so the non-linear stages cost a
+ * fraction of a per-sample chain. AVERAGE is the cheap alternative for a
+ * slow signal sampled fast: a boxcar over n samples and the decimation in
+ * one, it buys about log2(n)/2 bits of resolution against white noise.
+ *
+ * The RANGE stage debounces: the result becomes implausible
+ * (SIGCOND_ST_RANGE) after "debounce" samples in a row outside [min, max]
+ * and plausible again after as many inside; out-of-range samples are
+ * replaced by the last good one either way.
+ *
+ * Stage descriptors, filter coefficients and all filter / history state
+ * are carved at init from three static arrays (SIGCOND_MAX_STAGES,
+ * SIGCOND_COEFF_FLOATS, SIGCOND_STATE_FLOATS), so the pipelines of all
+ * channels sit next to each other in memory. A pipeline is run by one task.
+ */
+
+#ifndef SIGCOND_H
+#define SIGCOND_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Stages of all pipelines together. */
+#ifndef SIGCOND_MAX_STAGES
+#define SIGCOND_MAX_STAGES      20U
+#endif
+
+/** Filter coefficients of all pipelines together (floats). */
+#ifndef SIGCOND_COEFF_FLOATS
+#define SIGCOND_COEFF_FLOATS    96U
+#endif
+
+/** Filter and history state of all pipelines together (floats). */
+#ifndef SIGCOND_STATE_FLOATS
+#define SIGCOND_STATE_FLOATS    160U
+#endif
+
+/** Largest MEDIAN window. */
+#define SIGCOND_MEDIAN_MAX      7U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    SIGCOND_FIR = 0,
+    SIGCOND_BIQUAD,
+    SIGCOND_DECIMATE,
+    SIGCOND_MEDIAN,
+    SIGCOND_RATE_LIMIT,
+    SIGCOND_RANGE,
+    SIGCOND_AVERAGE
+} SigCond_StageType_t;
+
+/**
+ * @brief One stage of a pipeline table; use the SIGCOND_STAGE_* macros.
+ */
+typedef struct
+{
+    uint8_t type;           /**< SigCond_StageType_t. */
+    uint8_t n;              /**< Taps, biquad stages, factor, window or debounce. */
+    float   a;              /**< Cutoff Hz, rate per second, or range minimum. */
+    float   b;              /**< Range maximum. */
+} SigCond_StageCfg_t;
+
+#define SIGCOND_STAGE_FIR(taps, hz)         { (uint8_t)SIGCOND_FIR, (taps), (hz), 0.0f }
+#define SIGCOND_STAGE_BIQUAD(stages, hz)    { (uint8_t)SIGCOND_BIQUAD, (stages), (hz), 0.0f }
+#define SIGCOND_STAGE_DECIMATE(factor)      { (uint8_t)SIGCOND_DECIMATE, (factor), 0.0f, 0.0f }
+#define SIGCOND_STAGE_MEDIAN(window)        { (uint8_t)SIGCOND_MEDIAN, (window), 0.0f, 0.0f }
+#define SIGCOND_STAGE_RATE_LIMIT(perSec)    { (uint8_t)SIGCOND_RATE_LIMIT, 0U, (perSec), 0.0f }
+#define SIGCOND_STAGE_RANGE(lo, hi, deb)    { (uint8_t)SIGCOND_RANGE, (deb), (lo), (hi) }
+#define SIGCOND_STAGE_AVERAGE(factor)       { (uint8_t)SIGCOND_AVERAGE, (factor), 0.0f, 0.0f }
+
+/** Status bits of the last SigCond_Run(). */
+#define SIGCOND_ST_RANGE        0x01U   /**< Implausible (debounced). */
+#define SIGCOND_ST_RATE         0x02U   /**< Rate limit was active. */
+
+/**
+ * @brief A channel's pipeline (a slice of the static stage array).
+ */
+typedef struct
+{
+    uint16_t first;         /**< Index of the first stage. */
+    uint8_t  count;         /**< Stages. */
+    uint8_t  status;        /**< SIGCOND_ST_* of the last run. */
+} SigCond_Pipe_t;
+
+/**
+ * @brief Build a pipeline from @p cfg: design the filters and assign
+ *        coefficients and state from the static arrays.
+ *
+ * @param sampleHz   Input sample rate.
+ * @param blockSize  Largest block passed to SigCond_Run().
+ * @return HAL_OK, or HAL_ERROR for an invalid stage or no space left.
+ */
+HAL_StatusTypeDef SigCond_Init(SigCond_Pipe_t *pipe, const SigCond_StageCfg_t *cfg,
+                               uint32_t count, float sampleHz, uint32_t blockSize);
+
+/**
+ * @brief Run all stages over @p buf in place.
+ *
+ * @return Samples left in @p buf (the input count over the decimation, so
+ *         0 is possible when the block is shorter than the factor).
+ */
+uint32_t SigCond_Run(SigCond_Pipe_t *pipe, float *buf, uint32_t n);
+
+/**
+ * @brief Preload every stage for a constant input @p x (start-up, or after
+ *        the input was lost), so the output starts at @p x.
+ */
+void SigCond_Reset(SigCond_Pipe_t *pipe, float x);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIGCOND_H */
@@ -0,0 +1,127 @@
+/**
+ * @file    sim_clock.h
+ * @brief   Simulation clock: the vehicle model at real time, N x or flat out.
+ *
+ * The model and everything that consumes its data run on simulation time
+ * instead of the kernel tick:
+ *
+ *   - VehicleTask advances the clock by one step (1 / CTRL_LOOP_HZ) per
+ *     model step, and runs as many steps per control release as the scale
+ *     asks for (SimClock_Continue()).
+ *   - CanTxTask schedules the telemetry on SimClock_NowMs() and converts
+ *     its sleep back to kernel ticks (SimClock_ToTicks()), so the frames
+ *     keep their cycle times and deadbands in simulation time.
+ *
+ * Scales:
+ *
+ *   | Scale | Steps per release                   | Sim time          |
+ *   |-------|-------------------------------------|-------------------|
+ *   | 1     | 1                                   | kernel tick       |
+ *   | N     | N                                   | N x real time     |
+ *   | 0     | while SIM_CLOCK_FREE_LOAD_PCT of    | as fast as the    |
+ *   |       | the period is left ("max")          | CPU allows        |
+ *
+ * At scale 1 the clock is the kernel tick (plus the time gained in earlier
+ * fast runs), so the default build behaves as before. Sim time never
+ * jumps back when the scale changes. Other tasks keep real time: the CAN
+ * bus-off recovery, the RX ages and the sensors. The fleet runnables stay
+ * in the 100 ms raster.
+ *
+ * The model is deterministic per step, so a run at any scale passes
+ * through the same states; only the number of telemetry frames sent per
+ * simulated second may drop at high scales, since CanTxTask wakes at most
+ * once per tick and sends the latest snapshot.
+ *
+ * "sim" shows the scale, the sim time and the speed-up achieved,
+ * "sim scale <n|max>" sets the scale.
+ */
+
+#ifndef SIM_CLOCK_H
+#define SIM_CLOCK_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Largest fixed scale. */
+#ifndef SIM_CLOCK_MAX_SCALE
+#define SIM_CLOCK_MAX_SCALE     1000U
+#endif
+
+/** Share of the control period the free-running mode may use (%). */
+#ifndef SIM_CLOCK_FREE_LOAD_PCT
+#define SIM_CLOCK_FREE_LOAD_PCT 50U
+#endif
+
+#define SIM_CLOCK_SCALE_MAX     0U  /**< Free running: as fast as possible. */
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Clock state.
+ */
+typedef struct
+{
+    uint32_t scale;         /**< 1..SIM_CLOCK_MAX_SCALE, or SIM_CLOCK_SCALE_MAX. */
+    uint64_t simMs;         /**< Sim time since start. */
+    uint64_t steps;         /**< Model steps since start. */
+    uint32_t runSimMs;      /**< Sim time since the scale was set. */
+    uint32_t runTicks;      /**< Kernel ticks since the scale was set. */
+} SimClock_Status_t;
+
+/**
+ * @brief Start at scale 1 and register the "sim" commands.
+ */
+void SimClock_Init(void);
+
+/**
+ * @brief Set the scale (any task); sim time continues from where it is.
+ *
+ * @return HAL_OK, or HAL_ERROR above SIM_CLOCK_MAX_SCALE.
+ */
+HAL_StatusTypeDef SimClock_SetScale(uint32_t scale);
+
+/**
+ * @brief Current sim time (ms, wraps like the kernel tick; any task).
+ */
+uint32_t SimClock_NowMs(void);
+
+/**
+ * @brief Kernel ticks to sleep for @p simMs of sim time; at least one
+ *        tick for a non-zero time, osWaitForever passes through.
+ */
+uint32_t SimClock_ToTicks(uint32_t simMs);
+
+/**
+ * @brief Account for one model step of @p stepMs (control task only).
+ */
+void SimClock_Advance(uint32_t stepMs);
+
+/**
+ * @brief Whether the control task runs another step in this release.
+ *
+ * @param steps      Steps already run in this release.
+ * @param elapsedUs  Time since the release (CtrlLoop_ElapsedUs()).
+ * @param periodUs   Control period.
+ */
+uint8_t SimClock_Continue(uint32_t steps, uint32_t elapsedUs, uint32_t periodUs);
+
+/**
+ * @brief Consistent copy of the clock state (any task).
+ */
+void SimClock_GetStatus(SimClock_Status_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_CLOCK_H */
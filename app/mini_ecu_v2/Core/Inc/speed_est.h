@@ -0,0 +1,128 @@
+/**
+ * @file    speed_est.h
+ * @brief   Kalman filter estimate of vehicle speed and acceleration from
+ *          the speed sensor samples.
+ *
+ * SensorTask hands every block of the speed channel (vsensor.h), at
+ * VSENSOR_SAMPLE_HZ and in km/h after the fault injection but before the
+ * conditioning pipeline, to SpeedEst_Block(). The filter runs once per
+ * sample on the state x = [speed km/h, acceleration km/h/s]:
+ *
+ *   x' = F x + w,  F = | 1  dt |    w: white jerk of spectral density
+ *                      | 0   1 |       SPEED_EST_JERK_PSD
+ *   z  = H x + v,  H = | 1  0 |     v: sensor noise of variance
+ *                                      SPEED_EST_MEAS_VAR
+ *
+ * F, H, Q and R do not change, so the gain converges to a constant. With
+ * SPEED_EST_STEADY (the default) SpeedEst_Init() iterates the covariance
+ * recursion until it has, on the matrix kernels (dsp.h, arm_mat_*_f32()
+ * with DSP_USE_CMSIS), and a sample then costs the fixed-gain update,
+ * written out for this F and H: four multiply-adds. With 0 each sample
+ * runs the full predict / update on the kernels, P included (for a
+ * different model or a varying R later).
+ *
+ * A block the diagnostics find open, shorted or stuck is predicted only;
+ * after SPEED_EST_COAST_MS of that the estimate is invalid, and the next
+ * valid sample restarts the filter at it. With SPEED_EST_TELEMETRY the
+ * telemetry frame carries the valid estimate instead of the model's own
+ * speed (Vehicle_Publish()).
+ *
+ *   sensor est              state, gain, innovation, counters
+ */
+
+#ifndef SPEED_EST_H
+#define SPEED_EST_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = constant steady-state gain; 0 = full Kalman recursion per sample. */
+#ifndef SPEED_EST_STEADY
+#define SPEED_EST_STEADY        1
+#endif
+
+/** Process noise: jerk spectral density, (km/h/s^2)^2 s. */
+#ifndef SPEED_EST_JERK_PSD
+#define SPEED_EST_JERK_PSD      100.0f
+#endif
+
+/** Measurement noise variance, km/h^2: 6 counts of triangular noise plus
+ *  quantisation at 0.081 km/h per count (vsensor.c). */
+#ifndef SPEED_EST_MEAS_VAR
+#define SPEED_EST_MEAS_VAR      0.04f
+#endif
+
+/** Predicting only for longer than this makes the estimate invalid. */
+#ifndef SPEED_EST_COAST_MS
+#define SPEED_EST_COAST_MS      250U
+#endif
+
+/** Covariance iterations at most for the steady-state gain. */
+#ifndef SPEED_EST_RICCATI_MAX
+#define SPEED_EST_RICCATI_MAX   10000U
+#endif
+
+/** 1 = the telemetry frame carries the estimate (Vehicle_Publish()). */
+#ifndef SPEED_EST_TELEMETRY
+#define SPEED_EST_TELEMETRY     1
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Estimate and counters.
+ */
+typedef struct
+{
+    float    speedKph;      /**< Estimated speed, not below 0. */
+    float    accelKphS;     /**< Estimated acceleration. */
+    float    gain[2];       /**< Kalman gain of the last sample. */
+    float    innovMax;      /**< Largest |z - predicted| of the last block. */
+    uint32_t samples;       /**< Measurements taken. */
+    uint32_t coasted;       /**< Samples predicted only. */
+    uint32_t restarts;      /**< Restarts at a measurement. */
+    uint32_t gainIters;     /**< Covariance iterations to the steady gain. */
+    uint32_t timeMs;        /**< HAL tick of the last measurement. */
+    uint8_t  valid;
+} SpeedEst_State_t;
+
+/**
+ * @brief Compute the gain (SPEED_EST_STEADY) and register "sensor est".
+ *        Call once before the scheduler starts.
+ */
+void SpeedEst_Init(void);
+
+/**
+ * @brief Run the filter over @p n samples (km/h) of the speed channel
+ *        taken at VSENSOR_SAMPLE_HZ (SensorTask). @p valid = 0: the block
+ *        failed the diagnostics, predict @p n samples only.
+ */
+void SpeedEst_Block(const float *z, uint32_t n, uint8_t valid);
+
+/**
+ * @brief The estimated speed into @p kph, any task.
+ *
+ * @return Non-zero if valid; @p kph is left alone otherwise.
+ */
+uint8_t SpeedEst_GetKph(float *kph);
+
+/**
+ * @brief Consistent copy of the estimate and counters.
+ */
+void SpeedEst_Get(SpeedEst_State_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPEED_EST_H */
@@ -0,0 +1,55 @@
+/**
+ * @file    sram_layout.h
+ * @brief   Data placement in SRAM1 / SRAM2.
+ *
+ * The F446 SRAM is two bus-matrix slaves: SRAM1 (112 KB at 0x20000000)
+ * and SRAM2 (16 KB at 0x2001C000). The core and a DMA stream can each
+ * reach one of them in the same cycle, but two masters on one slave are
+ * arbitrated. STM32F446RETX_FLASH.ld therefore keeps them apart:
+ *
+ *   SRAM1  .ramfunc, .data, .bss (task stacks and TCBs in the RTOS heap or
+ *          the static task buffers, the signal cache, everything else),
+ *          heap and main stack
+ *   SRAM2  SRAM2_DMA buffers (the USART2 RX DMA buffer, the log rings and
+ *          their TX DMA staging and mux buffers, the wheel pulse capture
+ *          ring, the crank tooth table), NOINIT data, and in the
+ *          last 64 B the boot hand-off block (boot_handoff.h)
+ *
+ * SRAM2_DMA objects are zeroed by the startup code like .bss. NOINIT
+ * objects are never initialised and keep their contents over a reset
+ * (not over a power loss); validate them with a magic word before use.
+ * NOCLEAR objects are large SRAM1 buffers that nothing reads before
+ * writing (task stacks, rings read only up to a zeroed count); they
+ * follow .bss but are not zeroed, which saves start-up time (startup.h).
+ *
+ * The CAN trace ring (20 KB) does not fit SRAM2 and is only touched by
+ * the CPU, so it stays in .bss.
+ */
+
+#ifndef SRAM_LAYOUT_H
+#define SRAM_LAYOUT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Zero-initialised buffer in SRAM2, for DMA and bulk I/O data. */
+#ifndef SRAM2_DMA
+#define SRAM2_DMA  __attribute__((section(".bss.sram2")))
+#endif
+
+/** Object in SRAM2 that no startup code touches (crash data across resets). */
+#ifndef NOINIT
+#define NOINIT     __attribute__((section(".noinit")))
+#endif
+
+/** Object in SRAM1 the startup code does not zero; garbage until written. */
+#ifndef NOCLEAR
+#define NOCLEAR    __attribute__((section(".noclear")))
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRAM_LAYOUT_H */
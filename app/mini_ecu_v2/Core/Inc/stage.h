@@ -0,0 +1,189 @@
+/**
+ * @file    stage.h
+ * @brief   Background staging of an update image into the other A/B slot.
+ *
+ * The UDS server (uds.h) receives an image while the application keeps
+ * running: RequestDownload (0x34) to the base of the slot this image is not
+ * running from, TransferData (0x36) blocks, RequestTransferExit (0x37).
+ * The blocks go into a RAM ring (STAGE_RING_SIZE); Stage_Coop(), a
+ * coroutine of the low-priority BgTask (coop.h), erases the slot and
+ * programs the ring into it:
+ *
+ *   - Words are programmed STAGE_SLICE_WORDS at a time with the scheduler
+ *     suspended, ~16 us each: no task waits longer than one slice, every
+ *     task runs between two slices, and the other coroutines of BgTask get
+ *     a turn after each.
+ *   - A sector erase (64 or 128 KB, nominally 1..2 s on the F446) cannot be
+ *     sliced or suspended, and the control step, the rasters and the CAN
+ *     tasks all run from flash. Sectors that are already blank are skipped;
+ *     the others are erased only while the vehicle stands still
+ *     (STAGE_ERASE_MAX_KPH), the same window the flash log copies in
+ *     (nvm_log.h). The IWDG is reloaded just before, and the late WdgTask
+ *     run that follows restarts the task deadlines (watchdog.h).
+ *   - During either, the interrupts run from SRAM (ramfunc.h): CAN RX
+ *     frames queue in the RX ring, queued CAN TX frames keep leaving from
+ *     the mailbox interrupts, and the control loop release is counted.
+ *
+ * The longest time the scheduler was held, per kind of operation, is
+ * measured on the DWT cycle counter; "stage" and UDS_DID_STAGE report it.
+ *
+ * The whole slot is erased, the bootloader's tail (STAGE_SLOT_TAIL_SIZE:
+ * transfer records and signature check log) included, so the bootloader
+ * checks the new image from scratch. After 0x37 has found the header, the
+ * length and the CRC right, the image is activated like a bootloader
+ * update: its generation word is programmed one above the running image's
+ * ("stage activate" or routine UDS_RID_STAGE_ACTIVATE), and the next boot
+ * starts it on trial (boot_request.h).
+ *
+ * Staging is refused while the running image is on trial itself: the other
+ * slot then holds the image a rollback returns to.
+ */
+
+#ifndef STAGE_H
+#define STAGE_H
+
+#include "main.h"
+#include "coop.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Bytes TransferData may queue ahead of the programming; a power of two. */
+#ifndef STAGE_RING_SIZE
+#define STAGE_RING_SIZE        2048U
+#endif
+
+/** Words programmed per scheduler suspension. */
+#ifndef STAGE_SLICE_WORDS
+#define STAGE_SLICE_WORDS      16U
+#endif
+
+/** A sector erase waits for a speed below this (km/h). */
+#ifndef STAGE_ERASE_MAX_KPH
+#define STAGE_ERASE_MAX_KPH    0.5f
+#endif
+
+/** How often a pending erase checks its window (ms). */
+#ifndef STAGE_ERASE_POLL_MS
+#define STAGE_ERASE_POLL_MS    100U
+#endif
+
+/** Bytes at each slot end that belong to the bootloader (its
+ *  BOOT_SLOT_TAIL_SIZE, boot_resume.h; keep the two in sync). */
+#define STAGE_SLOT_TAIL_SIZE   1152U
+
+/** BgTask thread flag that wakes Stage_Coop(); apart from those of the
+ *  other coroutines (COOP_TABLE). */
+#define STAGE_FLAG             0x0008U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    STAGE_IDLE = 0,     /**< Nothing staged since boot. */
+    STAGE_ERASE,        /**< Erasing the slot (waiting for a window). */
+    STAGE_WRITE,        /**< Programming what TransferData delivers. */
+    STAGE_VERIFY,       /**< All bytes in, checking header and CRC. */
+    STAGE_READY,        /**< Verified image, ready to activate. */
+    STAGE_FAILED        /**< Aborted, flash error or bad image. */
+} Stage_State_t;
+
+/**
+ * @brief Staging figures.
+ */
+typedef struct
+{
+    Stage_State_t state;
+    uint32_t      base;          /**< Slot being staged into (the other one). */
+    uint32_t      length;        /**< Bytes announced by Stage_Begin(). */
+    uint32_t      received;      /**< Bytes taken by Stage_Write(). */
+    uint32_t      written;       /**< Bytes programmed and read back. */
+    uint32_t      erased;        /**< Sectors erased by the last staging. */
+    uint32_t      blank;         /**< Sectors found blank and skipped. */
+    uint32_t      sliceMaxUs;    /**< Longest program slice since boot. */
+    uint32_t      eraseMaxUs;    /**< Longest sector erase since boot. */
+    uint32_t      errors;        /**< Failed programs or erases since boot. */
+    const char   *reason;        /**< Why the last staging failed, or NULL. */
+} Stage_Stats_t;
+
+/**
+ * @brief Find the other slot and register the "stage" commands.
+ *
+ * Call before the scheduler starts (UDS serves requests in CanRxTask only).
+ *
+ * @return HAL_OK.
+ */
+HAL_StatusTypeDef Stage_Init(void);
+
+/**
+ * @brief The staging as a coroutine of BgTask (COOP_TABLE): sleeps on
+ *        STAGE_FLAG while nothing is staged, a slice per turn while
+ *        programming.
+ */
+void Stage_Coop(Coop_t *c);
+
+/**
+ * @brief Base address of the slot an image is staged into.
+ */
+uint32_t Stage_Target(void);
+
+/**
+ * @brief Start staging @p length bytes (the stamped image and its signature
+ *        trailer) into the other slot; discards an earlier one.
+ *
+ * @return HAL_OK; HAL_BUSY while the coroutine is still busy with an earlier
+ *         staging (it is aborted, retry); HAL_ERROR if the length does not
+ *         fit the slot or is not a multiple of 4, or the running image is
+ *         on trial.
+ */
+HAL_StatusTypeDef Stage_Begin(uint32_t length);
+
+/**
+ * @brief Queue the next @p n bytes of the image.
+ *
+ * @return HAL_OK; HAL_BUSY if the ring has no room for them yet (nothing
+ *         taken, retry); HAL_ERROR if no staging takes data or they run
+ *         past the announced length.
+ */
+HAL_StatusTypeDef Stage_Write(const uint8_t *data, uint32_t n);
+
+/**
+ * @brief The image is complete: HAL_OK once it is programmed and verified.
+ *
+ * @return HAL_OK; HAL_BUSY while the coroutine is still at it; HAL_ERROR if
+ *         bytes are missing or the staging failed.
+ */
+HAL_StatusTypeDef Stage_End(void);
+
+/**
+ * @brief Abandon the staging in progress; the slot stays as far as it got.
+ */
+void Stage_Abort(void);
+
+/**
+ * @brief Make the verified image boot next: program its generation.
+ *
+ * The caller resets (BootRequest_Restart()).
+ *
+ * @return HAL_OK, or HAL_ERROR if no image is ready or the program failed.
+ */
+HAL_StatusTypeDef Stage_Activate(void);
+
+/**
+ * @brief Copy the staging figures.
+ */
+void Stage_GetStats(Stage_Stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STAGE_H */
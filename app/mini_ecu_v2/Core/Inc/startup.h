@@ -0,0 +1,56 @@
+/**
+ * @file    startup.h
+ * @brief   Staged start-up before main(): clock first, then the RAM set-up.
+ *
+ * Reset_Handler (startup_stm32f446retx.s) runs in this order:
+ *
+ *   1. SystemInit()         FPU access, vector table
+ *   2. Startup_EarlyInit()  boot profile, the selected clock profile
+ *                           (ClockCfg_EarlyInit()) from the reset state
+ *   3. copy .data and .ramfunc from flash, 16 bytes per LDM/STM pair
+ *   4. zero .bss and .sram2, 16 bytes per STM
+ *   5. static constructors, main()
+ *
+ * So the memory loops run at the full core clock rather than the 16 MHz
+ * HSI, and buffers no code reads before writing them (NOCLEAR,
+ * sram_layout.h: task stacks, the CAN trace ring, the signal history)
+ * are not zeroed at all. SystemClock_Config() then finds the profile
+ * running and only adopts it.
+ *
+ * Reset_Handler marks each stage in the boot profile (boot_prof.h);
+ * Startup_Report() logs the sum once the log is up. The functions called
+ * from Reset_Handler may only use the stack, const data and NOINIT.
+ */
+
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start the boot profile (boot_prof.h) and the clock profile.
+ *
+ * Called from Reset_Handler only, before .data and .bss exist.
+ */
+void Startup_EarlyInit(void);
+
+/**
+ * @brief Log the time from reset to main() and the bytes copied and
+ *        zeroed. Call after Log_Init().
+ */
+void Startup_Report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STARTUP_H */
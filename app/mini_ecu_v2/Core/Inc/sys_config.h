@@ -0,0 +1,347 @@
+/**
+ * @file    sys_config.h
+ * @brief   Tasks, queues and interrupts of the application in tables, their
+ *          RAM budget and priority checks, the "tasks" and "irqs" reports.
+ *
+ * Every task is one line of SYS_TASK_TABLE: name, priority, stack, period
+ * and who creates it. From the table
+ *
+ *   - main.c defines the control block, the stack (NOCLEAR) and the
+ *     attributes of each SYS_BOOT and SYS_DEFERRED task and creates them,
+ *     in table order, before the scheduler starts or in DeferredInit();
+ *     the line's name is the task function.
+ *   - the modules that own their task (SYS_MODULE) take its priority and
+ *     stack from SYS_PRIO_<name> and SYS_WORDS_<name> below; the period
+ *     is only reported.
+ *   - sys_config.c checks at compile time that the stacks, control blocks
+ *     and queue storage of the table, and the kernel's idle and timer
+ *     tasks, fit in SYS_RAM_BUDGET, and that "stack" keeps every task.
+ *
+ * The statically allocated queues are listed in SYS_QUEUE_TABLE the same
+ * way: the owner sizes its storage from SYS_QDEPTH_<name>, the item type
+ * enters the budget.
+ *
+ * Adding a task or making a stack larger thus either fits the budget or
+ * fails the build. "tasks" prints the table with the bytes accounted:
+ *
+ *   Task            Prio  Stack B  Period us  Created
+ *   VehicleTask       40     1024     100000  boot
+ *   ...
+ *   11 tasks, 13768 B of 20480 B budget (idle and timer 1744 B)
+ *
+ * The priorities are the CMSIS-RTOS2 numbers (osPriorityNormal = 24).
+ * The raster tasks are accounted although raster.c only creates the ones
+ * with runnables, so the budget holds for any RASTER_RUNNABLE_TABLE.
+ *
+ * The interrupts are listed in SYS_IRQ_TABLE, with their NVIC priority
+ * against the kernel's syscall ceiling (see there).
+ */
+
+#ifndef SYS_CONFIG_H
+#define SYS_CONFIG_H
+
+#include "main.h"
+#include "cmsis_os2.h"
+#include "ctrl_loop.h"
+#include "vsensor.h"
+#include "watchdog.h"
+#include "irq_bench.h"
+#include "micro_bench.h"
+#include "fw_proxy.h"
+#include "can_if.h"
+#include "crank.h"
+#include "pc_prof.h"
+#include "qspi_flash.h"
+#include "usb_cdc.h"
+#include "watch.h"
+#include "FreeRTOSConfig.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/*
+ * What becomes of the CubeMX defaultTask (build option):
+ *   0  not built; LogTask and NvmTask serve the log and the flash log.
+ *   1  the generated osDelay(1) loop is created, to measure what it cost:
+ *      two context switches per tick and a 512 B stack from the heap.
+ *   2  BgTask: one low-priority thread serves both the log output and the
+ *      flash log in place of LogTask and NvmTask, one TCB and 512 B of
+ *      stack less (default).
+ * BgTask exists in every mode: its stackless coroutines (COOP_TABLE,
+ * coop.h) share one stack, the update staging always among them.
+ * "top" shows the context switches per second, "stack" the stacks.
+ */
+#ifndef DEFAULT_TASK_MODE
+#define DEFAULT_TASK_MODE  2
+#endif
+
+/** CliTask runs DeferredInit() at its table priority first, then this. */
+#ifndef CLI_TASK_PRIORITY
+#define CLI_TASK_PRIORITY  osPriorityAboveNormal
+#endif
+
+/** Stack of one raster task (words); the deepest runnable of the raster. */
+#ifndef RASTER_STACK_WORDS
+#define RASTER_STACK_WORDS      256U
+#endif
+
+/** Bytes of SRAM1 the table's tasks and queues may take, kernel included. */
+#ifndef SYS_RAM_BUDGET
+#define SYS_RAM_BUDGET     20480U
+#endif
+
+/* Who creates a task: main() before the scheduler, DeferredInit() in
+ * CliTask, or the owning module's init. */
+#define SYS_BOOT           0U
+#define SYS_DEFERRED       1U
+#define SYS_MODULE         2U
+
+#if DEFAULT_TASK_MODE == 2
+#define SYS_BG_TASKS_(X)                                                            \
+    X(BgTask,         osPriorityLow,          256U, 0U, SYS_BOOT) /* COOP_TABLE: log, flash log, staging */
+#else
+#define SYS_BG_TASKS_(X)                                                            \
+    X(LogTask,        osPriorityLow,          128U, 0U, SYS_BOOT) /* log ring to USART2 DMA */ \
+    X(NvmTask,        osPriorityLow,          256U, 0U, SYS_BOOT) /* DTC, calibration to flash */ \
+    X(BgTask,         osPriorityLow,          256U, 0U, SYS_BOOT) /* COOP_TABLE: staging */
+#endif
+
+/**
+ * Stackless coroutines BgTask runs (coop.h), in the order of a turn.
+ * X(name, function, flags): @p flags are all the thread flags the coroutine
+ * waits on, those a service waits on inside a turn included.
+ */
+#ifndef COOP_TABLE
+#if DEFAULT_TASK_MODE == 2
+#define COOP_TABLE(X)                                                               \
+    X(Log,    Log_Coop,    LOG_FLAG_DATA | LOG_FLAG_TX_DONE) /* log.h */            \
+    X(NvmLog, NvmLog_Coop, NVM_LOG_FLAG)                     /* nvm_log.h */        \
+    X(Stage,  Stage_Coop,  STAGE_FLAG)                       /* stage.h */
+#else
+#define COOP_TABLE(X)                                                               \
+    X(Stage,  Stage_Coop,  STAGE_FLAG)                       /* stage.h */
+#endif
+#endif
+
+#if WATCHDOG_ENABLE
+#define SYS_WDG_TASKS_(X)                                                           \
+    X(WdgTask,        osPriorityRealtime,     128U, WATCHDOG_CHECK_MS * 1000U, SYS_MODULE)
+#else
+#define SYS_WDG_TASKS_(X)
+#endif
+
+/* Flashing proxy: below CanRxTask, above the console it is fed from */
+#if FW_PROXY_ENABLE
+#define SYS_FW_PROXY_TASKS_(X)                                                      \
+    X(FwProxyTask,    osPriorityBelowNormal,  256U, 0U, SYS_MODULE) /* fw_proxy.h */
+#else
+#define SYS_FW_PROXY_TASKS_(X)
+#endif
+
+/* Load generator of "bench irq": below every task it measures */
+#if IRQ_BENCH_ENABLE
+#define SYS_IRQ_BENCH_TASKS_(X)                                                     \
+    X(IrqBenchTask,   osPriorityLow,          256U, 0U, SYS_DEFERRED)
+#else
+#define SYS_IRQ_BENCH_TASKS_(X)
+#endif
+
+/* Microbenchmarks of the bench image: above the tasks that would disturb
+ * a batch, yields a tick between batches */
+#if MICRO_BENCH_ENABLE
+#define SYS_MICRO_BENCH_TASKS_(X)                                                   \
+    X(MicroBenchTask, osPriorityHigh,         384U, 0U, SYS_DEFERRED)
+#else
+#define SYS_MICRO_BENCH_TASKS_(X)
+#endif
+
+/**
+ * X(name, priority, stackWords, periodUs, created); period 0 = woken by
+ * events only. Boot tasks are created in this order, which is also the
+ * order of their task numbers.
+ */
+#ifndef SYS_TASK_TABLE
+#define SYS_TASK_TABLE(X)                                                           \
+    X(VehicleTask,    CTRL_LOOP_PRIORITY,     256U, CTRL_LOOP_PERIOD_US, SYS_BOOT)  \
+    X(CliTask,        osPriorityLow,          256U, 0U, SYS_BOOT) /* CLI_TASK_PRIORITY after DeferredInit() */ \
+    X(CanRxTask,      osPriorityBelowNormal,  256U, 0U, SYS_BOOT) /* CAN_IF RX ring */ \
+    X(CanTxTask,      osPriorityNormal,       256U, 0U, SYS_BOOT) /* can_sched, bus-off */ \
+    X(SensorTask,     osPriorityNormal,       256U,                                 \
+      (VSENSOR_BLOCK * 1000000U) / VSENSOR_SAMPLE_HZ, SYS_BOOT)                     \
+    SYS_BG_TASKS_(X)                                                                \
+    SYS_WDG_TASKS_(X)                                                               \
+    SYS_FW_PROXY_TASKS_(X)                                                          \
+    X(Raster1ms,      osPriorityAboveNormal2, RASTER_STACK_WORDS, 1000U,   SYS_MODULE) \
+    X(Raster10ms,     osPriorityAboveNormal1, RASTER_STACK_WORDS, 10000U,  SYS_MODULE) \
+    X(Raster100ms,    osPriorityNormal1,      RASTER_STACK_WORDS, 100000U, SYS_MODULE) \
+    SYS_IRQ_BENCH_TASKS_(X)                                                         \
+    SYS_MICRO_BENCH_TASKS_(X)
+#endif
+
+#if MICRO_BENCH_ENABLE
+#define SYS_MICRO_BENCH_QUEUES_(X)  X(MicroBench, 1U, uint32_t)
+#else
+#define SYS_MICRO_BENCH_QUEUES_(X)
+#endif
+
+/**
+ * X(name, depth, itemType) of the statically allocated message queues.
+ */
+#ifndef SYS_QUEUE_TABLE
+#define SYS_QUEUE_TABLE(X)                                                          \
+    X(VehicleCmd,     4U, VehicleCmd_t)   /* CLI -> VehicleTask (vehicle_shared.h) */ \
+    SYS_MICRO_BENCH_QUEUES_(X)
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Interrupt priorities                                                       */
+/* -------------------------------------------------------------------------- */
+
+/*
+ * Every interrupt the application enables is one line of SYS_IRQ_TABLE:
+ * vector, NVIC priority (0 highest; 4 preemption bits, no subpriority) and
+ * where it sits against the kernel's syscall ceiling,
+ * configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY:
+ *
+ *   SYS_IRQ_KERNEL  the handler calls the FromISR API (thread flags,
+ *                   message bus, ...): at the ceiling or below, where the
+ *                   kernel's critical sections mask it
+ *   SYS_IRQ_FAST    latency-critical, the handler makes no kernel call:
+ *                   above the ceiling, so no critical section delays it
+ *
+ * sys_config.c checks every line against its kind at compile time.
+ * SysConfig_ApplyIrqs() sets the table's priorities after the CubeMX
+ * peripheral inits, over their generated defaults; the modules that
+ * enable a vector later set it from SYS_IRQ_PRIO_<name>, or from the
+ * configuration macro of their header that the line takes. At the end of
+ * the boot SysConfig_CheckIrqs() reads the NVIC back: an enabled vector at
+ * another priority than its line, or enabled without a line, is an error.
+ * "irqs" prints the table against the NVIC:
+ *
+ *   IRQ            Vec  Prio  NVIC  Kind    State
+ *   Watch           -4     0     0  fast    on
+ *   ...
+ *   25 interrupts, ceiling 5, 0 errors
+ *
+ * Vectors of disabled options stay in the table, unused: they are only
+ * checked while enabled.
+ */
+
+/* Where a line sits against the syscall ceiling. */
+#define SYS_IRQ_KERNEL     0U
+#define SYS_IRQ_FAST       1U
+
+/* Priority the kernel's own interrupts and the lowest lines share, and
+ * the highest that may call the kernel. */
+#define SYS_IRQ_LOWEST     configLIBRARY_LOWEST_INTERRUPT_PRIORITY
+#define SYS_IRQ_CEILING    configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY
+
+/* CAN RX above the kernel with CAN_IF_RX_FAST_IRQ (can_if.h): the RX
+ * vectors only fill the ring and pend the hand-off vector. */
+#if CAN_IF_RX_FAST_IRQ
+#define SYS_IRQ_CAN_RX_PRIO_   CAN_IF_RX_IRQ_PRIO
+#define SYS_IRQ_CAN_RX_KIND_   SYS_IRQ_FAST
+#else
+#define SYS_IRQ_CAN_RX_PRIO_   SYS_IRQ_CEILING
+#define SYS_IRQ_CAN_RX_KIND_   SYS_IRQ_KERNEL
+#endif
+
+#if USB_CDC_USE_OTG_FS
+#define SYS_IRQ_USB_IRQn_      OTG_FS_IRQn
+#else
+#define SYS_IRQ_USB_IRQn_      OTG_HS_IRQn
+#endif
+
+/**
+ * X(name, irqn, priority, kind), highest priority first. The CAN and
+ * console vectors share the ceiling, so none of them preempts another
+ * (the RX FIFOs, the TX refill and the bus-off wake-up rely on it).
+ */
+#ifndef SYS_IRQ_TABLE
+#define SYS_IRQ_TABLE(X)                                                            \
+    X(Watch,        DebugMonitor_IRQn,    WATCH_IRQ_PRIO,       SYS_IRQ_FAST)   /* watch.h */ \
+    X(PcProf,       TIM6_DAC_IRQn,        PC_PROF_IRQ_PRIO,     SYS_IRQ_FAST)   /* pc_prof.h */ \
+    X(Crank,        TIM4_IRQn,            CRANK_IRQ_PRIO,       SYS_IRQ_FAST)   /* crank, angle_sched */ \
+    X(Can1Rx0,      CAN1_RX0_IRQn,        SYS_IRQ_CAN_RX_PRIO_, SYS_IRQ_CAN_RX_KIND_) \
+    X(Can1Rx1,      CAN1_RX1_IRQn,        SYS_IRQ_CAN_RX_PRIO_, SYS_IRQ_CAN_RX_KIND_) \
+    X(Can2Rx0,      CAN2_RX0_IRQn,        SYS_IRQ_CAN_RX_PRIO_, SYS_IRQ_CAN_RX_KIND_) \
+    X(CanRxSwi,     CAN_IF_RX_SWI_IRQn,   SYS_IRQ_CEILING,      SYS_IRQ_KERNEL) /* wakes CanRxTask */ \
+    X(Can1Tx,       CAN1_TX_IRQn,         SYS_IRQ_CEILING,      SYS_IRQ_KERNEL)  \
+    X(Can1Sce,      CAN1_SCE_IRQn,        SYS_IRQ_CEILING,      SYS_IRQ_KERNEL) /* bus-off wake-up */ \
+    X(Can2Tx,       CAN2_TX_IRQn,         SYS_IRQ_CEILING,      SYS_IRQ_KERNEL)  \
+    X(Can2Sce,      CAN2_SCE_IRQn,        SYS_IRQ_CEILING,      SYS_IRQ_KERNEL)  \
+    X(CtrlLoop,     TIM5_IRQn,            SYS_IRQ_CEILING,      SYS_IRQ_KERNEL) /* wakes VehicleTask */ \
+    X(Usart2,       USART2_IRQn,          SYS_IRQ_CEILING,      SYS_IRQ_KERNEL) /* console */ \
+    X(UartRxDma,    DMA1_Stream5_IRQn,    SYS_IRQ_CEILING,      SYS_IRQ_KERNEL)  \
+    X(UartTxDma,    DMA1_Stream6_IRQn,    SYS_IRQ_CEILING,      SYS_IRQ_KERNEL) /* wakes LogTask */ \
+    X(VSensor,      DMA2_Stream0_IRQn,    SYS_IRQ_CEILING,      SYS_IRQ_KERNEL) /* wakes SensorTask */ \
+    X(DmaCopy,      DMA2_Stream1_IRQn,    SYS_IRQ_CEILING,      SYS_IRQ_KERNEL)  \
+    X(IrqBench,     EXTI4_IRQn,           IRQ_BENCH_EXTI_PRIO,                  \
+      (IRQ_BENCH_EXTI_PRIO < SYS_IRQ_CEILING) ? SYS_IRQ_FAST : SYS_IRQ_KERNEL) /* no kernel call */ \
+    X(UsbCdc,       SYS_IRQ_USB_IRQn_,    USB_CDC_IRQ_PRIO,     SYS_IRQ_KERNEL) /* usb_cdc.h */ \
+    X(QspiFlash,    QUADSPI_IRQn,         QSPI_FLASH_IRQ_PRIO,  SYS_IRQ_KERNEL) /* qspi_flash.h */ \
+    X(Exti15_10,    EXTI15_10_IRQn,       SYS_IRQ_LOWEST,       SYS_IRQ_KERNEL) /* pedal, NM wake-up */ \
+    X(PedalTimer,   TIM7_IRQn,            SYS_IRQ_LOWEST,       SYS_IRQ_KERNEL)  \
+    X(RtcWakeup,    RTC_WKUP_IRQn,        SYS_IRQ_LOWEST,       SYS_IRQ_KERNEL) /* low_power.h */ \
+    X(PendSV,       PendSV_IRQn,          SYS_IRQ_LOWEST,       SYS_IRQ_KERNEL) /* the kernel's */ \
+    X(SysTick,      SysTick_IRQn,         SYS_IRQ_LOWEST,       SYS_IRQ_KERNEL)
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Generated constants                                                        */
+/* -------------------------------------------------------------------------- */
+
+#define SYS_TASK_CONST_(name, prio, words, periodUs, created)                       \
+    SYS_PRIO_##name = (prio), SYS_WORDS_##name = (words), SYS_PERIOD_US_##name = (periodUs),
+#define SYS_TASK_COUNT_(name, prio, words, periodUs, created)   + 1U
+#define SYS_QUEUE_CONST_(name, depth, type)   SYS_QDEPTH_##name = (depth),
+#define SYS_IRQ_CONST_(name, irqn, prio, kind)   SYS_IRQ_PRIO_##name = (prio),
+#define SYS_IRQ_COUNT_(name, irqn, prio, kind)   + 1U
+
+enum
+{
+    SYS_TASK_TABLE(SYS_TASK_CONST_)
+    SYS_QUEUE_TABLE(SYS_QUEUE_CONST_)
+    SYS_IRQ_TABLE(SYS_IRQ_CONST_)
+};
+
+/** Tasks in SYS_TASK_TABLE. */
+#define SYS_TASKS          (0U SYS_TASK_TABLE(SYS_TASK_COUNT_))
+
+/** Interrupts in SYS_IRQ_TABLE. */
+#define SYS_IRQS           (0U SYS_IRQ_TABLE(SYS_IRQ_COUNT_))
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Register "tasks" and "irqs".
+ */
+void SysConfig_Init(void);
+
+/**
+ * @brief Set the NVIC priority of every SYS_IRQ_TABLE line (enables
+ *        nothing). Call after the CubeMX peripheral inits.
+ */
+void SysConfig_ApplyIrqs(void);
+
+/**
+ * @brief Check the NVIC against SYS_IRQ_TABLE and log each error: the
+ *        priority grouping, an enabled line at another priority, an
+ *        enabled vector without a line.
+ * @return Errors found.
+ */
+uint32_t SysConfig_CheckIrqs(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SYS_CONFIG_H */
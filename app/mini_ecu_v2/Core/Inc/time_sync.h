@@ -0,0 +1,233 @@
+/**
+ * @file    time_sync.h
+ * @brief   Time synchronization over CAN in the style of AUTOSAR CanTSyn:
+ *          one time master, SYNC and FUP messages, drift-corrected slaves.
+ *
+ * Every node counts microseconds since boot in hardware: TIM4 at 1 MHz,
+ * its update event clocking TIM12, read together as one 32-bit counter and
+ * extended to 64 bits here. That is the local time. The global time is the
+ * local time of the master; a slave maps its local time onto it.
+ *
+ * The master sends TimeSync (Core/mini_ecu.dbc) every TIME_SYNC_CYCLE_MS
+ * as a pair of frames on TIME_SYNC_CAN_ID:
+ *
+ *   SYNC (tsyn_type 0x10)  sequence counter and the seconds of the master
+ *                          time when it was queued
+ *   FUP  (tsyn_type 0x18)  the same counter and the master time at which
+ *                          the SYNC left, as seconds to add and microseconds
+ *
+ * The master takes that time in the TX-complete interrupt of the SYNC's
+ * mailbox, a slave its local time in the RX FIFO interrupt of the SYNC:
+ * both interrupts follow the end of the same frame on the bus, so the FUP
+ * tells a slave which global time belongs to its stamp. The bxCAN time-
+ * triggered mode stamps frames as well, but with its own bit-time counter
+ * that software cannot read, so those stamps cannot be related to either
+ * time; the interrupt stamps are off by their latency instead, some
+ * microseconds, the same on both sides as long as the CAN interrupts are
+ * not held up. TIME_SYNC_DELAY_US adds a measured difference.
+ *
+ * A slave then sets its global time to the stamp pair (a step, not a slew)
+ * and derives its rate against the master from the oldest of its last
+ * TIME_SYNC_RATE_PAIRS pairs, so the time between syncs is corrected for
+ * the drift of both crystals:
+ *
+ *   global = G0 + (L - L0) + (L - L0) * rate
+ *
+ * Before each step the time predicted for the new pair is compared with
+ * the one received; "tsyn" shows that error, the accuracy reached, last
+ * and worst. A slave that has no valid pair for TIME_SYNC_TIMEOUT_MS
+ * reports a timeout and keeps running on its last rate.
+ *
+ * The CAN trace (can_trace.h), the external log (ext_log.h), the tokenized
+ * log lines (log.h) and the telemetry samples (tlm_stream.h) are stamped
+ * with TimeSync_NowMsUs(), so captures from several nodes can be merged.
+ * Until a slave has synchronized, and on the master always, that is the
+ * local time. TIM4 and TIM12 stop in Stop mode (low_power.h), so after a
+ * bus sleep (can_nm.h) times jump until the first sync.
+ *
+ *   tsyn                 role, state, global and local time, rate and the
+ *                        accuracy; SYNC/FUP counters
+ *   tsyn reset           drop the synchronization (slave)
+ */
+
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include "main.h"
+#include "can_filters.h"
+#include "can_signals.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** SYNC and FUP identifier, in the high-priority range (can_filters.h). */
+#define TIME_SYNC_CAN_ID        CANSIG_TIME_SYNC_ID
+
+/** tsyn_type of the two messages. */
+#define TIME_SYNC_TYPE_SYNC     0x10U
+#define TIME_SYNC_TYPE_FUP      0x18U
+
+/** This node is the time master; the others are slaves. */
+#ifndef TIME_SYNC_MASTER
+#define TIME_SYNC_MASTER        (CAN_NODE_ID == 0U)
+#endif
+
+/** Time domain sent by the master and accepted by the slaves. */
+#ifndef TIME_SYNC_DOMAIN
+#define TIME_SYNC_DOMAIN        0U
+#endif
+
+/** SYNC cycle of the master (ms). */
+#ifndef TIME_SYNC_CYCLE_MS
+#define TIME_SYNC_CYCLE_MS      500U
+#endif
+
+/** A FUP later than this after its SYNC is dropped (ms). */
+#ifndef TIME_SYNC_FUP_TIMEOUT_MS
+#define TIME_SYNC_FUP_TIMEOUT_MS 100U
+#endif
+
+/** No valid pair for this long: timeout (ms). */
+#ifndef TIME_SYNC_TIMEOUT_MS
+#define TIME_SYNC_TIMEOUT_MS    2500U
+#endif
+
+/** Pairs kept for the rate, which spans one SYNC cycle less (2..8). */
+#ifndef TIME_SYNC_RATE_PAIRS
+#define TIME_SYNC_RATE_PAIRS    4U
+#endif
+
+/** Slave RX stamp minus master TX stamp of the same frame (us). */
+#ifndef TIME_SYNC_DELAY_US
+#define TIME_SYNC_DELAY_US      0
+#endif
+
+/** A pair this far from the prediction restarts the rate (us). */
+#ifndef TIME_SYNC_JUMP_US
+#define TIME_SYNC_JUMP_US       10000U
+#endif
+
+/** Rates beyond this are a bad pair, not a crystal (ppm). */
+#ifndef TIME_SYNC_MAX_PPM
+#define TIME_SYNC_MAX_PPM       500U
+#endif
+
+_Static_assert(TIME_SYNC_DOMAIN <= 15U, "TIME_SYNC_DOMAIN must be 0..15");
+_Static_assert((TIME_SYNC_RATE_PAIRS >= 2U) && (TIME_SYNC_RATE_PAIRS <= 8U),
+               "TIME_SYNC_RATE_PAIRS must be 2..8");
+_Static_assert(TIME_SYNC_TIMEOUT_MS > TIME_SYNC_CYCLE_MS,
+               "TIME_SYNC_TIMEOUT_MS must exceed the SYNC cycle");
+_Static_assert(TIME_SYNC_FUP_TIMEOUT_MS < TIME_SYNC_CYCLE_MS,
+               "TIME_SYNC_FUP_TIMEOUT_MS must be below the SYNC cycle");
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/** State of the global time. */
+typedef enum
+{
+    TIME_SYNC_LOCAL = 0,     /**< Never synchronized (or reset): local time. */
+    TIME_SYNC_SYNCED,        /**< Valid pairs arrive. */
+    TIME_SYNC_TIMEOUT,       /**< Synchronized before, no pair for TIME_SYNC_TIMEOUT_MS. */
+    TIME_SYNC_IS_MASTER      /**< The global time is the local time. */
+} TimeSync_State_t;
+
+/**
+ * @brief Synchronization figures since boot.
+ */
+typedef struct
+{
+    TimeSync_State_t state;
+    int32_t  ratePpb;        /**< Slave rate against the master (ppb, + = slow here). */
+    int64_t  offsetUs;       /**< Global minus local time at the last pair. */
+    uint32_t syncs;          /**< SYNC sent (master) or received (slave). */
+    uint32_t fups;           /**< FUP sent or received. */
+    uint32_t pairs;          /**< Pairs applied (slave). */
+    uint32_t fupLost;        /**< SYNC without a matching FUP in time (slave). */
+    uint32_t noStamp;        /**< SYNC without an RX or TX stamp. */
+    uint32_t jumps;          /**< Pairs beyond TIME_SYNC_JUMP_US (rate restarted). */
+    uint32_t timeouts;
+    uint32_t foreign;        /**< Messages from another master or domain. */
+    int32_t  errUs;          /**< Prediction error of the last pair. */
+    uint32_t errMaxUs;       /**< Largest |errUs| while synchronized. */
+    uint32_t lastPairMs;     /**< HAL tick of the last pair. */
+} TimeSync_Stats_t;
+
+/**
+ * @brief Start the microsecond counter (TIM4 -> TIM12), register the SYNC
+ *        and FUP frames (master) or the RX handler, and "tsyn". Call once
+ *        after CAN_IF_Init(), before the scheduler starts.
+ *
+ * @return HAL_OK, or HAL_ERROR if a frame or the handler cannot be registered.
+ */
+HAL_StatusTypeDef TimeSync_Init(void);
+
+/**
+ * @brief 100 ms runnable (raster.h): extend the local counter past its
+ *        32-bit wrap and watch the slave timeout.
+ */
+void TimeSync_Event100ms(void);
+
+/**
+ * @brief Local time, microseconds since boot (any context).
+ */
+uint64_t TimeSync_LocalUs(void);
+
+/**
+ * @brief Global time, microseconds since the master booted (any context).
+ */
+uint64_t TimeSync_NowUs(void);
+
+/**
+ * @brief Global time as milliseconds (wrapping like HAL_GetTick()) and
+ *        microseconds into that millisecond (0..999). Any context, in
+ *        SRAM (ramfunc.h): no 64-bit division.
+ */
+void TimeSync_NowMsUs(uint32_t *ms, uint32_t *us);
+
+/**
+ * @brief Global time in milliseconds, wrapping like HAL_GetTick().
+ */
+uint32_t TimeSync_NowMs(void);
+
+/**
+ * @brief CAN1 RX interrupt, a frame on TIME_SYNC_CAN_ID: stamp a SYNC.
+ */
+void TimeSync_OnCanRx(const uint8_t *data);
+
+/**
+ * @brief CAN1 TX-complete interrupt, a frame on TIME_SYNC_CAN_ID left the
+ *        mailbox: stamp the SYNC it was and queue its FUP.
+ */
+void TimeSync_OnTxConfirm(void);
+
+/**
+ * @brief The APB1 clock changed (clock_gov.h): restart the counter at the
+ *        new timer clock, continuing from @p localUs, the local time
+ *        before the switch plus its measured length.
+ */
+void TimeSync_ClockChanged(uint64_t localUs);
+
+/**
+ * @brief Drop the synchronization; the slave runs on local time until
+ *        the next pair.
+ */
+void TimeSync_Reset(void);
+
+/**
+ * @brief Copy the figures.
+ */
+void TimeSync_GetStats(TimeSync_Stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIME_SYNC_H */
@@ -0,0 +1,145 @@
+/**
+ * @file    timer_wheel.h
+ * @brief   Hierarchical timer wheel for protocol timeouts, ticked by the
+ *          1 ms raster.
+ *
+ * A protocol keeps its timers in its own state (a TimerWheel_Timer_t per
+ * timeout, e.g. ISO-TP N_Cr and N_Bs in IsoTp_Channel_t): nothing is
+ * allocated and nothing goes through a queue to a timer task, so starting,
+ * restarting and stopping are a few pointer writes, O(1) however many
+ * timers run.
+ *
+ * TIMER_WHEEL_LEVELS wheels of 2^TIMER_WHEEL_BITS slots each. Level 0 has
+ * a slot per millisecond; a slot of level n spans 2^(n * BITS) ms. A timer
+ * goes into the lowest level whose span covers its delay, in the slot of
+ * its expiry. Each tick takes the level-0 slot of that millisecond and
+ * fires what is in it; once level 0 comes round, the next slot of level 1
+ * is spread over level 0 (cascaded), and so on up. Every timer fires in
+ * the tick it is due, and moves at most once per level on the way.
+ * Defaults: 4 levels of 64 slots, delays up to 2^24 ms (4.6 h), longer
+ * ones clamped; 1 KB of slot heads.
+ *
+ * TimerWheel_Event1ms() is a runnable of the 1 ms raster (raster.h). It
+ * catches up on the ticks a late release missed (HAL_GetTick()), so a
+ * timer is never late more than the raster is. The callbacks run in that
+ * task, one after the other with interrupts enabled: they must be short
+ * and must not block, and typically set the owner's thread flag so the
+ * owner does the work in its own task.
+ *
+ * Start and stop are safe from any task and from interrupts; the lists are
+ * changed with interrupts masked, one timer at a time. A timer restarted
+ * between the tick taking it and its callback running still sees that
+ * callback, so an owner checks its own deadline when woken (as ISO-TP
+ * does), rather than trusting the wake-up alone.
+ *
+ *   wheel                   timers running, started, fired, cascaded
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Slots per level, as a power of two. */
+#ifndef TIMER_WHEEL_BITS
+#define TIMER_WHEEL_BITS        6U
+#endif
+
+/** Levels; BITS * LEVELS bits of milliseconds (at most 31). */
+#ifndef TIMER_WHEEL_LEVELS
+#define TIMER_WHEEL_LEVELS      4U
+#endif
+
+#if (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS) > 31U
+#error "TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS must stay below 32"
+#endif
+
+/** Longest delay (ms); longer ones are clamped to it. */
+#define TIMER_WHEEL_MAX_MS      ((1UL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1UL)
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/** Called in the 1 ms raster when the timer is due. */
+typedef void (*TimerWheel_Fn_t)(void *ctx);
+
+/**
+ * @brief One timer, embedded in its owner's state. Set up with
+ *        TimerWheel_Setup(); the rest is the wheel's.
+ */
+typedef struct TimerWheel_Timer_s
+{
+    struct TimerWheel_Timer_s  *next;
+    struct TimerWheel_Timer_s **pprev;   /**< NULL while not running. */
+    uint32_t                    expires; /**< HAL_GetTick() it fires at. */
+    TimerWheel_Fn_t             fn;
+    void                       *ctx;
+} TimerWheel_Timer_t;
+
+/**
+ * @brief Counters since boot.
+ */
+typedef struct
+{
+    uint32_t running;     /**< Timers in the wheel now ... */
+    uint32_t runningMax;  /**< ... and at most. */
+    uint32_t started;     /**< Starts and restarts. */
+    uint32_t stopped;     /**< Stopped before firing. */
+    uint32_t fired;
+    uint32_t cascaded;    /**< Moves to a lower level. */
+    uint32_t clamped;     /**< Delays cut to TIMER_WHEEL_MAX_MS. */
+    uint32_t caughtUp;    /**< Ticks a late raster release made up for. */
+    uint32_t firedMax;    /**< Most callbacks in one tick. */
+} TimerWheel_Stats_t;
+
+/**
+ * @brief Start the wheel at the current tick and register "wheel". Call
+ *        once before the scheduler starts, before any timer is started.
+ */
+void TimerWheel_Init(void);
+
+/**
+ * @brief Give @p t its callback; once per timer, while it is stopped.
+ */
+void TimerWheel_Setup(TimerWheel_Timer_t *t, TimerWheel_Fn_t fn, void *ctx);
+
+/**
+ * @brief (Re)start @p t to fire in @p ms (at least 1).
+ */
+void TimerWheel_Start(TimerWheel_Timer_t *t, uint32_t ms);
+
+/**
+ * @brief Stop @p t; nothing if it is not running.
+ */
+void TimerWheel_Stop(TimerWheel_Timer_t *t);
+
+/**
+ * @brief Non-zero while @p t waits to fire.
+ */
+uint8_t TimerWheel_IsRunning(const TimerWheel_Timer_t *t);
+
+/**
+ * @brief The due ticks: cascade and fire (1 ms raster runnable).
+ */
+void TimerWheel_Event1ms(void);
+
+/**
+ * @brief Consistent copy of the counters.
+ */
+void TimerWheel_GetStats(TimerWheel_Stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIMER_WHEEL_H */
@@ -0,0 +1,207 @@
+/**
+ * @file    tlm_stream.h
+ * @brief   Binary telemetry stream on the console UART ("tlm", tools/tlm_plot.py).
+ *
+ * The dashboard prints three values twice a second in about 60 text bytes.
+ * The stream sends a chosen set of the signals in TLM_SIGNAL_TABLE at up to
+ * 1 kHz instead, each sample as one binary frame of 2 bytes per signal:
+ *
+ *   0x00 | COBS(type | payload | CRC-16) | 0x00
+ *
+ * COBS removes every zero byte from the frame, so the zeros around it
+ * delimit frames on a UART also carrying CLI replies and log lines (which
+ * never contain a zero); CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF,
+ * little-endian) over type and payload rejects text and damaged frames.
+ *
+ *   'D' signal descriptor, one per selected signal:
+ *       version (u8), index (u8), count (u8), signal id (u8),
+ *       period ms (u16), scale (f32), name length (u8) + name,
+ *       unit length (u8) + unit
+ *   'S' sample: sequence (u16), global time ms (u32, time_sync.h), then
+ *       count raw values (i16) in descriptor order; physical = raw * scale
+ *
+ * Other modules send their own frame types the same way with
+ * TlmStream_SendFrame() ('N' and 'V', metrics.h); a decoder skips types
+ * it does not know.
+ *
+ * "tlm start" sends the descriptors before the first sample and again every
+ * TLM_DESC_PERIOD_MS, so a decoder that joins late learns the layout; the
+ * sequence counts every sample taken, so gaps show frames lost on the way.
+ *
+ * The samples are taken by a 1 ms runnable (raster.h) and queued on the
+ * log backend's telemetry stream (Log_WriteStream(LOG_STREAM_TLM)), which
+ * goes out by DMA from LogTask after any pending CLI output and log lines;
+ * with "log transport tlm rtt" they go to the probe instead. A frame the
+ * telemetry ring cannot take is dropped and counted. "tlm start" refuses a
+ * rate and signal set that would need more than TLM_LINK_PERCENT of the
+ * UART. With "log mux on" the frames travel inside mux frames on channel 2
+ * and tools/uart_mux.py hands them to the decoder.
+ *
+ *   tlm                           state, rate, frames, drops, link usage
+ *   tlm list                      signals with their id, unit and scale
+ *   tlm start <hz> [<sig,...>|all] stream the signals (default all)
+ *   tlm stop                      stop streaming
+ */
+
+#ifndef TLM_STREAM_H
+#define TLM_STREAM_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = telemetry stream and its 1 ms runnable built in. */
+#ifndef TLM_STREAM_ENABLE
+#define TLM_STREAM_ENABLE       1
+#endif
+
+/** Descriptors are repeated this often while streaming (ms). */
+#ifndef TLM_DESC_PERIOD_MS
+#define TLM_DESC_PERIOD_MS      2000U
+#endif
+
+/** Share of the UART bit rate "tlm start" may plan for (%). */
+#ifndef TLM_LINK_PERCENT
+#define TLM_LINK_PERCENT        80U
+#endif
+
+/** Highest sample rate (Hz); the runnable runs every 1 ms. */
+#define TLM_RATE_MAX            1000U
+
+/** Frame types and descriptor version. */
+#define TLM_FRAME_DESC          'D'
+#define TLM_FRAME_SAMPLE        'S'
+#define TLM_DESC_VERSION        1U
+
+/** Longest type + payload TlmStream_SendFrame() takes. */
+#define TLM_FRAME_MAX           64U
+
+/**
+ * @brief Streamable signals. X(name, text, unit, scale): TLM_SIG_<name>,
+ *        sent as raw = value / scale in an int16 (saturated). The id is the
+ *        position in the table; append new signals at the end.
+ */
+#define TLM_SIGNAL_TABLE(X)                                 \
+    X(SPEED,        "speed",        "km/h",  0.01f)         \
+    X(RPM,          "rpm",          "rpm",   1.0f)          \
+    X(COOLANT,      "coolant",      "degC",  0.01f)         \
+    X(CAN_SPEED,    "can_speed",    "km/h",  0.01f)         \
+    X(CAN_RPM,      "can_rpm",      "rpm",   1.0f)          \
+    X(CAN_COOLANT,  "can_coolant",  "degC",  0.01f)         \
+    X(CAN_AGE,      "can_age",      "ms",    1.0f)          \
+    X(SENS_SPEED,   "sens_speed",   "km/h",  0.01f)         \
+    X(SENS_RPM,     "sens_rpm",     "rpm",   1.0f)          \
+    X(SENS_COOLANT, "sens_coolant", "degC",  0.01f)         \
+    X(RAW_SPEED,    "raw_speed",    "count", 1.0f)          \
+    X(RAW_RPM,      "raw_rpm",      "count", 1.0f)          \
+    X(RAW_COOLANT,  "raw_coolant",  "count", 1.0f)          \
+    X(SENS_STATUS,  "sens_status",  "bits",  1.0f)          \
+    X(THROTTLE,     "throttle",     "%",     0.01f)         \
+    X(PEDAL,        "pedal",        "",      1.0f)          \
+    X(BUS_LOAD,     "bus_load",     "%",     0.1f)          \
+    X(CAN_TEC,      "can_tec",      "",      1.0f)          \
+    X(CAN_REC,      "can_rec",      "",      1.0f)          \
+    X(CPU_IDLE,     "cpu_idle",     "%",     0.1f)          \
+    X(LOG_FILL,     "log_fill",     "bytes", 1.0f)
+
+#define TLM_SIG_ENUM_(name, text, unit, scale)  TLM_SIG_##name,
+
+typedef enum
+{
+    TLM_SIGNAL_TABLE(TLM_SIG_ENUM_)
+    TLM_SIG_COUNT
+} TlmStream_Signal_t;
+
+_Static_assert(TLM_SIG_COUNT <= 32U, "TLM_SIGNAL_TABLE: selection masks are 32 bits");
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief One row of TLM_SIGNAL_TABLE.
+ */
+typedef struct
+{
+    const char *text;
+    const char *unit;
+    float       scale;      /**< Physical value of one raw count. */
+} TlmStream_SigInfo_t;
+
+/**
+ * @brief Stream counters.
+ */
+typedef struct
+{
+    uint8_t  running;
+    uint8_t  count;         /**< Signals selected. */
+    uint16_t periodMs;      /**< Sample period. */
+    uint32_t mask;          /**< Selected signals, bit = TlmStream_Signal_t. */
+    uint32_t samples;       /**< Samples taken since "tlm start". */
+    uint32_t dropped;       /**< Frames the telemetry ring could not take. */
+    uint32_t bytes;         /**< Bytes queued, descriptors included. */
+    uint32_t frameBytes;    /**< Bytes of one sample on the wire, at most. */
+} TlmStream_Stats_t;
+
+/**
+ * @brief Register the "tlm" commands; @p huart is the console UART, whose
+ *        bit rate bounds "tlm start".
+ *
+ * @return HAL_OK, or HAL_ERROR for a NULL @p huart.
+ */
+HAL_StatusTypeDef TlmStream_Init(UART_HandleTypeDef *huart);
+
+/**
+ * @brief Start streaming the signals in @p mask (bits of
+ *        TlmStream_Signal_t) every @p periodMs ms.
+ *
+ * @return HAL_OK, HAL_ERROR for an empty mask or a period out of range,
+ *         HAL_BUSY if it would need more than TLM_LINK_PERCENT of the UART.
+ */
+HAL_StatusTypeDef TlmStream_Start(uint32_t mask, uint32_t periodMs);
+
+/** Stop streaming. */
+void TlmStream_Stop(void);
+
+/** Copy the stream counters. */
+void TlmStream_GetStats(TlmStream_Stats_t *out);
+
+/** Row of signal @p sig, or NULL past the table. */
+const TlmStream_SigInfo_t *TlmStream_GetSignal(uint32_t sig);
+
+/** Signal id of the table name @p name ("speed"), or -1. */
+int32_t TlmStream_FindSignal(const char *name);
+
+/**
+ * @brief Physical values of the signals in @p mask into v[signal id]; the
+ *        other entries of @p v (TLM_SIG_COUNT floats) are left alone.
+ */
+void TlmStream_ReadSignals(uint32_t mask, float *v);
+
+/**
+ * @brief Queue @p len bytes of @p raw (type, payload) as one frame on the
+ *        telemetry stream, whether or not "tlm start" runs. @p raw needs
+ *        room for 2 more bytes (the CRC).
+ *
+ * @return HAL_OK, HAL_ERROR beyond TLM_FRAME_MAX, HAL_BUSY if the
+ *         telemetry ring could not take it.
+ */
+HAL_StatusTypeDef TlmStream_SendFrame(uint8_t *raw, uint32_t len);
+
+/**
+ * @brief 1 ms runnable (raster.h): take and queue a sample when one is due.
+ */
+void TlmStream_Event1ms(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLM_STREAM_H */
@@ -0,0 +1,137 @@
+/**
+ * @file    trip.h
+ * @brief   Trip computer and odometer, kept across resets in the flash log.
+ *
+ * VehicleTask calls Trip_Update() once per model step with the new state;
+ * each call adds that step's distance and time to a handful of counters,
+ * with no history and no search:
+ *
+ *   - odometer and total driving time (never reset)
+ *   - trip distance, driving time (speed at or above TRIP_MOVING_KPH) and
+ *     from them the average speed
+ *   - trip maximum engine speed
+ *   - trip time with the coolant above CAL TRIP_HOT_C
+ *
+ * Distance is integrated in whole metres with the fraction carried over,
+ * so the odometer does not drift however small a step is.
+ *
+ * The counters persist as three records of the flash log (nvm_log.h), but
+ * not on every change: Trip_Update() copies them to the stored set and
+ * wakes NvmTask every CAL TRIP_SAVE_MIN minutes of uptime while they
+ * changed, once the vehicle has stood still TRIP_STOP_SAVE_MS after a
+ * drive (the nearest this bench ECU has to key off), on "trip reset" and
+ * "trip save", and before a reset into the bootloader (Trip_Save(),
+ * boot_request.c). Only records whose values changed are written; a drive
+ * costs three 16-byte records per save, so the log's sector copy stays
+ * days apart. A reset loses at most the distance since the last save.
+ *
+ * The odometer also goes out on CAN every TRIP_ODO_CYCLE_MS (frame 0x110,
+ * Core/mini_ecu.dbc) from the TX scheduler, authenticated by SecOC
+ * (can_secoc.h), since a receiver must be able to trust it. The other
+ * counters share the multiplexed frame 0x111: one selector byte and two
+ * groups of bit-packed signals, sent in turn every TRIP_DATA_CYCLE_MS.
+ *
+ *   trip                 odometer and trip counters, last save
+ *   trip reset           start a new trip (the odometer stays)
+ *   trip save            write the counters now
+ */
+
+#ifndef TRIP_H
+#define TRIP_H
+
+#include "main.h"
+#include "vehicle.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Slowest speed counted as driving (km/h). */
+#ifndef TRIP_MOVING_KPH
+#define TRIP_MOVING_KPH         0.5f
+#endif
+
+/** Standstill after a drive that saves the counters (ms). */
+#ifndef TRIP_STOP_SAVE_MS
+#define TRIP_STOP_SAVE_MS       10000U
+#endif
+
+/** Odometer frame schedule (can_sched.h): cycle and phase (ms). */
+#ifndef TRIP_ODO_CYCLE_MS
+#define TRIP_ODO_CYCLE_MS       1000U
+#endif
+#ifndef TRIP_ODO_OFFSET_MS
+#define TRIP_ODO_OFFSET_MS      50U
+#endif
+
+/** Trip data frame schedule: one group per cycle, so each group is sent
+ *  every CANSIG_TRIP_DATA_GROUP_COUNT cycles (ms). */
+#ifndef TRIP_DATA_CYCLE_MS
+#define TRIP_DATA_CYCLE_MS      500U
+#endif
+#ifndef TRIP_DATA_OFFSET_MS
+#define TRIP_DATA_OFFSET_MS     300U
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Counters, whole units.
+ */
+typedef struct
+{
+    uint32_t odometerM;     /**< Distance since the log was formatted (m). */
+    uint32_t totalDriveS;   /**< Driving time, all trips (s). */
+    uint32_t tripM;
+    uint32_t tripDriveS;
+    uint32_t tripMaxRpm;
+    uint32_t tripHotS;      /**< Coolant above CAL TRIP_HOT_C (s). */
+    uint32_t saves;         /**< Saves queued since boot. */
+    uint32_t lastSaveMs;    /**< HAL tick of the last one. */
+} Trip_Stats_t;
+
+/**
+ * @brief Join the flash log and register "trip". Call once before
+ *        NvmLog_Init(), which restores the counters.
+ */
+void Trip_Init(void);
+
+/**
+ * @brief Add the odometer and trip data frames to the TX scheduler.
+ *        Call after CAN_IF_Init().
+ *
+ * @return HAL_OK, or HAL_ERROR if the scheduler table is full.
+ */
+HAL_StatusTypeDef Trip_CanInit(void);
+
+/**
+ * @brief Add one model step of @p stepMs with the state @p vs
+ *        (VehicleTask); saves when one is due.
+ */
+void Trip_Update(const VehicleState_t *vs, uint32_t stepMs);
+
+/**
+ * @brief Queue the changed counters for writing now (any task); NvmTask
+ *        writes them in the background.
+ *
+ * @return Records queued.
+ */
+uint32_t Trip_Save(void);
+
+/** Start a new trip and save; the odometer and total driving time stay. */
+void Trip_Reset(void);
+
+void Trip_GetStats(Trip_Stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRIP_H */
@@ -0,0 +1,148 @@
+/**
+ * @file    uart_baud.h
+ * @brief   Console baud rate switching with host confirmation ("baud").
+ *
+ * USART2 starts at 115200 baud, about 11.5 KB/s for the CLI, the log and
+ * the telemetry stream together. "baud <rate>" moves it to a faster rate
+ * the clock profile supports, without leaving a host that cannot follow
+ * cut off:
+ *
+ *   1. host: "baud 921600" at the current rate
+ *   2. ECU:  replies at the current rate, waits until LogTask has sent
+ *            everything queued, then reprograms BRR (and OVER8)
+ *   3. host: switches its port and sends "baud ok" at the new rate within
+ *            UART_BAUD_CONFIRM_MS
+ *   4. ECU:  "baud ok" keeps the rate; without it a 100 ms runnable
+ *            (raster.h) goes back to the rate before step 1
+ *
+ * USART2 is clocked by PCLK1. The divider PCLK1 / baud is rounded to a
+ * whole clock, with 16x oversampling down to 16 and OVER8 down to 8, so
+ * the fastest rate is PCLK1 / 8 (5.625 Mbaud at the 180 MHz profile,
+ * 1 Mbaud at HSI16). A rate more than UART_BAUD_MAX_ERR_PERMILLE off after
+ * rounding is refused: at 45 MHz, 921600 (-0.35 %), 2250000 and 3000000
+ * (OVER8) are exact enough, 2000000 (-2.2 %) is not; at the 84 MHz
+ * profile 2000000 and 3000000 are exact.
+ *
+ * The bootloader's update protocol switches the same way (BAUD command in
+ * its boot_update.h; tools/fw_update.py --speed). tools/baud_switch.py
+ * does steps 1 and 3 for the other host tools.
+ *
+ *   baud                  rate, divider, error and limits
+ *   baud <rate>           switch, to be confirmed at the new rate
+ *   baud ok               confirm the switch
+ */
+
+#ifndef UART_BAUD_H
+#define UART_BAUD_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = "baud" commands and the confirmation runnable built in. */
+#ifndef UART_BAUD_ENABLE
+#define UART_BAUD_ENABLE            1
+#endif
+
+/** Time the host has to send "baud ok" at the new rate (ms). */
+#ifndef UART_BAUD_CONFIRM_MS
+#define UART_BAUD_CONFIRM_MS        2000U
+#endif
+
+/** Longest wait for the queued output to go out before switching (ms). */
+#ifndef UART_BAUD_DRAIN_MS
+#define UART_BAUD_DRAIN_MS          500U
+#endif
+
+/** Rate error allowed after rounding the divider (1/1000). */
+#ifndef UART_BAUD_MAX_ERR_PERMILLE
+#define UART_BAUD_MAX_ERR_PERMILLE  20U
+#endif
+
+/** Slowest rate accepted. */
+#define UART_BAUD_MIN               1200U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief A rate as USART2 would run it.
+ */
+typedef struct
+{
+    uint32_t baud;          /**< Requested rate. */
+    uint32_t actual;        /**< PCLK1 / divider. */
+    uint32_t brr;           /**< USART_BRR value. */
+    uint8_t  over8;         /**< 1 = 8x oversampling (CR1.OVER8). */
+    int16_t  errPermille;   /**< (actual - baud) / baud. */
+} UartBaud_Setting_t;
+
+/**
+ * @brief Register the "baud" commands for the console UART @p huart.
+ *
+ * @return HAL_OK, or HAL_ERROR for a NULL @p huart.
+ */
+HAL_StatusTypeDef UartBaud_Init(UART_HandleTypeDef *huart);
+
+/**
+ * @brief Divider and error of @p baud from a @p pclkHz UART clock.
+ *
+ * @return HAL_OK, or HAL_ERROR if the rate is out of reach or more than
+ *         UART_BAUD_MAX_ERR_PERMILLE off (@p out is filled either way).
+ */
+HAL_StatusTypeDef UartBaud_Compute(uint32_t pclkHz, uint32_t baud, UartBaud_Setting_t *out);
+
+/**
+ * @brief Switch the console to @p baud once the queued output is out, and
+ *        go back unless UartBaud_Confirm() follows in UART_BAUD_CONFIRM_MS.
+ *
+ * Call from CliTask (above LogTask), after the reply announcing the switch
+ * has been queued.
+ *
+ * @return HAL_OK, HAL_ERROR for a rate UartBaud_Compute() refuses,
+ *         HAL_TIMEOUT if the output did not drain in UART_BAUD_DRAIN_MS.
+ */
+HAL_StatusTypeDef UartBaud_Request(uint32_t baud);
+
+/**
+ * @brief Keep the rate of the pending switch.
+ *
+ * @return HAL_OK, or HAL_ERROR if no switch is pending.
+ */
+HAL_StatusTypeDef UartBaud_Confirm(void);
+
+/** Current console rate (the requested value, see UartBaud_Setting_t). */
+uint32_t UartBaud_Get(void);
+
+/**
+ * @brief 100 ms runnable (raster.h): restore the previous rate when a
+ *        switch was not confirmed in time.
+ */
+void UartBaud_Event100ms(void);
+
+/**
+ * @brief 1 if the current rate, and the one a pending switch would go back
+ *        to, stay within UART_BAUD_MAX_ERR_PERMILLE from a @p pclkHz PCLK1.
+ */
+uint8_t UartBaud_Fits(uint32_t pclkHz);
+
+/**
+ * @brief After a PCLK1 change (clock_gov.h): recompute BRR for the current
+ *        rate, and the rate to go back to. The caller makes sure nothing
+ *        is being sent.
+ */
+void UartBaud_Retime(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UART_BAUD_H */
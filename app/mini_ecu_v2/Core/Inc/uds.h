@@ -0,0 +1,219 @@
+/**
+ * @file    uds.h
+ * @brief   UDS diagnostic server (ISO 14229) on the diagnostic ISO-TP channel.
+ *
+ * Requests arrive on the physical ID 0x7E0 + CAN_NODE_ID or the functional
+ * ID 0x7DF and are answered on 0x7E8 + CAN_NODE_ID. Each one is served in
+ * CanRxTask as soon as ISO-TP has reassembled it: the response is built
+ * straight into a mem_pool block that ISO-TP then sends and frees, so a
+ * tester can send the next request as soon as the last frame left.
+ *
+ *   | SID  | Service                     | Notes                              |
+ *   |------|-----------------------------|------------------------------------|
+ *   | 0x01 | OBD-II current data         | PIDs of obd.h, OBD_ENABLE          |
+ *   | 0x10 | DiagnosticSessionControl    | 01 default, 02 programming, 03 ext |
+ *   | 0x14 | ClearDiagnosticInformation  | group 0xFFFFFF (DTCs, crash record)|
+ *   | 0x19 | ReadDTCInformation          | sub 01, 02, 03, 04, 0A             |
+ *   | 0x22 | ReadDataByIdentifier        | up to UDS_MAX_READ_DIDS per request|
+ *   | 0x2A | ReadDataByPeriodicIdentifier| signal DIDs, extended session      |
+ *   | 0x2E | WriteDataByIdentifier       | calibration DIDs, extended session |
+ *   | 0x31 | RoutineControl              | UDS_RID_* below                    |
+ *   | 0x34 | RequestDownload             | other slot, extended session       |
+ *   | 0x36 | TransferData                | into the staging ring (stage.h)    |
+ *   | 0x37 | RequestTransferExit         | once the image is verified         |
+ *   | 0x3E | TesterPresent               | sub 00                             |
+ *
+ * 0x22 takes up to UDS_MAX_READ_DIDS DIDs in one request and answers them
+ * in one response, so a tester polls every signal of the dashboard in one
+ * round trip; DIDs this ECU does not know are left out, and only a request with
+ * none it knows is rejected (NRC 0x31).
+ *
+ * 0x2A <mode> <pDID>... subscribes periodic DIDs (0xF2xx, the request
+ * carries xx) at UDS_PERIODIC_SLOW_MS (mode 01), _MEDIUM_MS (02) or
+ * _FAST_MS (03), or stops them (04; without a pDID all of them), and
+ * answers 0x6A. The periodic DID 0xF2xx is signal DID 0x01xx. The TX
+ * scheduler (can_sched.h, one entry per rate) then sends each as one
+ * frame on UDS_CAN_PERIODIC_ID, <xx> <value> (ISO 14229-2 type 2), scaled
+ * from the signal cache when it is due: one frame per sample, where a
+ * 0x22 poll costs the request and the response. A subscription replaces
+ * the rate of a pDID already scheduled; a request with a pDID this ECU
+ * does not have is rejected whole (NRC 0x31). The stream ends when the
+ * extended session does: on 0x10 to another session and UDS_S3_TIMEOUT_MS
+ * after the last request, so a tester keeps it with 0x3E.
+ *
+ * DIDs:
+ *   - UDS_SIGNAL_DID_TABLE: the RX signal cache (can_sigcache.h), scaled to
+ *     unsigned 16-bit big-endian; 0xFFFF when stale or never received.
+ *     0xF2xx reads 0x01xx as well.
+ *   - UDS_DID_CAL_BASE + key: a calibration parameter (cal.h), the 4 bytes of
+ *     its value big-endian (float bits for F parameters). Written by 0x2E;
+ *     "cal commit" or routine UDS_RID_CAL_COMMIT keeps it over a reset.
+ *   - UDS_DID_CRASH: summary of the last crash (crash_dump.h): count, cause,
+ *     PC, LR, CFSR, HFSR, fault address and uptime; zeros without one.
+ *     0x14 clears it with the DTCs.
+ *   - UDS_DID_CAN_STATS: CAN1 counters since boot (can_stats.h), for
+ *     testers that load the bus (tools/can_hil.py): RX and TX frames, RX
+ *     frames lost by a full hardware FIFO and by a full RX ring, error
+ *     frames and bus-off entries, all u32, then the peak bus load in
+ *     permille (u16), TEC and REC; 28 bytes big-endian.
+ *   - UDS_DID_STAGE: image staging (stage.h): target slot base (u32),
+ *     state (u8, Stage_State_t), sectors erased (u8), bytes programmed,
+ *     longest program slice and longest sector erase in us (u32 each);
+ *     18 bytes big-endian.
+ *   - UDS_DID_LOAD_BASE + rpm bin: one row of the rpm x speed load
+ *     collective (load_coll.h), model steps per speed bin (u32 each);
+ *     UDS_DID_LOAD_TEMP: the coolant bins the same way. A response holds
+ *     seven rows, so a tester reads the collective in two requests.
+ *   - UDS_DID_PERF_LIFE_BASE + counter: one lifetime performance counter
+ *     (perf_life.h), u32.
+ *   - UDS_DID_METRICS_BASE + metric: one metric of METRICS_TABLE
+ *     (metrics.h), its words as u32: a counter 4 bytes, a gauge 8 (value,
+ *     peak), a histogram 32 (the buckets).
+ *   - 0xF186 active session, 0xF189 software version ("M.m.p").
+ *
+ * DTC snapshots (0x19 04 <DTC> <record>, 0xFF for all; 0x19 03 lists the
+ * DTCs and records stored):
+ *   - 01: speed, rpm and coolant of the DTC entry at its first occurrence,
+ *     as DIDs 0x0100..0x0102;
+ *   - 02: the freeze frame (freeze_frame.h) of the DTC, every signal DID as
+ *     the cache held it at the capture, 0xFFFF if it was stale then;
+ *   - 03: UDS_DID_FREEZE_HIST, the rows before the capture: rows (u8),
+ *     row period (u16 ms), then per row, oldest first, each signal of
+ *     FREEZE_FRAME_SIGNAL_TABLE scaled like its signal DID (u16).
+ *   02 and 03 exist only while the DTC holds a freeze frame.
+ *
+ * Routines:
+ *   - UDS_RID_CAL_COMMIT start: Cal_Commit(); result: values queued (u8).
+ *   - UDS_RID_SCENARIO start <name>: play at 1x; stop; results: playing
+ *     (u8), scenario time (u32 ms).
+ *   - UDS_RID_SIG_HIST start <TLM signal id (u8), tier (u8: 0 raw, 1 sec,
+ *     2 min), back (u16), count (u8)>: signal, tier, then the buckets
+ *     copied (u8) and each min, max, mean (i16, raw scaling), newest first
+ *     after skipping back; up to 41 a response.
+ *     Only with SIG_HIST_ENABLE; NRC 0x21 while the history is updating.
+ *   - UDS_RID_STAGE_ACTIVATE start: activate the staged image and reset
+ *     into it after the response; NRC 0x24 without a verified one.
+ *   - UDS_RID_AUDIT start <back (u16), count (u8)>: the events copied (u8),
+ *     then each 16 bytes as in audit.h (time u32, seq u16, command u8,
+ *     source u8, two arguments u32), newest first after skipping back; up
+ *     to 15 a response.
+ *
+ * Download into the other slot while the application runs (stage.h):
+ * 0x34 00 44 <slot base (u32)> <bytes (u32)> answers 0x74 0x20 <max block
+ * length (u16)>, the bytes of a 0x36 request including SID and counter.
+ * 0x36 <counter> <data> blocks follow, the counter from 0x01 and wrapping
+ * to 0x00; a repeat of the last block is answered without being written
+ * again. 0x36 and 0x37 answer NRC 0x21 while the staging is behind (the ring
+ * is full during a sector erase, or the image is still being checked): the
+ * tester repeats the same request. 0x37 fails with NRC 0x72 if the header
+ * or CRC of the programmed image is wrong. Leaving the extended session
+ * abandons the download. tools/uds_stage.py drives it.
+ *
+ * The extended session (and the programming session, which resets into the
+ * bootloader, boot_request.h) falls back to the default session
+ * UDS_S3_TIMEOUT_MS after the last request. Functional requests never get
+ * the negative responses ISO 14229 suppresses for them.
+ *
+ * "uds" shows the session and the request counts.
+ */
+
+#ifndef UDS_H
+#define UDS_H
+
+#include "main.h"
+#include "can_filters.h"
+#include "load_coll.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+#define UDS_CAN_REQ_ID       (0x7E0U + CAN_NODE_ID)
+#define UDS_CAN_RESP_ID      (0x7E8U + CAN_NODE_ID)
+#define UDS_CAN_FUNC_ID      0x7DFU
+#define UDS_CAN_PERIODIC_ID  (0x6E8U + CAN_NODE_ID)   /**< 0x2A frames */
+
+/** S3: a non-default session without requests ends after this long (ms). */
+#ifndef UDS_S3_TIMEOUT_MS
+#define UDS_S3_TIMEOUT_MS    5000U
+#endif
+
+/** DIDs one ReadDataByIdentifier request may carry. */
+#ifndef UDS_MAX_READ_DIDS
+#define UDS_MAX_READ_DIDS    16U
+#endif
+
+/** Periods of the 0x2A rates (ms, model time like every scheduled frame). */
+#ifndef UDS_PERIODIC_SLOW_MS
+#define UDS_PERIODIC_SLOW_MS    1000U
+#endif
+#ifndef UDS_PERIODIC_MEDIUM_MS
+#define UDS_PERIODIC_MEDIUM_MS  200U
+#endif
+#ifndef UDS_PERIODIC_FAST_MS
+#define UDS_PERIODIC_FAST_MS    50U
+#endif
+
+/** P2 / P2* server timing reported by DiagnosticSessionControl (ms). */
+#define UDS_P2_MS            50U
+#define UDS_P2_EXT_MS        5000U
+
+/**
+ * @brief Signal DIDs. X(did, signal, scale, offset): the response value is
+ *        (physical + offset) * scale, clamped to 0..0xFFFE.
+ */
+#define UDS_SIGNAL_DID_TABLE(X)                               \
+    X(0x0100U, CAN_SIG_SPEED,        100.0f, 0.0f)  /* 0.01 km/h */     \
+    X(0x0101U, CAN_SIG_RPM,          1.0f,   0.0f)  /* rpm */           \
+    X(0x0102U, CAN_SIG_COOLANT,      10.0f,  40.0f) /* 0.1 C, -40 C */  \
+    X(0x0110U, CAN_SIG_SENS_SPEED,   100.0f, 0.0f)                      \
+    X(0x0111U, CAN_SIG_SENS_RPM,     1.0f,   0.0f)                      \
+    X(0x0112U, CAN_SIG_SENS_COOLANT, 10.0f,  40.0f)
+
+/** Calibration DIDs: base + the CAL_TABLE key. */
+#define UDS_DID_CAL_BASE     0xC000U
+
+#define UDS_DID_CRASH        0x0120U
+#define UDS_DID_CAN_STATS    0x0130U
+#define UDS_DID_STAGE        0x0150U
+#define UDS_DID_FREEZE_HIST  0x0140U    /**< 0x19 04 record 03 only */
+#define UDS_DID_LOAD_BASE    0x0160U    /**< + rpm bin (load_coll.h) */
+#define UDS_DID_LOAD_TEMP    (UDS_DID_LOAD_BASE + LOAD_COLL_RPM_BINS)
+#define UDS_DID_PERF_LIFE_BASE 0x0170U  /**< + counter (perf_life.h) */
+#define UDS_DID_METRICS_BASE 0x0190U    /**< + metric (metrics.h) */
+#define UDS_DID_PERIODIC_BASE 0xF200U  /**< + xx: signal DID 0x0100 + xx */
+#define UDS_DID_SESSION      0xF186U
+#define UDS_DID_SW_VERSION   0xF189U
+
+/** Routines (0x31). */
+#define UDS_RID_CAL_COMMIT   0x0200U   /**< start: Cal_Commit(), result: values queued */
+#define UDS_RID_SCENARIO     0x0201U   /**< start <name>, stop, results: playing, time */
+#define UDS_RID_SIG_HIST     0x0202U   /**< start <sig, tier, back, count>: buckets (sig_hist.h) */
+#define UDS_RID_STAGE_ACTIVATE 0x0203U /**< start: boot the staged image (stage.h) */
+#define UDS_RID_AUDIT        0x0204U   /**< start <back, count>: audit events (audit.h) */
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Open the diagnostic ISO-TP channel, add the periodic DID rates to
+ *        the TX scheduler and register the "uds" command.
+ *
+ * Call after CAN_IF_Init() and CLI_IF_Init().
+ *
+ * @return HAL_OK, or HAL_ERROR if the can_if, ISO-TP or scheduler tables
+ *         are full.
+ */
+HAL_StatusTypeDef Uds_Init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UDS_H */
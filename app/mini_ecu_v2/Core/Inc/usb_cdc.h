@@ -0,0 +1,203 @@
+/**
+ * @file    usb_cdc.h
+ * @brief   USB CDC-ACM console: a virtual COM port for the CLI and the log.
+ *
+ * The ST-LINK UART tops out at a few hundred KB/s at best; a full-speed
+ * USB bulk endpoint carries 64-byte packets, up to 19 per 1 ms frame.
+ * This is a register-level device driver for the on-chip OTG core (slave
+ * mode, no ST USB middleware) exposing one CDC-ACM function:
+ *
+ *   EP0      control: enumeration, SET/GET_LINE_CODING,
+ *            SET_CONTROL_LINE_STATE
+ *   EP1 IN   bulk 64 B, ECU -> host
+ *   EP1 OUT  bulk 64 B, host -> ECU (CLI input)
+ *   EP2 IN   interrupt 8 B, CDC notifications (never sent)
+ *
+ * The device enumerates as a plain CDC-ACM port (/dev/ttyACM*, COMx with
+ * the in-box usbser driver). The line coding the host sets is kept for
+ * GET_LINE_CODING only; a USB port has no baud rate.
+ *
+ * Pins and core: PA11/PA12 (OTG_FS) carry CAN1 on this board, so by
+ * default the OTG_HS core is used with its embedded full-speed PHY on
+ * PB14 (DM) / PB15 (DP), AF12; USB_CDC_USE_OTG_FS selects OTG_FS for a
+ * board with CAN1 elsewhere. VBUS is not sensed (B-session valid is
+ * forced), so the pull-up is on whenever the driver is: wire D-, D+ and
+ * GND to a connector on the morpho header (CN10 pins 28 / 26 for PB14 /
+ * PB15 on the Nucleo-F446RE).
+ *
+ * Clock: the 48 MHz USB clock comes from PLLSAI (input / 8 x 96 / 4),
+ * selected as CK48, so it runs under every clock profile (clock_cfg.h)
+ * without touching the main PLL; HCLK must be at least 14.2 MHz. From
+ * the HSI (+-1 %) the clock is outside the 0.25 % the USB specification
+ * asks for; hosts in practice accept it, an HSE makes it compliant.
+ *
+ * Data path: the IN transfer reads straight from the caller's buffer into
+ * the endpoint FIFO, packet by packet from the FIFO-empty interrupt, so
+ * the log's staging chunk (log.c) is the only copy between the log ring
+ * and the wire. Completion calls UsbCdc_TxCpltCallback(), which log.c
+ * overrides like HAL_UART_TxCpltCallback(). A host that stops reading
+ * while the port is open does not hold LogTask: a transfer without
+ * progress for USB_CDC_TX_TIMEOUT_MS frames (SOF) is aborted and
+ * completes. OUT packets go to a USB_CDC_RX_SIZE ring that CliTask reads
+ * (UsbCdc_RxCallback() wakes it); the endpoint NAKs while the ring has no
+ * room for another packet.
+ *
+ * With the "usb" log transport (log.h) any stream goes over the port.
+ * When the host opens it (DTR set) the CLI output moves there and goes
+ * back to LOG_CLI_TRANSPORT when it closes (cli_if.c), so the bulk dumps
+ * that pace themselves on the CLI ring ("can trace dump", "rtos trace
+ * dump", "crash") run at USB speed.
+ *
+ *   usb                   state, line coding and byte counts
+ */
+
+#ifndef USB_CDC_H
+#define USB_CDC_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = USB CDC-ACM console built in (needs a USB connector, see above). */
+#ifndef USB_CDC_ENABLE
+#define USB_CDC_ENABLE          0
+#endif
+
+/** 0 = OTG_HS core, embedded FS PHY on PB14/PB15; 1 = OTG_FS on PA11/PA12. */
+#ifndef USB_CDC_USE_OTG_FS
+#define USB_CDC_USE_OTG_FS      0
+#endif
+
+/** Host -> ECU ring (bytes, power of two, at least two packets). */
+#ifndef USB_CDC_RX_SIZE
+#define USB_CDC_RX_SIZE         256U
+#endif
+
+/** An IN transfer without a packet taken for this many frames is aborted. */
+#ifndef USB_CDC_TX_TIMEOUT_MS
+#define USB_CDC_TX_TIMEOUT_MS   100U
+#endif
+
+/** NVIC priority of the OTG interrupt (may use FreeRTOS FromISR calls). */
+#ifndef USB_CDC_IRQ_PRIO
+#define USB_CDC_IRQ_PRIO        6U
+#endif
+
+/** USB IDs: ST's Virtual COM Port, which every host binds to its CDC driver. */
+#ifndef USB_CDC_VID
+#define USB_CDC_VID             0x0483U
+#endif
+#ifndef USB_CDC_PID
+#define USB_CDC_PID             0x5740U
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Device state, as seen from the bus.
+ */
+typedef enum
+{
+    USB_CDC_DETACHED = 0,   /**< Not started, or no bus reset seen yet. */
+    USB_CDC_DEFAULT,        /**< After a bus reset. */
+    USB_CDC_ADDRESSED,
+    USB_CDC_CONFIGURED,
+    USB_CDC_SUSPENDED
+} UsbCdc_State_t;
+
+/**
+ * @brief Counters since start.
+ */
+typedef struct
+{
+    UsbCdc_State_t state;
+    uint8_t        open;          /**< Configured and DTR set by the host. */
+    uint32_t       lineBaud;      /**< Last SET_LINE_CODING (informational). */
+    uint8_t        lineBits;
+    uint8_t        lineParity;    /**< 0 none, 1 odd, 2 even, 3 mark, 4 space. */
+    uint8_t        lineStop;      /**< 0 = 1, 1 = 1.5, 2 = 2 stop bits. */
+    uint32_t       txBytes;       /**< Bytes taken by the host. */
+    uint32_t       txTransfers;
+    uint32_t       txDropped;     /**< Bytes written while the port was closed. */
+    uint32_t       txTimeouts;    /**< Transfers aborted by USB_CDC_TX_TIMEOUT_MS. */
+    uint32_t       rxBytes;
+    uint32_t       rxFull;        /**< Times OUT was left NAKing, ring full. */
+    uint32_t       resets;        /**< Bus resets. */
+    uint32_t       suspends;
+} UsbCdc_Stats_t;
+
+/**
+ * @brief Start the 48 MHz clock, the pins and the OTG core, connect to the
+ *        bus and register "usb".
+ *
+ * Call before osKernelStart(), after the clock profile is set.
+ *
+ * @return HAL_OK, or HAL_ERROR if PLLSAI does not lock, HCLK is below
+ *         14.2 MHz or the core does not come out of reset.
+ */
+HAL_StatusTypeDef UsbCdc_Init(void);
+
+/**
+ * @brief Start an IN transfer of @p len bytes from @p data.
+ *
+ * @p data is read by the interrupt until UsbCdc_TxCpltCallback(), so it
+ * must stay untouched until then. A transfer that is a multiple of 64
+ * bytes ends with a zero-length packet.
+ *
+ * @return HAL_OK, HAL_BUSY while a transfer is running, HAL_ERROR if the
+ *         port is not open (nothing is started).
+ */
+HAL_StatusTypeDef UsbCdc_Transmit(const uint8_t *data, uint32_t len);
+
+/**
+ * @brief Blocking send: UsbCdc_Transmit() and wait up to @p timeoutMs.
+ *
+ * Bytes written while the port is closed are counted as dropped. Not
+ * from a critical section: completion comes from the OTG interrupt.
+ */
+void UsbCdc_Write(const uint8_t *data, uint32_t len, uint32_t timeoutMs);
+
+/**
+ * @brief Take up to @p size received bytes.
+ *
+ * @return Bytes copied to @p dst.
+ */
+uint32_t UsbCdc_Read(uint8_t *dst, uint32_t size);
+
+/** After an AHB clock change (clock_gov.h): TRDT for the new HCLK. */
+void UsbCdc_ClockChanged(void);
+
+/** 1 while the host has the port open (configured, DTR set). */
+uint8_t UsbCdc_IsOpen(void);
+
+void UsbCdc_GetStats(UsbCdc_Stats_t *st);
+
+/** OTG interrupt (OTG_HS_IRQHandler or OTG_FS_IRQHandler, stm32f4xx_it.c). */
+void UsbCdc_IRQHandler(void);
+
+/**
+ * @brief Callbacks from the OTG interrupt; weak, overridden like the HAL
+ *        UART callbacks.
+ *
+ * TxCplt: the transfer of UsbCdc_Transmit() finished or was aborted (bus
+ * reset, suspend, port closed, timeout). Rx: bytes arrived for
+ * UsbCdc_Read(). LineState: the host opened (1) or closed (0) the port.
+ */
+void UsbCdc_TxCpltCallback(void);
+void UsbCdc_RxCallback(void);
+void UsbCdc_LineStateCallback(uint8_t open);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* USB_CDC_H */
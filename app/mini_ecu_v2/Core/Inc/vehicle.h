@@ -4,13 +4,13 @@
  *
  * This module represents the *physical world* as the ECU would experience it.
  * It simulates:
- *   - vehicle speed (km/h)
- *   - engine RPM
- *   - coolant temperature (°C)
+ *   - vehicle speed (km/h), driven by the accelerator pedal (throttle)
+ *   - engine RPM, through a gearbox and torque map (powertrain.h)
+ *   - coolant temperature (°C), cooled by the radiator fan (fan duty)
  *
  * The rest of the ECU *must not* read or change these values directly.
- * Instead, virtual sensors (added later) will "measure" these values and
- * provide ADC/pulse/timer readings just like real hardware.
+ * Instead, virtual sensors (vsensor.h) "measure" these values and provide
+ * ADC readings just like real hardware.
  *
  * The purpose of this module:
  *   1. Be a plant model for SIL/HIL-style testing.
@@ -27,6 +27,40 @@
 extern "C" {
 #endif
 
+/** Reference step (s) the gains VEH_DECAY and VEH_RPM_LAG (cal.h) are given for. */
+#ifndef VEHICLE_REF_STEP_S
+#define VEHICLE_REF_STEP_S  0.1f
+#endif
+
+/** 1 = torque map and gearbox (powertrain.h), 0 = the fixed line
+ *  800 rpm + VEH_RPM_PER_KPH and VEHICLE_PEDAL_KPH_PER_S of pedal. */
+#ifndef VEHICLE_POWERTRAIN
+#define VEHICLE_POWERTRAIN  1
+#endif
+
+/** Acceleration at full throttle without the powertrain (km/h per s). */
+#ifndef VEHICLE_PEDAL_KPH_PER_S
+#define VEHICLE_PEDAL_KPH_PER_S  10.0f
+#endif
+
+/** 1 = radiator fan: loaded, the engine heats VEHICLE_FAN_SOAK_C past
+ *  VEH_WARMUP_C and the fan duty (Vehicle_SetFan()) takes the heat away;
+ *  0 = no fan, the coolant settles at VEH_WARMUP_C on its own. */
+#ifndef VEHICLE_FAN
+#define VEHICLE_FAN  1
+#endif
+
+/** Coolant temperature above VEH_WARMUP_C the loaded engine heats toward
+ *  with the fan off (°C). */
+#ifndef VEHICLE_FAN_SOAK_C
+#define VEHICLE_FAN_SOAK_C  12.0f
+#endif
+
+/** Cooling rate of the fan at full duty, per °C above ambient (1/s). */
+#ifndef VEHICLE_FAN_RATE
+#define VEHICLE_FAN_RATE  0.17f
+#endif
+
 /**
  * @brief Represents the "true" underlying physical state of the simulated vehicle.
  *
@@ -38,6 +72,9 @@ typedef struct
     float    speed_kph;        /**< Physical vehicle speed in km/h. */
     uint16_t engine_rpm;       /**< Physical crankshaft RPM (0–6000 typical). */
     float    coolant_temp_c;   /**< Physical coolant temperature in °C. */
+    float    throttle;         /**< Accelerator input 0..1 (Vehicle_SetThrottle()). */
+    uint8_t  gear;             /**< Engaged gear, 1..POWERTRAIN_GEARS. */
+    float    fan;              /**< Radiator fan duty 0..1 (Vehicle_SetFan()). */
 } VehicleState_t;
 
 /**
@@ -47,6 +84,7 @@ typedef struct
  *   - speed        = 0 km/h
  *   - engine_rpm   = 800 RPM
  *   - coolant_temp = 30 °C (cold engine)
+ *   - throttle     = 0, first gear, fan off
  *
  * @param[out] vs Pointer to a VehicleState_t instance to initialize.
  */
@@ -58,18 +96,28 @@ void Vehicle_Init(VehicleState_t *vs);
  * This function implements a *very* simple dynamic model:
  *
  * Speed Behavior:
- *   - If no target is being enforced, speed naturally decays (coast-down).
+ *   - The throttle accelerates the car: through the torque map and gear
+ *     with VEHICLE_POWERTRAIN, else by VEHICLE_PEDAL_KPH_PER_S at full.
+ *   - Speed naturally decays (coast-down).
  *
  * RPM Behavior:
- *   - RPM follows speed with a first-order lag (imitates engine inertia).
+ *   - The gearbox shifts on its schedule; RPM follows the speed through
+ *     the gear (or the fixed line) with a first-order lag (imitates engine
+ *     inertia).
  *   - RPM is clamped between safe limits (600 → 6000 rpm).
  *
  * Coolant Temperature Behavior:
- *   - Temperature gradually warms toward ~90°C when engine is active.
+ *   - Temperature gradually warms toward ~90°C when engine is active
+ *     (with VEHICLE_FAN toward VEHICLE_FAN_SOAK_C more, less what the fan
+ *     takes away in proportion to its duty and the excess over ambient).
  *   - It cools slightly when stationary or idling for long.
  *
  * These values form the "ground truth" that virtual sensors will sample.
  *
+ * The gains are rates: a step of @p dt_s applies them as exp(-k * dt_s),
+ * so ten 10 ms steps end where one 100 ms step does (up to the clamps and
+ * the RPM rounding). The exponentials are cached per step size.
+ *
  * @param[in,out] vs   Vehicle state to update.
  * @param[in]     dt_s Time step in seconds (e.g., 0.1 for 10Hz updates).
  */
@@ -88,6 +136,23 @@ void Vehicle_Update(VehicleState_t *vs, float dt_s);
  */
 void Vehicle_SetTargetSpeed(VehicleState_t *vs, float speed_kph);
 
+/**
+ * @brief Set the accelerator input the next Vehicle_Update() steps with.
+ *
+ * @param[in,out] vs       Pointer to the vehicle state.
+ * @param[in]     throttle Pedal position, clamped to [0, 1].
+ */
+void Vehicle_SetThrottle(VehicleState_t *vs, float throttle);
+
+/**
+ * @brief Set the radiator fan duty the next Vehicle_Update() steps with
+ *        (VEHICLE_FAN; ignored otherwise).
+ *
+ * @param[in,out] vs    Pointer to the vehicle state.
+ * @param[in]     duty  Fan duty, clamped to [0, 1].
+ */
+void Vehicle_SetFan(VehicleState_t *vs, float duty);
+
 /**
  * @brief Forcefully override all physical quantities.
  *
@@ -0,0 +1,108 @@
+/**
+ * @file    vehicle_fleet.h
+ * @brief   Batched plant model for many virtual vehicles (HIL load tests).
+ *
+ * Same dynamics as Vehicle_Update() (vehicle.c), but the state of all
+ * vehicles is stored as a structure of arrays so one update pass walks each
+ * quantity contiguously:
+ *
+ *   speed_kph[0..n-1]  rpm[0..n-1]  coolant_temp_c[0..n-1]
+ *
+ * With VEHICLE_FLEET_USE_DSP = 1 the speed and RPM steps use the CMSIS-DSP
+ * vector kernels (arm_scale_f32, arm_offset_f32, arm_sub_f32, arm_add_f32,
+ * arm_clip_f32); this needs CMSIS-DSP (arm_math.h + libarm_cortexM4lf_math)
+ * in the build. The default is a fused scalar loop, which on the
+ * Cortex-M4's scalar FPU is as fast and touches each element once.
+ *
+ * RPM is kept as float so the whole step stays in one domain; it is
+ * truncated to an integer when a vehicle is read out or sent.
+ *
+ * Every vehicle transmits its own telemetry frame (same layout as the
+ * single-vehicle frame) with StdId = VEHICLE_FLEET_ID_BASE + index. These
+ * IDs are not in CAN_E2E_TABLE, so their counter and CRC bytes stay zero.
+ */
+
+#ifndef VEHICLE_FLEET_H
+#define VEHICLE_FLEET_H
+
+#include <stdint.h>
+#include "vehicle.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Capacity of a VehicleFleet_t. */
+#ifndef VEHICLE_FLEET_MAX
+#define VEHICLE_FLEET_MAX        64U
+#endif
+
+/** Vehicles simulated by VehicleTask in addition to g_vehicle (0 = off). */
+#ifndef VEHICLE_FLEET_SIZE
+#define VEHICLE_FLEET_SIZE       0U
+#endif
+
+/** Telemetry ID of fleet vehicle 0 (vehicle i uses base + i). */
+#ifndef VEHICLE_FLEET_ID_BASE
+#define VEHICLE_FLEET_ID_BASE    0x200U
+#endif
+
+/** 1 = use CMSIS-DSP vector kernels for the update. */
+#ifndef VEHICLE_FLEET_USE_DSP
+#define VEHICLE_FLEET_USE_DSP    0
+#endif
+
+/**
+ * @brief Structure-of-arrays state of N vehicles.
+ */
+typedef struct
+{
+    uint32_t count;                               /**< Vehicles in use. */
+    uint32_t txNext;                              /**< Next vehicle to send. */
+    float    speed_kph[VEHICLE_FLEET_MAX];
+    float    rpm[VEHICLE_FLEET_MAX];
+    float    coolant_temp_c[VEHICLE_FLEET_MAX];
+    float    scratch[VEHICLE_FLEET_MAX];          /**< DSP path temporary. */
+} VehicleFleet_t;
+
+/**
+ * @brief Put @p count vehicles (clamped to VEHICLE_FLEET_MAX) at idle,
+ *        as Vehicle_Init() does for one.
+ */
+void VehicleFleet_Init(VehicleFleet_t *fleet, uint32_t count);
+
+/**
+ * @brief Advance every vehicle by one step (see Vehicle_Update()).
+ */
+void VehicleFleet_Update(VehicleFleet_t *fleet, float dt_s);
+
+/**
+ * @brief Set one vehicle's speed, clamped to [0, 200] km/h.
+ */
+void VehicleFleet_SetTargetSpeed(VehicleFleet_t *fleet, uint32_t idx, float speed_kph);
+
+/**
+ * @brief Add @p delta_kph to every vehicle's speed (e.g. pedal input).
+ */
+void VehicleFleet_AddSpeed(VehicleFleet_t *fleet, float delta_kph);
+
+/**
+ * @brief Read one vehicle as a VehicleState_t.
+ */
+void VehicleFleet_Get(const VehicleFleet_t *fleet, uint32_t idx, VehicleState_t *out);
+
+/**
+ * @brief Queue telemetry frames, continuing where the last call stopped.
+ *
+ * Stops at the first frame the CAN TX queue rejects, so a fleet larger than
+ * the queue is spread over several calls instead of being dropped.
+ *
+ * @return Number of frames queued.
+ */
+uint32_t VehicleFleet_SendTelemetry(VehicleFleet_t *fleet);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VEHICLE_FLEET_H */
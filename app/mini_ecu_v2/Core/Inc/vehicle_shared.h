@@ -0,0 +1,103 @@
+/**
+ * @file    vehicle_shared.h
+ * @brief   Cross-task access to the vehicle state (VEHICLE topic + command mailbox).
+ *
+ * VehicleTask is the single writer of the physical VehicleState_t. Other
+ * tasks never touch it directly:
+ *
+ *   - Readers (CLI dashboard, diagnostics) call Vehicle_GetSnapshot(), which
+ *     returns a consistent copy without taking a lock. Vehicle_Publish()
+ *     writes the state to the latest-value VEHICLE topic (msg_bus.h): each
+ *     publish goes to the next of its slots, so a reader that preempts the
+ *     writer mid-update still completes on its first attempt. A reader only
+ *     retries when the writer laps it in the middle of its copy. A task
+ *     that wants to run on each new state subscribes to the topic. The
+ *     publish also rounds the state into raw telemetry signals on the
+ *     TELEMETRY topic once, so CanTxTask packs the frame on integers
+ *     (Vehicle_GetTelemetry(), rtos_fpu.h).
+ *   - Writers (CLI commands, test harnesses) post a VehicleCmd_t with
+ *     Vehicle_PostCommand(). VehicleTask applies queued commands at the
+ *     start of its next tick (Vehicle_ApplyCommands()), so the control loop
+ *     never blocks on, or is priority-inverted by, a mutex.
+ */
+
+#ifndef VEHICLE_SHARED_H
+#define VEHICLE_SHARED_H
+
+#include "main.h"
+#include "vehicle.h"
+#include "can_signals.h"
+#include "sys_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Depth of the command mailbox (SYS_QUEUE_TABLE). */
+#define VEHICLE_CMD_QUEUE_LEN  ((uint32_t)SYS_QDEPTH_VehicleCmd)
+
+/** Command kinds. */
+typedef enum
+{
+    VEHICLE_CMD_SET_SPEED = 0,   /**< Vehicle_SetTargetSpeed(speed_kph). */
+    VEHICLE_CMD_FORCE            /**< Vehicle_Force() of the fields in mask. */
+} VehicleCmdType_t;
+
+/** VEHICLE_CMD_FORCE field mask; unmasked fields keep their value. */
+#define VEHICLE_FORCE_SPEED   0x01U
+#define VEHICLE_FORCE_RPM     0x02U
+#define VEHICLE_FORCE_TEMP    0x04U
+
+/**
+ * @brief One mailbox entry.
+ */
+typedef struct
+{
+    uint8_t  type;          /**< VehicleCmdType_t. */
+    uint8_t  mask;          /**< VEHICLE_FORCE_xxx (FORCE only). */
+    uint16_t engine_rpm;
+    float    speed_kph;
+    float    coolant_temp_c;
+} VehicleCmd_t;
+
+/**
+ * @brief Create the command mailbox; call after osKernelInitialize().
+ */
+HAL_StatusTypeDef Vehicle_SharedInit(void);
+
+/**
+ * @brief Publish the writer's state (VehicleTask only).
+ */
+void Vehicle_Publish(const VehicleState_t *vs);
+
+/**
+ * @brief Copy the last published state. Safe from any task; never blocks.
+ */
+void Vehicle_GetSnapshot(VehicleState_t *out);
+
+/**
+ * @brief Copy the last published state as raw telemetry signals (speed,
+ *        rpm, coolant; the E2E fields are 0). Any task; never blocks.
+ */
+void Vehicle_GetTelemetry(CanSig_VehicleTelemetry_Raw_t *out);
+
+/**
+ * @brief Queue a command for VehicleTask (non-blocking).
+ *
+ * @return HAL_OK, HAL_BUSY if the mailbox is full, HAL_ERROR if not
+ *         initialized.
+ */
+HAL_StatusTypeDef Vehicle_PostCommand(const VehicleCmd_t *cmd);
+
+/**
+ * @brief Apply all queued commands to @p vs (VehicleTask only).
+ *
+ * @return Number of commands applied.
+ */
+uint32_t Vehicle_ApplyCommands(VehicleState_t *vs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VEHICLE_SHARED_H */
@@ -0,0 +1,211 @@
+/**
+ * @file    vsensor.h
+ * @brief   Virtual sensors: block-sampled ADC channels for the vehicle model.
+ *
+ * The ECU does not read the vehicle model (vehicle.h) directly; it measures
+ * it through three analogue channels, sampled like an ADC scan with DMA,
+ * and with VSENSOR_PEDAL a fourth one for the accelerator pedal sensor
+ * (PEDAL_SOURCE_ADC, pedal.h):
+ *
+ *   | Channel  | Range        | Pin (ADC1) | Conditioning (sigcond.h)                    |
+ *   |----------|--------------|------------|---------------------------------------------|
+ *   | speed    | 0..300 km/h  | PA0  IN0   | FIR 32, /8, median 5, rate limit, range     |
+ *   | rpm      | 0..8000      | PA1  IN1   | biquad x2, /8, median 3, rate limit, range  |
+ *   | coolant  | -40..150 °C  | PA4  IN4   | biquad x2, /32, rate limit, range           |
+ *   | pedal    | 0..100 %     | PC0  IN10  | average of 8, median 3, range               |
+ *
+ * Each scan writes one 12-bit count per channel, interleaved, into a
+ * double buffer of 2 x VSENSOR_BLOCK scans. When a half is full the source
+ * signals it (the DMA half-transfer / transfer-complete interrupt) and
+ * sets VSENSOR_FLAG on the consumer task, which works on that half while
+ * the source fills the other. Per half the consumer
+ *
+ *   1. applies an injected fault ("sensor fault"),
+ *   2. checks the counts against the diagnostic window (open circuit /
+ *      short to supply) and for a flat line (stuck ADC or sensor),
+ *   3. de-interleaves each channel into engineering units and runs its
+ *      conditioning pipeline over the whole block (sigcond.h), and
+ *   4. publishes the last conditioned value, here and, while the channel
+ *      is valid, in the signal cache (CAN_SIG_SENS_*, can_sigcache.h);
+ *      the pedal goes to Pedal_OnSensor() instead, valid or not.
+ *
+ * Sources (VSENSOR_SOURCE):
+ *
+ *   - VSENSOR_SOURCE_SIM: a software timer fills one half per block period
+ *     from the published vehicle state: the sensor transfer function,
+ *     triangular noise of a few counts and 12-bit quantisation; the pedal
+ *     follows "sensor pedal <pct>". It then
+ *     calls the same block-complete path as the DMA interrupt.
+ *   - VSENSOR_SOURCE_ADC1: ADC1 scans the pins above on every TIM2 update
+ *     at VSENSOR_SAMPLE_HZ; DMA2 Stream0 moves the results into the buffer
+ *     in circular mode. Register level, as the HAL ADC/TIM drivers are
+ *     not part of this tree.
+ *
+ * A half is overwritten by the source one block period after it was
+ * signalled, so the consumer must finish within that time; a half still
+ * pending when it completes again counts as an overrun.
+ *
+ * "sensor" prints truth vs measurement, "sensor fault" injects a fault.
+ */
+
+#ifndef VSENSOR_H
+#define VSENSOR_H
+
+#include "main.h"
+#include "cmsis_os2.h"
+#include "pedal.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+#define VSENSOR_SOURCE_SIM      0U  /**< Software generator from the vehicle model. */
+#define VSENSOR_SOURCE_ADC1     1U  /**< ADC1 scan, TIM2 trigger, DMA2 Stream0. */
+
+#ifndef VSENSOR_SOURCE
+#define VSENSOR_SOURCE          VSENSOR_SOURCE_SIM
+#endif
+
+/** Scan the accelerator pedal sensor too (PC0, ADC1 IN10). */
+#ifndef VSENSOR_PEDAL
+#define VSENSOR_PEDAL           (PEDAL_SOURCE == PEDAL_SOURCE_ADC)
+#endif
+
+/** Scans per second. */
+#ifndef VSENSOR_SAMPLE_HZ
+#define VSENSOR_SAMPLE_HZ       1000U
+#endif
+
+/** Scans per half buffer (one block for the filters). A multiple of 4. */
+#ifndef VSENSOR_BLOCK
+#define VSENSOR_BLOCK           32U
+#endif
+
+/** Peak extra noise of VSENSOR_FAULT_NOISY (counts). */
+#ifndef VSENSOR_NOISY_COUNTS
+#define VSENSOR_NOISY_COUNTS    200U
+#endif
+
+/** Blocks without any change in a channel's counts before it is STUCK. */
+#ifndef VSENSOR_STUCK_BLOCKS
+#define VSENSOR_STUCK_BLOCKS    8U
+#endif
+
+/** Thread flag set on the consumer task when a half is ready. */
+#define VSENSOR_FLAG            0x0001U
+
+/** ADC full scale. */
+#define VSENSOR_COUNTS_MAX      4095U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    VSENSOR_CH_SPEED = 0,
+    VSENSOR_CH_RPM,
+    VSENSOR_CH_COOLANT,
+#if VSENSOR_PEDAL
+    VSENSOR_CH_PEDAL,
+#endif
+    VSENSOR_CH_COUNT
+} VSensor_Ch_t;
+
+/** Injected faults, applied to the sampled counts. */
+typedef enum
+{
+    VSENSOR_FAULT_NONE = 0,
+    VSENSOR_FAULT_OPEN,     /**< Reads 0 (input pulled down). */
+    VSENSOR_FAULT_SHORT,    /**< Reads full scale (short to supply). */
+    VSENSOR_FAULT_STUCK,    /**< Repeats the last count before the fault. */
+    VSENSOR_FAULT_NOISY,    /**< Adds +/- VSENSOR_NOISY_COUNTS of noise. */
+    VSENSOR_FAULT_COUNT
+} VSensor_Fault_t;
+
+/** Diagnostic status bits. */
+#define VSENSOR_ST_LOW          0x01U   /**< Counts below the valid window. */
+#define VSENSOR_ST_HIGH         0x02U   /**< Counts above the valid window. */
+#define VSENSOR_ST_STUCK        0x04U   /**< No change for several blocks. */
+#define VSENSOR_ST_IMPLAUSIBLE  0x08U   /**< Outside the plausible range (debounced). */
+#define VSENSOR_ST_RATE         0x10U   /**< Rate limit active in the last block. */
+
+/**
+ * @brief Measurement of one channel, updated once per block.
+ */
+typedef struct
+{
+    float    value;         /**< Conditioned, engineering units; held while LOW/HIGH. */
+    uint16_t raw;           /**< Last count of the block. */
+    uint16_t rawMin;        /**< Block minimum / maximum. */
+    uint16_t rawMax;
+    uint8_t  status;        /**< VSENSOR_ST_* bits. */
+    uint8_t  fault;         /**< Injected VSensor_Fault_t. */
+} VSensor_Channel_t;
+
+/**
+ * @brief All channels and the pipeline counters.
+ */
+typedef struct
+{
+    VSensor_Channel_t ch[VSENSOR_CH_COUNT];
+    uint32_t          blocks;       /**< Halves processed. */
+    uint32_t          overruns;     /**< Halves overwritten before processing. */
+    uint32_t          dmaErrors;    /**< DMA transfer errors (ADC1 source). */
+} VSensor_Reading_t;
+
+/**
+ * @brief Design the filters, set up the source and register the CLI
+ *        commands. Call once before the scheduler starts.
+ */
+HAL_StatusTypeDef VSensor_Init(void);
+
+/**
+ * @brief Start sampling; @p consumer is the task that calls VSensor_Task().
+ */
+HAL_StatusTypeDef VSensor_Start(osThreadId_t consumer);
+
+/**
+ * @brief Wait for VSENSOR_FLAG and process the halves that are ready.
+ *
+ * Call in a loop from the consumer task.
+ */
+void VSensor_Task(void);
+
+/**
+ * @brief Consistent copy of the latest measurement (any task).
+ */
+void VSensor_Get(VSensor_Reading_t *out);
+
+/**
+ * @brief Inject a fault on a channel (VSENSOR_FAULT_NONE clears it).
+ *
+ * @return HAL_OK, or HAL_ERROR for an invalid channel or fault.
+ */
+HAL_StatusTypeDef VSensor_SetFault(VSensor_Ch_t ch, VSensor_Fault_t fault);
+
+/** @return Channel name as "sensor" prints it ("speed", "rpm", "coolant",
+ *          "pedal"), "?" for an invalid channel. */
+const char *VSensor_ChannelName(VSensor_Ch_t ch);
+
+/**
+ * @brief The APB1 clock changed (clock_gov.h): keep TIM2 at
+ *        VSENSOR_SAMPLE_HZ (ADC1 source; nothing to do otherwise).
+ */
+void VSensor_ClockChanged(void);
+
+/**
+ * @brief DMA2 Stream0 interrupt (ADC1 source; nothing to do otherwise).
+ */
+void VSensor_DmaIRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VSENSOR_H */
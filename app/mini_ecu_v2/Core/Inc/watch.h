@@ -0,0 +1,182 @@
+/**
+ * @file    watch.h
+ * @brief   Data watchpoints: DWT comparators that trap writes to chosen
+ *          variables into the DebugMonitor exception, recorded in a ring.
+ *
+ * To find who writes a variable (a g_vehicle field that jumps at speed, a
+ * flag cleared behind a task's back) a slot programs one DWT comparator
+ * (4 on the Cortex-M4) on its address. Every matching access raises the
+ * DebugMonitor exception, at WATCH_IRQ_PRIO above all interrupts, whose
+ * handler records
+ *
+ *   - the stacked PC of the writer (the instruction after the store; the
+ *     watchpoint is asynchronous, so one or two instructions later at
+ *     most) and its stacked LR,
+ *   - the value now at the address (the value just written),
+ *   - DWT->CYCCNT and the tick, the exception number of an interrupt
+ *     writer (0 = a task) and the running task,
+ *
+ * into a ring of the newest WATCH_DEPTH records, and counts the hits per
+ * writer PC, up to WATCH_PCS of them: "watch" lists who wrote how often,
+ * which arm-none-eabi-addr2line turns into source lines. The writers do
+ * not change: no logging on their paths.
+ *
+ * Disarmed it costs nothing: the comparators are off and DEMCR.MON_EN is
+ * clear, so no access ever traps. Armed, every match costs an exception
+ * (about 100 cycles), so watch a variable written at most a few thousand
+ * times a second. A write inside a PRIMASK section traps when it ends;
+ * with a debugger attached (DHCSR.C_DEBUGEN) the comparators halt the core
+ * instead and nothing is recorded.
+ *
+ * Targets have names (Watch_Register(), "watch names") or a plain SRAM
+ * address; the watched range is a power of two of 1..WATCH_MAX_BYTES
+ * bytes, aligned to its size.
+ *
+ *   watch                             slots and the hits per writer PC
+ *   watch set <slot> <name|addr> [bytes] [w|r|rw]
+ *                                     arm a slot (default: the name's
+ *                                     size or 4 bytes, writes)
+ *   watch clear [<slot>]              disarm one slot or all, keep the log
+ *   watch log [<n>]                   the newest records
+ *   watch names                       registered targets
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = "watch" and its DebugMonitor handler built in. */
+#ifndef WATCH_ENABLE
+#define WATCH_ENABLE            1
+#endif
+
+/** Slots, at most the comparators the DWT has (DWT_CTRL.NUMCOMP). */
+#ifndef WATCH_SLOTS
+#define WATCH_SLOTS             4U
+#endif
+
+/** Records in the ring (power of two). */
+#ifndef WATCH_DEPTH
+#define WATCH_DEPTH             32U
+#endif
+
+/** Distinct writer PCs counted. */
+#ifndef WATCH_PCS
+#define WATCH_PCS               8U
+#endif
+
+/** Largest watched range (bytes, a power of two). */
+#define WATCH_MAX_BYTES         32U
+
+/** DebugMonitor priority: above every interrupt, which may write too. */
+#ifndef WATCH_IRQ_PRIO
+#define WATCH_IRQ_PRIO          0U
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/** Accesses a slot traps. */
+typedef enum
+{
+    WATCH_WRITE = 0,
+    WATCH_READ,
+    WATCH_READ_WRITE
+} Watch_Kind_t;
+
+/**
+ * @brief A named target. Registered by pointer; must stay valid.
+ */
+typedef struct
+{
+    const char  *name;
+    volatile void *addr;
+    uint8_t      size;          /**< Bytes, a power of two <= WATCH_MAX_BYTES. */
+} Watch_Target_t;
+
+/**
+ * @brief One trapped access.
+ */
+typedef struct
+{
+    uint32_t cycles;            /**< DWT->CYCCNT */
+    uint32_t timeMs;
+    uint32_t pc;                /**< Stacked PC: just after the access. */
+    uint32_t lr;                /**< Stacked LR: the writer's caller, mostly. */
+    uint32_t value;             /**< First 4 bytes at the slot's address after it. */
+    void    *task;              /**< Running task (TaskHandle_t). */
+    uint16_t exc;               /**< Exception number of the writer, 0 = thread. */
+    uint8_t  slot;
+    uint8_t  reserved;
+} Watch_Rec_t;
+
+/**
+ * @brief Register "watch", set the DebugMonitor priority. Slots start
+ *        disarmed.
+ */
+void Watch_Init(void);
+
+/**
+ * @brief Add named targets for "watch set".
+ *
+ * @return HAL_OK, or HAL_ERROR if the name table is full.
+ */
+HAL_StatusTypeDef Watch_Register(const Watch_Target_t *targets, uint32_t count);
+
+/**
+ * @brief Arm @p slot on @p size bytes at @p addr.
+ *
+ * @return HAL_OK, or HAL_ERROR for a bad slot, a range that is not a
+ *         power of two aligned to its size or an address outside SRAM.
+ */
+HAL_StatusTypeDef Watch_Set(uint32_t slot, uintptr_t addr, uint32_t size, Watch_Kind_t kind);
+
+/**
+ * @brief Disarm @p slot; with no slot left armed DebugMonitor is off.
+ */
+void Watch_Clear(uint32_t slot);
+
+/**
+ * @brief Copy records, newest first.
+ *
+ * @return Records copied.
+ */
+uint32_t Watch_Read(uint32_t count, Watch_Rec_t *out);
+
+/**
+ * @brief DebugMonitor body, from WATCH_DEBUGMON_ENTRY() with the stacked
+ *        exception frame.
+ */
+void Watch_DebugMon(const uint32_t *frame);
+
+/**
+ * @brief DebugMonitor handler body: passes the exception frame of the
+ *        interrupted code to Watch_DebugMon(). Use as the only statement
+ *        of a naked handler.
+ */
+#define WATCH_DEBUGMON_ENTRY()              \
+    __asm volatile                          \
+    (                                       \
+        "tst   lr, #4          \n"          \
+        "ite   eq              \n"          \
+        "mrseq r0, msp         \n"          \
+        "mrsne r0, psp         \n"          \
+        "b     Watch_DebugMon  \n"          \
+    )
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WATCH_H */
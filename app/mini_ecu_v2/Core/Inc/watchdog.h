@@ -0,0 +1,154 @@
+/**
+ * @file    watchdog.h
+ * @brief   Independent watchdog kicked only while every supervised task
+ *          checks in within its deadline.
+ *
+ * The periodic tasks are listed at compile time in WATCHDOG_TASK_TABLE
+ * with a deadline each. A task calls Watchdog_Start() once, then
+ * Watchdog_Checkin() every cycle: an LDREX/STREX OR of its bit into a
+ * shared mask, no lock, no kernel call (a few cycles).
+ *
+ * WdgTask runs every WATCHDOG_CHECK_MS above all other tasks. It takes
+ * and clears the mask, notes the time of each check-in and reloads the
+ * IWDG only if no started task has gone longer than its deadline without
+ * one. Otherwise it records the late task's name, the registers it was
+ * last switched out with and the recent log in the crash record
+ * (crash_dump.h, cause "Watchdog") and resets at once, so "crash" shows
+ * where the task hung.
+ * If WdgTask itself stops (interrupts off, an interrupt storm), the IWDG
+ * resets after WATCHDOG_TIMEOUT_MS and the boot reports an IWDG reset.
+ *
+ * A late WdgTask run (more than twice WATCHDOG_CHECK_MS) means nothing
+ * ran: the scheduler was suspended for a flash sector erase (nvm_log.h,
+ * stage.h). The deadlines then restart instead of blaming a task.
+ *
+ * Tasks that wait on an event without a timeout (CanRxTask, CanTxTask,
+ * CliTask, LogTask, NvmTask) have no cycle to check in from and are not
+ * supervised. The IWDG is frozen while a debugger halts the core.
+ *
+ * "wdg" shows the deadlines, the time since each check-in and the longest
+ * gap seen; "wdg test <task>" suspends a task to check the supervision.
+ */
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = IWDG and WdgTask started by Watchdog_Init(). */
+#ifndef WATCHDOG_ENABLE
+#define WATCHDOG_ENABLE        1
+#endif
+
+/** IWDG timeout at the nominal 32 kHz LSI (ms, up to 4095); the LSI may
+ *  run at 17..47 kHz. Longer than a 16 KB sector erase (~250 ms), during
+ *  which WdgTask does not run. */
+#ifndef WATCHDOG_TIMEOUT_MS
+#define WATCHDOG_TIMEOUT_MS    2000U
+#endif
+
+/** WdgTask period (ms); also the resolution of the deadlines. */
+/** Longest flash sector erase (ms): 128 KB, x32, datasheet maximum. */
+#ifndef WATCHDOG_ERASE_MAX_MS
+#define WATCHDOG_ERASE_MAX_MS  2000U
+#endif
+
+#ifndef WATCHDOG_CHECK_MS
+#define WATCHDOG_CHECK_MS      100U
+#endif
+
+/**
+ * @brief Supervised tasks. X(name, task name, deadline ms):
+ *        WATCHDOG_TASK_<name>, the longest time allowed between two
+ *        check-ins.
+ */
+#define WATCHDOG_TASK_TABLE(X)                          \
+    X(VEHICLE,     "VehicleTask", 500U)                 \
+    X(SENSOR,      "SensorTask",  500U)                 \
+    X(RASTER1MS,   "Raster1ms",   200U)                 \
+    X(RASTER10MS,  "Raster10ms",  300U)                 \
+    X(RASTER100MS, "Raster100ms", 500U)
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+#define WATCHDOG_TASK_ENUM_(name, text, deadlineMs)   WATCHDOG_TASK_##name,
+typedef enum
+{
+    WATCHDOG_TASK_TABLE(WATCHDOG_TASK_ENUM_)
+    WATCHDOG_TASK_COUNT
+} Watchdog_Task_t;
+
+_Static_assert(WATCHDOG_TASK_COUNT <= 32U, "one bit per task in g_watchdogAlive");
+
+/** Check-in bits since WdgTask last ran; written only by Watchdog_Checkin(). */
+extern volatile uint32_t g_watchdogAlive;
+
+/**
+ * @brief Start the IWDG and create WdgTask; register "wdg".
+ *
+ * Call after osKernelInitialize() and CrashDump_Init(). Once started the
+ * IWDG runs until the next reset.
+ *
+ * @return HAL_OK, or HAL_ERROR if WdgTask could not be created.
+ */
+HAL_StatusTypeDef Watchdog_Init(void);
+
+/**
+ * @brief Put the calling task under supervision as @p task; its deadline
+ *        runs from now.
+ */
+void Watchdog_Start(Watchdog_Task_t task);
+
+/**
+ * @brief Check in for @p task. Lock-free; call once per cycle.
+ */
+static inline void Watchdog_Checkin(Watchdog_Task_t task)
+{
+    uint32_t bits;
+
+    do
+    {
+        bits = __LDREXW(&g_watchdogAlive) | (1UL << (uint32_t)task);
+    } while (__STREXW(bits, &g_watchdogAlive) != 0U);
+}
+
+/**
+ * @brief Reload the IWDG now, right before a stall of known length that
+ *        WdgTask cannot run through.
+ *
+ * The stall gets the whole WATCHDOG_TIMEOUT_MS, which is only some 1.4 s
+ * at the fastest LSI (47 kHz); a longer one takes Watchdog_Stretch(). A
+ * no-op before the IWDG is started.
+ */
+static inline void Watchdog_Reload(void)
+{
+    IWDG->KR = 0xAAAAU;
+}
+
+/**
+ * @brief Stretch the IWDG to its longest timeout (22 s or more) for a
+ *        stall WATCHDOG_TIMEOUT_MS may not cover: a 128 KB sector erase
+ *        (stage.h) takes up to WATCHDOG_ERASE_MAX_MS. Watchdog_Restore()
+ *        right after it. No-ops before Watchdog_Init(); task context.
+ */
+void Watchdog_Stretch(void);
+
+/** Back to WATCHDOG_TIMEOUT_MS after Watchdog_Stretch(), reloaded. */
+void Watchdog_Restore(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WATCHDOG_H */
@@ -0,0 +1,146 @@
+/**
+ * @file    wheel_pulse.h
+ * @brief   Wheel-speed pulses: a tone wheel generated on TIM11, measured by
+ *          TIM1 input capture with DMA.
+ *
+ * A wheel-speed sensor gives WHEEL_PULSE_TEETH pulses per revolution of a
+ * wheel of WHEEL_PULSE_CIRC_MM rolling circumference, so the frequency is
+ *
+ *   f = speed / 3.6 / circumference * teeth     (48 teeth, 1.95 m:
+ *                                                6.8 Hz per km/h)
+ *
+ * Pins (jumper PB9 to PA8 on the board):
+ *
+ *   PB9  TIM11_CH1 (AF3)   pulse output, 50 % duty
+ *   PA8  TIM1_CH1  (AF1)   capture input, pull-down
+ *
+ * Generator: once per sensor block (SensorTask, vsensor.h)
+ * WheelPulse_Block() sets TIM11 to the frequency of the model speed. ARR,
+ * PSC and CCR1 are preloaded, so the period changes at the next pulse
+ * boundary without a glitch. Below 1000 / WHEEL_PULSE_TIMEOUT_MS Hz the
+ * output stays low (standstill).
+ *
+ * Capture: TIM1 counts at WHEEL_PULSE_TICK_HZ and latches every rising edge
+ * on PA8 into CCR1; each capture requests DMA2 Stream3 (channel 6), which
+ * moves the timestamp into a circular ring of WHEEL_PULSE_RING halfwords.
+ * Nothing interrupts, neither per pulse nor per ring pass: the same
+ * WheelPulse_Block() takes the ring up to the DMA's write position (NDTR)
+ * and evaluates the new edges together. The period is the sum of the
+ * 16-bit timestamp differences over their count, chained across blocks,
+ * so the resolution is one tick over the block, not one tick per period.
+ *
+ * The 16-bit counter wraps every 65536 / WHEEL_PULSE_TICK_HZ s (655 ms). An
+ * edge more than WHEEL_PULSE_TIMEOUT_MS after the last one (checked at
+ * block granularity, hence the margin below) is standstill: speed 0, and the
+ * next edge starts a new chain instead of giving a period. Between edges
+ * the frequency is capped at 1 / (time since the last edge), so a wheel
+ * that stops reads as slowing down rather than as holding its last speed.
+ *
+ * While the generator runs, a timeout with no edge at all is "no signal"
+ * (jumper missing) and the measurement is invalid. "sensor pulse" shows
+ * generator and measurement.
+ */
+
+#ifndef WHEEL_PULSE_H
+#define WHEEL_PULSE_H
+
+#include "main.h"
+#include "vsensor.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = pulse generator and capture; 0 = neither, the timers stay off. */
+#ifndef WHEEL_PULSE_ENABLE
+#define WHEEL_PULSE_ENABLE      1
+#endif
+
+/** Tone wheel teeth per revolution. */
+#ifndef WHEEL_PULSE_TEETH
+#define WHEEL_PULSE_TEETH       48U
+#endif
+
+/** Rolling circumference of the wheel, mm. */
+#ifndef WHEEL_PULSE_CIRC_MM
+#define WHEEL_PULSE_CIRC_MM     1950U
+#endif
+
+/** Capture counter rate (Hz); must divide every APB2 timer clock. */
+#ifndef WHEEL_PULSE_TICK_HZ
+#define WHEEL_PULSE_TICK_HZ     100000U
+#endif
+
+/** Capture ring entries: 125 ms of pulses at 300 km/h by default. */
+#ifndef WHEEL_PULSE_RING
+#define WHEEL_PULSE_RING        256U
+#endif
+
+/** No edge for this long: standstill. */
+#ifndef WHEEL_PULSE_TIMEOUT_MS
+#define WHEEL_PULSE_TIMEOUT_MS  500U
+#endif
+
+/* A chained difference spans at most the timeout plus the two blocks it
+ * may take to notice; that must stay within one counter wrap. */
+_Static_assert((((WHEEL_PULSE_TIMEOUT_MS + ((2000U * VSENSOR_BLOCK) / VSENSOR_SAMPLE_HZ)) *
+                 (uint64_t)WHEEL_PULSE_TICK_HZ) / 1000U) < 65536U,
+               "WHEEL_PULSE_TIMEOUT_MS does not fit one wrap of the 16-bit capture counter");
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Generator and measurement, as of the last block.
+ */
+typedef struct
+{
+    float    genHz;         /**< Frequency on PB9, 0 when stopped. */
+    float    hz;            /**< Measured on PA8. */
+    float    speedKph;      /**< From hz. */
+    uint32_t periodMinUs;   /**< Shortest / longest period of the block, */
+    uint32_t periodMaxUs;   /**< 0 without one. */
+    uint16_t blockEdges;    /**< Edges taken in the last block. */
+    uint8_t  valid;         /**< Edges as expected, or standstill. */
+    uint8_t  noSignal;      /**< Generator running, no edge for the timeout. */
+    uint32_t edges;         /**< Edges since boot ... */
+    uint32_t blocks;        /**< ... over this many blocks. */
+    uint32_t standstills;   /**< Timeouts. */
+    uint32_t overcaptures;  /**< Edges the DMA missed (CC1OF). */
+    uint32_t resyncs;       /**< Chains restarted by a clock change. */
+} WheelPulse_Reading_t;
+
+/**
+ * @brief Set up TIM11, TIM1 and DMA2 Stream3, start both timers and
+ *        register "sensor pulse". Call once before the scheduler starts.
+ */
+HAL_StatusTypeDef WheelPulse_Init(void);
+
+/**
+ * @brief Follow the model speed with the generator and evaluate the edges
+ *        captured since the last call (SensorTask, once per block).
+ */
+void WheelPulse_Block(void);
+
+/**
+ * @brief Consistent copy of the latest reading (any task).
+ */
+void WheelPulse_Get(WheelPulse_Reading_t *out);
+
+/**
+ * @brief The APB2 clock changed (clock_gov.h): retime both timers; the next
+ *        edge starts a new chain.
+ */
+void WheelPulse_ClockChanged(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WHEEL_PULSE_H */
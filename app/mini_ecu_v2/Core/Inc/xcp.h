@@ -0,0 +1,114 @@
+/**
+ * @file    xcp.h
+ * @brief   XCP-on-CAN slave: polling, memory upload and dynamic DAQ lists.
+ *
+ * A measurement and calibration tool (CANape, INCA, pyXCP) connects on
+ * XCP_CAN_CMD_ID and reads internal variables by address, as its A2L
+ * takes them from the ELF symbols, without any printf in the loop:
+ *
+ *   - Polling: SHORT_UPLOAD, or SET_MTA + UPLOAD, of up to 7 bytes from
+ *     RAM or flash - the CCP-style memory upload.
+ *   - DAQ: the tool allocates DAQ lists, ODTs and entries (FREE_DAQ,
+ *     ALLOC_DAQ, ALLOC_ODT, ALLOC_ODT_ENTRY, WRITE_DAQ), binds each list to
+ *     an event channel with a prescaler and starts them together. At each
+ *     event the configured addresses are copied into one CAN frame per ODT
+ *     (PID = absolute ODT number) on XCP_CAN_RES_ID, the first ODT of a
+ *     list with a 2-byte timestamp in 10 us units (GET_DAQ_CLOCK reads the
+ *     same clock).
+ *   - Calibration: DOWNLOAD of whole 4-byte values into g_calValues[]
+ *     (cal.h), range-checked by Cal_Set() and committed with "cal commit".
+ *     Any other RAM is read-only to the tool.
+ *
+ * Event channels (XCP_EVENT_TABLE) are the control loop step and the
+ * 1 / 10 / 100 ms rasters (raster.h), so samples are taken in the context
+ * that computes them, at the point the cycle's values are complete. A
+ * sample costs nothing while no list runs.
+ *
+ * Commands are handled in CanRxTask as they arrive; a DAQ frame the TX
+ * queue refuses is counted and the rest of that sample dropped. "xcp"
+ * shows the connection, the DAQ lists and the counters.
+ */
+
+#ifndef XCP_H
+#define XCP_H
+
+#include "main.h"
+#include "can_filters.h"
+#include "ctrl_loop.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 1 = XCP slave and its raster event runnables built in. */
+#ifndef XCP_ENABLE
+#define XCP_ENABLE           1
+#endif
+
+/** Commands (tool -> ECU) and responses / DAQ frames (ECU -> tool). DAQ
+ *  frames stay behind the telemetry in arbitration. */
+#define XCP_CAN_CMD_ID       (0x600U + CAN_NODE_ID)
+#define XCP_CAN_RES_ID       (0x680U + CAN_NODE_ID)
+
+/** Dynamic DAQ resources, shared by all lists. */
+#ifndef XCP_MAX_DAQ
+#define XCP_MAX_DAQ          4U
+#endif
+#ifndef XCP_MAX_ODT
+#define XCP_MAX_ODT          16U
+#endif
+#ifndef XCP_MAX_ODT_ENTRIES
+#define XCP_MAX_ODT_ENTRIES  64U
+#endif
+
+/**
+ * @brief Event channels. X(name, text, cycle ms): XCP_EVENT_<name> is its
+ *        channel number, in table order.
+ */
+#define XCP_EVENT_TABLE(X)                              \
+    X(CTRL,  "control loop", (1000U / CTRL_LOOP_HZ))    \
+    X(1MS,   "raster 1 ms",  1U)                        \
+    X(10MS,  "raster 10 ms", 10U)                       \
+    X(100MS, "raster 100 ms", 100U)
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+#define XCP_EVENT_ENUM_(name, text, cycleMs)   XCP_EVENT_##name,
+typedef enum
+{
+    XCP_EVENT_TABLE(XCP_EVENT_ENUM_)
+    XCP_EVENT_COUNT
+} Xcp_Event_t;
+
+/**
+ * @brief Listen on XCP_CAN_CMD_ID and register the "xcp" command.
+ *
+ * Call after CAN_IF_Init() and CLI_IF_Init().
+ *
+ * @return HAL_OK, or HAL_ERROR if no RX handler slot was free.
+ */
+HAL_StatusTypeDef Xcp_Init(void);
+
+/**
+ * @brief Sample the running DAQ lists bound to @p event and send their
+ *        ODTs. Call from the task that owns the event's cycle.
+ */
+void Xcp_Event(Xcp_Event_t event);
+
+/** Raster runnables (raster.h) raising the raster events. */
+void Xcp_Event1ms(void);
+void Xcp_Event10ms(void);
+void Xcp_Event100ms(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* XCP_H */
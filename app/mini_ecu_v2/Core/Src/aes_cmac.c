@@ -0,0 +1,280 @@
+/**
+ * @file    aes_cmac.c
+ * @brief   One-table AES-128 encryption, key expansion and CMAC.
+ */
+
+#include "aes_cmac.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define AES_ROUNDS          10U
+
+/* FIPS-197 S-box; only the key expansion and the table build read it. */
+static const uint8_t s_aesSbox[256] =
+{
+    0x63U, 0x7CU, 0x77U, 0x7BU, 0xF2U, 0x6BU, 0x6FU, 0xC5U, 0x30U, 0x01U, 0x67U, 0x2BU,
+    0xFEU, 0xD7U, 0xABU, 0x76U, 0xCAU, 0x82U, 0xC9U, 0x7DU, 0xFAU, 0x59U, 0x47U, 0xF0U,
+    0xADU, 0xD4U, 0xA2U, 0xAFU, 0x9CU, 0xA4U, 0x72U, 0xC0U, 0xB7U, 0xFDU, 0x93U, 0x26U,
+    0x36U, 0x3FU, 0xF7U, 0xCCU, 0x34U, 0xA5U, 0xE5U, 0xF1U, 0x71U, 0xD8U, 0x31U, 0x15U,
+    0x04U, 0xC7U, 0x23U, 0xC3U, 0x18U, 0x96U, 0x05U, 0x9AU, 0x07U, 0x12U, 0x80U, 0xE2U,
+    0xEBU, 0x27U, 0xB2U, 0x75U, 0x09U, 0x83U, 0x2CU, 0x1AU, 0x1BU, 0x6EU, 0x5AU, 0xA0U,
+    0x52U, 0x3BU, 0xD6U, 0xB3U, 0x29U, 0xE3U, 0x2FU, 0x84U, 0x53U, 0xD1U, 0x00U, 0xEDU,
+    0x20U, 0xFCU, 0xB1U, 0x5BU, 0x6AU, 0xCBU, 0xBEU, 0x39U, 0x4AU, 0x4CU, 0x58U, 0xCFU,
+    0xD0U, 0xEFU, 0xAAU, 0xFBU, 0x43U, 0x4DU, 0x33U, 0x85U, 0x45U, 0xF9U, 0x02U, 0x7FU,
+    0x50U, 0x3CU, 0x9FU, 0xA8U, 0x51U, 0xA3U, 0x40U, 0x8FU, 0x92U, 0x9DU, 0x38U, 0xF5U,
+    0xBCU, 0xB6U, 0xDAU, 0x21U, 0x10U, 0xFFU, 0xF3U, 0xD2U, 0xCDU, 0x0CU, 0x13U, 0xECU,
+    0x5FU, 0x97U, 0x44U, 0x17U, 0xC4U, 0xA7U, 0x7EU, 0x3DU, 0x64U, 0x5DU, 0x19U, 0x73U,
+    0x60U, 0x81U, 0x4FU, 0xDCU, 0x22U, 0x2AU, 0x90U, 0x88U, 0x46U, 0xEEU, 0xB8U, 0x14U,
+    0xDEU, 0x5EU, 0x0BU, 0xDBU, 0xE0U, 0x32U, 0x3AU, 0x0AU, 0x49U, 0x06U, 0x24U, 0x5CU,
+    0xC2U, 0xD3U, 0xACU, 0x62U, 0x91U, 0x95U, 0xE4U, 0x79U, 0xE7U, 0xC8U, 0x37U, 0x6DU,
+    0x8DU, 0xD5U, 0x4EU, 0xA9U, 0x6CU, 0x56U, 0xF4U, 0xEAU, 0x65U, 0x7AU, 0xAEU, 0x08U,
+    0xBAU, 0x78U, 0x25U, 0x2EU, 0x1CU, 0xA6U, 0xB4U, 0xC6U, 0xE8U, 0xDDU, 0x74U, 0x1FU,
+    0x4BU, 0xBDU, 0x8BU, 0x8AU, 0x70U, 0x3EU, 0xB5U, 0x66U, 0x48U, 0x03U, 0xF6U, 0x0EU,
+    0x61U, 0x35U, 0x57U, 0xB9U, 0x86U, 0xC1U, 0x1DU, 0x9EU, 0xE1U, 0xF8U, 0x98U, 0x11U,
+    0x69U, 0xD9U, 0x8EU, 0x94U, 0x9BU, 0x1EU, 0x87U, 0xE9U, 0xCEU, 0x55U, 0x28U, 0xDFU,
+    0x8CU, 0xA1U, 0x89U, 0x0DU, 0xBFU, 0xE6U, 0x42U, 0x68U, 0x41U, 0x99U, 0x2DU, 0x0FU,
+    0xB0U, 0x54U, 0xBBU, 0x16U
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Te0[x] = S[x] * {02, 01, 01, 03}, MSB first; Te1..Te3 are its rotations
+ * by 8, 16 and 24 bits. Built once, read-only afterwards; in .bss, i.e.
+ * SRAM. */
+static uint32_t s_aesTe0[256];
+static uint8_t  s_aesReady = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static inline uint32_t aes_ror(uint32_t x, uint32_t n)
+{
+    return (x >> n) | (x << (32U - n));
+}
+
+static inline uint32_t aes_get32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void aes_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint8_t aes_xtime(uint8_t a)
+{
+    return (uint8_t)((a << 1) ^ (((a & 0x80U) != 0U) ? 0x1BU : 0x00U));
+}
+
+static void aes_build_table(void)
+{
+    for (uint32_t x = 0U; x < 256U; ++x)
+    {
+        uint8_t s  = s_aesSbox[x];
+        uint8_t s2 = aes_xtime(s);
+
+        s_aesTe0[x] = ((uint32_t)s2 << 24) | ((uint32_t)s << 16) | ((uint32_t)s << 8) |
+                      (uint32_t)(uint8_t)(s2 ^ s);
+    }
+    s_aesReady = 1U;
+}
+
+/** SubWord(RotWord(w)) of the key expansion. */
+static uint32_t aes_sub_rot(uint32_t w)
+{
+    return ((uint32_t)s_aesSbox[(w >> 16) & 0xFFU] << 24) |
+           ((uint32_t)s_aesSbox[(w >> 8) & 0xFFU] << 16) |
+           ((uint32_t)s_aesSbox[w & 0xFFU] << 8) |
+           (uint32_t)s_aesSbox[w >> 24];
+}
+
+/** Doubling in GF(2^128), the CMAC subkey step. */
+static void aes_dbl(const uint8_t *in, uint8_t *out)
+{
+    uint8_t carry = (uint8_t)(in[0] >> 7);
+
+    for (uint32_t i = 0U; i < (AES_CMAC_BLOCK - 1U); ++i)
+        out[i] = (uint8_t)((in[i] << 1) | (in[i + 1U] >> 7));
+    out[AES_CMAC_BLOCK - 1U] = (uint8_t)((in[AES_CMAC_BLOCK - 1U] << 1) ^
+                                         ((carry != 0U) ? 0x87U : 0x00U));
+}
+
+static uint8_t aes_equal(const uint8_t *a, const char *hex)
+{
+    for (uint32_t i = 0U; i < AES_CMAC_BLOCK; ++i)
+    {
+        uint32_t v = 0U;
+
+        for (uint32_t j = 0U; j < 2U; ++j)
+        {
+            char c = hex[(i * 2U) + j];
+            v = (v << 4) | (uint32_t)((c <= '9') ? (c - '0') : (c - 'a' + 10));
+        }
+        if (a[i] != (uint8_t)v)
+            return 0U;
+    }
+    return 1U;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void AesCmac_SetKey(AesCmac_Key_t *k, const uint8_t *key)
+{
+    static const uint8_t zero[AES_CMAC_BLOCK] = { 0U };
+    uint32_t             rcon = 0x01U;
+    uint8_t              l[AES_CMAC_BLOCK];
+
+    if (s_aesReady == 0U)
+        aes_build_table();
+
+    for (uint32_t i = 0U; i < 4U; ++i)
+        k->rk[i] = aes_get32(&key[i * 4U]);
+
+    for (uint32_t i = 4U; i < (4U * (AES_ROUNDS + 1U)); i += 4U)
+    {
+        k->rk[i]      = k->rk[i - 4U] ^ aes_sub_rot(k->rk[i - 1U]) ^ (rcon << 24);
+        k->rk[i + 1U] = k->rk[i - 3U] ^ k->rk[i];
+        k->rk[i + 2U] = k->rk[i - 2U] ^ k->rk[i + 1U];
+        k->rk[i + 3U] = k->rk[i - 1U] ^ k->rk[i + 2U];
+        rcon          = aes_xtime((uint8_t)rcon);
+    }
+
+    /* L = E(K, 0), K1 = 2 L, K2 = 4 L. */
+    AesCmac_Encrypt(k, zero, l);
+    aes_dbl(l, k->k1);
+    aes_dbl(k->k1, k->k2);
+}
+
+void AesCmac_Encrypt(const AesCmac_Key_t *k, const uint8_t *in, uint8_t *out)
+{
+    const uint32_t *rk = k->rk;
+    const uint32_t *te = s_aesTe0;
+
+    uint32_t s0 = aes_get32(&in[0])  ^ rk[0];
+    uint32_t s1 = aes_get32(&in[4])  ^ rk[1];
+    uint32_t s2 = aes_get32(&in[8])  ^ rk[2];
+    uint32_t s3 = aes_get32(&in[12]) ^ rk[3];
+    uint32_t t0;
+    uint32_t t1;
+    uint32_t t2;
+    uint32_t t3;
+
+    for (uint32_t r = 1U; r < AES_ROUNDS; ++r)
+    {
+        rk += 4;
+        t0 = te[s0 >> 24] ^ aes_ror(te[(s1 >> 16) & 0xFFU], 8U) ^
+             aes_ror(te[(s2 >> 8) & 0xFFU], 16U) ^ aes_ror(te[s3 & 0xFFU], 24U) ^ rk[0];
+        t1 = te[s1 >> 24] ^ aes_ror(te[(s2 >> 16) & 0xFFU], 8U) ^
+             aes_ror(te[(s3 >> 8) & 0xFFU], 16U) ^ aes_ror(te[s0 & 0xFFU], 24U) ^ rk[1];
+        t2 = te[s2 >> 24] ^ aes_ror(te[(s3 >> 16) & 0xFFU], 8U) ^
+             aes_ror(te[(s0 >> 8) & 0xFFU], 16U) ^ aes_ror(te[s1 & 0xFFU], 24U) ^ rk[2];
+        t3 = te[s3 >> 24] ^ aes_ror(te[(s0 >> 16) & 0xFFU], 8U) ^
+             aes_ror(te[(s1 >> 8) & 0xFFU], 16U) ^ aes_ror(te[s2 & 0xFFU], 24U) ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+
+    /* Last round without MixColumns: the S-box byte is byte 1 and 2 of
+     * Te0[x], masked into place. */
+    rk += 4;
+    t0 = ((te[s0 >> 24] << 8) & 0xFF000000U) ^ (te[(s1 >> 16) & 0xFFU] & 0x00FF0000U) ^
+         (te[(s2 >> 8) & 0xFFU] & 0x0000FF00U) ^ ((te[s3 & 0xFFU] >> 8) & 0xFFU) ^ rk[0];
+    t1 = ((te[s1 >> 24] << 8) & 0xFF000000U) ^ (te[(s2 >> 16) & 0xFFU] & 0x00FF0000U) ^
+         (te[(s3 >> 8) & 0xFFU] & 0x0000FF00U) ^ ((te[s0 & 0xFFU] >> 8) & 0xFFU) ^ rk[1];
+    t2 = ((te[s2 >> 24] << 8) & 0xFF000000U) ^ (te[(s3 >> 16) & 0xFFU] & 0x00FF0000U) ^
+         (te[(s0 >> 8) & 0xFFU] & 0x0000FF00U) ^ ((te[s1 & 0xFFU] >> 8) & 0xFFU) ^ rk[2];
+    t3 = ((te[s3 >> 24] << 8) & 0xFF000000U) ^ (te[(s0 >> 16) & 0xFFU] & 0x00FF0000U) ^
+         (te[(s1 >> 8) & 0xFFU] & 0x0000FF00U) ^ ((te[s2 & 0xFFU] >> 8) & 0xFFU) ^ rk[3];
+
+    aes_put32(&out[0], t0);
+    aes_put32(&out[4], t1);
+    aes_put32(&out[8], t2);
+    aes_put32(&out[12], t3);
+}
+
+void AesCmac_Compute(const AesCmac_Key_t *k, const uint8_t *msg, uint32_t len, uint8_t *mac)
+{
+    uint8_t  x[AES_CMAC_BLOCK] = { 0U };
+    uint32_t pos = 0U;
+
+    /* Every block but the last: CBC. */
+    while ((len - pos) > AES_CMAC_BLOCK)
+    {
+        for (uint32_t i = 0U; i < AES_CMAC_BLOCK; ++i)
+            x[i] ^= msg[pos + i];
+        AesCmac_Encrypt(k, x, x);
+        pos += AES_CMAC_BLOCK;
+    }
+
+    /* The last block: complete with K1, or padded 10..0 with K2 (also the
+     * empty message). */
+    uint32_t       rest = len - pos;
+    const uint8_t *sub  = (rest == AES_CMAC_BLOCK) ? k->k1 : k->k2;
+
+    for (uint32_t i = 0U; i < AES_CMAC_BLOCK; ++i)
+    {
+        uint8_t m = (i < rest) ? msg[pos + i] : ((i == rest) ? 0x80U : 0x00U);
+        x[i] ^= (uint8_t)(m ^ sub[i]);
+    }
+    AesCmac_Encrypt(k, x, mac);
+}
+
+uint8_t AesCmac_SelfTest(void)
+{
+    static const uint8_t fipsKey[AES_CMAC_KEY_LEN] =
+    {
+        0x00U, 0x01U, 0x02U, 0x03U, 0x04U, 0x05U, 0x06U, 0x07U,
+        0x08U, 0x09U, 0x0AU, 0x0BU, 0x0CU, 0x0DU, 0x0EU, 0x0FU
+    };
+    static const uint8_t fipsIn[AES_CMAC_BLOCK] =
+    {
+        0x00U, 0x11U, 0x22U, 0x33U, 0x44U, 0x55U, 0x66U, 0x77U,
+        0x88U, 0x99U, 0xAAU, 0xBBU, 0xCCU, 0xDDU, 0xEEU, 0xFFU
+    };
+    static const uint8_t rfcKey[AES_CMAC_KEY_LEN] =
+    {
+        0x2BU, 0x7EU, 0x15U, 0x16U, 0x28U, 0xAEU, 0xD2U, 0xA6U,
+        0xABU, 0xF7U, 0x15U, 0x88U, 0x09U, 0xCFU, 0x4FU, 0x3CU
+    };
+    static const uint8_t rfcMsg[40] =
+    {
+        0x6BU, 0xC1U, 0xBEU, 0xE2U, 0x2EU, 0x40U, 0x9FU, 0x96U,
+        0xE9U, 0x3DU, 0x7EU, 0x11U, 0x73U, 0x93U, 0x17U, 0x2AU,
+        0xAEU, 0x2DU, 0x8AU, 0x57U, 0x1EU, 0x03U, 0xACU, 0x9CU,
+        0x9EU, 0xB7U, 0x6FU, 0xACU, 0x45U, 0xAFU, 0x8EU, 0x51U,
+        0x30U, 0xC8U, 0x1CU, 0x46U, 0xA3U, 0x5CU, 0xE4U, 0x11U
+    };
+
+    AesCmac_Key_t k;
+    uint8_t       out[AES_CMAC_BLOCK];
+    uint8_t       ok = 1U;
+
+    AesCmac_SetKey(&k, fipsKey);
+    AesCmac_Encrypt(&k, fipsIn, out);
+    ok &= aes_equal(out, "69c4e0d86a7b0430d8cdb78070b4c55a");
+
+    AesCmac_SetKey(&k, rfcKey);
+    AesCmac_Compute(&k, rfcMsg, 0U, out);
+    ok &= aes_equal(out, "bb1d6929e95937287fa37d129b756746");
+    AesCmac_Compute(&k, rfcMsg, 16U, out);
+    ok &= aes_equal(out, "070a16b46b4d4144f79bdd9dd04a287c");
+    AesCmac_Compute(&k, rfcMsg, 40U, out);
+    ok &= aes_equal(out, "dfa66747de9ae63030ca32611497c827");
+
+    memset(&k, 0, sizeof(k));
+    return ok;
+}
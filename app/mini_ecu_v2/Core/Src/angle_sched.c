@@ -0,0 +1,666 @@
+/**
+ * @file    angle_sched.c
+ * @brief   Crank-angle event scheduler on the TIM4 compare channels,
+ *          "angle" and "bench angle". See angle_sched.h.
+ */
+
+#include "angle_sched.h"
+#include "cli_if.h"
+#include "ramfunc.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if ANGLE_SCHED_ENABLE
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define AS_AF_TIM4          2U          /* PB7..PB9 = TIM4_CH2..CH4 */
+
+/** Last present tooth (crank.h): the reference for angles in the gap. */
+#define AS_LAST             (CRANK_TEETH - CRANK_MISSING - 1U)
+
+/** Angles: 0.1 degrees in the table, 0.01 degrees in the errors. */
+#define AS_DEG10_TOOTH      (3600U / CRANK_TEETH)
+#define AS_DEG100_TOOTH     (36000U / CRANK_TEETH)
+#define AS_DEG100_REV       36000
+
+/* OCxM */
+#define AS_OCM_ACTIVE       1U          /* active on match */
+#define AS_OCM_INACTIVE     2U          /* inactive on match */
+#define AS_OCM_FORCE_LOW    4U
+#define AS_OCM_FORCE_HIGH   5U
+
+#define AS_BENCH_SETTLE_MS  200U
+
+#define AS_CHECK_(name, ch, pin, deg10, us)                                                 \
+    _Static_assert(((ch) >= 2U) && ((ch) <= 4U), #name ": TIM4 channel 2..4");               \
+    _Static_assert((deg10) < 3600U, #name ": angle 0..359.9");                              \
+    _Static_assert(((us) >= ANGLE_SCHED_WIDTH_MIN) && ((us) <= ANGLE_SCHED_WIDTH_MAX),      \
+                   #name ": width out of range");
+ANGLE_SCHED_EVENT_TABLE(AS_CHECK_)
+
+/* Up to three teeth ahead at CRANK_MIN_RPM fit the 16-bit counter, and so
+ * does the gap the firing is measured in. */
+_Static_assert(((CRANK_MISSING + 1U) * 60000000U) / (CRANK_TEETH * CRANK_MIN_RPM) < 32768U,
+               "CRANK_MIN_RPM: schedule horizon longer than half a TIM4 wrap");
+
+typedef struct
+{
+    const char *name;
+    uint8_t     ch;
+    uint8_t     pin;
+    uint16_t    deg10;
+    uint16_t    widthUs;
+} AsCfg_t;
+
+#define AS_CFG_(name, ch, pin, deg10, us)   { #name, (ch), (pin), (deg10), (us) },
+static const AsCfg_t s_asCfg[ANGLE_SCHED_EVENTS] = { ANGLE_SCHED_EVENT_TABLE(AS_CFG_) };
+
+enum
+{
+    AS_IDLE = 0,            /* channel parked low */
+    AS_ARMED,               /* start in CCR */
+    AS_ACTIVE               /* output high, end in CCR */
+};
+
+/** Per event, interrupt state; other contexts copy it under PRIMASK. */
+typedef struct
+{
+    uint16_t deg10;
+    uint16_t widthUs;
+    uint8_t  refTooth;      /* last present tooth before the angle ... */
+    uint8_t  off10;         /* ... and the angle past it, 0.1 degrees */
+    uint8_t  state;
+    uint8_t  measPending;   /* fireT not yet placed between two edges */
+    uint16_t fireT;         /* TIM4 count the pulse started at */
+    uint32_t fired;
+    uint32_t late;
+    uint32_t overlaps;
+    uint32_t measured;
+    int64_t  errSum;        /* 0.01 degrees */
+    uint64_t errSq;
+    int32_t  errMin;
+    int32_t  errMax;
+    int32_t  winMin;        /* extremes since the bench step started */
+    int32_t  winMax;
+} AsEvent_t;
+
+typedef struct
+{
+    uint32_t measured;
+    uint32_t late;
+    uint32_t overlaps;
+    int64_t  errSum;
+    uint64_t errSq;
+    int32_t  errMin;
+    int32_t  errMax;
+} AsBenchEv_t;
+
+#define AS_STEP_(from, to)  { (from), (to) },
+static const uint16_t s_asSweep[][2] = { ANGLE_SCHED_SWEEP_TABLE(AS_STEP_) };
+#define AS_BENCH_STEPS      ((uint32_t)(sizeof(s_asSweep) / sizeof(s_asSweep[0])))
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static AsEvent_t              s_asEv[ANGLE_SCHED_EVENTS];
+
+/* Benchmark: started by the CLI, stepped by the runnable. */
+static volatile uint8_t       s_asBenchRun  = 0U;
+static volatile uint32_t      s_asBenchDone = 0U;   /* steps with results */
+static uint32_t               s_asBenchMs   = ANGLE_SCHED_BENCH_MS;
+static uint32_t               s_asBenchT0   = 0U;
+static uint8_t                s_asBenchMeas = 0U;
+static AsEvent_t              s_asBenchSnap[ANGLE_SCHED_EVENTS];
+static AsBenchEv_t            s_asBench[AS_BENCH_STEPS][ANGLE_SCHED_EVENTS];
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Where an angle is scheduled from: the last present tooth before it. */
+static void as_place(AsEvent_t *e, uint32_t deg10)
+{
+    uint32_t a   = (deg10 == 0U) ? 3600U : deg10;
+    uint32_t ref = (a - 1U) / AS_DEG10_TOOTH;
+
+    if (ref > AS_LAST)
+        ref = AS_LAST;
+    e->deg10    = (uint16_t)deg10;
+    e->refTooth = (uint8_t)ref;
+    e->off10    = (uint8_t)(a - (ref * AS_DEG10_TOOTH));
+}
+
+RAMFUNC static void as_mode(uint32_t i, uint32_t ocm)
+{
+    uint32_t          ch    = s_asCfg[i].ch;
+    volatile uint32_t *ccmr = (ch < 3U) ? &TIM4->CCMR1 : &TIM4->CCMR2;
+    uint32_t          shift = ((ch & 1U) != 0U) ? TIM_CCMR1_OC1M_Pos : TIM_CCMR1_OC2M_Pos;
+
+    *ccmr = (*ccmr & ~(7UL << shift)) | (ocm << shift);
+}
+
+RAMFUNC static volatile uint32_t *as_ccr(uint32_t i)
+{
+    return &TIM4->CCR1 + (s_asCfg[i].ch - 1U);
+}
+
+/** Park the channel: output low, no compare interrupt. */
+RAMFUNC static void as_park(uint32_t i)
+{
+    uint32_t bit = 1UL << s_asCfg[i].ch;
+
+    as_mode(i, AS_OCM_FORCE_LOW);
+    TIM4->DIER &= ~bit;
+    TIM4->SR    = ~bit;
+    s_asEv[i].state = AS_IDLE;
+}
+
+/** The pulse started at fireT: put its end into the compare. */
+RAMFUNC static void as_started(uint32_t i)
+{
+    AsEvent_t *e   = &s_asEv[i];
+    uint32_t   bit = 1UL << s_asCfg[i].ch;
+
+    e->fired++;
+    *as_ccr(i) = (uint16_t)(e->fireT + e->widthUs);
+    TIM4->SR   = ~bit;
+    as_mode(i, AS_OCM_INACTIVE);
+    e->state   = AS_ACTIVE;
+
+    if ((uint16_t)((uint16_t)TIM4->CNT - e->fireT) >= e->widthUs)
+    {
+        e->late++;
+        as_park(i);
+    }
+}
+
+/** Schedule event @p i from the tooth edge at @p t, @p per us per tooth. */
+RAMFUNC static void as_arm(uint32_t i, uint16_t t, uint32_t per)
+{
+    AsEvent_t *e   = &s_asEv[i];
+    uint32_t   bit = 1UL << s_asCfg[i].ch;
+
+    if (e->state != AS_IDLE)
+    {
+        e->overlaps++;
+        return;
+    }
+
+    uint32_t delay = ((uint32_t)e->off10 * per) / AS_DEG10_TOOTH;
+
+    e->fireT       = (uint16_t)(t + delay);
+    e->measPending = 1U;
+    e->state       = AS_ARMED;
+    *as_ccr(i)     = e->fireT;
+    TIM4->SR       = ~bit;
+    as_mode(i, AS_OCM_ACTIVE);
+    TIM4->DIER    |= bit;
+
+    /* Written too late for the match: the counter is already there. */
+    uint16_t now = (uint16_t)TIM4->CNT;
+    if ((uint16_t)(now - t) >= delay)
+    {
+        as_mode(i, AS_OCM_FORCE_HIGH);
+        e->fireT = now;
+        e->late++;
+        as_started(i);
+    }
+}
+
+/** The firing lies between the edge before and the one at @p t. */
+RAMFUNC static void as_measure(AsEvent_t *e, uint32_t tooth, uint32_t since, uint32_t dt)
+{
+    uint32_t prev   = (tooth == 0U) ? AS_LAST : (tooth - 1U);
+    uint32_t span   = (tooth == 0U) ? (CRANK_MISSING + 1U) : 1U;
+    int32_t  actual = (int32_t)((prev * AS_DEG100_TOOTH) +
+                                ((span * AS_DEG100_TOOTH * (dt - since)) / dt));
+    int32_t  err    = actual - ((int32_t)e->deg10 * 10);
+
+    if (err > (AS_DEG100_REV / 2))
+        err -= AS_DEG100_REV;
+    else if (err < -(AS_DEG100_REV / 2))
+        err += AS_DEG100_REV;
+
+    e->measured++;
+    e->errSum += err;
+    e->errSq  += (uint64_t)((int64_t)err * err);
+    if (err < e->errMin)
+        e->errMin = err;
+    if (err > e->errMax)
+        e->errMax = err;
+    if (err < e->winMin)
+        e->winMin = err;
+    if (err > e->winMax)
+        e->winMax = err;
+}
+
+static void as_snapshot(AsEvent_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memcpy(out, s_asEv, sizeof(s_asEv));
+    __set_PRIMASK(primask);
+}
+
+static void as_stats(uint32_t n, int64_t sum, uint64_t sq, float *mean, float *std)
+{
+    *mean = 0.0f;
+    *std  = 0.0f;
+    if (n == 0U)
+        return;
+
+    float m   = (float)sum / (float)n;
+    float var = ((float)sq / (float)n) - (m * m);
+
+    *mean = m / 100.0f;
+    *std  = (var > 0.0f) ? (sqrtf(var) / 100.0f) : 0.0f;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static const char *const s_asSyncNames[] = { "NOSYNC", "SEEK", "SYNC" };
+
+static void as_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    Crank_State_t s;
+    Crank_Get(&s);
+
+    CLI_IF_Printf("Angle scheduler on TIM4 compare, crank %s at %.0f rpm%s\r\n",
+                  s_asSyncNames[s.sync], (double)s.rpm,
+                  (s_asBenchRun != 0U) ? ", bench running" : "");
+    CLI_IF_Printf("  %-5s %2s %3s %6s %6s %8s %6s %6s %8s %7s %6s %7s %7s\r\n",
+                  "event", "ch", "pin", "deg", "us", "fired", "late", "overlap",
+                  "measured", "err", "jitter", "min", "max");
+
+    for (uint32_t i = 0U; i < ANGLE_SCHED_EVENTS; ++i)
+    {
+        AngleSched_Event_t ev;
+        (void)AngleSched_Get(i, &ev);
+
+        char pin[4] = "-";
+        if (s_asCfg[i].pin != 0U)
+        {
+            pin[0] = 'P';
+            pin[1] = 'B';
+            pin[2] = (char)('5' + s_asCfg[i].ch);
+            pin[3] = '\0';
+        }
+
+        CLI_IF_Printf("  %-5s %2u %3s %6.1f %6u %8lu %6lu %6lu %8lu %7.2f %6.2f %7.2f %7.2f\r\n",
+                      s_asCfg[i].name, (unsigned)s_asCfg[i].ch, pin,
+                      (double)((float)ev.deg10 / 10.0f), (unsigned)ev.widthUs,
+                      (unsigned long)ev.fired, (unsigned long)ev.late,
+                      (unsigned long)ev.overlaps, (unsigned long)ev.measured,
+                      (double)ev.errMeanDeg, (double)ev.errStdDeg,
+                      (double)ev.errMinDeg, (double)ev.errMaxDeg);
+    }
+    CLI_IF_Print("  (err: fired minus set angle, deg; jitter: its standard deviation)\r\n");
+}
+
+static void as_cmd_set(int argc, char *argv[])
+{
+    uint32_t i;
+
+    for (i = 0U; i < ANGLE_SCHED_EVENTS; ++i)
+    {
+        if (strcmp(argv[0], s_asCfg[i].name) == 0)
+            break;
+    }
+
+    char *end;
+    float deg = strtof(argv[1], &end);
+    if ((i >= ANGLE_SCHED_EVENTS) || (*end != '\0') || !(deg >= 0.0f) || (deg >= 360.0f))
+    {
+        CLI_IF_Print("Usage: angle set <event> <deg 0..359.9> [<us>]\r\n");
+        return;
+    }
+
+    uint32_t us = s_asEv[i].widthUs;
+    if (argc > 2)
+    {
+        us = (uint32_t)strtoul(argv[2], &end, 10);
+        if ((*end != '\0') || (us < ANGLE_SCHED_WIDTH_MIN) || (us > ANGLE_SCHED_WIDTH_MAX))
+        {
+            CLI_IF_Printf("Width %lu..%lu us.\r\n", (unsigned long)ANGLE_SCHED_WIDTH_MIN,
+                          (unsigned long)ANGLE_SCHED_WIDTH_MAX);
+            return;
+        }
+    }
+
+    uint32_t deg10 = (uint32_t)((deg * 10.0f) + 0.5f);
+    if (deg10 >= 3600U)
+        deg10 = 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    as_place(&s_asEv[i], deg10);
+    s_asEv[i].widthUs = (uint16_t)us;
+    __set_PRIMASK(primask);
+
+    CLI_IF_Printf("%s at %.1f deg for %lu us, from tooth %u.\r\n", s_asCfg[i].name,
+                  (double)((float)deg10 / 10.0f), (unsigned long)us,
+                  (unsigned)s_asEv[i].refTooth);
+}
+
+static void as_cmd_bench(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t done = s_asBenchDone;
+
+    CLI_IF_Printf("Angle bench: %s, %lu of %lu steps, %lu ms each\r\n",
+                  (s_asBenchRun != 0U) ? "running" : "idle", (unsigned long)done,
+                  (unsigned long)AS_BENCH_STEPS, (unsigned long)s_asBenchMs);
+    if (done == 0U)
+        return;
+
+    CLI_IF_Printf("  %5s %5s %-5s %8s %6s %6s %7s %6s %7s %7s\r\n",
+                  "from", "to", "event", "measured", "late", "overlap",
+                  "err", "jitter", "min", "max");
+    for (uint32_t s = 0U; s < done; ++s)
+    {
+        for (uint32_t i = 0U; i < ANGLE_SCHED_EVENTS; ++i)
+        {
+            const AsBenchEv_t *b = &s_asBench[s][i];
+            float              mean;
+            float              std;
+
+            as_stats(b->measured, b->errSum, b->errSq, &mean, &std);
+            CLI_IF_Printf("  %5u %5u %-5s %8lu %6lu %6lu %7.2f %6.2f %7.2f %7.2f\r\n",
+                          (unsigned)s_asSweep[s][0], (unsigned)s_asSweep[s][1], s_asCfg[i].name,
+                          (unsigned long)b->measured, (unsigned long)b->late,
+                          (unsigned long)b->overlaps, (double)mean, (double)std,
+                          (double)((b->measured != 0U) ? ((float)b->errMin / 100.0f) : 0.0f),
+                          (double)((b->measured != 0U) ? ((float)b->errMax / 100.0f) : 0.0f));
+        }
+    }
+}
+
+static void as_cmd_bench_start(int argc, char *argv[])
+{
+    uint32_t ms = ANGLE_SCHED_BENCH_MS;
+
+    if (argc > 0)
+    {
+        char *end;
+        ms = (uint32_t)strtoul(argv[0], &end, 10);
+        if ((*end != '\0') || (argc > 1) || (ms < 100U) || (ms > 10000U))
+        {
+            CLI_IF_Print("Usage: bench angle start [<ms per step, 100..10000>]\r\n");
+            return;
+        }
+    }
+
+    if (s_asBenchRun != 0U)
+    {
+        CLI_IF_Print("Angle bench busy.\r\n");
+        return;
+    }
+
+    s_asBenchMs   = ms;
+    s_asBenchDone = 0U;
+    s_asBenchMeas = 0U;
+    s_asBenchT0   = HAL_GetTick();
+    s_asBenchRun  = 1U;
+
+    CLI_IF_Printf("Angle bench started, %lu steps of %lu ms; \"bench angle\" shows the figures.\r\n",
+                  (unsigned long)AS_BENCH_STEPS, (unsigned long)ms);
+}
+
+static const CliCommand_t s_asCmds[] =
+{
+    { "angle",             "",                     0U, as_cmd_show,        "crank-angle events and their angle error" },
+    { "angle set",         "<event> <deg> [<us>]", 2U, as_cmd_set,         "move an event to an angle, set its width" },
+    { "bench angle",       "",                     0U, as_cmd_bench,       "angle error per sweep step and event" },
+    { "bench angle start", "[<ms>]",               0U, as_cmd_bench_start, "sweep the crank generator, measure the angle error" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef AngleSched_Init(void)
+{
+    GPIO_InitTypeDef gpio = {0};
+
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+
+    gpio.Mode      = GPIO_MODE_AF_PP;
+    gpio.Pull      = GPIO_NOPULL;
+    gpio.Speed     = GPIO_SPEED_FREQ_LOW;
+    gpio.Alternate = AS_AF_TIM4;
+
+    for (uint32_t i = 0U; i < ANGLE_SCHED_EVENTS; ++i)
+    {
+        uint32_t ch = s_asCfg[i].ch;
+
+        memset(&s_asEv[i], 0, sizeof(s_asEv[i]));
+        as_place(&s_asEv[i], s_asCfg[i].deg10);
+        s_asEv[i].widthUs = s_asCfg[i].widthUs;
+        s_asEv[i].errMin  = INT32_MAX;
+        s_asEv[i].errMax  = INT32_MIN;
+        s_asEv[i].winMin  = INT32_MAX;
+        s_asEv[i].winMax  = INT32_MIN;
+
+        /* Output compare without preload, parked low; TIM4 runs already. */
+        as_park(i);
+        if (s_asCfg[i].pin != 0U)
+        {
+            TIM4->CCER |= 1UL << ((ch - 1U) * 4U);
+            gpio.Pin    = 1UL << (5U + ch);         /* CH2 PB7 .. CH4 PB9 */
+            HAL_GPIO_Init(GPIOB, &gpio);
+        }
+    }
+
+    CLI_IF_REGISTER_TABLE(s_asCmds);
+
+    return HAL_OK;
+}
+
+/*
+ * From the tooth capture interrupt, at its priority. Integers only, as
+ * Crank_CaptureIRQHandler().
+ */
+RAMFUNC void AngleSched_ToothIRQ(uint32_t sync, uint32_t tooth, uint16_t t, uint32_t dt)
+{
+    if (sync != (uint32_t)CRANK_SYNC)
+    {
+        /* No tooth frame to measure in; what is armed fires regardless. */
+        for (uint32_t i = 0U; i < ANGLE_SCHED_EVENTS; ++i)
+            s_asEv[i].measPending = 0U;
+        return;
+    }
+
+    uint32_t per = (tooth == 0U) ? (dt / (CRANK_MISSING + 1U)) : dt;
+
+    for (uint32_t i = 0U; i < ANGLE_SCHED_EVENTS; ++i)
+    {
+        AsEvent_t *e = &s_asEv[i];
+
+        if (e->measPending != 0U)
+        {
+            /* Fired at or after the previous edge: at most dt ago. A
+             * firing still ahead wraps to far more than dt. */
+            uint32_t since = (uint16_t)(t - e->fireT);
+            if (since <= dt)
+            {
+                e->measPending = 0U;
+                as_measure(e, tooth, since, dt);
+            }
+        }
+
+        if (tooth == e->refTooth)
+            as_arm(i, t, per);
+    }
+}
+
+RAMFUNC void AngleSched_CompareIRQHandler(void)
+{
+    uint32_t sr = TIM4->SR & TIM4->DIER;
+
+    for (uint32_t i = 0U; i < ANGLE_SCHED_EVENTS; ++i)
+    {
+        uint32_t bit = 1UL << s_asCfg[i].ch;
+
+        if ((sr & bit) == 0U)
+            continue;
+
+        TIM4->SR = ~bit;
+        if (s_asEv[i].state == AS_ARMED)
+            as_started(i);
+        else
+            as_park(i);
+    }
+}
+
+void AngleSched_Event10ms(void)
+{
+    if (s_asBenchRun == 0U)
+        return;
+
+    uint32_t now  = HAL_GetTick();
+    uint32_t step = s_asBenchDone;
+    int32_t  from = (int32_t)s_asSweep[step][0];
+    int32_t  to   = (int32_t)s_asSweep[step][1];
+
+    if (s_asBenchMeas == 0U)
+    {
+        Crank_SetGeneratorRpm((uint16_t)from);
+        if ((now - s_asBenchT0) >= AS_BENCH_SETTLE_MS)
+        {
+            uint32_t primask = __get_PRIMASK();
+            __disable_irq();
+            for (uint32_t i = 0U; i < ANGLE_SCHED_EVENTS; ++i)
+            {
+                s_asEv[i].winMin = INT32_MAX;
+                s_asEv[i].winMax = INT32_MIN;
+            }
+            memcpy(s_asBenchSnap, s_asEv, sizeof(s_asEv));
+            __set_PRIMASK(primask);
+
+            s_asBenchT0   = now;
+            s_asBenchMeas = 1U;
+        }
+        return;
+    }
+
+    uint32_t el = now - s_asBenchT0;
+    if (el < s_asBenchMs)
+    {
+        Crank_SetGeneratorRpm((uint16_t)(from + (((to - from) * (int32_t)el) / (int32_t)s_asBenchMs)));
+        return;
+    }
+
+    AsEvent_t ev[ANGLE_SCHED_EVENTS];
+    as_snapshot(ev);
+
+    for (uint32_t i = 0U; i < ANGLE_SCHED_EVENTS; ++i)
+    {
+        AsBenchEv_t     *b = &s_asBench[step][i];
+        const AsEvent_t *p = &s_asBenchSnap[i];
+
+        b->measured = ev[i].measured - p->measured;
+        b->late     = ev[i].late - p->late;
+        b->overlaps = ev[i].overlaps - p->overlaps;
+        b->errSum   = ev[i].errSum - p->errSum;
+        b->errSq    = ev[i].errSq - p->errSq;
+        b->errMin   = ev[i].winMin;
+        b->errMax   = ev[i].winMax;
+    }
+
+    s_asBenchDone = step + 1U;
+    s_asBenchT0   = now;
+    s_asBenchMeas = 0U;
+    if ((step + 1U) >= AS_BENCH_STEPS)
+    {
+        s_asBenchRun = 0U;
+        Crank_SetGeneratorRpm(0U);
+    }
+}
+
+uint32_t AngleSched_Get(uint32_t id, AngleSched_Event_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (id >= ANGLE_SCHED_EVENTS)
+        return 0U;
+
+    AsEvent_t e;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    e = s_asEv[id];
+    __set_PRIMASK(primask);
+
+    out->deg10    = e.deg10;
+    out->widthUs  = e.widthUs;
+    out->fired    = e.fired;
+    out->late     = e.late;
+    out->overlaps = e.overlaps;
+    out->measured = e.measured;
+    as_stats(e.measured, e.errSum, e.errSq, &out->errMeanDeg, &out->errStdDeg);
+    if (e.measured != 0U)
+    {
+        out->errMinDeg = (float)e.errMin / 100.0f;
+        out->errMaxDeg = (float)e.errMax / 100.0f;
+    }
+    return 1U;
+}
+
+void AngleSched_ClockChanged(void)
+{
+    /* TimeSync_ClockChanged() restarted TIM4: every CCR is void. */
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint32_t i = 0U; i < ANGLE_SCHED_EVENTS; ++i)
+    {
+        as_park(i);
+        s_asEv[i].measPending = 0U;
+    }
+    __set_PRIMASK(primask);
+}
+
+#else /* !ANGLE_SCHED_ENABLE */
+
+HAL_StatusTypeDef AngleSched_Init(void)
+{
+    return HAL_OK;
+}
+
+void AngleSched_Event10ms(void)
+{
+}
+
+void AngleSched_ToothIRQ(uint32_t sync, uint32_t tooth, uint16_t t, uint32_t dt)
+{
+    (void)sync;
+    (void)tooth;
+    (void)t;
+    (void)dt;
+}
+
+void AngleSched_CompareIRQHandler(void)
+{
+}
+
+uint32_t AngleSched_Get(uint32_t id, AngleSched_Event_t *out)
+{
+    (void)id;
+    memset(out, 0, sizeof(*out));
+    return 0U;
+}
+
+void AngleSched_ClockChanged(void)
+{
+}
+
+#endif /* ANGLE_SCHED_ENABLE */
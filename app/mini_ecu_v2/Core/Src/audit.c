@@ -0,0 +1,178 @@
+/**
+ * @file    audit.c
+ * @brief   Audit ring of state-changing commands and "audit".
+ */
+
+#include "audit.h"
+#include "cli_if.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+_Static_assert(sizeof(Audit_Event_t) == 16U, "an audit event must be 16 bytes");
+_Static_assert((AUDIT_DEPTH != 0U) && ((AUDIT_DEPTH & (AUDIT_DEPTH - 1U)) == 0U),
+               "AUDIT_DEPTH must be a power of two");
+_Static_assert(AUDIT_CMD_COUNT <= 256U, "audit command IDs must fit a byte");
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+#define AU_NAME_(name, cmd, a0, a1) cmd,
+#define AU_ARGS_(name, cmd, a0, a1) { a0, a1 },
+static const char *const s_auNames[AUDIT_CMD_COUNT] = { AUDIT_CMD_TABLE(AU_NAME_) };
+static const char        s_auArgs[AUDIT_CMD_COUNT][2] = { AUDIT_CMD_TABLE(AU_ARGS_) };
+#undef AU_NAME_
+#undef AU_ARGS_
+
+static const char *const s_auSrcNames[AUDIT_SRC_COUNT] = { "cli", "uds" };
+
+/* Ring and the events written so far (the next sequence number): under
+ * PRIMASK, by any task. */
+static Audit_Event_t s_auRing[AUDIT_DEPTH];
+static uint32_t      s_auCount = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void au_print_arg(char kind, uint32_t v)
+{
+    switch (kind)
+    {
+    case 'u':
+        CLI_IF_Printf(" %lu", (unsigned long)v);
+        break;
+    case 'x':
+        CLI_IF_Printf(" 0x%lX", (unsigned long)v);
+        break;
+    case 'f':
+    {
+        float f;
+
+        memcpy(&f, &v, sizeof(f));
+        CLI_IF_Printf(" %.2f", (double)f);
+        break;
+    }
+    case 's':
+    {
+        char text[5];
+
+        memcpy(text, &v, 4U);
+        text[4] = '\0';
+        CLI_IF_Printf(" %s", text);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void au_cmd_show(int argc, char *argv[])
+{
+    uint32_t want = AUDIT_DEPTH;
+
+    if (argc > 0)
+    {
+        char *end;
+
+        want = (uint32_t)strtoul(argv[0], &end, 10);
+        if ((*end != '\0') || (want == 0U))
+        {
+            CLI_IF_Print("Usage: audit [<n>]\r\n");
+            return;
+        }
+        if (want > AUDIT_DEPTH)
+            want = AUDIT_DEPTH;
+    }
+
+    /* CliTask only: kept off its stack. */
+    static Audit_Event_t ev[AUDIT_DEPTH];
+    uint32_t             n = Audit_Read(0U, want, ev);
+
+    CLI_IF_Printf("%lu events recorded, %u held; newest first\r\n",
+                  (unsigned long)s_auCount, (unsigned)AUDIT_DEPTH);
+    CLI_IF_Print("  seq    time ms  src  command        arguments\r\n");
+
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        const Audit_Event_t *e = &ev[i];
+
+        if (e->cmd >= AUDIT_CMD_COUNT)
+            continue;
+        CLI_IF_Printf("%5u %10lu  %-4s %-14s", (unsigned)e->seq, (unsigned long)e->timeMs,
+                      (e->src < AUDIT_SRC_COUNT) ? s_auSrcNames[e->src] : "?",
+                      s_auNames[e->cmd]);
+        au_print_arg(s_auArgs[e->cmd][0], e->arg[0]);
+        au_print_arg(s_auArgs[e->cmd][1], e->arg[1]);
+        CLI_IF_Print("\r\n");
+    }
+}
+
+static const CliCommand_t s_auCmds[] =
+{
+    { "audit", "[<n>]", 0U, au_cmd_show, "state-changing commands, newest first" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void Audit_Init(void)
+{
+    CLI_IF_REGISTER_TABLE(s_auCmds);
+}
+
+void Audit_Record(Audit_Cmd_t cmd, Audit_Src_t src, uint32_t arg0, uint32_t arg1)
+{
+    uint32_t now = HAL_GetTick();
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    Audit_Event_t *e = &s_auRing[s_auCount & (AUDIT_DEPTH - 1U)];
+    e->timeMs = now;
+    e->seq    = (uint16_t)s_auCount;
+    e->cmd    = (uint8_t)cmd;
+    e->src    = (uint8_t)src;
+    e->arg[0] = arg0;
+    e->arg[1] = arg1;
+    s_auCount++;
+
+    __set_PRIMASK(primask);
+}
+
+void Audit_RecordF(Audit_Cmd_t cmd, Audit_Src_t src, float arg0, uint32_t arg1)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &arg0, sizeof(bits));
+    Audit_Record(cmd, src, bits, arg1);
+}
+
+uint32_t Audit_Read(uint32_t back, uint32_t count, Audit_Event_t *out)
+{
+    uint32_t got = 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint32_t held = (s_auCount < AUDIT_DEPTH) ? s_auCount : AUDIT_DEPTH;
+    for (uint32_t i = back; (i < held) && (got < count); ++i)
+        out[got++] = s_auRing[(s_auCount - 1U - i) & (AUDIT_DEPTH - 1U)];
+
+    __set_PRIMASK(primask);
+    return got;
+}
+
+uint32_t Audit_Text(const char *s)
+{
+    uint32_t v = 0U;
+
+    for (uint32_t i = 0U; (i < 4U) && (s[i] != '\0'); ++i)
+        v |= (uint32_t)(uint8_t)s[i] << (8U * i);
+    return v;
+}
@@ -0,0 +1,150 @@
+/**
+ * @file    boot_handoff.c
+ * @brief   Read the bootloader's hand-off block and leave it requests.
+ */
+
+#include "boot_handoff.h"
+#include "clock_cfg.h"
+#include "log.h"
+#include "fmt.h"
+#include <stdio.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define BH_BLOCK   ((BootHandoff_t *)BOOT_HANDOFF_ADDR)
+#define BH_WORDS   ((sizeof(BootHandoff_t) / 4U) - 1U)   /* without check */
+
+_Static_assert(sizeof(BootHandoff_t) <= 64U, "hand-off block outgrows its 64 B");
+_Static_assert(BOOT_HANDOFF_CLOCK_HSI16 == CLOCK_PROFILE_HSI16,
+               "hand-off clock codes follow CLOCK_PROFILE_xxx");
+
+/** RCC->CSR reset flags, most specific first. */
+static const struct
+{
+    uint32_t    mask;
+    const char *name;
+} s_resetFlags[] =
+{
+    { RCC_CSR_IWDGRSTF, "IWDG" },
+    { RCC_CSR_WWDGRSTF, "WWDG" },
+    { RCC_CSR_LPWRRSTF, "LPWR" },
+    { RCC_CSR_SFTRSTF,  "SW"   },
+    { RCC_CSR_BORRSTF,  "BOR"  },
+    { RCC_CSR_PORRSTF,  "POR"  },
+    { RCC_CSR_PINRSTF,  "PIN"  },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t bh_sum(const BootHandoff_t *ho)
+{
+    const uint32_t *w = (const uint32_t *)ho;
+    uint32_t sum = 0U;
+
+    for (uint32_t i = 0U; i < BH_WORDS; ++i)
+        sum ^= w[i];
+    return ~sum;
+}
+
+static uint8_t bh_valid(const BootHandoff_t *ho)
+{
+    return ((ho->magic == BOOT_HANDOFF_MAGIC) && (ho->version == BOOT_HANDOFF_VERSION) &&
+            (ho->check == bh_sum(ho))) ? 1U : 0U;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+const BootHandoff_t *BootHandoff_Get(void)
+{
+    return (bh_valid(BH_BLOCK) != 0U) ? BH_BLOCK : NULL;
+}
+
+const char *BootHandoff_ResetCauseName(uint32_t resetCause, char *buf, uint32_t len)
+{
+    uint32_t pos = 0U;
+
+    buf[0] = '\0';
+    for (uint32_t i = 0U; i < (uint32_t)(sizeof(s_resetFlags) / sizeof(s_resetFlags[0])); ++i)
+    {
+        if ((resetCause & s_resetFlags[i].mask) == 0U || pos >= len)
+            continue;
+        int n = FMT_SNPRINTF(&buf[pos], len - pos, "%s%s", (pos != 0U) ? ", " : "",
+                             s_resetFlags[i].name);
+        if (n > 0)
+            pos += (uint32_t)n;
+    }
+    if (pos == 0U)
+        (void)FMT_SNPRINTF(buf, len, "unknown");
+    return buf;
+}
+
+void BootHandoff_Report(void)
+{
+    BootHandoff_t *ho = BH_BLOCK;
+    char cause[32];
+
+    if (bh_valid(ho) == 0U)
+    {
+        LOG_INFO(MAIN, "No bootloader hand-off, started directly");
+        return;
+    }
+
+    LOG_INFO(MAIN, "Boot: slot %c, %s path, %lu us in the bootloader, reset %s",
+             (char)ho->slot, ((ho->flags & BOOT_HANDOFF_FAST) != 0U) ? "fast" : "logged",
+             (unsigned long)ho->bootUs,
+             BootHandoff_ResetCauseName(ho->resetCause, cause, sizeof(cause)));
+    if (ho->attempt != 0U)
+        LOG_INFO(MAIN, "Trial boot %lu of this image", (unsigned long)ho->attempt);
+
+    switch (ho->updateStatus)
+    {
+    case BOOT_HANDOFF_UPDATE_INSTALLED:
+        LOG_INFO(MAIN, "Update installed: v%lu.%lu.%lu",
+                 (unsigned long)((ho->updateVersion >> 16) & 0xFFU),
+                 (unsigned long)((ho->updateVersion >> 8) & 0xFFU),
+                 (unsigned long)(ho->updateVersion & 0xFFU));
+        break;
+    case BOOT_HANDOFF_UPDATE_ABORTED:
+        LOG_WARN(MAIN, "Update aborted, the previous image is still active");
+        break;
+    case BOOT_HANDOFF_UPDATE_IDLE:
+        LOG_INFO(MAIN, "Update mode timed out without a session");
+        break;
+    default:
+        break;
+    }
+
+    ho->updateStatus  = BOOT_HANDOFF_UPDATE_NONE;
+    ho->updateVersion = 0U;
+    ho->check         = bh_sum(ho);
+}
+
+void BootHandoff_RequestUpdate(void)
+{
+    BootHandoff_t *ho = BH_BLOCK;
+
+    if (bh_valid(ho) == 0U)
+    {
+        /* No bootloader wrote one this boot; start a block it will accept. */
+        ho->magic         = BOOT_HANDOFF_MAGIC;
+        ho->version       = BOOT_HANDOFF_VERSION;
+        ho->resetCause    = 0U;
+        ho->clock         = BOOT_HANDOFF_CLOCK_NONE;
+        ho->bootUs        = 0U;
+        ho->flags         = 0U;
+        ho->slot          = 0U;
+        ho->attempt       = 0U;
+        ho->updateStatus  = BOOT_HANDOFF_UPDATE_NONE;
+        ho->updateVersion = 0U;
+    }
+
+    ho->request = BOOT_HANDOFF_REQ_UPDATE;
+    ho->check   = bh_sum(ho);
+    __DSB();
+}
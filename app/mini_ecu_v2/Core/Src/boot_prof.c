@@ -0,0 +1,170 @@
+/**
+ * @file    boot_prof.c
+ * @brief   Boot-time points on the DWT cycle counter and "boot times".
+ */
+
+#include "boot_prof.h"
+#include "boot_handoff.h"
+#include "cli_if.h"
+#include "sram_layout.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define BOOT_PROF_LABEL_(name, label)  label,
+
+static const char *const s_bpLabels[BOOT_PROF_COUNT] = { BOOT_PROF_POINT_TABLE(BOOT_PROF_LABEL_) };
+
+typedef struct
+{
+    uint32_t lastCyc;   /* counter value the time so far is measured up to */
+    uint32_t lastMhz;   /* core clock at lastCyc */
+    uint32_t nowUs;     /* time since reset at lastCyc */
+    uint32_t marked;    /* bit per point */
+    uint32_t us[BOOT_PROF_COUNT];
+} BootProf_State_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Written from Reset_Handler on, so neither .data nor .bss. */
+NOINIT static BootProf_State_t s_bp;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Core clock in MHz from the RCC registers (SystemCoreClock may not exist yet). */
+static uint32_t bp_core_mhz(void)
+{
+    uint32_t hz = HSI_VALUE;
+
+    if ((RCC->CFGR & RCC_CFGR_SWS) == RCC_CFGR_SWS_PLL)
+    {
+        uint32_t pll = RCC->PLLCFGR;
+        uint32_t m   = pll & RCC_PLLCFGR_PLLM;
+        uint32_t n   = (pll & RCC_PLLCFGR_PLLN) >> RCC_PLLCFGR_PLLN_Pos;
+        uint32_t p   = (((pll & RCC_PLLCFGR_PLLP) >> RCC_PLLCFGR_PLLP_Pos) + 1U) * 2U;
+
+        hz = ((HSI_VALUE / m) * n) / p;
+    }
+    hz >>= AHBPrescTable[(RCC->CFGR & RCC_CFGR_HPRE) >> RCC_CFGR_HPRE_Pos];
+
+    return (hz >= 1000000U) ? (hz / 1000000U) : 1U;
+}
+
+/**
+ * Move the time up to @p now at the clock found at the last point: a
+ * switch at the end of a stage (as the clock stages do) costs nothing.
+ * The sub-microsecond rest stays in lastCyc.
+ */
+static void bp_advance(uint32_t now)
+{
+    uint32_t us = (now - s_bp.lastCyc) / s_bp.lastMhz;
+
+    s_bp.nowUs   += us;
+    s_bp.lastCyc += us * s_bp.lastMhz;
+    s_bp.lastMhz  = bp_core_mhz();
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void bp_cmd_times(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    const BootHandoff_t *ho = BootHandoff_Get();
+    uint32_t prev = 0U;
+
+    CLI_IF_Print("Point                  At us   Step us\r\n");
+    if (ho != NULL)
+        CLI_IF_Printf("%-20s %7lu   %7lu  (%s path)\r\n", "bootloader jump",
+                      (unsigned long)ho->bootUs, (unsigned long)ho->bootUs,
+                      ((ho->flags & BOOT_HANDOFF_FAST) != 0U) ? "fast" : "logged");
+    for (uint32_t i = 0U; i < BOOT_PROF_COUNT; ++i)
+    {
+        if ((s_bp.marked & (1UL << i)) == 0U)
+        {
+            CLI_IF_Printf("%-20s       -         -\r\n", s_bpLabels[i]);
+            continue;
+        }
+        if ((i == 0U) && (ho != NULL))
+            prev = ho->bootUs;
+        if (s_bp.us[i] < prev)
+        {
+            CLI_IF_Printf("%-20s %7lu         -\r\n", s_bpLabels[i], (unsigned long)s_bp.us[i]);
+            continue;
+        }
+        CLI_IF_Printf("%-20s %7lu   %7lu\r\n", s_bpLabels[i], (unsigned long)s_bp.us[i],
+                      (unsigned long)(s_bp.us[i] - prev));
+        prev = s_bp.us[i];
+    }
+}
+
+static const CliCommand_t s_bpCmds[] =
+{
+    { "boot times", "", 0U, bp_cmd_times, "time from reset to each start-up point" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void BootProf_Begin(void)
+{
+    s_bp.marked  = 0U;
+    s_bp.nowUs   = 0U;
+    s_bp.lastCyc = 0U;
+    s_bp.lastMhz = bp_core_mhz();
+
+    /* Running: the bootloader started it at reset, on the HSI. */
+    if ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0U)
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0U;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+
+    BootProf_Mark(BOOT_PROF_ENTRY);
+}
+
+void BootProf_Mark(uint32_t point)
+{
+    if ((point >= BOOT_PROF_COUNT) || ((s_bp.marked & (1UL << point)) != 0U))
+        return;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if ((s_bp.marked & (1UL << point)) == 0U)
+    {
+        bp_advance(DWT->CYCCNT);
+        s_bp.us[point] = s_bp.nowUs;
+        s_bp.marked |= 1UL << point;
+    }
+    __set_PRIMASK(primask);
+}
+
+void BootProf_Rebase(void)
+{
+    uint32_t now = DWT->CYCCNT;
+
+    bp_advance(now);
+    /* Counted from 0 again; the rest carries over. */
+    s_bp.lastCyc -= now;
+}
+
+uint32_t BootProf_Us(BootProf_Point_t point)
+{
+    return (((uint32_t)point < BOOT_PROF_COUNT) && ((s_bp.marked & (1UL << point)) != 0U))
+           ? s_bp.us[point] : 0U;
+}
+
+void BootProf_Init(void)
+{
+    CLI_IF_REGISTER_TABLE(s_bpCmds);
+}
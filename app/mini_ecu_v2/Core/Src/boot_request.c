@@ -0,0 +1,242 @@
+/**
+ * @file    boot_request.c
+ * @brief   Bootloader hand-over, image confirmation and the "boot" CLI
+ *          commands.
+ */
+
+#include "boot_request.h"
+#include "image_header.h"
+#include "boot_handoff.h"
+#include "trip.h"
+#include "load_coll.h"
+#include "perf_life.h"
+#include "cli_if.h"
+#include "log.h"
+#include "cmsis_os2.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static TimerHandle_t s_confirmTimer;
+static StaticTimer_t s_confirmTimerCb;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Header of the slot this image is not running from. */
+static const ImageHeader_t *br_other_header(void)
+{
+    uint32_t own = (uint32_t)&g_imageHeader - IMAGE_HEADER_OFFSET;
+
+    return IMAGE_HEADER_AT((own == IMAGE_SLOT_A_ADDR) ? IMAGE_SLOT_B_ADDR : IMAGE_SLOT_A_ADDR);
+}
+
+/** The bootloader would start @p hdr's slot (its CRC is checked there). */
+static uint8_t br_bootable(const ImageHeader_t *hdr)
+{
+    return ((hdr->magic == IMAGE_HEADER_MAGIC) && (hdr->length != IMAGE_ERASED) &&
+            (hdr->revoked == IMAGE_ERASED)) ? 1U : 0U;
+}
+
+/**
+ * Program one erased boot-control word of our own header.
+ *
+ * HAL_FLASH_Program() and its busy wait run from SRAM (ramfunc.h); the
+ * scheduler is suspended so no flash-resident task is switched in while the
+ * flash is busy, and the interrupts keep running.
+ */
+static HAL_StatusTypeDef br_program(const uint32_t *word, uint32_t value)
+{
+    HAL_StatusTypeDef status;
+
+    (void)HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                           FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+    vTaskSuspendAll();
+    status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, (uint32_t)word, value);
+    (void)xTaskResumeAll();
+    (void)HAL_FLASH_Lock();
+
+    if ((status == HAL_OK) && (*(const volatile uint32_t *)word != value))
+        status = HAL_ERROR;
+    return status;
+}
+
+/** Timer daemon: the image ran BOOT_REQUEST_CONFIRM_MS, accept it. */
+static void br_confirm_timer(TimerHandle_t timer)
+{
+    (void)timer;
+
+    if (g_imageHeader.confirmed != IMAGE_ERASED || g_imageHeader.generation == IMAGE_ERASED)
+        return;
+
+    if (BootRequest_ConfirmImage() == HAL_OK)
+        LOG_INFO(MAIN, "Image v%lu.%lu.%lu (generation %lu) confirmed",
+                 (unsigned long)((g_imageHeader.version >> 16) & 0xFFU),
+                 (unsigned long)((g_imageHeader.version >> 8) & 0xFFU),
+                 (unsigned long)(g_imageHeader.version & 0xFFU),
+                 (unsigned long)g_imageHeader.generation);
+    else
+        LOG_ERROR(MAIN, "Image confirmation failed, the bootloader will roll back");
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void br_cmd_update(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CLI_IF_Print("Resetting into the bootloader update mode...\r\n");
+    BootRequest_EnterUpdate();
+}
+
+static void br_print_slot(char name, const ImageHeader_t *hdr)
+{
+    const char *state;
+
+    if (hdr->magic != IMAGE_HEADER_MAGIC)
+    {
+        CLI_IF_Printf("  %c: empty\r\n", name);
+        return;
+    }
+
+    if (hdr->revoked != IMAGE_ERASED)
+        state = "revoked";
+    else if (hdr->generation == IMAGE_ERASED)
+        state = "flashed";
+    else if (hdr->confirmed != IMAGE_ERASED)
+        state = "confirmed";
+    else
+        state = "trial";
+
+    CLI_IF_Printf("  %c: v%lu.%lu.%lu, generation %lu, %s%s\r\n", name,
+                 (unsigned long)((hdr->version >> 16) & 0xFFU),
+                 (unsigned long)((hdr->version >> 8) & 0xFFU),
+                 (unsigned long)(hdr->version & 0xFFU),
+                 (unsigned long)((hdr->generation == IMAGE_ERASED) ? 0U : hdr->generation),
+                 state, (hdr == &g_imageHeader) ? " (running)" : "");
+}
+
+static void br_cmd_slots(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    const BootHandoff_t *ho = BootHandoff_Get();
+
+    br_print_slot('A', IMAGE_HEADER_AT(IMAGE_SLOT_A_ADDR));
+    br_print_slot('B', IMAGE_HEADER_AT(IMAGE_SLOT_B_ADDR));
+
+    if (ho != NULL)
+    {
+        char cause[32];
+
+        CLI_IF_Printf("Booted slot %c, %s path, %lu us, reset %s\r\n", (char)ho->slot,
+                      ((ho->flags & BOOT_HANDOFF_FAST) != 0U) ? "fast" : "logged",
+                      (unsigned long)ho->bootUs,
+                      BootHandoff_ResetCauseName(ho->resetCause, cause, sizeof(cause)));
+    }
+}
+
+static void br_cmd_confirm(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if (g_imageHeader.generation == IMAGE_ERASED)
+        CLI_IF_Print("Image not on trial (flashed directly)\r\n");
+    else if (g_imageHeader.confirmed != IMAGE_ERASED)
+        CLI_IF_Print("Image already confirmed\r\n");
+    else
+        CLI_IF_Print((BootRequest_ConfirmImage() == HAL_OK) ? "Image confirmed\r\n"
+                                                              : "Flash program failed\r\n");
+}
+
+static void br_cmd_rollback(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if (br_bootable(br_other_header()) == 0U)
+    {
+        CLI_IF_Print("No image in the other slot to roll back to\r\n");
+        return;
+    }
+    if (br_program(&g_imageHeader.revoked, 0U) != HAL_OK)
+    {
+        CLI_IF_Print("Flash program failed\r\n");
+        return;
+    }
+
+    CLI_IF_Print("Image revoked, resetting into the other slot...\r\n");
+    BootRequest_Restart();
+}
+
+static const CliCommand_t s_bootCmds[] =
+{
+    { "boot update",   "", 0U, br_cmd_update,   "reset into the bootloader update mode" },
+    { "boot slots",    "", 0U, br_cmd_slots,    "show the A/B slot headers" },
+    { "boot confirm",  "", 0U, br_cmd_confirm,  "confirm the running trial image" },
+    { "boot rollback", "", 0U, br_cmd_rollback, "revoke this image and boot the other slot" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef BootRequest_Init(void)
+{
+    CLI_IF_REGISTER_TABLE(s_bootCmds);
+
+#if BOOT_REQUEST_CONFIRM_MS > 0
+    if (g_imageHeader.generation != IMAGE_ERASED && g_imageHeader.confirmed == IMAGE_ERASED)
+    {
+        s_confirmTimer = xTimerCreateStatic("BootConfirm", pdMS_TO_TICKS(BOOT_REQUEST_CONFIRM_MS),
+                                            pdFALSE, NULL, br_confirm_timer, &s_confirmTimerCb);
+        if (s_confirmTimer == NULL || xTimerStart(s_confirmTimer, 0U) != pdPASS)
+            return HAL_ERROR;
+    }
+#endif
+
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef BootRequest_ConfirmImage(void)
+{
+    if (g_imageHeader.generation == IMAGE_ERASED || g_imageHeader.confirmed != IMAGE_ERASED)
+        return HAL_OK;
+
+    return br_program(&g_imageHeader.confirmed, 0U);
+}
+
+void BootRequest_Restart(void)
+{
+    /* NvmTask writes the trip counters, load collectives and lifetime
+     * performance counters during the delay. */
+    (void)Trip_Save();
+    (void)LoadColl_Save();
+    (void)PerfLife_Save();
+    osDelay(BOOT_REQUEST_RESET_DELAY_MS);
+    NVIC_SystemReset();
+}
+
+void BootRequest_EnterUpdate(void)
+{
+    /* NvmTask writes the trip counters, load collectives and lifetime
+     * performance counters during the delay. */
+    (void)Trip_Save();
+    (void)LoadColl_Save();
+    (void)PerfLife_Save();
+    osDelay(BOOT_REQUEST_RESET_DELAY_MS);
+
+    BootHandoff_RequestUpdate();
+    NVIC_SystemReset();
+}
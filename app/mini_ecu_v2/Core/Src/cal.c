@@ -0,0 +1,690 @@
+/**
+ * @file    cal.c
+ * @brief   Calibration shadow, its flash log client and "cal".
+ */
+
+#include "cal.h"
+#include "cal_image.h"
+#include "audit.h"
+#include "nvm_log.h"
+#include "cli_if.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define CAL_TYPE_F      0U
+#define CAL_TYPE_U      1U
+
+#define CAL_VAL_F(v)    { .f = (v) }
+#define CAL_VAL_U(v)    { .u = (v) }
+
+typedef struct
+{
+    const char *name;
+    uint16_t    key;
+    uint8_t     type;
+    Cal_Value_t def;
+    Cal_Value_t min;
+    Cal_Value_t max;
+    const char *help;
+} Cal_Def_t;
+
+#define CAL_DEF_(name, key, type, def, min, max, help) \
+    { #name, key, CAL_TYPE_##type, CAL_VAL_##type(def), CAL_VAL_##type(min), CAL_VAL_##type(max), help },
+static const Cal_Def_t s_calDefs[CAL_COUNT] = { CAL_TABLE(CAL_DEF_) };
+
+typedef struct
+{
+    const char *name;
+    uint16_t    key;
+    uint16_t    base;       /* first cell in the arrays of all cells */
+    uint8_t     rows;
+    uint8_t     cols;
+    float       min;
+    float       max;
+    const char *help;
+} Cal_MapDef_t;
+
+#define CAL_MAP_DEF_(name, key, rows, cols, min, max, help) \
+    { #name, key, (uint16_t)CAL_MAP_BASE_##name, rows, cols, min, max, help },
+static const Cal_MapDef_t s_calMapDefs[CAL_MAP_COUNT] = { CAL_MAP_TABLE(CAL_MAP_DEF_) };
+
+/* Flash log entries: the parameters, then every map cell. */
+#define CAL_ENTRIES     ((uint32_t)CAL_COUNT + (uint32_t)CAL_MAP_CELLS)
+
+/* Built-in map defaults, all maps in one array (flash): the fallback for a
+ * table the calibration image does not have. */
+#define CAL_MAP_DEFAULT_(name, key, rows, cols, min, max, help)   CAL_MAP_##name##_DEFAULT,
+static const float s_calMapDefault[CAL_MAP_CELLS] = { CAL_MAP_TABLE(CAL_MAP_DEFAULT_) };
+
+#define CAL_MAP_SIZE_CHECK_(name, key, rows, cols, min, max, help) \
+    _Static_assert(CAL_MAP_SIZE(name) <= 256U, "map " #name " has more cells than keys");
+CAL_MAP_TABLE(CAL_MAP_SIZE_CHECK_)
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+#define CAL_DEFAULT_(name, key, type, def, min, max, help)   CAL_VAL_##type(def),
+Cal_Value_t g_calValues[CAL_COUNT] = { CAL_TABLE(CAL_DEFAULT_) };
+
+/* Committed values (what the log holds) and the marks: dirty = set since
+ * the last commit, pending = committed but not yet written. Written under
+ * PRIMASK by Cal_Set()/Cal_Commit() (any task) and NvmTask. */
+static Cal_Value_t s_calStored[CAL_COUNT] = { CAL_TABLE(CAL_DEFAULT_) };
+static uint8_t     s_calDirty[CAL_ENTRIES];
+static uint8_t     s_calPending[CAL_ENTRIES];
+
+/* Maps: the flash table of each (image or built-in, chosen by Cal_Init())
+ * and the page readers see, the flash table or the overlay. */
+#define CAL_MAP_PTR_(name, key, rows, cols, min, max, help) \
+    &s_calMapDefault[CAL_MAP_BASE_##name],
+const float *g_calMaps[CAL_MAP_COUNT] = { CAL_MAP_TABLE(CAL_MAP_PTR_) };
+
+static const float *s_calMapFlash[CAL_MAP_COUNT] = { CAL_MAP_TABLE(CAL_MAP_PTR_) };
+static uint32_t     s_calMapImage;          /* bit m: map m from the image */
+_Static_assert(CAL_MAP_COUNT <= 32U, "s_calMapImage has a bit per map");
+static CalImage_Status_t s_calImageStatus = CAL_IMAGE_NO_IMAGE;
+
+/* Overlays, taken from the pool by the first cell a map changes and kept:
+ * rows x cols live cells, then as many committed ones. A map without one
+ * has its committed cells in flash. */
+static float    s_calOverlay[CAL_OVERLAY_CELLS];
+static uint32_t s_calOverlayUsed;
+static float   *s_calMapRam[CAL_MAP_COUNT];
+static uint32_t s_calMapLost;               /* committed cells not restored */
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t cal_in_range(const Cal_Def_t *d, Cal_Value_t v)
+{
+    if (d->type == CAL_TYPE_F)
+        return ((v.f >= d->min.f) && (v.f <= d->max.f)) ? 1U : 0U;
+
+    return ((v.u >= d->min.u) && (v.u <= d->max.u)) ? 1U : 0U;
+}
+
+/** Map of cell @p cell (index into the arrays of all cells). */
+static uint32_t cal_map_of(uint32_t cell)
+{
+    uint32_t m = 0U;
+
+    while (((m + 1U) < CAL_MAP_COUNT) && (cell >= s_calMapDefs[m + 1U].base))
+        m++;
+    return m;
+}
+
+static uint32_t cal_map_cells(uint32_t m)
+{
+    return (uint32_t)s_calMapDefs[m].rows * s_calMapDefs[m].cols;
+}
+
+/** Overlay of map @p m, taken from the pool with the flash cells as live
+ *  and committed values if it has none; NULL when the pool is out. PRIMASK
+ *  held (or before the scheduler). */
+static float *cal_map_overlay(uint32_t m)
+{
+    uint32_t n   = cal_map_cells(m);
+    float   *ram = s_calMapRam[m];
+
+    if (ram == NULL)
+    {
+        if ((CAL_OVERLAY_CELLS - s_calOverlayUsed) < (2U * n))
+            return NULL;
+        ram = &s_calOverlay[s_calOverlayUsed];
+        s_calOverlayUsed += 2U * n;
+        memcpy(ram, s_calMapFlash[m], (size_t)n * sizeof(float));
+        memcpy(&ram[n], s_calMapFlash[m], (size_t)n * sizeof(float));
+        s_calMapRam[m] = ram;
+    }
+    return ram;
+}
+
+/** Let readers see @p cells for map @p m. */
+static void cal_map_show(uint32_t m, const float *cells)
+{
+    /* Cells first, then the pointer: a reader sees one page or the other. */
+    __DMB();
+    g_calMaps[m] = cells;
+}
+
+static uint8_t cal_map_in_range(const Cal_MapDef_t *d, const float *cells)
+{
+    for (uint32_t i = 0U; i < ((uint32_t)d->rows * d->cols); ++i)
+    {
+        if (!((cells[i] >= d->min) && (cells[i] <= d->max)))
+            return 0U;
+    }
+    return 1U;
+}
+
+static void cal_map_restore(const NvmLog_Record_t *rec)
+{
+    for (uint32_t m = 0U; m < CAL_MAP_COUNT; ++m)
+    {
+        const Cal_MapDef_t *d = &s_calMapDefs[m];
+        uint32_t            c = (uint32_t)rec->key - d->key;
+        Cal_Value_t         v;
+
+        if (((uint32_t)rec->key < d->key) || (c >= ((uint32_t)d->rows * d->cols)))
+            continue;
+
+        /* As for parameters: a cell of another type or range is left out,
+         * and one the flash table already has needs no overlay. */
+        v.u = rec->data[0];
+        if ((rec->aux != CAL_TYPE_F) || !((v.f >= d->min) && (v.f <= d->max)) ||
+            ((s_calMapRam[m] == NULL) && (v.f == s_calMapFlash[m][c])))
+            return;
+
+        float *ram = cal_map_overlay(m);
+        if (ram == NULL)
+        {
+            s_calMapLost++;
+            return;
+        }
+        ram[c]                    = v.f;
+        ram[cal_map_cells(m) + c] = v.f;
+        cal_map_show(m, ram);
+        return;
+    }
+}
+
+static void cal_restore(const NvmLog_Record_t *rec)
+{
+    for (uint32_t i = 0U; i < CAL_COUNT; ++i)
+    {
+        const Cal_Def_t *d = &s_calDefs[i];
+        Cal_Value_t      v;
+
+        if (d->key != rec->key)
+            continue;
+
+        /* A record of another type or range (the table changed) keeps the
+         * default, and the next copy drops it. */
+        v.u = rec->data[0];
+        if ((rec->aux == d->type) && (cal_in_range(d, v) != 0U))
+        {
+            g_calValues[i] = v;
+            s_calStored[i] = v;
+        }
+        return;
+    }
+
+    cal_map_restore(rec);
+}
+
+static uint8_t cal_take(uint32_t i, uint8_t all, NvmLog_Record_t *rec)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint8_t take;
+    if (i < CAL_COUNT)
+    {
+        take = (all != 0U) ? (uint8_t)(s_calStored[i].u != s_calDefs[i].def.u)
+                           : s_calPending[i];
+        rec->key     = s_calDefs[i].key;
+        rec->aux     = s_calDefs[i].type;
+        rec->data[0] = s_calStored[i].u;
+    }
+    else
+    {
+        uint32_t            cell  = i - CAL_COUNT;
+        uint32_t            m     = cal_map_of(cell);
+        const Cal_MapDef_t *d     = &s_calMapDefs[m];
+        uint32_t            c     = cell - d->base;
+        const float        *saved = (s_calMapRam[m] != NULL) ? &s_calMapRam[m][cal_map_cells(m)]
+                                                             : s_calMapFlash[m];
+        Cal_Value_t         v     = { .f = saved[c] };
+
+        take = (all != 0U) ? (uint8_t)(saved[c] != s_calMapFlash[m][c]) : s_calPending[i];
+        rec->key     = (uint16_t)(d->key + c);
+        rec->aux     = CAL_TYPE_F;
+        rec->data[0] = v.u;
+    }
+    rec->data[1] = 0U;
+    s_calPending[i] = 0U;
+
+    __set_PRIMASK(primask);
+    return take;
+}
+
+static void cal_retry(uint32_t i)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_calPending[i] = 1U;
+    __set_PRIMASK(primask);
+}
+
+static const NvmLog_Client_t s_calClient =
+{
+    .tag     = NVM_LOG_TAG_CAL,
+    .count   = CAL_ENTRIES,
+    .restore = cal_restore,
+    .take    = cal_take,
+    .retry   = cal_retry,
+};
+
+static void cal_print_value(const Cal_Def_t *d, Cal_Value_t v)
+{
+    if (d->type == CAL_TYPE_F)
+        CLI_IF_Printf("%g", (double)v.f);
+    else
+        CLI_IF_Printf("%lu", (unsigned long)v.u);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void cal_show(uint32_t i)
+{
+    const Cal_Def_t *d = &s_calDefs[i];
+
+    CLI_IF_Printf("%-16s ", d->name);
+    cal_print_value(d, g_calValues[i]);
+    CLI_IF_Print((s_calDirty[i] != 0U) ? " (not committed)" : "");
+    CLI_IF_Print("  default ");
+    cal_print_value(d, d->def);
+    CLI_IF_Print(", ");
+    cal_print_value(d, d->min);
+    CLI_IF_Print("..");
+    cal_print_value(d, d->max);
+    CLI_IF_Printf("  %s\r\n", d->help);
+}
+
+static void cal_cmd_list(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    for (uint32_t i = 0U; i < CAL_COUNT; ++i)
+        cal_show(i);
+}
+
+static void cal_cmd_get(int argc, char *argv[])
+{
+    (void)argc;
+
+    int32_t id = Cal_Find(argv[0]);
+    if (id < 0)
+    {
+        CLI_IF_Printf("Unknown parameter '%s' (see 'cal')\r\n", argv[0]);
+        return;
+    }
+
+    cal_show((uint32_t)id);
+}
+
+static void cal_cmd_set(int argc, char *argv[])
+{
+    (void)argc;
+
+    int32_t id = Cal_Find(argv[0]);
+    if (id < 0)
+    {
+        CLI_IF_Printf("Unknown parameter '%s' (see 'cal')\r\n", argv[0]);
+        return;
+    }
+
+    const Cal_Def_t *d   = &s_calDefs[id];
+    char            *end = NULL;
+    Cal_Value_t      v;
+
+    if (d->type == CAL_TYPE_F)
+        v.f = strtof(argv[1], &end);
+    else
+        v.u = (uint32_t)strtoul(argv[1], &end, 10);
+
+    if ((end == argv[1]) || (*end != '\0') || (Cal_Set((Cal_Id_t)id, v) != HAL_OK))
+    {
+        CLI_IF_Print("Value must be ");
+        cal_print_value(d, d->min);
+        CLI_IF_Print("..");
+        cal_print_value(d, d->max);
+        CLI_IF_Print("\r\n");
+        return;
+    }
+
+    Audit_Record(AUDIT_CMD_CAL_SET, AUDIT_SRC_CLI, (uint32_t)id, v.u);
+    CLI_IF_Print("OK, 'cal commit' to keep it\r\n");
+}
+
+static void cal_cmd_map(int argc, char *argv[])
+{
+    if (argc == 0)
+    {
+        for (uint32_t m = 0U; m < CAL_MAP_COUNT; ++m)
+        {
+            const Cal_MapDef_t *d = &s_calMapDefs[m];
+
+            CLI_IF_Printf("%-16s %2u x %-2u %-5s %-8s %g..%g  %s\r\n", d->name,
+                          (unsigned)d->rows, (unsigned)d->cols,
+                          (g_calMaps[m] == s_calMapFlash[m]) ? "flash" : "RAM",
+                          ((s_calMapImage & (1UL << m)) != 0U) ? "image" : "built-in",
+                          (double)d->min, (double)d->max, d->help);
+        }
+        return;
+    }
+
+    int32_t m = Cal_MapFind(argv[0]);
+    if (m < 0)
+    {
+        CLI_IF_Printf("Unknown map '%s' (see 'cal map')\r\n", argv[0]);
+        return;
+    }
+
+    const Cal_MapDef_t *d     = &s_calMapDefs[m];
+    const float        *cells = g_calMaps[m];
+
+    CLI_IF_Printf("%s: %s\r\n    ", d->name, d->help);
+    for (uint32_t c = 0U; c < d->cols; ++c)
+        CLI_IF_Printf(" %7lu ", (unsigned long)c);
+    for (uint32_t r = 0U; r < d->rows; ++r)
+    {
+        CLI_IF_Printf("\r\n%3lu ", (unsigned long)r);
+        for (uint32_t c = 0U; c < d->cols; ++c)
+        {
+            uint32_t i = ((uint32_t)r * d->cols) + c;
+
+            CLI_IF_Printf(" %7.6g%c", (double)cells[i],
+                          (s_calDirty[CAL_COUNT + d->base + i] != 0U) ? '*' : ' ');
+        }
+    }
+    CLI_IF_Print("\r\n(* not committed)\r\n");
+}
+
+static void cal_cmd_map_set(int argc, char *argv[])
+{
+    (void)argc;
+
+    int32_t m = Cal_MapFind(argv[0]);
+    if (m < 0)
+    {
+        CLI_IF_Printf("Unknown map '%s' (see 'cal map')\r\n", argv[0]);
+        return;
+    }
+
+    const Cal_MapDef_t *d = &s_calMapDefs[m];
+    char               *e1;
+    char               *e2;
+    char               *e3;
+    unsigned long       row = strtoul(argv[1], &e1, 10);
+    unsigned long       col = strtoul(argv[2], &e2, 10);
+    float               v   = strtof(argv[3], &e3);
+
+    HAL_StatusTypeDef st = HAL_ERROR;
+
+    if ((*e1 == '\0') && (*e2 == '\0') && (e3 != argv[3]) && (*e3 == '\0'))
+        st = Cal_MapSet((Cal_MapId_t)m, (uint32_t)row, (uint32_t)col, v);
+    if (st == HAL_BUSY)
+    {
+        CLI_IF_Printf("No overlay RAM left for %s (CAL_OVERLAY_CELLS %u)\r\n", d->name,
+                      (unsigned)CAL_OVERLAY_CELLS);
+        return;
+    }
+    if (st != HAL_OK)
+    {
+        CLI_IF_Printf("Cell must be 0..%u 0..%u, value %g..%g\r\n", (unsigned)(d->rows - 1U),
+                      (unsigned)(d->cols - 1U), (double)d->min, (double)d->max);
+        return;
+    }
+
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    Audit_Record(AUDIT_CMD_CAL_MAP_SET, AUDIT_SRC_CLI,
+                 (uint32_t)m | ((uint32_t)row << 8) | ((uint32_t)col << 16), bits);
+    CLI_IF_Print("OK, 'cal commit' to keep it\r\n");
+}
+
+static void cal_cmd_map_page(int argc, char *argv[])
+{
+    (void)argc;
+
+    int32_t m = Cal_MapFind(argv[0]);
+    if (m < 0)
+    {
+        CLI_IF_Printf("Unknown map '%s' (see 'cal map')\r\n", argv[0]);
+        return;
+    }
+
+    uint8_t ram = (strcmp(argv[1], "ram") == 0) ? 1U : 0U;
+    if ((ram == 0U) && (strcmp(argv[1], "flash") != 0))
+    {
+        CLI_IF_Print("Page must be flash or ram\r\n");
+        return;
+    }
+
+    if (Cal_MapPage((Cal_MapId_t)m, ram) != HAL_OK)
+    {
+        CLI_IF_Printf("No overlay RAM left for %s (CAL_OVERLAY_CELLS %u)\r\n", argv[0],
+                      (unsigned)CAL_OVERLAY_CELLS);
+        return;
+    }
+
+    CLI_IF_Printf("%s reads the %s page\r\n", argv[0], (ram != 0U) ? "RAM" : "flash");
+}
+
+static void cal_cmd_image(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    const CalImage_Header_t *img = CalImage_Get();
+
+    CLI_IF_Printf("Image at 0x%08lX: %s", (unsigned long)(uintptr_t)img,
+                  CalImage_StatusName(s_calImageStatus));
+    if (CalImage_Usable(s_calImageStatus) != 0U)
+        CLI_IF_Printf(", dataset %lu, %lu of %u B, %u tables, CRC 0x%08lX",
+                      (unsigned long)img->version, (unsigned long)img->length,
+                      (unsigned)CAL_IMAGE_SIZE, (unsigned)img->count, (unsigned long)img->crc32);
+    CLI_IF_Print("\r\n");
+
+    for (uint32_t m = 0U; m < CAL_MAP_COUNT; ++m)
+    {
+        CLI_IF_Printf("  %-16s %-8s at 0x%08lX, %s page%s\r\n", s_calMapDefs[m].name,
+                      ((s_calMapImage & (1UL << m)) != 0U) ? "image" : "built-in",
+                      (unsigned long)(uintptr_t)s_calMapFlash[m],
+                      (g_calMaps[m] == s_calMapFlash[m]) ? "flash" : "RAM",
+                      (s_calMapRam[m] != NULL) ? ", overlay" : "");
+    }
+
+    CLI_IF_Printf("Overlay RAM: %lu of %u cells", (unsigned long)s_calOverlayUsed,
+                  (unsigned)CAL_OVERLAY_CELLS);
+    if (s_calMapLost != 0U)
+        CLI_IF_Printf(", %lu committed cells not restored (full)", (unsigned long)s_calMapLost);
+    CLI_IF_Print("\r\n");
+}
+
+static void cal_cmd_commit(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t queued = Cal_Commit();
+
+    Audit_Record(AUDIT_CMD_CAL_COMMIT, AUDIT_SRC_CLI, queued, 0U);
+    CLI_IF_Printf("%lu values queued for flash\r\n", (unsigned long)queued);
+}
+
+static const CliCommand_t s_calCmds[] =
+{
+    { "cal",        "",               0U, cal_cmd_list,   "calibration parameters" },
+    { "cal get",    "<name>",         1U, cal_cmd_get,    "show one calibration parameter" },
+    { "cal set",    "<name> <value>", 2U, cal_cmd_set,    "set a parameter (RAM until 'cal commit')" },
+    { "cal commit", "",               0U, cal_cmd_commit, "write the changed parameters and cells to flash" },
+    { "cal map",    "[<name>]",       0U, cal_cmd_map,    "calibration maps, or one as a grid" },
+    { "cal map set", "<name> <row> <col> <value>", 4U, cal_cmd_map_set,
+      "set a map cell (RAM until 'cal commit')" },
+    { "cal map page", "<name> flash|ram", 2U, cal_cmd_map_page,
+      "switch a map between its flash table and the RAM overlay" },
+    { "cal image",  "",               0U, cal_cmd_image,  "calibration image and overlays" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void Cal_Init(void)
+{
+    const CalImage_Header_t *img = CalImage_Get();
+
+    s_calImageStatus = CalImage_Check(img);
+    if (CalImage_Usable(s_calImageStatus) == 0U)
+        LOG_ERROR(MAIN, "Calibration image: %s, built-in maps", CalImage_StatusName(s_calImageStatus));
+
+    for (uint32_t m = 0U; (m < CAL_MAP_COUNT) && (CalImage_Usable(s_calImageStatus) != 0U); ++m)
+    {
+        const Cal_MapDef_t *d     = &s_calMapDefs[m];
+        const float        *cells = CalImage_Table(img, d->key, d->rows, d->cols);
+
+        if ((cells == NULL) || (cal_map_in_range(d, cells) == 0U))
+        {
+            LOG_WARN(MAIN, "Calibration image: no valid %s, built-in default", d->name);
+            continue;
+        }
+        s_calMapFlash[m] = cells;
+        g_calMaps[m]     = cells;
+        s_calMapImage   |= 1UL << m;
+    }
+
+    if (NvmLog_Register(&s_calClient) != HAL_OK)
+        LOG_ERROR(MAIN, "Calibration not in the flash log, defaults only");
+
+    CLI_IF_REGISTER_TABLE(s_calCmds);
+}
+
+int32_t Cal_Find(const char *name)
+{
+    if (name == NULL)
+        return -1;
+
+    for (uint32_t i = 0U; i < CAL_COUNT; ++i)
+    {
+        if (strcmp(name, s_calDefs[i].name) == 0)
+            return (int32_t)i;
+    }
+
+    return -1;
+}
+
+int32_t Cal_MapFind(const char *name)
+{
+    if (name == NULL)
+        return -1;
+
+    for (uint32_t m = 0U; m < CAL_MAP_COUNT; ++m)
+    {
+        if (strcmp(name, s_calMapDefs[m].name) == 0)
+            return (int32_t)m;
+    }
+
+    return -1;
+}
+
+int32_t Cal_FindKey(uint16_t key)
+{
+    for (uint32_t i = 0U; i < CAL_COUNT; ++i)
+    {
+        if (s_calDefs[i].key == key)
+            return (int32_t)i;
+    }
+
+    return -1;
+}
+
+HAL_StatusTypeDef Cal_Set(Cal_Id_t id, Cal_Value_t value)
+{
+    if (((uint32_t)id >= CAL_COUNT) || (cal_in_range(&s_calDefs[id], value) == 0U))
+        return HAL_ERROR;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    g_calValues[id] = value;
+    s_calDirty[id]  = (value.u != s_calStored[id].u) ? 1U : 0U;
+    __set_PRIMASK(primask);
+
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef Cal_MapSet(Cal_MapId_t id, uint32_t row, uint32_t col, float value)
+{
+    if ((uint32_t)id >= CAL_MAP_COUNT)
+        return HAL_ERROR;
+
+    const Cal_MapDef_t *d = &s_calMapDefs[id];
+    if ((row >= d->rows) || (col >= d->cols) || !((value >= d->min) && (value <= d->max)))
+        return HAL_ERROR;
+
+    uint32_t c = (row * d->cols) + col;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    float *ram = cal_map_overlay((uint32_t)id);
+    if (ram != NULL)
+    {
+        ram[c] = value;
+        cal_map_show((uint32_t)id, ram);
+        s_calDirty[CAL_COUNT + d->base + c] = (value != ram[cal_map_cells((uint32_t)id) + c]) ? 1U : 0U;
+    }
+    __set_PRIMASK(primask);
+
+    return (ram != NULL) ? HAL_OK : HAL_BUSY;
+}
+
+HAL_StatusTypeDef Cal_MapPage(Cal_MapId_t id, uint8_t ram)
+{
+    if ((uint32_t)id >= CAL_MAP_COUNT)
+        return HAL_ERROR;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const float *cells = (ram != 0U) ? cal_map_overlay((uint32_t)id) : s_calMapFlash[id];
+    if (cells != NULL)
+        cal_map_show((uint32_t)id, cells);
+    __set_PRIMASK(primask);
+
+    return (cells != NULL) ? HAL_OK : HAL_BUSY;
+}
+
+uint32_t Cal_Commit(void)
+{
+    uint32_t queued = 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    for (uint32_t i = 0U; i < CAL_ENTRIES; ++i)
+    {
+        if (s_calDirty[i] == 0U)
+            continue;
+        if (i < CAL_COUNT)
+        {
+            s_calStored[i] = g_calValues[i];
+        }
+        else
+        {
+            /* Only Cal_MapSet() marks a cell, after taking the overlay. */
+            uint32_t cell = i - CAL_COUNT;
+            uint32_t m    = cal_map_of(cell);
+            uint32_t c    = cell - s_calMapDefs[m].base;
+
+            s_calMapRam[m][cal_map_cells(m) + c] = s_calMapRam[m][c];
+        }
+        s_calDirty[i]   = 0U;
+        s_calPending[i] = 1U;
+        queued++;
+    }
+
+    __set_PRIMASK(primask);
+
+    if (queued != 0U)
+        NvmLog_Notify();
+    return queued;
+}
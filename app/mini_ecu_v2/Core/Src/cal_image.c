@@ -0,0 +1,116 @@
+/**
+ * @file    cal_image.c
+ * @brief   The linked calibration image and its checks.
+ *
+ * The image is built from CAL_MAP_TABLE and the map defaults of cal.h. The
+ * CRC stays erased; tools/image_stamp.py fills it in after the link.
+ */
+
+#include "cal_image.h"
+#include "cal.h"
+#include "crc.h"
+#include <stddef.h>
+
+/* -------------------------------------------------------------------------- */
+/* Linked image                                                               */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    CalImage_Header_t hdr;
+    CalImage_Entry_t  dir[CAL_MAP_COUNT];
+    float             cells[CAL_MAP_CELLS];
+} CalImage_Linked_t;
+
+_Static_assert(sizeof(CalImage_Linked_t) <= CAL_IMAGE_SIZE, "maps do not fit the calibration image");
+_Static_assert((sizeof(CalImage_Header_t) % 4U) == 0U, "header must keep the cells aligned");
+_Static_assert((sizeof(CalImage_Entry_t) % 4U) == 0U, "directory must keep the cells aligned");
+
+#define CAL_IMAGE_NAME_CHECK_(name, key, rows, cols, min, max, help) \
+    _Static_assert(sizeof(#name) <= CAL_IMAGE_NAME_LEN, "map name " #name " too long for the image");
+CAL_MAP_TABLE(CAL_IMAGE_NAME_CHECK_)
+
+#define CAL_IMAGE_ENTRY_(name, key, rows, cols, min, max, help)                 \
+    { #name, key, rows, cols,                                                   \
+      (uint32_t)(offsetof(CalImage_Linked_t, cells) + (CAL_MAP_BASE_##name * sizeof(float))) },
+#define CAL_IMAGE_CELLS_(name, key, rows, cols, min, max, help)   CAL_MAP_##name##_DEFAULT,
+
+__attribute__((section(".cal_image"), used))
+static const CalImage_Linked_t s_calImageLinked =
+{
+    .hdr =
+    {
+        .magic   = CAL_IMAGE_MAGIC,
+        .layout  = CAL_IMAGE_LAYOUT,
+        .count   = (uint16_t)CAL_MAP_COUNT,
+        .version = CAL_IMAGE_VERSION,
+        .length  = (uint32_t)sizeof(CalImage_Linked_t),
+        .crc32   = 0xFFFFFFFFU,
+    },
+    .dir   = { CAL_MAP_TABLE(CAL_IMAGE_ENTRY_) },
+    .cells = { CAL_MAP_TABLE(CAL_IMAGE_CELLS_) },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static const char *const s_calImageStatusNames[] =
+{
+    "ok", "not stamped", "no image", "other layout", "bad length", "CRC mismatch"
+};
+#define CAL_IMAGE_STATUS_COUNT  (sizeof(s_calImageStatusNames) / sizeof(s_calImageStatusNames[0]))
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+const CalImage_Header_t *CalImage_Get(void)
+{
+    return &s_calImageLinked.hdr;
+}
+
+CalImage_Status_t CalImage_Check(const CalImage_Header_t *img)
+{
+    if (img->magic != CAL_IMAGE_MAGIC)
+        return CAL_IMAGE_NO_IMAGE;
+    if (img->layout != CAL_IMAGE_LAYOUT)
+        return CAL_IMAGE_BAD_LAYOUT;
+    if ((img->length > CAL_IMAGE_SIZE) || ((img->length % 4U) != 0U) ||
+        (img->length < (sizeof(CalImage_Header_t) + ((uint32_t)img->count * sizeof(CalImage_Entry_t)))))
+        return CAL_IMAGE_BAD_LENGTH;
+    if (img->crc32 == 0xFFFFFFFFU)
+        return CAL_IMAGE_UNSTAMPED;
+
+    const uint32_t *w     = (const uint32_t *)img;
+    const uint32_t  crc_w = (uint32_t)(offsetof(CalImage_Header_t, crc32) / 4U);
+    uint32_t        crc   = Crc_Mpeg32(CRC32_INIT, w, crc_w);
+
+    crc = Crc_Mpeg32(crc, &w[crc_w + 1U], (img->length / 4U) - crc_w - 1U);
+    return (crc == img->crc32) ? CAL_IMAGE_OK : CAL_IMAGE_BAD_CRC;
+}
+
+const float *CalImage_Table(const CalImage_Header_t *img, uint16_t key, uint32_t rows,
+                            uint32_t cols)
+{
+    const CalImage_Entry_t *dir = (const CalImage_Entry_t *)(img + 1);
+
+    for (uint32_t i = 0U; i < img->count; ++i)
+    {
+        const CalImage_Entry_t *e = &dir[i];
+
+        if ((e->key != key) || (e->rows != rows) || (e->cols != cols))
+            continue;
+        if (((e->offset % 4U) != 0U) || (e->offset > img->length) ||
+            ((img->length - e->offset) < (rows * cols * (uint32_t)sizeof(float))))
+            return NULL;
+        return (const float *)((const uint8_t *)img + e->offset);
+    }
+
+    return NULL;
+}
+
+const char *CalImage_StatusName(CalImage_Status_t status)
+{
+    return ((uint32_t)status < CAL_IMAGE_STATUS_COUNT) ? s_calImageStatusNames[status] : "?";
+}
@@ -0,0 +1,295 @@
+/**
+ * @file    can_alarm.c
+ * @brief   Threshold alarms through the urgent TX mailbox. See can_alarm.h.
+ */
+
+#include "can_alarm.h"
+#include "cal.h"
+#include "can_signals.h"
+#include "cli_if.h"
+#include <string.h>
+
+#if CAN_ALARM_ENABLE
+
+_Static_assert(CAN_ALARM_COUNT <= 32U, "CAN_ALARM_TABLE: one pending bit per alarm");
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define CA_NONE  0xFFU
+
+typedef struct
+{
+    const char *name;
+    const char *text;
+    float       hyst;
+    uint8_t     above;
+    uint8_t     cal;     /* Cal_Id_t of the threshold */
+} CaDef_t;
+
+/** One alarm: its state and the frame of its newest edge until loaded. */
+typedef struct
+{
+    uint8_t  active;
+    uint32_t raised;
+    float    value;      /* at the last edge */
+    uint32_t atCycles;   /* DWT stamp of the pending edge */
+    uint8_t  data[CANSIG_ALARM_DLC];
+} CaAlarm_t;
+
+#define CA_DEF_(name, field, dir, cal, hyst, text) \
+    { #name, text, (hyst), (uint8_t)(dir), (uint8_t)CAL_##cal },
+static const CaDef_t s_caDefs[CAN_ALARM_COUNT] = { CAN_ALARM_TABLE(CA_DEF_) };
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static CAN_IF_TxTemplate_t s_caTx;
+static CaAlarm_t           s_caAlarms[CAN_ALARM_COUNT];
+static CanAlarm_Stats_t    s_caStats;
+static uint8_t             s_caSeq = 0U;
+
+/* Shared with the TX interrupt; changed with interrupts masked. */
+static uint32_t s_caPending  = 0U;        /* bit i: s_caAlarms[i] waits */
+static uint8_t  s_caInFlight = CA_NONE;   /* alarm whose frame the mailbox holds */
+static uint32_t s_caFlightAt = 0U;        /* its detection stamp */
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static void ca_lat(CanAlarm_Lat_t *l, uint32_t cycles)
+{
+    uint32_t cyclesPerUs = SystemCoreClock / 1000000U;
+    uint32_t us = cycles / ((cyclesPerUs != 0U) ? cyclesPerUs : 1U);
+
+    l->count++;
+    l->sumUs += us;
+    if (us > l->maxUs)
+        l->maxUs = us;
+}
+
+/**
+ * @brief Load the lowest pending alarm if the mailbox is free. Interrupts
+ *        masked.
+ */
+static void ca_kick(void)
+{
+    while (s_caPending != 0U)
+    {
+        uint32_t i = 0U;
+        while ((s_caPending & (1UL << i)) == 0U)
+            i++;
+
+        HAL_StatusTypeDef st = CAN_IF_TransmitUrgent(&s_caTx, s_caAlarms[i].data);
+        if (st == HAL_BUSY)
+            return;
+
+        s_caPending &= ~(1UL << i);
+        if (st != HAL_OK)
+        {
+            s_caStats.lost++;
+            continue;
+        }
+
+        /* The previous frame left without a confirmation (SIL). */
+        if (s_caInFlight != CA_NONE)
+            s_caStats.unconfirmed++;
+        s_caInFlight = (uint8_t)i;
+        s_caFlightAt = s_caAlarms[i].atCycles;
+        ca_lat(&s_caStats.load, DWT->CYCCNT - s_caFlightAt);
+        return;
+    }
+}
+
+/** Alarm @p i went to @p active at @p at with @p value: send the edge. */
+static void ca_edge(uint32_t i, uint8_t active, float value, uint32_t at)
+{
+    CaAlarm_t     *a = &s_caAlarms[i];
+    CanSig_Alarm_t m =
+    {
+        .alarm_index  = (uint8_t)i,
+        .alarm_active = active,
+        .alarm_value  = value,
+    };
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    m.alarm_seq = (uint8_t)(s_caSeq++ & 0x0FU);
+    CanSig_Alarm_Pack(a->data, &m);
+    a->active   = active;
+    a->value    = value;
+    a->atCycles = at;
+    if (active != 0U)
+        a->raised++;
+
+    s_caStats.edges++;
+    if ((s_caPending & (1UL << i)) != 0U)
+        s_caStats.replaced++;
+    s_caPending |= 1UL << i;
+    ca_kick();
+    if ((s_caPending & (1UL << i)) != 0U)
+        s_caStats.waited++;
+    __set_PRIMASK(primask);
+}
+
+static void ca_lat_print(const char *what, const CanAlarm_Lat_t *l)
+{
+    CLI_IF_Printf("  %-17s %6lu frames, mean %4lu us, max %5lu us\r\n", what,
+                  (unsigned long)l->count,
+                  (unsigned long)((l->count != 0U) ? (l->sumUs / l->count) : 0U),
+                  (unsigned long)l->maxUs);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void alarm_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CanAlarm_Stats_t st;
+
+    CanAlarm_GetStats(&st);
+
+    CLI_IF_Printf("Alarms on 0x%03X, CAN1 mailbox %u:\r\n",
+                  (unsigned)CANSIG_ALARM_ID, (unsigned)CAN_IF_TX_URGENT_MAILBOX);
+    for (uint32_t i = 0U; i < CAN_ALARM_COUNT; ++i)
+    {
+        const CaDef_t *d = &s_caDefs[i];
+
+        CLI_IF_Printf("  %u %-11s %s %8.1f (hyst %.1f) %-6s %5lu raised, last %.1f  %s\r\n",
+                      (unsigned)i, d->name, (d->above != 0U) ? ">" : "<",
+                      (double)g_calValues[d->cal].f, (double)d->hyst,
+                      (s_caAlarms[i].active != 0U) ? "ACTIVE" : "-",
+                      (unsigned long)s_caAlarms[i].raised, (double)s_caAlarms[i].value, d->text);
+    }
+    CLI_IF_Printf("%lu edges: %lu waited for the mailbox, %lu replaced, %lu lost, "
+                  "%lu unconfirmed\r\n",
+                  (unsigned long)st.edges, (unsigned long)st.waited,
+                  (unsigned long)st.replaced, (unsigned long)st.lost,
+                  (unsigned long)st.unconfirmed);
+    ca_lat_print("detect -> mailbox", &st.load);
+    ca_lat_print("detect -> bus", &st.bus);
+}
+
+static void alarm_cmd_reset(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memset(&s_caStats, 0, sizeof(s_caStats));
+    for (uint32_t i = 0U; i < CAN_ALARM_COUNT; ++i)
+        s_caAlarms[i].raised = 0U;
+    __set_PRIMASK(primask);
+
+    CLI_IF_Print("Alarm counters cleared\r\n");
+}
+
+static const CliCommand_t s_caCmds[] =
+{
+    { "alarm",       "", 0U, alarm_cmd_show,  "threshold alarms: states, detect-to-bus latency" },
+    { "alarm reset", "", 0U, alarm_cmd_reset, "clear the alarm counters" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void CanAlarm_Init(void)
+{
+    CAN_IF_TxTemplateInit(&s_caTx, CANSIG_ALARM_ID, CANSIG_ALARM_DLC);
+    CLI_IF_REGISTER_TABLE(s_caCmds);
+}
+
+void CanAlarm_Check(const VehicleState_t *vs)
+{
+#define CA_CHECK_(name, field, dir, cal, hyst, text)                                   \
+    {                                                                                  \
+        CaAlarm_t *a   = &s_caAlarms[CAN_ALARM_##name];                                \
+        float      v   = (float)vs->field;                                             \
+        float      thr = CAL_F(cal);                                                   \
+        uint8_t    on  = ((dir) == CAN_ALARM_ABOVE) ? ((v > thr) ? 1U : 0U)             \
+                                                    : ((v < thr) ? 1U : 0U);            \
+        uint8_t    off = ((dir) == CAN_ALARM_ABOVE) ? ((v < (thr - (hyst))) ? 1U : 0U)  \
+                                                    : ((v > (thr + (hyst))) ? 1U : 0U); \
+        if ((a->active == 0U) ? (on != 0U) : (off != 0U))                              \
+            ca_edge(CAN_ALARM_##name, (uint8_t)(a->active ^ 1U), v, DWT->CYCCNT);       \
+    }
+    CAN_ALARM_TABLE(CA_CHECK_)
+#undef CA_CHECK_
+
+    /* A frame left pending on a taken mailbox, in case no TX interrupt
+     * follows (mailbox aborted, SIL). */
+    if (s_caPending != 0U)
+    {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        ca_kick();
+        __set_PRIMASK(primask);
+    }
+}
+
+void CanAlarm_OnTxDone(uint8_t ok)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s_caInFlight != CA_NONE)
+    {
+        if (ok != 0U)
+            ca_lat(&s_caStats.bus, DWT->CYCCNT - s_caFlightAt);
+        else
+            s_caStats.lost++;
+        s_caInFlight = CA_NONE;
+    }
+    ca_kick();
+    __set_PRIMASK(primask);
+}
+
+uint8_t CanAlarm_IsActive(CanAlarm_Id_t id)
+{
+    return (id < CAN_ALARM_COUNT) ? s_caAlarms[id].active : 0U;
+}
+
+void CanAlarm_GetStats(CanAlarm_Stats_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *out = s_caStats;
+    __set_PRIMASK(primask);
+}
+
+#else /* !CAN_ALARM_ENABLE */
+
+void CanAlarm_Init(void)
+{
+}
+
+void CanAlarm_Check(const VehicleState_t *vs)
+{
+    (void)vs;
+}
+
+void CanAlarm_OnTxDone(uint8_t ok)
+{
+    (void)ok;
+}
+
+uint8_t CanAlarm_IsActive(CanAlarm_Id_t id)
+{
+    (void)id;
+    return 0U;
+}
+
+void CanAlarm_GetStats(CanAlarm_Stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+}
+
+#endif /* CAN_ALARM_ENABLE */
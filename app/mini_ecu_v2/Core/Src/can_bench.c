@@ -0,0 +1,386 @@
+/**
+ * @file    can_bench.c
+ * @brief   CAN loopback self-benchmark and "bench can".
+ */
+
+#include "can_bench.h"
+#include "can_if.h"
+#include "can_filters.h"
+#include "can_stats.h"
+#include "cli_if.h"
+#include "log.h"
+#include "perf.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "fmt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/** Bits of an 8-byte standard data frame without stuff bits, with the
+ *  3-bit intermission. */
+#define BENCH_FRAME_BITS    111U
+
+/** Paced steps in % of the nominal frame rate; a flood step follows. */
+static const uint8_t s_benchSteps[] = { 10U, 25U, 50U, 75U, 90U, 100U };
+
+#define BENCH_STEP_COUNT    (sizeof(s_benchSteps) / sizeof(s_benchSteps[0]))
+
+/** How long a step waits for its last frames to come back (ms). */
+#define BENCH_DRAIN_MS      100U
+
+/** Written by the handler in CanRxTask, read by CliTask between steps. */
+typedef struct
+{
+    uint32_t received;
+    uint32_t lost;          /* sequence gaps */
+    uint32_t outOfOrder;    /* sequence numbers below the expected one */
+    uint32_t next;          /* expected sequence number */
+    uint32_t maxUs;
+    uint32_t hist[CAN_BENCH_BINS];
+} CanBench_Rx_t;
+
+/** One step's result. */
+typedef struct
+{
+    uint32_t target;        /* frames/s, 0 = flood */
+    uint32_t sent;
+    uint32_t busy;          /* refused by the full TX queue (paced steps) */
+    uint32_t rxPerSec;
+    uint32_t lost;
+    uint32_t outOfOrder;
+    uint32_t ringDrops;
+    uint32_t isrCycles;     /* per received frame, UINT32_MAX = not measured */
+    uint32_t p50, p90, p99; /* us */
+    uint32_t maxUs;
+    uint16_t cpuPermille;
+} CanBench_Step_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/** Tag of the step running, 0 = none (frames ignored). */
+static volatile uint8_t s_benchTag = 0U;
+static uint8_t          s_benchLastTag = 0U;
+static CanBench_Rx_t    s_benchRx;
+static uint32_t         s_benchStale = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** CanRxTask: a bench frame came back. */
+static void bench_on_frame(const CAN_IF_Msg_t *msg, void *ctx)
+{
+    (void)ctx;
+
+    uint32_t now = DWT->CYCCNT;
+    uint8_t  tag = s_benchTag;
+
+    if ((tag == 0U) || (CAN_IF_MSG_LEN(msg) != 8U) || (msg->Data[0] != tag))
+    {
+        s_benchStale++;
+        return;
+    }
+
+    CanBench_Rx_t *rx  = &s_benchRx;
+    uint32_t       seq = (uint32_t)msg->Data[1] | ((uint32_t)msg->Data[2] << 8) |
+                         ((uint32_t)msg->Data[3] << 16);
+
+    if (seq >= rx->next)
+    {
+        rx->lost += seq - rx->next;
+        rx->next  = seq + 1U;
+    }
+    else
+    {
+        rx->outOfOrder++;
+    }
+    rx->received++;
+
+    uint32_t stamp = (uint32_t)msg->Data[4] | ((uint32_t)msg->Data[5] << 8) |
+                     ((uint32_t)msg->Data[6] << 16) | ((uint32_t)msg->Data[7] << 24);
+    uint32_t cyclesPerUs = SystemCoreClock / 1000000U;
+    uint32_t us = (now - stamp) / ((cyclesPerUs != 0U) ? cyclesPerUs : 1U);
+    uint32_t b  = us / CAN_BENCH_BIN_US;
+
+    rx->hist[(b < CAN_BENCH_BINS) ? b : (CAN_BENCH_BINS - 1U)]++;
+    if (us > rx->maxUs)
+        rx->maxUs = us;
+}
+
+/** CliTask: one bench frame, stamped at the last moment. */
+static HAL_StatusTypeDef bench_send(uint8_t tag, uint32_t seq)
+{
+    uint8_t f[8];
+
+    f[0] = tag;
+    f[1] = (uint8_t)seq;
+    f[2] = (uint8_t)(seq >> 8);
+    f[3] = (uint8_t)(seq >> 16);
+
+    uint32_t stamp = DWT->CYCCNT;
+    f[4] = (uint8_t)stamp;
+    f[5] = (uint8_t)(stamp >> 8);
+    f[6] = (uint8_t)(stamp >> 16);
+    f[7] = (uint8_t)(stamp >> 24);
+
+    return CAN_IF_Transmit(CAN_BENCH_ID, f, 8U);
+}
+
+/** Latency below which @p permille of the samples lie (bin upper edge;
+ *  the overflow bin reports the maximum). */
+static uint32_t bench_percentile(const CanBench_Rx_t *rx, uint32_t permille)
+{
+    uint64_t want = ((uint64_t)rx->received * permille + 999U) / 1000U;
+    uint64_t seen = 0U;
+
+    for (uint32_t b = 0U; b < (CAN_BENCH_BINS - 1U); ++b)
+    {
+        seen += rx->hist[b];
+        if ((seen >= want) && (seen > 0U))
+        {
+            uint32_t edge = (b + 1U) * CAN_BENCH_BIN_US;
+            return (edge < rx->maxUs) ? edge : rx->maxUs;
+        }
+    }
+    return rx->maxUs;
+}
+
+/** Perf sum of the RX interrupt probe (0 without PERF_ENABLE). */
+static uint64_t bench_isr_cycles(void)
+{
+#if PERF_ENABLE
+    Perf_Stats_t st;
+    if (Perf_Get(PERF_CAN_RX_ISR, &st) == HAL_OK)
+        return st.sum;
+#endif
+    return 0U;
+}
+
+static uint32_t bench_ring_drops(void)
+{
+    CanRing_Stats_t st;
+    CanRing_t *ring = CAN_IF_GetRxRing();
+
+    if (ring == NULL)
+        return 0U;
+    CanRing_GetStats(ring, &st);
+    return st.overflows;
+}
+
+/**
+ * @brief Run one step: @p target frames/s for @p stepMs, 0 = flood.
+ */
+static void bench_run_step(uint32_t target, uint32_t stepMs, CanBench_Step_t *out)
+{
+    /* New tag, never 0; let CanRxTask finish the previous step's frames. */
+    s_benchTag = 0U;
+    osDelay(2U);
+    memset(&s_benchRx, 0, sizeof(s_benchRx));
+    s_benchLastTag = (uint8_t)((s_benchLastTag == 0xFFU) ? 1U : (s_benchLastTag + 1U));
+
+    CanStats_Summary_t st0;
+    (void)CanStats_Get(&st0, NULL, 0U);
+    uint32_t ring0  = bench_ring_drops();
+    uint64_t isr0   = bench_isr_cycles();
+    uint32_t idle0  = ulTaskGetIdleRunTimeCounter();
+    uint32_t cyc0   = DWT->CYCCNT;
+    uint32_t t0     = osKernelGetTickCount();
+    uint32_t sent   = 0U;
+    uint32_t busy   = 0U;
+
+    s_benchTag = s_benchLastTag;
+
+    for (;;)
+    {
+        uint32_t elapsed = osKernelGetTickCount() - t0;
+        if (elapsed >= stepMs)
+            break;
+
+        if (target == 0U)
+        {
+            /* Flood: fill the TX queue, come back next tick. */
+            while (bench_send(s_benchLastTag, sent) == HAL_OK)
+                sent++;
+        }
+        else
+        {
+            uint32_t due = (uint32_t)(((uint64_t)target * (elapsed + 1U)) / 1000U);
+            while (sent < due)
+            {
+                if (bench_send(s_benchLastTag, sent) == HAL_OK)
+                    sent++;
+                else
+                {
+                    /* The queue did not keep up: retried next tick. */
+                    busy++;
+                    break;
+                }
+            }
+        }
+        osDelay(1U);
+    }
+
+    uint32_t txEnd = osKernelGetTickCount();
+    uint32_t cyc1  = DWT->CYCCNT;
+    uint32_t idle1 = ulTaskGetIdleRunTimeCounter();
+
+    /* The last frames are still queued or on the wire. */
+    while (((s_benchRx.received + s_benchRx.lost) < sent) &&
+           ((osKernelGetTickCount() - txEnd) < BENCH_DRAIN_MS))
+        osDelay(1U);
+
+    uint32_t span = osKernelGetTickCount() - t0;
+    s_benchTag = 0U;
+    osDelay(2U);
+
+    CanStats_Summary_t st1;
+    (void)CanStats_Get(&st1, NULL, 0U);
+
+    /* Frames that never came back count as lost. */
+    if ((s_benchRx.received + s_benchRx.lost) < sent)
+        s_benchRx.lost = sent - s_benchRx.received;
+
+    uint32_t rxFrames = st1.rxFrames - st0.rxFrames;
+    uint64_t isr      = bench_isr_cycles() - isr0;
+    uint64_t wall     = (uint64_t)(txEnd - t0) * (SystemCoreClock / 1000U);
+    uint32_t busyCyc  = (cyc1 - cyc0) - (idle1 - idle0);
+
+    out->target      = target;
+    out->sent        = sent;
+    out->busy        = busy;
+    out->rxPerSec    = (span != 0U) ? (uint32_t)(((uint64_t)s_benchRx.received * 1000U) / span) : 0U;
+    out->lost        = s_benchRx.lost;
+    out->outOfOrder  = s_benchRx.outOfOrder;
+    out->ringDrops   = bench_ring_drops() - ring0;
+    out->isrCycles   = ((PERF_ENABLE != 0) && (rxFrames != 0U)) ? (uint32_t)(isr / rxFrames)
+                                                                : UINT32_MAX;
+    out->p50         = bench_percentile(&s_benchRx, 500U);
+    out->p90         = bench_percentile(&s_benchRx, 900U);
+    out->p99         = bench_percentile(&s_benchRx, 990U);
+    out->maxUs       = s_benchRx.maxUs;
+    out->cpuPermille = (wall != 0U) ? (uint16_t)(((uint64_t)busyCyc * 1000U) / wall) : 0U;
+    if (out->cpuPermille > 1000U)
+        out->cpuPermille = 1000U;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void bench_print_step(const CanBench_Step_t *s)
+{
+    char isr[12];
+
+    if (s->isrCycles == UINT32_MAX)
+        (void)strcpy(isr, "-");
+    else
+        (void)FMT_SNPRINTF(isr, sizeof(isr), "%lu", (unsigned long)s->isrCycles);
+
+    if (s->target == 0U)
+        CLI_IF_Print("  flood");
+    else
+        CLI_IF_Printf("%7lu", (unsigned long)s->target);
+
+    CLI_IF_Printf(" %7lu %5lu %7lu %6lu %5lu %5lu %6s %6lu %6lu %6lu %6lu %3u.%u\r\n",
+                  (unsigned long)s->sent, (unsigned long)s->busy,
+                  (unsigned long)s->rxPerSec, (unsigned long)s->lost,
+                  (unsigned long)s->outOfOrder, (unsigned long)s->ringDrops, isr,
+                  (unsigned long)s->p50, (unsigned long)s->p90, (unsigned long)s->p99,
+                  (unsigned long)s->maxUs,
+                  (unsigned)(s->cpuPermille / 10U), (unsigned)(s->cpuPermille % 10U));
+}
+
+/**
+ * @brief CLI: "bench can [<ms>]" - the step series, <ms> per step.
+ */
+static void bench_cmd_can(int argc, char *argv[])
+{
+    uint32_t stepMs = CAN_BENCH_STEP_MS;
+
+    if (argc > 0)
+    {
+        char *end;
+        stepMs = (uint32_t)strtoul(argv[0], &end, 10);
+        if ((*end != '\0') || (argc > 1) || (stepMs < 100U) || (stepMs > 10000U))
+        {
+            CLI_IF_Print("Usage: bench can [<ms per step, 100..10000>]\r\n");
+            return;
+        }
+    }
+
+    CanTiming_t t;
+    uint32_t    mode = CAN_IF_GetBitTiming(&t);
+
+    if ((mode & CAN_MODE_LOOPBACK) == 0U)
+    {
+        CLI_IF_Print("Needs a loopback mode (can mode silent-loopback).\r\n");
+        return;
+    }
+
+    uint32_t nominal = t.bitrate / BENCH_FRAME_BITS;
+
+    CLI_IF_Printf("CAN bench: %lu bit/s, %s, ID 0x%03lX, %lu ms per step, nominal %lu frames/s\r\n",
+                  (unsigned long)t.bitrate,
+                  ((mode & CAN_MODE_SILENT) != 0U) ? "silent-loopback" : "loopback",
+                  (unsigned long)CAN_BENCH_ID, (unsigned long)stepMs, (unsigned long)nominal);
+    CLI_IF_Print(" Target    Sent  Busy   Rx/s   Lost   OoO  Ring ISR cy"
+                 "  p50us  p90us  p99us  maxus  CPU%\r\n");
+
+    uint32_t        sustained = 0U;
+    uint8_t         failed    = 0U;
+    CanBench_Step_t s;
+
+    for (uint32_t i = 0U; i <= BENCH_STEP_COUNT; ++i)
+    {
+        uint32_t target = (i < BENCH_STEP_COUNT) ? ((nominal * s_benchSteps[i]) / 100U) : 0U;
+
+        bench_run_step(target, stepMs, &s);
+        bench_print_step(&s);
+
+        if (target == 0U)
+            break;
+        if ((s.busy == 0U) && (s.lost == 0U) && (s.outOfOrder == 0U) &&
+            (s.ringDrops == 0U) && (failed == 0U))
+        {
+            if (s.rxPerSec > sustained)
+                sustained = s.rxPerSec;
+        }
+        else
+        {
+            failed = 1U;
+        }
+    }
+
+    CLI_IF_Printf("Sustained %lu frames/s, saturation %lu frames/s, %lu stale frames\r\n",
+                  (unsigned long)sustained, (unsigned long)s.rxPerSec,
+                  (unsigned long)s_benchStale);
+}
+
+static const CliCommand_t s_benchCmds[] =
+{
+    { "bench can", "[<ms>]", 0U, bench_cmd_can,
+      "CAN loopback throughput, latency and CPU benchmark" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef CanBench_Init(void)
+{
+    if (CAN_IF_RegisterHandler(CAN_BENCH_ID, CAN_FILTER_STD_EXACT, bench_on_frame, NULL) != HAL_OK)
+        return HAL_ERROR;
+
+    if (CanFilters_Covers(0U, CAN_BENCH_ID, CAN_FILTER_STD_EXACT) == 0U)
+        LOG_WARN(CAN, "Bench ID 0x%03lX not in CAN_FILTER_TABLE", (unsigned long)CAN_BENCH_ID);
+
+    CLI_IF_REGISTER_TABLE(s_benchCmds);
+    return HAL_OK;
+}
@@ -0,0 +1,261 @@
+/**
+ * @file    can_busoff.c
+ * @brief   Bus-off recovery state machine and "can busoff".
+ */
+
+#include "can_busoff.h"
+#include "can_if.h"
+#include "cli_if.h"
+#include "log.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    BUSOFF_IDLE = 0,    /* on the bus */
+    BUSOFF_BACKOFF,     /* waiting to restart at s_boNext */
+    BUSOFF_VERIFY       /* restarted, checking ESR at s_boNext */
+} CanBusOff_Step_t;
+
+/** Recessive bits bxCAN must see to leave bus-off (128 x 11). */
+#define BUSOFF_RECOVERY_BITS    1408U
+
+/** "a is at or after b" on a wrapping millisecond counter. */
+#define BUSOFF_REACHED(a, b)    ((int32_t)((a) - (b)) >= 0)
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Set by the bus-off interrupt, taken by CanTxTask under PRIMASK. */
+static volatile uint8_t  s_boPending  = 0U;
+static volatile uint32_t s_boPendTick = 0U;     /* HAL tick of the interrupt */
+
+/* CanTxTask only, apart from s_boStep, which anyone may read. */
+static volatile uint8_t  s_boStep     = BUSOFF_IDLE;
+static uint32_t          s_boNext     = 0U;     /* kernel tick of the next step */
+static uint32_t          s_boAttempt  = 0U;     /* attempts in this episode */
+static uint32_t          s_boDownTick = 0U;     /* HAL tick the episode began */
+static uint32_t          s_boUpTick   = 0U;     /* HAL tick of the last recovery */
+static uint8_t           s_boEverUp   = 0U;
+static osThreadId_t      s_boThread   = NULL;
+
+/* Written by CanTxTask, copied by the CLI; guarded by PRIMASK. */
+static CanBusOff_Stats_t s_boStats;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t busoff_backoff(uint32_t attempt)
+{
+    return (attempt < CAN_BUSOFF_FAST_RETRIES) ? CAN_BUSOFF_FAST_MS : CAN_BUSOFF_SLOW_MS;
+}
+
+/** Time the controller needs after a restart before ESR can show recovery. */
+static uint32_t busoff_verify_ms(void)
+{
+    CanTiming_t t;
+    (void)CAN_IF_GetBitTiming(&t);
+
+    if (t.bitrate == 0U)
+        return CAN_BUSOFF_FAST_MS;
+
+    /* Rounded up, plus one tick so a partial tick cannot cut it short. */
+    return ((BUSOFF_RECOVERY_BITS * 1000U) + t.bitrate - 1U) / t.bitrate + 1U;
+}
+
+/** Count a failed restart and wait for the next one. */
+static void busoff_retry(uint32_t nowMs)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_boStats.failed++;
+    __set_PRIMASK(primask);
+
+    s_boAttempt++;
+    s_boNext = nowMs + busoff_backoff(s_boAttempt);
+    s_boStep = BUSOFF_BACKOFF;
+}
+
+static void busoff_restart(uint32_t nowMs)
+{
+    uint32_t flushed = 0U;
+    HAL_StatusTypeDef status = CAN_IF_Restart(CAN_BUSOFF_FLUSH_TXQ, &flushed);
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_boStats.attempts++;
+    s_boStats.flushed += flushed;
+    __set_PRIMASK(primask);
+
+    if (status != HAL_OK)
+    {
+        busoff_retry(nowMs);
+        return;
+    }
+
+    s_boNext = nowMs + busoff_verify_ms();
+    s_boStep = BUSOFF_VERIFY;
+}
+
+static void busoff_recovered(void)
+{
+    uint32_t now  = HAL_GetTick();
+    uint32_t down = now - s_boDownTick;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_boStats.recoveries++;
+    s_boStats.lastDowntimeMs   = down;
+    s_boStats.totalDowntimeMs += down;
+    if (down > s_boStats.maxDowntimeMs)
+        s_boStats.maxDowntimeMs = down;
+    __set_PRIMASK(primask);
+
+    LOG_INFO(CAN, "Bus-off recovered after %lu ms, %lu restart(s)",
+             (unsigned long)down, (unsigned long)(s_boAttempt + 1U));
+
+    s_boUpTick = now;
+    s_boEverUp = 1U;
+    s_boStep   = BUSOFF_IDLE;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void busoff_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CanBusOff_Stats_t st;
+    CanBusOff_GetStats(&st);
+
+    if (st.downNowMs != 0U)
+        CLI_IF_Printf("BUS-OFF for %lu ms, recovering\r\n", (unsigned long)st.downNowMs);
+    else
+        CLI_IF_Print("On the bus\r\n");
+
+    CLI_IF_Printf("Episodes %lu, recovered %lu, restarts %lu (failed %lu), "
+                  "TX frames flushed %lu\r\n",
+                  (unsigned long)st.events, (unsigned long)st.recoveries,
+                  (unsigned long)st.attempts, (unsigned long)st.failed,
+                  (unsigned long)st.flushed);
+    CLI_IF_Printf("Downtime: last %lu ms, max %lu ms, total %lu ms\r\n",
+                  (unsigned long)st.lastDowntimeMs, (unsigned long)st.maxDowntimeMs,
+                  (unsigned long)st.totalDowntimeMs);
+    CLI_IF_Printf("Policy: %u x %u ms, then every %u ms; TX queue %s\r\n",
+                  (unsigned)CAN_BUSOFF_FAST_RETRIES, (unsigned)CAN_BUSOFF_FAST_MS,
+                  (unsigned)CAN_BUSOFF_SLOW_MS,
+                  (CAN_BUSOFF_FLUSH_TXQ != 0U) ? "flushed" : "kept");
+}
+
+static const CliCommand_t s_boCmds[] =
+{
+    { "can busoff", "", 0U, busoff_cmd_show, "bus-off recovery state and downtime" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void CanBusOff_Init(void)
+{
+    s_boPending = 0U;
+    s_boStep    = BUSOFF_IDLE;
+    s_boAttempt = 0U;
+    s_boEverUp  = 0U;
+    memset(&s_boStats, 0, sizeof(s_boStats));
+
+    CLI_IF_REGISTER_TABLE(s_boCmds);
+}
+
+void CanBusOff_SetConsumer(osThreadId_t thread)
+{
+    s_boThread = thread;
+}
+
+void CanBusOff_OnBusOff(void)
+{
+    /* HAL reports BOF on every error interrupt while the flag is set;
+     * only the first one of an episode counts. */
+    if ((s_boPending != 0U) || (s_boStep != BUSOFF_IDLE))
+        return;
+
+    s_boPendTick = HAL_GetTick();
+    s_boPending  = 1U;
+
+    if (s_boThread != NULL)
+        (void)osThreadFlagsSet(s_boThread, CAN_BUSOFF_FLAG);
+}
+
+uint32_t CanBusOff_Run(uint32_t nowMs)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t  pending = s_boPending;
+    uint32_t tick    = s_boPendTick;
+    s_boPending = 0U;
+    __set_PRIMASK(primask);
+
+    if ((pending != 0U) && (s_boStep == BUSOFF_IDLE))
+    {
+        /* Soon after the last recovery: the bus is still bad, carry on
+         * with the retry count instead of hammering it with fast ones. */
+        if ((s_boEverUp == 0U) || ((tick - s_boUpTick) >= CAN_BUSOFF_STABLE_MS))
+            s_boAttempt = 0U;
+        else
+            s_boAttempt++;
+
+        s_boDownTick = tick;
+        s_boNext     = nowMs + busoff_backoff(s_boAttempt);
+        s_boStep     = BUSOFF_BACKOFF;
+
+        primask = __get_PRIMASK();
+        __disable_irq();
+        s_boStats.events++;
+        __set_PRIMASK(primask);
+
+        LOG_WARN(CAN, "Bus-off, restart in %lu ms", (unsigned long)(s_boNext - nowMs));
+    }
+
+    if ((s_boStep == BUSOFF_BACKOFF) && BUSOFF_REACHED(nowMs, s_boNext))
+    {
+        busoff_restart(nowMs);
+    }
+    else if ((s_boStep == BUSOFF_VERIFY) && BUSOFF_REACHED(nowMs, s_boNext))
+    {
+        if (CAN_IF_IsBusOff() == 0U)
+            busoff_recovered();
+        else
+            busoff_retry(nowMs);
+    }
+
+    if (s_boStep == BUSOFF_IDLE)
+        return osWaitForever;
+
+    return BUSOFF_REACHED(nowMs, s_boNext) ? 0U : (s_boNext - nowMs);
+}
+
+uint8_t CanBusOff_IsActive(void)
+{
+    return ((s_boStep != BUSOFF_IDLE) || (s_boPending != 0U)) ? 1U : 0U;
+}
+
+void CanBusOff_GetStats(CanBusOff_Stats_t *stats)
+{
+    if (stats == NULL)
+        return;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *stats = s_boStats;
+    __set_PRIMASK(primask);
+
+    stats->downNowMs = (s_boStep != BUSOFF_IDLE) ? (HAL_GetTick() - s_boDownTick) : 0U;
+}
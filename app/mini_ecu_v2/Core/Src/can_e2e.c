@@ -0,0 +1,256 @@
+/**
+ * @file    can_e2e.c
+ * @brief   CRC8 and alive counter of the protected CAN frames, "can e2e".
+ */
+
+#include "can_e2e.h"
+#include "can_if.h"
+#include "cli_if.h"
+#include "ramfunc.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    uint32_t key;
+    uint8_t  dlc;
+    uint16_t dataId;
+} CanE2E_Def_t;
+
+#define CAN_E2E_DEF_(name, id, dlc, dataId)   { (id), (dlc), (dataId) },
+static const CanE2E_Def_t s_e2eDefs[CAN_E2E_COUNT] = { CAN_E2E_TABLE(CAN_E2E_DEF_) };
+
+#define CAN_E2E_NAME_(name, id, dlc, dataId)  #name,
+static const char *const s_e2eNames[CAN_E2E_COUNT] = { CAN_E2E_TABLE(CAN_E2E_NAME_) };
+
+#define CAN_E2E_DLC_OK_(name, id, dlc, dataId) && ((dlc) >= 3U) && ((dlc) <= 8U)
+_Static_assert(1 CAN_E2E_TABLE(CAN_E2E_DLC_OK_), "an E2E frame needs 3..8 bytes");
+_Static_assert(CAN_E2E_COUNT < CAN_E2E_NONE, "too many E2E frames");
+_Static_assert(CAN_E2E_MAX_DELTA <= CAN_E2E_COUNTER_MAX, "CAN_E2E_MAX_DELTA above the counter range");
+
+/* CRC8 SAE J1850, polynomial 0x1D, MSB first: s_e2eCrc[x] = x * 0x1D. */
+static const uint8_t s_e2eCrc[256] =
+{
+    0x00U, 0x1DU, 0x3AU, 0x27U, 0x74U, 0x69U, 0x4EU, 0x53U, 0xE8U, 0xF5U, 0xD2U, 0xCFU,
+    0x9CU, 0x81U, 0xA6U, 0xBBU, 0xCDU, 0xD0U, 0xF7U, 0xEAU, 0xB9U, 0xA4U, 0x83U, 0x9EU,
+    0x25U, 0x38U, 0x1FU, 0x02U, 0x51U, 0x4CU, 0x6BU, 0x76U, 0x87U, 0x9AU, 0xBDU, 0xA0U,
+    0xF3U, 0xEEU, 0xC9U, 0xD4U, 0x6FU, 0x72U, 0x55U, 0x48U, 0x1BU, 0x06U, 0x21U, 0x3CU,
+    0x4AU, 0x57U, 0x70U, 0x6DU, 0x3EU, 0x23U, 0x04U, 0x19U, 0xA2U, 0xBFU, 0x98U, 0x85U,
+    0xD6U, 0xCBU, 0xECU, 0xF1U, 0x13U, 0x0EU, 0x29U, 0x34U, 0x67U, 0x7AU, 0x5DU, 0x40U,
+    0xFBU, 0xE6U, 0xC1U, 0xDCU, 0x8FU, 0x92U, 0xB5U, 0xA8U, 0xDEU, 0xC3U, 0xE4U, 0xF9U,
+    0xAAU, 0xB7U, 0x90U, 0x8DU, 0x36U, 0x2BU, 0x0CU, 0x11U, 0x42U, 0x5FU, 0x78U, 0x65U,
+    0x94U, 0x89U, 0xAEU, 0xB3U, 0xE0U, 0xFDU, 0xDAU, 0xC7U, 0x7CU, 0x61U, 0x46U, 0x5BU,
+    0x08U, 0x15U, 0x32U, 0x2FU, 0x59U, 0x44U, 0x63U, 0x7EU, 0x2DU, 0x30U, 0x17U, 0x0AU,
+    0xB1U, 0xACU, 0x8BU, 0x96U, 0xC5U, 0xD8U, 0xFFU, 0xE2U, 0x26U, 0x3BU, 0x1CU, 0x01U,
+    0x52U, 0x4FU, 0x68U, 0x75U, 0xCEU, 0xD3U, 0xF4U, 0xE9U, 0xBAU, 0xA7U, 0x80U, 0x9DU,
+    0xEBU, 0xF6U, 0xD1U, 0xCCU, 0x9FU, 0x82U, 0xA5U, 0xB8U, 0x03U, 0x1EU, 0x39U, 0x24U,
+    0x77U, 0x6AU, 0x4DU, 0x50U, 0xA1U, 0xBCU, 0x9BU, 0x86U, 0xD5U, 0xC8U, 0xEFU, 0xF2U,
+    0x49U, 0x54U, 0x73U, 0x6EU, 0x3DU, 0x20U, 0x07U, 0x1AU, 0x6CU, 0x71U, 0x56U, 0x4BU,
+    0x18U, 0x05U, 0x22U, 0x3FU, 0x84U, 0x99U, 0xBEU, 0xA3U, 0xF0U, 0xEDU, 0xCAU, 0xD7U,
+    0x35U, 0x28U, 0x0FU, 0x12U, 0x41U, 0x5CU, 0x7BU, 0x66U, 0xDDU, 0xC0U, 0xE7U, 0xFAU,
+    0xA9U, 0xB4U, 0x93U, 0x8EU, 0xF8U, 0xE5U, 0xC2U, 0xDFU, 0x8CU, 0x91U, 0xB6U, 0xABU,
+    0x10U, 0x0DU, 0x2AU, 0x37U, 0x64U, 0x79U, 0x5EU, 0x43U, 0xB2U, 0xAFU, 0x88U, 0x95U,
+    0xC6U, 0xDBU, 0xFCU, 0xE1U, 0x5AU, 0x47U, 0x60U, 0x7DU, 0x2EU, 0x33U, 0x14U, 0x09U,
+    0x7FU, 0x62U, 0x45U, 0x58U, 0x0BU, 0x16U, 0x31U, 0x2CU, 0x97U, 0x8AU, 0xADU, 0xB0U,
+    0xE3U, 0xFEU, 0xD9U, 0xC4U
+};
+
+typedef struct
+{
+    uint8_t        txCounter;
+    uint8_t        rxCounter;
+    uint8_t        rxSynced;
+    CanE2E_Stats_t stats;
+} CanE2E_State_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* TX fields under PRIMASK (CAN_IF_TransmitBus(), any task); RX fields in
+ * CanRxTask, or the RX interrupt for an ISR-decoded ID (CAN_IF_ISR_DECODERS),
+ * read by "can e2e" under PRIMASK. */
+static CanE2E_State_t s_e2eState[CAN_E2E_COUNT];
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** CRC of the data ID and @p data[0 .. n - 1]. */
+RAMFUNC static uint8_t e2e_crc(uint16_t dataId, const uint8_t *data, uint32_t n)
+{
+    uint8_t crc = 0xFFU;
+
+    crc = s_e2eCrc[crc ^ (uint8_t)dataId];
+    crc = s_e2eCrc[crc ^ (uint8_t)(dataId >> 8)];
+    for (uint32_t i = 0U; i < n; ++i)
+        crc = s_e2eCrc[crc ^ data[i]];
+
+    return (uint8_t)(crc ^ 0xFFU);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void e2e_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CLI_IF_Print("ID     name            sent   received     lost repeated  wrongseq   failed\r\n");
+    for (uint8_t e = 0U; e < CAN_E2E_COUNT; ++e)
+    {
+        CanE2E_Stats_t st;
+        uint32_t       key = s_e2eDefs[e].key;
+
+        (void)CanE2E_GetStats(e, &st);
+        CLI_IF_Printf("0x%0*lX %-10s %9lu %10lu %8lu %8lu %9lu %8lu\r\n",
+                      ((key & CAN_IF_ID_EXT) != 0U) ? 8 : 3,
+                      (unsigned long)(key & 0x1FFFFFFFU), s_e2eNames[e],
+                      (unsigned long)st.sent, (unsigned long)st.received, (unsigned long)st.lost,
+                      (unsigned long)st.repeated, (unsigned long)st.wrongSeq,
+                      (unsigned long)st.errors);
+    }
+}
+
+static void e2e_cmd_reset(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint32_t e = 0U; e < CAN_E2E_COUNT; ++e)
+    {
+        CanE2E_State_t *s = &s_e2eState[e];
+        uint32_t        sent = s->stats.sent;
+
+        memset(&s->stats, 0, sizeof(s->stats));
+        s->stats.sent = sent;
+        s->rxSynced   = 0U;
+    }
+    __set_PRIMASK(primask);
+
+    CLI_IF_Print("E2E RX figures cleared.\r\n");
+}
+
+static const CliCommand_t s_e2eCmds[] =
+{
+    { "can e2e",       "", 0U, e2e_cmd_show,  "per-ID E2E counters: lost, repeated, failed" },
+    { "can e2e reset", "", 0U, e2e_cmd_reset, "clear the E2E RX counters, resynchronise" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void CanE2E_Init(void)
+{
+    memset(s_e2eState, 0, sizeof(s_e2eState));
+    CLI_IF_REGISTER_TABLE(s_e2eCmds);
+}
+
+RAMFUNC uint8_t CanE2E_Find(uint32_t key)
+{
+    for (uint8_t e = 0U; e < CAN_E2E_COUNT; ++e)
+    {
+        if (s_e2eDefs[e].key == key)
+            return e;
+    }
+    return CAN_E2E_NONE;
+}
+
+uint8_t CanE2E_Protect(uint8_t e, uint8_t *data, uint8_t dlc)
+{
+    const CanE2E_Def_t *d = &s_e2eDefs[e];
+    uint32_t            n = (uint32_t)d->dlc - 1U;
+
+    if (dlc < d->dlc)
+        return 0U;
+
+    data[n - 1U] = (uint8_t)((data[n - 1U] & 0xF0U) | s_e2eState[e].txCounter);
+    data[n]      = e2e_crc(d->dataId, data, n);
+    return 1U;
+}
+
+void CanE2E_Sent(uint8_t e)
+{
+    CanE2E_State_t *s = &s_e2eState[e];
+
+    s->txCounter = (s->txCounter >= CAN_E2E_COUNTER_MAX) ? 0U : (uint8_t)(s->txCounter + 1U);
+    s->stats.sent++;
+}
+
+RAMFUNC CanE2E_Result_t CanE2E_Check(uint8_t e, const uint8_t *data, uint8_t dlc)
+{
+    const CanE2E_Def_t *d = &s_e2eDefs[e];
+    CanE2E_State_t     *s = &s_e2eState[e];
+    uint32_t            n = (uint32_t)d->dlc - 1U;
+    uint8_t             counter = (uint8_t)(data[n - 1U] & 0x0FU);
+    CanE2E_Result_t     r       = CAN_E2E_OK;
+
+    uint8_t bad = ((dlc < d->dlc) || (counter > CAN_E2E_COUNTER_MAX) ||
+                   (data[n] != e2e_crc(d->dataId, data, n))) ? 1U : 0U;
+
+    /* "can e2e reset" runs in CliTask. */
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint32_t delta = ((uint32_t)counter + (CAN_E2E_COUNTER_MAX + 1U) - s->rxCounter) %
+                     (CAN_E2E_COUNTER_MAX + 1U);
+
+    if (bad != 0U)
+    {
+        s->stats.errors++;
+        r = CAN_E2E_ERROR;
+    }
+    else if (s->rxSynced == 0U)
+    {
+        r = CAN_E2E_OK;
+    }
+    else if (delta == 0U)
+    {
+        s->stats.repeated++;
+        r = CAN_E2E_REPEATED;
+    }
+    else if (delta == 1U)
+    {
+        r = CAN_E2E_OK;
+    }
+    else if (delta <= CAN_E2E_MAX_DELTA)
+    {
+        s->stats.lost += delta - 1U;
+        r = CAN_E2E_LOST;
+    }
+    else
+    {
+        s->stats.wrongSeq++;
+        r = CAN_E2E_WRONG_SEQ;
+    }
+
+    if (r <= CAN_E2E_WRONG_SEQ)
+    {
+        s->rxCounter = counter;
+        s->rxSynced  = 1U;
+        s->stats.received++;
+    }
+
+    __set_PRIMASK(primask);
+    return r;
+}
+
+HAL_StatusTypeDef CanE2E_GetStats(uint8_t e, CanE2E_Stats_t *out)
+{
+    if ((e >= CAN_E2E_COUNT) || (out == NULL))
+        return HAL_ERROR;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *out = s_e2eState[e].stats;
+    __set_PRIMASK(primask);
+    return HAL_OK;
+}
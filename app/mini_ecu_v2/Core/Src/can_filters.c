@@ -0,0 +1,491 @@
+/**
+ * @file    can_filters.c
+ * @brief   Packs the declarative CAN_FILTER_TABLE into bxCAN filter banks.
+ *
+ * Packing works per class (identifier kind x match kind x FIFO). Every
+ * entry is converted into one, two or four 16-bit register halves; four
+ * halves fill one bank. A partially filled bank is padded by repeating its
+ * last entry, which is harmless because a duplicate ID or ID/mask pair
+ * does not widen what the bank accepts.
+ *
+ * While packing, the filter match index (FMI) of every bank slot is
+ * recorded so received frames can be traced back to their table entry.
+ * FMIs are numbered per FIFO in bank order; a bank contributes one number
+ * per entry it holds (4, 2, 2 or 1 depending on its layout).
+ *
+ * Half-word order, matching HAL_CAN_ConfigFilter():
+ *   16-bit scale: IdLow, MaskIdLow, IdHigh, MaskIdHigh
+ *   32-bit scale: IdHigh, IdLow, MaskIdHigh, MaskIdLow
+ *
+ * The register image of every table bank is kept, so an entry can be
+ * muted while the controller runs (CanFilters_SetMuted()): its slots are
+ * overwritten with a copy of another entry of the same bank, or the bank
+ * is deactivated if it holds nothing else. Filter values may be changed
+ * with the bank deactivated (FA1R), without initialization mode.
+ */
+
+#include "can_filters.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/** Filter register bits below the identifier fields. */
+#define CANF_STD_SHIFT        5U
+#define CANF_STD_IDE          0x0008U
+#define CANF_STD_RTR          0x0010U
+#define CANF_EXT_SHIFT        3U
+#define CANF_EXT_IDE          0x00000004U
+#define CANF_EXT_RTR          0x00000002U
+
+#define CANF_ENTRY_STD(arg, id, mask, fifo) \
+    { (uint32_t)(id), (uint32_t)(mask), (uint8_t)(fifo), 0U },
+#define CANF_ENTRY_EXT(arg, id, mask, fifo) \
+    { (uint32_t)(id), (uint32_t)(mask), (uint8_t)(fifo), 1U },
+
+/** Runtime copy of the acceptance table (flash-resident). */
+static const CanFilter_Entry_t s_filterTable[] =
+{
+    CAN_FILTER_TABLE(CANF_ENTRY_STD, CANF_ENTRY_EXT, 0)
+};
+
+#define CANF_TABLE_LEN  (sizeof(s_filterTable) / sizeof(s_filterTable[0]))
+
+/** Marker for an FMI that does not map to a table entry. */
+#define CANF_NO_ENTRY   0xFFU
+
+_Static_assert(CANF_TABLE_LEN < CANF_NO_ENTRY, "CAN_FILTER_TABLE too long for FMI map");
+
+/** FMI -> table entry, per FIFO. Filled by CanFilters_Apply(). */
+static uint8_t  s_fmiEntry[2][CAN_FILTERS_MAX_FMI];
+
+/** Next free FMI per FIFO while packing. */
+static uint32_t s_fmiNext[2];
+
+_Static_assert(CANF_TABLE_LEN <= 32U, "CAN_FILTER_TABLE too long for the mute mask");
+
+/**
+ * Table banks as programmed: FR1/FR2 as half-words (FR1[15:0] first), the
+ * entry of each slot and the slot count (0 = not a table bank).
+ */
+static uint16_t s_bankImage[CAN_FILTERS_MAX_BANKS][4];
+static uint8_t  s_bankEntry[CAN_FILTERS_MAX_BANKS][4];
+static uint8_t  s_bankSlots[CAN_FILTERS_MAX_BANKS];
+
+/** Muted table entries, bit per entry. Cleared by every apply. */
+static uint32_t s_muted;
+
+/** One packing class: all entries sharing a bank layout and FIFO. */
+typedef struct
+{
+    uint8_t ext;     /**< 1 = 29-bit identifiers. */
+    uint8_t exact;   /**< 1 = list mode, 0 = mask mode. */
+} CanFilter_Class_t;
+
+/* List classes first: for equal scale the hardware prefers list matches,
+ * keeping them in low banks also keeps their match indices small. */
+static const CanFilter_Class_t s_classes[] =
+{
+    { 0U, 1U },   /* 16-bit list */
+    { 0U, 0U },   /* 16-bit mask */
+    { 1U, 1U },   /* 32-bit list */
+    { 1U, 0U },   /* 32-bit mask */
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t canf_is_exact(const CanFilter_Entry_t *e)
+{
+    uint32_t full = (e->ext != 0U) ? CAN_FILTER_EXT_EXACT : CAN_FILTER_STD_EXACT;
+    return ((e->mask & full) == full) ? 1U : 0U;
+}
+
+/**
+ * @brief Convert one entry into register half-words.
+ *
+ * @return Number of half-words written (1, 2 or 4).
+ */
+static uint32_t canf_encode(const CanFilter_Entry_t *e, uint16_t out[4])
+{
+    if (e->ext == 0U)
+    {
+        out[0] = (uint16_t)((e->id & 0x7FFU) << CANF_STD_SHIFT);
+        if (canf_is_exact(e))
+            return 1U;
+
+        out[1] = (uint16_t)(((e->mask & 0x7FFU) << CANF_STD_SHIFT) |
+                            CANF_STD_IDE | CANF_STD_RTR);
+        return 2U;
+    }
+
+    uint32_t id = ((e->id & 0x1FFFFFFFU) << CANF_EXT_SHIFT) | CANF_EXT_IDE;
+    out[0] = (uint16_t)(id >> 16);
+    out[1] = (uint16_t)(id & 0xFFFFU);
+    if (canf_is_exact(e))
+        return 2U;
+
+    uint32_t mask = ((e->mask & 0x1FFFFFFFU) << CANF_EXT_SHIFT) |
+                    CANF_EXT_IDE | CANF_EXT_RTR;
+    out[2] = (uint16_t)(mask >> 16);
+    out[3] = (uint16_t)(mask & 0xFFFFU);
+    return 4U;
+}
+
+/**
+ * @brief Write one bank and record the FMIs of its slots.
+ *
+ * @param[in] slots    Table entry of each slot (CANF_NO_ENTRY if none).
+ * @param[in] nSlots   Entries held by this bank layout (4, 2 or 1).
+ */
+static HAL_StatusTypeDef canf_write_bank(CAN_HandleTypeDef *hcan, uint32_t bank,
+                                         const CanFilter_Class_t *cls,
+                                         uint32_t fifo, const uint16_t v[4],
+                                         const uint8_t slots[4], uint32_t nSlots)
+{
+    for (uint32_t j = 0U; j < nSlots; ++j)
+    {
+        uint32_t fmi = s_fmiNext[fifo]++;
+        if (fmi < CAN_FILTERS_MAX_FMI)
+            s_fmiEntry[fifo][fmi] = slots[j];
+    }
+
+    if (bank < CAN_FILTERS_MAX_BANKS)
+    {
+        uint16_t *img = s_bankImage[bank];
+
+        /* FR1 = IdLow | MaskIdLow << 16 (16-bit), IdHigh << 16 | IdLow (32-bit). */
+        img[0] = (cls->ext == 0U) ? v[0] : v[1];
+        img[1] = (cls->ext == 0U) ? v[1] : v[0];
+        img[2] = (cls->ext == 0U) ? v[2] : v[3];
+        img[3] = (cls->ext == 0U) ? v[3] : v[2];
+        memcpy(s_bankEntry[bank], slots, nSlots);
+        s_bankSlots[bank] = (uint8_t)nSlots;
+    }
+
+    CAN_FilterTypeDef cfg;
+    memset(&cfg, 0, sizeof(cfg));
+
+    cfg.FilterBank           = bank;
+    cfg.FilterMode           = (cls->exact != 0U) ? CAN_FILTERMODE_IDLIST
+                                                  : CAN_FILTERMODE_IDMASK;
+    cfg.FilterFIFOAssignment = fifo;
+    cfg.FilterActivation     = ENABLE;
+    cfg.SlaveStartFilterBank = CAN_FILTERS_SLAVE_START_BANK;
+
+    if (cls->ext == 0U)
+    {
+        cfg.FilterScale      = CAN_FILTERSCALE_16BIT;
+        cfg.FilterIdLow      = v[0];
+        cfg.FilterMaskIdLow  = v[1];
+        cfg.FilterIdHigh     = v[2];
+        cfg.FilterMaskIdHigh = v[3];
+    }
+    else
+    {
+        cfg.FilterScale      = CAN_FILTERSCALE_32BIT;
+        cfg.FilterIdHigh     = v[0];
+        cfg.FilterIdLow      = v[1];
+        cfg.FilterMaskIdHigh = v[2];
+        cfg.FilterMaskIdLow  = v[3];
+    }
+
+    return HAL_CAN_ConfigFilter(hcan, &cfg);
+}
+
+/**
+ * @brief Write a table bank with its muted entries taken out.
+ *
+ * Each muted slot gets the half-words of the first unmuted one; with none
+ * left the bank stays deactivated. CAN1 keeps running: frames that arrive
+ * during the few cycles the bank is off are not accepted by it.
+ */
+static void canf_commit_bank(CAN_HandleTypeDef *hcan, uint32_t bank)
+{
+    uint32_t nSlots = s_bankSlots[bank];
+    uint32_t w      = 4U / nSlots;          /* half-words per slot */
+    uint16_t img[4];
+    int32_t  donor  = -1;
+
+    memcpy(img, s_bankImage[bank], sizeof(img));
+
+    for (uint32_t j = 0U; (j < nSlots) && (donor < 0); ++j)
+    {
+        uint8_t e = s_bankEntry[bank][j];
+        if ((e != CANF_NO_ENTRY) && ((s_muted & (1UL << e)) == 0U))
+            donor = (int32_t)j;
+    }
+
+    for (uint32_t j = 0U; (donor >= 0) && (j < nSlots); ++j)
+    {
+        uint8_t e = s_bankEntry[bank][j];
+        if ((e != CANF_NO_ENTRY) && ((s_muted & (1UL << e)) != 0U))
+            memcpy(&img[j * w], &s_bankImage[bank][(uint32_t)donor * w], w * sizeof(uint16_t));
+    }
+
+    CAN_TypeDef *can = hcan->Instance;   /* CAN1: it owns the filter registers */
+    uint32_t     bit = 1UL << bank;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    can->FA1R &= ~bit;
+    if (donor >= 0)
+    {
+        can->sFilterRegister[bank].FR1 = (uint32_t)img[0] | ((uint32_t)img[1] << 16);
+        can->sFilterRegister[bank].FR2 = (uint32_t)img[2] | ((uint32_t)img[3] << 16);
+        can->FA1R |= bit;
+    }
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief Pack all entries of one class/FIFO into consecutive banks.
+ *
+ * @param[in,out] bank Next free bank; advanced past the banks written.
+ */
+static HAL_StatusTypeDef canf_pack_class(CAN_HandleTypeDef *hcan,
+                                         const CanFilter_Class_t *cls,
+                                         uint32_t fifo, uint32_t *bank)
+{
+    uint16_t v[4];
+    uint16_t last[4];
+    uint8_t  slots[4];
+    uint32_t fill = 0U;
+    uint32_t lastLen = 0U;
+    uint8_t  lastEntry = CANF_NO_ENTRY;
+
+    for (uint32_t i = 0U; i < CANF_TABLE_LEN; ++i)
+    {
+        const CanFilter_Entry_t *e = &s_filterTable[i];
+
+        if ((e->ext != cls->ext) || (e->fifo != fifo) ||
+            (canf_is_exact(e) != cls->exact))
+            continue;
+
+        lastLen   = canf_encode(e, last);
+        lastEntry = (uint8_t)i;
+        slots[fill / lastLen] = lastEntry;
+        for (uint32_t k = 0U; k < lastLen; ++k)
+            v[fill++] = last[k];
+
+        if (fill == 4U)
+        {
+            HAL_StatusTypeDef st = canf_write_bank(hcan, (*bank)++, cls, fifo,
+                                                   v, slots, 4U / lastLen);
+            if (st != HAL_OK)
+                return st;
+            fill = 0U;
+        }
+    }
+
+    if (fill > 0U)
+    {
+        /* Pad with copies of the last entry. */
+        while (fill < 4U)
+        {
+            slots[fill / lastLen] = lastEntry;
+            for (uint32_t k = 0U; (k < lastLen) && (fill < 4U); ++k)
+                v[fill++] = last[k];
+        }
+        return canf_write_bank(hcan, (*bank)++, cls, fifo,
+                               v, slots, 4U / lastLen);
+    }
+
+    return HAL_OK;
+}
+
+/**
+ * @brief Program the banks: the table (if @p table), then a catch-all
+ *        bank (if @p catchAll); the rest are deactivated.
+ */
+static HAL_StatusTypeDef canf_apply(CAN_HandleTypeDef *hcan, uint8_t table, uint8_t catchAll)
+{
+    uint32_t bank = 0U;
+    HAL_StatusTypeDef st = HAL_OK;
+
+    if (hcan == NULL)
+        return HAL_ERROR;
+
+    memset(s_fmiEntry, CANF_NO_ENTRY, sizeof(s_fmiEntry));
+    memset(s_bankSlots, 0, sizeof(s_bankSlots));
+    s_fmiNext[0] = 0U;
+    s_fmiNext[1] = 0U;
+    s_muted      = 0U;
+
+    for (uint32_t c = 0U; (table != 0U) && (c < (sizeof(s_classes) / sizeof(s_classes[0]))); ++c)
+    {
+        for (uint32_t fifo = CAN_FILTER_FIFO0; fifo <= CAN_FILTER_FIFO1; ++fifo)
+        {
+            st = canf_pack_class(hcan, &s_classes[c], fifo, &bank);
+            if (st != HAL_OK)
+                return st;
+        }
+    }
+
+    if (catchAll != 0U)
+    {
+        static const CanFilter_Class_t any32 = { 1U, 0U };
+        const uint16_t any[4]   = { 0U, 0U, 0U, 0U };
+        const uint8_t  none[4]  = { CANF_NO_ENTRY, CANF_NO_ENTRY,
+                                    CANF_NO_ENTRY, CANF_NO_ENTRY };
+
+        st = canf_write_bank(hcan, bank++, &any32, CAN_FILTER_FIFO0,
+                             any, none, 1U);
+        if (st != HAL_OK)
+            return st;
+    }
+
+    /* Deactivate whatever a previous configuration may have left behind. */
+    for (; bank < CAN_FILTERS_MAX_BANKS; ++bank)
+    {
+        CAN_FilterTypeDef cfg;
+        memset(&cfg, 0, sizeof(cfg));
+
+        cfg.FilterBank           = bank;
+        cfg.FilterMode           = CAN_FILTERMODE_IDMASK;
+        cfg.FilterScale          = CAN_FILTERSCALE_32BIT;
+        cfg.FilterFIFOAssignment = CAN_FILTER_FIFO0;
+        cfg.FilterActivation     = DISABLE;
+        cfg.SlaveStartFilterBank = CAN_FILTERS_SLAVE_START_BANK;
+
+        st = HAL_CAN_ConfigFilter(hcan, &cfg);
+        if (st != HAL_OK)
+            return st;
+    }
+
+    return HAL_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef CanFilters_Apply(CAN_HandleTypeDef *hcan)
+{
+    return canf_apply(hcan, 1U, (CAN_FILTERS_ACCEPT_ALL != 0) ? 1U : 0U);
+}
+
+HAL_StatusTypeDef CanFilters_ApplyAcceptAll(CAN_HandleTypeDef *hcan)
+{
+    return canf_apply(hcan, 0U, 1U);
+}
+
+HAL_StatusTypeDef CanFilters_ApplySlave(CAN_HandleTypeDef *hcan,
+                                        const CanFilter_Entry_t *table, uint32_t count)
+{
+    if ((hcan == NULL) || ((table == NULL) && (count > 0U)) ||
+        (count > (CAN_FILTERS_TOTAL_BANKS - CAN_FILTERS_SLAVE_START_BANK)))
+        return HAL_ERROR;
+
+    for (uint32_t i = 0U; (CAN_FILTERS_SLAVE_START_BANK + i) < CAN_FILTERS_TOTAL_BANKS; ++i)
+    {
+        CAN_FilterTypeDef cfg;
+        memset(&cfg, 0, sizeof(cfg));
+
+        cfg.FilterBank           = CAN_FILTERS_SLAVE_START_BANK + i;
+        cfg.FilterMode           = CAN_FILTERMODE_IDMASK;
+        cfg.FilterScale          = CAN_FILTERSCALE_32BIT;
+        cfg.FilterFIFOAssignment = CAN_FILTER_FIFO0;
+        cfg.FilterActivation     = DISABLE;
+        cfg.SlaveStartFilterBank = CAN_FILTERS_SLAVE_START_BANK;
+
+        if (i < count)
+        {
+            const CanFilter_Entry_t *e = &table[i];
+            uint32_t id;
+            uint32_t mask;
+
+            /* 32-bit scale for both kinds: STID[10:0] sits at bit 21. */
+            if (e->ext != 0U)
+            {
+                id   = ((e->id & 0x1FFFFFFFU) << CANF_EXT_SHIFT) | CANF_EXT_IDE;
+                mask = ((e->mask & 0x1FFFFFFFU) << CANF_EXT_SHIFT);
+            }
+            else
+            {
+                id   = (e->id & 0x7FFU) << 21;
+                mask = (e->mask & 0x7FFU) << 21;
+            }
+            mask |= CANF_EXT_IDE | CANF_EXT_RTR;
+
+            cfg.FilterIdHigh         = id >> 16;
+            cfg.FilterIdLow          = id & 0xFFFFU;
+            cfg.FilterMaskIdHigh     = mask >> 16;
+            cfg.FilterMaskIdLow      = mask & 0xFFFFU;
+            cfg.FilterFIFOAssignment = e->fifo;
+            cfg.FilterActivation     = ENABLE;
+        }
+
+        HAL_StatusTypeDef st = HAL_CAN_ConfigFilter(hcan, &cfg);
+        if (st != HAL_OK)
+            return st;
+    }
+
+    return HAL_OK;
+}
+
+int32_t CanFilters_EntryFromMatch(uint32_t fifo, uint32_t fmi)
+{
+    if ((fifo > CAN_FILTER_FIFO1) || (fmi >= CAN_FILTERS_MAX_FMI))
+        return -1;
+
+    uint8_t e = s_fmiEntry[fifo][fmi];
+    return (e == CANF_NO_ENTRY) ? -1 : (int32_t)e;
+}
+
+HAL_StatusTypeDef CanFilters_SetMuted(CAN_HandleTypeDef *hcan, uint32_t entry, uint8_t muted)
+{
+    if ((hcan == NULL) || (entry >= CANF_TABLE_LEN))
+        return HAL_ERROR;
+
+    uint32_t bit  = 1UL << entry;
+    uint32_t next = (muted != 0U) ? (s_muted | bit) : (s_muted & ~bit);
+    if (next == s_muted)
+        return HAL_OK;
+    s_muted = next;
+
+    for (uint32_t bank = 0U; bank < CAN_FILTERS_MAX_BANKS; ++bank)
+    {
+        for (uint32_t j = 0U; j < s_bankSlots[bank]; ++j)
+        {
+            if (s_bankEntry[bank][j] == entry)
+            {
+                canf_commit_bank(hcan, bank);
+                break;
+            }
+        }
+    }
+
+    return HAL_OK;
+}
+
+uint32_t CanFilters_GetMuted(void)
+{
+    return s_muted;
+}
+
+const CanFilter_Entry_t *CanFilters_GetTable(uint32_t *count)
+{
+    if (count != NULL)
+        *count = (uint32_t)CANF_TABLE_LEN;
+
+    return s_filterTable;
+}
+
+uint8_t CanFilters_Covers(uint8_t ext, uint32_t id, uint32_t mask)
+{
+    if (CAN_FILTERS_ACCEPT_ALL != 0)
+        return 1U;
+
+    for (uint32_t i = 0U; i < CANF_TABLE_LEN; ++i)
+    {
+        const CanFilter_Entry_t *e = &s_filterTable[i];
+
+        if ((e->ext == ext) && ((mask & e->mask) == e->mask) &&
+            (((id ^ e->id) & e->mask) == 0U))
+            return 1U;
+    }
+    return 0U;
+}
@@ -0,0 +1,198 @@
+/**
+ * @file    can_gw.c
+ * @brief   Gateway routing table, rate limits and "can gw".
+ */
+
+#include "can_gw.h"
+#include "fw_proxy.h"
+#include "cli_if.h"
+#include "log.h"
+#include "ramfunc.h"
+#include "fmt.h"
+#include <stdio.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+_Static_assert(CAN_IF_NUM_BUSES > 1U, "the gateway needs CAN2 (CAN_IF_NUM_BUSES 2)");
+
+typedef struct
+{
+    uint8_t  src;
+    uint8_t  dst;
+    uint8_t  sent;        /* a frame was forwarded: lastMs is valid */
+    uint16_t minGapMs;
+    uint32_t id;
+    uint32_t mask;
+    uint32_t dstId;
+    uint32_t lastMs;
+    uint32_t forwarded;
+    uint32_t limited;     /* dropped by minGapMs */
+    uint32_t dropped;     /* destination queue full or bus down */
+} CanGwRoute_t;
+
+#define CAN_GW_ROUTE_(src, id, mask, dst, dstId, gap)                          \
+    { (uint8_t)(src), (uint8_t)(dst), 0U, (uint16_t)(gap),                     \
+      (uint32_t)(id), (uint32_t)(mask) & CAN_IF_ID_MASK, (uint32_t)(dstId),    \
+      0U, 0U, 0U, 0U },
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Not const: read by the RX interrupt, which keeps running from SRAM
+ * while the flash is busy (ramfunc.h). */
+static CanGwRoute_t s_gwRoutes[] = { CAN_GW_ROUTE_TABLE(CAN_GW_ROUTE_) };
+
+#define CAN_GW_ROUTE_COUNT  (sizeof(s_gwRoutes) / sizeof(s_gwRoutes[0]))
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void gw_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CLI_IF_Print("Route                          Gap ms  Forwarded    Limited    Dropped\r\n");
+    for (uint32_t i = 0U; i < CAN_GW_ROUTE_COUNT; ++i)
+    {
+        const CanGwRoute_t *r = &s_gwRoutes[i];
+        uint8_t ext    = ((r->id & CAN_IF_ID_EXT) != 0U) ? 1U : 0U;
+        uint8_t dstExt = ((r->dstId & CAN_IF_ID_EXT) != 0U) ? 1U : 0U;
+        char    name[48];
+
+        (void)FMT_SNPRINTF(name, sizeof(name), "CAN%u 0x%0*lX/%0*lX -> CAN%u 0x%0*lX",
+                           (unsigned)(r->src + 1U),
+                           ext ? 8 : 3, (unsigned long)(r->id & CAN_IF_ID_MASK),
+                           ext ? 8 : 3, (unsigned long)r->mask,
+                           (unsigned)(r->dst + 1U),
+                           dstExt ? 8 : 3, (unsigned long)(r->dstId & CAN_IF_ID_MASK));
+        CLI_IF_Printf("%-30s %6u %10lu %10lu %10lu\r\n", name, (unsigned)r->minGapMs,
+                      (unsigned long)r->forwarded, (unsigned long)r->limited,
+                      (unsigned long)r->dropped);
+    }
+
+    CLI_IF_Print("Bus       Queued       Sent    Dropped  Queue peak\r\n");
+    for (uint32_t bus = 0U; bus < CAN_IF_NUM_BUSES; ++bus)
+    {
+        CAN_IF_TxStats_t st;
+        CAN_IF_GetBusTxStats(bus, &st);
+
+        CLI_IF_Printf("CAN%lu %10lu %10lu %10lu  %10lu\r\n", (unsigned long)(bus + 1U),
+                      (unsigned long)st.queued, (unsigned long)st.sent,
+                      (unsigned long)st.dropped, (unsigned long)st.highWater);
+    }
+}
+
+static const CliCommand_t s_gwCmds[] =
+{
+    { "can gw", "", 0U, gw_cmd_show, "gateway routes and per-bus TX counters" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void CanGw_Init(void)
+{
+    for (uint32_t i = 0U; i < CAN_GW_ROUTE_COUNT; ++i)
+    {
+        const CanGwRoute_t *r = &s_gwRoutes[i];
+
+        if ((r->src >= CAN_IF_NUM_BUSES) || (r->dst >= CAN_IF_NUM_BUSES) || (r->src == r->dst))
+            LOG_WARN(CAN, "Gateway route %lu: bad buses, never used", (unsigned long)i);
+        else if ((r->src == CAN_IF_BUS1) &&
+                 (CanFilters_Covers(((r->id & CAN_IF_ID_EXT) != 0U) ? 1U : 0U,
+                                    r->id & CAN_IF_ID_MASK, r->mask) == 0U))
+            LOG_WARN(CAN, "Gateway route %lu: 0x%lX/0x%lX not fully in CAN_FILTER_TABLE",
+                     (unsigned long)i, (unsigned long)(r->id & CAN_IF_ID_MASK),
+                     (unsigned long)r->mask);
+    }
+
+    CLI_IF_REGISTER_TABLE(s_gwCmds);
+}
+
+uint32_t CanGw_GetFilters(uint32_t bus, CanFilter_Entry_t *out, uint32_t max)
+{
+    uint32_t n = 0U;
+
+    for (uint32_t i = 0U; i < CAN_GW_ROUTE_COUNT; ++i)
+    {
+        const CanGwRoute_t *r = &s_gwRoutes[i];
+
+        if (r->src != bus)
+            continue;
+        if ((out != NULL) && (n < max))
+        {
+            out[n].id   = r->id & CAN_IF_ID_MASK;
+            out[n].mask = r->mask;
+            out[n].fifo = CAN_FILTER_FIFO0;
+            out[n].ext  = ((r->id & CAN_IF_ID_EXT) != 0U) ? 1U : 0U;
+        }
+        n++;
+    }
+#if FW_PROXY_ENABLE
+    /* The bootloader responses for the flashing proxy, one bank for all */
+    if (bus == CAN_IF_BUS2)
+    {
+        if ((out != NULL) && (n < max))
+        {
+            out[n].id   = FW_PROXY_RESP_ID;
+            out[n].mask = 0x7FFU & ~(FW_PROXY_MAX_NODES - 1U);
+            out[n].fifo = CAN_FILTER_FIFO0;
+            out[n].ext  = 0U;
+        }
+        n++;
+    }
+#endif
+    return n;
+}
+
+RAMFUNC void CanGw_OnRx(uint32_t bus, uint32_t key, uint8_t dlc, const uint8_t *data)
+{
+    if ((key & CAN_IF_ID_RTR) != 0U)
+        return;
+
+#if FW_PROXY_ENABLE
+    if ((bus == CAN_IF_BUS2) && ((key & ~(FW_PROXY_MAX_NODES - 1U)) == FW_PROXY_RESP_ID))
+    {
+        FwProxy_OnRx(key, dlc, data);
+        return;
+    }
+#endif
+
+    for (uint32_t i = 0U; i < CAN_GW_ROUTE_COUNT; ++i)
+    {
+        CanGwRoute_t *r = &s_gwRoutes[i];
+
+        if ((r->src != bus) || (((key ^ r->id) & (r->mask | CAN_IF_ID_EXT)) != 0U))
+            continue;
+
+        /* All CAN RX interrupts share one priority and never preempt
+         * each other, so the route needs no lock. */
+        uint32_t now = HAL_GetTick();
+        if ((r->minGapMs != 0U) && (r->sent != 0U) && ((now - r->lastMs) < r->minGapMs))
+        {
+            r->limited++;
+            return;
+        }
+
+        uint32_t id = (key & ~r->mask & CAN_IF_ID_MASK) |
+                      (r->dstId & (r->mask | CAN_IF_ID_EXT));
+
+        if (CAN_IF_Forward(r->dst, id, data, dlc) == HAL_OK)
+        {
+            r->forwarded++;
+            r->lastMs = now;
+            r->sent   = 1U;
+        }
+        else
+        {
+            r->dropped++;
+        }
+        return;
+    }
+}
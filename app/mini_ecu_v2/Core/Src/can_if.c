@@ -3,247 +3,2339 @@
  * @brief   CAN interface abstraction for the Mini ECU project.
  *
  * Responsibilities:
- *   - Configure and start CAN1 (loopback, filter, interrupts).
- *   - Provide a telemetry TX API (VehicleState_t → CAN frame).
- *   - Buffer received frames in an RTOS message queue.
+ *   - Configure and start CAN1 (loopback, filter table, interrupts), and
+ *     CAN2 for the gateway (can_gw.h).
+ *   - Provide a non-blocking TX API backed by a priority-ordered software
+ *     queue per controller that the mailbox-complete interrupts refill
+ *     from.
+ *   - Provide a telemetry TX API (VehicleState_t → CAN frame) and
+ *     schedule the telemetry frame: cyclic, and early when the published
+ *     vehicle state moves beyond a deadband (can_sched.h).
+ *   - Buffer received frames in a lock-free SPSC ring (ISR -> CanRxTask),
+ *     optionally from an RX interrupt above the kernel (CAN_IF_RX_FAST_IRQ).
  *   - Provide optional logging via Log_* when enabled from CLI.
+ *   - Register the "can ..." CLI commands.
  */
 
 #include "can_if.h"
+#include "audit.h"
+#include "boot_prof.h"
+#include "cal.h"
+#include "can_alarm.h"
+#include "can_busoff.h"
+#include "can_e2e.h"
+#include "can_secoc.h"
+#include "can_filters.h"
+#include "can_gw.h"
+#include "can_rxlimit.h"
+#include "can_sched.h"
+#include "can_stats.h"
+#include "can_trace.h"
+#include "cli_if.h"
+#include "ext_log.h"
+#include "fault_inj.h"
+#include "fmt.h"
 #include "log.h"
+#include "low_power.h"
+#include "mem_pool.h"
+#include "perf.h"
+#include "ramfunc.h"
+#include "time_sync.h"
+#include "vehicle_shared.h"
+#include "FreeRTOS.h"
 #include <string.h>
-#include <stdio.h>
+#include <stdlib.h>
 
 /* External handles generated by CubeMX (defined in main.c) */
 extern CAN_HandleTypeDef  hcan1;
+#if CAN_IF_NUM_BUSES > 1U
+extern CAN_HandleTypeDef  hcan2;
+#endif
+
+_Static_assert((CAN_IF_NUM_BUSES == 1U) || (CAN_IF_NUM_BUSES == 2U),
+               "CAN_IF_NUM_BUSES: CAN1, or CAN1 and CAN2");
+
+#if CAN_IF_RX_FAST_IRQ
+_Static_assert(CAN_IF_RX_IRQ_PRIO < configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY,
+               "CAN_IF_RX_FAST_IRQ needs the RX interrupts above the kernel");
+#endif
 
 /* -------------------------------------------------------------------------- */
 /* Local state                                                                */
 /* -------------------------------------------------------------------------- */
 
-/** RX queue used by CanRxTask to receive CAN frames from ISR context. */
-static osMessageQueueId_t s_canRxQueue = NULL;
+/** RX ring used by CanRxTask to receive CAN frames from ISR context. */
+static CanRing_t    s_canRxRing;
+static CAN_IF_Msg_t s_canRxSlots[CAN_IF_RX_RING_SIZE] CAN_RING_ALIGNED;
+static uint8_t      s_canRxRingReady = 0U;
+
+/** Latest-value slots (CAN_IF_LATEST_TABLE), written by the RX interrupt. */
+#define CAN_LATEST_ID_(id)  (id),
+static const uint32_t s_canLatestIds[] = { CAN_IF_LATEST_TABLE(CAN_LATEST_ID_) };
+#define CAN_LATEST_COUNT    (sizeof(s_canLatestIds) / sizeof(s_canLatestIds[0]))
+
+_Static_assert(CAN_LATEST_COUNT <= 32U, "CAN_IF_LATEST_TABLE: one dirty bit per ID");
+
+typedef struct
+{
+    uint32_t taken;      /* processed by CanRxTask */
+    uint32_t replaced;   /* overwritten before CanRxTask took them */
+} CanLatestStats_t;
+
+static CAN_IF_Msg_t       s_canLatest[CAN_LATEST_COUNT];
+static CanLatestStats_t   s_canLatestStats[CAN_LATEST_COUNT];
+static volatile uint32_t  s_canLatestDirty = 0U;   /* bit i: s_canLatest[i] */
+
+/** Filter match index -> latest slot + 1 (0: ring), per FIFO. */
+static uint8_t            s_canLatestFmi[2][CAN_FILTERS_MAX_FMI];
+
+#if CAN_IF_RX_FAST_IRQ
+/** ErrorCode of a failed FIFO read, logged by the hand-off interrupt. */
+static volatile uint32_t s_canRxFailErr = 0U;
+#endif
+
+/** Flag controlled by CLI to turn CAN RX logging on/off. */
+static uint8_t s_canLoggingEnabled = 0U;
+
+/** Registered RX handler. */
+typedef struct
+{
+    CAN_IF_RxHandler_t fn;
+    void              *ctx;
+} CanRxHandler_t;
+
+/** Route for a 29-bit identifier (exact or masked). */
+typedef struct
+{
+    uint32_t id;
+    uint32_t mask;
+    uint8_t  handler;
+} CanExtRoute_t;
+
+/** Handler slots; slot 0 is reserved to mean "no handler". */
+static CanRxHandler_t s_canRxHandlers[CAN_IF_MAX_HANDLERS + 1U];
+static uint8_t        s_canRxHandlerCount = 0U;
+
+/** Direct-mapped dispatch for 11-bit IDs: StdId -> handler slot. */
+static uint8_t        s_canStdDispatch[2048];
+
+/** 29-bit routes: exact IDs sorted by id, masked IDs in insertion order. */
+static CanExtRoute_t  s_canExtExact[CAN_IF_MAX_EXT_HANDLERS];
+static uint8_t        s_canExtExactCount = 0U;
+static CanExtRoute_t  s_canExtMasked[CAN_IF_MAX_EXT_HANDLERS];
+static uint8_t        s_canExtMaskedCount = 0U;
+
+/** Consumers of reassembled messages, keyed by identifier. */
+typedef struct
+{
+    uint32_t            id;
+    CAN_IF_PduHandler_t fn;
+    void               *ctx;
+} CanPduHandler_t;
+
+static CanPduHandler_t s_canPduHandlers[CAN_IF_MAX_PDU_HANDLERS];
+static uint8_t         s_canPduHandlerCount = 0U;
+
+#if CAN_IF_ISR_DECODERS
+/** ID decoded in the RX interrupt (CAN_IF_RegisterIsrDecoder()). */
+typedef struct
+{
+    uint32_t            key;
+    CAN_IF_IsrDecoder_t decode;
+    CAN_IF_IsrWake_t    wake;
+    void               *ctx;
+    uint8_t             e2e;       /* CanE2E_Find() of key */
+    uint32_t            frames;    /* decoded, RX interrupt */
+    uint32_t            dropped;   /* failed the E2E check, RX interrupt */
+} CanIsrDecoder_t;
+
+static CanIsrDecoder_t   s_canIsrDec[CAN_IF_ISR_DECODERS];
+static volatile uint32_t s_canIsrDecCount = 0U;   /* published last */
+static volatile uint32_t s_canIsrWake     = 0U;   /* bit i: wake of s_canIsrDec[i] due */
+#endif
+
+/** One controller: its submission slots and software TX queue, both
+ *  drained by its TX interrupt, and the TX counters. txStats is written
+ *  by that interrupt (or with interrupts masked); producers count their
+ *  refusals in txRefused atomically. */
+typedef struct
+{
+    CAN_HandleTypeDef *hcan;
+    IRQn_Type          txIrq;
+    CanTxSub_t         txSub;
+    CanTxQueue_t       txQueue;
+    CAN_IF_TxStats_t   txStats;
+    volatile uint32_t  txRefused;
+    uint8_t            running;   /* started by CAN_IF_Init() */
+    uint8_t            silent;    /* CAN_MODE_SILENT: TX refused */
+    uint8_t            asleep;    /* CAN_IF_Sleep(): TX refused */
+    uint8_t            tsynMb;    /* TX mailboxes holding a time sync frame */
+    uint8_t            inOrderMb; /* TX mailboxes holding a CAN_TXQ_IN_ORDER frame */
+    uint8_t            txFifo;    /* CAN_IF_SetTxFifo(): mailboxes leave in load order */
+    uint8_t            queueMb;   /* TX mailboxes the queue refill may load */
+} CanBus_t;
+
+/** CAN1's mailboxes for the queue: CAN_IF_TX_URGENT keeps one out. */
+#if CAN_IF_TX_URGENT
+#define CAN_BUS1_QUEUE_MB  (0x7U & ~(1U << CAN_IF_TX_URGENT_MAILBOX))
+#else
+#define CAN_BUS1_QUEUE_MB  0x7U
+#endif
+
+static CanBus_t s_canBus[CAN_IF_NUM_BUSES] =
+{
+    { .hcan = &hcan1, .txIrq = CAN1_TX_IRQn, .queueMb = CAN_BUS1_QUEUE_MB },
+#if CAN_IF_NUM_BUSES > 1U
+    { .hcan = &hcan2, .txIrq = CAN2_TX_IRQn, .queueMb = 0x7U },
+#endif
+};
+
+/** Marker for "FMI does not identify a single ID, look it up". */
+#define CAN_FMI_LOOKUP  0xFFU
+
+/** Filter match index -> handler slot shortcut, per FIFO. */
+static uint8_t        s_canFmiDispatch[2][CAN_FILTERS_MAX_FMI];
+
+/** Bit timing and mode currently programmed into BTR, and the bitrate
+ *  they were computed for. */
+static CanTiming_t    s_canTiming;
+static uint32_t       s_canMode = CAN_MODE_LOOPBACK;
+static uint32_t       s_canBitrate = CAN_IF_BITRATE;
+
+/** Set while a task stops and restarts CAN1 (bitrate change, bus-off). */
+static volatile uint8_t s_canReconfig = 0U;
+
+/** Controllers CAN_IF_ClockPrepare() stopped, bit n = bus n. */
+static uint8_t        s_canClockStopped = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+#if CAN_IF_RX_FAST_IRQ
+/** Ring notify hook: the RX interrupts may not set thread flags. */
+RAMFUNC static void can_rx_pend_swi(void)
+{
+    NVIC_SetPendingIRQ(CAN_IF_RX_SWI_IRQn);
+}
+#endif
+
+/** Controller of a HAL handle, NULL for one CAN_IF does not drive. */
+RAMFUNC static CanBus_t *can_bus_of(const CAN_HandleTypeDef *hcan)
+{
+    for (uint32_t i = 0U; i < CAN_IF_NUM_BUSES; ++i)
+    {
+        if (s_canBus[i].hcan == hcan)
+            return &s_canBus[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Find the handler slot for an identifier (0 if none).
+ */
+static uint8_t can_lookup_handler(uint8_t ext, uint32_t id)
+{
+    if (ext == 0U)
+        return s_canStdDispatch[id & 0x7FFU];
+
+    /* Exact 29-bit IDs: binary search over the sorted table. */
+    uint32_t lo = 0U;
+    uint32_t hi = s_canExtExactCount;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2U;
+        if (s_canExtExact[mid].id == id)
+            return s_canExtExact[mid].handler;
+        if (s_canExtExact[mid].id < id)
+            lo = mid + 1U;
+        else
+            hi = mid;
+    }
+
+    /* Masked 29-bit ranges: short linear scan. */
+    for (uint8_t i = 0U; i < s_canExtMaskedCount; ++i)
+    {
+        const CanExtRoute_t *r = &s_canExtMasked[i];
+        if ((id & r->mask) == (r->id & r->mask))
+            return r->handler;
+    }
+
+    return 0U;
+}
+
+/**
+ * @brief Precompute handlers for frames accepted by exact-ID filters.
+ *
+ * A list-mode filter accepts exactly one ID, so its match index alone
+ * identifies the handler. Mask filters stay on the ID lookup path.
+ */
+static void can_rebuild_fmi_dispatch(void)
+{
+    uint32_t count = 0U;
+    const CanFilter_Entry_t *table = CanFilters_GetTable(&count);
+
+    memset(s_canFmiDispatch, CAN_FMI_LOOKUP, sizeof(s_canFmiDispatch));
+    memset(s_canLatestFmi, 0, sizeof(s_canLatestFmi));
+
+    for (uint32_t fifo = 0U; fifo < 2U; ++fifo)
+    {
+        for (uint32_t fmi = 0U; fmi < CAN_FILTERS_MAX_FMI; ++fmi)
+        {
+            int32_t e = CanFilters_EntryFromMatch(fifo, fmi);
+            if ((e < 0) || ((uint32_t)e >= count))
+                continue;
+
+            const CanFilter_Entry_t *f = &table[e];
+            uint32_t full = f->ext ? CAN_FILTER_EXT_EXACT : CAN_FILTER_STD_EXACT;
+            if ((f->mask & full) != full)
+                continue;
+
+            s_canFmiDispatch[fifo][fmi] = can_lookup_handler(f->ext, f->id);
+
+            uint32_t key = f->ext ? (f->id | CAN_IF_ID_EXT) : f->id;
+            for (uint32_t i = 0U; i < CAN_LATEST_COUNT; ++i)
+            {
+                if (s_canLatestIds[i] == key)
+                    s_canLatestFmi[fifo][fmi] = (uint8_t)(i + 1U);
+            }
+        }
+    }
+}
+
+/** Warn about latest-value IDs that no exact filter entry leads to. */
+static void can_check_latest(void)
+{
+    for (uint32_t i = 0U; i < CAN_LATEST_COUNT; ++i)
+    {
+        uint8_t found = 0U;
+
+        for (uint32_t fifo = 0U; fifo < 2U; ++fifo)
+        {
+            for (uint32_t fmi = 0U; fmi < CAN_FILTERS_MAX_FMI; ++fmi)
+            {
+                if (s_canLatestFmi[fifo][fmi] == (uint8_t)(i + 1U))
+                    found = 1U;
+            }
+        }
+        if (found == 0U)
+            LOG_WARN(CAN, "Latest-value ID 0x%lX has no exact filter, kept in the ring",
+                     (unsigned long)(s_canLatestIds[i] & CAN_IF_ID_MASK));
+    }
+}
+
+/** Wake CanRxTask from the RX interrupt (the ring's notification path). */
+RAMFUNC static void can_rx_wake(void)
+{
+#if CAN_IF_RX_FAST_IRQ
+    can_rx_pend_swi();
+#else
+    CanRing_Notify(&s_canRxRing);
+#endif
+}
+
+#if CAN_IF_ISR_DECODERS
+/**
+ * @brief Decode a frame of an ISR-decoded ID in the RX interrupt.
+ *
+ * The same gate as CAN_IF_ProcessRxMsg(): nothing in listen-only mode, and
+ * a protected ID must pass its E2E check (SecOC IDs are refused at
+ * registration, a CMAC is too long for here).
+ *
+ * @return Non-zero if @p key is one: the frame is done with.
+ */
+RAMFUNC static uint8_t can_isr_decode(uint32_t key, uint8_t dlc, const uint8_t *data,
+                                      uint32_t rxCycles)
+{
+    uint32_t n = s_canIsrDecCount;
+
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        CanIsrDecoder_t *d = &s_canIsrDec[i];
+
+        if (d->key != key)
+            continue;
+
+        LowPower_OnCanRx();
+        if ((s_canBus[CAN_IF_BUS1].silent != 0U) ||
+            ((d->e2e != CAN_E2E_NONE) && (CanE2E_Check(d->e2e, data, dlc) > CAN_E2E_WRONG_SEQ)))
+        {
+            d->dropped++;
+            return 1U;
+        }
+
+        d->frames++;
+        if ((d->decode(key, dlc, data, rxCycles, d->ctx) != 0U) && (d->wake != NULL))
+        {
+            /* Only the RX interrupts set bits, can_isr_wakeups() clears
+             * them under PRIMASK. */
+            s_canIsrWake |= 1UL << i;
+#if CAN_IF_RX_FAST_IRQ
+            can_rx_pend_swi();
+#endif
+        }
+        return 1U;
+    }
+    return 0U;
+}
+
+/** Run the wake functions the decoders asked for; kernel priority. */
+RAMFUNC static void can_isr_wakeups(void)
+{
+    if (s_canIsrWake == 0U)
+        return;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t due = s_canIsrWake;
+    s_canIsrWake = 0U;
+    __set_PRIMASK(primask);
+
+    while (due != 0U)
+    {
+        uint32_t i = 31U - __CLZ(due);
+
+        due &= ~(1UL << i);
+        s_canIsrDec[i].wake(s_canIsrDec[i].ctx);
+    }
+}
+#endif
+
+/** Mailbox identifier register image of @p id (| CAN_IF_ID_EXT), TXRQ clear. */
+RAMFUNC static uint32_t can_tx_tir(uint32_t id)
+{
+    if ((id & CAN_IF_ID_EXT) != 0U)
+        return ((id & CAN_IF_ID_MASK) << CAN_TI0R_EXID_Pos) | CAN_TI0R_IDE;
+
+    return (id & 0x7FFU) << CAN_TI0R_STID_Pos;
+}
+
+/**
+ * @brief Write one frame into the lowest of the free mailboxes @p tme
+ *        (TSR TME bits, at least one set).
+ *
+ * The frame already is a register image (can_txq.h): three data writes
+ * and the identifier with TXRQ, which starts the transmission, instead of
+ * HAL_CAN_AddTxMessage() and its header encoding (CAN_IF_TX_DIRECT). In
+ * SRAM with the submit path below: the gateway calls it from the RX
+ * interrupts.
+ *
+ * @return The mailbox's bit (CAN_TX_MAILBOXn).
+ */
+RAMFUNC static uint8_t can_tx_to_mailbox(CanBus_t *b, const CanTxFrame_t *f, uint32_t tme)
+{
+#if CAN_IF_TX_DIRECT
+    CAN_TypeDef           *can = b->hcan->Instance;
+    uint32_t               mb  = ((tme & 1U) != 0U) ? 0U : (((tme & 2U) != 0U) ? 1U : 2U);
+    CAN_TxMailBox_TypeDef *m   = &can->sTxMailBox[mb];
+    uint8_t                bit = (uint8_t)(1U << mb);
+
+    m->TDTR = f->tdtr & CAN_TDT0R_DLC;
+    m->TDLR = f->data[0];
+    m->TDHR = f->data[1];
+    m->TIR  = f->tir | CAN_TI0R_TXRQ;
+#else
+    CAN_TxHeaderTypeDef h;
+    uint32_t            mailbox = 0U;
+
+    memset(&h, 0, sizeof(h));
+    if ((f->tir & CAN_TI0R_IDE) != 0U)
+    {
+        h.ExtId = f->tir >> CAN_TI0R_EXID_Pos;
+        h.IDE   = CAN_ID_EXT;
+    }
+    else
+    {
+        h.StdId = f->tir >> CAN_TI0R_STID_Pos;
+        h.IDE   = CAN_ID_STD;
+    }
+    h.RTR = CAN_RTR_DATA;
+    h.DLC = f->tdtr & CAN_TDT0R_DLC;
+    /* HAL loads the mailbox TSR CODE names, the lowest free one; the
+     * urgent mailbox is the highest, so that is one of tme. */
+    (void)tme;
+    (void)HAL_CAN_AddTxMessage(b->hcan, &h, (const uint8_t *)f->data, &mailbox);
+
+    uint8_t bit = (uint8_t)mailbox;
+#endif
+
+    if (b == &s_canBus[CAN_IF_BUS1])
+    {
+        uint32_t key = ((f->tir & CAN_TI0R_IDE) != 0U)
+                     ? ((f->tir >> CAN_TI0R_EXID_Pos) | CAN_IF_ID_EXT)
+                     : (f->tir >> CAN_TI0R_STID_Pos);
+
+        CanStats_OnTx(key, (uint8_t)(f->tdtr & CAN_TDT0R_DLC));
+
+        /* Its TX confirmation is the master's SYNC stamp (time_sync.h). */
+        if (f->tir == ((uint32_t)TIME_SYNC_CAN_ID << CAN_TI0R_STID_Pos))
+            b->tsynMb |= bit;
+        else
+            b->tsynMb &= (uint8_t)~bit;
+    }
+    return bit;
+}
+
+/**
+ * @brief 1 if the in-order frame @p f has to wait: the in-order mailboxes
+ *        are all taken or, with ID priority, its identifier is loaded.
+ *
+ * @param busy Mailboxes with a pending request (TME clear).
+ */
+RAMFUNC static uint8_t can_tx_hold(const CanBus_t *b, const CanTxFrame_t *f, uint32_t busy)
+{
+    uint32_t held = b->inOrderMb;
+    uint32_t n    = (held & 1U) + ((held >> 1) & 1U) + ((held >> 2) & 1U);
+
+    if (n >= CAN_IF_TX_IN_ORDER_MAILBOXES)
+        return 1U;
+    if (b->txFifo != 0U)
+        return 0U;
+
+    for (uint32_t mb = 0U; mb < 3U; ++mb)
+    {
+        if (((busy & (1U << mb)) != 0U) &&
+            ((b->hcan->Instance->sTxMailBox[mb].TIR & ~CAN_TI0R_TXRQ) == f->tir))
+            return 1U;
+    }
+    return 0U;
+}
+
+/**
+ * @brief Move queued frames into free mailboxes, highest priority first.
+ *
+ * An in-order frame at the head that has to wait (can_tx_hold()) stops the
+ * refill until a mailbox completes; frames behind it are lower in priority
+ * anyway. Frames stay queued while the controller is not initialised, as
+ * with HAL_CAN_GetTxMailboxesFreeLevel(). From the TX interrupt, or with
+ * interrupts masked.
+ */
+RAMFUNC static void can_tx_refill(CanBus_t *b)
+{
+    HAL_CAN_StateTypeDef state = b->hcan->State;
+    CanTxFrame_t         f;
+
+    if ((state == HAL_CAN_STATE_READY) || (state == HAL_CAN_STATE_LISTENING))
+    {
+        for (;;)
+        {
+            uint32_t tme  = (b->hcan->Instance->TSR & CAN_TSR_TME) >> CAN_TSR_TME_Pos;
+            uint32_t busy = ~tme & 0x7U;
+
+            /* A completed or aborted mailbox holds nothing any more. */
+            b->inOrderMb &= (uint8_t)busy;
+            tme          &= b->queueMb;
+
+            const CanTxFrame_t *head = CanTxQ_Peek(&b->txQueue);
+            if ((tme == 0U) || (head == NULL))
+                break;
+
+            uint8_t inOrder = ((head->tdtr & CAN_TXQ_IN_ORDER) != 0U) ? 1U : 0U;
+            if ((inOrder != 0U) && (can_tx_hold(b, head, busy) != 0U))
+                break;
+
+            (void)CanTxQ_Pop(&b->txQueue, &f);
+            uint8_t bit = can_tx_to_mailbox(b, &f, tme);
+            if (inOrder != 0U)
+                b->inOrderMb |= bit;
+        }
+    }
+    b->txStats.depth = CanTxQ_Count(&b->txQueue);
+}
+
+/**
+ * @brief Take the submitted frames into the queue, then fill the free
+ *        mailboxes from it.
+ *
+ * From the TX interrupt, or with interrupts masked.
+ */
+RAMFUNC static void can_tx_service(CanBus_t *b)
+{
+    uint32_t n = CanTxSub_Take(&b->txSub, &b->txQueue);
+
+    if (n != 0U)
+    {
+        b->txStats.queued += n;
+        b->txStats.depth   = CanTxQ_Count(&b->txQueue);
+        if (b->txStats.depth > b->txStats.highWater)
+            b->txStats.highWater = b->txStats.depth;
+    }
+    can_tx_refill(b);
+}
+
+/** Count a refused frame; any context. */
+RAMFUNC static void can_tx_refuse(CanBus_t *b)
+{
+    uint32_t n;
+
+    do
+    {
+        n = __LDREXW(&b->txRefused) + 1U;
+    } while (__STREXW(n, &b->txRefused) != 0U);
+}
+
+/**
+ * @brief Claim a submission slot for a frame on @p b; any context.
+ *
+ * @return HAL_OK with @p *slot to fill; HAL_BUSY if every slot is taken
+ *         or HAL_ERROR if the bus refuses TX (both counted as dropped).
+ */
+RAMFUNC static HAL_StatusTypeDef can_tx_claim(CanBus_t *b, CanTxFrame_t **slot)
+{
+    if ((b->silent != 0U) || (b->asleep != 0U))
+    {
+        can_tx_refuse(b);
+        return HAL_ERROR;
+    }
+
+    *slot = CanTxSub_Claim(&b->txSub);
+    if (*slot == NULL)
+    {
+        can_tx_refuse(b);
+        return HAL_BUSY;
+    }
+    return HAL_OK;
+}
+
+/** Publish a filled slot and pend the TX interrupt, which queues it. */
+RAMFUNC static void can_tx_publish(CanBus_t *b, CanTxFrame_t *slot)
+{
+    CanTxSub_Publish(&b->txSub, slot);
+    NVIC_SetPendingIRQ(b->txIrq);
+}
+
+/**
+ * @brief Log one received frame as "RX ID=... DLC=... Data=...".
+ */
+static void can_log_rx(const CAN_IF_Msg_t *msg)
+{
+    /* "RX ID=0x12345678 DLC=8 Data=xx xx xx xx xx xx xx xx TS=65535"; an FD
+     * frame gives its length ("LEN=64"), cut at LOG_LINE_MAX. */
+    char     line[48U + (3U * CAN_IF_MAX_DLEN)];
+    uint32_t n   = 0U;
+    uint8_t  len = CAN_IF_MSG_LEN(msg);
+
+    if (!LOG_ENABLED(LOG_LEVEL_INFO, CAN))
+        return;
+
+    n += Fmt_Str(&line[n], "RX ID=0x", 0U);
+    n += Fmt_Hex(&line[n], msg->Id & CAN_IF_ID_MASK, CAN_IF_MSG_IS_EXT(msg) ? 8U : 3U);
+    n += Fmt_Str(&line[n], CAN_IF_MSG_IS_FD(msg) ? " LEN=" : " DLC=", 0U);
+    n += Fmt_Dec(&line[n], len, 0U);
+    n += Fmt_Str(&line[n], " Data=", 0U);
+    n += Fmt_HexBytes(&line[n], msg->Data, len, ' ');
+    n += Fmt_Str(&line[n], " TS=", 0U);
+    n += Fmt_Dec(&line[n], CAN_IF_MSG_TIME(msg), 0U);
+
+    Log_WriteText(LOG_LEVEL_INFO, "CAN", line, n);
+}
+
+/**
+ * @brief Compute and program bit timing; CAN1 must be in init mode.
+ */
+static HAL_StatusTypeDef can_apply_timing(uint32_t bitrate, uint32_t mode)
+{
+    CanTiming_t t;
+
+    if (CanTiming_Compute(HAL_RCC_GetPCLK1Freq(), bitrate,
+                          CAN_TIMING_SAMPLE_POINT, &t) != HAL_OK)
+        return HAL_ERROR;
+
+    hcan1.Instance->BTR = CanTiming_ToBtr(&t, mode);
+    CanTiming_ToInit(&t, &hcan1.Init);
+    hcan1.Init.Mode = mode;
+
+    s_canTiming  = t;
+    s_canMode    = mode;
+    s_canBitrate = bitrate;
+    return HAL_OK;
+}
+
+/**
+ * @brief Drop CAN1's software TX queue and abort its mailboxes.
+ *
+ * @return Frames dropped (the aborted ones are counted by the abort
+ *         callbacks).
+ */
+static uint32_t can_tx_flush(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    CanBus_t *b      = &s_canBus[CAN_IF_BUS1];
+    uint32_t  queued = CanTxQ_Count(&b->txQueue) + CanTxSub_Discard(&b->txSub);
+    CanTxQ_Init(&b->txQueue);
+    b->txStats.dropped += queued;
+    b->txStats.depth    = 0U;
+    uint32_t dropped = queued + (3U - HAL_CAN_GetTxMailboxesFreeLevel(&hcan1));
+    __set_PRIMASK(primask);
+
+    (void)HAL_CAN_AbortTxRequest(&hcan1, CAN_TX_MAILBOX0 | CAN_TX_MAILBOX1 |
+                                         CAN_TX_MAILBOX2);
+    return dropped;
+}
+
+/**
+ * @brief Acceptance filters for a mode: catch-all in CAN_MODE_SILENT,
+ *        CAN_FILTER_TABLE otherwise. CAN1 must not be running.
+ */
+static HAL_StatusTypeDef can_apply_filters(uint32_t mode)
+{
+    HAL_StatusTypeDef status = (mode == CAN_MODE_SILENT) ? CanFilters_ApplyAcceptAll(&hcan1)
+                                                         : CanFilters_Apply(&hcan1);
+    can_rebuild_fmi_dispatch();
+    CanRxLimit_Rebuild();
+    return status;
+}
+
+/** Mode for a "can mode" / "can bitrate" argument; 0 = parsed into @p mode. */
+static int can_parse_mode(const char *arg, uint32_t *mode)
+{
+    if (strcmp(arg, "normal") == 0)
+        *mode = CAN_MODE_NORMAL;
+    else if (strcmp(arg, "loopback") == 0)
+        *mode = CAN_MODE_LOOPBACK;
+    else if (strcmp(arg, "silent") == 0)
+        *mode = CAN_MODE_SILENT;
+    else if (strcmp(arg, "silent-loopback") == 0)
+        *mode = CAN_MODE_SILENT_LOOPBACK;
+    else
+        return -1;
+    return 0;
+}
+
+static const char *can_mode_name(uint32_t mode)
+{
+    return (mode == CAN_MODE_NORMAL)   ? "normal"   :
+           (mode == CAN_MODE_LOOPBACK) ? "loopback" :
+           (mode == CAN_MODE_SILENT)   ? "silent"   : "silent-loopback";
+}
+
+/**
+ * @brief Claim the right to stop and restart CAN1.
+ *
+ * @return 1 if claimed, 0 if another task is already doing it.
+ */
+static uint8_t can_reconfig_claim(void)
+{
+    uint8_t claimed = 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s_canReconfig == 0U)
+    {
+        s_canReconfig = 1U;
+        claimed = 1U;
+    }
+    __set_PRIMASK(primask);
+    return claimed;
+}
+
+/**
+ * @brief CLI: "can bitrate [<bps> [<mode>]]".
+ *
+ * Without arguments, prints the active timing. The mode defaults to the
+ * current one so "can bitrate 1000000" keeps loopback.
+ */
+static void can_cmd_bitrate(int argc, char *argv[])
+{
+    CanTiming_t t;
+    uint32_t    mode = CAN_IF_GetBitTiming(&t);
+
+    if (argc > 0)
+    {
+        char    *end;
+        uint32_t bitrate = (uint32_t)strtoul(argv[0], &end, 10);
+
+        if ((*end != '\0') || (argc > 2))
+        {
+            CLI_IF_Print("Usage: can bitrate <bps> [normal|loopback|silent|silent-loopback]\r\n");
+            return;
+        }
+
+        if ((argc == 2) && (can_parse_mode(argv[1], &mode) != 0))
+        {
+            CLI_IF_Print("Usage: can bitrate <bps> [normal|loopback|silent|silent-loopback]\r\n");
+            return;
+        }
+
+        HAL_StatusTypeDef st = CAN_IF_SetBitrate(bitrate, mode);
+        if (st == HAL_BUSY)
+        {
+            CLI_IF_Print("CAN1 is being restarted, try again.\r\n");
+            return;
+        }
+        if (st != HAL_OK)
+        {
+            CLI_IF_Print("Bitrate not reachable from the current APB1 clock.\r\n");
+            return;
+        }
+        Audit_Record(AUDIT_CMD_CAN_BITRATE, AUDIT_SRC_CLI, bitrate, mode);
+        (void)CAN_IF_GetBitTiming(&t);
+    }
+
+    CLI_IF_Printf("CAN: %lu bit/s, %s, presc %lu, BS1 %u, BS2 %u, SJW %u, SP %u.%u%%\r\n",
+                  (unsigned long)t.bitrate, can_mode_name(mode), (unsigned long)t.prescaler,
+                  (unsigned)t.bs1, (unsigned)t.bs2, (unsigned)t.sjw,
+                  (unsigned)(t.samplePoint / 10U), (unsigned)(t.samplePoint % 10U));
+}
+
+/**
+ * @brief CLI: "can mode [<mode>]" - show or set the operating mode at the
+ *        current bitrate.
+ */
+static void can_cmd_mode(int argc, char *argv[])
+{
+    uint32_t mode;
+
+    if (argc > 0)
+    {
+        if ((argc > 1) || (can_parse_mode(argv[0], &mode) != 0))
+        {
+            CLI_IF_Print("Usage: can mode [normal|loopback|silent|silent-loopback]\r\n");
+            return;
+        }
+
+        HAL_StatusTypeDef st = CAN_IF_SetMode(mode);
+        if (st == HAL_BUSY)
+        {
+            CLI_IF_Print("CAN1 is being restarted, try again.\r\n");
+            return;
+        }
+        if (st != HAL_OK)
+        {
+            CLI_IF_Printf("Mode change failed (%d).\r\n", (int)st);
+            return;
+        }
+        Audit_Record(AUDIT_CMD_CAN_MODE, AUDIT_SRC_CLI, mode, 0U);
+    }
+
+    CanTiming_t t;
+    mode = CAN_IF_GetBitTiming(&t);
+
+    CLI_IF_Printf("CAN1: %s, %lu bit/s\r\n", can_mode_name(mode), (unsigned long)t.bitrate);
+    if (mode == CAN_MODE_SILENT)
+        CLI_IF_Print("Listen-only: all IDs accepted, not handled, TX refused\r\n");
+}
+
+/**
+ * @brief CLI: "can rx" - RX ring fill and drops, latest-value slots, ISR
+ *        decoders.
+ */
+static void can_cmd_rx(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CanRing_Stats_t st;
+    CanRing_GetStats(&s_canRxRing, &st);
+
+    CLI_IF_Printf("Ring: %lu/%lu, peak %lu, dropped %lu\r\n",
+                  (unsigned long)st.count, (unsigned long)st.capacity,
+                  (unsigned long)st.highWater, (unsigned long)st.overflows);
+    CLI_IF_Print("Latest ID      Taken   Replaced\r\n");
+    for (uint32_t i = 0U; i < CAN_LATEST_COUNT; ++i)
+    {
+        CLI_IF_Printf("%*s0x%0*lX %10lu %10lu\r\n",
+                      ((s_canLatestIds[i] & CAN_IF_ID_EXT) != 0U) ? 0 : 5, "",
+                      ((s_canLatestIds[i] & CAN_IF_ID_EXT) != 0U) ? 8 : 3,
+                      (unsigned long)(s_canLatestIds[i] & CAN_IF_ID_MASK),
+                      (unsigned long)s_canLatestStats[i].taken,
+                      (unsigned long)s_canLatestStats[i].replaced);
+    }
+#if CAN_IF_ISR_DECODERS
+    if (s_canIsrDecCount != 0U)
+        CLI_IF_Print("ISR ID       Decoded    Dropped\r\n");
+    for (uint32_t i = 0U; i < s_canIsrDecCount; ++i)
+    {
+        const CanIsrDecoder_t *d = &s_canIsrDec[i];
+
+        CLI_IF_Printf("%*s0x%0*lX %10lu %10lu\r\n",
+                      ((d->key & CAN_IF_ID_EXT) != 0U) ? 0 : 5, "",
+                      ((d->key & CAN_IF_ID_EXT) != 0U) ? 8 : 3,
+                      (unsigned long)(d->key & CAN_IF_ID_MASK),
+                      (unsigned long)d->frames, (unsigned long)d->dropped);
+    }
+#endif
+}
+
+/**
+ * @brief CLI: "can txarb [prio|fifo]" - show or set the mailbox arbitration
+ *        of every driven bus.
+ */
+static void can_cmd_txarb(int argc, char *argv[])
+{
+    if (argc > 0)
+    {
+        uint8_t fifo;
+
+        if ((argc == 1) && (strcmp(argv[0], "fifo") == 0))
+            fifo = 1U;
+        else if ((argc == 1) && (strcmp(argv[0], "prio") == 0))
+            fifo = 0U;
+        else
+        {
+            CLI_IF_Print("Usage: can txarb [prio|fifo]\r\n");
+            return;
+        }
+        for (uint32_t bus = 0U; bus < CAN_IF_NUM_BUSES; ++bus)
+            (void)CAN_IF_SetTxFifo(bus, fifo);
+    }
+
+    for (uint32_t bus = 0U; bus < CAN_IF_NUM_BUSES; ++bus)
+    {
+        CLI_IF_Printf("CAN%lu: mailboxes by %s, in-order frames in up to %u\r\n",
+                      (unsigned long)(bus + 1U),
+                      (CAN_IF_GetTxFifo(bus) != 0U) ? "load order" : "identifier",
+                      (unsigned)CAN_IF_TX_IN_ORDER_MAILBOXES);
+    }
+}
+
+static const CliCommand_t s_canCmds[] =
+{
+    { "can bitrate", "[<bps> [<mode>]]", 0U, can_cmd_bitrate,
+      "show or set CAN bit timing" },
+    { "can mode",    "[normal|loopback|silent|silent-loopback]", 0U, can_cmd_mode,
+      "show or set the CAN1 operating mode" },
+    { "can rx",      "", 0U, can_cmd_rx, "RX ring fill and drops, latest-value slots, ISR decoders" },
+    { "can txarb",   "[prio|fifo]", 0U, can_cmd_txarb,
+      "show or set the TX mailbox arbitration" },
+};
+
+#if CAN_IF_NUM_BUSES > 1U
+/**
+ * @brief Bring up CAN2 with CAN1's bit timing and the gateway's filters.
+ *
+ * CAN2 is still in init mode from HAL_CAN_Init(), so BTR can be written.
+ */
+static HAL_StatusTypeDef can_bus2_start(void)
+{
+    CanBus_t          *b = &s_canBus[CAN_IF_BUS2];
+    CanFilter_Entry_t  filters[CAN_FILTERS_TOTAL_BANKS - CAN_FILTERS_SLAVE_START_BANK];
+    uint32_t           n = CanGw_GetFilters(CAN_IF_BUS2, filters,
+                                            (uint32_t)(sizeof(filters) / sizeof(filters[0])));
+    HAL_StatusTypeDef  status;
+
+    if (n > (uint32_t)(sizeof(filters) / sizeof(filters[0])))
+    {
+        LOG_ERROR(CAN, "%lu gateway routes from CAN2, %lu filter banks",
+                  (unsigned long)n, (unsigned long)(sizeof(filters) / sizeof(filters[0])));
+        return HAL_ERROR;
+    }
+
+    /* Both controllers are on APB1. */
+    hcan2.Instance->BTR = CanTiming_ToBtr(&s_canTiming, hcan2.Init.Mode);
+    CanTiming_ToInit(&s_canTiming, &hcan2.Init);
+
+    status = CanFilters_ApplySlave(&hcan2, filters, n);
+    if (status != HAL_OK)
+        return status;
+
+    CanTxSub_Init(&b->txSub);
+    CanTxQ_Init(&b->txQueue);
+    memset(&b->txStats, 0, sizeof(b->txStats));
+    b->txRefused = 0U;
+
+    status = HAL_CAN_Start(&hcan2);
+    if (status != HAL_OK)
+        return status;
+
+#if CAN_IF_RX_FAST_IRQ
+    /* The RX interrupts of both controllers at one priority (can_gw.c). */
+    HAL_NVIC_SetPriority(CAN2_RX0_IRQn, CAN_IF_RX_IRQ_PRIO, 0U);
+#endif
+
+    /* Bus-off recovers in hardware (AutoBusOff, MX_CAN2_Init()); errors
+     * are only cleared. */
+    status = HAL_CAN_ActivateNotification(&hcan2, CAN_IT_RX_FIFO0_MSG_PENDING |
+                                                  CAN_IT_TX_MAILBOX_EMPTY     |
+                                                  CAN_IT_ERROR                |
+                                                  CAN_IT_BUSOFF);
+    if (status != HAL_OK)
+        return status;
+
+    (void)CAN_IF_SetTxFifo(CAN_IF_BUS2, CAN_IF_TX_FIFO);
+    b->running = 1U;
+    LOG_INFO(CAN, "CAN2 started, %lu gateway filters", (unsigned long)n);
+    return HAL_OK;
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Telemetry schedule                                                         */
+/* -------------------------------------------------------------------------- */
+
+/* Deadbands in raw signal units, folded at compile time: the schedule
+ * runs in CanTxTask, which stays off the FPU (rtos_fpu.h). */
+#define CAN_TELEM_DB_SPEED_RAW_ \
+    ((int32_t)((CAN_IF_TELEM_DB_SPEED_KPH * CANSIG_VEHICLE_TELEMETRY_SPEED_KPH_SCALE) + 0.5f))
+#define CAN_TELEM_DB_TEMP_RAW_ \
+    ((int32_t)((CAN_IF_TELEM_DB_TEMP_C * CANSIG_VEHICLE_TELEMETRY_COOLANT_TEMP_C_SCALE) + 0.5f))
+
+/** Raw signals carried by the last telemetry frame, for the deadbands. */
+static CanSig_VehicleTelemetry_Raw_t s_canTelemSent;
+
+static HAL_StatusTypeDef can_telem_tx(uint32_t id, const CanSig_VehicleTelemetry_Raw_t *raw);
+
+/** CanTxTask: has the published state moved beyond a deadband? */
+static uint8_t can_telem_changed(void *ctx)
+{
+    (void)ctx;
+
+    CanSig_VehicleTelemetry_Raw_t raw = { 0 };
+    Vehicle_GetTelemetry(&raw);
+
+    int32_t dspeed = (int32_t)raw.speed_kph - (int32_t)s_canTelemSent.speed_kph;
+    int32_t drpm   = (int32_t)raw.engine_rpm - (int32_t)s_canTelemSent.engine_rpm;
+    int32_t dtemp  = (int32_t)raw.coolant_temp_c - (int32_t)s_canTelemSent.coolant_temp_c;
+
+    return ((abs(dspeed) >= CAN_TELEM_DB_SPEED_RAW_) ||
+            ((uint32_t)abs(drpm) >= CAN_IF_TELEM_DB_RPM) ||
+            (abs(dtemp) >= CAN_TELEM_DB_TEMP_RAW_))
+           ? 1U : 0U;
+}
+
+/** CanTxTask: send the published state. */
+static HAL_StatusTypeDef can_telem_send(void *ctx)
+{
+    (void)ctx;
+
+    CanSig_VehicleTelemetry_Raw_t raw = { 0 };
+    Vehicle_GetTelemetry(&raw);
+
+    PERF_BEGIN(CAN_TX_TELEM);
+    HAL_StatusTypeDef status = can_telem_tx(CAN_IF_TELEMETRY_ID, &raw);
+    PERF_END(CAN_TX_TELEM);
+
+    if (status == HAL_OK)
+        s_canTelemSent = raw;
+    return status;
+}
+
+/* Mailbox image of the telemetry frame, built once by CAN_IF_Init(). */
+static CAN_IF_TxTemplate_t s_canTelemTx;
+
+/* Cycle and gap are calibration values, set by CAN_IF_Init(). */
+static CanSched_Frame_t s_canTelemFrame =
+{
+    .name     = "telemetry",
+    .id       = CAN_IF_TELEMETRY_ID,
+    .cycleMs  = CAN_IF_TELEM_CYCLE_MS,
+    .minGapMs = CAN_IF_TELEM_MIN_GAP_MS,
+    .offsetMs = CAN_IF_TELEM_OFFSET_MS,
+    .changed  = can_telem_changed,
+    .send     = can_telem_send,
+    .ctx      = NULL,
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef CAN_IF_Init(void)
+{
+    HAL_StatusTypeDef status = HAL_OK;
+
+    /* --- 0. Prepare RX ring before any RX interrupt can fire. ------------ */
+    status = CanRing_Init(&s_canRxRing, s_canRxSlots,
+                          sizeof(CAN_IF_Msg_t), CAN_IF_RX_RING_SIZE);
+    if (status != HAL_OK)
+    {
+        LOG_ERROR(CAN, "Failed to init CAN RX ring");
+        return status;
+    }
+    s_canRxRingReady = 1U;
+
+    /* Registered first so "can bitrate" is available even if bring-up
+     * fails below. */
+    CLI_IF_REGISTER_TABLE(s_canCmds);
+    CanSched_Init();
+    CanE2E_Init();
+    CAN_IF_TxTemplateInit(&s_canTelemTx, CAN_IF_TELEMETRY_ID, CANSIG_VEHICLE_TELEMETRY_DLC);
+    s_canTelemFrame.cycleMs  = (uint16_t)CAL_U(CAN_TELEM_CYCLE);
+    s_canTelemFrame.minGapMs = (uint16_t)CAL_U(CAN_TELEM_GAP);
+    (void)CanSched_Add(&s_canTelemFrame);
+    CanBusOff_Init();
+    CanRxLimit_Init();
+    CanTrace_Init();
+#if CAN_LAT_ENABLE
+    CanLat_Init();
+#endif
+
+    /* --- 1. Bit timing for the active clock profile. --------------------- */
+    status = can_apply_timing(CAN_IF_BITRATE, CAN_IF_MODE);
+    if (status != HAL_OK)
+    {
+        LOG_ERROR(CAN, "No bit timing for %lu bit/s at PCLK1=%lu Hz",
+                  (unsigned long)CAN_IF_BITRATE,
+                  (unsigned long)HAL_RCC_GetPCLK1Freq());
+        return status;
+    }
+    LOG_INFO(CAN, "Bitrate %lu bit/s (presc %lu, %u TQ, SP %u.%u%%)",
+             (unsigned long)s_canTiming.bitrate,
+             (unsigned long)s_canTiming.prescaler,
+             (unsigned)s_canTiming.tqPerBit,
+             (unsigned)(s_canTiming.samplePoint / 10U),
+             (unsigned)(s_canTiming.samplePoint % 10U));
+
+    /* --- 2. Configure filters from the declarative table. ---------------- */
+    status = can_apply_filters(s_canMode);
+    if (status != HAL_OK)
+    {
+        LOG_ERROR(CAN, "CanFilters_Apply failed, status=%ld err=0x%08lX",
+                  (long)status, (unsigned long)hcan1.ErrorCode);
+        return status;
+    }
+
+    s_canBus[CAN_IF_BUS1].silent = (s_canMode == CAN_MODE_SILENT) ? 1U : 0U;
+    if (s_canBus[CAN_IF_BUS1].silent == 0U)
+        can_check_latest();
+
+    CanTxSub_Init(&s_canBus[CAN_IF_BUS1].txSub);
+    CanTxQ_Init(&s_canBus[CAN_IF_BUS1].txQueue);
+    memset(&s_canBus[CAN_IF_BUS1].txStats, 0, sizeof(s_canBus[CAN_IF_BUS1].txStats));
+    s_canBus[CAN_IF_BUS1].txRefused = 0U;
+
+    /* --- 3. Start CAN peripheral. ---------------------------------------- */
+    status = HAL_CAN_Start(&hcan1);
+    if (status != HAL_OK)
+    {
+        LOG_ERROR(CAN, "HAL_CAN_Start failed, status=%ld err=0x%08lX",
+                  (long)status, (unsigned long)hcan1.ErrorCode);
+        return status;
+    }
+
+#if CAN_IF_RX_FAST_IRQ
+    /* --- 3a. RX above the kernel, hand-off at the kernel priority. ------- */
+    CanRing_SetNotifyHook(&s_canRxRing, can_rx_pend_swi);
+    HAL_NVIC_SetPriority(CAN_IF_RX_SWI_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, 0U);
+    HAL_NVIC_EnableIRQ(CAN_IF_RX_SWI_IRQn);
+    HAL_NVIC_SetPriority(CAN1_RX0_IRQn, CAN_IF_RX_IRQ_PRIO, 0U);
+    HAL_NVIC_SetPriority(CAN1_RX1_IRQn, CAN_IF_RX_IRQ_PRIO, 0U);
+#endif
+
+    /* --- 4. Enable RX + error notifications. ----------------------------- */
+    uint32_t notifFlags =
+        CAN_IT_RX_FIFO0_MSG_PENDING |
+        CAN_IT_RX_FIFO1_MSG_PENDING |
+        CAN_IT_TX_MAILBOX_EMPTY     |
+        CAN_IT_BUSOFF               |
+        CAN_IT_ERROR                |
+        CAN_IT_LAST_ERROR_CODE      |
+        CAN_IT_ERROR_WARNING        |
+        CAN_IT_ERROR_PASSIVE        |
+        CAN_IT_WAKEUP;
+
+    status = HAL_CAN_ActivateNotification(&hcan1, notifFlags);
+    if (status != HAL_OK)
+    {
+        LOG_ERROR(CAN, "HAL_CAN_ActivateNotification failed, status=%ld err=0x%08lX",
+                  (long)status, (unsigned long)hcan1.ErrorCode);
+        return status;
+    }
+    (void)CAN_IF_SetTxFifo(CAN_IF_BUS1, CAN_IF_TX_FIFO);
+    s_canBus[CAN_IF_BUS1].running = 1U;
+
+#if CAN_IF_NUM_BUSES > 1U
+    /* --- 5. CAN2 for the gateway; CAN1 runs on without it. --------------- */
+    CanGw_Init();
+    status = can_bus2_start();
+    if (status != HAL_OK)
+    {
+        LOG_ERROR(CAN, "CAN2 start failed, status=%ld err=0x%08lX, gateway off",
+                  (long)status, (unsigned long)hcan2.ErrorCode);
+    }
+#endif
+
+    LOG_INFO(CAN, "CAN_IF initialized successfully");
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef CAN_IF_SetBitrate(uint32_t bitrate, uint32_t mode)
+{
+    CanTiming_t t;
+
+    /* Validate first so a bad request leaves the bus running. */
+    if (((mode & ~CAN_MODE_SILENT_LOOPBACK) != 0U) ||
+        (CanTiming_Compute(HAL_RCC_GetPCLK1Freq(), bitrate,
+                           CAN_TIMING_SAMPLE_POINT, &t) != HAL_OK))
+        return HAL_ERROR;
+
+    if (can_reconfig_claim() == 0U)
+        return HAL_BUSY;
+
+    CanBus_t *b      = &s_canBus[CAN_IF_BUS1];
+    uint8_t   silent = (mode == CAN_MODE_SILENT) ? 1U : 0U;
+    uint8_t   swap   = (silent != b->silent) ? 1U : 0U;
+
+    /* Nothing could leave the mailboxes in listen-only mode. */
+    if ((silent != 0U) && (swap != 0U))
+    {
+        b->silent = 1U;
+        (void)can_tx_flush();
+    }
+
+    uint8_t running = (HAL_CAN_GetState(&hcan1) == HAL_CAN_STATE_LISTENING) ? 1U : 0U;
+
+    if (running != 0U)
+    {
+        if (HAL_CAN_Stop(&hcan1) != HAL_OK)
+        {
+            b->silent     = (s_canMode == CAN_MODE_SILENT) ? 1U : 0U;
+            s_canReconfig = 0U;
+            return HAL_ERROR;
+        }
+    }
+
+    HAL_StatusTypeDef status = can_apply_timing(bitrate, mode);
+
+    if ((status == HAL_OK) && (swap != 0U))
+    {
+        status = can_apply_filters(mode);
+        b->silent = silent;
+    }
+
+    if (running != 0U)
+    {
+        HAL_StatusTypeDef st = HAL_CAN_Start(&hcan1);
+        if (status == HAL_OK)
+            status = st;
+    }
+    s_canReconfig = 0U;
+
+    if (status == HAL_OK)
+    {
+        LOG_INFO(CAN, "Bitrate %lu bit/s, %s",
+                 (unsigned long)s_canTiming.bitrate, can_mode_name(mode));
+    }
+    return status;
+}
+
+HAL_StatusTypeDef CAN_IF_SetMode(uint32_t mode)
+{
+    return CAN_IF_SetBitrate(s_canBitrate, mode);
+}
+
+HAL_StatusTypeDef CAN_IF_Sleep(void)
+{
+    if (can_reconfig_claim() == 0U)
+        return HAL_BUSY;
+
+    CanBus_t *b = &s_canBus[CAN_IF_BUS1];
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    b->asleep = 1U;
+    __set_PRIMASK(primask);
+
+    /* Sleep is entered once the bus is idle; nothing may be left to send. */
+    uint32_t dropped = can_tx_flush();
+    HAL_StatusTypeDef status = HAL_CAN_RequestSleep(&hcan1);
+
+    s_canReconfig = 0U;
+    if (status != HAL_OK)
+    {
+        b->asleep = 0U;
+        return status;
+    }
+
+    if (dropped != 0U)
+        LOG_DEBUG(CAN, "Sleep: %lu queued frames dropped", (unsigned long)dropped);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef CAN_IF_WakeUp(void)
+{
+    if (can_reconfig_claim() == 0U)
+        return HAL_BUSY;
+
+    /* Already awake if the bus woke the controller (AutoWakeUp). */
+    HAL_StatusTypeDef status = HAL_CAN_WakeUp(&hcan1);
+
+    if (status == HAL_OK)
+        s_canBus[CAN_IF_BUS1].asleep = 0U;
+    s_canReconfig = 0U;
+    return status;
+}
+
+void CAN_IF_WakeUpFromIsr(void)
+{
+    /* SLEEP off without the wait for SLAK: the controller joins the bus
+       after 11 recessive bits. CAN_IF_WakeUp() still follows for the rest. */
+    hcan1.Instance->MCR &= ~CAN_MCR_SLEEP;
+}
+
+uint8_t CAN_IF_IsAsleep(void)
+{
+    return s_canBus[CAN_IF_BUS1].asleep;
+}
+
+uint8_t CAN_IF_ClockFits(uint32_t pclk1Hz)
+{
+    CanTiming_t t;
+
+    return (CanTiming_Compute(pclk1Hz, s_canBitrate, CAN_TIMING_SAMPLE_POINT, &t) == HAL_OK)
+               ? 1U : 0U;
+}
+
+HAL_StatusTypeDef CAN_IF_ClockPrepare(void)
+{
+    if (can_reconfig_claim() == 0U)
+        return HAL_BUSY;
+
+    /* The sleep mode holds no timing to redo, but would be left by Stop. */
+    if (s_canBus[CAN_IF_BUS1].asleep != 0U)
+    {
+        s_canReconfig = 0U;
+        return HAL_BUSY;
+    }
+
+    s_canClockStopped = 0U;
+    if (HAL_CAN_GetState(&hcan1) == HAL_CAN_STATE_LISTENING)
+    {
+        if (HAL_CAN_Stop(&hcan1) != HAL_OK)
+        {
+            s_canReconfig = 0U;
+            return HAL_ERROR;
+        }
+        s_canClockStopped |= 1U << CAN_IF_BUS1;
+    }
+#if CAN_IF_NUM_BUSES > 1U
+    if ((s_canBus[CAN_IF_BUS2].running != 0U) &&
+        (HAL_CAN_GetState(&hcan2) == HAL_CAN_STATE_LISTENING) &&
+        (HAL_CAN_Stop(&hcan2) == HAL_OK))
+    {
+        s_canClockStopped |= 1U << CAN_IF_BUS2;
+    }
+#endif
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef CAN_IF_ClockResume(void)
+{
+    /* CAN_IF_ClockFits() was asked before the switch. */
+    HAL_StatusTypeDef status = can_apply_timing(s_canBitrate, s_canMode);
+
+    if ((s_canClockStopped & (1U << CAN_IF_BUS1)) != 0U)
+    {
+        HAL_StatusTypeDef st = HAL_CAN_Start(&hcan1);
+        if (status == HAL_OK)
+            status = st;
+    }
+#if CAN_IF_NUM_BUSES > 1U
+    if ((s_canClockStopped & (1U << CAN_IF_BUS2)) != 0U)
+    {
+        hcan2.Instance->BTR = CanTiming_ToBtr(&s_canTiming, hcan2.Init.Mode);
+        CanTiming_ToInit(&s_canTiming, &hcan2.Init);
+        HAL_StatusTypeDef st = HAL_CAN_Start(&hcan2);
+        if (status == HAL_OK)
+            status = st;
+    }
+#endif
+    s_canClockStopped = 0U;
+    s_canReconfig     = 0U;
+    return status;
+}
+
+HAL_StatusTypeDef CAN_IF_Restart(uint8_t flushTx, uint32_t *flushed)
+{
+    uint32_t dropped = 0U;
+
+    if (can_reconfig_claim() == 0U)
+        return HAL_BUSY;
+
+    if (flushTx != 0U)
+        dropped = can_tx_flush();
+
+    /* A restart that timed out leaves the handle in ERROR, which
+     * HAL_CAN_Start() refuses; the registers are still configured. */
+    if (HAL_CAN_GetState(&hcan1) == HAL_CAN_STATE_ERROR)
+        hcan1.State = HAL_CAN_STATE_READY;
+
+    HAL_StatusTypeDef status = HAL_OK;
+    if (HAL_CAN_GetState(&hcan1) == HAL_CAN_STATE_LISTENING)
+        status = HAL_CAN_Stop(&hcan1);
+    if (status == HAL_OK)
+        status = HAL_CAN_Start(&hcan1);
+
+    s_canReconfig = 0U;
+
+    if (flushed != NULL)
+        *flushed = dropped;
+    return status;
+}
+
+HAL_StatusTypeDef CAN_IF_MuteFilter(uint32_t entry, uint8_t muted)
+{
+    if (can_reconfig_claim() == 0U)
+        return HAL_BUSY;
+
+    HAL_StatusTypeDef status = CanFilters_SetMuted(&hcan1, entry, muted);
+
+    s_canReconfig = 0U;
+    return status;
+}
+
+uint8_t CAN_IF_IsBusOff(void)
+{
+    return ((hcan1.Instance->ESR & CAN_ESR_BOFF) != 0U) ? 1U : 0U;
+}
+
+uint32_t CAN_IF_GetBitTiming(CanTiming_t *timing)
+{
+    if (timing != NULL)
+        *timing = s_canTiming;
+
+    return s_canMode;
+}
+
+HAL_StatusTypeDef CAN_IF_Transmit(uint32_t id, const uint8_t *data, uint8_t dlc)
+{
+    return CAN_IF_TransmitBus(CAN_IF_BUS1, id, data, dlc);
+}
+
+HAL_StatusTypeDef CAN_IF_TransmitBus(uint32_t bus, uint32_t id, const uint8_t *data, uint8_t dlc)
+{
+    /* bxCAN has no FD frame format: a longer payload has no mailbox. */
+    if ((dlc > CAN_IF_CLASSIC_DLEN) || ((data == NULL) && (dlc > 0U)))
+        return HAL_ERROR;
+
+    CAN_IF_TxTemplate_t t;
+
+    CAN_IF_TxTemplateInit(&t, id, dlc);
+    return CAN_IF_TransmitTemplate(bus, &t, data);
+}
+
+void CAN_IF_TxTemplateInit(CAN_IF_TxTemplate_t *t, uint32_t id, uint8_t dlc)
+{
+    t->key  = ((id & CAN_IF_ID_EXT) != 0U) ? (id & (CAN_IF_ID_EXT | CAN_IF_ID_MASK))
+                                            : (id & 0x7FFU);
+    t->tir  = can_tx_tir(t->key);
+    t->tdtr = (dlc > 8U) ? 8U : dlc;
+    if ((id & CAN_IF_TX_IN_ORDER) != 0U)
+        t->tdtr |= CAN_TXQ_IN_ORDER;
+    t->e2e  = CanE2E_Find(t->key);
+    t->sec  = CanSecOC_Find(t->key);
+}
+
+HAL_StatusTypeDef CAN_IF_TransmitTemplate(uint32_t bus, const CAN_IF_TxTemplate_t *t,
+                                          const uint8_t *data)
+{
+    if ((bus >= CAN_IF_NUM_BUSES) || (s_canBus[bus].running == 0U) || (t == NULL) ||
+        ((data == NULL) && ((t->tdtr & CAN_TDT0R_DLC) > 0U)))
+        return HAL_ERROR;
+
+    CanBus_t    *b   = &s_canBus[bus];
+    uint8_t      dlc = (uint8_t)(t->tdtr & CAN_TDT0R_DLC);
+    CanTxFrame_t f;
+
+    /* Asleep: refused before a freshness value or a counter is used up. */
+    if (b->asleep != 0U)
+        return HAL_BUSY;
+
+    f.tir     = t->tir;
+    f.tdtr    = t->tdtr;
+    f.data[0] = 0U;
+    f.data[1] = 0U;
+    if (dlc > 0U)
+        memcpy(f.data, data, dlc);
+
+    /* The MAC (can_secoc.h) is computed here, outside the critical
+     * section; HAL_BUSY while its freshness value is not yet stored. */
+    if (t->sec != CAN_SECOC_NONE)
+    {
+        HAL_StatusTypeDef st = CanSecOC_Protect(t->sec, (uint8_t *)f.data, dlc);
+        if (st != HAL_OK)
+            return st;
+    }
+
+#if CAN_LAT_ENABLE
+    uint32_t t0 = DWT->CYCCNT;
+#endif
+
+    /* No masking: the slot is this caller's until it is published, and
+     * only the TX interrupt touches the queue and the mailboxes. The E2E
+     * counter moves only for a frame that got a slot; each E2E identifier
+     * has a single sender, so it needs no lock either. */
+    CanTxFrame_t     *slot;
+    HAL_StatusTypeDef status = can_tx_claim(b, &slot);
+    if (status != HAL_OK)
+        return status;
+
+    *slot = f;
+    if ((t->e2e != CAN_E2E_NONE) && (CanE2E_Protect(t->e2e, (uint8_t *)slot->data, dlc) != 0U))
+        CanE2E_Sent(t->e2e);
+
+    /* Stamped before the frame can reach a mailbox, so the loopback RX
+     * cannot come first; masked for the recorder's own state. */
+#if CAN_LAT_ENABLE
+    if ((bus == CAN_IF_BUS1) && ((s_canMode & CAN_MODE_LOOPBACK) != 0U))
+    {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        CanLat_TxRequest(t->key, t0);
+        __set_PRIMASK(primask);
+    }
+#endif
+
+    can_tx_publish(b, slot);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef CAN_IF_TransmitUrgent(const CAN_IF_TxTemplate_t *t, const uint8_t *data)
+{
+#if CAN_IF_TX_URGENT
+    CanBus_t *b   = &s_canBus[CAN_IF_BUS1];
+    uint8_t   dlc = (t != NULL) ? (uint8_t)(t->tdtr & CAN_TDT0R_DLC) : 0U;
+
+    if ((b->running == 0U) || (b->silent != 0U) || (t == NULL) ||
+        (t->sec != CAN_SECOC_NONE) || ((data == NULL) && (dlc > 0U)))
+        return HAL_ERROR;
+    if (b->asleep != 0U)
+        return HAL_BUSY;
+
+    uint32_t words[2] = { 0U, 0U };
+    if (dlc > 0U)
+        memcpy(words, data, dlc);
+
+    CAN_TypeDef           *can = hcan1.Instance;
+    CAN_TxMailBox_TypeDef *m   = &can->sTxMailBox[CAN_IF_TX_URGENT_MAILBOX];
+
+    /* Masked so a bus-off flush or a mode change cannot abort the mailbox
+     * half written. RQCP still set: the TX interrupt has yet to confirm the
+     * previous frame, whose confirmation must not be taken for this one. */
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (((m->TIR & CAN_TI0R_TXRQ) != 0U) ||
+        ((can->TSR & (CAN_TSR_RQCP0 << (8U * CAN_IF_TX_URGENT_MAILBOX))) != 0U))
+    {
+        __set_PRIMASK(primask);
+        return HAL_BUSY;
+    }
+    if ((t->e2e != CAN_E2E_NONE) && (CanE2E_Protect(t->e2e, (uint8_t *)words, dlc) != 0U))
+        CanE2E_Sent(t->e2e);
+    m->TDTR = dlc;
+    m->TDLR = words[0];
+    m->TDHR = words[1];
+    m->TIR  = t->tir | CAN_TI0R_TXRQ;
+    CanStats_OnTx(t->key, dlc);
+    b->tsynMb &= (uint8_t)~(1U << CAN_IF_TX_URGENT_MAILBOX);
+    __set_PRIMASK(primask);
+
+    /* Nothing to queue; the SIL shim sends its mailboxes from here. */
+    NVIC_SetPendingIRQ(b->txIrq);
+    return HAL_OK;
+#else
+    (void)t;
+    (void)data;
+    return HAL_ERROR;
+#endif
+}
+
+RAMFUNC HAL_StatusTypeDef CAN_IF_Forward(uint32_t bus, uint32_t id, const uint8_t *data, uint8_t dlc)
+{
+    if ((bus >= CAN_IF_NUM_BUSES) || (s_canBus[bus].running == 0U))
+        return HAL_ERROR;
+
+    CanBus_t         *b = &s_canBus[bus];
+    CanTxFrame_t     *f;
+    HAL_StatusTypeDef status = can_tx_claim(b, &f);
+    if (status != HAL_OK)
+        return status;
 
-/** Flag controlled by CLI to turn CAN RX logging on/off. */
-static uint8_t s_canLoggingEnabled = 0U;
+    /* A gateway keeps the order of every identifier it forwards. */
+    f->tir  = can_tx_tir(id);
+    f->tdtr = ((dlc > 8U) ? 8U : dlc) | CAN_TXQ_IN_ORDER;
+    /* Bytes, not memcpy(): this runs from SRAM (ramfunc.h), and the RX
+     * slot's payload need not be word-aligned. */
+    uint8_t *bytes = (uint8_t *)f->data;
+    for (uint32_t k = 0U; k < 8U; ++k)
+        bytes[k] = data[k];
 
-/* -------------------------------------------------------------------------- */
-/* Public API                                                                 */
-/* -------------------------------------------------------------------------- */
+    /* The RX interrupt may run above the TX one (CAN_IF_RX_FAST_IRQ): the
+     * frame is queued once this interrupt returns. */
+    can_tx_publish(b, f);
+    return HAL_OK;
+}
 
-HAL_StatusTypeDef CAN_IF_Init(void)
+HAL_StatusTypeDef CAN_IF_SetTxFifo(uint32_t bus, uint8_t fifo)
 {
-    HAL_StatusTypeDef status = HAL_OK;
+    if (bus >= CAN_IF_NUM_BUSES)
+        return HAL_ERROR;
 
-    /* --- 1. Configure filter: accept all IDs into FIFO0. ----------------- */
-    CAN_FilterTypeDef filterCfg;
-    memset(&filterCfg, 0, sizeof(filterCfg));
-
-    filterCfg.FilterBank           = 0;
-    filterCfg.FilterMode           = CAN_FILTERMODE_IDMASK;
-    filterCfg.FilterScale          = CAN_FILTERSCALE_32BIT;
-    filterCfg.FilterIdHigh         = 0x0000;
-    filterCfg.FilterIdLow          = 0x0000;
-    filterCfg.FilterMaskIdHigh     = 0x0000;
-    filterCfg.FilterMaskIdLow      = 0x0000;
-    filterCfg.FilterFIFOAssignment = CAN_FILTER_FIFO0;
-    filterCfg.FilterActivation     = ENABLE;
-    filterCfg.SlaveStartFilterBank = 14;
-
-    status = HAL_CAN_ConfigFilter(&hcan1, &filterCfg);
-    if (status != HAL_OK)
-    {
-        LOG_ERROR("CAN", "HAL_CAN_ConfigFilter failed, status=%ld err=0x%08lX",
-                  (long)status, (unsigned long)hcan1.ErrorCode);
-        return status;
-    }
+    CanBus_t *b = &s_canBus[bus];
 
-    /* --- 2. Start CAN peripheral. ---------------------------------------- */
-    status = HAL_CAN_Start(&hcan1);
-    if (status != HAL_OK)
-    {
-        LOG_ERROR("CAN", "HAL_CAN_Start failed, status=%ld err=0x%08lX",
-                  (long)status, (unsigned long)hcan1.ErrorCode);
-        return status;
-    }
+    /* TXFP may change at any time; the TX interrupt reads txFifo. */
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    b->txFifo = (fifo != 0U) ? 1U : 0U;
+    if (b->txFifo != 0U)
+        b->hcan->Instance->MCR |= CAN_MCR_TXFP;
+    else
+        b->hcan->Instance->MCR &= ~CAN_MCR_TXFP;
+    __set_PRIMASK(primask);
+    return HAL_OK;
+}
 
-    /* --- 3. Enable RX + error notifications. ----------------------------- */
-    uint32_t notifFlags =
-        CAN_IT_RX_FIFO0_MSG_PENDING |
-        CAN_IT_BUSOFF               |
-        CAN_IT_ERROR                |
-        CAN_IT_LAST_ERROR_CODE      |
-        CAN_IT_ERROR_WARNING;
+uint8_t CAN_IF_GetTxFifo(uint32_t bus)
+{
+    return (bus < CAN_IF_NUM_BUSES) ? s_canBus[bus].txFifo : 0U;
+}
 
-    status = HAL_CAN_ActivateNotification(&hcan1, notifFlags);
-    if (status != HAL_OK)
+void CAN_IF_GetTxStats(CAN_IF_TxStats_t *stats)
+{
+    CAN_IF_GetBusTxStats(CAN_IF_BUS1, stats);
+}
+
+void CAN_IF_GetBusTxStats(uint32_t bus, CAN_IF_TxStats_t *stats)
+{
+    if (stats == NULL)
+        return;
+    if (bus >= CAN_IF_NUM_BUSES)
     {
-        LOG_ERROR("CAN", "HAL_CAN_ActivateNotification failed, status=%ld err=0x%08lX",
-                  (long)status, (unsigned long)hcan1.ErrorCode);
-        return status;
+        memset(stats, 0, sizeof(*stats));
+        return;
     }
 
-    /* --- 4. Create RX message queue. ------------------------------------- */
-    const osMessageQueueAttr_t queueAttr =
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *stats = s_canBus[bus].txStats;
+    stats->dropped += s_canBus[bus].txRefused;
+    __set_PRIMASK(primask);
+}
+
+void CAN_IF_SendTelemetry(const VehicleState_t *vs)
+{
+    PERF_BEGIN(CAN_TX_TELEM);
+
+    /* Non-blocking; a full queue is accounted in the TX stats. */
+    (void)CAN_IF_SendTelemetryId(CAN_IF_TELEMETRY_ID, vs);
+
+    PERF_END(CAN_TX_TELEM);
+}
+
+HAL_StatusTypeDef CAN_IF_SendTelemetryId(uint32_t id, const VehicleState_t *vs)
+{
+    if (vs == NULL)
+        return HAL_ERROR;
+
+    const CanSig_VehicleTelemetry_t m =
     {
-        .name = "CanRxQueue"
+        .speed_kph      = vs->speed_kph,
+        .engine_rpm     = vs->engine_rpm,
+        .coolant_temp_c = vs->coolant_temp_c,
     };
+    CanSig_VehicleTelemetry_Raw_t raw;
+
+    CanSig_VehicleTelemetry_ToRaw(&m, &raw);
+    return can_telem_tx(id, &raw);
+}
+
+/** The telemetry frame from raw signals; no floating point. */
+static HAL_StatusTypeDef can_telem_tx(uint32_t id, const CanSig_VehicleTelemetry_Raw_t *raw)
+{
+    uint8_t data[CANSIG_VEHICLE_TELEMETRY_DLC];
+
+    CanSig_VehicleTelemetry_PackRaw(data, raw);
+
+    if (id != CAN_IF_TELEMETRY_ID)
+        return CAN_IF_Transmit(id, data, CANSIG_VEHICLE_TELEMETRY_DLC);
+
+    HAL_StatusTypeDef status = CAN_IF_TransmitTemplate(CAN_IF_BUS1, &s_canTelemTx, data);
+    if (status == HAL_OK)
+        BootProf_Mark(BOOT_PROF_TELEMETRY);
+    return status;
+}
 
-    s_canRxQueue = osMessageQueueNew(8U, sizeof(CAN_IF_Msg_t), &queueAttr);
-    if (s_canRxQueue == NULL)
+void CAN_IF_SetLogging(uint8_t enable)
+{
+    s_canLoggingEnabled = (enable != 0U) ? 1U : 0U;
+    LOG_INFO(CAN, "RX logging %s", s_canLoggingEnabled ? "ENABLED" : "DISABLED");
+}
+
+CanRing_t *CAN_IF_GetRxRing(void)
+{
+    return (s_canRxRingReady != 0U) ? &s_canRxRing : NULL;
+}
+
+HAL_StatusTypeDef CAN_IF_InjectRx(uint32_t key, uint8_t len, uint32_t fifo, const uint8_t *data)
+{
+    if (s_canRxRingReady == 0U)
+        return HAL_ERROR;
+    if (len > CAN_IF_MAX_DLEN)
+        len = (uint8_t)CAN_IF_MAX_DLEN;
+
+    /* Above 8 bytes an FD frame, its payload filled up to the DLC code. */
+    uint8_t  dlc   = CAN_IF_LenToDlc(len);
+    uint8_t  fd    = (len > CAN_IF_CLASSIC_DLEN) ? 1U : 0U;
+    uint8_t  fill  = (fd != 0U) ? CAN_IF_DlcToLen(dlc, 1U) : (uint8_t)CAN_IF_CLASSIC_DLEN;
+    uint32_t flags = (fd != 0U) ? (CAN_IF_MSG_INFO_FDF | CAN_IF_MSG_INFO_BRS) : 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    CAN_IF_Msg_t *slot = (CAN_IF_Msg_t *)CanRing_Reserve(&s_canRxRing);
+
+    CanStats_OnRx(key, dlc);
+    if (slot != NULL)
     {
-        LOG_ERROR("CAN", "Failed to create CAN RX queue");
+        slot->Id = key;
+        for (uint8_t i = 0U; i < fill; ++i)
+            slot->Data[i] = (i < len) ? data[i] : 0U;
+        slot->Info = (uint32_t)dlc | flags | ((fifo & 0x01U) << CAN_IF_MSG_INFO_FIFO_POS) |
+                     (0xFFU << 8);
+#if CAN_LAT_ENABLE
+        slot->EnqCycles = DWT->CYCCNT;
+#endif
+        CanRing_Commit(&s_canRxRing);
+    }
+
+    __set_PRIMASK(primask);
+
+    return (slot != NULL) ? HAL_OK : HAL_BUSY;
+}
+
+HAL_StatusTypeDef CAN_IF_ReinjectRx(const CAN_IF_Msg_t *msg)
+{
+    if (s_canRxRingReady == 0U)
         return HAL_ERROR;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    CAN_IF_Msg_t *slot = (CAN_IF_Msg_t *)CanRing_Reserve(&s_canRxRing);
+
+    if (slot != NULL)
+    {
+        *slot = *msg;
+        slot->Info = (msg->Info & ~0xFF00U) | ((uint32_t)CAN_IF_FMI_REINJECTED << 8);
+#if CAN_LAT_ENABLE
+        slot->EnqCycles = DWT->CYCCNT;
+#endif
+        CanRing_Commit(&s_canRxRing);
     }
 
-    LOG_INFO("CAN", "CAN_IF initialized successfully");
-    return HAL_OK;
+    __set_PRIMASK(primask);
+
+    return (slot != NULL) ? HAL_OK : HAL_BUSY;
 }
 
-void CAN_IF_SendTelemetry(const VehicleState_t *vs)
+uint32_t CAN_IF_ProcessLatest(void)
 {
-    if (vs == NULL)
-        return;
+    uint32_t done = 0U;
+
+    for (;;)
+    {
+        CAN_IF_Msg_t msg;
+        uint32_t     primask = __get_PRIMASK();
+        __disable_irq();
+
+        uint32_t dirty = s_canLatestDirty;
+        if (dirty == 0U)
+        {
+            __set_PRIMASK(primask);
+            return done;
+        }
 
-    uint16_t speed_0p1 = (uint16_t)(vs->speed_kph * 10.0f);
-    uint16_t rpm       = vs->engine_rpm;
-    int16_t  temp_0p1  = (int16_t)(vs->coolant_temp_c * 10.0f);
+        uint32_t i = 31U - __CLZ(dirty);
+        msg = s_canLatest[i];
+        s_canLatestDirty = dirty & ~(1U << i);
+        s_canLatestStats[i].taken++;
+        __set_PRIMASK(primask);
 
-    CAN_TxHeaderTypeDef txHeader;
-    uint8_t data[8] = {0};
-    uint32_t mailbox = 0;
+        CAN_IF_ProcessRxMsg(&msg);
+        done++;
+    }
+}
 
-    memset(&txHeader, 0, sizeof(txHeader));
+HAL_StatusTypeDef CAN_IF_RegisterHandler(uint32_t id, uint32_t mask,
+                                         CAN_IF_RxHandler_t fn, void *ctx)
+{
+    if ((fn == NULL) || (s_canRxHandlerCount >= CAN_IF_MAX_HANDLERS))
+        return HAL_ERROR;
 
-    txHeader.StdId = 0x100U;
-    txHeader.IDE   = CAN_ID_STD;
-    txHeader.RTR   = CAN_RTR_DATA;
-    txHeader.DLC   = 6U;
+    uint8_t ext = ((id & CAN_IF_ID_EXT) != 0U) ? 1U : 0U;
+    uint8_t slot;
 
-    data[0] = (uint8_t)(speed_0p1 & 0xFFU);
-    data[1] = (uint8_t)((speed_0p1 >> 8) & 0xFFU);
-    data[2] = (uint8_t)(rpm & 0xFFU);
-    data[3] = (uint8_t)((rpm >> 8) & 0xFFU);
-    data[4] = (uint8_t)(temp_0p1 & 0xFFU);
-    data[5] = (uint8_t)((temp_0p1 >> 8) & 0xFFU);
+    if (ext == 0U)
+    {
+        slot = (uint8_t)(s_canRxHandlerCount + 1U);
 
-    HAL_StatusTypeDef status = HAL_CAN_AddTxMessage(&hcan1, &txHeader, data, &mailbox);
-    if (status != HAL_OK)
+        uint32_t want = id & mask & 0x7FFU;
+        for (uint32_t i = 0U; i < 2048U; ++i)
+        {
+            if ((i & mask) == want)
+                s_canStdDispatch[i] = slot;
+        }
+    }
+    else
     {
-        LOG_WARN("CAN",
-                 "Telemetry TX failed (status=%ld, err=0x%08lX) "
-                 "speed=%.1f rpm=%u temp=%.1f",
-                 (long)status,
-                 (unsigned long)hcan1.ErrorCode,
-                 vs->speed_kph,
-                 (unsigned)vs->engine_rpm,
-                 vs->coolant_temp_c);
+        id &= 0x1FFFFFFFU;
+
+        if ((mask & CAN_FILTER_EXT_EXACT) == CAN_FILTER_EXT_EXACT)
+        {
+            /* Replace an existing exact route for the same ID. */
+            for (uint8_t i = 0U; i < s_canExtExactCount; ++i)
+            {
+                if (s_canExtExact[i].id == id)
+                {
+                    s_canRxHandlers[s_canExtExact[i].handler].fn  = fn;
+                    s_canRxHandlers[s_canExtExact[i].handler].ctx = ctx;
+                    return HAL_OK;
+                }
+            }
+
+            if (s_canExtExactCount >= CAN_IF_MAX_EXT_HANDLERS)
+                return HAL_ERROR;
+
+            slot = (uint8_t)(s_canRxHandlerCount + 1U);
+
+            /* Insertion sort keeps the table ready for binary search. */
+            uint8_t pos = s_canExtExactCount;
+            while ((pos > 0U) && (s_canExtExact[pos - 1U].id > id))
+            {
+                s_canExtExact[pos] = s_canExtExact[pos - 1U];
+                pos--;
+            }
+            s_canExtExact[pos].id      = id;
+            s_canExtExact[pos].mask    = CAN_FILTER_EXT_EXACT;
+            s_canExtExact[pos].handler = slot;
+            s_canExtExactCount++;
+        }
+        else
+        {
+            if (s_canExtMaskedCount >= CAN_IF_MAX_EXT_HANDLERS)
+                return HAL_ERROR;
+
+            slot = (uint8_t)(s_canRxHandlerCount + 1U);
+
+            s_canExtMasked[s_canExtMaskedCount].id      = id;
+            s_canExtMasked[s_canExtMaskedCount].mask    = mask & 0x1FFFFFFFU;
+            s_canExtMasked[s_canExtMaskedCount].handler = slot;
+            s_canExtMaskedCount++;
+        }
     }
+
+    s_canRxHandlers[slot].fn  = fn;
+    s_canRxHandlers[slot].ctx = ctx;
+    s_canRxHandlerCount++;
+
+    can_rebuild_fmi_dispatch();
+    return HAL_OK;
 }
 
-void CAN_IF_SetLogging(uint8_t enable)
+HAL_StatusTypeDef CAN_IF_RegisterIsrDecoder(uint32_t id, CAN_IF_IsrDecoder_t decode,
+                                            CAN_IF_IsrWake_t wake, void *ctx)
 {
-    s_canLoggingEnabled = (enable != 0U) ? 1U : 0U;
-    LOG_INFO("CAN", "RX logging %s", s_canLoggingEnabled ? "ENABLED" : "DISABLED");
+#if CAN_IF_ISR_DECODERS
+    uint32_t n   = s_canIsrDecCount;
+    uint32_t key = ((id & CAN_IF_ID_EXT) != 0U) ? (id & (CAN_IF_ID_EXT | CAN_IF_ID_MASK))
+                                                : (id & 0x7FFU);
+
+    if ((decode == NULL) || (n >= CAN_IF_ISR_DECODERS) ||
+        (CanSecOC_Find(key) != CAN_SECOC_NONE))
+        return HAL_ERROR;
+
+    CanIsrDecoder_t *d = &s_canIsrDec[n];
+    d->key     = key;
+    d->decode  = decode;
+    d->wake    = wake;
+    d->ctx     = ctx;
+    d->e2e     = CanE2E_Find(key);
+    d->frames  = 0U;
+    d->dropped = 0U;
+
+    /* The interrupt looks at the first s_canIsrDecCount entries only. */
+    __DMB();
+    s_canIsrDecCount = n + 1U;
+    return HAL_OK;
+#else
+    (void)id;
+    (void)decode;
+    (void)wake;
+    (void)ctx;
+    return HAL_ERROR;
+#endif
+}
+
+HAL_StatusTypeDef CAN_IF_RegisterPduHandler(uint32_t id, CAN_IF_PduHandler_t fn, void *ctx)
+{
+    if (fn == NULL)
+        return HAL_ERROR;
+
+    for (uint8_t i = 0U; i < s_canPduHandlerCount; ++i)
+    {
+        if (s_canPduHandlers[i].id == id)
+        {
+            s_canPduHandlers[i].fn  = fn;
+            s_canPduHandlers[i].ctx = ctx;
+            return HAL_OK;
+        }
+    }
+
+    if (s_canPduHandlerCount >= CAN_IF_MAX_PDU_HANDLERS)
+        return HAL_ERROR;
+
+    s_canPduHandlers[s_canPduHandlerCount].id  = id;
+    s_canPduHandlers[s_canPduHandlerCount].fn  = fn;
+    s_canPduHandlers[s_canPduHandlerCount].ctx = ctx;
+    s_canPduHandlerCount++;
+    return HAL_OK;
 }
 
-osMessageQueueId_t CAN_IF_GetRxQueueHandle(void)
+HAL_StatusTypeDef CAN_IF_DeliverPdu(uint32_t id, uint8_t *data, uint16_t len)
 {
-    return s_canRxQueue;
+    if (data == NULL)
+        return HAL_ERROR;
+
+    for (uint8_t i = 0U; i < s_canPduHandlerCount; ++i)
+    {
+        if (s_canPduHandlers[i].id == id)
+        {
+            s_canPduHandlers[i].fn(id, data, len, s_canPduHandlers[i].ctx);
+            return HAL_OK;
+        }
+    }
+
+    /* Nobody wants it: release the block so the pool does not leak. */
+    (void)MemPool_Free(data);
+    LOG_DEBUG(CAN, "PDU on 0x%03lX (%u B) unclaimed, dropped",
+              (unsigned long)id, (unsigned)len);
+    return HAL_ERROR;
 }
 
 void CAN_IF_ProcessRxMsg(const CAN_IF_Msg_t *msg)
 {
-    if ((msg == NULL) || (s_canLoggingEnabled == 0U))
+    if (msg == NULL)
         return;
 
-    char payload[3 * 8 + 1]; /* "xx " * 8 + '\0' */
-    size_t pos = 0U;
+#if FAULT_INJ_ENABLE
+    /* Injected CAN faults (fault_inj.h): the frame may go on corrupted,
+     * come back later or not at all. */
+    CAN_IF_Msg_t faulty;
+    msg = FaultInj_CanRx(msg, &faulty);
+    if (msg == NULL)
+        return;
+#endif
+
+#if CAN_LAT_ENABLE
+    uint32_t deqCycles = DWT->CYCCNT;
+#endif
+
+    PERF_BEGIN(CAN_RX_PROCESS);
+    LowPower_OnCanRx();
+
+    if (s_canLoggingEnabled != 0U)
+        can_log_rx(msg);
 
-    for (uint8_t i = 0U; i < msg->DLC && i < 8U; ++i)
+    /* Listen-only: logged and traced, but the node takes no part. A frame
+     * failing its E2E check (can_e2e.h) or its authentication
+     * (can_secoc.h) does not reach its handler. */
+    uint8_t e2e = CanE2E_Find(CAN_IF_MSG_KEY(msg));
+    uint8_t sec = CanSecOC_Find(CAN_IF_MSG_KEY(msg));
+
+    if ((s_canBus[CAN_IF_BUS1].silent == 0U) &&
+        ((e2e == CAN_E2E_NONE) ||
+         (CanE2E_Check(e2e, msg->Data, CAN_IF_MSG_LEN(msg)) <= CAN_E2E_WRONG_SEQ)) &&
+        ((sec == CAN_SECOC_NONE) ||
+         (CanSecOC_Verify(sec, msg->Data, CAN_IF_MSG_LEN(msg)) == HAL_OK)))
     {
-        if (pos + 3U >= sizeof(payload))
-            break;
-        int n = snprintf(&payload[pos], sizeof(payload) - pos, "%02X ", msg->Data[i]);
-        if (n <= 0)
-            break;
-        pos += (size_t)n;
+        /* Fast path: an exact-ID hardware filter already told us who it is. */
+        uint8_t slot = CAN_FMI_LOOKUP;
+        uint8_t fmi  = CAN_IF_MSG_FMI(msg);
+        if (fmi < CAN_FILTERS_MAX_FMI)
+            slot = s_canFmiDispatch[CAN_IF_MSG_FIFO(msg)][fmi];
+
+        if (slot == CAN_FMI_LOOKUP)
+            slot = can_lookup_handler(CAN_IF_MSG_IS_EXT(msg) ? 1U : 0U, msg->Id & CAN_IF_ID_MASK);
+
+        if (slot != 0U)
+            s_canRxHandlers[slot].fn(msg, s_canRxHandlers[slot].ctx);
     }
-    if (pos > 0U && payload[pos - 1U] == ' ')
-        payload[pos - 1U] = '\0';
-    else
-        payload[pos] = '\0';
 
-    uint32_t id = (msg->IDE ? msg->ExtId : msg->StdId);
+    PERF_END(CAN_RX_PROCESS);
 
-    LOG_INFO("CAN", "RX ID=0x%03lX DLC=%u Data=%s",
-             (unsigned long)id,
-             (unsigned)msg->DLC,
-             payload);
+#if CAN_LAT_ENABLE
+    /* Outside the probe: the table update is not part of the RX path. */
+    CanLat_Rx(CAN_IF_MSG_KEY(msg), msg->EnqCycles, deqCycles,
+              ((s_canMode & CAN_MODE_LOOPBACK) != 0U) ? 1U : 0U);
+#endif
 }
 
 /* -------------------------------------------------------------------------- */
 /* HAL callbacks (ISR context)                                                */
 /* -------------------------------------------------------------------------- */
 
-void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan)
+#if CAN_IF_RX_DIRECT
+/**
+ * @brief Pop the oldest frame of @p fifo: four word loads from its output
+ *        mailbox, then RFOM.
+ *
+ * RF1R has the layout of RF0R. It is written with RFOM alone: FULL and
+ * FOVR are cleared by writing 1, so a read-modify-write (as HAL does)
+ * would clear them unseen.
+ *
+ * @param[out] key  CAN_IF_Msg_t::Id.
+ * @param[out] info RDTR (DLC, FMI, timestamp), CAN_IF_Msg_t::Info without the FIFO bit.
+ * @param[out] data Payload as the RDLR/RDHR words.
+ * @return 1 if a frame was read, 0 if the FIFO is empty.
+ */
+RAMFUNC static uint8_t can_rx_read(CAN_HandleTypeDef *hcan, uint32_t fifo,
+                                   uint32_t *key, uint32_t *info, uint32_t *data)
 {
-    if (hcan != &hcan1)
-        return;
+    CAN_TypeDef       *can = hcan->Instance;
+    volatile uint32_t *rfr = (fifo == CAN_RX_FIFO0) ? &can->RF0R : &can->RF1R;
+
+    if ((*rfr & CAN_RF0R_FMP0) == 0U)
+        return 0U;
+
+    const CAN_FIFOMailBox_TypeDef *m = &can->sFIFOMailBox[fifo];
+    uint32_t rir = m->RIR;
+
+    *info   = m->RDTR;
+    data[0] = m->RDLR;
+    data[1] = m->RDHR;
+    *rfr    = CAN_RF0R_RFOM0;
+
+    *key = ((rir & CAN_RI0R_IDE) != 0U) ? ((rir >> CAN_RI0R_EXID_Pos) | CAN_IF_ID_EXT)
+                                        : (rir >> CAN_RI0R_STID_Pos);
+    if ((rir & CAN_RI0R_RTR) != 0U)
+        *key |= CAN_IF_ID_RTR;
+    return 1U;
+}
+#else
+/** Report a failed HAL_CAN_GetRxMessage(). */
+RAMFUNC static void can_rx_failed(const CAN_HandleTypeDef *hcan)
+{
+#if CAN_IF_RX_FAST_IRQ
+    s_canRxFailErr = hcan->ErrorCode;
+    can_rx_pend_swi();
+#else
+    LOG_WARN(CAN, "HAL_CAN_GetRxMessage failed, err=0x%08lX",
+             (unsigned long)hcan->ErrorCode);
+#endif
+}
+
+/**
+ * @brief Pop the oldest frame of @p fifo through HAL_CAN_GetRxMessage();
+ *        outputs as the register version above.
+ *
+ * @return 1 if a frame was read, 0 if the FIFO is empty or the read
+ *         failed (reported).
+ */
+RAMFUNC static uint8_t can_rx_read(CAN_HandleTypeDef *hcan, uint32_t fifo,
+                                   uint32_t *key, uint32_t *info, uint32_t *data)
+{
+    CAN_RxHeaderTypeDef h;
+
+    if (HAL_CAN_GetRxFifoFillLevel(hcan, fifo) == 0U)
+        return 0U;
+    if (HAL_CAN_GetRxMessage(hcan, fifo, &h, (uint8_t *)data) != HAL_OK)
+    {
+        can_rx_failed(hcan);
+        return 0U;
+    }
+
+    *key = (h.IDE == CAN_ID_EXT) ? (h.ExtId | CAN_IF_ID_EXT) : h.StdId;
+    if (h.RTR == CAN_RTR_REMOTE)
+        *key |= CAN_IF_ID_RTR;
+    *info = (h.DLC & 0x0FU) | ((h.FilterMatchIndex & 0xFFU) << 8) | (h.Timestamp << 16);
+    return 1U;
+}
+#endif
 
-    CAN_RxHeaderTypeDef rxHeader;
-    uint8_t             rxData[8];
+/**
+ * @brief Move every pending frame of one hardware FIFO into the RX ring.
+ *
+ * Each bxCAN FIFO holds up to 3 frames. Draining all of them per interrupt
+ * saves an interrupt entry per frame at burst load and keeps the FIFO from
+ * overrunning while thread-level code holds the CPU.
+ *
+ * The FIFO0 and FIFO1 interrupts share one NVIC priority, so they never
+ * preempt each other and together form the ring's single producer. With
+ * CAN_IF_RX_FAST_IRQ that priority is above the kernel: nothing here may
+ * call it (the ring pends the hand-off interrupt, PRIMASK sections only).
+ */
+RAMFUNC static void can_drain_fifo(CAN_HandleTypeDef *hcan, uint32_t fifo)
+{
+    uint32_t scratch[2];
+    uint32_t key;
+    uint32_t info;
 
-    if (HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO0, &rxHeader, rxData) != HAL_OK)
+    for (;;)
     {
-        LOG_WARN("CAN", "HAL_CAN_GetRxMessage failed, err=0x%08lX",
-                 (unsigned long)hcan1.ErrorCode);
-        return;
+        /* Zero-copy: payload is read straight into the ring slot. If the
+         * ring is full the frame still has to be popped from the hardware
+         * FIFO, so it is read into a scratch buffer and dropped (counted
+         * by the ring).
+         */
+        CAN_IF_Msg_t *slot = (s_canRxRingReady != 0U)
+                           ? (CAN_IF_Msg_t *)CanRing_Reserve(&s_canRxRing)
+                           : NULL;
+        uint32_t *dst32 = (slot != NULL) ? slot->Data32 : scratch;
+
+        if (can_rx_read(hcan, fifo, &key, &info, dst32) == 0U)
+            break;
+#if CAN_IF_ISR_DECODERS
+        uint32_t rxCycles = DWT->CYCCNT;
+#endif
+
+        const uint8_t *dst = (const uint8_t *)dst32;
+        uint8_t        dlc = (uint8_t)(info & 0x0FU);
+        uint32_t       fmi = (info >> 8) & 0xFFU;
+
+#if CAN_IF_NUM_BUSES > 1U
+        /* Forwarded before anything else, and also when the ring is full. */
+        CanGw_OnRx(CAN_IF_BUS1, key, dlc, dst);
+#endif
+
+        /* Over its entry's rate: counted, but no ring slot and no
+         * CanRxTask time (can_rxlimit.h). The slot stays free. */
+        if (CanRxLimit_Admit(fifo, fmi, key) == 0U)
+        {
+            CanStats_OnRx(key, dlc);
+            continue;
+        }
+
+        /* A latest-value ID goes to its own slot instead; the reserved
+         * ring slot stays free for the next frame. */
+        uint32_t latest = (fmi < CAN_FILTERS_MAX_FMI) ? s_canLatestFmi[fifo][fmi] : 0U;
+        if (latest != 0U)
+        {
+            slot = &s_canLatest[latest - 1U];
+            /* Words, not memcpy(): this runs from SRAM (ramfunc.h). */
+            slot->Data32[0] = dst32[0];
+            slot->Data32[1] = dst32[1];
+            if ((s_canLatestDirty & (1U << (latest - 1U))) != 0U)
+                s_canLatestStats[latest - 1U].replaced++;
+        }
+
+        /* Counted even when the ring is full: the frame was on the bus. */
+        CanStats_OnRx(key, dlc);
+        CanTrace_OnRx(key, dlc,
+                      (uint8_t)(((fifo == CAN_RX_FIFO1) ? CAN_TRACE_F_FIFO1 : 0U) |
+                                ((slot == NULL) ? CAN_TRACE_F_RING_FULL : 0U)),
+                      dst);
+#if EXT_LOG_ENABLE
+        ExtLog_OnCanRx(key, dlc, dst);
+#endif
+        if (key == TIME_SYNC_CAN_ID)
+            TimeSync_OnCanRx(dst);
+
+#if CAN_IF_ISR_DECODERS
+        /* Decoded right here: the reserved ring slot stays free. */
+        if (can_isr_decode(key, dlc, dst, rxCycles) != 0U)
+            continue;
+#endif
+
+        if (slot == NULL)
+            continue;
+
+        slot->Id   = key;
+        slot->Info = info | (fifo << CAN_IF_MSG_INFO_FIFO_POS);
+#if CAN_LAT_ENABLE
+        slot->EnqCycles = DWT->CYCCNT;
+#endif
+
+        if (latest != 0U)
+        {
+            uint32_t dirty = s_canLatestDirty;
+
+            /* CAN_IF_ProcessLatest() clears bits under PRIMASK, so this
+             * read-modify-write is never split. */
+            s_canLatestDirty = dirty | (1U << (latest - 1U));
+            if (dirty == 0U)
+                can_rx_wake();
+            continue;
+        }
+
+        CanRing_Commit(&s_canRxRing);
     }
 
-    if (s_canRxQueue == NULL)
+#if CAN_IF_ISR_DECODERS && !CAN_IF_RX_FAST_IRQ
+    /* Already at the kernel priority: wake the decoders' consumers now. */
+    can_isr_wakeups();
+#endif
+}
+
+#if CAN_IF_NUM_BUSES > 1U
+/**
+ * @brief CAN2: every frame goes through the gateway and nowhere else.
+ *
+ * Same interrupt priority as the CAN1 drain. The payload is read into
+ * two words that CAN_IF_Forward() hands to the destination.
+ */
+RAMFUNC static void can_drain_gw(CAN_HandleTypeDef *hcan, uint32_t bus, uint32_t fifo)
+{
+    uint32_t data[2];
+    uint32_t key;
+    uint32_t info;
+
+    while (can_rx_read(hcan, fifo, &key, &info, data) != 0U)
+        CanGw_OnRx(bus, key, (uint8_t)(info & 0x0FU), (const uint8_t *)data);
+}
+#endif
+
+RAMFUNC void CAN_IF_TxIRQHandler(uint32_t bus)
+{
+    if ((bus < CAN_IF_NUM_BUSES) && (s_canBus[bus].running != 0U))
+        can_tx_service(&s_canBus[bus]);
+}
+
+#if CAN_IF_RX_FAST_IRQ
+/*
+ * The RX vectors call CAN_IF_RxIRQHandler() directly. The TX and SCE
+ * vectors still run HAL_CAN_IRQHandler(), which also looks at the RX
+ * FIFOs: a frame it sees there is left to the RX interrupt, which is
+ * pending and preempts as soon as this one returns (or sooner), so the
+ * ring keeps its single producer.
+ */
+RAMFUNC void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan)
+{
+    (void)hcan;
+}
+
+RAMFUNC void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan)
+{
+    (void)hcan;
+}
+
+RAMFUNC void CAN_IF_RxIRQHandler(uint32_t bus, uint32_t fifo)
+{
+#if CAN_IF_NUM_BUSES > 1U
+    if (bus != CAN_IF_BUS1)
+    {
+        can_drain_gw(&hcan2, bus, fifo);
         return;
+    }
+#else
+    (void)bus;
+#endif
+    PERF_BEGIN(CAN_RX_ISR);
+    can_drain_fifo(&hcan1, fifo);
+    PERF_END(CAN_RX_ISR);
+}
 
-    CAN_IF_Msg_t msg;
-    memset(&msg, 0, sizeof(msg));
+RAMFUNC void CAN_IF_RxSwiIRQHandler(void)
+{
+    uint32_t err = s_canRxFailErr;
 
-    msg.StdId = rxHeader.StdId;
-    msg.ExtId = rxHeader.ExtId;
-    msg.IDE   = (uint8_t)rxHeader.IDE;
-    msg.RTR   = (uint8_t)rxHeader.RTR;
-    msg.DLC   = rxHeader.DLC;
+    CanRing_Notify(&s_canRxRing);
+#if CAN_IF_ISR_DECODERS
+    can_isr_wakeups();
+#endif
 
-    uint8_t len = (rxHeader.DLC <= 8U) ? rxHeader.DLC : 8U;
-    for (uint8_t i = 0; i < len; ++i)
+    if (err != 0U)
+    {
+        s_canRxFailErr = 0U;
+        LOG_WARN(CAN, "HAL_CAN_GetRxMessage failed, err=0x%08lX",
+                 (unsigned long)err);
+    }
+}
+#else
+RAMFUNC void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan)
+{
+#if CAN_IF_NUM_BUSES > 1U
+    if (hcan == &hcan2)
     {
-        msg.Data[i] = rxData[i];
+        can_drain_gw(hcan, CAN_IF_BUS2, CAN_RX_FIFO0);
+        return;
     }
+#endif
+    if (hcan != &hcan1)
+        return;
+
+    PERF_BEGIN(CAN_RX_ISR);
+    can_drain_fifo(hcan, CAN_RX_FIFO0);
+    PERF_END(CAN_RX_ISR);
+}
+
+RAMFUNC void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan)
+{
+    if (hcan != &hcan1)
+        return;
 
-    (void)osMessageQueuePut(s_canRxQueue, &msg, 0U, 0U);
+    can_drain_fifo(hcan, CAN_RX_FIFO1);
 }
+#endif
 
 void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan)
 {
     if (hcan != &hcan1)
+    {
+        /* CAN2 recovers from bus-off by itself (AutoBusOff). */
+        (void)HAL_CAN_ResetError(hcan);
         return;
+    }
 
-    LOG_WARN("CAN", "CAN error callback fired, err=0x%08lX",
-             (unsigned long)hcan1.ErrorCode);
+    /* Counted only; "can stats" and its timer report them, so an error
+     * storm costs no logging in interrupt context. HAL ORs every error
+     * into ErrorCode, so clear it for the next interrupt. Recovery is
+     * left to CanTxTask (can_busoff). */
+    CanStats_OnError(hcan->ErrorCode, hcan->Instance->ESR);
+    if ((hcan->ErrorCode & HAL_CAN_ERROR_BOF) != 0U)
+        CanBusOff_OnBusOff();
+    (void)HAL_CAN_ResetError(hcan);
 }
 
-/* TX mailbox callbacks kept as no-ops for completeness. */
+/* TX mailbox callbacks: account the frame and refill from the software queue.
+ * In SRAM, so queued frames keep leaving while the flash is busy. */
 
-void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan)
+RAMFUNC static void can_tx_complete(CAN_HandleTypeDef *hcan, uint32_t mailbox, uint8_t ok)
 {
-    (void)hcan;
+    CanBus_t *b = can_bus_of(hcan);
+
+    if (b == NULL)
+        return;
+
+    if (ok)
+        b->txStats.sent++;
+    else
+        b->txStats.dropped++;
+
+    if ((b->tsynMb & mailbox) != 0U)
+    {
+        b->tsynMb &= (uint8_t)~mailbox;
+        if (ok)
+            TimeSync_OnTxConfirm();
+    }
+
+#if CAN_IF_TX_URGENT
+    if ((b == &s_canBus[CAN_IF_BUS1]) && (mailbox == (1U << CAN_IF_TX_URGENT_MAILBOX)))
+    {
+        CanAlarm_OnTxDone(ok);
+        return;
+    }
+#endif
+
+    can_tx_refill(b);
 }
 
-void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan)
+RAMFUNC void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan)
 {
-    (void)hcan;
+    can_tx_complete(hcan, CAN_TX_MAILBOX0, 1U);
 }
 
-void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan)
+RAMFUNC void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan)
 {
-    (void)hcan;
+    can_tx_complete(hcan, CAN_TX_MAILBOX1, 1U);
+}
+
+RAMFUNC void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan)
+{
+    can_tx_complete(hcan, CAN_TX_MAILBOX2, 1U);
+}
+
+RAMFUNC void HAL_CAN_TxMailbox0AbortCallback(CAN_HandleTypeDef *hcan)
+{
+    can_tx_complete(hcan, CAN_TX_MAILBOX0, 0U);
+}
+
+RAMFUNC void HAL_CAN_TxMailbox1AbortCallback(CAN_HandleTypeDef *hcan)
+{
+    can_tx_complete(hcan, CAN_TX_MAILBOX1, 0U);
+}
+
+RAMFUNC void HAL_CAN_TxMailbox2AbortCallback(CAN_HandleTypeDef *hcan)
+{
+    can_tx_complete(hcan, CAN_TX_MAILBOX2, 0U);
 }
@@ -0,0 +1,211 @@
+/**
+ * @file    can_lat.c
+ * @brief   CAN latency table and the "can lat" CLI commands.
+ */
+
+#include "can_lat.h"
+#include "can_if.h"
+#include "cli_if.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    uint32_t       id;
+    uint32_t       txCycles;     /* CAN_IF_Transmit() stamp of the frame in flight */
+    uint8_t        txPending;
+    CanLat_Stats_t path[CAN_LAT_PATHS];
+} CanLat_Entry_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Guarded by PRIMASK: CAN_IF_Transmit() runs in any task. */
+static CanLat_Entry_t s_lat[CAN_LAT_MAX_IDS];
+static uint32_t       s_latCount = 0U;
+
+static const char *const s_pathNames[CAN_LAT_PATHS] = { "isr>task", "tx>rx" };
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Entry for @p id, added if there is room; caller holds PRIMASK. */
+static CanLat_Entry_t *lat_entry(uint32_t id)
+{
+    for (uint32_t i = 0U; i < s_latCount; ++i)
+    {
+        if (s_lat[i].id == id)
+            return &s_lat[i];
+    }
+
+    if (s_latCount >= CAN_LAT_MAX_IDS)
+        return NULL;
+
+    CanLat_Entry_t *e = &s_lat[s_latCount++];
+    memset(e, 0, sizeof(*e));
+    e->id = id;
+    return e;
+}
+
+static void lat_record(CanLat_Stats_t *st, uint32_t cycles)
+{
+    uint32_t cyclesPerUs = SystemCoreClock / 1000000U;
+    uint32_t us = cycles / ((cyclesPerUs != 0U) ? cyclesPerUs : 1U);
+
+    /* Bucket = bit length of the latency in us, as in perf.c. */
+    uint32_t b = 32U - __CLZ(us);
+    if (b >= CAN_LAT_BUCKETS)
+        b = CAN_LAT_BUCKETS - 1U;
+
+    st->count++;
+    st->sumUs += us;
+    if (us > st->maxUs)
+        st->maxUs = us;
+    if (us > CAN_LAT_BUDGET_US)
+        st->overBudget++;
+    st->hist[b]++;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void lat_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t       id;
+    CanLat_Stats_t st[CAN_LAT_PATHS];
+
+    if (CanLat_Get(0U, &id, st) != HAL_OK)
+    {
+        CLI_IF_Print("No CAN frames measured yet\r\n");
+        return;
+    }
+
+    CLI_IF_Printf("Budget %lu us\r\n", (unsigned long)CAN_LAT_BUDGET_US);
+    CLI_IF_Print("ID         path         count  mean_us   max_us  over\r\n");
+
+    for (uint32_t i = 0U; CanLat_Get(i, &id, st) == HAL_OK; ++i)
+    {
+        for (uint32_t p = 0U; p < CAN_LAT_PATHS; ++p)
+        {
+            if (st[p].count == 0U)
+                continue;
+
+            CLI_IF_Printf("%s0x%0*lX %-9s %9lu %8lu %8lu %5lu\r\n",
+                          ((id & CAN_IF_ID_EXT) != 0U) ? "" : "  ",
+                          ((id & CAN_IF_ID_EXT) != 0U) ? 8 : 3,
+                          (unsigned long)(id & 0x1FFFFFFFU), s_pathNames[p],
+                          (unsigned long)st[p].count,
+                          (unsigned long)(st[p].sumUs / st[p].count),
+                          (unsigned long)st[p].maxUs, (unsigned long)st[p].overBudget);
+
+            /* Non-empty buckets as "<upper bound us>:count". */
+            CLI_IF_Print("  hist");
+            for (uint32_t b = 0U; b < CAN_LAT_BUCKETS; ++b)
+            {
+                if (st[p].hist[b] == 0U)
+                    continue;
+
+                if (b == (CAN_LAT_BUCKETS - 1U))
+                    CLI_IF_Printf(" >=%lu:%lu", 1UL << (b - 1U), (unsigned long)st[p].hist[b]);
+                else
+                    CLI_IF_Printf(" <%lu:%lu", 1UL << b, (unsigned long)st[p].hist[b]);
+            }
+            CLI_IF_Print("\r\n");
+        }
+    }
+}
+
+static void lat_cmd_reset(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CanLat_Reset();
+    CLI_IF_Print("CAN latency statistics cleared.\r\n");
+}
+
+static const CliCommand_t s_latCmds[] =
+{
+    { "can lat",       "", 0U, lat_cmd_show,  "per-ID ISR->task and TX->RX latency" },
+    { "can lat reset", "", 0U, lat_cmd_reset, "clear the CAN latency statistics" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void CanLat_Init(void)
+{
+    CanLat_Reset();
+    CLI_IF_REGISTER_TABLE(s_latCmds);
+}
+
+void CanLat_TxRequest(uint32_t id, uint32_t cycles)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    CanLat_Entry_t *e = lat_entry(id);
+    if ((e != NULL) && (e->txPending == 0U))
+    {
+        e->txCycles  = cycles;
+        e->txPending = 1U;
+    }
+
+    __set_PRIMASK(primask);
+}
+
+void CanLat_Rx(uint32_t id, uint32_t enqCycles, uint32_t deqCycles, uint8_t loopback)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    CanLat_Entry_t *e = lat_entry(id);
+    if (e != NULL)
+    {
+        lat_record(&e->path[CAN_LAT_ISR_TO_TASK], deqCycles - enqCycles);
+
+        if ((loopback != 0U) && (e->txPending != 0U))
+        {
+            lat_record(&e->path[CAN_LAT_TX_TO_RX], enqCycles - e->txCycles);
+            e->txPending = 0U;
+        }
+    }
+
+    __set_PRIMASK(primask);
+}
+
+HAL_StatusTypeDef CanLat_Get(uint32_t index, uint32_t *id, CanLat_Stats_t *stats)
+{
+    HAL_StatusTypeDef status = HAL_ERROR;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (index < s_latCount)
+    {
+        *id = s_lat[index].id;
+        memcpy(stats, s_lat[index].path, sizeof(s_lat[index].path));
+        status = HAL_OK;
+    }
+
+    __set_PRIMASK(primask);
+    return status;
+}
+
+void CanLat_Reset(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_latCount = 0U;
+    __set_PRIMASK(primask);
+}
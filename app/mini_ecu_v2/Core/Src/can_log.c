@@ -0,0 +1,303 @@
+/**
+ * @file    can_log.c
+ * @brief   "can" log transport: stream ring, rate-capped scheduler frame
+ *          and "can log".
+ *
+ * Ring records are a 4-byte header, stream (u8) | frames lost before this
+ * record (u8) | length (u16), and the bytes. LogTask is the only producer
+ * and advances the head; the scheduler task is the only consumer and
+ * advances the tail, so neither needs a lock.
+ */
+
+#include "can_log.h"
+
+#if CAN_LOG_ENABLE
+
+#include "can_if.h"
+#include "can_sched.h"
+#include "cli_if.h"
+#include "log.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define CL_REC_HDR_SIZE     4U
+#define CL_FRAME_DATA       7U
+#define CL_SEQ_MASK         0x3FU
+#define CL_STREAM_SHIFT     6U
+
+/* The budget counts hundredths of a bit, so that percent x bit/ms is exact.
+ * It may save up two bursts: a send takes one at most, and the refill left
+ * over after a full burst is not lost. */
+#define CL_FRAME_COST       (CAN_LOG_FRAME_BITS * 100U)
+#define CL_BUDGET_MAX       (2U * CAN_LOG_BURST * CL_FRAME_COST)
+
+_Static_assert((CAN_LOG_RING_SIZE & (CAN_LOG_RING_SIZE - 1U)) == 0U,
+               "CAN_LOG_RING_SIZE must be a power of two");
+_Static_assert((CL_REC_HDR_SIZE + LOG_TX_CHUNK_SIZE) <= CAN_LOG_RING_SIZE,
+               "CAN_LOG_RING_SIZE must hold a log chunk");
+_Static_assert(LOG_STREAM_COUNT <= 4U, "the stream must fit two bits");
+_Static_assert((CAN_LOG_LOAD_PCT >= 1U) && (CAN_LOG_LOAD_PCT <= 100U),
+               "CAN_LOG_LOAD_PCT must be 1..100");
+_Static_assert((CAN_LOG_BURST >= 1U) && (CAN_LOG_BURST <= CAN_SCHED_BURST),
+               "CAN_LOG_BURST must be 1..CAN_SCHED_BURST");
+_Static_assert((CAN_LOG_ID >= 0x7F8U) && (CAN_LOG_ID <= 0x7FFU),
+               "CAN_NODE_ID must be 0..7");
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t           s_clRing[CAN_LOG_RING_SIZE];
+static volatile uint32_t s_clHead = 0U;     /* LogTask */
+static volatile uint32_t s_clTail = 0U;     /* scheduler task */
+
+/* LogTask: frames of the chunks dropped since the last record queued. */
+static uint32_t          s_clSkip = 0U;
+
+/* Scheduler task: the record being sent and the bus-load budget. */
+static uint32_t          s_clLeft   = 0U;
+static uint8_t           s_clStream = 0U;
+static uint8_t           s_clSeq    = 0U;
+static uint32_t          s_clBudget = CL_BUDGET_MAX;
+static uint32_t          s_clStamp  = 0U;
+
+/* dropped and peak by LogTask, the rest by the scheduler task; "can log"
+ * may read one of them a frame stale. */
+static CanLog_Stats_t    s_clStats;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static void cl_copy_in(uint32_t pos, const uint8_t *src, uint32_t len)
+{
+    for (uint32_t i = 0U; i < len; ++i)
+        s_clRing[(pos + i) & (CAN_LOG_RING_SIZE - 1U)] = src[i];
+}
+
+static void cl_copy_out(uint32_t pos, uint8_t *dst, uint32_t len)
+{
+    for (uint32_t i = 0U; i < len; ++i)
+        dst[i] = s_clRing[(pos + i) & (CAN_LOG_RING_SIZE - 1U)];
+}
+
+/** Budget for the time since the last refill, up to CL_BUDGET_MAX. */
+static void cl_refill(uint32_t now)
+{
+    CanTiming_t timing;
+    uint32_t    elapsed = now - s_clStamp;
+
+    s_clStamp = now;
+    if (elapsed > 1000U)
+        elapsed = 1000U;    /* full anyway; keeps the product in range */
+
+    (void)CAN_IF_GetBitTiming(&timing);
+    s_clBudget += elapsed * (timing.bitrate / 1000U) * CAN_LOG_LOAD_PCT;
+    if (s_clBudget > CL_BUDGET_MAX)
+        s_clBudget = CL_BUDGET_MAX;
+}
+
+/**
+ * @brief Next frame of the queued bytes, without taking them.
+ *
+ * @return DLC, 0 if nothing is queued.
+ */
+static uint8_t cl_peek(uint8_t *data)
+{
+    uint32_t tail = s_clTail;
+
+    if (s_clLeft == 0U)
+    {
+        uint8_t hdr[CL_REC_HDR_SIZE];
+
+        if (tail == s_clHead)
+            return 0U;
+        __DMB();    /* the bytes before the head index */
+
+        cl_copy_out(tail, hdr, CL_REC_HDR_SIZE);
+        s_clStream = hdr[0];
+        s_clSeq    = (uint8_t)(s_clSeq + hdr[1]);
+        s_clLeft   = (uint32_t)hdr[2] | ((uint32_t)hdr[3] << 8);
+        tail      += CL_REC_HDR_SIZE;
+        s_clTail   = tail;
+    }
+
+    uint32_t n = (s_clLeft > CL_FRAME_DATA) ? CL_FRAME_DATA : s_clLeft;
+
+    data[0] = (uint8_t)((uint32_t)s_clStream << CL_STREAM_SHIFT) | (s_clSeq & CL_SEQ_MASK);
+    cl_copy_out(tail, &data[1], n);
+    return (uint8_t)(1U + n);
+}
+
+/** Take the @p n bytes of the frame cl_peek() made. */
+static void cl_take(uint32_t n)
+{
+    s_clLeft -= n;
+    s_clSeq++;
+    s_clStats.frames++;
+    s_clStats.bytes += n;
+
+    __DMB();    /* read before the producer may reuse the space */
+    s_clTail = s_clTail + n;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Scheduled frame                                                            */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t cl_pending(void *ctx)
+{
+    (void)ctx;
+    return ((s_clLeft != 0U) || (s_clTail != s_clHead)) ? 1U : 0U;
+}
+
+/**
+ * Up to CAN_LOG_BURST frames as the budget allows. Held back by the budget
+ * the send still counts, so the scheduler looks again a period later.
+ */
+static HAL_StatusTypeDef cl_send(void *ctx)
+{
+    (void)ctx;
+
+    cl_refill(HAL_GetTick());
+    if (s_clBudget < CL_FRAME_COST)
+    {
+        s_clStats.throttled++;
+        return HAL_OK;
+    }
+
+    for (uint32_t sent = 0U; (sent < CAN_LOG_BURST) && (s_clBudget >= CL_FRAME_COST); ++sent)
+    {
+        uint8_t data[8];
+        uint8_t dlc = cl_peek(data);
+
+        if (dlc == 0U)
+            break;
+        if (CAN_IF_Transmit(CAN_LOG_ID, data, dlc) != HAL_OK)
+        {
+            /* TX queue full: the frame stays queued here. */
+            s_clStats.busy++;
+            return (sent == 0U) ? HAL_BUSY : HAL_OK;
+        }
+        cl_take((uint32_t)dlc - 1U);
+        s_clBudget -= CL_FRAME_COST;
+    }
+    return HAL_OK;
+}
+
+static const CanSched_Frame_t s_clFrame =
+{
+    .name     = "log",
+    .id       = CAN_LOG_ID,
+    .cycleMs  = 0U,
+    .minGapMs = CAN_LOG_PERIOD_MS,
+    .offsetMs = 0U,
+    .changed  = cl_pending,
+    .send     = cl_send,
+    .ctx      = NULL,
+};
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void cl_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CanLog_Stats_t st;
+    CanTiming_t    timing;
+    uint32_t       on = 0U;
+
+    CanLog_GetStats(&st);
+    (void)CAN_IF_GetBitTiming(&timing);
+
+    CLI_IF_Printf("Log frames on 0x%03X, streams:", (unsigned)CAN_LOG_ID);
+    for (uint32_t i = 0U; i < (uint32_t)LOG_STREAM_COUNT; ++i)
+    {
+        if (Log_GetTransport((Log_Stream_t)i) == LOG_TRANSPORT_CAN)
+        {
+            CLI_IF_Printf(" %s", Log_StreamName((Log_Stream_t)i));
+            on++;
+        }
+    }
+    CLI_IF_Print((on == 0U) ? " none (log transport <stream> can)\r\n" : "\r\n");
+
+    CLI_IF_Printf("Cap %u %% of %lu bit/s: %lu bit/s, up to %u frames per %u ms\r\n",
+                  (unsigned)CAN_LOG_LOAD_PCT, (unsigned long)timing.bitrate,
+                  (unsigned long)((timing.bitrate / 100U) * CAN_LOG_LOAD_PCT),
+                  (unsigned)CAN_LOG_BURST, (unsigned)CAN_LOG_PERIOD_MS);
+    CLI_IF_Printf("Queued %lu of %u bytes, peak %lu\r\n", (unsigned long)st.queued,
+                  (unsigned)CAN_LOG_RING_SIZE, (unsigned long)st.peak);
+    CLI_IF_Printf("Frames %lu, bytes %lu; dropped %lu bytes, held by the cap %lu, "
+                  "TX queue full %lu\r\n",
+                  (unsigned long)st.frames, (unsigned long)st.bytes,
+                  (unsigned long)st.dropped, (unsigned long)st.throttled,
+                  (unsigned long)st.busy);
+}
+
+static const CliCommand_t s_clCmds[] =
+{
+    { "can log", "", 0U, cl_cmd_show, "log streams sent as CAN frames" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef CanLog_Init(void)
+{
+    s_clStamp = HAL_GetTick();
+
+    CLI_IF_REGISTER_TABLE(s_clCmds);
+    return CanSched_Add(&s_clFrame);
+}
+
+void CanLog_Write(uint8_t stream, const uint8_t *data, uint32_t len)
+{
+    uint32_t head = s_clHead;
+    uint32_t fill = head - s_clTail;
+
+    if (len == 0U)
+        return;
+
+    if ((CL_REC_HDR_SIZE + len) > (CAN_LOG_RING_SIZE - fill))
+    {
+        /* The receiver sees the frames it would have taken as a gap. */
+        s_clStats.dropped += len;
+        s_clSkip += (len + CL_FRAME_DATA - 1U) / CL_FRAME_DATA;
+        return;
+    }
+
+    uint8_t hdr[CL_REC_HDR_SIZE] =
+    {
+        stream, (uint8_t)s_clSkip,      /* modulo 256 keeps it exact modulo 64 */
+        (uint8_t)len, (uint8_t)(len >> 8)
+    };
+
+    cl_copy_in(head, hdr, CL_REC_HDR_SIZE);
+    cl_copy_in(head + CL_REC_HDR_SIZE, data, len);
+    s_clSkip = 0U;
+
+    fill += CL_REC_HDR_SIZE + len;
+    if (fill > s_clStats.peak)
+        s_clStats.peak = fill;
+
+    __DMB();
+    s_clHead = head + CL_REC_HDR_SIZE + len;
+
+    if (fill == (CL_REC_HDR_SIZE + len))
+        CanSched_Notify();      /* was empty: the scheduler may be asleep */
+}
+
+void CanLog_GetStats(CanLog_Stats_t *stats)
+{
+    *stats        = s_clStats;
+    stats->queued = s_clHead - s_clTail;
+}
+
+#endif /* CAN_LOG_ENABLE */
@@ -0,0 +1,423 @@
+/**
+ * @file    can_nm.c
+ * @brief   NM state machine, NM PDUs, the bus wake-up EXTI line and "nm".
+ *
+ * Time is HAL_GetTick() milliseconds compared by unsigned differences, so
+ * the tick may wrap. The state machine runs in the 100 ms raster only; the
+ * RX handler (CanRxTask) and the wake-up interrupts hand it their news
+ * through the flags below.
+ */
+
+#include "can_nm.h"
+#include "can_if.h"
+#include "can_sched.h"
+#include "cli_if.h"
+#include "log.h"
+#include "low_power.h"
+#include "pedal.h"
+#include "sys_config.h"
+#include "vehicle_shared.h"
+#include "FreeRTOS.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define NM_EXTI_LINE        GPIO_PIN_11     /* PA11 = CAN1_RX */
+#define NM_MOVING_KPH       0.5f            /* as TRIP_MOVING_KPH */
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Raster task only. */
+static uint8_t       s_nmReady      = 0U;   /* CanNm_Init() done */
+static CanNm_State_t s_nmState      = CAN_NM_BUS_SLEEP;
+static uint32_t      s_nmStateTick  = 0U;   /* entry into s_nmState */
+static uint32_t      s_nmLastTx     = 0U;
+static uint8_t       s_nmImmediate  = 0U;   /* PDUs left to send at once */
+static uint8_t       s_nmActive     = 0U;   /* woke the bus itself */
+static uint8_t       s_nmRequested  = 0U;
+static uint32_t      s_nmPresses    = 0U;
+static uint8_t       s_nmAwaitRx    = 0U;   /* wake-up delays pending */
+static uint8_t       s_nmAwaitTx    = 0U;
+static CanNm_Stats_t s_nmStats;
+
+/* Set by the CLI; read by the raster. */
+static volatile uint8_t s_nmRequest  = (CAN_NM_REQUEST_AT_BOOT != 0) ? 1U : 0U;
+static volatile uint8_t s_nmSendRmr  = 0U;
+
+/* Written by CanRxTask and the wake-up interrupts, taken by the raster;
+ * guarded by PRIMASK. */
+static uint32_t s_nmLastNm    = 0U;     /* last NM PDU on the bus, either way */
+static uint8_t  s_nmRxPending = 0U;
+static uint8_t  s_nmRxRmr     = 0U;
+static uint8_t  s_nmBusWake   = 0U;
+static uint32_t s_nmWakeTick  = 0U;
+static uint32_t s_nmRxCount   = 0U;
+static uint64_t s_nmNodes     = 0U;
+
+static const char *const s_nmStateNames[] =
+{
+    "bus sleep", "repeat message", "normal", "ready sleep", "prepare bus sleep"
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Interrupts: the bus woke the core (EXTI) or the controller (AutoWakeUp). */
+static void nm_bus_woken(void)
+{
+    EXTI->IMR &= ~NM_EXTI_LINE;
+    if (s_nmBusWake == 0U)
+    {
+        s_nmBusWake  = 1U;
+        s_nmWakeTick = HAL_GetTick();
+    }
+    LowPower_SetStop(0U);
+}
+
+/** CanRxTask: an NM PDU of another node. */
+static void nm_on_frame(const CAN_IF_Msg_t *msg, void *ctx)
+{
+    (void)ctx;
+
+    if (CAN_IF_MSG_LEN(msg) < CANSIG_NM_PDU_DLC)
+        return;
+
+    CanSig_NmPdu_t pdu;
+    CanSig_NmPdu_Unpack(msg->Data, &pdu);
+
+    uint32_t node = CAN_IF_MSG_KEY(msg) - CAN_NM_BASE_ID;
+    if (node == CAN_NM_NODE)
+        return;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_nmLastNm    = HAL_GetTick();
+    s_nmRxPending = 1U;
+    s_nmRxRmr    |= pdu.nm_repeat_request;
+    s_nmRxCount++;
+    s_nmNodes    |= (uint64_t)1U << node;
+    __set_PRIMASK(primask);
+}
+
+/** Is the bus needed here? B1 counts once per press. */
+static uint8_t nm_needed(void)
+{
+    Pedal_State_t  pedal;
+    VehicleState_t vs;
+
+    Pedal_Get(&pedal);
+    Vehicle_GetSnapshot(&vs);
+
+    uint8_t pressed = (pedal.presses != s_nmPresses) ? 1U : 0U;
+    s_nmPresses = pedal.presses;
+
+    return ((s_nmRequest != 0U) || (pressed != 0U) ||
+            (vs.speed_kph >= NM_MOVING_KPH)) ? 1U : 0U;
+}
+
+static void nm_send(uint32_t now)
+{
+    CanSig_NmPdu_t pdu;
+    uint8_t        data[CANSIG_NM_PDU_DLC];
+
+    pdu.nm_source         = (uint8_t)CAN_NM_NODE;
+    pdu.nm_repeat_request = s_nmSendRmr;
+    pdu.nm_active_wakeup  = s_nmActive;
+    pdu.nm_state          = (uint8_t)s_nmState;
+    CanSig_NmPdu_Pack(data, &pdu);
+
+    /* A full TX queue: the cycle timer stays due, retried next pass. */
+    if (CAN_IF_Transmit(CAN_NM_BASE_ID + CAN_NM_NODE, data, CANSIG_NM_PDU_DLC) != HAL_OK)
+        return;
+
+    if (pdu.nm_repeat_request != 0U)
+        s_nmSendRmr = 0U;
+    if (s_nmImmediate > 0U)
+        s_nmImmediate--;
+    s_nmLastTx = now;
+    s_nmStats.txPdus++;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_nmLastNm = now;
+    __set_PRIMASK(primask);
+
+    if (s_nmAwaitTx != 0U)
+    {
+        s_nmAwaitTx = 0U;
+        s_nmStats.wakeTxMs = now - s_nmWakeTick;
+        if (s_nmStats.wakeTxMs > s_nmStats.wakeTxMaxMs)
+            s_nmStats.wakeTxMaxMs = s_nmStats.wakeTxMs;
+    }
+}
+
+static void nm_enter(CanNm_State_t state, uint32_t now)
+{
+    CanNm_State_t from = s_nmState;
+
+    s_nmState     = state;
+    s_nmStateTick = now;
+
+    switch (state)
+    {
+    case CAN_NM_REPEAT_MESSAGE:
+        s_nmImmediate = CAN_NM_IMMEDIATE_TX;
+        if (from == CAN_NM_BUS_SLEEP)
+        {
+            EXTI->IMR &= ~NM_EXTI_LINE;
+            LowPower_SetStop(0U);
+            if (CAN_IF_WakeUp() != HAL_OK)
+                LOG_WARN(CAN, "NM: CAN1 did not leave sleep mode");
+            s_nmAwaitRx = 1U;
+            s_nmAwaitTx = 1U;
+        }
+        CanSched_Suspend(0U);
+        break;
+
+    case CAN_NM_PREPARE_BUS_SLEEP:
+        CanSched_Suspend(1U);
+        break;
+
+    case CAN_NM_BUS_SLEEP:
+        s_nmActive = 0U;
+        s_nmStats.sleeps++;
+
+        /* PR first: a frame from here on must end the next Stop. */
+        EXTI->PR   = NM_EXTI_LINE;
+        EXTI->IMR |= NM_EXTI_LINE;
+        LowPower_SetStop((CAN_NM_STOP != 0) ? 1U : 0U);
+        LOG_INFO(CAN, "NM: bus sleep");
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void nm_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CanNm_Stats_t st;
+    CanNm_GetStats(&st);
+
+    CLI_IF_Printf("NM node %u on 0x%03X: %s, bus %s here\r\n", (unsigned)CAN_NM_NODE,
+                  (unsigned)(CAN_NM_BASE_ID + CAN_NM_NODE), s_nmStateNames[st.state],
+                  (st.requested != 0U) ? "needed" : "released");
+    CLI_IF_Printf("PDUs sent %lu, received %lu; nodes heard 0x%08lX%08lX\r\n",
+                  (unsigned long)st.txPdus, (unsigned long)st.rxPdus,
+                  (unsigned long)(st.nodes >> 32), (unsigned long)(st.nodes & 0xFFFFFFFFU));
+    CLI_IF_Printf("Bus sleeps %lu, woken by the bus %lu, locally %lu\r\n",
+                  (unsigned long)st.sleeps, (unsigned long)st.busWakes,
+                  (unsigned long)st.localWakes);
+    CLI_IF_Printf("Wake-up to first PDU received %lu ms (max %lu), sent %lu ms (max %lu)\r\n",
+                  (unsigned long)st.wakeRxMs, (unsigned long)st.wakeRxMaxMs,
+                  (unsigned long)st.wakeTxMs, (unsigned long)st.wakeTxMaxMs);
+}
+
+static void nm_cmd_request(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CanNm_Request(1U);
+    CLI_IF_Print("Bus needed here\r\n");
+}
+
+static void nm_cmd_release(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CanNm_Request(0U);
+    CLI_IF_Print("Bus released here; it sleeps once no node needs it\r\n");
+}
+
+static void nm_cmd_repeat(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CanNm_RepeatMessageRequest();
+    CLI_IF_Print("Repeat Message Request with the next PDU\r\n");
+}
+
+static const CliCommand_t s_nmCmds[] =
+{
+    { "nm",         "", 0U, nm_cmd_show,    "network management state and wake-up delays" },
+    { "nm request", "", 0U, nm_cmd_request, "the bus is needed here (key on)" },
+    { "nm release", "", 0U, nm_cmd_release, "release the bus here (key off)" },
+    { "nm repeat",  "", 0U, nm_cmd_repeat,  "send a Repeat Message Request" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef CanNm_Init(void)
+{
+    memset(&s_nmStats, 0, sizeof(s_nmStats));
+
+    if (CAN_IF_RegisterHandler(CAN_NM_BASE_ID, CAN_NM_ID_MASK, nm_on_frame, NULL) != HAL_OK)
+        return HAL_ERROR;
+
+    if (CanFilters_Covers(0U, CAN_NM_BASE_ID, CAN_NM_ID_MASK) == 0U)
+        LOG_WARN(CAN, "NM range 0x%03lX not in CAN_FILTER_TABLE", (unsigned long)CAN_NM_BASE_ID);
+
+    /* Line 11 from PA11, falling edge (SOF is dominant); armed in BUS_SLEEP. */
+    __HAL_RCC_SYSCFG_CLK_ENABLE();
+    SYSCFG->EXTICR[2] &= ~SYSCFG_EXTICR3_EXTI11;
+    EXTI->IMR  &= ~NM_EXTI_LINE;
+    EXTI->RTSR &= ~NM_EXTI_LINE;
+    EXTI->FTSR |= NM_EXTI_LINE;
+    EXTI->PR    = NM_EXTI_LINE;
+    HAL_NVIC_SetPriority(EXTI15_10_IRQn, SYS_IRQ_PRIO_Exti15_10, 0U);
+    HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
+
+    /* Power-on is a wake-up: announce this node to the others. */
+    s_nmState     = CAN_NM_REPEAT_MESSAGE;
+    s_nmStateTick = HAL_GetTick();
+    s_nmImmediate = CAN_NM_IMMEDIATE_TX;
+    s_nmActive    = s_nmRequest;
+    s_nmReady     = 1U;
+
+    CLI_IF_REGISTER_TABLE(s_nmCmds);
+    return HAL_OK;
+}
+
+void CanNm_Event100ms(void)
+{
+    if (s_nmReady == 0U)
+        return;
+
+    uint32_t now    = HAL_GetTick();
+    uint8_t  needed = nm_needed();
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t  rx       = s_nmRxPending;
+    uint8_t  rmr      = s_nmRxRmr;
+    uint8_t  busWake  = s_nmBusWake;
+    uint32_t lastNm   = s_nmLastNm;
+    uint32_t rxCount  = s_nmRxCount;
+    s_nmRxPending = 0U;
+    s_nmRxRmr     = 0U;
+    s_nmBusWake   = 0U;
+    __set_PRIMASK(primask);
+
+    if (s_nmSendRmr != 0U)
+        rmr = 1U;
+
+    if ((rx != 0U) && (s_nmAwaitRx != 0U))
+    {
+        s_nmAwaitRx = 0U;
+        s_nmStats.wakeRxMs = lastNm - s_nmWakeTick;
+        if (s_nmStats.wakeRxMs > s_nmStats.wakeRxMaxMs)
+            s_nmStats.wakeRxMaxMs = s_nmStats.wakeRxMs;
+    }
+
+    switch (s_nmState)
+    {
+    case CAN_NM_BUS_SLEEP:
+        if ((busWake != 0U) || (rx != 0U))
+        {
+            s_nmStats.busWakes++;
+            nm_enter(CAN_NM_REPEAT_MESSAGE, now);
+        }
+        else if ((needed != 0U) || (rmr != 0U))
+        {
+            s_nmStats.localWakes++;
+            s_nmWakeTick = now;
+            s_nmActive   = 1U;
+            nm_enter(CAN_NM_REPEAT_MESSAGE, now);
+        }
+        break;
+
+    case CAN_NM_PREPARE_BUS_SLEEP:
+        if ((rx != 0U) || (needed != 0U) || (rmr != 0U))
+            nm_enter(CAN_NM_REPEAT_MESSAGE, now);
+        else if (((now - s_nmStateTick) >= CAN_NM_WAIT_SLEEP_MS) && (CAN_IF_Sleep() == HAL_OK))
+            nm_enter(CAN_NM_BUS_SLEEP, now);
+        break;
+
+    case CAN_NM_REPEAT_MESSAGE:
+        if ((now - s_nmStateTick) >= CAN_NM_REPEAT_MS)
+            nm_enter((needed != 0U) ? CAN_NM_NORMAL : CAN_NM_READY_SLEEP, now);
+        break;
+
+    case CAN_NM_NORMAL:
+        if (rmr != 0U)
+            nm_enter(CAN_NM_REPEAT_MESSAGE, now);
+        else if (needed == 0U)
+            nm_enter(CAN_NM_READY_SLEEP, now);
+        break;
+
+    case CAN_NM_READY_SLEEP:
+    default:
+        if (rmr != 0U)
+            nm_enter(CAN_NM_REPEAT_MESSAGE, now);
+        else if (needed != 0U)
+            nm_enter(CAN_NM_NORMAL, now);
+        else if ((now - lastNm) >= CAN_NM_TIMEOUT_MS)
+            nm_enter(CAN_NM_PREPARE_BUS_SLEEP, now);
+        break;
+    }
+
+    if ((s_nmState == CAN_NM_REPEAT_MESSAGE) || (s_nmState == CAN_NM_NORMAL))
+    {
+        if ((s_nmImmediate > 0U) || ((now - s_nmLastTx) >= CAN_NM_MSG_CYCLE_MS))
+            nm_send(now);
+    }
+
+    s_nmRequested    = needed;
+    s_nmStats.rxPdus = rxCount;
+}
+
+void CanNm_Request(uint8_t on)
+{
+    s_nmRequest = (on != 0U) ? 1U : 0U;
+}
+
+void CanNm_RepeatMessageRequest(void)
+{
+    s_nmSendRmr = 1U;
+}
+
+void CanNm_ExtiIRQHandler(void)
+{
+    if (((EXTI->IMR & NM_EXTI_LINE) == 0U) || ((EXTI->PR & NM_EXTI_LINE) == 0U))
+        return;
+
+    EXTI->PR = NM_EXTI_LINE;
+    CAN_IF_WakeUpFromIsr();
+    nm_bus_woken();
+}
+
+/** bxCAN left its sleep mode by itself (AutoWakeUp): the core was awake. */
+void HAL_CAN_WakeUpFromRxMsgCallback(CAN_HandleTypeDef *hcan)
+{
+    if ((hcan->Instance == CAN1) && (CAN_IF_IsAsleep() != 0U))
+        nm_bus_woken();
+}
+
+void CanNm_GetStats(CanNm_Stats_t *out)
+{
+    *out           = s_nmStats;
+    out->state     = s_nmState;
+    out->requested = s_nmRequested;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    out->nodes = s_nmNodes;
+    __set_PRIMASK(primask);
+}
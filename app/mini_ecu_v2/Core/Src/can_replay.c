@@ -0,0 +1,335 @@
+/**
+ * @file    can_replay.c
+ * @brief   Trace replay engine and "can replay".
+ */
+
+#include "can_replay.h"
+#include "can_if.h"
+#include "can_filters.h"
+#include "can_ring.h"
+#include "cli_if.h"
+#include "cmsis_os2.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/** Slowest and fastest "can replay <speed>" (1/1000 of the original rate). */
+#define REPLAY_SPEED_MIN    1U
+#define REPLAY_SPEED_MAX    1000000U
+
+typedef struct
+{
+    CanReplay_Next_t  next;
+    void             *ctx;
+    uint32_t          speed;
+    uint32_t          startMs;
+    uint32_t          firstMs;      /* stamp of the first record */
+    uint16_t          firstUs;
+    CanTrace_Rec_t    rec;          /* next record, not yet due */
+    uint8_t           pending;
+    uint8_t           started;      /* firstMs/firstUs are set */
+    CanReplay_Stats_t stats;
+} CanReplay_State_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static CanReplay_State_t s_rp;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Microseconds of @p r after the first record.
+ *
+ * Modulo 2^32 ms, as candump stamps (epoch seconds) overflow timeMs;
+ * stamps before the first record give 0.
+ */
+static uint64_t replay_offset_us(const CanReplay_State_t *rp, const CanTrace_Rec_t *r)
+{
+    uint32_t dMs = r->timeMs - rp->firstMs;
+
+    if (dMs >= 0x80000000U)
+        return 0U;
+
+    int64_t us = ((int64_t)dMs * 1000) + (int64_t)r->timeUs - (int64_t)rp->firstUs;
+    return (us > 0) ? (uint64_t)us : 0U;
+}
+
+/**
+ * @brief FIFO the first matching filter entry routes @p key to.
+ *
+ * @return CAN_RX_FIFO0 / CAN_RX_FIFO1, or -1 if no entry accepts it.
+ */
+static int32_t replay_fifo(uint32_t key)
+{
+    if (CAN_FILTERS_ACCEPT_ALL != 0)
+        return (int32_t)CAN_RX_FIFO0;
+
+    uint32_t                 count;
+    const CanFilter_Entry_t *t   = CanFilters_GetTable(&count);
+    uint8_t                  ext = ((key & CAN_IF_ID_EXT) != 0U) ? 1U : 0U;
+    uint32_t                 id  = key & CAN_IF_ID_MASK;
+
+    for (uint32_t i = 0U; i < count; ++i)
+    {
+        if ((t[i].ext == ext) && (((id ^ t[i].id) & t[i].mask) == 0U))
+            return (t[i].fifo == CAN_FILTER_FIFO1) ? (int32_t)CAN_RX_FIFO1 : (int32_t)CAN_RX_FIFO0;
+    }
+    return -1;
+}
+
+static uint8_t replay_ring_full(void)
+{
+    CanRing_t      *ring = CAN_IF_GetRxRing();
+    CanRing_Stats_t st;
+
+    if (ring == NULL)
+        return 1U;
+    CanRing_GetStats(ring, &st);
+    return (st.count >= st.capacity) ? 1U : 0U;
+}
+
+/** Trace ring source of "can replay": ctx is the index of the next record. */
+static uint8_t replay_next_trace(void *ctx, CanTrace_Rec_t *rec)
+{
+    uint32_t             *i = (uint32_t *)ctx;
+    const CanTrace_Rec_t *r = CanTrace_Get(*i);
+
+    if (r == NULL)
+        return 0U;
+    *rec = *r;
+    (*i)++;
+    return 1U;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief CLI: "can replay [<speed>|fast]" - replay the trace ring.
+ */
+static void replay_cmd_run(int argc, char *argv[])
+{
+    uint32_t speed = 1000U;
+
+    if (argc > 0)
+    {
+        char *end;
+
+        if (strcmp(argv[0], "fast") == 0)
+        {
+            speed = CAN_REPLAY_FAST;
+        }
+        else
+        {
+            float f = strtof(argv[0], &end);
+            speed   = (uint32_t)((f * 1000.0f) + 0.5f);
+            if ((end == argv[0]) || (*end != '\0') ||
+                (speed < REPLAY_SPEED_MIN) || (speed > REPLAY_SPEED_MAX))
+            {
+                CLI_IF_Print("Usage: can replay [<speed 0.001..1000>|fast]\r\n");
+                return;
+            }
+        }
+    }
+
+    uint32_t count = CanTrace_Stop();
+    if (count == 0U)
+    {
+        CLI_IF_Print("Trace is empty: record one (\"can trace start\") or load it "
+                     "(tools/can_replay.py)\r\n");
+        return;
+    }
+
+    CanRing_t      *ring = CAN_IF_GetRxRing();
+    CanRing_Stats_t before;
+    CanRing_Stats_t after;
+
+    if (ring == NULL)
+    {
+        CLI_IF_Print("CAN RX ring not available\r\n");
+        return;
+    }
+    CanRing_GetStats(ring, &before);
+
+    if (speed == CAN_REPLAY_FAST)
+        CLI_IF_Printf("Replaying %lu frames as fast as CanRxTask takes them\r\n",
+                      (unsigned long)count);
+    else
+        CLI_IF_Printf("Replaying %lu frames at %lu.%03lux\r\n", (unsigned long)count,
+                      (unsigned long)(speed / 1000U), (unsigned long)(speed % 1000U));
+
+    /* Fast: below CanRxTask, which then takes every frame as it is
+     * committed, as from the interrupt. Paced: CliTask stays above it, so
+     * bursts fill the ring as they would. */
+    osThreadId_t self = osThreadGetId();
+    osPriority_t prio = osThreadGetPriority(self);
+    uint32_t     idx  = 0U;
+
+    if (speed == CAN_REPLAY_FAST)
+        (void)osThreadSetPriority(self, osPriorityLow);
+
+    CanReplay_Stats_t st;
+    uint32_t          lastFrames = 0U;
+    uint32_t          lastMove   = HAL_GetTick();
+    uint8_t           stalled    = 0U;
+
+    CanReplay_Begin(replay_next_trace, &idx, speed, HAL_GetTick());
+    while (CanReplay_Poll(HAL_GetTick()) != 0U)
+    {
+        if (speed != CAN_REPLAY_FAST)
+        {
+            (void)osDelay(1U);
+            continue;
+        }
+
+        CanReplay_GetStats(&st);
+        if (st.frames != lastFrames)
+        {
+            lastFrames = st.frames;
+            lastMove   = HAL_GetTick();
+        }
+        else if ((HAL_GetTick() - lastMove) >= CAN_REPLAY_STALL_MS)
+        {
+            stalled = 1U;
+            break;
+        }
+
+        if (replay_ring_full() != 0U)
+            (void)osDelay(1U);
+        else
+            (void)osThreadYield();
+    }
+
+    (void)osThreadSetPriority(self, prio);
+    CanReplay_GetStats(&st);
+    CanRing_GetStats(ring, &after);
+
+    uint32_t ms = (st.elapsedMs != 0U) ? st.elapsedMs : 1U;
+
+    CLI_IF_Printf("%s: %lu frames in %lu ms (%lu frames/s), trace span %lu ms, "
+                  "%lu rejected by the filters\r\n",
+                  (stalled != 0U) ? "Stalled, CanRxTask not draining" : "Done",
+                  (unsigned long)st.frames, (unsigned long)st.elapsedMs,
+                  (unsigned long)(((uint64_t)st.frames * 1000U) / ms),
+                  (unsigned long)st.traceMs, (unsigned long)st.filtered);
+    CLI_IF_Printf("RX ring: %lu dropped, %lu waits, high water %lu of %lu; "
+                  "max %lu ms behind schedule\r\n",
+                  (unsigned long)(after.overflows - before.overflows),
+                  (unsigned long)st.waits, (unsigned long)after.highWater,
+                  (unsigned long)after.capacity, (unsigned long)st.maxLateMs);
+}
+
+static const CliCommand_t s_rpCmds[] =
+{
+    { "can replay", "[<speed>|fast]", 0U, replay_cmd_run,
+      "replay the trace ring into the RX pipeline" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef CanReplay_Init(void)
+{
+    memset(&s_rp, 0, sizeof(s_rp));
+    s_rp.stats.done = 1U;
+
+    CLI_IF_REGISTER_TABLE(s_rpCmds);
+
+    return HAL_OK;
+}
+
+void CanReplay_Begin(CanReplay_Next_t next, void *ctx, uint32_t speed, uint32_t nowMs)
+{
+    memset(&s_rp, 0, sizeof(s_rp));
+    s_rp.next    = next;
+    s_rp.ctx     = ctx;
+    s_rp.speed   = speed;
+    s_rp.startMs = nowMs;
+}
+
+uint8_t CanReplay_Poll(uint32_t nowMs)
+{
+    CanReplay_State_t *rp     = &s_rp;
+    uint32_t           budget = CAN_REPLAY_BATCH;
+
+    if ((rp->stats.done != 0U) || (rp->next == NULL))
+        return 0U;
+
+    for (;;)
+    {
+        if (rp->pending == 0U)
+        {
+            if (rp->next(rp->ctx, &rp->rec) == 0U)
+            {
+                rp->stats.done      = 1U;
+                rp->stats.elapsedMs = nowMs - rp->startMs;
+                return 0U;
+            }
+            rp->pending = 1U;
+        }
+
+        if (rp->started == 0U)
+        {
+            rp->firstMs = rp->rec.timeMs;
+            rp->firstUs = rp->rec.timeUs;
+            rp->started = 1U;
+        }
+        uint64_t offUs = replay_offset_us(rp, &rp->rec);
+
+        rp->stats.elapsedMs = nowMs - rp->startMs;
+
+        if (rp->speed != CAN_REPLAY_FAST)
+        {
+            uint64_t dueUs = (offUs * 1000U) / rp->speed;
+            uint64_t nowUs = (uint64_t)rp->stats.elapsedMs * 1000U;
+
+            if (dueUs > nowUs)
+                return 1U;
+
+            uint32_t late = (uint32_t)((nowUs - dueUs) / 1000U);
+            if (late > rp->stats.maxLateMs)
+                rp->stats.maxLateMs = late;
+        }
+        else
+        {
+            if (budget == 0U)
+                return 1U;
+            if (replay_ring_full() != 0U)
+            {
+                rp->stats.waits++;
+                return 1U;
+            }
+            budget--;
+        }
+
+        if ((uint32_t)(offUs / 1000U) > rp->stats.traceMs)
+            rp->stats.traceMs = (uint32_t)(offUs / 1000U);
+        rp->pending = 0U;
+
+        int32_t fifo = replay_fifo(rp->rec.id);
+        if (fifo < 0)
+        {
+            rp->stats.filtered++;
+            continue;
+        }
+
+        if (CAN_IF_InjectRx(rp->rec.id, rp->rec.dlc, (uint32_t)fifo, rp->rec.data) == HAL_OK)
+            rp->stats.frames++;
+        else
+            rp->stats.ringFull++;
+    }
+}
+
+void CanReplay_GetStats(CanReplay_Stats_t *stats)
+{
+    *stats = s_rp.stats;
+}
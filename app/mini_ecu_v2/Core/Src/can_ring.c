@@ -0,0 +1,173 @@
+/**
+ * @file    can_ring.c
+ * @brief   Lock-free SPSC ring buffer implementation.
+ *
+ * head and tail are free-running 32-bit counters. The fill level is
+ * always (head - tail), which stays correct across wrap-around because
+ * the capacity is a power of two and never exceeds 2^31.
+ *
+ * Ordering:
+ *   - Producer fills the slot, then a DMB, then publishes head.
+ *   - Consumer reads the slot, then a DMB, then publishes tail.
+ *
+ * The notify hook is read by the producer only; it is installed before
+ * the producer interrupt is enabled.
+ */
+
+#include "can_ring.h"
+#include "ramfunc.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef CanRing_Init(CanRing_t *ring, void *storage,
+                               uint32_t elemSize, uint32_t capacity)
+{
+    if ((ring == NULL) || (storage == NULL) || (elemSize == 0U))
+        return HAL_ERROR;
+
+    /* Capacity must be a power of two so indices can be masked. */
+    if ((capacity < 2U) || ((capacity & (capacity - 1U)) != 0U))
+        return HAL_ERROR;
+
+    memset(ring, 0, sizeof(*ring));
+
+    ring->storage  = (uint8_t *)storage;
+    ring->elemSize = elemSize;
+    ring->mask     = capacity - 1U;
+
+    return HAL_OK;
+}
+
+void CanRing_SetConsumer(CanRing_t *ring, osThreadId_t thread, uint32_t flags)
+{
+    if (ring == NULL)
+        return;
+
+    ring->notifyFlags = flags;
+    ring->consumer    = thread;
+}
+
+void CanRing_SetNotifyHook(CanRing_t *ring, void (*hook)(void))
+{
+    if (ring == NULL)
+        return;
+
+    ring->notifyHook = hook;
+}
+
+RAMFUNC void CanRing_Notify(CanRing_t *ring)
+{
+    if (ring->consumer != NULL)
+        (void)osThreadFlagsSet(ring->consumer, ring->notifyFlags);
+}
+
+RAMFUNC void *CanRing_Reserve(CanRing_t *ring)
+{
+    uint32_t head = ring->head;
+
+    if ((head - ring->tail) > ring->mask)
+    {
+        ring->overflows++;
+        return NULL;
+    }
+
+    return &ring->storage[(head & ring->mask) * ring->elemSize];
+}
+
+RAMFUNC void CanRing_Commit(CanRing_t *ring)
+{
+    uint32_t head = ring->head;
+    uint32_t tail = ring->tail;
+
+    /* Slot contents must be visible before the new head. */
+    __DMB();
+    ring->head = head + 1U;
+
+    uint32_t count = (head + 1U) - tail;
+    if (count > ring->highWater)
+        ring->highWater = count;
+
+    /* Wake the consumer only on the empty -> non-empty transition. */
+    if (head != tail)
+        return;
+
+    if (ring->notifyHook != NULL)
+        ring->notifyHook();
+    else if (ring->consumer != NULL)
+        (void)osThreadFlagsSet(ring->consumer, ring->notifyFlags);
+}
+
+void *CanRing_Peek(CanRing_t *ring)
+{
+    uint32_t tail = ring->tail;
+
+    if (ring->head == tail)
+        return NULL;
+
+    /* Do not read slot contents ahead of the head we just observed. */
+    __DMB();
+    return &ring->storage[(tail & ring->mask) * ring->elemSize];
+}
+
+void CanRing_Release(CanRing_t *ring)
+{
+    /* Finish reading the slot before handing it back to the producer. */
+    __DMB();
+    ring->tail = ring->tail + 1U;
+}
+
+uint32_t CanRing_PeekBatch(CanRing_t *ring, void **first, uint32_t max)
+{
+    uint32_t tail  = ring->tail;
+    uint32_t count = ring->head - tail;
+
+    if (count == 0U)
+        return 0U;
+
+    /* Clip to the end of the storage so the run is contiguous. */
+    uint32_t idx = tail & ring->mask;
+    if (count > (ring->mask + 1U - idx))
+        count = ring->mask + 1U - idx;
+    if (count > max)
+        count = max;
+
+    /* Do not read slot contents ahead of the head we just observed. */
+    __DMB();
+    *first = &ring->storage[idx * ring->elemSize];
+    return count;
+}
+
+void CanRing_ReleaseBatch(CanRing_t *ring, uint32_t count)
+{
+    /* Finish reading the slots before handing them back to the producer. */
+    __DMB();
+    ring->tail = ring->tail + count;
+}
+
+uint32_t CanRing_Count(const CanRing_t *ring)
+{
+    return ring->head - ring->tail;
+}
+
+void CanRing_GetStats(const CanRing_t *ring, CanRing_Stats_t *stats)
+{
+    if ((ring == NULL) || (stats == NULL))
+        return;
+
+    stats->capacity  = ring->mask + 1U;
+    stats->count     = ring->head - ring->tail;
+    stats->highWater = ring->highWater;
+    stats->overflows = ring->overflows;
+}
+
+void CanRing_ResetStats(CanRing_t *ring)
+{
+    if (ring == NULL)
+        return;
+
+    ring->highWater = ring->head - ring->tail;
+    ring->overflows = 0U;
+}
@@ -0,0 +1,340 @@
+/**
+ * @file    can_rxlimit.c
+ * @brief   Token buckets per filter entry, flood muting and "can rxlimit".
+ *
+ * Tokens are counted in thousandths of a frame: a bucket gains @c rate per
+ * millisecond and a frame costs 1000, so the interrupt needs no divide.
+ * After @c fillMs without frames the bucket is simply full, which also
+ * keeps the multiply from overflowing.
+ */
+
+#include "can_rxlimit.h"
+#include "can_if.h"
+#include "cli_if.h"
+#include "log.h"
+#include "ramfunc.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/** Tokens per frame. */
+#define RXL_FRAME            1000U
+
+/** Retry of a mute or resume refused by a reconfiguration (ms). */
+#define RXL_RETRY_MS         10U
+
+/** "a is at or after b" on a wrapping millisecond counter. */
+#define RXL_REACHED(a, b)    ((int32_t)((a) - (b)) >= 0)
+
+#define RXL_ENTRIES          CAN_FILTER_N_ENTRIES
+
+typedef struct
+{
+    /* Set by CanRxLimit_Init(). */
+    uint32_t rate;             /* tokens per ms = frames/s; 0 = not limited */
+    uint32_t cap;              /* burst * RXL_FRAME */
+    uint32_t fillMs;           /* empty to full */
+
+    /* RX interrupt of the entry's FIFO only. */
+    uint32_t tokens;
+    uint32_t lastMs;           /* HAL tick of the last refill */
+    uint32_t floodMs;          /* HAL tick of the first drop of this run */
+    uint32_t lastDropMs;
+    uint32_t dropped;
+    uint32_t lastKey;
+    uint32_t floods;
+    volatile uint8_t flood;    /* set by the interrupt, cleared by CanTxTask */
+
+    /* CanTxTask only. */
+    uint8_t  muted;
+    uint8_t  retry;            /* CAN_IF_MuteFilter() refused, try at until */
+    uint32_t until;            /* kernel tick: resume, or the retry */
+    uint32_t mutes;
+} RxLimit_Bucket_t;
+
+typedef struct
+{
+    uint32_t key;
+    uint32_t rate;
+    uint32_t burst;
+} RxLimit_Override_t;
+
+#define RXL_OVERRIDE(id, r, b)  { (uint32_t)(id), (uint32_t)(r), (uint32_t)(b) },
+
+static const RxLimit_Override_t s_rxlOverrides[] =
+{
+    CAN_RXLIMIT_TABLE(RXL_OVERRIDE)
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static RxLimit_Bucket_t s_rxl[RXL_ENTRIES];
+
+/** FMI -> bucket + 1 per FIFO, 0 = not limited. Rebuilt with CAN1 stopped. */
+static uint8_t s_rxlFmi[2][CAN_FILTERS_MAX_FMI];
+
+static osThreadId_t s_rxlThread = NULL;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Key of a table entry as CAN_RXLIMIT_TABLE writes it. */
+static uint32_t rxl_key(const CanFilter_Entry_t *e)
+{
+    return (e->ext != 0U) ? (e->id | CAN_IF_ID_EXT) : e->id;
+}
+
+/** Mute @p i, or resume it; on a refusal try again in RXL_RETRY_MS. */
+static void rxl_set_muted(uint32_t i, RxLimit_Bucket_t *b, uint8_t muted, uint32_t nowMs)
+{
+    if (CAN_IF_MuteFilter(i, muted) != HAL_OK)
+    {
+        b->retry = 1U;
+        b->until = nowMs + RXL_RETRY_MS;
+        return;
+    }
+    b->retry = 0U;
+
+    uint32_t count = 0U;
+    const CanFilter_Entry_t *e = &CanFilters_GetTable(&count)[i];
+
+    b->muted = muted;
+    if (muted != 0U)
+    {
+        b->mutes++;
+        b->until = nowMs + CAN_RXLIMIT_MUTE_MS;
+        LOG_WARN(CAN, "RX flood on filter 0x%lX/0x%lX (last ID 0x%lX), muted for %lu ms",
+                 (unsigned long)e->id, (unsigned long)e->mask,
+                 (unsigned long)b->lastKey, (unsigned long)CAN_RXLIMIT_MUTE_MS);
+    }
+    else
+    {
+        /* Frames counted again from here on; a new run of drops makes a
+         * new flood. */
+        b->flood = 0U;
+        LOG_INFO(CAN, "RX filter 0x%lX/0x%lX resumed",
+                 (unsigned long)e->id, (unsigned long)e->mask);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void rxl_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t count = 0U;
+    const CanFilter_Entry_t *table = CanFilters_GetTable(&count);
+
+    CLI_IF_Printf("Flood: %u ms of drops mutes the filter for %u ms\r\n",
+                  (unsigned)CAN_RXLIMIT_FLOOD_MS, (unsigned)CAN_RXLIMIT_MUTE_MS);
+    CLI_IF_Print("Filter               Rate/s Burst   Dropped  Last drop  Floods Mutes  State\r\n");
+
+    for (uint32_t i = 0U; i < count; ++i)
+    {
+        CanRxLimit_Stats_t st;
+        if (CanRxLimit_GetStats(i, &st) != 0)
+            break;
+
+        if (st.rate == 0U)
+        {
+            CLI_IF_Printf("%08lX/%08lX       -     -         -          -       -     -  on\r\n",
+                          (unsigned long)table[i].id, (unsigned long)table[i].mask);
+            continue;
+        }
+
+        CLI_IF_Printf("%08lX/%08lX  %6lu %5lu %9lu   %08lX %7lu %5lu  ",
+                      (unsigned long)table[i].id, (unsigned long)table[i].mask,
+                      (unsigned long)st.rate, (unsigned long)st.burst,
+                      (unsigned long)st.dropped, (unsigned long)st.lastKey,
+                      (unsigned long)st.floods, (unsigned long)st.mutes);
+        if (st.mutedMs != 0U)
+            CLI_IF_Printf("muted %lu ms\r\n", (unsigned long)st.mutedMs);
+        else
+            CLI_IF_Print("on\r\n");
+    }
+}
+
+static const CliCommand_t s_rxlCmds[] =
+{
+    { "can rxlimit", "", 0U, rxl_cmd_show, "RX rate limits, drops and muted filters" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void CanRxLimit_Init(void)
+{
+    uint32_t count = 0U;
+    const CanFilter_Entry_t *table = CanFilters_GetTable(&count);
+
+    memset(s_rxl, 0, sizeof(s_rxl));
+    memset(s_rxlFmi, 0, sizeof(s_rxlFmi));
+
+    for (uint32_t i = 0U; (i < count) && (i < RXL_ENTRIES); ++i)
+    {
+        RxLimit_Bucket_t *b  = &s_rxl[i];
+        uint32_t        rate  = CAN_RXLIMIT_RATE;
+        uint32_t        burst = CAN_RXLIMIT_BURST;
+
+        for (uint32_t k = 0U; k < (sizeof(s_rxlOverrides) / sizeof(s_rxlOverrides[0])); ++k)
+        {
+            if (s_rxlOverrides[k].key == rxl_key(&table[i]))
+            {
+                rate  = s_rxlOverrides[k].rate;
+                burst = s_rxlOverrides[k].burst;
+            }
+        }
+
+        if ((rate == 0U) || (burst == 0U))
+            continue;
+
+        b->rate   = rate;
+        b->cap    = burst * RXL_FRAME;
+        b->fillMs = (b->cap + rate - 1U) / rate;
+    }
+
+    CLI_IF_REGISTER_TABLE(s_rxlCmds);
+}
+
+void CanRxLimit_Rebuild(void)
+{
+    uint32_t now = HAL_GetTick();
+
+    memset(s_rxlFmi, 0, sizeof(s_rxlFmi));
+
+    for (uint32_t fifo = 0U; fifo < 2U; ++fifo)
+    {
+        for (uint32_t fmi = 0U; fmi < CAN_FILTERS_MAX_FMI; ++fmi)
+        {
+            int32_t e = CanFilters_EntryFromMatch(fifo, fmi);
+            if ((e >= 0) && ((uint32_t)e < RXL_ENTRIES) && (s_rxl[e].rate != 0U))
+                s_rxlFmi[fifo][fmi] = (uint8_t)(e + 1);
+        }
+    }
+
+    /* Full buckets. The apply also unmuted every filter: a pending
+     * resume of CanTxTask then does nothing but log. */
+    for (uint32_t i = 0U; i < RXL_ENTRIES; ++i)
+    {
+        RxLimit_Bucket_t *b = &s_rxl[i];
+
+        b->tokens     = b->cap;
+        b->lastMs     = now;
+        b->lastDropMs = now - CAN_RXLIMIT_QUIET_MS - 1U;
+    }
+}
+
+void CanRxLimit_SetConsumer(osThreadId_t thread)
+{
+    s_rxlThread = thread;
+}
+
+RAMFUNC uint8_t CanRxLimit_Admit(uint32_t fifo, uint32_t fmi, uint32_t key)
+{
+    uint32_t n = (fmi < CAN_FILTERS_MAX_FMI) ? s_rxlFmi[fifo & 1U][fmi] : 0U;
+    if (n == 0U)
+        return 1U;
+
+    RxLimit_Bucket_t *b   = &s_rxl[n - 1U];
+    uint32_t          now = HAL_GetTick();
+    uint32_t          el  = now - b->lastMs;
+
+    if (el != 0U)
+    {
+        b->lastMs = now;
+        if (el >= b->fillMs)
+            b->tokens = b->cap;
+        else
+        {
+            uint32_t t = b->tokens + (el * b->rate);
+            b->tokens = (t > b->cap) ? b->cap : t;
+        }
+    }
+
+    if (b->tokens >= RXL_FRAME)
+    {
+        b->tokens -= RXL_FRAME;
+        return 1U;
+    }
+
+    b->dropped++;
+    b->lastKey = key;
+    if ((now - b->lastDropMs) > CAN_RXLIMIT_QUIET_MS)
+        b->floodMs = now;
+    b->lastDropMs = now;
+
+    if ((CAN_RXLIMIT_MUTE_MS != 0U) && (b->flood == 0U) &&
+        ((now - b->floodMs) >= CAN_RXLIMIT_FLOOD_MS))
+    {
+        b->flood = 1U;
+        b->floods++;
+        if (s_rxlThread != NULL)
+            (void)osThreadFlagsSet(s_rxlThread, CAN_RXLIMIT_FLAG);
+    }
+    return 0U;
+}
+
+uint32_t CanRxLimit_Run(uint32_t nowMs)
+{
+    uint32_t wait = osWaitForever;
+
+    for (uint32_t i = 0U; i < RXL_ENTRIES; ++i)
+    {
+        RxLimit_Bucket_t *b = &s_rxl[i];
+
+        uint8_t due = ((b->muted == 0U) && (b->retry == 0U)) ||
+                      RXL_REACHED(nowMs, b->until);
+
+        if ((b->muted == 0U) && (b->flood != 0U) && (due != 0U))
+            rxl_set_muted(i, b, 1U, nowMs);
+        else if ((b->muted != 0U) && (due != 0U))
+            rxl_set_muted(i, b, 0U, nowMs);
+
+        /* Waiting: a resume, or a refused mute to be tried again. */
+        if ((b->muted != 0U) || ((b->flood != 0U) && (b->retry != 0U)))
+        {
+            uint32_t left = RXL_REACHED(nowMs, b->until) ? 0U : (b->until - nowMs);
+            if (left < wait)
+                wait = left;
+        }
+    }
+
+    return wait;
+}
+
+int CanRxLimit_GetStats(uint32_t entry, CanRxLimit_Stats_t *stats)
+{
+    if ((entry >= RXL_ENTRIES) || (stats == NULL))
+        return -1;
+
+    const RxLimit_Bucket_t *b = &s_rxl[entry];
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    stats->rate    = b->rate;
+    stats->burst   = b->cap / RXL_FRAME;
+    stats->dropped = b->dropped;
+    stats->lastKey = b->lastKey;
+    stats->floods  = b->floods;
+    __set_PRIMASK(primask);
+
+    /* Written by CanTxTask; a torn read only shows a stale count. */
+    stats->mutes   = b->mutes;
+    stats->mutedMs = 0U;
+    if ((b->muted != 0U) && ((CanFilters_GetMuted() & (1UL << entry)) != 0U))
+    {
+        uint32_t now = osKernelGetTickCount();
+        stats->mutedMs = RXL_REACHED(now, b->until) ? 0U : (b->until - now);
+    }
+    return 0;
+}
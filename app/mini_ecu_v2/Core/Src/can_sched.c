@@ -0,0 +1,248 @@
+/**
+ * @file    can_sched.c
+ * @brief   CAN TX scheduler table, the scheduling pass and "can sched".
+ *
+ * Time is kept in free-running milliseconds and compared with signed
+ * differences, so the tick counter may wrap.
+ */
+
+#include "can_sched.h"
+#include "ramfunc.h"
+#include "cli_if.h"
+#include "metrics.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    const CanSched_Frame_t *cfg;
+    uint32_t                nextDue;    /* next cyclic send */
+    uint32_t                lastSent;
+    uint8_t                 sentOnce;
+    CanSched_Stats_t        stats;
+} CanSched_Entry_t;
+
+/** "a is at or after b" on a wrapping millisecond counter. */
+#define SCHED_REACHED(a, b)   ((int32_t)((a) - (b)) >= 0)
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Written by CanSched_Add() before the scheduler task starts, then by that
+ * task only; "can sched" reads counters that may be one send stale. */
+static CanSched_Entry_t s_sched[CAN_SCHED_MAX_FRAMES];
+static uint32_t         s_schedCount   = 0U;
+static uint8_t          s_schedStarted = 0U;
+static uint32_t         s_schedNow     = 0U;
+static osThreadId_t     s_schedThread  = NULL;
+
+/* Runs that left a due frame to the next millisecond (CAN_SCHED_BURST). */
+static uint32_t         s_schedBursts  = 0U;
+
+/* CanSched_Suspend(): set by the network management task, read here. */
+static volatile uint8_t s_schedSuspended = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Earlier of @p a and @p b; osWaitForever counts as "never". */
+static uint32_t sched_min_wait(uint32_t a, uint32_t b)
+{
+    return (b < a) ? b : a;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void sched_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if (s_schedCount == 0U)
+    {
+        CLI_IF_Print("No scheduled CAN frames\r\n");
+        return;
+    }
+
+    CLI_IF_Print("frame          ID         cycle  gap  ofs   cyclic  change   held   busy\r\n");
+    for (uint32_t i = 0U; i < s_schedCount; ++i)
+    {
+        const CanSched_Frame_t *f = s_sched[i].cfg;
+        CanSched_Stats_t        st;
+
+        (void)CanSched_GetStats(i, &st);
+        CLI_IF_Printf("%-14s 0x%08lX %5u %4u %4u %8lu %7lu %6lu %6lu\r\n",
+                      f->name, (unsigned long)f->id, (unsigned)f->cycleMs,
+                      (unsigned)f->minGapMs, (unsigned)f->offsetMs,
+                      (unsigned long)st.cyclic, (unsigned long)st.onChange,
+                      (unsigned long)st.gapHeld, (unsigned long)st.busy);
+    }
+    CLI_IF_Printf("Runs cut short by the %u-frame burst limit: %lu\r\n",
+                  (unsigned)CAN_SCHED_BURST, (unsigned long)s_schedBursts);
+    if (s_schedSuspended != 0U)
+        CLI_IF_Print("Suspended: the bus is going to sleep\r\n");
+}
+
+static const CliCommand_t s_schedCmds[] =
+{
+    { "can sched", "", 0U, sched_cmd_show, "scheduled CAN frames and their counters" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void CanSched_Init(void)
+{
+    memset(s_sched, 0, sizeof(s_sched));
+    s_schedCount   = 0U;
+    s_schedStarted = 0U;
+    s_schedBursts  = 0U;
+    s_schedSuspended = 0U;
+
+    CLI_IF_REGISTER_TABLE(s_schedCmds);
+}
+
+HAL_StatusTypeDef CanSched_Add(const CanSched_Frame_t *frame)
+{
+    if ((frame == NULL) || (frame->send == NULL) ||
+        ((frame->cycleMs == 0U) && (frame->changed == NULL)) ||
+        (s_schedCount >= CAN_SCHED_MAX_FRAMES))
+        return HAL_ERROR;
+
+    CanSched_Entry_t *e = &s_sched[s_schedCount];
+    memset(e, 0, sizeof(*e));
+    e->cfg = frame;
+
+    /* Before the first run the offset is relative to it (see below). */
+    e->nextDue = s_schedNow + frame->offsetMs;
+
+    s_schedCount++;
+    return HAL_OK;
+}
+
+void CanSched_SetConsumer(osThreadId_t thread)
+{
+    s_schedThread = thread;
+}
+
+RAMFUNC void CanSched_Notify(void)
+{
+    if (s_schedThread != NULL)
+        (void)osThreadFlagsSet(s_schedThread, CAN_SCHED_FLAG);
+}
+
+void CanSched_Suspend(uint8_t on)
+{
+    if (on != 0U)
+    {
+        s_schedSuspended = 1U;
+        return;
+    }
+
+    if (s_schedSuspended == 0U)
+        return;
+
+    /* Resume as from boot: the offsets apply again from the next run. */
+    s_schedStarted   = 0U;
+    s_schedSuspended = 0U;
+    CanSched_Notify();
+}
+
+uint32_t CanSched_Run(uint32_t nowMs)
+{
+    if (s_schedSuspended != 0U)
+        return osWaitForever;
+
+    if (s_schedStarted == 0U)
+    {
+        /* Offsets count from the first run, not from the tick at boot. */
+        for (uint32_t i = 0U; i < s_schedCount; ++i)
+            s_sched[i].nextDue = nowMs + s_sched[i].cfg->offsetMs;
+        s_schedStarted = 1U;
+    }
+    s_schedNow = nowMs;
+
+    uint32_t wait     = osWaitForever;
+    uint32_t sent     = 0U;
+    uint8_t  deferred = 0U;
+
+    for (uint32_t i = 0U; i < s_schedCount; ++i)
+    {
+        CanSched_Entry_t       *e = &s_sched[i];
+        const CanSched_Frame_t *f = e->cfg;
+
+        uint8_t cyclic = ((f->cycleMs != 0U) && SCHED_REACHED(nowMs, e->nextDue)) ? 1U : 0U;
+        uint8_t change = ((cyclic == 0U) && (f->changed != NULL) &&
+                          (f->changed(f->ctx) != 0U)) ? 1U : 0U;
+
+        uint8_t held   = 0U;
+
+        if ((cyclic != 0U) || (change != 0U))
+        {
+            uint32_t gapEnd = e->lastSent + f->minGapMs;
+
+            if ((e->sentOnce != 0U) && !SCHED_REACHED(nowMs, gapEnd))
+            {
+                /* Rate limit: look again once the gap is over. */
+                held = 1U;
+                e->stats.gapHeld++;
+                wait = sched_min_wait(wait, gapEnd - nowMs);
+            }
+            else if (sent >= CAN_SCHED_BURST)
+            {
+                deferred = 1U;
+                wait     = sched_min_wait(wait, 1U);
+            }
+            else if (f->send(f->ctx) != HAL_OK)
+            {
+                /* TX queue full: stays due, retried next millisecond. */
+                e->stats.busy++;
+                wait = sched_min_wait(wait, 1U);
+            }
+            else
+            {
+                sent++;
+                e->lastSent = nowMs;
+                e->sentOnce = 1U;
+                if (cyclic != 0U)
+                {
+                    e->stats.cyclic++;
+                    METRIC_SET(CAN_SCHED_LATE_MS, nowMs - e->nextDue);
+                }
+                else
+                    e->stats.onChange++;
+
+                /* An on-change send restarts the cycle as well. */
+                e->nextDue = nowMs + f->cycleMs;
+            }
+        }
+
+        if ((f->cycleMs != 0U) && (held == 0U))
+        {
+            uint32_t due = SCHED_REACHED(nowMs, e->nextDue) ? 1U : (e->nextDue - nowMs);
+            wait = sched_min_wait(wait, due);
+        }
+    }
+
+    if (deferred != 0U)
+        s_schedBursts++;
+
+    return wait;
+}
+
+HAL_StatusTypeDef CanSched_GetStats(uint32_t index, CanSched_Stats_t *stats)
+{
+    if ((index >= s_schedCount) || (stats == NULL))
+        return HAL_ERROR;
+
+    *stats = s_sched[index].stats;
+    return HAL_OK;
+}
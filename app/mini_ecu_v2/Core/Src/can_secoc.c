@@ -0,0 +1,413 @@
+/**
+ * @file    can_secoc.c
+ * @brief   Freshness values and MACs of the authenticated CAN frames, their
+ *          flash log client and "can secoc".
+ */
+
+#include "can_secoc.h"
+#include "aes_cmac.h"
+#include "can_if.h"
+#include "nvm_log.h"
+#include "cli_if.h"
+#include "log.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* Records: key = entry, aux = SECOC_REC_VERSION, data[0] = TX FV reserved
+ * up to (exclusive), data[1] = RX FV floor. */
+#define SECOC_REC_VERSION   1U
+
+typedef struct
+{
+    uint32_t key;
+    uint8_t  payload;
+    uint8_t  fv;
+    uint8_t  mac;
+    uint16_t dataId;
+} CanSecOC_Def_t;
+
+#define CAN_SECOC_DEF_(name, id, payload, fv, mac, dataId)   { (id), (payload), (fv), (mac), (dataId) },
+static const CanSecOC_Def_t s_secDefs[CAN_SECOC_COUNT] = { CAN_SECOC_TABLE(CAN_SECOC_DEF_) };
+
+#define CAN_SECOC_NAME_(name, id, payload, fv, mac, dataId)  #name,
+static const char *const s_secNames[CAN_SECOC_COUNT] = { CAN_SECOC_TABLE(CAN_SECOC_NAME_) };
+
+#define CAN_SECOC_OK_(name, id, payload, fv, mac, dataId)                         \
+    && (((payload) + (fv) + (mac)) <= 8U) && ((fv) >= 1U) && ((fv) <= 4U) &&      \
+       ((mac) >= 3U) && ((2U + (payload) + 4U) <= AES_CMAC_BLOCK)
+_Static_assert(1 CAN_SECOC_TABLE(CAN_SECOC_OK_), "a SecOC frame needs fv 1..4, mac 3..8 in 8 bytes");
+_Static_assert(CAN_SECOC_COUNT < CAN_SECOC_NONE, "too many SecOC frames");
+
+typedef struct
+{
+    uint32_t         txFv;      /* next FV to send */
+    uint32_t         txBound;   /* reserved up to, queued for the log */
+    uint32_t         txSafe;    /* reserved up to, taken by NvmTask */
+    uint32_t         rxFv;
+    uint32_t         rxStored;
+    uint32_t         rxProbe;   /* windows ahead tried by the last rejection */
+    uint8_t          pending;
+    CanSecOC_Stats_t stats;     /* txFv, rxFv filled in by GetStats */
+} CanSecOC_State_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Written by CanSecOC_Init() before the scheduler starts, read-only after. */
+static AesCmac_Key_t s_secKey;
+static uint8_t       s_secReady    = 0U;
+static uint8_t       s_secNvm      = 0U;
+static uint8_t       s_secSelfTest = 0U;
+
+/* TX fields: the sending tasks; RX fields: CanRxTask; the flash fields
+ * also NvmTask. All under PRIMASK. */
+static CanSecOC_State_t s_secState[CAN_SECOC_COUNT];
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static void secoc_reset_state(void)
+{
+    memset(s_secState, 0, sizeof(s_secState));
+    for (uint32_t e = 0U; e < CAN_SECOC_COUNT; ++e)
+    {
+        /* 0 would never pass the receiver's "above the last one". */
+        s_secState[e].txFv    = 1U;
+        s_secState[e].txBound = 1U;
+        s_secState[e].txSafe  = 1U;
+    }
+}
+
+/**
+ * @brief MAC of the payload of @p data with FV @p fv into @p mac (16
+ *        bytes).
+ *
+ * @return DWT cycles it took.
+ */
+static uint32_t secoc_mac(const CanSecOC_Def_t *d, const uint8_t *data, uint32_t fv, uint8_t *mac)
+{
+    uint32_t t0 = DWT->CYCCNT;
+    uint8_t  msg[AES_CMAC_BLOCK];
+    uint32_t n = 0U;
+
+    msg[n++] = (uint8_t)(d->dataId >> 8);
+    msg[n++] = (uint8_t)d->dataId;
+    memcpy(&msg[n], data, d->payload);
+    n += d->payload;
+    msg[n++] = (uint8_t)(fv >> 24);
+    msg[n++] = (uint8_t)(fv >> 16);
+    msg[n++] = (uint8_t)(fv >> 8);
+    msg[n++] = (uint8_t)fv;
+
+    AesCmac_Compute(&s_secKey, msg, n, mac);
+    return DWT->CYCCNT - t0;
+}
+
+/** Book the MAC time; caller holds PRIMASK. */
+static void secoc_cycles(CanSecOC_State_t *s, uint32_t cycles)
+{
+    s->stats.macCycles = cycles;
+    if (cycles > s->stats.macMax)
+        s->stats.macMax = cycles;
+}
+
+static void secoc_restore(const NvmLog_Record_t *rec)
+{
+    uint32_t e = (uint32_t)rec->key;
+
+    if ((e >= CAN_SECOC_COUNT) || (rec->aux != SECOC_REC_VERSION))
+        return;
+
+    CanSecOC_State_t *s  = &s_secState[e];
+    uint32_t          tx = (rec->data[0] != 0U) ? rec->data[0] : 1U;
+
+    /* Every FV below the reservation may have been sent: start at it. */
+    s->txFv     = tx;
+    s->txBound  = tx;
+    s->txSafe   = tx;
+    s->rxFv     = rec->data[1];
+    s->rxStored = rec->data[1];
+}
+
+static uint8_t secoc_take(uint32_t i, uint8_t all, NvmLog_Record_t *rec)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    CanSecOC_State_t *s = &s_secState[i];
+
+    uint8_t take = (all != 0U) ? (uint8_t)((s->txBound > 1U) || (s->rxStored != 0U)) : s->pending;
+    rec->key     = (uint16_t)i;
+    rec->aux     = SECOC_REC_VERSION;
+    rec->data[0] = s->txBound;
+    rec->data[1] = s->rxStored;
+    s->pending   = 0U;
+
+    /* NvmTask programs it next; the FVs below are safe to use. */
+    s->txSafe = s->txBound;
+
+    __set_PRIMASK(primask);
+    return take;
+}
+
+static void secoc_retry(uint32_t i)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_secState[i].pending = 1U;
+    __set_PRIMASK(primask);
+}
+
+static const NvmLog_Client_t s_secClient =
+{
+    .tag     = NVM_LOG_TAG_SECOC,
+    .count   = CAN_SECOC_COUNT,
+    .restore = secoc_restore,
+    .take    = secoc_take,
+    .retry   = secoc_retry,
+};
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void secoc_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t mhz = SystemCoreClock / 1000000U;
+
+    if (mhz == 0U)
+        mhz = 1U;
+
+    CLI_IF_Printf("AES-128-CMAC, self-test %s; freshness %s\r\n",
+                  (s_secSelfTest != 0U) ? "passed" : "FAILED",
+                  (s_secNvm != 0U) ? "kept in the flash log" : "not kept over a reset");
+    CLI_IF_Print("ID    name          tx FV      rx FV      sent   held  verified  failed errors"
+                 "  MAC cycles   max     us\r\n");
+    for (uint8_t e = 0U; e < CAN_SECOC_COUNT; ++e)
+    {
+        CanSecOC_Stats_t st;
+        uint32_t         key = s_secDefs[e].key;
+        uint32_t         us10;
+
+        (void)CanSecOC_GetStats(e, &st);
+        us10 = (st.macMax * 10U) / mhz;
+        CLI_IF_Printf("0x%0*lX %-8s %10lu %10lu %9lu %6lu %9lu %7lu %6lu %11lu %5lu %4lu.%lu\r\n",
+                      ((key & CAN_IF_ID_EXT) != 0U) ? 8 : 3,
+                      (unsigned long)(key & 0x1FFFFFFFU), s_secNames[e],
+                      (unsigned long)st.txFv, (unsigned long)st.rxFv, (unsigned long)st.sent,
+                      (unsigned long)st.held, (unsigned long)st.verified,
+                      (unsigned long)st.failed, (unsigned long)st.errors,
+                      (unsigned long)st.macCycles, (unsigned long)st.macMax,
+                      (unsigned long)(us10 / 10U), (unsigned long)(us10 % 10U));
+    }
+}
+
+static const CliCommand_t s_secCmds[] =
+{
+    { "can secoc", "", 0U, secoc_cmd_show, "authenticated CAN frames: freshness, MAC checks" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void CanSecOC_Init(void)
+{
+    static const uint8_t key[AES_CMAC_KEY_LEN] = CAN_SECOC_KEY;
+
+    _Static_assert(sizeof(key) == AES_CMAC_KEY_LEN, "CAN_SECOC_KEY must be 16 bytes");
+
+    secoc_reset_state();
+
+    s_secSelfTest = AesCmac_SelfTest();
+    if (s_secSelfTest == 0U)
+        LOG_ERROR(CAN, "AES-CMAC self-test failed, no authenticated frames");
+
+    AesCmac_SetKey(&s_secKey, key);
+    s_secReady = s_secSelfTest;
+
+    s_secNvm = (NvmLog_Register(&s_secClient) == HAL_OK) ? 1U : 0U;
+    if (s_secNvm == 0U)
+        LOG_ERROR(CAN, "SecOC freshness not in the flash log, not kept over a reset");
+
+    CLI_IF_REGISTER_TABLE(s_secCmds);
+}
+
+uint8_t CanSecOC_Find(uint32_t key)
+{
+    for (uint8_t e = 0U; e < CAN_SECOC_COUNT; ++e)
+    {
+        if (s_secDefs[e].key == key)
+            return e;
+    }
+    return CAN_SECOC_NONE;
+}
+
+HAL_StatusTypeDef CanSecOC_Protect(uint8_t e, uint8_t *data, uint8_t dlc)
+{
+    const CanSecOC_Def_t *d  = &s_secDefs[e];
+    CanSecOC_State_t     *s  = &s_secState[e];
+    HAL_StatusTypeDef     st = HAL_OK;
+    uint8_t               notify = 0U;
+    uint32_t              fv     = 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if ((s_secReady == 0U) || (dlc < (d->payload + d->fv + d->mac)) ||
+        (s->txFv > (0xFFFFFFFFU - CAN_SECOC_FV_RESERVE)))
+    {
+        s->stats.errors++;
+        st = HAL_ERROR;
+    }
+    else
+    {
+        /* Half the reservation used: queue the next one. */
+        if ((s_secNvm != 0U) && ((s->txBound - s->txFv) <= (CAN_SECOC_FV_RESERVE / 2U)))
+        {
+            s->txBound = s->txFv + CAN_SECOC_FV_RESERVE;
+            s->pending = 1U;
+            notify     = 1U;
+        }
+
+        if ((s_secNvm != 0U) && (s->txFv >= s->txSafe))
+        {
+            s->stats.held++;
+            st = HAL_BUSY;
+        }
+        else
+        {
+            fv = s->txFv++;
+            s->stats.sent++;
+        }
+    }
+
+    __set_PRIMASK(primask);
+
+    if (notify != 0U)
+        NvmLog_Notify();
+    if (st != HAL_OK)
+        return st;
+
+    uint8_t  mac[AES_CMAC_BLOCK];
+    uint32_t cycles = secoc_mac(d, data, fv, mac);
+
+    for (uint32_t i = 0U; i < d->fv; ++i)
+        data[d->payload + i] = (uint8_t)(fv >> (8U * i));
+    memcpy(&data[d->payload + d->fv], mac, d->mac);
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    secoc_cycles(s, cycles);
+    __set_PRIMASK(primask);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef CanSecOC_Verify(uint8_t e, const uint8_t *data, uint8_t dlc)
+{
+    const CanSecOC_Def_t *d = &s_secDefs[e];
+    CanSecOC_State_t     *s = &s_secState[e];
+    uint8_t               notify = 0U;
+
+    if ((s_secReady == 0U) || (dlc < (d->payload + d->fv + d->mac)))
+    {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        s->stats.errors++;
+        __set_PRIMASK(primask);
+        return HAL_ERROR;
+    }
+
+    uint64_t step  = (uint64_t)1U << (8U * d->fv);
+    uint64_t trunc = 0U;
+
+    for (uint32_t i = 0U; i < d->fv; ++i)
+        trunc |= (uint64_t)data[d->payload + i] << (8U * i);
+
+    /* The smallest FV above the last accepted one with these low bytes.
+     * Only CanRxTask moves rxFv and rxProbe. */
+    uint64_t latest = s->rxFv;
+    uint64_t fv     = (latest & ~(step - 1U)) | trunc;
+    uint32_t probe  = 0U;
+    uint32_t cycles = 0U;
+    uint8_t  ok     = 0U;
+
+    if (fv <= latest)
+        fv += step;
+
+    /* Failing that, one more window further ahead per rejected frame, so
+     * the receiver catches up after more than step - 1 lost frames. */
+    for (uint32_t attempt = 0U; (attempt < 2U) && (ok == 0U); ++attempt)
+    {
+        if (attempt != 0U)
+        {
+            probe = s->rxProbe + 1U;
+            fv   += step * probe;
+        }
+        if (fv > 0xFFFFFFFFU)
+        {
+            probe = 0U;
+            break;
+        }
+
+        uint8_t mac[AES_CMAC_BLOCK];
+        uint8_t diff = 0U;
+
+        cycles += secoc_mac(d, data, (uint32_t)fv, mac);
+
+        /* Every byte compared, so the time does not tell how many matched. */
+        for (uint32_t i = 0U; i < d->mac; ++i)
+            diff |= (uint8_t)(mac[i] ^ data[d->payload + d->fv + i]);
+        ok = (diff == 0U) ? 1U : 0U;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    secoc_cycles(s, cycles);
+    if (ok != 0U)
+    {
+        s->rxFv    = (uint32_t)fv;
+        s->rxProbe = 0U;
+        s->stats.verified++;
+        if ((s_secNvm != 0U) && ((s->rxFv - s->rxStored) >= (CAN_SECOC_FV_RESERVE / 2U)))
+        {
+            s->rxStored = s->rxFv;
+            s->pending  = 1U;
+            notify      = 1U;
+        }
+    }
+    else
+    {
+        s->rxProbe = probe;
+        s->stats.failed++;
+    }
+
+    __set_PRIMASK(primask);
+
+    if (notify != 0U)
+        NvmLog_Notify();
+    return (ok != 0U) ? HAL_OK : HAL_ERROR;
+}
+
+HAL_StatusTypeDef CanSecOC_GetStats(uint8_t e, CanSecOC_Stats_t *out)
+{
+    if ((e >= CAN_SECOC_COUNT) || (out == NULL))
+        return HAL_ERROR;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *out      = s_secState[e].stats;
+    out->txFv = s_secState[e].txFv;
+    out->rxFv = s_secState[e].rxFv;
+    __set_PRIMASK(primask);
+    return HAL_OK;
+}
@@ -0,0 +1,451 @@
+/**
+ * @file    can_sigcache.c
+ * @brief   Frame decoders and sensor updates into the last-value signal
+ *          cache, subscriptions and "can sig".
+ */
+
+#include "can_sigcache.h"
+#include "can_if.h"
+#include "cli_if.h"
+#include "ramfunc.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    osThreadId_t thread;
+    uint32_t     sigMask;
+    uint32_t     flags;
+} CanSigCache_Sub_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Written by the RX interrupt or CanRxTask and by SensorTask under PRIMASK
+ * and s_sigLock, copied out by any task through s_sigLock (can_sigcache.h).
+ * The frame signals are kept as the raw values on the bus, so the decoder
+ * works on integers (rtos_fpu.h); their entry value is filled in by the
+ * reader, raw x factor as the generated Unpack has it. Stats and
+ * subscriptions are guarded by PRIMASK. */
+static CanSigCache_Entry_t s_sigEntries[CAN_SIG_COUNT];
+static int32_t             s_sigRaw[CAN_SIG_FRAME_COUNT];
+static volatile uint32_t   s_sigLock = 0U;        /* odd while written */
+static CanSigCache_Stats_t s_sigStats;
+static CanSigCache_Sub_t   s_sigSubs[CAN_SIGCACHE_MAX_SUBS];
+
+#if CAN_SIGCACHE_ISR_DECODE
+/* Changed signals of the ISR decoder, for its wake function. */
+static uint32_t            s_sigIsrChanged = 0U;
+#endif
+
+static const char *const s_sigNames[CAN_SIG_COUNT] =
+{
+    "speed_kph", "engine_rpm", "coolant_temp_c",
+    "sens_speed_kph", "sens_rpm", "sens_coolant_c"
+};
+
+static const float s_sigFactor[CAN_SIG_FRAME_COUNT] =
+{
+    CANSIG_VEHICLE_TELEMETRY_SPEED_KPH_FACTOR, 1.0f, CANSIG_VEHICLE_TELEMETRY_COOLANT_TEMP_C_FACTOR
+};
+
+static const float s_sigScale[CAN_SIG_FRAME_COUNT] =
+{
+    CANSIG_VEHICLE_TELEMETRY_SPEED_KPH_SCALE, 1.0f, CANSIG_VEHICLE_TELEMETRY_COOLANT_TEMP_C_SCALE
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Start of a write; caller holds PRIMASK. */
+RAMFUNC static void sigcache_write_begin(void)
+{
+    s_sigLock = s_sigLock + 1U;
+    __DMB();
+}
+
+/** End of a write; caller holds PRIMASK. */
+RAMFUNC static void sigcache_write_end(void)
+{
+    __DMB();
+    s_sigLock = s_sigLock + 1U;
+}
+
+/** Lock word to read under; waits out a write in progress. */
+static uint32_t sigcache_read_begin(void)
+{
+    uint32_t lock;
+
+    /* Odd only if this preempted a writer, which holds PRIMASK: not on
+     * this core, kept for the general case. */
+    while (((lock = s_sigLock) & 1U) != 0U)
+    {
+    }
+    __DMB();
+    return lock;
+}
+
+/** Non-zero if a write overlapped the read begun at @p lock. */
+static uint8_t sigcache_read_retry(uint32_t lock)
+{
+    __DMB();
+    if (s_sigLock == lock)
+        return 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_sigStats.retries++;
+    __set_PRIMASK(primask);
+    return 1U;
+}
+
+/** Store @p raw as a new sample of frame signal @p sig; caller holds
+ *  PRIMASK and the write. @return CAN_SIG_BIT(sig) if the value changed,
+ *  else 0. */
+RAMFUNC static uint32_t sigcache_store_raw(CanSigCache_Signal_t sig, int32_t raw, uint32_t nowMs)
+{
+    CanSigCache_Entry_t *e = &s_sigEntries[sig];
+    uint32_t changed = ((e->seq == 0U) || (s_sigRaw[sig] != raw)) ? CAN_SIG_BIT(sig) : 0U;
+
+    s_sigRaw[sig] = raw;
+    e->timeMs = nowMs;
+    e->seq++;
+    return changed;
+}
+
+/** Store @p value as a new sample of @p sig; caller holds PRIMASK and
+ *  the write. @return CAN_SIG_BIT(sig) if the value changed, else 0. */
+static uint32_t sigcache_store(CanSigCache_Signal_t sig, float value, uint32_t nowMs)
+{
+    if ((uint32_t)sig < CAN_SIG_FRAME_COUNT)
+        return sigcache_store_raw(sig, cansig_round(value * s_sigScale[sig]), nowMs);
+
+    CanSigCache_Entry_t *e = &s_sigEntries[sig];
+    uint32_t changed = ((e->seq == 0U) || (e->value != value)) ? CAN_SIG_BIT(sig) : 0U;
+
+    e->value  = value;
+    e->timeMs = nowMs;
+    e->seq++;
+    return changed;
+}
+
+/** Set the flags of every subscriber to a signal in @p changed; a task or
+ *  an interrupt at the kernel priority. */
+RAMFUNC static void sigcache_notify(uint32_t changed)
+{
+    CanSigCache_Sub_t wake[CAN_SIGCACHE_MAX_SUBS];
+    uint32_t          n = 0U;
+
+    if (changed == 0U)
+        return;
+
+    /* Collected under PRIMASK, woken outside it: setting a flag can switch
+     * to the woken task. */
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint32_t i = 0U; i < CAN_SIGCACHE_MAX_SUBS; ++i)
+    {
+        if ((s_sigSubs[i].thread != NULL) && ((s_sigSubs[i].sigMask & changed) != 0U))
+            wake[n++] = s_sigSubs[i];
+    }
+    __set_PRIMASK(primask);
+
+    for (uint32_t i = 0U; i < n; ++i)
+        (void)osThreadFlagsSet(wake[i].thread, wake[i].flags);
+}
+
+/**
+ * @brief Store a telemetry frame (@p data, the DLC checked) received at
+ *        @p rxCycles. Interrupts masked inside, so also the RX interrupt's.
+ *
+ * @return The signals that changed value.
+ */
+RAMFUNC static uint32_t sigcache_telemetry(const uint8_t *data, uint32_t rxCycles)
+{
+    CanSig_VehicleTelemetry_Raw_t m;
+
+    CanSig_VehicleTelemetry_UnpackRaw(data, &m);
+    uint32_t now = HAL_GetTick();
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    sigcache_write_begin();
+    uint32_t changed = sigcache_store_raw(CAN_SIG_SPEED, (int32_t)m.speed_kph, now);
+    changed |= sigcache_store_raw(CAN_SIG_RPM, (int32_t)m.engine_rpm, now);
+    changed |= sigcache_store_raw(CAN_SIG_COOLANT, (int32_t)m.coolant_temp_c, now);
+    sigcache_write_end();
+    s_sigStats.frames++;
+
+#if CAN_LAT_ENABLE
+    uint32_t cyclesPerUs = SystemCoreClock / 1000000U;
+    uint32_t us = (DWT->CYCCNT - rxCycles) / ((cyclesPerUs != 0U) ? cyclesPerUs : 1U);
+
+    s_sigStats.lastLatUs = us;
+    if (us > s_sigStats.maxLatUs)
+        s_sigStats.maxLatUs = us;
+#else
+    (void)rxCycles;
+#endif
+
+    __set_PRIMASK(primask);
+    return changed;
+}
+
+/** CanRxTask: decode a telemetry frame into the cache. */
+static void sigcache_on_telemetry(const CAN_IF_Msg_t *msg, void *ctx)
+{
+    (void)ctx;
+
+    if (CAN_IF_MSG_LEN(msg) < CANSIG_VEHICLE_TELEMETRY_DLC)
+        return;
+
+#if CAN_LAT_ENABLE
+    sigcache_notify(sigcache_telemetry(msg->Data, msg->EnqCycles));
+#else
+    sigcache_notify(sigcache_telemetry(msg->Data, 0U));
+#endif
+}
+
+#if CAN_SIGCACHE_ISR_DECODE
+/** CAN1 RX interrupt: decode a telemetry frame; wake only on a change. */
+RAMFUNC static uint8_t sigcache_isr_telemetry(uint32_t key, uint8_t dlc, const uint8_t *data,
+                                              uint32_t rxCycles, void *ctx)
+{
+    (void)key;
+    (void)ctx;
+
+    if (dlc < CANSIG_VEHICLE_TELEMETRY_DLC)
+        return 0U;
+
+    uint32_t changed = sigcache_telemetry(data, rxCycles);
+    if (changed == 0U)
+        return 0U;
+
+    /* Only the RX interrupts set bits; the wake clears them masked. */
+    s_sigIsrChanged |= changed;
+    return 1U;
+}
+
+/** Kernel priority, after the decoder: wake the subscribers. */
+RAMFUNC static void sigcache_isr_wake(void *ctx)
+{
+    (void)ctx;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t changed = s_sigIsrChanged;
+    s_sigIsrChanged = 0U;
+    __set_PRIMASK(primask);
+
+    sigcache_notify(changed);
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void sigcache_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t now = HAL_GetTick();
+
+    CLI_IF_Print("signal               value    age_ms        seq\r\n");
+    for (uint32_t i = 0U; i < (uint32_t)CAN_SIG_COUNT; ++i)
+    {
+        CanSigCache_Entry_t e;
+        (void)CanSigCache_Read((CanSigCache_Signal_t)i, &e);
+
+        if (e.seq == 0U)
+        {
+            CLI_IF_Printf("%-16s %9s %9s %10s\r\n", s_sigNames[i], "---", "---", "0");
+            continue;
+        }
+
+        CLI_IF_Printf("%-16s %9.1f %9lu %10lu%s\r\n", s_sigNames[i], e.value,
+                      (unsigned long)(now - e.timeMs), (unsigned long)e.seq,
+                      (CanSigCache_IsStale(&e, now) != 0U) ? "  STALE" : "");
+    }
+
+    CanSigCache_Stats_t st;
+    CanSigCache_GetStats(&st);
+    const char *where = (st.inIsr != 0U) ? "RX interrupt" : "CanRxTask";
+#if CAN_LAT_ENABLE
+    CLI_IF_Printf("Frames %lu (%s), RX interrupt -> cache last %lu us, max %lu us\r\n",
+                  (unsigned long)st.frames, where, (unsigned long)st.lastLatUs,
+                  (unsigned long)st.maxLatUs);
+#else
+    CLI_IF_Printf("Frames %lu (%s)\r\n", (unsigned long)st.frames, where);
+#endif
+    CLI_IF_Printf("Reads retried %lu\r\n", (unsigned long)st.retries);
+}
+
+static const CliCommand_t s_sigCmds[] =
+{
+    { "can sig", "", 0U, sigcache_cmd_show, "last received CAN signal values" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef CanSigCache_Init(void)
+{
+    memset(s_sigEntries, 0, sizeof(s_sigEntries));
+    memset(s_sigRaw, 0, sizeof(s_sigRaw));
+    memset(&s_sigStats, 0, sizeof(s_sigStats));
+    memset(s_sigSubs, 0, sizeof(s_sigSubs));
+
+    CLI_IF_REGISTER_TABLE(s_sigCmds);
+
+#if CAN_SIGCACHE_ISR_DECODE
+    if (CAN_IF_RegisterIsrDecoder(CANSIG_VEHICLE_TELEMETRY_ID, sigcache_isr_telemetry,
+                                  sigcache_isr_wake, NULL) == HAL_OK)
+    {
+        s_sigStats.inIsr = 1U;
+        return HAL_OK;
+    }
+#endif
+
+    return CAN_IF_RegisterHandler(CANSIG_VEHICLE_TELEMETRY_ID, 0x7FFU,
+                                  sigcache_on_telemetry, NULL);
+}
+
+HAL_StatusTypeDef CanSigCache_Read(CanSigCache_Signal_t sig, CanSigCache_Entry_t *out)
+{
+    if (((uint32_t)sig >= (uint32_t)CAN_SIG_COUNT) || (out == NULL))
+        return HAL_ERROR;
+
+    uint32_t frame = ((uint32_t)sig < CAN_SIG_FRAME_COUNT) ? 1U : 0U;
+    int32_t  raw   = 0;
+    uint32_t lock;
+
+    do
+    {
+        lock = sigcache_read_begin();
+        *out = s_sigEntries[sig];
+        if (frame != 0U)
+            raw = s_sigRaw[sig];
+    } while (sigcache_read_retry(lock) != 0U);
+
+    /* Scaled in the reader's task */
+    if (frame != 0U)
+        out->value = (float)raw * s_sigFactor[sig];
+    return HAL_OK;
+}
+
+uint32_t CanSigCache_Seq(CanSigCache_Signal_t sig)
+{
+    /* An aligned word: read whole without PRIMASK. */
+    return ((uint32_t)sig < (uint32_t)CAN_SIG_COUNT) ? s_sigEntries[sig].seq : 0U;
+}
+
+void CanSigCache_Snapshot(CanSigCache_Entry_t out[CAN_SIG_COUNT])
+{
+    int32_t  raw[CAN_SIG_FRAME_COUNT];
+    uint32_t lock;
+
+    do
+    {
+        lock = sigcache_read_begin();
+        memcpy(out, s_sigEntries, sizeof(s_sigEntries));
+        memcpy(raw, s_sigRaw, sizeof(s_sigRaw));
+    } while (sigcache_read_retry(lock) != 0U);
+
+    for (uint32_t i = 0U; i < CAN_SIG_FRAME_COUNT; ++i)
+        out[i].value = (float)raw[i] * s_sigFactor[i];
+}
+
+const char *CanSigCache_Name(CanSigCache_Signal_t sig)
+{
+    return ((uint32_t)sig < (uint32_t)CAN_SIG_COUNT) ? s_sigNames[sig] : "?";
+}
+
+HAL_StatusTypeDef CanSigCache_Update(uint32_t sigMask, const float *values)
+{
+    if ((values == NULL) || ((sigMask >> CAN_SIG_COUNT) != 0U))
+        return HAL_ERROR;
+
+    uint32_t now     = HAL_GetTick();
+    uint32_t changed = 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    sigcache_write_begin();
+    for (uint32_t i = 0U; i < (uint32_t)CAN_SIG_COUNT; ++i)
+    {
+        if ((sigMask & CAN_SIG_BIT(i)) != 0U)
+            changed |= sigcache_store((CanSigCache_Signal_t)i, values[i], now);
+    }
+    sigcache_write_end();
+    __set_PRIMASK(primask);
+
+    sigcache_notify(changed);
+    return HAL_OK;
+}
+
+uint8_t CanSigCache_IsStale(const CanSigCache_Entry_t *e, uint32_t nowMs)
+{
+    return ((e == NULL) || (e->seq == 0U) ||
+            ((nowMs - e->timeMs) > CAN_SIGCACHE_STALE_MS)) ? 1U : 0U;
+}
+
+void CanSigCache_GetStats(CanSigCache_Stats_t *out)
+{
+    if (out == NULL)
+        return;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *out = s_sigStats;
+    __set_PRIMASK(primask);
+}
+
+HAL_StatusTypeDef CanSigCache_Subscribe(osThreadId_t thread, uint32_t sigMask, uint32_t flags)
+{
+    if ((thread == NULL) || ((sigMask != 0U) && (flags == 0U)))
+        return HAL_ERROR;
+
+    HAL_StatusTypeDef status = HAL_ERROR;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    CanSigCache_Sub_t *slot = NULL;
+    for (uint32_t i = 0U; i < CAN_SIGCACHE_MAX_SUBS; ++i)
+    {
+        if (s_sigSubs[i].thread == thread)
+        {
+            slot = &s_sigSubs[i];
+            break;
+        }
+        if ((slot == NULL) && (s_sigSubs[i].thread == NULL))
+            slot = &s_sigSubs[i];
+    }
+
+    if (sigMask == 0U)
+    {
+        /* Unsubscribe; not subscribed is not an error. */
+        if ((slot != NULL) && (slot->thread == thread))
+            memset(slot, 0, sizeof(*slot));
+        status = HAL_OK;
+    }
+    else if (slot != NULL)
+    {
+        slot->thread  = thread;
+        slot->sigMask = sigMask;
+        slot->flags   = flags;
+        status = HAL_OK;
+    }
+
+    __set_PRIMASK(primask);
+    return status;
+}
@@ -0,0 +1,418 @@
+/**
+ * @file    can_stats.c
+ * @brief   CAN bus load and error counters, the sampling timer and
+ *          "can stats".
+ *
+ * All CAN interrupts share one NVIC priority, so the interrupt-side
+ * updates never preempt each other; the TX path in task context and the
+ * timer hold PRIMASK around theirs.
+ */
+
+#include "can_stats.h"
+#include "can_if.h"
+#include "cli_if.h"
+#include "log.h"
+#include "ramfunc.h"
+#include "FreeRTOS.h"
+#include "timers.h"
+#include <string.h>
+
+/* External handles generated by CubeMX (defined in main.c) */
+extern CAN_HandleTypeDef hcan1;
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    uint32_t id;
+    uint32_t frames;
+    uint32_t prevFrames;    /* frames at the previous window */
+    uint32_t perSec;
+} CanStats_Entry_t;
+
+/* Nominal frame length: SOF .. EOF plus the 3-bit intermission. */
+#define STATS_STD_BITS          47U
+#define STATS_EXT_BITS          67U
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Guarded by PRIMASK outside the CAN interrupts. */
+static CanStats_Entry_t   s_statsIds[CAN_STATS_MAX_IDS];
+static uint32_t           s_statsIdCount = 0U;
+static CanStats_Summary_t s_stats;
+static uint32_t           s_statsRxBits = 0U;
+static uint32_t           s_statsTxBits = 0U;
+static uint8_t            s_statsResetPending = 0U;
+
+/* Timer task only. */
+static uint32_t           s_prevRxFrames = 0U;
+static uint32_t           s_prevTxFrames = 0U;
+static uint32_t           s_prevRxBits   = 0U;
+static uint32_t           s_prevTxBits   = 0U;
+static uint32_t           s_prevTick     = 0U;
+static uint32_t           s_reportTick   = 0U;
+static uint32_t           s_reportLec[CAN_STATS_LEC_COUNT];
+static uint32_t           s_reportOverruns = 0U;
+
+/* Staging copies for the CLI; static to keep them off the CliTask stack. */
+static CanStats_Id_t      s_cliIds[CAN_STATS_MAX_IDS];
+
+/* Created with the native API, as in rtos_stats.c. */
+static TimerHandle_t      s_statsTimer = NULL;
+static StaticTimer_t      s_statsTimerCb;
+
+/** HAL_CAN_ERROR_* bit reported for each last error code. */
+static const uint32_t s_lecHalBits[CAN_STATS_LEC_COUNT] =
+{
+    0U, HAL_CAN_ERROR_STF, HAL_CAN_ERROR_FOR, HAL_CAN_ERROR_ACK,
+    HAL_CAN_ERROR_BR, HAL_CAN_ERROR_BD, HAL_CAN_ERROR_CRC, 0U
+};
+
+static const char *const s_lecNames[CAN_STATS_LEC_COUNT] =
+{
+    "none", "stuff", "form", "ack", "bit-rec", "bit-dom", "crc", "sw"
+};
+
+static const char *const s_stateNames[CAN_STATS_STATES] =
+{
+    "error-active", "error-warning", "error-passive", "bus-off"
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Bits @p key / @p dlc occupies on the bus, without stuff bits. */
+RAMFUNC static uint32_t stats_frame_bits(uint32_t key, uint8_t dlc)
+{
+    uint32_t bits = ((key & CAN_IF_ID_EXT) != 0U) ? STATS_EXT_BITS : STATS_STD_BITS;
+
+    /* A remote frame carries a DLC but no data field. */
+    if ((key & CAN_IF_ID_RTR) == 0U)
+        bits += 8U * ((dlc < 8U) ? dlc : 8U);
+    return bits;
+}
+
+static CanStats_State_t stats_state_of(uint32_t esr)
+{
+    if ((esr & CAN_ESR_BOFF) != 0U)
+        return CAN_STATS_BUSOFF;
+    if ((esr & CAN_ESR_EPVF) != 0U)
+        return CAN_STATS_PASSIVE;
+    if ((esr & CAN_ESR_EWGF) != 0U)
+        return CAN_STATS_WARNING;
+    return CAN_STATS_ACTIVE;
+}
+
+/** Count a transition if @p esr shows a new state; PRIMASK or CAN ISR. */
+static void stats_track_state(uint32_t esr)
+{
+    CanStats_State_t st = stats_state_of(esr);
+
+    if ((uint8_t)st != s_stats.state)
+    {
+        s_stats.state = (uint8_t)st;
+        s_stats.entered[st]++;
+    }
+}
+
+static uint32_t stats_per_sec(uint32_t delta, uint32_t ms)
+{
+    return (ms != 0U) ? (uint32_t)(((uint64_t)delta * 1000U) / ms) : 0U;
+}
+
+/** Log one line of the errors since the last one, at most every
+ *  CAN_STATS_REPORT_MS (timer task). */
+static void stats_report(uint32_t now, const CanStats_Summary_t *sum)
+{
+    uint32_t errors = 0U;
+    uint32_t d[CAN_STATS_LEC_COUNT];
+
+    for (uint32_t i = 0U; i < CAN_STATS_LEC_COUNT; ++i)
+    {
+        d[i]    = sum->lec[i] - s_reportLec[i];
+        errors += d[i];
+    }
+    uint32_t overruns = sum->fifoOverruns - s_reportOverruns;
+
+    if (((errors == 0U) && (overruns == 0U)) ||
+        ((now - s_reportTick) < CAN_STATS_REPORT_MS))
+        return;
+
+    LOG_WARN(CAN, "%lu errors in %lu ms (stuff %lu form %lu ack %lu bit %lu crc %lu), "
+             "%lu FIFO overruns, TEC %u REC %u, %s",
+             (unsigned long)errors, (unsigned long)(now - s_reportTick),
+             (unsigned long)d[1], (unsigned long)d[2], (unsigned long)d[3],
+             (unsigned long)(d[4] + d[5]), (unsigned long)d[6],
+             (unsigned long)overruns, (unsigned)sum->tec, (unsigned)sum->rec,
+             s_stateNames[sum->state]);
+
+    memcpy(s_reportLec, sum->lec, sizeof(s_reportLec));
+    s_reportOverruns = sum->fifoOverruns;
+    s_reportTick     = now;
+}
+
+static void stats_sample(TimerHandle_t timer)
+{
+    (void)timer;
+
+    CanTiming_t t;
+    uint32_t    mode = CAN_IF_GetBitTiming(&t);
+    uint32_t    now  = HAL_GetTick();
+    uint32_t    ms   = now - s_prevTick;
+
+    CanStats_Summary_t sum;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    /* "can stats reset" zeroed the counters these copies refer to. */
+    if (s_statsResetPending != 0U)
+    {
+        s_prevRxFrames   = 0U;
+        s_prevTxFrames   = 0U;
+        s_prevRxBits     = 0U;
+        s_prevTxBits     = 0U;
+        memset(s_reportLec, 0, sizeof(s_reportLec));
+        s_reportOverruns = 0U;
+        s_statsResetPending = 0U;
+    }
+
+    /* The counters only ever fall without an interrupt: poll them. */
+    uint32_t esr = hcan1.Instance->ESR;
+    stats_track_state(esr);
+    s_stats.tec = (uint8_t)(esr >> CAN_ESR_TEC_Pos);
+    s_stats.rec = (uint8_t)(esr >> CAN_ESR_REC_Pos);
+
+    uint32_t rxBits = s_statsRxBits - s_prevRxBits;
+    uint32_t txBits = s_statsTxBits - s_prevTxBits;
+
+    s_stats.rxPerSec = stats_per_sec(s_stats.rxFrames - s_prevRxFrames, ms);
+    s_stats.txPerSec = stats_per_sec(s_stats.txFrames - s_prevTxFrames, ms);
+    for (uint32_t i = 0U; i < s_statsIdCount; ++i)
+    {
+        CanStats_Entry_t *e = &s_statsIds[i];
+        e->perSec     = stats_per_sec(e->frames - e->prevFrames, ms);
+        e->prevFrames = e->frames;
+    }
+
+    s_prevRxFrames = s_stats.rxFrames;
+    s_prevTxFrames = s_stats.txFrames;
+    s_prevRxBits   = s_statsRxBits;
+    s_prevTxBits   = s_statsTxBits;
+
+    /* In loopback every RX frame is the copy of one of ours. */
+    uint32_t busBits = txBits + (((mode & CAN_MODE_LOOPBACK) != 0U) ? 0U : rxBits);
+    uint64_t capacity = (uint64_t)t.bitrate * ms;
+    uint32_t load = (capacity != 0U)
+                  ? (uint32_t)(((uint64_t)busBits * 1000000U) / capacity) : 0U;
+
+    s_stats.loadPermille = (uint16_t)((load > 1000U) ? 1000U : load);
+    if (s_stats.loadPermille > s_stats.peakLoadPermille)
+        s_stats.peakLoadPermille = s_stats.loadPermille;
+    s_stats.windows++;
+
+    sum = s_stats;
+    __set_PRIMASK(primask);
+
+    s_prevTick = now;
+    stats_report(now, &sum);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void stats_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CanStats_Summary_t s;
+    CanTiming_t        t;
+    uint32_t           n = CanStats_Get(&s, s_cliIds, CAN_STATS_MAX_IDS);
+
+    (void)CAN_IF_GetBitTiming(&t);
+
+    CLI_IF_Printf("Bus load %u.%u%% (peak %u.%u%%) at %lu bit/s, %lu ms windows\r\n",
+                  (unsigned)(s.loadPermille / 10U), (unsigned)(s.loadPermille % 10U),
+                  (unsigned)(s.peakLoadPermille / 10U), (unsigned)(s.peakLoadPermille % 10U),
+                  (unsigned long)t.bitrate, (unsigned long)CAN_STATS_PERIOD_MS);
+    CLI_IF_Printf("RX %lu/s (%lu), TX %lu/s (%lu)\r\n",
+                  (unsigned long)s.rxPerSec, (unsigned long)s.rxFrames,
+                  (unsigned long)s.txPerSec, (unsigned long)s.txFrames);
+    CLI_IF_Printf("State %s, TEC %u (peak %u), REC %u (peak %u)\r\n",
+                  s_stateNames[s.state], (unsigned)s.tec, (unsigned)s.tecPeak,
+                  (unsigned)s.rec, (unsigned)s.recPeak);
+    CLI_IF_Printf("Entered: warning %lu, passive %lu, bus-off %lu, active again %lu\r\n",
+                  (unsigned long)s.entered[CAN_STATS_WARNING],
+                  (unsigned long)s.entered[CAN_STATS_PASSIVE],
+                  (unsigned long)s.entered[CAN_STATS_BUSOFF],
+                  (unsigned long)s.entered[CAN_STATS_ACTIVE]);
+
+    CLI_IF_Print("Errors:");
+    for (uint32_t i = 1U; i < (CAN_STATS_LEC_COUNT - 1U); ++i)
+        CLI_IF_Printf(" %s %lu", s_lecNames[i], (unsigned long)s.lec[i]);
+    CLI_IF_Printf(", FIFO overruns %lu, SCE interrupts %lu\r\n",
+                  (unsigned long)s.fifoOverruns, (unsigned long)s.errorIrqs);
+
+    if (n == 0U)
+        return;
+
+    CLI_IF_Print("ID               frames    per_s\r\n");
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        uint32_t id = s_cliIds[i].id;
+
+        CLI_IF_Printf("%s0x%0*lX%s %12lu %8lu\r\n",
+                      ((id & CAN_IF_ID_EXT) != 0U) ? "" : "     ",
+                      ((id & CAN_IF_ID_EXT) != 0U) ? 8 : 3,
+                      (unsigned long)(id & CAN_IF_ID_MASK),
+                      ((id & CAN_IF_ID_RTR) != 0U) ? "r" : " ",
+                      (unsigned long)s_cliIds[i].frames,
+                      (unsigned long)s_cliIds[i].perSec);
+    }
+    if (s.otherFrames != 0U)
+        CLI_IF_Printf("Other IDs: %lu frames\r\n", (unsigned long)s.otherFrames);
+}
+
+static void stats_cmd_reset(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CanStats_Reset();
+    CLI_IF_Print("CAN statistics cleared.\r\n");
+}
+
+static const CliCommand_t s_statsCmds[] =
+{
+    { "can stats",       "", 0U, stats_cmd_show,  "CAN bus load, frame rates and errors" },
+    { "can stats reset", "", 0U, stats_cmd_reset, "clear the CAN statistics" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef CanStats_Init(void)
+{
+    if (s_statsTimer != NULL)
+        return HAL_OK;
+
+    s_prevTick   = HAL_GetTick();
+    s_reportTick = s_prevTick;
+
+    s_statsTimer = xTimerCreateStatic("CanStats", pdMS_TO_TICKS(CAN_STATS_PERIOD_MS),
+                                      pdTRUE, NULL, stats_sample, &s_statsTimerCb);
+    if (s_statsTimer == NULL)
+        return HAL_ERROR;
+
+    CLI_IF_REGISTER_TABLE(s_statsCmds);
+
+    return (xTimerStart(s_statsTimer, 0U) == pdPASS) ? HAL_OK : HAL_ERROR;
+}
+
+RAMFUNC void CanStats_OnRx(uint32_t key, uint8_t dlc)
+{
+    s_stats.rxFrames++;
+    s_statsRxBits += stats_frame_bits(key, dlc);
+
+    for (uint32_t i = 0U; i < s_statsIdCount; ++i)
+    {
+        if (s_statsIds[i].id == key)
+        {
+            s_statsIds[i].frames++;
+            return;
+        }
+    }
+
+    if (s_statsIdCount >= CAN_STATS_MAX_IDS)
+    {
+        s_stats.otherFrames++;
+        return;
+    }
+
+    /* Field by field: a memset() call would run from flash (ramfunc.h). */
+    CanStats_Entry_t *e = &s_statsIds[s_statsIdCount++];
+    e->id         = key;
+    e->frames     = 1U;
+    e->prevFrames = 0U;
+    e->perSec     = 0U;
+}
+
+RAMFUNC void CanStats_OnTx(uint32_t key, uint8_t dlc)
+{
+    s_stats.txFrames++;
+    s_statsTxBits += stats_frame_bits(key, dlc);
+}
+
+void CanStats_OnError(uint32_t halError, uint32_t esr)
+{
+    s_stats.errorIrqs++;
+
+    for (uint32_t i = 1U; i < CAN_STATS_LEC_COUNT; ++i)
+    {
+        if ((halError & s_lecHalBits[i]) != 0U)
+            s_stats.lec[i]++;
+    }
+    if ((halError & (HAL_CAN_ERROR_RX_FOV0 | HAL_CAN_ERROR_RX_FOV1)) != 0U)
+        s_stats.fifoOverruns++;
+
+    uint8_t tec = (uint8_t)(esr >> CAN_ESR_TEC_Pos);
+    uint8_t rec = (uint8_t)(esr >> CAN_ESR_REC_Pos);
+    if (tec > s_stats.tecPeak)
+        s_stats.tecPeak = tec;
+    if (rec > s_stats.recPeak)
+        s_stats.recPeak = rec;
+
+    stats_track_state(esr);
+}
+
+uint32_t CanStats_Get(CanStats_Summary_t *sum, CanStats_Id_t *ids, uint32_t max)
+{
+    uint32_t n = 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (sum != NULL)
+        *sum = s_stats;
+
+    if (ids != NULL)
+    {
+        n = (s_statsIdCount < max) ? s_statsIdCount : max;
+        for (uint32_t i = 0U; i < n; ++i)
+        {
+            ids[i].id     = s_statsIds[i].id;
+            ids[i].frames = s_statsIds[i].frames;
+            ids[i].perSec = s_statsIds[i].perSec;
+        }
+    }
+
+    __set_PRIMASK(primask);
+    return n;
+}
+
+void CanStats_Reset(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint8_t state = s_stats.state;
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stats.state  = state;
+    s_statsIdCount = 0U;
+    s_statsRxBits  = 0U;
+    s_statsTxBits  = 0U;
+
+    /* The timer's previous-window copies are its own; it drops them at
+     * its next sample. */
+    s_statsResetPending = 1U;
+
+    __set_PRIMASK(primask);
+}
@@ -0,0 +1,129 @@
+/**
+ * @file    can_timing.c
+ * @brief   bxCAN bit-timing calculator implementation.
+ *
+ * Search, for each quanta count N from 25 down to 8 (8 is the practical
+ * minimum for a usable sample point):
+ *   - prescaler = round(PCLK1 / (bitrate * N)), skip if out of 1..1024
+ *   - bitrate error must be within CAN_TIMING_MAX_ERR_PPM
+ *   - BS2 = round(N * (1 - sample point)), clamped to the legal range,
+ *     BS1 = N - 1 - BS2
+ * Candidates whose sample point is within CAN_TIMING_SP_TOL of the request
+ * are preferred; among those the smallest bitrate error wins, then the
+ * largest N. If none is within tolerance, the closest sample point wins.
+ */
+
+#include "can_timing.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define CANT_BS1_MAX       16U
+#define CANT_BS2_MAX       8U
+#define CANT_SJW_MAX       4U
+#define CANT_TQ_MAX        (1U + CANT_BS1_MAX + CANT_BS2_MAX)
+#define CANT_TQ_MIN        8U
+#define CANT_PRESC_MAX     1024U
+
+static uint32_t cant_absdiff(uint32_t a, uint32_t b)
+{
+    return (a > b) ? (a - b) : (b - a);
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef CanTiming_Compute(uint32_t pclkHz, uint32_t bitrate,
+                                    uint32_t samplePermille, CanTiming_t *out)
+{
+    if ((out == NULL) || (bitrate == 0U) || (pclkHz == 0U) ||
+        (samplePermille == 0U) || (samplePermille >= 1000U))
+        return HAL_ERROR;
+
+    uint8_t  found    = 0U;
+    uint8_t  bestGood = 0U;
+    uint32_t bestSp   = 0xFFFFFFFFU;
+    uint32_t bestErr  = 0xFFFFFFFFU;
+
+    for (uint32_t n = CANT_TQ_MAX; n >= CANT_TQ_MIN; --n)
+    {
+        uint64_t div   = (uint64_t)bitrate * n;
+        uint32_t presc = (uint32_t)(((uint64_t)pclkHz + (div / 2U)) / div);
+        if ((presc == 0U) || (presc > CANT_PRESC_MAX))
+            continue;
+
+        uint32_t actual = pclkHz / (presc * n);
+        uint32_t errPpm = (uint32_t)(((uint64_t)cant_absdiff(actual, bitrate) * 1000000U) / bitrate);
+        if (errPpm > CAN_TIMING_MAX_ERR_PPM)
+            continue;
+
+        uint32_t bs2 = ((n * (1000U - samplePermille)) + 500U) / 1000U;
+        if (bs2 < 1U)
+            bs2 = 1U;
+        if (bs2 > CANT_BS2_MAX)
+            bs2 = CANT_BS2_MAX;
+
+        uint32_t bs1 = n - 1U - bs2;
+        if (bs1 > CANT_BS1_MAX)
+        {
+            bs1 = CANT_BS1_MAX;
+            bs2 = n - 1U - bs1;
+            if (bs2 > CANT_BS2_MAX)
+                continue;
+        }
+        if (bs1 < 1U)
+            continue;
+
+        uint32_t sp    = ((1U + bs1) * 1000U) / n;
+        uint32_t spErr = cant_absdiff(sp, samplePermille);
+        uint8_t  good  = (spErr <= CAN_TIMING_SP_TOL) ? 1U : 0U;
+
+        /* Iterating from large N down keeps the larger N on ties. */
+        uint8_t better;
+        if (found == 0U)
+            better = 1U;
+        else if (good != bestGood)
+            better = good;
+        else if (good != 0U)
+            better = (errPpm < bestErr) ? 1U : 0U;
+        else
+            better = (spErr < bestSp) ? 1U : 0U;
+
+        if (better != 0U)
+        {
+            found    = 1U;
+            bestGood = good;
+            bestSp   = spErr;
+            bestErr  = errPpm;
+
+            out->prescaler   = presc;
+            out->bs1         = (uint8_t)bs1;
+            out->bs2         = (uint8_t)bs2;
+            out->sjw         = (uint8_t)((bs2 < CANT_SJW_MAX) ? bs2 : CANT_SJW_MAX);
+            out->tqPerBit    = (uint8_t)n;
+            out->bitrate     = actual;
+            out->samplePoint = (uint16_t)sp;
+        }
+    }
+
+    return (found != 0U) ? HAL_OK : HAL_ERROR;
+}
+
+void CanTiming_ToInit(const CanTiming_t *t, CAN_InitTypeDef *init)
+{
+    init->Prescaler     = t->prescaler;
+    init->SyncJumpWidth = ((uint32_t)t->sjw - 1U) << CAN_BTR_SJW_Pos;
+    init->TimeSeg1      = ((uint32_t)t->bs1 - 1U) << CAN_BTR_TS1_Pos;
+    init->TimeSeg2      = ((uint32_t)t->bs2 - 1U) << CAN_BTR_TS2_Pos;
+}
+
+uint32_t CanTiming_ToBtr(const CanTiming_t *t, uint32_t mode)
+{
+    return mode |
+           (((uint32_t)t->sjw - 1U) << CAN_BTR_SJW_Pos) |
+           (((uint32_t)t->bs1 - 1U) << CAN_BTR_TS1_Pos) |
+           (((uint32_t)t->bs2 - 1U) << CAN_BTR_TS2_Pos) |
+           ((t->prescaler - 1U) << CAN_BTR_BRP_Pos);
+}
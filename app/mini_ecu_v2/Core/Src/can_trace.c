@@ -0,0 +1,710 @@
+/**
+ * @file    can_trace.c
+ * @brief   CAN RX trace ring, trigger/stop conditions and "can trace".
+ */
+
+#include "can_trace.h"
+#include "can_if.h"
+#include "cli_if.h"
+#include "clock_gov.h"
+#include "log.h"
+#include "fmt.h"
+#include "ramfunc.h"
+#include "sram_layout.h"
+#include "time_sync.h"
+#include "cmsis_os2.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+_Static_assert((CAN_TRACE_DEPTH >= 2U) && ((CAN_TRACE_DEPTH & (CAN_TRACE_DEPTH - 1U)) == 0U),
+               "CAN_TRACE_DEPTH must be a power of two");
+_Static_assert(sizeof(CanTrace_Rec_t) == 20U, "CanTrace_Rec_t is the binary dump layout");
+
+typedef enum
+{
+    TRACE_STOPPED = 0,  /* not recording */
+    TRACE_ARMED,        /* waiting for the start condition */
+    TRACE_RUNNING,      /* recording, watching for the stop condition */
+    TRACE_POST          /* stop condition seen, recording s_trLeft more */
+} CanTrace_State_t;
+
+/** Identifier match: (id ^ key) & (mask | EXT) == 0. */
+typedef struct
+{
+    uint8_t  set;
+    uint32_t key;       /* CAN_IF_MSG_KEY() format */
+    uint32_t mask;      /* identifier bits compared */
+} CanTrace_Match_t;
+
+#define TRACE_BIN_VERSION    1U
+#define TRACE_BIN_PER_FRAME  12U    /* records per 'R' frame (len <= 255) */
+
+#define TRACE_PACK_VERSION   2U
+#define TRACE_PACK_FRAME     240U   /* 'P' payload, whole records */
+#define TRACE_PACK_REC_MAX   24U    /* tag + 10 time + 5 ID + 8 data */
+
+/* Packed record tag: DLC, RTR, the two flags and "new ID follows". */
+#define TRACE_TAG_DLC        0x0FU
+#define TRACE_TAG_RTR        0x10U
+#define TRACE_TAG_FLAGS_POS  5U
+#define TRACE_TAG_NEW_ID     0x80U
+
+_Static_assert(TRACE_PACK_FRAME <= (TRACE_BIN_PER_FRAME * sizeof(CanTrace_Rec_t)),
+               "a 'P' frame must fit the frame buffer of trace_bin_frame()");
+_Static_assert((CAN_TRACE_DICT_SIZE >= 1U) && (CAN_TRACE_DICT_SIZE <= 256U),
+               "CAN_TRACE_DICT_SIZE: the index is one byte");
+
+/** Encoder state of a packed dump; the decoder keeps the same. */
+typedef struct
+{
+    uint64_t lastUs;
+    uint32_t dict[CAN_TRACE_DICT_SIZE];
+    uint32_t dictUsed;
+    uint32_t dictNext;          /* slot the next new ID takes */
+} CanTrace_Pack_t;
+
+/** Output chunk for the text dump. */
+#define TRACE_TEXT_CHUNK     256U
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* The RX FIFO interrupts are the only writers while recording; the CLI
+ * changes the state and conditions under PRIMASK and reads the ring only
+ * when stopped, and only the records below s_trHead (so it is NOCLEAR). */
+NOCLEAR static CanTrace_Rec_t s_trRing[CAN_TRACE_DEPTH];
+static volatile uint8_t s_trState = TRACE_STOPPED;
+static volatile uint32_t s_trHead = 0U;         /* records written since start */
+static uint32_t         s_trLeft  = 0U;         /* TRACE_POST: records to go */
+static uint8_t          s_trHit   = 0U;         /* last stop was the condition */
+
+static CanTrace_Match_t s_trStart;
+static CanTrace_Match_t s_trStop;
+static uint32_t         s_trPost  = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+RAMFUNC static uint8_t trace_match(const CanTrace_Match_t *m, uint32_t key)
+{
+    return (((key ^ m->key) & (m->mask | CAN_IF_ID_EXT)) == 0U) ? 1U : 0U;
+}
+
+/** Time of an RX interrupt: the global time (time_sync.h). */
+RAMFUNC static void trace_now(CanTrace_Rec_t *r)
+{
+    uint32_t ms;
+    uint32_t us;
+
+    TimeSync_NowMsUs(&ms, &us);
+    r->timeMs = ms;
+    r->timeUs = (uint16_t)us;
+}
+
+/** Records held, oldest first from index (s_trHead - count). */
+static uint32_t trace_count(void)
+{
+    return (s_trHead < CAN_TRACE_DEPTH) ? s_trHead : CAN_TRACE_DEPTH;
+}
+
+static const CanTrace_Rec_t *trace_rec(uint32_t i)
+{
+    return &s_trRing[(s_trHead - trace_count() + i) & (CAN_TRACE_DEPTH - 1U)];
+}
+
+/** Stop recording; the ring is stable afterwards. */
+static void trace_stop(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_trState = TRACE_STOPPED;
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief Parse "<id>[:<mask>]" (hex; 8 ID digits or > 0x7FF = 29-bit).
+ */
+static uint8_t trace_parse_match(const char *s, CanTrace_Match_t *m)
+{
+    const char *colon = strchr(s, ':');
+    size_t      idLen = (colon != NULL) ? (size_t)(colon - s) : strlen(s);
+    char       *end;
+
+    if ((idLen == 0U) || (idLen > 8U))
+        return 0U;
+
+    uint32_t id = (uint32_t)strtoul(s, &end, 16);
+    if (end != (s + idLen))
+        return 0U;
+
+    uint8_t  ext  = ((idLen == 8U) || (id > 0x7FFU)) ? 1U : 0U;
+    uint32_t full = (ext != 0U) ? CAN_IF_ID_MASK : 0x7FFU;
+    uint32_t mask = full;
+
+    if (id > full)
+        return 0U;
+
+    if (colon != NULL)
+    {
+        mask = (uint32_t)strtoul(colon + 1, &end, 16);
+        if ((end == (colon + 1)) || (*end != '\0'))
+            return 0U;
+        mask &= full;
+    }
+
+    m->set  = 1U;
+    m->key  = (ext != 0U) ? (id | CAN_IF_ID_EXT) : id;
+    m->mask = mask;
+    return 1U;
+}
+
+/** Value of hex digit @p c, or -1. */
+static int32_t trace_hex_digit(char c)
+{
+    if ((c >= '0') && (c <= '9'))
+        return c - '0';
+    if ((c >= 'A') && (c <= 'F'))
+        return c - 'A' + 10;
+    if ((c >= 'a') && (c <= 'f'))
+        return c - 'a' + 10;
+    return -1;
+}
+
+/** 1 if @p c ends a candump field: NUL, or whitespace in a line in place. */
+static uint8_t trace_field_end(char c)
+{
+    return ((c == '\0') || (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n')) ? 1U : 0U;
+}
+
+static void trace_print_match(const char *what, const CanTrace_Match_t *m)
+{
+    uint8_t  ext = ((m->key & CAN_IF_ID_EXT) != 0U) ? 1U : 0U;
+    uint32_t id  = m->key & CAN_IF_ID_MASK;
+
+    if (ext != 0U)
+        CLI_IF_Printf("%s %08lX:%08lX", what, (unsigned long)id, (unsigned long)m->mask);
+    else
+        CLI_IF_Printf("%s %03lX:%03lX", what, (unsigned long)id, (unsigned long)m->mask);
+}
+
+/**
+ * @brief Send @p len bytes on the CLI stream from where they are; returns
+ *        when the buffer is free again (Log_Send()).
+ *
+ * @return HAL_OK, or HAL_TIMEOUT if the log ring stayed full.
+ */
+static HAL_StatusTypeDef trace_emit(const void *data, uint32_t len)
+{
+    return Log_Send(LOG_STREAM_CLI, data, len, CAN_TRACE_DUMP_TIMEOUT_MS);
+}
+
+static HAL_StatusTypeDef trace_dump_text(uint32_t count)
+{
+    char     buf[TRACE_TEXT_CHUNK];
+    uint32_t len = 0U;
+
+    for (uint32_t i = 0U; i < count; ++i)
+    {
+        len += CanTrace_FormatLine(trace_rec(i), &buf[len]);
+
+        if ((len + CAN_TRACE_LINE_MAX) > sizeof(buf))
+        {
+            if (trace_emit(buf, len) != HAL_OK)
+                return HAL_TIMEOUT;
+            len = 0U;
+        }
+    }
+
+    return (len > 0U) ? trace_emit(buf, len) : HAL_OK;
+}
+
+/** Send one 0xFD | len | type | payload frame. */
+static HAL_StatusTypeDef trace_bin_frame(uint8_t type, const void *payload, uint32_t len)
+{
+    uint8_t frame[3U + (TRACE_BIN_PER_FRAME * sizeof(CanTrace_Rec_t))];
+
+    frame[0] = CAN_TRACE_SYNC;
+    frame[1] = (uint8_t)(1U + len);
+    frame[2] = type;
+    memcpy(&frame[3], payload, len);
+
+    return trace_emit(frame, 3U + len);
+}
+
+/** The 'H' frame; a packed dump adds the dictionary size. */
+static HAL_StatusTypeDef trace_bin_header(uint8_t version, uint16_t recSize, uint32_t count)
+{
+    CanTiming_t t;
+    uint8_t     hdr[16];
+    uint32_t    overwritten = s_trHead - count;
+
+    (void)CAN_IF_GetBitTiming(&t);
+
+    hdr[0] = version;
+    memcpy(&hdr[1], &recSize, 2U);
+    memcpy(&hdr[3], &count, 4U);
+    memcpy(&hdr[7], &overwritten, 4U);
+    memcpy(&hdr[11], &t.bitrate, 4U);
+    hdr[15] = (uint8_t)(CAN_TRACE_DICT_SIZE - 1U);
+    return trace_bin_frame('H', hdr, (version == TRACE_PACK_VERSION) ? 16U : 15U);
+}
+
+static HAL_StatusTypeDef trace_dump_bin(uint32_t count)
+{
+    if (trace_bin_header(TRACE_BIN_VERSION, (uint16_t)sizeof(CanTrace_Rec_t), count) != HAL_OK)
+        return HAL_TIMEOUT;
+
+    CanTrace_Rec_t recs[TRACE_BIN_PER_FRAME];
+    uint32_t       n = 0U;
+
+    for (uint32_t i = 0U; i < count; ++i)
+    {
+        recs[n++] = *trace_rec(i);
+
+        if ((n == TRACE_BIN_PER_FRAME) || (i == (count - 1U)))
+        {
+            if (trace_bin_frame('R', recs, n * sizeof(CanTrace_Rec_t)) != HAL_OK)
+                return HAL_TIMEOUT;
+            n = 0U;
+        }
+    }
+
+    return trace_bin_frame('E', &count, 4U);
+}
+
+static uint32_t trace_varint(uint8_t *out, uint64_t v)
+{
+    uint32_t n = 0U;
+
+    while (v >= 0x80U)
+    {
+        out[n++] = (uint8_t)(v | 0x80U);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+/**
+ * @brief Append @p r to @p out in the packed encoding (can_trace.h).
+ *
+ * @return Bytes written, at most TRACE_PACK_REC_MAX.
+ */
+static uint32_t trace_pack(CanTrace_Pack_t *st, const CanTrace_Rec_t *r, uint8_t *out)
+{
+    uint64_t us    = ((uint64_t)r->timeMs * 1000U) + r->timeUs;
+    int64_t  delta = (int64_t)(us - st->lastUs);
+    uint32_t key   = r->id & ~CAN_IF_ID_RTR;
+    uint8_t  dlc   = (r->dlc < 8U) ? r->dlc : 8U;
+    uint8_t  rtr   = ((r->id & CAN_IF_ID_RTR) != 0U) ? 1U : 0U;
+    uint32_t slot  = 0U;
+    uint32_t n     = 1U;
+
+    while ((slot < st->dictUsed) && (st->dict[slot] != key))
+        slot++;
+
+    out[0] = (uint8_t)(dlc | ((rtr != 0U) ? TRACE_TAG_RTR : 0U) |
+                       ((r->flags & 0x03U) << TRACE_TAG_FLAGS_POS) |
+                       ((slot == st->dictUsed) ? TRACE_TAG_NEW_ID : 0U));
+
+    /* Zigzag: the global time may step back after a resync. */
+    n += trace_varint(&out[n], ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+    st->lastUs = us;
+
+    if (slot < st->dictUsed)
+    {
+        out[n++] = (uint8_t)slot;
+    }
+    else
+    {
+        /* New ID: into the next slot, round robin once all are used. */
+        n += trace_varint(&out[n], ((uint64_t)(key & CAN_IF_ID_MASK) << 1) |
+                                   (((key & CAN_IF_ID_EXT) != 0U) ? 1U : 0U));
+        st->dict[st->dictNext] = key;
+        st->dictNext = (st->dictNext + 1U) % CAN_TRACE_DICT_SIZE;
+        if (st->dictUsed < CAN_TRACE_DICT_SIZE)
+            st->dictUsed++;
+    }
+
+    if (rtr == 0U)
+    {
+        memcpy(&out[n], r->data, dlc);
+        n += dlc;
+    }
+    return n;
+}
+
+static HAL_StatusTypeDef trace_dump_pack(uint32_t count)
+{
+    static CanTrace_Pack_t st;     /* CliTask only; off its stack */
+    uint8_t                buf[TRACE_PACK_FRAME];
+    uint32_t               len = 0U;
+
+    memset(&st, 0, sizeof(st));
+    if (trace_bin_header(TRACE_PACK_VERSION, 0U, count) != HAL_OK)
+        return HAL_TIMEOUT;
+
+    for (uint32_t i = 0U; i < count; ++i)
+    {
+        if ((len + TRACE_PACK_REC_MAX) > sizeof(buf))
+        {
+            if (trace_bin_frame('P', buf, len) != HAL_OK)
+                return HAL_TIMEOUT;
+            len = 0U;
+        }
+        len += trace_pack(&st, trace_rec(i), &buf[len]);
+    }
+    if ((len > 0U) && (trace_bin_frame('P', buf, len) != HAL_OK))
+        return HAL_TIMEOUT;
+
+    return trace_bin_frame('E', &count, 4U);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void trace_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    static const char *const states[] = { "stopped", "armed", "recording", "recording" };
+    uint8_t  state = s_trState;
+    uint32_t head  = s_trHead;
+    uint32_t held  = (head < CAN_TRACE_DEPTH) ? head : CAN_TRACE_DEPTH;
+
+    CLI_IF_Printf("Trace %s%s: %lu frames recorded, %lu of %lu held, %lu overwritten\r\n",
+                  states[state],
+                  ((state == TRACE_STOPPED) && (s_trHit != 0U)) ? " (stop condition)" : "",
+                  (unsigned long)head, (unsigned long)held,
+                  (unsigned long)CAN_TRACE_DEPTH, (unsigned long)(head - held));
+
+    if (s_trStart.set != 0U)
+        trace_print_match("Start on", &s_trStart);
+    else
+        CLI_IF_Print("Start at once");
+
+    if (s_trStop.set != 0U)
+    {
+        trace_print_match(", stop on", &s_trStop);
+        CLI_IF_Printf(" + %lu frames\r\n", (unsigned long)s_trPost);
+    }
+    else
+    {
+        CLI_IF_Print(", no stop condition\r\n");
+    }
+}
+
+static void trace_cmd_start(int argc, char *argv[])
+{
+    CanTrace_Match_t m;
+    memset(&m, 0, sizeof(m));
+
+    if ((argc > 1) || ((argc == 1) && (trace_parse_match(argv[0], &m) == 0U)))
+    {
+        CLI_IF_Print("Usage: can trace start [<id>[:<mask>]]\r\n");
+        return;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_trStart = m;
+    s_trHead  = 0U;
+    s_trHit   = 0U;
+    s_trState = (m.set != 0U) ? TRACE_ARMED : TRACE_RUNNING;
+    __set_PRIMASK(primask);
+
+    CLI_IF_Print((m.set != 0U) ? "Trace armed\r\n" : "Trace recording\r\n");
+}
+
+static void trace_cmd_stop(int argc, char *argv[])
+{
+    if (argc == 0)
+    {
+        trace_stop();
+        CLI_IF_Printf("Trace stopped, %lu frames held\r\n", (unsigned long)trace_count());
+        return;
+    }
+
+    CanTrace_Match_t m;
+    char            *end  = NULL;
+    unsigned long    post = 0UL;
+
+    memset(&m, 0, sizeof(m));
+    if (argc == 2)
+        post = strtoul(argv[1], &end, 10);
+
+    if ((argc > 2) || (trace_parse_match(argv[0], &m) == 0U) ||
+        ((end != NULL) && (*end != '\0')))
+    {
+        CLI_IF_Print("Usage: can trace stop [<id>[:<mask>] [<frames after>]]\r\n");
+        return;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_trStop = m;
+    s_trPost = (uint32_t)post;
+    __set_PRIMASK(primask);
+
+    trace_print_match("Trace stops on", &m);
+    CLI_IF_Printf(" + %lu frames\r\n", post);
+}
+
+static void trace_cmd_clear(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_trState = TRACE_STOPPED;
+    s_trHead  = 0U;
+    s_trHit   = 0U;
+    memset(&s_trStart, 0, sizeof(s_trStart));
+    memset(&s_trStop, 0, sizeof(s_trStop));
+    s_trPost  = 0U;
+    __set_PRIMASK(primask);
+
+    CLI_IF_Print("Trace cleared\r\n");
+}
+
+static void trace_cmd_dump(int argc, char *argv[])
+{
+    uint8_t bin = 0U;   /* 1 raw records, 2 packed */
+
+    if (argc == 1)
+    {
+        if (strcmp(argv[0], "bin") == 0)
+            bin = 1U;
+        else if (strcmp(argv[0], "pack") == 0)
+            bin = 2U;
+        else if (strcmp(argv[0], "text") != 0)
+            argc = 2;
+    }
+    if (argc > 1)
+    {
+        CLI_IF_Print("Usage: can trace dump [text|bin|pack]\r\n");
+        return;
+    }
+
+    trace_stop();
+#if CLOCK_GOV_ENABLE
+    ClockGov_Boost(0U);
+#endif
+
+    uint32_t count = trace_count();
+    HAL_StatusTypeDef st = (bin == 2U) ? trace_dump_pack(count)
+                         : (bin == 1U) ? trace_dump_bin(count) : trace_dump_text(count);
+
+    if (st != HAL_OK)
+        CLI_IF_Print("\r\nTrace dump aborted: UART not draining\r\n");
+    else if (bin == 0U)
+        CLI_IF_Printf("# %lu frames\r\n", (unsigned long)count);
+}
+
+static void trace_cmd_add(int argc, char *argv[])
+{
+    CanTrace_Rec_t rec;
+
+    if ((argc != 2) || (CanTrace_ParseLine(argv[0], argv[1], &rec) == 0U))
+    {
+        CLI_IF_Print("Usage: can trace add <sec>.<usec> <id>#<data>\r\n");
+        return;
+    }
+    if (s_trState != TRACE_STOPPED)
+    {
+        CLI_IF_Print("Trace is recording, stop it first\r\n");
+        return;
+    }
+
+    /* Quiet on success: tools/can_replay.py sends one line per record. */
+    s_trRing[s_trHead & (CAN_TRACE_DEPTH - 1U)] = rec;
+    s_trHead++;
+}
+
+static const CliCommand_t s_trCmds[] =
+{
+    { "can trace",       "", 0U, trace_cmd_show,  "CAN trace recorder state" },
+    { "can trace start", "[<id>[:<mask>]]", 0U, trace_cmd_start,
+      "record RX frames, now or from a matching ID" },
+    { "can trace stop",  "[<id>[:<mask>] [<n>]]", 0U, trace_cmd_stop,
+      "stop now, or <n> frames after a matching ID" },
+    { "can trace dump",  "[text|bin|pack]", 0U, trace_cmd_dump,
+      "stop and send the trace (candump text, binary or packed)" },
+    { "can trace clear", "", 0U, trace_cmd_clear, "empty the trace, drop conditions" },
+    { "can trace add",   "<sec>.<usec> <id>#<data>", 2U, trace_cmd_add,
+      "append a record (loads a trace for \"can replay\")" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void CanTrace_Init(void)
+{
+    s_trState = TRACE_STOPPED;
+    s_trHead  = 0U;
+    s_trHit   = 0U;
+    s_trPost  = 0U;
+    memset(&s_trStart, 0, sizeof(s_trStart));
+    memset(&s_trStop, 0, sizeof(s_trStop));
+
+    CLI_IF_REGISTER_TABLE(s_trCmds);
+}
+
+uint32_t CanTrace_Stop(void)
+{
+    trace_stop();
+    return trace_count();
+}
+
+const CanTrace_Rec_t *CanTrace_Get(uint32_t i)
+{
+    return (i < trace_count()) ? trace_rec(i) : NULL;
+}
+
+uint8_t CanTrace_ParseLine(const char *time, const char *frame, CanTrace_Rec_t *rec)
+{
+    char *end;
+
+    if (*time == '(')
+        time++;
+
+    uint32_t sec = (uint32_t)strtoul(time, &end, 10);
+    if ((end == time) || (*end != '.'))
+        return 0U;
+
+    const char *frac = end + 1;
+    uint32_t    usec = (uint32_t)strtoul(frac, &end, 10);
+    if ((end != (frac + 6)) || ((trace_field_end(*end) == 0U) && (*end != ')')))
+        return 0U;
+
+    /* Bounded to the field: a mapped file has no NUL after it. */
+    const char *hash = frame;
+    while ((trace_field_end(*hash) == 0U) && (*hash != '#'))
+        hash++;
+
+    size_t idLen = (size_t)(hash - frame);
+    if ((*hash != '#') || (idLen == 0U) || (idLen > 8U))
+        return 0U;
+
+    uint32_t id = (uint32_t)strtoul(frame, &end, 16);
+    uint8_t  ext = ((idLen == 8U) || (id > 0x7FFU)) ? 1U : 0U;
+    if ((end != hash) || (id > ((ext != 0U) ? CAN_IF_ID_MASK : 0x7FFU)))
+        return 0U;
+
+    memset(rec, 0, sizeof(*rec));
+    rec->timeMs = (sec * 1000U) + (usec / 1000U);
+    rec->timeUs = (uint16_t)(usec % 1000U);
+    rec->id     = (ext != 0U) ? (id | CAN_IF_ID_EXT) : id;
+
+    /* "R" or "R<dlc>" is a remote frame; data may have '.' separators. */
+    const char *p = hash + 1;
+    if (*p == 'R')
+    {
+        rec->id |= CAN_IF_ID_RTR;
+        if (trace_field_end(p[1]) != 0U)
+            return 1U;
+        if ((p[1] < '0') || (p[1] > '8') || (trace_field_end(p[2]) == 0U))
+            return 0U;
+        rec->dlc = (uint8_t)(p[1] - '0');
+        return 1U;
+    }
+
+    while (trace_field_end(*p) == 0U)
+    {
+        if (*p == '.')
+        {
+            p++;
+            continue;
+        }
+
+        int32_t hi = trace_hex_digit(p[0]);
+        int32_t lo = (hi >= 0) ? trace_hex_digit(p[1]) : -1;
+        if ((lo < 0) || (rec->dlc >= 8U))
+            return 0U;
+
+        rec->data[rec->dlc++] = (uint8_t)((hi << 4) | lo);
+        p += 2;
+    }
+    return 1U;
+}
+
+uint32_t CanTrace_FormatLine(const CanTrace_Rec_t *rec, char *out)
+{
+    uint32_t usec = ((rec->timeMs % 1000U) * 1000U) + rec->timeUs;
+    uint32_t id   = rec->id & CAN_IF_ID_MASK;
+    uint32_t pos;
+
+    pos  = Fmt_Str(out, "(", 0U);
+    pos += Fmt_Dec(&out[pos], rec->timeMs / 1000U, 0U);
+    pos += Fmt_Str(&out[pos], ".", 0U);
+    pos += Fmt_DecZ(&out[pos], usec, 6U);
+    pos += Fmt_Str(&out[pos], ") " CAN_TRACE_IFNAME " ", 0U);
+    pos += Fmt_Hex(&out[pos], id, ((rec->id & CAN_IF_ID_EXT) != 0U) ? 8U : 3U);
+    out[pos++] = '#';
+
+    if ((rec->id & CAN_IF_ID_RTR) != 0U)
+        out[pos++] = 'R';
+    else
+        pos += Fmt_HexBytes(&out[pos], rec->data, (rec->dlc < 8U) ? rec->dlc : 8U, '\0');
+
+    out[pos++] = '\r';
+    out[pos++] = '\n';
+    return pos;
+}
+
+RAMFUNC void CanTrace_OnRx(uint32_t key, uint8_t dlc, uint8_t flags, const uint8_t *data)
+{
+    uint8_t state = s_trState;
+
+    if (state == TRACE_STOPPED)
+        return;
+
+    uint32_t match = key & ~CAN_IF_ID_RTR;
+
+    if (state == TRACE_ARMED)
+    {
+        if (trace_match(&s_trStart, match) == 0U)
+            return;
+        state = TRACE_RUNNING;
+    }
+
+    if (dlc > 8U)
+        dlc = 8U;
+
+    CanTrace_Rec_t *r = &s_trRing[s_trHead & (CAN_TRACE_DEPTH - 1U)];
+    trace_now(r);
+    r->dlc   = dlc;
+    r->flags = flags;
+    r->id    = key;
+    /* A loop, not memcpy(): this runs from SRAM (ramfunc.h), libc does not. */
+    for (uint8_t i = 0U; i < 8U; ++i)
+        r->data[i] = (i < dlc) ? data[i] : 0U;
+    s_trHead++;
+
+    if (state == TRACE_RUNNING)
+    {
+        if ((s_trStop.set != 0U) && (trace_match(&s_trStop, match) != 0U))
+        {
+            s_trLeft = s_trPost;
+            state    = (s_trPost != 0U) ? TRACE_POST : TRACE_STOPPED;
+        }
+    }
+    else if (--s_trLeft == 0U)
+    {
+        state = TRACE_STOPPED;
+    }
+
+    if (state == TRACE_STOPPED)
+        s_trHit = 1U;
+    s_trState = state;
+}
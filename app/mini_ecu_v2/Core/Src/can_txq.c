@@ -0,0 +1,256 @@
+/**
+ * @file    can_txq.c
+ * @brief   Binary min-heap implementation of the CAN software TX queue.
+ *
+ * Arbitration key:
+ *   - The first 11 bits on the wire are the base ID, for both frame types.
+ *   - On an equal base ID a standard frame beats an extended one
+ *     (recessive SRR/IDE bits of the extended frame).
+ *
+ * Encoding the key as (base << 18 | ext_low18) << 1 | ext keeps that
+ * ordering with a plain unsigned compare. That is the TIR image shifted
+ * right by two: STID/EXID in bits 31:3, IDE in bit 2.
+ *
+ * Push, pop, the submission slots and their helpers run from SRAM: the
+ * gateway submits frames from the CAN RX interrupts and the TX interrupt
+ * takes them (can_gw.h, ramfunc.h).
+ */
+
+#include "can_txq.h"
+#include "main.h"
+#include "ramfunc.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+RAMFUNC static uint32_t txq_key(const CanTxFrame_t *f)
+{
+    return f->tir >> 2;
+}
+
+/** 1 if element a must leave before element b. */
+RAMFUNC static uint8_t txq_before(const CanTxQueue_t *q, uint32_t a, uint32_t b)
+{
+    if (q->key[a] != q->key[b])
+        return (q->key[a] < q->key[b]) ? 1U : 0U;
+
+    /* Same ID: older submission first (wrap-safe). */
+    return ((int32_t)(q->seq[a] - q->seq[b]) < 0) ? 1U : 0U;
+}
+
+RAMFUNC static void txq_swap(CanTxQueue_t *q, uint32_t a, uint32_t b)
+{
+    CanTxFrame_t f = q->frame[a];
+    uint32_t     k = q->key[a];
+    uint32_t     s = q->seq[a];
+
+    q->frame[a] = q->frame[b];
+    q->key[a]   = q->key[b];
+    q->seq[a]   = q->seq[b];
+
+    q->frame[b] = f;
+    q->key[b]   = k;
+    q->seq[b]   = s;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void CanTxQ_Init(CanTxQueue_t *q)
+{
+    memset(q, 0, sizeof(*q));
+}
+
+RAMFUNC uint8_t CanTxQ_Push(CanTxQueue_t *q, const CanTxFrame_t *frame)
+{
+    if (q->count >= CAN_TXQ_SIZE)
+        return 0U;
+
+    return CanTxQ_PushSeq(q, frame, q->nextSeq++);
+}
+
+RAMFUNC uint8_t CanTxQ_PushSeq(CanTxQueue_t *q, const CanTxFrame_t *frame, uint32_t seq)
+{
+    if (q->count >= CAN_TXQ_SIZE)
+        return 0U;
+
+    uint32_t i = q->count++;
+
+    q->frame[i] = *frame;
+    q->key[i]   = txq_key(frame);
+    q->seq[i]   = seq;
+
+    /* Sift up. */
+    while (i > 0U)
+    {
+        uint32_t parent = (i - 1U) / 2U;
+        if (!txq_before(q, i, parent))
+            break;
+        txq_swap(q, i, parent);
+        i = parent;
+    }
+
+    return 1U;
+}
+
+RAMFUNC uint8_t CanTxQ_Pop(CanTxQueue_t *q, CanTxFrame_t *out)
+{
+    if (q->count == 0U)
+        return 0U;
+
+    *out = q->frame[0];
+
+    q->count--;
+    if (q->count == 0U)
+        return 1U;
+
+    q->frame[0] = q->frame[q->count];
+    q->key[0]   = q->key[q->count];
+    q->seq[0]   = q->seq[q->count];
+
+    /* Sift down. */
+    uint32_t i = 0U;
+    for (;;)
+    {
+        uint32_t l = (2U * i) + 1U;
+        uint32_t r = l + 1U;
+        uint32_t best = i;
+
+        if ((l < q->count) && txq_before(q, l, best))
+            best = l;
+        if ((r < q->count) && txq_before(q, r, best))
+            best = r;
+        if (best == i)
+            break;
+
+        txq_swap(q, i, best);
+        i = best;
+    }
+
+    return 1U;
+}
+
+RAMFUNC const CanTxFrame_t *CanTxQ_Peek(const CanTxQueue_t *q)
+{
+    return (q->count != 0U) ? &q->frame[0] : NULL;
+}
+
+RAMFUNC uint32_t CanTxQ_Count(const CanTxQueue_t *q)
+{
+    return q->count;
+}
+
+/* ---- Submission slots ---- */
+
+/** Atomically OR @p bits into @p mask. */
+RAMFUNC static void txsub_set(volatile uint32_t *mask, uint32_t bits)
+{
+    uint32_t v;
+
+    do
+    {
+        v = __LDREXW(mask) | bits;
+    } while (__STREXW(v, mask) != 0U);
+}
+
+/** Atomically read @p mask and clear it. */
+RAMFUNC static uint32_t txsub_take_all(volatile uint32_t *mask)
+{
+    uint32_t v;
+
+    do
+    {
+        v = __LDREXW(mask);
+    } while (__STREXW(0U, mask) != 0U);
+    return v;
+}
+
+void CanTxSub_Init(CanTxSub_t *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->free = (CAN_TXSUB_SIZE == 32U) ? 0xFFFFFFFFU : ((1UL << CAN_TXSUB_SIZE) - 1UL);
+}
+
+RAMFUNC CanTxFrame_t *CanTxSub_Claim(CanTxSub_t *s)
+{
+    uint32_t mask;
+    uint32_t slot;
+    uint32_t ticket;
+
+    do
+    {
+        mask = __LDREXW(&s->free);
+        if (mask == 0U)
+        {
+            __CLREX();
+            return NULL;
+        }
+        slot = (uint32_t)__builtin_ctz(mask);
+    } while (__STREXW(mask & ~(1UL << slot), &s->free) != 0U);
+
+    do
+    {
+        ticket = __LDREXW(&s->nextTicket);
+    } while (__STREXW(ticket + 1U, &s->nextTicket) != 0U);
+
+    s->ticket[slot] = ticket;
+    return &s->frame[slot];
+}
+
+RAMFUNC void CanTxSub_Publish(CanTxSub_t *s, CanTxFrame_t *frame)
+{
+    uint32_t slot = (uint32_t)(frame - s->frame);
+
+    /* The frame and its ticket are written before the bit says so. */
+    __DMB();
+    txsub_set(&s->ready, 1UL << slot);
+}
+
+RAMFUNC uint32_t CanTxSub_Take(CanTxSub_t *s, CanTxQueue_t *q)
+{
+    uint32_t taken = txsub_take_all(&s->ready);
+    uint32_t moved = 0U;
+    uint32_t done  = 0U;
+
+    __DMB();
+
+    /* Oldest first (usually there is one): if the queue fills up, the
+     * frames left for later are newer than those it took. */
+    while ((taken != 0U) && (CanTxQ_Count(q) < CAN_TXQ_SIZE))
+    {
+        uint32_t oldest = (uint32_t)__builtin_ctz(taken);
+
+        for (uint32_t bits = taken & (taken - 1U); bits != 0U; bits &= bits - 1U)
+        {
+            uint32_t slot = (uint32_t)__builtin_ctz(bits);
+            if ((int32_t)(s->ticket[slot] - s->ticket[oldest]) < 0)
+                oldest = slot;
+        }
+
+        (void)CanTxQ_PushSeq(q, &s->frame[oldest], s->ticket[oldest]);
+        taken &= ~(1UL << oldest);
+        done  |= 1UL << oldest;
+        moved++;
+    }
+
+    if (taken != 0U)
+        txsub_set(&s->ready, taken);
+    if (done != 0U)
+        txsub_set(&s->free, done);
+    return moved;
+}
+
+RAMFUNC uint32_t CanTxSub_Discard(CanTxSub_t *s)
+{
+    uint32_t taken = txsub_take_all(&s->ready);
+    uint32_t n     = 0U;
+
+    for (uint32_t bits = taken; bits != 0U; bits &= bits - 1U)
+        n++;
+    if (taken != 0U)
+        txsub_set(&s->free, taken);
+    return n;
+}
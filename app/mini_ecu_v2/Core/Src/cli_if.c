@@ -3,132 +3,1683 @@
  * @brief   Minimal UART CLI with live dashboard for Mini ECU.
  *
  * Design:
- *   - UART RX interrupt fills a small ring buffer.
+ *   - USART2 RX runs on DMA in circular mode into s_cliRxDma. The HAL
+ *     "receive to idle" event (IDLE line, half and full transfer) wakes
+ *     CliTask with a thread flag; there is no per-byte interrupt.
  *   - CLI_IF_Task() runs at thread level:
- *       * consumes bytes and interprets commands
+ *       * sleeps until RX data arrives or the dashboard is due
+ *       * consumes bytes between its read index and the DMA write index
+ *         and interprets commands
  *       * periodically prints a "speedometer" line with current values
+ *   - Commands come from a registration table ({name, args, minArgs,
+ *     handler, help}). Lines are tokenized once and the command is found by
+ *     binary search over the name-sorted table; "help" is generated from it.
+ *     Modules add their own commands with CLI_IF_Register().
+ *
+ *   - With CLI_RTT_POLL_MS set, the task also polls the RTT down buffer
+ *     (rtt.h) and feeds those bytes to the same line editor.
+ *   - With USB_CDC_ENABLE, bytes from the USB CDC port (usb_cdc.h) go to
+ *     the same line editor; while the host has the port open the CLI
+ *     output stream is on the "usb" transport.
  *
  * Live dashboard:
  *   - Shows Speed / RPM / Coolant temperature in a single line.
  *   - Uses '\r' to overwrite the same line repeatedly.
- *   - Currently uses the "true" VehicleState_t values; later we can
- *     switch to decoded CAN RX telemetry if desired.
+ *   - By default reads a consistent Vehicle_GetSnapshot() copy of the
+ *     "true" vehicle state; "veh" commands go through the vehicle mailbox.
+ *   - "dash src can" renders the values decoded from CAN RX instead
+ *     (can_sigcache.h) and adds the RX frame rate, the RX interrupt ->
+ *     cache latency and the age of each signal.
+ *   - Pauses after CLI_DASH_IDLE_MS without a received byte (UART, USB or
+ *     RTT), so an unattended node spends no UART time on it; the next
+ *     byte resumes it with a full redraw.
+ *   - The period doubles for every CLI_DASH_BACKLOG_PCT of the rings
+ *     queued on the CLI transport, up to CLI_DASH_MAX_PERIOD_MS, so log
+ *     lines and telemetry get the link first.
+ *   - "dash perf" replaces the line by a four-row pipeline page (ring and
+ *     queue fill, drops, ISR rate, p99 latencies, CPU per task) above a
+ *     scroll region; its fields are kept as numbers and only the ones
+ *     that changed are formatted and sent.
+ */
+
+#include "cli_if.h"
+#include "audit.h"
+#include "can_if.h"
+#include "can_sigcache.h"
+#include "rtos_stats.h"
+#include "vehicle_shared.h"
+#include "log.h"
+#include "mem_pool.h"
+#include "perf.h"
+#include "fmt.h"
+#include "platform_dma.h"
+#include "ramfunc.h"
+#include "rtt.h"
+#include "irq_bench.h"
+#include "cli_script.h"
+#include "cli_rpc.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>   /* atof, strtoul */
+#include <stdarg.h>
+#include "cmsis_os2.h"
+
+/* --------------------------------------------------------------------------
+ * Local state
+ * -------------------------------------------------------------------------- */
+
+/** UART used for CLI interaction. */
+static UART_HandleTypeDef *s_cliUart = NULL;
+
+/** Circular DMA RX buffer (written by DMA, read by CliTask), in SRAM2. */
+PLATFORM_DMA_BUFFER static uint8_t s_cliRxDma[CLI_RX_DMA_SIZE];
+
+_Static_assert((CLI_RX_DMA_SIZE % PLATFORM_DMA_ALIGN) == 0U,
+               "CLI_RX_DMA_SIZE: whole cache lines");
+
+/** Next byte of s_cliRxDma the parser has not consumed yet. */
+static uint32_t s_cliRxRead = 0U;
+
+/** CliTask, woken by the RX event callback (NULL until CLI_IF_Task runs). */
+static osThreadId_t s_cliThread = NULL;
+
+/** UART errors (overrun/noise/framing) that forced an RX restart. */
+static volatile uint32_t s_cliRxOverruns = 0U;
+
+/** Set by CLI_IF_Resume(): check the RX DMA on the next pass. */
+static volatile uint8_t  s_cliResume   = 0U;
+
+/** RX DMA found stopped after Stop mode and restarted. */
+static uint32_t          s_cliRxRearms = 0U;
+
+/** Thread flag raised by the RX event callback. */
+#define CLI_RX_FLAG  0x0001U
+
+/** While CLI_IF_ExecuteCapture() runs: its output buffer, size, bytes
+ *  written and bytes that did not fit. */
+static char             *s_cliCapBuf  = NULL;
+static uint32_t          s_cliCapSize = 0U;
+static uint32_t          s_cliCapLen  = 0U;
+static uint32_t          s_cliCapCut  = 0U;
+
+/* ---- Dashboard ----
+ *
+ * Row 1 layout (1-based columns):
+ *   SPD: xxxx.x km/h | RPM: xxxxx | TEMP: xxx.x C
+ *        ^6                 ^25          ^39
+ * and with the CAN source, continued by
+ *   | RX: xxxxx/s | LAT: xxxxx us | AGE: xxxxx xxxxx xxxxx ms
+ *       ^53             ^68             ^84   ^90   ^96
+ * The labels are drawn on a full redraw only; afterwards each value is
+ * re-sent on its own (cursor positioned) when its text changes.
+ */
+#define CLI_DASH_FIELD_COUNT  8U
+#define CLI_DASH_MODEL_FIELDS 3U
+#define CLI_DASH_FIELD_LEN    8U
+
+/** Largest number the 5-digit CAN fields show; larger values are capped. */
+#define CLI_DASH_NUM_MAX      99999U
+
+/** "log ram" prints in chunks of this size, each once the ring has room. */
+#define CLI_LOG_RAM_CHUNK       64U
+#define CLI_LOG_RAM_TIMEOUT_MS  500U
+
+/** "log dump" sends the post-mortem ring by reference in pieces of this size. */
+#define CLI_LOG_DUMP_CHUNK      128U
+#define CLI_LOG_DUMP_TIMEOUT_MS 500U
+
+typedef struct
+{
+    uint8_t col;     /**< 1-based column of the value. */
+    uint8_t width;   /**< Printed width of the value. */
+} CliDashField_t;
+
+static const CliDashField_t s_dashFields[CLI_DASH_FIELD_COUNT] =
+{
+    {  6U, 6U },     /* speed (km/h) */
+    { 25U, 5U },     /* RPM */
+    { 39U, 5U },     /* coolant (C) */
+    { 53U, 5U },     /* CAN RX frames/s */
+    { 68U, 5U },     /* RX interrupt -> cache (us) */
+    { 84U, 5U },     /* age of speed (ms) */
+    { 90U, 5U },     /* age of RPM (ms) */
+    { 96U, 5U },     /* age of coolant (ms) */
+};
+
+/** Label text in front of each value on a full redraw. */
+static const char *const s_dashLabels[CLI_DASH_FIELD_COUNT] =
+{
+    "SPD: ", " km/h | RPM: ", " | TEMP: ", " C | RX: ",
+    "/s | LAT: ", " us | AGE: ", " ", " ",
+};
+
+/** Value text last sent for each field. */
+static char s_dashShown[CLI_DASH_FIELD_COUNT][CLI_DASH_FIELD_LEN];
+
+/** Non-zero forces a full redraw (labels and all values). */
+static uint8_t s_dashDirty = 1U;
+
+/** Refreshes since the last full redraw. */
+static uint32_t s_dashSinceFull = 0U;
+
+/** Refresh period in ms set by "dash rate" (0 = dashboard off). */
+static uint32_t s_dashPeriodMs = CLI_DASH_PERIOD_MS;
+
+/** "dash on" / "dash off". */
+static uint8_t  s_dashOn = (CLI_DASH_PERIOD_MS != 0U) ? 1U : 0U;
+
+/** Pause after this long without input (ms, 0 = never). */
+static uint32_t s_dashIdleMs = CLI_DASH_IDLE_MS;
+
+/** Tick of the last received byte; paused since the idle time ran out;
+ *  resumed by input, redraw now. */
+static uint32_t s_dashInputTick = 0U;
+static uint8_t  s_dashPaused    = 0U;
+static uint8_t  s_dashResumed   = 0U;
+static uint32_t s_dashPauses    = 0U;
+
+/** Period in use after the backlog stretch, and the refreshes it delayed. */
+static uint32_t s_dashEffMs     = CLI_DASH_PERIOD_MS;
+static uint32_t s_dashStretched = 0U;
+
+/** Non-zero: render the CAN RX signal cache instead of the vehicle model. */
+static uint8_t s_dashFromCan = CLI_DASH_FROM_CAN;
+
+/** Frame count and tick at the previous refresh, for the RX rate. */
+static uint32_t s_dashRxFrames = 0U;
+static uint32_t s_dashRxTick   = 0U;
+static uint32_t s_dashRxRate   = 0U;
+
+/* ---- Pipeline page ("dash perf") ----
+ *
+ * Rows 1..4 (1-based columns), above a scroll region from row 5:
+ *   RX ring xxxxx/xxxxx hw xxxxx ovf xxxxx | TX q xxxxx hw xxxxx drop xxxxx
+ *           ^9    ^15     ^24       ^34           ^47     ^56       ^67
+ *   LOG ring xxxxx/xxxxx hw xxxxx drop xxxxx | ISR xxxxx/s | idle xxxxx%
+ *            ^10   ^16     ^25        ^36          ^48            ^63
+ *   p99 us: RX ISR xxxxx | RX proc xxxxx | ISR->task xxxxx | dash xxxxx
+ *                  ^16             ^32               ^50          ^63
+ *   CPU: nnnnnnnn xxxxx% nnnnnnnn xxxxx% nnnnnnnn xxxxx% nnnnnnnn xxxxx%
+ *        ^6       ^15    ^22      ^31    ^38      ^47    ^54      ^63
+ * The p99 figures are the upper edge of the log2 bucket (perf.h, can_lat.h)
+ * holding the 99th percentile of the samples since the previous refresh;
+ * RX ISR, RX proc and dash time the code of PERF_CAN_RX_ISR,
+ * PERF_CAN_RX_PROCESS and PERF_CLI_DASH (this refresh), ISR->task the
+ * CAN_LAT_ISR_TO_TASK path of all identifiers. CPU lists the busiest
+ * tasks of the last RtosStats window, the idle task left out.
+ */
+#define CLI_DASH_PERF_FIELDS  25U
+#define CLI_DASH_PERF_ROWS    4U
+#define CLI_DASH_PERF_TASKS   4U
+#define CLI_DASH_PERF_PROBES  3U
+_Static_assert(CLI_DASH_PERF_ROWS == 4U, "cli_dash_page() starts the scroll region at row 5");
+
+/** Field values that are not numbers: not built in, no sample yet. */
+#define CLI_DASH_PERF_NA      0xFFFFFFFFU
+#define CLI_DASH_PERF_NONE    0xFFFFFFFEU
+
+typedef enum
+{
+    CLI_DASH_NUM = 0,    /**< 5-digit number, capped at CLI_DASH_NUM_MAX. */
+    CLI_DASH_PERMILLE,   /**< Per mille shown as percent, one decimal. */
+    CLI_DASH_NAME,       /**< Task name, cut to the width. */
+} CliDashKind_t;
+
+typedef struct
+{
+    uint8_t row;
+    uint8_t col;
+    uint8_t width;
+    uint8_t kind;        /**< CliDashKind_t */
+} CliDashPerfField_t;
+
+static const CliDashPerfField_t s_dashPerfFields[CLI_DASH_PERF_FIELDS] =
+{
+    { 1U,  9U, 5U, CLI_DASH_NUM },      /* CAN RX ring fill */
+    { 1U, 15U, 5U, CLI_DASH_NUM },      /* CAN RX ring slots */
+    { 1U, 24U, 5U, CLI_DASH_NUM },      /* CAN RX ring high water */
+    { 1U, 34U, 5U, CLI_DASH_NUM },      /* CAN RX ring overflows */
+    { 1U, 47U, 5U, CLI_DASH_NUM },      /* TX queue depth */
+    { 1U, 56U, 5U, CLI_DASH_NUM },      /* TX queue high water */
+    { 1U, 67U, 5U, CLI_DASH_NUM },      /* TX frames dropped */
+    { 2U, 10U, 5U, CLI_DASH_NUM },      /* log lines ring fill (bytes) */
+    { 2U, 16U, 5U, CLI_DASH_NUM },      /* log lines ring size */
+    { 2U, 25U, 5U, CLI_DASH_NUM },      /* log lines ring peak */
+    { 2U, 36U, 5U, CLI_DASH_NUM },      /* log lines dropped */
+    { 2U, 48U, 5U, CLI_DASH_NUM },      /* CAN RX interrupts/s */
+    { 2U, 63U, 5U, CLI_DASH_PERMILLE }, /* idle */
+    { 3U, 16U, 5U, CLI_DASH_NUM },      /* p99 CAN RX ISR */
+    { 3U, 32U, 5U, CLI_DASH_NUM },      /* p99 CAN RX processing */
+    { 3U, 50U, 5U, CLI_DASH_NUM },      /* p99 RX interrupt -> CanRxTask */
+    { 3U, 63U, 5U, CLI_DASH_NUM },      /* p99 dashboard refresh */
+    { 4U,  6U, 8U, CLI_DASH_NAME },     /* busiest task */
+    { 4U, 15U, 5U, CLI_DASH_PERMILLE },
+    { 4U, 22U, 8U, CLI_DASH_NAME },
+    { 4U, 31U, 5U, CLI_DASH_PERMILLE },
+    { 4U, 38U, 8U, CLI_DASH_NAME },
+    { 4U, 47U, 5U, CLI_DASH_PERMILLE },
+    { 4U, 54U, 8U, CLI_DASH_NAME },
+    { 4U, 63U, 5U, CLI_DASH_PERMILLE },
+};
+
+/** Label text in front of each value, and after the last one of a row. */
+static const char *const s_dashPerfLabels[CLI_DASH_PERF_FIELDS] =
+{
+    "RX ring ", "/", " hw ", " ovf ", " | TX q ", " hw ", " drop ",
+    "LOG ring ", "/", " hw ", " drop ", " | ISR ", "/s | idle ",
+    "p99 us: RX ISR ", " | RX proc ", " | ISR->task ", " | dash ",
+    "CPU: ", " ", "% ", " ", "% ", " ", "% ", " ",
+};
+static const char *const s_dashPerfTails[CLI_DASH_PERF_ROWS] = { "", "%", "", "%" };
+
+/** Values last sent: numbers, or for CLI_DASH_NAME fields the name. */
+typedef struct
+{
+    uint32_t    num[CLI_DASH_PERF_FIELDS];
+    const char *name[CLI_DASH_PERF_FIELDS];
+} CliDashPerfVals_t;
+
+static CliDashPerfVals_t s_dashPerfShown;
+
+/** Non-zero: the pipeline page is shown instead of the line. */
+static uint8_t  s_dashPerf = 0U;
+
+/** Probe histograms and the CAN_RX_ISR count at the previous refresh, for
+ *  the per-refresh p99 and the interrupt rate. */
+#if PERF_ENABLE
+static const perf_id_t s_dashPerfProbes[CLI_DASH_PERF_PROBES] =
+{
+    PERF_CAN_RX_ISR, PERF_CAN_RX_PROCESS, PERF_CLI_DASH,
+};
+static uint32_t s_dashPerfHist[CLI_DASH_PERF_PROBES][PERF_HIST_BUCKETS];
+static uint32_t s_dashIsrCount = 0U;
+static uint32_t s_dashIsrTick  = 0U;
+#endif
+#if CAN_LAT_ENABLE
+static uint32_t s_dashLatHist[CAN_LAT_BUCKETS];
+#endif
+
+/** Busiest tasks of RtosStats window s_dashTopWindow (0: none yet). */
+static uint32_t    s_dashTopWindow = 0U;
+static uint16_t    s_dashIdle      = 0U;
+static const char *s_dashTopName[CLI_DASH_PERF_TASKS];
+static uint16_t    s_dashTopLoad[CLI_DASH_PERF_TASKS];
+
+/** Registered commands, sorted by name for binary search. */
+static const CliCommand_t *s_cmds[CLI_MAX_COMMANDS];
+static uint32_t            s_cmdCount = 0U;
+
+/* --------------------------------------------------------------------------
+ * Local helpers
+ * -------------------------------------------------------------------------- */
+
+/**
+ * @brief Print a string on the CLI UART.
+ *
+ * Output is queued through the log backend, which owns the UART TX path,
+ * so CLI text and log lines never interleave mid-line and the CLI task
+ * never blocks on the UART.
+ */
+static void cli_uart_print(const char *s)
+{
+    if ((s == NULL) || (s_cliUart == NULL))
+        return;
+
+    size_t len = strlen(s);
+    if (len == 0U)
+        return;
+
+    if (s_cliCapBuf != NULL)
+    {
+        uint32_t room = s_cliCapSize - s_cliCapLen;
+        uint32_t n    = ((uint32_t)len < room) ? (uint32_t)len : room;
+
+        memcpy(&s_cliCapBuf[s_cliCapLen], s, n);
+        s_cliCapLen += n;
+        s_cliCapCut += (uint32_t)len - n;
+        return;
+    }
+
+    (void)Log_WriteRaw(s, len);
+}
+
+/**
+ * @brief Start (or restart) circular DMA reception with IDLE detection.
+ */
+static void cli_rx_start(void)
+{
+    s_cliRxRead = 0U;
+
+    if (HAL_UARTEx_ReceiveToIdle_DMA(s_cliUart, s_cliRxDma, CLI_RX_DMA_SIZE) == HAL_OK)
+    {
+        /* Half-transfer events are not needed: IDLE and TC already cover
+         * every burst, and the buffer is far larger than one line. */
+        __HAL_DMA_DISABLE_IT(s_cliUart->hdmarx, DMA_IT_HT);
+    }
+}
+
+/**
+ * @brief Restart the circular DMA reception if it no longer runs: after
+ *        Stop mode a framing error may have ended it.
+ */
+static void cli_rx_check(void)
+{
+    if ((s_cliUart->RxState == HAL_UART_STATE_BUSY_RX) &&
+        ((s_cliUart->hdmarx->Instance->CR & DMA_SxCR_EN) != 0U))
+        return;
+
+    (void)HAL_UART_AbortReceive(s_cliUart);
+    s_cliRxRearms++;
+    cli_rx_start();
+}
+
+/**
+ * @brief Current DMA write index into s_cliRxDma.
+ */
+static uint32_t cli_rx_write_pos(void)
+{
+    uint32_t remaining = __HAL_DMA_GET_COUNTER(s_cliUart->hdmarx);
+    return (CLI_RX_DMA_SIZE - remaining) % CLI_RX_DMA_SIZE;
+}
+
+/**
+ * @brief 5-digit dashboard number, capped at CLI_DASH_NUM_MAX.
+ */
+static uint32_t cli_dash_num(char *out, uint32_t v)
+{
+    return Fmt_Dec(out, (v < CLI_DASH_NUM_MAX) ? v : CLI_DASH_NUM_MAX, 5U);
+}
+
+/**
+ * @brief One-decimal dashboard value, clamped so it fits CLI_DASH_FIELD_LEN.
+ */
+static uint32_t cli_dash_fixed(char *out, float v, uint8_t width)
+{
+    if (v > 99999.9f)
+        v = 99999.9f;
+    else if (v < -9999.9f)
+        v = -9999.9f;
+    return Fmt_Fixed(out, v, 1U, width);
+}
+
+/**
+ * @brief Dashboard values from the CAN RX signal cache.
+ *
+ * Signals not received yet show "---". The rate is the frame count
+ * difference over the time since the previous refresh.
+ */
+static void cli_dash_can_values(char val[][CLI_DASH_FIELD_LEN])
+{
+    CanSigCache_Entry_t e[CAN_SIG_COUNT];
+    CanSigCache_Stats_t st;
+
+    for (uint32_t i = 0U; i < (uint32_t)CAN_SIG_COUNT; ++i)
+        (void)CanSigCache_Read((CanSigCache_Signal_t)i, &e[i]);
+    CanSigCache_GetStats(&st);
+
+    uint32_t now = HAL_GetTick();
+
+    if ((now - s_dashRxTick) > 0U)
+    {
+        s_dashRxRate   = ((st.frames - s_dashRxFrames) * 1000U) / (now - s_dashRxTick);
+        s_dashRxFrames = st.frames;
+        s_dashRxTick   = now;
+    }
+
+    if (e[CAN_SIG_SPEED].seq != 0U)
+        (void)cli_dash_fixed(val[0], e[CAN_SIG_SPEED].value, 6U);
+    else
+        (void)Fmt_Str(val[0], "---", 6U);
+
+    if (e[CAN_SIG_RPM].seq != 0U)
+        (void)cli_dash_num(val[1], (uint32_t)e[CAN_SIG_RPM].value);
+    else
+        (void)Fmt_Str(val[1], "---", 5U);
+
+    if (e[CAN_SIG_COOLANT].seq != 0U)
+        (void)cli_dash_fixed(val[2], e[CAN_SIG_COOLANT].value, 5U);
+    else
+        (void)Fmt_Str(val[2], "---", 5U);
+
+    (void)cli_dash_num(val[3], s_dashRxRate);
+
+#if CAN_LAT_ENABLE
+    if (st.frames != 0U)
+        (void)cli_dash_num(val[4], st.lastLatUs);
+    else
+        (void)Fmt_Str(val[4], "---", 5U);
+#else
+    (void)Fmt_Str(val[4], "n/a", 5U);
+#endif
+
+    for (uint32_t i = 0U; i < CAN_SIG_FRAME_COUNT; ++i)
+    {
+        if (e[i].seq == 0U)
+            (void)Fmt_Str(val[5U + i], "---", 5U);
+        else
+            (void)cli_dash_num(val[5U + i], now - e[i].timeMs);
+    }
+}
+
+/**
+ * @brief Share of the rings queued on the CLI stream's transport (%).
+ *
+ * The log lines and telemetry that share the link count too: they are
+ * what the dashboard should make room for.
+ */
+static uint32_t cli_dash_backlog(void)
+{
+    Log_TransportId_t tp   = Log_GetTransport(LOG_STREAM_CLI);
+    uint32_t          fill = 0U;
+    uint32_t          size = 0U;
+
+    for (uint32_t i = 0U; i < (uint32_t)LOG_STREAM_COUNT; ++i)
+    {
+        Log_Stats_t st;
+
+        if (Log_GetTransport((Log_Stream_t)i) != tp)
+            continue;
+        Log_GetStreamStats((Log_Stream_t)i, &st);
+        fill += st.fill;
+        size += st.ringSize;
+    }
+
+    return (size != 0U) ? ((fill * 100U) / size) : 0U;
+}
+
+/**
+ * @brief Refresh period right now (ms): 0 while off or paused, else the
+ *        "dash rate" period doubled per CLI_DASH_BACKLOG_PCT of backlog.
+ */
+static uint32_t cli_dash_period(uint32_t now)
+{
+    if ((s_dashOn == 0U) || (s_dashPeriodMs == 0U))
+        return 0U;
+
+    if ((s_dashIdleMs != 0U) && ((now - s_dashInputTick) >= s_dashIdleMs))
+    {
+        if (s_dashPaused == 0U)
+        {
+            s_dashPaused = 1U;
+            s_dashPauses++;
+            LOG_INFO(CLI, "Dashboard paused, no input for %lu s", (unsigned long)(s_dashIdleMs / 1000U));
+        }
+        return 0U;
+    }
+
+    uint32_t period = s_dashPeriodMs;
+#if CLI_DASH_BACKLOG_PCT > 0U
+    uint32_t pct = cli_dash_backlog();
+
+    for (uint32_t p = CLI_DASH_BACKLOG_PCT; (p <= pct) && (period < CLI_DASH_MAX_PERIOD_MS);
+         p += CLI_DASH_BACKLOG_PCT)
+        period *= 2U;
+    if (period > CLI_DASH_MAX_PERIOD_MS)
+        period = (s_dashPeriodMs > CLI_DASH_MAX_PERIOD_MS) ? s_dashPeriodMs : CLI_DASH_MAX_PERIOD_MS;
+#endif
+    s_dashEffMs = period;
+    return period;
+}
+
+/**
+ * @brief A byte was received: restart the idle time, and have a paused
+ *        dashboard redrawn in full at once.
+ */
+static void cli_dash_input(void)
+{
+    s_dashInputTick = osKernelGetTickCount();
+    if (s_dashPaused == 0U)
+        return;
+
+    s_dashPaused  = 0U;
+    s_dashResumed = 1U;
+    s_dashDirty   = 1U;
+}
+
+#if PERF_ENABLE || CAN_LAT_ENABLE
+/**
+ * @brief Bucket holding the 99th percentile of the samples added to
+ *        @p hist since @p prev, which then takes the new counts.
+ *
+ * A count below the previous one means the histogram was reset; the
+ * count itself is taken.
+ *
+ * @return Bucket index, or @p buckets without a new sample.
+ */
+static uint32_t cli_dash_p99_bucket(const uint32_t *hist, uint32_t *prev, uint32_t buckets)
+{
+    uint32_t d[PERF_HIST_BUCKETS > CAN_LAT_BUCKETS ? PERF_HIST_BUCKETS : CAN_LAT_BUCKETS];
+    uint32_t total = 0U;
+
+    for (uint32_t b = 0U; b < buckets; ++b)
+    {
+        d[b]    = (hist[b] >= prev[b]) ? (hist[b] - prev[b]) : hist[b];
+        prev[b] = hist[b];
+        total  += d[b];
+    }
+    if (total == 0U)
+        return buckets;
+
+    /* First bucket where the running count reaches ceil(0.99 * total). */
+    uint32_t want = total - (total / 100U);
+    uint32_t run  = 0U;
+    uint32_t b    = 0U;
+
+    for (; b < (buckets - 1U); ++b)
+    {
+        run += d[b];
+        if (run >= want)
+            break;
+    }
+    return b;
+}
+#endif
+
+#if PERF_ENABLE
+/**
+ * @brief Per-refresh p99 of probe @p slot in us (CLI_DASH_PERF_NONE
+ *        without a sample); the last bucket, open-ended, gives the max.
+ */
+static uint32_t cli_dash_probe_p99(uint32_t slot, const Perf_Stats_t *st)
+{
+    uint32_t b = cli_dash_p99_bucket(st->hist, s_dashPerfHist[slot], PERF_HIST_BUCKETS);
+
+    if (b >= PERF_HIST_BUCKETS)
+        return CLI_DASH_PERF_NONE;
+
+    uint32_t cycles = (b < (PERF_HIST_BUCKETS - 1U)) ? (1UL << b) : st->max;
+    uint32_t mhz    = SystemCoreClock / 1000000U;
+
+    return (cycles + mhz - 1U) / mhz;
+}
+#endif
+
+/**
+ * @brief Busiest tasks and the idle share, taken again only once
+ *        RtosStats has closed a new window.
+ */
+static void cli_dash_perf_tasks(void)
+{
+    /* CliTask only: kept off its stack. */
+    static RtosStats_Task_t tasks[RTOS_STATS_MAX_TASKS];
+    RtosStats_Summary_t     sum;
+    uint32_t                n = RtosStats_Get(tasks, RTOS_STATS_MAX_TASKS, &sum);
+
+    if ((n == 0U) || (sum.windows == s_dashTopWindow))
+        return;
+    s_dashTopWindow = sum.windows;
+    s_dashIdle      = sum.idlePermille;
+
+    for (uint32_t k = 0U; k < CLI_DASH_PERF_TASKS; ++k)
+    {
+        int32_t best = -1;
+
+        for (uint32_t i = 0U; i < n; ++i)
+        {
+            /* The idle task is the idle field; taken tasks are marked
+             * with a NULL name. */
+            if ((tasks[i].name == NULL) || (strcmp(tasks[i].name, "IDLE") == 0))
+                continue;
+            if ((best < 0) || (tasks[i].cpuPermille > tasks[best].cpuPermille))
+                best = (int32_t)i;
+        }
+
+        if (best < 0)
+        {
+            s_dashTopName[k] = NULL;
+            s_dashTopLoad[k] = 0U;
+            continue;
+        }
+        s_dashTopName[k] = tasks[best].name;
+        s_dashTopLoad[k] = tasks[best].cpuPermille;
+        tasks[best].name = NULL;
+    }
+}
+
+/**
+ * @brief Current values of the pipeline page.
+ */
+static void cli_dash_perf_values(CliDashPerfVals_t *v)
+{
+    CanRing_Stats_t  rs;
+    CAN_IF_TxStats_t ts;
+    Log_Stats_t      ls;
+
+    CanRing_GetStats(CAN_IF_GetRxRing(), &rs);
+    CAN_IF_GetTxStats(&ts);
+    Log_GetStats(&ls);
+
+    memset(v->name, 0, sizeof(v->name));
+    v->num[0]  = rs.count;
+    v->num[1]  = rs.capacity;
+    v->num[2]  = rs.highWater;
+    v->num[3]  = rs.overflows;
+    v->num[4]  = ts.depth;
+    v->num[5]  = ts.highWater;
+    v->num[6]  = ts.dropped;
+    v->num[7]  = ls.fill;
+    v->num[8]  = ls.ringSize;
+    v->num[9]  = ls.peakFill;
+    v->num[10] = ls.droppedLines;
+
+#if PERF_ENABLE
+    Perf_Stats_t ps[CLI_DASH_PERF_PROBES];
+    uint32_t     now = HAL_GetTick();
+
+    for (uint32_t i = 0U; i < CLI_DASH_PERF_PROBES; ++i)
+        (void)Perf_Get(s_dashPerfProbes[i], &ps[i]);
+
+    if ((now - s_dashIsrTick) > 0U)
+    {
+        v->num[11] = ((ps[0].count - s_dashIsrCount) * 1000U) / (now - s_dashIsrTick);
+        s_dashIsrCount = ps[0].count;
+        s_dashIsrTick  = now;
+    }
+    else
+    {
+        v->num[11] = s_dashPerfShown.num[11];
+    }
+    v->num[13] = cli_dash_probe_p99(0U, &ps[0]);
+    v->num[14] = cli_dash_probe_p99(1U, &ps[1]);
+    v->num[16] = cli_dash_probe_p99(2U, &ps[2]);
+#else
+    v->num[11] = CLI_DASH_PERF_NA;
+    v->num[13] = CLI_DASH_PERF_NA;
+    v->num[14] = CLI_DASH_PERF_NA;
+    v->num[16] = CLI_DASH_PERF_NA;
+#endif
+
+#if CAN_LAT_ENABLE
+    /* CliTask only: kept off its stack. */
+    static CanLat_Stats_t lat[CAN_LAT_PATHS];
+    uint32_t              hist[CAN_LAT_BUCKETS] = { 0U };
+    uint32_t              maxUs = 0U;
+    uint32_t              id;
+
+    for (uint32_t i = 0U; CanLat_Get(i, &id, lat) == HAL_OK; ++i)
+    {
+        for (uint32_t b = 0U; b < CAN_LAT_BUCKETS; ++b)
+            hist[b] += lat[CAN_LAT_ISR_TO_TASK].hist[b];
+        if (lat[CAN_LAT_ISR_TO_TASK].maxUs > maxUs)
+            maxUs = lat[CAN_LAT_ISR_TO_TASK].maxUs;
+    }
+
+    uint32_t b = cli_dash_p99_bucket(hist, s_dashLatHist, CAN_LAT_BUCKETS);
+
+    if (b >= CAN_LAT_BUCKETS)
+        v->num[15] = CLI_DASH_PERF_NONE;
+    else
+        v->num[15] = (b < (CAN_LAT_BUCKETS - 1U)) ? (1UL << b) : maxUs;
+#else
+    v->num[15] = CLI_DASH_PERF_NA;
+#endif
+
+    cli_dash_perf_tasks();
+    v->num[12] = (s_dashTopWindow != 0U) ? s_dashIdle : CLI_DASH_PERF_NONE;
+    for (uint32_t k = 0U; k < CLI_DASH_PERF_TASKS; ++k)
+    {
+        v->num[17U + (2U * k)]  = 0U;
+        v->name[17U + (2U * k)] = s_dashTopName[k];
+        v->num[18U + (2U * k)]  = (s_dashTopName[k] != NULL) ? s_dashTopLoad[k] : CLI_DASH_PERF_NONE;
+    }
+}
+
+/**
+ * @brief Text of pipeline field @p i, padded to its width.
+ */
+static uint32_t cli_dash_perf_format(char *out, uint32_t i, const CliDashPerfVals_t *v)
+{
+    const CliDashPerfField_t *f = &s_dashPerfFields[i];
+    char                      text[CLI_DASH_FIELD_LEN + 1U];
+
+    if (f->kind == CLI_DASH_NAME)
+    {
+        const char *name = (v->name[i] != NULL) ? v->name[i] : "-";
+        uint32_t    n    = 0U;
+
+        for (; (n < f->width) && (name[n] != '\0'); ++n)
+            text[n] = name[n];
+        text[n] = '\0';
+        return Fmt_StrLeft(out, text, f->width);
+    }
+
+    if (v->num[i] == CLI_DASH_PERF_NA)
+        return Fmt_Str(out, "n/a", f->width);
+    if (v->num[i] == CLI_DASH_PERF_NONE)
+        return Fmt_Str(out, "---", f->width);
+    if (f->kind == CLI_DASH_PERMILLE)
+        return cli_dash_fixed(out, (float)v->num[i] / 10.0f, f->width);
+    return cli_dash_num(out, v->num[i]);
+}
+
+/**
+ * @brief Update the pipeline page: everything on a full redraw, otherwise
+ *        the fields whose number (or task) changed.
+ */
+static void cli_update_dash_perf(void)
+{
+    PERF_BEGIN(CLI_DASH);
+
+    /* CliTask only: kept off its stack. */
+    static CliDashPerfVals_t v;
+    static char              buf[512];
+    size_t                   len = 0U;
+
+    cli_dash_perf_values(&v);
+
+    if (++s_dashSinceFull >= CLI_DASH_FULL_EVERY)
+        s_dashDirty = 1U;
+
+    /* save cursor ... restore cursor, as one record like the line */
+    len = Fmt_Str(buf, "\x1b[s", 0U);
+    if (s_dashDirty != 0U)
+    {
+        uint8_t row = 0U;
+
+        for (uint32_t i = 0U; i < CLI_DASH_PERF_FIELDS; ++i)
+        {
+            if (s_dashPerfFields[i].row != row)
+            {
+                if (row != 0U)
+                {
+                    len += Fmt_Str(&buf[len], s_dashPerfTails[row - 1U], 0U);
+                    len += Fmt_Str(&buf[len], "\x1b[K", 0U);
+                }
+                row  = s_dashPerfFields[i].row;
+                len += Fmt_Str(&buf[len], "\x1b[", 0U);
+                len += Fmt_Dec(&buf[len], row, 0U);
+                len += Fmt_Str(&buf[len], ";1H", 0U);
+            }
+            len += Fmt_Str(&buf[len], s_dashPerfLabels[i], 0U);
+            len += cli_dash_perf_format(&buf[len], i, &v);
+        }
+        len += Fmt_Str(&buf[len], s_dashPerfTails[row - 1U], 0U);
+        len += Fmt_Str(&buf[len], "\x1b[K", 0U);
+    }
+    else
+    {
+        for (uint32_t i = 0U; i < CLI_DASH_PERF_FIELDS; ++i)
+        {
+            if ((v.num[i] == s_dashPerfShown.num[i]) && (v.name[i] == s_dashPerfShown.name[i]))
+                continue;
+
+            len += Fmt_Str(&buf[len], "\x1b[", 0U);
+            len += Fmt_Dec(&buf[len], s_dashPerfFields[i].row, 0U);
+            len += Fmt_Str(&buf[len], ";", 0U);
+            len += Fmt_Dec(&buf[len], s_dashPerfFields[i].col, 0U);
+            len += Fmt_Str(&buf[len], "H", 0U);
+            len += cli_dash_perf_format(&buf[len], i, &v);
+        }
+
+        if (len == 3U)
+        {
+            PERF_END(CLI_DASH);
+            return;   /* nothing changed */
+        }
+    }
+    len += Fmt_Str(&buf[len], "\x1b[u", 0U);
+
+    if (Log_WriteRaw(buf, len) == HAL_OK)
+    {
+        s_dashPerfShown = v;
+        if (s_dashDirty != 0U)
+        {
+            s_dashDirty     = 0U;
+            s_dashSinceFull = 0U;
+        }
+    }
+    else
+    {
+        s_dashDirty = 1U;
+    }
+
+    PERF_END(CLI_DASH);
+}
+
+/**
+ * @brief Update the live dashboard line with current values.
+ *
+ * Uses ANSI escape codes to:
+ *   - Save the current cursor position
+ *   - Move to the top-left of the screen (row 1, col 1)
+ *   - Overwrite the dashboard line
+ *   - Restore the cursor position so typing isn't disturbed
+ */
+static void cli_update_dashboard(void)
+{
+    if (s_cliUart == NULL)
+        return;
+
+    if (s_dashPerf != 0U)
+    {
+        cli_update_dash_perf();
+        return;
+    }
+
+    PERF_BEGIN(CLI_DASH);
+
+    char     val[CLI_DASH_FIELD_COUNT][CLI_DASH_FIELD_LEN];
+    uint32_t fields;
+
+    if (s_dashFromCan != 0U)
+    {
+        cli_dash_can_values(val);
+        fields = CLI_DASH_FIELD_COUNT;
+    }
+    else
+    {
+        VehicleState_t vs;
+        Vehicle_GetSnapshot(&vs);
+
+        (void)cli_dash_fixed(val[0], vs.speed_kph, 6U);
+        (void)cli_dash_num(val[1], (uint32_t)vs.engine_rpm);
+        (void)cli_dash_fixed(val[2], vs.coolant_temp_c, 5U);
+        for (uint32_t i = CLI_DASH_MODEL_FIELDS; i < CLI_DASH_FIELD_COUNT; i++)
+            val[i][0] = '\0';
+        fields = CLI_DASH_MODEL_FIELDS;
+    }
+
+    /* Periodic full redraw repairs a terminal that was reconnected or
+     * scrolled the dashboard away. */
+    if (++s_dashSinceFull >= CLI_DASH_FULL_EVERY)
+        s_dashDirty = 1U;
+
+    /* Built as one record so a log line cannot land between the cursor
+     * save and restore sequences. */
+    char   buf[256];
+    size_t len;
+
+    if (s_dashDirty != 0U)
+    {
+        /* save cursor, home, dashboard, clear to EOL, restore cursor */
+        len = Fmt_Str(buf, "\x1b[s\x1b[H", 0U);
+        for (uint32_t i = 0U; i < fields; i++)
+        {
+            len += Fmt_Str(&buf[len], s_dashLabels[i], 0U);
+            len += Fmt_Str(&buf[len], val[i], 0U);
+        }
+        len += Fmt_Str(&buf[len], (fields == CLI_DASH_FIELD_COUNT) ? " ms" : " C", 0U);
+        len += Fmt_Str(&buf[len], "\x1b[K\x1b[u", 0U);
+    }
+    else
+    {
+        /* save cursor, then "row 1, column c" + value per changed field */
+        len = 0U;
+        for (uint32_t i = 0U; i < fields; i++)
+        {
+            if (strcmp(val[i], s_dashShown[i]) == 0)
+                continue;
+
+            if (len == 0U)
+            {
+                memcpy(buf, "\x1b[s", 3U);
+                len = 3U;
+            }
+            len += Fmt_Str(&buf[len], "\x1b[1;", 0U);
+            len += Fmt_Dec(&buf[len], s_dashFields[i].col, 0U);
+            len += Fmt_Str(&buf[len], "H", 0U);
+            len += Fmt_StrLeft(&buf[len], val[i], s_dashFields[i].width);
+        }
+
+        if (len == 0U)
+        {
+            PERF_END(CLI_DASH);
+            return;   /* nothing changed */
+        }
+
+        memcpy(&buf[len], "\x1b[u", 3U);
+        len += 3U;
+    }
+
+    if (Log_WriteRaw(buf, len) == HAL_OK)
+    {
+        memcpy(s_dashShown, val, sizeof(s_dashShown));
+        if (s_dashDirty != 0U)
+        {
+            s_dashDirty     = 0U;
+            s_dashSinceFull = 0U;
+        }
+    }
+    else
+    {
+        /* Dropped: the terminal state is unknown, redraw everything. */
+        s_dashDirty = 1U;
+    }
+
+    PERF_END(CLI_DASH);
+}
+
+/* --------------------------------------------------------------------------
+ * Command registry
+ * -------------------------------------------------------------------------- */
+
+/**
+ * @brief Binary search of the sorted command table.
+ *
+ * @return Matching entry or NULL.
+ */
+static const CliCommand_t *cli_find(const char *name)
+{
+    uint32_t lo = 0U;
+    uint32_t hi = s_cmdCount;
+
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2U;
+        int      cmp = strcmp(name, s_cmds[mid]->name);
+
+        if (cmp == 0)
+            return s_cmds[mid];
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1U;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Split @p line in place into space-separated words.
+ *
+ * @return Number of words, or -1 if there are more than CLI_MAX_ARGS.
+ */
+static int cli_tokenize(char *line, char *argv[])
+{
+    int   argc = 0;
+    char *p    = line;
+
+    for (;;)
+    {
+        while (*p == ' ')
+            p++;
+        if (*p == '\0')
+            break;
+
+        if (argc == (int)CLI_MAX_ARGS)
+            return -1;
+        argv[argc++] = p;
+
+        while ((*p != ' ') && (*p != '\0'))
+            p++;
+        if (*p == ' ')
+            *p++ = '\0';
+    }
+
+    return argc;
+}
+
+/**
+ * @brief Tokenize a complete line, look up the command and run it.
+ *
+ * Longer names are tried first ("can stats reset", then "can stats", then
+ * "can"), so groups and plain commands can share their first words.
+ */
+static void cli_dispatch(char *line)
+{
+    char *argv[CLI_MAX_ARGS];
+    int   argc = cli_tokenize(line, argv);
+
+    if (argc < 0)
+    {
+        CLI_IF_Printf("Too many arguments (max %u).\r\n", (unsigned)CLI_MAX_ARGS);
+    }
+    else if (argc > 0)
+    {
+        const CliCommand_t *cmd  = NULL;
+        int                 used = (argc < 3) ? argc : 3;
+
+        for (; used > 0; --used)
+        {
+            char key[CLI_NAME_MAX];
+            int  n = (used == 3) ? FMT_SNPRINTF(key, sizeof(key), "%s %s %s", argv[0], argv[1], argv[2])
+                   : (used == 2) ? FMT_SNPRINTF(key, sizeof(key), "%s %s", argv[0], argv[1])
+                   :               FMT_SNPRINTF(key, sizeof(key), "%s", argv[0]);
+
+            if ((n > 0) && ((size_t)n < sizeof(key)))
+                cmd = cli_find(key);
+            if (cmd != NULL)
+                break;
+        }
+
+        if (cmd == NULL)
+        {
+            CLI_IF_Print("Unknown command. Try 'help'.\r\n");
+        }
+        else if ((argc - used) < (int)cmd->minArgs)
+        {
+            CLI_IF_Printf("Usage: %s %s\r\n", cmd->name,
+                          (cmd->args != NULL) ? cmd->args : "");
+        }
+        else
+        {
+            cmd->handler(argc - used, &argv[used]);
+        }
+    }
+}
+
+/**
+ * @brief Run a typed line: the reply on its own lines, then the prompt.
+ */
+static void cli_execute(char *line)
+{
+    cli_uart_print("\r\n");
+    cli_dispatch(line);
+    cli_uart_print("> ");
+}
+
+/* --------------------------------------------------------------------------
+ * Built-in commands
+ * -------------------------------------------------------------------------- */
+
+static void cli_cmd_help(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CLI_IF_Print("Commands:\r\n");
+
+    for (uint32_t i = 0U; i < s_cmdCount; i++)
+    {
+        const CliCommand_t *cmd = s_cmds[i];
+        char usage[64];
+
+        if (cmd->help == NULL)
+            continue;   /* alias */
+
+        (void)FMT_SNPRINTF(usage, sizeof(usage), "%s %s", cmd->name,
+                           (cmd->args != NULL) ? cmd->args : "");
+        CLI_IF_Printf("  %-26s - %s\r\n", usage, cmd->help);
+    }
+}
+
+static void cli_cmd_veh_speed(int argc, char *argv[])
+{
+    (void)argc;
+
+    VehicleCmd_t cmd = { 0 };
+    cmd.type      = (uint8_t)VEHICLE_CMD_SET_SPEED;
+    cmd.speed_kph = (float)atof(argv[0]);  /* simple parser */
+
+    if (Vehicle_PostCommand(&cmd) != HAL_OK)
+    {
+        CLI_IF_Print("Vehicle busy, try again.\r\n");
+        return;
+    }
+    Audit_RecordF(AUDIT_CMD_VEH_SPEED, AUDIT_SRC_CLI, cmd.speed_kph, 0U);
+    LOG_INFO(CLI, "Set target speed to %.1f km/h", cmd.speed_kph);
+    CLI_IF_Print("OK: speed updated\r\n");
+}
+
+static void cli_cmd_veh_cool_hot(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    VehicleCmd_t cmd = { 0 };
+    cmd.type           = (uint8_t)VEHICLE_CMD_FORCE;
+    cmd.mask           = VEHICLE_FORCE_TEMP;
+    cmd.coolant_temp_c = 115.0f;
+
+    if (Vehicle_PostCommand(&cmd) != HAL_OK)
+    {
+        CLI_IF_Print("Vehicle busy, try again.\r\n");
+        return;
+    }
+    Audit_RecordF(AUDIT_CMD_VEH_COOL_HOT, AUDIT_SRC_CLI, cmd.coolant_temp_c, 0U);
+    LOG_WARN(CLI, "Injected coolant overheat");
+    CLI_IF_Print("Injected: coolant overheat\r\n");
+}
+
+static void cli_cmd_log_on(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CAN_IF_SetLogging(1U);
+    Audit_Record(AUDIT_CMD_LOG_ON, AUDIT_SRC_CLI, 0U, 0U);
+    LOG_INFO(CLI, "CAN RX logging enabled");
+    CLI_IF_Print("CAN RX logging: ON\r\n");
+}
+
+static void cli_cmd_log_off(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CAN_IF_SetLogging(0U);
+    Audit_Record(AUDIT_CMD_LOG_OFF, AUDIT_SRC_CLI, 0U, 0U);
+    LOG_INFO(CLI, "CAN RX logging disabled");
+    CLI_IF_Print("CAN RX logging: OFF\r\n");
+}
+
+static void cli_cmd_log_stats(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    Log_Stats_t st;
+
+    for (uint32_t i = 0U; i < (uint32_t)LOG_STREAM_COUNT; ++i)
+    {
+        Log_GetStreamStats((Log_Stream_t)i, &st);
+        CLI_IF_Printf("Log %-5s: %lu/%lu B queued, peak %lu B, dropped %lu, transport %s\r\n",
+                      Log_StreamName((Log_Stream_t)i),
+                      (unsigned long)st.fill,
+                      (unsigned long)st.ringSize,
+                      (unsigned long)st.peakFill,
+                      (unsigned long)st.droppedLines,
+                      Log_TransportName(Log_GetTransport((Log_Stream_t)i)));
+    }
+    CLI_IF_Printf("Mux %s; itm dropped %lu B, ram %lu B taken\r\n",
+                  (Log_GetMux() != 0U) ? "on" : "off",
+                  (unsigned long)st.itmDropped,
+                  (unsigned long)Log_RamWritten());
+
+    Log_LimitStats_t lim;
+    Log_GetLimitStats(&lim);
+    CLI_IF_Printf("Limits %s: %lu suppressed per site; shed W %lu, I %lu, D %lu; budget %lu B\r\n",
+                  (lim.on != 0U) ? "on" : "off", (unsigned long)lim.suppressed,
+                  (unsigned long)lim.shed[LOG_LEVEL_WARN], (unsigned long)lim.shed[LOG_LEVEL_INFO],
+                  (unsigned long)lim.shed[LOG_LEVEL_DEBUG], (unsigned long)lim.budget);
+}
+
+/**
+ * @brief "log limit [on|off]": the per-site rate limit and the budget (log.h).
+ */
+static void cli_cmd_log_limit(int argc, char *argv[])
+{
+    if (argc == 1)
+    {
+        if (strcmp(argv[0], "on") == 0)
+        {
+            Log_SetLimit(1U);
+        }
+        else if (strcmp(argv[0], "off") == 0)
+        {
+            Log_SetLimit(0U);
+        }
+        else
+        {
+            CLI_IF_Print("Usage: log limit [on|off]\r\n");
+            return;
+        }
+    }
+
+    Log_LimitStats_t lim;
+    Log_GetLimitStats(&lim);
+    CLI_IF_Printf("Log limits: %s (%u lines per site, 1 per %u ms; %u B/s)\r\n",
+                  (lim.on != 0U) ? "on" : "off", (unsigned)LOG_SITE_BURST,
+                  (unsigned)LOG_SITE_PERIOD_MS, (unsigned)LOG_BUDGET_BPS);
+}
+
+/** Usage of "log transport", with the transports this build has. */
+static void cli_log_transport_usage(void)
+{
+    CLI_IF_Print("Usage: log transport <lines|cli|tlm> <");
+    for (uint32_t i = 0U; i < (uint32_t)LOG_TRANSPORT_COUNT; ++i)
+        CLI_IF_Printf("%s%s", (i > 0U) ? "|" : "", Log_TransportName((Log_TransportId_t)i));
+    CLI_IF_Print(">\r\n");
+}
+
+/**
+ * @brief "log transport [lines|cli|tlm <name>]".
+ */
+static void cli_cmd_log_transport(int argc, char *argv[])
+{
+    if (argc == 2)
+    {
+        int32_t stream = Log_FindStream(argv[0]);
+        int32_t tp     = Log_FindTransport(argv[1]);
+        if ((stream < 0) || (tp < 0) ||
+            (Log_SetTransport((Log_Stream_t)stream, (Log_TransportId_t)tp) != HAL_OK))
+        {
+            cli_log_transport_usage();
+            return;
+        }
+    }
+    else if (argc != 0)
+    {
+        cli_log_transport_usage();
+        return;
+    }
+
+    CLI_IF_Printf("Log transport: lines %s, cli %s, tlm %s\r\n",
+                  Log_TransportName(Log_GetTransport(LOG_STREAM_LINES)),
+                  Log_TransportName(Log_GetTransport(LOG_STREAM_CLI)),
+                  Log_TransportName(Log_GetTransport(LOG_STREAM_TLM)));
+}
+
+/**
+ * @brief "log mux [on|off]": frame the UART output per channel (log.h).
+ *
+ * The reply to "on" already goes out framed, so a host tool switching it
+ * on can check it decodes without a second round trip.
+ */
+static void cli_cmd_log_mux(int argc, char *argv[])
+{
+    if (argc == 1)
+    {
+        if (strcmp(argv[0], "on") == 0)
+        {
+            Log_SetMux(1U);
+        }
+        else if (strcmp(argv[0], "off") == 0)
+        {
+            Log_SetMux(0U);
+        }
+        else
+        {
+            CLI_IF_Print("Usage: log mux [on|off]\r\n");
+            return;
+        }
+    }
+
+    CLI_IF_Printf("Log mux: %s\r\n", (Log_GetMux() != 0U) ? "on" : "off");
+}
+
+/**
+ * @brief "log ram": print the "ram" capture as it stood when called.
+ *
+ * The output goes through the log ring, so each chunk waits for room
+ * rather than dropping the rest.
+ */
+static void cli_cmd_log_ram(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t end = Log_RamWritten();
+    uint32_t pos = 0U;
+    char     buf[CLI_LOG_RAM_CHUNK + 1U];
+    uint32_t n;
+
+    CLI_IF_Printf("Log RAM capture, %lu B taken:\r\n", (unsigned long)end);
+    while ((n = Log_ReadRam(&pos, end, buf, CLI_LOG_RAM_CHUNK)) > 0U)
+    {
+        uint32_t start = HAL_GetTick();
+        for (;;)
+        {
+            Log_Stats_t st;
+            Log_GetStreamStats(LOG_STREAM_CLI, &st);
+            if (((st.ringSize - st.fill) >= (2U * CLI_LOG_RAM_CHUNK)) ||
+                ((HAL_GetTick() - start) >= CLI_LOG_RAM_TIMEOUT_MS))
+            {
+                break;
+            }
+            (void)osDelay(1U);
+        }
+
+        buf[n] = '\0';
+        CLI_IF_Print(buf);
+    }
+    CLI_IF_Print("\r\n");
+}
+
+/**
+ * @brief "log dump [n]": print the post-mortem ring, or its newest n lines.
+ *
+ * Each piece is copied out (the ring keeps moving) and handed to LogTask
+ * with Log_Send(), which returns once it is sent.
  */
+static void cli_cmd_log_dump(int argc, char *argv[])
+{
+    if (LOG_PM_SIZE == 0U)
+    {
+        CLI_IF_Print("Post-mortem log not built in (LOG_PM_SIZE)\r\n");
+        return;
+    }
 
-#include "cli_if.h"
-#include "can_if.h"
-#include "log.h"
+    uint32_t end = Log_PmWritten();
+    uint32_t pos = end - LOG_PM_SIZE;
+    char     buf[CLI_LOG_DUMP_CHUNK];
+    uint32_t n;
 
-#include <string.h>
-#include <stdio.h>
-#include <stdlib.h>   /* atof */
+    if (argc >= 1)
+    {
+        char         *stop;
+        unsigned long lines = strtoul(argv[0], &stop, 10);
 
-/* --------------------------------------------------------------------------
- * Local state
- * -------------------------------------------------------------------------- */
+        if ((*stop != '\0') || (lines == 0UL))
+        {
+            CLI_IF_Print("Usage: log dump [lines]\r\n");
+            return;
+        }
+        pos = Log_PmLineStart((uint32_t)lines);
+    }
 
-/** UART used for CLI interaction. */
-static UART_HandleTypeDef *s_cliUart = NULL;
+    CLI_IF_Printf("Post-mortem log, %lu B written (%lu B before this boot):\r\n",
+                  (unsigned long)end, (unsigned long)Log_PmBoot());
+    while ((n = Log_ReadPm(&pos, end, buf, sizeof(buf))) > 0U)
+    {
+        if (Log_Send(LOG_STREAM_CLI, buf, n, CLI_LOG_DUMP_TIMEOUT_MS) != HAL_OK)
+            break;
+    }
+    CLI_IF_Print("\r\n");
+}
 
-/** Vehicle state used by the live dashboard and commands. */
-static VehicleState_t *s_vehicle = NULL;
+static void cli_cmd_mem(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
 
-/** Single-byte RX buffer used by HAL UART interrupt. */
-static uint8_t s_rxByte = 0U;
+    for (uint32_t cls = 0U; cls < MEM_POOL_CLASS_COUNT; ++cls)
+    {
+        MemPool_Stats_t st;
+        if (MemPool_GetStats(cls, &st) != HAL_OK)
+            break;
 
-/** Ring buffer for RX bytes from ISR to task. */
-#define CLI_RX_BUF_SIZE 64U
-static uint8_t s_cliBuf[CLI_RX_BUF_SIZE];
-static volatile uint8_t s_cliHead = 0U;
-static volatile uint8_t s_cliTail = 0U;
+        CLI_IF_Printf("Pool %3lu B: %lu/%lu in use, peak %lu, allocs %lu, failed %lu\r\n",
+                      (unsigned long)st.blockSize,
+                      (unsigned long)st.inUse,
+                      (unsigned long)st.blocks,
+                      (unsigned long)st.peak,
+                      (unsigned long)st.allocs,
+                      (unsigned long)st.failures);
+    }
+}
 
-/* --------------------------------------------------------------------------
- * Local helpers
- * -------------------------------------------------------------------------- */
+/**
+ * @brief Parse a log level name ("error".."debug") or digit ("0".."3").
+ *
+ * @return Level, or -1 if not recognised.
+ */
+static int32_t cli_parse_level(const char *s)
+{
+    static const char *const names[] = { "error", "warn", "info", "debug" };
 
-static void cli_uart_print(const char *s)
+    for (uint32_t i = 0U; i < (sizeof(names) / sizeof(names[0])); ++i)
+    {
+        if (strcmp(s, names[i]) == 0)
+            return (int32_t)i;
+    }
+
+    if ((s[0] >= '0') && (s[0] <= '3') && (s[1] == '\0'))
+        return (int32_t)(s[0] - '0');
+
+    return -1;
+}
+
+/**
+ * @brief "log level [<mod>|all <lvl>]".
+ */
+static void cli_cmd_log_level(int argc, char *argv[])
 {
-    if ((s == NULL) || (s_cliUart == NULL))
+    static const char lvlChar[] = { 'E', 'W', 'I', 'D' };
+
+    if (argc == 0)
+    {
+        /* List all modules: "MAIN=I CAN=I ..." */
+        char   buf[96];
+        size_t n = (size_t)FMT_SNPRINTF(buf, sizeof(buf), "Log levels:");
+        for (uint32_t i = 0U; (i < (uint32_t)LOG_MOD_COUNT) && (n < sizeof(buf)); ++i)
+        {
+            log_level_t lvl = Log_GetModuleLevel((log_module_t)i);
+            n += (size_t)FMT_SNPRINTF(&buf[n], sizeof(buf) - n, " %s=%c",
+                                      Log_ModuleName((log_module_t)i),
+                                      lvlChar[(uint32_t)lvl & 3U]);
+        }
+        CLI_IF_Print(buf);
+        CLI_IF_Print("\r\n");
+        return;
+    }
+
+    if (argc != 2)
+    {
+        CLI_IF_Print("Usage: log level <mod|all> <error|warn|info|debug>\r\n");
         return;
+    }
 
-    size_t len = strlen(s);
-    if (len == 0U)
+    int32_t lvl = cli_parse_level(argv[1]);
+    if (lvl < 0)
+    {
+        CLI_IF_Print("Unknown level. Use error, warn, info or debug.\r\n");
         return;
+    }
+
+    int32_t mod = 0xFF;
+
+    if (strcmp(argv[0], "all") == 0)
+    {
+        Log_SetLevel((log_level_t)lvl);
+    }
+    else
+    {
+        mod = Log_FindModule(argv[0]);
+        if (mod < 0)
+        {
+            CLI_IF_Print("Unknown module. Try 'log level'.\r\n");
+            return;
+        }
+        Log_SetModuleLevel((log_module_t)mod, (log_level_t)lvl);
+    }
+    Audit_Record(AUDIT_CMD_LOG_LEVEL, AUDIT_SRC_CLI, (uint32_t)mod, (uint32_t)lvl);
+
+    CLI_IF_Printf("Log level %s = %s\r\n", argv[0], argv[1]);
+}
+
+static void cli_cmd_dash(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
 
-    (void)HAL_UART_Transmit(s_cliUart, (uint8_t *)s,
-                            (uint16_t)len, HAL_MAX_DELAY);
+    s_dashDirty = 1U;
+    cli_update_dashboard();
 }
 
 /**
- * @brief Push a character into the ring buffer (ISR context).
+ * @brief One line on the state of the dashboard.
  */
-static void cli_push(uint8_t c)
+static void cli_dash_show(void)
 {
-    uint8_t next = (uint8_t)((s_cliHead + 1U) % CLI_RX_BUF_SIZE);
+    if ((s_dashOn == 0U) || (s_dashPeriodMs == 0U))
+        CLI_IF_Print("Dashboard: off");
+    else if (s_dashPaused != 0U)
+        CLI_IF_Print("Dashboard: paused (no input)");
+    else
+        CLI_IF_Printf("Dashboard: every %lu ms (now %lu ms, backlog %lu%%)",
+                      (unsigned long)s_dashPeriodMs, (unsigned long)s_dashEffMs,
+                      (unsigned long)cli_dash_backlog());
 
-    if (next != s_cliTail)
-    {
-        s_cliBuf[s_cliHead] = c;
-        s_cliHead = next;
-    }
-    /* else: buffer full, drop byte */
+    if (s_dashIdleMs != 0U)
+        CLI_IF_Printf(", pauses after %lu s idle", (unsigned long)(s_dashIdleMs / 1000U));
+    else
+        CLI_IF_Print(", never pauses");
+    CLI_IF_Printf("; %lu pauses, %lu refreshes stretched\r\n",
+                  (unsigned long)s_dashPauses, (unsigned long)s_dashStretched);
 }
 
 /**
- * @brief Pop a character from the ring buffer (task context).
- *
- * @return 1 if a character is available, 0 if buffer is empty.
+ * @brief Wake CliTask so a new period or state takes effect at once.
  */
-static int cli_pop(uint8_t *c)
+static void cli_dash_kick(void)
+{
+    s_dashDirty = 1U;
+    if (s_cliThread != NULL)
+        (void)osThreadFlagsSet(s_cliThread, CLI_RX_FLAG);
+}
+
+static void cli_cmd_dash_rate(int argc, char *argv[])
+{
+    if (argc == 0)
+    {
+        cli_dash_show();
+        return;
+    }
+
+    char *end;
+    unsigned long ms = strtoul(argv[0], &end, 10);
+    if ((*end != '\0') || ((ms != 0U) && (ms < CLI_DASH_MIN_PERIOD_MS)))
+    {
+        CLI_IF_Printf("Rate must be 0 (off) or >= %u ms\r\n",
+                      (unsigned)CLI_DASH_MIN_PERIOD_MS);
+        return;
+    }
+
+    if (ms == 0U)
+    {
+        s_dashOn = 0U;
+    }
+    else
+    {
+        s_dashPeriodMs = (uint32_t)ms;
+        s_dashEffMs    = (uint32_t)ms;
+        s_dashOn       = 1U;
+    }
+    cli_dash_kick();
+    cli_dash_show();
+}
+
+static void cli_cmd_dash_on(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if (s_dashPeriodMs == 0U)
+    {
+        CLI_IF_Print("No refresh period, use 'dash rate <ms>'\r\n");
+        return;
+    }
+    s_dashOn = 1U;
+    cli_dash_kick();
+    cli_dash_show();
+}
+
+static void cli_cmd_dash_off(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    s_dashOn = 0U;
+    cli_dash_show();
+}
+
+static void cli_cmd_dash_idle(int argc, char *argv[])
+{
+    (void)argc;
+
+    char *end;
+    unsigned long sec = strtoul(argv[0], &end, 10);
+    if ((*end != '\0') || (sec > 86400U))
+    {
+        CLI_IF_Print("Idle time must be 0 (never) .. 86400 s\r\n");
+        return;
+    }
+
+    s_dashIdleMs = (uint32_t)sec * 1000U;
+    cli_dash_kick();
+    cli_dash_show();
+}
+
+static void cli_cmd_dash_src(int argc, char *argv[])
 {
-    if (s_cliHead == s_cliTail)
-        return 0;
+    if (argc > 0)
+    {
+        if (strcmp(argv[0], "can") == 0)
+            s_dashFromCan = 1U;
+        else if (strcmp(argv[0], "model") == 0)
+            s_dashFromCan = 0U;
+        else
+        {
+            CLI_IF_Print("Usage: dash src [model|can]\r\n");
+            return;
+        }
+
+        CanSigCache_Stats_t st;
+        CanSigCache_GetStats(&st);
+        s_dashRxTick   = HAL_GetTick();
+        s_dashRxFrames = st.frames;
+        s_dashRxRate   = 0U;
+
+        s_dashDirty = 1U;
+    }
 
-    *c = s_cliBuf[s_cliTail];
-    s_cliTail = (uint8_t)((s_cliTail + 1U) % CLI_RX_BUF_SIZE);
-    return 1;
+    CLI_IF_Printf("Dashboard source: %s\r\n",
+                  (s_dashFromCan != 0U) ? "can (decoded CAN RX)" : "model (vehicle state)");
 }
 
 /**
- * @brief Update the live dashboard line with current values.
+ * @brief Switch between the line and the pipeline page.
  *
- * Uses ANSI escape codes to:
- *   - Save the current cursor position
- *   - Move to the top-left of the screen (row 1, col 1)
- *   - Overwrite the dashboard line
- *   - Restore the cursor position so typing isn't disturbed
+ * The page keeps rows 1..CLI_DASH_PERF_ROWS for itself with a scroll
+ * region below them; going back to the line gives the rows back.
  */
-static void cli_update_dashboard(void)
+static void cli_dash_page(uint8_t perf)
 {
-    if ((s_cliUart == NULL) || (s_vehicle == NULL))
-        return;
+    if (perf != s_dashPerf)
+    {
+        if (perf != 0U)
+            cli_uart_print("\x1b[2J\x1b[5r\x1b[5;1H");
+        else
+            cli_uart_print("\x1b[r\x1b[2J\x1b[2;1H");
+        s_dashPerf = perf;
+    }
+    cli_dash_kick();
+}
+
+static void cli_cmd_dash_perf(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    cli_dash_page(1U);
+    cli_update_dashboard();
+}
 
-    char buf[128];
-    (void)snprintf(buf, sizeof(buf),
-                   "SPD: %6.1f km/h | RPM: %5u | TEMP: %5.1f C   ",
-                   s_vehicle->speed_kph,
-                   (unsigned)s_vehicle->engine_rpm,
-                   s_vehicle->coolant_temp_c);
+static void cli_cmd_dash_line(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
 
-    /* Save cursor position */
-    cli_uart_print("\x1b[s");
-    /* Go to top-left (row 1, col 1) */
-    cli_uart_print("\x1b[H");
-    /* Print dashboard and clear to end of line */
-    cli_uart_print(buf);
-    cli_uart_print("\x1b[K");
-    /* Restore cursor position */
-    cli_uart_print("\x1b[u");
+    cli_dash_page(0U);
+    cli_update_dashboard();
 }
 
+static const CliCommand_t s_builtinCmds[] =
+{
+    { "help",         "",                  0U, cli_cmd_help,         "show this help" },
+    { "h",            "",                  0U, cli_cmd_help,         NULL },
+    { "veh speed",    "<kph>",             1U, cli_cmd_veh_speed,    "set target speed" },
+    { "veh cool-hot", "",                  0U, cli_cmd_veh_cool_hot, "inject coolant overheat" },
+    { "log on",       "",                  0U, cli_cmd_log_on,       "enable CAN RX logging" },
+    { "log off",      "",                  0U, cli_cmd_log_off,      "disable CAN RX logging" },
+    { "log stats",    "",                  0U, cli_cmd_log_stats,    "show log buffer statistics" },
+    { "log level",    "[<mod|all> <lvl>]", 0U, cli_cmd_log_level,    "show or set module log levels" },
+    { "log transport", "[<lines|cli|tlm> <tp>]", 0U, cli_cmd_log_transport, "show or set the log transports" },
+    { "log mux",      "[on|off]",          0U, cli_cmd_log_mux,      "frame the UART output per channel" },
+    { "log limit",    "[on|off]",          0U, cli_cmd_log_limit,    "rate limit log storms" },
+    { "log ram",      "",                  0U, cli_cmd_log_ram,      "print the RAM log capture" },
+    { "log dump",     "[n]",               0U, cli_cmd_log_dump,     "print the post-mortem log (newest n lines)" },
+    { "mem",          "",                  0U, cli_cmd_mem,          "show message pool usage" },
+    { "dash",         "",                  0U, cli_cmd_dash,         "redraw the dashboard" },
+    { "dash rate",    "[<ms>]",            0U, cli_cmd_dash_rate,    "show or set the dashboard refresh period (0 = off)" },
+    { "dash on",      "",                  0U, cli_cmd_dash_on,      "turn the dashboard on" },
+    { "dash off",     "",                  0U, cli_cmd_dash_off,     "turn the dashboard off" },
+    { "dash idle",    "<s>",               1U, cli_cmd_dash_idle,    "pause the dashboard after s without input (0 = never)" },
+    { "dash src",     "[model|can]",       0U, cli_cmd_dash_src,     "dashboard from the model or CAN RX" },
+    { "dash perf",    "",                  0U, cli_cmd_dash_perf,    "pipeline page: queues, drops, rates, p99, CPU" },
+    { "dash line",    "",                  0U, cli_cmd_dash_line,    "back to the one-line dashboard" },
+};
 
 /**
  * @brief Handle a single character (line assembly + command parsing).
  */
 static void cli_handle_char(uint8_t c)
 {
-    static char   line[32];
-    static uint8_t idx = 0U;
+    static char    line[CLI_LINE_MAX];
+    static uint32_t idx = 0U;
+
+    /* An RPC frame is no typing and does not wake the dashboard. */
+    if (CliRpc_RxByte(c) != 0U)
+        return;
+
+    /* Someone is typing: before the command, which may show the state. */
+    cli_dash_input();
+
+    /* A script upload takes the bytes as they are, without echo. */
+    if (CliScript_RxByte(c) != 0U)
+        return;
 
     /* Handle end-of-line (CR or LF). */
     if ((c == '\r') || (c == '\n'))
@@ -143,69 +1694,8 @@ static void cli_handle_char(uint8_t c)
         line[idx] = '\0';
         idx = 0U;
 
-        LOG_DEBUG("CLI", "Command: '%s'", line);
-
-        /* ---------------- Commands ---------------- */
-
-        if ((strcmp(line, "h") == 0) || (strcmp(line, "help") == 0))
-        {
-            cli_uart_print(
-                "\r\nCommands:\r\n"
-                "  help          - show this help\r\n"
-                "  veh speed X   - set target speed to X km/h\r\n"
-                "  veh cool-hot  - inject coolant overheat\r\n"
-                "  log on        - enable CAN RX logging\r\n"
-                "  log off       - disable CAN RX logging\r\n> "
-            );
-        }
-        else if (strncmp(line, "veh speed ", 10) == 0)
-        {
-            float v = (float)atof(&line[10]);  /* simple parser */
-
-            if (s_vehicle != NULL)
-            {
-                Vehicle_SetTargetSpeed(s_vehicle, v);
-                LOG_INFO("CLI", "Set target speed to %.1f km/h", v);
-                cli_uart_print("\r\nOK: speed updated\r\n> ");
-            }
-            else
-            {
-                cli_uart_print("\r\nNo vehicle bound to CLI.\r\n> ");
-            }
-        }
-        else if (strcmp(line, "veh cool-hot") == 0)
-        {
-            if (s_vehicle != NULL)
-            {
-                Vehicle_Force(s_vehicle,
-                              s_vehicle->speed_kph,
-                              s_vehicle->engine_rpm,
-                              115.0f);
-                LOG_WARN("CLI", "Injected coolant overheat");
-                cli_uart_print("\r\nInjected: coolant overheat\r\n> ");
-            }
-            else
-            {
-                cli_uart_print("\r\nNo vehicle bound to CLI.\r\n> ");
-            }
-        }
-        else if (strcmp(line, "log on") == 0)
-        {
-            CAN_IF_SetLogging(1U);
-            LOG_INFO("CLI", "CAN RX logging enabled");
-            cli_uart_print("\r\nCAN RX logging: ON\r\n> ");
-        }
-        else if (strcmp(line, "log off") == 0)
-        {
-            CAN_IF_SetLogging(0U);
-            LOG_INFO("CLI", "CAN RX logging disabled");
-            cli_uart_print("\r\nCAN RX logging: OFF\r\n> ");
-        }
-        else
-        {
-            cli_uart_print("\r\nUnknown command. Try 'help'.\r\n> ");
-        }
-
+        LOG_DEBUG(CLI, "Command: '%s'", line);
+        cli_execute(line);
         return;
     }
 
@@ -216,7 +1706,7 @@ static void cli_handle_char(uint8_t c)
 
         if (s_cliUart != NULL)
         {
-            (void)HAL_UART_Transmit(s_cliUart, &c, 1U, HAL_MAX_DELAY);
+            (void)Log_WriteRaw((const char *)&c, 1U);
         }
     }
     /* else: line full, extra chars are ignored */
@@ -226,50 +1716,222 @@ static void cli_handle_char(uint8_t c)
  * Public API
  * -------------------------------------------------------------------------- */
 
-void CLI_IF_Init(UART_HandleTypeDef *huart, VehicleState_t *vehicle)
+HAL_StatusTypeDef CLI_IF_Register(const CliCommand_t *cmds, uint32_t count)
+{
+    if (cmds == NULL)
+        return HAL_ERROR;
+
+    for (uint32_t i = 0U; i < count; i++)
+    {
+        const CliCommand_t *cmd = &cmds[i];
+
+        if ((cmd->name == NULL) || (cmd->handler == NULL) ||
+            (strlen(cmd->name) >= CLI_NAME_MAX))
+        {
+            LOG_ERROR(CLI, "Invalid command entry %lu", (unsigned long)i);
+            return HAL_ERROR;
+        }
+        if (cli_find(cmd->name) != NULL)
+        {
+            LOG_ERROR(CLI, "Duplicate command '%s'", cmd->name);
+            return HAL_ERROR;
+        }
+        if (s_cmdCount >= CLI_MAX_COMMANDS)
+        {
+            LOG_ERROR(CLI, "Command table full, '%s' dropped", cmd->name);
+            return HAL_ERROR;
+        }
+
+        /* Insertion keeps the table sorted. */
+        uint32_t pos = s_cmdCount;
+        while ((pos > 0U) && (strcmp(s_cmds[pos - 1U]->name, cmd->name) > 0))
+        {
+            s_cmds[pos] = s_cmds[pos - 1U];
+            pos--;
+        }
+        s_cmds[pos] = cmd;
+        s_cmdCount++;
+    }
+
+    return HAL_OK;
+}
+
+void CLI_IF_Execute(char *line)
+{
+    if (line != NULL)
+        cli_dispatch(line);
+}
+
+uint32_t CLI_IF_ExecuteCapture(char *line, char *out, uint32_t size, uint32_t *cut)
+{
+    if ((line == NULL) || (out == NULL))
+        return 0U;
+
+    s_cliCapBuf  = out;
+    s_cliCapSize = size;
+    s_cliCapLen  = 0U;
+    s_cliCapCut  = 0U;
+    cli_dispatch(line);
+    s_cliCapBuf  = NULL;
+
+    if (cut != NULL)
+        *cut = s_cliCapCut;
+    return s_cliCapLen;
+}
+
+void CLI_IF_Print(const char *s)
+{
+    cli_uart_print(s);
+}
+
+void CLI_IF_Printf(const char *fmt, ...)
+{
+    char    buf[CLI_PRINTF_MAX];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = FMT_VSNPRINTF(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    if (n > 0)
+        cli_uart_print(buf);
+}
+
+void CLI_IF_Init(UART_HandleTypeDef *huart)
 {
     s_cliUart = huart;
-    s_vehicle = vehicle;
-    s_cliHead = 0U;
-    s_cliTail = 0U;
+
+    CLI_IF_REGISTER_TABLE(s_builtinCmds);
+    CliScript_Init();
+    CliRpc_Init();
+
+#if CLI_RTT_POLL_MS > 0
+    Rtt_Init();
+#endif
 
     if (s_cliUart != NULL)
     {
-        /* Start RX interrupt */
-        (void)HAL_UART_Receive_IT(s_cliUart, &s_rxByte, 1U);
+        /* Start circular DMA reception */
+        cli_rx_start();
 
         /* Clear screen and home the cursor */
         cli_uart_print("\x1b[2J\x1b[H");
 
         /* Draw initial dashboard on top line */
+        s_dashDirty = 1U;
         cli_update_dashboard();
 
         /* Print greeting + prompt on next line */
         cli_uart_print("\r\nCLI ready. Type 'help' and press Enter.\r\n> ");
 
-        LOG_INFO("CLI", "CLI initialized");
+        LOG_INFO(CLI, "CLI initialized");
     }
 }
 
 
 void CLI_IF_Task(void)
 {
-    uint8_t c;
+    static uint32_t lastDash = 0U;
+
+    if (s_cliThread == NULL)
+    {
+        s_cliThread     = osThreadGetId();
+        lastDash        = osKernelGetTickCount();
+        s_dashInputTick = lastDash;
+    }
+
+    /* Sleep until input arrives or the next dashboard refresh is due. */
+    uint32_t period  = cli_dash_period(osKernelGetTickCount());
+    uint32_t elapsed = osKernelGetTickCount() - lastDash;
+    uint32_t timeout;
+    if (period == 0U)
+        timeout = osWaitForever;
+    else
+        timeout = (elapsed < period) ? (period - elapsed) : 0U;
+
+    /* Wake when the idle time runs out, to pause. */
+    if ((period != 0U) && (s_dashIdleMs != 0U))
+    {
+        uint32_t idle = osKernelGetTickCount() - s_dashInputTick;
+        uint32_t left = (idle < s_dashIdleMs) ? (s_dashIdleMs - idle) : 0U;
+        if (left < timeout)
+            timeout = left;
+    }
+
+    /* Or the next step of a running script. */
+    uint32_t script = CliScript_Run(osKernelGetTickCount());
+    if (script < timeout)
+        timeout = script;
+
+#if CLI_RTT_POLL_MS > 0
+    if (timeout > CLI_RTT_POLL_MS)
+        timeout = CLI_RTT_POLL_MS;
+#endif
+
+    if (timeout > 0U)
+    {
+        (void)osThreadFlagsWait(CLI_RX_FLAG, osFlagsWaitAny, timeout);
+    }
+    IRQ_BENCH_END(UART);
+
+    if ((s_cliResume != 0U) && (s_cliUart != NULL))
+    {
+        s_cliResume = 0U;
+        cli_rx_check();
+    }
+
+    /* Drain everything the DMA has written since the last pass. */
+    if (s_cliUart != NULL)
+    {
+        uint32_t wr = cli_rx_write_pos();
+        if (wr < s_cliRxRead)
+        {
+            PlatformDma_Invalidate(&s_cliRxDma[s_cliRxRead], CLI_RX_DMA_SIZE - s_cliRxRead);
+            PlatformDma_Invalidate(s_cliRxDma, wr);
+        }
+        else
+        {
+            PlatformDma_Invalidate(&s_cliRxDma[s_cliRxRead], wr - s_cliRxRead);
+        }
+        while (s_cliRxRead != wr)
+        {
+            cli_handle_char(s_cliRxDma[s_cliRxRead]);
+            s_cliRxRead = (s_cliRxRead + 1U) % CLI_RX_DMA_SIZE;
+        }
+    }
+
+#if USB_CDC_ENABLE
+    /* Then the USB CDC port. */
+    uint8_t  usb[32];
+    uint32_t got;
+    while ((got = UsbCdc_Read(usb, sizeof(usb))) > 0U)
+    {
+        for (uint32_t i = 0U; i < got; ++i)
+            cli_handle_char(usb[i]);
+    }
+#endif
 
-    /* Drain RX bytes and feed parser. */
-    while (cli_pop(&c))
+#if CLI_RTT_POLL_MS > 0
+    /* Then what the probe has written to the RTT down buffer. */
+    uint8_t  rtt[16];
+    uint32_t n;
+    while ((n = Rtt_Read(rtt, sizeof(rtt))) > 0U)
     {
-        cli_handle_char(c);
+        for (uint32_t i = 0U; i < n; ++i)
+            cli_handle_char(rtt[i]);
     }
+#endif
+
+    /* A paused dashboard is redrawn on the first keypress. */
+    uint32_t now = osKernelGetTickCount();
 
-    /* Periodic dashboard refresh.
-     * Assumes this function is called every ~10 ms from CliTask.
-     */
-    static uint32_t dashCounter = 0U;
-    dashCounter++;
-    if (dashCounter >= 50U)  /* ~500 ms at 10 ms tick */
+    period = cli_dash_period(now);
+    if ((period != 0U) && ((s_dashResumed != 0U) || ((now - lastDash) >= period)))
     {
-        dashCounter = 0U;
+        s_dashResumed = 0U;
+        if (period > s_dashPeriodMs)
+            s_dashStretched++;
+        lastDash = now;
         cli_update_dashboard();
     }
 }
@@ -279,16 +1941,67 @@ void CLI_IF_Task(void)
  * -------------------------------------------------------------------------- */
 
 /**
- * @brief UART RX complete callback override for CLI UART.
+ * @brief UART "receive to idle" event callback override for CLI UART.
+ *
+ * Called by HAL on IDLE line and on DMA transfer complete (buffer wrap).
+ * @p Size is the DMA write index; the task reads it from the DMA counter
+ * itself, so this only wakes CliTask.
+ */
+RAMFUNC void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+    (void)Size;
+
+    if ((huart == s_cliUart) && (s_cliThread != NULL))
+    {
+        (void)osThreadFlagsSet(s_cliThread, CLI_RX_FLAG);
+    }
+}
+
+void CLI_IF_Resume(void)
+{
+    s_cliResume = 1U;
+    if (s_cliThread != NULL)
+        (void)osThreadFlagsSet(s_cliThread, CLI_RX_FLAG);
+}
+
+/**
+ * @brief UART error callback override for CLI UART.
  *
- * Called by HAL when a byte is received. We push the byte into the
- * ring buffer and re-arm the next RX interrupt.
+ * An overrun/noise/framing error aborts the HAL reception; restart the
+ * circular DMA so the CLI keeps listening. Unread bytes are discarded.
  */
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
 {
     if (huart == s_cliUart)
     {
-        cli_push(s_rxByte);
-        (void)HAL_UART_Receive_IT(s_cliUart, &s_rxByte, 1U);
+        if (huart->RxState == HAL_UART_STATE_READY)
+        {
+            s_cliRxOverruns++;
+            cli_rx_start();
+        }
+    }
+}
+
+#if USB_CDC_ENABLE
+/**
+ * @brief USB CDC bytes arrived: wake CliTask.
+ */
+void UsbCdc_RxCallback(void)
+{
+    if (s_cliThread != NULL)
+    {
+        (void)osThreadFlagsSet(s_cliThread, CLI_RX_FLAG);
     }
 }
+
+/**
+ * @brief The host opened or closed the USB port: move the CLI output there
+ *        and back to LOG_CLI_TRANSPORT.
+ */
+void UsbCdc_LineStateCallback(uint8_t open)
+{
+    (void)Log_SetTransport(LOG_STREAM_CLI, (open != 0U) ? LOG_TRANSPORT_USB : LOG_CLI_TRANSPORT);
+    if (open != 0U)
+        (void)Log_WriteRaw("\r\n> ", 4U);
+}
+#endif /* USB_CDC_ENABLE */
@@ -0,0 +1,583 @@
+/**
+ * @file    cli_rpc.c
+ * @brief   Binary RPC frames on the CLI console: framing, handlers, "rpc".
+ */
+
+#include "cli_rpc.h"
+#include "cli_if.h"
+#include "cal.h"
+#include "can_stats.h"
+#include "crc.h"
+#include "log.h"
+#include "stage.h"
+#include "vehicle_shared.h"
+#include "cmsis_os2.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/** Request header: type, seq, cmd; response header: type, seq, cmd, status. */
+#define RPC_REQ_HDR         3U
+#define RPC_RESP_HDR        4U
+
+/** Response before COBS: header, EXEC output in TLVs of 255 bytes, the
+ *  bytes cut, CRC. */
+#define RPC_RESP_MAX        (RPC_RESP_HDR + CLI_RPC_OUT_MAX + (2U * ((CLI_RPC_OUT_MAX + 254U) / 255U)) + \
+                             6U + 2U)
+
+/** On the wire: one COBS code byte per 254 and the two delimiters. */
+#define RPC_WIRE_LEN(n)     ((n) + ((n) / 254U) + 1U + 2U)
+
+/** Request arguments: the decoded TLVs. */
+typedef struct
+{
+    const uint8_t *tlv;
+    uint32_t       len;
+} RpcArgs_t;
+
+/** Response under construction. */
+typedef struct
+{
+    uint8_t  *buf;
+    uint32_t  len;
+    uint32_t  size;
+} RpcOut_t;
+
+typedef uint8_t (*RpcHandler_t)(const RpcArgs_t *in, RpcOut_t *out);
+
+typedef struct
+{
+    uint8_t      id;
+    const char  *name;
+    RpcHandler_t fn;
+} RpcCmd_t;
+
+#define RPC_PROTO_(name, id, fn)   static uint8_t rpc_##fn(const RpcArgs_t *in, RpcOut_t *out);
+CLI_RPC_TABLE(RPC_PROTO_)
+
+#define RPC_ENTRY_(name, id, fn)   { (id), #name, rpc_##fn },
+
+static const RpcCmd_t s_rpcCmds[] = { CLI_RPC_TABLE(RPC_ENTRY_) };
+
+#define RPC_CMD_COUNT   ((uint32_t)(sizeof(s_rpcCmds) / sizeof(s_rpcCmds[0])))
+
+/* Per parameter: its record key and whether it is a float. */
+#define RPC_CAL_KEY_(name, key, type, def, min, max, help)    (key),
+#define RPC_CAL_F_F     1U
+#define RPC_CAL_F_U     0U
+#define RPC_CAL_F_(name, key, type, def, min, max, help)      RPC_CAL_F_##type,
+
+static const uint16_t s_rpcCalKey[CAL_COUNT]   = { CAL_TABLE(RPC_CAL_KEY_) };
+static const uint8_t  s_rpcCalFloat[CAL_COUNT] = { CAL_TABLE(RPC_CAL_F_) };
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Request being received, still COBS-encoded; decoded in place. */
+static uint8_t  s_rpcRx[RPC_WIRE_LEN(CLI_RPC_REQ_MAX)];
+static uint32_t s_rpcRxLen  = 0U;
+static uint8_t  s_rpcRxIn   = 0U;         /* between the opening and closing zero */
+static uint8_t  s_rpcRxOver = 0U;         /* longer than s_rpcRx */
+static uint32_t s_rpcRxTick = 0U;
+
+static char     s_rpcText[CLI_RPC_OUT_MAX];   /* EXEC output */
+static uint8_t  s_rpcResp[RPC_RESP_MAX];
+static uint8_t  s_rpcWire[RPC_WIRE_LEN(RPC_RESP_MAX)];
+
+/* Counters for "rpc". */
+static uint32_t s_rpcServed   = 0U;
+static uint32_t s_rpcBadCrc   = 0U;
+static uint32_t s_rpcBadFrame = 0U;       /* COBS, size or type */
+static uint32_t s_rpcTimeouts = 0U;
+static uint32_t s_rpcTxDrops  = 0U;
+static uint32_t s_rpcLastUs   = 0U;
+static uint32_t s_rpcMaxUs    = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief COBS-decode @p len bytes in place.
+ *
+ * @return Decoded length, or 0 if the encoding is broken.
+ */
+static uint32_t rpc_cobs_decode(uint8_t *buf, uint32_t len)
+{
+    uint32_t in  = 0U;
+    uint32_t out = 0U;
+
+    while (in < len)
+    {
+        uint32_t code = buf[in++];
+
+        if ((code == 0U) || ((in + code - 1U) > len))
+            return 0U;
+        for (uint32_t i = 1U; i < code; ++i)
+            buf[out++] = buf[in++];
+        if ((code != 0xFFU) && (in < len))
+            buf[out++] = 0U;
+    }
+    return out;
+}
+
+/** Value of tag @p tag in the request, or NULL; its length in @p len. */
+static const uint8_t *rpc_arg(const RpcArgs_t *in, uint8_t tag, uint32_t *len)
+{
+    uint32_t pos = 0U;
+
+    while ((pos + 2U) <= in->len)
+    {
+        uint32_t n = in->tlv[pos + 1U];
+
+        if ((pos + 2U + n) > in->len)
+            break;
+        if (in->tlv[pos] == tag)
+        {
+            *len = n;
+            return &in->tlv[pos + 2U];
+        }
+        pos += 2U + n;
+    }
+    return NULL;
+}
+
+/** Little-endian number of @p bytes bytes in tag @p tag. @return 0 if absent. */
+static uint8_t rpc_arg_num(const RpcArgs_t *in, uint8_t tag, uint32_t bytes, uint32_t *v)
+{
+    uint32_t       len;
+    const uint8_t *p = rpc_arg(in, tag, &len);
+
+    if ((p == NULL) || (len != bytes))
+        return 0U;
+
+    *v = 0U;
+    for (uint32_t i = 0U; i < bytes; ++i)
+        *v |= (uint32_t)p[i] << (8U * i);
+    return 1U;
+}
+
+static uint8_t rpc_arg_f32(const RpcArgs_t *in, uint8_t tag, float *f)
+{
+    uint32_t u;
+
+    if (rpc_arg_num(in, tag, 4U, &u) == 0U)
+        return 0U;
+    memcpy(f, &u, sizeof(*f));
+    return 1U;
+}
+
+/** Text of tag @p tag, terminated, into @p dst. @return 0 if absent or too long. */
+static uint8_t rpc_arg_text(const RpcArgs_t *in, uint8_t tag, char *dst, uint32_t size)
+{
+    uint32_t       len;
+    const uint8_t *p = rpc_arg(in, tag, &len);
+
+    if ((p == NULL) || (len == 0U) || (len >= size))
+        return 0U;
+    memcpy(dst, p, len);
+    dst[len] = '\0';
+    return 1U;
+}
+
+/** Append a TLV; a value too large for the response is cut. */
+static void rpc_put(RpcOut_t *out, uint8_t tag, const void *data, uint32_t len)
+{
+    if (len > 255U)
+        len = 255U;
+    if ((out->len + 2U + len) > out->size)
+        return;
+
+    out->buf[out->len++] = tag;
+    out->buf[out->len++] = (uint8_t)len;
+    memcpy(&out->buf[out->len], data, len);
+    out->len += len;
+}
+
+static void rpc_put_num(RpcOut_t *out, uint8_t tag, uint32_t v, uint32_t bytes)
+{
+    uint8_t b[4];
+
+    for (uint32_t i = 0U; i < bytes; ++i)
+        b[i] = (uint8_t)(v >> (8U * i));
+    rpc_put(out, tag, b, bytes);
+}
+
+static void rpc_put_f32(RpcOut_t *out, uint8_t tag, float f)
+{
+    uint32_t u;
+
+    memcpy(&u, &f, sizeof(u));
+    rpc_put_num(out, tag, u, 4U);
+}
+
+/** Parameter named by tag 1 or keyed by tag 2. @return Its id, or -1. */
+static int32_t rpc_cal_id(const RpcArgs_t *in)
+{
+    char     name[24];
+    uint32_t key;
+
+    if (rpc_arg_text(in, 1U, name, sizeof(name)) != 0U)
+        return Cal_Find(name);
+    if (rpc_arg_num(in, 2U, 2U, &key) != 0U)
+        return Cal_FindKey((uint16_t)key);
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Handlers                                                                   */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t rpc_ping(const RpcArgs_t *in, RpcOut_t *out)
+{
+    (void)in;
+
+    rpc_put_num(out, 1U, osKernelGetTickCount(), 4U);
+    rpc_put_num(out, 2U, CLI_RPC_VERSION, 1U);
+    return CLI_RPC_OK;
+}
+
+static uint8_t rpc_exec(const RpcArgs_t *in, RpcOut_t *out)
+{
+    char     line[CLI_LINE_MAX];
+    uint32_t cut = 0U;
+    uint32_t n;
+
+    if (rpc_arg_text(in, 1U, line, sizeof(line)) == 0U)
+        return CLI_RPC_E_ARG;
+
+    n = CLI_IF_ExecuteCapture(line, s_rpcText, sizeof(s_rpcText), &cut);
+    for (uint32_t pos = 0U; pos < n; pos += 255U)
+        rpc_put(out, 1U, &s_rpcText[pos], ((n - pos) > 255U) ? 255U : (n - pos));
+    if (cut != 0U)
+        rpc_put_num(out, 2U, cut, 4U);
+    return CLI_RPC_OK;
+}
+
+static uint8_t rpc_veh_get(const RpcArgs_t *in, RpcOut_t *out)
+{
+    VehicleState_t vs;
+
+    (void)in;
+    Vehicle_GetSnapshot(&vs);
+    rpc_put_f32(out, 1U, vs.speed_kph);
+    rpc_put_num(out, 2U, vs.engine_rpm, 2U);
+    rpc_put_f32(out, 3U, vs.coolant_temp_c);
+    rpc_put_f32(out, 4U, vs.throttle);
+    rpc_put_num(out, 5U, vs.gear, 1U);
+    return CLI_RPC_OK;
+}
+
+static uint8_t rpc_veh_speed(const RpcArgs_t *in, RpcOut_t *out)
+{
+    VehicleCmd_t cmd = { 0 };
+
+    (void)out;
+    if (rpc_arg_f32(in, 1U, &cmd.speed_kph) == 0U)
+        return CLI_RPC_E_ARG;
+    cmd.type = (uint8_t)VEHICLE_CMD_SET_SPEED;
+    return (Vehicle_PostCommand(&cmd) == HAL_OK) ? CLI_RPC_OK : CLI_RPC_E_REFUSED;
+}
+
+static uint8_t rpc_log_level(const RpcArgs_t *in, RpcOut_t *out)
+{
+    char     name[16];
+    int32_t  mod = -1;
+    uint32_t level;
+
+    if (rpc_arg_text(in, 1U, name, sizeof(name)) != 0U)
+    {
+        mod = Log_FindModule(name);
+        if (mod < 0)
+            return CLI_RPC_E_ARG;
+    }
+    if (rpc_arg_num(in, 2U, 1U, &level) != 0U)
+    {
+        if (level > (uint32_t)LOG_LEVEL_DEBUG)
+            return CLI_RPC_E_ARG;
+        if (mod >= 0)
+            Log_SetModuleLevel((log_module_t)mod, (log_level_t)level);
+        else
+            Log_SetLevel((log_level_t)level);
+    }
+
+    level = (mod >= 0) ? (uint32_t)Log_GetModuleLevel((log_module_t)mod) : (uint32_t)Log_GetLevel();
+    rpc_put_num(out, 2U, level, 1U);
+    return CLI_RPC_OK;
+}
+
+static uint8_t rpc_stats(const RpcArgs_t *in, RpcOut_t *out)
+{
+    CanStats_Summary_t can;
+
+    (void)in;
+    rpc_put_num(out, 1U, osKernelGetTickCount(), 4U);
+    for (uint32_t s = 0U; s < (uint32_t)LOG_STREAM_COUNT; ++s)
+    {
+        Log_Stats_t st;
+
+        Log_GetStreamStats((Log_Stream_t)s, &st);
+        rpc_put_num(out, (uint8_t)(2U + s), st.droppedLines, 4U);
+    }
+
+    (void)CanStats_Get(&can, NULL, 0U);
+    rpc_put_num(out, 5U, can.rxFrames, 4U);
+    rpc_put_num(out, 6U, can.txFrames, 4U);
+    rpc_put_num(out, 7U, can.state, 1U);
+    rpc_put_num(out, 8U, can.tec, 1U);
+    rpc_put_num(out, 9U, can.rec, 1U);
+    rpc_put_num(out, 10U, can.fifoOverruns, 4U);
+    return CLI_RPC_OK;
+}
+
+static uint8_t rpc_cal_get(const RpcArgs_t *in, RpcOut_t *out)
+{
+    int32_t id = rpc_cal_id(in);
+
+    if (id < 0)
+        return CLI_RPC_E_ARG;
+
+    rpc_put_num(out, 2U, s_rpcCalKey[id], 2U);
+    if (s_rpcCalFloat[id] != 0U)
+        rpc_put_f32(out, 3U, g_calValues[id].f);
+    else
+        rpc_put_num(out, 4U, g_calValues[id].u, 4U);
+    return CLI_RPC_OK;
+}
+
+static uint8_t rpc_cal_set(const RpcArgs_t *in, RpcOut_t *out)
+{
+    int32_t     id = rpc_cal_id(in);
+    Cal_Value_t v;
+
+    (void)out;
+    if (id < 0)
+        return CLI_RPC_E_ARG;
+    if (((s_rpcCalFloat[id] != 0U) && (rpc_arg_f32(in, 3U, &v.f) == 0U)) ||
+        ((s_rpcCalFloat[id] == 0U) && (rpc_arg_num(in, 4U, 4U, &v.u) == 0U)))
+        return CLI_RPC_E_ARG;
+    return (Cal_Set((Cal_Id_t)id, v) == HAL_OK) ? CLI_RPC_OK : CLI_RPC_E_REFUSED;
+}
+
+static uint8_t rpc_cal_commit(const RpcArgs_t *in, RpcOut_t *out)
+{
+    (void)in;
+    rpc_put_num(out, 1U, Cal_Commit(), 4U);
+    return CLI_RPC_OK;
+}
+
+static uint8_t rpc_stage_begin(const RpcArgs_t *in, RpcOut_t *out)
+{
+    uint32_t length;
+
+    if (rpc_arg_num(in, 1U, 4U, &length) != 0U)
+    {
+        HAL_StatusTypeDef status = Stage_Begin(length);
+
+        if (status != HAL_OK)
+            return (status == HAL_BUSY) ? CLI_RPC_E_REFUSED : CLI_RPC_E_ARG;
+    }
+    rpc_put_num(out, 1U, Stage_Target(), 4U);
+    return CLI_RPC_OK;
+}
+
+static uint8_t rpc_stage_data(const RpcArgs_t *in, RpcOut_t *out)
+{
+    Stage_Stats_t  st;
+    uint32_t       offset;
+    uint32_t       len  = 0U;
+    const uint8_t *data = rpc_arg(in, 2U, &len);
+
+    if ((rpc_arg_num(in, 1U, 4U, &offset) == 0U) || (data == NULL))
+        return CLI_RPC_E_ARG;
+
+    /* A repeat whose response was lost is answered, not written again. */
+    Stage_GetStats(&st);
+    if ((offset + len) > st.received)
+    {
+        if (offset != st.received)
+            return CLI_RPC_E_ARG;
+
+        HAL_StatusTypeDef status = Stage_Write(data, len);
+        if (status != HAL_OK)
+            return (status == HAL_BUSY) ? CLI_RPC_E_REFUSED : CLI_RPC_E_ARG;
+        st.received += len;
+    }
+    rpc_put_num(out, 1U, st.received, 4U);
+    return CLI_RPC_OK;
+}
+
+static uint8_t rpc_stage_end(const RpcArgs_t *in, RpcOut_t *out)
+{
+    Stage_Stats_t     st;
+    HAL_StatusTypeDef status = Stage_End();
+
+    (void)in;
+    if (status != HAL_OK)
+        return (status == HAL_BUSY) ? CLI_RPC_E_REFUSED : CLI_RPC_E_ARG;
+
+    Stage_GetStats(&st);
+    rpc_put_num(out, 1U, st.written, 4U);
+    return CLI_RPC_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Framing                                                                    */
+/* -------------------------------------------------------------------------- */
+
+/** Append the CRC to the response, COBS-encode it and queue it. */
+static void rpc_send(uint32_t len)
+{
+    uint16_t crc = Crc_Ccitt16(CRC16_INIT, s_rpcResp, len);
+
+    s_rpcResp[len++] = (uint8_t)crc;
+    s_rpcResp[len++] = (uint8_t)(crc >> 8);
+
+    uint32_t out  = 1U;
+    uint32_t code = out++;
+
+    s_rpcWire[0]    = 0U;
+    s_rpcWire[code] = 1U;
+    for (uint32_t i = 0U; i < len; ++i)
+    {
+        if (s_rpcResp[i] == 0U)
+        {
+            code            = out++;
+            s_rpcWire[code] = 1U;
+            continue;
+        }
+        s_rpcWire[out++] = s_rpcResp[i];
+        if (++s_rpcWire[code] == 0xFFU)
+        {
+            code            = out++;
+            s_rpcWire[code] = 1U;
+        }
+    }
+    s_rpcWire[out++] = 0U;
+
+    if (Log_WriteStream(LOG_STREAM_CLI, (const char *)s_rpcWire, out) != HAL_OK)
+        s_rpcTxDrops++;
+}
+
+/** A complete request frame (still encoded) is in s_rpcRx. */
+static void rpc_frame(void)
+{
+    uint32_t len = rpc_cobs_decode(s_rpcRx, s_rpcRxLen);
+
+    if ((s_rpcRxOver != 0U) || (len < (RPC_REQ_HDR + 2U)) || (s_rpcRx[0] != CLI_RPC_FRAME_REQ))
+    {
+        s_rpcBadFrame++;
+        return;
+    }
+    len -= 2U;
+    if (Crc_Ccitt16(CRC16_INIT, s_rpcRx, len) != (uint16_t)(s_rpcRx[len] | ((uint16_t)s_rpcRx[len + 1U] << 8)))
+    {
+        s_rpcBadCrc++;
+        return;
+    }
+
+    RpcArgs_t in  = { &s_rpcRx[RPC_REQ_HDR], len - RPC_REQ_HDR };
+    RpcOut_t  out = { s_rpcResp, RPC_RESP_HDR, RPC_RESP_MAX - 2U };
+    uint8_t   status = CLI_RPC_E_CMD;
+    uint32_t  t0 = DWT->CYCCNT;
+
+    for (uint32_t i = 0U; i < RPC_CMD_COUNT; ++i)
+    {
+        if (s_rpcCmds[i].id == s_rpcRx[2])
+        {
+            status = s_rpcCmds[i].fn(&in, &out);
+            break;
+        }
+    }
+    if (status != CLI_RPC_OK)
+        out.len = RPC_RESP_HDR;
+
+    s_rpcResp[0] = CLI_RPC_FRAME_RESP;
+    s_rpcResp[1] = s_rpcRx[1];
+    s_rpcResp[2] = s_rpcRx[2];
+    s_rpcResp[3] = status;
+    rpc_send(out.len);
+
+    uint32_t cyclesPerUs = SystemCoreClock / 1000000U;
+
+    s_rpcLastUs = (DWT->CYCCNT - t0) / ((cyclesPerUs != 0U) ? cyclesPerUs : 1U);
+    if (s_rpcLastUs > s_rpcMaxUs)
+        s_rpcMaxUs = s_rpcLastUs;
+    s_rpcServed++;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI commands                                                               */
+/* -------------------------------------------------------------------------- */
+
+static void rpc_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CLI_IF_Printf("RPC v%u: %lu served, last %lu us, max %lu us\r\n", (unsigned)CLI_RPC_VERSION,
+                  (unsigned long)s_rpcServed, (unsigned long)s_rpcLastUs, (unsigned long)s_rpcMaxUs);
+    CLI_IF_Printf("  bad crc %lu, bad frame %lu, timed out %lu, replies dropped %lu\r\n",
+                  (unsigned long)s_rpcBadCrc, (unsigned long)s_rpcBadFrame,
+                  (unsigned long)s_rpcTimeouts, (unsigned long)s_rpcTxDrops);
+    CLI_IF_Print("  commands:");
+    for (uint32_t i = 0U; i < RPC_CMD_COUNT; ++i)
+        CLI_IF_Printf(" %02X %s", (unsigned)s_rpcCmds[i].id, s_rpcCmds[i].name);
+    CLI_IF_Print("\r\n");
+}
+
+static const CliCommand_t s_rpcCliCmds[] =
+{
+    { "rpc", "", 0U, rpc_cmd_show, "binary RPC: requests served, errors, commands (tools/cli_rpc.py)" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void CliRpc_Init(void)
+{
+    CLI_IF_REGISTER_TABLE(s_rpcCliCmds);
+}
+
+uint8_t CliRpc_RxByte(uint8_t c)
+{
+    uint32_t now = osKernelGetTickCount();
+
+    if ((s_rpcRxIn != 0U) && ((now - s_rpcRxTick) >= CLI_RPC_RX_TIMEOUT_MS))
+    {
+        s_rpcRxIn = 0U;
+        s_rpcTimeouts++;
+    }
+
+    if (s_rpcRxIn == 0U)
+    {
+        if (c != 0U)
+            return 0U;
+        s_rpcRxIn   = 1U;
+        s_rpcRxLen  = 0U;
+        s_rpcRxOver = 0U;
+        s_rpcRxTick = now;
+        return 1U;
+    }
+
+    s_rpcRxTick = now;
+    if (c == 0U)
+    {
+        /* Two zeros in a row: the opening one of this frame. */
+        if (s_rpcRxLen == 0U)
+            return 1U;
+        s_rpcRxIn = 0U;
+        rpc_frame();
+        return 1U;
+    }
+
+    if (s_rpcRxLen < sizeof(s_rpcRx))
+        s_rpcRx[s_rpcRxLen++] = c;
+    else
+        s_rpcRxOver = 1U;
+    return 1U;
+}
@@ -0,0 +1,526 @@
+/**
+ * @file    cli_script.c
+ * @brief   CLI script upload, check and execution, and "script".
+ */
+
+#include "cli_script.h"
+#include "cli_if.h"
+#include "crc.h"
+#include "cmsis_os2.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define SC_WAIT_MAX_MS      3600000U    /* longest wait: one hour */
+
+typedef enum
+{
+    SC_OP_CMD = 0,
+    SC_OP_WAIT,
+    SC_OP_REPEAT,
+    SC_OP_END
+} CliScript_Op_t;
+
+/** One line that does something; comments and blank lines are not kept. */
+typedef struct
+{
+    uint16_t offset;    /* text in s_scBuf */
+    uint16_t source;    /* 1-based line number in the upload */
+    uint8_t  op;        /* CliScript_Op_t */
+    uint32_t arg;       /* wait ms, repeat count, or the END's REPEAT step */
+} CliScript_Step_t;
+
+typedef struct
+{
+    uint32_t runs;
+    uint32_t lastUs;
+    uint32_t maxUs;
+    uint64_t sumUs;
+} CliScript_Time_t;
+
+typedef struct
+{
+    uint32_t step;      /* the REPEAT */
+    uint32_t left;      /* bodies still to run; 0 = forever */
+} CliScript_Loop_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Script text; line ends become NULs when it is checked. */
+static char             s_scBuf[CLI_SCRIPT_SIZE];
+static uint32_t         s_scBytes = 0U;
+static uint16_t         s_scCrc   = 0U;
+
+static CliScript_Step_t s_scSteps[CLI_SCRIPT_MAX_LINES];
+static CliScript_Time_t s_scTimes[CLI_SCRIPT_MAX_LINES];
+static uint32_t         s_scCount = 0U;     /* 0 = no script */
+
+/* Upload in progress: bytes still expected, of how many, the CRC to check. */
+static uint32_t         s_scLoadLeft  = 0U;
+static uint32_t         s_scLoadTotal = 0U;
+static uint32_t         s_scLoadTick  = 0U;
+static uint16_t         s_scLoadCrc   = 0U;
+static uint8_t          s_scLoadHasCrc = 0U;
+static uint8_t          s_scLoadFirst = 0U;
+
+/* Run state. */
+static uint8_t          s_scRunning = 0U;
+static uint32_t         s_scPc      = 0U;
+static uint32_t         s_scDue     = 0U;
+static CliScript_Loop_t s_scLoops[CLI_SCRIPT_DEPTH];
+static uint32_t         s_scDepth   = 0U;
+static uint32_t         s_scStart   = 0U;
+static uint32_t         s_scRunCmds = 0U;
+static uint32_t         s_scSlowUs  = 0U;
+static uint32_t         s_scSlowStep = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Is @p word the first word of @p text (followed by a blank or the end)? */
+static const char *script_word(const char *text, const char *word)
+{
+    size_t n = strlen(word);
+
+    if ((strncmp(text, word, n) != 0) || ((text[n] != '\0') && (text[n] != ' ') && (text[n] != '\t')))
+        return NULL;
+    text += n;
+    while ((*text == ' ') || (*text == '\t'))
+        text++;
+    return text;
+}
+
+/** "wait" argument: n, n ms or n s, in ms. @return 0 if malformed. */
+static uint8_t script_parse_wait(const char *arg, uint32_t *ms)
+{
+    char         *end;
+    unsigned long n = strtoul(arg, &end, 10);
+
+    if (end == arg)
+        return 0U;
+    if (strcmp(end, "s") == 0)
+        n *= 1000UL;
+    else if ((*end != '\0') && (strcmp(end, "ms") != 0))
+        return 0U;
+    if (n > SC_WAIT_MAX_MS)
+        return 0U;
+
+    *ms = (uint32_t)n;
+    return 1U;
+}
+
+/**
+ * @brief Split the upload into lines and build the steps.
+ *
+ * @return 0 on success, else the 1-based line of the first error, with
+ *         @p why set.
+ */
+static uint32_t script_check(const char **why)
+{
+    uint32_t open[CLI_SCRIPT_DEPTH];
+    uint32_t depth  = 0U;
+    uint32_t source = 0U;
+    uint32_t pos    = 0U;
+
+    s_scCount = 0U;
+    s_scBuf[s_scBytes] = '\0';
+
+    while (pos < s_scBytes)
+    {
+        char    *line = &s_scBuf[pos];
+        uint32_t len  = 0U;
+
+        while (((pos + len) < s_scBytes) && (line[len] != '\n'))
+            len++;
+        line[len] = '\0';
+        if ((len > 0U) && (line[len - 1U] == '\r'))
+            line[len - 1U] = '\0';
+        pos += len + 1U;
+        source++;
+
+        while ((*line == ' ') || (*line == '\t'))
+            line++;
+        if ((*line == '\0') || (*line == '#'))
+            continue;
+
+        if (strlen(line) >= CLI_LINE_MAX)
+        {
+            *why = "line too long";
+            return source;
+        }
+        if (s_scCount >= CLI_SCRIPT_MAX_LINES)
+        {
+            *why = "too many lines";
+            return source;
+        }
+
+        CliScript_Step_t *st  = &s_scSteps[s_scCount];
+        const char       *arg;
+
+        st->offset = (uint16_t)(line - s_scBuf);
+        st->source = (uint16_t)source;
+        st->op     = (uint8_t)SC_OP_CMD;
+        st->arg    = 0U;
+
+        if ((arg = script_word(line, "wait")) != NULL)
+        {
+            st->op = (uint8_t)SC_OP_WAIT;
+            if (script_parse_wait(arg, &st->arg) == 0U)
+            {
+                *why = "wait <n>[ms|s], at most 1 h";
+                return source;
+            }
+        }
+        else if ((arg = script_word(line, "repeat")) != NULL)
+        {
+            char *end;
+
+            st->op  = (uint8_t)SC_OP_REPEAT;
+            st->arg = (uint32_t)strtoul(arg, &end, 10);
+            if ((end == arg) || (*end != '\0'))
+            {
+                *why = "repeat <n>";
+                return source;
+            }
+            if (depth >= CLI_SCRIPT_DEPTH)
+            {
+                *why = "repeat nested too deep";
+                return source;
+            }
+            open[depth++] = s_scCount;
+        }
+        else if ((arg = script_word(line, "end")) != NULL)
+        {
+            if ((*arg != '\0') || (depth == 0U))
+            {
+                *why = "end without repeat";
+                return source;
+            }
+            st->op  = (uint8_t)SC_OP_END;
+            st->arg = open[--depth];
+        }
+
+        s_scCount++;
+    }
+
+    if (depth != 0U)
+    {
+        *why = "repeat without end";
+        return s_scSteps[open[depth - 1U]].source;
+    }
+    return 0U;
+}
+
+/** The upload is complete: check it and report. */
+static void script_loaded(void)
+{
+    const char *why = NULL;
+    uint32_t    bad;
+
+    s_scCrc = Crc_Ccitt16(CRC16_INIT, (const uint8_t *)s_scBuf, s_scBytes);
+    if ((s_scLoadHasCrc != 0U) && (s_scCrc != s_scLoadCrc))
+    {
+        s_scCount = 0U;
+        CLI_IF_Printf("\r\nScript rejected: crc 0x%04X, expected 0x%04X\r\n> ",
+                      (unsigned)s_scCrc, (unsigned)s_scLoadCrc);
+        return;
+    }
+
+    bad = script_check(&why);
+    if (bad != 0U)
+    {
+        s_scCount = 0U;
+        CLI_IF_Printf("\r\nScript rejected: line %lu: %s\r\n> ", (unsigned long)bad, why);
+        return;
+    }
+
+    memset(s_scTimes, 0, sizeof(s_scTimes));
+    CLI_IF_Printf("\r\nScript: %lu B, %lu steps, crc 0x%04X\r\n> ", (unsigned long)s_scBytes,
+                  (unsigned long)s_scCount, (unsigned)s_scCrc);
+}
+
+/** Run one command step and time it. */
+static void script_exec(uint32_t step)
+{
+    char     line[CLI_LINE_MAX];
+    uint32_t cyclesPerUs = SystemCoreClock / 1000000U;
+
+    strcpy(line, &s_scBuf[s_scSteps[step].offset]);
+
+    uint32_t t0 = DWT->CYCCNT;
+    CLI_IF_Execute(line);
+    uint32_t us = (DWT->CYCCNT - t0) / ((cyclesPerUs != 0U) ? cyclesPerUs : 1U);
+
+    CliScript_Time_t *t = &s_scTimes[step];
+    t->runs++;
+    t->lastUs = us;
+    t->sumUs += us;
+    if (us > t->maxUs)
+        t->maxUs = us;
+    if (us >= s_scSlowUs)
+    {
+        s_scSlowUs   = us;
+        s_scSlowStep = step;
+    }
+    s_scRunCmds++;
+}
+
+/** The run reached its end (from CliScript_Run(), with a prompt) or was
+ *  stopped (from "script stop", whose prompt follows). */
+static void script_finish(const char *how, uint8_t prompt)
+{
+    s_scRunning = 0U;
+    CLI_IF_Printf("%sScript %s: %lu commands in %lu ms", (prompt != 0U) ? "\r\n" : "", how,
+                  (unsigned long)s_scRunCmds, (unsigned long)(osKernelGetTickCount() - s_scStart));
+    if (s_scRunCmds != 0U)
+        CLI_IF_Printf(", slowest line %u (%lu us)", (unsigned)s_scSteps[s_scSlowStep].source,
+                      (unsigned long)s_scSlowUs);
+    CLI_IF_Print((prompt != 0U) ? "\r\n> " : "\r\n");
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI commands                                                               */
+/* -------------------------------------------------------------------------- */
+
+static void script_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if (s_scLoadLeft != 0U)
+        CLI_IF_Printf("Script: loading, %lu of %lu B\r\n",
+                      (unsigned long)(s_scLoadTotal - s_scLoadLeft), (unsigned long)s_scLoadTotal);
+    else if (s_scCount == 0U)
+        CLI_IF_Print("Script: none\r\n");
+    else
+        CLI_IF_Printf("Script: %lu B, %lu steps, crc 0x%04X, %s\r\n", (unsigned long)s_scBytes,
+                      (unsigned long)s_scCount, (unsigned)s_scCrc,
+                      (s_scRunning != 0U) ? "running" : "stopped");
+}
+
+static void script_cmd_load(int argc, char *argv[])
+{
+    char         *end;
+    unsigned long n = strtoul(argv[0], &end, 10);
+
+    if ((*end != '\0') || (n == 0U) || (n >= CLI_SCRIPT_SIZE))
+    {
+        CLI_IF_Printf("Size must be 1..%u bytes\r\n", (unsigned)(CLI_SCRIPT_SIZE - 1U));
+        return;
+    }
+    s_scLoadHasCrc = 0U;
+    if (argc > 1)
+    {
+        unsigned long crc = strtoul(argv[1], &end, 16);
+
+        if ((*end != '\0') || (crc > 0xFFFFU))
+        {
+            CLI_IF_Print("CRC must be 16-bit hex\r\n");
+            return;
+        }
+        s_scLoadCrc    = (uint16_t)crc;
+        s_scLoadHasCrc = 1U;
+    }
+
+    s_scRunning   = 0U;
+    s_scCount     = 0U;
+    s_scBytes     = 0U;
+    s_scLoadTotal = (uint32_t)n;
+    s_scLoadLeft  = (uint32_t)n;
+    s_scLoadFirst = 1U;
+    s_scLoadTick  = osKernelGetTickCount();
+    CLI_IF_Printf("Send %lu bytes\r\n", n);
+}
+
+static void script_cmd_list(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    for (uint32_t i = 0U; i < s_scCount; ++i)
+        CLI_IF_Printf("%4u  %s\r\n", (unsigned)s_scSteps[i].source, &s_scBuf[s_scSteps[i].offset]);
+}
+
+static void script_cmd_run(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if ((s_scCount == 0U) || (s_scLoadLeft != 0U))
+    {
+        CLI_IF_Print("No script, use 'script load'\r\n");
+        return;
+    }
+
+    memset(s_scTimes, 0, sizeof(s_scTimes));
+    s_scPc       = 0U;
+    s_scDepth    = 0U;
+    s_scRunCmds  = 0U;
+    s_scSlowUs   = 0U;
+    s_scSlowStep = 0U;
+    s_scStart    = osKernelGetTickCount();
+    s_scDue      = s_scStart;
+    s_scRunning  = 1U;
+    CLI_IF_Printf("Script: running %lu steps\r\n", (unsigned long)s_scCount);
+}
+
+static void script_cmd_stop(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if (s_scLoadLeft != 0U)
+    {
+        s_scLoadLeft = 0U;
+        CLI_IF_Print("Script upload aborted\r\n");
+    }
+    else if (s_scRunning != 0U)
+    {
+        script_finish("stopped", 0U);
+    }
+    else
+    {
+        CLI_IF_Print("Script: not running\r\n");
+    }
+}
+
+static void script_cmd_report(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CLI_IF_Print("Line   Runs  Last us  Mean us   Max us  Command\r\n");
+    for (uint32_t i = 0U; i < s_scCount; ++i)
+    {
+        const CliScript_Time_t *t = &s_scTimes[i];
+
+        if (s_scSteps[i].op != (uint8_t)SC_OP_CMD)
+            continue;
+        CLI_IF_Printf("%4u %6lu %8lu %8lu %8lu  %s\r\n", (unsigned)s_scSteps[i].source,
+                      (unsigned long)t->runs, (unsigned long)t->lastUs,
+                      (unsigned long)((t->runs != 0U) ? (uint32_t)(t->sumUs / t->runs) : 0U),
+                      (unsigned long)t->maxUs, &s_scBuf[s_scSteps[i].offset]);
+    }
+}
+
+static const CliCommand_t s_scCmds[] =
+{
+    { "script",        "",               0U, script_cmd_show,   "show the loaded CLI script" },
+    { "script load",   "<bytes> [<crc>]", 1U, script_cmd_load,  "upload a script: the next <bytes> bytes, no echo" },
+    { "script list",   "",               0U, script_cmd_list,   "list the script's steps" },
+    { "script run",    "",               0U, script_cmd_run,    "run the script" },
+    { "script stop",   "",               0U, script_cmd_stop,   "stop the script or its upload" },
+    { "script report", "",               0U, script_cmd_report, "per command: runs, last, mean and max time" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void CliScript_Init(void)
+{
+    CLI_IF_REGISTER_TABLE(s_scCmds);
+}
+
+uint8_t CliScript_RxByte(uint8_t c)
+{
+    if (s_scLoadLeft == 0U)
+        return 0U;
+
+    /* The '\n' of the "script load" line's CR LF. */
+    if ((s_scLoadFirst != 0U) && (c == '\n'))
+    {
+        s_scLoadFirst = 0U;
+        return 1U;
+    }
+    s_scLoadFirst = 0U;
+
+    s_scBuf[s_scBytes++] = (char)c;
+    s_scLoadTick = osKernelGetTickCount();
+    if (--s_scLoadLeft == 0U)
+        script_loaded();
+    return 1U;
+}
+
+uint32_t CliScript_Run(uint32_t nowMs)
+{
+    if (s_scLoadLeft != 0U)
+    {
+        uint32_t idle = nowMs - s_scLoadTick;
+
+        if (idle < CLI_SCRIPT_LOAD_TIMEOUT_MS)
+            return CLI_SCRIPT_LOAD_TIMEOUT_MS - idle;
+
+        CLI_IF_Printf("\r\nScript upload timed out: %lu of %lu B\r\n> ",
+                      (unsigned long)(s_scLoadTotal - s_scLoadLeft), (unsigned long)s_scLoadTotal);
+        s_scLoadLeft = 0U;
+        return osWaitForever;
+    }
+
+    if (s_scRunning == 0U)
+        return osWaitForever;
+    if ((int32_t)(nowMs - s_scDue) < 0)
+        return s_scDue - nowMs;
+
+    for (uint32_t steps = 0U; steps < CLI_SCRIPT_BURST; ++steps)
+    {
+        const CliScript_Step_t *st = &s_scSteps[s_scPc];
+
+        switch ((CliScript_Op_t)st->op)
+        {
+        case SC_OP_WAIT:
+            s_scPc++;
+            s_scDue = osKernelGetTickCount() + st->arg;
+            break;
+
+        case SC_OP_REPEAT:
+            s_scLoops[s_scDepth].step = s_scPc;
+            s_scLoops[s_scDepth].left = st->arg;
+            s_scDepth++;
+            s_scPc++;
+            break;
+
+        case SC_OP_END:
+        {
+            CliScript_Loop_t *lp = &s_scLoops[s_scDepth - 1U];
+
+            if ((lp->left == 0U) || (--lp->left != 0U))
+            {
+                s_scPc = lp->step + 1U;
+            }
+            else
+            {
+                s_scDepth--;
+                s_scPc++;
+            }
+            break;
+        }
+
+        default:
+            script_exec(s_scPc);
+            s_scPc++;
+            break;
+        }
+
+        /* A command may have stopped the run or loaded another script. */
+        if (s_scRunning == 0U)
+            return osWaitForever;
+        if (s_scPc >= s_scCount)
+        {
+            script_finish("done", 1U);
+            return osWaitForever;
+        }
+        if (st->op == (uint8_t)SC_OP_WAIT)
+            return st->arg;
+    }
+
+    /* A burst without a wait: yield a tick to the lower priority tasks. */
+    s_scDue = osKernelGetTickCount() + 1U;
+    return 1U;
+}
@@ -0,0 +1,374 @@
+/**
+ * @file    clock_cfg.c
+ * @brief   System clock profile selection and switching.
+ *
+ * PLL settings (HSI = 16 MHz, PLLM = 8 -> 2 MHz VCO input, as recommended
+ * by RM0390 for low jitter):
+ *   84 MHz : PLLN = 168, PLLP = 4   (VCO 336 MHz)
+ *   180 MHz: PLLN = 180, PLLP = 2   (VCO 360 MHz)
+ */
+
+#include "clock_cfg.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/** Hardware settings behind each public profile entry. */
+typedef struct
+{
+    uint8_t  pllOn;
+    uint8_t  overDrive;
+    uint32_t pllN;
+    uint32_t pllP;
+    uint32_t vos;
+    uint32_t apb1Div;
+    uint32_t apb2Div;
+    uint32_t flashLatency;
+} ClockCfg_Hw_t;
+
+#define CLOCK_PLL_M  8U
+#define CLOCK_PLL_Q  7U   /* not a 48 MHz clock; USB takes PLLSAI (usb_cdc.c) */
+
+/* ClockCfg_EarlyInit(): polls per ready flag before giving up (no tick
+ * yet), some milliseconds at 16 MHz. */
+#define CLOCK_EARLY_SPINS  100000U
+
+/* ClockCfg_Apply(): the regulator output settles well within this (ms),
+ * as HAL_PWREx_ControlVoltageScaling() allows. */
+#define CLOCK_VOSRDY_TIMEOUT_MS  1000U
+
+static const ClockCfg_Profile_t s_profiles[CLOCK_PROFILE_COUNT] =
+{
+    [CLOCK_PROFILE_HSI16]  = { "HSI16",   16000000U,  8000000U },
+    [CLOCK_PROFILE_84MHZ]  = { "84MHz",   84000000U, 42000000U },
+    [CLOCK_PROFILE_180MHZ] = { "180MHz", 180000000U, 45000000U },
+};
+
+static const ClockCfg_Hw_t s_hw[CLOCK_PROFILE_COUNT] =
+{
+    [CLOCK_PROFILE_HSI16]  = { 0U, 0U,   0U, RCC_PLLP_DIV2, PWR_REGULATOR_VOLTAGE_SCALE3,
+                               RCC_HCLK_DIV2, RCC_HCLK_DIV1, FLASH_LATENCY_0 },
+    [CLOCK_PROFILE_84MHZ]  = { 1U, 0U, 168U, RCC_PLLP_DIV4, PWR_REGULATOR_VOLTAGE_SCALE3,
+                               RCC_HCLK_DIV2, RCC_HCLK_DIV1, FLASH_LATENCY_2 },
+    [CLOCK_PROFILE_180MHZ] = { 1U, 1U, 180U, RCC_PLLP_DIV2, PWR_REGULATOR_VOLTAGE_SCALE1,
+                               RCC_HCLK_DIV4, RCC_HCLK_DIV2, FLASH_LATENCY_5 },
+};
+
+_Static_assert(CLOCK_PROFILE < CLOCK_PROFILE_COUNT, "Unknown CLOCK_PROFILE");
+
+static const ClockCfg_Profile_t *s_active = &s_profiles[CLOCK_PROFILE_HSI16];
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Run from the HSI with the current wait states before touching PLL.
+ *
+ * Keeping the (higher) latency is always safe while the frequency drops.
+ */
+static HAL_StatusTypeDef clock_to_hsi(void)
+{
+    if (__HAL_RCC_GET_SYSCLK_SOURCE() != RCC_SYSCLKSOURCE_STATUS_PLLCLK)
+        return HAL_OK;
+
+    RCC_ClkInitTypeDef clk = {0};
+    clk.ClockType      = RCC_CLOCKTYPE_SYSCLK;
+    clk.SYSCLKSource   = RCC_SYSCLKSOURCE_HSI;
+
+    return HAL_RCC_ClockConfig(&clk, __HAL_FLASH_GET_LATENCY());
+}
+
+/**
+ * @brief Stop the main PLL and wait until it is off; SYSCLK must already
+ *        run from the HSI. VOS may only be written with the PLL off.
+ */
+static HAL_StatusTypeDef clock_pll_off(void)
+{
+    uint32_t start = HAL_GetTick();
+
+    __HAL_RCC_PLL_DISABLE();
+    while (__HAL_RCC_GET_FLAG(RCC_FLAG_PLLRDY) != RESET)
+    {
+        if ((HAL_GetTick() - start) > PLL_TIMEOUT_VALUE)
+            return HAL_TIMEOUT;
+    }
+    return HAL_OK;
+}
+
+/** Wait for the regulator to reach the VOS scale written; PLL on. */
+static HAL_StatusTypeDef clock_wait_vos(void)
+{
+    uint32_t start = HAL_GetTick();
+
+    while (__HAL_PWR_GET_FLAG(PWR_FLAG_VOSRDY) == RESET)
+    {
+        if ((HAL_GetTick() - start) > CLOCK_VOSRDY_TIMEOUT_MS)
+            return HAL_TIMEOUT;
+    }
+    return HAL_OK;
+}
+
+/** ART accelerator: prefetch buffer plus instruction and data caches. */
+static void clock_enable_art(void)
+{
+    __HAL_FLASH_PREFETCH_BUFFER_ENABLE();
+    __HAL_FLASH_INSTRUCTION_CACHE_ENABLE();
+    __HAL_FLASH_DATA_CACHE_ENABLE();
+}
+
+/** The clock tree already runs @p hw (bus dividers in RCC_CFGR encoding). */
+static uint8_t clock_matches(const ClockCfg_Hw_t *hw)
+{
+    uint32_t cfgr   = RCC->CFGR;
+    uint32_t source = (hw->pllOn != 0U) ? RCC_SYSCLKSOURCE_STATUS_PLLCLK
+                                        : RCC_SYSCLKSOURCE_STATUS_HSI;
+
+    if ((cfgr & RCC_CFGR_SWS) != source || (cfgr & RCC_CFGR_HPRE) != RCC_SYSCLK_DIV1 ||
+        (cfgr & RCC_CFGR_PPRE1) != hw->apb1Div ||
+        (cfgr & RCC_CFGR_PPRE2) != (hw->apb2Div << 3) ||
+        __HAL_FLASH_GET_LATENCY() != hw->flashLatency ||
+        (PWR->CR & PWR_CR_VOS) != hw->vos)
+        return 0U;
+
+    if ((__HAL_PWR_GET_FLAG(PWR_FLAG_ODRDY) != 0U) != (hw->overDrive != 0U))
+        return 0U;
+
+    if (hw->pllOn != 0U)
+    {
+        uint32_t pll = RCC->PLLCFGR;
+
+        if ((pll & RCC_PLLCFGR_PLLSRC) != RCC_PLLSOURCE_HSI ||
+            (pll & RCC_PLLCFGR_PLLM) != CLOCK_PLL_M ||
+            ((pll & RCC_PLLCFGR_PLLN) >> RCC_PLLCFGR_PLLN_Pos) != hw->pllN ||
+            ((pll & RCC_PLLCFGR_PLLP) >> RCC_PLLCFGR_PLLP_Pos) != ((hw->pllP >> 1U) - 1U))
+            return 0U;
+    }
+
+    return 1U;
+}
+
+/** Wait for (@p reg & @p mask) == @p value; 0 on timeout. */
+static uint32_t clock_early_wait(const volatile uint32_t *reg, uint32_t mask, uint32_t value)
+{
+    for (uint32_t n = 0U; n < CLOCK_EARLY_SPINS; ++n)
+    {
+        if ((*reg & mask) == value)
+            return 1U;
+    }
+    return 0U;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+uint32_t ClockCfg_Select(void)
+{
+#ifdef CLOCK_BOOT_CFG_ADDR
+    uint32_t word = *(const volatile uint32_t *)(CLOCK_BOOT_CFG_ADDR);
+
+    if (((word & CLOCK_BOOT_CFG_MASK) == CLOCK_BOOT_CFG_MAGIC) &&
+        ((word & 0xFFU) < CLOCK_PROFILE_COUNT))
+    {
+        return word & 0xFFU;
+    }
+#endif
+
+    return CLOCK_PROFILE;
+}
+
+HAL_StatusTypeDef ClockCfg_Apply(uint32_t profile)
+{
+    if (profile >= CLOCK_PROFILE_COUNT)
+        return HAL_ERROR;
+
+    const ClockCfg_Hw_t *hw = &s_hw[profile];
+    RCC_OscInitTypeDef osc = {0};
+    RCC_ClkInitTypeDef clk = {0};
+
+    __HAL_RCC_PWR_CLK_ENABLE();
+
+    if (clock_to_hsi() != HAL_OK)
+        return HAL_ERROR;
+
+    /* Over-drive may only be left while not running from the PLL. */
+    if ((hw->overDrive == 0U) && (__HAL_PWR_GET_FLAG(PWR_FLAG_ODRDY) != 0U))
+    {
+        if (HAL_PWREx_DisableOverDrive() != HAL_OK)
+            return HAL_ERROR;
+    }
+
+    /* VOS is written with the PLL off; the regulator switches to it when
+     * the PLL starts again, and VOSRDY tells when it has. */
+    if (clock_pll_off() != HAL_OK)
+        return HAL_ERROR;
+    __HAL_PWR_VOLTAGESCALING_CONFIG(hw->vos);
+
+    osc.OscillatorType      = RCC_OSCILLATORTYPE_HSI;
+    osc.HSIState            = RCC_HSI_ON;
+    osc.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
+    if (hw->pllOn != 0U)
+    {
+        osc.PLL.PLLState  = RCC_PLL_ON;
+        osc.PLL.PLLSource = RCC_PLLSOURCE_HSI;
+        osc.PLL.PLLM      = CLOCK_PLL_M;
+        osc.PLL.PLLN      = hw->pllN;
+        osc.PLL.PLLP      = hw->pllP;
+        osc.PLL.PLLQ      = CLOCK_PLL_Q;
+        osc.PLL.PLLR      = 2U;
+    }
+    else
+    {
+        osc.PLL.PLLState  = RCC_PLL_OFF;
+    }
+
+    if (HAL_RCC_OscConfig(&osc) != HAL_OK)
+        return HAL_ERROR;
+
+    if ((hw->pllOn != 0U) && (clock_wait_vos() != HAL_OK))
+        return HAL_ERROR;
+
+    if (hw->overDrive != 0U)
+    {
+        /* Needed above 168 MHz; must be enabled before switching to PLL. */
+        if (HAL_PWREx_EnableOverDrive() != HAL_OK)
+            return HAL_ERROR;
+    }
+
+    clk.ClockType      = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK |
+                         RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+    clk.SYSCLKSource   = (hw->pllOn != 0U) ? RCC_SYSCLKSOURCE_PLLCLK
+                                           : RCC_SYSCLKSOURCE_HSI;
+    clk.AHBCLKDivider  = RCC_SYSCLK_DIV1;
+    clk.APB1CLKDivider = hw->apb1Div;
+    clk.APB2CLKDivider = hw->apb2Div;
+
+    /* Raises wait states before / lowers them after the switch. */
+    if (HAL_RCC_ClockConfig(&clk, hw->flashLatency) != HAL_OK)
+        return HAL_ERROR;
+
+    clock_enable_art();
+
+    s_active = &s_profiles[profile];
+    return HAL_OK;
+}
+
+void ClockCfg_EarlyInit(void)
+{
+    const ClockCfg_Hw_t *hw = &s_hw[ClockCfg_Select()];
+
+    /* From the reset state only; a clock the bootloader left is for
+     * SystemClock_Config() to adopt or redo. */
+    if ((hw->pllOn == 0U) || ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_HSI) ||
+        ((RCC->CR & RCC_CR_PLLON) != 0U))
+        return;
+
+    RCC->APB1ENR |= RCC_APB1ENR_PWREN;
+    (void)RCC->APB1ENR;
+    PWR->CR = (PWR->CR & ~PWR_CR_VOS) | hw->vos;
+
+    RCC->PLLCFGR = RCC_PLLSOURCE_HSI | CLOCK_PLL_M |
+                   (hw->pllN << RCC_PLLCFGR_PLLN_Pos) |
+                   (((hw->pllP >> 1U) - 1U) << RCC_PLLCFGR_PLLP_Pos) |
+                   (CLOCK_PLL_Q << RCC_PLLCFGR_PLLQ_Pos) | (2U << RCC_PLLCFGR_PLLR_Pos);
+    RCC->CR |= RCC_CR_PLLON;
+    if (clock_early_wait(&RCC->CR, RCC_CR_PLLRDY, RCC_CR_PLLRDY) == 0U)
+        return;
+
+    if (hw->overDrive != 0U)
+    {
+        PWR->CR |= PWR_CR_ODEN;
+        if (clock_early_wait(&PWR->CSR, PWR_CSR_ODRDY, PWR_CSR_ODRDY) == 0U)
+            return;
+        PWR->CR |= PWR_CR_ODSWEN;
+        if (clock_early_wait(&PWR->CSR, PWR_CSR_ODSWRDY, PWR_CSR_ODSWRDY) == 0U)
+            return;
+    }
+
+    /* Wait states and the ART accelerator before the frequency rises. */
+    FLASH->ACR = hw->flashLatency | FLASH_ACR_PRFTEN | FLASH_ACR_ICEN | FLASH_ACR_DCEN;
+    if (clock_early_wait(&FLASH->ACR, FLASH_ACR_LATENCY, hw->flashLatency) == 0U)
+        return;
+
+    /* Bus dividers and the switch in one write: APB1/APB2 never exceed
+     * their limits. */
+    RCC->CFGR = (RCC->CFGR & ~(RCC_CFGR_HPRE | RCC_CFGR_PPRE1 | RCC_CFGR_PPRE2 | RCC_CFGR_SW)) |
+                RCC_SYSCLK_DIV1 | hw->apb1Div | (hw->apb2Div << 3) | RCC_CFGR_SW_PLL;
+    (void)clock_early_wait(&RCC->CFGR, RCC_CFGR_SWS, RCC_CFGR_SWS_PLL);
+}
+
+HAL_StatusTypeDef ClockCfg_Adopt(uint32_t profile)
+{
+    if (profile >= CLOCK_PROFILE_COUNT)
+        return HAL_ERROR;
+
+    /* PWR registers read as 0 with the clock gated. */
+    __HAL_RCC_PWR_CLK_ENABLE();
+
+    if (clock_matches(&s_hw[profile]) == 0U)
+        return HAL_ERROR;
+
+    clock_enable_art();
+
+    SystemCoreClockUpdate();
+    if (HAL_InitTick(uwTickPrio) != HAL_OK)
+        return HAL_ERROR;
+
+    s_active = &s_profiles[profile];
+    return HAL_OK;
+}
+
+const ClockCfg_Profile_t *ClockCfg_GetActive(void)
+{
+    return s_active;
+}
+
+uint32_t ClockCfg_GetActiveId(void)
+{
+    return (uint32_t)(s_active - s_profiles);
+}
+
+const ClockCfg_Profile_t *ClockCfg_GetProfile(uint32_t profile)
+{
+    return (profile < CLOCK_PROFILE_COUNT) ? &s_profiles[profile] : NULL;
+}
+
+uint32_t ClockCfg_TimerHz(void)
+{
+    uint32_t hz = HAL_RCC_GetPCLK1Freq();
+
+    if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1)
+        hz *= 2U;
+    return hz;
+}
+
+uint32_t ClockCfg_Apb2TimerHz(void)
+{
+    uint32_t hz = HAL_RCC_GetPCLK2Freq();
+
+    if ((RCC->CFGR & RCC_CFGR_PPRE2) != RCC_CFGR_PPRE2_DIV1)
+        hz *= 2U;
+    return hz;
+}
+
+void ClockCfg_RetimeTimer(TIM_TypeDef *tim, uint32_t psc, uint32_t arr)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint32_t cnt = (uint32_t)(((uint64_t)tim->CNT * (arr + 1U)) / ((uint64_t)tim->ARR + 1U));
+    tim->ARR = arr;
+    if (tim->PSC != psc)
+    {
+        uint32_t cr1 = tim->CR1;
+        tim->CR1 = cr1 | TIM_CR1_URS;
+        tim->PSC = psc;
+        tim->EGR = TIM_EGR_UG;
+        tim->CR1 = cr1;
+    }
+    tim->CNT = cnt;
+
+    __set_PRIMASK(primask);
+}
@@ -0,0 +1,484 @@
+/**
+ * @file    clock_gov.c
+ * @brief   Load windows, profile decision, the switch itself and "clk".
+ */
+
+#include "clock_gov.h"
+
+#if CLOCK_GOV_ENABLE
+
+#include "angle_sched.h"
+#include "can_if.h"
+#include "cli_if.h"
+#include "crank.h"
+#include "ctrl_loop.h"
+#include "fan_ctrl.h"
+#include "log.h"
+#include "pc_prof.h"
+#include "pedal.h"
+#include "time_sync.h"
+#include "usb_cdc.h"
+#include "vsensor.h"
+#include "wheel_pulse.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+_Static_assert(CLOCK_GOV_MIN_PROFILE <= CLOCK_GOV_MAX_PROFILE,
+               "CLOCK_GOV_MIN_PROFILE must not be above CLOCK_GOV_MAX_PROFILE");
+_Static_assert(CLOCK_GOV_MAX_PROFILE < CLOCK_PROFILE_COUNT, "unknown CLOCK_GOV_MAX_PROFILE");
+_Static_assert(CLOCK_GOV_DOWN_PERMILLE < CLOCK_GOV_UP_PERMILLE,
+               "CLOCK_GOV_DOWN_PERMILLE must be below CLOCK_GOV_UP_PERMILLE");
+_Static_assert((CLOCK_GOV_WINDOW_MS >= 100U) && ((CLOCK_GOV_WINDOW_MS % 100U) == 0U),
+               "CLOCK_GOV_WINDOW_MS must be a multiple of the 100 ms raster");
+_Static_assert(UART_BAUD_ENABLE, "the clock governor retimes the console through uart_baud.c");
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define CG_HSI_MHZ          (HSI_VALUE / 1000000U)
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static UART_HandleTypeDef *s_cgUart = NULL;
+static uint32_t         s_cgMax = CLOCK_GOV_MAX_PROFILE;   /* clamped at init */
+
+/* Mode and manual profile: written by CliTask, read by the runnable. */
+static volatile uint8_t  s_cgMode = (uint8_t)CLOCK_GOV_AUTO;
+static volatile uint32_t s_cgPinned = CLOCK_GOV_MAX_PROFILE;
+
+/* Boost: any task, under PRIMASK. */
+static volatile uint8_t  s_cgBoosting = 0U;
+static uint32_t          s_cgBoostStart = 0U;
+static uint32_t          s_cgBoostMs = 0U;
+
+/* The rest belongs to the 100 ms raster task. */
+static uint32_t          s_cgWant;              /* auto mode's profile */
+static uint8_t           s_cgLastMode = (uint8_t)CLOCK_GOV_AUTO;
+static uint32_t          s_cgUp = 0U;           /* windows in a row above / below */
+static uint32_t          s_cgDown = 0U;
+static uint32_t          s_cgWinTick = 0U;
+static uint32_t          s_cgWinCycles = 0U;
+static uint32_t          s_cgWinIdle = 0U;
+static uint32_t          s_cgAtTick = 0U;       /* last time-at-profile update */
+static ClockGov_Stats_t  s_cgStats;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Start a load window at @p now. */
+static void cg_window_start(uint32_t now)
+{
+    s_cgWinTick   = now;
+    s_cgWinCycles = DWT->CYCCNT;
+    s_cgWinIdle   = ulTaskGetIdleRunTimeCounter();
+}
+
+/** Credit the time since the last call to the current profile. */
+static void cg_account(uint32_t now)
+{
+    s_cgStats.atMs[ClockCfg_GetActiveId()] += now - s_cgAtTick;
+    s_cgAtTick = now;
+}
+
+/** Load of the window ending at @p now, 0..1000. */
+static uint32_t cg_window_load(uint32_t now)
+{
+    uint32_t cycles = DWT->CYCCNT - s_cgWinCycles;
+    uint32_t idle   = ulTaskGetIdleRunTimeCounter() - s_cgWinIdle;
+    uint64_t wall   = (uint64_t)(now - s_cgWinTick) * (SystemCoreClock / 1000U);
+    uint32_t busy   = (cycles > idle) ? (cycles - idle) : 0U;
+
+    if (wall == 0U)
+        return 0U;
+
+    uint64_t load = ((uint64_t)busy * 1000U) / wall;
+    return (load < 1000U) ? (uint32_t)load : 1000U;
+}
+
+/** Auto mode: step s_cgWant from the window's @p load. */
+static void cg_decide(uint32_t load)
+{
+    uint32_t cur = ClockCfg_GetActiveId();
+
+    if (load >= CLOCK_GOV_UP_PERMILLE)
+    {
+        s_cgDown = 0U;
+        if ((++s_cgUp >= CLOCK_GOV_UP_WINDOWS) && (cur < s_cgMax))
+        {
+            s_cgWant = cur + 1U;
+            s_cgUp   = 0U;
+        }
+        return;
+    }
+
+    s_cgUp = 0U;
+    if (cur <= CLOCK_GOV_MIN_PROFILE)
+    {
+        s_cgDown = 0U;
+        return;
+    }
+
+    /* The same work at the lower clock takes longer by the clock ratio. */
+    uint64_t lower = ((uint64_t)load * ClockCfg_GetProfile(cur)->sysclkHz) /
+                     ClockCfg_GetProfile(cur - 1U)->sysclkHz;
+
+    if (lower > CLOCK_GOV_DOWN_PERMILLE)
+    {
+        s_cgDown = 0U;
+    }
+    else if (++s_cgDown >= CLOCK_GOV_DOWN_WINDOWS)
+    {
+        s_cgWant = cur - 1U;
+        s_cgDown = 0U;
+    }
+}
+
+/** 1 if CAN and the console can be timed from @p profile's APB1 clock. */
+static uint8_t cg_fits(uint32_t profile)
+{
+    uint32_t apb1 = ClockCfg_GetProfile(profile)->apb1Hz;
+
+    return ((CAN_IF_ClockFits(apb1) != 0U) && (UartBaud_Fits(apb1) != 0U)) ? 1U : 0U;
+}
+
+/** Re-derive everything that counts the bus clocks; CAN last. */
+static void cg_retime(uint64_t localUs)
+{
+    TimeSync_ClockChanged(localUs);
+#if CRANK_ENABLE
+    Crank_ClockChanged();
+#endif
+#if ANGLE_SCHED_ENABLE
+    AngleSched_ClockChanged();
+#endif
+    CtrlLoop_ClockChanged();
+    VSensor_ClockChanged();
+    Pedal_ClockChanged();
+#if FAN_CTRL_ENABLE
+    FanCtrl_ClockChanged();
+#endif
+#if WHEEL_PULSE_ENABLE
+    WheelPulse_ClockChanged();
+#endif
+#if PC_PROF_ENABLE
+    PcProf_ClockChanged();
+#endif
+    UartBaud_Retime();
+    Log_ClockChanged();
+#if USB_CDC_ENABLE
+    UsbCdc_ClockChanged();
+#endif
+    if (CAN_IF_ClockResume() != HAL_OK)
+        s_cgStats.failed++;
+}
+
+/**
+ * Switch to @p to with the scheduler suspended.
+ *
+ * @return HAL_OK, HAL_BUSY to try again in 100 ms, HAL_ERROR if the
+ *         profile did not apply (the old one is back).
+ */
+static HAL_StatusTypeDef cg_switch(uint32_t to)
+{
+    uint32_t from    = ClockCfg_GetActiveId();
+    uint32_t fromMhz = SystemCoreClock / 1000000U;
+
+    vTaskSuspendAll();
+
+    /* LogTask cannot start a transfer until the scheduler resumes. */
+    if ((Log_TxBusy() != 0U) || (__HAL_UART_GET_FLAG(s_cgUart, UART_FLAG_TC) == 0U))
+    {
+        (void)xTaskResumeAll();
+        return HAL_BUSY;
+    }
+
+    uint32_t c0    = DWT->CYCCNT;
+    uint64_t local = TimeSync_LocalUs();
+
+    if (CAN_IF_ClockPrepare() != HAL_OK)
+    {
+        (void)xTaskResumeAll();
+        return HAL_BUSY;
+    }
+
+    uint32_t          c1     = DWT->CYCCNT;
+    HAL_StatusTypeDef status = ClockCfg_Apply(to);
+    if (status != HAL_OK)
+        (void)ClockCfg_Apply(from);
+    uint32_t          c2     = DWT->CYCCNT;
+
+    /* Most of ClockCfg_Apply() runs on the HSI while the PLL locks. */
+    uint32_t us    = ((c1 - c0) / fromMhz) + ((c2 - c1) / CG_HSI_MHZ);
+    uint32_t toMhz = SystemCoreClock / 1000000U;
+
+    cg_retime(local + us + ((DWT->CYCCNT - c2) / toMhz));
+    us += (DWT->CYCCNT - c2) / toMhz;
+
+    (void)xTaskResumeAll();
+
+    s_cgStats.lastUs = us;
+    if (us > s_cgStats.maxUs)
+        s_cgStats.maxUs = us;
+    return status;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void cg_cmd_show(void)
+{
+    ClockGov_Stats_t st;
+    const ClockCfg_Profile_t *p;
+
+    ClockGov_GetStats(&st);
+    p = ClockCfg_GetProfile(st.profile);
+
+    CLI_IF_Printf("Clock %s: SYSCLK %lu Hz, APB1 %lu Hz, %s%s\r\n", p->name,
+                  (unsigned long)SystemCoreClock, (unsigned long)HAL_RCC_GetPCLK1Freq(),
+                  (st.mode == CLOCK_GOV_MANUAL) ? "pinned" : "auto",
+                  (st.boosting != 0U) ? ", boost" : "");
+    CLI_IF_Printf("Load %u.%u %% (up at %u.%u %%, down at %u.%u %% of the lower clock)\r\n",
+                  (unsigned)(st.loadPermille / 10U), (unsigned)(st.loadPermille % 10U),
+                  (unsigned)(CLOCK_GOV_UP_PERMILLE / 10U), (unsigned)(CLOCK_GOV_UP_PERMILLE % 10U),
+                  (unsigned)(CLOCK_GOV_DOWN_PERMILLE / 10U),
+                  (unsigned)(CLOCK_GOV_DOWN_PERMILLE % 10U));
+    CLI_IF_Printf("Switches %lu, deferred %lu, refused %lu, failed %lu; last %lu us, max %lu us\r\n",
+                  (unsigned long)st.switches, (unsigned long)st.deferred,
+                  (unsigned long)st.refused, (unsigned long)st.failed,
+                  (unsigned long)st.lastUs, (unsigned long)st.maxUs);
+    for (uint32_t i = CLOCK_GOV_MIN_PROFILE; i <= s_cgMax; ++i)
+    {
+        CLI_IF_Printf("  %-7s %lu ms\r\n", ClockCfg_GetProfile(i)->name,
+                      (unsigned long)st.atMs[i]);
+    }
+}
+
+static void cg_cmd_clk(int argc, char *argv[])
+{
+    if (argc == 0)
+    {
+        cg_cmd_show();
+        return;
+    }
+
+    if (strcmp(argv[0], "auto") == 0)
+    {
+        ClockGov_SetAuto();
+        CLI_IF_Print("Clock profile follows the load\r\n");
+        return;
+    }
+
+    for (uint32_t i = 0U; i < CLOCK_PROFILE_COUNT; ++i)
+    {
+        if (strcmp(argv[0], ClockCfg_GetProfile(i)->name) == 0)
+        {
+            if (ClockGov_SetProfile(i) != HAL_OK)
+            {
+                CLI_IF_Printf("%s not usable (range %s..%s, CAN bitrate and baud rate)\r\n",
+                              argv[0], ClockCfg_GetProfile(CLOCK_GOV_MIN_PROFILE)->name,
+                              ClockCfg_GetProfile(s_cgMax)->name);
+                return;
+            }
+            CLI_IF_Printf("Clock pinned to %s from the next 100 ms\r\n", argv[0]);
+            return;
+        }
+    }
+
+    CLI_IF_Print("Usage: clk [auto|HSI16|84MHz|180MHz]\r\n");
+}
+
+static void cg_cmd_reset(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    ClockGov_ResetStats();
+    CLI_IF_Print("Clock governor counters cleared\r\n");
+}
+
+static const CliCommand_t s_cgCmds[] =
+{
+    { "clk",       "[auto|<profile>]", 0U, cg_cmd_clk,   "clock profile and load, or pin/free it" },
+    { "clk reset", "",                 0U, cg_cmd_reset, "clear the clock governor counters" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef ClockGov_Init(UART_HandleTypeDef *console)
+{
+    if (console == NULL)
+        return HAL_ERROR;
+
+    uint32_t now = HAL_GetTick();
+
+    s_cgUart = console;
+    s_cgMax  = ClockCfg_GetActiveId();
+    if (s_cgMax > CLOCK_GOV_MAX_PROFILE)
+        s_cgMax = CLOCK_GOV_MAX_PROFILE;
+    s_cgWant   = ClockCfg_GetActiveId();
+    s_cgPinned = s_cgWant;
+    s_cgMode     = (uint8_t)CLOCK_GOV_AUTO;
+    s_cgLastMode = (uint8_t)CLOCK_GOV_AUTO;
+    s_cgAtTick   = now;
+    memset(&s_cgStats, 0, sizeof(s_cgStats));
+    cg_window_start(now);
+
+    CLI_IF_REGISTER_TABLE(s_cgCmds);
+    return HAL_OK;
+}
+
+void ClockGov_Event100ms(void)
+{
+    if (s_cgUart == NULL)
+        return;
+
+    uint32_t now = HAL_GetTick();
+    uint32_t cur = ClockCfg_GetActiveId();
+    uint32_t to;
+
+    cg_account(now);
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if ((s_cgBoosting != 0U) && ((now - s_cgBoostStart) >= s_cgBoostMs))
+    {
+        s_cgBoosting = 0U;
+        s_cgWant     = cur;     /* from here the load windows step down */
+    }
+    uint8_t boosting = s_cgBoosting;
+    __set_PRIMASK(primask);
+
+    /* Back from a pinned profile: the load windows go on from it. */
+    uint8_t mode = s_cgMode;
+    if (mode != s_cgLastMode)
+    {
+        s_cgWant     = cur;
+        s_cgUp       = 0U;
+        s_cgDown     = 0U;
+        s_cgLastMode = mode;
+    }
+
+    if ((now - s_cgWinTick) >= CLOCK_GOV_WINDOW_MS)
+    {
+        s_cgStats.loadPermille = (uint16_t)cg_window_load(now);
+        if (mode == (uint8_t)CLOCK_GOV_AUTO)
+            cg_decide(s_cgStats.loadPermille);
+        cg_window_start(now);
+    }
+
+    if (mode == (uint8_t)CLOCK_GOV_MANUAL)
+        to = s_cgPinned;
+    else
+        to = (boosting != 0U) ? s_cgMax : s_cgWant;
+
+    if (to == cur)
+        return;
+
+    /* The CAN bitrate or the baud rate may have changed since the request. */
+    if (cg_fits(to) == 0U)
+    {
+        s_cgStats.refused++;
+        s_cgWant   = cur;
+        s_cgPinned = cur;
+        primask = __get_PRIMASK();
+        __disable_irq();
+        s_cgBoosting = 0U;
+        __set_PRIMASK(primask);
+        LOG_WARN(MAIN, "Clock %s refused: CAN or console rate out of reach",
+                 ClockCfg_GetProfile(to)->name);
+        return;
+    }
+
+    HAL_StatusTypeDef status = cg_switch(to);
+    if (status == HAL_BUSY)
+    {
+        s_cgStats.deferred++;
+        return;
+    }
+
+    s_cgUp   = 0U;
+    s_cgDown = 0U;
+    cg_window_start(HAL_GetTick());
+    if (status != HAL_OK)
+    {
+        s_cgStats.failed++;
+        s_cgWant   = cur;
+        s_cgPinned = cur;
+        LOG_ERROR(MAIN, "Clock %s failed, staying at %s", ClockCfg_GetProfile(to)->name,
+                  ClockCfg_GetProfile(cur)->name);
+        return;
+    }
+
+    s_cgStats.switches++;
+    LOG_DEBUG(MAIN, "Clock %s -> %s in %lu us", ClockCfg_GetProfile(cur)->name,
+              ClockCfg_GetProfile(to)->name, (unsigned long)s_cgStats.lastUs);
+}
+
+void ClockGov_Boost(uint32_t ms)
+{
+    uint32_t now = HAL_GetTick();
+
+    if (ms == 0U)
+        ms = CLOCK_GOV_BOOST_MS;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    /* Extend only: a shorter boost inside a longer one changes nothing. */
+    if ((s_cgBoosting == 0U) || ((now + ms) - s_cgBoostStart) > s_cgBoostMs)
+    {
+        if (s_cgBoosting == 0U)
+            s_cgBoostStart = now;
+        s_cgBoostMs  = (now + ms) - s_cgBoostStart;
+        s_cgBoosting = 1U;
+    }
+    __set_PRIMASK(primask);
+}
+
+HAL_StatusTypeDef ClockGov_SetProfile(uint32_t profile)
+{
+    /* Unsigned: below CLOCK_GOV_MIN_PROFILE wraps above the range too. */
+    if (((profile - CLOCK_GOV_MIN_PROFILE) > (s_cgMax - CLOCK_GOV_MIN_PROFILE)) ||
+        (cg_fits(profile) == 0U))
+        return HAL_ERROR;
+
+    s_cgPinned = profile;
+    s_cgMode   = (uint8_t)CLOCK_GOV_MANUAL;
+    return HAL_OK;
+}
+
+void ClockGov_SetAuto(void)
+{
+    s_cgMode = (uint8_t)CLOCK_GOV_AUTO;
+}
+
+void ClockGov_GetStats(ClockGov_Stats_t *stats)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *stats          = s_cgStats;
+    stats->profile  = ClockCfg_GetActiveId();
+    stats->mode     = (ClockGov_Mode_t)s_cgMode;
+    stats->boosting = s_cgBoosting;
+    __set_PRIMASK(primask);
+}
+
+void ClockGov_ResetStats(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint16_t load = s_cgStats.loadPermille;
+    memset(&s_cgStats, 0, sizeof(s_cgStats));
+    s_cgStats.loadPermille = load;
+    s_cgAtTick = HAL_GetTick();
+    __set_PRIMASK(primask);
+}
+
+#endif /* CLOCK_GOV_ENABLE */
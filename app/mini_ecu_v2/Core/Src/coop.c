@@ -0,0 +1,192 @@
+/**
+ * @file    coop.c
+ * @brief   Coroutine host of BgTask and "coop". See coop.h.
+ */
+
+#include "coop.h"
+#include "sys_config.h"
+#include "log.h"
+#include "nvm_log.h"
+#include "stage.h"
+#include "cli_if.h"
+#include "cmsis_os2.h"
+#include <stdio.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define CO_ENUM_(name, fn, flags)   COOP_##name,
+enum
+{
+    COOP_TABLE(CO_ENUM_)
+    COOP_COUNT
+};
+
+/* Disjoint flag sets: their OR is their sum. */
+#define CO_OR_(name, fn, flags)     | (uint32_t)(flags)
+#define CO_SUM_(name, fn, flags)    + (uint32_t)(flags)
+_Static_assert((0U COOP_TABLE(CO_OR_)) == (0U COOP_TABLE(CO_SUM_)),
+               "COOP_TABLE: two coroutines wait on the same thread flag");
+
+typedef struct
+{
+    const char *name;
+    void      (*fn)(Coop_t *c);
+    uint32_t    flags;
+} CoDef_t;
+
+typedef struct
+{
+    uint32_t turns;
+    uint32_t maxCycles;
+} CoStats_t;
+
+#define CO_DEF_(name, fn, flags)    { #name, fn, (uint32_t)(flags) },
+static const CoDef_t s_coDefs[COOP_COUNT] = { COOP_TABLE(CO_DEF_) };
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static Coop_t                s_coCoops[COOP_COUNT];
+static CoStats_t             s_coStats[COOP_COUNT];
+static volatile osThreadId_t s_coThread = NULL;
+static uint32_t              s_coWakes  = 0U;     /* host wake-ups */
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** The wait of @p c is over at @p now. */
+static uint8_t co_ready(const Coop_t *c, uint32_t now)
+{
+    if (c->done != 0U)
+        return 0U;
+    if (c->got != 0U)
+        return 1U;
+    return ((c->timed != 0U) && ((int32_t)(now - c->until) >= 0)) ? 1U : 0U;
+}
+
+static void co_turn(uint32_t i)
+{
+    Coop_t  *c  = &s_coCoops[i];
+    uint32_t t0 = DWT->CYCCNT;
+
+    s_coDefs[i].fn(c);
+    c->got = 0U;
+
+    uint32_t dt = DWT->CYCCNT - t0;
+    s_coStats[i].turns++;
+    if (dt > s_coStats[i].maxCycles)
+        s_coStats[i].maxCycles = dt;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void coop_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t cyclesPerUs = SystemCoreClock / 1000000U;
+    uint32_t now         = osKernelGetTickCount();
+
+    if (cyclesPerUs == 0U)
+        cyclesPerUs = 1U;
+
+    CLI_IF_Printf("BgTask coroutines, %lu wake-ups:\r\n", (unsigned long)s_coWakes);
+    CLI_IF_Printf("  %-8s %7s  %-6s %-10s %9s\r\n", "name", "turns", "flags", "timeout", "longest");
+    for (uint32_t i = 0U; i < COOP_COUNT; ++i)
+    {
+        const Coop_t *c = &s_coCoops[i];
+        char          timeout[16];
+
+        if (c->done != 0U)
+            (void)snprintf(timeout, sizeof(timeout), "ended");
+        else if (c->timed == 0U)
+            (void)snprintf(timeout, sizeof(timeout), "-");
+        else
+            (void)snprintf(timeout, sizeof(timeout), "%ld ms", (long)(int32_t)(c->until - now));
+
+        CLI_IF_Printf("  %-8s %7lu  0x%04lX %-10s %6lu us\r\n", s_coDefs[i].name,
+                      (unsigned long)s_coStats[i].turns, (unsigned long)c->wait, timeout,
+                      (unsigned long)(s_coStats[i].maxCycles / cyclesPerUs));
+    }
+}
+
+static const CliCommand_t s_coCmds[] =
+{
+    { "coop", "", 0U, coop_cmd_show, "BgTask coroutines: turns, waits, longest turn" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void Coop_Init(void)
+{
+    CLI_IF_REGISTER_TABLE(s_coCmds);
+}
+
+void Coop_Run(void)
+{
+    s_coThread = osThreadGetId();
+
+    for (uint32_t i = 0U; i < COOP_COUNT; ++i)
+        co_turn(i);
+
+    for (;;)
+    {
+        uint32_t now     = osKernelGetTickCount();
+        uint32_t mask    = 0U;
+        uint32_t timeout = osWaitForever;
+
+        for (uint32_t i = 0U; i < COOP_COUNT; ++i)
+        {
+            const Coop_t *c = &s_coCoops[i];
+
+            if (c->done != 0U)
+                continue;
+            mask |= c->wait;
+            if (c->timed != 0U)
+            {
+                int32_t left = (int32_t)(c->until - now);
+                uint32_t ms  = (left > 0) ? (uint32_t)left : 0U;
+                if (ms < timeout)
+                    timeout = ms;
+            }
+        }
+
+        uint32_t flags = 0U;
+        if (mask != 0U)
+        {
+            flags = osThreadFlagsWait(mask, osFlagsWaitAny, timeout);
+            if ((flags & osFlagsError) != 0U)
+                flags = 0U;
+        }
+        else
+        {
+            (void)osDelay(timeout);
+        }
+        s_coWakes++;
+
+        now = osKernelGetTickCount();
+        for (uint32_t i = 0U; i < COOP_COUNT; ++i)
+        {
+            s_coCoops[i].got = flags & s_coCoops[i].wait;
+            if (co_ready(&s_coCoops[i], now) != 0U)
+                co_turn(i);
+        }
+    }
+}
+
+void Coop_Notify(uint32_t flags)
+{
+    osThreadId_t thread = s_coThread;
+
+    if (thread != NULL)
+        (void)osThreadFlagsSet(thread, flags);
+}
@@ -0,0 +1,623 @@
+/**
+ * @file    crank.c
+ * @brief   60-2 crank wheel generator (TIM8 + DMA), tooth capture decoder
+ *          (TIM4), "crank" and "bench crank". See crank.h.
+ */
+
+#include "crank.h"
+#include "angle_sched.h"
+#include "cli_if.h"
+#include "clock_cfg.h"
+#include "platform_dma.h"
+#include "ramfunc.h"
+#include "vehicle_shared.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if CRANK_ENABLE
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define CK_AF_TIM8          3U          /* PC6 = TIM8_CH1 */
+#define CK_AF_TIM4          2U          /* PB6 = TIM4_CH1 */
+
+/* DMA2 Stream2 channel 7 = TIM8_CH1, requested on update (CCDS). */
+#define CK_DMA              DMA2_Stream2
+#define CK_DMA_CHSEL        7U
+#define CK_DMA_S2_FLAGS     (DMA_LIFCR_CFEIF2 | DMA_LIFCR_CDMEIF2 | DMA_LIFCR_CTEIF2 | \
+                             DMA_LIFCR_CHTIF2 | DMA_LIFCR_CTCIF2)
+
+/** Edges per revolution; the last one before the gap is tooth CK_LAST. */
+#define CK_PRESENT          (CRANK_TEETH - CRANK_MISSING)
+#define CK_LAST             (CK_PRESENT - 1U)
+
+/** TIM4 counts microseconds (time_sync.h). */
+#define CK_US_PER_S         1000000.0f
+
+/** Generator pulse width; shorter than a tooth up to 25000 rpm. */
+#define CK_PULSE_US         40U
+
+/** Cycles of exception entry and return around the handler body (no FP
+ *  context), added per edge to the benchmark's load. */
+#define CK_EXC_CYCLES       24U
+
+#define CK_BENCH_SETTLE_MS  200U
+
+#define CK_RPM_(rpm)        (rpm),
+static const uint16_t s_ckBenchRpm[] = { CRANK_BENCH_RPM_TABLE(CK_RPM_) };
+#define CK_BENCH_STEPS      ((uint32_t)(sizeof(s_ckBenchRpm) / sizeof(s_ckBenchRpm[0])))
+
+/** Capture interrupt state; other contexts copy it under PRIMASK. */
+typedef struct
+{
+    uint16_t last;          /* capture of the last edge */
+    uint16_t ref;           /* last normal tooth time, us */
+    uint16_t dt;            /* last tooth time, a gap divided by its teeth */
+    uint8_t  sync;          /* Crank_Sync_t */
+    uint8_t  tooth;
+    uint32_t revAcc;        /* us since tooth 0 ... */
+    uint32_t revUs;         /* ... and of the last full revolution */
+    uint32_t edges;
+    uint32_t revs;
+    uint32_t syncs;
+    uint32_t losses;
+    uint32_t overcaptures;
+    uint32_t cycles;        /* sum of the bodies */
+    uint32_t cyclesMax;
+} CkIsr_t;
+
+typedef struct
+{
+    uint16_t rpm;
+    uint32_t edges;
+    uint32_t cycles;
+    uint32_t cyclesMax;
+    uint32_t losses;
+    uint32_t windowCycles;
+    float    revRpm;
+} CkBench_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static CkIsr_t                s_ckIsr;
+static volatile uint8_t       s_ckRestart = 0U;     /* next edge starts at NOSYNC */
+
+/* Read by DMA2 Stream2: CCR1 per tooth position. */
+PLATFORM_DMA_BUFFER static uint16_t s_ckTable[CRANK_TEETH];
+
+/* 10 ms runnable. */
+static uint16_t               s_ckGenRpm    = 0U;
+static uint32_t               s_ckSeenEdges = 0U;
+static uint32_t               s_ckSeenMs    = 0U;
+static uint8_t                s_ckStalled   = 1U;
+static uint32_t               s_ckStalls    = 0U;
+static volatile uint16_t      s_ckHoldRpm   = 0U;   /* Crank_SetGeneratorRpm() */
+
+/* Benchmark: started by the CLI, stepped by the runnable. */
+static volatile uint8_t       s_ckBenchRun  = 0U;
+static volatile uint32_t      s_ckBenchDone = 0U;   /* steps with results */
+static uint32_t               s_ckBenchMs   = CRANK_BENCH_MS;
+static uint32_t               s_ckBenchT0   = 0U;   /* HAL tick of the phase start */
+static uint8_t                s_ckBenchMeas = 0U;   /* settled, measuring */
+static CkIsr_t                s_ckBenchSnap;
+static uint32_t               s_ckBenchCyc0 = 0U;
+static CkBench_t              s_ckBench[CK_BENCH_STEPS];
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** TIM8 prescaler: a tooth at CRANK_MIN_RPM still fits 16 bits. */
+static uint32_t ck_psc(void)
+{
+    uint64_t counts = ((uint64_t)ClockCfg_Apb2TimerHz() * 60U) / (CRANK_TEETH * CRANK_MIN_RPM);
+
+    return (uint32_t)((counts - 1U) / 65536U);
+}
+
+/** One revolution of CCR1 values: a pulse per present tooth. */
+static void ck_fill_table(uint32_t psc)
+{
+    uint32_t pulse = (uint32_t)(((uint64_t)ClockCfg_Apb2TimerHz() * CK_PULSE_US) /
+                                (1000000ULL * (psc + 1U)));
+
+    for (uint32_t i = 0U; i < CRANK_TEETH; ++i)
+        s_ckTable[i] = (i < CK_PRESENT) ? (uint16_t)pulse : 0U;
+    PlatformDma_Clean(s_ckTable, (uint32_t)sizeof(s_ckTable));
+}
+
+/** Run the wheel at @p rpm; below CRANK_MIN_RPM the output is held low. */
+static void ck_generate(uint32_t rpm)
+{
+    if (rpm < CRANK_MIN_RPM)
+        rpm = 0U;
+    if (rpm == s_ckGenRpm)
+        return;
+
+    if (rpm == 0U)
+    {
+        TIM8->CCMR1 = TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1PE;               /* forced low */
+    }
+    else
+    {
+        /* A tooth per 1/rpm s on a 60-position wheel; ARR is preloaded. */
+        uint64_t counts = ((uint64_t)ClockCfg_Apb2TimerHz() * 60U) /
+                          ((uint64_t)CRANK_TEETH * rpm * (TIM8->PSC + 1U));
+        TIM8->ARR   = (uint32_t)counts - 1U;
+        TIM8->CCMR1 = TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1 | TIM_CCMR1_OC1PE;  /* PWM 1 */
+    }
+    s_ckGenRpm = (uint16_t)rpm;
+}
+
+static void ck_snapshot(CkIsr_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *out = s_ckIsr;
+    __set_PRIMASK(primask);
+}
+
+/** Advance the benchmark; @return the speed it wants, 0 when idle. */
+static uint32_t ck_bench_step(uint32_t now)
+{
+    uint32_t step = s_ckBenchDone;
+
+    if (s_ckBenchRun == 0U)
+        return 0U;
+    if (step >= CK_BENCH_STEPS)
+    {
+        s_ckBenchRun = 0U;
+        return 0U;
+    }
+
+    if (s_ckBenchMeas == 0U)
+    {
+        if ((now - s_ckBenchT0) >= CK_BENCH_SETTLE_MS)
+        {
+            uint32_t primask = __get_PRIMASK();
+            __disable_irq();
+            s_ckIsr.cyclesMax = 0U;
+            s_ckBenchSnap     = s_ckIsr;
+            s_ckBenchCyc0     = DWT->CYCCNT;
+            __set_PRIMASK(primask);
+
+            s_ckBenchT0   = now;
+            s_ckBenchMeas = 1U;
+        }
+    }
+    else if ((now - s_ckBenchT0) >= s_ckBenchMs)
+    {
+        CkIsr_t k;
+        ck_snapshot(&k);
+
+        CkBench_t *b    = &s_ckBench[step];
+        b->rpm          = s_ckBenchRpm[step];
+        b->edges        = k.edges - s_ckBenchSnap.edges;
+        b->cycles       = k.cycles - s_ckBenchSnap.cycles;
+        b->cyclesMax    = k.cyclesMax;
+        b->losses       = k.losses - s_ckBenchSnap.losses;
+        b->windowCycles = DWT->CYCCNT - s_ckBenchCyc0;
+        b->revRpm       = (k.revUs != 0U) ? ((60.0f * CK_US_PER_S) / (float)k.revUs) : 0.0f;
+
+        s_ckBenchDone = step + 1U;
+        s_ckBenchT0   = now;
+        s_ckBenchMeas = 0U;
+        if ((step + 1U) >= CK_BENCH_STEPS)
+        {
+            s_ckBenchRun = 0U;
+            return 0U;
+        }
+        step++;
+    }
+
+    return s_ckBenchRpm[step];
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static const char *const s_ckSyncNames[] = { "NOSYNC", "SEEK", "SYNC" };
+
+static void ck_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    Crank_State_t  s;
+    VehicleState_t vs;
+
+    Crank_Get(&s);
+    Vehicle_GetSnapshot(&vs);
+
+    CLI_IF_Printf("Crank %u-%u, TIM8 PC6 -> TIM4 PB6: generator %u rpm (engine %u rpm)%s\r\n",
+                  (unsigned)CRANK_TEETH, (unsigned)CRANK_MISSING, (unsigned)s.genRpm,
+                  (unsigned)vs.engine_rpm, (s_ckBenchRun != 0U) ? ", bench running" : "");
+    CLI_IF_Printf("%s tooth %u, angle %.1f deg, %.1f rpm tooth, %.1f rpm revolution\r\n",
+                  s_ckSyncNames[s.sync], (unsigned)s.tooth, (double)s.angleDeg,
+                  (double)s.rpm, (double)s.revRpm);
+    CLI_IF_Printf("%lu edges, %lu revolutions, %lu syncs, %lu losses, %lu stalls, "
+                  "%lu overcaptures; ISR max %lu cycles\r\n",
+                  (unsigned long)s.edges, (unsigned long)s.revs, (unsigned long)s.syncs,
+                  (unsigned long)s.losses, (unsigned long)s.stalls,
+                  (unsigned long)s.overcaptures, (unsigned long)s.cyclesMax);
+}
+
+static void ck_cmd_bench(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t done = s_ckBenchDone;
+
+    CLI_IF_Printf("Crank bench: %s, %lu of %lu speeds, %lu ms each, core %lu Hz\r\n",
+                  (s_ckBenchRun != 0U) ? "running" : "idle", (unsigned long)done,
+                  (unsigned long)CK_BENCH_STEPS, (unsigned long)s_ckBenchMs,
+                  (unsigned long)SystemCoreClock);
+    if (done == 0U)
+        return;
+
+    CLI_IF_Printf("  %5s %8s %8s %6s %6s %7s %6s %8s\r\n",
+                  "rpm", "teeth/s", "edges", "mean", "max", "load", "losses", "rev rpm");
+    for (uint32_t i = 0U; i < done; ++i)
+    {
+        const CkBench_t *b   = &s_ckBench[i];
+        float            sec = (float)b->windowCycles / (float)SystemCoreClock;
+        float            mean = (b->edges != 0U) ? ((float)b->cycles / (float)b->edges) : 0.0f;
+        float            load = (b->windowCycles != 0U)
+                                ? ((100.0f * ((float)b->cycles + ((float)b->edges * (float)CK_EXC_CYCLES))) /
+                                   (float)b->windowCycles)
+                                : 0.0f;
+
+        CLI_IF_Printf("  %5u %8.0f %8lu %6.1f %6lu %6.2f%% %6lu %8.1f\r\n",
+                      (unsigned)b->rpm, (double)((sec > 0.0f) ? ((float)b->edges / sec) : 0.0f),
+                      (unsigned long)b->edges, (double)mean, (unsigned long)b->cyclesMax,
+                      (double)load, (unsigned long)b->losses, (double)b->revRpm);
+    }
+}
+
+static void ck_cmd_bench_start(int argc, char *argv[])
+{
+    uint32_t ms = CRANK_BENCH_MS;
+
+    if (argc > 0)
+    {
+        char *end;
+        ms = (uint32_t)strtoul(argv[0], &end, 10);
+        if ((*end != '\0') || (argc > 1) || (ms < 100U) || (ms > 10000U))
+        {
+            CLI_IF_Print("Usage: bench crank start [<ms per speed, 100..10000>]\r\n");
+            return;
+        }
+    }
+
+    if (s_ckBenchRun != 0U)
+    {
+        CLI_IF_Print("Crank bench busy.\r\n");
+        return;
+    }
+
+    s_ckBenchMs   = ms;
+    s_ckBenchDone = 0U;
+    s_ckBenchMeas = 0U;
+    s_ckBenchT0   = HAL_GetTick();
+    s_ckBenchRun  = 1U;
+
+    CLI_IF_Printf("Crank bench started, %lu speeds of %lu ms; \"bench crank\" shows the figures.\r\n",
+                  (unsigned long)CK_BENCH_STEPS, (unsigned long)ms);
+}
+
+static const CliCommand_t s_ckCmds[] =
+{
+    { "crank",             "",       0U, ck_cmd_show,        "crank wheel: generator, sync, angle, rpm" },
+    { "bench crank",       "",       0U, ck_cmd_bench,       "crank decoder ISR cycles and CPU load per rpm" },
+    { "bench crank start", "[<ms>]", 0U, ck_cmd_bench_start, "sweep the crank generator over the bench speeds" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef Crank_Init(void)
+{
+    GPIO_InitTypeDef gpio = {0};
+    uint32_t         psc  = ck_psc();
+
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+    __HAL_RCC_GPIOC_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    __HAL_RCC_TIM8_CLK_ENABLE();
+
+    gpio.Pin       = GPIO_PIN_6;
+    gpio.Mode      = GPIO_MODE_AF_PP;
+    gpio.Pull      = GPIO_NOPULL;
+    gpio.Speed     = GPIO_SPEED_FREQ_LOW;
+    gpio.Alternate = CK_AF_TIM8;
+    HAL_GPIO_Init(GPIOC, &gpio);
+
+    gpio.Pull      = GPIO_PULLDOWN;
+    gpio.Alternate = CK_AF_TIM4;
+    HAL_GPIO_Init(GPIOB, &gpio);
+
+    ck_fill_table(psc);
+
+    /* DMA2 Stream2: the table into CCR1, one entry per update, circular. */
+    CK_DMA->CR = 0U;
+    while ((CK_DMA->CR & DMA_SxCR_EN) != 0U)
+    {
+    }
+    DMA2->LIFCR  = CK_DMA_S2_FLAGS;
+    CK_DMA->PAR  = (uint32_t)&TIM8->CCR1;
+    CK_DMA->M0AR = (uint32_t)&s_ckTable[0];
+    CK_DMA->NDTR = CRANK_TEETH;
+    CK_DMA->FCR  = 0U;
+    CK_DMA->CR   = (CK_DMA_CHSEL << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_MSIZE_0 | DMA_SxCR_PSIZE_0 |
+                   DMA_SxCR_MINC | DMA_SxCR_CIRC | DMA_SxCR_DIR_0;
+    CK_DMA->CR  |= DMA_SxCR_EN;
+
+    /* TIM8: a tooth period per update, CCR1 preloaded from the DMA; held
+     * low until the engine turns. An advanced timer: MOE gates the output. */
+    TIM8->CR1   = TIM_CR1_ARPE;
+    TIM8->CR2   = TIM_CR2_CCDS;
+    TIM8->PSC   = psc;
+    TIM8->ARR   = 0xFFFFU;
+    TIM8->CCR1  = 0U;
+    TIM8->CCMR1 = TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1PE;
+    TIM8->CCER  = TIM_CCER_CC1E;
+    TIM8->BDTR  = TIM_BDTR_MOE;
+    TIM8->DIER  = TIM_DIER_CC1DE;
+    TIM8->EGR   = TIM_EGR_UG;
+    TIM8->CR1  |= TIM_CR1_CEN;
+
+    /* TIM4 runs for the local time already; CH1 only adds a capture of
+     * rising edges with an 8-sample filter, and its interrupt. */
+    TIM4->CCMR1 = (TIM4->CCMR1 & ~(TIM_CCMR1_CC1S | TIM_CCMR1_IC1F | TIM_CCMR1_IC1PSC)) |
+                  TIM_CCMR1_CC1S_0 | TIM_CCMR1_IC1F_1 | TIM_CCMR1_IC1F_0;
+    TIM4->CCER  = (TIM4->CCER & ~(TIM_CCER_CC1P | TIM_CCER_CC1NP)) | TIM_CCER_CC1E;
+    TIM4->SR    = ~(TIM_SR_CC1IF | TIM_SR_CC1OF);
+    TIM4->DIER |= TIM_DIER_CC1IE;
+
+    s_ckSeenMs = HAL_GetTick();
+
+    HAL_NVIC_SetPriority(TIM4_IRQn, CRANK_IRQ_PRIO, 0U);
+    HAL_NVIC_EnableIRQ(TIM4_IRQn);
+
+    CLI_IF_REGISTER_TABLE(s_ckCmds);
+
+    return HAL_OK;
+}
+
+/*
+ * One tooth edge. Registers and integers only, state in one struct: the
+ * body is a few dozen cycles from RAM (ramfunc.h), and no FP context is
+ * stacked for it.
+ */
+RAMFUNC void Crank_CaptureIRQHandler(void)
+{
+    uint32_t t0 = DWT->CYCCNT;
+    CkIsr_t *k  = &s_ckIsr;
+
+    if ((TIM4->SR & TIM_SR_CC1OF) != 0U)
+    {
+        TIM4->SR = ~TIM_SR_CC1OF;
+        k->overcaptures++;
+    }
+
+    /* Reading CCR1 clears CC1IF. */
+    uint16_t t  = (uint16_t)TIM4->CCR1;
+    uint32_t dt = (uint16_t)(t - k->last);
+
+    k->last = t;
+    k->edges++;
+
+    if (s_ckRestart != 0U)
+    {
+        s_ckRestart = 0U;
+        k->sync     = (uint8_t)CRANK_NOSYNC;
+    }
+
+    uint32_t gap = ((2U * dt) > ((CRANK_MISSING + 2U) * (uint32_t)k->ref)) ? 1U : 0U;
+
+    switch (k->sync)
+    {
+    case CRANK_NOSYNC:
+        /* No tooth time yet. */
+        k->sync = (uint8_t)CRANK_SEEK;
+        k->ref  = 0U;
+        k->dt   = 0U;
+        break;
+
+    case CRANK_SEEK:
+        if ((k->ref != 0U) && (gap != 0U))
+        {
+            k->sync   = (uint8_t)CRANK_SYNC;
+            k->tooth  = 0U;
+            k->revAcc = 0U;
+            k->dt     = (uint16_t)(dt / (CRANK_MISSING + 1U));
+            k->syncs++;
+        }
+        else
+        {
+            k->ref = (uint16_t)dt;
+            k->dt  = (uint16_t)dt;
+        }
+        break;
+
+    default:
+        k->revAcc += dt;
+        if ((gap != 0U) && (k->tooth == CK_LAST))
+        {
+            /* Tooth 0, one revolution more. */
+            k->revUs  = k->revAcc;
+            k->revs++;
+            k->tooth  = 0U;
+            k->revAcc = 0U;
+            k->dt     = (uint16_t)(dt / (CRANK_MISSING + 1U));
+        }
+        else if ((gap != 0U) || (k->tooth == CK_LAST))
+        {
+            /* A gap out of place (or the wheel slowed down hard) or the gap
+             * did not come: look for it again against this tooth time. */
+            k->sync = (uint8_t)CRANK_SEEK;
+            k->ref  = (uint16_t)dt;
+            k->dt   = (uint16_t)dt;
+            k->losses++;
+        }
+        else
+        {
+            k->tooth++;
+            k->ref = (uint16_t)dt;
+            k->dt  = (uint16_t)dt;
+        }
+        break;
+    }
+
+#if ANGLE_SCHED_ENABLE
+    AngleSched_ToothIRQ(k->sync, k->tooth, t, dt);
+#endif
+
+    uint32_t c = DWT->CYCCNT - t0;
+    k->cycles += c;
+    if (c > k->cyclesMax)
+        k->cyclesMax = c;
+}
+
+void Crank_Event10ms(void)
+{
+    uint32_t now   = HAL_GetTick();
+    uint32_t bench = ck_bench_step(now);
+
+    if (bench != 0U)
+    {
+        ck_generate(bench);
+    }
+    else if (s_ckHoldRpm != 0U)
+    {
+        ck_generate(s_ckHoldRpm);
+    }
+    else
+    {
+        VehicleState_t vs;
+        Vehicle_GetSnapshot(&vs);
+        ck_generate(vs.engine_rpm);
+    }
+
+    /* Stalled before the microsecond counter can wrap between two edges. */
+    uint32_t edges = s_ckIsr.edges;
+    if (edges != s_ckSeenEdges)
+    {
+        s_ckSeenEdges = edges;
+        s_ckSeenMs    = now;
+        s_ckStalled   = 0U;
+    }
+    else if (((now - s_ckSeenMs) > CRANK_STALL_MS) && (s_ckStalled == 0U))
+    {
+        s_ckStalled = 1U;
+        s_ckRestart = 1U;
+        s_ckStalls++;
+    }
+}
+
+void Crank_SetGeneratorRpm(uint16_t rpm)
+{
+    s_ckHoldRpm = rpm;
+}
+
+void Crank_Get(Crank_State_t *out)
+{
+    CkIsr_t k;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    k = s_ckIsr;
+    uint16_t now = (uint16_t)TIM4->CNT;
+    __set_PRIMASK(primask);
+
+    uint8_t stalled = s_ckStalled;
+
+    memset(out, 0, sizeof(*out));
+    out->sync         = (stalled != 0U) ? (uint8_t)CRANK_NOSYNC : k.sync;
+    out->tooth        = k.tooth;
+    out->genRpm       = s_ckGenRpm;
+    out->edges        = k.edges;
+    out->revs         = k.revs;
+    out->syncs        = k.syncs;
+    out->losses       = k.losses;
+    out->stalls       = s_ckStalls;
+    out->overcaptures = k.overcaptures;
+    out->cyclesMax    = k.cyclesMax;
+
+    if ((stalled != 0U) || (k.dt == 0U))
+        return;
+
+    out->rpm    = (60.0f * CK_US_PER_S) / ((float)CRANK_TEETH * (float)k.dt);
+    out->revRpm = (k.revUs != 0U) ? ((60.0f * CK_US_PER_S) / (float)k.revUs) : 0.0f;
+
+    if (k.sync == (uint8_t)CRANK_SYNC)
+    {
+        /* Into the current tooth, at most up to its next edge. */
+        float span = (k.tooth == CK_LAST) ? (float)(CRANK_MISSING + 1U) : 1.0f;
+        float frac = (float)(uint16_t)(now - k.last) / (float)k.dt;
+
+        if (frac > span)
+            frac = span;
+        out->angleDeg = ((float)k.tooth + frac) * (360.0f / (float)CRANK_TEETH);
+    }
+}
+
+void Crank_ClockChanged(void)
+{
+    uint32_t psc = ck_psc();
+
+    /* The table only depends on the prescaler; the speed is re-set from
+     * the new clock at once. */
+    ck_fill_table(psc);
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    TIM8->CR1 |= TIM_CR1_UDIS;
+    TIM8->PSC  = psc;
+    TIM8->CR1 &= ~TIM_CR1_UDIS;
+    __set_PRIMASK(primask);
+
+    uint32_t rpm = s_ckGenRpm;
+    s_ckGenRpm = 0U;
+    ck_generate(rpm);
+
+    /* TimeSync_ClockChanged() restarted TIM4. */
+    s_ckRestart = 1U;
+}
+
+#else /* !CRANK_ENABLE */
+
+HAL_StatusTypeDef Crank_Init(void)
+{
+    return HAL_OK;
+}
+
+void Crank_Event10ms(void)
+{
+}
+
+void Crank_CaptureIRQHandler(void)
+{
+}
+
+void Crank_SetGeneratorRpm(uint16_t rpm)
+{
+    (void)rpm;
+}
+
+void Crank_Get(Crank_State_t *out)
+{
+    memset(out, 0, sizeof(*out));
+}
+
+void Crank_ClockChanged(void)
+{
+}
+
+#endif /* CRANK_ENABLE */
@@ -0,0 +1,609 @@
+/**
+ * @file    crash_dump.c
+ * @brief   Fault capture into no-init RAM, boot report and "crash".
+ */
+
+#include "crash_dump.h"
+#include "sram_layout.h"
+#include "cli_if.h"
+#include "fmt.h"
+#include "log.h"
+#include "rtos_stack.h"
+#include "cmsis_os2.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdio.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define CD_WORDS            ((sizeof(CrashDump_t) / 4U) - 1U)   /* without check */
+
+/* Memory a frame, a stack or a task name may be read from. */
+#define CD_RAM_START        SRAM1_BASE
+#define CD_RAM_END          (SRAM2_BASE + (16U * 1024U))
+
+#define CD_FRAME_BYTES      32U          /* R0-R3, R12, LR, PC, xPSR */
+#define CD_FP_FRAME_BYTES   72U          /* S0-S15, FPSCR, reserved */
+#define CD_XPSR_ALIGN       (1UL << 9)   /* one pad word was stacked */
+#define CD_SWITCH_WORDS     9U           /* port context switch: R4-R11, EXC_RETURN */
+#define CD_FP_SWITCH_BYTES  64U          /* S16-S31 with an FP frame */
+#define CD_EXC_THREAD       0x08U        /* EXC_RETURN: back to thread mode */
+#define CD_EXC_NO_FP        0x10U        /* EXC_RETURN: basic frame */
+#define CD_CONTROL_PSP      0x02U        /* CONTROL.SPSEL */
+
+/* IPSR exception numbers of the configurable faults. */
+#define CD_EXC_MEMMANAGE    4U
+#define CD_EXC_BUSFAULT     5U
+#define CD_EXC_USAGEFAULT   6U
+
+/* Output of "crash": lines wait for this much room in the log ring. */
+#define CD_PRINT_ROOM       160U
+#define CD_PRINT_TIMEOUT_MS 500U
+#define CD_RAW_LINE_BYTES   32U
+
+_Static_assert(CRASH_DUMP_TASK_LEN >= configMAX_TASK_NAME_LEN, "task names must fit the record");
+_Static_assert((CRASH_DUMP_LOG_BYTES % 4U) == 0U, "log[] keeps the record word aligned");
+
+typedef struct
+{
+    uint32_t    mask;
+    const char *name;
+} Cd_Bit_t;
+
+static const Cd_Bit_t s_cdCfsrBits[] =
+{
+    { SCB_CFSR_IACCVIOL_Msk,    "IACCVIOL"    },
+    { SCB_CFSR_DACCVIOL_Msk,    "DACCVIOL"    },
+    { SCB_CFSR_MUNSTKERR_Msk,   "MUNSTKERR"   },
+    { SCB_CFSR_MSTKERR_Msk,     "MSTKERR"     },
+    { SCB_CFSR_MLSPERR_Msk,     "MLSPERR"     },
+    { SCB_CFSR_MMARVALID_Msk,   "MMARVALID"   },
+    { SCB_CFSR_IBUSERR_Msk,     "IBUSERR"     },
+    { SCB_CFSR_PRECISERR_Msk,   "PRECISERR"   },
+    { SCB_CFSR_IMPRECISERR_Msk, "IMPRECISERR" },
+    { SCB_CFSR_UNSTKERR_Msk,    "UNSTKERR"    },
+    { SCB_CFSR_STKERR_Msk,      "STKERR"      },
+    { SCB_CFSR_LSPERR_Msk,      "LSPERR"      },
+    { SCB_CFSR_BFARVALID_Msk,   "BFARVALID"   },
+    { SCB_CFSR_UNDEFINSTR_Msk,  "UNDEFINSTR"  },
+    { SCB_CFSR_INVSTATE_Msk,    "INVSTATE"    },
+    { SCB_CFSR_INVPC_Msk,       "INVPC"       },
+    { SCB_CFSR_NOCP_Msk,        "NOCP"        },
+    { SCB_CFSR_UNALIGNED_Msk,   "UNALIGNED"   },
+    { SCB_CFSR_DIVBYZERO_Msk,   "DIVBYZERO"   },
+};
+
+static const Cd_Bit_t s_cdHfsrBits[] =
+{
+    { SCB_HFSR_VECTTBL_Msk,  "VECTTBL"  },
+    { SCB_HFSR_FORCED_Msk,   "FORCED"   },
+    { SCB_HFSR_DEBUGEVT_Msk, "DEBUGEVT" },
+};
+
+#define CD_CAUSE_NAME_(name, text)   text,
+static const char *const s_cdCauseNames[CRASH_DUMP_CAUSE_COUNT] = { CRASH_DUMP_CAUSE_TABLE(CD_CAUSE_NAME_) };
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Written by the fault path with interrupts off, otherwise by CliTask and
+ * the init code. */
+NOINIT static CrashDump_t s_cdRecord;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t cd_sum(const CrashDump_t *rec)
+{
+    const uint32_t *w = (const uint32_t *)rec;
+    uint32_t sum = 0U;
+
+    for (uint32_t i = 0U; i < CD_WORDS; ++i)
+        sum ^= w[i];
+    return ~sum;
+}
+
+static uint8_t cd_valid(const CrashDump_t *rec)
+{
+    return ((rec->magic == CRASH_DUMP_MAGIC) && (rec->version == CRASH_DUMP_VERSION) &&
+            (rec->check == cd_sum(rec))) ? 1U : 0U;
+}
+
+static uint8_t cd_in_ram(uint32_t addr, uint32_t len)
+{
+    return ((addr >= CD_RAM_START) && (addr < CD_RAM_END) && (len <= CD_RAM_END - addr)) ? 1U : 0U;
+}
+
+/** Start a record: interrupts off, counters, fault status registers. */
+static CrashDump_t *cd_begin(CrashDump_Cause_t cause)
+{
+    __disable_irq();
+
+    CrashDump_t *rec   = &s_cdRecord;
+    uint32_t     count = (cd_valid(rec) != 0U) ? (rec->count + 1U) : 1U;
+
+    memset(rec, 0, sizeof(*rec));
+    rec->magic    = CRASH_DUMP_MAGIC;
+    rec->version  = CRASH_DUMP_VERSION;
+    rec->cause    = (uint32_t)cause;
+    rec->count    = count;
+    rec->uptimeMs = HAL_GetTick();
+    rec->cfsr     = SCB->CFSR;
+    rec->hfsr     = SCB->HFSR;
+    rec->mmfar    = SCB->MMFAR;
+    rec->bfar     = SCB->BFAR;
+
+    return rec;
+}
+
+/** The name of @p task (NULL: the running one), if the kernel and its TCB
+ *  look sane. */
+static void cd_task(CrashDump_t *rec, TaskHandle_t task)
+{
+    if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED)
+        return;
+
+    if (task == NULL)
+        task = xTaskGetCurrentTaskHandle();
+    if ((task == NULL) || (cd_in_ram((uint32_t)task, 4U) == 0U))
+        return;
+
+    const char *name = pcTaskGetName(task);
+    if (cd_in_ram((uint32_t)name, configMAX_TASK_NAME_LEN) == 0U)
+        return;
+
+    for (uint32_t i = 0U; (i < (CRASH_DUMP_TASK_LEN - 1U)) && (name[i] != '\0'); ++i)
+        rec->task[i] = name[i];
+}
+
+/** Stack slice, task, log, seal; then reset or stop. */
+static void __attribute__((noreturn)) cd_finish(CrashDump_t *rec, TaskHandle_t task)
+{
+    uint32_t n = 0U;
+
+    if ((rec->sp & 3U) == 0U)
+    {
+        const uint32_t *sp = (const uint32_t *)rec->sp;
+
+        while ((n < CRASH_DUMP_STACK_WORDS) && (cd_in_ram(rec->sp + (n * 4U), 4U) != 0U))
+        {
+            rec->stack[n] = sp[n];
+            n++;
+        }
+    }
+    rec->stackWords = n;
+
+    cd_task(rec, task);
+#if (LOG_PM_SIZE > 0U)
+    rec->logLen = Log_PmTail(rec->log, sizeof(rec->log));
+#else
+    rec->logLen = Log_CopyRecent(rec->log, sizeof(rec->log));
+#endif
+    rec->check  = cd_sum(rec);
+    __DSB();
+
+    if ((CoreDebug->DHCSR & CoreDebug_DHCSR_C_DEBUGEN_Msk) != 0U)
+        __BKPT(0);
+
+#if CRASH_DUMP_RESET
+    NVIC_SystemReset();
+#endif
+
+    for (;;)
+    {
+    }
+}
+
+/** Registers and SP of @p task as it was last switched out. */
+static void cd_switched_out(CrashDump_t *rec, const void *task)
+{
+    uint32_t addr;
+
+    /* pxTopOfStack, the first TCB word: R4-R11, EXC_RETURN, S16-S31 if
+     * the task used the FPU, then the exception frame of its last switch. */
+    if (cd_in_ram((uint32_t)task, 4U) == 0U)
+        return;
+    addr = *(const uint32_t *)task;
+
+    if (((addr & 3U) == 0U) && (cd_in_ram(addr, CD_SWITCH_WORDS * 4U) != 0U))
+    {
+        const uint32_t *ctx = (const uint32_t *)addr;
+
+        for (uint32_t i = 0U; i < 8U; ++i)
+            rec->r[4U + i] = ctx[i];
+        rec->excReturn = ctx[8];
+        addr += CD_SWITCH_WORDS * 4U;
+        if ((rec->excReturn & CD_EXC_NO_FP) == 0U)
+        {
+            rec->flags |= CRASH_DUMP_FP_FRAME;
+            addr += CD_FP_SWITCH_BYTES;
+        }
+
+        if (cd_in_ram(addr, CD_FRAME_BYTES) != 0U)
+        {
+            const uint32_t *frame = (const uint32_t *)addr;
+
+            rec->flags |= CRASH_DUMP_FRAME;
+            rec->r[0]  = frame[0];
+            rec->r[1]  = frame[1];
+            rec->r[2]  = frame[2];
+            rec->r[3]  = frame[3];
+            rec->r[12] = frame[4];
+            rec->lr    = frame[5];
+            rec->pc    = frame[6];
+            rec->xpsr  = frame[7];
+
+            addr += CD_FRAME_BYTES;
+            if ((rec->flags & CRASH_DUMP_FP_FRAME) != 0U)
+                addr += CD_FP_FRAME_BYTES;
+            if ((rec->xpsr & CD_XPSR_ALIGN) != 0U)
+                addr += 4U;
+        }
+    }
+    rec->sp = addr;
+}
+
+/** Names of the bits of @p value set in @p bits, space separated. */
+static const char *cd_bit_names(const Cd_Bit_t *bits, uint32_t count, uint32_t value,
+                                char *buf, uint32_t len)
+{
+    uint32_t pos = 0U;
+
+    buf[0] = '\0';
+    for (uint32_t i = 0U; i < count; ++i)
+    {
+        if (((value & bits[i].mask) == 0U) || (pos >= len))
+            continue;
+        int n = FMT_SNPRINTF(&buf[pos], len - pos, "%s%s", (pos != 0U) ? " " : "", bits[i].name);
+        if (n > 0)
+            pos += (uint32_t)n;
+    }
+    return buf;
+}
+
+/** Print once the log ring has room, so a long report is not cut. */
+static void cd_print(const char *s)
+{
+    uint32_t start = HAL_GetTick();
+
+    for (;;)
+    {
+        Log_Stats_t st;
+        Log_GetStreamStats(LOG_STREAM_CLI, &st);
+
+        if (((st.ringSize - st.fill) >= CD_PRINT_ROOM) ||
+            ((HAL_GetTick() - start) >= CD_PRINT_TIMEOUT_MS))
+        {
+            break;
+        }
+        (void)osDelay(1U);
+    }
+
+    CLI_IF_Print(s);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void cd_show_log(const CrashDump_t *rec)
+{
+    char     line[CLI_PRINTF_MAX];
+    uint32_t n = 0U;
+
+#if LOG_TOKENIZED
+    (void)line;
+    (void)n;
+    CLI_IF_Printf("Log: %lu bytes, tokenized (\"crash raw\" + tools/crash_decode.py)\r\n",
+                  (unsigned long)rec->logLen);
+#else
+    CLI_IF_Printf("Log (last %lu bytes):\r\n", (unsigned long)rec->logLen);
+    for (uint32_t i = 0U; (i < rec->logLen) && (i < CRASH_DUMP_LOG_BYTES); ++i)
+    {
+        char c = rec->log[i];
+
+        line[n++] = ((c == '\r') || (c == '\n') || ((c >= ' ') && (c <= '~'))) ? c : '.';
+        if ((c == '\n') || (n >= sizeof(line) - 1U))
+        {
+            line[n] = '\0';
+            cd_print(line);
+            n = 0U;
+        }
+    }
+    if (n > 0U)
+    {
+        line[n] = '\0';
+        cd_print(line);
+        cd_print("\r\n");
+    }
+#endif
+}
+
+static void cd_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    const CrashDump_t *rec = CrashDump_Get();
+    char line[CLI_PRINTF_MAX];
+
+    if (rec == NULL)
+    {
+        CLI_IF_Print("No crash recorded\r\n");
+        return;
+    }
+
+    CLI_IF_Printf("Crash #%lu, %lu boot(s) ago: %s after %lu ms\r\n",
+                  (unsigned long)rec->count, (unsigned long)rec->bootsSince,
+                  CrashDump_CauseName(rec->cause), (unsigned long)rec->uptimeMs);
+    if ((rec->flags & CRASH_DUMP_IN_HANDLER) != 0U)
+        CLI_IF_Printf("In exception %lu (task %s interrupted)\r\n",
+                      (unsigned long)(rec->xpsr & 0x1FFU), (rec->task[0] != '\0') ? rec->task : "-");
+    else
+        CLI_IF_Printf("In task %s\r\n", (rec->task[0] != '\0') ? rec->task : "- (scheduler not started)");
+
+    CLI_IF_Printf("PC   0x%08lX  LR   0x%08lX  SP   0x%08lX\r\n",
+                  (unsigned long)rec->pc, (unsigned long)rec->lr, (unsigned long)rec->sp);
+    if ((rec->flags & CRASH_DUMP_FRAME) != 0U)
+    {
+        CLI_IF_Printf("xPSR 0x%08lX  EXC_RETURN 0x%08lX%s\r\n", (unsigned long)rec->xpsr,
+                      (unsigned long)rec->excReturn,
+                      ((rec->flags & CRASH_DUMP_FP_FRAME) != 0U) ? " (FP frame)" : "");
+        for (uint32_t i = 0U; i < 13U; i += 4U)
+        {
+            uint32_t pos = 0U;
+
+            for (uint32_t j = i; (j < i + 4U) && (j < 13U); ++j)
+            {
+                pos += (uint32_t)FMT_SNPRINTF(&line[pos], sizeof(line) - pos, "R%-2lu  0x%08lX  ",
+                                              (unsigned long)j, (unsigned long)rec->r[j]);
+            }
+            (void)FMT_SNPRINTF(&line[pos], sizeof(line) - pos, "\r\n");
+            cd_print(line);
+        }
+    }
+    else if (rec->cause <= CRASH_DUMP_CAUSE_USAGEFAULT)
+    {
+        CLI_IF_Print("No exception frame (stacking fault or SP outside RAM)\r\n");
+    }
+
+    CLI_IF_Printf("CFSR 0x%08lX %s\r\n", (unsigned long)rec->cfsr,
+                  cd_bit_names(s_cdCfsrBits, (uint32_t)(sizeof(s_cdCfsrBits) / sizeof(s_cdCfsrBits[0])),
+                               rec->cfsr, line, sizeof(line)));
+    CLI_IF_Printf("HFSR 0x%08lX %s\r\n", (unsigned long)rec->hfsr,
+                  cd_bit_names(s_cdHfsrBits, (uint32_t)(sizeof(s_cdHfsrBits) / sizeof(s_cdHfsrBits[0])),
+                               rec->hfsr, line, sizeof(line)));
+    if ((rec->cfsr & SCB_CFSR_MMARVALID_Msk) != 0U)
+        CLI_IF_Printf("MMFAR 0x%08lX\r\n", (unsigned long)rec->mmfar);
+    if ((rec->cfsr & SCB_CFSR_BFARVALID_Msk) != 0U)
+        CLI_IF_Printf("BFAR 0x%08lX\r\n", (unsigned long)rec->bfar);
+
+    CLI_IF_Printf("Stack (%lu words from SP):\r\n", (unsigned long)rec->stackWords);
+    for (uint32_t i = 0U; i < rec->stackWords; i += 4U)
+    {
+        uint32_t pos = (uint32_t)FMT_SNPRINTF(line, sizeof(line), "  0x%08lX:",
+                                              (unsigned long)(rec->sp + (i * 4U)));
+
+        for (uint32_t j = i; (j < i + 4U) && (j < rec->stackWords); ++j)
+            pos += (uint32_t)FMT_SNPRINTF(&line[pos], sizeof(line) - pos, " %08lX", (unsigned long)rec->stack[j]);
+        (void)FMT_SNPRINTF(&line[pos], sizeof(line) - pos, "\r\n");
+        cd_print(line);
+    }
+
+    cd_show_log(rec);
+}
+
+/** The record in hex, CD_RAW_LINE_BYTES per line, for crash_decode.py. */
+static void cd_cmd_raw(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    const CrashDump_t *rec = CrashDump_Get();
+    const uint8_t     *p   = (const uint8_t *)&s_cdRecord;
+    char line[8U + (2U * CD_RAW_LINE_BYTES) + 3U];
+
+    if (rec == NULL)
+    {
+        CLI_IF_Print("No crash recorded\r\n");
+        return;
+    }
+
+    CLI_IF_Printf("crash raw %lu bytes\r\n", (unsigned long)sizeof(CrashDump_t));
+    for (uint32_t off = 0U; off < sizeof(CrashDump_t); off += CD_RAW_LINE_BYTES)
+    {
+        uint32_t len = ((sizeof(CrashDump_t) - off) < CD_RAW_LINE_BYTES)
+                           ? (uint32_t)(sizeof(CrashDump_t) - off) : CD_RAW_LINE_BYTES;
+        uint32_t pos = Fmt_Hex(line, off, 4U);
+
+        line[pos++] = ':';
+        line[pos++] = ' ';
+        pos += Fmt_HexBytes(&line[pos], &p[off], len, '\0');
+        line[pos++] = '\r';
+        line[pos++] = '\n';
+        line[pos]   = '\0';
+        cd_print(line);
+    }
+}
+
+static void cd_cmd_clear(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CrashDump_Clear();
+    CLI_IF_Print("Crash record cleared\r\n");
+}
+
+/** Deliberate faults, to check the capture on the target. */
+static void cd_cmd_test(int argc, char *argv[])
+{
+    (void)argc;
+
+    if (strcmp(argv[0], "bus") == 0)
+    {
+        /* Unmapped FMC bank: precise BusFault with BFAR */
+        volatile uint32_t v = *(volatile const uint32_t *)0x60000000U;
+        (void)v;
+    }
+    else if (strcmp(argv[0], "usage") == 0)
+    {
+        __asm volatile ("udf #0");
+    }
+    else if (strcmp(argv[0], "error") == 0)
+    {
+        Error_Handler();
+    }
+    else
+    {
+        CLI_IF_Print("Usage: crash test <bus|usage|error>\r\n");
+    }
+}
+
+static const CliCommand_t s_cdCmds[] =
+{
+    { "crash",       "",                   0U, cd_cmd_show,  "Last crash: cause, registers, fault status, stack, log" },
+    { "crash raw",   "",                   0U, cd_cmd_raw,   "Last crash record in hex (tools/crash_decode.py)" },
+    { "crash clear", "",                   0U, cd_cmd_clear, "Discard the crash record" },
+    { "crash test",  "<bus|usage|error>",  1U, cd_cmd_test,  "Fault on purpose (resets the ECU)" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void CrashDump_Init(void)
+{
+    /* Faults get their own handler and status instead of a forced HardFault. */
+    SCB->SHCSR |= SCB_SHCSR_MEMFAULTENA_Msk | SCB_SHCSR_BUSFAULTENA_Msk | SCB_SHCSR_USGFAULTENA_Msk;
+
+    CrashDump_t *rec = &s_cdRecord;
+    if (cd_valid(rec) != 0U)
+    {
+        if (rec->bootsSince == 0U)
+        {
+            LOG_ERROR(MAIN, "Crash: %s at PC 0x%08lX LR 0x%08lX in %s, CFSR 0x%08lX HFSR 0x%08lX (\"crash\")",
+                      CrashDump_CauseName(rec->cause), (unsigned long)rec->pc, (unsigned long)rec->lr,
+                      (rec->task[0] != '\0') ? rec->task : "-",
+                      (unsigned long)rec->cfsr, (unsigned long)rec->hfsr);
+        }
+        rec->bootsSince++;
+        rec->check = cd_sum(rec);
+    }
+
+    CLI_IF_REGISTER_TABLE(s_cdCmds);
+}
+
+const CrashDump_t *CrashDump_Get(void)
+{
+    return (cd_valid(&s_cdRecord) != 0U) ? &s_cdRecord : NULL;
+}
+
+void CrashDump_Clear(void)
+{
+    s_cdRecord.magic = 0U;
+    s_cdRecord.check = 0U;
+}
+
+const char *CrashDump_CauseName(uint32_t cause)
+{
+    return (cause < CRASH_DUMP_CAUSE_COUNT) ? s_cdCauseNames[cause] : "?";
+}
+
+void CrashDump_Fault(const uint32_t *frame, uint32_t excReturn, const uint32_t *r4r11)
+{
+    CrashDump_Cause_t cause;
+
+    switch (__get_IPSR())
+    {
+        case CD_EXC_MEMMANAGE:  cause = CRASH_DUMP_CAUSE_MEMMANAGE;  break;
+        case CD_EXC_BUSFAULT:   cause = CRASH_DUMP_CAUSE_BUSFAULT;   break;
+        case CD_EXC_USAGEFAULT: cause = CRASH_DUMP_CAUSE_USAGEFAULT; break;
+        default:                cause = CRASH_DUMP_CAUSE_HARDFAULT;  break;
+    }
+
+    /* A store into a stack guard (RTOS_STACK_GUARD, rtos_stack.h) is an
+     * overrun of the running task, or of the interrupts on the MSP. */
+    if ((cause != CRASH_DUMP_CAUSE_BUSFAULT) && (cause != CRASH_DUMP_CAUSE_USAGEFAULT) &&
+        (RtosStack_GuardHit(SCB->CFSR, SCB->MMFAR) != 0U))
+        cause = CRASH_DUMP_CAUSE_STACK;
+
+    CrashDump_t *rec  = cd_begin(cause);
+    uint32_t     addr = (uint32_t)frame;
+
+    rec->excReturn = excReturn;
+    for (uint32_t i = 0U; i < 8U; ++i)
+        rec->r[4U + i] = r4r11[i];
+
+    /* A frame that faulted while being stacked is not there to read. */
+    if (((rec->cfsr & (SCB_CFSR_MSTKERR_Msk | SCB_CFSR_STKERR_Msk)) == 0U) &&
+        ((addr & 3U) == 0U) && (cd_in_ram(addr, CD_FRAME_BYTES) != 0U))
+    {
+        rec->flags |= CRASH_DUMP_FRAME;
+        rec->r[0]  = frame[0];
+        rec->r[1]  = frame[1];
+        rec->r[2]  = frame[2];
+        rec->r[3]  = frame[3];
+        rec->r[12] = frame[4];
+        rec->lr    = frame[5];
+        rec->pc    = frame[6];
+        rec->xpsr  = frame[7];
+
+        /* SP before the exception: past the frame, the FP part and the pad. */
+        addr += CD_FRAME_BYTES;
+        if ((excReturn & CD_EXC_NO_FP) == 0U)
+        {
+            rec->flags |= CRASH_DUMP_FP_FRAME;
+            addr += CD_FP_FRAME_BYTES;
+        }
+        if ((rec->xpsr & CD_XPSR_ALIGN) != 0U)
+            addr += 4U;
+    }
+    rec->sp = addr;
+
+    if ((excReturn & CD_EXC_THREAD) == 0U)
+        rec->flags |= CRASH_DUMP_IN_HANDLER;
+
+    cd_finish(rec, NULL);
+}
+
+void CrashDump_Halt(CrashDump_Cause_t cause, uint32_t pc)
+{
+    uint32_t     ipsr = __get_IPSR();
+    uint32_t     sp   = ((ipsr == 0U) && ((__get_CONTROL() & CD_CONTROL_PSP) != 0U)) ? __get_PSP() : __get_MSP();
+    CrashDump_t *rec  = cd_begin(cause);
+
+    rec->pc   = pc;
+    rec->sp   = sp;
+    rec->xpsr = ipsr;
+    if (ipsr != 0U)
+        rec->flags |= CRASH_DUMP_IN_HANDLER;
+
+    cd_finish(rec, NULL);
+}
+
+void CrashDump_Watchdog(void *task)
+{
+    CrashDump_t *rec = cd_begin(CRASH_DUMP_CAUSE_WATCHDOG);
+
+    cd_switched_out(rec, task);
+    cd_finish(rec, (TaskHandle_t)task);
+}
+
+void CrashDump_StackOverflow(void *task)
+{
+    CrashDump_t *rec = cd_begin(CRASH_DUMP_CAUSE_STACK);
+
+    cd_switched_out(rec, task);
+    cd_finish(rec, (TaskHandle_t)task);
+}
+
+void CrashDump_Assert(void)
+{
+    CrashDump_Halt(CRASH_DUMP_CAUSE_ASSERT, (uint32_t)__builtin_return_address(0));
+}
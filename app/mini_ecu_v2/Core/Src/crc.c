@@ -0,0 +1,51 @@
+/**
+ * @file    crc.c
+ * @brief   Nibble-table CRC-16/CCITT-FALSE and CRC-32/MPEG-2.
+ */
+
+#include "crc.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/** CRC of each nibble value shifted in at the top. */
+static const uint16_t s_crcNib[16] =
+{
+    0x0000U, 0x1021U, 0x2042U, 0x3063U, 0x4084U, 0x50A5U, 0x60C6U, 0x70E7U,
+    0x8108U, 0x9129U, 0xA14AU, 0xB16BU, 0xC18CU, 0xD1ADU, 0xE1CEU, 0xF1EFU
+};
+
+/** CRC-32 of each nibble value: (n << 28) shifted through 4 steps. */
+static const uint32_t s_crcNib32[16] =
+{
+    0x00000000U, 0x04C11DB7U, 0x09823B6EU, 0x0D4326D9U,
+    0x130476DCU, 0x17C56B6BU, 0x1A864DB2U, 0x1E475005U,
+    0x2608EDB8U, 0x22C9F00FU, 0x2F8AD6D6U, 0x2B4BCB61U,
+    0x350C9B64U, 0x31CD86D3U, 0x3C8EA00AU, 0x384FBDBDU
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+uint16_t Crc_Ccitt16(uint16_t crc, const uint8_t *data, uint32_t len)
+{
+    for (uint32_t i = 0U; i < len; ++i)
+    {
+        crc = (uint16_t)((crc << 4) ^ s_crcNib[(crc >> 12) ^ (data[i] >> 4)]);
+        crc = (uint16_t)((crc << 4) ^ s_crcNib[(crc >> 12) ^ (data[i] & 0x0FU)]);
+    }
+    return crc;
+}
+
+uint32_t Crc_Mpeg32(uint32_t crc, const uint32_t *words, uint32_t count)
+{
+    for (uint32_t i = 0U; i < count; ++i)
+    {
+        crc ^= words[i];
+        for (uint32_t k = 0U; k < 8U; ++k)
+            crc = (crc << 4) ^ s_crcNib32[crc >> 28];
+    }
+    return crc;
+}
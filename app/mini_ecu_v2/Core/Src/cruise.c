@@ -0,0 +1,386 @@
+/**
+ * @file    cruise.c
+ * @brief   Cruise control PI, its rate limit and "veh cruise".
+ */
+
+#include "cruise.h"
+#include "audit.h"
+#include "cal.h"
+#include "cli_if.h"
+#include "log.h"
+#include "pedal.h"
+#include "speed_est.h"
+#include "vehicle_shared.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if CRUISE_ENABLE
+
+_Static_assert((CRUISE_HZ == 100U) || (CRUISE_HZ == 1000U),
+               "CRUISE_HZ must be 100 or 1000 (a raster)");
+_Static_assert((CRUISE_MIN_KPH > 0.0f) && (CRUISE_MIN_KPH < CRUISE_MAX_KPH),
+               "CRUISE_MIN_KPH must be above 0 and below CRUISE_MAX_KPH");
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define CR_Q16_ONE          65536.0f
+#define CR_Q24_ONE          (1L << 24)
+
+/** Throttle change per step (Q24). */
+#define CR_SLEW_Q24         ((int32_t)((CRUISE_SLEW_PER_S * (float)CR_Q24_ONE) / (float)CRUISE_HZ))
+
+_Static_assert(CR_SLEW_Q24 > 0, "CRUISE_SLEW_PER_S is below one Q24 step");
+
+/** s_crRequest: nothing new, disengage; a set speed is Q16 km/h. */
+#define CR_REQ_NONE         (-2)
+#define CR_REQ_OFF          (-1)
+
+/** Fixed-point form of the calibration, keyed by the float values. */
+typedef struct
+{
+    float   kp;
+    float   ki;
+    int32_t kpQ24;      /* throttle per km/h */
+    int32_t kiQ24;      /* throttle per km/h and step */
+} Cruise_Gains_t;
+
+/** Loop state in its fixed-point form; published under PRIMASK. */
+typedef struct
+{
+    uint8_t  engaged;
+    uint8_t  override;
+    int32_t  spQ16;
+    int32_t  measQ16;
+    int32_t  errQ16;
+    int32_t  pQ24;
+    int32_t  iQ24;
+    int32_t  outQ24;
+    uint32_t steps;
+    uint32_t saturated;
+    uint32_t limited;
+    uint32_t overrides;
+    uint32_t cancels;
+} Cruise_Raw_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Control task only. */
+static Cruise_Gains_t s_crGains;
+static Cruise_Raw_t   s_crWork;
+
+/* Published; readers copy under PRIMASK. */
+static Cruise_Raw_t   s_crCopy;
+
+/* Commanded throttle (Q24), 0 while disengaged; one word, any reader. */
+static volatile int32_t s_crOutQ24 = 0;
+
+/* Set by the CLI, taken by the next step. The raster task preempts
+ * CliTask, never the other way round, so the step reads and clears it
+ * undisturbed. */
+static volatile int32_t s_crRequest = CR_REQ_NONE;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static int32_t cruise_clamp(int64_t v, int32_t lo, int32_t hi)
+{
+    if (v < lo)
+        return lo;
+    if (v > hi)
+        return hi;
+    return (int32_t)v;
+}
+
+/** Re-derive the fixed-point gains when the calibration changed. */
+static void cruise_gains(void)
+{
+    const float kp = CAL_F(CRUISE_KP);
+    const float ki = CAL_F(CRUISE_KI);
+
+    if ((kp == s_crGains.kp) && (ki == s_crGains.ki))
+        return;
+
+    s_crGains.kp    = kp;
+    s_crGains.ki    = ki;
+    s_crGains.kpQ24 = (int32_t)(kp * (float)CR_Q24_ONE);
+    s_crGains.kiQ24 = (int32_t)((ki * (float)CR_Q24_ONE) / (float)CRUISE_HZ);
+}
+
+/** Take a request from the CLI into the loop. */
+static void cruise_request(Cruise_Raw_t *w)
+{
+    int32_t req = s_crRequest;
+
+    if (req == CR_REQ_NONE)
+        return;
+    s_crRequest = CR_REQ_NONE;
+
+    if (req == CR_REQ_OFF)
+    {
+        w->engaged = 0U;
+        return;
+    }
+
+    /* Bumpless: a newly engaged loop starts from the model's throttle. */
+    if (w->engaged == 0U)
+    {
+        VehicleState_t vs;
+        Vehicle_GetSnapshot(&vs);
+
+        w->iQ24   = cruise_clamp((int64_t)(vs.throttle * (float)CR_Q24_ONE), 0, CR_Q24_ONE);
+        w->outQ24 = w->iQ24;
+    }
+    w->engaged = 1U;
+    w->spQ16   = req;
+}
+
+static void cruise_publish(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_crCopy = s_crWork;
+    __set_PRIMASK(primask);
+}
+
+static float cruise_frac(int32_t q24)
+{
+    return (float)q24 / (float)CR_Q24_ONE;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void cruise_cmd_show(void)
+{
+    Cruise_Status_t st;
+
+    Cruise_GetStatus(&st);
+
+    if (st.engaged == 0U)
+    {
+        CLI_IF_Printf("Cruise off, %u Hz PI; set %.0f .. %.0f km/h with \"veh cruise <kph>\"\r\n",
+                      (unsigned)CRUISE_HZ, (double)CRUISE_MIN_KPH, (double)CRUISE_MAX_KPH);
+    }
+    else
+    {
+        CLI_IF_Printf("Cruise at %.1f km/h, %u Hz PI: throttle %.1f %%%s\r\n",
+                      (double)st.setpoint, (unsigned)CRUISE_HZ, (double)(st.throttle * 100.0f),
+                      (st.override != 0U) ? ", pedal overrides" : "");
+        CLI_IF_Printf("Speed %.2f km/h, error %+.2f km/h: P %.1f %%, I %.1f %%\r\n",
+                      (double)st.measured, (double)st.error,
+                      (double)(st.p * 100.0f), (double)(st.i * 100.0f));
+    }
+    CLI_IF_Printf("%lu steps, %lu saturated, %lu rate limited, %lu overridden, %lu cancelled; "
+                  "Kp %.3f /(km/h), Ki %.3f /(km/h s), slew %.2f /s\r\n",
+                  (unsigned long)st.steps, (unsigned long)st.saturated,
+                  (unsigned long)st.limited, (unsigned long)st.overrides,
+                  (unsigned long)st.cancels, (double)CAL_F(CRUISE_KP),
+                  (double)CAL_F(CRUISE_KI), (double)CRUISE_SLEW_PER_S);
+}
+
+static void cruise_cmd(int argc, char *argv[])
+{
+    if (argc == 0)
+    {
+        cruise_cmd_show();
+        return;
+    }
+
+    if (strcmp(argv[0], "off") == 0)
+    {
+        Cruise_Set(-1.0f);
+        Audit_RecordF(AUDIT_CMD_VEH_CRUISE, AUDIT_SRC_CLI, 0.0f, 0U);
+        LOG_INFO(CLI, "Cruise off");
+        CLI_IF_Print("OK: cruise off\r\n");
+        return;
+    }
+
+    char *end = NULL;
+    float kph = strtof(argv[0], &end);
+
+    if ((end == argv[0]) || (*end != '\0') || (kph < CRUISE_MIN_KPH) || (kph > CRUISE_MAX_KPH))
+    {
+        CLI_IF_Printf("Set speed: %.0f..%.0f (km/h) or off\r\n",
+                      (double)CRUISE_MIN_KPH, (double)CRUISE_MAX_KPH);
+        return;
+    }
+
+    Cruise_Set(kph);
+    Audit_RecordF(AUDIT_CMD_VEH_CRUISE, AUDIT_SRC_CLI, kph, 0U);
+    LOG_INFO(CLI, "Cruise at %.1f km/h", (double)kph);
+    CLI_IF_Print("OK: cruise engaged\r\n");
+}
+
+static const CliCommand_t s_crCmds[] =
+{
+    { "veh cruise", "[<kph>|off]", 0U, cruise_cmd, "hold a speed with the throttle PI, or show it" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void Cruise_Init(void)
+{
+    cruise_gains();
+    cruise_publish();
+
+    CLI_IF_REGISTER_TABLE(s_crCmds);
+}
+
+void Cruise_Step(void)
+{
+    Cruise_Raw_t *w = &s_crWork;
+
+    cruise_request(w);
+    if (w->engaged == 0U)
+    {
+        if (s_crOutQ24 != 0)
+        {
+            s_crOutQ24 = 0;
+            w->outQ24  = 0;
+            cruise_publish();
+        }
+        return;
+    }
+
+    float kph;
+    if (SpeedEst_GetKph(&kph) == 0U)
+    {
+        /* No speed, no cruise: the car coasts. */
+        w->engaged = 0U;
+        w->outQ24  = 0;
+        w->cancels++;
+        s_crOutQ24 = 0;
+        cruise_publish();
+        LOG_WARN(VEH, "Cruise cancelled: speed estimate invalid");
+        return;
+    }
+
+    if (kph < 0.0f)
+        kph = 0.0f;
+    else if (kph > 300.0f)
+        kph = 300.0f;
+
+    Pedal_State_t pedal;
+    Pedal_Get(&pedal);
+
+    cruise_gains();
+
+    w->measQ16 = (int32_t)(kph * CR_Q16_ONE);
+    w->errQ16  = w->spQ16 - w->measQ16;
+    w->steps++;
+
+    int32_t p   = cruise_clamp(((int64_t)s_crGains.kpQ24 * w->errQ16) >> 16,
+                               -2 * CR_Q24_ONE, 2 * CR_Q24_ONE);
+    int32_t di  = (int32_t)(((int64_t)s_crGains.kiQ24 * w->errQ16) >> 16);
+    int32_t i   = cruise_clamp((int64_t)w->iQ24 + di, 0, CR_Q24_ONE);
+    int32_t raw = p + i;
+    int32_t u   = cruise_clamp(raw, 0, CR_Q24_ONE);
+
+    if ((raw < 0) || (raw > CR_Q24_ONE))
+        w->saturated++;
+
+    /* Rate limit from the last output. */
+    if (u > (w->outQ24 + CR_SLEW_Q24))
+    {
+        u = w->outQ24 + CR_SLEW_Q24;
+        w->limited++;
+    }
+    else if (u < (w->outQ24 - CR_SLEW_Q24))
+    {
+        u = w->outQ24 - CR_SLEW_Q24;
+        w->limited++;
+    }
+
+    /* Anti-windup: no integration further into a held output, nor while
+     * the pedal drives the throttle instead. */
+    w->override = (pedal.throttle > cruise_frac(u)) ? 1U : 0U;
+    if (w->override != 0U)
+        w->overrides++;
+    if ((w->override != 0U) || ((raw > u) && (di > 0)) || ((raw < u) && (di < 0)))
+        i = w->iQ24;
+
+    w->pQ24    = p;
+    w->iQ24    = i;
+    w->outQ24  = u;
+    s_crOutQ24 = u;
+    cruise_publish();
+}
+
+float Cruise_GetThrottle(void)
+{
+    return cruise_frac(s_crOutQ24);
+}
+
+void Cruise_GetStatus(Cruise_Status_t *out)
+{
+    Cruise_Raw_t raw;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    raw = s_crCopy;
+    __set_PRIMASK(primask);
+
+    out->engaged   = raw.engaged;
+    out->override  = raw.override;
+    out->setpoint  = (float)raw.spQ16 / CR_Q16_ONE;
+    out->measured  = (float)raw.measQ16 / CR_Q16_ONE;
+    out->error     = (float)raw.errQ16 / CR_Q16_ONE;
+    out->p         = cruise_frac(raw.pQ24);
+    out->i         = cruise_frac(raw.iQ24);
+    out->throttle  = cruise_frac(raw.outQ24);
+    out->steps     = raw.steps;
+    out->saturated = raw.saturated;
+    out->limited   = raw.limited;
+    out->overrides = raw.overrides;
+    out->cancels   = raw.cancels;
+}
+
+void Cruise_Set(float kph)
+{
+    if (kph < 0.0f)
+    {
+        s_crRequest = CR_REQ_OFF;
+        return;
+    }
+
+    if (kph < CRUISE_MIN_KPH)
+        kph = CRUISE_MIN_KPH;
+    else if (kph > CRUISE_MAX_KPH)
+        kph = CRUISE_MAX_KPH;
+    s_crRequest = (int32_t)(kph * CR_Q16_ONE);
+}
+
+#else /* !CRUISE_ENABLE */
+
+void Cruise_Init(void)
+{
+}
+
+void Cruise_Step(void)
+{
+}
+
+float Cruise_GetThrottle(void)
+{
+    return 0.0f;
+}
+
+void Cruise_GetStatus(Cruise_Status_t *out)
+{
+    memset(out, 0, sizeof(*out));
+}
+
+void Cruise_Set(float kph)
+{
+    (void)kph;
+}
+
+#endif /* CRUISE_ENABLE */
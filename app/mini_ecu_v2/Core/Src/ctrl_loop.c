@@ -0,0 +1,305 @@
+/**
+ * @file    ctrl_loop.c
+ * @brief   Control loop release sources, cycle figures and the "loop" commands.
+ */
+
+#include "ctrl_loop.h"
+#include "cli_if.h"
+#include "clock_cfg.h"
+#include "ramfunc.h"
+#include "sys_config.h"
+#include "FreeRTOS.h"
+#include <string.h>
+
+_Static_assert((CTRL_LOOP_HZ >= 10U) && (CTRL_LOOP_HZ <= 1000U) && ((CTRL_LOOP_HZ % 10U) == 0U),
+               "CTRL_LOOP_HZ must be a multiple of 10 in 10..1000");
+_Static_assert((configTICK_RATE_HZ % CTRL_LOOP_HZ) == 0U,
+               "CTRL_LOOP_HZ must divide the kernel tick rate");
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define CL_PERIOD_TICKS     (configTICK_RATE_HZ / CTRL_LOOP_HZ)
+#define CL_US_PER_TICK      (1000000U / configTICK_RATE_HZ)
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Written by the control task, "missed" also by the TIM5 interrupt;
+ * readers copy under PRIMASK. */
+static CtrlLoop_Stats_t s_clStats;
+
+static osThreadId_t s_clThread  = NULL;
+static uint32_t     s_clStart   = 0U;   /* CYCCNT at the start of the step */
+
+#if CTRL_LOOP_SOURCE == CTRL_LOOP_SOURCE_TIM5
+static volatile uint8_t s_clPending = 0U;   /* released, not yet taken */
+#else
+static uint32_t s_clWake = 0U;              /* tick the next cycle is due on */
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static void ctrl_record(CtrlLoop_Hist_t *h, uint32_t us)
+{
+    /* Bucket = bit length of the time in us, as in can_lat.c. */
+    uint32_t b = 32U - __CLZ(us);
+    if (b >= CTRL_LOOP_BUCKETS)
+        b = CTRL_LOOP_BUCKETS - 1U;
+
+    h->count++;
+    h->sumUs += us;
+    if (us > h->maxUs)
+        h->maxUs = us;
+    h->hist[b]++;
+}
+
+static void ctrl_record_jitter(uint32_t us)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    ctrl_record(&s_clStats.jitter, us);
+    __set_PRIMASK(primask);
+}
+
+static uint32_t ctrl_cycles_to_us(uint32_t cycles)
+{
+    uint32_t cyclesPerUs = SystemCoreClock / 1000000U;
+
+    return cycles / ((cyclesPerUs != 0U) ? cyclesPerUs : 1U);
+}
+
+/* -------------------------------------------------------------------------- */
+/* TIM5 source                                                                */
+/* -------------------------------------------------------------------------- */
+
+#if CTRL_LOOP_SOURCE == CTRL_LOOP_SOURCE_TIM5
+
+static HAL_StatusTypeDef ctrl_source_init(void)
+{
+    __HAL_RCC_TIM5_CLK_ENABLE();
+
+    /* 1 MHz count, update every period. */
+    TIM5->CR1  = 0U;
+    TIM5->PSC  = (ClockCfg_TimerHz() / 1000000U) - 1U;
+    TIM5->ARR  = CTRL_LOOP_PERIOD_US - 1U;
+    TIM5->EGR  = TIM_EGR_UG;
+    TIM5->SR   = 0U;
+    TIM5->DIER = TIM_DIER_UIE;
+
+    /* Highest priority that may still use the RTOS API. */
+    HAL_NVIC_SetPriority(TIM5_IRQn, SYS_IRQ_PRIO_CtrlLoop, 0U);
+    HAL_NVIC_EnableIRQ(TIM5_IRQn);
+
+    return HAL_OK;
+}
+
+static HAL_StatusTypeDef ctrl_source_start(void)
+{
+    TIM5->CR1 |= TIM_CR1_CEN;
+    return HAL_OK;
+}
+
+static uint32_t ctrl_source_wait(void)
+{
+    (void)osThreadFlagsWait(CTRL_LOOP_FLAG, osFlagsWaitAny, osWaitForever);
+    s_clPending = 0U;
+
+    /* The counter restarted at the update, so it reads the latency. */
+    return TIM5->CNT;
+}
+
+RAMFUNC void CtrlLoop_TimerIRQHandler(void)
+{
+    TIM5->SR = ~TIM_SR_UIF;
+
+    if (s_clPending != 0U)
+        s_clStats.missed++;
+    s_clPending = 1U;
+
+    if (s_clThread != NULL)
+        (void)osThreadFlagsSet(s_clThread, CTRL_LOOP_FLAG);
+}
+
+#else /* CTRL_LOOP_SOURCE_RTOS */
+
+static HAL_StatusTypeDef ctrl_source_init(void)
+{
+    return HAL_OK;
+}
+
+static HAL_StatusTypeDef ctrl_source_start(void)
+{
+    s_clWake = osKernelGetTickCount();
+    return HAL_OK;
+}
+
+static uint32_t ctrl_source_wait(void)
+{
+    s_clWake += CL_PERIOD_TICKS;
+
+    /* A wake time already past means the task is a period or more late:
+     * skip the lost releases and continue from now. */
+    if (osDelayUntil(s_clWake) != osOK)
+    {
+        uint32_t now = osKernelGetTickCount();
+
+        s_clStats.missed += (now - s_clWake) / CL_PERIOD_TICKS;
+        s_clWake = now;
+    }
+
+    /* Whole ticks since the due one plus the part of the current tick;
+     * a tick interrupt pending between the two reads adds one more. */
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t elapsed = SysTick->LOAD - SysTick->VAL;
+    uint32_t ticks   = osKernelGetTickCount() - s_clWake;
+    if ((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0U)
+        ticks++;
+    __set_PRIMASK(primask);
+
+    return (ticks * CL_US_PER_TICK) + ctrl_cycles_to_us(elapsed);
+}
+
+void CtrlLoop_TimerIRQHandler(void)
+{
+}
+
+#endif /* CTRL_LOOP_SOURCE */
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void ctrl_print_hist(const char *name, const CtrlLoop_Hist_t *h)
+{
+    CLI_IF_Printf("%-7s %8lu %8lu\r\n", name,
+                  (unsigned long)((h->count != 0U) ? (h->sumUs / h->count) : 0U),
+                  (unsigned long)h->maxUs);
+
+    /* Non-empty buckets as "<upper bound us>:count". */
+    CLI_IF_Print("  hist");
+    for (uint32_t b = 0U; b < CTRL_LOOP_BUCKETS; ++b)
+    {
+        if (h->hist[b] == 0U)
+            continue;
+
+        if (b == (CTRL_LOOP_BUCKETS - 1U))
+            CLI_IF_Printf(" >=%lu:%lu", 1UL << (b - 1U), (unsigned long)h->hist[b]);
+        else
+            CLI_IF_Printf(" <%lu:%lu", 1UL << b, (unsigned long)h->hist[b]);
+    }
+    CLI_IF_Print("\r\n");
+}
+
+static void ctrl_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CtrlLoop_Stats_t st;
+
+    CtrlLoop_GetStats(&st);
+
+    CLI_IF_Printf("%s, %u Hz (%lu us): %lu cycles, %lu missed, %lu overruns\r\n",
+                  (CTRL_LOOP_SOURCE == CTRL_LOOP_SOURCE_TIM5) ? "TIM5" : "RTOS tick",
+                  (unsigned)CTRL_LOOP_HZ, (unsigned long)CTRL_LOOP_PERIOD_US,
+                  (unsigned long)st.cycles, (unsigned long)st.missed,
+                  (unsigned long)st.overruns);
+    CLI_IF_Print("         mean_us   max_us\r\n");
+    ctrl_print_hist("jitter", &st.jitter);
+    ctrl_print_hist("exec", &st.exec);
+}
+
+static void ctrl_cmd_reset(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CtrlLoop_ResetStats();
+    CLI_IF_Print("Control loop statistics cleared.\r\n");
+}
+
+static const CliCommand_t s_clCmds[] =
+{
+    { "loop",       "", 0U, ctrl_cmd_show,  "control loop jitter and execution time" },
+    { "loop reset", "", 0U, ctrl_cmd_reset, "clear the control loop statistics" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef CtrlLoop_Init(void)
+{
+    CtrlLoop_ResetStats();
+
+    if (ctrl_source_init() != HAL_OK)
+        return HAL_ERROR;
+
+    CLI_IF_REGISTER_TABLE(s_clCmds);
+
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef CtrlLoop_Start(void)
+{
+    s_clThread = osThreadGetId();
+    if (s_clThread == NULL)
+        return HAL_ERROR;
+
+    return ctrl_source_start();
+}
+
+void CtrlLoop_Wait(void)
+{
+    uint32_t jitterUs = ctrl_source_wait();
+
+    s_clStart = DWT->CYCCNT;
+    ctrl_record_jitter(jitterUs);
+}
+
+uint32_t CtrlLoop_ElapsedUs(void)
+{
+    return ctrl_cycles_to_us(DWT->CYCCNT - s_clStart);
+}
+
+void CtrlLoop_Done(void)
+{
+    uint32_t us = CtrlLoop_ElapsedUs();
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    ctrl_record(&s_clStats.exec, us);
+    s_clStats.cycles++;
+    if (us > CTRL_LOOP_PERIOD_US)
+        s_clStats.overruns++;
+    __set_PRIMASK(primask);
+}
+
+void CtrlLoop_GetStats(CtrlLoop_Stats_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *out = s_clStats;
+    __set_PRIMASK(primask);
+}
+
+void CtrlLoop_ResetStats(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memset(&s_clStats, 0, sizeof(s_clStats));
+    __set_PRIMASK(primask);
+}
+
+void CtrlLoop_ClockChanged(void)
+{
+#if CTRL_LOOP_SOURCE == CTRL_LOOP_SOURCE_TIM5
+    ClockCfg_RetimeTimer(TIM5, (ClockCfg_TimerHz() / 1000000U) - 1U, CTRL_LOOP_PERIOD_US - 1U);
+#endif
+}
@@ -0,0 +1,369 @@
+/**
+ * @file    dma_copy.c
+ * @brief   DMA2 Stream1 memory-to-memory service and the "dma" command.
+ */
+
+#include "dma_copy.h"
+#include "cli_if.h"
+#include "platform_dma.h"
+#include "sys_config.h"
+#include "cmsis_os2.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* DMA2 Stream1, channel 0: memory to memory needs no request line. */
+#define DC_DMA              DMA2_Stream1
+#define DC_DMA_FLAGS        (DMA_LIFCR_CTCIF1 | DMA_LIFCR_CHTIF1 | DMA_LIFCR_CTEIF1 | \
+                             DMA_LIFCR_CDMEIF1 | DMA_LIFCR_CFEIF1)
+
+/* Items per stream run (NDTR is 16 bits). */
+#define DC_RUN_MAX          0xFFFFU
+
+/* With a data cache the CPU copies the partial lines at the ends of the
+ * destination, so the lines the stream writes hold nothing else. */
+#if PLATFORM_DCACHE
+#define DC_LINE             PLATFORM_DMA_ALIGN
+#else
+#define DC_LINE             1U
+#endif
+
+_Static_assert(DMA_COPY_MIN_BYTES >= (2U * DC_LINE), "DMA_COPY_MIN_BYTES: two cache lines or more");
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* The transfer: claimed under PRIMASK by a start, then owned by the
+ * stream interrupt until it clears s_dcBusy. */
+static volatile uint8_t  s_dcBusy   = 0U;
+static uint8_t           s_dcWord   = 0U;     /* 4-byte items, else bytes */
+static uint8_t           s_dcFill   = 0U;     /* source does not advance */
+static uint32_t          s_dcSrc    = 0U;
+static uint32_t          s_dcDst    = 0U;
+static uint32_t          s_dcLeft   = 0U;     /* items after the current run */
+static uint32_t          s_dcRun    = 0U;     /* items of the current run */
+static uint32_t          s_dcBase   = 0U;     /* destination the stream writes */
+static uint32_t          s_dcBytes  = 0U;
+static DmaCopy_Done_t    s_dcDone   = NULL;
+static void             *s_dcCtx    = NULL;
+static osThreadId_t      s_dcWaiter = NULL;
+static volatile HAL_StatusTypeDef s_dcResult = HAL_OK;
+
+/* Fill source, read by the stream. */
+static uint32_t          s_dcPattern = 0U;
+
+/* Written under PRIMASK (starts) and by the stream interrupt. */
+static DmaCopy_Stats_t   s_dcStats;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/* Program and enable the next run; the stream is off. */
+static void dc_run(void)
+{
+    uint32_t items = (s_dcLeft > DC_RUN_MAX) ? DC_RUN_MAX : s_dcLeft;
+    uint32_t size  = (s_dcWord != 0U) ? (DMA_SxCR_PSIZE_1 | DMA_SxCR_MSIZE_1) : 0U;
+
+    s_dcRun   = items;
+    s_dcLeft -= items;
+
+    DMA2->LIFCR   = DC_DMA_FLAGS;
+    DC_DMA->PAR   = s_dcSrc;
+    DC_DMA->M0AR  = s_dcDst;
+    DC_DMA->NDTR  = items;
+    /* Memory to memory needs the FIFO; single transfers, so the
+     * threshold only sets when the FIFO drains. */
+    DC_DMA->FCR   = DMA_SxFCR_DMDIS | DMA_SxFCR_FTH_0;
+    DC_DMA->CR    = DMA_SxCR_DIR_1 | DMA_SxCR_MINC | ((s_dcFill != 0U) ? 0U : DMA_SxCR_PINC) |
+                    size | DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+    /* The buffer writes before this reach memory before the stream reads. */
+    __DSB();
+    DC_DMA->CR   |= DMA_SxCR_EN;
+}
+
+/* Complete the transfer: free the stream first, so @p done may start the
+ * next one. */
+static void dc_finish(HAL_StatusTypeDef status)
+{
+    DmaCopy_Done_t done   = s_dcDone;
+    void          *ctx    = s_dcCtx;
+    osThreadId_t   waiter = s_dcWaiter;
+
+    /* Lines the core fetched while the stream ran are stale. */
+    PlatformDma_Invalidate((void *)(uintptr_t)s_dcBase, s_dcBytes);
+
+    s_dcResult = status;
+    s_dcBusy   = 0U;
+
+    if (done != NULL)
+        done(ctx, status);
+    else if (waiter != NULL)
+        (void)osThreadFlagsSet(waiter, DMA_COPY_FLAG);
+}
+
+/* Claim the stream, or do a short request on the CPU. @return HAL_OK with
+ * the stream claimed in *claimed, HAL_OK for a CPU copy. */
+static HAL_StatusTypeDef dc_claim(uint32_t len, uint8_t *claimed)
+{
+    *claimed = 0U;
+
+    if (len >= DMA_COPY_MIN_BYTES)
+    {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        if (s_dcBusy != 0U)
+        {
+            s_dcStats.busy++;
+            __set_PRIMASK(primask);
+            return HAL_BUSY;
+        }
+        s_dcBusy = 1U;
+        s_dcStats.dmaCopies++;
+        s_dcStats.dmaBytes += len;
+        __set_PRIMASK(primask);
+        *claimed = 1U;
+        return HAL_OK;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_dcStats.cpuCopies++;
+    __set_PRIMASK(primask);
+    return HAL_OK;
+}
+
+/* Done on the CPU: report as a transfer would. */
+static void dc_cpu_done(DmaCopy_Done_t done, void *ctx)
+{
+    s_dcResult = HAL_OK;
+    if (done != NULL)
+        done(ctx, HAL_OK);
+    else if (__get_IPSR() == 0U)
+        (void)osThreadFlagsSet(osThreadGetId(), DMA_COPY_FLAG);
+}
+
+static void dc_start(uintptr_t dst, uintptr_t src, uint32_t len, uint8_t fill,
+                     DmaCopy_Done_t done, void *ctx)
+{
+    s_dcWord   = (((dst | (fill ? 0U : src)) & 3U) == 0U) ? 1U : 0U;
+    s_dcFill   = fill;
+    s_dcSrc    = (uint32_t)src;
+    s_dcDst    = (uint32_t)dst;
+    s_dcLeft   = (s_dcWord != 0U) ? (len / 4U) : len;
+    s_dcBase   = (uint32_t)dst;
+    s_dcBytes  = len;
+    s_dcDone   = done;
+    s_dcCtx    = ctx;
+    s_dcWaiter = (done == NULL) ? osThreadGetId() : NULL;
+
+    /* A flag left by an earlier transfer must not end this wait. */
+    if (done == NULL)
+        (void)osThreadFlagsClear(DMA_COPY_FLAG);
+
+    PlatformDma_Clean((const void *)src, (fill != 0U) ? 4U : len);
+    PlatformDma_Invalidate((void *)dst, len);
+    dc_run();
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void dc_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    DmaCopy_Stats_t st;
+
+    DmaCopy_GetStats(&st);
+    CLI_IF_Printf("DMA2 Stream1 %s: %lu transfers, %lu KB; %lu on the CPU (< %u B), "
+                  "%lu refused busy, %lu errors\r\n",
+                  (DmaCopy_Busy() != 0U) ? "busy" : "idle", (unsigned long)st.dmaCopies,
+                  (unsigned long)(st.dmaBytes / 1024U), (unsigned long)st.cpuCopies,
+                  (unsigned)DMA_COPY_MIN_BYTES, (unsigned long)st.busy,
+                  (unsigned long)st.errors);
+}
+
+static const CliCommand_t s_dcCmds[] =
+{
+    { "dma", "", 0U, dc_cmd_show, "DMA memory-to-memory copies" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void DmaCopy_Init(void)
+{
+    __HAL_RCC_DMA2_CLK_ENABLE();
+
+    DC_DMA->CR &= ~DMA_SxCR_EN;
+    while ((DC_DMA->CR & DMA_SxCR_EN) != 0U)
+    {
+    }
+    DMA2->LIFCR = DC_DMA_FLAGS;
+    memset(&s_dcStats, 0, sizeof(s_dcStats));
+
+    HAL_NVIC_SetPriority(DMA2_Stream1_IRQn, SYS_IRQ_PRIO_DmaCopy, 0U);
+    HAL_NVIC_EnableIRQ(DMA2_Stream1_IRQn);
+
+    CLI_IF_REGISTER_TABLE(s_dcCmds);
+}
+
+HAL_StatusTypeDef DmaCopy_Start(void *dst, const void *src, uint32_t len, DmaCopy_Done_t done,
+                                void *ctx)
+{
+    uint8_t claimed;
+
+    if ((dst == NULL) || (src == NULL))
+        return HAL_ERROR;
+
+    HAL_StatusTypeDef status = dc_claim(len, &claimed);
+    if (status != HAL_OK)
+        return status;
+
+    if (claimed == 0U)
+    {
+        memcpy(dst, src, len);
+        dc_cpu_done(done, ctx);
+        return HAL_OK;
+    }
+
+    uint32_t head = (uint32_t)(DC_LINE - ((uintptr_t)dst & (DC_LINE - 1U))) & (DC_LINE - 1U);
+    uint32_t tail = (uint32_t)((uintptr_t)dst + len) & (DC_LINE - 1U);
+    if ((head + tail) != 0U)
+    {
+        memcpy(dst, src, head);
+        memcpy((uint8_t *)dst + len - tail, (const uint8_t *)src + len - tail, tail);
+        dst  = (uint8_t *)dst + head;
+        src  = (const uint8_t *)src + head;
+        len -= head + tail;
+    }
+
+    /* The bytes past the last word of a word transfer. */
+    uint32_t whole = len & ~3U;
+    if ((((uintptr_t)dst | (uintptr_t)src) & 3U) == 0U)
+        memcpy((uint8_t *)dst + whole, (const uint8_t *)src + whole, len - whole);
+
+    dc_start((uintptr_t)dst, (uintptr_t)src, len, 0U, done, ctx);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef DmaCopy_Fill(void *dst, uint8_t value, uint32_t len, DmaCopy_Done_t done,
+                               void *ctx)
+{
+    uint8_t claimed;
+
+    if (dst == NULL)
+        return HAL_ERROR;
+
+    HAL_StatusTypeDef status = dc_claim(len, &claimed);
+    if (status != HAL_OK)
+        return status;
+
+    if (claimed == 0U)
+    {
+        memset(dst, value, len);
+        dc_cpu_done(done, ctx);
+        return HAL_OK;
+    }
+
+    uint32_t head = (uint32_t)(DC_LINE - ((uintptr_t)dst & (DC_LINE - 1U))) & (DC_LINE - 1U);
+    uint32_t tail = (uint32_t)((uintptr_t)dst + len) & (DC_LINE - 1U);
+    if ((head + tail) != 0U)
+    {
+        memset(dst, value, head);
+        memset((uint8_t *)dst + len - tail, value, tail);
+        dst  = (uint8_t *)dst + head;
+        len -= head + tail;
+    }
+
+    uint32_t whole = len & ~3U;
+    if (((uintptr_t)dst & 3U) == 0U)
+        memset((uint8_t *)dst + whole, value, len - whole);
+
+    s_dcPattern = 0x01010101U * value;
+    dc_start((uintptr_t)dst, (uintptr_t)&s_dcPattern, len, 1U, done, ctx);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef DmaCopy_Wait(uint32_t timeoutMs)
+{
+    uint32_t flags = osThreadFlagsWait(DMA_COPY_FLAG, osFlagsWaitAny, timeoutMs);
+
+    if ((flags & osFlagsError) == 0U)
+        return s_dcResult;
+
+    /* Stop a transfer this task still owns, so its buffers are free again. */
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if ((s_dcBusy != 0U) && (s_dcWaiter == osThreadGetId()))
+    {
+        DC_DMA->CR &= ~(DMA_SxCR_EN | DMA_SxCR_TCIE | DMA_SxCR_TEIE);
+        while ((DC_DMA->CR & DMA_SxCR_EN) != 0U)
+        {
+        }
+        DMA2->LIFCR = DC_DMA_FLAGS;
+        s_dcBusy    = 0U;
+        s_dcStats.errors++;
+    }
+    __set_PRIMASK(primask);
+    return HAL_TIMEOUT;
+}
+
+void DmaCopy_Memcpy(void *dst, const void *src, uint32_t len)
+{
+    /* A stream busy, an error or a transfer that takes far longer than its
+     * ~1 ms per 64 KB: the CPU copies. */
+    if ((len < DMA_COPY_MIN_BYTES) || (DmaCopy_Start(dst, src, len, NULL, NULL) != HAL_OK) ||
+        (DmaCopy_Wait(2U + (len / 16384U)) != HAL_OK))
+    {
+        memcpy(dst, src, len);
+    }
+}
+
+uint8_t DmaCopy_Busy(void)
+{
+    return s_dcBusy;
+}
+
+void DmaCopy_GetStats(DmaCopy_Stats_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *out = s_dcStats;
+    __set_PRIMASK(primask);
+}
+
+void DmaCopy_IRQHandler(void)
+{
+    uint32_t isr = DMA2->LISR;
+
+    DMA2->LIFCR = DC_DMA_FLAGS;
+
+    /* A transfer error disables the stream. */
+    if ((isr & DMA_LISR_TEIF1) != 0U)
+    {
+        s_dcStats.errors++;
+        dc_finish(HAL_ERROR);
+        return;
+    }
+    if ((isr & DMA_LISR_TCIF1) == 0U)
+        return;
+
+    uint32_t bytes = (s_dcWord != 0U) ? (4U * s_dcRun) : s_dcRun;
+
+    s_dcDst += bytes;
+    if (s_dcFill == 0U)
+        s_dcSrc += bytes;
+
+    if (s_dcLeft != 0U)
+        dc_run();
+    else
+        dc_finish(HAL_OK);
+}
@@ -0,0 +1,376 @@
+/**
+ * @file    dsp.c
+ * @brief   Block FIR / biquad kernels, low-pass designs and matrix
+ *          kernels.
+ */
+
+#include "dsp.h"
+#include <math.h>
+
+#if DSP_USE_CMSIS
+#include "arm_math.h"
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define DSP_PI  3.14159265f
+
+#if DSP_USE_CMSIS
+_Static_assert(sizeof(Dsp_MatF32_t) == sizeof(arm_matrix_instance_f32),
+               "Dsp_MatF32_t must keep the arm_matrix_instance_f32 layout");
+#define DSP_MAT_(m)      ((arm_matrix_instance_f32 *)(void *)(m))
+#define DSP_MAT_C_(m)    ((const arm_matrix_instance_f32 *)(const void *)(m))
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void Dsp_FirInitF32(Dsp_FirF32_t *s, uint16_t numTaps, const float *coeffs,
+                    float *state, uint32_t blockSize)
+{
+    s->numTaps = numTaps;
+    s->coeffs  = coeffs;
+    s->state   = state;
+
+    for (uint32_t i = 0U; i < ((uint32_t)numTaps + blockSize - 1U); ++i)
+        state[i] = 0.0f;
+}
+
+void Dsp_FirF32(Dsp_FirF32_t *s, const float *in, float *out, uint32_t blockSize)
+{
+#if DSP_USE_CMSIS
+    arm_fir_instance_f32 inst = { s->numTaps, s->state, (float32_t *)s->coeffs };
+
+    arm_fir_f32(&inst, in, out, blockSize);
+#else
+    const float *b     = s->coeffs;
+    float       *state = s->state;
+    uint32_t     taps  = s->numTaps;
+    uint32_t     n     = 0U;
+
+    /* state[0 .. taps-2] holds the previous inputs, the block follows. */
+    for (uint32_t i = 0U; i < blockSize; ++i)
+        state[taps - 1U + i] = in[i];
+
+    /* Four outputs per pass: each coefficient is loaded once for all four,
+     * and the inputs slide through registers. */
+    for (; (n + 4U) <= blockSize; n += 4U)
+    {
+        const float *x = &state[n];
+        float acc0 = 0.0f;
+        float acc1 = 0.0f;
+        float acc2 = 0.0f;
+        float acc3 = 0.0f;
+        float x0   = x[0];
+        float x1   = x[1];
+        float x2   = x[2];
+
+        for (uint32_t k = 0U; k < taps; ++k)
+        {
+            float c  = b[k];
+            float x3 = x[k + 3U];
+
+            acc0 += c * x0;
+            acc1 += c * x1;
+            acc2 += c * x2;
+            acc3 += c * x3;
+            x0 = x1;
+            x1 = x2;
+            x2 = x3;
+        }
+
+        out[n]      = acc0;
+        out[n + 1U] = acc1;
+        out[n + 2U] = acc2;
+        out[n + 3U] = acc3;
+    }
+
+    for (; n < blockSize; ++n)
+    {
+        float acc = 0.0f;
+
+        for (uint32_t k = 0U; k < taps; ++k)
+            acc += b[k] * state[n + k];
+        out[n] = acc;
+    }
+
+    /* Keep the last taps - 1 inputs for the next block. */
+    for (uint32_t k = 0U; k < (taps - 1U); ++k)
+        state[k] = state[blockSize + k];
+#endif
+}
+
+void Dsp_BiquadInitF32(Dsp_BiquadF32_t *s, uint8_t numStages, const float *coeffs,
+                       float *state)
+{
+    s->numStages = numStages;
+    s->coeffs    = coeffs;
+    s->state     = state;
+
+    for (uint32_t i = 0U; i < (2U * (uint32_t)numStages); ++i)
+        state[i] = 0.0f;
+}
+
+void Dsp_BiquadF32(Dsp_BiquadF32_t *s, const float *in, float *out, uint32_t blockSize)
+{
+#if DSP_USE_CMSIS
+    arm_biquad_cascade_df2T_instance_f32 inst = { s->numStages, s->state, (float32_t *)s->coeffs };
+
+    arm_biquad_cascade_df2T_f32(&inst, in, out, blockSize);
+#else
+    const float *c   = s->coeffs;
+    float       *d   = s->state;
+    const float *src = in;
+
+    for (uint32_t st = 0U; st < s->numStages; ++st)
+    {
+        float b0 = c[0];
+        float b1 = c[1];
+        float b2 = c[2];
+        float a1 = c[3];
+        float a2 = c[4];
+        float d1 = d[0];
+        float d2 = d[1];
+
+        for (uint32_t n = 0U; n < blockSize; ++n)
+        {
+            float x = src[n];
+            float y = (b0 * x) + d1;
+
+            d1 = (b1 * x) + (a1 * y) + d2;
+            d2 = (b2 * x) + (a2 * y);
+            out[n] = y;
+        }
+
+        d[0] = d1;
+        d[1] = d2;
+        c   += DSP_BIQUAD_COEFFS;
+        d   += 2;
+        src  = out;     /* later stages filter in place */
+    }
+#endif
+}
+
+void Dsp_FirSettleF32(Dsp_FirF32_t *s, float x)
+{
+    for (uint32_t k = 0U; k < ((uint32_t)s->numTaps - 1U); ++k)
+        s->state[k] = x;
+}
+
+void Dsp_BiquadSettleF32(Dsp_BiquadF32_t *s, float x)
+{
+    const float *c = s->coeffs;
+    float       *d = s->state;
+
+    for (uint32_t st = 0U; st < s->numStages; ++st)
+    {
+        float den = 1.0f - c[3] - c[4];
+        float y   = (den != 0.0f) ? (((c[0] + c[1] + c[2]) * x) / den) : x;
+
+        d[1] = (c[2] * x) + (c[4] * y);
+        d[0] = (c[1] * x) + (c[3] * y) + d[1];
+        x    = y;
+        c   += DSP_BIQUAD_COEFFS;
+        d   += 2;
+    }
+}
+
+void Dsp_FirLowpassF32(float *coeffs, uint16_t numTaps, float cutoffHz, float sampleHz)
+{
+    float fc  = cutoffHz / sampleHz;
+    float mid = 0.5f * (float)(numTaps - 1U);
+    float sum = 0.0f;
+
+    for (uint32_t i = 0U; i < numTaps; ++i)
+    {
+        float t = (float)i - mid;
+        float h = (t == 0.0f) ? (2.0f * fc) : (sinf(2.0f * DSP_PI * fc * t) / (DSP_PI * t));
+
+        if (numTaps > 1U)
+            h *= 0.54f - (0.46f * cosf((2.0f * DSP_PI * (float)i) / (float)(numTaps - 1U)));
+        coeffs[i] = h;
+        sum += h;
+    }
+
+    for (uint32_t i = 0U; i < numTaps; ++i)
+        coeffs[i] /= sum;
+}
+
+void Dsp_BiquadLowpassF32(float *coeffs, float cutoffHz, float sampleHz, float q)
+{
+    float w0    = (2.0f * DSP_PI * cutoffHz) / sampleHz;
+    float cw    = cosf(w0);
+    float alpha = sinf(w0) / (2.0f * q);
+    float a0    = 1.0f + alpha;
+
+    coeffs[0] = ((1.0f - cw) * 0.5f) / a0;
+    coeffs[1] = (1.0f - cw) / a0;
+    coeffs[2] = coeffs[0];
+    coeffs[3] = (2.0f * cw) / a0;
+    coeffs[4] = -(1.0f - alpha) / a0;
+}
+
+void Dsp_MatInitF32(Dsp_MatF32_t *m, uint16_t numRows, uint16_t numCols, float *data)
+{
+    m->numRows = numRows;
+    m->numCols = numCols;
+    m->pData   = data;
+}
+
+Dsp_Status_t Dsp_MatAddF32(const Dsp_MatF32_t *a, const Dsp_MatF32_t *b, Dsp_MatF32_t *dst)
+{
+#if DSP_USE_CMSIS
+    return (Dsp_Status_t)arm_mat_add_f32(DSP_MAT_C_(a), DSP_MAT_C_(b), DSP_MAT_(dst));
+#else
+    if ((a->numRows != b->numRows) || (a->numCols != b->numCols) ||
+        (a->numRows != dst->numRows) || (a->numCols != dst->numCols))
+        return DSP_SIZE_MISMATCH;
+
+    for (uint32_t i = 0U; i < ((uint32_t)a->numRows * a->numCols); ++i)
+        dst->pData[i] = a->pData[i] + b->pData[i];
+    return DSP_OK;
+#endif
+}
+
+Dsp_Status_t Dsp_MatSubF32(const Dsp_MatF32_t *a, const Dsp_MatF32_t *b, Dsp_MatF32_t *dst)
+{
+#if DSP_USE_CMSIS
+    return (Dsp_Status_t)arm_mat_sub_f32(DSP_MAT_C_(a), DSP_MAT_C_(b), DSP_MAT_(dst));
+#else
+    if ((a->numRows != b->numRows) || (a->numCols != b->numCols) ||
+        (a->numRows != dst->numRows) || (a->numCols != dst->numCols))
+        return DSP_SIZE_MISMATCH;
+
+    for (uint32_t i = 0U; i < ((uint32_t)a->numRows * a->numCols); ++i)
+        dst->pData[i] = a->pData[i] - b->pData[i];
+    return DSP_OK;
+#endif
+}
+
+Dsp_Status_t Dsp_MatMultF32(const Dsp_MatF32_t *a, const Dsp_MatF32_t *b, Dsp_MatF32_t *dst)
+{
+#if DSP_USE_CMSIS
+    return (Dsp_Status_t)arm_mat_mult_f32(DSP_MAT_C_(a), DSP_MAT_C_(b), DSP_MAT_(dst));
+#else
+    uint32_t rows  = a->numRows;
+    uint32_t inner = a->numCols;
+    uint32_t cols  = b->numCols;
+
+    if ((b->numRows != inner) || (dst->numRows != rows) || (dst->numCols != cols))
+        return DSP_SIZE_MISMATCH;
+
+    for (uint32_t r = 0U; r < rows; ++r)
+    {
+        for (uint32_t c = 0U; c < cols; ++c)
+        {
+            float acc = 0.0f;
+
+            for (uint32_t k = 0U; k < inner; ++k)
+                acc += a->pData[(r * inner) + k] * b->pData[(k * cols) + c];
+            dst->pData[(r * cols) + c] = acc;
+        }
+    }
+    return DSP_OK;
+#endif
+}
+
+Dsp_Status_t Dsp_MatTransF32(const Dsp_MatF32_t *a, Dsp_MatF32_t *dst)
+{
+#if DSP_USE_CMSIS
+    return (Dsp_Status_t)arm_mat_trans_f32(DSP_MAT_C_(a), DSP_MAT_(dst));
+#else
+    uint32_t rows = a->numRows;
+    uint32_t cols = a->numCols;
+
+    if ((dst->numRows != cols) || (dst->numCols != rows))
+        return DSP_SIZE_MISMATCH;
+
+    for (uint32_t r = 0U; r < rows; ++r)
+    {
+        for (uint32_t c = 0U; c < cols; ++c)
+            dst->pData[(c * rows) + r] = a->pData[(r * cols) + c];
+    }
+    return DSP_OK;
+#endif
+}
+
+Dsp_Status_t Dsp_MatScaleF32(const Dsp_MatF32_t *a, float k, Dsp_MatF32_t *dst)
+{
+#if DSP_USE_CMSIS
+    return (Dsp_Status_t)arm_mat_scale_f32(DSP_MAT_C_(a), k, DSP_MAT_(dst));
+#else
+    if ((a->numRows != dst->numRows) || (a->numCols != dst->numCols))
+        return DSP_SIZE_MISMATCH;
+
+    for (uint32_t i = 0U; i < ((uint32_t)a->numRows * a->numCols); ++i)
+        dst->pData[i] = a->pData[i] * k;
+    return DSP_OK;
+#endif
+}
+
+Dsp_Status_t Dsp_MatInverseF32(Dsp_MatF32_t *a, Dsp_MatF32_t *dst)
+{
+#if DSP_USE_CMSIS
+    return (Dsp_Status_t)arm_mat_inverse_f32(DSP_MAT_C_(a), DSP_MAT_(dst));
+#else
+    uint32_t n = a->numRows;
+    float   *m = a->pData;
+    float   *x = dst->pData;
+
+    if ((a->numCols != n) || (dst->numRows != n) || (dst->numCols != n))
+        return DSP_SIZE_MISMATCH;
+
+    for (uint32_t i = 0U; i < (n * n); ++i)
+        x[i] = ((i % (n + 1U)) == 0U) ? 1.0f : 0.0f;
+
+    for (uint32_t col = 0U; col < n; ++col)
+    {
+        /* Largest pivot of the column, swapped up in both matrices. */
+        uint32_t piv = col;
+        for (uint32_t r = col + 1U; r < n; ++r)
+        {
+            if (fabsf(m[(r * n) + col]) > fabsf(m[(piv * n) + col]))
+                piv = r;
+        }
+        if (m[(piv * n) + col] == 0.0f)
+            return DSP_SINGULAR;
+
+        if (piv != col)
+        {
+            for (uint32_t c = 0U; c < n; ++c)
+            {
+                float t = m[(col * n) + c];
+                m[(col * n) + c] = m[(piv * n) + c];
+                m[(piv * n) + c] = t;
+                t = x[(col * n) + c];
+                x[(col * n) + c] = x[(piv * n) + c];
+                x[(piv * n) + c] = t;
+            }
+        }
+
+        float inv = 1.0f / m[(col * n) + col];
+        for (uint32_t c = 0U; c < n; ++c)
+        {
+            m[(col * n) + c] *= inv;
+            x[(col * n) + c] *= inv;
+        }
+
+        for (uint32_t r = 0U; r < n; ++r)
+        {
+            float f = m[(r * n) + col];
+
+            if ((r == col) || (f == 0.0f))
+                continue;
+            for (uint32_t c = 0U; c < n; ++c)
+            {
+                m[(r * n) + c] -= f * m[(col * n) + c];
+                x[(r * n) + c] -= f * x[(col * n) + c];
+            }
+        }
+    }
+    return DSP_OK;
+#endif
+}
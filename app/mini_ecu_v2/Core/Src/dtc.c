@@ -0,0 +1,362 @@
+/**
+ * @file    dtc.c
+ * @brief   DTC entries, their flash log client and "dtc".
+ */
+
+#include "dtc.h"
+#include "audit.h"
+#include "freeze_frame.h"
+#include "nvm_log.h"
+#include "vehicle_shared.h"
+#include "cli_if.h"
+#include "log.h"
+#include <ctype.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    uint8_t  status;
+    uint8_t  pending;       /* changed since the last write */
+    uint16_t occurrences;
+    uint16_t rpm;
+    uint8_t  speedKph;
+    int8_t   coolantC;
+} Dtc_Entry_t;
+
+#define DTC_CODE_(name, code, text)   code,
+static const uint16_t s_dtCodes[DTC_COUNT] = { DTC_TABLE(DTC_CODE_) };
+
+#define DTC_TEXT_(name, code, text)   text,
+static const char *const s_dtTexts[DTC_COUNT] = { DTC_TABLE(DTC_TEXT_) };
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Entries: written by Dtc_Set()/Dtc_Clear() (any task) and NvmTask, under
+ * PRIMASK. */
+static Dtc_Entry_t s_dtEntries[DTC_COUNT];
+static uint32_t    s_dtCoalesced = 0U;      /* changes merged into a pending write */
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/* Record: key = code, aux = status, data[0] = occurrences | rpm << 16,
+ * data[1] = speed | (coolant + 128) << 8. */
+static void dtc_restore(const NvmLog_Record_t *rec)
+{
+    uint32_t i = 0U;
+
+    while ((i < DTC_COUNT) && (s_dtCodes[i] != rec->key))
+        i++;
+    if (i >= DTC_COUNT)
+        return;
+
+    Dtc_Entry_t *e = &s_dtEntries[i];
+    e->status      = rec->aux;
+    e->occurrences = (uint16_t)(rec->data[0] & 0xFFFFU);
+    e->rpm         = (uint16_t)(rec->data[0] >> 16);
+    e->speedKph    = (uint8_t)(rec->data[1] & 0xFFU);
+    e->coolantC    = (int8_t)((int32_t)((rec->data[1] >> 8) & 0xFFU) - 128);
+}
+
+static uint8_t dtc_take(uint32_t i, uint8_t all, NvmLog_Record_t *rec)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    const Dtc_Entry_t *e = &s_dtEntries[i];
+
+    /* A cleared entry is written once as an empty record, then dropped. */
+    uint8_t take = (all != 0U) ? (uint8_t)((e->status != 0U) || (e->occurrences != 0U))
+                               : e->pending;
+    rec->key     = s_dtCodes[i];
+    rec->aux     = e->status;
+    rec->data[0] = (uint32_t)e->occurrences | ((uint32_t)e->rpm << 16);
+    rec->data[1] = (uint32_t)e->speedKph | ((uint32_t)(uint8_t)(e->coolantC + 128) << 8);
+    s_dtEntries[i].pending = 0U;
+
+    __set_PRIMASK(primask);
+    return take;
+}
+
+static void dtc_retry(uint32_t i)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_dtEntries[i].pending = 1U;
+    __set_PRIMASK(primask);
+}
+
+static const NvmLog_Client_t s_dtClient =
+{
+    .tag     = NVM_LOG_TAG_DTC,
+    .count   = DTC_COUNT,
+    .restore = dtc_restore,
+    .take    = dtc_take,
+    .retry   = dtc_retry,
+};
+
+static void dtc_format_code(uint16_t code, char out[6])
+{
+    static const char letters[4] = { 'P', 'C', 'B', 'U' };
+    static const char hex[]      = "0123456789ABCDEF";
+
+    out[0] = letters[code >> 14];
+    out[1] = hex[(code >> 12) & 0x3U];
+    out[2] = hex[(code >> 8) & 0xFU];
+    out[3] = hex[(code >> 4) & 0xFU];
+    out[4] = hex[code & 0xFU];
+    out[5] = '\0';
+}
+
+/* "P0217" (any case) -> 0x0217. */
+static HAL_StatusTypeDef dtc_parse_code(const char *text, uint16_t *code)
+{
+    static const char letters[] = "PCBU";
+
+    if (strlen(text) != 5U)
+        return HAL_ERROR;
+
+    const char *l = strchr(letters, toupper((unsigned char)text[0]));
+    if (l == NULL)
+        return HAL_ERROR;
+
+    uint32_t value = (uint32_t)(l - letters);
+    for (uint32_t i = 1U; i < 5U; ++i)
+    {
+        int c = toupper((unsigned char)text[i]);
+
+        if (isxdigit(c) == 0)
+            return HAL_ERROR;
+        value = (value << 4) | (uint32_t)((c <= '9') ? (c - '0') : (c - 'A' + 10));
+    }
+    if (((value >> 12) & 0xCU) != 0U)   /* second character 0..3 */
+        return HAL_ERROR;
+
+    *code = (uint16_t)(((value >> 16) << 14) | (value & 0x3FFFU));
+    return HAL_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void dtc_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t shown = 0U;
+
+    for (uint32_t i = 0U; i < DTC_COUNT; ++i)
+    {
+        Dtc_Info_t info;
+        char       code[6];
+
+        (void)Dtc_Get((Dtc_Id_t)i, &info);
+        if ((info.status == 0U) && (info.occurrences == 0U))
+            continue;
+
+        if (shown++ == 0U)
+            CLI_IF_Print("Code   status     count  freeze frame             description\r\n");
+
+        dtc_format_code(info.code, code);
+        CLI_IF_Printf("%s  %-9s %6u  %3u km/h %4u rpm %4d C  %s\r\n", code,
+                      ((info.status & DTC_ST_ACTIVE) != 0U) ? "active" : "stored",
+                      (unsigned)info.occurrences, (unsigned)info.speedKph, (unsigned)info.rpm,
+                      (int)info.coolantC, info.text);
+    }
+    if (shown == 0U)
+        CLI_IF_Print("No DTCs stored\r\n");
+
+    FreezeFrame_Stats_t ff;
+    FreezeFrame_GetStats(&ff);
+
+    CLI_IF_Printf("%lu changes coalesced into pending writes ('nvm' for the log)\r\n",
+                  (unsigned long)s_dtCoalesced);
+    CLI_IF_Printf("Freeze frames %lu/%u, %lu captured, %lu dropped ('dtc frame <code>')\r\n",
+                  (unsigned long)ff.used, (unsigned)FREEZE_FRAME_SLOTS,
+                  (unsigned long)ff.captured, (unsigned long)ff.dropped);
+}
+
+static void dtc_cmd_frame(int argc, char *argv[])
+{
+    (void)argc;
+
+    /* Static: a frame is too large for the CLI task's stack. */
+    static FreezeFrame_t f;
+    uint16_t             code;
+    char                 text[6];
+
+    if (dtc_parse_code(argv[0], &code) != HAL_OK)
+    {
+        CLI_IF_Print("Code like P0217 expected\r\n");
+        return;
+    }
+    dtc_format_code(code, text);
+    if (FreezeFrame_Get(code, &f) != HAL_OK)
+    {
+        CLI_IF_Printf("No freeze frame for %s\r\n", text);
+        return;
+    }
+
+    CLI_IF_Printf("%s captured at %lu ms; signal cache then:\r\n", text,
+                  (unsigned long)f.timeMs);
+    for (uint32_t i = 0U; i < (uint32_t)CAN_SIG_COUNT; ++i)
+    {
+        const CanSigCache_Entry_t *e = &f.cache[i];
+
+        if (e->seq == 0U)
+            CLI_IF_Printf("  %-16s %9s\r\n", CanSigCache_Name((CanSigCache_Signal_t)i), "---");
+        else
+            CLI_IF_Printf("  %-16s %9.1f  %5ld ms old%s\r\n",
+                          CanSigCache_Name((CanSigCache_Signal_t)i), (double)e->value,
+                          (long)(f.timeMs - e->timeMs),
+                          (CanSigCache_IsStale(e, f.timeMs) != 0U) ? "  STALE" : "");
+    }
+
+    CLI_IF_Printf("Before it, every %u ms (oldest first):\r\n", (unsigned)FREEZE_FRAME_ROW_MS);
+    CLI_IF_Print("      ms");
+    for (uint32_t c = 0U; c < FREEZE_FRAME_SIGNALS; ++c)
+        CLI_IF_Printf(" %15s", CanSigCache_Name((CanSigCache_Signal_t)FreezeFrame_Signal(c)));
+    CLI_IF_Print("\r\n");
+    for (uint32_t r = 0U; r < f.rows; ++r)
+    {
+        CLI_IF_Printf("  %6ld", -(long)((f.rows - r) * FREEZE_FRAME_ROW_MS));
+        for (uint32_t c = 0U; c < FREEZE_FRAME_SIGNALS; ++c)
+            CLI_IF_Printf(" %15.1f", (double)f.hist[r][c]);
+        CLI_IF_Print("\r\n");
+    }
+}
+
+static void dtc_cmd_clear(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    Dtc_Clear();
+    Audit_Record(AUDIT_CMD_DTC_CLEAR, AUDIT_SRC_CLI, 0U, 0U);
+    CLI_IF_Print("DTCs cleared.\r\n");
+}
+
+static const CliCommand_t s_dtCmds[] =
+{
+    { "dtc",       "", 0U, dtc_cmd_show,  "stored trouble codes" },
+    { "dtc clear", "", 0U, dtc_cmd_clear, "clear all trouble codes" },
+    { "dtc frame", "<code>", 1U, dtc_cmd_frame, "freeze frame of a code, e.g. P0217" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void Dtc_Init(void)
+{
+    memset(s_dtEntries, 0, sizeof(s_dtEntries));
+    s_dtCoalesced = 0U;
+
+    if (NvmLog_Register(&s_dtClient) != HAL_OK)
+        LOG_ERROR(MAIN, "DTCs not in the flash log, not kept over a reset");
+
+    CLI_IF_REGISTER_TABLE(s_dtCmds);
+}
+
+void Dtc_Set(Dtc_Id_t id, uint8_t failing)
+{
+    if ((uint32_t)id >= DTC_COUNT)
+        return;
+
+    Dtc_Entry_t *e    = &s_dtEntries[id];
+    uint8_t      fail = (failing != 0U) ? DTC_ST_ACTIVE : 0U;
+
+    /* Unchanged result: nothing to do, however often it is reported. */
+    if ((e->status & DTC_ST_ACTIVE) == fail)
+        return;
+
+    VehicleState_t vs;
+    if (fail != 0U)
+        Vehicle_GetSnapshot(&vs);
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    /* A racing report of the same code got there first. */
+    if ((e->status & DTC_ST_ACTIVE) == fail)
+    {
+        __set_PRIMASK(primask);
+        return;
+    }
+
+    if (fail != 0U)
+    {
+        if (e->occurrences == 0U)
+        {
+            e->speedKph = (uint8_t)((vs.speed_kph > 255.0f) ? 255.0f : vs.speed_kph);
+            e->coolantC = (int8_t)vs.coolant_temp_c;
+            e->rpm      = vs.engine_rpm;
+            (void)FreezeFrame_Capture(s_dtCodes[id]);
+        }
+        if (e->occurrences < 0xFFFFU)
+            e->occurrences++;
+        e->status |= DTC_ST_ACTIVE | DTC_ST_CONFIRMED;
+    }
+    else
+    {
+        e->status &= (uint8_t)~DTC_ST_ACTIVE;
+    }
+
+    if (e->pending != 0U)
+        s_dtCoalesced++;
+    e->pending = 1U;
+
+    __set_PRIMASK(primask);
+
+    NvmLog_Notify();
+}
+
+void Dtc_Clear(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    for (uint32_t i = 0U; i < DTC_COUNT; ++i)
+    {
+        Dtc_Entry_t *e = &s_dtEntries[i];
+
+        if ((e->status == 0U) && (e->occurrences == 0U))
+            continue;
+        memset(e, 0, sizeof(*e));
+        e->pending = 1U;
+    }
+    FreezeFrame_Clear();
+
+    __set_PRIMASK(primask);
+
+    NvmLog_Notify();
+}
+
+HAL_StatusTypeDef Dtc_Get(Dtc_Id_t id, Dtc_Info_t *out)
+{
+    if (((uint32_t)id >= DTC_COUNT) || (out == NULL))
+        return HAL_ERROR;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    Dtc_Entry_t e = s_dtEntries[id];
+    __set_PRIMASK(primask);
+
+    out->code        = s_dtCodes[id];
+    out->status      = e.status;
+    out->occurrences = e.occurrences;
+    out->text        = s_dtTexts[id];
+    out->speedKph    = e.speedKph;
+    out->coolantC    = e.coolantC;
+    out->rpm         = e.rpm;
+    return HAL_OK;
+}
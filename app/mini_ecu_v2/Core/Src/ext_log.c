@@ -0,0 +1,782 @@
+/**
+ * @file    ext_log.c
+ * @brief   Circular page store on the QSPI flash: RAM page staging, the
+ *          interrupt-driven writer, recovery at init and "xlog".
+ */
+
+#include "ext_log.h"
+
+#if EXT_LOG_ENABLE
+
+#include "can_if.h"
+#include "can_trace.h"
+#include "cli_if.h"
+#include "clock_gov.h"
+#include "crc.h"
+#include "log.h"
+#include "ramfunc.h"
+#include "time_sync.h"
+#include "cmsis_os2.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+_Static_assert((EXT_LOG_STAGE_PAGES >= 2U) && ((EXT_LOG_STAGE_PAGES & (EXT_LOG_STAGE_PAGES - 1U)) == 0U),
+               "EXT_LOG_STAGE_PAGES must be a power of two");
+_Static_assert(sizeof(ExtLog_PageHdr_t) == 16U, "ExtLog_PageHdr_t is the flash layout");
+
+#define XL_PAGE             QSPI_FLASH_PAGE_SIZE
+#define XL_HDR              16U
+#define XL_PAGES            (QSPI_FLASH_SIZE / XL_PAGE)
+#define XL_SECTOR_PAGES     (QSPI_FLASH_SECTOR_SIZE / XL_PAGE)
+#define XL_REC_HDR          4U      /* type, len, dt */
+#define XL_TIME_LEN         6U      /* ms (u32), us (u16) */
+#define XL_CAN_LEN          5U      /* id (u32), dlc (u8), then the data */
+
+/** Stream bytes per record: bounds the copy made with interrupts off. */
+#define XL_STREAM_CHUNK     120U
+
+#define XL_BIN_VERSION      1U
+#define XL_BIN_HALF         128U    /* page bytes per 'P' frame */
+#define XL_TEXT_CHUNK       256U
+
+typedef enum
+{
+    XL_STOPPED = 0,
+    XL_RECORDING,
+    XL_ERASING          /* "xlog erase": only the chip erase runs */
+} ExtLog_State_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Staging ring: page s_xlClosed (mod EXT_LOG_STAGE_PAGES) is the one being
+ * filled, pages s_xlDone..s_xlClosed - 1 wait for the flash. Producers
+ * (CAN RX interrupt, LogTask, the raster) fill and close under PRIMASK;
+ * the writer in the QUADSPI interrupt only reads closed pages and moves
+ * s_xlDone. */
+static uint8_t           s_xlStage[EXT_LOG_STAGE_PAGES][XL_PAGE] __ALIGNED(4);
+static volatile uint8_t  s_xlState   = XL_STOPPED;
+static volatile uint32_t s_xlClosed  = 0U;
+static volatile uint32_t s_xlDone    = 0U;
+static uint8_t           s_xlOpen    = 0U;      /* page s_xlClosed has records */
+static uint32_t          s_xlPos     = 0U;      /* fill of the open page */
+static uint32_t          s_xlOpenMs  = 0U;
+static uint32_t          s_xlLastMs  = 0U;      /* time of the last record */
+static uint32_t          s_xlLastUs  = 0U;
+
+/* Sequence numbers: pages first..next-1 are in flash (or staged), pages
+ * from next up to erasedEnd - 1 are erased and ready. */
+static volatile uint32_t s_xlFirstSeq  = 0U;
+static volatile uint32_t s_xlNextSeq   = 0U;
+static volatile uint32_t s_xlErasedEnd = 0U;
+
+/* The operation the writer started, for the watchdog. */
+static volatile uint8_t  s_xlOp      = QSPI_FLASH_OP_NONE;
+static volatile uint32_t s_xlOpTick  = 0U;
+static uint32_t          s_xlEraseSeq = 0U;
+
+static ExtLog_Stats_t    s_xlStats;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** As trace_now() (can_trace.c): the global time (time_sync.h). */
+RAMFUNC static void xl_now(uint32_t *ms, uint32_t *us)
+{
+    TimeSync_NowMsUs(ms, us);
+}
+
+RAMFUNC static uint8_t *xl_stage(uint32_t page)
+{
+    return s_xlStage[page & (EXT_LOG_STAGE_PAGES - 1U)];
+}
+
+RAMFUNC static uint8_t *xl_put16(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    return &p[2];
+}
+
+RAMFUNC static uint8_t *xl_put32(uint8_t *p, uint32_t v)
+{
+    return xl_put16(xl_put16(p, v), v >> 16);
+}
+
+static uint32_t xl_get16(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t xl_get32(const uint8_t *p)
+{
+    return xl_get16(p) | (xl_get16(&p[2]) << 16);
+}
+
+static uint32_t xl_addr(uint32_t seq)
+{
+    return (seq & (XL_PAGES - 1U)) * XL_PAGE;
+}
+
+/** CRC of a page: the header without its crc field, then the records. */
+static uint16_t xl_page_crc(const uint8_t *page, uint32_t used)
+{
+    uint16_t crc = Crc_Ccitt16(CRC16_INIT, page, XL_HDR - 2U);
+    return Crc_Ccitt16(crc, &page[XL_HDR], used);
+}
+
+/* ---- Producers (PRIMASK held) ---- */
+
+/** Hand the open page to the writer. */
+RAMFUNC static void xl_close(void)
+{
+    ExtLog_PageHdr_t *h = (ExtLog_PageHdr_t *)(void *)xl_stage(s_xlClosed);
+
+    h->used  = (uint16_t)(s_xlPos - XL_HDR);
+    s_xlOpen = 0U;
+    s_xlClosed++;
+    if ((s_xlClosed - s_xlDone) > s_xlStats.stagedMax)
+        s_xlStats.stagedMax = s_xlClosed - s_xlDone;
+    QspiFlash_Kick();
+}
+
+/** Start the next page at @p ms / @p us; 0 if every buffer is waiting. */
+RAMFUNC static uint8_t xl_open(uint32_t ms, uint32_t us)
+{
+    if ((s_xlClosed - s_xlDone) >= EXT_LOG_STAGE_PAGES)
+        return 0U;
+
+    ExtLog_PageHdr_t *h = (ExtLog_PageHdr_t *)(void *)xl_stage(s_xlClosed);
+
+    h->magic   = EXT_LOG_PAGE_MAGIC;
+    h->used    = 0U;
+    h->seq     = s_xlNextSeq++;
+    h->timeMs  = ms;
+    h->timeUs  = (uint16_t)us;
+    h->crc     = 0U;
+    s_xlPos    = XL_HDR;
+    s_xlOpenMs = ms;
+    s_xlLastMs = ms;
+    s_xlLastUs = us;
+    s_xlOpen   = 1U;
+    return 1U;
+}
+
+/**
+ * @brief Room for a @p len byte record of @p type in the open page (opening
+ *        or moving to the next one as needed, with a time record when the
+ *        gap does not fit dt).
+ *
+ * @return Where the payload goes, or NULL if no staging page is free.
+ */
+RAMFUNC static uint8_t *xl_reserve(uint8_t type, uint32_t len)
+{
+    uint32_t ms;
+    uint32_t us;
+
+    xl_now(&ms, &us);
+
+    for (uint32_t pass = 0U; pass < 2U; ++pass)
+    {
+        if ((s_xlOpen == 0U) && (xl_open(ms, us) == 0U))
+            return NULL;
+
+        uint32_t dms  = ms - s_xlLastMs;
+        uint32_t dt   = (dms <= 65U) ? ((dms * 1000U) + us - s_xlLastUs) : 0x10000U;
+        uint32_t time = (dt > 0xFFFFU) ? (XL_REC_HDR + XL_TIME_LEN) : 0U;
+        uint32_t need = time + XL_REC_HDR + len;
+
+        if ((s_xlPos + need) <= XL_PAGE)
+        {
+            uint8_t *p = &xl_stage(s_xlClosed)[s_xlPos];
+
+            if (time != 0U)
+            {
+                *p++ = EXT_LOG_REC_TIME;
+                *p++ = XL_TIME_LEN;
+                p    = xl_put16(p, 0U);
+                p    = xl_put16(xl_put32(p, ms), us);
+                dt   = 0U;
+            }
+            *p++ = type;
+            *p++ = (uint8_t)len;
+            p    = xl_put16(p, dt);
+
+            s_xlPos    += need;
+            s_xlLastMs  = ms;
+            s_xlLastUs  = us;
+            s_xlStats.records++;
+            s_xlStats.bytes += need;
+            return p;
+        }
+
+        xl_close();
+    }
+    return NULL;
+}
+
+/* ---- Writer (QUADSPI interrupt) ---- */
+
+static void xl_started(QspiFlash_Op_t op, HAL_StatusTypeDef st)
+{
+    if (st == HAL_OK)
+    {
+        s_xlOp     = (uint8_t)op;
+        s_xlOpTick = HAL_GetTick();
+    }
+}
+
+/** Erase ahead or program the oldest closed page, if any. */
+static void xl_next(void)
+{
+    if ((s_xlState == XL_ERASING) || (s_xlDone == s_xlClosed) || (QspiFlash_Busy() != 0U))
+        return;
+
+    uint8_t          *page = xl_stage(s_xlDone);
+    ExtLog_PageHdr_t *h    = (ExtLog_PageHdr_t *)(void *)page;
+
+    if ((int32_t)(h->seq - s_xlErasedEnd) >= 0)
+    {
+        s_xlEraseSeq = h->seq - (h->seq % XL_SECTOR_PAGES);
+        xl_started(QSPI_FLASH_OP_ERASE,
+                   QspiFlash_StartErase(xl_addr(s_xlEraseSeq), QSPI_FLASH_SECTOR_SIZE));
+        return;
+    }
+
+    h->crc = xl_page_crc(page, h->used);
+    xl_started(QSPI_FLASH_OP_PROGRAM,
+               QspiFlash_StartProgram(xl_addr(h->seq), page, XL_HDR + h->used));
+}
+
+/* ---- Reading the flash ---- */
+
+/** Page @p seq from the mapped flash if it is that page and intact. */
+static const uint8_t *xl_read_page(const uint8_t *map, uint32_t seq)
+{
+    const uint8_t *page = &map[xl_addr(seq)];
+
+    if ((xl_get16(page) != EXT_LOG_PAGE_MAGIC) || (xl_get32(&page[4]) != seq))
+        return NULL;
+
+    uint32_t used = xl_get16(&page[2]);
+    if (((XL_HDR + used) > XL_PAGE) || (xl_page_crc(page, used) != xl_get16(&page[14])))
+        return NULL;
+
+    return page;
+}
+
+static uint8_t xl_blank(const uint8_t *page)
+{
+    for (uint32_t i = 0U; i < XL_PAGE; ++i)
+    {
+        if (page[i] != 0xFFU)
+            return 0U;
+    }
+    return 1U;
+}
+
+/**
+ * @brief Find the store again: the first page of every sector gives the
+ *        oldest and the newest sector, the newest is walked to its last
+ *        intact page.
+ *
+ * The page after it is written next if it is still erased; a torn page
+ * (reset during a program) moves on to the next sector.
+ */
+static void xl_scan(const uint8_t *map)
+{
+    uint8_t  found  = 0U;
+    uint32_t oldest = 0U;
+    uint32_t newest = 0U;
+
+    for (uint32_t s = 0U; s < XL_PAGES; s += XL_SECTOR_PAGES)
+    {
+        const uint8_t *page = &map[s * XL_PAGE];
+        uint32_t       seq  = xl_get32(&page[4]);
+
+        /* Header only: a full check of every sector would take seconds. */
+        if ((xl_get16(page) != EXT_LOG_PAGE_MAGIC) || ((seq & (XL_PAGES - 1U)) != s))
+            continue;
+
+        if ((found == 0U) || ((int32_t)(seq - oldest) < 0))
+            oldest = seq;
+        if ((found == 0U) || ((int32_t)(seq - newest) > 0))
+            newest = seq;
+        found = 1U;
+    }
+
+    if (found == 0U)
+    {
+        s_xlFirstSeq  = 0U;
+        s_xlNextSeq   = 0U;
+        s_xlErasedEnd = 0U;
+        return;
+    }
+
+    uint32_t next = newest;
+    while (((next - newest) < XL_SECTOR_PAGES) && (xl_read_page(map, next) != NULL))
+        next++;
+
+    if (((next - newest) < XL_SECTOR_PAGES) && (xl_blank(&map[xl_addr(next)]) != 0U))
+    {
+        s_xlErasedEnd = newest + XL_SECTOR_PAGES;
+    }
+    else
+    {
+        next          = newest + XL_SECTOR_PAGES;
+        s_xlErasedEnd = next;
+    }
+    s_xlFirstSeq = oldest;
+    s_xlNextSeq  = next;
+}
+
+/** Stop recording and wait until every staged page is in flash. */
+static HAL_StatusTypeDef xl_drain(void)
+{
+    uint32_t start = HAL_GetTick();
+
+    ExtLog_SetRecording(0U);
+    while ((s_xlDone != s_xlClosed) || (QspiFlash_Busy() != 0U))
+    {
+        if ((HAL_GetTick() - start) >= EXT_LOG_OP_TIMEOUT_MS)
+            return HAL_TIMEOUT;
+        (void)osDelay(1U);
+    }
+    return HAL_OK;
+}
+
+/* ---- Dump ---- */
+
+/** As trace_emit() (can_trace.c): send from the buffer, wait until free. */
+static HAL_StatusTypeDef xl_emit(const void *data, uint32_t len)
+{
+    return Log_Send(LOG_STREAM_CLI, data, len, EXT_LOG_DUMP_TIMEOUT_MS);
+}
+
+static HAL_StatusTypeDef xl_dump_can(const uint8_t *map, uint32_t *frames, uint32_t *bad)
+{
+    char     buf[XL_TEXT_CHUNK];
+    uint32_t len = 0U;
+
+    for (uint32_t seq = s_xlFirstSeq; seq != s_xlNextSeq; ++seq)
+    {
+        const uint8_t *page = xl_read_page(map, seq);
+        if (page == NULL)
+        {
+            (*bad)++;
+            continue;
+        }
+
+        uint32_t end = XL_HDR + xl_get16(&page[2]);
+        uint32_t ms  = xl_get32(&page[8]);
+        uint32_t us  = xl_get16(&page[12]);
+
+        for (uint32_t pos = XL_HDR; (pos + XL_REC_HDR) <= end; pos += XL_REC_HDR + page[pos + 1U])
+        {
+            const uint8_t *rec = &page[pos];
+            uint32_t       n   = rec[1];
+
+            if ((pos + XL_REC_HDR + n) > end)
+                break;
+
+            us += xl_get16(&rec[2]);
+            ms += us / 1000U;
+            us %= 1000U;
+
+            if ((rec[0] == EXT_LOG_REC_TIME) && (n == XL_TIME_LEN))
+            {
+                ms = xl_get32(&rec[4]);
+                us = xl_get16(&rec[8]);
+            }
+            else if ((rec[0] == EXT_LOG_REC_CAN) && (n >= XL_CAN_LEN))
+            {
+                CanTrace_Rec_t r;
+
+                memset(&r, 0, sizeof(r));
+                r.timeMs = ms;
+                r.timeUs = (uint16_t)us;
+                r.id     = xl_get32(&rec[4]);
+                r.dlc    = rec[8];
+                n -= XL_CAN_LEN;
+                memcpy(r.data, &rec[4U + XL_CAN_LEN], (n < 8U) ? n : 8U);
+
+                len += CanTrace_FormatLine(&r, &buf[len]);
+                (*frames)++;
+
+                if ((len + CAN_TRACE_LINE_MAX) > sizeof(buf))
+                {
+                    if (xl_emit(buf, len) != HAL_OK)
+                        return HAL_TIMEOUT;
+                    len = 0U;
+                }
+            }
+        }
+    }
+
+    return (len > 0U) ? xl_emit(buf, len) : HAL_OK;
+}
+
+/** Send one EXT_LOG_SYNC | len | type | payload frame. */
+static HAL_StatusTypeDef xl_bin_frame(uint8_t type, const void *head, uint32_t headLen,
+                                      const void *body, uint32_t bodyLen)
+{
+    uint8_t frame[3U + 5U + XL_BIN_HALF];
+
+    frame[0] = EXT_LOG_SYNC;
+    frame[1] = (uint8_t)(1U + headLen + bodyLen);
+    frame[2] = type;
+    memcpy(&frame[3], head, headLen);
+    if (bodyLen > 0U)
+        memcpy(&frame[3U + headLen], body, bodyLen);
+
+    return xl_emit(frame, 3U + headLen + bodyLen);
+}
+
+static HAL_StatusTypeDef xl_dump_bin(const uint8_t *map, uint32_t *sent, uint32_t *bad)
+{
+    uint8_t  hdr[11];
+    uint16_t pageSize = XL_PAGE;
+    uint32_t first    = s_xlFirstSeq;
+    uint32_t count    = s_xlNextSeq - first;
+
+    hdr[0] = XL_BIN_VERSION;
+    memcpy(&hdr[1], &pageSize, 2U);
+    memcpy(&hdr[3], &count, 4U);
+    memcpy(&hdr[7], &first, 4U);
+    if (xl_bin_frame('H', hdr, sizeof(hdr), NULL, 0U) != HAL_OK)
+        return HAL_TIMEOUT;
+
+    for (uint32_t seq = first; seq != s_xlNextSeq; ++seq)
+    {
+        const uint8_t *page = xl_read_page(map, seq);
+        if (page == NULL)
+        {
+            (*bad)++;
+            continue;
+        }
+
+        for (uint32_t off = 0U; off < XL_PAGE; off += XL_BIN_HALF)
+        {
+            uint8_t where[5];
+
+            memcpy(where, &seq, 4U);
+            where[4] = (uint8_t)off;
+            if (xl_bin_frame('P', where, sizeof(where), &page[off], XL_BIN_HALF) != HAL_OK)
+                return HAL_TIMEOUT;
+        }
+        (*sent)++;
+    }
+
+    return xl_bin_frame('E', sent, 4U, NULL, 0U);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void xl_cmd_show(int argc, char *argv[])
+{
+    QspiFlash_Stats_t qf;
+    ExtLog_Stats_t    st;
+
+    (void)argc;
+    (void)argv;
+
+    QspiFlash_GetStats(&qf);
+    ExtLog_GetStats(&st);
+
+    uint32_t held = st.nextSeq - st.firstSeq;
+
+    CLI_IF_Printf("QSPI flash %06lX, %lu KB at %lu kHz: %lu programs (max %lu us), "
+                  "%lu erases (max %lu us), %lu errors\r\n",
+                  (unsigned long)qf.jedecId, (unsigned long)(QSPI_FLASH_SIZE / 1024U),
+                  (unsigned long)(qf.clockHz / 1000U), (unsigned long)qf.programs,
+                  (unsigned long)qf.maxProgramUs, (unsigned long)qf.erases,
+                  (unsigned long)qf.maxEraseUs, (unsigned long)qf.errors);
+    CLI_IF_Printf("Store %s: pages %lu..%lu, %lu of %lu (%lu KB)\r\n",
+                  (st.erasing != 0U) ? "erasing" : ((st.recording != 0U) ? "recording" : "stopped"),
+                  (unsigned long)st.firstSeq, (unsigned long)(st.nextSeq - ((held > 0U) ? 1U : 0U)),
+                  (unsigned long)held, (unsigned long)st.pages,
+                  (unsigned long)((held * XL_PAGE) / 1024U));
+    CLI_IF_Printf("Staged %lu of %u pages (peak %lu); %lu records, %lu KB\r\n",
+                  (unsigned long)st.staged, (unsigned)EXT_LOG_STAGE_PAGES,
+                  (unsigned long)st.stagedMax, (unsigned long)st.records,
+                  (unsigned long)(st.bytes / 1024U));
+    CLI_IF_Printf("Dropped %lu records (staging full), %lu pages lost, %lu timeouts\r\n",
+                  (unsigned long)st.dropped, (unsigned long)st.pageErrors,
+                  (unsigned long)st.timeouts);
+}
+
+static void xl_cmd_start(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if (s_xlState == XL_ERASING)
+    {
+        CLI_IF_Print("Chip erase running\r\n");
+        return;
+    }
+    ExtLog_SetRecording(1U);
+    CLI_IF_Print("External log recording\r\n");
+}
+
+static void xl_cmd_stop(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    ExtLog_SetRecording(0U);
+    CLI_IF_Print("External log stopped\r\n");
+}
+
+static void xl_cmd_dump(int argc, char *argv[])
+{
+    uint8_t bin = 0U;
+
+    if (argc == 1)
+    {
+        if (strcmp(argv[0], "bin") == 0)
+            bin = 1U;
+        else if (strcmp(argv[0], "can") != 0)
+            argc = 2;
+    }
+    if (argc > 1)
+    {
+        CLI_IF_Print("Usage: xlog dump [can|bin]\r\n");
+        return;
+    }
+    if ((s_xlState == XL_ERASING) || (xl_drain() != HAL_OK))
+    {
+        CLI_IF_Print("Flash busy\r\n");
+        return;
+    }
+#if CLOCK_GOV_ENABLE
+    ClockGov_Boost(0U);
+#endif
+
+    const uint8_t    *map  = QspiFlash_Map();
+    uint32_t          n    = 0U;
+    uint32_t          bad  = 0U;
+    HAL_StatusTypeDef st   = (bin != 0U) ? xl_dump_bin(map, &n, &bad) : xl_dump_can(map, &n, &bad);
+
+    if (st != HAL_OK)
+        CLI_IF_Print("\r\nExternal log dump aborted: console not draining\r\n");
+    else if (bin == 0U)
+        CLI_IF_Printf("# %lu frames, %lu pages unreadable; recording stopped\r\n",
+                      (unsigned long)n, (unsigned long)bad);
+}
+
+static void xl_cmd_erase(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if ((s_xlState == XL_ERASING) || (xl_drain() != HAL_OK))
+    {
+        CLI_IF_Print("Flash busy\r\n");
+        return;
+    }
+
+    s_xlState = XL_ERASING;
+    if (QspiFlash_StartErase(0U, QSPI_FLASH_CHIP) != HAL_OK)
+    {
+        s_xlState = XL_STOPPED;
+        CLI_IF_Print("Chip erase not started\r\n");
+        return;
+    }
+    CLI_IF_Print("Erasing the chip (tens of seconds); \"xlog\" shows when it is done\r\n");
+}
+
+static const CliCommand_t s_xlCmds[] =
+{
+    { "xlog",       "", 0U, xl_cmd_show,  "QSPI flash log store state and counters" },
+    { "xlog start", "", 0U, xl_cmd_start, "record CAN frames and xlog streams" },
+    { "xlog stop",  "", 0U, xl_cmd_stop,  "stop recording, flush the open page" },
+    { "xlog dump",  "[can|bin]", 0U, xl_cmd_dump,
+      "stop and send the store (candump text or binary pages)" },
+    { "xlog erase", "", 0U, xl_cmd_erase, "erase the whole store" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef ExtLog_Init(void)
+{
+    const uint8_t *map = QspiFlash_Map();
+
+    if (map == NULL)
+        return HAL_ERROR;
+
+    memset(&s_xlStats, 0, sizeof(s_xlStats));
+    s_xlClosed = 0U;
+    s_xlDone   = 0U;
+    s_xlOpen   = 0U;
+    s_xlOp     = QSPI_FLASH_OP_NONE;
+    xl_scan(map);
+
+    CLI_IF_REGISTER_TABLE(s_xlCmds);
+#if EXT_LOG_AUTOSTART
+    s_xlState = XL_RECORDING;
+#endif
+    return HAL_OK;
+}
+
+RAMFUNC void ExtLog_OnCanRx(uint32_t key, uint8_t dlc, const uint8_t *data)
+{
+    if (s_xlState != XL_RECORDING)
+        return;
+
+    if (dlc > 8U)
+        dlc = 8U;
+
+    uint32_t n       = ((key & CAN_IF_ID_RTR) != 0U) ? 0U : dlc;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint8_t *p = xl_reserve(EXT_LOG_REC_CAN, XL_CAN_LEN + n);
+    if (p == NULL)
+    {
+        s_xlStats.dropped++;
+    }
+    else
+    {
+        p    = xl_put32(p, key);
+        *p++ = dlc;
+        /* A loop, not memcpy(): this runs from SRAM (ramfunc.h), libc does not. */
+        for (uint32_t i = 0U; i < n; ++i)
+            p[i] = data[i];
+    }
+
+    __set_PRIMASK(primask);
+}
+
+void ExtLog_WriteStream(uint8_t stream, const uint8_t *data, uint32_t len)
+{
+    while ((len > 0U) && (s_xlState == XL_RECORDING))
+    {
+        uint32_t n       = (len < XL_STREAM_CHUNK) ? len : XL_STREAM_CHUNK;
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+
+        uint8_t *p = xl_reserve((uint8_t)(EXT_LOG_REC_STREAM + stream), n);
+        if (p == NULL)
+            s_xlStats.dropped++;
+        else
+            memcpy(p, data, n);
+
+        __set_PRIMASK(primask);
+        data += n;
+        len  -= n;
+    }
+}
+
+void ExtLog_SetRecording(uint8_t on)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s_xlState != XL_ERASING)
+    {
+        s_xlState = (on != 0U) ? XL_RECORDING : XL_STOPPED;
+        if ((on == 0U) && (s_xlOpen != 0U))
+            xl_close();
+    }
+    __set_PRIMASK(primask);
+}
+
+void ExtLog_GetStats(ExtLog_Stats_t *st)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *st           = s_xlStats;
+    st->recording = (s_xlState == XL_RECORDING) ? 1U : 0U;
+    st->erasing   = (s_xlState == XL_ERASING) ? 1U : 0U;
+    st->firstSeq  = s_xlFirstSeq;
+    st->nextSeq   = s_xlNextSeq;
+    st->pages     = XL_PAGES;
+    st->staged    = s_xlClosed - s_xlDone;
+    __set_PRIMASK(primask);
+}
+
+void ExtLog_Event100ms(void)
+{
+    uint32_t now     = HAL_GetTick();
+    uint8_t  timeout = 0U;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if ((s_xlState == XL_RECORDING) && (s_xlOpen != 0U) && ((now - s_xlOpenMs) >= EXT_LOG_FLUSH_MS))
+        xl_close();
+
+    /* A chip that stopped answering: drop what is staged rather than let
+     * the producers run into a full staging ring for good. */
+    if ((s_xlOp != QSPI_FLASH_OP_NONE) && (s_xlState != XL_ERASING) &&
+        ((now - s_xlOpTick) >= EXT_LOG_OP_TIMEOUT_MS))
+    {
+        QspiFlash_Abort();
+        s_xlOp    = QSPI_FLASH_OP_NONE;
+        s_xlState = XL_STOPPED;
+        s_xlOpen  = 0U;
+        s_xlStats.timeouts++;
+        s_xlStats.pageErrors += s_xlClosed - s_xlDone;
+        s_xlDone  = s_xlClosed;
+        timeout   = 1U;
+    }
+
+    __set_PRIMASK(primask);
+
+    if (timeout != 0U)
+        LOG_WARN(MAIN, "QSPI flash operation timed out, external log stopped");
+}
+
+/**
+ * @brief The writer: account for the finished operation and start the
+ *        next one (QUADSPI interrupt).
+ */
+void QspiFlash_DoneCallback(QspiFlash_Op_t op, HAL_StatusTypeDef status)
+{
+    if (op == QSPI_FLASH_OP_PROGRAM)
+    {
+        if (status != HAL_OK)
+            s_xlStats.pageErrors++;
+        s_xlDone++;
+    }
+    else if ((op == QSPI_FLASH_OP_ERASE) && (s_xlState == XL_ERASING))
+    {
+        /* "xlog erase": a new store from sequence 0, every page ready. */
+        if (status == HAL_OK)
+        {
+            s_xlFirstSeq  = 0U;
+            s_xlNextSeq   = 0U;
+            s_xlErasedEnd = XL_PAGES;
+        }
+        s_xlState = XL_STOPPED;
+    }
+    else if (op == QSPI_FLASH_OP_ERASE)
+    {
+        if (status == HAL_OK)
+        {
+            /* The sector held the oldest pages, one lap back. */
+            s_xlErasedEnd = s_xlEraseSeq + XL_SECTOR_PAGES;
+            if ((s_xlErasedEnd > XL_PAGES) && ((int32_t)((s_xlErasedEnd - XL_PAGES) - s_xlFirstSeq) > 0))
+                s_xlFirstSeq = s_xlErasedEnd - XL_PAGES;
+        }
+        else
+        {
+            s_xlStats.pageErrors++;     /* not written over unerased data */
+            s_xlDone++;
+        }
+    }
+
+    if (op != QSPI_FLASH_OP_NONE)
+        s_xlOp = QSPI_FLASH_OP_NONE;
+    xl_next();
+}
+
+#endif /* EXT_LOG_ENABLE */
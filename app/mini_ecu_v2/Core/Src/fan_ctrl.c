@@ -0,0 +1,394 @@
+/**
+ * @file    fan_ctrl.c
+ * @brief   Radiator fan PI, TIM10 PWM and "fan".
+ */
+
+#include "fan_ctrl.h"
+#include "audit.h"
+#include "cal.h"
+#include "cli_if.h"
+#include "clock_cfg.h"
+#include "vsensor.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if FAN_CTRL_ENABLE
+
+_Static_assert((FAN_CTRL_HZ == 100U) || (FAN_CTRL_HZ == 1000U),
+               "FAN_CTRL_HZ must be 100 or 1000 (a raster)");
+_Static_assert((FAN_CTRL_PWM_HZ >= 20U) && (FAN_CTRL_PWM_HZ <= 100000U),
+               "FAN_CTRL_PWM_HZ must be 20..100000");
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define FC_Q16_ONE          65536.0f
+#define FC_Q24_ONE          (1L << 24)
+#define FC_AF_TIM10         3U          /* PB8 = TIM10_CH1 */
+
+/* Coolant sensor states the loop does not trust. */
+#define FC_SENSOR_INVALID   (VSENSOR_ST_LOW | VSENSOR_ST_HIGH | VSENSOR_ST_STUCK | \
+                             VSENSOR_ST_IMPLAUSIBLE)
+
+/** Fixed-point form of the calibration, keyed by the float values. */
+typedef struct
+{
+    float   spC;
+    float   kp;
+    float   ki;
+    int32_t spQ16;      /* °C */
+    int32_t kpQ24;      /* duty per °C */
+    int32_t kiQ24;      /* duty per °C and step */
+} FanCtrl_Gains_t;
+
+/** Loop state in its fixed-point form; published under PRIMASK. */
+typedef struct
+{
+    int32_t  spQ16;
+    int32_t  measQ16;
+    int32_t  errQ16;
+    int32_t  pQ24;
+    int32_t  iQ24;
+    int32_t  dutyQ24;
+    uint8_t  manual;
+    uint8_t  failsafe;
+    uint32_t steps;
+    uint32_t saturated;
+    uint32_t failsafeSteps;
+} FanCtrl_Raw_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Control task only. */
+static FanCtrl_Gains_t s_fcGains;
+static FanCtrl_Raw_t   s_fcWork;
+
+/* Published; readers copy under PRIMASK. */
+static FanCtrl_Raw_t   s_fcCopy;
+
+/* Manual duty (Q24), -1 for the controller; set by the CLI. */
+static volatile int32_t s_fcManual = -1;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static int32_t fan_clamp(int64_t v, int32_t lo, int32_t hi)
+{
+    if (v < lo)
+        return lo;
+    if (v > hi)
+        return hi;
+    return (int32_t)v;
+}
+
+/** Re-derive the fixed-point gains when the calibration changed. */
+static void fan_gains(void)
+{
+    const float sp = CAL_F(FAN_SETPOINT_C);
+    const float kp = CAL_F(FAN_KP);
+    const float ki = CAL_F(FAN_KI);
+
+    if ((sp == s_fcGains.spC) && (kp == s_fcGains.kp) && (ki == s_fcGains.ki))
+        return;
+
+    s_fcGains.spC   = sp;
+    s_fcGains.kp    = kp;
+    s_fcGains.ki    = ki;
+    s_fcGains.spQ16 = (int32_t)(sp * FC_Q16_ONE);
+    s_fcGains.kpQ24 = (int32_t)(kp * (float)FC_Q24_ONE);
+    s_fcGains.kiQ24 = (int32_t)((ki * (float)FC_Q24_ONE) / (float)FAN_CTRL_HZ);
+}
+
+/** Prescaler and period for FAN_CTRL_PWM_HZ at the current APB2 clock. */
+static void fan_timing(uint32_t *psc, uint32_t *arr)
+{
+    uint32_t counts = ClockCfg_Apb2TimerHz() / FAN_CTRL_PWM_HZ;
+
+    *psc = (counts - 1U) / 65536U;
+    *arr = (counts / (*psc + 1U)) - 1U;
+}
+
+/** CCR1 for @p dutyQ24 of the current period; preloaded, no update. */
+static void fan_output(int32_t dutyQ24)
+{
+    TIM10->CCR1 = (uint32_t)(((uint64_t)(uint32_t)dutyQ24 * (TIM10->ARR + 1U)) >> 24);
+}
+
+static void fan_publish(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_fcCopy = s_fcWork;
+    __set_PRIMASK(primask);
+}
+
+static float fan_pct(int32_t q24)
+{
+    return ((float)q24 * 100.0f) / (float)FC_Q24_ONE;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void fan_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    FanCtrl_Status_t st;
+
+    FanCtrl_GetStatus(&st);
+
+    CLI_IF_Printf("Fan %s, %u Hz PI, TIM10 PWM %u Hz on PB8: duty %.1f %% (%lu / %lu)\r\n",
+                  (st.manual != 0U) ? "manual" : ((st.failsafe != 0U) ? "FAILSAFE" : "auto"),
+                  (unsigned)FAN_CTRL_HZ, (unsigned)FAN_CTRL_PWM_HZ, (double)(st.duty * 100.0f),
+                  (unsigned long)st.ccr, (unsigned long)st.arr);
+    CLI_IF_Printf("Coolant %.2f C, set point %.1f C, error %+.2f C: P %.1f %%, I %.1f %%\r\n",
+                  (double)st.measured, (double)st.setpoint, (double)st.error,
+                  (double)(st.p * 100.0f), (double)(st.i * 100.0f));
+    CLI_IF_Printf("%lu steps, %lu saturated, %lu failsafe; Kp %.3f /C, Ki %.3f /(C s)\r\n",
+                  (unsigned long)st.steps, (unsigned long)st.saturated,
+                  (unsigned long)st.failsafeSteps,
+                  (double)CAL_F(FAN_KP), (double)CAL_F(FAN_KI));
+}
+
+static void fan_cmd_duty(int argc, char *argv[])
+{
+    (void)argc;
+
+    char *end = NULL;
+    float pct = strtof(argv[0], &end);
+
+    if ((end == argv[0]) || (*end != '\0') || (pct < 0.0f) || (pct > 100.0f))
+    {
+        CLI_IF_Print("Duty: 0..100 (%)\r\n");
+        return;
+    }
+
+    FanCtrl_SetManual(pct / 100.0f);
+    Audit_RecordF(AUDIT_CMD_FAN_DUTY, AUDIT_SRC_CLI, pct, 0U);
+    CLI_IF_Printf("Fan held at %.1f %%\r\n", (double)pct);
+}
+
+static void fan_cmd_auto(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    FanCtrl_SetManual(-1.0f);
+    Audit_Record(AUDIT_CMD_FAN_AUTO, AUDIT_SRC_CLI, 0U, 0U);
+    CLI_IF_Print("Fan on the controller\r\n");
+}
+
+static const CliCommand_t s_fcCmds[] =
+{
+    { "fan",      "",      0U, fan_cmd_show, "radiator fan loop: coolant, PI terms, duty" },
+    { "fan duty", "<pct>", 1U, fan_cmd_duty, "hold a fan duty (0..100 %)" },
+    { "fan auto", "",      0U, fan_cmd_auto, "fan back on the controller" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef FanCtrl_Init(void)
+{
+    GPIO_InitTypeDef gpio = {0};
+    uint32_t         psc;
+    uint32_t         arr;
+
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+    __HAL_RCC_TIM10_CLK_ENABLE();
+
+    gpio.Pin       = GPIO_PIN_8;
+    gpio.Mode      = GPIO_MODE_AF_PP;
+    gpio.Pull      = GPIO_NOPULL;
+    gpio.Speed     = GPIO_SPEED_FREQ_LOW;
+    gpio.Alternate = FC_AF_TIM10;
+    HAL_GPIO_Init(GPIOB, &gpio);
+
+    /* PWM mode 1, CCR1 and ARR preloaded: a new duty waits for the end of
+     * the period. No interrupt, no DMA. */
+    fan_timing(&psc, &arr);
+    TIM10->CR1   = TIM_CR1_ARPE;
+    TIM10->PSC   = psc;
+    TIM10->ARR   = arr;
+    TIM10->CCR1  = 0U;
+    TIM10->CCMR1 = TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1 | TIM_CCMR1_OC1PE;
+    TIM10->CCER  = TIM_CCER_CC1E;
+    TIM10->EGR   = TIM_EGR_UG;
+    TIM10->CR1  |= TIM_CR1_CEN;
+
+    fan_gains();
+    s_fcWork.spQ16 = s_fcGains.spQ16;
+    fan_publish();
+
+    CLI_IF_REGISTER_TABLE(s_fcCmds);
+
+    return HAL_OK;
+}
+
+void FanCtrl_Step(void)
+{
+    FanCtrl_Raw_t    *w = &s_fcWork;
+    VSensor_Reading_t r;
+    int32_t           manual = s_fcManual;
+
+    fan_gains();
+    VSensor_Get(&r);
+
+    const VSensor_Channel_t *c = &r.ch[VSENSOR_CH_COOLANT];
+    float meas = c->value;
+
+    if (meas < -40.0f)
+        meas = -40.0f;
+    else if (meas > 150.0f)
+        meas = 150.0f;
+
+    w->spQ16    = s_fcGains.spQ16;
+    w->measQ16  = (int32_t)(meas * FC_Q16_ONE);
+    w->errQ16   = w->measQ16 - w->spQ16;
+    w->failsafe = ((c->status & FC_SENSOR_INVALID) != 0U) ? 1U : 0U;
+    w->steps++;
+
+    if (manual >= 0)
+    {
+        /* Held duty; the integrator tracks it for a bumpless return. */
+        w->manual  = 1U;
+        w->pQ24    = 0;
+        w->iQ24    = manual;
+        w->dutyQ24 = manual;
+    }
+    else if (w->failsafe != 0U)
+    {
+        w->manual  = 0U;
+        w->pQ24    = 0;
+        w->dutyQ24 = (int32_t)(FAN_CTRL_FAILSAFE * (float)FC_Q24_ONE);
+        w->failsafeSteps++;
+    }
+    else
+    {
+        int32_t p  = fan_clamp(((int64_t)s_fcGains.kpQ24 * w->errQ16) >> 16,
+                               -2 * FC_Q24_ONE, 2 * FC_Q24_ONE);
+        int32_t di = (int32_t)(((int64_t)s_fcGains.kiQ24 * w->errQ16) >> 16);
+        int32_t i  = fan_clamp((int64_t)w->iQ24 + di, 0, FC_Q24_ONE);
+        int32_t u  = p + i;
+
+        /* Anti-windup: no integration further into a saturated output. */
+        if (((u > FC_Q24_ONE) && (di > 0)) || ((u < 0) && (di < 0)))
+        {
+            i = w->iQ24;
+            u = p + i;
+        }
+        if ((u < 0) || (u > FC_Q24_ONE))
+            w->saturated++;
+
+        w->manual  = 0U;
+        w->pQ24    = p;
+        w->iQ24    = i;
+        w->dutyQ24 = fan_clamp(u, 0, FC_Q24_ONE);
+    }
+
+    fan_output(w->dutyQ24);
+    fan_publish();
+}
+
+float FanCtrl_GetDuty(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t ccr = TIM10->CCR1;
+    uint32_t arr = TIM10->ARR;
+    __set_PRIMASK(primask);
+
+    return (float)ccr / (float)(arr + 1U);
+}
+
+void FanCtrl_GetStatus(FanCtrl_Status_t *out)
+{
+    FanCtrl_Raw_t raw;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    raw       = s_fcCopy;
+    out->ccr  = TIM10->CCR1;
+    out->arr  = TIM10->ARR + 1U;
+    __set_PRIMASK(primask);
+
+    out->setpoint      = (float)raw.spQ16 / FC_Q16_ONE;
+    out->measured      = (float)raw.measQ16 / FC_Q16_ONE;
+    out->error         = (float)raw.errQ16 / FC_Q16_ONE;
+    out->p             = fan_pct(raw.pQ24) / 100.0f;
+    out->i             = fan_pct(raw.iQ24) / 100.0f;
+    out->duty          = fan_pct(raw.dutyQ24) / 100.0f;
+    out->manual        = raw.manual;
+    out->failsafe      = raw.failsafe;
+    out->steps         = raw.steps;
+    out->saturated     = raw.saturated;
+    out->failsafeSteps = raw.failsafeSteps;
+}
+
+void FanCtrl_SetManual(float duty)
+{
+    if (duty < 0.0f)
+        s_fcManual = -1;
+    else
+        s_fcManual = (int32_t)(((duty > 1.0f) ? 1.0f : duty) * (float)FC_Q24_ONE);
+}
+
+void FanCtrl_ClockChanged(void)
+{
+    uint32_t psc;
+    uint32_t arr;
+
+    fan_timing(&psc, &arr);
+
+    /* Period and duty change together at the next update: hold it off
+     * while the three preload registers are written. */
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t ccr = (uint32_t)(((uint64_t)TIM10->CCR1 * (arr + 1U)) / (TIM10->ARR + 1U));
+    TIM10->CR1 |= TIM_CR1_UDIS;
+    TIM10->PSC  = psc;
+    TIM10->ARR  = arr;
+    TIM10->CCR1 = ccr;
+    TIM10->CR1 &= ~TIM_CR1_UDIS;
+    __set_PRIMASK(primask);
+}
+
+#else /* !FAN_CTRL_ENABLE */
+
+HAL_StatusTypeDef FanCtrl_Init(void)
+{
+    return HAL_OK;
+}
+
+void FanCtrl_Step(void)
+{
+}
+
+float FanCtrl_GetDuty(void)
+{
+    return 0.0f;
+}
+
+void FanCtrl_GetStatus(FanCtrl_Status_t *out)
+{
+    memset(out, 0, sizeof(*out));
+}
+
+void FanCtrl_SetManual(float duty)
+{
+    (void)duty;
+}
+
+void FanCtrl_ClockChanged(void)
+{
+}
+
+#endif /* FAN_CTRL_ENABLE */
@@ -0,0 +1,759 @@
+/**
+ * @file    fault_inj.c
+ * @brief   Fault engine timeline, CAN RX hook and the "fault" commands.
+ */
+
+#include "fault_inj.h"
+
+#if FAULT_INJ_ENABLE
+
+#include "vsensor.h"
+#include "audit.h"
+#include "cli_if.h"
+#include "fmt.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* End of a list. */
+#define FI_NIL              0xFFU
+
+/* Longest random gap (ticks), so due times stay comparable across the
+ * 32-bit wrap: about 11 days. */
+#define FI_GAP_MAX_TICKS    100000000.0f
+
+_Static_assert(FAULT_INJ_MAX_FAULTS < FI_NIL, "fault numbers must fit below FI_NIL");
+_Static_assert((FAULT_INJ_DELAY_DEPTH > 0U) && (FAULT_INJ_DELAY_DEPTH <= 255U),
+               "delay FIFO depth out of range");
+
+typedef enum
+{
+    FI_FREE = 0,
+    FI_WAITING,             /* In s_fiWaiting, by start. */
+    FI_ACTIVE,              /* In s_fiActive, by end. */
+    FI_DONE                 /* Scheduled and over; kept for "fault". */
+} FiState_t;
+
+typedef struct
+{
+    FaultInj_Spec_t spec;
+    uint8_t         state;  /* FiState_t */
+    uint8_t         next;   /* List link */
+    uint8_t         open;   /* Active without an end (durMs 0) */
+    uint32_t        dueMs;  /* Waiting: start. Active: end. */
+    float           lnMiss; /* ln(1 - chance), random faults */
+    uint32_t        starts;
+    uint32_t        frames; /* CAN frames it acted on */
+} FiFault_t;
+
+typedef struct
+{
+    CAN_IF_Msg_t msg;
+    uint32_t     dueMs;
+} FiDelayed_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+#define FI_KIND_NAME_(name, word, can) word,
+#define FI_KIND_CAN_(name, word, can)  can,
+static const char *const s_fiKindNames[FAULT_INJ_KIND_COUNT] =
+{
+    FAULT_INJ_KIND_TABLE(FI_KIND_NAME_)
+};
+static const uint8_t s_fiKindCan[FAULT_INJ_KIND_COUNT] =
+{
+    FAULT_INJ_KIND_TABLE(FI_KIND_CAN_)
+};
+#undef FI_KIND_NAME_
+#undef FI_KIND_CAN_
+
+/* Sensor kinds as the fault the channel gets. */
+static const uint8_t s_fiSensorFault[FAULT_INJ_KIND_COUNT] =
+{
+    [FAULT_INJ_STUCK]   = VSENSOR_FAULT_STUCK,
+    [FAULT_INJ_NOISE]   = VSENSOR_FAULT_NOISY,
+    [FAULT_INJ_DROPOUT] = VSENSOR_FAULT_OPEN,
+};
+
+/* Faults, both lists, the CAN faults among the active ones, the generator,
+ * the delay FIFO and the counters: written under PRIMASK by the runnable,
+ * FaultInj_Add() / _Remove() (any task) and CanRxTask. */
+static FiFault_t          s_fiFaults[FAULT_INJ_MAX_FAULTS];
+static uint8_t            s_fiWaiting = FI_NIL;
+static uint8_t            s_fiActive  = FI_NIL;
+static uint8_t            s_fiCan[FAULT_INJ_MAX_FAULTS];
+static volatile uint8_t   s_fiCanCount = 0U;
+static volatile uint8_t   s_fiDirty    = 0U;
+static uint32_t           s_fiRng      = FAULT_INJ_SEED;
+static FiDelayed_t        s_fiDelay[FAULT_INJ_DELAY_DEPTH];
+static uint8_t            s_fiDelayHead  = 0U;
+static volatile uint8_t   s_fiDelayCount = 0U;
+static FaultInj_Stats_t   s_fiStats;
+
+/* Runnable only: what the engine last set per sensor channel. */
+static uint8_t            s_fiApplied[VSENSOR_CH_COUNT];
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** a before b, across the tick wrap. */
+static inline uint8_t fi_before(uint32_t a, uint32_t b)
+{
+    return ((int32_t)(a - b) < 0) ? 1U : 0U;
+}
+
+static uint32_t fi_rand(void)
+{
+    uint32_t x = s_fiRng;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_fiRng = x;
+    return x;
+}
+
+/** Time to the next start of random fault @p f: geometric in ticks. */
+static uint32_t fi_gap_ms(const FiFault_t *f)
+{
+    if (f->spec.chance >= 1000U)
+        return FAULT_INJ_TICK_MS;
+
+    /* u in (0, 1], so ln(u) is finite and <= 0. */
+    float u = ((float)(fi_rand() >> 8) + 1.0f) * (1.0f / 16777216.0f);
+    float n = 1.0f + (logf(u) / f->lnMiss);
+
+    if (n > FI_GAP_MAX_TICKS)
+        n = FI_GAP_MAX_TICKS;
+    return (uint32_t)n * FAULT_INJ_TICK_MS;
+}
+
+/** Insert @p i into the list at @p head by due time; open faults last. */
+static void fi_insert(uint8_t *head, uint8_t i)
+{
+    const FiFault_t *f    = &s_fiFaults[i];
+    uint8_t         *link = head;
+
+    while (*link != FI_NIL)
+    {
+        const FiFault_t *g = &s_fiFaults[*link];
+
+        if ((g->open != 0U) || ((f->open == 0U) && (fi_before(f->dueMs, g->dueMs) != 0U)))
+            break;
+        link = &s_fiFaults[*link].next;
+    }
+    s_fiFaults[i].next = *link;
+    *link = i;
+}
+
+static void fi_unlink(uint8_t *head, uint8_t i)
+{
+    for (uint8_t *link = head; *link != FI_NIL; link = &s_fiFaults[*link].next)
+    {
+        if (*link == i)
+        {
+            *link = s_fiFaults[i].next;
+            return;
+        }
+    }
+}
+
+/** Collect the active CAN faults for the RX hook; under PRIMASK. */
+static void fi_rebuild_can(void)
+{
+    uint8_t n = 0U;
+
+    for (uint8_t i = s_fiActive; i != FI_NIL; i = s_fiFaults[i].next)
+    {
+        if (s_fiKindCan[s_fiFaults[i].spec.kind] != 0U)
+            s_fiCan[n++] = i;
+    }
+    s_fiCanCount = n;
+}
+
+/** Give each sensor channel the fault of its first active sensor fault. */
+static void fi_sync_sensors(void)
+{
+    uint8_t want[VSENSOR_CH_COUNT];
+
+    memset(want, VSENSOR_FAULT_NONE, sizeof(want));
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint8_t i = s_fiActive; i != FI_NIL; i = s_fiFaults[i].next)
+    {
+        const FaultInj_Spec_t *s = &s_fiFaults[i].spec;
+
+        if ((s_fiKindCan[s->kind] == 0U) && (want[s->target] == VSENSOR_FAULT_NONE))
+            want[s->target] = s_fiSensorFault[s->kind];
+    }
+    __set_PRIMASK(primask);
+
+    /* Outside the lock: VSensor_SetFault() logs. */
+    for (uint32_t ch = 0U; ch < VSENSOR_CH_COUNT; ++ch)
+    {
+        if (want[ch] == s_fiApplied[ch])
+            continue;
+        s_fiApplied[ch] = want[ch];
+        (void)VSensor_SetFault((VSensor_Ch_t)ch, (VSensor_Fault_t)want[ch]);
+    }
+}
+
+/** End the due active faults and start the due waiting ones; under
+ *  PRIMASK. @return 1 if any did. */
+static uint8_t fi_step(uint32_t now)
+{
+    uint8_t changed = 0U;
+
+    /* Ends first: a random fault re-armed here starts a tick later at the
+     * earliest. */
+    while (s_fiActive != FI_NIL)
+    {
+        uint8_t    i = s_fiActive;
+        FiFault_t *f = &s_fiFaults[i];
+
+        if ((f->open != 0U) || (fi_before(now, f->dueMs) != 0U))
+            break;
+        s_fiActive = f->next;
+        changed    = 1U;
+
+        if (f->spec.chance != 0U)
+        {
+            f->state = FI_WAITING;
+            f->dueMs = now + fi_gap_ms(f);
+            fi_insert(&s_fiWaiting, i);
+        }
+        else
+        {
+            f->state = FI_DONE;
+        }
+    }
+
+    while (s_fiWaiting != FI_NIL)
+    {
+        uint8_t    i = s_fiWaiting;
+        FiFault_t *f = &s_fiFaults[i];
+
+        if (fi_before(now, f->dueMs) != 0U)
+            break;
+        s_fiWaiting = f->next;
+        changed     = 1U;
+
+        f->state = FI_ACTIVE;
+        f->open  = (f->spec.durMs == 0U) ? 1U : 0U;
+        f->dueMs = now + f->spec.durMs;
+        f->starts++;
+        s_fiStats.starts++;
+        fi_insert(&s_fiActive, i);
+    }
+
+    if (changed != 0U)
+        fi_rebuild_can();
+    return changed;
+}
+
+/** Put the due delayed frames back into the RX ring, in arrival order. */
+static void fi_release(uint32_t now)
+{
+    for (;;)
+    {
+        CAN_IF_Msg_t msg;
+
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        if ((s_fiDelayCount == 0U) || (fi_before(now, s_fiDelay[s_fiDelayHead].dueMs) != 0U))
+        {
+            __set_PRIMASK(primask);
+            return;
+        }
+        msg = s_fiDelay[s_fiDelayHead].msg;
+        s_fiDelayHead = (uint8_t)((s_fiDelayHead + 1U) % FAULT_INJ_DELAY_DEPTH);
+        s_fiDelayCount--;
+        __set_PRIMASK(primask);
+
+        if (CAN_IF_ReinjectRx(&msg) != HAL_OK)
+        {
+            primask = __get_PRIMASK();
+            __disable_irq();
+            s_fiStats.reinjectFail++;
+            __set_PRIMASK(primask);
+        }
+    }
+}
+
+/** Flip one payload bit of @p msg; @return 1 if there was one to flip. */
+static uint8_t fi_corrupt(CAN_IF_Msg_t *msg, uint32_t param)
+{
+    uint32_t bits = 8U * (uint32_t)CAN_IF_MSG_LEN(msg);
+    uint32_t bit  = (param == FAULT_INJ_BIT_RANDOM) ? (fi_rand() % ((bits != 0U) ? bits : 1U))
+                                                     : param;
+
+    if ((CAN_IF_MSG_IS_RTR(msg)) || (bit >= bits))
+        return 0U;
+    msg->Data[bit >> 3] ^= (uint8_t)(1U << (bit & 7U));
+    return 1U;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static const char *const s_fiStateNames[] = { "free", "waiting", "active", "done" };
+
+static void fi_usage(void)
+{
+    CLI_IF_Print("fault add <stuck|noise|dropout> <speed|rpm|coolant> <at> <dur> or\r\n"
+                 "fault add <drop|delay|corrupt> <hex id> <at> <dur> [ms|bit]\r\n"
+                 "  at: ms from now, or p<N> for N per mille per 10 ms; dur 0: until deleted\r\n");
+}
+
+static void fi_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    /* CliTask only: kept off its stack. */
+    static FiFault_t faults[FAULT_INJ_MAX_FAULTS];
+    FaultInj_Stats_t st;
+    uint8_t          delayed;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memcpy(faults, s_fiFaults, sizeof(faults));
+    st      = s_fiStats;
+    delayed = s_fiDelayCount;
+    __set_PRIMASK(primask);
+
+    uint32_t now = HAL_GetTick();
+
+    CLI_IF_Printf("%lu starts; frames: %lu dropped, %lu delayed (%u held), %lu corrupted; "
+                  "%lu past a full FIFO, %lu not re-injected\r\n",
+                  (unsigned long)st.starts, (unsigned long)st.dropped,
+                  (unsigned long)st.delayed, (unsigned)delayed, (unsigned long)st.corrupted,
+                  (unsigned long)st.delayFull, (unsigned long)st.reinjectFail);
+    CLI_IF_Print(" id kind     target      trigger   dur ms  param  state    in ms  starts  frames\r\n");
+
+    for (uint32_t i = 0U; i < FAULT_INJ_MAX_FAULTS; ++i)
+    {
+        const FiFault_t       *f = &faults[i];
+        const FaultInj_Spec_t *s = &f->spec;
+        char                   target[12];
+        char                   trigger[12];
+        char                   due[12];
+
+        if (f->state == FI_FREE)
+            continue;
+
+        if (s_fiKindCan[s->kind] == 0U)
+            (void)FMT_SNPRINTF(target, sizeof(target), "%s", VSensor_ChannelName((VSensor_Ch_t)s->target));
+        else if ((s->target & CAN_IF_ID_EXT) != 0U)
+            (void)FMT_SNPRINTF(target, sizeof(target), "%08lX", (unsigned long)(s->target & CAN_IF_ID_MASK));
+        else
+            (void)FMT_SNPRINTF(target, sizeof(target), "%03lX", (unsigned long)s->target);
+
+        if (s->chance != 0U)
+            (void)FMT_SNPRINTF(trigger, sizeof(trigger), "p%u", (unsigned)s->chance);
+        else
+            (void)FMT_SNPRINTF(trigger, sizeof(trigger), "@%lu", (unsigned long)s->atMs);
+
+        if (((f->state == FI_WAITING) || ((f->state == FI_ACTIVE) && (f->open == 0U))))
+            (void)FMT_SNPRINTF(due, sizeof(due), "%ld", (long)(int32_t)(f->dueMs - now));
+        else
+            (void)FMT_SNPRINTF(due, sizeof(due), "-");
+
+        CLI_IF_Printf("%3lu %-8s %-11s %-9s %6lu %6lu  %-8s %5s %7lu %7lu\r\n",
+                      (unsigned long)i, s_fiKindNames[s->kind], target, trigger,
+                      (unsigned long)s->durMs, (unsigned long)s->param,
+                      s_fiStateNames[f->state], due, (unsigned long)f->starts,
+                      (unsigned long)f->frames);
+    }
+}
+
+static void fi_cmd_add(int argc, char *argv[])
+{
+    FaultInj_Spec_t spec;
+    char           *end;
+    uint8_t         id;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.kind = FAULT_INJ_KIND_COUNT;
+    for (uint32_t k = 0U; k < FAULT_INJ_KIND_COUNT; ++k)
+    {
+        if (strcmp(argv[0], s_fiKindNames[k]) == 0)
+            spec.kind = (uint8_t)k;
+    }
+    if (spec.kind == FAULT_INJ_KIND_COUNT)
+    {
+        fi_usage();
+        return;
+    }
+
+    if (s_fiKindCan[spec.kind] == 0U)
+    {
+        spec.target = VSENSOR_CH_COUNT;
+        for (uint32_t ch = 0U; ch < VSENSOR_CH_COUNT; ++ch)
+        {
+            if (strcmp(argv[1], VSensor_ChannelName((VSensor_Ch_t)ch)) == 0)
+                spec.target = ch;
+        }
+    }
+    else
+    {
+        unsigned long canId = strtoul(argv[1], &end, 16);
+
+        if ((*end != '\0') || (canId > CAN_IF_ID_MASK))
+        {
+            fi_usage();
+            return;
+        }
+        spec.target = (canId > 0x7FFUL) ? ((uint32_t)canId | CAN_IF_ID_EXT) : (uint32_t)canId;
+    }
+
+    if (argv[2][0] == 'p')
+    {
+        spec.chance = (uint16_t)strtoul(&argv[2][1], &end, 10);
+        if (spec.chance == 0U)
+            end = argv[2];
+    }
+    else
+    {
+        spec.atMs = (uint32_t)strtoul(argv[2], &end, 10);
+    }
+    if (*end != '\0')
+    {
+        fi_usage();
+        return;
+    }
+
+    spec.durMs = (uint32_t)strtoul(argv[3], &end, 10);
+    if (*end != '\0')
+    {
+        fi_usage();
+        return;
+    }
+
+    if (spec.kind == FAULT_INJ_DELAY)
+        spec.param = FAULT_INJ_DELAY_MS;
+    else if (spec.kind == FAULT_INJ_CORRUPT)
+        spec.param = FAULT_INJ_BIT_RANDOM;
+    if (argc > 4)
+    {
+        spec.param = (uint32_t)strtoul(argv[4], &end, 10);
+        if (*end != '\0')
+        {
+            fi_usage();
+            return;
+        }
+    }
+
+    HAL_StatusTypeDef status = FaultInj_Add(&spec, &id);
+    if (status == HAL_BUSY)
+        CLI_IF_Printf("All %u faults in use\r\n", (unsigned)FAULT_INJ_MAX_FAULTS);
+    else if (status != HAL_OK)
+        fi_usage();
+    else
+    {
+        Audit_Record(AUDIT_CMD_FAULT_ADD, AUDIT_SRC_CLI,
+                     (uint32_t)id | ((uint32_t)spec.kind << 8) | ((uint32_t)spec.chance << 16),
+                     spec.target);
+        CLI_IF_Printf("Fault %u added\r\n", (unsigned)id);
+    }
+}
+
+static void fi_cmd_del(int argc, char *argv[])
+{
+    (void)argc;
+
+    char         *end;
+    unsigned long id = strtoul(argv[0], &end, 10);
+
+    if ((*end != '\0') || (id > 0xFFUL) || (FaultInj_Remove((uint8_t)id) != HAL_OK))
+    {
+        CLI_IF_Printf("No fault %s\r\n", argv[0]);
+        return;
+    }
+    Audit_Record(AUDIT_CMD_FAULT_DEL, AUDIT_SRC_CLI, (uint32_t)id, 0U);
+    CLI_IF_Printf("Fault %lu removed\r\n", id);
+}
+
+static void fi_cmd_clear(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    FaultInj_Clear();
+    Audit_Record(AUDIT_CMD_FAULT_CLEAR, AUDIT_SRC_CLI, 0U, 0U);
+    CLI_IF_Print("All faults removed\r\n");
+}
+
+static void fi_cmd_seed(int argc, char *argv[])
+{
+    (void)argc;
+
+    char         *end;
+    unsigned long seed = strtoul(argv[0], &end, 0);
+
+    if (*end != '\0')
+    {
+        CLI_IF_Print("Seed: a number, 0 for the default\r\n");
+        return;
+    }
+    FaultInj_Seed((uint32_t)seed);
+    CLI_IF_Printf("Generator seeded with 0x%08lX\r\n",
+                  (unsigned long)((seed != 0UL) ? seed : FAULT_INJ_SEED));
+}
+
+static const CliCommand_t s_fiCmds[] =
+{
+    { "fault",       "", 0U, fi_cmd_show, "fault engine: faults and counters" },
+    { "fault add",   "<kind> <target> <at> <dur> [param]", 4U, fi_cmd_add,
+      "add a scheduled (ms) or random (p<N>) fault" },
+    { "fault del",   "<id>", 1U, fi_cmd_del, "remove a fault" },
+    { "fault clear", "", 0U, fi_cmd_clear, "remove all faults" },
+    { "fault seed",  "<n>", 1U, fi_cmd_seed, "reseed the fault generator (0: default)" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef FaultInj_Init(void)
+{
+    memset(s_fiFaults, 0, sizeof(s_fiFaults));
+    memset(&s_fiStats, 0, sizeof(s_fiStats));
+    memset(s_fiApplied, VSENSOR_FAULT_NONE, sizeof(s_fiApplied));
+    s_fiWaiting    = FI_NIL;
+    s_fiActive     = FI_NIL;
+    s_fiCanCount   = 0U;
+    s_fiDelayHead  = 0U;
+    s_fiDelayCount = 0U;
+    s_fiRng        = FAULT_INJ_SEED;
+
+    return CLI_IF_Register(s_fiCmds, (uint32_t)(sizeof(s_fiCmds) / sizeof(s_fiCmds[0])));
+}
+
+HAL_StatusTypeDef FaultInj_Add(const FaultInj_Spec_t *spec, uint8_t *id)
+{
+    if ((spec == NULL) || (spec->kind >= FAULT_INJ_KIND_COUNT) || (spec->chance > 1000U) ||
+        (spec->atMs > INT32_MAX) || (spec->durMs > INT32_MAX))
+        return HAL_ERROR;
+    if (s_fiKindCan[spec->kind] == 0U)
+    {
+        if (spec->target >= VSENSOR_CH_COUNT)
+            return HAL_ERROR;
+    }
+    else if ((spec->kind == FAULT_INJ_CORRUPT) && (spec->param > 63U) &&
+             (spec->param != FAULT_INJ_BIT_RANDOM))
+    {
+        return HAL_ERROR;
+    }
+    else if ((spec->kind == FAULT_INJ_DELAY) && (spec->param > INT32_MAX))
+    {
+        return HAL_ERROR;
+    }
+
+    float    lnMiss = (spec->chance != 0U) ? logf(1.0f - ((float)spec->chance * 0.001f)) : 0.0f;
+    uint32_t now    = HAL_GetTick();
+    uint8_t  slot   = FI_NIL;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    /* A free number, else the oldest finished one. */
+    for (uint8_t i = 0U; i < FAULT_INJ_MAX_FAULTS; ++i)
+    {
+        if (s_fiFaults[i].state == FI_FREE)
+        {
+            slot = i;
+            break;
+        }
+        if ((s_fiFaults[i].state == FI_DONE) && (slot == FI_NIL))
+            slot = i;
+    }
+    if (slot == FI_NIL)
+    {
+        __set_PRIMASK(primask);
+        return HAL_BUSY;
+    }
+
+    FiFault_t *f = &s_fiFaults[slot];
+    f->spec   = *spec;
+    f->state  = FI_WAITING;
+    f->open   = 0U;
+    f->lnMiss = lnMiss;
+    f->starts = 0U;
+    f->frames = 0U;
+    f->dueMs  = now + ((spec->chance != 0U) ? fi_gap_ms(f) : spec->atMs);
+    fi_insert(&s_fiWaiting, slot);
+
+    __set_PRIMASK(primask);
+
+    if (id != NULL)
+        *id = slot;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef FaultInj_Remove(uint8_t id)
+{
+    if (id >= FAULT_INJ_MAX_FAULTS)
+        return HAL_ERROR;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    FiFault_t *f = &s_fiFaults[id];
+    if (f->state == FI_FREE)
+    {
+        __set_PRIMASK(primask);
+        return HAL_ERROR;
+    }
+    if (f->state == FI_WAITING)
+        fi_unlink(&s_fiWaiting, id);
+    else if (f->state == FI_ACTIVE)
+        fi_unlink(&s_fiActive, id);
+    f->state = FI_FREE;
+    fi_rebuild_can();
+    s_fiDirty = 1U;
+
+    __set_PRIMASK(primask);
+    return HAL_OK;
+}
+
+void FaultInj_Clear(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    for (uint32_t i = 0U; i < FAULT_INJ_MAX_FAULTS; ++i)
+        s_fiFaults[i].state = FI_FREE;
+    s_fiWaiting    = FI_NIL;
+    s_fiActive     = FI_NIL;
+    s_fiCanCount   = 0U;
+    s_fiDelayCount = 0U;
+    s_fiDirty      = 1U;
+
+    __set_PRIMASK(primask);
+}
+
+void FaultInj_Seed(uint32_t seed)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_fiRng = (seed != 0U) ? seed : FAULT_INJ_SEED;
+    __set_PRIMASK(primask);
+}
+
+void FaultInj_GetStats(FaultInj_Stats_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *out = s_fiStats;
+    __set_PRIMASK(primask);
+}
+
+void FaultInj_Event10ms(void)
+{
+    /* Nothing held: one look at the heads. */
+    if ((s_fiWaiting == FI_NIL) && (s_fiActive == FI_NIL) && (s_fiDelayCount == 0U) &&
+        (s_fiDirty == 0U))
+        return;
+
+    uint32_t now = HAL_GetTick();
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t changed = s_fiDirty;
+    s_fiDirty = 0U;
+    if (fi_step(now) != 0U)
+        changed = 1U;
+    __set_PRIMASK(primask);
+
+    fi_release(now);
+
+    if (changed != 0U)
+        fi_sync_sensors();
+}
+
+const CAN_IF_Msg_t *FaultInj_CanRx(const CAN_IF_Msg_t *msg, CAN_IF_Msg_t *scratch)
+{
+    /* A frame a delay fault already held goes through. */
+    if ((s_fiCanCount == 0U) || (CAN_IF_MSG_FMI(msg) == CAN_IF_FMI_REINJECTED))
+        return msg;
+
+    const CAN_IF_Msg_t *out     = msg;
+    uint32_t            key     = CAN_IF_MSG_KEY(msg);
+    uint8_t             drop    = 0U;
+    uint8_t             delay   = 0U;
+    uint8_t             flipped = 0U;
+    uint32_t            delayMs = 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    for (uint32_t n = 0U; n < s_fiCanCount; ++n)
+    {
+        FiFault_t *f = &s_fiFaults[s_fiCan[n]];
+
+        if (f->spec.target != key)
+            continue;
+        f->frames++;
+
+        switch (f->spec.kind)
+        {
+        case FAULT_INJ_DROP:
+            drop = 1U;
+            break;
+        case FAULT_INJ_DELAY:
+            delay = 1U;
+            if (f->spec.param > delayMs)
+                delayMs = f->spec.param;
+            break;
+        case FAULT_INJ_CORRUPT:
+            if (out == msg)
+            {
+                *scratch = *msg;
+                out      = scratch;
+            }
+            flipped |= fi_corrupt(scratch, f->spec.param);
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (flipped != 0U)
+        s_fiStats.corrupted++;
+
+    if (drop != 0U)
+    {
+        s_fiStats.dropped++;
+        out = NULL;
+    }
+    else if ((delay != 0U) && (s_fiDelayCount >= FAULT_INJ_DELAY_DEPTH))
+    {
+        s_fiStats.delayFull++;
+    }
+    else if (delay != 0U)
+    {
+        FiDelayed_t *d = &s_fiDelay[(s_fiDelayHead + s_fiDelayCount) % FAULT_INJ_DELAY_DEPTH];
+
+        d->msg   = *out;
+        d->dueMs = HAL_GetTick() + delayMs;
+        s_fiDelayCount++;
+        s_fiStats.delayed++;
+        out = NULL;
+    }
+
+    __set_PRIMASK(primask);
+    return out;
+}
+
+#endif /* FAULT_INJ_ENABLE */
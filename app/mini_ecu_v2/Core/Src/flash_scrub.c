@@ -0,0 +1,306 @@
+/**
+ * @file    flash_scrub.c
+ * @brief   Idle-time CRC of the image and calibration flash, and "scrub".
+ */
+
+#include "flash_scrub.h"
+#include "cal_image.h"
+#include "cli_if.h"
+#include "dtc.h"
+#include "image_header.h"
+#include "log.h"
+#include <stddef.h>
+
+#if FLASH_SCRUB_ENABLE
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/** Largest image the slots hold (slot B). */
+#define FS_IMAGE_MAX        (256U * 1024U)
+
+typedef struct
+{
+    const char       *name;
+    Dtc_Id_t          dtc;
+    uint8_t           valid;    /* stamped: scrubbed */
+    uint8_t           ok;       /* last reported result */
+    uint32_t          base;
+    uint32_t          length;   /* bytes from base */
+    uint32_t          skipOff;  /* bytes left out of the CRC */
+    uint32_t          skipLen;
+    uint32_t          expect;   /* stamped CRC */
+
+    /* Idle hook -> runnable: the result of the last check and its count. */
+    volatile uint32_t crc;
+    volatile uint32_t checked;
+
+    /* Runnable only. */
+    uint32_t          reported;
+    uint32_t          mismatches;
+} FlashScrub_Region_t;
+
+#define FS_IMAGE            0U
+#define FS_CAL              1U
+#define FS_REGIONS          2U
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static FlashScrub_Region_t s_fsRegions[FS_REGIONS] =
+{
+    { .name = "image", .dtc = DTC_ROM_CHECKSUM, .ok = 1U },
+    { .name = "cal",   .dtc = DTC_CAL_CHECKSUM, .ok = 1U },
+};
+
+/* Set by the runnable to start a pass, cleared by the idle hook at its end. */
+static volatile uint8_t  s_fsRunning = 0U;
+
+/* Idle hook only while a pass runs. */
+static uint32_t          s_fsIndex = 0U;
+static uint32_t          s_fsPos   = 0U;
+
+static volatile uint32_t s_fsSlices   = 0U;
+static volatile uint32_t s_fsSliceMax = 0U;
+
+/* Runnable; "scrub now" moves the next start up. */
+static volatile uint32_t s_fsNextMs  = 0U;
+static uint32_t          s_fsStartMs = 0U;
+static uint8_t           s_fsWasRunning = 0U;
+static uint32_t          s_fsPasses  = 0U;
+static uint32_t          s_fsPassMs  = 0U;
+static uint32_t          s_fsMismatches = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static void fs_region_set(FlashScrub_Region_t *r, uint32_t base, uint32_t length,
+                          uint32_t skipOff, uint32_t skipLen, uint32_t expect)
+{
+    r->base    = base;
+    r->length  = length;
+    r->skipOff = skipOff;
+    r->skipLen = skipLen;
+    r->expect  = expect;
+    r->valid   = 1U;
+}
+
+/** First region from @p i on that is scrubbed, FS_REGIONS if none. */
+static uint32_t fs_next_valid(uint32_t i)
+{
+    while ((i < FS_REGIONS) && (s_fsRegions[i].valid == 0U))
+        i++;
+    return i;
+}
+
+/** Compare the regions checked since the last call and report them. */
+static void fs_report(void)
+{
+    for (uint32_t i = 0U; i < FS_REGIONS; ++i)
+    {
+        FlashScrub_Region_t *r       = &s_fsRegions[i];
+        uint32_t             checked = r->checked;
+
+        if (checked == r->reported)
+            continue;
+        r->reported = checked;
+
+        uint32_t crc = r->crc;
+        uint8_t  ok  = (crc == r->expect) ? 1U : 0U;
+
+        if (ok == 0U)
+        {
+            r->mismatches++;
+            s_fsMismatches++;
+        }
+        if ((ok == 0U) && (r->ok != 0U))
+        {
+            LOG_ERROR(MAIN, "Flash scrub: %s CRC %08lX, stamped %08lX", r->name,
+                      (unsigned long)crc, (unsigned long)r->expect);
+        }
+        else if ((ok != 0U) && (r->ok == 0U))
+        {
+            LOG_WARN(MAIN, "Flash scrub: %s CRC matches again", r->name);
+        }
+        r->ok = ok;
+        Dtc_Set(r->dtc, (ok == 0U) ? 1U : 0U);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void fs_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t cyclesPerUs = SystemCoreClock / 1000000U;
+    if (cyclesPerUs == 0U)
+        cyclesPerUs = 1U;
+
+    CLI_IF_Printf("Flash scrub every %u s, %u B per idle slice: %s, %lu passes, last %lu ms\r\n",
+                  (unsigned)FLASH_SCRUB_PERIOD_S, (unsigned)FLASH_SCRUB_SLICE_BYTES,
+                  (s_fsRunning != 0U) ? "running" : "waiting", (unsigned long)s_fsPasses,
+                  (unsigned long)s_fsPassMs);
+    CLI_IF_Printf("Slices %lu, longest %lu cycles (%lu us)\r\n", (unsigned long)s_fsSlices,
+                  (unsigned long)s_fsSliceMax, (unsigned long)(s_fsSliceMax / cyclesPerUs));
+
+    for (uint32_t i = 0U; i < FS_REGIONS; ++i)
+    {
+        const FlashScrub_Region_t *r = &s_fsRegions[i];
+
+        if (r->valid == 0U)
+        {
+            CLI_IF_Printf("  %-6s not stamped, not scrubbed\r\n", r->name);
+            continue;
+        }
+        CLI_IF_Printf("  %-6s 0x%08lX %7lu B  stamped %08lX  last %08lX  %s, %lu checks, %lu mismatches\r\n",
+                      r->name, (unsigned long)r->base, (unsigned long)r->length,
+                      (unsigned long)r->expect, (unsigned long)r->crc,
+                      (r->reported == 0U) ? "-" : ((r->ok != 0U) ? "ok" : "MISMATCH"),
+                      (unsigned long)r->reported, (unsigned long)r->mismatches);
+    }
+}
+
+static void fs_cmd_now(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if (s_fsRunning != 0U)
+    {
+        CLI_IF_Print("A pass is running.\r\n");
+        return;
+    }
+    s_fsNextMs = HAL_GetTick();
+    CLI_IF_Print("Pass starts within 100 ms.\r\n");
+}
+
+static const CliCommand_t s_fsCmds[] =
+{
+    { "scrub",     "", 0U, fs_cmd_show, "idle-time flash CRC check" },
+    { "scrub now", "", 0U, fs_cmd_now,  "start a flash scrub pass" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void FlashScrub_Init(void)
+{
+    const ImageHeader_t *hdr  = &g_imageHeader;
+    uint32_t             base = (uint32_t)hdr - IMAGE_HEADER_OFFSET;
+    uint32_t             end  = IMAGE_HEADER_OFFSET + (uint32_t)sizeof(ImageHeader_t);
+
+    if ((hdr->magic == IMAGE_HEADER_MAGIC) && (hdr->crc32 != IMAGE_ERASED) &&
+        (hdr->length >= end) && (hdr->length <= FS_IMAGE_MAX) && ((hdr->length & 3U) == 0U))
+    {
+        fs_region_set(&s_fsRegions[FS_IMAGE], base, hdr->length, IMAGE_HEADER_OFFSET,
+                      (uint32_t)sizeof(ImageHeader_t), hdr->crc32);
+    }
+
+    /* cal.c has checked it already; an image it did not take is not ours. */
+    const CalImage_Header_t *img = CalImage_Get();
+    if (CalImage_Check(img) == CAL_IMAGE_OK)
+    {
+        fs_region_set(&s_fsRegions[FS_CAL], (uint32_t)img, img->length,
+                      (uint32_t)offsetof(CalImage_Header_t, crc32), 4U, img->crc32);
+    }
+
+    __HAL_RCC_CRC_CLK_ENABLE();
+
+    s_fsNextMs = HAL_GetTick() + (FLASH_SCRUB_PERIOD_S * 1000U);
+    CLI_IF_REGISTER_TABLE(s_fsCmds);
+}
+
+void FlashScrub_Idle(void)
+{
+    if (s_fsRunning == 0U)
+        return;
+
+    uint32_t i = fs_next_valid(s_fsIndex);
+    if (i >= FS_REGIONS)
+    {
+        s_fsIndex   = 0U;
+        s_fsRunning = 0U;
+        return;
+    }
+
+    FlashScrub_Region_t *r   = &s_fsRegions[i];
+    uint32_t             t0  = DWT->CYCCNT;
+    uint32_t             pos = s_fsPos;
+
+    if (pos == 0U)
+        CRC->CR = CRC_CR_RESET;
+    if (pos == r->skipOff)
+        pos += r->skipLen;
+
+    uint32_t end = pos + FLASH_SCRUB_SLICE_BYTES;
+    if (end > r->length)
+        end = r->length;
+    if ((pos < r->skipOff) && (end > r->skipOff))
+        end = r->skipOff;
+
+    for (const uint32_t *p = (const uint32_t *)(r->base + pos); pos < end; pos += 4U)
+        CRC->DR = *p++;
+
+    if (pos >= r->length)
+    {
+        r->crc = CRC->DR;
+        r->checked++;
+        s_fsIndex = i + 1U;
+        pos       = 0U;
+    }
+    else
+    {
+        s_fsIndex = i;
+    }
+    s_fsPos = pos;
+
+    uint32_t cycles = DWT->CYCCNT - t0;
+    if (cycles > s_fsSliceMax)
+        s_fsSliceMax = cycles;
+    s_fsSlices++;
+}
+
+void FlashScrub_Event100ms(void)
+{
+    uint32_t now     = HAL_GetTick();
+    uint8_t  running = s_fsRunning;
+
+    /* The idle hook counts a region checked before it ends the pass. */
+    fs_report();
+    if (running != 0U)
+        return;
+
+    if (s_fsWasRunning != 0U)
+    {
+        s_fsWasRunning = 0U;
+        s_fsPasses++;
+        s_fsPassMs = now - s_fsStartMs;
+    }
+
+    if ((int32_t)(now - s_fsNextMs) >= 0)
+    {
+        s_fsStartMs    = now;
+        s_fsNextMs     = now + (FLASH_SCRUB_PERIOD_S * 1000U);
+        s_fsWasRunning = 1U;
+        s_fsRunning    = 1U;
+    }
+}
+
+void FlashScrub_GetStats(FlashScrub_Stats_t *out)
+{
+    out->passes     = s_fsPasses;
+    out->slices     = s_fsSlices;
+    out->sliceMax   = s_fsSliceMax;
+    out->passMs     = s_fsPassMs;
+    out->mismatches = s_fsMismatches;
+}
+
+#endif /* FLASH_SCRUB_ENABLE */
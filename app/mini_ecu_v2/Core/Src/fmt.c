@@ -0,0 +1,743 @@
+/**
+ * @file    fmt.c
+ * @brief   Table-driven hex, decimal and fixed-point formatters.
+ */
+
+#include "fmt.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+static const char s_fmtHex[16] =
+{
+    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
+};
+
+/** "00".."99": two digits per lookup, so one division per digit pair. */
+static const char s_fmtDigits2[200] =
+{
+    '0','0','0','1','0','2','0','3','0','4','0','5','0','6','0','7','0','8','0','9',
+    '1','0','1','1','1','2','1','3','1','4','1','5','1','6','1','7','1','8','1','9',
+    '2','0','2','1','2','2','2','3','2','4','2','5','2','6','2','7','2','8','2','9',
+    '3','0','3','1','3','2','3','3','3','4','3','5','3','6','3','7','3','8','3','9',
+    '4','0','4','1','4','2','4','3','4','4','4','5','4','6','4','7','4','8','4','9',
+    '5','0','5','1','5','2','5','3','5','4','5','5','5','6','5','7','5','8','5','9',
+    '6','0','6','1','6','2','6','3','6','4','6','5','6','6','6','7','6','8','6','9',
+    '7','0','7','1','7','2','7','3','7','4','7','5','7','6','7','7','7','8','7','9',
+    '8','0','8','1','8','2','8','3','8','4','8','5','8','6','8','7','8','8','8','9',
+    '9','0','9','1','9','2','9','3','9','4','9','5','9','6','9','7','9','8','9','9'
+};
+
+static const uint32_t s_fmtPow10[FMT_FIXED_MAX_DEC + 1U] = { 1U, 10U, 100U, 1000U, 10000U };
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Write the digits of @p v backwards so they end just before @p end.
+ *
+ * @return Number of digits (at least 1).
+ */
+static uint32_t fmt_digits_rev(char *end, uint32_t v)
+{
+    char *p = end;
+
+    while (v >= 100U)
+    {
+        uint32_t q = v / 100U;
+        uint32_t r = (v - (q * 100U)) * 2U;
+
+        p -= 2;
+        p[0] = s_fmtDigits2[r];
+        p[1] = s_fmtDigits2[r + 1U];
+        v = q;
+    }
+
+    if (v >= 10U)
+    {
+        p -= 2;
+        p[0] = s_fmtDigits2[v * 2U];
+        p[1] = s_fmtDigits2[(v * 2U) + 1U];
+    }
+    else
+    {
+        *--p = (char)('0' + v);
+    }
+
+    return (uint32_t)(end - p);
+}
+
+/**
+ * @brief fmt_digits_rev() of a 64-bit value: nine digits per 64-bit
+ *        division while @p v needs more than 32 bits, none after.
+ */
+static uint32_t fmt_digits_rev64(char *end, uint64_t v)
+{
+    char *p = end;
+
+    while (v > 0xFFFFFFFFU)
+    {
+        uint64_t q = v / 1000000000U;
+        uint32_t k = fmt_digits_rev(p, (uint32_t)(v - (q * 1000000000U)));
+
+        p -= k;
+        for (; k < 9U; ++k)
+            *--p = '0';
+        v = q;
+    }
+    p -= fmt_digits_rev(p, (uint32_t)v);
+
+    return (uint32_t)(end - p);
+}
+
+/** Copy @p len characters of @p src after @p pad spaces, NUL-terminated. */
+static uint32_t fmt_emit(char *out, const char *src, uint32_t len, uint8_t width)
+{
+    uint32_t pad = (width > len) ? (width - len) : 0U;
+    char    *p   = out;
+
+    for (uint32_t i = 0U; i < pad; ++i)
+        *p++ = ' ';
+    for (uint32_t i = 0U; i < len; ++i)
+        *p++ = src[i];
+    *p = '\0';
+
+    return pad + len;
+}
+
+static uint32_t fmt_strlen(const char *s)
+{
+    uint32_t n = 0U;
+
+    while (s[n] != '\0')
+        n++;
+    return n;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+uint32_t Fmt_Hex(char *out, uint32_t value, uint8_t digits)
+{
+    if (digits == 0U)
+        digits = 1U;
+    else if (digits > 8U)
+        digits = 8U;
+
+    for (uint32_t i = digits; i > 0U; --i)
+    {
+        out[i - 1U] = s_fmtHex[value & 0x0FU];
+        value >>= 4;
+    }
+    out[digits] = '\0';
+
+    return digits;
+}
+
+uint32_t Fmt_HexBytes(char *out, const uint8_t *data, uint32_t len, char sep)
+{
+    char *p = out;
+
+    for (uint32_t i = 0U; i < len; ++i)
+    {
+        if ((sep != '\0') && (i > 0U))
+            *p++ = sep;
+        *p++ = s_fmtHex[data[i] >> 4];
+        *p++ = s_fmtHex[data[i] & 0x0FU];
+    }
+    *p = '\0';
+
+    return (uint32_t)(p - out);
+}
+
+uint32_t Fmt_Dec(char *out, uint32_t value, uint8_t width)
+{
+    char     tmp[FMT_DEC_MAX];
+    uint32_t n = fmt_digits_rev(&tmp[sizeof(tmp)], value);
+
+    return fmt_emit(out, &tmp[sizeof(tmp) - n], n, width);
+}
+
+uint32_t Fmt_DecZ(char *out, uint32_t value, uint8_t width)
+{
+    char     tmp[FMT_DEC_MAX];
+    uint32_t n = fmt_digits_rev(&tmp[sizeof(tmp)], value);
+    uint32_t i = 0U;
+
+    for (; (i + n) < width; ++i)
+        out[i] = '0';
+
+    return i + fmt_emit(&out[i], &tmp[sizeof(tmp) - n], n, 0U);
+}
+
+uint32_t Fmt_Int(char *out, int32_t value, uint8_t width)
+{
+    char     tmp[FMT_DEC_MAX];
+    uint32_t mag = (value < 0) ? (0U - (uint32_t)value) : (uint32_t)value;
+    uint32_t n   = fmt_digits_rev(&tmp[sizeof(tmp)], mag);
+
+    if (value < 0)
+        tmp[sizeof(tmp) - ++n] = '-';
+
+    return fmt_emit(out, &tmp[sizeof(tmp) - n], n, width);
+}
+
+uint32_t Fmt_Fixed(char *out, float value, uint8_t decimals, uint8_t width)
+{
+    /* Sign, 10 integer digits, point, decimals. */
+    char tmp[1U + 10U + 1U + FMT_FIXED_MAX_DEC];
+    char *end = &tmp[sizeof(tmp)];
+    char *p   = end;
+
+    if (value != value)
+        return fmt_emit(out, "nan", 3U, width);
+
+    if (decimals > FMT_FIXED_MAX_DEC)
+        decimals = FMT_FIXED_MAX_DEC;
+
+    uint8_t neg = (value < 0.0f) ? 1U : 0U;
+    if (neg != 0U)
+        value = -value;
+
+    float    scaled = (value * (float)s_fmtPow10[decimals]) + 0.5f;
+    uint32_t u      = (scaled >= 4294967295.0f) ? 0xFFFFFFFFU : (uint32_t)scaled;
+    uint32_t ip     = u / s_fmtPow10[decimals];
+
+    if (decimals > 0U)
+    {
+        uint32_t fp = u - (ip * s_fmtPow10[decimals]);
+        uint32_t n  = fmt_digits_rev(p, fp);
+
+        p -= n;
+        for (; n < decimals; ++n)
+            *--p = '0';
+        *--p = '.';
+    }
+
+    p -= fmt_digits_rev(p, ip);
+    if (neg != 0U)
+        *--p = '-';
+
+    return fmt_emit(out, p, (uint32_t)(end - p), width);
+}
+
+uint32_t Fmt_Str(char *out, const char *s, uint8_t width)
+{
+    return fmt_emit(out, s, fmt_strlen(s), width);
+}
+
+uint32_t Fmt_StrLeft(char *out, const char *s, uint8_t width)
+{
+    uint32_t n = fmt_emit(out, s, fmt_strlen(s), 0U);
+
+    for (; n < width; ++n)
+        out[n] = ' ';
+    out[n] = '\0';
+
+    return n;
+}
+
+/* -------------------------------------------------------------------------- */
+/* printf subset                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Output window: characters past size - 1 are counted, not stored. */
+typedef struct
+{
+    char  *buf;
+    size_t size;
+    size_t n;
+} FmtOut_t;
+
+typedef struct
+{
+    uint8_t left;       /* '-' */
+    uint8_t zero;       /* '0' */
+    uint8_t plus;       /* '+' */
+    uint8_t space;      /* ' ' */
+    uint8_t alt;        /* '#' */
+    int32_t width;
+    int32_t prec;       /* -1: none */
+} FmtSpec_t;
+
+/* Octal digits of 2^64 - 1, the longest integer conversion. */
+#define FMT_INT_MAX     22U
+
+/* Sign, 10 integer digits, point, FMT_PRINTF_MAX_PREC decimals, "e-38". */
+#define FMT_FLOAT_MAX   (1U + 10U + 1U + FMT_PRINTF_MAX_PREC + 4U)
+
+static const uint32_t s_fmtPow10x[FMT_PRINTF_MAX_PREC + 1U] =
+{
+    1U, 10U, 100U, 1000U, 10000U, 100000U, 1000000U, 10000000U, 100000000U, 1000000000U
+};
+
+static void fmt_put(FmtOut_t *o, char c)
+{
+    if ((o->n + 1U) < o->size)
+        o->buf[o->n] = c;
+    o->n++;
+}
+
+static void fmt_repeat(FmtOut_t *o, char c, int32_t count)
+{
+    for (int32_t i = 0; i < count; ++i)
+        fmt_put(o, c);
+}
+
+/**
+ * @brief Emit one conversion: @p pre (sign or "0x", "" for none), @p zeros
+ *        zeros, then @p len characters of @p body, padded to the field
+ *        width.
+ *
+ * @param[in] zeroPad Whether the '0' flag applies to this conversion.
+ */
+static void fmt_field(FmtOut_t *o, const FmtSpec_t *sp, const char *pre, uint32_t zeros,
+                      const char *body, uint32_t len, uint8_t zeroPad)
+{
+    uint32_t preLen = fmt_strlen(pre);
+    int32_t  total  = (int32_t)(len + zeros + preLen);
+    int32_t  pad    = (sp->width > total) ? (sp->width - total) : 0;
+
+    if ((sp->left == 0U) && ((sp->zero == 0U) || (zeroPad == 0U)))
+        fmt_repeat(o, ' ', pad);
+    for (uint32_t i = 0U; i < preLen; ++i)
+        fmt_put(o, pre[i]);
+    if ((sp->left == 0U) && (sp->zero != 0U) && (zeroPad != 0U))
+        fmt_repeat(o, '0', pad);
+    fmt_repeat(o, '0', (int32_t)zeros);
+    for (uint32_t i = 0U; i < len; ++i)
+        fmt_put(o, body[i]);
+    if (sp->left != 0U)
+        fmt_repeat(o, ' ', pad);
+}
+
+static void fmt_integer(FmtOut_t *o, const FmtSpec_t *sp, uint64_t mag, uint8_t neg, char conv)
+{
+    char     tmp[FMT_INT_MAX];
+    char    *end    = &tmp[sizeof(tmp)];
+    char     pre[3] = { '\0', '\0', '\0' };
+    uint32_t n;
+
+    if ((conv == 'x') || (conv == 'X') || (conv == 'o'))
+    {
+        const char *digits = (conv == 'X') ? s_fmtHex : "0123456789abcdef";
+        uint32_t    shift  = (conv == 'o') ? 3U : 4U;
+        uint32_t    mask   = (1U << shift) - 1U;
+        char       *p      = end;
+
+        do
+        {
+            *--p = digits[(uint32_t)mag & mask];
+            mag >>= shift;
+        } while (mag != 0U);
+        n = (uint32_t)(end - p);
+
+        /* "%#x": "0x" before a non-zero value. */
+        if ((sp->alt != 0U) && (conv != 'o') && ((n > 1U) || (end[-1] != '0')))
+        {
+            pre[0] = '0';
+            pre[1] = conv;
+        }
+    }
+    else
+    {
+        n      = fmt_digits_rev64(end, mag);
+        pre[0] = (neg != 0U) ? '-' : (sp->plus != 0U) ? '+' : (sp->space != 0U) ? ' ' : '\0';
+    }
+
+    /* "%.0u" of 0 prints nothing. */
+    if ((sp->prec == 0) && (n == 1U) && (end[-1] == '0'))
+        n = 0U;
+
+    uint32_t zeros = ((sp->prec > 0) && ((uint32_t)sp->prec > n)) ? ((uint32_t)sp->prec - n) : 0U;
+
+    /* "%#o": the first digit is a 0. */
+    if ((conv == 'o') && (sp->alt != 0U) && (zeros == 0U) && ((n == 0U) || (end[-(int32_t)n] != '0')))
+        zeros = 1U;
+
+    fmt_field(o, sp, pre, zeros, &end[-(int32_t)n], n, (sp->prec < 0) ? 1U : 0U);
+}
+
+/** "0x" and the hex digits of @p v, padded as one field. */
+static void fmt_put_hex_prefix(FmtOut_t *o, const FmtSpec_t *sp, uintptr_t v)
+{
+    char  tmp[2U + (2U * sizeof(uintptr_t))];
+    char *end = &tmp[sizeof(tmp)];
+    char *p   = end;
+
+    do
+    {
+        *--p = "0123456789abcdef"[v & 0x0FU];
+        v >>= 4;
+    } while (v != 0U);
+    *--p = 'x';
+    *--p = '0';
+    fmt_field(o, sp, "", 0U, p, (uint32_t)(end - p), 0U);
+}
+
+/**
+ * @brief Digits of |@p a| with @p prec decimals, rounded; a >= 0, < 2^32.
+ *
+ * @return Characters written to @p out.
+ */
+static uint32_t fmt_fixed_body(char *out, float a, uint32_t prec, uint8_t alt)
+{
+    char     tmp[FMT_FLOAT_MAX];
+    char    *end   = &tmp[sizeof(tmp)];
+    char    *p     = end;
+    uint32_t scale = s_fmtPow10x[prec];
+    uint32_t ip    = (uint32_t)a;
+    float    fr    = ((a - (float)ip) * (float)scale) + 0.5f;
+    uint32_t fp    = (fr >= (float)scale) ? scale : (uint32_t)fr;
+
+    if (fp >= scale)
+    {
+        ip++;
+        fp -= scale;
+    }
+    if (prec > 0U)
+    {
+        uint32_t n = fmt_digits_rev(p, fp);
+
+        p -= n;
+        for (; n < prec; ++n)
+            *--p = '0';
+    }
+    if ((prec > 0U) || (alt != 0U))
+        *--p = '.';
+    p -= fmt_digits_rev(p, ip);
+
+    uint32_t len = (uint32_t)(end - p);
+    for (uint32_t i = 0U; i < len; ++i)
+        out[i] = p[i];
+    return len;
+}
+
+/** Scale @p a (> 0) into [1, 10) and return the power of ten taken out. */
+static int32_t fmt_exp10(float *a)
+{
+    int32_t e = 0;
+
+    while (*a >= 10.0f)
+    {
+        *a /= 10.0f;
+        e++;
+    }
+    while (*a < 1.0f)
+    {
+        *a *= 10.0f;
+        e--;
+    }
+    return e;
+}
+
+/** "d.ddde+XX" of @p a >= 0 with @p prec decimals. */
+static uint32_t fmt_exp_body(char *out, float a, uint32_t prec, uint8_t alt, char conv)
+{
+    int32_t  e = (a > 0.0f) ? fmt_exp10(&a) : 0;
+    uint32_t n = fmt_fixed_body(out, a, prec, alt);
+
+    /* Rounding may carry to "10.0". */
+    if ((out[0] == '1') && (out[1] == '0'))
+    {
+        e++;
+        n = fmt_fixed_body(out, a / 10.0f, prec, alt);
+    }
+
+    uint32_t ue = (e < 0) ? (uint32_t)(-e) : (uint32_t)e;
+    out[n++] = ((conv == 'E') || (conv == 'G')) ? 'E' : 'e';
+    out[n++] = (e < 0) ? '-' : '+';
+    out[n++] = (char)('0' + ((ue / 10U) % 10U));
+    out[n++] = (char)('0' + (ue % 10U));
+    return n;
+}
+
+/** Drop trailing zeros after the point, and the point if nothing follows. */
+static uint32_t fmt_strip_zeros(char *s, uint32_t n)
+{
+    uint32_t dot = n;
+
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        if (s[i] == '.')
+            dot = i;
+    }
+    if (dot == n)
+        return n;
+
+    uint32_t end = n;
+    while ((end > (dot + 1U)) && (s[end - 1U] == '0'))
+        end--;
+    if (end == (dot + 1U))
+        end = dot;
+    return end;
+}
+
+static void fmt_float(FmtOut_t *o, const FmtSpec_t *sp, double d, char conv)
+{
+    char    body[FMT_FLOAT_MAX];
+    float   v       = (float)d;
+    uint8_t neg     = ((v < 0.0f) || ((v == 0.0f) && (d < 0.0))) ? 1U : 0U;
+    char    sign[2] = { (neg != 0U) ? '-' : (sp->plus != 0U) ? '+' : (sp->space != 0U) ? ' ' : '\0',
+                        '\0' };
+    float   a       = (neg != 0U) ? -v : v;
+
+    if (v != v)
+    {
+        fmt_field(o, sp, "", 0U, "nan", 3U, 0U);
+        return;
+    }
+    if ((a - a) != 0.0f)
+    {
+        fmt_field(o, sp, sign, 0U, "inf", 3U, 0U);
+        return;
+    }
+
+    uint32_t prec = (sp->prec < 0) ? 6U : (uint32_t)sp->prec;
+    if (prec > FMT_PRINTF_MAX_PREC)
+        prec = FMT_PRINTF_MAX_PREC;
+
+    uint32_t n;
+    if ((conv == 'f') || (conv == 'F'))
+    {
+        /* Beyond the 32-bit integer part: scientific instead. */
+        n = (a < 4294967040.0f) ? fmt_fixed_body(body, a, prec, sp->alt)
+                                : fmt_exp_body(body, a, prec, sp->alt, 'e');
+    }
+    else if ((conv == 'e') || (conv == 'E'))
+    {
+        n = fmt_exp_body(body, a, prec, sp->alt, conv);
+    }
+    else
+    {
+        /* %g: the exponent %e would print decides the style (C11 7.21.6.1). */
+        uint32_t p = (prec == 0U) ? 1U : prec;
+        n = fmt_exp_body(body, a, p - 1U, 0U, conv);
+
+        int32_t x = (body[n - 3U] == '-') ? -(int32_t)(((uint32_t)(body[n - 2U] - '0') * 10U) +
+                                                       (uint32_t)(body[n - 1U] - '0'))
+                                          : (int32_t)(((uint32_t)(body[n - 2U] - '0') * 10U) +
+                                                      (uint32_t)(body[n - 1U] - '0'));
+        if (((int32_t)p > x) && (x >= -4))
+        {
+            n = fmt_fixed_body(body, a, (uint32_t)((int32_t)p - 1 - x), sp->alt);
+            if (sp->alt == 0U)
+                n = fmt_strip_zeros(body, n);
+        }
+        else if (sp->alt == 0U)
+        {
+            /* Strip in the mantissa, keep the exponent. */
+            char     ex[4];
+            uint32_t m = n - 4U;
+
+            for (uint32_t i = 0U; i < 4U; ++i)
+                ex[i] = body[m + i];
+            m = fmt_strip_zeros(body, m);
+            for (uint32_t i = 0U; i < 4U; ++i)
+                body[m + i] = ex[i];
+            n = m + 4U;
+        }
+    }
+
+    fmt_field(o, sp, sign, 0U, body, n, 1U);
+}
+
+int Fmt_Vsnprintf(char *out, size_t size, const char *fmt, va_list ap)
+{
+    FmtOut_t o = { out, size, 0U };
+
+    while (*fmt != '\0')
+    {
+        if (*fmt != '%')
+        {
+            fmt_put(&o, *fmt++);
+            continue;
+        }
+        fmt++;
+
+        FmtSpec_t sp = { 0U, 0U, 0U, 0U, 0U, 0, -1 };
+
+        for (;; ++fmt)
+        {
+            if (*fmt == '-')
+                sp.left = 1U;
+            else if (*fmt == '0')
+                sp.zero = 1U;
+            else if (*fmt == '+')
+                sp.plus = 1U;
+            else if (*fmt == ' ')
+                sp.space = 1U;
+            else if (*fmt == '#')
+                sp.alt = 1U;
+            else
+                break;
+        }
+
+        if (*fmt == '*')
+        {
+            sp.width = va_arg(ap, int);
+            if (sp.width < 0)
+            {
+                sp.left  = 1U;
+                sp.width = -sp.width;
+            }
+            fmt++;
+        }
+        else
+        {
+            while ((*fmt >= '0') && (*fmt <= '9'))
+                sp.width = (sp.width * 10) + (*fmt++ - '0');
+        }
+
+        if (*fmt == '.')
+        {
+            fmt++;
+            sp.prec = 0;
+            if (*fmt == '*')
+            {
+                int p = va_arg(ap, int);
+                sp.prec = (p < 0) ? -1 : p;
+                fmt++;
+            }
+            else
+            {
+                while ((*fmt >= '0') && (*fmt <= '9'))
+                    sp.prec = (sp.prec * 10) + (*fmt++ - '0');
+            }
+        }
+
+        /* Length: 'H' for hh, 'L' for ll, else the letter; '\0' for none. */
+        char lng = '\0';
+        if ((*fmt == 'h') || (*fmt == 'l'))
+        {
+            lng = *fmt++;
+            if (*fmt == lng)
+            {
+                lng = (lng == 'h') ? 'H' : 'L';
+                fmt++;
+            }
+        }
+        else if ((*fmt == 'j') || (*fmt == 'z') || (*fmt == 't'))
+        {
+            lng = *fmt++;
+        }
+
+        char conv = *fmt;
+        if (conv == '\0')
+            break;
+        fmt++;
+
+        switch (conv)
+        {
+        case 'd':
+        case 'i':
+        {
+            int64_t v;
+
+            if (lng == 'L')
+                v = (int64_t)va_arg(ap, long long);
+            else if (lng == 'j')
+                v = (int64_t)va_arg(ap, intmax_t);
+            else if (lng == 'l')
+                v = (int64_t)va_arg(ap, long);
+            else if ((lng == 'z') || (lng == 't'))
+                v = (int64_t)va_arg(ap, ptrdiff_t);
+            else if (lng == 'h')
+                v = (int64_t)(short)va_arg(ap, int);
+            else if (lng == 'H')
+                v = (int64_t)(signed char)va_arg(ap, int);
+            else
+                v = (int64_t)va_arg(ap, int);
+
+            uint64_t m = (v < 0) ? (0U - (uint64_t)v) : (uint64_t)v;
+            fmt_integer(&o, &sp, m, (v < 0) ? 1U : 0U, 'u');
+            break;
+        }
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+        {
+            uint64_t v;
+
+            if (lng == 'L')
+                v = (uint64_t)va_arg(ap, unsigned long long);
+            else if (lng == 'j')
+                v = (uint64_t)va_arg(ap, uintmax_t);
+            else if (lng == 'l')
+                v = (uint64_t)va_arg(ap, unsigned long);
+            else if ((lng == 'z') || (lng == 't'))
+                v = (uint64_t)va_arg(ap, size_t);
+            else if (lng == 'h')
+                v = (uint64_t)(unsigned short)va_arg(ap, unsigned int);
+            else if (lng == 'H')
+                v = (uint64_t)(unsigned char)va_arg(ap, unsigned int);
+            else
+                v = (uint64_t)va_arg(ap, unsigned int);
+
+            fmt_integer(&o, &sp, v, 0U, conv);
+            break;
+        }
+        case 'c':
+        {
+            char c = (char)va_arg(ap, int);
+            fmt_field(&o, &sp, "", 0U, &c, 1U, 0U);
+            break;
+        }
+        case 's':
+        {
+            const char *s = va_arg(ap, const char *);
+            uint32_t    n = 0U;
+
+            if (s == NULL)
+                s = "(null)";
+            while ((s[n] != '\0') && ((sp.prec < 0) || (n < (uint32_t)sp.prec)))
+                n++;
+            fmt_field(&o, &sp, "", 0U, s, n, 0U);
+            break;
+        }
+        case 'p':
+        {
+            /* As "%#lx", like newlib. */
+            sp.alt = 0U;
+            fmt_put_hex_prefix(&o, &sp, (uintptr_t)va_arg(ap, void *));
+            break;
+        }
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+            fmt_float(&o, &sp, va_arg(ap, double), conv);
+            break;
+        case '%':
+            fmt_put(&o, '%');
+            break;
+        default:
+            /* Unknown conversion: print it as written. */
+            fmt_put(&o, '%');
+            fmt_put(&o, conv);
+            break;
+        }
+    }
+
+    if (size != 0U)
+        out[(o.n < size) ? o.n : (size - 1U)] = '\0';
+
+    return (int)o.n;
+}
+
+int Fmt_Snprintf(char *out, size_t size, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = Fmt_Vsnprintf(out, size, fmt, ap);
+    va_end(ap);
+
+    return n;
+}
@@ -24,6 +24,10 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "ramfunc.h"
+#include "boot_prof.h"
+#include "crash_dump.h"
+#include "flash_scrub.h"
 
 /* USER CODE END Includes */
 
@@ -52,8 +56,83 @@
 
 /* USER CODE END FunctionPrototypes */
 
+/* Functions needed when configGENERATE_RUN_TIME_STATS is on */
+void configureTimerForRunTimeStats(void);
+unsigned long getRunTimeCounterValue(void);
+
+/* Hook prototypes */
+void vApplicationIdleHook(void);
+void vApplicationStackOverflowHook(TaskHandle_t xTask, char *pcTaskName);
+
+/* USER CODE BEGIN 1 */
+/*
+ * The run-time stats clock is the DWT cycle counter: one count per core
+ * cycle, no timer peripheral and no interrupt. Called by the kernel from
+ * vTaskStartScheduler().
+ */
+void configureTimerForRunTimeStats(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  /* The boot profile counts on over the restart (boot_prof.h) */
+  BootProf_Rebase();
+  DWT->CYCCNT = 0U;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+RAMFUNC unsigned long getRunTimeCounterValue(void)
+{
+  return DWT->CYCCNT;
+}
+/* USER CODE END 1 */
+
+/* USER CODE BEGIN 4 */
+/*
+ * configUSE_IDLE_HOOK: called by the idle task on every turn, before it
+ * sleeps. Must not block; whatever becomes ready preempts it.
+ */
+void vApplicationIdleHook(void)
+{
+#if FLASH_SCRUB_ENABLE
+  FlashScrub_Idle();
+#endif
+}
+
+/*
+ * configCHECK_FOR_STACK_OVERFLOW: called from the context switch with the
+ * overrunning task still current and its registers already saved. The
+ * crash dump records them like a watchdog stop and resets; carrying on
+ * would run on whatever the overrun overwrote.
+ */
+void vApplicationStackOverflowHook(TaskHandle_t xTask, char *pcTaskName)
+{
+  (void)pcTaskName;
+  CrashDump_StackOverflow(xTask);
+}
+/* USER CODE END 4 */
+
 /* Private application code --------------------------------------------------*/
 /* USER CODE BEGIN Application */
 
+#if RTOS_STATIC_ALLOC
+/*
+ * No heap in the static-only build. The CMSIS-RTOS2 wrapper still references
+ * the allocator from APIs this application does not use (thread enumerate,
+ * timers, memory pools); reaching one of them is a configuration error, so
+ * stop in configASSERT() instead of failing silently.
+ */
+void *pvPortMalloc(size_t xWantedSize)
+{
+  (void)xWantedSize;
+  configASSERT(0);
+  return NULL;
+}
+
+void vPortFree(void *pv)
+{
+  (void)pv;
+  configASSERT(0);
+}
+#endif
+
 /* USER CODE END Application */
 
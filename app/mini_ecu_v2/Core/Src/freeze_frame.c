@@ -0,0 +1,322 @@
+/**
+ * @file    freeze_frame.c
+ * @brief   Freeze frame slots, the pre-trigger ring and their flash log
+ *          client.
+ */
+
+#include "freeze_frame.h"
+#include "nvm_log.h"
+#include "log.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* Records: key = slot << 8 | chunk. Chunks 0.. CAN_SIG_COUNT - 1: cache
+ * entry, aux = received, data = value bits, time; then the history cells
+ * two by two, oldest row first; the header last, aux = used, data[0] =
+ * code | rows << 16, data[1] = capture time. */
+#define FF_CHUNK_HIST       ((uint32_t)CAN_SIG_COUNT)
+#define FF_CHUNK_HEAD       (FREEZE_FRAME_CHUNKS - 1U)
+#define FF_CELLS            (FREEZE_FRAME_ROWS * FREEZE_FRAME_SIGNALS)
+#define FF_ALL_CHUNKS       ((FREEZE_FRAME_CHUNKS >= 64U) ? ~0ULL \
+                                                          : ((1ULL << FREEZE_FRAME_CHUNKS) - 1ULL))
+
+/* Rasters (100 ms) per pre-trigger row. */
+#define FF_ROW_DIV          (FREEZE_FRAME_ROW_MS / 100U)
+
+_Static_assert(FREEZE_FRAME_SIGNALS > 0U, "FREEZE_FRAME_SIGNAL_TABLE is empty");
+_Static_assert(FREEZE_FRAME_CHUNKS <= 64U, "a slot's pending chunks must fit one 64-bit mask");
+
+typedef struct
+{
+    uint8_t       used;
+    FreezeFrame_t f;
+} FreezeFrame_Slot_t;
+
+#define FF_SIG_(name)       (uint8_t)CAN_SIG_##name,
+static const uint8_t s_ffSignals[FREEZE_FRAME_SIGNALS] = { FREEZE_FRAME_SIGNAL_TABLE(FF_SIG_) };
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Slots and their pending chunks: written by FreezeFrame_Capture() (any
+ * context), FreezeFrame_Clear() and NvmTask, under PRIMASK. */
+static FreezeFrame_Slot_t  s_ffSlots[FREEZE_FRAME_SLOTS];
+static uint64_t            s_ffPending[FREEZE_FRAME_SLOTS];
+static FreezeFrame_Stats_t s_ffStats;
+
+/* Pre-trigger ring: s_ffHead is the next row written, s_ffRows the rows
+ * filled. Written by the 100 ms raster, read by a capture, under PRIMASK. */
+static float    s_ffRing[FREEZE_FRAME_ROWS][FREEZE_FRAME_SIGNALS];
+static uint32_t s_ffHead = 0U;
+static uint32_t s_ffRows = 0U;
+static uint32_t s_ffDiv  = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t ff_f2u(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static float ff_u2f(uint32_t u)
+{
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static void ff_restore(const NvmLog_Record_t *rec)
+{
+    uint32_t slot  = (uint32_t)rec->key >> 8;
+    uint32_t chunk = (uint32_t)rec->key & 0xFFU;
+
+    if ((slot >= FREEZE_FRAME_SLOTS) || (chunk >= FREEZE_FRAME_CHUNKS))
+        return;
+
+    FreezeFrame_Slot_t *s    = &s_ffSlots[slot];
+    float              *cell = &s->f.hist[0][0];
+
+    if (chunk == FF_CHUNK_HEAD)
+    {
+        s->used     = (rec->aux != 0U) ? 1U : 0U;
+        s->f.code   = (uint16_t)(rec->data[0] & 0xFFFFU);
+        s->f.rows   = (uint8_t)(rec->data[0] >> 16);
+        s->f.timeMs = rec->data[1];
+        if (s->f.rows > FREEZE_FRAME_ROWS)
+            s->used = 0U;
+    }
+    else if (chunk < FF_CHUNK_HIST)
+    {
+        s->f.cache[chunk].value  = ff_u2f(rec->data[0]);
+        s->f.cache[chunk].timeMs = rec->data[1];
+        s->f.cache[chunk].seq    = (rec->aux != 0U) ? 1U : 0U;
+    }
+    else
+    {
+        uint32_t c = (chunk - FF_CHUNK_HIST) * 2U;
+
+        cell[c] = ff_u2f(rec->data[0]);
+        if ((c + 1U) < FF_CELLS)
+            cell[c + 1U] = ff_u2f(rec->data[1]);
+    }
+}
+
+static uint8_t ff_take(uint32_t i, uint8_t all, NvmLog_Record_t *rec)
+{
+    uint32_t slot  = i / FREEZE_FRAME_CHUNKS;
+    uint32_t chunk = i % FREEZE_FRAME_CHUNKS;
+    uint64_t bit   = 1ULL << chunk;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    const FreezeFrame_Slot_t *s    = &s_ffSlots[slot];
+    const float              *cell = &s->f.hist[0][0];
+
+    /* A freed slot is written once as an empty header, then dropped. */
+    uint8_t take = (all != 0U) ? s->used : (uint8_t)((s_ffPending[slot] & bit) != 0U);
+
+    rec->key = (uint16_t)((slot << 8) | chunk);
+    if (chunk == FF_CHUNK_HEAD)
+    {
+        rec->aux     = s->used;
+        rec->data[0] = (uint32_t)s->f.code | ((uint32_t)s->f.rows << 16);
+        rec->data[1] = s->f.timeMs;
+    }
+    else if (chunk < FF_CHUNK_HIST)
+    {
+        rec->aux     = (s->f.cache[chunk].seq != 0U) ? 1U : 0U;
+        rec->data[0] = ff_f2u(s->f.cache[chunk].value);
+        rec->data[1] = s->f.cache[chunk].timeMs;
+    }
+    else
+    {
+        uint32_t c = (chunk - FF_CHUNK_HIST) * 2U;
+
+        rec->aux     = 0U;
+        rec->data[0] = ff_f2u(cell[c]);
+        rec->data[1] = ((c + 1U) < FF_CELLS) ? ff_f2u(cell[c + 1U]) : 0U;
+    }
+    s_ffPending[slot] &= ~bit;
+
+    __set_PRIMASK(primask);
+    return take;
+}
+
+static void ff_retry(uint32_t i)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_ffPending[i / FREEZE_FRAME_CHUNKS] |= 1ULL << (i % FREEZE_FRAME_CHUNKS);
+    __set_PRIMASK(primask);
+}
+
+static const NvmLog_Client_t s_ffClient =
+{
+    .tag     = NVM_LOG_TAG_FF,
+    .count   = FREEZE_FRAME_SLOTS * FREEZE_FRAME_CHUNKS,
+    .restore = ff_restore,
+    .take    = ff_take,
+    .retry   = ff_retry,
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+uint32_t FreezeFrame_Signal(uint32_t col)
+{
+    return (col < FREEZE_FRAME_SIGNALS) ? s_ffSignals[col] : (uint32_t)CAN_SIG_COUNT;
+}
+
+void FreezeFrame_Init(void)
+{
+    memset(s_ffSlots, 0, sizeof(s_ffSlots));
+    memset(s_ffPending, 0, sizeof(s_ffPending));
+    memset(&s_ffStats, 0, sizeof(s_ffStats));
+    s_ffHead = 0U;
+    s_ffRows = 0U;
+    s_ffDiv  = 0U;
+
+    if (NvmLog_Register(&s_ffClient) != HAL_OK)
+        LOG_ERROR(MAIN, "Freeze frames not in the flash log, not kept over a reset");
+}
+
+HAL_StatusTypeDef FreezeFrame_Capture(uint16_t code)
+{
+    const uint32_t rowBytes = sizeof(s_ffRing[0]);
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    FreezeFrame_Slot_t *s = NULL;
+
+    for (uint32_t i = 0U; i < FREEZE_FRAME_SLOTS; ++i)
+    {
+        if (s_ffSlots[i].used == 0U)
+        {
+            if (s == NULL)
+                s = &s_ffSlots[i];
+        }
+        else if (s_ffSlots[i].f.code == code)
+        {
+            __set_PRIMASK(primask);
+            return HAL_BUSY;
+        }
+    }
+
+    if (s == NULL)
+    {
+        s_ffStats.dropped++;
+        __set_PRIMASK(primask);
+        return HAL_ERROR;
+    }
+
+    s->used     = 1U;
+    s->f.code   = code;
+    s->f.rows   = (uint8_t)s_ffRows;
+    s->f.timeMs = HAL_GetTick();
+    CanSigCache_Snapshot(s->f.cache);
+
+    /* Until the ring has wrapped its rows start at 0; after, at s_ffHead. */
+    if (s_ffRows < FREEZE_FRAME_ROWS)
+    {
+        memcpy(s->f.hist, s_ffRing, s_ffRows * rowBytes);
+    }
+    else
+    {
+        uint32_t older = FREEZE_FRAME_ROWS - s_ffHead;
+
+        memcpy(s->f.hist, s_ffRing[s_ffHead], older * rowBytes);
+        memcpy(s->f.hist[older], s_ffRing, s_ffHead * rowBytes);
+    }
+
+    s_ffPending[s - s_ffSlots] = FF_ALL_CHUNKS;
+    s_ffStats.captured++;
+
+    __set_PRIMASK(primask);
+    return HAL_OK;
+}
+
+void FreezeFrame_Clear(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    for (uint32_t i = 0U; i < FREEZE_FRAME_SLOTS; ++i)
+    {
+        if (s_ffSlots[i].used == 0U)
+            continue;
+        s_ffSlots[i].used = 0U;
+        s_ffPending[i]    = 1ULL << FF_CHUNK_HEAD;
+    }
+
+    __set_PRIMASK(primask);
+}
+
+HAL_StatusTypeDef FreezeFrame_Get(uint16_t code, FreezeFrame_t *out)
+{
+    HAL_StatusTypeDef st = HAL_ERROR;
+
+    if (out == NULL)
+        return HAL_ERROR;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint32_t i = 0U; i < FREEZE_FRAME_SLOTS; ++i)
+    {
+        if ((s_ffSlots[i].used != 0U) && (s_ffSlots[i].f.code == code))
+        {
+            *out = s_ffSlots[i].f;
+            st   = HAL_OK;
+            break;
+        }
+    }
+    __set_PRIMASK(primask);
+    return st;
+}
+
+void FreezeFrame_GetStats(FreezeFrame_Stats_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *out      = s_ffStats;
+    out->used = 0U;
+    for (uint32_t i = 0U; i < FREEZE_FRAME_SLOTS; ++i)
+        out->used += s_ffSlots[i].used;
+    __set_PRIMASK(primask);
+}
+
+void FreezeFrame_Event100ms(void)
+{
+    if (++s_ffDiv < FF_ROW_DIV)
+        return;
+    s_ffDiv = 0U;
+
+    /* Build the row outside the critical section, store it in one copy. */
+    float row[FREEZE_FRAME_SIGNALS];
+
+    for (uint32_t c = 0U; c < FREEZE_FRAME_SIGNALS; ++c)
+    {
+        CanSigCache_Entry_t e;
+
+        (void)CanSigCache_Read((CanSigCache_Signal_t)s_ffSignals[c], &e);
+        row[c] = e.value;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memcpy(s_ffRing[s_ffHead], row, sizeof(row));
+    s_ffHead = (s_ffHead + 1U) % FREEZE_FRAME_ROWS;
+    if (s_ffRows < FREEZE_FRAME_ROWS)
+        s_ffRows++;
+    __set_PRIMASK(primask);
+}
@@ -0,0 +1,1042 @@
+/**
+ * @file    fw_proxy.c
+ * @brief   Flashing proxy on CAN2: FwProxyTask, its ISO-TP client and "fwp".
+ *
+ * The CAN2 RX interrupt only copies the frames of 0x7E8..0x7EF into a ring
+ * (FwProxy_OnRx()); everything else runs in FwProxyTask: reassembly, flow
+ * control, the requests and the node states, so none of it needs a lock.
+ * FwProxy_Start() sets a job up only while the task is idle and hands it
+ * over by the state word, as stage.c does.
+ *
+ * Each node has one request outstanding and its own sender; the functional
+ * sender carries the chunks. Senders work as isotp.c's: a burst of
+ * consecutive frames per pass, the next tick when CAN2 has no submission
+ * slot.
+ */
+
+#include "fw_proxy.h"
+
+#if FW_PROXY_ENABLE
+
+#include "can_if.h"
+#include "can_ring.h"
+#include "stage.h"
+#include "image_header.h"
+#include "cli_if.h"
+#include "log.h"
+#include "ramfunc.h"
+#include "sys_config.h"
+#include "cmsis_os2.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+_Static_assert(CAN_IF_NUM_BUSES > 1U, "the flashing proxy needs CAN2 (CAN_IF_NUM_BUSES 2)");
+_Static_assert((FW_PROXY_RX_FRAMES & (FW_PROXY_RX_FRAMES - 1U)) == 0U,
+               "FW_PROXY_RX_FRAMES must be a power of two");
+
+/* Bootloader commands and status codes (boot_update.h). */
+#define FWP_CMD_INFO        0x01U
+#define FWP_CMD_ERASE       0x02U
+#define FWP_CMD_WRITE       0x03U
+#define FWP_CMD_DONE        0x04U
+#define FWP_CMD_GO          0x05U
+
+#define FWP_ST_OK           0U
+#define FWP_ST_INCOMPLETE   6U
+
+/* INFO of protocol 3 names the slot written; 7 takes the ERASE tag. */
+#define FWP_PROTO_SLOTS     3U
+#define FWP_PROTO_RESUME    7U
+#define FWP_ALL_SECTORS     0xFFFFFFFFU
+
+/* Reply words kept after the status: INFO's first seven, up to the slot
+ * base; the transfer record behind them is not needed. */
+#define FWP_WORDS           7U
+#define FWP_RESP_MAX        (4U + (FWP_WORDS * 4U))
+
+/* Request header (cmd, 0, seq) and up to three argument words. */
+#define FWP_HDR_MAX         16U
+
+/* ISO-TP, as isotp.c. */
+#define FWP_PCI_SF          0x0U
+#define FWP_PCI_FF          0x1U
+#define FWP_PCI_CF          0x2U
+#define FWP_PCI_FC          0x3U
+#define FWP_FS_CTS          0x0U
+#define FWP_FS_WAIT         0x1U
+#define FWP_SF_MAX          7U
+#define FWP_FF_DATA         6U
+#define FWP_CF_DATA         7U
+#define FWP_PDU_MAX         4095U
+#define FWP_PAD             0xCCU
+
+#define FWP_TX_IDLE         0U
+#define FWP_TX_FIRST        1U      /* Single or First Frame to send */
+#define FWP_TX_WAIT_FC      2U
+#define FWP_TX_CF           3U
+#define FWP_TX_GAP          4U      /* functional: the nodes program the chunk */
+
+typedef enum
+{
+    FWP_N_OFF = 0,          /* not in the job */
+    FWP_N_INFO,
+    FWP_N_ERASE,
+    FWP_N_READY,            /* erased, takes the multicast */
+    FWP_N_DONE,
+    FWP_N_RESEND,           /* a missed chunk, physically */
+    FWP_N_GO,
+    FWP_N_OK,
+    FWP_N_SKIPPED,
+    FWP_N_FAILED
+} FwpNodeState_t;
+
+/** A CAN2 frame from the RX interrupt. */
+typedef struct
+{
+    uint32_t key;
+    union
+    {
+        uint8_t  data[8];
+        uint32_t words[2];
+    };
+    uint8_t  dlc;
+} FwpFrame_t;
+
+/** One PDU being sent: the header here, the chunk straight from the slot. */
+typedef struct
+{
+    uint32_t       id;
+    uint8_t        hdr[FWP_HDR_MAX];
+    uint8_t        hdrLen;
+    uint8_t        state;
+    uint8_t        sn;
+    uint8_t        block;      /* CFs left before the next FC, 0 = no limit */
+    uint8_t        stmin;      /* ticks between CFs */
+    const uint8_t *data;
+    uint16_t       len;        /* whole PDU */
+    uint16_t       pos;        /* bytes sent */
+    uint32_t       tick;       /* FC wait start, last CF, or gap start */
+} FwpTx_t;
+
+typedef struct
+{
+    uint8_t     state;
+    uint8_t     cmd;           /* request waiting for its reply, 0 = none */
+    uint8_t     tries;         /* sends of it left */
+    uint8_t     proto;
+    uint8_t     failCmd;       /* request that failed, 0 = none */
+    uint16_t    seq;
+    uint32_t    sentMs;
+    uint32_t    waitMs;
+    uint32_t    version;       /* image in the node before */
+    uint32_t    value;         /* missing chunk, then the CRC DONE verified */
+    uint32_t    resent;
+    const char *reason;
+    FwpTx_t     tx;
+
+    /* Reply being reassembled; bytes past FWP_RESP_MAX are dropped. */
+    uint8_t     rx[FWP_RESP_MAX];
+    uint16_t    rxLen;
+    uint16_t    rxPos;
+    uint8_t     rxSn;
+    uint8_t     rxOn;
+} FwpNode_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static osThreadId_t s_fpThread = NULL;
+static StaticTask_t s_fpTaskCb;
+static StackType_t  s_fpStack[SYS_WORDS_FwProxyTask];
+
+static CanRing_t  s_fpRing;
+static FwpFrame_t s_fpFrames[FW_PROXY_RX_FRAMES] CAN_RING_ALIGNED;
+
+static volatile FwProxy_State_t s_fpState = FW_PROXY_IDLE;
+static volatile uint8_t         s_fpAbort = 0U;
+
+static FwpNode_t       s_fpNodes[FW_PROXY_MAX_NODES];
+static FwpTx_t         s_fpMc;               /* functional WRITE */
+static FwProxy_Stats_t s_fpStats;
+static uint32_t        s_fpOptions;
+static uint32_t        s_fpChunk;            /* chunk size of the job, 0 before the first INFO */
+
+static const char *const s_fpNodeNames[] =
+{
+    "-", "info", "erase", "erased", "done", "resend", "go", "ok", "skipped", "failed"
+};
+
+static const char *const s_fpCmdNames[] = { "", "info", "erase", "write", "done", "go" };
+
+/* BootUpdate_Status_t */
+static const char *const s_fpStatusNames[] =
+{
+    "ok", "CRC error", "bad frame", "out of range", "not erased", "flash error",
+    "incomplete", "image invalid", "unknown command", "no erase", "out of sequence",
+    "stream corrupt"
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t fwp_running(FwProxy_State_t state)
+{
+    return ((state != FW_PROXY_IDLE) && (state != FW_PROXY_FINISHED)) ? 1U : 0U;
+}
+
+static uint8_t fwp_settled(uint8_t state)
+{
+    return ((state == FWP_N_OFF) || (state >= FWP_N_OK)) ? 1U : 0U;
+}
+
+static const char *fwp_status_name(uint32_t status)
+{
+    return (status < (sizeof(s_fpStatusNames) / sizeof(s_fpStatusNames[0])))
+           ? s_fpStatusNames[status] : "unknown status";
+}
+
+static void fwp_give_up(FwpNode_t *node, uint8_t state, uint8_t cmd, const char *reason)
+{
+    node->state   = state;
+    node->cmd     = 0U;
+    node->failCmd = cmd;
+    node->reason  = reason;
+    node->tx.state = FWP_TX_IDLE;
+}
+
+/** STmin byte in ticks, as isotp.c: 100..900 us rounded up to one. */
+static uint8_t fwp_stmin_ms(uint8_t raw)
+{
+    if (raw <= 0x7FU)
+        return raw;
+    if ((raw >= 0xF1U) && (raw <= 0xF9U))
+        return 1U;
+    return 0x7FU;
+}
+
+static uint8_t fwp_byte(const FwpTx_t *tx, uint32_t i)
+{
+    return (i < tx->hdrLen) ? tx->hdr[i] : tx->data[i - tx->hdrLen];
+}
+
+static void fwp_tx_start(FwpTx_t *tx, uint32_t id, const uint8_t *hdr, uint8_t hdrLen,
+                         const uint8_t *data, uint32_t dataLen)
+{
+    memcpy(tx->hdr, hdr, hdrLen);
+    tx->id     = id;
+    tx->hdrLen = hdrLen;
+    tx->data   = data;
+    tx->len    = (uint16_t)(hdrLen + dataLen);
+    tx->pos    = 0U;
+    tx->state  = FWP_TX_FIRST;
+}
+
+static HAL_StatusTypeDef fwp_send(uint32_t id, const uint8_t *f)
+{
+    return CAN_IF_TransmitBus(CAN_IF_BUS2, id | CAN_IF_TX_IN_ORDER, f, 8U);
+}
+
+/**
+ * The due frames of one PDU.
+ *
+ * @return Ticks until it needs the next call.
+ */
+static uint32_t fwp_tx_run(FwpTx_t *tx, uint32_t now)
+{
+    uint8_t  functional = (tx->id == FW_PROXY_FUNC_ID) ? 1U : 0U;
+    uint32_t elapsed    = now - tx->tick;
+    uint8_t  f[8];
+
+    if (tx->state == FWP_TX_GAP)
+    {
+        if (elapsed <= FW_PROXY_MC_GAP_MS)
+            return FW_PROXY_MC_GAP_MS + 1U - elapsed;
+        tx->state = FWP_TX_IDLE;
+        return 0U;
+    }
+
+    if (tx->state == FWP_TX_WAIT_FC)
+    {
+        if (elapsed <= FW_PROXY_REPLY_MS)
+            return FW_PROXY_REPLY_MS + 1U - elapsed;
+        tx->state = FWP_TX_IDLE;            /* no FC: the reply times out */
+        return osWaitForever;
+    }
+
+    memset(f, FWP_PAD, sizeof(f));
+    if (tx->state == FWP_TX_FIRST)
+    {
+        uint32_t n = (tx->len <= FWP_SF_MAX) ? tx->len : FWP_FF_DATA;
+        uint32_t o = (tx->len <= FWP_SF_MAX) ? 1U : 2U;
+
+        if (o == 1U)
+        {
+            f[0] = (uint8_t)((FWP_PCI_SF << 4) | tx->len);
+        }
+        else
+        {
+            f[0] = (uint8_t)((FWP_PCI_FF << 4) | (tx->len >> 8));
+            f[1] = (uint8_t)tx->len;
+        }
+        for (uint32_t i = 0U; i < n; ++i)
+            f[o + i] = fwp_byte(tx, i);
+
+        if (fwp_send(tx->id, f) != HAL_OK)
+            return 1U;                      /* TX queue full: next tick */
+
+        tx->pos  = (uint16_t)n;
+        tx->sn   = 1U;
+        tx->tick = now;
+        if (tx->pos == tx->len)
+        {
+            tx->state = (functional != 0U) ? FWP_TX_GAP : FWP_TX_IDLE;
+            return (functional != 0U) ? (FW_PROXY_MC_GAP_MS + 1U) : osWaitForever;
+        }
+        if (functional == 0U)
+        {
+            tx->state = FWP_TX_WAIT_FC;
+            return FW_PROXY_REPLY_MS + 1U;
+        }
+
+        /* Functional: no FC, the pace agreed in advance. */
+        tx->block = 0U;
+        tx->stmin = (uint8_t)FW_PROXY_MC_STMIN_MS;
+        tx->state = FWP_TX_CF;
+    }
+
+    if (tx->state != FWP_TX_CF)
+        return osWaitForever;
+
+    for (uint32_t burst = 0U; burst < FW_PROXY_TX_BURST; ++burst)
+    {
+        elapsed = now - tx->tick;
+        if ((tx->stmin != 0U) && (elapsed <= tx->stmin))
+            return tx->stmin + 1U - elapsed;
+
+        uint32_t n = (uint32_t)(tx->len - tx->pos);
+        if (n > FWP_CF_DATA)
+            n = FWP_CF_DATA;
+
+        memset(f, FWP_PAD, sizeof(f));
+        f[0] = (uint8_t)((FWP_PCI_CF << 4) | tx->sn);
+        for (uint32_t i = 0U; i < n; ++i)
+            f[1U + i] = fwp_byte(tx, tx->pos + i);
+
+        if (fwp_send(tx->id, f) != HAL_OK)
+            return 1U;
+
+        tx->pos  = (uint16_t)(tx->pos + n);
+        tx->sn   = (uint8_t)((tx->sn + 1U) & 0x0FU);
+        tx->tick = now;
+        if (tx->pos == tx->len)
+        {
+            tx->state = (functional != 0U) ? FWP_TX_GAP : FWP_TX_IDLE;
+            return (functional != 0U) ? (FW_PROXY_MC_GAP_MS + 1U) : osWaitForever;
+        }
+        if ((tx->block != 0U) && (--tx->block == 0U))
+        {
+            tx->state = FWP_TX_WAIT_FC;
+            return FW_PROXY_REPLY_MS + 1U;
+        }
+    }
+
+    return 1U;                              /* burst done, room for the others */
+}
+
+/** Flow control from a node for the request being sent to it. */
+static void fwp_tx_fc(FwpTx_t *tx, const FwpFrame_t *fr, uint32_t now)
+{
+    if ((tx->state != FWP_TX_WAIT_FC) || (fr->dlc < 3U))
+        return;
+
+    uint8_t fs = fr->data[0] & 0x0FU;
+    if (fs == FWP_FS_WAIT)
+    {
+        tx->tick = now;
+        return;
+    }
+    if (fs != FWP_FS_CTS)
+    {
+        tx->state = FWP_TX_IDLE;            /* overflow: the reply times out */
+        return;
+    }
+
+    tx->block = fr->data[1];
+    tx->stmin = fwp_stmin_ms(fr->data[2]);
+    tx->tick  = now - tx->stmin - 1U;       /* the first CF needs no gap */
+    tx->state = FWP_TX_CF;
+}
+
+/** Send request @p cmd to node @p n and wait @p waitMs for its reply. */
+static void fwp_call(uint32_t n, uint8_t cmd, uint16_t seq, const uint32_t *args, uint32_t words,
+                     const uint8_t *data, uint32_t dataLen, uint32_t waitMs, uint8_t tries,
+                     uint32_t now)
+{
+    FwpNode_t *node = &s_fpNodes[n];
+    uint8_t    hdr[FWP_HDR_MAX] = { cmd, 0U, (uint8_t)seq, (uint8_t)(seq >> 8) };
+
+    if (words != 0U)
+        memcpy(&hdr[4], args, words * 4U);
+    fwp_tx_start(&node->tx, FW_PROXY_REQ_ID + n, hdr, (uint8_t)(4U + (words * 4U)), data, dataLen);
+
+    node->cmd    = cmd;
+    node->seq    = seq;
+    node->tries  = tries;
+    node->sentMs = now;
+    node->waitMs = waitMs;
+}
+
+/** The reply to the node's request: its next state. */
+static void fwp_result(FwpNode_t *node, uint8_t cmd, uint32_t status, const uint32_t *w)
+{
+    if ((status != FWP_ST_OK) && !((cmd == FWP_CMD_DONE) && (status == FWP_ST_INCOMPLETE)))
+    {
+        fwp_give_up(node, FWP_N_FAILED, cmd, fwp_status_name(status));
+        return;
+    }
+
+    switch (node->state)
+    {
+        case FWP_N_INFO:
+            node->proto   = (uint8_t)w[0];
+            node->version = w[4];
+            /* w: protocol, chunk, window, slot size, version, state, slot */
+            if (node->proto < FWP_PROTO_SLOTS)
+                fwp_give_up(node, FWP_N_SKIPPED, cmd, "bootloader without A/B slots");
+            else if (w[6] != s_fpStats.base)
+                fwp_give_up(node, FWP_N_SKIPPED, cmd, "linked for the other slot");
+            else if (s_fpStats.length > w[3])
+                fwp_give_up(node, FWP_N_SKIPPED, cmd, "image larger than the slot");
+            else if ((w[1] == 0U) || ((w[1] & 3U) != 0U) || ((w[1] + 4U) > FWP_PDU_MAX) ||
+                     ((s_fpChunk != 0U) && (w[1] != s_fpChunk)))
+                fwp_give_up(node, FWP_N_SKIPPED, cmd, "other chunk size");
+            else
+            {
+                s_fpChunk         = w[1];
+                s_fpStats.chunks  = (s_fpStats.length + s_fpChunk - 1U) / s_fpChunk;
+                node->state       = FWP_N_ERASE;
+            }
+            break;
+
+        case FWP_N_ERASE:
+            node->state = FWP_N_READY;
+            break;
+
+        case FWP_N_DONE:
+            if (status == FWP_ST_INCOMPLETE)
+            {
+                if ((node->resent >= FW_PROXY_RESENDS) || (w[1] >= s_fpStats.chunks))
+                    fwp_give_up(node, FWP_N_FAILED, cmd, "chunks missing");
+                else
+                {
+                    node->value = w[1];
+                    node->state = FWP_N_RESEND;
+                }
+            }
+            else if (w[1] != IMAGE_HEADER_AT(s_fpStats.base)->crc32)
+                fwp_give_up(node, FWP_N_FAILED, cmd, "CRC mismatch");
+            else
+            {
+                node->value = w[1];
+                node->state = ((s_fpOptions & FW_PROXY_OPT_NO_GO) != 0U) ? FWP_N_OK : FWP_N_GO;
+            }
+            break;
+
+        case FWP_N_RESEND:
+            node->resent++;
+            s_fpStats.resent++;
+            node->state = FWP_N_DONE;
+            break;
+
+        case FWP_N_GO:
+            node->state = FWP_N_OK;
+            break;
+
+        default:
+            break;
+    }
+}
+
+/** A complete reply PDU of node @p n. */
+static void fwp_reply(uint32_t n, uint32_t len)
+{
+    FwpNode_t *node = &s_fpNodes[n];
+    uint32_t   w[FWP_WORDS];
+
+    if (len > FWP_RESP_MAX)
+        len = FWP_RESP_MAX;
+    /* A UDS answer of the application, or a late reply, is not ours. */
+    if ((node->cmd == 0U) || (len < 4U) || (node->rx[0] != node->cmd) ||
+        ((uint16_t)(node->rx[2] | ((uint16_t)node->rx[3] << 8)) != node->seq))
+    {
+        return;
+    }
+
+    memset(w, 0, sizeof(w));
+    memcpy(w, &node->rx[4], len - 4U);
+
+    uint8_t cmd = node->cmd;
+    node->cmd      = 0U;
+    node->tx.state = FWP_TX_IDLE;
+    fwp_result(node, cmd, node->rx[1], w);
+}
+
+/** FwProxyTask: one frame of a node. */
+static void fwp_rx(const FwpFrame_t *fr, uint32_t now)
+{
+    uint32_t n = (fr->key & CAN_IF_ID_MASK) - FW_PROXY_RESP_ID;
+
+    if ((n >= FW_PROXY_MAX_NODES) || (fr->dlc < 2U))
+        return;
+
+    FwpNode_t *node = &s_fpNodes[n];
+    uint8_t    pci  = fr->data[0] >> 4;
+
+    if (pci == FWP_PCI_FC)
+    {
+        fwp_tx_fc(&node->tx, fr, now);
+        return;
+    }
+
+    if (pci == FWP_PCI_SF)
+    {
+        uint32_t len = fr->data[0] & 0x0FU;
+
+        if ((len == 0U) || (len > (uint32_t)(fr->dlc - 1U)))
+            return;
+        memcpy(node->rx, &fr->data[1], len);
+        node->rxOn = 0U;
+        fwp_reply(n, len);
+        return;
+    }
+
+    if (pci == FWP_PCI_FF)
+    {
+        uint8_t f[8];
+
+        node->rxLen = (uint16_t)(((fr->data[0] & 0x0FU) << 8) | fr->data[1]);
+        if ((node->rxLen <= FWP_SF_MAX) || (fr->dlc < 8U))
+            return;
+        memcpy(node->rx, &fr->data[2], FWP_FF_DATA);
+        node->rxPos = FWP_FF_DATA;
+        node->rxSn  = 1U;
+        node->rxOn  = 1U;
+
+        /* Everything at once (BS 0, STmin 0); a lost FC costs one retry. */
+        memset(f, FWP_PAD, sizeof(f));
+        f[0] = (uint8_t)((FWP_PCI_FC << 4) | FWP_FS_CTS);
+        f[1] = 0U;
+        f[2] = 0U;
+        (void)fwp_send(FW_PROXY_REQ_ID + n, f);
+        return;
+    }
+
+    if ((pci != FWP_PCI_CF) || (node->rxOn == 0U))
+        return;
+    if ((fr->data[0] & 0x0FU) != node->rxSn)
+    {
+        node->rxOn = 0U;                    /* lost a frame: the reply times out */
+        return;
+    }
+
+    for (uint32_t i = 1U; (i < fr->dlc) && (node->rxPos < node->rxLen); ++i, ++node->rxPos)
+    {
+        if (node->rxPos < FWP_RESP_MAX)
+            node->rx[node->rxPos] = fr->data[i];
+    }
+    node->rxSn = (uint8_t)((node->rxSn + 1U) & 0x0FU);
+    if (node->rxPos == node->rxLen)
+    {
+        node->rxOn = 0U;
+        fwp_reply(n, node->rxLen);
+    }
+}
+
+/** The request node @p n needs next, if any. */
+static void fwp_next(uint32_t n, uint32_t now)
+{
+    FwpNode_t *node = &s_fpNodes[n];
+
+    switch (node->state)
+    {
+        case FWP_N_INFO:
+            if (s_fpState != FW_PROXY_REQUEST)
+                fwp_call(n, FWP_CMD_INFO, 0U, NULL, 0U, NULL, 0U, FW_PROXY_REPLY_MS,
+                         ((s_fpOptions & FW_PROXY_OPT_REQUEST) != 0U) ? FW_PROXY_REQUEST_TRIES
+                                                                      : FW_PROXY_TRIES, now);
+            break;
+
+        case FWP_N_ERASE:
+        {
+            /* Every sector; the tag lets an interrupted job resume. */
+            uint32_t args[3] = { s_fpStats.length, FWP_ALL_SECTORS,
+                                 IMAGE_HEADER_AT(s_fpStats.base)->crc32 };
+
+            fwp_call(n, FWP_CMD_ERASE, 0U, args, (node->proto >= FWP_PROTO_RESUME) ? 3U : 1U,
+                     NULL, 0U, FW_PROXY_ERASE_MS, 1U, now);
+            break;
+        }
+
+        case FWP_N_DONE:
+            fwp_call(n, FWP_CMD_DONE, 0U, NULL, 0U, NULL, 0U, 2U * FW_PROXY_REPLY_MS,
+                     FW_PROXY_TRIES, now);
+            break;
+
+        case FWP_N_RESEND:
+        {
+            uint32_t off = node->value * s_fpChunk;
+            uint32_t len = s_fpStats.length - off;
+
+            fwp_call(n, FWP_CMD_WRITE, (uint16_t)node->value, NULL, 0U,
+                     (const uint8_t *)(uintptr_t)(s_fpStats.base + off),
+                     (len < s_fpChunk) ? len : s_fpChunk, FW_PROXY_REPLY_MS, FW_PROXY_TRIES, now);
+            break;
+        }
+
+        case FWP_N_GO:
+            fwp_call(n, FWP_CMD_GO, 0U, NULL, 0U, NULL, 0U, FW_PROXY_REPLY_MS,
+                     FW_PROXY_TRIES, now);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * One node: its next request, its frames, its reply timeout.
+ *
+ * @return Ticks until it needs the next call.
+ */
+static uint32_t fwp_node_run(uint32_t n, uint32_t now)
+{
+    FwpNode_t *node = &s_fpNodes[n];
+
+    if ((node->cmd == 0U) && (node->tx.state == FWP_TX_IDLE))
+        fwp_next(n, now);
+
+    uint32_t wait = fwp_tx_run(&node->tx, now);
+    if (node->cmd == 0U)
+        return wait;
+
+    uint32_t elapsed = now - node->sentMs;
+    if (elapsed < node->waitMs)
+        return ((node->waitMs - elapsed) < wait) ? (node->waitMs - elapsed) : wait;
+
+    if (node->tries > 1U)
+    {
+        node->tries--;
+        node->tx.pos   = 0U;
+        node->tx.state = FWP_TX_FIRST;
+        node->sentMs   = now;
+        return 0U;
+    }
+    fwp_give_up(node, FWP_N_FAILED, node->cmd, "no reply");
+    return 0U;
+}
+
+static void fwp_finish(uint32_t now)
+{
+    uint32_t ok = 0U;
+
+    for (uint32_t n = 0U; n < FW_PROXY_MAX_NODES; ++n)
+    {
+        if (s_fpNodes[n].state == FWP_N_OK)
+            ok++;
+    }
+
+    s_fpStats.elapsedMs = now - s_fpStats.startMs;
+    s_fpState           = FW_PROXY_FINISHED;
+    LOG_INFO(CAN, "Proxy: %lu of %lu nodes updated in %lu ms, %lu chunks resent",
+             (unsigned long)ok, (unsigned long)__builtin_popcount(s_fpStats.nodes),
+             (unsigned long)s_fpStats.elapsedMs, (unsigned long)s_fpStats.resent);
+}
+
+/**
+ * The job: every node, the multicast, the phase.
+ *
+ * @return Ticks until it needs the next call.
+ */
+static uint32_t fwp_job_run(uint32_t now)
+{
+    const char   *stop = (s_fpAbort != 0U) ? "aborted" : NULL;
+    Stage_Stats_t st;
+    uint32_t      wait = osWaitForever;
+    uint32_t      count[FWP_N_FAILED + 1U];
+
+    /* The chunks are read from the slot: a new staging ends the job. */
+    Stage_GetStats(&st);
+    if ((st.state != STAGE_READY) || (st.base != s_fpStats.base))
+        stop = "staged image replaced";
+
+    if (stop != NULL)
+    {
+        for (uint32_t n = 0U; n < FW_PROXY_MAX_NODES; ++n)
+        {
+            if (fwp_settled(s_fpNodes[n].state) == 0U)
+                fwp_give_up(&s_fpNodes[n], FWP_N_FAILED, 0U, stop);
+        }
+        fwp_finish(now);
+        return osWaitForever;
+    }
+
+    if (s_fpState == FW_PROXY_REQUEST)
+    {
+        uint32_t elapsed = now - s_fpStats.startMs;
+
+        if (elapsed < FW_PROXY_REQUEST_MS)
+            wait = FW_PROXY_REQUEST_MS - elapsed;
+        else
+            s_fpState = FW_PROXY_INFO;
+    }
+
+    memset(count, 0, sizeof(count));
+    for (uint32_t n = 0U; n < FW_PROXY_MAX_NODES; ++n)
+    {
+        if (s_fpNodes[n].state == FWP_N_OFF)
+            continue;
+
+        uint32_t w = fwp_node_run(n, now);
+        if (w < wait)
+            wait = w;
+        count[s_fpNodes[n].state]++;
+    }
+
+    switch (s_fpState)
+    {
+        case FW_PROXY_INFO:
+        case FW_PROXY_ERASE:
+            if (count[FWP_N_INFO] != 0U)
+                break;
+            s_fpState = FW_PROXY_ERASE;
+            if (count[FWP_N_ERASE] != 0U)
+                break;
+            if (count[FWP_N_READY] == 0U)
+            {
+                fwp_finish(now);
+                return osWaitForever;
+            }
+            s_fpState = FW_PROXY_WRITE;
+            return 0U;
+
+        case FW_PROXY_WRITE:
+            if (s_fpMc.state == FWP_TX_IDLE)
+            {
+                uint32_t i = s_fpStats.sent;
+
+                if (i == s_fpStats.chunks)
+                {
+                    for (uint32_t n = 0U; n < FW_PROXY_MAX_NODES; ++n)
+                    {
+                        if (s_fpNodes[n].state == FWP_N_READY)
+                            s_fpNodes[n].state = FWP_N_DONE;
+                    }
+                    s_fpState = FW_PROXY_VERIFY;
+                    return 0U;
+                }
+
+                uint8_t  hdr[4] = { FWP_CMD_WRITE, 0U, (uint8_t)i, (uint8_t)(i >> 8) };
+                uint32_t off    = i * s_fpChunk;
+                uint32_t len    = s_fpStats.length - off;
+
+                fwp_tx_start(&s_fpMc, FW_PROXY_FUNC_ID, hdr, sizeof(hdr),
+                             (const uint8_t *)(uintptr_t)(s_fpStats.base + off),
+                             (len < s_fpChunk) ? len : s_fpChunk);
+                s_fpStats.sent++;
+            }
+            {
+                uint32_t w = fwp_tx_run(&s_fpMc, now);
+                if (w < wait)
+                    wait = w;
+            }
+            break;
+
+        case FW_PROXY_VERIFY:
+            if ((count[FWP_N_DONE] != 0U) || (count[FWP_N_RESEND] != 0U))
+                break;
+            s_fpState = FW_PROXY_GO;
+            return 0U;
+
+        case FW_PROXY_GO:
+            if (count[FWP_N_GO] == 0U)
+            {
+                fwp_finish(now);
+                return osWaitForever;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return wait;
+}
+
+/** FwProxyTask: sleeps while no job runs. */
+static void fwp_task(void *argument)
+{
+    uint32_t wait = osWaitForever;
+
+    (void)argument;
+    for (;;)
+    {
+        (void)osThreadFlagsWait(FW_PROXY_FLAG, osFlagsWaitAny, wait);
+
+        uint32_t    now = osKernelGetTickCount();
+        FwpFrame_t *fr;
+
+        while ((fr = (FwpFrame_t *)CanRing_Peek(&s_fpRing)) != NULL)
+        {
+            if (fwp_running(s_fpState) != 0U)
+                fwp_rx(fr, now);
+            CanRing_Release(&s_fpRing);
+        }
+
+        wait = (fwp_running(s_fpState) != 0U) ? fwp_job_run(now) : osWaitForever;
+#if CAN_IF_RX_FAST_IRQ
+        /* The RX interrupt runs above the kernel and cannot wake the task:
+         * poll the ring every tick while a job runs. */
+        if ((fwp_running(s_fpState) != 0U) && (wait > 1U))
+            wait = 1U;
+#endif
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void fwp_cmd_show(int argc, char *argv[])
+{
+    static const char *const names[] =
+    {
+        "idle", "requesting", "info", "erasing", "writing", "verifying", "starting", "finished"
+    };
+    FwProxy_Stats_t st;
+
+    (void)argc;
+    (void)argv;
+
+    FwProxy_GetStats(&st);
+    CLI_IF_Printf("Proxy %s: %lu B from 0x%08lX in %lu chunks, %lu multicast, %lu resent, %lu ms\r\n",
+                  names[st.state], (unsigned long)st.length, (unsigned long)st.base,
+                  (unsigned long)st.chunks, (unsigned long)st.sent, (unsigned long)st.resent,
+                  (unsigned long)st.elapsedMs);
+    if (st.state == FW_PROXY_IDLE)
+        return;
+
+    CLI_IF_Printf("Nodes %lu ok, %lu failed or skipped\r\n",
+                  (unsigned long)st.ok, (unsigned long)st.failed);
+    CLI_IF_Print("Node  State     Proto  Before        Resent  Note\r\n");
+    for (uint32_t n = 0U; n < FW_PROXY_MAX_NODES; ++n)
+    {
+        const FwpNode_t *node = &s_fpNodes[n];
+
+        if (node->state == FWP_N_OFF)
+            continue;
+        CLI_IF_Printf("%4lu  %-8s  %5u  v%lu.%lu.%-6lu %6lu  %s%s%s\r\n", (unsigned long)n,
+                      s_fpNodeNames[node->state], (unsigned)node->proto,
+                      (unsigned long)((node->version >> 16) & 0xFFU),
+                      (unsigned long)((node->version >> 8) & 0xFFU),
+                      (unsigned long)(node->version & 0xFFU), (unsigned long)node->resent,
+                      (node->failCmd != 0U) ? s_fpCmdNames[node->failCmd] : "",
+                      (node->failCmd != 0U) ? ": " : "",
+                      (node->reason != NULL) ? node->reason : "");
+    }
+}
+
+static void fwp_cmd_start(int argc, char *argv[])
+{
+    uint32_t mask    = 0U;
+    uint32_t options = 0U;
+    char    *p       = argv[0];
+
+    for (;;)
+    {
+        char    *end;
+        uint32_t n = (uint32_t)strtoul(p, &end, 10);
+
+        if ((end == p) || (n >= FW_PROXY_MAX_NODES) || ((*end != ',') && (*end != '\0')))
+        {
+            CLI_IF_Printf("Nodes 0..%u, comma-separated\r\n", (unsigned)(FW_PROXY_MAX_NODES - 1U));
+            return;
+        }
+        mask |= 1UL << n;
+        if (*end == '\0')
+            break;
+        p = end + 1;
+    }
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "req") == 0)
+            options |= FW_PROXY_OPT_REQUEST;
+        else if (strcmp(argv[i], "nogo") == 0)
+            options |= FW_PROXY_OPT_NO_GO;
+        else
+        {
+            CLI_IF_Printf("Unknown option '%s' (req, nogo)\r\n", argv[i]);
+            return;
+        }
+    }
+
+    HAL_StatusTypeDef status = FwProxy_Start(mask, options);
+    if (status == HAL_BUSY)
+        CLI_IF_Print("A job is running (fwp abort)\r\n");
+    else if (status != HAL_OK)
+        CLI_IF_Print("No verified image staged (stage)\r\n");
+    else
+        CLI_IF_Printf("Flashing nodes 0x%02lX\r\n", (unsigned long)mask);
+}
+
+static void fwp_cmd_abort(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    FwProxy_Abort();
+    CLI_IF_Print("Proxy job aborted\r\n");
+}
+
+static const CliCommand_t s_fpCmds[] =
+{
+    { "fwp",       "", 0U, fwp_cmd_show, "flashing proxy: job and nodes on CAN2" },
+    { "fwp start", "<n>[,<n>...] [req] [nogo]", 1U, fwp_cmd_start,
+      "flash the staged image into CAN2 nodes" },
+    { "fwp abort", "", 0U, fwp_cmd_abort, "stop the proxy job" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef FwProxy_Init(void)
+{
+    if (CanRing_Init(&s_fpRing, s_fpFrames, sizeof(s_fpFrames[0]), FW_PROXY_RX_FRAMES) != HAL_OK)
+        return HAL_ERROR;
+
+    const osThreadAttr_t attr =
+    {
+        .name       = "FwProxyTask",
+        .priority   = (osPriority_t)SYS_PRIO_FwProxyTask,
+        .cb_mem     = &s_fpTaskCb,
+        .cb_size    = sizeof(s_fpTaskCb),
+        .stack_mem  = s_fpStack,
+        .stack_size = sizeof(s_fpStack)
+    };
+
+    osThreadId_t thread = osThreadNew(fwp_task, NULL, &attr);
+    if (thread == NULL)
+        return HAL_ERROR;
+#if !CAN_IF_RX_FAST_IRQ
+    CanRing_SetConsumer(&s_fpRing, thread, FW_PROXY_FLAG);
+#endif
+
+    /* The RX interrupt takes frames once the ring is ready. */
+    __DMB();
+    s_fpThread = thread;
+
+    CLI_IF_REGISTER_TABLE(s_fpCmds);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef FwProxy_Start(uint32_t nodeMask, uint32_t options)
+{
+    Stage_Stats_t st;
+
+    if (s_fpThread == NULL)
+        return HAL_ERROR;
+    if (fwp_running(s_fpState) != 0U)
+        return HAL_BUSY;
+
+    Stage_GetStats(&st);
+    nodeMask &= (1UL << FW_PROXY_MAX_NODES) - 1U;
+    if ((nodeMask == 0U) || (st.state != STAGE_READY))
+        return HAL_ERROR;
+
+    memset(s_fpNodes, 0, sizeof(s_fpNodes));
+    memset(&s_fpMc, 0, sizeof(s_fpMc));
+    memset(&s_fpStats, 0, sizeof(s_fpStats));
+    s_fpStats.nodes   = nodeMask;
+    s_fpStats.base    = st.base;
+    s_fpStats.length  = st.length;
+    s_fpStats.startMs = osKernelGetTickCount();
+    s_fpOptions       = options;
+    s_fpChunk         = 0U;
+    s_fpAbort         = 0U;
+
+    for (uint32_t n = 0U; n < FW_PROXY_MAX_NODES; ++n)
+    {
+        static const uint8_t session[2] = { 0x10U, 0x02U };   /* UDS programming session */
+
+        if ((nodeMask & (1UL << n)) == 0U)
+            continue;
+        s_fpNodes[n].state = FWP_N_INFO;
+        if ((options & FW_PROXY_OPT_REQUEST) != 0U)
+            fwp_tx_start(&s_fpNodes[n].tx, FW_PROXY_REQ_ID + n, session, sizeof(session), NULL, 0U);
+    }
+
+    __DMB();
+    s_fpState = ((options & FW_PROXY_OPT_REQUEST) != 0U) ? FW_PROXY_REQUEST : FW_PROXY_INFO;
+    (void)osThreadFlagsSet(s_fpThread, FW_PROXY_FLAG);
+
+    LOG_INFO(CAN, "Proxy: %lu B from 0x%08lX to nodes 0x%02lX",
+             (unsigned long)st.length, (unsigned long)st.base, (unsigned long)nodeMask);
+    return HAL_OK;
+}
+
+void FwProxy_Abort(void)
+{
+    if ((s_fpThread == NULL) || (fwp_running(s_fpState) == 0U))
+        return;
+
+    s_fpAbort = 1U;
+    (void)osThreadFlagsSet(s_fpThread, FW_PROXY_FLAG);
+}
+
+void FwProxy_GetStats(FwProxy_Stats_t *out)
+{
+    *out        = s_fpStats;
+    out->state  = s_fpState;
+    out->ok     = 0U;
+    out->failed = 0U;
+    for (uint32_t n = 0U; n < FW_PROXY_MAX_NODES; ++n)
+    {
+        uint8_t state = s_fpNodes[n].state;
+
+        if (state == FWP_N_OK)
+            out->ok++;
+        else if ((state == FWP_N_SKIPPED) || (state == FWP_N_FAILED))
+            out->failed++;
+    }
+    if (fwp_running(out->state) != 0U)
+        out->elapsedMs = osKernelGetTickCount() - out->startMs;
+}
+
+RAMFUNC void FwProxy_OnRx(uint32_t key, uint8_t dlc, const uint8_t *data)
+{
+    if (s_fpThread == NULL)
+        return;
+
+    FwpFrame_t *fr = (FwpFrame_t *)CanRing_Reserve(&s_fpRing);
+    if (fr == NULL)
+        return;                             /* counted by the ring */
+
+    /* Words, not memcpy(): this runs from SRAM (ramfunc.h); the payload
+     * is the two words of can_drain_gw(). */
+    fr->key      = key;
+    fr->dlc      = (dlc > 8U) ? 8U : dlc;
+    fr->words[0] = ((const uint32_t *)(const void *)data)[0];
+    fr->words[1] = ((const uint32_t *)(const void *)data)[1];
+    CanRing_Commit(&s_fpRing);
+}
+
+#endif /* FW_PROXY_ENABLE */
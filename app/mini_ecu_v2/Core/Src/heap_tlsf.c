@@ -0,0 +1,409 @@
+/**
+ * @file    heap_tlsf.c
+ * @brief   Two-level segregated fit (TLSF) FreeRTOS heap, in place of heap_4.
+ *
+ * Built with RTOS_HEAP_TLSF=1 ("make RTOS_HEAP_TLSF=1" drops heap_4.c).
+ * pvPortMalloc() and vPortFree() take the same time whatever the state of
+ * the heap: heap_4 walks its address-ordered free list to the first block
+ * that fits, so its cost grows with fragmentation; here the free blocks
+ * are kept in lists by size class and two bitmaps say which lists are
+ * not empty.
+ *
+ *   first level   the power of two of the size (FL: 128 B, 256 B, ...)
+ *   second level  that range cut into TLSF_SL_COUNT equal classes
+ *   below 128 B   one class per 8 B
+ *
+ * A request is rounded up to the start of the next class, so any block in
+ * the class found fits: the first list at or above it that is not empty
+ * (one CLZ/CTZ per level) gives the block, the remainder is split off and
+ * filed again. Freeing merges with the physical neighbours through the
+ * previous-block pointer in the header and the sentinel at the end. Waste:
+ * the 8 B header per block plus at most 1/TLSF_SL_COUNT of the request.
+ *
+ * Like heap_4 the pool is ucHeap[configTOTAL_HEAP_SIZE] (tools/ram_report.py
+ * finds it by name) and calls are serialised with vTaskSuspendAll(), so
+ * interrupts must not allocate. vPortGetHeapStats() fills a HeapStats_t
+ * for "heap" (rtos_stack.h).
+ *
+ * The build fails when configTOTAL_HEAP_SIZE cannot hold the heap plan of
+ * FreeRTOSConfig.h (RTOS_HEAP_PLAN_BYTES in RTOS_HEAP_PLAN_BLOCKS blocks,
+ * with their headers and worst-case rounding), is not aligned, or is
+ * beyond the largest block the first level can file.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "sram_layout.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#if RTOS_HEAP_TLSF
+
+#if (configSUPPORT_DYNAMIC_ALLOCATION == 0)
+#error "heap_tlsf.c needs configSUPPORT_DYNAMIC_ALLOCATION (not with RTOS_STATIC_ALLOC)"
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Second-level classes per power of two, as log2 (16: at most 1/16 waste). */
+#ifndef TLSF_SL_LOG2
+#define TLSF_SL_LOG2        4U
+#endif
+
+/** Largest pool the first level files, as log2 (128 KB: all of SRAM). */
+#ifndef TLSF_FL_MAX_LOG2
+#define TLSF_FL_MAX_LOG2    17U
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define TLSF_ALIGN          ((size_t)portBYTE_ALIGNMENT)
+#define TLSF_ALIGN_LOG2     3U
+#define TLSF_SL_COUNT       (1U << TLSF_SL_LOG2)
+#define TLSF_FL_SHIFT       (TLSF_SL_LOG2 + TLSF_ALIGN_LOG2)
+#define TLSF_SMALL          ((size_t)1U << TLSF_FL_SHIFT)
+#define TLSF_FL_COUNT       (TLSF_FL_MAX_LOG2 - TLSF_FL_SHIFT + 1U)
+
+#define TLSF_FREE           ((size_t)1U)        /* in size: block is free */
+#define TLSF_SIZE_MASK      (~(TLSF_ALIGN - 1U))
+
+#define TLSF_ALIGN_UP(n)    (((size_t)(n) + (TLSF_ALIGN - 1U)) & TLSF_SIZE_MASK)
+
+typedef struct TlsfBlock
+{
+    struct TlsfBlock *prevPhys;     /* block before this one in memory, NULL for the first */
+    size_t            size;         /* payload bytes | TLSF_FREE */
+    /* Payload; free blocks keep their list links in it. */
+    struct TlsfBlock *nextFree;
+    struct TlsfBlock *prevFree;
+} TlsfBlock_t;
+
+#define TLSF_HDR            TLSF_ALIGN_UP(offsetof(TlsfBlock_t, nextFree))
+#define TLSF_MIN_PAYLOAD    TLSF_ALIGN_UP(sizeof(TlsfBlock_t) - TLSF_HDR)
+
+/* Largest request: it must still round up into the last first-level class. */
+#define TLSF_MAX_ALLOC      (((size_t)1U << TLSF_FL_MAX_LOG2) - 1U - \
+                             ((size_t)1U << (TLSF_FL_MAX_LOG2 - 1U - TLSF_SL_LOG2)))
+
+/* The plan: each planned block costs its header and up to one class of
+ * rounding; the pool also holds the sentinel header and alignment slack. */
+#define TLSF_PLAN_BYTES     ((size_t)RTOS_HEAP_PLAN_BYTES + \
+                             ((size_t)RTOS_HEAP_PLAN_BYTES >> TLSF_SL_LOG2) + \
+                             ((size_t)RTOS_HEAP_PLAN_BLOCKS * (TLSF_HDR + TLSF_ALIGN)) + \
+                             TLSF_HDR + TLSF_ALIGN)
+
+_Static_assert((1U << TLSF_ALIGN_LOG2) == portBYTE_ALIGNMENT, "TLSF_ALIGN_LOG2 follows portBYTE_ALIGNMENT");
+_Static_assert(TLSF_SL_COUNT <= 32U, "second-level bitmap is one word");
+_Static_assert(TLSF_FL_COUNT <= 32U, "first-level bitmap is one word");
+_Static_assert((configTOTAL_HEAP_SIZE % portBYTE_ALIGNMENT) == 0,
+               "configTOTAL_HEAP_SIZE must be a multiple of portBYTE_ALIGNMENT");
+_Static_assert(configTOTAL_HEAP_SIZE < ((size_t)1U << TLSF_FL_MAX_LOG2),
+               "configTOTAL_HEAP_SIZE beyond TLSF_FL_MAX_LOG2");
+_Static_assert(configTOTAL_HEAP_SIZE >= TLSF_PLAN_BYTES,
+               "configTOTAL_HEAP_SIZE cannot hold RTOS_HEAP_PLAN_BYTES in RTOS_HEAP_PLAN_BLOCKS blocks");
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+#if (configAPPLICATION_ALLOCATED_HEAP == 1)
+extern uint8_t ucHeap[configTOTAL_HEAP_SIZE];
+#else
+/* Block headers are written before use, so the pool is not zeroed. */
+NOCLEAR static uint8_t ucHeap[configTOTAL_HEAP_SIZE] __attribute__((aligned(portBYTE_ALIGNMENT)));
+#endif
+
+static TlsfBlock_t *s_tlsfLists[TLSF_FL_COUNT][TLSF_SL_COUNT];
+static uint32_t     s_tlsfFlMap;
+static uint32_t     s_tlsfSlMap[TLSF_FL_COUNT];
+static uint8_t      s_tlsfReady;
+
+/* Free payload bytes and blocks; all under vTaskSuspendAll(). */
+static size_t       s_tlsfFree;
+static size_t       s_tlsfMinFree;
+static size_t       s_tlsfFreeBlocks;
+static size_t       s_tlsfAllocs;
+static size_t       s_tlsfFrees;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static inline uint32_t tlsf_fls(size_t n)
+{
+    return 31U - (uint32_t)__builtin_clz((uint32_t)n);
+}
+
+static inline size_t tlsf_size(const TlsfBlock_t *b)
+{
+    return b->size & TLSF_SIZE_MASK;
+}
+
+static inline uint8_t tlsf_is_free(const TlsfBlock_t *b)
+{
+    return ((b->size & TLSF_FREE) != 0U) ? 1U : 0U;
+}
+
+static inline TlsfBlock_t *tlsf_next_phys(const TlsfBlock_t *b)
+{
+    return (TlsfBlock_t *)((uint8_t *)b + TLSF_HDR + tlsf_size(b));
+}
+
+/** Class a block of @p size bytes is filed in. */
+static void tlsf_mapping(size_t size, uint32_t *fl, uint32_t *sl)
+{
+    if (size < TLSF_SMALL)
+    {
+        *fl = 0U;
+        *sl = (uint32_t)(size >> TLSF_ALIGN_LOG2);
+    }
+    else
+    {
+        uint32_t f = tlsf_fls(size);
+
+        *sl = (uint32_t)(size >> (f - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+        *fl = f - (TLSF_FL_SHIFT - 1U);
+    }
+}
+
+static void tlsf_insert(TlsfBlock_t *b)
+{
+    uint32_t fl;
+    uint32_t sl;
+
+    tlsf_mapping(tlsf_size(b), &fl, &sl);
+
+    b->prevFree = NULL;
+    b->nextFree = s_tlsfLists[fl][sl];
+    if (b->nextFree != NULL)
+        b->nextFree->prevFree = b;
+    s_tlsfLists[fl][sl] = b;
+    s_tlsfFlMap     |= 1UL << fl;
+    s_tlsfSlMap[fl] |= 1UL << sl;
+
+    b->size |= TLSF_FREE;
+    s_tlsfFree += tlsf_size(b);
+    s_tlsfFreeBlocks++;
+}
+
+static void tlsf_remove(TlsfBlock_t *b)
+{
+    uint32_t fl;
+    uint32_t sl;
+
+    tlsf_mapping(tlsf_size(b), &fl, &sl);
+
+    if (b->prevFree != NULL)
+        b->prevFree->nextFree = b->nextFree;
+    else
+        s_tlsfLists[fl][sl] = b->nextFree;
+    if (b->nextFree != NULL)
+        b->nextFree->prevFree = b->prevFree;
+
+    if (s_tlsfLists[fl][sl] == NULL)
+    {
+        s_tlsfSlMap[fl] &= ~(1UL << sl);
+        if (s_tlsfSlMap[fl] == 0U)
+            s_tlsfFlMap &= ~(1UL << fl);
+    }
+
+    b->size &= ~TLSF_FREE;
+    s_tlsfFree -= tlsf_size(b);
+    s_tlsfFreeBlocks--;
+}
+
+/** First free block of at least @p size bytes, or NULL. */
+static TlsfBlock_t *tlsf_find(size_t size)
+{
+    uint32_t fl;
+    uint32_t sl;
+
+    /* Round up to the next class: every block filed there fits. */
+    if (size >= TLSF_SMALL)
+        size += ((size_t)1U << (tlsf_fls(size) - TLSF_SL_LOG2)) - 1U;
+    tlsf_mapping(size, &fl, &sl);
+    if (fl >= TLSF_FL_COUNT)
+        return NULL;
+
+    uint32_t slMap = s_tlsfSlMap[fl] & (~0UL << sl);
+    if (slMap == 0U)
+    {
+        uint32_t flMap = ((fl + 1U) < 32U) ? (s_tlsfFlMap & (~0UL << (fl + 1U))) : 0U;
+        if (flMap == 0U)
+            return NULL;
+        fl    = (uint32_t)__builtin_ctz(flMap);
+        slMap = s_tlsfSlMap[fl];
+    }
+    sl = (uint32_t)__builtin_ctz(slMap);
+
+    return s_tlsfLists[fl][sl];
+}
+
+/** One free block over the pool, then a used sentinel of size 0. */
+static void tlsf_init(void)
+{
+    uint8_t *start = (uint8_t *)(((uintptr_t)ucHeap + (TLSF_ALIGN - 1U)) & ~(uintptr_t)(TLSF_ALIGN - 1U));
+    size_t   pool  = ((size_t)(&ucHeap[configTOTAL_HEAP_SIZE] - start)) & TLSF_SIZE_MASK;
+
+    TlsfBlock_t *first = (TlsfBlock_t *)start;
+    first->prevPhys = NULL;
+    first->size     = pool - (2U * TLSF_HDR);
+
+    TlsfBlock_t *end = tlsf_next_phys(first);
+    end->prevPhys = first;
+    end->size     = 0U;
+
+    tlsf_insert(first);
+    s_tlsfMinFree = s_tlsfFree;
+    s_tlsfReady   = 1U;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API (portable.h)                                                    */
+/* -------------------------------------------------------------------------- */
+
+void *pvPortMalloc(size_t xWantedSize)
+{
+    void *pv = NULL;
+
+    vTaskSuspendAll();
+    {
+        if (s_tlsfReady == 0U)
+            tlsf_init();
+
+        if ((xWantedSize != 0U) && (xWantedSize <= TLSF_MAX_ALLOC))
+        {
+            size_t size = TLSF_ALIGN_UP(xWantedSize);
+            if (size < TLSF_MIN_PAYLOAD)
+                size = TLSF_MIN_PAYLOAD;
+
+            TlsfBlock_t *b = tlsf_find(size);
+            if (b != NULL)
+            {
+                tlsf_remove(b);
+
+                /* Split off the rest if it makes a block of its own. */
+                if (tlsf_size(b) >= (size + TLSF_HDR + TLSF_MIN_PAYLOAD))
+                {
+                    TlsfBlock_t *rest = (TlsfBlock_t *)((uint8_t *)b + TLSF_HDR + size);
+
+                    rest->prevPhys = b;
+                    rest->size     = tlsf_size(b) - size - TLSF_HDR;
+                    tlsf_next_phys(rest)->prevPhys = rest;
+                    b->size = size;
+                    tlsf_insert(rest);
+                }
+
+                if (s_tlsfFree < s_tlsfMinFree)
+                    s_tlsfMinFree = s_tlsfFree;
+                s_tlsfAllocs++;
+                pv = (uint8_t *)b + TLSF_HDR;
+            }
+        }
+        traceMALLOC(pv, xWantedSize);
+    }
+    (void)xTaskResumeAll();
+
+#if (configUSE_MALLOC_FAILED_HOOK == 1)
+    if (pv == NULL)
+    {
+        extern void vApplicationMallocFailedHook(void);
+        vApplicationMallocFailedHook();
+    }
+#endif
+
+    return pv;
+}
+
+void vPortFree(void *pv)
+{
+    if (pv == NULL)
+        return;
+
+    TlsfBlock_t *b = (TlsfBlock_t *)((uint8_t *)pv - TLSF_HDR);
+
+    configASSERT(tlsf_is_free(b) == 0U);
+    configASSERT(((uint8_t *)b >= ucHeap) && ((uint8_t *)pv < &ucHeap[configTOTAL_HEAP_SIZE]));
+
+    vTaskSuspendAll();
+    {
+        traceFREE(pv, tlsf_size(b));
+
+        TlsfBlock_t *prev = b->prevPhys;
+        if ((prev != NULL) && (tlsf_is_free(prev) != 0U))
+        {
+            tlsf_remove(prev);
+            prev->size += TLSF_HDR + tlsf_size(b);
+            b = prev;
+        }
+
+        TlsfBlock_t *next = tlsf_next_phys(b);
+        if (tlsf_is_free(next) != 0U)
+        {
+            tlsf_remove(next);
+            b->size += TLSF_HDR + tlsf_size(next);
+        }
+        tlsf_next_phys(b)->prevPhys = b;
+
+        tlsf_insert(b);
+        s_tlsfFrees++;
+    }
+    (void)xTaskResumeAll();
+}
+
+void vPortInitialiseBlocks(void)
+{
+    /* Only for heap_1/2 compatibility; the pool is set up on first use. */
+}
+
+size_t xPortGetFreeHeapSize(void)
+{
+    return s_tlsfFree;
+}
+
+size_t xPortGetMinimumEverFreeHeapSize(void)
+{
+    return s_tlsfMinFree;
+}
+
+void vPortGetHeapStats(HeapStats_t *pxHeapStats)
+{
+    size_t largest  = 0U;
+    size_t smallest = (size_t)-1;
+
+    vTaskSuspendAll();
+    {
+        if (s_tlsfReady == 0U)
+            tlsf_init();
+
+        /* Only the highest and the lowest non-empty list are walked. */
+        if (s_tlsfFlMap != 0U)
+        {
+            uint32_t fl = tlsf_fls(s_tlsfFlMap);
+            uint32_t sl = tlsf_fls(s_tlsfSlMap[fl]);
+
+            for (const TlsfBlock_t *b = s_tlsfLists[fl][sl]; b != NULL; b = b->nextFree)
+                largest = (tlsf_size(b) > largest) ? tlsf_size(b) : largest;
+
+            fl = (uint32_t)__builtin_ctz(s_tlsfFlMap);
+            sl = (uint32_t)__builtin_ctz(s_tlsfSlMap[fl]);
+            for (const TlsfBlock_t *b = s_tlsfLists[fl][sl]; b != NULL; b = b->nextFree)
+                smallest = (tlsf_size(b) < smallest) ? tlsf_size(b) : smallest;
+        }
+
+        pxHeapStats->xAvailableHeapSpaceInBytes      = s_tlsfFree;
+        pxHeapStats->xSizeOfLargestFreeBlockInBytes  = largest;
+        pxHeapStats->xSizeOfSmallestFreeBlockInBytes = (s_tlsfFreeBlocks != 0U) ? smallest : 0U;
+        pxHeapStats->xNumberOfFreeBlocks             = s_tlsfFreeBlocks;
+        pxHeapStats->xMinimumEverFreeBytesRemaining  = s_tlsfMinFree;
+        pxHeapStats->xNumberOfSuccessfulAllocations  = s_tlsfAllocs;
+        pxHeapStats->xNumberOfSuccessfulFrees        = s_tlsfFrees;
+    }
+    (void)xTaskResumeAll();
+}
+
+#endif /* RTOS_HEAP_TLSF */
@@ -0,0 +1,22 @@
+/**
+ * @file    image_header.c
+ * @brief   The application image header instance.
+ *
+ * Length and CRC stay erased here; tools/image_stamp.py fills them in after
+ * the link so the values cover the final binary. The boot-control words
+ * stay erased in the binary and are programmed on the device.
+ */
+
+#include "image_header.h"
+
+__attribute__((section(".image_header"), used))
+const ImageHeader_t g_imageHeader =
+{
+    .magic      = IMAGE_HEADER_MAGIC,
+    .version    = APP_FW_VERSION,
+    .length     = IMAGE_ERASED,
+    .crc32      = IMAGE_ERASED,
+    .generation = IMAGE_ERASED,
+    .confirmed  = IMAGE_ERASED,
+    .revoked    = IMAGE_ERASED,
+};
@@ -0,0 +1,465 @@
+/**
+ * @file    irq_bench.c
+ * @brief   Interrupt and wake-up latency benchmark on TIM3 input capture
+ *          and "bench irq".
+ */
+
+#include "irq_bench.h"
+
+#if IRQ_BENCH_ENABLE
+
+#include "cli_if.h"
+#include "clock_cfg.h"
+#include "log.h"
+#include "vehicle_fleet.h"
+#include "cmsis_os2.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert((IRQ_BENCH_EXTI_PRIO >= configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY) &&
+               (IRQ_BENCH_EXTI_PRIO <= configLIBRARY_LOWEST_INTERRUPT_PRIORITY),
+               "IRQ_BENCH_EXTI_PRIO must be a priority that may use the RTOS API");
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    IB_PATH_EXTI = 0,
+    IB_PATH_CAN,
+    IB_PATH_UART,
+    IB_PATHS
+} IrqBench_Path_t;
+
+static const char *const s_ibPathNames[IB_PATHS] = { "exti", "can", "uart" };
+
+typedef struct
+{
+    uint8_t load;           /* % of every tick burnt */
+    uint8_t storm;          /* logging storm on */
+} IrqBench_StepCfg_t;
+
+#define IB_STEP_ENTRY_(load, storm) { (load), (storm) },
+static const IrqBench_StepCfg_t s_ibSteps[] = { IRQ_BENCH_STEP_TABLE(IB_STEP_ENTRY_) };
+
+#define IB_STEP_COUNT       (sizeof(s_ibSteps) / sizeof(s_ibSteps[0]))
+
+/** One path in one step. */
+typedef struct
+{
+    uint32_t count;
+    uint32_t over;          /* start seen, no end inside the window */
+    uint32_t minNs;
+    uint32_t maxNs;
+    uint64_t sumNs;
+    uint32_t hist[IRQ_BENCH_BUCKETS];
+} IrqBench_Stats_t;
+
+typedef struct
+{
+    IrqBench_Stats_t path[IB_PATHS];
+    uint16_t         cpuPermille;
+} IrqBench_Step_t;
+
+#define IB_FLAG_START       0x0001U
+#define IB_EXTI_LINE        IRQ_BENCH_START_PIN     /* EXTI line n = pin n */
+
+/* Pseudo-random exti compare times, in timer clocks after the start. */
+#define IB_EXTI_MIN_TICKS   2000U
+#define IB_EXTI_SPAN_TICKS  20000U
+
+/* GPIO MODER values for the start marker. */
+#define IB_MODER_OUT        1U
+#define IB_MODER_AF         2U
+#define IB_AF_TIM3          2U
+#define IB_START_POS2       (2U * 4U)       /* PB4: MODER field */
+#define IB_START_POS4       (4U * 4U)       /* PB4: AFR[0] field */
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+volatile uint8_t g_irqBenchArm = (uint8_t)IRQ_BENCH_ARM_IDLE;
+
+static osThreadId_t     s_ibThread = NULL;
+static volatile uint8_t s_ibRunning = 0U;
+static volatile uint8_t s_ibStop = 0U;
+/** Steps of the current or last run with final figures. */
+static volatile uint32_t s_ibDone = 0U;
+static uint32_t         s_ibStepMs = IRQ_BENCH_STEP_MS;
+static uint32_t         s_ibTimClk = 0U;
+static uint32_t         s_ibRand = 1U;
+static IrqBench_Step_t  s_ibResult[IB_STEP_COUNT];
+
+/* Load: a multiply-accumulate over a flash table keeps the FPU context
+ * live (lazy stacking on every interrupt) and the flash accelerator busy. */
+static const float s_ibLoadTab[32] =
+{
+    0.10f, 0.20f, 0.30f, 0.40f, 0.50f, 0.60f, 0.70f, 0.80f,
+    0.90f, 1.00f, 1.10f, 1.20f, 1.30f, 1.40f, 1.50f, 1.60f,
+    1.70f, 1.80f, 1.90f, 2.00f, 2.10f, 2.20f, 2.30f, 2.40f,
+    2.50f, 2.60f, 2.70f, 2.80f, 2.90f, 3.00f, 3.10f, 3.20f
+};
+static volatile float s_ibSink = 0.0f;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Switch the start marker (PB4) between GPIO output and TIM3_CH1. */
+static void ib_start_pin_mode(uint32_t mode)
+{
+    IRQ_BENCH_GPIO->MODER = (IRQ_BENCH_GPIO->MODER & ~(3UL << IB_START_POS2)) |
+                            (mode << IB_START_POS2);
+}
+
+/** Stop TIM3, lower both markers and arm @p path for the next sample. */
+static void ib_arm(IrqBench_Path_t path)
+{
+    TIM3->CR1 = TIM_CR1_OPM | TIM_CR1_URS;
+    g_irqBenchArm = (uint8_t)IRQ_BENCH_ARM_IDLE;
+
+    IRQ_BENCH_GPIO->BSRR = (uint32_t)(IRQ_BENCH_START_PIN | IRQ_BENCH_END_PIN) << 16U;
+
+    TIM3->PSC = (path == IB_PATH_EXTI) ? 0U : ((s_ibTimClk / IRQ_BENCH_TASK_HZ) - 1U);
+    TIM3->CNT = 0U;
+    TIM3->EGR = TIM_EGR_UG;
+
+    if (path == IB_PATH_EXTI)
+    {
+        s_ibRand = (s_ibRand * 1103515245U) + 12345U;
+
+        /* Forced low, high again on the match; then hand the pin over. */
+        TIM3->CCMR1 = TIM_CCMR1_OC1M_2;
+        TIM3->CCR1  = IB_EXTI_MIN_TICKS + ((s_ibRand >> 16U) % IB_EXTI_SPAN_TICKS);
+        TIM3->CCMR1 = TIM_CCMR1_OC1M_0;
+        ib_start_pin_mode(IB_MODER_AF);
+
+        EXTI->PR   = IB_EXTI_LINE;
+        EXTI->IMR |= IB_EXTI_LINE;
+    }
+    else
+    {
+        EXTI->IMR &= ~IB_EXTI_LINE;
+        ib_start_pin_mode(IB_MODER_OUT);
+    }
+
+    TIM3->SR = 0U;
+    g_irqBenchArm = (uint8_t)((path == IB_PATH_EXTI) ? IRQ_BENCH_ARM_EXTI_END :
+                              (path == IB_PATH_CAN)  ? IRQ_BENCH_ARM_CAN : IRQ_BENCH_ARM_UART);
+    TIM3->CR1 |= TIM_CR1_CEN;
+}
+
+static void ib_disarm(void)
+{
+    TIM3->CR1 = TIM_CR1_OPM | TIM_CR1_URS;
+    g_irqBenchArm = (uint8_t)IRQ_BENCH_ARM_IDLE;
+    EXTI->IMR &= ~IB_EXTI_LINE;
+    ib_start_pin_mode(IB_MODER_OUT);
+    IRQ_BENCH_GPIO->BSRR = (uint32_t)(IRQ_BENCH_START_PIN | IRQ_BENCH_END_PIN) << 16U;
+}
+
+static void ib_record(IrqBench_Stats_t *st, uint32_t ns)
+{
+    uint32_t b = 0U;
+    while ((b < (IRQ_BENCH_BUCKETS - 1U)) && (ns >= (32UL << b)))
+        b++;
+
+    if ((st->count == 0U) || (ns < st->minNs))
+        st->minNs = ns;
+    if (ns > st->maxNs)
+        st->maxNs = ns;
+    st->sumNs += ns;
+    st->count++;
+    st->hist[b]++;
+}
+
+/** Take a finished sample of @p path and re-arm; a pending one is left. */
+static void ib_poll(IrqBench_Path_t path, IrqBench_Stats_t *st)
+{
+    uint32_t sr = TIM3->SR;
+
+    /* The counter starts at 0 and stops at 0 when the window is over, so
+     * a capture of 0 happened after the window. */
+    if (((sr & TIM_SR_CC3IF) != 0U) && ((sr & TIM_SR_CC4IF) != 0U))
+    {
+        uint32_t startTicks = TIM3->CCR4;
+        uint32_t endTicks   = TIM3->CCR3;
+
+        if ((endTicks != 0U) && (endTicks >= startTicks))
+        {
+            uint32_t rate = s_ibTimClk / (TIM3->PSC + 1U);
+            ib_record(st, (uint32_t)(((uint64_t)(endTicks - startTicks) * 1000000000ULL) / rate));
+        }
+        else if (startTicks != 0U)
+        {
+            st->over++;
+        }
+        ib_arm(path);
+    }
+    else if ((TIM3->CR1 & TIM_CR1_CEN) == 0U)
+    {
+        /* Window over: a start without an end is an outlier, no start
+         * just means no event in the window. */
+        if (((sr & TIM_SR_CC4IF) != 0U) && (TIM3->CCR4 != 0U))
+            st->over++;
+        ib_arm(path);
+    }
+}
+
+/** Spin until @p cycles have passed since @p c0. */
+static void ib_burn(uint32_t c0, uint32_t cycles)
+{
+    while ((DWT->CYCCNT - c0) < cycles)
+    {
+        float acc = s_ibSink;
+        for (uint32_t i = 0U; i < (sizeof(s_ibLoadTab) / sizeof(s_ibLoadTab[0])); ++i)
+            acc = (acc * 0.999f) + s_ibLoadTab[i];
+        s_ibSink = acc;
+    }
+}
+
+static void ib_run_step(const IrqBench_StepCfg_t *cfg, IrqBench_Step_t *out)
+{
+    uint32_t burn   = ((SystemCoreClock / 1000U) * cfg->load) / 100U;
+    uint32_t phase  = s_ibStepMs / (uint32_t)IB_PATHS;
+    uint32_t lines  = 0U;
+    uint32_t idle0  = ulTaskGetIdleRunTimeCounter();
+    uint32_t cyc0   = DWT->CYCCNT;
+    uint32_t t0     = osKernelGetTickCount();
+
+    memset(out, 0, sizeof(*out));
+
+    for (uint32_t p = 0U; (p < (uint32_t)IB_PATHS) && (s_ibStop == 0U); ++p)
+    {
+        uint32_t start = osKernelGetTickCount();
+
+        ib_arm((IrqBench_Path_t)p);
+        while (((osKernelGetTickCount() - start) < phase) && (s_ibStop == 0U))
+        {
+            ib_burn(DWT->CYCCNT, burn);
+            if (cfg->storm != 0U)
+            {
+                for (uint32_t i = 0U; i < IRQ_BENCH_STORM_LINES; ++i)
+                    LOG_INFO(MAIN, "irq bench storm %lu", (unsigned long)lines++);
+            }
+            osDelay(1U);
+            ib_poll((IrqBench_Path_t)p, &out->path[p]);
+        }
+        ib_disarm();
+    }
+
+    uint32_t cyc1  = DWT->CYCCNT;
+    uint32_t idle1 = ulTaskGetIdleRunTimeCounter();
+    uint64_t wall  = (uint64_t)(osKernelGetTickCount() - t0) * (SystemCoreClock / 1000U);
+    uint32_t busy  = (cyc1 - cyc0) - (idle1 - idle0);
+
+    out->cpuPermille = (wall != 0U) ? (uint16_t)(((uint64_t)busy * 1000U) / wall) : 0U;
+    if (out->cpuPermille > 1000U)
+        out->cpuPermille = 1000U;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void ib_print_step(uint32_t i)
+{
+    const IrqBench_Step_t *s = &s_ibResult[i];
+
+    CLI_IF_Printf("Step %lu: load %u%%%s, CPU %u.%u%%\r\n", (unsigned long)(i + 1U),
+                  (unsigned)s_ibSteps[i].load, (s_ibSteps[i].storm != 0U) ? " + log storm" : "",
+                  (unsigned)(s->cpuPermille / 10U), (unsigned)(s->cpuPermille % 10U));
+
+    for (uint32_t p = 0U; p < (uint32_t)IB_PATHS; ++p)
+    {
+        const IrqBench_Stats_t *st = &s->path[p];
+
+        if (st->count == 0U)
+        {
+            CLI_IF_Printf("  %-4s      0 samples, over %lu\r\n", s_ibPathNames[p],
+                          (unsigned long)st->over);
+            continue;
+        }
+
+        CLI_IF_Printf("  %-4s %6lu samples, over %lu, ns min %lu mean %lu max %lu\r\n       ",
+                      s_ibPathNames[p], (unsigned long)st->count, (unsigned long)st->over,
+                      (unsigned long)st->minNs, (unsigned long)(st->sumNs / st->count),
+                      (unsigned long)st->maxNs);
+        for (uint32_t b = 0U; b < IRQ_BENCH_BUCKETS; ++b)
+        {
+            if (st->hist[b] == 0U)
+                continue;
+            if (b == (IRQ_BENCH_BUCKETS - 1U))
+                CLI_IF_Printf(" >%lu:%lu", (unsigned long)(16UL << b), (unsigned long)st->hist[b]);
+            else
+                CLI_IF_Printf(" %lu:%lu", (unsigned long)(32UL << b), (unsigned long)st->hist[b]);
+        }
+        CLI_IF_Print("\r\n");
+    }
+}
+
+/**
+ * @brief CLI: "bench irq" - state and the figures of the current or last run.
+ */
+static void ib_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t done = s_ibDone;
+
+    CLI_IF_Printf("IRQ bench: %s, step %lu of %lu, %lu ms per step, timer %lu Hz, fleet %u\r\n",
+                  (s_ibRunning != 0U) ? "running" : "idle", (unsigned long)done,
+                  (unsigned long)IB_STEP_COUNT, (unsigned long)s_ibStepMs,
+                  (unsigned long)s_ibTimClk, (unsigned)VEHICLE_FLEET_SIZE);
+
+    for (uint32_t i = 0U; i < done; ++i)
+        ib_print_step(i);
+}
+
+/**
+ * @brief CLI: "bench irq start [<ms>]" - run the steps, <ms> per step.
+ */
+static void ib_cmd_start(int argc, char *argv[])
+{
+    uint32_t stepMs = IRQ_BENCH_STEP_MS;
+
+    if (argc > 0)
+    {
+        char *end;
+        stepMs = (uint32_t)strtoul(argv[0], &end, 10);
+        if ((*end != '\0') || (argc > 1) || (stepMs < 300U) || (stepMs > 60000U))
+        {
+            CLI_IF_Print("Usage: bench irq start [<ms per step, 300..60000>]\r\n");
+            return;
+        }
+    }
+
+    if ((s_ibRunning != 0U) || (s_ibThread == NULL))
+    {
+        CLI_IF_Print("IRQ bench busy or not running.\r\n");
+        return;
+    }
+
+    s_ibStepMs = stepMs;
+    s_ibDone   = 0U;
+    s_ibStop   = 0U;
+    s_ibRunning = 1U;
+    (void)osThreadFlagsSet(s_ibThread, IB_FLAG_START);
+
+    CLI_IF_Printf("IRQ bench started, %lu steps of %lu ms; \"bench irq\" shows the figures.\r\n",
+                  (unsigned long)IB_STEP_COUNT, (unsigned long)stepMs);
+}
+
+/**
+ * @brief CLI: "bench irq stop" - end a run after the current tick.
+ */
+static void ib_cmd_stop(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    s_ibStop = 1U;
+    CLI_IF_Print("OK\r\n");
+}
+
+static const CliCommand_t s_ibCmds[] =
+{
+    { "bench irq",       "",       0U, ib_cmd_show,  "Interrupt latency benchmark figures" },
+    { "bench irq start", "[<ms>]", 0U, ib_cmd_start, "Run the interrupt latency benchmark" },
+    { "bench irq stop",  "",       0U, ib_cmd_stop,  "Stop the interrupt latency benchmark" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef IrqBench_Init(void)
+{
+    GPIO_InitTypeDef gpio = {0};
+
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+    __HAL_RCC_SYSCFG_CLK_ENABLE();
+    __HAL_RCC_TIM3_CLK_ENABLE();
+
+    /* Markers low; PB4 only becomes TIM3_CH1 for the exti path. */
+    IRQ_BENCH_GPIO->BSRR = (uint32_t)(IRQ_BENCH_START_PIN | IRQ_BENCH_END_PIN) << 16U;
+    gpio.Pin       = IRQ_BENCH_START_PIN | IRQ_BENCH_END_PIN;
+    gpio.Mode      = GPIO_MODE_OUTPUT_PP;
+    gpio.Pull      = GPIO_NOPULL;
+    gpio.Speed     = GPIO_SPEED_FREQ_VERY_HIGH;
+    HAL_GPIO_Init(IRQ_BENCH_GPIO, &gpio);
+    IRQ_BENCH_GPIO->AFR[0] = (IRQ_BENCH_GPIO->AFR[0] & ~(0xFUL << IB_START_POS4)) |
+                             (IB_AF_TIM3 << IB_START_POS4);
+
+    gpio.Pin       = IRQ_BENCH_CAP_START_PIN | IRQ_BENCH_CAP_END_PIN;
+    gpio.Mode      = GPIO_MODE_AF_PP;
+    gpio.Alternate = IB_AF_TIM3;
+    HAL_GPIO_Init(IRQ_BENCH_GPIO, &gpio);
+
+    /* PB4 drives EXTI4 on its rising edge in any pin mode; masked until
+     * the exti path arms it. */
+    SYSCFG->EXTICR[1] = (SYSCFG->EXTICR[1] & ~SYSCFG_EXTICR2_EXTI4) | SYSCFG_EXTICR2_EXTI4_PB;
+    EXTI->IMR  &= ~IB_EXTI_LINE;
+    EXTI->RTSR |= IB_EXTI_LINE;
+    EXTI->FTSR &= ~IB_EXTI_LINE;
+    EXTI->PR    = IB_EXTI_LINE;
+
+    /* TIM3: CH1 output compare (exti stimulus), CH3 / CH4 capture the end
+     * and start markers on their rising edge. */
+    s_ibTimClk = ClockCfg_TimerHz();
+
+    TIM3->CR1   = TIM_CR1_OPM | TIM_CR1_URS;
+    TIM3->ARR   = 0xFFFFU;
+    TIM3->CCMR1 = TIM_CCMR1_OC1M_2;
+    TIM3->CCMR2 = TIM_CCMR2_CC3S_0 | TIM_CCMR2_CC4S_0;
+    TIM3->CCER  = TIM_CCER_CC1E | TIM_CCER_CC3E | TIM_CCER_CC4E;
+    TIM3->DIER  = 0U;
+    TIM3->EGR   = TIM_EGR_UG;
+    TIM3->SR    = 0U;
+
+    s_ibRand = DWT->CYCCNT | 1U;
+
+    HAL_NVIC_SetPriority(EXTI4_IRQn, IRQ_BENCH_EXTI_PRIO, 0U);
+    HAL_NVIC_EnableIRQ(EXTI4_IRQn);
+
+    CLI_IF_REGISTER_TABLE(s_ibCmds);
+
+    return HAL_OK;
+}
+
+void IrqBench_Task(void)
+{
+    s_ibThread = osThreadGetId();
+
+    for (;;)
+    {
+        (void)osThreadFlagsWait(IB_FLAG_START, osFlagsWaitAny, osWaitForever);
+
+        /* The clock governor may have changed the profile since init. */
+        s_ibTimClk = ClockCfg_TimerHz();
+        LOG_INFO(MAIN, "IRQ bench: %lu steps of %lu ms", (unsigned long)IB_STEP_COUNT,
+                 (unsigned long)s_ibStepMs);
+
+        for (uint32_t i = 0U; (i < IB_STEP_COUNT) && (s_ibStop == 0U); ++i)
+        {
+            ib_run_step(&s_ibSteps[i], &s_ibResult[i]);
+            if (s_ibStop == 0U)
+                s_ibDone = i + 1U;
+        }
+
+        LOG_INFO(MAIN, "IRQ bench %s", (s_ibStop != 0U) ? "stopped" : "done");
+        s_ibRunning = 0U;
+    }
+}
+
+void IrqBench_ExtiIRQHandler(void)
+{
+    EXTI->PR = IB_EXTI_LINE;
+}
+
+#endif /* IRQ_BENCH_ENABLE */
@@ -0,0 +1,538 @@
+/**
+ * @file    isotp.c
+ * @brief   ISO-TP receiver and sender over can_if.
+ *
+ * Reassembly goes straight into a mem_pool block sized by the First Frame,
+ * which is then passed to the consumer by pointer (CAN_IF_DeliverPdu), so
+ * a PDU is copied exactly once: out of the CAN frames. Sending works the
+ * same way round: the channel keeps the caller's block and frames it out.
+ *
+ * Sender states: IDLE -> WAIT_FC (First Frame sent, or a block of
+ * Consecutive Frames completed) -> SEND (FC CTS received) -> ... -> IDLE.
+ * CanRxTask moves a channel out of IDLE and WAIT_FC, CanTxTask
+ * (IsoTp_Run()) out of SEND and, on the N_Bs timeout, WAIT_FC; both
+ * transitions out of WAIT_FC are taken under PRIMASK.
+ *
+ * The N_Cr and N_Bs timers run one tick past their timeout, so the
+ * deadline check of the task they wake has passed when they fire.
+ */
+
+#include "isotp.h"
+#include "can_if.h"
+#include "mem_pool.h"
+#include "log.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* Protocol control information, high nibble of byte 0. */
+#define ISOTP_PCI_SF     0x0U
+#define ISOTP_PCI_FF     0x1U
+#define ISOTP_PCI_CF     0x2U
+#define ISOTP_PCI_FC     0x3U
+
+/* Flow status of an FC frame. */
+#define ISOTP_FS_CTS     0x0U
+#define ISOTP_FS_WAIT    0x1U
+#define ISOTP_FS_OVFLW   0x2U
+
+#define ISOTP_SF_MAX     7U
+#define ISOTP_FF_DATA    6U
+#define ISOTP_CF_DATA    7U
+#define ISOTP_PDU_MAX    4095U
+
+#define ISOTP_TX_IDLE    0U
+#define ISOTP_TX_WAIT_FC 1U
+#define ISOTP_TX_SEND    2U
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static IsoTp_Channel_t *s_isoChannels[ISOTP_MAX_CHANNELS];
+static uint32_t         s_isoChannelCount = 0U;
+static osThreadId_t     s_isoConsumer     = NULL;
+static osThreadId_t     s_isoRxConsumer   = NULL;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Timer wheel (1 ms raster): N_Cr ran out, CanRxTask drops the PDU. */
+static void isotp_rx_expired(void *ctx)
+{
+    (void)ctx;
+
+    if (s_isoRxConsumer != NULL)
+        (void)osThreadFlagsSet(s_isoRxConsumer, ISOTP_RX_FLAG);
+}
+
+/** Timer wheel (1 ms raster): N_Bs ran out, CanTxTask abandons the PDU. */
+static void isotp_tx_expired(void *ctx)
+{
+    (void)ctx;
+
+    if (s_isoConsumer != NULL)
+        (void)osThreadFlagsSet(s_isoConsumer, ISOTP_TX_FLAG);
+}
+
+static void isotp_abort(IsoTp_Channel_t *ch)
+{
+    TimerWheel_Stop(&ch->rxTimer);
+    if (ch->buf != NULL)
+    {
+        (void)MemPool_Free(ch->buf);
+        ch->buf = NULL;
+        ch->dropped++;
+    }
+}
+
+static void isotp_fc(const IsoTp_Channel_t *ch, uint8_t status)
+{
+    uint8_t f[8];
+
+    memset(f, ISOTP_PAD, sizeof(f));
+    f[0] = (uint8_t)((ISOTP_PCI_FC << 4) | status);
+    f[1] = ch->bs;
+    f[2] = ch->stmin;
+    (void)CAN_IF_Transmit(ch->txId | CAN_IF_TX_IN_ORDER, f, 8U);
+}
+
+/** STmin byte in ms: 0x00..0x7F as is, 100..900 us rounded up to a tick,
+ *  reserved values as the maximum (ISO 15765-2). */
+static uint8_t isotp_stmin_ms(uint8_t raw)
+{
+    if (raw <= 0x7FU)
+        return raw;
+    if ((raw >= 0xF1U) && (raw <= 0xF9U))
+        return 1U;
+    return 0x7FU;
+}
+
+/** Back to IDLE, freeing the PDU block. */
+static void isotp_tx_end(IsoTp_Channel_t *ch, uint8_t aborted)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t *block = ch->txBuf;
+    ch->txBuf   = NULL;
+    ch->txState = ISOTP_TX_IDLE;
+    TimerWheel_Stop(&ch->txTimer);
+    __set_PRIMASK(primask);
+
+    if (block != NULL)
+        (void)MemPool_Free(block);
+    if (aborted != 0U)
+        ch->txAborted++;
+}
+
+/** Take a PDU waiting for flow control back from the receiver side and
+ *  abandon it; 0 if FC arrived in the meantime. */
+static uint8_t isotp_tx_cancel_wait(IsoTp_Channel_t *ch)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t waiting = (ch->txState == ISOTP_TX_WAIT_FC) ? 1U : 0U;
+    if (waiting != 0U)
+        ch->txState = ISOTP_TX_SEND;    /* ours again, for the cleanup */
+    __set_PRIMASK(primask);
+
+    if (waiting != 0U)
+        isotp_tx_end(ch, 1U);
+    return waiting;
+}
+
+/** CanRxTask: flow control for the PDU being sent. */
+static void isotp_rx_fc(IsoTp_Channel_t *ch, const CAN_IF_Msg_t *msg)
+{
+    if ((ch->txState != ISOTP_TX_WAIT_FC) || (CAN_IF_MSG_LEN(msg) < 3U))
+        return;
+
+    uint8_t fs = msg->Data[0] & 0x0FU;
+    if (fs == ISOTP_FS_WAIT)
+    {
+        ch->txTick = HAL_GetTick();    /* N_Bs starts again */
+        TimerWheel_Start(&ch->txTimer, ISOTP_FC_TIMEOUT_MS + 1U);
+        return;
+    }
+    if (fs != ISOTP_FS_CTS)
+    {
+        LOG_DEBUG(CAN, "ISO-TP 0x%03lX: flow status %u, PDU abandoned",
+                  (unsigned long)ch->txId, (unsigned)fs);
+        isotp_tx_end(ch, 1U);
+        return;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (ch->txState == ISOTP_TX_WAIT_FC)
+    {
+        ch->txBlock = msg->Data[1];
+        ch->txStmin = isotp_stmin_ms(msg->Data[2]);
+        /* The first CF of a block needs no gap. */
+        ch->txTick  = HAL_GetTick() - ch->txStmin - 1U;
+        ch->txState = ISOTP_TX_SEND;
+        TimerWheel_Stop(&ch->txTimer);
+    }
+    __set_PRIMASK(primask);
+
+    if (s_isoConsumer != NULL)
+        (void)osThreadFlagsSet(s_isoConsumer, ISOTP_TX_FLAG);
+}
+
+/**
+ * CanTxTask: the due Consecutive Frames of one channel.
+ *
+ * @return Ticks until the channel needs the next call; osWaitForever
+ *         while waiting for FC (txTimer wakes the task).
+ */
+static uint32_t isotp_tx_run(IsoTp_Channel_t *ch, uint32_t now)
+{
+    if (ch->txState == ISOTP_TX_WAIT_FC)
+    {
+        if ((now - ch->txTick) <= ISOTP_FC_TIMEOUT_MS)
+            return osWaitForever;
+
+        if (isotp_tx_cancel_wait(ch) == 0U)
+            return 0U;                      /* FC just arrived */
+        LOG_DEBUG(CAN, "ISO-TP 0x%03lX: no flow control, PDU abandoned",
+                  (unsigned long)ch->txId);
+        return osWaitForever;
+    }
+
+    if (ch->txState != ISOTP_TX_SEND)
+        return osWaitForever;
+
+    for (uint32_t n = 0U; n < ISOTP_TX_BURST; ++n)
+    {
+        /* STmin is a minimum: one tick more than it, as the first tick may
+         * be partial. */
+        uint32_t elapsed = now - ch->txTick;
+        if ((ch->txStmin != 0U) && (elapsed <= ch->txStmin))
+            return ch->txStmin + 1U - elapsed;
+
+        uint8_t  f[8];
+        uint16_t len = (uint16_t)(ch->txLen - ch->txPos);
+        if (len > ISOTP_CF_DATA)
+            len = ISOTP_CF_DATA;
+
+        memset(f, ISOTP_PAD, sizeof(f));
+        f[0] = (uint8_t)((ISOTP_PCI_CF << 4) | ch->txSn);
+        memcpy(&f[1], ch->txBuf + ch->txPos, len);
+
+        uint8_t last     = (ch->txPos + len == ch->txLen) ? 1U : 0U;
+        uint8_t blockEnd = ((last == 0U) && (ch->txBlock == 1U)) ? 1U : 0U;
+
+        /* The receiver may answer the last CF of a block before
+         * CAN_IF_Transmit() returns: wait for FC before sending it. */
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        if (blockEnd != 0U)
+        {
+            ch->txState = ISOTP_TX_WAIT_FC;
+            ch->txTick  = now;
+        }
+        HAL_StatusTypeDef st = CAN_IF_Transmit(ch->txId | CAN_IF_TX_IN_ORDER, f, 8U);
+        if ((st != HAL_OK) && (blockEnd != 0U))
+            ch->txState = ISOTP_TX_SEND;
+        else if (blockEnd != 0U)
+            TimerWheel_Start(&ch->txTimer, ISOTP_FC_TIMEOUT_MS + 1U);
+        __set_PRIMASK(primask);
+
+        if (st != HAL_OK)
+            return 1U;                      /* TX queue full: next tick */
+
+        ch->txPos = (uint16_t)(ch->txPos + len);
+        ch->txSn  = (uint8_t)((ch->txSn + 1U) & 0x0FU);
+        if (last != 0U)
+        {
+            isotp_tx_end(ch, 0U);
+            return osWaitForever;
+        }
+        if (blockEnd != 0U)
+            return osWaitForever;
+        if (ch->txBlock != 0U)
+            ch->txBlock--;
+        ch->txTick = now;
+    }
+
+    return 1U;                              /* burst done, room for others */
+}
+
+/** Single Frame: a pool block of exactly the payload, delivered at once. */
+static void isotp_rx_sf(IsoTp_Channel_t *ch, uint32_t id, const CAN_IF_Msg_t *msg)
+{
+    uint16_t n = msg->Data[0] & 0x0FU;
+    if ((n == 0U) || (n > ISOTP_SF_MAX) || (n > CAN_IF_MSG_LEN(msg) - 1U))
+        return;
+
+    uint8_t *block = (uint8_t *)MemPool_Alloc(n);
+    if (block == NULL)
+    {
+        ch->dropped++;
+        return;
+    }
+
+    memcpy(block, &msg->Data[1], n);
+    (void)CAN_IF_DeliverPdu(id, block, n);
+}
+
+static void isotp_rx_ff(IsoTp_Channel_t *ch, const CAN_IF_Msg_t *msg)
+{
+    uint16_t n = (uint16_t)(((msg->Data[0] & 0x0FU) << 8) | msg->Data[1]);
+    if ((CAN_IF_MSG_LEN(msg) != 8U) || (n <= ISOTP_SF_MAX))
+        return;
+
+    /* A new First Frame replaces an unfinished PDU. */
+    isotp_abort(ch);
+
+    ch->buf = (n <= MEM_POOL_MAX_BLOCK) ? (uint8_t *)MemPool_Alloc(n) : NULL;
+    if (ch->buf == NULL)
+    {
+        ch->dropped++;
+        isotp_fc(ch, ISOTP_FS_OVFLW);
+        return;
+    }
+
+    memcpy(ch->buf, &msg->Data[2], ISOTP_FF_DATA);
+    ch->len   = n;
+    ch->pos   = ISOTP_FF_DATA;
+    ch->sn    = 1U;
+    ch->block = ch->bs;
+    ch->tick  = HAL_GetTick();
+    TimerWheel_Start(&ch->rxTimer, ISOTP_TIMEOUT_MS + 1U);
+    isotp_fc(ch, ISOTP_FS_CTS);
+}
+
+static void isotp_rx_cf(IsoTp_Channel_t *ch, const CAN_IF_Msg_t *msg)
+{
+    if (ch->buf == NULL)
+        return;
+
+    if ((msg->Data[0] & 0x0FU) != ch->sn)
+    {
+        LOG_DEBUG(CAN, "ISO-TP 0x%03lX: SN %u, expected %u, PDU dropped",
+                  (unsigned long)ch->rxId, (unsigned)(msg->Data[0] & 0x0FU),
+                  (unsigned)ch->sn);
+        isotp_abort(ch);
+        return;
+    }
+
+    uint16_t n = (uint16_t)(ch->len - ch->pos);
+    if (n > ISOTP_CF_DATA)
+        n = ISOTP_CF_DATA;
+    if (CAN_IF_MSG_LEN(msg) < n + 1U)
+    {
+        isotp_abort(ch);
+        return;
+    }
+
+    memcpy(ch->buf + ch->pos, &msg->Data[1], n);
+    ch->pos  = (uint16_t)(ch->pos + n);
+    ch->sn   = (uint8_t)((ch->sn + 1U) & 0x0FU);
+    ch->tick = HAL_GetTick();
+
+    if (ch->pos == ch->len)
+    {
+        uint8_t *block = ch->buf;
+        ch->buf = NULL;
+        TimerWheel_Stop(&ch->rxTimer);
+        (void)CAN_IF_DeliverPdu(ch->rxId, block, ch->len);
+        return;
+    }
+    TimerWheel_Start(&ch->rxTimer, ISOTP_TIMEOUT_MS + 1U);
+
+    if ((ch->bs != 0U) && (--ch->block == 0U))
+    {
+        ch->block = ch->bs;
+        isotp_fc(ch, ISOTP_FS_CTS);
+    }
+}
+
+/** CanRxTask: one frame on the channel's physical or functional ID. */
+static void isotp_on_frame(const CAN_IF_Msg_t *msg, void *ctx)
+{
+    IsoTp_Channel_t *ch = (IsoTp_Channel_t *)ctx;
+    uint32_t id = CAN_IF_MSG_KEY(msg);
+
+    if (CAN_IF_MSG_IS_RTR(msg) || (CAN_IF_MSG_LEN(msg) == 0U))
+        return;
+
+    /* N_Cr expired: the rest of the PDU is not coming. */
+    if ((ch->buf != NULL) && ((HAL_GetTick() - ch->tick) > ISOTP_TIMEOUT_MS))
+        isotp_abort(ch);
+
+    uint8_t pci = msg->Data[0] >> 4;
+
+    /* Functional addressing carries single frames only (ISO 15765-2). */
+    if (id != ch->rxId)
+    {
+        if (pci == ISOTP_PCI_SF)
+            isotp_rx_sf(ch, id, msg);
+        return;
+    }
+
+    /* A new request: the receiver gave up on the response waiting for its
+     * flow control. */
+    if ((pci == ISOTP_PCI_SF) || (pci == ISOTP_PCI_FF))
+        (void)isotp_tx_cancel_wait(ch);
+
+    switch (pci)
+    {
+        case ISOTP_PCI_SF:
+            isotp_abort(ch);
+            isotp_rx_sf(ch, id, msg);
+            break;
+
+        case ISOTP_PCI_FF:
+            isotp_rx_ff(ch, msg);
+            break;
+
+        case ISOTP_PCI_CF:
+            isotp_rx_cf(ch, msg);
+            break;
+
+        case ISOTP_PCI_FC:
+            isotp_rx_fc(ch, msg);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef IsoTp_Open(IsoTp_Channel_t *ch)
+{
+    if (ch == NULL)
+        return HAL_ERROR;
+
+    uint32_t exact = ((ch->rxId & CAN_IF_ID_EXT) != 0U) ? 0x1FFFFFFFU : 0x7FFU;
+
+    if (s_isoChannelCount >= ISOTP_MAX_CHANNELS)
+        return HAL_ERROR;
+
+    ch->buf       = NULL;
+    ch->dropped   = 0U;
+    ch->txBuf     = NULL;
+    ch->txState   = ISOTP_TX_IDLE;
+    ch->txAborted = 0U;
+    TimerWheel_Setup(&ch->rxTimer, isotp_rx_expired, ch);
+    TimerWheel_Setup(&ch->txTimer, isotp_tx_expired, ch);
+
+    if (CAN_IF_RegisterHandler(ch->rxId, exact, isotp_on_frame, ch) != HAL_OK)
+        return HAL_ERROR;
+
+    if (ch->funcId != ISOTP_NO_ID)
+    {
+        exact = ((ch->funcId & CAN_IF_ID_EXT) != 0U) ? 0x1FFFFFFFU : 0x7FFU;
+        if (CAN_IF_RegisterHandler(ch->funcId, exact, isotp_on_frame, ch) != HAL_OK)
+            return HAL_ERROR;
+    }
+
+    s_isoChannels[s_isoChannelCount++] = ch;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef IsoTp_Send(IsoTp_Channel_t *ch, const uint8_t *data, uint16_t len)
+{
+    uint8_t f[8];
+
+    if ((ch == NULL) || (data == NULL) || (len == 0U) || (len > ISOTP_SF_MAX))
+        return HAL_ERROR;
+
+    memset(f, ISOTP_PAD, sizeof(f));
+    f[0] = (uint8_t)len;
+    memcpy(&f[1], data, len);
+    return CAN_IF_Transmit(ch->txId | CAN_IF_TX_IN_ORDER, f, 8U);
+}
+
+HAL_StatusTypeDef IsoTp_SendBlock(IsoTp_Channel_t *ch, uint8_t *block, uint16_t len)
+{
+    if (block == NULL)
+        return HAL_ERROR;
+
+    if ((ch == NULL) || (len == 0U) || (len > ISOTP_PDU_MAX))
+    {
+        (void)MemPool_Free(block);
+        return HAL_ERROR;
+    }
+
+    /* One PDU at a time per channel. */
+    if (ch->txState != ISOTP_TX_IDLE)
+    {
+        (void)MemPool_Free(block);
+        ch->txAborted++;
+        return HAL_BUSY;
+    }
+
+    if (len <= ISOTP_SF_MAX)
+    {
+        HAL_StatusTypeDef st = IsoTp_Send(ch, block, len);
+        (void)MemPool_Free(block);
+        if (st != HAL_OK)
+            ch->txAborted++;
+        return st;
+    }
+
+    uint8_t f[8];
+    f[0] = (uint8_t)((ISOTP_PCI_FF << 4) | (len >> 8));
+    f[1] = (uint8_t)(len & 0xFFU);
+    memcpy(&f[2], block, ISOTP_FF_DATA);
+
+    /* WAIT_FC before the First Frame leaves: FC may follow at once. */
+    ch->txBuf   = block;
+    ch->txLen   = len;
+    ch->txPos   = ISOTP_FF_DATA;
+    ch->txSn    = 1U;
+    ch->txTick  = HAL_GetTick();
+    ch->txState = ISOTP_TX_WAIT_FC;
+    TimerWheel_Start(&ch->txTimer, ISOTP_FC_TIMEOUT_MS + 1U);
+
+    HAL_StatusTypeDef st = CAN_IF_Transmit(ch->txId | CAN_IF_TX_IN_ORDER, f, 8U);
+    if (st != HAL_OK)
+        isotp_tx_end(ch, 1U);
+    return st;
+}
+
+void IsoTp_SetConsumer(osThreadId_t thread)
+{
+    s_isoConsumer = thread;
+}
+
+void IsoTp_SetRxConsumer(osThreadId_t thread)
+{
+    s_isoRxConsumer = thread;
+}
+
+void IsoTp_RxRun(void)
+{
+    uint32_t now = HAL_GetTick();
+
+    for (uint32_t i = 0U; i < s_isoChannelCount; ++i)
+    {
+        IsoTp_Channel_t *ch = s_isoChannels[i];
+
+        if ((ch->buf != NULL) && ((now - ch->tick) > ISOTP_TIMEOUT_MS))
+            isotp_abort(ch);
+    }
+}
+
+uint32_t IsoTp_Run(void)
+{
+    uint32_t wait = osWaitForever;
+
+    for (uint32_t i = 0U; i < s_isoChannelCount; ++i)
+    {
+        uint32_t w = isotp_tx_run(s_isoChannels[i], HAL_GetTick());
+        if (w < wait)
+            wait = w;
+    }
+
+    return wait;
+}
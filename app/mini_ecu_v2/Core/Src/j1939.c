@@ -0,0 +1,1143 @@
+/**
+ * @file    j1939.c
+ * @brief   J1939 decoding, PGN table, address claim, transport and "j1939".
+ *
+ * CanRxTask decodes the frames, looks up the PGNs, runs the receive
+ * sessions and reacts to claims, requests and transport control frames.
+ * CanTxTask (J1939_Run()) sends our first claim, ends the claim wait and
+ * queues the frames of the transport message being sent.
+ *
+ * Sender states: IDLE -> BAM -> IDLE, or IDLE -> WAIT_CTS (RTS sent) ->
+ * SEND (CTS received) -> WAIT_CTS ... -> WAIT_EOMA (last TP.DT sent) ->
+ * IDLE. As in isotp.c, CanRxTask only moves the sender out of the WAIT
+ * states and CanTxTask out of BAM and SEND, both under PRIMASK; a remote
+ * abort during SEND is left to J1939_Run() as a request.
+ */
+
+#include "j1939.h"
+#include "can_if.h"
+#include "image_header.h"
+#include "cli_if.h"
+#include "log.h"
+#include "fmt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* Identifier fields. */
+#define J1939_ID_PRIO_POS      26U
+#define J1939_ID_EDP           (1UL << 25)
+#define J1939_PGN_MASK         0x3FFFFU
+#define J1939_PGN_PDU1_MASK    0x3FF00U
+#define J1939_PF_PDU2          240U
+
+/* TP.CM control bytes and abort reasons (J1939-21). */
+#define J1939_TP_RTS           16U
+#define J1939_TP_CTS           17U
+#define J1939_TP_EOMA          19U
+#define J1939_TP_BAM           32U
+#define J1939_TP_ABORT         255U
+
+#define J1939_ABORT_BUSY       1U     /* no session free */
+#define J1939_ABORT_RESOURCES  2U     /* no block, too long, address lost */
+#define J1939_ABORT_TIMEOUT    3U
+#define J1939_ABORT_CTS_IN_DT  4U
+#define J1939_ABORT_BAD_SEQ    7U
+#define J1939_ABORT_REMOTE     0xFFU  /* abortReq: the other side aborted */
+
+/* Acknowledgment control bytes. */
+#define J1939_ACK_NACK         1U
+#define J1939_ACK_CANNOT       3U
+
+#define J1939_TP_PRIO          7U
+#define J1939_TP_PACKET        7U
+#define J1939_TP_PACKETS(len)  (((uint32_t)(len) + J1939_TP_PACKET - 1U) / J1939_TP_PACKET)
+
+/* Transport timeouts (ms). */
+#define J1939_T1_MS            750U   /* BAM receiver: between TP.DT */
+#define J1939_T2_MS            1250U  /* RTS/CTS receiver: CTS or TP.DT -> TP.DT */
+#define J1939_T3_MS            1250U  /* sender: RTS or last TP.DT -> CTS / EoMA */
+
+/* Claim states. */
+#define J1939_CLAIM_INIT       0U     /* nothing sent yet */
+#define J1939_CLAIM_WAIT       1U     /* claimed, J1939_CLAIM_WAIT_MS running */
+#define J1939_CLAIM_DONE       2U
+#define J1939_CLAIM_LOST       3U     /* Cannot Claim sent */
+
+/* Receive session states. */
+#define J1939_RX_IDLE          0U
+#define J1939_RX_BAM           1U
+#define J1939_RX_CMDT          2U
+
+/* Send session states. */
+#define J1939_TX_IDLE          0U
+#define J1939_TX_BAM           1U
+#define J1939_TX_WAIT_CTS      2U
+#define J1939_TX_SEND          3U
+#define J1939_TX_WAIT_EOMA     4U
+
+/* Software identification: field count, one field, '*'. */
+#define J1939_SOFT_ID_MAX      32U
+
+/** A registered PGN; a slot with no callback is free. */
+typedef struct
+{
+    uint32_t          pgn;
+    J1939_RxFn_t      onRx;
+    J1939_RequestFn_t onRequest;
+    void             *ctx;
+    uint32_t          rx;
+    uint32_t          requests;
+} J1939Pgn_t;
+
+/** A message being reassembled (CanRxTask only). */
+typedef struct
+{
+    uint8_t  state;
+    uint8_t  sa;
+    uint8_t  packets;
+    uint8_t  next;      /* sequence number expected */
+    uint8_t  window;    /* RTS/CTS: packets left of the last CTS */
+    uint8_t  maxCts;    /* RTS/CTS: sender's limit per CTS */
+    uint16_t len;
+    uint32_t pgn;
+    uint32_t tick;      /* last frame of the session */
+    uint8_t *buf;
+} J1939RxSession_t;
+
+/** The message being sent. */
+typedef struct
+{
+    volatile uint8_t state;
+    volatile uint8_t abortReq;  /* abort reason for J1939_Run(), 0 = none */
+    uint8_t  sa;
+    uint8_t  da;
+    uint8_t  packets;
+    uint8_t  next;      /* sequence number of the next TP.DT */
+    uint8_t  window;    /* packets left of the current CTS */
+    uint16_t len;
+    uint32_t pgn;
+    uint32_t tick;      /* last TP.CM / TP.DT, or when the wait started */
+    uint8_t *buf;
+} J1939TxSession_t;
+
+typedef struct
+{
+    uint32_t frames;      /* J1939 frames for us */
+    uint32_t unhandled;   /* PGNs nobody registered */
+    uint32_t answered;    /* requests answered */
+    uint32_t nacked;      /* destination-specific requests refused */
+    uint32_t defended;    /* claims for our address we won */
+    uint32_t lost;        /* addresses lost to a lower NAME */
+    uint32_t bamRx;
+    uint32_t cmdtRx;
+    uint32_t rxDropped;   /* announced messages we had no room for */
+    uint32_t rxAborted;   /* sequence errors, timeouts, remote aborts */
+    uint32_t txSent;      /* transport messages completed */
+    uint32_t txAborted;
+} J1939Stats_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static J1939Pgn_t       s_j1939Pgns[J1939_PGN_SLOTS];
+static uint32_t         s_j1939PgnCount = 0U;
+static J1939RxSession_t s_j1939Rx[J1939_MAX_RX_SESSIONS];
+static J1939TxSession_t s_j1939Tx;
+static J1939Stats_t     s_j1939Stats;
+static osThreadId_t     s_j1939Consumer = NULL;
+
+/* Claim: changed by CanRxTask (contention) and CanTxTask under PRIMASK.
+ * s_j1939Addr is the address claimed or being claimed. */
+static volatile uint8_t  s_j1939ClaimState = J1939_CLAIM_INIT;
+static volatile uint8_t  s_j1939Addr       = J1939_PREFERRED_ADDRESS;
+static volatile uint32_t s_j1939ClaimTick  = 0U;
+static uint64_t          s_j1939Name       = 0U;
+
+/* Addresses claimed by other NAMEs (CanRxTask only). */
+static uint32_t          s_j1939Taken[256U / 32U];
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t j1939_get24(const uint8_t *p)
+{
+    return ((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16)) & J1939_PGN_MASK;
+}
+
+/** 29-bit identifier, CAN_IF_ID_EXT set; @p da replaces PS for PDU1. */
+static uint32_t j1939_id(uint8_t prio, uint32_t pgn, uint8_t da, uint8_t sa)
+{
+    if (((pgn >> 8) & 0xFFU) < J1939_PF_PDU2)
+        pgn = (pgn & J1939_PGN_PDU1_MASK) | da;
+
+    return CAN_IF_ID_EXT | ((uint32_t)(prio & 7U) << J1939_ID_PRIO_POS) |
+           ((pgn & J1939_PGN_MASK) << 8) | sa;
+}
+
+static uint32_t j1939_hash(uint32_t pgn)
+{
+    return ((pgn * 0x9E3779B1U) >> 16) & (J1939_PGN_SLOTS - 1U);
+}
+
+/** The slot of @p pgn, or the free slot where it would go. */
+static J1939Pgn_t *j1939_slot(uint32_t pgn)
+{
+    uint32_t i = j1939_hash(pgn);
+
+    for (uint32_t n = 0U; n < J1939_PGN_SLOTS; ++n)
+    {
+        J1939Pgn_t *p = &s_j1939Pgns[i];
+
+        if (((p->onRx == NULL) && (p->onRequest == NULL)) || (p->pgn == pgn))
+            return p;
+        i = (i + 1U) & (J1939_PGN_SLOTS - 1U);
+    }
+    return NULL;
+}
+
+static J1939Pgn_t *j1939_find(uint32_t pgn)
+{
+    J1939Pgn_t *p = j1939_slot(pgn);
+    return ((p != NULL) && (p->pgn == pgn) && ((p->onRx != NULL) || (p->onRequest != NULL)))
+           ? p : NULL;
+}
+
+static void j1939_wake(void)
+{
+    if (s_j1939Consumer != NULL)
+        (void)osThreadFlagsSet(s_j1939Consumer, J1939_TX_FLAG);
+}
+
+/** Address Claimed from @p sa, Cannot Claim with J1939_ADDR_NULL. */
+static HAL_StatusTypeDef j1939_send_claim(uint8_t sa)
+{
+    uint8_t f[8];
+
+    for (uint32_t i = 0U; i < 8U; ++i)
+        f[i] = (uint8_t)(s_j1939Name >> (8U * i));
+    return CAN_IF_Transmit(j1939_id(J1939_PRIO_DEFAULT, J1939_PGN_ADDRESS_CLAIM,
+                                    J1939_ADDR_GLOBAL, sa), f, 8U);
+}
+
+static void j1939_send_ack(uint8_t control, uint8_t requester, uint32_t pgn)
+{
+    uint8_t f[8] = { control, 0xFFU, 0xFFU, 0xFFU, requester,
+                     (uint8_t)pgn, (uint8_t)(pgn >> 8), (uint8_t)(pgn >> 16) };
+
+    (void)CAN_IF_Transmit(j1939_id(J1939_PRIO_DEFAULT, J1939_PGN_ACK, J1939_ADDR_GLOBAL,
+                                   s_j1939Addr), f, 8U);
+}
+
+static HAL_StatusTypeDef j1939_send_cm(uint8_t sa, uint8_t da, uint8_t control,
+                                       uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4,
+                                       uint32_t pgn)
+{
+    uint8_t f[8] = { control, b1, b2, b3, b4,
+                     (uint8_t)pgn, (uint8_t)(pgn >> 8), (uint8_t)(pgn >> 16) };
+
+    return CAN_IF_Transmit(j1939_id(J1939_TP_PRIO, J1939_PGN_TP_CM, da, sa), f, 8U);
+}
+
+static void j1939_send_abort(uint8_t sa, uint8_t da, uint8_t reason, uint32_t pgn)
+{
+    (void)j1939_send_cm(sa, da, J1939_TP_ABORT, reason, 0xFFU, 0xFFU, 0xFFU, pgn);
+}
+
+/* ---- Message dispatch ---------------------------------------------------- */
+
+static void j1939_dispatch(const J1939_Msg_t *m)
+{
+    J1939Pgn_t *p = j1939_find(m->pgn);
+
+    if ((p == NULL) || (p->onRx == NULL))
+    {
+        s_j1939Stats.unhandled++;
+        return;
+    }
+    p->rx++;
+    p->onRx(m, p->ctx);
+}
+
+/* ---- Address claim ------------------------------------------------------- */
+
+static uint8_t j1939_taken(uint8_t addr)
+{
+    return ((s_j1939Taken[addr >> 5] >> (addr & 31U)) & 1U) != 0U ? 1U : 0U;
+}
+
+/** CanRxTask: a lower NAME took @p addr; claim the next free address of
+ *  the window, or send Cannot Claim. */
+static void j1939_lose_address(uint8_t addr)
+{
+    uint8_t next = J1939_ADDR_NULL;
+
+    for (uint32_t n = 1U; n < J1939_ADDRESS_COUNT; ++n)
+    {
+        uint8_t a = (uint8_t)(J1939_ADDRESS_FIRST +
+                              ((addr - J1939_ADDRESS_FIRST + n) % J1939_ADDRESS_COUNT));
+        if (j1939_taken(a) == 0U)
+        {
+            next = a;
+            break;
+        }
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_j1939Addr       = next;
+    s_j1939ClaimState = (next != J1939_ADDR_NULL) ? J1939_CLAIM_WAIT : J1939_CLAIM_LOST;
+    s_j1939ClaimTick  = HAL_GetTick();
+    __set_PRIMASK(primask);
+
+    s_j1939Stats.lost++;
+    (void)j1939_send_claim(next);
+    if (next != J1939_ADDR_NULL)
+        LOG_WARN(CAN, "J1939: address 0x%02X lost, claiming 0x%02X",
+                 (unsigned)addr, (unsigned)next);
+    else
+        LOG_WARN(CAN, "J1939: address 0x%02X lost, no address left", (unsigned)addr);
+    j1939_wake();
+}
+
+static void j1939_rx_claim(const J1939_Msg_t *m)
+{
+    if ((m->len < 8U) || (m->sa >= J1939_ADDR_NULL))
+        return;
+
+    uint64_t name = 0U;
+    for (uint32_t i = 0U; i < 8U; ++i)
+        name |= (uint64_t)m->data[i] << (8U * i);
+    if (name == s_j1939Name)
+        return;                             /* our own, looped back */
+
+    s_j1939Taken[m->sa >> 5] |= 1UL << (m->sa & 31U);
+
+    if ((m->sa != s_j1939Addr) || (s_j1939ClaimState == J1939_CLAIM_LOST))
+        return;
+
+    /* The lower NAME keeps the address. */
+    if (s_j1939Name < name)
+    {
+        if (s_j1939ClaimState != J1939_CLAIM_INIT)
+        {
+            s_j1939Stats.defended++;
+            (void)j1939_send_claim(m->sa);
+        }
+        return;
+    }
+    j1939_lose_address(m->sa);
+}
+
+static void j1939_rx_request(const J1939_Msg_t *m)
+{
+    if (m->len < 3U)
+        return;
+
+    uint32_t pgn = j1939_get24(m->data);
+    uint8_t  da  = (m->da == J1939_ADDR_GLOBAL) ? J1939_ADDR_GLOBAL : m->sa;
+
+    if (pgn == J1939_PGN_ADDRESS_CLAIM)
+    {
+        /* Address Claimed, or Cannot Claim once every address is lost. */
+        if (s_j1939ClaimState != J1939_CLAIM_INIT)
+            (void)j1939_send_claim(s_j1939Addr);
+        return;
+    }
+    if (s_j1939ClaimState != J1939_CLAIM_DONE)
+        return;
+
+    HAL_StatusTypeDef st = HAL_ERROR;
+    J1939Pgn_t       *p  = j1939_find(pgn);
+    if ((p != NULL) && (p->onRequest != NULL))
+    {
+        p->requests++;
+        st = p->onRequest(pgn, da, p->ctx);
+    }
+
+    if (st == HAL_OK)
+    {
+        s_j1939Stats.answered++;
+        return;
+    }
+    /* A global request nobody answers stays unanswered (J1939-21). */
+    if (m->da != J1939_ADDR_GLOBAL)
+    {
+        s_j1939Stats.nacked++;
+        j1939_send_ack((st == HAL_BUSY) ? J1939_ACK_CANNOT : J1939_ACK_NACK, m->sa, pgn);
+    }
+}
+
+/* ---- Transport: receiving ------------------------------------------------ */
+
+static J1939RxSession_t *j1939_rx_session(uint8_t state, uint8_t sa)
+{
+    for (uint32_t i = 0U; i < J1939_MAX_RX_SESSIONS; ++i)
+    {
+        J1939RxSession_t *s = &s_j1939Rx[i];
+
+        if ((s->state == state) && ((state == J1939_RX_IDLE) || (s->sa == sa)))
+            return s;
+    }
+    return NULL;
+}
+
+static void j1939_rx_end(J1939RxSession_t *s, uint8_t aborted)
+{
+    if (s->buf != NULL)
+        (void)MemPool_Free(s->buf);
+    s->buf   = NULL;
+    s->state = J1939_RX_IDLE;
+    if (aborted != 0U)
+        s_j1939Stats.rxAborted++;
+}
+
+/** Grant the next packets of an RTS/CTS message. */
+static void j1939_rx_cts(J1939RxSession_t *s)
+{
+    uint32_t n = (uint32_t)s->packets - s->next + 1U;
+
+    if (n > J1939_CTS_PACKETS)
+        n = J1939_CTS_PACKETS;
+    if (n > s->maxCts)
+        n = s->maxCts;
+
+    s->window = (uint8_t)n;
+    (void)j1939_send_cm(s_j1939Addr, s->sa, J1939_TP_CTS, (uint8_t)n, s->next,
+                        0xFFU, 0xFFU, s->pgn);
+}
+
+/**
+ * @brief T1 / T2: end the sessions whose sender went quiet.
+ *
+ * @return Ticks until the next session can expire, or osWaitForever.
+ */
+static uint32_t j1939_rx_expire(uint32_t now)
+{
+    uint32_t wait = osWaitForever;
+
+    for (uint32_t i = 0U; i < J1939_MAX_RX_SESSIONS; ++i)
+    {
+        J1939RxSession_t *s = &s_j1939Rx[i];
+
+        if (s->state == J1939_RX_IDLE)
+            continue;
+
+        uint32_t limit   = (s->state == J1939_RX_BAM) ? J1939_T1_MS : J1939_T2_MS;
+        uint32_t elapsed = now - s->tick;
+        if (elapsed <= limit)
+        {
+            if ((limit - elapsed + 1U) < wait)
+                wait = limit - elapsed + 1U;
+            continue;
+        }
+
+        if (s->state == J1939_RX_CMDT)
+            j1939_send_abort(s_j1939Addr, s->sa, J1939_ABORT_TIMEOUT, s->pgn);
+        j1939_rx_end(s, 1U);
+    }
+
+    return wait;
+}
+
+/** BAM or RTS: start reassembling into a pool block. */
+static void j1939_rx_start(const J1939_Msg_t *m, uint8_t state, uint32_t pgn)
+{
+    uint16_t len     = (uint16_t)(m->data[1] | (m->data[2] << 8));
+    uint8_t  packets = m->data[3];
+
+    if ((len <= 8U) || (packets != J1939_TP_PACKETS(len)))
+        return;
+
+    /* A new announcement replaces the sender's unfinished message. */
+    J1939RxSession_t *s = j1939_rx_session(state, m->sa);
+    if (s != NULL)
+        j1939_rx_end(s, 1U);
+    else
+        s = j1939_rx_session(J1939_RX_IDLE, 0U);
+
+    uint8_t *buf = ((s != NULL) && (len <= J1939_TP_MAX)) ? (uint8_t *)MemPool_Alloc(len) : NULL;
+    if (buf == NULL)
+    {
+        s_j1939Stats.rxDropped++;
+        if (state == J1939_RX_CMDT)
+            j1939_send_abort(s_j1939Addr, m->sa,
+                             (s == NULL) ? J1939_ABORT_BUSY : J1939_ABORT_RESOURCES, pgn);
+        return;
+    }
+
+    s->state   = state;
+    s->sa      = m->sa;
+    s->packets = packets;
+    s->next    = 1U;
+    s->len     = len;
+    s->pgn     = pgn;
+    s->tick    = HAL_GetTick();
+    s->buf     = buf;
+
+    if (state == J1939_RX_CMDT)
+    {
+        s->maxCts = (m->data[4] == 0U) ? 0xFFU : m->data[4];
+        j1939_rx_cts(s);
+    }
+}
+
+static void j1939_rx_dt(const J1939_Msg_t *m)
+{
+    uint8_t state = (m->da == J1939_ADDR_GLOBAL) ? J1939_RX_BAM : J1939_RX_CMDT;
+    J1939RxSession_t *s = j1939_rx_session(state, m->sa);
+
+    if ((s == NULL) || (m->len < 2U))
+        return;
+
+    uint32_t pos = (uint32_t)(m->data[0] - 1U) * J1939_TP_PACKET;
+    uint32_t n   = s->len - pos;
+    if (n > J1939_TP_PACKET)
+        n = J1939_TP_PACKET;
+
+    if ((m->data[0] != s->next) || (m->len < n + 1U) ||
+        ((state == J1939_RX_CMDT) && (s->window == 0U)))
+    {
+        LOG_DEBUG(CAN, "J1939: TP.DT %u from 0x%02X, expected %u, message dropped",
+                  (unsigned)m->data[0], (unsigned)m->sa, (unsigned)s->next);
+        if (state == J1939_RX_CMDT)
+            j1939_send_abort(s_j1939Addr, s->sa, J1939_ABORT_BAD_SEQ, s->pgn);
+        j1939_rx_end(s, 1U);
+        return;
+    }
+
+    memcpy(s->buf + pos, &m->data[1], n);
+    s->next++;
+    s->tick = HAL_GetTick();
+
+    if (s->next <= s->packets)
+    {
+        if ((state == J1939_RX_CMDT) && (--s->window == 0U))
+            j1939_rx_cts(s);
+        return;
+    }
+
+    if (state == J1939_RX_CMDT)
+    {
+        (void)j1939_send_cm(s_j1939Addr, s->sa, J1939_TP_EOMA, (uint8_t)s->len,
+                            (uint8_t)(s->len >> 8), s->packets, 0xFFU, s->pgn);
+        s_j1939Stats.cmdtRx++;
+    }
+    else
+    {
+        s_j1939Stats.bamRx++;
+    }
+
+    J1939_Msg_t msg = { s->pgn, s->sa, m->da, m->prio, s->len, s->buf };
+    j1939_dispatch(&msg);
+    j1939_rx_end(s, 0U);
+}
+
+/* ---- Transport: sending -------------------------------------------------- */
+
+/** Back to IDLE, freeing the message block. */
+static void j1939_tx_end(uint8_t aborted)
+{
+    J1939TxSession_t *t = &s_j1939Tx;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t *block = t->buf;
+    t->buf      = NULL;
+    t->abortReq = 0U;
+    t->state    = J1939_TX_IDLE;
+    __set_PRIMASK(primask);
+
+    if (block != NULL)
+        (void)MemPool_Free(block);
+    if (aborted != 0U)
+        s_j1939Stats.txAborted++;
+    else
+        s_j1939Stats.txSent++;
+}
+
+/** Take a message waiting for CTS / EoMA back from the receiver side; 0
+ *  if the answer arrived in the meantime. */
+static uint8_t j1939_tx_cancel_wait(void)
+{
+    J1939TxSession_t *t = &s_j1939Tx;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t waiting = ((t->state == J1939_TX_WAIT_CTS) || (t->state == J1939_TX_WAIT_EOMA))
+                      ? 1U : 0U;
+    if (waiting != 0U)
+        t->state = J1939_TX_SEND;           /* ours again, for the cleanup */
+    __set_PRIMASK(primask);
+
+    return waiting;
+}
+
+/** Queue the next TP.DT of the message. */
+static HAL_StatusTypeDef j1939_tx_dt(const J1939TxSession_t *t)
+{
+    uint8_t  f[8];
+    uint32_t pos = (uint32_t)(t->next - 1U) * J1939_TP_PACKET;
+    uint32_t n   = t->len - pos;
+    if (n > J1939_TP_PACKET)
+        n = J1939_TP_PACKET;
+
+    memset(f, 0xFF, sizeof(f));
+    f[0] = t->next;
+    memcpy(&f[1], t->buf + pos, n);
+    return CAN_IF_Transmit(j1939_id(J1939_TP_PRIO, J1939_PGN_TP_DT, t->da, t->sa) | CAN_IF_TX_IN_ORDER,
+                           f, 8U);
+}
+
+/** CanRxTask: CTS, EoMA or abort for the message we are sending. */
+static void j1939_tx_on_cm(const J1939_Msg_t *m, uint32_t pgn)
+{
+    J1939TxSession_t *t = &s_j1939Tx;
+    uint8_t *done = NULL;
+    uint8_t  aborted = 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t state   = t->state;
+    uint8_t waiting = ((state == J1939_TX_WAIT_CTS) || (state == J1939_TX_WAIT_EOMA)) ? 1U : 0U;
+
+    if ((state == J1939_TX_IDLE) || (state == J1939_TX_BAM) || (t->da != m->sa) || (t->pgn != pgn))
+    {
+        /* not ours */
+    }
+    else if (m->data[0] == J1939_TP_CTS)
+    {
+        uint8_t n    = m->data[1];
+        uint8_t next = m->data[2];
+
+        if (waiting == 0U)
+        {
+            t->abortReq = J1939_ABORT_CTS_IN_DT;
+        }
+        else if (n == 0U)
+        {
+            t->tick = HAL_GetTick();        /* hold: the wait starts again */
+        }
+        else if ((next >= 1U) && (next <= t->packets))
+        {
+            /* Also a retransmission request after the last packet. */
+            t->next   = next;
+            t->window = ((uint32_t)t->packets - next + 1U < n)
+                        ? (uint8_t)(t->packets - next + 1U) : n;
+            t->state  = J1939_TX_SEND;
+        }
+    }
+    else if ((m->data[0] == J1939_TP_EOMA) && (state == J1939_TX_WAIT_EOMA))
+    {
+        done = t->buf;
+    }
+    else if (m->data[0] == J1939_TP_ABORT)
+    {
+        if (waiting != 0U)
+        {
+            done    = t->buf;
+            aborted = 1U;
+        }
+        else
+        {
+            t->abortReq = J1939_ABORT_REMOTE;
+        }
+    }
+
+    if (done != NULL)
+    {
+        t->buf   = NULL;
+        t->state = J1939_TX_IDLE;
+    }
+    uint8_t wake = ((t->state == J1939_TX_SEND) || (t->abortReq != 0U)) ? 1U : 0U;
+    __set_PRIMASK(primask);
+
+    if (done != NULL)
+    {
+        (void)MemPool_Free(done);
+        if (aborted != 0U)
+            s_j1939Stats.txAborted++;
+        else
+            s_j1939Stats.txSent++;
+    }
+    if (wake != 0U)
+        j1939_wake();
+}
+
+static void j1939_rx_cm(const J1939_Msg_t *m)
+{
+    if (m->len < 8U)
+        return;
+
+    uint32_t pgn = j1939_get24(&m->data[5]);
+
+    switch (m->data[0])
+    {
+        case J1939_TP_BAM:
+            if (m->da == J1939_ADDR_GLOBAL)
+                j1939_rx_start(m, J1939_RX_BAM, pgn);
+            break;
+
+        case J1939_TP_RTS:
+            if (m->da != J1939_ADDR_GLOBAL)
+                j1939_rx_start(m, J1939_RX_CMDT, pgn);
+            break;
+
+        case J1939_TP_ABORT:
+        {
+            J1939RxSession_t *s = j1939_rx_session(J1939_RX_CMDT, m->sa);
+            if ((s != NULL) && (s->pgn == pgn))
+                j1939_rx_end(s, 1U);
+            j1939_tx_on_cm(m, pgn);
+            break;
+        }
+
+        case J1939_TP_CTS:
+        case J1939_TP_EOMA:
+            j1939_tx_on_cm(m, pgn);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * CanTxTask: the due frames of the message being sent.
+ *
+ * @return Ticks until the next call is needed.
+ */
+static uint32_t j1939_tx_run(uint32_t now)
+{
+    J1939TxSession_t *t = &s_j1939Tx;
+    uint8_t state = t->state;
+    uint8_t lost  = (t->sa != s_j1939Addr) ? 1U : 0U;
+
+    if (state == J1939_TX_IDLE)
+        return osWaitForever;
+
+    if ((state == J1939_TX_WAIT_CTS) || (state == J1939_TX_WAIT_EOMA))
+    {
+        uint32_t elapsed = now - t->tick;
+        if ((lost == 0U) && (elapsed <= J1939_T3_MS))
+            return J1939_T3_MS + 1U - elapsed;
+
+        if (j1939_tx_cancel_wait() == 0U)
+            return 0U;                      /* CTS / EoMA just arrived */
+        j1939_send_abort(t->sa, t->da,
+                         (lost != 0U) ? J1939_ABORT_RESOURCES : J1939_ABORT_TIMEOUT, t->pgn);
+        LOG_DEBUG(CAN, "J1939: PGN %lu to 0x%02X abandoned", (unsigned long)t->pgn,
+                  (unsigned)t->da);
+        j1939_tx_end(1U);
+        return osWaitForever;
+    }
+
+    /* BAM and SEND are ours. */
+    if ((t->abortReq != 0U) || (lost != 0U))
+    {
+        if ((state == J1939_TX_SEND) && (t->abortReq != J1939_ABORT_REMOTE))
+            j1939_send_abort(t->sa, t->da,
+                             (t->abortReq != 0U) ? t->abortReq : J1939_ABORT_RESOURCES, t->pgn);
+        j1939_tx_end(1U);
+        return osWaitForever;
+    }
+
+    if (state == J1939_TX_BAM)
+    {
+        uint32_t elapsed = now - t->tick;
+        if (elapsed < J1939_BAM_GAP_MS)
+            return J1939_BAM_GAP_MS - elapsed;
+        if (j1939_tx_dt(t) != HAL_OK)
+            return 1U;                      /* TX queue full: next tick */
+
+        t->tick = now;
+        if (++t->next > t->packets)
+        {
+            j1939_tx_end(0U);
+            return osWaitForever;
+        }
+        return J1939_BAM_GAP_MS;
+    }
+
+    for (uint32_t n = 0U; n < J1939_TX_BURST; ++n)
+    {
+        /* The receiver may answer the last packet of a window before
+         * CAN_IF_Transmit() returns: wait for it before that packet leaves. */
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        HAL_StatusTypeDef st = j1939_tx_dt(t);
+        if (st == HAL_OK)
+        {
+            t->next++;
+            if (--t->window == 0U)
+            {
+                t->state = (t->next > t->packets) ? J1939_TX_WAIT_EOMA : J1939_TX_WAIT_CTS;
+                t->tick  = now;
+            }
+        }
+        uint8_t sending = (t->state == J1939_TX_SEND) ? 1U : 0U;
+        __set_PRIMASK(primask);
+
+        if (st != HAL_OK)
+            return 1U;
+        if (sending == 0U)
+            return J1939_T3_MS + 1U;
+    }
+
+    return 1U;                              /* burst done, room for others */
+}
+
+/** CanTxTask: first claim and the end of the claim wait. */
+static uint32_t j1939_claim_run(uint32_t now)
+{
+    uint32_t wait = osWaitForever;
+    uint8_t  done = 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s_j1939ClaimState == J1939_CLAIM_INIT)
+    {
+        if (j1939_send_claim(s_j1939Addr) == HAL_OK)
+        {
+            s_j1939ClaimState = J1939_CLAIM_WAIT;
+            s_j1939ClaimTick  = now;
+        }
+        else
+        {
+            wait = 1U;
+        }
+    }
+    if (s_j1939ClaimState == J1939_CLAIM_WAIT)
+    {
+        uint32_t elapsed = now - s_j1939ClaimTick;
+        if (elapsed > J1939_CLAIM_WAIT_MS)
+        {
+            s_j1939ClaimState = J1939_CLAIM_DONE;
+            done = 1U;
+        }
+        else
+        {
+            wait = J1939_CLAIM_WAIT_MS + 1U - elapsed;
+        }
+    }
+    __set_PRIMASK(primask);
+
+    if (done != 0U)
+        LOG_INFO(CAN, "J1939: address 0x%02X claimed", (unsigned)s_j1939Addr);
+    return wait;
+}
+
+/* ---- Stack's own PGNs ---------------------------------------------------- */
+
+/** Software identification: one field, "MECU M.m.p*". */
+static HAL_StatusTypeDef j1939_softid_on_request(uint32_t pgn, uint8_t da, void *ctx)
+{
+    (void)ctx;
+
+    uint8_t *block = (uint8_t *)MemPool_Alloc(J1939_SOFT_ID_MAX);
+    if (block == NULL)
+        return HAL_BUSY;
+
+    block[0] = 1U;
+    int n = FMT_SNPRINTF((char *)&block[1], J1939_SOFT_ID_MAX - 1U, "MECU %lu.%lu.%lu*",
+                         (unsigned long)((g_imageHeader.version >> 16) & 0xFFU),
+                         (unsigned long)((g_imageHeader.version >> 8) & 0xFFU),
+                         (unsigned long)(g_imageHeader.version & 0xFFU));
+    return J1939_SendBlock(pgn, da, J1939_PRIO_DEFAULT, block, (uint16_t)(n + 1));
+}
+
+/** CanRxTask: every 29-bit frame no other handler claimed. */
+static void j1939_on_frame(const CAN_IF_Msg_t *msg, void *ctx)
+{
+    (void)ctx;
+
+    uint32_t id = msg->Id & CAN_IF_ID_MASK;
+    if (!CAN_IF_MSG_IS_EXT(msg) || CAN_IF_MSG_IS_RTR(msg) || ((id & J1939_ID_EDP) != 0U))
+        return;
+
+    J1939_Msg_t m;
+    m.pgn  = (id >> 8) & J1939_PGN_MASK;
+    m.sa   = (uint8_t)id;
+    m.da   = J1939_ADDR_GLOBAL;
+    m.prio = (uint8_t)((id >> J1939_ID_PRIO_POS) & 7U);
+    m.len  = CAN_IF_MSG_LEN(msg);
+    m.data = msg->Data;
+
+    if (((m.pgn >> 8) & 0xFFU) < J1939_PF_PDU2)
+    {
+        m.da   = (uint8_t)m.pgn;
+        m.pgn &= J1939_PGN_PDU1_MASK;
+        if ((m.da != J1939_ADDR_GLOBAL) && (m.da != s_j1939Addr))
+            return;                         /* for a neighbour in the window */
+    }
+
+    /* Our own frames: contention for the address, or the loopback echo. */
+    if ((m.sa == s_j1939Addr) && (m.sa != J1939_ADDR_NULL) &&
+        (m.pgn != J1939_PGN_ADDRESS_CLAIM))
+        return;
+
+    s_j1939Stats.frames++;
+    (void)j1939_rx_expire(HAL_GetTick());
+
+    switch (m.pgn)
+    {
+        case J1939_PGN_ADDRESS_CLAIM:
+            j1939_rx_claim(&m);
+            break;
+
+        case J1939_PGN_REQUEST:
+            j1939_rx_request(&m);
+            break;
+
+        case J1939_PGN_TP_CM:
+            j1939_rx_cm(&m);
+            break;
+
+        case J1939_PGN_TP_DT:
+            j1939_rx_dt(&m);
+            break;
+
+        default:
+            j1939_dispatch(&m);
+            break;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static const char *const s_j1939ClaimNames[] = { "not claimed", "claiming", "claimed", "lost" };
+
+static void j1939_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    const J1939Stats_t *st = &s_j1939Stats;
+
+    CLI_IF_Printf("Address 0x%02X %s, NAME %08lX%08lX\r\n", (unsigned)s_j1939Addr,
+                  s_j1939ClaimNames[s_j1939ClaimState],
+                  (unsigned long)(s_j1939Name >> 32), (unsigned long)(uint32_t)s_j1939Name);
+    CLI_IF_Printf("Frames %lu, unhandled %lu, requests answered %lu, NACKed %lu\r\n",
+                  (unsigned long)st->frames, (unsigned long)st->unhandled,
+                  (unsigned long)st->answered, (unsigned long)st->nacked);
+    CLI_IF_Printf("Claims defended %lu, addresses lost %lu\r\n",
+                  (unsigned long)st->defended, (unsigned long)st->lost);
+    CLI_IF_Printf("TP RX: BAM %lu, RTS/CTS %lu, dropped %lu, aborted %lu\r\n",
+                  (unsigned long)st->bamRx, (unsigned long)st->cmdtRx,
+                  (unsigned long)st->rxDropped, (unsigned long)st->rxAborted);
+    CLI_IF_Printf("TP TX: sent %lu, aborted %lu%s\r\n",
+                  (unsigned long)st->txSent, (unsigned long)st->txAborted,
+                  (s_j1939Tx.state != J1939_TX_IDLE) ? ", one in progress" : "");
+
+    CLI_IF_Print("PGN     Hex    Received   Requests\r\n");
+    for (uint32_t i = 0U; i < J1939_PGN_SLOTS; ++i)
+    {
+        const J1939Pgn_t *p = &s_j1939Pgns[i];
+
+        if ((p->onRx == NULL) && (p->onRequest == NULL))
+            continue;
+        CLI_IF_Printf("%-7lu %05lX %10lu %10lu\r\n", (unsigned long)p->pgn,
+                      (unsigned long)p->pgn, (unsigned long)p->rx, (unsigned long)p->requests);
+    }
+}
+
+static void j1939_cmd_request(int argc, char *argv[])
+{
+    char    *end = NULL;
+    uint32_t pgn = (uint32_t)strtoul(argv[0], &end, 16);
+    uint8_t  bad = (*end != '\0') ? 1U : 0U;
+    uint32_t da  = J1939_ADDR_GLOBAL;
+
+    if (argc > 1)
+    {
+        da = (uint32_t)strtoul(argv[1], &end, 16);
+        if (*end != '\0')
+            bad = 1U;
+    }
+    if ((argc > 2) || (bad != 0U) || (pgn > J1939_PGN_MASK) || (da > J1939_ADDR_GLOBAL))
+    {
+        CLI_IF_Print("Usage: j1939 request <pgn hex> [<address hex>]\r\n");
+        return;
+    }
+
+    uint8_t f[3] = { (uint8_t)pgn, (uint8_t)(pgn >> 8), (uint8_t)(pgn >> 16) };
+    HAL_StatusTypeDef st = J1939_Send(J1939_PGN_REQUEST, (uint8_t)da, J1939_PRIO_DEFAULT, f, 3U);
+    if (st == HAL_OK)
+        CLI_IF_Printf("Requested PGN %05lX from 0x%02lX\r\n", (unsigned long)pgn, (unsigned long)da);
+    else
+        CLI_IF_Printf("Request failed (%s)\r\n", (st == HAL_BUSY) ? "TX queue full" : "no address");
+}
+
+static const CliCommand_t s_j1939Cmds[] =
+{
+    { "j1939",         "",                  0U, j1939_cmd_show,    "J1939 address, counters and PGNs" },
+    { "j1939 request", "<pgn> [<address>]", 1U, j1939_cmd_request, "send a J1939 request (hex)" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef J1939_Init(void)
+{
+    /* Identity number: the MCU unique ID, so identical ECUs differ. */
+    uint32_t identity = (HAL_GetUIDw0() ^ HAL_GetUIDw1() ^ HAL_GetUIDw2()) & 0x1FFFFFU;
+
+    s_j1939Name = (uint64_t)identity |
+                  ((uint64_t)(J1939_NAME_MANUFACTURER & 0x7FFU) << 21) |
+                  ((uint64_t)(CAN_NODE_ID & 0x7U) << 32) |             /* ECU instance */
+                  ((uint64_t)(J1939_NAME_FUNCTION & 0xFFU) << 40) |
+                  ((uint64_t)(J1939_NAME_INDUSTRY & 0x7U) << 60) |
+                  (1ULL << 63);                                        /* arbitrary address capable */
+
+    if ((CanFilters_Covers(1U, (uint32_t)J1939_ADDR_GLOBAL << 8, 0xFF00U) == 0U) ||
+        (CanFilters_Covers(1U, (uint32_t)J1939_ADDRESS_FIRST << 8,
+                           (0xFFU & ~(J1939_ADDRESS_COUNT - 1U)) << 8) == 0U))
+        LOG_WARN(CAN, "J1939: CAN_FILTER_TABLE does not take PDU1 to global and "
+                      "0x%02X..0x%02X", (unsigned)J1939_ADDRESS_FIRST,
+                 (unsigned)(J1939_ADDRESS_FIRST + J1939_ADDRESS_COUNT - 1U));
+
+    (void)J1939_RegisterPgn(J1939_PGN_SOFT_ID, NULL, j1939_softid_on_request, NULL);
+    CLI_IF_REGISTER_TABLE(s_j1939Cmds);
+
+    return CAN_IF_RegisterHandler(CAN_IF_ID_EXT, 0U, j1939_on_frame, NULL);
+}
+
+HAL_StatusTypeDef J1939_RegisterPgn(uint32_t pgn, J1939_RxFn_t onRx,
+                                    J1939_RequestFn_t onRequest, void *ctx)
+{
+    if (((onRx == NULL) && (onRequest == NULL)) || (pgn > J1939_PGN_MASK))
+        return HAL_ERROR;
+
+    J1939Pgn_t *p = j1939_slot(pgn);
+    if (p == NULL)
+        return HAL_ERROR;
+
+    if (p->pgn != pgn || ((p->onRx == NULL) && (p->onRequest == NULL)))
+    {
+        if (s_j1939PgnCount >= J1939_MAX_PGNS)
+            return HAL_ERROR;
+        s_j1939PgnCount++;
+        p->rx       = 0U;
+        p->requests = 0U;
+
+        /* A PDU2 broadcast only arrives with its own filter entry. */
+        if ((onRx != NULL) && (((pgn >> 8) & 0xFFU) >= J1939_PF_PDU2) &&
+            (CanFilters_Covers(1U, pgn << 8, J1939_PGN_MASK << 8) == 0U))
+            LOG_WARN(CAN, "J1939: PGN %lu not in CAN_FILTER_TABLE", (unsigned long)pgn);
+    }
+
+    p->pgn       = pgn;
+    p->onRx      = onRx;
+    p->onRequest = onRequest;
+    p->ctx       = ctx;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef J1939_Send(uint32_t pgn, uint8_t da, uint8_t prio,
+                             const uint8_t *data, uint8_t len)
+{
+    uint8_t sa = J1939_GetAddress();
+
+    if ((sa == J1939_ADDR_NULL) || (pgn > J1939_PGN_MASK) || (len > 8U) ||
+        ((data == NULL) && (len > 0U)))
+        return HAL_ERROR;
+
+    return CAN_IF_Transmit(j1939_id(prio, pgn, da, sa), data, len);
+}
+
+HAL_StatusTypeDef J1939_SendBlock(uint32_t pgn, uint8_t da, uint8_t prio,
+                                  uint8_t *block, uint16_t len)
+{
+    J1939TxSession_t *t = &s_j1939Tx;
+
+    if (block == NULL)
+        return HAL_ERROR;
+
+    uint8_t sa = J1939_GetAddress();
+    if ((sa == J1939_ADDR_NULL) || (pgn > J1939_PGN_MASK) || (len == 0U) || (len > J1939_TP_MAX))
+    {
+        (void)MemPool_Free(block);
+        return HAL_ERROR;
+    }
+
+    if (len <= 8U)
+    {
+        HAL_StatusTypeDef st = J1939_Send(pgn, da, prio, block, (uint8_t)len);
+        (void)MemPool_Free(block);
+        return st;
+    }
+
+    /* One message at a time; the session is set up before its TP.CM
+     * leaves, as CTS may follow at once. */
+    uint8_t packets = (uint8_t)J1939_TP_PACKETS(len);
+    uint8_t bam     = (da == J1939_ADDR_GLOBAL) ? 1U : 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t busy = (t->state != J1939_TX_IDLE) ? 1U : 0U;
+    if (busy == 0U)
+    {
+        t->buf      = block;
+        t->len      = len;
+        t->pgn      = pgn;
+        t->sa       = sa;
+        t->da       = da;
+        t->packets  = packets;
+        t->next     = 1U;
+        t->abortReq = 0U;
+        t->tick     = HAL_GetTick();
+        t->state    = (bam != 0U) ? J1939_TX_BAM : J1939_TX_WAIT_CTS;
+    }
+    __set_PRIMASK(primask);
+
+    if (busy != 0U)
+    {
+        (void)MemPool_Free(block);
+        s_j1939Stats.txAborted++;
+        return HAL_BUSY;
+    }
+
+    HAL_StatusTypeDef st = j1939_send_cm(sa, da, (bam != 0U) ? J1939_TP_BAM : J1939_TP_RTS,
+                                         (uint8_t)len, (uint8_t)(len >> 8), packets, 0xFFU, pgn);
+    if (st != HAL_OK)
+    {
+        j1939_tx_end(1U);
+        return st;
+    }
+
+    j1939_wake();
+    return HAL_OK;
+}
+
+uint8_t J1939_GetAddress(void)
+{
+    return (s_j1939ClaimState == J1939_CLAIM_DONE) ? s_j1939Addr : J1939_ADDR_NULL;
+}
+
+void J1939_SetConsumer(osThreadId_t thread)
+{
+    s_j1939Consumer = thread;
+}
+
+uint32_t J1939_RxRun(void)
+{
+    return j1939_rx_expire(HAL_GetTick());
+}
+
+uint32_t J1939_Run(void)
+{
+    uint32_t now  = HAL_GetTick();
+    uint32_t wait = j1939_claim_run(now);
+    uint32_t w    = j1939_tx_run(now);
+
+    return (w < wait) ? w : wait;
+}
@@ -0,0 +1,302 @@
+/**
+ * @file    load_coll.c
+ * @brief   Load collectives, their flash log client and "load".
+ */
+
+#include "load_coll.h"
+#include "nvm_log.h"
+#include "cli_if.h"
+#include "ctrl_loop.h"
+#include "log.h"
+#include "fmt.h"
+#include <stdio.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* Records: key = LC_KEY_BASE + record, aux = LC_REC_VERSION, data = cells
+ * 2 x record and 2 x record + 1. Change the version with the bins: records
+ * of another layout are dropped at boot. */
+#define LC_KEY_BASE         0x0001U
+#define LC_REC_VERSION      1U
+#define LC_REC_COUNT        ((LOAD_COLL_CELLS + 1U) / 2U)
+
+/* Cells: the matrix row by row, then the coolant bins. */
+#define LC_TEMP_BASE        (LOAD_COLL_RPM_BINS * LOAD_COLL_SPEED_BINS)
+
+#define LC_SPEED_RECIP      (1.0f / LOAD_COLL_SPEED_BIN_KPH)
+#define LC_TEMP_RECIP       (1.0f / LOAD_COLL_TEMP_BIN_C)
+
+_Static_assert((LOAD_COLL_RPM_BINS > 0U) && (LOAD_COLL_SPEED_BINS > 0U) &&
+               (LOAD_COLL_TEMP_BINS > 0U), "load collective without bins");
+_Static_assert(LC_REC_COUNT <= 0xFFFEU, "too many load collective records");
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Cells (live) and what was last queued for the log (stored, pending = not
+ * yet written), padded to whole records. Written under PRIMASK by
+ * VehicleTask, LoadColl_Save() / LoadColl_Reset() (any task) and NvmTask. */
+static uint32_t s_lcLive[LC_REC_COUNT * 2U];
+static uint32_t s_lcStored[LC_REC_COUNT * 2U];
+static uint8_t  s_lcPending[LC_REC_COUNT];
+
+/* VehicleTask: last periodic save. */
+static uint32_t s_lcCheckMs = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static void lc_restore(const NvmLog_Record_t *rec)
+{
+    uint32_t i = (uint32_t)rec->key - LC_KEY_BASE;
+
+    if ((i >= LC_REC_COUNT) || (rec->aux != LC_REC_VERSION))
+        return;
+
+    s_lcLive[2U * i]          = rec->data[0];
+    s_lcLive[(2U * i) + 1U]   = rec->data[1];
+    s_lcStored[2U * i]        = rec->data[0];
+    s_lcStored[(2U * i) + 1U] = rec->data[1];
+}
+
+static uint8_t lc_take(uint32_t i, uint8_t all, NvmLog_Record_t *rec)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    /* A record back at zero (a reset) is written once, then dropped. */
+    uint8_t take = (all != 0U)
+                   ? (uint8_t)((s_lcStored[2U * i] != 0U) || (s_lcStored[(2U * i) + 1U] != 0U))
+                   : s_lcPending[i];
+    rec->key     = (uint16_t)(LC_KEY_BASE + i);
+    rec->aux     = LC_REC_VERSION;
+    rec->data[0] = s_lcStored[2U * i];
+    rec->data[1] = s_lcStored[(2U * i) + 1U];
+    s_lcPending[i] = 0U;
+
+    __set_PRIMASK(primask);
+    return take;
+}
+
+static void lc_retry(uint32_t i)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_lcPending[i] = 1U;
+    __set_PRIMASK(primask);
+}
+
+static const NvmLog_Client_t s_lcClient =
+{
+    .tag     = NVM_LOG_TAG_LOAD,
+    .count   = LC_REC_COUNT,
+    .restore = lc_restore,
+    .take    = lc_take,
+    .retry   = lc_retry,
+};
+
+/** Bin of @p x (a value already scaled to bin widths): truncated, the
+ *  first bin for anything below (and NaN), the last for anything above. */
+static uint32_t lc_bin(float x, uint32_t bins)
+{
+    if (!(x > 0.0f))
+        return 0U;
+    return (x < (float)bins) ? (uint32_t)x : (bins - 1U);
+}
+
+static void lc_inc(uint32_t *cell)
+{
+    if (*cell != UINT32_MAX)
+        (*cell)++;
+}
+
+/** Column header of bin @p b of @p bins from @p lo, @p width wide. */
+static const char *lc_edge(uint32_t b, uint32_t bins, float lo, float width, char *buf,
+                           size_t len)
+{
+    if (b + 1U < bins)
+        (void)FMT_SNPRINTF(buf, len, "<%ld", (long)(lo + ((float)(b + 1U) * width)));
+    else
+        (void)FMT_SNPRINTF(buf, len, ">=%ld", (long)(lo + ((float)b * width)));
+    return buf;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void lc_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    /* CliTask only: kept off its stack. */
+    static LoadColl_t lc;
+    char              edge[12];
+
+    LoadColl_Get(&lc);
+
+    CLI_IF_Print("Seconds per rpm x km/h\r\n   rpm");
+    for (uint32_t s = 0U; s < LOAD_COLL_SPEED_BINS; ++s)
+    {
+        CLI_IF_Printf(" %9s", lc_edge(s, LOAD_COLL_SPEED_BINS, 0.0f, LOAD_COLL_SPEED_BIN_KPH,
+                                      edge, sizeof(edge)));
+    }
+    CLI_IF_Print("\r\n");
+
+    for (uint32_t r = 0U; r < LOAD_COLL_RPM_BINS; ++r)
+    {
+        CLI_IF_Printf("%6s", lc_edge(r, LOAD_COLL_RPM_BINS, 0.0f,
+                                     (float)(1UL << LOAD_COLL_RPM_SHIFT), edge, sizeof(edge)));
+        for (uint32_t s = 0U; s < LOAD_COLL_SPEED_BINS; ++s)
+            CLI_IF_Printf(" %9lu", (unsigned long)(lc.rpmSpeed[r][s] / CTRL_LOOP_HZ));
+        CLI_IF_Print("\r\n");
+    }
+
+    CLI_IF_Print("Seconds per coolant C\r\n      ");
+    for (uint32_t t = 0U; t < LOAD_COLL_TEMP_BINS; ++t)
+    {
+        CLI_IF_Printf(" %9s", lc_edge(t, LOAD_COLL_TEMP_BINS, LOAD_COLL_TEMP_MIN_C,
+                                      LOAD_COLL_TEMP_BIN_C, edge, sizeof(edge)));
+    }
+    CLI_IF_Print("\r\n      ");
+    for (uint32_t t = 0U; t < LOAD_COLL_TEMP_BINS; ++t)
+        CLI_IF_Printf(" %9lu", (unsigned long)(lc.temp[t] / CTRL_LOOP_HZ));
+    CLI_IF_Print("\r\n");
+}
+
+static void lc_cmd_save(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CLI_IF_Printf("%lu records queued for flash\r\n", (unsigned long)LoadColl_Save());
+}
+
+static void lc_cmd_reset(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    LoadColl_Reset();
+    CLI_IF_Print("Load collectives cleared\r\n");
+}
+
+static const CliCommand_t s_lcCmds[] =
+{
+    { "load",       "", 0U, lc_cmd_show,  "load collectives: time per rpm x speed, coolant" },
+    { "load save",  "", 0U, lc_cmd_save,  "write the load collectives to flash now" },
+    { "load reset", "", 0U, lc_cmd_reset, "clear the load collectives" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void LoadColl_Init(void)
+{
+    memset(s_lcLive, 0, sizeof(s_lcLive));
+    memset(s_lcStored, 0, sizeof(s_lcStored));
+    memset(s_lcPending, 0, sizeof(s_lcPending));
+
+    if (NvmLog_Register(&s_lcClient) != HAL_OK)
+        LOG_ERROR(MAIN, "Load collectives not in the flash log, not kept over a reset");
+
+    CLI_IF_REGISTER_TABLE(s_lcCmds);
+}
+
+void LoadColl_Update(const VehicleState_t *vs)
+{
+    uint32_t r = (uint32_t)vs->engine_rpm >> LOAD_COLL_RPM_SHIFT;
+    uint32_t s = lc_bin(vs->speed_kph * LC_SPEED_RECIP, LOAD_COLL_SPEED_BINS);
+    uint32_t t = lc_bin((vs->coolant_temp_c - LOAD_COLL_TEMP_MIN_C) * LC_TEMP_RECIP,
+                        LOAD_COLL_TEMP_BINS);
+
+    if (r >= LOAD_COLL_RPM_BINS)
+        r = LOAD_COLL_RPM_BINS - 1U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    lc_inc(&s_lcLive[(r * LOAD_COLL_SPEED_BINS) + s]);
+    lc_inc(&s_lcLive[LC_TEMP_BASE + t]);
+    __set_PRIMASK(primask);
+
+    uint32_t now = HAL_GetTick();
+    if ((now - s_lcCheckMs) >= (LOAD_COLL_SAVE_MIN * 60000U))
+    {
+        s_lcCheckMs = now;
+        (void)LoadColl_Save();
+    }
+}
+
+uint32_t LoadColl_Save(void)
+{
+    uint32_t queued = 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    for (uint32_t i = 0U; i < LC_REC_COUNT; ++i)
+    {
+        uint32_t c = 2U * i;
+
+        if ((s_lcLive[c] == s_lcStored[c]) && (s_lcLive[c + 1U] == s_lcStored[c + 1U]))
+            continue;
+        s_lcStored[c]      = s_lcLive[c];
+        s_lcStored[c + 1U] = s_lcLive[c + 1U];
+        s_lcPending[i]     = 1U;
+        queued++;
+    }
+
+    __set_PRIMASK(primask);
+
+    if (queued != 0U)
+        NvmLog_Notify();
+    return queued;
+}
+
+void LoadColl_Reset(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memset(s_lcLive, 0, sizeof(s_lcLive));
+    __set_PRIMASK(primask);
+
+    (void)LoadColl_Save();
+}
+
+void LoadColl_Get(LoadColl_t *out)
+{
+    _Static_assert(sizeof(out->rpmSpeed) + sizeof(out->temp) ==
+                   LOAD_COLL_CELLS * sizeof(uint32_t), "LoadColl_t is not the cells");
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memcpy(out->rpmSpeed, s_lcLive, sizeof(out->rpmSpeed));
+    memcpy(out->temp, &s_lcLive[LC_TEMP_BASE], sizeof(out->temp));
+    __set_PRIMASK(primask);
+}
+
+uint32_t LoadColl_GetRow(uint32_t rpmBin, uint32_t *out)
+{
+    uint32_t n;
+
+    if (rpmBin < LOAD_COLL_RPM_BINS)
+        n = LOAD_COLL_SPEED_BINS;
+    else if (rpmBin == LOAD_COLL_RPM_BINS)
+        n = LOAD_COLL_TEMP_BINS;
+    else
+        return 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memcpy(out, &s_lcLive[rpmBin * LOAD_COLL_SPEED_BINS], n * sizeof(uint32_t));
+    __set_PRIMASK(primask);
+
+    return n;
+}
@@ -2,79 +2,1565 @@
  * @file    log.c
  * @brief   Lightweight logging framework implementation.
  *
- * Uses blocking HAL_UART_Transmit() for now.
+ * Deferred, asynchronous backend:
+ *   - Log_Write() formats the line on the caller's stack and copies it into
+ *     a lock-free multi-producer byte ring. It never touches the UART, so
+ *     it is cheap and safe from ISRs and tasks alike.
+ *   - Log_Task() (run by a low-priority LogTask) batches committed records
+ *     of one stream into a staging buffer and hands it to that stream's
+ *     transport: HAL_UART_Transmit_DMA() for "uart-dma", sleeping until
+ *     the TX-complete callback fires, or a synchronous write.
+ *   - Each stream (CLI output, log lines, telemetry) has its own ring. A
+ *     chunk is taken from the first non-empty ring in s_logPrio, so a burst
+ *     of log lines or telemetry delays a CLI reply by one chunk at most.
+ *   - With "log mux on" each chunk bound for the UART is sent as one frame
+ *     0x00 | COBS(stream | data) | 0x00 (log.h).
+ *   - Log_Submit() queues a request record (buffer, length, who to notify)
+ *     instead of the bytes. The drain ends the chunk before it, takes it
+ *     as the stream's "current request" and serves that in chunk-sized
+ *     pieces straight from the buffer (or framed from it), then notifies
+ *     the submitter.
+ *   - Before the scheduler runs there is no LogTask, so records are drained
+ *     synchronously (blocking HAL_UART_Transmit() for both UART transports)
+ *     to keep early boot messages (and Error_Handler paths) visible.
+ *
+ * With LOG_TOKENIZED, the LOG_* macros call Log_WriteTok() instead and the
+ * ring carries compact binary frames (see log.h); the output path is the
+ * same for both formats.
+ *
+ * Ring records are 4-byte aligned: a header word followed by the payload.
+ *   bit 31    : committed (payload complete, consumer may read it)
+ *   bit 30    : padding record (skip to the start of the buffer)
+ *   bit 29    : request record (payload is a Log_Request_t, Log_Submit())
+ *   bits 15..0: payload length (padding: total record size)
+ * Producers claim space with LDREX/STREX on the head index, so concurrent
+ * writers from different priorities never block each other. The consumer
+ * zeroes consumed space so stale bytes can never look like a committed
+ * header on the next lap.
  */
 
 #include "log.h"
+#include "metrics.h"
+#include "perf.h"
+#include "platform_dma.h"
+#include "rtt.h"
+#include "sram_layout.h"
+#include "time_sync.h"
+#include "cmsis_os2.h"
+#include "fmt.h"
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define LOG_REC_COMMITTED    0x80000000U
+#define LOG_REC_PAD          0x40000000U
+#define LOG_REC_REQ          0x20000000U
+#define LOG_REC_LEN_MASK     0x0000FFFFU
+#define LOG_REC_HDR_SIZE     4U
+
+#define LOG_ALIGN4(n)        (((n) + 3U) & ~3U)
+
+/* Mux frame of one chunk: the stream byte and the data, one COBS code byte
+ * per started block of 254 of them, and the two delimiters. */
+#define LOG_MUX_DATA_MAX     (LOG_TX_CHUNK_SIZE + 1U)
+#define LOG_MUX_FRAME_MAX    (LOG_MUX_DATA_MAX + ((LOG_MUX_DATA_MAX / 254U) + 1U) + 2U)
+
+_Static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1U)) == 0U,
+               "LOG_RING_SIZE must be a power of two");
+_Static_assert((LOG_CLI_RING_SIZE & (LOG_CLI_RING_SIZE - 1U)) == 0U,
+               "LOG_CLI_RING_SIZE must be a power of two");
+_Static_assert((LOG_TLM_RING_SIZE & (LOG_TLM_RING_SIZE - 1U)) == 0U,
+               "LOG_TLM_RING_SIZE must be a power of two");
+_Static_assert(LOG_TX_CHUNK_SIZE <= (LOG_RING_SIZE / 4U),
+               "LOG_TX_CHUNK_SIZE too large for LOG_RING_SIZE");
+_Static_assert(LOG_TX_CHUNK_SIZE <= (LOG_CLI_RING_SIZE / 2U),
+               "LOG_TX_CHUNK_SIZE too large for LOG_CLI_RING_SIZE");
+_Static_assert(LOG_TX_CHUNK_SIZE <= (LOG_TLM_RING_SIZE / 2U),
+               "LOG_TX_CHUNK_SIZE too large for LOG_TLM_RING_SIZE");
+_Static_assert((12U + (8U * (1U + LOG_TOK_STR_MAX))) <= 255U,
+               "LOG_TOK_STR_MAX too large for the tokenized frame length byte");
+_Static_assert((LOG_RAM_SIZE & (LOG_RAM_SIZE - 1U)) == 0U,
+               "LOG_RAM_SIZE must be a power of two");
+_Static_assert((LOG_SITE_BURST <= 0xFFFFU) && (LOG_SITE_PERIOD_MS > 0U),
+               "LOG_SITE_BURST must fit a u16, LOG_SITE_PERIOD_MS be non-zero");
+_Static_assert(LOG_BUDGET_BURST <= (0xFFFFFFFFU / 1000U),
+               "LOG_BUDGET_BURST too large for the millibyte budget");
+
+/* ITM / TPIU set-up for SWO (ARMv7-M ARM C1.10, CoreSight TPIU). */
+#define LOG_ITM_UNLOCK       0xC5ACCE55U
+#define LOG_TPI_NRZ          2U           /* SPPR: asynchronous, NRZ (UART-like) */
+#define LOG_TPI_NO_FORMATTER 0x100U       /* FFCR: TrigIn only, ITM data as is */
+
+/**
+ * @brief One output transport.
+ *
+ * @c write sends synchronously. @c start, if set, begins a transfer that
+ * ends with HAL_UART_TxCpltCallback(); it is only used from LogTask.
+ */
+typedef struct
+{
+    void             (*open)(void);
+    void             (*write)(const uint8_t *data, uint32_t len);
+    HAL_StatusTypeDef (*start)(const uint8_t *data, uint32_t len);
+} Log_Transport_t;
+
+/**
+ * @brief Record ring of one stream. Producers claim space at @c head
+ *        (LDREX/STREX); only the drain advances @c tail.
+ */
+typedef struct
+{
+    uint8_t          *buf;
+    uint32_t          size;      /* power of two */
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t peak;
+    volatile uint32_t dropped;
+} Log_Ring_t;
+
+/**
+ * @brief Bytes submitted by reference (Log_Submit()); @c len counts down
+ *        as the pieces are taken.
+ */
+typedef struct
+{
+    const uint8_t *data;
+    uint32_t       len;
+    osThreadId_t   notify;
+    uint32_t       flags;
+} Log_Request_t;
+
+#if (LOG_TOKENIZED != 0)
+/* Frame layout for tools/log_decode.py: the stamp is u64 microseconds. */
+static const char s_logTokLayout[] __attribute__((section(".log_fmt"), used)) =
+    "V" "\x1f" "LOG" "\x1f" "stamp-us64";
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
 static UART_HandleTypeDef *s_logUart = NULL;
 static log_level_t         s_logLevel = LOG_LEVEL_INFO;
 
-void Log_Init(UART_HandleTypeDef *huart)
+#define LOG_MOD_LEVEL_(name)  (uint8_t)LOG_LEVEL_INFO,
+#define LOG_MOD_NAME_(name)   #name,
+
+uint8_t g_logLevels[LOG_MOD_COUNT] = { LOG_MODULE_TABLE(LOG_MOD_LEVEL_) };
+
+static const char *const s_logModNames[LOG_MOD_COUNT] = { LOG_MODULE_TABLE(LOG_MOD_NAME_) };
+
+/* Rings and staging buffers live in SRAM2 with the other UART buffers,
+ * away from the stacks in SRAM1 (sram_layout.h). */
+SRAM2_DMA static uint8_t  s_logLinesBuf[LOG_RING_SIZE] __attribute__((aligned(4)));
+SRAM2_DMA static uint8_t  s_logCliBuf[LOG_CLI_RING_SIZE] __attribute__((aligned(4)));
+SRAM2_DMA static uint8_t  s_logTlmBuf[LOG_TLM_RING_SIZE] __attribute__((aligned(4)));
+
+static Log_Ring_t         s_logRings[LOG_STREAM_COUNT] =
 {
-    s_logUart = huart;
+    [LOG_STREAM_LINES] = { s_logLinesBuf, LOG_RING_SIZE,     0U, 0U, 0U, 0U },
+    [LOG_STREAM_CLI]   = { s_logCliBuf,   LOG_CLI_RING_SIZE, 0U, 0U, 0U, 0U },
+    [LOG_STREAM_TLM]   = { s_logTlmBuf,   LOG_TLM_RING_SIZE, 0U, 0U, 0U, 0U },
+};
+
+/** Drain order: interactive output first, bulk telemetry last. */
+static const uint8_t      s_logPrio[LOG_STREAM_COUNT] =
+{
+    (uint8_t)LOG_STREAM_CLI, (uint8_t)LOG_STREAM_LINES, (uint8_t)LOG_STREAM_TLM
+};
+
+/** Request being served per stream, LogTask (or the early-boot drain) only. */
+static Log_Request_t      s_logReqs[LOG_STREAM_COUNT];
+
+static const char *const  s_logStreamNames[LOG_STREAM_COUNT] =
+{
+    [LOG_STREAM_LINES] = "lines",
+    [LOG_STREAM_CLI]   = "cli",
+    [LOG_STREAM_TLM]   = "tlm",
+};
+
+/** Staging buffer handed to the DMA (and the blocking early-boot path). */
+PLATFORM_DMA_BUFFER static uint8_t s_logTxBuf[LOG_TX_CHUNK_SIZE];
+static uint32_t           s_logTxLen = 0U;  /* bytes of the last chunk in s_logTxBuf */
+static uint8_t            s_logTxStream = 0U;   /* its stream, for "xlog" records and "can" frames */
+
+/** The chunk as a mux frame, when "log mux" is on. */
+PLATFORM_DMA_BUFFER static uint8_t s_logMuxBuf[LOG_MUX_FRAME_MAX];
+static volatile uint8_t   s_logMux = LOG_MUX_DEFAULT;
+
+static osThreadId_t       s_logThread = NULL;
+static volatile uint8_t   s_logTxBusy = 0U; /* LogTask holds a chunk (Log_TxIdle()) */
+
+/* Transport per stream, read by the drain once per chunk. */
+static volatile uint8_t   s_logStreamTp[LOG_STREAM_COUNT] =
+{
+    [LOG_STREAM_LINES] = (uint8_t)LOG_LINES_TRANSPORT,
+    [LOG_STREAM_CLI]   = (uint8_t)LOG_CLI_TRANSPORT,
+    [LOG_STREAM_TLM]   = (uint8_t)LOG_TLM_TRANSPORT,
+};
+
+/* "ram" transport: capture ring, written by the drain only. */
+static uint8_t            s_logRam[LOG_RAM_SIZE];
+static volatile uint32_t  s_logRamWritten = 0U;
+
+static volatile uint32_t  s_logItmDropped = 0U;
+
+#if (LOG_PM_SIZE > 0U)
+#define LOG_PM_MAGIC        0x4C4F4750U     /* "LOGP" */
+
+/* Post-mortem ring: every log line, kept over a reset. written is the
+ * absolute end, claimed with LDREX/STREX by each writer before it copies. */
+typedef struct
+{
+    uint32_t          magic;
+    uint32_t          size;
+    volatile uint32_t written;
+    uint8_t           data[LOG_PM_SIZE];
+} Log_Pm_t;
+
+NOINIT static Log_Pm_t    s_logPm;
+static uint32_t           s_logPmBoot = 0U; /* written at Log_Init(): older bytes are from before the reset */
+#endif
+
+/* Rate limits. The budget counts millibytes so that the refill of
+ * LOG_BUDGET_BPS per second is exact at a 1 ms tick; both under PRIMASK. */
+static volatile uint8_t   s_logLimit = 1U;
+static uint32_t           s_logBudget      = LOG_BUDGET_BURST * 1000U;
+static uint32_t           s_logBudgetStamp = 0U;
+static volatile uint32_t  s_logSuppressed  = 0U;
+static volatile uint32_t  s_logShed[4];
+
+/* -------------------------------------------------------------------------- */
+/* Ring helpers                                                               */
+/* -------------------------------------------------------------------------- */
+
+static inline volatile uint32_t *log_hdr_at(const Log_Ring_t *ring, uint32_t idx)
+{
+    return (volatile uint32_t *)&ring->buf[idx & (ring->size - 1U)];
 }
 
-void Log_SetLevel(log_level_t level)
+/**
+ * @brief Claim space in @p ring for a record of @p len payload bytes.
+ *
+ * @param[out] hdr Header word of the claimed record.
+ * @return Payload pointer, or NULL if the ring is full (record dropped).
+ */
+static uint8_t *log_reserve(Log_Ring_t *ring, uint32_t len, volatile uint32_t **hdr)
 {
-    s_logLevel = level;
+    uint32_t size = LOG_REC_HDR_SIZE + LOG_ALIGN4(len);
+    uint32_t head;
+    uint32_t total;
+    uint32_t pad;
+
+    do
+    {
+        head = __LDREXW(&ring->head);
+
+        uint32_t toEnd = ring->size - (head & (ring->size - 1U));
+        pad   = (size > toEnd) ? toEnd : 0U;
+        total = pad + size;
+
+        if (((head - ring->tail) + total) > ring->size)
+        {
+            __CLREX();
+            ring->dropped++;
+            return NULL;
+        }
+    } while (__STREXW(head + total, &ring->head) != 0U);
+
+    uint32_t fill = (head + total) - ring->tail;
+    if (fill > ring->peak)
+        ring->peak = fill;
+    METRIC_HIST(LOG_RECORD_BYTES, len);
+
+    if (pad != 0U)
+    {
+        *log_hdr_at(ring, head) = LOG_REC_COMMITTED | LOG_REC_PAD | pad;
+        head += pad;
+    }
+
+    *hdr = log_hdr_at(ring, head);
+    **hdr = len;   /* not committed yet */
+    return &ring->buf[(head + LOG_REC_HDR_SIZE) & (ring->size - 1U)];
 }
 
-log_level_t Log_GetLevel(void)
+static void log_commit(volatile uint32_t *hdr)
 {
-    return s_logLevel;
+    __DMB();
+    *hdr |= LOG_REC_COMMITTED;
 }
 
-void Log_Write(log_level_t level, const char *module, const char *fmt, ...)
+/* -------------------------------------------------------------------------- */
+/* Transports                                                                 */
+/* -------------------------------------------------------------------------- */
+
+static void log_uart_write(const uint8_t *data, uint32_t len)
 {
-    if (level > s_logLevel)
-        return;
+    if (s_logUart != NULL)
+        (void)HAL_UART_Transmit(s_logUart, (uint8_t *)data, (uint16_t)len, 100U);
+}
 
+static HAL_StatusTypeDef log_uart_start(const uint8_t *data, uint32_t len)
+{
     if (s_logUart == NULL)
+        return HAL_ERROR;
+    /* The staging buffers, or a submitted buffer anywhere in RAM. */
+    PlatformDma_Clean(data, len);
+    return HAL_UART_Transmit_DMA(s_logUart, (uint8_t *)data, (uint16_t)len);
+}
+
+/** SWO as NRZ at LOG_ITM_SWO_HZ from the core clock, stimulus port on. */
+static void log_itm_open(void)
+{
+    uint32_t div = SystemCoreClock / LOG_ITM_SWO_HZ;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DBGMCU->CR       |= DBGMCU_CR_TRACE_IOEN;    /* TRACE_MODE 00: SWO only */
+
+    TPI->CSPSR = 1U;                             /* 1-bit port */
+    TPI->SPPR  = LOG_TPI_NRZ;
+    TPI->ACPR  = (div > 0U) ? (div - 1U) : 0U;
+    TPI->FFCR  = LOG_TPI_NO_FORMATTER;
+
+    ITM->LAR  = LOG_ITM_UNLOCK;
+    ITM->TCR  = (1UL << ITM_TCR_TraceBusID_Pos) | ITM_TCR_ITMENA_Msk;
+    ITM->TPR  = 0U;                              /* unprivileged writes allowed */
+    ITM->TER |= 1UL << LOG_ITM_PORT;
+}
+
+/** Words while the FIFO has room (a few cycles each), then the tail bytes.
+ *  With the port off (a debugger took the ITM) the bytes are counted. */
+static void log_itm_write(const uint8_t *data, uint32_t len)
+{
+    volatile ITM_Type *itm = ITM;
+
+    if (((itm->TCR & ITM_TCR_ITMENA_Msk) == 0U) || ((itm->TER & (1UL << LOG_ITM_PORT)) == 0U))
+    {
+        s_logItmDropped += len;
         return;
+    }
 
-    char msgBuf[128];
-    char outBuf[160];
+    for (; len >= 4U; data += 4U, len -= 4U)
+    {
+        uint32_t word;
 
-    va_list args;
-    va_start(args, fmt);
-    int n = vsnprintf(msgBuf, sizeof(msgBuf), fmt, args);
-    va_end(args);
+        memcpy(&word, data, 4U);
+        while (itm->PORT[LOG_ITM_PORT].u32 == 0U)
+        {
+        }
+        itm->PORT[LOG_ITM_PORT].u32 = word;
+    }
+    for (; len > 0U; ++data, --len)
+    {
+        while (itm->PORT[LOG_ITM_PORT].u32 == 0U)
+        {
+        }
+        itm->PORT[LOG_ITM_PORT].u8 = *data;
+    }
+}
+
+static void log_ram_write(const uint8_t *data, uint32_t len)
+{
+    uint32_t pos = s_logRamWritten;
+
+    for (uint32_t i = 0U; i < len; ++i)
+        s_logRam[(pos + i) & (LOG_RAM_SIZE - 1U)] = data[i];
+    __DMB();
+    s_logRamWritten = pos + len;
+}
+
+static void log_rtt_write(const uint8_t *data, uint32_t len)
+{
+    (void)Rtt_Write(data, len);     /* drops are counted by rtt.c */
+}
+
+#if USB_CDC_ENABLE
+static void log_usb_write(const uint8_t *data, uint32_t len)
+{
+    UsbCdc_Write(data, len, 100U);  /* drops while closed are counted by usb_cdc.c */
+}
+
+/** The IN endpoint reads the chunk in place: no copy to a USB buffer. */
+static HAL_StatusTypeDef log_usb_start(const uint8_t *data, uint32_t len)
+{
+    return UsbCdc_Transmit(data, len);
+}
+#endif /* USB_CDC_ENABLE */
+
+#if EXT_LOG_ENABLE
+static void log_xlog_write(const uint8_t *data, uint32_t len)
+{
+    ExtLog_WriteStream(s_logTxStream, data, len);
+}
+#endif /* EXT_LOG_ENABLE */
+
+#if CAN_LOG_ENABLE
+static void log_can_write(const uint8_t *data, uint32_t len)
+{
+    CanLog_Write(s_logTxStream, data, len);     /* drops are counted by can_log.c */
+}
+#endif /* CAN_LOG_ENABLE */
+
+#define LOG_TP_NAME_(name, text)  text,
+static const char *const s_logTpNames[LOG_TRANSPORT_COUNT] = { LOG_TRANSPORT_TABLE(LOG_TP_NAME_) };
+
+static const Log_Transport_t s_logTransports[LOG_TRANSPORT_COUNT] =
+{
+    [LOG_TRANSPORT_UART]     = { NULL,         log_uart_write, NULL           },
+    [LOG_TRANSPORT_UART_DMA] = { NULL,         log_uart_write, log_uart_start },
+    [LOG_TRANSPORT_ITM]      = { log_itm_open, log_itm_write,  NULL           },
+    [LOG_TRANSPORT_RAM]      = { NULL,         log_ram_write,  NULL           },
+    [LOG_TRANSPORT_RTT]      = { Rtt_Init,     log_rtt_write,  NULL           },
+#if USB_CDC_ENABLE
+    [LOG_TRANSPORT_USB]      = { NULL,         log_usb_write,  log_usb_start  },
+#endif
+#if EXT_LOG_ENABLE
+    [LOG_TRANSPORT_XLOG]     = { NULL,         log_xlog_write, NULL           },
+#endif
+#if CAN_LOG_ENABLE
+    [LOG_TRANSPORT_CAN]      = { NULL,         log_can_write,  NULL           },
+#endif
+};
+
+/* -------------------------------------------------------------------------- */
+/* Output path                                                                */
+/* -------------------------------------------------------------------------- */
+
+/** First stream in s_logPrio with a committed record or a request being
+ *  served, or LOG_STREAM_COUNT. */
+static uint32_t log_next_stream(void)
+{
+    for (uint32_t i = 0U; i < (uint32_t)LOG_STREAM_COUNT; ++i)
+    {
+        const Log_Ring_t *ring = &s_logRings[s_logPrio[i]];
+
+        if ((s_logReqs[s_logPrio[i]].len != 0U) ||
+            ((ring->tail != ring->head) &&
+             ((*log_hdr_at(ring, ring->tail) & LOG_REC_COMMITTED) != 0U)))
+        {
+            return s_logPrio[i];
+        }
+    }
+    return (uint32_t)LOG_STREAM_COUNT;
+}
+
+/**
+ * @brief Next piece of the request being served on @p stream, in place.
+ */
+static uint32_t log_request_piece(uint32_t stream, const uint8_t **data)
+{
+    Log_Request_t *req = &s_logReqs[stream];
+    uint32_t       n   = (req->len > LOG_TX_CHUNK_SIZE) ? LOG_TX_CHUNK_SIZE : req->len;
+
+    *data         = req->data;
+    s_logTxLen    = 0U;         /* not in s_logTxBuf (Log_CopyRecent()) */
+    s_logTxStream = (uint8_t)stream;
+
+    req->data += n;
+    req->len  -= n;
+    return n;
+}
+
+/**
+ * @brief Copy committed records of the most urgent stream into s_logTxBuf
+ *        and free their ring space, or take the next piece of a submitted
+ *        buffer.
+ *
+ * Stops at the first uncommitted record so output order within the stream
+ * is preserved, and before a request record: the bytes queued ahead of it
+ * go out first.
+ *
+ * @param[out] stream Stream of the chunk.
+ * @param[out] data   The chunk: s_logTxBuf or the submitted buffer.
+ * @return Number of bytes in the chunk.
+ */
+static uint32_t log_drain_chunk(uint32_t *stream, const uint8_t **data)
+{
+    uint32_t out = 0U;
+
+    *stream = log_next_stream();
+    if (*stream >= (uint32_t)LOG_STREAM_COUNT)
+        return 0U;
+
+    if (s_logReqs[*stream].len != 0U)
+        return log_request_piece(*stream, data);
+
+    Log_Ring_t *ring = &s_logRings[*stream];
+    uint32_t    mask = ring->size - 1U;
+
+    for (;;)
+    {
+        uint32_t tail = ring->tail;
+        if (tail == ring->head)
+            break;
+
+        uint32_t hdr = *log_hdr_at(ring, tail);
+        if ((hdr & LOG_REC_COMMITTED) == 0U)
+            break;
+
+        uint32_t size;
+        if ((hdr & LOG_REC_PAD) != 0U)
+        {
+            size = hdr & LOG_REC_LEN_MASK;
+        }
+        else if ((hdr & LOG_REC_REQ) != 0U)
+        {
+            if (out > 0U)
+                break;
+
+            __DMB();
+            memcpy(&s_logReqs[*stream], &ring->buf[(tail + LOG_REC_HDR_SIZE) & mask],
+                   sizeof(Log_Request_t));
+            size = LOG_REC_HDR_SIZE + LOG_ALIGN4((uint32_t)sizeof(Log_Request_t));
+            memset(&ring->buf[tail & mask], 0, size);
+            __DMB();
+            ring->tail = tail + size;
+            return log_request_piece(*stream, data);
+        }
+        else
+        {
+            uint32_t len = hdr & LOG_REC_LEN_MASK;
+            if ((out + len) > LOG_TX_CHUNK_SIZE)
+                break;
+
+            __DMB();
+            memcpy(&s_logTxBuf[out], &ring->buf[(tail + LOG_REC_HDR_SIZE) & mask], len);
+            out += len;
+            size = LOG_REC_HDR_SIZE + LOG_ALIGN4(len);
+        }
+
+        /* Records never wrap, so the region is contiguous. */
+        memset(&ring->buf[tail & mask], 0, size);
+        __DMB();
+        ring->tail = tail + size;
+    }
+
+    if (out > 0U)
+    {
+        s_logTxLen    = out;
+        s_logTxStream = (uint8_t)*stream;
+    }
+    *data = s_logTxBuf;
+    return out;
+}
+
+/**
+ * @brief The chunk of @p stream is out: wake the submitter if it was the
+ *        end of its request.
+ */
+static void log_chunk_done(uint32_t stream)
+{
+    Log_Request_t *req = &s_logReqs[stream];
+
+    if ((req->len == 0U) && (req->notify != NULL))
+    {
+        (void)osThreadFlagsSet(req->notify, req->flags);
+        req->notify = NULL;
+    }
+}
+
+/**
+ * @brief Frame the chunk for the UART when "log mux" is on:
+ *        0x00 | COBS(stream | data) | 0x00 into s_logMuxBuf.
+ *
+ * @param[in]     data Chunk from log_drain_chunk().
+ * @param[in,out] len  Chunk length; the frame length when framed.
+ * @return The bytes to send.
+ */
+static const uint8_t *log_mux_frame(uint32_t stream, uint32_t tp, const uint8_t *data,
+                                    uint32_t *len)
+{
+    if ((s_logMux == 0U) ||
+        ((tp != (uint32_t)LOG_TRANSPORT_UART) && (tp != (uint32_t)LOG_TRANSPORT_UART_DMA)))
+    {
+        return data;
+    }
+
+    uint32_t out  = 1U;
+    uint32_t code = out++;      /* position of the pending COBS code byte */
+
+    s_logMuxBuf[0] = 0x00U;
+    for (uint32_t i = 0U; i <= *len; ++i)
+    {
+        uint8_t b = (i == 0U) ? (uint8_t)stream : data[i - 1U];
+
+        if (b != 0x00U)
+            s_logMuxBuf[out++] = b;
+        if ((b == 0x00U) || ((out - code) == 0xFFU))
+        {
+            s_logMuxBuf[code] = (uint8_t)(out - code);
+            code = out++;
+        }
+    }
+    s_logMuxBuf[code] = (uint8_t)(out - code);
+    s_logMuxBuf[out++] = 0x00U;
+
+    *len = out;
+    return s_logMuxBuf;
+}
+
+/**
+ * @brief Append @p len bytes to @p dst at @p pos after skipping @p *skip.
+ */
+static uint32_t log_copy_part(char *dst, uint32_t pos, const uint8_t *src, uint32_t len,
+                              uint32_t *skip)
+{
+    uint32_t drop = (*skip < len) ? *skip : len;
+
+    *skip -= drop;
+    memcpy(&dst[pos], &src[drop], len - drop);
+    return pos + (len - drop);
+}
 
-    if (n < 0)
+/**
+ * @brief Blocking drain used while no LogTask is running.
+ */
+static void log_flush_blocking(void)
+{
+    if (s_logUart == NULL)
         return;
 
-    if ((size_t)n >= sizeof(msgBuf))
+    uint32_t       n;
+    uint32_t       stream;
+    const uint8_t *chunk;
+    while ((n = log_drain_chunk(&stream, &chunk)) > 0U)
+    {
+        uint32_t       tp   = s_logStreamTp[stream];
+        const uint8_t *data = log_mux_frame(stream, tp, chunk, &n);
+
+        s_logTransports[tp].write(data, n);
+        log_chunk_done(stream);
+    }
+}
+
+/** Wake LogTask, or drain on the spot before the scheduler runs. */
+static void log_kick(void)
+{
+    if (s_logThread != NULL)
+    {
+        (void)osThreadFlagsSet(s_logThread, LOG_FLAG_DATA);
+    }
+    else if (osKernelGetState() != osKernelRunning)
     {
-        n = (int)sizeof(msgBuf) - 1;
-        msgBuf[n] = '\0';
+        log_flush_blocking();
     }
+}
+
+/**
+ * @brief Queue @p len bytes as one record of @p stream and kick the output
+ *        path.
+ *
+ * @return HAL_OK, or HAL_BUSY if the ring had no room (record dropped).
+ */
+static HAL_StatusTypeDef log_enqueue(Log_Stream_t stream, const char *data, uint32_t len)
+{
+    volatile uint32_t *hdr;
+    uint8_t *dst = log_reserve(&s_logRings[stream], len, &hdr);
+    if (dst == NULL)
+        return HAL_BUSY;
+
+    memcpy(dst, data, len);
+    log_commit(hdr);
+    log_kick();
+
+    return HAL_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Rate limits                                                                */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief 1 when the limits apply: on, and LogTask drains the rings. The
+ *        blocking output before it runs cannot be flooded, and the boot
+ *        banner must not be shed.
+ */
+static inline uint8_t log_limited(void)
+{
+    return ((s_logLimit != 0U) && (s_logThread != NULL)) ? 1U : 0U;
+}
+
+/**
+ * @brief Top the budget up to now and say whether a line of @p level may
+ *        be formatted: DEBUG needs half the burst left, INFO a quarter,
+ *        WARN anything, ERROR nothing.
+ */
+static uint8_t log_budget_admit(log_level_t level)
+{
+#if (LOG_BUDGET_BPS > 0U)
+    static const uint32_t floors[4] =
+    {
+        0U, 1U, (LOG_BUDGET_BURST * 1000U) / 4U, (LOG_BUDGET_BURST * 1000U) / 2U
+    };
+    uint32_t lvl = ((uint32_t)level < 4U) ? (uint32_t)level : 3U;
+    uint8_t  ok;
+
+    if ((log_limited() == 0U) || (lvl == (uint32_t)LOG_LEVEL_ERROR))
+        return 1U;
 
-    char levelChar = 'I';
-    switch (level)
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint32_t now = HAL_GetTick();
+    uint32_t dt  = now - s_logBudgetStamp;
+    uint32_t cap = LOG_BUDGET_BURST * 1000U;
+
+    s_logBudgetStamp = now;
+    if (dt > ((cap / LOG_BUDGET_BPS) + 1U))
+        dt = (cap / LOG_BUDGET_BPS) + 1U;
+    s_logBudget += dt * LOG_BUDGET_BPS;
+    if (s_logBudget > cap)
+        s_logBudget = cap;
+
+    ok = (s_logBudget >= floors[lvl]) ? 1U : 0U;
+    if (ok == 0U)
+        s_logShed[lvl]++;
+
+    __set_PRIMASK(primask);
+    return ok;
+#else
+    (void)level;
+    return 1U;
+#endif
+}
+
+/** Take @p len bytes of a line from the budget. */
+static void log_budget_debit(uint32_t len)
+{
+#if (LOG_BUDGET_BPS > 0U)
+    if (log_limited() == 0U)
+        return;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_logBudget = (s_logBudget > (len * 1000U)) ? (s_logBudget - (len * 1000U)) : 0U;
+    __set_PRIMASK(primask);
+#else
+    (void)len;
+#endif
+}
+
+/** Append @p len bytes to the post-mortem ring; any context, no lock. */
+static void log_pm_write(const char *data, uint32_t len)
+{
+#if (LOG_PM_SIZE > 0U)
+    uint32_t pos;
+
+    if (len > LOG_PM_SIZE)
     {
-        case LOG_LEVEL_ERROR: levelChar = 'E'; break;
-        case LOG_LEVEL_WARN:  levelChar = 'W'; break;
-        case LOG_LEVEL_INFO:  levelChar = 'I'; break;
-        case LOG_LEVEL_DEBUG: levelChar = 'D'; break;
-        default:              levelChar = '?'; break;
+        data += len - LOG_PM_SIZE;
+        len   = LOG_PM_SIZE;
     }
 
+    do
+    {
+        pos = __LDREXW(&s_logPm.written);
+    } while (__STREXW(pos + len, &s_logPm.written) != 0U);
+
+    uint32_t at    = pos & (LOG_PM_SIZE - 1U);
+    uint32_t first = ((LOG_PM_SIZE - at) < len) ? (LOG_PM_SIZE - at) : len;
+
+    memcpy(&s_logPm.data[at], data, first);
+    memcpy(s_logPm.data, &data[first], len - first);
+#else
+    (void)data;
+    (void)len;
+#endif
+}
+
+/** Keep a finished log line (or tokenized frame) in the post-mortem ring
+ *  and queue it against the budget. */
+static void log_line_out(const char *data, uint32_t len)
+{
+    log_pm_write(data, len);
+    log_budget_debit(len);
+    (void)log_enqueue(LOG_STREAM_LINES, data, len);
+}
+
+/** Longest module tag copied into the line prefix. */
+#define LOG_TAG_MAX  8U
+
+/**
+ * @brief Write the "[<s>.<us>][L][MOD] " prefix (at most 19 + 5 +
+ *        LOG_TAG_MAX chars). The 64-bit division stays here, in the text
+ *        path, after the line has passed every limit.
+ */
+static size_t log_prefix(char *out, uint64_t stampUs, log_level_t level, const char *module)
+{
+    static const char levelChars[] = { 'E', 'W', 'I', 'D' };
+    size_t n = 0U;
+
     if (module == NULL)
         module = "GEN";
 
-    n = snprintf(outBuf, sizeof(outBuf), "[%c][%s] %s\r\n",
-                 levelChar, module, msgBuf);
-    if (n <= 0)
+#if (LOG_TEXT_STAMP != 0)
+    out[n++] = '[';
+    n += Fmt_Dec(&out[n], (uint32_t)(stampUs / 1000000U), 0U);
+    out[n++] = '.';
+    n += Fmt_DecZ(&out[n], (uint32_t)(stampUs % 1000000U), 6U);
+    out[n++] = ']';
+#else
+    (void)stampUs;
+#endif
+
+    out[n++] = '[';
+    out[n++] = ((uint32_t)level < sizeof(levelChars)) ? levelChars[level] : '?';
+    out[n++] = ']';
+    out[n++] = '[';
+    for (uint32_t i = 0U; (module[i] != '\0') && (i < LOG_TAG_MAX); ++i)
+        out[n++] = module[i];
+    out[n++] = ']';
+    out[n++] = ' ';
+
+    return n;
+}
+
+/**
+ * @brief Format "[<stamp>][L][MOD] text\r\n" and queue it.
+ */
+static void log_vwrite(uint64_t stampUs, log_level_t level, const char *module, const char *fmt,
+                       va_list args)
+{
+    char   outBuf[LOG_LINE_MAX];
+    size_t n = log_prefix(outBuf, stampUs, level, module);
+
+    /* Leave room for "\r\n". */
+    size_t room = sizeof(outBuf) - n - 2U;
+
+    int m = FMT_VSNPRINTF(&outBuf[n], room + 1U, fmt, args);
+
+    if (m < 0)
         return;
 
-    size_t len = (size_t)n;
-    if (len > sizeof(outBuf))
-        len = sizeof(outBuf);
+    size_t len = n + (((size_t)m > room) ? room : (size_t)m);
+    outBuf[len++] = '\r';
+    outBuf[len++] = '\n';
+
+    log_line_out(outBuf, (uint32_t)len);
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void Log_Init(UART_HandleTypeDef *huart)
+{
+    s_logUart = huart;
+
+#if (LOG_PM_SIZE > 0U)
+    if ((s_logPm.magic != LOG_PM_MAGIC) || (s_logPm.size != LOG_PM_SIZE))
+    {
+        s_logPm.written = 0U;
+        s_logPm.size    = LOG_PM_SIZE;
+        s_logPm.magic   = LOG_PM_MAGIC;
+    }
+    else if (s_logPm.written != 0U)
+    {
+        static const char mark[] = "--- reset ---\r\n";
+        log_pm_write(mark, (uint32_t)(sizeof(mark) - 1U));
+    }
+    s_logPmBoot = s_logPm.written;
+#endif
 
-    (void)HAL_UART_Transmit(s_logUart, (uint8_t *)outBuf,
-                            (uint16_t)len, 10U);
+    for (uint32_t i = 0U; i < (uint32_t)LOG_STREAM_COUNT; ++i)
+        (void)Log_SetTransport((Log_Stream_t)i, (Log_TransportId_t)s_logStreamTp[i]);
+}
+
+void Log_SetLevel(log_level_t level)
+{
+    s_logLevel = level;
+
+    for (uint32_t i = 0U; i < (uint32_t)LOG_MOD_COUNT; ++i)
+    {
+        g_logLevels[i] = (uint8_t)level;
+    }
+}
+
+log_level_t Log_GetLevel(void)
+{
+    return s_logLevel;
+}
+
+void Log_SetModuleLevel(log_module_t mod, log_level_t level)
+{
+    if ((uint32_t)mod < (uint32_t)LOG_MOD_COUNT)
+    {
+        g_logLevels[mod] = (uint8_t)level;
+    }
+}
+
+log_level_t Log_GetModuleLevel(log_module_t mod)
+{
+    if ((uint32_t)mod >= (uint32_t)LOG_MOD_COUNT)
+        return LOG_LEVEL_ERROR;
+
+    return (log_level_t)g_logLevels[mod];
+}
+
+int32_t Log_FindModule(const char *name)
+{
+    if (name == NULL)
+        return -1;
+
+    for (uint32_t i = 0U; i < (uint32_t)LOG_MOD_COUNT; ++i)
+    {
+        if (strcmp(name, s_logModNames[i]) == 0)
+            return (int32_t)i;
+    }
+
+    return -1;
+}
+
+const char *Log_ModuleName(log_module_t mod)
+{
+    if ((uint32_t)mod >= (uint32_t)LOG_MOD_COUNT)
+        return NULL;
+
+    return s_logModNames[mod];
+}
+
+void Log_Write(log_level_t level, const char *module, const char *fmt, ...)
+{
+    uint64_t stampUs = TimeSync_LocalUs();
+
+    if ((s_logUart == NULL) || (log_budget_admit(level) == 0U))
+        return;
+
+    PERF_BEGIN(LOG_WRITE);
+
+    va_list args;
+    va_start(args, fmt);
+    log_vwrite(stampUs, level, module, fmt, args);
+    va_end(args);
+
+    PERF_END(LOG_WRITE);
+}
+
+void Log_WriteText(log_level_t level, const char *module, const char *text, size_t len)
+{
+    uint64_t stampUs = TimeSync_LocalUs();
+
+    if ((s_logUart == NULL) || (text == NULL) || (log_budget_admit(level) == 0U))
+        return;
+
+    PERF_BEGIN(LOG_WRITE);
+
+    char   outBuf[LOG_LINE_MAX];
+    size_t n    = log_prefix(outBuf, stampUs, level, module);
+    size_t room = sizeof(outBuf) - n - 2U;
+
+    if (len > room)
+        len = room;
+    memcpy(&outBuf[n], text, len);
+    n += len;
+    outBuf[n++] = '\r';
+    outBuf[n++] = '\n';
+
+    log_line_out(outBuf, (uint32_t)n);
+
+    PERF_END(LOG_WRITE);
+}
+
+HAL_StatusTypeDef Log_WriteStream(Log_Stream_t stream, const char *data, size_t len)
+{
+    HAL_StatusTypeDef status = HAL_OK;
+
+    if ((data == NULL) || (s_logUart == NULL) || ((uint32_t)stream >= (uint32_t)LOG_STREAM_COUNT))
+        return HAL_ERROR;
+
+    /* Split so that every record fits into one DMA chunk. */
+    while (len > 0U)
+    {
+        uint32_t part = (len > LOG_TX_CHUNK_SIZE) ? LOG_TX_CHUNK_SIZE : (uint32_t)len;
+        if (log_enqueue(stream, data, part) != HAL_OK)
+            status = HAL_BUSY;
+        data += part;
+        len  -= part;
+    }
+
+    return status;
+}
+
+HAL_StatusTypeDef Log_WriteRaw(const char *data, size_t len)
+{
+    return Log_WriteStream(LOG_STREAM_CLI, data, len);
+}
+
+HAL_StatusTypeDef Log_Submit(Log_Stream_t stream, const void *data, uint32_t len,
+                             osThreadId_t notify, uint32_t flags)
+{
+    if ((data == NULL) || (len == 0U) || (s_logUart == NULL) ||
+        ((uint32_t)stream >= (uint32_t)LOG_STREAM_COUNT))
+    {
+        return HAL_ERROR;
+    }
+
+    const Log_Request_t req = { (const uint8_t *)data, len, notify, flags };
+    volatile uint32_t  *hdr;
+    uint8_t *dst = log_reserve(&s_logRings[stream], (uint32_t)sizeof(req), &hdr);
+    if (dst == NULL)
+        return HAL_BUSY;
+
+    memcpy(dst, &req, sizeof(req));
+    *hdr |= LOG_REC_REQ;
+    log_commit(hdr);
+    log_kick();
+
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef Log_Send(Log_Stream_t stream, const void *data, uint32_t len,
+                           uint32_t timeoutMs)
+{
+    /* Before the scheduler the submit itself sends the bytes. */
+    uint8_t      running = (osKernelGetState() == osKernelRunning) ? 1U : 0U;
+    osThreadId_t self    = (running != 0U) ? osThreadGetId() : NULL;
+    uint32_t     start   = HAL_GetTick();
+
+    if (self != NULL)
+        (void)osThreadFlagsClear(LOG_FLAG_SENT);
+
+    for (;;)
+    {
+        HAL_StatusTypeDef st = Log_Submit(stream, data, len, self, LOG_FLAG_SENT);
+
+        if (st == HAL_ERROR)
+            return st;
+        if (st == HAL_OK)
+            break;
+        if ((running == 0U) || ((HAL_GetTick() - start) >= timeoutMs))
+            return HAL_TIMEOUT;
+        (void)osDelay(1U);
+    }
+
+    if (self != NULL)
+        (void)osThreadFlagsWait(LOG_FLAG_SENT, osFlagsWaitAny, osWaitForever);
+    return HAL_OK;
+}
+
+void Log_WriteTok(log_level_t level, uint32_t token,
+                  const Log_Arg_t *args, uint32_t nargs)
+{
+    uint64_t stampUs = TimeSync_LocalUs();
+
+    /* The level is carried by the token record; here it only meets the budget. */
+    if ((s_logUart == NULL) || (log_budget_admit(level) == 0U))
+        return;
+
+    /* sync + len + token + stamp + 8 args, strings up to the limit */
+    uint8_t  frame[2U + 12U + (8U * (1U + LOG_TOK_STR_MAX))];
+    uint32_t pos = 2U;
+
+    memcpy(&frame[pos], &token, 4U);    pos += 4U;
+    memcpy(&frame[pos], &stampUs, 8U);  pos += 8U;
+
+    for (uint32_t i = 0U; (i < nargs) && (i < 8U); ++i)
+    {
+        if (args[i].str != NULL)
+        {
+            size_t len = strnlen(args[i].str, LOG_TOK_STR_MAX);
+            frame[pos++] = (uint8_t)len;
+            memcpy(&frame[pos], args[i].str, len);
+            pos += (uint32_t)len;
+        }
+        else
+        {
+            memcpy(&frame[pos], &args[i].word, 4U);
+            pos += 4U;
+        }
+    }
+
+    frame[0] = LOG_TOK_SYNC;
+    frame[1] = (uint8_t)(pos - 2U);
+
+    log_line_out((const char *)frame, pos);
+}
+
+uint8_t Log_SiteAdmit(Log_Site_t *site, log_level_t level, const char *module)
+{
+#if (LOG_SITE_BURST > 0U)
+    uint32_t repeated = 0U;
+    uint8_t  ok       = 1U;
+
+    if (log_limited() == 0U)
+        return 1U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint32_t now    = HAL_GetTick();
+    uint32_t refill = (now - site->stamp) / LOG_SITE_PERIOD_MS;
+
+    if (refill >= site->spent)
+    {
+        site->spent = 0U;
+        site->stamp = now;
+    }
+    else
+    {
+        site->spent  = (uint16_t)(site->spent - refill);
+        site->stamp += refill * LOG_SITE_PERIOD_MS;
+    }
+
+    if (site->spent < LOG_SITE_BURST)
+    {
+        site->spent++;
+        repeated = site->suppressed;
+        site->suppressed = 0U;
+    }
+    else
+    {
+        if (site->suppressed < 0xFFFFU)
+            site->suppressed++;
+        s_logSuppressed++;
+        ok = 0U;
+    }
+
+    __set_PRIMASK(primask);
+
+    if (repeated != 0U)
+        Log_Write(level, module, "%lu suppressed like:", (unsigned long)repeated);
+    return ok;
+#else
+    (void)site;
+    (void)level;
+    (void)module;
+    return 1U;
+#endif
+}
+
+void Log_SetLimit(uint8_t on)
+{
+    s_logLimit = (on != 0U) ? 1U : 0U;
+}
+
+void Log_GetLimitStats(Log_LimitStats_t *stats)
+{
+    stats->on         = s_logLimit;
+    stats->suppressed = s_logSuppressed;
+    for (uint32_t i = 0U; i < 4U; ++i)
+        stats->shed[i] = s_logShed[i];
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    stats->budget = s_logBudget / 1000U;
+    __set_PRIMASK(primask);
+}
+
+uint32_t Log_Service(void)
+{
+    if (s_logThread == NULL)
+    {
+        s_logThread = osThreadGetId();
+    }
+
+    s_logTxBusy = 1U;
+
+    uint32_t       stream;
+    const uint8_t *chunk;
+    uint32_t       n = log_drain_chunk(&stream, &chunk);
+    if ((n == 0U) || (s_logUart == NULL))
+    {
+        s_logTxBusy = 0U;
+        return 0U;
+    }
+
+    uint32_t               tp   = s_logStreamTp[stream];
+    const Log_Transport_t *t    = &s_logTransports[tp];
+    uint32_t               len  = n;
+    const uint8_t         *data = log_mux_frame(stream, tp, chunk, &len);
+    uint8_t                sent = 0U;
+
+    if (t->start != NULL)
+    {
+        (void)osThreadFlagsClear(LOG_FLAG_TX_DONE);
+        if (t->start(data, len) == HAL_OK)
+        {
+            (void)osThreadFlagsWait(LOG_FLAG_TX_DONE, osFlagsWaitAny, osWaitForever);
+            sent = 1U;
+        }
+        /* UART busy with something else: fall back to a blocking send. */
+    }
+    if (sent == 0U)
+        t->write(data, len);
+    log_chunk_done(stream);
+    s_logTxBusy = 0U;
+    return n;
+}
+
+void Log_Coop(Coop_t *c)
+{
+    COOP_BEGIN(c);
+    for (;;)
+    {
+        /* One chunk a turn: a steady log stream cannot hold off the
+         * other coroutines. */
+        while (Log_Service() != 0U)
+            COOP_YIELD(c);
+        COOP_WAIT_FLAGS(c, LOG_FLAG_DATA, COOP_FOREVER);
+    }
+    COOP_END(c);
+}
+
+uint8_t Log_TxIdle(void)
+{
+    if (s_logTxBusy != 0U)
+        return 0U;
+
+    for (uint32_t i = 0U; i < (uint32_t)LOG_STREAM_COUNT; ++i)
+    {
+        if ((s_logRings[i].head != s_logRings[i].tail) || (s_logReqs[i].len != 0U))
+            return 0U;
+    }
+    return 1U;
+}
+
+uint8_t Log_TxBusy(void)
+{
+    return (s_logTxBusy != 0U) ? 1U : 0U;
+}
+
+void Log_ClockChanged(void)
+{
+    for (uint32_t i = 0U; i < (uint32_t)LOG_STREAM_COUNT; ++i)
+    {
+        if (s_logStreamTp[i] == (uint8_t)LOG_TRANSPORT_ITM)
+        {
+            log_itm_open();     /* ACPR from the new SystemCoreClock */
+            return;
+        }
+    }
+}
+
+void Log_Task(void)
+{
+    if (Log_Service() == 0U)
+    {
+        (void)osThreadFlagsWait(LOG_FLAG_DATA, osFlagsWaitAny, osWaitForever);
+    }
+}
+
+HAL_StatusTypeDef Log_SetTransport(Log_Stream_t stream, Log_TransportId_t transport)
+{
+    if (((uint32_t)stream >= (uint32_t)LOG_STREAM_COUNT) ||
+        ((uint32_t)transport >= (uint32_t)LOG_TRANSPORT_COUNT))
+    {
+        return HAL_ERROR;
+    }
+
+    if (s_logTransports[transport].open != NULL)
+        s_logTransports[transport].open();
+    s_logStreamTp[stream] = (uint8_t)transport;
+
+    return HAL_OK;
+}
+
+Log_TransportId_t Log_GetTransport(Log_Stream_t stream)
+{
+    if ((uint32_t)stream >= (uint32_t)LOG_STREAM_COUNT)
+        return LOG_TRANSPORT_UART_DMA;
+
+    return (Log_TransportId_t)s_logStreamTp[stream];
+}
+
+int32_t Log_FindStream(const char *name)
+{
+    if (name == NULL)
+        return -1;
+
+    for (uint32_t i = 0U; i < (uint32_t)LOG_STREAM_COUNT; ++i)
+    {
+        if (strcmp(name, s_logStreamNames[i]) == 0)
+            return (int32_t)i;
+    }
+
+    return -1;
+}
+
+const char *Log_StreamName(Log_Stream_t stream)
+{
+    if ((uint32_t)stream >= (uint32_t)LOG_STREAM_COUNT)
+        return NULL;
+
+    return s_logStreamNames[stream];
+}
+
+void Log_SetMux(uint8_t on)
+{
+    s_logMux = (on != 0U) ? 1U : 0U;
+}
+
+uint8_t Log_GetMux(void)
+{
+    return s_logMux;
+}
+
+int32_t Log_FindTransport(const char *name)
+{
+    if (name == NULL)
+        return -1;
+
+    for (uint32_t i = 0U; i < (uint32_t)LOG_TRANSPORT_COUNT; ++i)
+    {
+        if (strcmp(name, s_logTpNames[i]) == 0)
+            return (int32_t)i;
+    }
+
+    return -1;
+}
+
+const char *Log_TransportName(Log_TransportId_t transport)
+{
+    if ((uint32_t)transport >= (uint32_t)LOG_TRANSPORT_COUNT)
+        return NULL;
+
+    return s_logTpNames[transport];
+}
+
+uint32_t Log_RamWritten(void)
+{
+    return s_logRamWritten;
+}
+
+uint32_t Log_ReadRam(uint32_t *pos, uint32_t end, char *dst, uint32_t size)
+{
+    uint32_t written = s_logRamWritten;
+    uint32_t from    = *pos;
+    uint32_t n;
+
+    /* Offsets are absolute and wrap at 2^32: compare by the distance. */
+    if ((written - from) > LOG_RAM_SIZE)
+        from = written - LOG_RAM_SIZE;
+    if ((written - end) > (written - from))
+        end = from;
+
+    n = end - from;
+    if (n > size)
+        n = size;
+
+    for (uint32_t i = 0U; i < n; ++i)
+        dst[i] = (char)s_logRam[(from + i) & (LOG_RAM_SIZE - 1U)];
+
+    *pos = from + n;
+    return n;
+}
+
+uint32_t Log_PmWritten(void)
+{
+#if (LOG_PM_SIZE > 0U)
+    return s_logPm.written;
+#else
+    return 0U;
+#endif
+}
+
+uint32_t Log_PmBoot(void)
+{
+#if (LOG_PM_SIZE > 0U)
+    return s_logPmBoot;
+#else
+    return 0U;
+#endif
+}
+
+uint32_t Log_ReadPm(uint32_t *pos, uint32_t end, char *dst, uint32_t size)
+{
+#if (LOG_PM_SIZE > 0U)
+    uint32_t written = s_logPm.written;
+    uint32_t held    = (written < LOG_PM_SIZE) ? written : LOG_PM_SIZE;
+    uint32_t from    = *pos;
+    uint32_t n;
+
+    /* Never read before the first byte since the ring was set up. */
+    if ((written - from) > held)
+        from = written - held;
+    if ((written - end) > (written - from))
+        end = from;
+
+    n = end - from;
+    if (n > size)
+        n = size;
+
+    for (uint32_t i = 0U; i < n; ++i)
+        dst[i] = (char)s_logPm.data[(from + i) & (LOG_PM_SIZE - 1U)];
+
+    *pos = from + n;
+    return n;
+#else
+    (void)pos;
+    (void)end;
+    (void)dst;
+    (void)size;
+    return 0U;
+#endif
+}
+
+uint32_t Log_PmLineStart(uint32_t lines)
+{
+#if (LOG_PM_SIZE > 0U)
+    uint32_t end    = s_logPm.written;
+    uint32_t oldest = end - ((end < LOG_PM_SIZE) ? end : LOG_PM_SIZE);
+    uint32_t pos    = end;
+
+    if (lines == 0U)
+        return end;
+
+    /* The newline ending the newest line does not count. */
+    if ((pos != oldest) && (s_logPm.data[(pos - 1U) & (LOG_PM_SIZE - 1U)] == (uint8_t)'\n'))
+        pos--;
+
+    while (pos != oldest)
+    {
+        if (s_logPm.data[(pos - 1U) & (LOG_PM_SIZE - 1U)] == (uint8_t)'\n')
+        {
+            if (--lines == 0U)
+                break;
+        }
+        pos--;
+    }
+    return pos;
+#else
+    (void)lines;
+    return 0U;
+#endif
+}
+
+/**
+ * @brief End of the committed records queued in @p ring from its tail; a
+ *        damaged ring ends the walk.
+ *
+ * @param[out] bytes Payload bytes up to the returned index.
+ */
+static uint32_t log_ring_committed(const Log_Ring_t *ring, uint32_t *bytes)
+{
+    uint32_t head = ring->head;
+    uint32_t tail;
+
+    *bytes = 0U;
+    for (tail = ring->tail; (tail != head) && ((head - tail) <= ring->size); )
+    {
+        uint32_t hdr = *log_hdr_at(ring, tail);
+        uint32_t len = hdr & LOG_REC_LEN_MASK;
+
+        if (((hdr & LOG_REC_COMMITTED) == 0U) || (len > ring->size) ||
+            (((hdr & LOG_REC_PAD) != 0U) && (len == 0U)))
+        {
+            break;
+        }
+        if ((hdr & LOG_REC_PAD) == 0U)
+        {
+            if ((hdr & LOG_REC_REQ) == 0U)
+                *bytes += len;
+            len = LOG_REC_HDR_SIZE + LOG_ALIGN4(len);
+        }
+        tail += len;
+    }
+    return tail;
+}
+
+/** Append the records of @p ring from its tail up to @p end. */
+static uint32_t log_ring_copy(const Log_Ring_t *ring, uint32_t end, char *dst, uint32_t pos,
+                              uint32_t *skip)
+{
+    for (uint32_t tail = ring->tail; tail != end; )
+    {
+        uint32_t hdr = *log_hdr_at(ring, tail);
+        uint32_t len = hdr & LOG_REC_LEN_MASK;
+
+        if ((hdr & LOG_REC_PAD) == 0U)
+        {
+            if ((hdr & LOG_REC_REQ) == 0U)
+                pos = log_copy_part(dst, pos,
+                                    &ring->buf[(tail + LOG_REC_HDR_SIZE) & (ring->size - 1U)],
+                                    len, skip);
+            len = LOG_REC_HDR_SIZE + LOG_ALIGN4(len);
+        }
+        tail += len;
+    }
+    return pos;
+}
+
+uint32_t Log_PmTail(char *dst, uint32_t size)
+{
+    uint32_t end = Log_PmWritten();
+    uint32_t pos = end - size;
+
+    return Log_ReadPm(&pos, end, dst, size);
+}
+
+uint32_t Log_CopyRecent(char *dst, uint32_t size)
+{
+    /* Text streams only: log lines, then CLI output. */
+    static const uint8_t streams[] = { (uint8_t)LOG_STREAM_LINES, (uint8_t)LOG_STREAM_CLI };
+
+    uint32_t txLen = (s_logTxLen <= LOG_TX_CHUNK_SIZE) ? s_logTxLen : 0U;
+    uint32_t end[sizeof(streams)];
+    uint32_t total = txLen;
+
+    for (uint32_t i = 0U; i < sizeof(streams); ++i)
+    {
+        uint32_t bytes;
+        end[i] = log_ring_committed(&s_logRings[streams[i]], &bytes);
+        total += bytes;
+    }
+
+    /* Newest bytes last: drop the oldest that do not fit. */
+    uint32_t skip = (total > size) ? (total - size) : 0U;
+    uint32_t pos  = log_copy_part(dst, 0U, s_logTxBuf, txLen, &skip);
+
+    for (uint32_t i = 0U; i < sizeof(streams); ++i)
+        pos = log_ring_copy(&s_logRings[streams[i]], end[i], dst, pos, &skip);
+
+    return pos;
+}
+
+void Log_GetStreamStats(Log_Stream_t stream, Log_Stats_t *stats)
+{
+    if ((stats == NULL) || ((uint32_t)stream >= (uint32_t)LOG_STREAM_COUNT))
+        return;
+
+    const Log_Ring_t *ring = &s_logRings[stream];
+
+    stats->ringSize     = ring->size;
+    stats->fill         = ring->head - ring->tail;
+    stats->peakFill     = ring->peak;
+    stats->droppedLines = ring->dropped;
+    stats->itmDropped   = s_logItmDropped;
+}
+
+void Log_GetStats(Log_Stats_t *stats)
+{
+    Log_GetStreamStats(LOG_STREAM_LINES, stats);
+}
+
+/* -------------------------------------------------------------------------- */
+/* HAL callback override (ISR context)                                        */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief UART TX complete: wake LogTask for the next chunk.
+ */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+    if ((huart == s_logUart) && (s_logThread != NULL))
+    {
+        (void)osThreadFlagsSet(s_logThread, LOG_FLAG_TX_DONE);
+    }
+}
+
+#if USB_CDC_ENABLE
+/**
+ * @brief USB IN transfer done (or aborted): wake LogTask for the next chunk.
+ */
+void UsbCdc_TxCpltCallback(void)
+{
+    if (s_logThread != NULL)
+    {
+        (void)osThreadFlagsSet(s_logThread, LOG_FLAG_TX_DONE);
+    }
 }
+#endif /* USB_CDC_ENABLE */
@@ -0,0 +1,663 @@
+/**
+ * @file    low_power.c
+ * @brief   RTC-timed tickless idle (vPortSuppressTicksAndSleep).
+ *
+ * RTC clocking from the 32.768 kHz LSE:
+ *   ck_apre = LSE / 4 = 8192 Hz: the sub-second counter (SSR), read with
+ *             the shadow registers bypassed; with the seconds and minutes
+ *             of TR it gives the time slept to 122 us.
+ *   wakeup  = LSE / 2 = 16384 Hz: the wakeup timer that ends a sleep.
+ *
+ * The kernel tick is 1 ms. The part of a tick that had passed when SysTick
+ * was stopped is added to the time slept; whole ticks are stepped, and
+ * SysTick restarts with only the rest of the current tick, so the kernel
+ * does not drift against the RTC across sleeps.
+ *
+ * Stop mode (LowPower_SetStop()): the same tickless sleep, with SLEEPDEEP
+ * and the regulator in low-power mode. The RTC keeps counting, so the
+ * time slept is measured the same way. Stop ends with the core on the
+ * HSI; the PLL and the over-drive are brought back before PRIMASK clears,
+ * so no interrupt handler runs on the wrong clock.
+ *
+ * Wake-up figures: the DWT cycle counter runs again from the first
+ * instruction after the WFI, on the HSI, so the cycles to the end of the
+ * clock restore over HSI_VALUE give the wake-to-ready time; EXTI->PR still
+ * holds the wake source, its handler has not run. The wake-to-frame time
+ * is taken on the microsecond timebase (time_sync.h), which is back at its
+ * 1 MHz from that point on.
+ */
+
+#include "low_power.h"
+#include "cli_if.h"
+#include "log.h"
+#include "ramfunc.h"
+#include "sys_config.h"
+#include "time_sync.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define LP_APRE_HZ        8192U                        /* sub-second counter */
+#define LP_PREDIV_A       ((LSE_VALUE / LP_APRE_HZ) - 1U)
+#define LP_PREDIV_S       (LP_APRE_HZ - 1U)
+#define LP_WUT_HZ         (LSE_VALUE / 2U)             /* WUCKSEL = RTC/2 */
+#define LP_WRAP           (3600U * LP_APRE_HZ)         /* TR minutes roll over */
+#define LP_EXTI_WAKEUP    EXTI_IMR_MR22
+#define LP_EXTI_CAN       EXTI_PR_PR11                 /* PA11 = CAN1_RX, can_nm.c */
+#define LP_EXTI_B1        EXTI_PR_PR13                 /* PC13 = B1, pedal.c */
+#define LP_HSI_MHZ        (HSI_VALUE / 1000000U)       /* core clock after Stop */
+#define LP_INIT_TIMEOUT   10U                          /* ms, a few RTCCLK */
+#define LP_CLOCK_SPINS    100000U                      /* > 1 ms at 16 MHz */
+
+/** Time in 1/(LP_APRE_HZ * 1000) s: one kernel tick is LP_APRE_HZ of it. */
+#define LP_TICK_UNITS     LP_APRE_HZ
+
+_Static_assert(LSE_VALUE == 32768U, "RTC prescalers assume a 32.768 kHz LSE");
+_Static_assert(configTICK_RATE_HZ == 1000U, "HAL tick is stepped 1:1 with the kernel tick");
+_Static_assert(((uint64_t)LOW_POWER_MAX_SLEEP_MS * LP_WUT_HZ) / 1000U <= 0x10000U,
+               "LOW_POWER_MAX_SLEEP_MS exceeds the wakeup counter");
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static volatile uint8_t s_ready = 0U;
+static volatile uint8_t s_stop  = 0U;   /* LowPower_SetStop() */
+
+static TimerHandle_t s_lseTimer = NULL;
+static StaticTimer_t s_lseTimerCb;
+static uint32_t      s_lseWaitMs = 0U;
+
+/* RCC sleep enables outside a sleep (restored by LowPower_PostSleep). */
+static uint32_t s_ahb1Lp;
+static uint32_t s_ahb2Lp;
+static uint32_t s_ahb3Lp;
+static uint32_t s_apb1Lp;
+static uint32_t s_apb2Lp;
+
+/* Written by the idle task with interrupts off. */
+static uint32_t   s_sleeps;
+static uint32_t   s_earlyWakes;
+static uint32_t   s_aborted;
+static uint32_t   s_stops;
+static uint32_t   s_stopVetoes;
+static uint32_t   s_clockErrors;     /* PLL / over-drive not back after Stop */
+static uint64_t   s_sleepUnits;      /* 1/LP_APRE_HZ s, Sleep mode */
+static uint64_t   s_stopUnits;       /* and Stop mode */
+static uint32_t   s_longestUnits;
+static TickType_t s_windowStart;
+
+/* Stop wake-ups, written by the idle task and LowPower_OnCanRx() with
+   interrupts off. */
+static uint32_t          s_wakeCan;
+static uint32_t          s_wakeButton;
+static uint32_t          s_wakeRtc;
+static uint32_t          s_wakeOther;
+static uint32_t          s_readyUs;
+static uint32_t          s_readyMaxUs;
+static volatile uint8_t  s_framePending;    /* CAN wake-up, no frame yet */
+static uint64_t          s_frameWakeUs;     /* local time of that wake-up */
+static uint32_t          s_frames;
+static uint32_t          s_frameUs;
+static uint32_t          s_frameMaxUs;
+static uint32_t          s_frameLate;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static void lp_rtc_unlock(void)
+{
+    RTC->WPR = 0xCAU;
+    RTC->WPR = 0x53U;
+}
+
+static void lp_rtc_lock(void)
+{
+    RTC->WPR = 0xFFU;
+}
+
+/** Clear WUTF without touching INIT (rc_w0 flags). */
+static void lp_rtc_clear_wutf(void)
+{
+    RTC->ISR = (~(RTC_ISR_WUTF | RTC_ISR_INIT)) | (RTC->ISR & RTC_ISR_INIT);
+}
+
+static HAL_StatusTypeDef lp_rtc_wait(uint32_t flag)
+{
+    uint32_t start = HAL_GetTick();
+
+    while ((RTC->ISR & flag) == 0U)
+    {
+        if ((HAL_GetTick() - start) > LP_INIT_TIMEOUT)
+            return HAL_TIMEOUT;
+    }
+    return HAL_OK;
+}
+
+/** RTC on the LSE: prescalers, direct reads, wakeup clock and its EXTI line. */
+static HAL_StatusTypeDef lp_rtc_start(void)
+{
+    HAL_StatusTypeDef status;
+
+    __HAL_RCC_RTC_CONFIG(RCC_RTCCLKSOURCE_LSE);
+    __HAL_RCC_RTC_ENABLE();
+
+    lp_rtc_unlock();
+    RTC->ISR = RTC_ISR_INIT | ~RTC_ISR_WUTF;
+    status = lp_rtc_wait(RTC_ISR_INITF);
+    if (status == HAL_OK)
+    {
+        RTC->PRER  = LP_PREDIV_S;
+        RTC->PRER |= LP_PREDIV_A << RTC_PRER_PREDIV_A_Pos;
+        RTC->CR   &= ~(RTC_CR_FMT | RTC_CR_WUTE | RTC_CR_WUTIE);
+        RTC->CR   |= RTC_CR_BYPSHAD;
+        status = lp_rtc_wait(RTC_ISR_WUTWF);
+    }
+    if (status == HAL_OK)
+        RTC->CR = (RTC->CR & ~RTC_CR_WUCKSEL) | (RTC_CR_WUCKSEL_1 | RTC_CR_WUCKSEL_0);
+    RTC->ISR &= ~RTC_ISR_INIT;
+    lp_rtc_lock();
+
+    if (status != HAL_OK)
+        return status;
+
+    EXTI->IMR  |= LP_EXTI_WAKEUP;
+    EXTI->RTSR |= LP_EXTI_WAKEUP;
+    HAL_NVIC_SetPriority(RTC_WKUP_IRQn, SYS_IRQ_PRIO_RtcWakeup, 0U);
+    HAL_NVIC_EnableIRQ(RTC_WKUP_IRQn);
+
+    s_ready = 1U;
+    return HAL_OK;
+}
+
+/** RTC time in 1/LP_APRE_HZ s, modulo LP_WRAP. */
+static uint32_t lp_rtc_now(void)
+{
+    uint32_t ssr;
+    uint32_t tr;
+
+    /* With BYPSHAD, TR only changes together with an SSR reload. */
+    do
+    {
+        ssr = RTC->SSR;
+        tr  = RTC->TR;
+    } while (ssr != RTC->SSR);
+
+    uint32_t sec = (((tr & RTC_TR_MNT) >> RTC_TR_MNT_Pos) * 10U +
+                    ((tr & RTC_TR_MNU) >> RTC_TR_MNU_Pos)) * 60U +
+                   ((tr & RTC_TR_ST) >> RTC_TR_ST_Pos) * 10U +
+                   ((tr & RTC_TR_SU) >> RTC_TR_SU_Pos);
+
+    return (sec * LP_APRE_HZ) + (LP_PREDIV_S - (ssr & RTC_SSR_SS));
+}
+
+static void lp_wakeup_start(uint32_t ms)
+{
+    uint32_t wut = (ms * LP_WUT_HZ) / 1000U;
+
+    lp_rtc_unlock();
+    RTC->WUTR = (wut > 1U) ? (wut - 1U) : 0U;
+    lp_rtc_clear_wutf();
+    RTC->CR |= RTC_CR_WUTE | RTC_CR_WUTIE;
+    lp_rtc_lock();
+}
+
+/** Stop the wakeup timer; 1 if it ended the sleep. */
+static uint8_t lp_wakeup_stop(void)
+{
+    uint8_t fired;
+
+    lp_rtc_unlock();
+    RTC->CR &= ~(RTC_CR_WUTE | RTC_CR_WUTIE);
+    fired = ((RTC->ISR & RTC_ISR_WUTF) != 0U) ? 1U : 0U;
+    lp_rtc_clear_wutf();
+    lp_rtc_lock();
+
+    EXTI->PR = LP_EXTI_WAKEUP;
+    NVIC_ClearPendingIRQ(RTC_WKUP_IRQn);
+    return fired;
+}
+
+/** Timer service: wait for the LSE after a power loss. */
+static void lp_lse_poll(TimerHandle_t timer)
+{
+    if (__HAL_RCC_GET_FLAG(RCC_FLAG_LSERDY) != 0U)
+    {
+        (void)xTimerStop(timer, 0U);
+        if (lp_rtc_start() == HAL_OK)
+            LOG_INFO(MAIN, "LSE running after %lu ms, tickless idle on",
+                     (unsigned long)s_lseWaitMs);
+        else
+            LOG_ERROR(MAIN, "RTC init failed, tickless idle off");
+        return;
+    }
+
+    s_lseWaitMs += LOW_POWER_LSE_POLL_MS;
+    if (s_lseWaitMs >= LOW_POWER_LSE_TIMEOUT_MS)
+    {
+        (void)xTimerStop(timer, 0U);
+        LOG_WARN(MAIN, "LSE did not start, tickless idle off");
+    }
+}
+
+/** Spin (interrupts off, no tick) until @p flag is set in @p reg. */
+static uint8_t lp_spin(const volatile uint32_t *reg, uint32_t flag)
+{
+    for (uint32_t n = 0U; n < LP_CLOCK_SPINS; ++n)
+    {
+        if ((*reg & flag) != 0U)
+            return 1U;
+    }
+    return 0U;
+}
+
+/**
+ * After Stop the core runs on the HSI with the PLL off; @p cfgr and
+ * @p overDrive are the state before it. PLLCFGR, VOS, the prescalers and
+ * the flash wait states survive Stop, so this is the PLL, the over-drive
+ * and SW, in the order ClockCfg_Apply() uses. The HSI profile has nothing
+ * to restore.
+ */
+static void lp_clock_restore(uint32_t cfgr, uint8_t overDrive)
+{
+    if ((cfgr & RCC_CFGR_SWS) != RCC_CFGR_SWS_PLL)
+        return;
+
+    RCC->CR |= RCC_CR_PLLON;
+    uint8_t ok = lp_spin(&RCC->CR, RCC_CR_PLLRDY);
+
+    if ((ok != 0U) && (overDrive != 0U))
+    {
+        PWR->CR |= PWR_CR_ODEN;
+        ok = lp_spin(&PWR->CSR, PWR_CSR_ODRDY);
+        if (ok != 0U)
+        {
+            PWR->CR |= PWR_CR_ODSWEN;
+            ok = lp_spin(&PWR->CSR, PWR_CSR_ODSWRDY);
+        }
+    }
+
+    if (ok != 0U)
+    {
+        RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | RCC_CFGR_SW_PLL;
+        for (uint32_t n = 0U; (n < LP_CLOCK_SPINS) &&
+             ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_PLL); ++n)
+        {
+        }
+        ok = ((RCC->CFGR & RCC_CFGR_SWS) == RCC_CFGR_SWS_PLL) ? 1U : 0U;
+    }
+
+    if (ok == 0U)
+        s_clockErrors++;
+}
+
+/**
+ * Interrupts off, clocks back after Stop: @p pending is EXTI->PR right
+ * after the WFI, @p cycles the HSI cycles since.
+ */
+static void lp_stop_woken(uint32_t pending, uint32_t cycles)
+{
+    uint32_t us = cycles / LP_HSI_MHZ;
+
+    s_readyUs = us;
+    if (us > s_readyMaxUs)
+        s_readyMaxUs = us;
+
+    if ((pending & LP_EXTI_CAN) != 0U)
+    {
+        s_wakeCan++;
+        s_frameWakeUs  = TimeSync_LocalUs() - us;
+        s_framePending = 1U;
+    }
+    else if ((pending & LP_EXTI_B1) != 0U)
+        s_wakeButton++;
+    else if ((pending & LP_EXTI_WAKEUP) != 0U)
+        s_wakeRtc++;
+    else
+        s_wakeOther++;
+}
+
+static uint32_t lp_units_to_ms(uint64_t units)
+{
+    return (uint32_t)((units * 1000U) / LP_APRE_HZ);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void lp_cmd_power(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    LowPower_Stats_t st;
+    LowPower_GetStats(&st);
+
+    CLI_IF_Printf("Tickless idle: %s\r\n",
+                  (st.tickless != 0U) ? "RTC wakeup (LSE), sleep mode" : "off, SysTick running");
+    CLI_IF_Printf("Residency: %u.%u %% of %lu ms (%lu ms asleep)\r\n",
+                  (unsigned)(st.residencyPermille / 10U), (unsigned)(st.residencyPermille % 10U),
+                  (unsigned long)st.windowMs, (unsigned long)st.sleptMs);
+    CLI_IF_Printf("Time: run %lu ms, sleep %lu ms, stop %lu ms\r\n",
+                  (unsigned long)st.runMs, (unsigned long)st.sleepMs, (unsigned long)st.stopMs);
+    CLI_IF_Printf("Sleeps: %lu, longest %lu ms, early wakes %lu, aborted %lu\r\n",
+                  (unsigned long)st.sleeps, (unsigned long)st.longestMs,
+                  (unsigned long)st.earlyWakes, (unsigned long)st.aborted);
+    CLI_IF_Printf("Stop mode: %s, %lu entered, %lu held off by UART TX, %lu clock restore errors\r\n",
+                  (st.stopAllowed != 0U) ? "allowed" : "off", (unsigned long)st.stops,
+                  (unsigned long)st.stopVetoes, (unsigned long)st.clockErrors);
+    CLI_IF_Printf("Stop wakes: CAN %lu, B1 %lu, RTC %lu, other %lu\r\n",
+                  (unsigned long)st.wakeCan, (unsigned long)st.wakeButton,
+                  (unsigned long)st.wakeRtc, (unsigned long)st.wakeOther);
+    CLI_IF_Printf("Wake to ready: last %lu us, max %lu us\r\n",
+                  (unsigned long)st.readyUs, (unsigned long)st.readyMaxUs);
+    CLI_IF_Printf("Wake to CAN frame: last %lu us, max %lu us, %lu of %lu over %lu us\r\n",
+                  (unsigned long)st.frameUs, (unsigned long)st.frameMaxUs,
+                  (unsigned long)st.frameLate, (unsigned long)st.frames,
+                  (unsigned long)LOW_POWER_FRAME_TARGET_US);
+}
+
+static void lp_cmd_power_reset(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    LowPower_ResetStats();
+    CLI_IF_Print("Sleep statistics reset\r\n");
+}
+
+static const CliCommand_t s_powerCmds[] =
+{
+    { "power",       "", 0U, lp_cmd_power,       "run/sleep/stop time, Stop wake-ups and latency" },
+    { "power reset", "", 0U, lp_cmd_power_reset, "start a new residency window" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef LowPower_Init(void)
+{
+    __HAL_RCC_PWR_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+
+#ifdef DEBUG
+    /* Keep the debug port alive while the core sleeps or stops. */
+    HAL_DBGMCU_EnableDBGSleepMode();
+    HAL_DBGMCU_EnableDBGStopMode();
+#endif
+
+    CLI_IF_REGISTER_TABLE(s_powerCmds);
+
+    s_windowStart = xTaskGetTickCount();
+
+    /* The RTC clock source can only be changed by a backup-domain reset. */
+    uint32_t source = __HAL_RCC_GET_RTC_SOURCE();
+    if ((source != 0U) && (source != RCC_RTCCLKSOURCE_LSE))
+    {
+        __HAL_RCC_BACKUPRESET_FORCE();
+        __HAL_RCC_BACKUPRESET_RELEASE();
+    }
+
+    __HAL_RCC_LSE_CONFIG(RCC_LSE_ON);
+    if (__HAL_RCC_GET_FLAG(RCC_FLAG_LSERDY) != 0U)
+        return lp_rtc_start();
+
+    s_lseTimer = xTimerCreateStatic("LowPower", pdMS_TO_TICKS(LOW_POWER_LSE_POLL_MS),
+                                    pdTRUE, NULL, lp_lse_poll, &s_lseTimerCb);
+    if (s_lseTimer == NULL)
+        return HAL_ERROR;
+
+    return (xTimerStart(s_lseTimer, 0U) == pdPASS) ? HAL_OK : HAL_ERROR;
+}
+
+void vPortSuppressTicksAndSleep(TickType_t xExpectedIdleTime)
+{
+    TickType_t idle = xExpectedIdleTime;
+
+    if (idle > pdMS_TO_TICKS(LOW_POWER_MAX_SLEEP_MS))
+        idle = pdMS_TO_TICKS(LOW_POWER_MAX_SLEEP_MS);
+
+    /* PRIMASK, not BASEPRI: every interrupt must still end the WFI. */
+    __disable_irq();
+    __DSB();
+    __ISB();
+
+    if (eTaskConfirmSleepModeStatus() == eAbortSleep)
+    {
+        s_aborted++;
+        __enable_irq();
+        return;
+    }
+
+    /* WUTR is writable (WUTWF) within 2 RTCCLK of the last stop, so this
+       only fails without a running LSE. */
+    if ((s_ready == 0U) || ((RTC->ISR & RTC_ISR_WUTWF) == 0U))
+    {
+        /* No timebase: sleep until the next tick or interrupt. */
+        __DSB();
+        __WFI();
+        __ISB();
+        __enable_irq();
+        return;
+    }
+
+    uint32_t load = SysTick->LOAD;
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+
+    /* Part of the current tick that has already passed. */
+    uint32_t into = (uint32_t)(((uint64_t)(load - SysTick->VAL) * LP_TICK_UNITS) / (load + 1U));
+    uint32_t start = lp_rtc_now();
+
+    lp_wakeup_start((uint32_t)(idle - 1U) * (1000U / configTICK_RATE_HZ));
+
+    /* Stop only on the RTC path: it alone measures a sleep without SysTick. */
+    uint8_t  stop      = s_stop;
+    uint32_t cfgr      = RCC->CFGR;
+    if ((stop != 0U) && ((LOW_POWER_STOP_UART->SR & USART_SR_TC) == 0U))
+    {
+        /* Stop would freeze the UART mid-byte: Sleep this time. */
+        stop = 0U;
+        s_stopVetoes++;
+    }
+    uint8_t  overDrive = ((PWR->CSR & PWR_CSR_ODSWRDY) != 0U) ? 1U : 0U;
+
+    TickType_t modifiable = idle;
+    configPRE_SLEEP_PROCESSING(modifiable);
+    if (modifiable > 0U)
+    {
+        if (stop != 0U)
+        {
+#if LOW_POWER_STOP_LPDS
+            PWR->CR |= PWR_CR_LPDS | PWR_CR_CWUF;
+#else
+            PWR->CR = (PWR->CR & ~PWR_CR_LPDS) | PWR_CR_CWUF;
+#endif
+            SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
+        }
+        __DSB();
+        __WFI();
+        __ISB();
+        if (stop != 0U)
+        {
+            uint32_t woke    = DWT->CYCCNT;
+            uint32_t pending = EXTI->PR;
+            SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+            lp_clock_restore(cfgr, overDrive);
+            lp_stop_woken(pending, DWT->CYCCNT - woke);
+            s_stops++;
+        }
+    }
+    configPOST_SLEEP_PROCESSING(idle);
+
+    uint8_t  byTimer = lp_wakeup_stop();
+    uint32_t slept   = (lp_rtc_now() + LP_WRAP - start) % LP_WRAP;
+
+    uint32_t units = into + (slept * 1000U);
+    uint32_t ticks = units / LP_TICK_UNITS;
+    uint32_t part  = units % LP_TICK_UNITS;
+
+    if (ticks >= idle)
+    {
+        /* The last tick is due: let the SysTick path deliver it at once. */
+        ticks = idle - 1U;
+        part  = 0U;
+        SCB->ICSR = SCB_ICSR_PENDSTSET_Msk;
+    }
+
+    /* Run SysTick for the rest of the current tick, then normal periods. */
+    uint32_t rest = (uint32_t)(((uint64_t)(LP_TICK_UNITS - part) * (load + 1U)) / LP_TICK_UNITS);
+    SysTick->LOAD = (rest > 1U) ? (rest - 1U) : load;
+    SysTick->VAL  = 0U;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+    SysTick->LOAD = load;
+
+    vTaskStepTick(ticks);
+    uwTick += ticks;
+
+    s_sleeps++;
+    s_earlyWakes += (byTimer == 0U) ? 1U : 0U;
+    if ((stop != 0U) && (modifiable > 0U))
+        s_stopUnits += slept;
+    else
+        s_sleepUnits += slept;
+    if (slept > s_longestUnits)
+        s_longestUnits = slept;
+
+    __enable_irq();
+
+    /* The CLI RX DMA may have lost a byte, or its reception, to Stop. */
+    if ((stop != 0U) && (modifiable > 0U))
+        CLI_IF_Resume();
+}
+
+void LowPower_PreSleep(uint32_t *expected)
+{
+    (void)expected;
+
+    s_ahb1Lp = RCC->AHB1LPENR;
+    s_ahb2Lp = RCC->AHB2LPENR;
+    s_ahb3Lp = RCC->AHB3LPENR;
+    s_apb1Lp = RCC->APB1LPENR;
+    s_apb2Lp = RCC->APB2LPENR;
+
+    /* Takes effect with the WFI; the flash interface clock stops too. */
+    RCC->AHB1LPENR = LOW_POWER_SLEEP_AHB1;
+    RCC->AHB2LPENR = 0U;
+    RCC->AHB3LPENR = 0U;
+    RCC->APB1LPENR = LOW_POWER_SLEEP_APB1;
+    RCC->APB2LPENR = LOW_POWER_SLEEP_APB2;
+}
+
+void LowPower_PostSleep(uint32_t expected)
+{
+    (void)expected;
+
+    RCC->AHB1LPENR = s_ahb1Lp;
+    RCC->AHB2LPENR = s_ahb2Lp;
+    RCC->AHB3LPENR = s_ahb3Lp;
+    RCC->APB1LPENR = s_apb1Lp;
+    RCC->APB2LPENR = s_apb2Lp;
+}
+
+void LowPower_WakeupIRQHandler(void)
+{
+    /* Normally already handled by lp_wakeup_stop() before PRIMASK clears. */
+    lp_rtc_unlock();
+    lp_rtc_clear_wutf();
+    lp_rtc_lock();
+    EXTI->PR = LP_EXTI_WAKEUP;
+}
+
+void LowPower_SetStop(uint8_t allow)
+{
+    s_stop = (allow != 0U) ? 1U : 0U;
+}
+
+RAMFUNC void LowPower_OnCanRx(void)
+{
+    if (s_framePending == 0U)
+        return;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s_framePending != 0U)
+    {
+        uint32_t us = (uint32_t)(TimeSync_LocalUs() - s_frameWakeUs);
+        s_framePending = 0U;
+        s_frames++;
+        s_frameUs = us;
+        if (us > s_frameMaxUs)
+            s_frameMaxUs = us;
+        if (us > LOW_POWER_FRAME_TARGET_US)
+            s_frameLate++;
+    }
+    __set_PRIMASK(primask);
+}
+
+void LowPower_GetStats(LowPower_Stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    uint64_t sleep     = s_sleepUnits;
+    uint64_t stop      = s_stopUnits;
+    stats->tickless    = s_ready;
+    stats->stopAllowed = s_stop;
+    stats->stops       = s_stops;
+    stats->stopVetoes  = s_stopVetoes;
+    stats->clockErrors = s_clockErrors;
+    stats->wakeCan     = s_wakeCan;
+    stats->wakeButton  = s_wakeButton;
+    stats->wakeRtc     = s_wakeRtc;
+    stats->wakeOther   = s_wakeOther;
+    stats->readyUs     = s_readyUs;
+    stats->readyMaxUs  = s_readyMaxUs;
+    stats->frames      = s_frames;
+    stats->frameUs     = s_frameUs;
+    stats->frameMaxUs  = s_frameMaxUs;
+    stats->frameLate   = s_frameLate;
+    stats->sleeps      = s_sleeps;
+    stats->earlyWakes  = s_earlyWakes;
+    stats->aborted     = s_aborted;
+    stats->longestMs   = lp_units_to_ms(s_longestUnits);
+    stats->windowMs    = (uint32_t)(xTaskGetTickCount() - s_windowStart);
+    taskEXIT_CRITICAL();
+
+    stats->sleepMs = lp_units_to_ms(sleep);
+    stats->stopMs  = lp_units_to_ms(stop);
+    stats->sleptMs = lp_units_to_ms(sleep + stop);
+    stats->runMs   = (stats->sleptMs < stats->windowMs) ? (stats->windowMs - stats->sleptMs) : 0U;
+    stats->residencyPermille = (stats->windowMs == 0U) ? 0U :
+        (uint16_t)(((uint64_t)((stats->sleptMs < stats->windowMs) ? stats->sleptMs : stats->windowMs)
+                    * 1000U) / stats->windowMs);
+}
+
+void LowPower_ResetStats(void)
+{
+    taskENTER_CRITICAL();
+    s_sleeps       = 0U;
+    s_earlyWakes   = 0U;
+    s_aborted      = 0U;
+    s_stops        = 0U;
+    s_stopVetoes   = 0U;
+    s_sleepUnits   = 0U;
+    s_stopUnits    = 0U;
+    s_longestUnits = 0U;
+    s_wakeCan      = 0U;
+    s_wakeButton   = 0U;
+    s_wakeRtc      = 0U;
+    s_wakeOther    = 0U;
+    s_readyUs      = 0U;
+    s_readyMaxUs   = 0U;
+    s_frames       = 0U;
+    s_frameUs      = 0U;
+    s_frameMaxUs   = 0U;
+    s_frameLate    = 0U;
+    s_windowStart  = xTaskGetTickCount();
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,207 @@
+/**
+ * @file    lut.c
+ * @brief   Lookup table axes, segment search and interpolation kernels.
+ */
+
+#include "lut.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/*
+ * Segment of @p x in bp[0 .. n-1], x already clamped to the axis. Each pass
+ * halves the candidate segments [base, base + len) with one compare; the
+ * select compiles to a conditional move, and the pass count depends on n
+ * only.
+ */
+static uint32_t lut_segment_f32(const float *bp, uint32_t n, float x)
+{
+    const float *base = bp;
+    uint32_t     len  = n - 1U;
+
+    while (len > 1U)
+    {
+        uint32_t half = len / 2U;
+
+        base = (x >= base[half]) ? &base[half] : base;
+        len -= half;
+    }
+
+    return (uint32_t)(base - bp);
+}
+
+static uint32_t lut_segment_q15(const int16_t *bp, uint32_t n, int16_t x)
+{
+    const int16_t *base = bp;
+    uint32_t       len  = n - 1U;
+
+    while (len > 1U)
+    {
+        uint32_t half = len / 2U;
+
+        base = (x >= base[half]) ? &base[half] : base;
+        len -= half;
+    }
+
+    return (uint32_t)(base - bp);
+}
+
+static int16_t lut_lerp_q15(int16_t y0, int16_t y1, uint32_t f)
+{
+    /* |y1 - y0| * 32768 < 2^31: the product cannot overflow. */
+    return (int16_t)(y0 + ((((int32_t)y1 - (int32_t)y0) * (int32_t)f) >> 15));
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef Lut_AxisInitF32(Lut_AxisF32_t *a, const float *bp, float *inv, uint32_t n)
+{
+    a->bp  = bp;
+    a->inv = inv;
+    a->n   = 0U;
+
+    if (n < 2U)
+        return HAL_ERROR;
+
+    for (uint32_t i = 0U; i < (n - 1U); ++i)
+    {
+        if (!(bp[i + 1U] > bp[i]))
+            return HAL_ERROR;
+        inv[i] = 1.0f / (bp[i + 1U] - bp[i]);
+    }
+
+    a->n = n;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef Lut_AxisInitQ15(Lut_AxisQ15_t *a, const int16_t *bp, uint32_t *inv, uint32_t n)
+{
+    a->bp  = bp;
+    a->inv = inv;
+    a->n   = 0U;
+
+    if (n < 2U)
+        return HAL_ERROR;
+
+    for (uint32_t i = 0U; i < (n - 1U); ++i)
+    {
+        if (bp[i + 1U] <= bp[i])
+            return HAL_ERROR;
+        inv[i] = 0x80000000UL / (uint32_t)((int32_t)bp[i + 1U] - (int32_t)bp[i]);
+    }
+
+    a->n = n;
+    return HAL_OK;
+}
+
+void Lut_LocateF32(const Lut_AxisF32_t *a, float x, Lut_PosF32_t *pos)
+{
+    const float *bp = a->bp;
+    float        lo = bp[0];
+    float        hi = bp[a->n - 1U];
+
+    x = (x < lo) ? lo : x;
+    x = (x > hi) ? hi : x;
+
+    uint32_t i = lut_segment_f32(bp, a->n, x);
+    pos->i = i;
+    pos->f = (x - bp[i]) * a->inv[i];
+}
+
+void Lut_LocateQ15(const Lut_AxisQ15_t *a, int16_t x, Lut_PosQ15_t *pos)
+{
+    const int16_t *bp = a->bp;
+    int16_t        lo = bp[0];
+    int16_t        hi = bp[a->n - 1U];
+
+    x = (x < lo) ? lo : x;
+    x = (x > hi) ? hi : x;
+
+    uint32_t i = lut_segment_q15(bp, a->n, x);
+    uint32_t d = (uint32_t)((int32_t)x - (int32_t)bp[i]);
+
+    /* d * 2^31 / spacing, shifted to Q15: 32768 at the segment end. */
+    pos->i = i;
+    pos->f = (uint32_t)(((uint64_t)d * a->inv[i]) >> 16);
+    pos->f = (pos->f > LUT_Q15_ONE) ? LUT_Q15_ONE : pos->f;
+}
+
+float Lut_Interp1AtF32(const float *y, const Lut_PosF32_t *pos)
+{
+    const float *p = &y[pos->i];
+
+    return p[0] + ((p[1] - p[0]) * pos->f);
+}
+
+int16_t Lut_Interp1AtQ15(const int16_t *y, const Lut_PosQ15_t *pos)
+{
+    const int16_t *p = &y[pos->i];
+
+    return lut_lerp_q15(p[0], p[1], pos->f);
+}
+
+float Lut_Interp2AtF32(const float *z, uint32_t nx, const Lut_PosF32_t *px,
+                       const Lut_PosF32_t *py)
+{
+    const float *r0 = &z[(py->i * nx) + px->i];
+    const float *r1 = &r0[nx];
+
+    float a = r0[0] + ((r0[1] - r0[0]) * px->f);
+    float b = r1[0] + ((r1[1] - r1[0]) * px->f);
+
+    return a + ((b - a) * py->f);
+}
+
+int16_t Lut_Interp2AtQ15(const int16_t *z, uint32_t nx, const Lut_PosQ15_t *px,
+                         const Lut_PosQ15_t *py)
+{
+    const int16_t *r0 = &z[(py->i * nx) + px->i];
+    const int16_t *r1 = &r0[nx];
+
+    /* Both row results lie between table values, so they stay int16. */
+    int16_t a = lut_lerp_q15(r0[0], r0[1], px->f);
+    int16_t b = lut_lerp_q15(r1[0], r1[1], px->f);
+
+    return lut_lerp_q15(a, b, py->f);
+}
+
+float Lut_Interp1F32(const Lut_AxisF32_t *a, const float *y, float x)
+{
+    Lut_PosF32_t pos;
+
+    Lut_LocateF32(a, x, &pos);
+    return Lut_Interp1AtF32(y, &pos);
+}
+
+int16_t Lut_Interp1Q15(const Lut_AxisQ15_t *a, const int16_t *y, int16_t x)
+{
+    Lut_PosQ15_t pos;
+
+    Lut_LocateQ15(a, x, &pos);
+    return Lut_Interp1AtQ15(y, &pos);
+}
+
+float Lut_Interp2F32(const Lut_AxisF32_t *ax, const Lut_AxisF32_t *ay, const float *z,
+                     float x, float y)
+{
+    Lut_PosF32_t px;
+    Lut_PosF32_t py;
+
+    Lut_LocateF32(ax, x, &px);
+    Lut_LocateF32(ay, y, &py);
+    return Lut_Interp2AtF32(z, ax->n, &px, &py);
+}
+
+int16_t Lut_Interp2Q15(const Lut_AxisQ15_t *ax, const Lut_AxisQ15_t *ay, const int16_t *z,
+                       int16_t x, int16_t y)
+{
+    Lut_PosQ15_t px;
+    Lut_PosQ15_t py;
+
+    Lut_LocateQ15(ax, x, &px);
+    Lut_LocateQ15(ay, y, &py);
+    return Lut_Interp2AtQ15(z, ax->n, &px, &py);
+}
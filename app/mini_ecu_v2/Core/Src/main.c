@@ -24,8 +24,85 @@
 /* USER CODE BEGIN Includes */
 #include "vehicle.h"
 #include "can_if.h"
+#include "can_alarm.h"
+#include "can_busoff.h"
+#include "can_rxlimit.h"
+#include "can_sched.h"
+#include "can_sigcache.h"
+#include "can_stats.h"
+#include "can_bench.h"
+#include "can_log.h"
+#include "can_replay.h"
+#include "irq_bench.h"
+#include "micro_bench.h"
 #include "cli_if.h"
 #include "log.h"
+#include "clock_cfg.h"
+#include "vehicle_fleet.h"
+#include "vehicle_shared.h"
+#include "msg_bus.h"
+#include "mem_pool.h"
+#include "rtos_fpu.h"
+#include "rtos_stats.h"
+#include "rtos_trace.h"
+#include "rtos_stack.h"
+#include "perf.h"
+#include "metrics.h"
+#include "flash_scrub.h"
+#include "boot_request.h"
+#include "uds.h"
+#include "xcp.h"
+#include "tlm_stream.h"
+#include "uart_baud.h"
+#include "clock_gov.h"
+#include "usb_cdc.h"
+#include "qspi_flash.h"
+#include "ext_log.h"
+#include "sig_hist.h"
+#include "isotp.h"
+#include "j1939.h"
+#include "boot_handoff.h"
+#include "crash_dump.h"
+#include "watchdog.h"
+#include "low_power.h"
+#include "platform_dma.h"
+#include "ramfunc.h"
+#include "startup.h"
+#include "boot_prof.h"
+#include "sram_layout.h"
+#include "vsensor.h"
+#include "speed_est.h"
+#include "wheel_pulse.h"
+#include "crank.h"
+#include "angle_sched.h"
+#include "ctrl_loop.h"
+#include "raster.h"
+#include "pedal.h"
+#include "fan_ctrl.h"
+#include "cruise.h"
+#include "scenario.h"
+#include "fault_inj.h"
+#include "sim_clock.h"
+#include "dtc.h"
+#include "freeze_frame.h"
+#include "cal.h"
+#include "powertrain.h"
+#include "trip.h"
+#include "load_coll.h"
+#include "perf_life.h"
+#include "dma_copy.h"
+#include "audit.h"
+#include "watch.h"
+#include "pc_prof.h"
+#include "can_secoc.h"
+#include "can_nm.h"
+#include "time_sync.h"
+#include "nvm_log.h"
+#include "stage.h"
+#include "coop.h"
+#include "timer_wheel.h"
+#include "fw_proxy.h"
+#include "sys_config.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -45,6 +122,13 @@
  *   v2.1 - CAN_IF abstraction, RX queue, CLI-controlled logging.
  *   v2.2 - VehicleState model + CLI control + CAN telemetry integration.
  */
+
+/* Notification bits CanRxTask waits on, one per event source */
+#define CANRX_EVENTS       (CAN_IF_RX_FLAG | ISOTP_RX_FLAG)
+
+#if (DEFAULT_TASK_MODE == 1) && RTOS_STATIC_ALLOC
+#error "DEFAULT_TASK_MODE 1 creates the generated defaultTask from the heap"
+#endif
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -54,57 +138,94 @@
 
 /* Private variables ---------------------------------------------------------*/
 CAN_HandleTypeDef hcan1;
+CAN_HandleTypeDef hcan2;
 
 UART_HandleTypeDef huart2;
+DMA_HandleTypeDef hdma_usart2_rx;
+DMA_HandleTypeDef hdma_usart2_tx;
 
-/* Definitions for defaultTask (kept for CubeMX compatibility, currently unused) */
+/* Definitions for defaultTask (kept for CubeMX compatibility, DEFAULT_TASK_MODE 1 only) */
+#if DEFAULT_TASK_MODE == 1
 osThreadId_t defaultTaskHandle;
 const osThreadAttr_t defaultTask_attributes = {
   .name = "defaultTask",
   .stack_size = 128 * 4,
   .priority = (osPriority_t) osPriorityNormal,
 };
+#endif
 /* USER CODE BEGIN PV */
 
-/* Global vehicle state shared between tasks */
-VehicleState_t g_vehicle;
-
-/* RTOS task handles */
-static osThreadId_t vehicleTaskHandle;
-static osThreadId_t cliTaskHandle;
-static osThreadId_t canRxTaskHandle;
-
-/* RTOS task attributes */
-static const osThreadAttr_t canRxTask_attributes = {
-  .name       = "CanRxTask",
-  .priority   = osPriorityBelowNormal,
-  .stack_size = 256 * 4
-};
-
-static const osThreadAttr_t vehicleTask_attributes = {
-  .name       = "VehicleTask",
-  .priority   = osPriorityNormal,
-  .stack_size = 256 * 4
+/* Vehicle state, owned by VehicleTask. Other tasks read the published
+ * snapshot and post commands (vehicle_shared.h). */
+static VehicleState_t g_vehicle;
+
+#if WATCH_ENABLE
+/* Its fields as "watch set" targets (watch.h). */
+static const Watch_Target_t s_watchTargets[] = {
+  { "veh.speed",    &g_vehicle.speed_kph,      (uint8_t)sizeof(g_vehicle.speed_kph)      },
+  { "veh.rpm",      &g_vehicle.engine_rpm,     (uint8_t)sizeof(g_vehicle.engine_rpm)     },
+  { "veh.coolant",  &g_vehicle.coolant_temp_c, (uint8_t)sizeof(g_vehicle.coolant_temp_c) },
+  { "veh.throttle", &g_vehicle.throttle,       (uint8_t)sizeof(g_vehicle.throttle)       },
+  { "veh.gear",     &g_vehicle.gear,           (uint8_t)sizeof(g_vehicle.gear)           },
 };
+#endif
+
+#if VEHICLE_FLEET_SIZE > 0U
+/* Extra simulated vehicles for HIL load tests (see vehicle_fleet.h). */
+static VehicleFleet_t s_fleet;
+#endif
+
+/* RTOS task memory of the SYS_BOOT and SYS_DEFERRED tasks of
+ * SYS_TASK_TABLE (sys_config.h): control blocks and stacks are supplied
+ * statically so task creation never touches the FreeRTOS heap (see
+ * RTOS_STATIC_ALLOC). The kernel fills each stack at task creation, so the
+ * startup code does not zero them (NOCLEAR). */
+#define MAIN_TASK_DEF_(task, prio, words, periodUs, created)        MAIN_TASK_DEF_##created(task, prio, words)
+#define MAIN_TASK_DEF_SYS_BOOT(task, prio, words)                   MAIN_TASK_OBJ_(task, prio, words)
+#define MAIN_TASK_DEF_SYS_DEFERRED(task, prio, words)               MAIN_TASK_OBJ_(task, prio, words)
+#define MAIN_TASK_DEF_SYS_MODULE(task, prio, words)
+#define MAIN_TASK_OBJ_(task, prio, words)                           \
+  static void task(void *argument);                                 \
+  static StaticTask_t task##_cb;                                    \
+  NOCLEAR static StackType_t task##_stack[words];                   \
+  static const osThreadAttr_t task##_attributes = {                 \
+    .name       = #task,                                            \
+    .priority   = (osPriority_t)(prio),                             \
+    .cb_mem     = &task##_cb,                                       \
+    .cb_size    = sizeof(task##_cb),                                \
+    .stack_mem  = task##_stack,                                     \
+    .stack_size = sizeof(task##_stack)                              \
+  };
+
+/* Creation of the tasks of one stage, in table order */
+#define MAIN_TASK_NEW_(task, prio, words, periodUs, created)        MAIN_TASK_NEW_##created(task)
+#define MAIN_TASK_NEW_SYS_BOOT(task)                                MAIN_TASK_START_(task)
+#define MAIN_TASK_NEW_SYS_DEFERRED(task)
+#define MAIN_TASK_NEW_SYS_MODULE(task)
+#define MAIN_TASK_LATE_(task, prio, words, periodUs, created)       MAIN_TASK_LATE_##created(task)
+#define MAIN_TASK_LATE_SYS_BOOT(task)
+#define MAIN_TASK_LATE_SYS_DEFERRED(task)                           MAIN_TASK_START_(task)
+#define MAIN_TASK_LATE_SYS_MODULE(task)
+#define MAIN_TASK_START_(task)                                      \
+  if (osThreadNew(task, NULL, &task##_attributes) == NULL)          \
+  {                                                                 \
+    LOG_ERROR(MAIN, #task " not created");                          \
+  }
 
-static const osThreadAttr_t cliTask_attributes = {
-  .name       = "CliTask",
-  .priority   = osPriorityAboveNormal,
-  .stack_size = 256 * 4
-};
+SYS_TASK_TABLE(MAIN_TASK_DEF_)
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
+static void MX_DMA_Init(void);
 static void MX_CAN1_Init(void);
+static void MX_CAN2_Init(void);
 static void MX_USART2_UART_Init(void);
 void StartDefaultTask(void *argument);
 
 /* USER CODE BEGIN PFP */
-static void VehicleTask(void *argument);
-static void CliTask(void *argument);
-static void CanRxTask(void *argument);
+static void DeferredInit(void);
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
@@ -119,6 +240,10 @@ int main(void)
 {
 
   /* USER CODE BEGIN 1 */
+  /* Vector table to SRAM before SysTick starts (ramfunc.h) */
+  RamFunc_Init();
+  /* DMA section uncached, then the caches on, before any DMA (platform_dma.h) */
+  PlatformDma_Init();
   /* USER CODE END 1 */
 
   /* MCU Configuration--------------------------------------------------------*/
@@ -127,58 +252,357 @@ int main(void)
   HAL_Init();
 
   /* USER CODE BEGIN Init */
+  BootProf_Mark(BOOT_PROF_HAL);
   /* USER CODE END Init */
 
   /* Configure the system clock */
   SystemClock_Config();
 
   /* USER CODE BEGIN SysInit */
+  BootProf_Mark(BOOT_PROF_CLOCK);
   /* USER CODE END SysInit */
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  BootProf_Mark(BOOT_PROF_MX_GPIO);
+  MX_DMA_Init();
+  BootProf_Mark(BOOT_PROF_MX_DMA);
   MX_CAN1_Init();
+#if CAN_IF_NUM_BUSES > 1U
+  MX_CAN2_Init();
+#endif
+  BootProf_Mark(BOOT_PROF_MX_CAN);
   MX_USART2_UART_Init();
+  BootProf_Mark(BOOT_PROF_MX_UART);
   /* USER CODE BEGIN 2 */
 
+  /* Interrupt priorities of SYS_IRQ_TABLE over the generated defaults */
+  SysConfig_ApplyIrqs();
+
   /* Initialize logging on USART2 */
   Log_Init(&huart2);
-  Log_SetLevel(LOG_LEVEL_INFO);
+  BootProf_Mark(BOOT_PROF_LOG);
+
+  /* Only what the first telemetry frame and the control loop need runs
+     here; the console, the reports and the tools come up in CliTask once
+     the scheduler runs (DeferredInit()). Calibration stays here: the CAN
+     periods and the model read it. */
+
+  /* Trouble codes, freeze frames, calibration, trip counters, SecOC
+     freshness values, load collectives and lifetime performance counters
+     from the flash log in sectors 2..3, restored before anything reads
+     them */
+  Dtc_Init();
+  FreezeFrame_Init();
+  Cal_Init();
+  Trip_Init();
+  CanSecOC_Init();
+  LoadColl_Init();
+  PerfLife_Init();
+  NvmLog_Init();
+  Log_SetLevel((log_level_t)CAL_U(LOG_LEVEL));
+
+  /* Fault handlers with their own status; report a crash of the last run */
+  CrashDump_Init();
+
+  /* Topics between tasks and interrupts ("bus") */
+  MsgBus_Init();
+
+  /* Initialize vehicle model (gearbox and torque map axes first) and
+     publish the start state */
+  Powertrain_Init();
+  Vehicle_Init(&g_vehicle);
+  Vehicle_Publish(&g_vehicle);
 
-  LOG_INFO("MAIN", "Mini ECU – CAN + RTOS Telemetry Node starting...");
+  /* Hot-path cycle probes ("perf dump"); starts the DWT cycle counter */
+  Perf_Init();
 
-  /* Initialize vehicle model */
-  Vehicle_Init(&g_vehicle);
+  /* Counters, gauges and histograms of METRICS_TABLE ("metrics") */
+  Metrics_Init();
+
+#if FLASH_SCRUB_ENABLE
+  /* Image and calibration CRCs again in idle time ("scrub") */
+  FlashScrub_Init();
+#endif
+
+  /* Block pools for message payloads; must exist before CAN RX starts */
+  MemPool_Init();
+
+  /* Protocol timeouts (timer_wheel.h), ticked by the 1 ms raster */
+  TimerWheel_Init();
+
+  /* Memory-to-memory copies on DMA2 Stream1 (dma_copy.h) */
+  DmaCopy_Init();
+
+  /* Ring of state-changing commands ("audit", audit.h) */
+  Audit_Init();
+
+#if WATCH_ENABLE
+  /* DWT data watchpoints ("watch", watch.h), disarmed */
+  Watch_Init();
+  (void)Watch_Register(s_watchTargets, (uint32_t)(sizeof(s_watchTargets) / sizeof(s_watchTargets[0])));
+#endif
+
+#if PC_PROF_ENABLE
+  /* PC-sampling profiler on TIM6 ("prof", pc_prof.h), stopped */
+  if (PcProf_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "PcProf_Init failed, no PC profile");
+  }
+#endif
 
   /* Initialize CAN interface (filters, start, queue, notifications) */
   if (CAN_IF_Init() != HAL_OK)
   {
-    LOG_ERROR("MAIN", "CAN_IF_Init FAILED, halting");
+    LOG_ERROR(MAIN, "CAN_IF_Init FAILED, halting");
     Error_Handler();
   }
+  BootProf_Mark(BOOT_PROF_CAN_IF);
+
+  /* Threshold alarms through the urgent mailbox (can_alarm.h) */
+  CanAlarm_Init();
+
+  /* Authenticated odometer frame (can_secoc.h) and multiplexed trip data */
+  if (Trip_CanInit() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "Trip_CanInit failed, odometer / trip data frames missing");
+  }
 
-  /* Initialize CLI interface (starts UART RX internally) */
-  CLI_IF_Init(&huart2, &g_vehicle);
+  /* Decode the telemetry frame into the RX signal cache ("dash src can") */
+  if (CanSigCache_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "CanSigCache_Init failed, no decoded CAN dashboard");
+  }
 
-  LOG_INFO("MAIN", "Init complete, creating RTOS tasks...");
+  /* Network management: NM PDUs and coordinated bus sleep (can_nm.h) */
+  if (CanNm_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "CanNm_Init failed, the bus never sleeps");
+  }
+
+  /* Global time: SYNC/FUP master or slave, trace and log stamps (time_sync.h) */
+  if (TimeSync_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "TimeSync_Init failed, time stamps stay local");
+  }
+
+#if CAN_LOG_ENABLE
+  /* Log streams as CAN frames ("log transport <stream> can"); registered
+   * after the cyclic frames so the scheduler serves those first */
+  if (CanLog_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "CanLog_Init failed, no log over CAN");
+  }
+#endif
+
+  /* UDS server on the diagnostic IDs (programming session, DIDs, DTCs) */
+  if (Uds_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "Uds_Init failed, no diagnostics or update hand-over over CAN");
+  }
+
+#if XCP_ENABLE
+  /* XCP slave for measurement (DAQ) and calibration tools */
+  if (Xcp_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "Xcp_Init failed, no XCP measurement");
+  }
+#endif
+
+#if SIG_HIST_ENABLE
+  /* Min / max / mean history of the vehicle signals ("hist") */
+  if (SigHist_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "SigHist_Init failed, no signal history");
+  }
+#endif
+
+#if UART_BAUD_ENABLE
+  /* Console baud switching with host confirmation ("baud") */
+  if (UartBaud_Init(&huart2) != HAL_OK)
+  {
+    LOG_WARN(MAIN, "UartBaud_Init failed, console stays at %lu baud",
+             (unsigned long)huart2.Init.BaudRate);
+  }
+#endif
+
+#if CLOCK_GOV_ENABLE
+  /* Clock profile from the measured load ("clk") */
+  if (ClockGov_Init(&huart2) != HAL_OK)
+  {
+    LOG_WARN(MAIN, "ClockGov_Init failed, clock stays at %s", ClockCfg_GetActive()->name);
+  }
+#endif
+
+#if J1939_ENABLE
+  /* J1939 on the 29-bit IDs: address claim, requests, transport */
+  if (J1939_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "J1939_Init failed, no J1939");
+  }
+#endif
+
+  /* Loopback self-benchmark of the CAN stack ("bench can") */
+  if (CanBench_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "CanBench_Init failed, 'bench can' unavailable");
+  }
 
   /* Initialize the RTOS kernel */
   osKernelInitialize();
 
-  /* Create VehicleTask: updates model + sends telemetry */
-  vehicleTaskHandle = osThreadNew(VehicleTask, NULL, &vehicleTask_attributes);
+  /* Vehicle command mailbox (CLI -> VehicleTask) */
+  if (Vehicle_SharedInit() != HAL_OK)
+  {
+    LOG_ERROR(MAIN, "Vehicle_SharedInit FAILED, halting");
+    Error_Handler();
+  }
+
+  /* Per-task CPU load sampling for "top" (diagnostic only, not fatal) */
+  if (RtosStats_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "RtosStats_Init failed, 'top' unavailable");
+  }
+
+  /* Kernel event recorder ("rtos trace"); stopped until started */
+  RtosTrace_Init();
+
+  /* Stack sizes and high-water marks ("stack"); fills the unused MSP */
+  RtosStack_Init();
+
+  /* Task and queue table report ("tasks") */
+  SysConfig_Init();
+
+  /* CAN bus load / error windows for "can stats" (diagnostic only) */
+  if (CanStats_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "CanStats_Init failed, 'can stats' unavailable");
+  }
+
+  /* RTC timebase for tickless idle and the "power" command */
+  if (LowPower_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "LowPower_Init failed, idle keeps the tick running");
+  }
+
+  /* Virtual sensors: ADC-style sample blocks of the vehicle model */
+  if (VSensor_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "VSensor_Init failed, no sensor measurements");
+  }
+
+  /* Kalman speed estimate of the speed sensor; steady gain computed here */
+  SpeedEst_Init();
+
+  /* Wheel-speed pulses: TIM11 on PB9 generates, TIM1 on PA8 captures by DMA */
+  if (WheelPulse_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "WheelPulse_Init failed, no wheel-speed pulses");
+  }
+
+  /* 60-2 crank wheel: TIM8 on PC6 generates, TIM4 on PB6 captures teeth */
+  if (Crank_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "Crank_Init failed, no crank signal");
+  }
+
+  /* Crank-angle events on the TIM4 compare channels, INJ on PB7 */
+  if (AngleSched_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "AngleSched_Init failed, no angle events");
+  }
+
+  /* Accelerator pedal: B1 edges debounced by TIM7, no polling */
+  if (Pedal_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "Pedal_Init failed, no accelerator input");
+  }
+
+  /* Radiator fan: PI on the coolant sensor, TIM10 PWM (fan_ctrl.h) */
+  if (FanCtrl_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "FanCtrl_Init failed, no fan control");
+  }
+
+  /* Cruise control: PI from the speed estimate to the throttle (cruise.h) */
+  Cruise_Init();
+
+  /* Drive-cycle and fault scenarios for the "scenario" command */
+  Scenario_Init();
+
+#if FAULT_INJ_ENABLE
+  /* Scheduled and random sensor / CAN faults ("fault") */
+  if (FaultInj_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "FaultInj_Init failed, no fault engine");
+  }
+#endif
+
+  /* Sim time of the model and the telemetry, real time by default */
+  SimClock_Init();
+
+  /* Control loop release (tick or TIM5) and its jitter figures for "loop" */
+  if (CtrlLoop_Init() != HAL_OK)
+  {
+    LOG_ERROR(MAIN, "CtrlLoop_Init FAILED, halting");
+    Error_Handler();
+  }
+
+#if VEHICLE_FLEET_SIZE > 0U
+  /* Spread the fleet over the speed range so the frames differ. */
+  VehicleFleet_Init(&s_fleet, VEHICLE_FLEET_SIZE);
+  for (uint32_t i = 0U; i < s_fleet.count; i++)
+  {
+    VehicleFleet_SetTargetSpeed(&s_fleet, i, (float)(i * 3U));
+  }
+#endif
+
+  /* Raster tasks for the 1 / 10 / 100 ms runnables (raster.h) */
+  if (Raster_Init() != HAL_OK)
+  {
+    LOG_ERROR(MAIN, "Raster_Init FAILED, halting");
+    Error_Handler();
+  }
+
+  /* An update staged into the other slot over UDS, a coroutine of BgTask (stage.h) */
+  if (Stage_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "Stage_Init failed, no update staging while running");
+  }
+
+  /* "coop": the coroutines BgTask runs (coop.h) */
+  Coop_Init();
 
-  /* Create CliTask: runs CLI_IF_Task() in a loop */
-  cliTaskHandle = osThreadNew(CliTask, NULL, &cliTask_attributes);
+#if FW_PROXY_ENABLE
+  /* FwProxyTask: the staged image to the bootloaders on CAN2 (fw_proxy.h) */
+  if (FwProxy_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "FwProxy_Init failed, no flashing of the CAN2 nodes");
+  }
+#endif
+
+#if WATCHDOG_ENABLE
+  /* IWDG, kicked by WdgTask while the periodic tasks check in (watchdog.h) */
+  if (Watchdog_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "Watchdog_Init failed, no IWDG");
+  }
+#endif
 
-  /* Create CAN RX task: consumes messages from CAN_IF RX queue */
-  canRxTaskHandle = osThreadNew(CanRxTask, NULL, &canRxTask_attributes);
+  /* Create the SYS_BOOT tasks of SYS_TASK_TABLE (sys_config.h) */
+  SYS_TASK_TABLE(MAIN_TASK_NEW_)
+
+#if DEFAULT_TASK_MODE == 1
+  /* Create the generated defaultTask, only to measure its cost */
+  defaultTaskHandle = osThreadNew(StartDefaultTask, NULL, &defaultTask_attributes);
+#endif
 
   /* Start the RTOS scheduler (never returns) */
+  BootProf_Mark(BOOT_PROF_KERNEL);
   osKernelStart();
 
   /* We should never reach here */
-  LOG_ERROR("MAIN", "osKernelStart returned unexpectedly!");
+  LOG_ERROR(MAIN, "osKernelStart returned unexpectedly!");
 
   /* USER CODE END 2 */
 
@@ -199,39 +623,22 @@ int main(void)
   */
 void SystemClock_Config(void)
 {
-  RCC_OscInitTypeDef RCC_OscInitStruct = {0};
-  RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
-
-  /** Configure the main internal regulator output voltage
-  */
-  __HAL_RCC_PWR_CLK_ENABLE();
-  __HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE3);
-
-  /** Initializes the RCC Oscillators according to the specified parameters
-  * in the RCC_OscInitTypeDef structure.
-  */
-  RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI;
-  RCC_OscInitStruct.HSIState = RCC_HSI_ON;
-  RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
-  RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
-  if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
+  /* USER CODE BEGIN SystemClock_Config */
+  /* Profile tables, voltage scaling, over-drive, wait states and ART
+     accelerator live in clock_cfg.c (selected by CLOCK_PROFILE or the
+     boot config word). Reset_Handler normally has the selected profile
+     running already (startup.h), or the bootloader left it
+     (boot_handoff.h); then it is only adopted. */
+  uint32_t profile = ClockCfg_Select();
+
+  if (ClockCfg_Adopt(profile) != HAL_OK)
   {
-    Error_Handler();
-  }
-
-  /** Initializes the CPU, AHB and APB buses clocks
-  */
-  RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_SYSCLK
-                              |RCC_CLOCKTYPE_PCLK1|RCC_CLOCKTYPE_PCLK2;
-  RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_HSI;
-  RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
-  RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV2;
-  RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
-
-  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_0) != HAL_OK)
-  {
-    Error_Handler();
+    if (ClockCfg_Apply(profile) != HAL_OK)
+    {
+      Error_Handler();
+    }
   }
+  /* USER CODE END SystemClock_Config */
 }
 
 /**
@@ -250,19 +657,20 @@ static void MX_CAN1_Init(void)
 
   hcan1.Instance = CAN1;
 
-  /* Typical, safe timing for F4 (APB1 = 45 MHz):
-     - Prescaler = 16
-     - 1 (sync) + 13 + 2 = 16 TQ per bit
-     => ~ 45 MHz / (16 * 16) ≈ 175 kbps (exact speed isn’t critical in loopback)
-  */
-  hcan1.Init.Prescaler           = 16;
+  /* Bit timing is derived from the actual APB1 clock so the bus stays at
+     CAN_IF_BITRATE whatever clock profile is active. */
+  CanTiming_t timing;
+  if (CanTiming_Compute(HAL_RCC_GetPCLK1Freq(), CAN_IF_BITRATE,
+                        CAN_TIMING_SAMPLE_POINT, &timing) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  CanTiming_ToInit(&timing, &hcan1.Init);
+
   hcan1.Init.Mode                = CAN_MODE_LOOPBACK;   // single-board testing
-  hcan1.Init.SyncJumpWidth       = CAN_SJW_1TQ;
-  hcan1.Init.TimeSeg1            = CAN_BS1_13TQ;
-  hcan1.Init.TimeSeg2            = CAN_BS2_2TQ;
-  hcan1.Init.TimeTriggeredMode   = DISABLE;
+  hcan1.Init.TimeTriggeredMode   = ENABLE;    // RX SOF timestamps (TGT stays off)
   hcan1.Init.AutoBusOff          = DISABLE;
-  hcan1.Init.AutoWakeUp          = DISABLE;
+  hcan1.Init.AutoWakeUp          = ENABLE;
   hcan1.Init.AutoRetransmission  = ENABLE;
   hcan1.Init.ReceiveFifoLocked   = DISABLE;
   hcan1.Init.TransmitFifoPriority= DISABLE;
@@ -276,6 +684,47 @@ static void MX_CAN1_Init(void)
   /* USER CODE END CAN1_Init 2 */
 }
 
+/**
+  * @brief CAN2 Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_CAN2_Init(void)
+{
+  /* USER CODE BEGIN CAN2_Init 0 */
+  /* USER CODE END CAN2_Init 0 */
+
+  /* USER CODE BEGIN CAN2_Init 1 */
+  /* Gateway bus (can_gw.h); CAN_IF_Init() gives it CAN1's bit timing */
+  /* USER CODE END CAN2_Init 1 */
+
+  hcan2.Instance = CAN2;
+
+  CanTiming_t timing;
+  if (CanTiming_Compute(HAL_RCC_GetPCLK1Freq(), CAN_IF_BITRATE,
+                        CAN_TIMING_SAMPLE_POINT, &timing) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  CanTiming_ToInit(&timing, &hcan2.Init);
+
+  hcan2.Init.Mode                = CAN_MODE_LOOPBACK;   // single-board testing
+  hcan2.Init.TimeTriggeredMode   = DISABLE;
+  hcan2.Init.AutoBusOff          = ENABLE;    // no can_busoff recovery for CAN2
+  hcan2.Init.AutoWakeUp          = DISABLE;
+  hcan2.Init.AutoRetransmission  = ENABLE;
+  hcan2.Init.ReceiveFifoLocked   = DISABLE;
+  hcan2.Init.TransmitFifoPriority= DISABLE;
+
+  if (HAL_CAN_Init(&hcan2) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  /* USER CODE BEGIN CAN2_Init 2 */
+  /* USER CODE END CAN2_Init 2 */
+}
+
 /**
   * @brief USART2 Initialization Function
   * @param None
@@ -306,6 +755,25 @@ static void MX_USART2_UART_Init(void)
 
 }
 
+/**
+  * Enable DMA controller clock
+  */
+static void MX_DMA_Init(void)
+{
+
+  /* DMA controller clock enable */
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  /* DMA interrupt init */
+  /* DMA1_Stream5_IRQn interrupt configuration (USART2_RX) */
+  HAL_NVIC_SetPriority(DMA1_Stream5_IRQn, 5, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Stream5_IRQn);
+  /* DMA1_Stream6_IRQn interrupt configuration (USART2_TX) */
+  HAL_NVIC_SetPriority(DMA1_Stream6_IRQn, 5, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Stream6_IRQn);
+
+}
+
 /**
   * @brief GPIO Initialization Function
   * @param None
@@ -345,93 +813,316 @@ static void MX_GPIO_Init(void)
 
 /* USER CODE BEGIN 4 */
 
+/**
+  * @brief 100 ms runnable (raster.h): blinks LD2 at 1 Hz while the
+  *        scheduler runs.
+  */
+void App_Heartbeat100ms(void)
+{
+  static uint32_t calls = 0U;
+
+  if (++calls >= 5U)
+  {
+    calls = 0U;
+    HAL_GPIO_TogglePin(LD2_GPIO_Port, LD2_Pin);
+  }
+}
+
+#if VEHICLE_FLEET_SIZE > 0U
+/**
+  * @brief 100 ms runnable (raster.h): steps the load-test fleet and queues
+  *        its frames, outside the control loop.
+  *
+  * The fleet follows the accelerator pedal (pedal.h) like g_vehicle.
+  */
+void App_Fleet100ms(void)
+{
+  const float dt_s           = 0.1f;
+  const float accel_step_kph = 10.0f * dt_s;   /* ~10 km/h per second */
+
+  Pedal_State_t pedal;
+  Pedal_Get(&pedal);
+
+  if (pedal.throttle > 0.0f)
+  {
+    VehicleFleet_AddSpeed(&s_fleet, accel_step_kph * pedal.throttle);
+  }
+
+  VehicleFleet_Update(&s_fleet, dt_s);
+  (void)VehicleFleet_SendTelemetry(&s_fleet);
+}
+#endif
+
 /**
   * @brief Task that updates the vehicle model and sends CAN telemetry.
   *
-  * The blue user button (B1 on PC13) is treated as a simple
-  * "accelerator pedal":
-  *   - While pressed  -> speed increases at a fixed rate.
-  *   - When released -> vehicle coasts down via Vehicle_Update().
+  * The blue user button (B1 on PC13) is the accelerator pedal (pedal.h):
+  *   - While pressed  -> the throttle ramps up and the model accelerates
+  *                       through the torque map and gearbox (powertrain.h).
+  *   - When released -> the throttle ramps down and the vehicle coasts
+  *                       down via Vehicle_Update().
+  *
+  * Engaged cruise control ("veh cruise", cruise.h) drives the same throttle
+  * from the 10 ms raster; the larger of the two wins, so the pedal can
+  * override it.
+  *
+  * While a scenario plays ("scenario play", scenario.h) it drives the model
+  * instead and the pedal and cruise control are ignored.
+  *
+  * The model steps at CTRL_LOOP_HZ (ctrl_loop.h); telemetry stays at
+  * 10 Hz and the fleet runs in the 100 ms raster (App_Fleet100ms()). With
+  * "sim scale" (sim_clock.h) a release runs several steps, all in sim time.
   */
 static void VehicleTask(void *argument)
 {
   (void)argument;
 
-  const uint32_t period_ms        = 100U;   /* 10 Hz task rate          */
-  const float    dt_s             = 0.1f;   /* 100 ms time step         */
-  const float    accel_kph_per_s  = 10.0f;  /* ~10 km/h per second      */
-  const float    accel_step_kph   = accel_kph_per_s * dt_s;
+  const float    dt_s             = 1.0f / (float)CTRL_LOOP_HZ;
+  const uint32_t step_ms          = 1000U / CTRL_LOOP_HZ;
+  const uint32_t telemetry_div    = CTRL_LOOP_HZ / 10U;  /* 10 Hz telemetry */
+  const float    overtemp_c       = 105.0f; /* P0217 above this coolant temp */
+
+  uint32_t cycle = 0U;
+
+  /* Pedal edges from TIM7, logged here rather than in the interrupt */
+  const int32_t pedal_sub = MsgBus_Subscribe(MSG_TOPIC_PEDAL, NULL, 0U);
 
-  uint32_t last_wake = osKernelGetTickCount();
-  uint8_t  lastPressed = 0U;
+  (void)CtrlLoop_Start();
+  Watchdog_Start(WATCHDOG_TASK_VEHICLE);
 
   for (;;)
   {
-    /* Read accelerator pedal (blue button B1, active-low on Nucleo) */
-    GPIO_PinState pinState = HAL_GPIO_ReadPin(B1_GPIO_Port, B1_Pin);
-    uint8_t pressed = (pinState == GPIO_PIN_RESET) ? 1U : 0U;
+    /* Released at CTRL_LOOP_HZ by the tick or TIM5 (ctrl_loop.h) */
+    CtrlLoop_Wait();
 
-    if (pressed)
-    {
-      /* Increase physical speed a bit each tick while pedal is held */
-      Vehicle_SetTargetSpeed(&g_vehicle,
-                             g_vehicle.speed_kph + accel_step_kph);
+    /* Commands posted by other tasks since the last tick */
+    (void)Vehicle_ApplyCommands(&g_vehicle);
 
-      if (!lastPressed)
+    Pedal_Event_t edge;
+    while (MsgBus_Receive(MSG_TOPIC_PEDAL, pedal_sub, &edge) == HAL_OK)
+    {
+      if (edge.pressed != 0U)
       {
-        /* Rising edge: pedal just pressed */
-        LOG_INFO("MAIN", "Accelerator pressed");
+        LOG_INFO(VEH, "Accelerator pressed");
+      }
+      else
+      {
+        LOG_INFO(VEH, "Accelerator released after %lu ms", (unsigned long)edge.heldMs);
       }
     }
-    else
+
+    /* The radiator fan runs at the duty the TIM10 output carries (fan_ctrl.h) */
+    Vehicle_SetFan(&g_vehicle, FanCtrl_GetDuty());
+
+    /* One model step at real time, more when the sim clock runs faster */
+    uint32_t steps = 0U;
+    do
     {
-      if (lastPressed)
+      /* A playing scenario drives the model in place of the pedal (scenario.h) */
+      if (Scenario_Step(&g_vehicle, step_ms) == 0U)
       {
-        /* Falling edge: pedal just released */
-        LOG_INFO("MAIN", "Accelerator released");
+        /* Accelerator pedal position, debounced from the B1 edges (pedal.h) */
+        Pedal_State_t pedal;
+        Pedal_Get(&pedal);
+
+        /* Engaged cruise control holds the speed; a deeper pedal overrides it */
+        float throttle = Cruise_GetThrottle();
+        if (pedal.throttle > throttle)
+        {
+          throttle = pedal.throttle;
+        }
+
+        Vehicle_SetThrottle(&g_vehicle, throttle);
+
+        /* Advance the physical model (drive, coast-down, gear, RPM, coolant temp) */
+        Vehicle_Update(&g_vehicle, dt_s);
       }
-    }
-    lastPressed = pressed;
+      Vehicle_Publish(&g_vehicle);
+      SimClock_Advance(step_ms);
+
+      /* Threshold crossings go on the bus from here, past the TX queue */
+      CanAlarm_Check(&g_vehicle);
 
-    /* Advance the physical model (coast-down, RPM, coolant temp) */
-    Vehicle_Update(&g_vehicle, dt_s);
+      /* Odometer and trip computer, saved to flash in batches (trip.h) */
+      Trip_Update(&g_vehicle, step_ms);
 
-    /* Broadcast telemetry on CAN */
-    CAN_IF_SendTelemetry(&g_vehicle);
+      /* Time per rpm x speed and coolant bin, saved in batches (load_coll.h) */
+      LoadColl_Update(&g_vehicle);
 
-    last_wake += period_ms;
-    (void)osDelayUntil(last_wake);
+      /* Telemetry goes out from CanTxTask; let it check the deadbands */
+      if (++cycle >= telemetry_div)
+      {
+        cycle = 0U;
+        CanSched_Notify();
+      }
+    } while (SimClock_Continue(++steps, CtrlLoop_ElapsedUs(), CTRL_LOOP_PERIOD_US) != 0U);
+
+#if XCP_ENABLE
+    /* DAQ lists on the control loop event see this cycle's final values */
+    Xcp_Event(XCP_EVENT_CTRL);
+#endif
+
+    /* Engine over temperature monitor; only a change costs anything */
+    Dtc_Set(DTC_ENGINE_OVERTEMP, (g_vehicle.coolant_temp_c > overtemp_c) ? 1U : 0U);
+
+    CtrlLoop_Done();
+
+    /* Alive for the watchdog supervisor (watchdog.h) */
+    Watchdog_Checkin(WATCHDOG_TASK_VEHICLE);
   }
 }
 
+/**
+  * @brief Non-critical init, run by CliTask after the scheduler starts.
+  *
+  * main() brings up only what the first telemetry frame and the control
+  * loop need. Everything else runs here, in CliTask at osPriorityLow
+  * before it takes CLI commands: the start-up reports (which main() would
+  * have written at blocking UART speed), the CLI banner and dashboard,
+  * the USB console (a 50 ms core reset), the QSPI flash scan and the
+  * tools. Calling CLI_IF_Register() from the task that dispatches keeps
+  * the command table single-threaded. Modules with CAN handlers (UDS,
+  * XCP, J1939, the CAN bench) or raster runnables stay in main(): neither
+  * table may change under running tasks.
+  */
+static void DeferredInit(void)
+{
+  LOG_INFO(MAIN, "Mini ECU – CAN + RTOS Telemetry Node starting...");
+  LOG_INFO(MAIN, "Clock profile %s, SYSCLK %lu Hz",
+           ClockCfg_GetActive()->name, (unsigned long)SystemCoreClock);
+
+  /* Time from reset to main() (startup.h) and "boot times" (boot_prof.h) */
+  Startup_Report();
+  BootProf_Init();
+
+  LOG_INFO(MAIN, "%lu B of interrupt code in SRAM, vectors at 0x%08lX",
+           (unsigned long)RamFunc_CodeSize(), (unsigned long)SCB->VTOR);
+
+  /* What the bootloader did: slot, path, boot time, reset cause, update */
+  BootHandoff_Report();
+
+  /* CLI interface: UART RX, clear screen, dashboard and greeting */
+  CLI_IF_Init(&huart2);
+  BootProf_Mark(BOOT_PROF_CLI);
+
+  /* The "boot" commands and the trial-image confirmation */
+  if (BootRequest_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "BootRequest_Init failed, trial image not confirmed automatically");
+  }
+
+#if TLM_STREAM_ENABLE
+  /* Binary telemetry stream on the console UART ("tlm start") */
+  if (TlmStream_Init(&huart2) != HAL_OK)
+  {
+    LOG_WARN(MAIN, "TlmStream_Init failed, no telemetry stream");
+  }
+#endif
+
+#if USB_CDC_ENABLE
+  /* USB CDC-ACM console; takes the CLI output while the host has it open */
+  if (UsbCdc_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "UsbCdc_Init failed, no USB console");
+  }
+#endif
+
+#if QSPI_FLASH_ENABLE
+  /* QSPI NOR flash and the long-duration recorder on it ("xlog") */
+  if (QspiFlash_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "QspiFlash_Init failed, no external log");
+  }
+#if EXT_LOG_ENABLE
+  else if (ExtLog_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "ExtLog_Init failed, no external log");
+  }
+#endif
+#endif
+
+  if (CanReplay_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "CanReplay_Init failed, 'can replay' unavailable");
+  }
+
+#if IRQ_BENCH_ENABLE
+  /* Interrupt latency benchmark on TIM3 capture ("bench irq") */
+  if (IrqBench_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "IrqBench_Init failed, 'bench irq' unavailable");
+  }
+#endif
+
+#if MICRO_BENCH_ENABLE
+  /* On-target microbenchmarks of the bench image ("bench micro") */
+  if (MicroBench_Init() != HAL_OK)
+  {
+    LOG_WARN(MAIN, "MicroBench_Init failed, 'bench micro' unavailable");
+  }
+#endif
+
+  /* Create the SYS_DEFERRED tasks: the bench tasks (IrqBenchTask,
+   * MicroBenchTask) of the bench images */
+  SYS_TASK_TABLE(MAIN_TASK_LATE_)
+
+  /* Every enabled interrupt where SYS_IRQ_TABLE has it (sys_config.h) */
+  if (SysConfig_CheckIrqs() != 0U)
+  {
+    LOG_ERROR(MAIN, "Interrupt priorities differ from SYS_IRQ_TABLE ('irqs')");
+  }
+
+  BootProf_Mark(BOOT_PROF_DEFERRED);
+  LOG_INFO(MAIN, "Init complete, %lu us after reset (boot times)",
+           (unsigned long)BootProf_Us(BOOT_PROF_DEFERRED));
+}
+
 /**
   * @brief Task that runs the CLI interface.
   *
-  * CLI_IF_Task() drains the ring buffer and parses commands.
+  * CLI_IF_Task() blocks until RX DMA input arrives or the dashboard is
+  * due, then parses commands; no extra delay is needed here.
   */
 static void CliTask(void *argument)
 {
   (void)argument;
 
+  /* Below the control and CAN tasks until the rest of the system is up */
+  DeferredInit();
+  (void)osThreadSetPriority(osThreadGetId(), CLI_TASK_PRIORITY);
+
   for (;;)
   {
     CLI_IF_Task();
-    /* Small delay to yield CPU; CLI_IF_Task is non-blocking */
-    osDelay(10);
   }
 }
 
 /**
-  * @brief Task that waits for CAN frames and lets CAN_IF process them.
+  * @brief Event loop of the CAN receive side.
+  *
+  * One wait on the task's notification bits covers every source; a source
+  * without a bit is a timer, served when the wait times out. Each wake-up
+  * services all pending sources in priority order:
+  *
+  *   1. Frames (CAN_IF_RX_FLAG): the CAN_IF RX ring, consumed in place,
+  *      and the latest-value slots of the cyclic status IDs
+  *      (CAN_IF_LATEST_TABLE), drained until both are empty. The ISR only
+  *      raises the flag when the ring or the slots go from empty to
+  *      non-empty, so a burst costs a single wake-up.
+  *   2. Timers: reassemblies whose sender went quiet. ISO-TP N_Cr runs on
+  *      the timer wheel, which raises ISOTP_RX_FLAG; the J1939 T1 / T2
+  *      deadlines set the next wait.
+  *
+  * A new source adds its bit to CANRX_EVENTS and its step to the loop.
   */
 static void CanRxTask(void *argument)
 {
   (void)argument;
 
-  osMessageQueueId_t q = CAN_IF_GetRxQueueHandle();
-  if (q == NULL)
+  CanRing_t *ring = CAN_IF_GetRxRing();
+  if (ring == NULL)
   {
-    LOG_ERROR("CANRX", "RX queue is NULL in CanRxTask");
+    LOG_ERROR(CANRX, "RX ring is NULL in CanRxTask");
     /* Loop with delay rather than crashing */
     for (;;)
     {
@@ -439,38 +1130,247 @@ static void CanRxTask(void *argument)
     }
   }
 
+  CanRing_SetConsumer(ring, osThreadGetId(), CAN_IF_RX_FLAG);
+  IsoTp_SetRxConsumer(osThreadGetId());
+
   for (;;)
   {
-    CAN_IF_Msg_t msg;
-    /* Wait forever for next CAN message */
-    if (osMessageQueueGet(q, &msg, NULL, osWaitForever) == osOK)
+    uint32_t done;
+    uint32_t frames = 0U;
+
+    /* End of the "bench irq" CAN path: the task runs after an RX interrupt */
+    IRQ_BENCH_END(CAN);
+
+    /* 1. Frames. The latest-value slots between batches, so a full ring
+     * cannot hold them off; then CAN_IF_RX_BATCH ring slots per tail
+     * update. Frames that arrive meanwhile are taken in the same pass. */
+    do
     {
-      /* Let CAN interface layer handle/log the message */
-      CAN_IF_ProcessRxMsg(&msg);
+      void    *batch;
+      uint32_t n;
+
+      done = CAN_IF_ProcessLatest();
+
+      n = CanRing_PeekBatch(ring, &batch, CAN_IF_RX_BATCH);
+      if (n > 0U)
+      {
+        const CAN_IF_Msg_t *msg = (const CAN_IF_Msg_t *)batch;
+
+        /* Let CAN interface layer handle/log the messages */
+        for (uint32_t i = 0U; i < n; ++i)
+        {
+          CAN_IF_ProcessRxMsg(&msg[i]);
+        }
+        CanRing_ReleaseBatch(ring, n);
+        done += n;
+      }
+      frames += done;
+    } while (done != 0U);
+    METRIC_HIST(CAN_RX_WAKE_FRAMES, frames);
+
+    /* 2. Timers, after the frames that may have kept them alive */
+    IsoTp_RxRun();
+    uint32_t wait = osWaitForever;
+#if J1939_ENABLE
+    wait = J1939_RxRun();
+#endif
+
+    /* Until a source raises its bit or the next deadline; a bit raised
+     * while the loop ran ends the wait at once. Blocks with the basic
+     * frame even after a diagnostic request used the FPU (rtos_fpu.h) */
+    RtosFpu_Release();
+    (void)osThreadFlagsWait(CANRX_EVENTS, osFlagsWaitAny, wait);
+  }
+}
+
+/**
+  * @brief Task that sends the scheduled CAN frames, the ISO-TP
+  *        Consecutive Frames and the J1939 claim and transport frames,
+  *        recovers from bus-off and mutes flooding RX filters.
+  *
+  * Sleeps until the next frame is due, until a data owner calls
+  * CanSched_Notify(), until ISO-TP flow control or a J1939 CTS arrives or
+  * until the bus-off or an RX flood interrupt wakes it, so on-change
+  * frames go out without polling and cyclic ones without a fixed-rate
+  * wake-up (1 tick = 1 ms). While bus-off, only the recovery runs.
+  */
+static void CanTxTask(void *argument)
+{
+  (void)argument;
+
+  CanSched_SetConsumer(osThreadGetId());
+  CanBusOff_SetConsumer(osThreadGetId());
+  CanRxLimit_SetConsumer(osThreadGetId());
+  IsoTp_SetConsumer(osThreadGetId());
+#if J1939_ENABLE
+  J1939_SetConsumer(osThreadGetId());
+#endif
+
+  for (;;)
+  {
+    uint32_t wait = CanBusOff_Run(osKernelGetTickCount());
+
+    Dtc_Set(DTC_CAN_BUSOFF, CanBusOff_IsActive());
+
+    /* Mute RX filters that flood, resume them when their time is up */
+    uint32_t due = CanRxLimit_Run(osKernelGetTickCount());
+    if (due < wait)
+      wait = due;
+
+    if (CanBusOff_IsActive() == 0U)
+    {
+      /* Frames follow the model's sim time; recovery stays on real time */
+      due = SimClock_ToTicks(CanSched_Run(SimClock_NowMs()));
+      if (due < wait)
+        wait = due;
+
+      /* Consecutive Frames of the diagnostic responses, on real time */
+      due = IsoTp_Run();
+      if (due < wait)
+        wait = due;
+
+#if J1939_ENABLE
+      /* Address claim and the J1939 transport message being sent */
+      due = J1939_Run();
+      if (due < wait)
+        wait = due;
+#endif
     }
+
+    RtosFpu_Release();
+    (void)osThreadFlagsWait(CAN_SCHED_FLAG | CAN_BUSOFF_FLAG | ISOTP_TX_FLAG | J1939_TX_FLAG |
+                            CAN_RXLIMIT_FLAG, osFlagsWaitAny, wait);
+  }
+}
+
+#if DEFAULT_TASK_MODE != 2
+/**
+  * @brief Task that streams queued log output to the UART.
+  *
+  * Runs at low priority: logging never delays control work, and lines
+  * produced in a burst are sent as one DMA transfer.
+  */
+static void LogTask(void *argument)
+{
+  (void)argument;
+
+  for (;;)
+  {
+    Log_Task();
+  }
+}
+#endif
+
+/**
+  * @brief Task that filters the virtual sensor sample blocks.
+  *
+  * Started here so the source only signals once the consumer exists;
+  * VSensor_Task() sleeps until a half buffer is ready.
+  */
+static void SensorTask(void *argument)
+{
+  (void)argument;
+
+  if (VSensor_Start(osThreadGetId()) != HAL_OK)
+  {
+    LOG_ERROR(MAIN, "VSensor_Start failed");
+  }
+  else
+  {
+    Watchdog_Start(WATCHDOG_TASK_SENSOR);
+  }
+
+  for (;;)
+  {
+    VSensor_Task();
+    Watchdog_Checkin(WATCHDOG_TASK_SENSOR);
   }
 }
 
+/**
+  * @brief Task that writes the flash log: changed trouble codes and
+  *        committed calibration values.
+  *
+  * Lowest application priority with LogTask: the owners only mark entries
+  * (nvm_log.h), the flash programs and the occasional sector erase run here.
+  */
+#if DEFAULT_TASK_MODE != 2
+static void NvmTask(void *argument)
+{
+  (void)argument;
+
+  for (;;)
+  {
+    NvmLog_Task();
+  }
+}
+#endif
+
+/**
+  * @brief Background task: the stackless coroutines of COOP_TABLE on one
+  *        stack, the update staging and, in DEFAULT_TASK_MODE 2, the log
+  *        output and the flash log in place of LogTask and NvmTask.
+  *
+  * Each only ever slept on its own thread flags at the same low priority;
+  * the flags differ, so one thread waits for any of them (coop.h). One log
+  * chunk and one program slice go out per turn, so neither a steady log
+  * stream nor a staging holds off the rest. A flash log pass holds off
+  * the log for its length, which the flash stall did before as well.
+  */
+static void BgTask(void *argument)
+{
+  (void)argument;
+
+  Coop_Run();
+}
+
+#if IRQ_BENCH_ENABLE
+/**
+  * @brief Task that runs "bench irq start": the CPU load, the logging
+  *        storm and the TIM3 sampling (irq_bench.h).
+  */
+static void IrqBenchTask(void *argument)
+{
+  (void)argument;
+
+  IrqBench_Task();
+}
+#endif
+
+#if MICRO_BENCH_ENABLE
+/**
+  * @brief Task that runs the microbenchmark registry (micro_bench.h).
+  */
+static void MicroBenchTask(void *argument)
+{
+  (void)argument;
+
+  MicroBench_Task();
+}
+#endif
+
 /* USER CODE END 4 */
 
 /* USER CODE BEGIN Header_StartDefaultTask */
 /**
   * @brief  Function implementing the defaultTask thread.
-  *         Currently unused; kept for CubeMX compatibility.
+  *         Built for DEFAULT_TASK_MODE 1 only; kept for CubeMX compatibility.
   * @param  argument: Not used
   * @retval None
   */
+#if DEFAULT_TASK_MODE == 1
 /* USER CODE END Header_StartDefaultTask */
 void StartDefaultTask(void *argument)
 {
   /* USER CODE BEGIN 5 */
-  /* Infinite loop (not used in current design) */
+  /* Infinite loop: wakes every tick and does nothing */
   for(;;)
   {
     osDelay(1);
   }
   /* USER CODE END 5 */
 }
+#endif
 
 /**
   * @brief  This function is executed in case of error occurrence.
@@ -479,11 +1379,8 @@ void StartDefaultTask(void *argument)
 void Error_Handler(void)
 {
   /* USER CODE BEGIN Error_Handler_Debug */
-  /* User can add his own implementation to report the HAL error return state */
-  __disable_irq();
-  while (1)
-  {
-  }
+  /* Record where it was called from and reset (crash_dump.h) */
+  CrashDump_Halt(CRASH_DUMP_CAUSE_ERROR, (uint32_t)__builtin_return_address(0));
   /* USER CODE END Error_Handler_Debug */
 }
 
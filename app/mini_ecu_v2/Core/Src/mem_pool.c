@@ -0,0 +1,214 @@
+/**
+ * @file    mem_pool.c
+ * @brief   Lock-free fixed-size block pools.
+ *
+ * Each class keeps its free blocks in a LIFO list whose link lives in the
+ * first word of the free block. Links and the list head hold block numbers
+ * plus one (0 = end of list) rather than addresses, so the list stays one
+ * 32-bit word wide on any pointer size (the host SIL build). Push and pop
+ * are LDREX/STREX loops on the list head. Cortex-M clears the exclusive
+ * monitor on every exception entry and return, so a pop that is
+ * interrupted between reading the head block's link and the STREX always
+ * retries; the ABA problem of a plain compare-and-swap stack cannot occur
+ * on this single-core part.
+ */
+
+#include "mem_pool.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/** Link stored in the first word of a free block. */
+typedef uint32_t MemPoolLink_t;
+
+typedef struct
+{
+    uint8_t           *base;
+    uint32_t           blockSize;
+    uint32_t           blocks;
+    volatile uint32_t  head;        /**< First free block number + 1, 0 if empty. */
+    volatile uint32_t  inUse;
+    volatile uint32_t  peak;
+    volatile uint32_t  allocs;
+    volatile uint32_t  failures;
+} MemPool_t;
+
+static uint8_t s_pool16 [16U  * MEM_POOL_16_BLOCKS]  __attribute__((aligned(8)));
+static uint8_t s_pool64 [64U  * MEM_POOL_64_BLOCKS]  __attribute__((aligned(8)));
+static uint8_t s_pool256[256U * MEM_POOL_256_BLOCKS] __attribute__((aligned(8)));
+
+static MemPool_t s_pools[MEM_POOL_CLASS_COUNT] =
+{
+    { s_pool16,  16U,  MEM_POOL_16_BLOCKS,  0U, 0U, 0U, 0U, 0U },
+    { s_pool64,  64U,  MEM_POOL_64_BLOCKS,  0U, 0U, 0U, 0U, 0U },
+    { s_pool256, 256U, MEM_POOL_256_BLOCKS, 0U, 0U, 0U, 0U, 0U },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t mp_atomic_add(volatile uint32_t *v, uint32_t delta)
+{
+    uint32_t n;
+
+    do
+    {
+        n = __LDREXW(v) + delta;
+    } while (__STREXW(n, v) != 0U);
+
+    return n;
+}
+
+static void mp_atomic_max(volatile uint32_t *v, uint32_t value)
+{
+    do
+    {
+        if (__LDREXW(v) >= value)
+        {
+            __CLREX();
+            return;
+        }
+    } while (__STREXW(value, v) != 0U);
+}
+
+static MemPoolLink_t *mp_block(const MemPool_t *p, uint32_t link)
+{
+    return (MemPoolLink_t *)(void *)&p->base[(link - 1U) * p->blockSize];
+}
+
+static void *mp_pop(MemPool_t *p)
+{
+    uint32_t head;
+
+    do
+    {
+        head = __LDREXW(&p->head);
+        if (head == 0U)
+        {
+            __CLREX();
+            return NULL;
+        }
+    } while (__STREXW(*mp_block(p, head), &p->head) != 0U);
+
+    __DMB();
+    return mp_block(p, head);
+}
+
+static void mp_push(MemPool_t *p, const uint8_t *block)
+{
+    uint32_t       link = ((uint32_t)(block - p->base) / p->blockSize) + 1U;
+    MemPoolLink_t *b    = mp_block(p, link);
+
+    __DMB();
+
+    do
+    {
+        *b = __LDREXW(&p->head);
+    } while (__STREXW(link, &p->head) != 0U);
+}
+
+/**
+ * @brief Pool owning @p block, or NULL.
+ */
+static MemPool_t *mp_owner(const void *block)
+{
+    const uint8_t *b = (const uint8_t *)block;
+
+    for (uint32_t i = 0U; i < MEM_POOL_CLASS_COUNT; i++)
+    {
+        MemPool_t *p = &s_pools[i];
+
+        if ((b >= p->base) && (b < (p->base + (p->blockSize * p->blocks))))
+        {
+            return (((uint32_t)(b - p->base) % p->blockSize) == 0U) ? p : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void MemPool_Init(void)
+{
+    for (uint32_t i = 0U; i < MEM_POOL_CLASS_COUNT; i++)
+    {
+        MemPool_t *p = &s_pools[i];
+
+        p->head  = 0U;
+        p->inUse = 0U;
+        p->peak  = 0U;
+
+        /* Chain in reverse so the first allocation returns block 0. */
+        for (uint32_t link = p->blocks; link > 0U; link--)
+        {
+            *mp_block(p, link) = p->head;
+            p->head = link;
+        }
+    }
+}
+
+void *MemPool_Alloc(size_t size)
+{
+    if ((size == 0U) || (size > MEM_POOL_MAX_BLOCK))
+        return NULL;
+
+    uint32_t first = 0U;
+    while (s_pools[first].blockSize < size)
+        first++;
+
+    for (uint32_t i = first; i < MEM_POOL_CLASS_COUNT; i++)
+    {
+        MemPool_t *p = &s_pools[i];
+        void      *b = mp_pop(p);
+
+        if (b != NULL)
+        {
+            mp_atomic_max(&p->peak, mp_atomic_add(&p->inUse, 1U));
+            (void)mp_atomic_add(&p->allocs, 1U);
+            return b;
+        }
+    }
+
+    (void)mp_atomic_add(&s_pools[first].failures, 1U);
+    return NULL;
+}
+
+HAL_StatusTypeDef MemPool_Free(void *block)
+{
+    MemPool_t *p = mp_owner(block);
+
+    if ((block == NULL) || (p == NULL))
+        return HAL_ERROR;
+
+    mp_push(p, (const uint8_t *)block);
+    (void)mp_atomic_add(&p->inUse, (uint32_t)-1);
+    return HAL_OK;
+}
+
+size_t MemPool_BlockSize(const void *block)
+{
+    const MemPool_t *p = mp_owner(block);
+
+    return (p != NULL) ? p->blockSize : 0U;
+}
+
+HAL_StatusTypeDef MemPool_GetStats(uint32_t cls, MemPool_Stats_t *stats)
+{
+    if ((cls >= MEM_POOL_CLASS_COUNT) || (stats == NULL))
+        return HAL_ERROR;
+
+    const MemPool_t *p = &s_pools[cls];
+
+    stats->blockSize = p->blockSize;
+    stats->blocks    = p->blocks;
+    stats->inUse     = p->inUse;
+    stats->peak      = p->peak;
+    stats->allocs    = p->allocs;
+    stats->failures  = p->failures;
+    return HAL_OK;
+}
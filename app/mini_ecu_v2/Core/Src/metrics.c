@@ -0,0 +1,239 @@
+/**
+ * @file    metrics.c
+ * @brief   Metrics registry table, snapshot and the "metrics" commands.
+ */
+
+#include "metrics.h"
+#include "cli_if.h"
+#include "tlm_stream.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/** "metrics dump" frame types and version. */
+#define METRICS_FRAME_NAME      'N'
+#define METRICS_FRAME_VALUES    'V'
+#define METRICS_DUMP_VERSION    1U
+
+/** Longest name / unit in an 'N' frame. */
+#define METRICS_TEXT_MAX        23U
+
+/** Words per 'V' frame: type, tick, first word and total before them. */
+#define METRICS_DUMP_WORDS      12U
+
+_Static_assert((1U + 4U + 2U + 2U + (4U * METRICS_DUMP_WORDS)) <= TLM_FRAME_MAX,
+               "a metrics values frame must fit one telemetry frame");
+_Static_assert((8U + (2U * METRICS_TEXT_MAX)) <= TLM_FRAME_MAX,
+               "a metrics name frame must fit one telemetry frame");
+_Static_assert(METRICS_COUNT <= 256U, "METRICS_TABLE: 'N' frames carry a u8 index");
+
+#define METRICS_INFO_(name, kind, unit, shift)                                    \
+    { #name, unit, METRICS_KIND_##kind, METRICS_WORDS_##kind, (shift), METRIC_SLOT_##name },
+
+static const Metrics_Info_t s_metricsInfo[METRICS_COUNT] = { METRICS_TABLE(METRICS_INFO_) };
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+volatile uint32_t g_metrics[METRICS_WORDS];
+
+/* Copy the exports work from; CliTask only, kept off its stack. */
+static uint32_t s_metricsSnap[METRICS_WORDS];
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void metrics_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    static const char *const kinds[] = { "counter", "gauge", "hist" };
+
+    Metrics_Snapshot(s_metricsSnap);
+
+    CLI_IF_Print("Metric               kind          value  unit\r\n");
+    for (uint32_t id = 0U; id < METRICS_COUNT; ++id)
+    {
+        const Metrics_Info_t *m = &s_metricsInfo[id];
+        const uint32_t       *w = &s_metricsSnap[m->slot];
+
+        if (m->kind == METRICS_KIND_GAUGE)
+        {
+            CLI_IF_Printf("%-20s %-7s %10lu  %s, peak %lu\r\n", m->name, kinds[m->kind],
+                          (unsigned long)w[0], m->unit, (unsigned long)w[1]);
+            continue;
+        }
+        if (m->kind != METRICS_KIND_HIST)
+        {
+            CLI_IF_Printf("%-20s %-7s %10lu  %s\r\n", m->name, kinds[m->kind],
+                          (unsigned long)w[0], m->unit);
+            continue;
+        }
+
+        uint32_t total = 0U;
+        for (uint32_t b = 0U; b < METRICS_HIST_BUCKETS; ++b)
+            total += w[b];
+        CLI_IF_Printf("%-20s %-7s %10lu  samples of %s\r\n", m->name, kinds[m->kind],
+                      (unsigned long)total, m->unit);
+
+        /* Non-empty buckets as "<upper bound>:count". */
+        if (total == 0U)
+            continue;
+        CLI_IF_Print("  hist");
+        for (uint32_t b = 0U; b < METRICS_HIST_BUCKETS; ++b)
+        {
+            if (w[b] == 0U)
+                continue;
+
+            if (b == (METRICS_HIST_BUCKETS - 1U))
+                CLI_IF_Printf(" >=%lu:%lu", 1UL << (m->shift + b - 1U), (unsigned long)w[b]);
+            else
+                CLI_IF_Printf(" <%lu:%lu", 1UL << (m->shift + b), (unsigned long)w[b]);
+        }
+        CLI_IF_Print("\r\n");
+    }
+}
+
+static void metrics_cmd_reset(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    Metrics_Reset();
+    CLI_IF_Print("Metrics cleared.\r\n");
+}
+
+#if TLM_STREAM_ENABLE
+/**
+ * Binary frames on the telemetry stream (tlm_stream.h framing):
+ *
+ *   'N' version (u8), index (u8), count (u8), kind (u8), words (u8),
+ *       shift (u8), name (u8 length + text), unit (u8 length + text)
+ *       one per metric
+ *   'V' tick ms (u32), first word (u16), total words (u16), then up to
+ *       METRICS_DUMP_WORDS words (u32) of the snapshot, all little-endian
+ */
+static void metrics_cmd_dump(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint8_t  raw[TLM_FRAME_MAX + 2U];
+    uint32_t frames = 0U;
+    uint32_t failed = 0U;
+
+    for (uint32_t id = 0U; id < METRICS_COUNT; ++id)
+    {
+        const Metrics_Info_t *m    = &s_metricsInfo[id];
+        size_t                nlen = strnlen(m->name, METRICS_TEXT_MAX);
+        size_t                ulen = strnlen(m->unit, METRICS_TEXT_MAX);
+        uint32_t              n    = 0U;
+
+        raw[n++] = METRICS_FRAME_NAME;
+        raw[n++] = METRICS_DUMP_VERSION;
+        raw[n++] = (uint8_t)id;
+        raw[n++] = (uint8_t)METRICS_COUNT;
+        raw[n++] = m->kind;
+        raw[n++] = m->words;
+        raw[n++] = m->shift;
+        raw[n++] = (uint8_t)nlen;
+        memcpy(&raw[n], m->name, nlen);  n += (uint32_t)nlen;
+        raw[n++] = (uint8_t)ulen;
+        memcpy(&raw[n], m->unit, ulen);  n += (uint32_t)ulen;
+
+        failed += (TlmStream_SendFrame(raw, n) != HAL_OK) ? 1U : 0U;
+        frames++;
+    }
+
+    Metrics_Snapshot(s_metricsSnap);
+
+    uint32_t tick  = HAL_GetTick();
+    uint16_t total = (uint16_t)METRICS_WORDS;
+
+    for (uint32_t first = 0U; first < METRICS_WORDS; first += METRICS_DUMP_WORDS)
+    {
+        uint32_t count = METRICS_WORDS - first;
+        uint16_t at    = (uint16_t)first;
+        uint32_t n     = 0U;
+
+        if (count > METRICS_DUMP_WORDS)
+            count = METRICS_DUMP_WORDS;
+
+        raw[n++] = METRICS_FRAME_VALUES;
+        memcpy(&raw[n], &tick, 4U);                          n += 4U;
+        memcpy(&raw[n], &at, 2U);                            n += 2U;
+        memcpy(&raw[n], &total, 2U);                         n += 2U;
+        memcpy(&raw[n], &s_metricsSnap[first], 4U * count);  n += 4U * count;
+
+        failed += (TlmStream_SendFrame(raw, n) != HAL_OK) ? 1U : 0U;
+        frames++;
+    }
+
+    CLI_IF_Printf("\r\n%lu metrics, %lu words in %lu frames", (unsigned long)METRICS_COUNT,
+                  (unsigned long)METRICS_WORDS, (unsigned long)frames);
+    if (failed != 0U)
+        CLI_IF_Printf(", %lu dropped by the telemetry ring", (unsigned long)failed);
+    CLI_IF_Print("\r\n");
+}
+#endif
+
+static const CliCommand_t s_metricsCmds[] =
+{
+    { "metrics",       "", 0U, metrics_cmd_show,  "counters, gauges and histograms" },
+    { "metrics reset", "", 0U, metrics_cmd_reset, "clear the metrics" },
+#if TLM_STREAM_ENABLE
+    { "metrics dump",  "", 0U, metrics_cmd_dump,
+      "metrics as telemetry frames (tools/metrics_dump.py)" },
+#endif
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void Metrics_Init(void)
+{
+    Metrics_Reset();
+    CLI_IF_REGISTER_TABLE(s_metricsCmds);
+}
+
+const Metrics_Info_t *Metrics_GetInfo(uint32_t id)
+{
+    return (id < METRICS_COUNT) ? &s_metricsInfo[id] : NULL;
+}
+
+void Metrics_Snapshot(uint32_t *out)
+{
+    for (uint32_t i = 0U; i < METRICS_WORDS; ++i)
+        out[i] = g_metrics[i];
+}
+
+uint16_t Metrics_Read(uint32_t id, uint8_t *out)
+{
+    if (id >= METRICS_COUNT)
+        return 0U;
+
+    const Metrics_Info_t *m = &s_metricsInfo[id];
+
+    for (uint32_t i = 0U; i < m->words; ++i)
+    {
+        uint32_t v = g_metrics[m->slot + i];
+
+        out[(4U * i) + 0U] = (uint8_t)(v >> 24);
+        out[(4U * i) + 1U] = (uint8_t)(v >> 16);
+        out[(4U * i) + 2U] = (uint8_t)(v >> 8);
+        out[(4U * i) + 3U] = (uint8_t)v;
+    }
+    return (uint16_t)(4U * m->words);
+}
+
+void Metrics_Reset(void)
+{
+    for (uint32_t i = 0U; i < METRICS_WORDS; ++i)
+        g_metrics[i] = 0U;
+}
@@ -0,0 +1,582 @@
+/**
+ * @file    micro_bench.c
+ * @brief   On-target microbenchmark registry, MicroBenchTask and
+ *          "bench micro".
+ */
+
+#include "micro_bench.h"
+
+#if MICRO_BENCH_ENABLE
+
+#include "can_e2e.h"
+#include "aes_cmac.h"
+#include "can_if.h"
+#include "can_ring.h"
+#include "can_signals.h"
+#include "clock_cfg.h"
+#include "dma_copy.h"
+#include "cli_if.h"
+#include "fmt.h"
+#include "image_header.h"
+#include "log.h"
+#include "lut.h"
+#include "mem_pool.h"
+#include "powertrain.h"
+#include "sys_config.h"
+#include "vehicle.h"
+#include "cmsis_os2.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/** Thread flags of MicroBenchTask: run request, and the flags benchmark. */
+#define MB_FLAG_RUN         0x0001U
+#define MB_FLAG_BENCH       0x0002U
+
+/** Lines per log batch: all of them must fit the ring at once. */
+#define MB_LOG_OPS          16U
+
+/** Ticks a log batch waits at most for the ring to drain. */
+#define MB_DRAIN_TICKS      50U
+
+/** Ring slots of ring_push_pop. */
+#define MB_RING_SLOTS       16U
+
+/** One benchmark: @p fn performs @p ops operations. */
+typedef struct
+{
+    const char *name;
+    void      (*fn)(uint32_t ops);
+    uint32_t    ops;
+    uint8_t     log;        /* writes log lines: drain the ring first */
+} MicroBench_Entry_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static osThreadId_t     s_mbThread = NULL;
+static osMessageQueueId_t s_mbQueue = NULL;
+static StaticQueue_t    s_mbQueueCb;
+static uint32_t         s_mbQueueMem[SYS_QDEPTH_MicroBench];
+
+static CanRing_t        s_mbRing;
+static CAN_IF_Msg_t     s_mbRingMem[MB_RING_SLOTS];
+
+static VehicleState_t   s_mbVehicle;
+
+/** Copy buffers; the source is one word longer for the unaligned copy. */
+static uint32_t         s_mbSrc[(1024U / 4U) + 1U];
+static uint32_t         s_mbDst[1024U / 4U];
+
+/** Q15 copy of the torque map (0.01 Nm) over int16 axes, for lut_interp2_q15. */
+static const int16_t    s_mbRpmBp[4]  = { 800, 2000, 4000, 6000 };
+static const int16_t    s_mbThrBp[3]  = { 0, 16384, 32767 };
+static uint32_t         s_mbRpmInv[3];
+static uint32_t         s_mbThrInv[2];
+static Lut_AxisQ15_t    s_mbRpmAxis;
+static Lut_AxisQ15_t    s_mbThrAxis;
+static const int16_t    s_mbQ15Map[3 * 4] =
+{
+    0,     0,     0,     0,
+    7000,  11500, 10500, 6000,
+    10000, 19000, 20000, 14000,
+};
+
+/** A bench key for aes128_block and cmac_frame (not the SecOC key). */
+static AesCmac_Key_t    s_mbAesKey;
+
+/** Results land here so the optimizer cannot drop the work. */
+static volatile uint32_t s_mbSink;
+
+/* -------------------------------------------------------------------------- */
+/* Benchmarks                                                                 */
+/* -------------------------------------------------------------------------- */
+
+static void mb_empty(uint32_t ops)
+{
+    for (uint32_t i = 0U; i < ops; ++i)
+        s_mbSink = i;
+}
+
+static void mb_log_const(uint32_t ops)
+{
+    for (uint32_t i = 0U; i < ops; ++i)
+        Log_Write(LOG_LEVEL_INFO, "BENCH", "constant line of a typical length");
+}
+
+static void mb_log_int(uint32_t ops)
+{
+    for (uint32_t i = 0U; i < ops; ++i)
+        Log_Write(LOG_LEVEL_INFO, "BENCH", "id 0x%03lX dlc %lu seq %lu",
+                  (unsigned long)0x123U, (unsigned long)8U, (unsigned long)i);
+}
+
+static void mb_log_str(uint32_t ops)
+{
+    for (uint32_t i = 0U; i < ops; ++i)
+        Log_Write(LOG_LEVEL_INFO, "BENCH", "state %s -> %s", "RUNNING", "DEGRADED");
+}
+
+static void mb_log_float(uint32_t ops)
+{
+    for (uint32_t i = 0U; i < ops; ++i)
+        Log_Write(LOG_LEVEL_INFO, "BENCH", "speed %.2f km/h", (double)s_mbVehicle.speed_kph);
+}
+
+/* The same line through both formatters, integers and a float. */
+#define MB_FMT_LINE  "id 0x%03lX dlc %lu speed %.2f km/h"
+
+#if !FMT_PRINTF
+static void mb_snprintf_newlib(uint32_t ops)
+{
+    char buf[48];
+
+    for (uint32_t i = 0U; i < ops; ++i)
+        s_mbSink = (uint32_t)snprintf(buf, sizeof(buf), MB_FMT_LINE, (unsigned long)0x123U,
+                                      (unsigned long)i, (double)s_mbVehicle.speed_kph);
+}
+#endif
+
+static void mb_snprintf_fmt(uint32_t ops)
+{
+    char buf[48];
+
+    for (uint32_t i = 0U; i < ops; ++i)
+        s_mbSink = (uint32_t)Fmt_Snprintf(buf, sizeof(buf), MB_FMT_LINE, (unsigned long)0x123U,
+                                          (unsigned long)i, (double)s_mbVehicle.speed_kph);
+}
+
+static void mb_vehicle_update(uint32_t ops)
+{
+    for (uint32_t i = 0U; i < ops; ++i)
+        Vehicle_Update(&s_mbVehicle, 0.1f);
+    s_mbSink = s_mbVehicle.engine_rpm;
+}
+
+static void mb_lut_interp2_f32(uint32_t ops)
+{
+    float acc = 0.0f;
+
+    for (uint32_t i = 0U; i < ops; ++i)
+        acc += Powertrain_Torque((float)(800U + ((i * 37U) % 5200U)), (float)(i & 7U) * 0.125f);
+    s_mbSink = (uint32_t)acc;
+}
+
+static void mb_lut_interp2_q15(uint32_t ops)
+{
+    int32_t acc = 0;
+
+    for (uint32_t i = 0U; i < ops; ++i)
+        acc += Lut_Interp2Q15(&s_mbRpmAxis, &s_mbThrAxis, s_mbQ15Map,
+                              (int16_t)(800U + ((i * 37U) % 5200U)), (int16_t)((i & 7U) << 12));
+    s_mbSink = (uint32_t)acc;
+}
+
+static void mb_telemetry_pack(uint32_t ops)
+{
+    CanSig_VehicleTelemetry_t m = { .speed_kph = 87.5f, .engine_rpm = 2450U, .coolant_temp_c = 88.2f };
+    uint8_t                   data[8];
+
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        m.engine_rpm = (uint16_t)i;
+        CanSig_VehicleTelemetry_Pack(data, &m);
+        s_mbSink = data[2];
+    }
+}
+
+static void mb_telemetry_unpack(uint32_t ops)
+{
+    CanSig_VehicleTelemetry_t m;
+    uint8_t                   data[8] = { 0x6BU, 0x03U, 0x92U, 0x09U, 0x72U, 0x03U, 0U, 0U };
+
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        data[0] = (uint8_t)i;
+        CanSig_VehicleTelemetry_Unpack(data, &m);
+        s_mbSink = m.engine_rpm;
+    }
+}
+
+static void mb_tripdata_unpack(uint32_t ops)
+{
+    CanSig_TripData_t m;
+    uint8_t           data[8] = { 0U, 0x39U, 0x30U, 0xD0U, 0x1CU, 0x18U, 0x8FU, 0x19U };
+
+    memset(&m, 0, sizeof(m));
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        data[0] = (uint8_t)(i & 1U);
+        s_mbSink = CanSig_TripData_Unpack(data, &m);
+    }
+}
+
+static void mb_e2e_protect(uint32_t ops)
+{
+    uint8_t data[8] = { 0x6BU, 0x03U, 0x92U, 0x09U, 0x72U, 0x03U, 0U, 0U };
+
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        data[0] = (uint8_t)i;
+        (void)CanE2E_Protect(CAN_E2E_TELEMETRY, data, 8U);
+        s_mbSink = data[7];
+    }
+}
+
+static void mb_e2e_round_trip(uint32_t ops)
+{
+    uint8_t data[8] = { 0x6BU, 0x03U, 0x92U, 0x09U, 0x72U, 0x03U, 0U, 0U };
+
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        data[0] = (uint8_t)i;
+
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        (void)CanE2E_Protect(CAN_E2E_TELEMETRY, data, 8U);
+        CanE2E_Sent(CAN_E2E_TELEMETRY);
+        __set_PRIMASK(primask);
+
+        s_mbSink = (uint32_t)CanE2E_Check(CAN_E2E_TELEMETRY, data, 8U);
+    }
+}
+
+static void mb_aes128_block(uint32_t ops)
+{
+    uint8_t block[AES_CMAC_BLOCK] = { 0U };
+
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        block[0] = (uint8_t)i;
+        AesCmac_Encrypt(&s_mbAesKey, block, block);
+    }
+    s_mbSink = block[15];
+}
+
+/* The MAC of one odometer frame (can_secoc.h): data ID, 4 payload bytes
+ * and the 4-byte FV, one padded block. Sending and checking a frame each
+ * cost this much. */
+static void mb_cmac_frame(uint32_t ops)
+{
+    uint8_t msg[10] = { 0x01U, 0x10U, 0x40U, 0xE2U, 0x01U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U };
+    uint8_t mac[AES_CMAC_BLOCK];
+
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        msg[9] = (uint8_t)i;
+        AesCmac_Compute(&s_mbAesKey, msg, sizeof(msg), mac);
+        s_mbSink = mac[0];
+    }
+}
+
+static void mb_ring_push_pop(uint32_t ops)
+{
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        CAN_IF_Msg_t *slot = (CAN_IF_Msg_t *)CanRing_Reserve(&s_mbRing);
+        if (slot != NULL)
+        {
+            slot->Id   = 0x123U;
+            slot->Info = 8U;
+            CanRing_Commit(&s_mbRing);
+        }
+
+        const CAN_IF_Msg_t *msg = (const CAN_IF_Msg_t *)CanRing_Peek(&s_mbRing);
+        if (msg != NULL)
+        {
+            s_mbSink = msg->Id;
+            CanRing_Release(&s_mbRing);
+        }
+    }
+}
+
+static void mb_memcpy_8(uint32_t ops)
+{
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        memcpy(s_mbDst, s_mbSrc, 8U);
+        s_mbSink = s_mbDst[0];
+    }
+}
+
+static void mb_memcpy_64(uint32_t ops)
+{
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        memcpy(s_mbDst, s_mbSrc, 64U);
+        s_mbSink = s_mbDst[0];
+    }
+}
+
+static void mb_memcpy_64u(uint32_t ops)
+{
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        memcpy(s_mbDst, (const uint8_t *)s_mbSrc + 1U, 64U);
+        s_mbSink = s_mbDst[0];
+    }
+}
+
+static void mb_memcpy_1k(uint32_t ops)
+{
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        memcpy(s_mbDst, s_mbSrc, 1024U);
+        s_mbSink = s_mbDst[0];
+    }
+}
+
+static void mb_dma_copy_1k(uint32_t ops)
+{
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        DmaCopy_Memcpy(s_mbDst, s_mbSrc, 1024U);
+        s_mbSink = s_mbDst[0];
+    }
+}
+
+static void mb_pool_alloc_free(uint32_t ops)
+{
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        void *block = MemPool_Alloc(64U);
+        if (block != NULL)
+            (void)MemPool_Free(block);
+    }
+}
+
+static void mb_queue_put_get(uint32_t ops)
+{
+    uint32_t word = 0U;
+
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        (void)osMessageQueuePut(s_mbQueue, &i, 0U, 0U);
+        (void)osMessageQueueGet(s_mbQueue, &word, NULL, 0U);
+    }
+    s_mbSink = word;
+}
+
+static void mb_notify_give_take(uint32_t ops)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        (void)xTaskNotifyGive(self);
+        s_mbSink = ulTaskNotifyTake(pdTRUE, 0U);
+    }
+}
+
+static void mb_flags_set_wait(uint32_t ops)
+{
+    for (uint32_t i = 0U; i < ops; ++i)
+    {
+        (void)osThreadFlagsSet(s_mbThread, MB_FLAG_BENCH);
+        s_mbSink = osThreadFlagsWait(MB_FLAG_BENCH, osFlagsWaitAny, 0U);
+    }
+}
+
+static const MicroBench_Entry_t s_mbEntries[] =
+{
+    { "empty",            mb_empty,            1000U, 0U },
+    { "log_const",        mb_log_const,        MB_LOG_OPS, 1U },
+    { "log_int",          mb_log_int,          MB_LOG_OPS, 1U },
+    { "log_str",          mb_log_str,          MB_LOG_OPS, 1U },
+    { "log_float",        mb_log_float,        MB_LOG_OPS, 1U },
+#if !FMT_PRINTF
+    { "snprintf_newlib",  mb_snprintf_newlib,  500U,  0U },
+#endif
+    { "snprintf_fmt",     mb_snprintf_fmt,     500U,  0U },
+    { "vehicle_update",   mb_vehicle_update,   200U,  0U },
+    { "lut_interp2_f32",  mb_lut_interp2_f32,  500U,  0U },
+    { "lut_interp2_q15",  mb_lut_interp2_q15,  500U,  0U },
+    { "telemetry_pack",   mb_telemetry_pack,   500U,  0U },
+    { "telemetry_unpack", mb_telemetry_unpack, 500U,  0U },
+    { "tripdata_unpack",  mb_tripdata_unpack,  500U,  0U },
+    { "e2e_protect",      mb_e2e_protect,      500U,  0U },
+    { "e2e_round_trip",   mb_e2e_round_trip,   500U,  0U },
+    { "aes128_block",     mb_aes128_block,     200U,  0U },
+    { "cmac_frame",       mb_cmac_frame,       200U,  0U },
+    { "ring_push_pop",    mb_ring_push_pop,    500U,  0U },
+    { "memcpy_8",         mb_memcpy_8,         500U,  0U },
+    { "memcpy_64",        mb_memcpy_64,        200U,  0U },
+    { "memcpy_64u",       mb_memcpy_64u,       200U,  0U },
+    { "memcpy_1k",        mb_memcpy_1k,        20U,   0U },
+    { "dma_copy_1k",      mb_dma_copy_1k,      20U,   0U },
+    { "pool_alloc_free",  mb_pool_alloc_free,  200U,  0U },
+    { "queue_put_get",    mb_queue_put_get,    200U,  0U },
+    { "notify_give_take", mb_notify_give_take, 200U,  0U },
+    { "flags_set_wait",   mb_flags_set_wait,   200U,  0U },
+};
+
+#define MB_ENTRY_COUNT  (sizeof(s_mbEntries) / sizeof(s_mbEntries[0]))
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Wait until LogTask has emptied the log lines and CLI output rings. */
+static void mb_drain_log(void)
+{
+    Log_Stats_t lines;
+    Log_Stats_t cli;
+
+    for (uint32_t t = 0U; t < MB_DRAIN_TICKS; ++t)
+    {
+        Log_GetStats(&lines);
+        Log_GetStreamStats(LOG_STREAM_CLI, &cli);
+        if ((lines.fill == 0U) && (cli.fill == 0U))
+            return;
+        (void)osDelay(1U);
+    }
+}
+
+/** Print "<whole>.<tenth>" of @p cycles / @p ops. */
+static void mb_print_per_op(uint64_t cycles, uint32_t ops)
+{
+    uint64_t tenths = (cycles * 10U + ops / 2U) / ops;
+
+    CLI_IF_Printf(" %lu.%lu", (unsigned long)(tenths / 10U), (unsigned long)(tenths % 10U));
+}
+
+/** Run @p e MICRO_BENCH_BATCHES times and print its report line. */
+static void mb_run_entry(const MicroBench_Entry_t *e)
+{
+    uint32_t best  = UINT32_MAX;
+    uint64_t total = 0U;
+
+    for (uint32_t b = 0U; b < MICRO_BENCH_BATCHES; ++b)
+    {
+        /* Start each batch on a fresh tick, with lower priorities served. */
+        if (e->log != 0U)
+            mb_drain_log();
+        (void)osDelay(1U);
+
+        uint32_t t0     = DWT->CYCCNT;
+        e->fn(e->ops);
+        uint32_t cycles = DWT->CYCCNT - t0;
+
+        total += cycles;
+        if (cycles < best)
+            best = cycles;
+    }
+
+    CLI_IF_Printf("bench %s", e->name);
+    mb_print_per_op(best, e->ops);
+    mb_print_per_op(total, e->ops * MICRO_BENCH_BATCHES);
+    CLI_IF_Printf(" %lu\r\n", (unsigned long)e->ops);
+}
+
+/** Run the registry and print the report. */
+static void mb_run_all(void)
+{
+    uint32_t          ver = g_imageHeader.version;
+    Log_Stats_t       st;
+    Log_TransportId_t lines = Log_GetTransport(LOG_STREAM_LINES);
+
+    CLI_IF_Printf("# micro bench v1\r\n");
+    CLI_IF_Printf("# fw %lu.%lu.%lu dev 0x%03lX rev 0x%04lX core %lu profile %s ws %lu\r\n",
+                  (unsigned long)((ver >> 16) & 0xFFU), (unsigned long)((ver >> 8) & 0xFFU),
+                  (unsigned long)(ver & 0xFFU),
+                  (unsigned long)(DBGMCU->IDCODE & DBGMCU_IDCODE_DEV_ID),
+                  (unsigned long)(DBGMCU->IDCODE >> DBGMCU_IDCODE_REV_ID_Pos),
+                  (unsigned long)SystemCoreClock, ClockCfg_GetActive()->name,
+                  (unsigned long)__HAL_FLASH_GET_LATENCY());
+    mb_drain_log();
+
+    /* Log lines go to RAM for the run, so the log benchmarks measure the
+     * queueing path and not the UART. */
+    (void)Log_SetTransport(LOG_STREAM_LINES, LOG_TRANSPORT_RAM);
+    Log_GetStats(&st);
+    uint32_t dropped = st.droppedLines;
+
+    Vehicle_Init(&s_mbVehicle);
+    Vehicle_SetTargetSpeed(&s_mbVehicle, 80.0f);
+    (void)Lut_AxisInitQ15(&s_mbRpmAxis, s_mbRpmBp, s_mbRpmInv, 4U);
+    (void)Lut_AxisInitQ15(&s_mbThrAxis, s_mbThrBp, s_mbThrInv, 3U);
+    for (uint32_t i = 0U; i < (uint32_t)(sizeof(s_mbSrc) / sizeof(s_mbSrc[0])); ++i)
+        s_mbSrc[i] = i * 0x9E3779B9U;
+
+    for (uint32_t i = 0U; i < MB_ENTRY_COUNT; ++i)
+    {
+        mb_run_entry(&s_mbEntries[i]);
+        mb_drain_log();
+    }
+
+    Log_GetStats(&st);
+    (void)Log_SetTransport(LOG_STREAM_LINES, lines);
+
+    CLI_IF_Printf("# end %lu benchmarks, %lu log lines dropped\r\n",
+                  (unsigned long)MB_ENTRY_COUNT, (unsigned long)(st.droppedLines - dropped));
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief CLI: "bench micro" - run the microbenchmarks again.
+ */
+static void mb_cmd_run(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    (void)osThreadFlagsSet(s_mbThread, MB_FLAG_RUN);
+}
+
+static const CliCommand_t s_mbCmds[] =
+{
+    { "bench micro", "", 0U, mb_cmd_run, "Run the microbenchmarks (cycles per operation)" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef MicroBench_Init(void)
+{
+    const osMessageQueueAttr_t attrs =
+    {
+        .name    = "benchQueue",
+        .cb_mem  = &s_mbQueueCb,
+        .cb_size = sizeof(s_mbQueueCb),
+        .mq_mem  = s_mbQueueMem,
+        .mq_size = sizeof(s_mbQueueMem),
+    };
+
+    s_mbQueue = osMessageQueueNew(SYS_QDEPTH_MicroBench, sizeof(uint32_t), &attrs);
+    if (s_mbQueue == NULL)
+        return HAL_ERROR;
+
+    if (CanRing_Init(&s_mbRing, s_mbRingMem, sizeof(s_mbRingMem[0]), MB_RING_SLOTS) != HAL_OK)
+        return HAL_ERROR;
+
+    static const uint8_t aesKey[AES_CMAC_KEY_LEN] = { 0x4DU, 0x45U, 0x43U, 0x55U };
+    AesCmac_SetKey(&s_mbAesKey, aesKey);
+
+    CLI_IF_REGISTER_TABLE(s_mbCmds);
+
+    return HAL_OK;
+}
+
+void MicroBench_Task(void)
+{
+    s_mbThread = osThreadGetId();
+
+    (void)osDelay(MICRO_BENCH_START_MS);
+
+    for (;;)
+    {
+        mb_run_all();
+        (void)osThreadFlagsWait(MB_FLAG_RUN, osFlagsWaitAny, osWaitForever);
+    }
+}
+
+#endif /* MICRO_BENCH_ENABLE */
@@ -0,0 +1,291 @@
+/**
+ * @file    msg_bus.c
+ * @brief   Topic registry, slot rings, subscriber wake-up and "bus".
+ *
+ * Each topic is a ring of slots indexed by a free-running message count:
+ *
+ *   publisher:  fill slot[head & mask] (the loan), DMB, head++
+ *   reader:     i = index to read (head - 1, or its own position)
+ *               copy slot[i & mask], DMB
+ *               valid if head - i < slots: the publisher has not loaned
+ *               slot i again yet
+ *
+ * head only grows and each topic has one publisher, so neither side ever
+ * waits for the other.
+ */
+
+#include "msg_bus.h"
+#include "cli_if.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define MB_SLOTS_CHECK_(name, type, kind, slots)                                \
+    _Static_assert(((slots) >= 2U) && (((slots) & ((slots) - 1U)) == 0U),      \
+                   "msg bus topic " #name ": slots must be a power of two >= 2");
+MSG_BUS_TOPIC_TABLE(MB_SLOTS_CHECK_)
+
+/** Attempts before a reader gives up on a publisher that laps it each time. */
+#define MB_READ_TRIES       8U
+
+typedef struct
+{
+    const char *name;
+    uint8_t    *storage;
+    uint32_t    size;
+    uint32_t    mask;
+    uint32_t    kind;
+} MbTopicDef_t;
+
+typedef struct
+{
+    osThreadId_t thread;
+    uint32_t     flags;
+    uint32_t     next;          /* index of the next message to receive */
+    uint32_t     lost;
+} MbSub_t;
+
+typedef struct
+{
+    volatile uint32_t head;     /* messages published */
+    volatile uint32_t subCount;
+    uint32_t          wakeups;
+    uint32_t          retries;
+    MbSub_t           subs[MSG_BUS_MAX_SUBS];
+} MbTopic_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+#define MB_STORAGE_(name, type, kind, slots)  static type s_mbSlots_##name[slots];
+MSG_BUS_TOPIC_TABLE(MB_STORAGE_)
+
+#define MB_DEF_(name, type, kind, slots)                                        \
+    [MSG_TOPIC_##name] = { #name, (uint8_t *)s_mbSlots_##name, (uint32_t)sizeof(type), \
+                           (slots) - 1U, (kind) },
+
+static const MbTopicDef_t s_mbDefs[MSG_TOPIC_COUNT] =
+{
+    MSG_BUS_TOPIC_TABLE(MB_DEF_)
+};
+
+static MbTopic_t s_mbTopics[MSG_TOPIC_COUNT];
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t *mb_slot(const MbTopicDef_t *d, uint32_t index)
+{
+    return &d->storage[(index & d->mask) * d->size];
+}
+
+/**
+ * Copy message @p index of topic @p t into @p dst.
+ *
+ * @return 1 if the copy is whole, 0 if the publisher loaned the slot again
+ *         while it was taken (@p dst then holds a mix).
+ */
+static uint8_t mb_copy(MsgBus_Topic_t t, uint32_t index, void *dst)
+{
+    const MbTopicDef_t *d = &s_mbDefs[t];
+
+    memcpy(dst, mb_slot(d, index), d->size);
+    __DMB();
+    return ((s_mbTopics[t].head - index) <= d->mask) ? 1U : 0U;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void mb_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CLI_IF_Print("Topic       Kind    Size  Slots  Published  Wakeups  Retries  Subs (lost)\r\n");
+
+    for (uint32_t t = 0U; t < (uint32_t)MSG_TOPIC_COUNT; ++t)
+    {
+        MsgBus_Stats_t st;
+        (void)MsgBus_GetStats((MsgBus_Topic_t)t, &st);
+
+        CLI_IF_Printf("%-10s  %-6s  %4lu  %5lu  %9lu  %7lu  %7lu  %lu",
+                      st.name, (st.kind == MSG_BUS_QUEUED) ? "queued" : "latest",
+                      (unsigned long)st.size, (unsigned long)st.slots,
+                      (unsigned long)st.published, (unsigned long)st.wakeups,
+                      (unsigned long)st.retries, (unsigned long)st.subscribers);
+        for (uint32_t i = 0U; i < st.subscribers; ++i)
+        {
+            CLI_IF_Printf("%s%lu", (i == 0U) ? " (" : " ",
+                          (unsigned long)MsgBus_Lost((MsgBus_Topic_t)t, (int32_t)i));
+        }
+        CLI_IF_Print((st.subscribers != 0U) ? ")\r\n" : "\r\n");
+    }
+}
+
+static const CliCommand_t s_mbCmds[] =
+{
+    { "bus", "", 0U, mb_cmd_show, "message bus topics and subscribers" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void MsgBus_Init(void)
+{
+    CLI_IF_REGISTER_TABLE(s_mbCmds);
+}
+
+void *MsgBus_Loan(MsgBus_Topic_t topic)
+{
+    const MbTopicDef_t *d = &s_mbDefs[topic];
+
+    return mb_slot(d, s_mbTopics[topic].head);
+}
+
+void MsgBus_Publish(MsgBus_Topic_t topic)
+{
+    MbTopic_t *t = &s_mbTopics[topic];
+
+    __DMB();                    /* the message before the count */
+    t->head++;
+
+    uint32_t n = t->subCount;
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        if (t->subs[i].thread != NULL)
+        {
+            (void)osThreadFlagsSet(t->subs[i].thread, t->subs[i].flags);
+            t->wakeups++;
+        }
+    }
+}
+
+void MsgBus_Write(MsgBus_Topic_t topic, const void *msg)
+{
+    memcpy(MsgBus_Loan(topic), msg, s_mbDefs[topic].size);
+    MsgBus_Publish(topic);
+}
+
+int32_t MsgBus_Subscribe(MsgBus_Topic_t topic, osThreadId_t thread, uint32_t flags)
+{
+    int32_t    sub = -1;
+    MbTopic_t *t   = &s_mbTopics[topic];
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (t->subCount < MSG_BUS_MAX_SUBS)
+    {
+        MbSub_t *s = &t->subs[t->subCount];
+
+        s->thread = thread;
+        s->flags  = flags;
+        s->next   = t->head;
+        s->lost   = 0U;
+        sub = (int32_t)t->subCount;
+        __DMB();
+        t->subCount++;          /* publishes see it complete */
+    }
+    __set_PRIMASK(primask);
+
+    return sub;
+}
+
+HAL_StatusTypeDef MsgBus_Read(MsgBus_Topic_t topic, void *dst)
+{
+    MbTopic_t *t = &s_mbTopics[topic];
+
+    for (uint32_t n = 0U; n < MB_READ_TRIES; ++n)
+    {
+        uint32_t head = t->head;
+        __DMB();
+
+        if (head == 0U)
+        {
+            memset(dst, 0, s_mbDefs[topic].size);
+            return HAL_BUSY;
+        }
+        if (mb_copy(topic, head - 1U, dst) != 0U)
+            return HAL_OK;
+        t->retries++;
+    }
+
+    /* Lapped every time: take the newest under PRIMASK, it cannot move. */
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    (void)mb_copy(topic, t->head - 1U, dst);
+    __set_PRIMASK(primask);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef MsgBus_Receive(MsgBus_Topic_t topic, int32_t sub, void *dst)
+{
+    MbTopic_t          *t = &s_mbTopics[topic];
+    const MbTopicDef_t *d = &s_mbDefs[topic];
+
+    if ((sub < 0) || ((uint32_t)sub >= t->subCount))
+        return HAL_ERROR;
+
+    MbSub_t *s = &t->subs[sub];
+
+    for (;;)
+    {
+        uint32_t head = t->head;
+        __DMB();
+
+        if (s->next == head)
+            return HAL_BUSY;
+
+        if (d->kind == MSG_BUS_LATEST)
+        {
+            s->next = head - 1U;
+        }
+        else if ((head - s->next) > d->mask)
+        {
+            /* Slot next is loaned again: skip to the oldest still whole. */
+            s->lost += (head - s->next) - d->mask;
+            s->next  = head - d->mask;
+        }
+
+        if (mb_copy(topic, s->next, dst) != 0U)
+        {
+            s->next++;
+            return HAL_OK;
+        }
+        t->retries++;
+    }
+}
+
+uint32_t MsgBus_Lost(MsgBus_Topic_t topic, int32_t sub)
+{
+    MbTopic_t *t = &s_mbTopics[topic];
+
+    if ((sub < 0) || ((uint32_t)sub >= t->subCount))
+        return 0U;
+    return t->subs[sub].lost;
+}
+
+HAL_StatusTypeDef MsgBus_GetStats(MsgBus_Topic_t topic, MsgBus_Stats_t *stats)
+{
+    if ((uint32_t)topic >= (uint32_t)MSG_TOPIC_COUNT)
+        return HAL_ERROR;
+
+    const MbTopicDef_t *d = &s_mbDefs[topic];
+    const MbTopic_t    *t = &s_mbTopics[topic];
+
+    stats->name        = d->name;
+    stats->kind        = d->kind;
+    stats->size        = d->size;
+    stats->slots       = d->mask + 1U;
+    stats->published   = t->head;
+    stats->subscribers = t->subCount;
+    stats->wakeups     = t->wakeups;
+    stats->retries     = t->retries;
+    return HAL_OK;
+}
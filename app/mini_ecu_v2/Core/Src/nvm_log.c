@@ -0,0 +1,440 @@
+/**
+ * @file    nvm_log.c
+ * @brief   Two-sector flash log, its clients, NvmTask and "nvm".
+ */
+
+#include "nvm_log.h"
+#include "vehicle_shared.h"
+#include "cli_if.h"
+#include "log.h"
+#include "cmsis_os2.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define NV_MAGIC            0x31435444U     /* "DTC1": the DTC log's format, kept */
+#define NV_ERASED           0xFFFFFFFFU
+#define NV_NO_SECTOR        0xFFU
+#define NV_WORDS            (NVM_LOG_RECORD_SIZE / 4U)
+
+_Static_assert((NVM_LOG_GC_IDLE_PCT > 0U) && (NVM_LOG_GC_IDLE_PCT < 100U),
+               "NVM_LOG_GC_IDLE_PCT must be 1..99");
+
+/* Sector header: magic, generation, ~generation, reserved (erased). */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t generation;
+    uint32_t generationInv;
+    uint32_t reserved;
+} NvmLog_Header_t;
+
+/* Record: key | aux << 16 | tag << 24, data[0], data[1], check word. */
+typedef struct
+{
+    uint32_t w[NV_WORDS];
+} NvmLog_Slot_t;
+
+static const uint32_t s_nvSectorAddr[2] = { NVM_LOG_SECTOR_0_ADDR, NVM_LOG_SECTOR_1_ADDR };
+static const uint32_t s_nvSectorId[2]   = { NVM_LOG_SECTOR_0, NVM_LOG_SECTOR_1 };
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Clients are added before the scheduler starts; the log position and the
+ * figures are NvmTask's after NvmLog_Init(). */
+static const NvmLog_Client_t *s_nvClients[NVM_LOG_MAX_CLIENTS];
+static uint32_t       s_nvClientCount = 0U;
+static uint32_t       s_nvEntries     = 0U;     /* entries of all clients */
+static NvmLog_Stats_t s_nvStats;
+static uint32_t       s_nvNext        = 0U;     /* next free record slot */
+static osThreadId_t   s_nvThread      = NULL;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static const NvmLog_Header_t *nvm_header(uint32_t sector)
+{
+    return (const NvmLog_Header_t *)s_nvSectorAddr[sector];
+}
+
+static const NvmLog_Slot_t *nvm_slot(uint32_t sector, uint32_t slot)
+{
+    return (const NvmLog_Slot_t *)(s_nvSectorAddr[sector] + ((slot + 1U) * NVM_LOG_RECORD_SIZE));
+}
+
+static uint8_t nvm_header_valid(uint32_t sector)
+{
+    const NvmLog_Header_t *h = nvm_header(sector);
+
+    return ((h->magic == NV_MAGIC) && (h->generation == ~h->generationInv)) ? 1U : 0U;
+}
+
+static uint32_t nvm_check(const NvmLog_Slot_t *r)
+{
+    uint32_t c = r->w[0] ^ ((r->w[1] << 11) | (r->w[1] >> 21)) ^
+                 ((r->w[2] << 22) | (r->w[2] >> 10)) ^ NV_MAGIC;
+
+    /* Never the erased value, so a check word not yet programmed fails. */
+    return (c == NV_ERASED) ? 0U : c;
+}
+
+static void nvm_encode(NvmLog_Slot_t *r, uint8_t tag, const NvmLog_Record_t *rec)
+{
+    r->w[0] = (uint32_t)rec->key | ((uint32_t)rec->aux << 16) | ((uint32_t)tag << 24);
+    r->w[1] = rec->data[0];
+    r->w[2] = rec->data[1];
+    r->w[3] = nvm_check(r);
+}
+
+static const NvmLog_Client_t *nvm_find(uint8_t tag)
+{
+    for (uint32_t c = 0U; c < s_nvClientCount; ++c)
+    {
+        if (s_nvClients[c]->tag == tag)
+            return s_nvClients[c];
+    }
+    return NULL;
+}
+
+/** Restore the clients from @p sector and find its first free slot. */
+static void nvm_scan(uint32_t sector)
+{
+    s_nvNext = 0U;
+
+    for (uint32_t slot = 0U; slot < NVM_LOG_SECTOR_RECORDS; ++slot)
+    {
+        const NvmLog_Slot_t *r = nvm_slot(sector, slot);
+
+        if ((r->w[0] == NV_ERASED) && (r->w[1] == NV_ERASED) &&
+            (r->w[2] == NV_ERASED) && (r->w[3] == NV_ERASED))
+            break;
+
+        /* Anything but erased uses the slot, valid or not. */
+        s_nvNext = slot + 1U;
+
+        if (r->w[3] != nvm_check(r))
+        {
+            s_nvStats.torn++;
+            continue;
+        }
+
+        /* A tag nobody claims any more is dropped by the next copy. */
+        const NvmLog_Client_t *client = nvm_find((uint8_t)(r->w[0] >> 24));
+        if (client == NULL)
+            continue;
+
+        NvmLog_Record_t rec;
+        rec.key     = (uint16_t)(r->w[0] & 0xFFFFU);
+        rec.aux     = (uint8_t)((r->w[0] >> 16) & 0xFFU);
+        rec.data[0] = r->w[1];
+        rec.data[1] = r->w[2];
+        client->restore(&rec);
+    }
+}
+
+/**
+ * Program @p n words at @p addr; the busy wait runs from SRAM and the
+ * scheduler is suspended, as in boot_request.c.
+ */
+static HAL_StatusTypeDef nvm_program(uint32_t addr, const uint32_t *words, uint32_t n)
+{
+    HAL_StatusTypeDef status = HAL_OK;
+
+    (void)HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                           FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+    vTaskSuspendAll();
+    for (uint32_t i = 0U; (i < n) && (status == HAL_OK); ++i)
+        status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr + (i * 4U), words[i]);
+    (void)xTaskResumeAll();
+    (void)HAL_FLASH_Lock();
+
+    for (uint32_t i = 0U; (i < n) && (status == HAL_OK); ++i)
+    {
+        if (((const volatile uint32_t *)addr)[i] != words[i])
+            status = HAL_ERROR;
+    }
+
+    if (status != HAL_OK)
+        s_nvStats.errors++;
+    return status;
+}
+
+static HAL_StatusTypeDef nvm_erase(uint32_t sector)
+{
+    FLASH_EraseInitTypeDef erase = {0};
+    uint32_t               sectorError = 0U;
+    HAL_StatusTypeDef      status;
+
+    erase.TypeErase    = FLASH_TYPEERASE_SECTORS;
+    erase.Sector       = s_nvSectorId[sector];
+    erase.NbSectors    = 1U;
+    erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+
+    (void)HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                           FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+    vTaskSuspendAll();
+    status = HAL_FLASHEx_Erase(&erase, &sectorError);
+    (void)xTaskResumeAll();
+    (void)HAL_FLASH_Lock();
+
+    if (status != HAL_OK)
+        s_nvStats.errors++;
+    return status;
+}
+
+/** After a failed copy: every entry still has to reach the log. */
+static void nvm_retry_all(void)
+{
+    for (uint32_t c = 0U; c < s_nvClientCount; ++c)
+    {
+        for (uint32_t i = 0U; i < s_nvClients[c]->count; ++i)
+            s_nvClients[c]->retry(i);
+    }
+}
+
+/**
+ * Copy the live entries into the other sector (or format the first one)
+ * and make it active. On failure the old sector stays active and all
+ * entries are pending again.
+ */
+static HAL_StatusTypeDef nvm_copy(void)
+{
+    uint32_t target = (s_nvStats.sector == 0U) ? 1U : 0U;
+    uint32_t gen    = (s_nvStats.sector == NV_NO_SECTOR) ? 1U : (s_nvStats.generation + 1U);
+    uint32_t slot   = 0U;
+
+    s_nvStats.copies++;
+    if (nvm_erase(target) != HAL_OK)
+    {
+        nvm_retry_all();
+        return HAL_ERROR;
+    }
+
+    for (uint32_t c = 0U; c < s_nvClientCount; ++c)
+    {
+        const NvmLog_Client_t *client = s_nvClients[c];
+
+        for (uint32_t i = 0U; i < client->count; ++i)
+        {
+            NvmLog_Record_t rec;
+            NvmLog_Slot_t   r;
+
+            if (client->take(i, 1U, &rec) == 0U)
+                continue;
+
+            nvm_encode(&r, client->tag, &rec);
+            if (nvm_program((uint32_t)nvm_slot(target, slot), r.w, NV_WORDS) != HAL_OK)
+            {
+                nvm_retry_all();
+                return HAL_ERROR;
+            }
+            slot++;
+            s_nvStats.written++;
+        }
+    }
+
+    const NvmLog_Header_t h = { NV_MAGIC, gen, ~gen, NV_ERASED };
+    if (nvm_program(s_nvSectorAddr[target], (const uint32_t *)&h, 3U) != HAL_OK)
+    {
+        nvm_retry_all();
+        return HAL_ERROR;
+    }
+
+    s_nvStats.sector     = (uint8_t)target;
+    s_nvStats.generation = gen;
+    s_nvNext             = slot;
+    return HAL_OK;
+}
+
+/**
+ * Append the record of entry @p i of @p client, or copy the log if the
+ * sector is full. Returns HAL_ERROR only if that copy failed: the entries
+ * stay pending and the caller should stop for this round rather than
+ * erase again.
+ */
+static HAL_StatusTypeDef nvm_append(const NvmLog_Client_t *client, uint32_t i,
+                                    const NvmLog_Record_t *rec)
+{
+    NvmLog_Slot_t r;
+
+    if (s_nvNext >= NVM_LOG_SECTOR_RECORDS)
+    {
+        /* The copy writes this entry's state as well. */
+        client->retry(i);
+        if (nvm_copy() != HAL_OK)
+        {
+            LOG_ERROR(MAIN, "NVM log copy failed");
+            return HAL_ERROR;
+        }
+        return HAL_OK;
+    }
+
+    nvm_encode(&r, client->tag, rec);
+    if (nvm_program((uint32_t)nvm_slot(s_nvStats.sector, s_nvNext), r.w, NV_WORDS) != HAL_OK)
+    {
+        /* The slot may be half programmed: skip it, retry in the next. */
+        client->retry(i);
+        LOG_ERROR(MAIN, "NVM record write failed at %lu", (unsigned long)s_nvNext);
+    }
+    else
+    {
+        s_nvStats.written++;
+    }
+    s_nvNext++;
+    return HAL_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void nvm_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    NvmLog_Stats_t st;
+
+    NvmLog_GetStats(&st);
+    if (st.sector == NV_NO_SECTOR)
+    {
+        CLI_IF_Print("Log not formatted yet\r\n");
+        return;
+    }
+    CLI_IF_Printf("Log in sector %u, generation %lu: %lu/%u records, %lu clients\r\n",
+                  (unsigned)(st.sector + 2U), (unsigned long)st.generation,
+                  (unsigned long)st.records, (unsigned)NVM_LOG_SECTOR_RECORDS,
+                  (unsigned long)s_nvClientCount);
+    CLI_IF_Printf("Since boot: %lu written, %lu copies, %lu torn, %lu errors\r\n",
+                  (unsigned long)st.written, (unsigned long)st.copies,
+                  (unsigned long)st.torn, (unsigned long)st.errors);
+}
+
+static const CliCommand_t s_nvCmds[] =
+{
+    { "nvm", "", 0U, nvm_cmd_show, "flash log of the DTCs and the calibration" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef NvmLog_Register(const NvmLog_Client_t *client)
+{
+    /* A copy must fit every entry of every client into one sector. */
+    if ((client == NULL) || (client->restore == NULL) || (client->take == NULL) ||
+        (client->retry == NULL) || (s_nvClientCount >= NVM_LOG_MAX_CLIENTS) ||
+        (nvm_find(client->tag) != NULL) ||
+        ((s_nvEntries + client->count) >= NVM_LOG_SECTOR_RECORDS))
+        return HAL_ERROR;
+
+    s_nvClients[s_nvClientCount++] = client;
+    s_nvEntries += client->count;
+    return HAL_OK;
+}
+
+void NvmLog_Init(void)
+{
+    memset(&s_nvStats, 0, sizeof(s_nvStats));
+    s_nvStats.sector = NV_NO_SECTOR;
+
+    /* Highest valid generation; the difference keeps the order across a wrap.
+     * Without a valid sector NvmTask formats one on its first run. */
+    uint8_t v0 = nvm_header_valid(0U);
+    uint8_t v1 = nvm_header_valid(1U);
+
+    if ((v0 != 0U) && ((v1 == 0U) ||
+                       ((int32_t)(nvm_header(0U)->generation - nvm_header(1U)->generation) > 0)))
+        s_nvStats.sector = 0U;
+    else if (v1 != 0U)
+        s_nvStats.sector = 1U;
+
+    if (s_nvStats.sector != NV_NO_SECTOR)
+    {
+        s_nvStats.generation = nvm_header(s_nvStats.sector)->generation;
+        nvm_scan(s_nvStats.sector);
+    }
+
+    CLI_IF_REGISTER_TABLE(s_nvCmds);
+}
+
+void NvmLog_Notify(void)
+{
+    if (s_nvThread != NULL)
+        (void)osThreadFlagsSet(s_nvThread, NVM_LOG_FLAG);
+}
+
+void NvmLog_GetStats(NvmLog_Stats_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *out         = s_nvStats;
+    out->records = s_nvNext;
+    __set_PRIMASK(primask);
+}
+
+void NvmLog_Task(void)
+{
+    /* The first pass runs at once: format, or catch up on what was marked
+     * before the scheduler started. */
+    if (s_nvThread != NULL)
+        (void)osThreadFlagsWait(NVM_LOG_FLAG, osFlagsWaitAny, osWaitForever);
+
+    NvmLog_Service();
+}
+
+void NvmLog_Service(void)
+{
+    if (s_nvThread == NULL)
+        s_nvThread = osThreadGetId();
+
+    if ((s_nvStats.sector == NV_NO_SECTOR) && (nvm_copy() != HAL_OK))
+    {
+        LOG_ERROR(MAIN, "NVM log format failed, DTCs and calibration are not kept");
+        return;
+    }
+
+    for (uint32_t c = 0U; c < s_nvClientCount; ++c)
+    {
+        const NvmLog_Client_t *client = s_nvClients[c];
+
+        for (uint32_t i = 0U; i < client->count; ++i)
+        {
+            NvmLog_Record_t rec;
+
+            if ((client->take(i, 0U, &rec) != 0U) && (nvm_append(client, i, &rec) != HAL_OK))
+                return;
+        }
+    }
+
+    /* Copy early while the vehicle stands, so the erase stall rarely
+     * falls into a drive. */
+    if (s_nvNext >= ((NVM_LOG_SECTOR_RECORDS * NVM_LOG_GC_IDLE_PCT) / 100U))
+    {
+        VehicleState_t vs;
+
+        Vehicle_GetSnapshot(&vs);
+        if ((vs.speed_kph < 0.5f) && (nvm_copy() != HAL_OK))
+            LOG_ERROR(MAIN, "NVM log copy failed");
+    }
+}
+
+void NvmLog_Coop(Coop_t *c)
+{
+    COOP_BEGIN(c);
+    for (;;)
+    {
+        NvmLog_Service();
+        COOP_WAIT_FLAGS(c, NVM_LOG_FLAG, COOP_FOREVER);
+    }
+    COOP_END(c);
+}
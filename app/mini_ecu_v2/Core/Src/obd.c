@@ -0,0 +1,217 @@
+/**
+ * @file    obd.c
+ * @brief   OBD-II service 01 PIDs from the signal cache and "obd".
+ */
+
+#include "obd.h"
+
+#if OBD_ENABLE
+
+#include "cli_if.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/** PID 0x00: which of 0x01..0x20 are answered. */
+#define OBD_PID_SUPPORTED    0x00U
+
+typedef struct
+{
+    uint8_t              pid;
+    uint8_t              len;
+    CanSigCache_Signal_t sig;
+    float                scale;
+    float                offset;
+} Obd_Pid_t;
+
+#define OBD_PID_(pid, sig, len, scale, offset)  { pid, len, sig, scale, offset },
+static const Obd_Pid_t s_obdPids[] = { OBD_PID_TABLE(OBD_PID_) };
+#undef OBD_PID_
+
+#define OBD_PID_COUNT  (sizeof(s_obdPids) / sizeof(s_obdPids[0]))
+
+/* PID n of 0x01..0x20 is bit 32 - n of the PID 0x00 word. */
+#define OBD_PID_BIT_(pid, sig, len, scale, offset) \
+    | ((((pid) >= 0x01U) && ((pid) <= 0x20U)) ? (1UL << (32U - (pid))) : 0UL)
+#define OBD_SUPPORTED_MASK   (0UL OBD_PID_TABLE(OBD_PID_BIT_))
+
+#define OBD_PID_LEN_(pid, sig, len, scale, offset)  _Static_assert((len) <= OBD_PID_MAX_LEN, "PID data too long");
+OBD_PID_TABLE(OBD_PID_LEN_)
+#undef OBD_PID_LEN_
+
+/** What one PID holds ready: data bytes and the update they were made from. */
+typedef struct
+{
+    uint32_t seq;            /**< CanSigCache_Seq() at the encode, 0 = none. */
+    uint32_t timeMs;         /**< Cache time of that update. */
+    uint8_t  data[OBD_PID_MAX_LEN];
+} Obd_Encoded_t;
+
+typedef struct
+{
+    uint32_t requests;
+    uint32_t answered;       /**< PIDs answered. */
+    uint32_t unknown;        /**< PIDs requested this ECU has not. */
+    uint32_t stale;          /**< PIDs left out: no fresh value. */
+    uint32_t encodes;        /**< PIDs made again after an update. */
+} Obd_Stats_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* CanRxTask only (requests), read by "obd" in CliTask; a torn read shows one
+ * wrong figure once. */
+static Obd_Encoded_t s_obdEnc[OBD_PID_COUNT];
+static Obd_Stats_t   s_obdStats;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static int32_t obd_find(uint8_t pid)
+{
+    for (uint32_t i = 0U; i < OBD_PID_COUNT; ++i)
+    {
+        if (s_obdPids[i].pid == pid)
+            return (int32_t)i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Encode PID @p i from the cache again if its signal was updated
+ *        since the last time.
+ */
+static void obd_refresh(uint32_t i)
+{
+    const Obd_Pid_t *p   = &s_obdPids[i];
+    Obd_Encoded_t   *enc = &s_obdEnc[i];
+
+    if (CanSigCache_Seq(p->sig) == enc->seq)
+        return;
+
+    CanSigCache_Entry_t e;
+    (void)CanSigCache_Read(p->sig, &e);
+
+    float    max = (p->len == 1U) ? 255.0f : 65535.0f;
+    float    v   = ((e.value + p->offset) * p->scale) + 0.5f;
+    uint32_t raw = (v <= 0.0f) ? 0U : ((v >= max) ? (uint32_t)max : (uint32_t)v);
+
+    for (uint32_t b = 0U; b < p->len; ++b)
+        enc->data[b] = (uint8_t)(raw >> (8U * (p->len - 1U - b)));
+    enc->timeMs = e.timeMs;
+    enc->seq    = e.seq;
+    s_obdStats.encodes++;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void obd_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t now = HAL_GetTick();
+
+    CLI_IF_Printf("Service 01, PIDs 00-20 supported: %08lX\r\n", (unsigned long)OBD_SUPPORTED_MASK);
+    CLI_IF_Print("PID  signal           data      age ms\r\n");
+    for (uint32_t i = 0U; i < OBD_PID_COUNT; ++i)
+    {
+        const Obd_Encoded_t *enc = &s_obdEnc[i];
+        char                 hex[(2U * OBD_PID_MAX_LEN) + 1U];
+        uint32_t             n = 0U;
+
+        for (uint32_t b = 0U; b < s_obdPids[i].len; ++b)
+        {
+            static const char digits[] = "0123456789ABCDEF";
+
+            hex[n++] = digits[enc->data[b] >> 4];
+            hex[n++] = digits[enc->data[b] & 0x0FU];
+        }
+        hex[n] = '\0';
+
+        if (enc->seq == 0U)
+            CLI_IF_Printf("%02X   %-16s %-8s  ---\r\n", (unsigned)s_obdPids[i].pid,
+                          CanSigCache_Name(s_obdPids[i].sig), "-");
+        else
+            CLI_IF_Printf("%02X   %-16s %-8s  %lu\r\n", (unsigned)s_obdPids[i].pid,
+                          CanSigCache_Name(s_obdPids[i].sig), hex,
+                          (unsigned long)(now - enc->timeMs));
+    }
+    CLI_IF_Printf("Requests %lu: PIDs answered %lu, unknown %lu, stale %lu; encodes %lu\r\n",
+                  (unsigned long)s_obdStats.requests, (unsigned long)s_obdStats.answered,
+                  (unsigned long)s_obdStats.unknown, (unsigned long)s_obdStats.stale,
+                  (unsigned long)s_obdStats.encodes);
+}
+
+static const CliCommand_t s_obdCmds[] =
+{
+    { "obd", "", 0U, obd_cmd_show, "OBD-II service 01 PIDs and request counts" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void Obd_Init(void)
+{
+    memset(s_obdEnc, 0, sizeof(s_obdEnc));
+    memset(&s_obdStats, 0, sizeof(s_obdStats));
+
+    CLI_IF_REGISTER_TABLE(s_obdCmds);
+}
+
+uint16_t Obd_CurrentData(const uint8_t *pids, uint16_t count, uint8_t *out)
+{
+    uint32_t now = HAL_GetTick();
+    uint16_t pos = 0U;
+
+    s_obdStats.requests++;
+
+    for (uint16_t k = 0U; k < count; ++k)
+    {
+        uint8_t pid = pids[k];
+
+        if (pid == OBD_PID_SUPPORTED)
+        {
+            out[pos]      = pid;
+            out[pos + 1U] = (uint8_t)(OBD_SUPPORTED_MASK >> 24);
+            out[pos + 2U] = (uint8_t)(OBD_SUPPORTED_MASK >> 16);
+            out[pos + 3U] = (uint8_t)(OBD_SUPPORTED_MASK >> 8);
+            out[pos + 4U] = (uint8_t)OBD_SUPPORTED_MASK;
+            pos = (uint16_t)(pos + 5U);
+            s_obdStats.answered++;
+            continue;
+        }
+
+        int32_t i = obd_find(pid);
+        if (i < 0)
+        {
+            s_obdStats.unknown++;
+            continue;
+        }
+
+        obd_refresh((uint32_t)i);
+
+        const Obd_Encoded_t *enc = &s_obdEnc[i];
+        if ((enc->seq == 0U) || ((now - enc->timeMs) > CAN_SIGCACHE_STALE_MS))
+        {
+            s_obdStats.stale++;
+            continue;
+        }
+
+        out[pos] = pid;
+        memcpy(&out[pos + 1U], enc->data, s_obdPids[i].len);
+        pos = (uint16_t)(pos + 1U + s_obdPids[i].len);
+        s_obdStats.answered++;
+    }
+
+    return pos;
+}
+
+#endif /* OBD_ENABLE */
@@ -0,0 +1,453 @@
+/**
+ * @file    pc_prof.c
+ * @brief   PC-sampling profiler: TIM6 sample handler, bins and "prof".
+ *
+ * TIM6 is a basic timer on APB1 counting at 1 MHz; its update interrupt
+ * is the sample. The handler is entered naked (PC_PROF_TIM6_ENTRY()) so
+ * that it sees the exception frame of the code it interrupted, and runs
+ * from SRAM: a flash wait state in it would cost every sample.
+ */
+
+#include "pc_prof.h"
+
+#if PC_PROF_ENABLE
+
+#include "clock_cfg.h"
+#include "cli_if.h"
+#include "fmt.h"
+#include "log.h"
+#include "ramfunc.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* Stacked exception frame: R0-R3, R12, LR, PC, xPSR. */
+#define PP_FRAME_PC         6U
+#define PP_FRAME_XPSR       7U
+#define PP_XPSR_EXC_MASK    0x1FFU
+
+/** 16 system exceptions plus the device interrupts up to FMPI2C1_ER. */
+#define PP_EXC_COUNT        (16U + (uint32_t)FMPI2C1_ER_IRQn + 1U)
+
+#define PP_REGIONS          2U
+#define PP_TOP_BINS         10U
+#define PP_TOP_EXC          6U
+#define PP_DUMP_CHUNK       512U
+#define PP_DUMP_LINE_MAX    48U     /* longest dump line */
+#define PP_DUMP_TIMEOUT_MS  1000U
+
+_Static_assert(PC_PROF_PERIOD_US >= PC_PROF_MIN_US, "PC_PROF_PERIOD_US too short");
+_Static_assert(PC_PROF_PERIOD_US <= PC_PROF_MAX_US, "PC_PROF_PERIOD_US too long");
+
+/** A code range and its bins. */
+typedef struct
+{
+    const char *name;
+    uint32_t    base;
+    uint32_t    span;           /* bytes from base */
+    uint32_t    shift;          /* bin width 1 << shift */
+    uint32_t   *bins;
+    uint32_t    count;
+} PcProf_Region_t;
+
+/* Startup code and linker script. */
+extern const uint32_t g_pfnVectors[];
+extern uint32_t _etext;
+extern uint32_t _sramfunc;
+extern uint32_t _eramfunc;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Counted by the handler only; CliTask clears them with TIM6 stopped. */
+static uint32_t        s_ppTextBins[PC_PROF_TEXT_BINS];
+static uint32_t        s_ppRamBins[PC_PROF_RAM_BINS];
+static uint32_t        s_ppExc[PP_EXC_COUNT];
+static PcProf_Stats_t  s_ppStats;
+
+/* SRAM code first: with the RAM linker script it lies inside "text". */
+static PcProf_Region_t s_ppRegions[PP_REGIONS] =
+{
+    { "ramfunc", 0U, 0U, 0U, s_ppRamBins,  PC_PROF_RAM_BINS  },
+    { "text",    0U, 0U, 0U, s_ppTextBins, PC_PROF_TEXT_BINS },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static void pp_region_set(PcProf_Region_t *r, uint32_t start, uint32_t end)
+{
+    uint32_t shift = PC_PROF_MIN_SHIFT;
+
+    while ((r->count << shift) < (end - start))
+        shift++;
+
+    r->base  = start;
+    r->span  = end - start;
+    r->shift = shift;
+}
+
+/** TIM6 counts at 1 MHz, one update per @p periodUs. */
+static uint32_t pp_psc(void)
+{
+    return (ClockCfg_TimerHz() / 1000000U) - 1U;
+}
+
+static uint32_t pp_percent_x10(uint32_t part, uint32_t whole)
+{
+    return (whole == 0U) ? 0U : (uint32_t)(((uint64_t)part * 1000U) / whole);
+}
+
+/**
+ * Index of the largest nonzero count in @p counts[first..n-1] below
+ * @p limit, or equal to it after index @p after: called with the previous
+ * result, it walks the counts largest first. @p n if none is left.
+ */
+static uint32_t pp_next(const uint32_t *counts, uint32_t first, uint32_t n, uint32_t limit,
+                        uint32_t after, uint32_t *value)
+{
+    uint32_t best = n;
+
+    *value = 0U;
+    for (uint32_t i = first; i < n; ++i)
+    {
+        uint32_t v = counts[i];
+
+        if ((v == 0U) || (v > limit) || ((v == limit) && (i <= after)))
+            continue;
+        if ((best == n) || (v > *value))
+        {
+            best   = i;
+            *value = v;
+        }
+    }
+    return best;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void pp_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    PcProf_Stats_t st;
+
+    PcProf_GetStats(&st);
+    if (st.samples == 0U)
+    {
+        CLI_IF_Printf("Profiler %s, no samples (prof start [<period us>])\r\n",
+                      (st.running != 0U) ? "running" : "stopped");
+        return;
+    }
+
+    uint32_t ms = ((st.running != 0U) ? HAL_GetTick() : st.stopMs) - st.startMs;
+
+    CLI_IF_Printf("Profiler %s: %lu samples every %lu us over %lu ms\r\n",
+                  (st.running != 0U) ? "running" : "stopped", (unsigned long)st.samples,
+                  (unsigned long)st.periodUs, (unsigned long)ms);
+
+    uint32_t t = pp_percent_x10(st.thread, st.samples);
+    uint32_t o = pp_percent_x10(st.other, st.samples);
+
+    CLI_IF_Printf("Tasks %lu.%lu %%, interrupts %lu.%lu %%, outside the code %lu.%lu %%\r\n",
+                  (unsigned long)(t / 10U), (unsigned long)(t % 10U),
+                  (unsigned long)((1000U - t) / 10U), (unsigned long)((1000U - t) % 10U),
+                  (unsigned long)(o / 10U), (unsigned long)(o % 10U));
+
+    /* Busiest interrupts and system exceptions. */
+    uint32_t limit = UINT32_MAX;
+    uint32_t after = 0U;
+
+    for (uint32_t n = 0U; n < PP_TOP_EXC; ++n)
+    {
+        uint32_t v;
+        uint32_t e = pp_next(s_ppExc, 1U, PP_EXC_COUNT, limit, after, &v);
+        uint32_t p = pp_percent_x10(v, st.samples);
+
+        if (e == PP_EXC_COUNT)
+            break;
+        if (e < 16U)
+            CLI_IF_Printf("  exception %-3lu %7lu  %3lu.%lu %%\r\n", (unsigned long)e,
+                          (unsigned long)v, (unsigned long)(p / 10U), (unsigned long)(p % 10U));
+        else
+            CLI_IF_Printf("  IRQ %-3lu       %7lu  %3lu.%lu %%\r\n", (unsigned long)(e - 16U),
+                          (unsigned long)v, (unsigned long)(p / 10U), (unsigned long)(p % 10U));
+        limit = v;
+        after = e;
+    }
+
+    CLI_IF_Print("Hottest bins:  region   address     bytes  samples\r\n");
+    for (uint32_t r = 0U; r < PP_REGIONS; ++r)
+    {
+        const PcProf_Region_t *reg = &s_ppRegions[r];
+
+        limit = UINT32_MAX;
+        after = 0U;
+        for (uint32_t n = 0U; n < PP_TOP_BINS; ++n)
+        {
+            uint32_t v;
+            uint32_t i = pp_next(reg->bins, 0U, reg->count, limit, after, &v);
+            uint32_t p = pp_percent_x10(v, st.samples);
+
+            if (i == reg->count)
+                break;
+            CLI_IF_Printf("               %-7s  0x%08lX  %5lu  %7lu  %3lu.%lu %%\r\n", reg->name,
+                          (unsigned long)(reg->base + (i << reg->shift)),
+                          (unsigned long)(1UL << reg->shift), (unsigned long)v,
+                          (unsigned long)(p / 10U), (unsigned long)(p % 10U));
+            limit = v;
+            after = i;
+        }
+    }
+    CLI_IF_Print("Functions: prof dump + tools/pc_prof.py --elf\r\n");
+}
+
+static void pp_cmd_start(int argc, char *argv[])
+{
+    uint32_t period = PC_PROF_PERIOD_US;
+
+    if (argc > 0)
+    {
+        char *end;
+
+        period = (uint32_t)strtoul(argv[0], &end, 10);
+        if (*end != '\0')
+            period = 0U;
+    }
+
+    if (PcProf_Start(period) != HAL_OK)
+    {
+        CLI_IF_Printf("Period must be %u..%u us\r\n", (unsigned)PC_PROF_MIN_US,
+                      (unsigned)PC_PROF_MAX_US);
+        return;
+    }
+    CLI_IF_Printf("Profiler sampling every %lu us (%lu Hz)\r\n", (unsigned long)period,
+                  (unsigned long)(1000000U / period));
+}
+
+static void pp_cmd_stop(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    PcProf_Stats_t st;
+
+    PcProf_Stop();
+    PcProf_GetStats(&st);
+    CLI_IF_Printf("Profiler stopped, %lu samples\r\n", (unsigned long)st.samples);
+}
+
+/** "prof dump" output: lines gathered into a chunk for Log_Send(). */
+typedef struct
+{
+    char     buf[PP_DUMP_CHUNK];
+    uint32_t len;
+    uint32_t lines;
+    uint8_t  ok;
+} PcProf_Dump_t;
+
+static void pp_flush(PcProf_Dump_t *d)
+{
+    if ((d->ok != 0U) && (d->len > 0U) &&
+        (Log_Send(LOG_STREAM_CLI, d->buf, d->len, PP_DUMP_TIMEOUT_MS) != HAL_OK))
+    {
+        d->ok = 0U;
+    }
+    d->len = 0U;
+}
+
+static void pp_line(PcProf_Dump_t *d, const char *fmt, ...)
+{
+    va_list ap;
+
+    if ((d->len + PP_DUMP_LINE_MAX) > sizeof(d->buf))
+        pp_flush(d);
+    if (d->ok == 0U)
+        return;
+
+    va_start(ap, fmt);
+    d->len += (uint32_t)FMT_VSNPRINTF(&d->buf[d->len], sizeof(d->buf) - d->len, fmt, ap);
+    va_end(ap);
+    d->lines++;
+}
+
+/**
+ * Text lines, sent through Log_Send() a chunk at a time so that none is
+ * dropped however many bins are set:
+ *
+ *   prof dump <period us> <samples> <thread> <other>
+ *   prof region <name> <base> <bin bytes> <bins>
+ *   prof bin <address> <samples>        nonzero bins only
+ *   prof exc <exception> <samples>      nonzero exceptions only
+ *   prof end <lines>
+ */
+static void pp_cmd_dump(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    /* CliTask only: kept off its stack. */
+    static PcProf_Dump_t d;
+    PcProf_Stats_t       st;
+
+    PcProf_GetStats(&st);
+    d.len   = 0U;
+    d.lines = 0U;
+    d.ok    = 1U;
+
+    pp_line(&d, "prof dump %lu %lu %lu %lu\r\n", (unsigned long)st.periodUs,
+            (unsigned long)st.samples, (unsigned long)st.thread, (unsigned long)st.other);
+
+    for (uint32_t r = 0U; r < PP_REGIONS; ++r)
+    {
+        const PcProf_Region_t *reg = &s_ppRegions[r];
+
+        pp_line(&d, "prof region %s %08lX %lu %lu\r\n", reg->name, (unsigned long)reg->base,
+                (unsigned long)(1UL << reg->shift), (unsigned long)reg->count);
+        for (uint32_t i = 0U; i < reg->count; ++i)
+        {
+            if (reg->bins[i] != 0U)
+                pp_line(&d, "prof bin %08lX %lu\r\n",
+                        (unsigned long)(reg->base + (i << reg->shift)), (unsigned long)reg->bins[i]);
+        }
+    }
+
+    for (uint32_t e = 0U; e < PP_EXC_COUNT; ++e)
+    {
+        if (s_ppExc[e] != 0U)
+            pp_line(&d, "prof exc %lu %lu\r\n", (unsigned long)e, (unsigned long)s_ppExc[e]);
+    }
+
+    pp_line(&d, "prof end %lu\r\n", (unsigned long)(d.lines + 1U));
+    pp_flush(&d);
+
+    if (d.ok == 0U)
+        CLI_IF_Print("\r\nProfile dump aborted: output not draining\r\n");
+}
+
+static const CliCommand_t s_ppCmds[] =
+{
+    { "prof",       "",              0U, pp_cmd_show,
+      "PC-sampling profile: where the CPU goes" },
+    { "prof start", "[<period us>]", 0U, pp_cmd_start,
+      "clear the profile and sample the PC" },
+    { "prof stop",  "",              0U, pp_cmd_stop,
+      "stop sampling, keep the profile" },
+    { "prof dump",  "",              0U, pp_cmd_dump,
+      "profile bins for tools/pc_prof.py" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef PcProf_Init(void)
+{
+    pp_region_set(&s_ppRegions[0], (uint32_t)&_sramfunc, (uint32_t)&_eramfunc);
+    pp_region_set(&s_ppRegions[1], (uint32_t)g_pfnVectors, (uint32_t)&_etext);
+
+    __HAL_RCC_TIM6_CLK_ENABLE();
+
+    TIM6->CR1  = 0U;
+    TIM6->PSC  = pp_psc();
+    TIM6->ARR  = PC_PROF_PERIOD_US - 1U;
+    TIM6->EGR  = TIM_EGR_UG;
+    TIM6->SR   = 0U;
+    TIM6->DIER = TIM_DIER_UIE;
+
+    /* Above every interrupt, and above BASEPRI: no RTOS API in the handler. */
+    HAL_NVIC_SetPriority(TIM6_DAC_IRQn, PC_PROF_IRQ_PRIO, 0U);
+    HAL_NVIC_EnableIRQ(TIM6_DAC_IRQn);
+
+    CLI_IF_REGISTER_TABLE(s_ppCmds);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef PcProf_Start(uint32_t periodUs)
+{
+    if ((periodUs < PC_PROF_MIN_US) || (periodUs > PC_PROF_MAX_US))
+        return HAL_ERROR;
+
+    PcProf_Stop();
+
+    memset(s_ppTextBins, 0, sizeof(s_ppTextBins));
+    memset(s_ppRamBins, 0, sizeof(s_ppRamBins));
+    memset(s_ppExc, 0, sizeof(s_ppExc));
+    memset(&s_ppStats, 0, sizeof(s_ppStats));
+    s_ppStats.periodUs = periodUs;
+    s_ppStats.startMs  = HAL_GetTick();
+    s_ppStats.running  = 1U;
+
+    TIM6->PSC = pp_psc();
+    TIM6->ARR = periodUs - 1U;
+    TIM6->EGR = TIM_EGR_UG;     /* loads PSC; UIF cleared below */
+    TIM6->CNT = 0U;
+    TIM6->SR  = 0U;
+    TIM6->CR1 = TIM_CR1_URS | TIM_CR1_CEN;
+    return HAL_OK;
+}
+
+void PcProf_Stop(void)
+{
+    if (s_ppStats.running == 0U)
+        return;
+
+    TIM6->CR1 &= ~TIM_CR1_CEN;
+    TIM6->SR   = 0U;
+    NVIC_ClearPendingIRQ(TIM6_DAC_IRQn);
+
+    s_ppStats.stopMs  = HAL_GetTick();
+    s_ppStats.running = 0U;
+}
+
+void PcProf_GetStats(PcProf_Stats_t *stats)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *stats = s_ppStats;
+    __set_PRIMASK(primask);
+}
+
+void PcProf_ClockChanged(void)
+{
+    if (s_ppStats.running != 0U)
+        ClockCfg_RetimeTimer(TIM6, pp_psc(), s_ppStats.periodUs - 1U);
+}
+
+RAMFUNC void PcProf_Sample(const uint32_t *frame)
+{
+    uint32_t pc  = frame[PP_FRAME_PC];
+    uint32_t exc = frame[PP_FRAME_XPSR] & PP_XPSR_EXC_MASK;
+
+    TIM6->SR = ~TIM_SR_UIF;
+
+    s_ppStats.samples++;
+    if (exc == 0U)
+        s_ppStats.thread++;
+    if (exc < PP_EXC_COUNT)
+        s_ppExc[exc]++;
+
+    for (uint32_t r = 0U; r < PP_REGIONS; ++r)
+    {
+        const PcProf_Region_t *reg = &s_ppRegions[r];
+        uint32_t               off = pc - reg->base;
+
+        if (off < reg->span)
+        {
+            reg->bins[off >> reg->shift]++;
+            return;
+        }
+    }
+    s_ppStats.other++;
+}
+
+#endif /* PC_PROF_ENABLE */
@@ -0,0 +1,316 @@
+/**
+ * @file    pedal.c
+ * @brief   B1 edge interrupt, TIM7 debounce, pedal position and "pedal";
+ *          or the analogue pedal sensor's hysteresis and fail-safe.
+ */
+
+#include "pedal.h"
+#include "cli_if.h"
+#include "clock_cfg.h"
+#include "msg_bus.h"
+#include "sys_config.h"
+#include "cmsis_os2.h"
+#include "FreeRTOS.h"
+
+_Static_assert((PEDAL_DEBOUNCE_MS >= 1U) && (PEDAL_DEBOUNCE_MS <= 6000U),
+               "PEDAL_DEBOUNCE_MS must be 1..6000");
+_Static_assert((PEDAL_RAMP_UP_MS > 0U) && (PEDAL_RAMP_DOWN_MS > 0U),
+               "pedal ramps must be non-zero");
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define PD_EXTI_LINE        B1_Pin      /* EXTI line n = pin n */
+#define PD_TIM_HZ           10000U      /* TIM7 count rate */
+#define PD_FULL             1000U       /* position in permille */
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Written by the EXTI and TIM7 handlers (same priority, no nesting), or
+ * by Pedal_OnSensor() under PRIMASK (ADC source); readers copy under
+ * PRIMASK. */
+static uint8_t  s_pdPressed    = 0U;
+static uint32_t s_pdEdgeTick   = 0U;    /* last debounced edge */
+static uint32_t s_pdEdgePos    = 0U;    /* position at that edge, permille */
+static uint32_t s_pdPressTick  = 0U;
+static uint32_t s_pdPresses    = 0U;
+static uint32_t s_pdBounces    = 0U;
+static uint32_t s_pdLastPress  = 0U;
+
+#if PEDAL_SOURCE == PEDAL_SOURCE_B1
+static uint32_t s_pdFirstTick  = 0U;    /* first edge of the current burst */
+#else
+static uint32_t s_pdSensorPos  = 0U;    /* permille */
+static uint8_t  s_pdFault      = 1U;    /* until the first valid block */
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+#if PEDAL_SOURCE == PEDAL_SOURCE_B1
+static uint8_t pedal_pin_pressed(void)
+{
+    return ((B1_GPIO_Port->IDR & B1_Pin) == 0U) ? 1U : 0U;
+}
+#endif
+
+/** Position at @p tick on the current ramp (permille). */
+static uint32_t pedal_position(uint32_t tick)
+{
+#if PEDAL_SOURCE == PEDAL_SOURCE_ADC
+    (void)tick;
+    return s_pdSensorPos;
+#else
+    uint32_t dt = tick - s_pdEdgeTick;
+
+    if (s_pdPressed != 0U)
+    {
+        if (dt >= PEDAL_RAMP_UP_MS)
+            return PD_FULL;
+
+        uint32_t pos = s_pdEdgePos + ((dt * PD_FULL) / PEDAL_RAMP_UP_MS);
+        return (pos < PD_FULL) ? pos : PD_FULL;
+    }
+
+    if (dt >= PEDAL_RAMP_DOWN_MS)
+        return 0U;
+
+    uint32_t down = (dt * PD_FULL) / PEDAL_RAMP_DOWN_MS;
+    return (s_pdEdgePos > down) ? (s_pdEdgePos - down) : 0U;
+#endif
+}
+
+#if PEDAL_SOURCE == PEDAL_SOURCE_B1
+/** Mask the line and let TIM7 time the bounce burst starting at @p tick. */
+static void pedal_arm(uint32_t tick)
+{
+    EXTI->IMR    &= ~PD_EXTI_LINE;
+    s_pdFirstTick = tick;
+    TIM7->CNT     = 0U;
+    TIM7->CR1    |= TIM_CR1_CEN;
+}
+#endif
+
+/** Take a debounced edge into the state (interrupt context or PRIMASK). */
+static void pedal_take(uint8_t pressed, uint32_t tick)
+{
+    s_pdEdgePos  = pedal_position(tick);
+    s_pdEdgeTick = tick;
+    s_pdPressed  = pressed;
+
+    if (pressed != 0U)
+    {
+        s_pdPresses++;
+        s_pdPressTick = tick;
+    }
+    else
+    {
+        s_pdLastPress = tick - s_pdPressTick;
+    }
+}
+
+static void pedal_publish(uint8_t pressed, uint32_t tick, uint32_t heldMs)
+{
+    Pedal_Event_t *ev = MsgBus_Loan(MSG_TOPIC_PEDAL);
+
+    ev->pressed = pressed;
+    ev->tick    = tick;
+    ev->heldMs  = (pressed != 0U) ? 0U : heldMs;
+    MsgBus_Publish(MSG_TOPIC_PEDAL);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void pedal_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    Pedal_State_t st;
+
+    Pedal_Get(&st);
+
+    CLI_IF_Printf("Pedal %s, throttle %.1f %%, last edge %lu ms ago\r\n",
+                  (st.pressed != 0U) ? "pressed" : "released", (double)(st.throttle * 100.0f),
+                  (unsigned long)(osKernelGetTickCount() - st.edgeTick));
+#if PEDAL_SOURCE == PEDAL_SOURCE_ADC
+    CLI_IF_Printf("%lu presses, last %lu ms; sensor PC0 (ADC1 IN10) %s, "
+                  "pressed above %.1f %%, released below %.1f %%\r\n",
+                  (unsigned long)st.presses, (unsigned long)st.lastPressMs,
+                  (st.sensorFault != 0U) ? "FAULT, throttle 0" : "ok",
+                  (double)PEDAL_ADC_PRESS_PCT, (double)PEDAL_ADC_RELEASE_PCT);
+#else
+    CLI_IF_Printf("%lu presses, last %lu ms, %lu bounces rejected (debounce %u ms)\r\n",
+                  (unsigned long)st.presses, (unsigned long)st.lastPressMs,
+                  (unsigned long)st.bounces, (unsigned)PEDAL_DEBOUNCE_MS);
+#endif
+}
+
+static const CliCommand_t s_pdCmds[] =
+{
+    { "pedal", "", 0U, pedal_cmd_show, "accelerator pedal state and throttle" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef Pedal_Init(void)
+{
+#if PEDAL_SOURCE == PEDAL_SOURCE_ADC
+    /* The sensor is a vsensor channel; VSensor_Init() sets up the pin. */
+    s_pdPressed  = 0U;
+    s_pdEdgeTick = osKernelGetTickCount();
+#else
+    GPIO_InitTypeDef gpio = {0};
+
+    /* MX_GPIO_Init() arms the falling edge only; the release matters too. */
+    gpio.Pin  = B1_Pin;
+    gpio.Mode = GPIO_MODE_IT_RISING_FALLING;
+    gpio.Pull = GPIO_NOPULL;
+    HAL_GPIO_Init(B1_GPIO_Port, &gpio);
+
+    /* TIM7 one-pulse: counts PEDAL_DEBOUNCE_MS once per start. */
+    __HAL_RCC_TIM7_CLK_ENABLE();
+
+    TIM7->CR1  = TIM_CR1_OPM | TIM_CR1_URS;
+    TIM7->PSC  = (ClockCfg_TimerHz() / PD_TIM_HZ) - 1U;
+    TIM7->ARR  = (PEDAL_DEBOUNCE_MS * (PD_TIM_HZ / 1000U)) - 1U;
+    TIM7->EGR  = TIM_EGR_UG;
+    TIM7->SR   = 0U;
+    TIM7->DIER = TIM_DIER_UIE;
+
+    s_pdPressed  = pedal_pin_pressed();
+    s_pdEdgeTick = osKernelGetTickCount();
+    s_pdEdgePos  = 0U;
+
+    HAL_NVIC_SetPriority(TIM7_IRQn, SYS_IRQ_PRIO_PedalTimer, 0U);
+    HAL_NVIC_EnableIRQ(TIM7_IRQn);
+    __HAL_GPIO_EXTI_CLEAR_IT(PD_EXTI_LINE);
+    HAL_NVIC_SetPriority(EXTI15_10_IRQn, SYS_IRQ_PRIO_Exti15_10, 0U);
+    HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
+#endif
+
+    CLI_IF_REGISTER_TABLE(s_pdCmds);
+
+    return HAL_OK;
+}
+
+void Pedal_ClockChanged(void)
+{
+#if PEDAL_SOURCE == PEDAL_SOURCE_B1
+    uint32_t psc = (ClockCfg_TimerHz() / PD_TIM_HZ) - 1U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    /* An update event would end a running debounce (one-pulse); it then
+       takes the prescaler over at its end, for the next press. */
+    if ((TIM7->CR1 & TIM_CR1_CEN) != 0U)
+        TIM7->PSC = psc;
+    else
+        ClockCfg_RetimeTimer(TIM7, psc, TIM7->ARR);
+    __set_PRIMASK(primask);
+#endif
+}
+
+void Pedal_Get(Pedal_State_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    out->pressed     = s_pdPressed;
+    out->throttle    = (float)pedal_position(osKernelGetTickCount()) / (float)PD_FULL;
+    out->presses     = s_pdPresses;
+    out->bounces     = s_pdBounces;
+    out->edgeTick    = s_pdEdgeTick;
+    out->lastPressMs = s_pdLastPress;
+#if PEDAL_SOURCE == PEDAL_SOURCE_ADC
+    out->sensorFault = s_pdFault;
+#else
+    out->sensorFault = 0U;
+#endif
+
+    __set_PRIMASK(primask);
+}
+
+void Pedal_OnSensor(float pct, uint8_t valid)
+{
+#if PEDAL_SOURCE == PEDAL_SOURCE_ADC
+    uint32_t tick = osKernelGetTickCount();
+    uint32_t pos  = 0U;
+
+    /* Fail-safe: no valid sensor, no throttle. */
+    if (valid != 0U)
+    {
+        if (pct >= 100.0f)
+            pos = PD_FULL;
+        else if (pct > 0.0f)
+            pos = (uint32_t)((pct * ((float)PD_FULL / 100.0f)) + 0.5f);
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t pressed = s_pdPressed;
+    if ((pressed == 0U) && (valid != 0U) && (pct >= PEDAL_ADC_PRESS_PCT))
+        pressed = 1U;
+    else if ((pressed != 0U) && ((valid == 0U) || (pct < PEDAL_ADC_RELEASE_PCT)))
+        pressed = 0U;
+
+    uint8_t edge = (pressed != s_pdPressed) ? 1U : 0U;
+    if (edge != 0U)
+        pedal_take(pressed, tick);
+    s_pdSensorPos = pos;
+    s_pdFault     = (valid != 0U) ? 0U : 1U;
+    uint32_t held = s_pdLastPress;
+    __set_PRIMASK(primask);
+
+    if (edge != 0U)
+        pedal_publish(pressed, tick, held);
+#else
+    (void)pct;
+    (void)valid;
+#endif
+}
+
+void Pedal_ExtiIRQHandler(void)
+{
+    if (__HAL_GPIO_EXTI_GET_IT(PD_EXTI_LINE) == 0U)
+        return;
+
+    __HAL_GPIO_EXTI_CLEAR_IT(PD_EXTI_LINE);
+#if PEDAL_SOURCE == PEDAL_SOURCE_B1
+    pedal_arm(osKernelGetTickCount());
+#endif
+}
+
+void Pedal_TimerIRQHandler(void)
+{
+    TIM7->SR = ~TIM_SR_UIF;
+
+#if PEDAL_SOURCE == PEDAL_SOURCE_B1
+    uint8_t pressed = pedal_pin_pressed();
+
+    if (pressed != s_pdPressed)
+    {
+        pedal_take(pressed, s_pdFirstTick);
+        pedal_publish(pressed, s_pdFirstTick, s_pdLastPress);
+    }
+    else
+    {
+        s_pdBounces++;
+    }
+
+    __HAL_GPIO_EXTI_CLEAR_IT(PD_EXTI_LINE);
+    EXTI->IMR |= PD_EXTI_LINE;
+
+    /* A change while the line was masked has no edge left to report. */
+    if (pedal_pin_pressed() != s_pdPressed)
+        pedal_arm(osKernelGetTickCount());
+#endif
+}
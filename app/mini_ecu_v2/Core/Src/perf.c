@@ -0,0 +1,192 @@
+/**
+ * @file    perf.c
+ * @brief   Probe table and "perf" CLI commands.
+ */
+
+#include "perf.h"
+#include "cli_if.h"
+#include "ramfunc.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static Perf_Stats_t s_perf[PERF_PROBE_COUNT];
+static uint32_t     s_perfOverhead = 0U;
+
+#define PERF_NAME_(name)  #name,
+
+static const char *const s_perfNames[PERF_PROBE_COUNT] =
+{
+    PERF_PROBE_TABLE(PERF_NAME_)
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static void perf_clear(Perf_Stats_t *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->min = UINT32_MAX;
+}
+
+/**
+ * @brief Probe cost with nothing in between; not subtracted from results.
+ */
+static uint32_t perf_measure_overhead(void)
+{
+    uint32_t best = UINT32_MAX;
+
+    for (uint32_t i = 0U; i < 8U; i++)
+    {
+        uint32_t t0 = DWT->CYCCNT;
+        uint32_t d = DWT->CYCCNT - t0;
+        if (d < best)
+            best = d;
+    }
+
+    return best;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void perf_cmd_dump(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t cyclesPerUs = SystemCoreClock / 1000000U;
+    if (cyclesPerUs == 0U)
+        cyclesPerUs = 1U;
+
+    CLI_IF_Printf("Cycles @ %lu MHz, probe overhead %lu (included)\r\n",
+                  (unsigned long)cyclesPerUs, (unsigned long)s_perfOverhead);
+    CLI_IF_Print("Probe              count        min       mean        max  mean_us\r\n");
+
+    for (uint32_t id = 0U; id < PERF_PROBE_COUNT; id++)
+    {
+        Perf_Stats_t st;
+        (void)Perf_Get((perf_id_t)id, &st);
+
+        if (st.count == 0U)
+        {
+            CLI_IF_Printf("%-14s %9s\r\n", s_perfNames[id], "-");
+            continue;
+        }
+
+        uint32_t mean = (uint32_t)(st.sum / st.count);
+        CLI_IF_Printf("%-14s %9lu %10lu %10lu %10lu %8lu\r\n",
+                      s_perfNames[id], (unsigned long)st.count,
+                      (unsigned long)st.min, (unsigned long)mean,
+                      (unsigned long)st.max, (unsigned long)(mean / cyclesPerUs));
+
+        /* Non-empty buckets as "<upper bound>:count". */
+        CLI_IF_Print("  hist");
+        for (uint32_t b = 0U; b < PERF_HIST_BUCKETS; b++)
+        {
+            if (st.hist[b] == 0U)
+                continue;
+
+            if (b == (PERF_HIST_BUCKETS - 1U))
+                CLI_IF_Printf(" >=%lu:%lu", 1UL << (b - 1U), (unsigned long)st.hist[b]);
+            else
+                CLI_IF_Printf(" <%lu:%lu", 1UL << b, (unsigned long)st.hist[b]);
+        }
+        CLI_IF_Print("\r\n");
+    }
+}
+
+static void perf_cmd_reset(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    Perf_Reset();
+    CLI_IF_Print("Perf probes cleared.\r\n");
+}
+
+static const CliCommand_t s_perfCmds[] =
+{
+    { "perf dump",  "", 0U, perf_cmd_dump,  "show hot-path cycle statistics" },
+    { "perf reset", "", 0U, perf_cmd_reset, "clear hot-path statistics" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void Perf_Init(void)
+{
+    /* Also the FreeRTOS run-time stats clock; enabling it twice is harmless. */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    Perf_Reset();
+    s_perfOverhead = perf_measure_overhead();
+
+    CLI_IF_REGISTER_TABLE(s_perfCmds);
+}
+
+RAMFUNC void Perf_Record(perf_id_t id, uint32_t cycles)
+{
+    if ((uint32_t)id >= PERF_PROBE_COUNT)
+        return;
+
+    /* Bucket = bit length of the duration: 0 -> 0, 1 -> 1, 2..3 -> 2, ... */
+    uint32_t b = 32U - __CLZ(cycles);
+    if (b >= PERF_HIST_BUCKETS)
+        b = PERF_HIST_BUCKETS - 1U;
+
+    Perf_Stats_t *st = &s_perf[id];
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    st->count++;
+    st->sum += cycles;
+    if (cycles < st->min)
+        st->min = cycles;
+    if (cycles > st->max)
+        st->max = cycles;
+    st->hist[b]++;
+
+    __set_PRIMASK(primask);
+}
+
+void Perf_Reset(void)
+{
+    for (uint32_t id = 0U; id < PERF_PROBE_COUNT; id++)
+    {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        perf_clear(&s_perf[id]);
+        __set_PRIMASK(primask);
+    }
+}
+
+HAL_StatusTypeDef Perf_Get(perf_id_t id, Perf_Stats_t *out)
+{
+    if (((uint32_t)id >= PERF_PROBE_COUNT) || (out == NULL))
+        return HAL_ERROR;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *out = s_perf[id];
+    __set_PRIMASK(primask);
+
+    return HAL_OK;
+}
+
+const char *Perf_Name(perf_id_t id)
+{
+    return ((uint32_t)id < PERF_PROBE_COUNT) ? s_perfNames[id] : NULL;
+}
+
+uint32_t Perf_Overhead(void)
+{
+    return s_perfOverhead;
+}
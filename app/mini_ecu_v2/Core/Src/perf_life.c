@@ -0,0 +1,440 @@
+/**
+ * @file    perf_life.c
+ * @brief   Lifetime performance counters in NOINIT RAM, their flash log
+ *          client and "perf life".
+ */
+
+#include "perf_life.h"
+#include "nvm_log.h"
+#include "cli_if.h"
+#include "can_if.h"
+#include "can_ring.h"
+#include "can_stats.h"
+#include "crank.h"
+#include "crc.h"
+#include "ctrl_loop.h"
+#include "log.h"
+#include "raster.h"
+#include "rtos_stats.h"
+#include "sram_layout.h"
+#include <stddef.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* Records: key = PL_KEY_BASE + record, aux = PL_REC_VERSION, data = values
+ * 2 x record and 2 x record + 1. */
+#define PL_KEY_BASE         0x0001U
+#define PL_REC_VERSION      1U
+#define PL_REC_COUNT        ((PERF_LIFE_COUNT + 1U) / 2U)
+
+/** Block layout: changes with the table, so a block of another build is
+ *  not taken over. */
+#define PL_LAYOUT           ((1UL << 16) | PERF_LIFE_COUNT)
+
+enum
+{
+    PL_SUM = 0,
+    PL_MAX,
+    PL_MIN,
+    PL_BOOT
+};
+
+#define PL_KIND_(name, kind, unit)  PL_##kind,
+#define PL_NAME_(name, kind, unit)  #name,
+#define PL_UNIT_(name, kind, unit)  unit,
+
+/* Padded to whole records; the pad is a SUM that stays 0. */
+static const uint8_t     s_plKind[PL_REC_COUNT * 2U] = { PERF_LIFE_COUNTER_TABLE(PL_KIND_) };
+static const char *const s_plNames[PERF_LIFE_COUNT]  = { PERF_LIFE_COUNTER_TABLE(PL_NAME_) };
+static const char *const s_plUnits[PERF_LIFE_COUNT]  = { PERF_LIFE_COUNTER_TABLE(PL_UNIT_) };
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t layout;
+    uint32_t value[PL_REC_COUNT * 2U];
+    uint32_t crc;           /* CRC-32/MPEG-2 of the words above */
+} PlBlock_t;
+
+#define PL_CRC_WORDS        ((uint32_t)(offsetof(PlBlock_t, crc) / 4U))
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* The lifetime values; kept over any reset but a power loss. Written under
+ * PRIMASK by the 100 ms raster and PerfLife_Clear(). */
+NOINIT static PlBlock_t s_plBlock;
+
+/* What was last queued for the log (stored, pending = not yet written) and
+ * what the boot scan found in it. Under PRIMASK like the block. */
+static uint32_t s_plStored[PL_REC_COUNT * 2U];
+static uint32_t s_plNvm[PL_REC_COUNT * 2U];
+static uint8_t  s_plPending[PL_REC_COUNT];
+
+/* 100 ms raster: the figures as of the last sample, the block merged. */
+static uint32_t s_plCur[PERF_LIFE_COUNT];
+static uint8_t  s_plStarted = 0U;
+static uint8_t  s_plWarm    = 0U;   /* this boot found a valid block */
+static uint32_t s_plSaveMs  = 0U;
+
+/* Sample buffer of rtos_stats.h, 100 ms raster only. */
+static RtosStats_Task_t s_plTasks[RTOS_STATS_MAX_TASKS];
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t pl_default(uint32_t i)
+{
+    return (s_plKind[i] == PL_MIN) ? UINT32_MAX : 0U;
+}
+
+static uint32_t pl_crc(const PlBlock_t *b)
+{
+    return Crc_Mpeg32(CRC32_INIT, (const uint32_t *)b, PL_CRC_WORDS);
+}
+
+static uint8_t pl_valid(const PlBlock_t *b)
+{
+    return ((b->magic == PERF_LIFE_MAGIC) && (b->layout == PL_LAYOUT) &&
+            (b->crc == pl_crc(b))) ? 1U : 0U;
+}
+
+static void pl_seal(void)
+{
+    s_plBlock.magic  = PERF_LIFE_MAGIC;
+    s_plBlock.layout = PL_LAYOUT;
+    s_plBlock.crc    = pl_crc(&s_plBlock);
+}
+
+static void pl_restore(const NvmLog_Record_t *rec)
+{
+    uint32_t i = (uint32_t)rec->key - PL_KEY_BASE;
+
+    if ((i >= PL_REC_COUNT) || (rec->aux != PL_REC_VERSION))
+        return;
+
+    s_plNvm[2U * i]             = rec->data[0];
+    s_plNvm[(2U * i) + 1U]      = rec->data[1];
+    s_plStored[2U * i]          = rec->data[0];
+    s_plStored[(2U * i) + 1U]   = rec->data[1];
+}
+
+static uint8_t pl_take(uint32_t i, uint8_t all, NvmLog_Record_t *rec)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    /* A record back at its default (a clear) is written once, then dropped. */
+    uint8_t take = (all != 0U)
+                   ? (uint8_t)((s_plStored[2U * i] != pl_default(2U * i)) ||
+                               (s_plStored[(2U * i) + 1U] != pl_default((2U * i) + 1U)))
+                   : s_plPending[i];
+    rec->key     = (uint16_t)(PL_KEY_BASE + i);
+    rec->aux     = PL_REC_VERSION;
+    rec->data[0] = s_plStored[2U * i];
+    rec->data[1] = s_plStored[(2U * i) + 1U];
+    s_plPending[i] = 0U;
+
+    __set_PRIMASK(primask);
+    return take;
+}
+
+static void pl_retry(uint32_t i)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_plPending[i] = 1U;
+    __set_PRIMASK(primask);
+}
+
+static const NvmLog_Client_t s_plClient =
+{
+    .tag     = NVM_LOG_TAG_PERF,
+    .count   = PL_REC_COUNT,
+    .restore = pl_restore,
+    .take    = pl_take,
+    .retry   = pl_retry,
+};
+
+/** The figures now, since boot or their last reset command. */
+static void pl_sample(uint32_t *cur)
+{
+    memset(cur, 0, PERF_LIFE_COUNT * sizeof(cur[0]));
+
+    cur[PERF_LIFE_UPTIME] = HAL_GetTick() / 1000U;
+
+    for (uint32_t r = 0U; r < (uint32_t)RASTER_COUNT; ++r)
+    {
+        Raster_Stats_t rs;
+        if (Raster_GetStats((Raster_Id_t)r, &rs) != HAL_OK)
+            continue;
+        cur[PERF_LIFE_RASTER_OVERRUNS] += rs.overruns;
+        if (rs.maxUs > cur[PERF_LIFE_RASTER_MAX])
+            cur[PERF_LIFE_RASTER_MAX] = rs.maxUs;
+    }
+
+    Raster_RunStats_t run;
+    for (uint32_t i = 0U; Raster_GetRunnable(i, NULL, NULL, &run) == HAL_OK; ++i)
+        cur[PERF_LIFE_BUDGET_OVERS] += run.overBudget;
+
+    CtrlLoop_Stats_t cl;
+    CtrlLoop_GetStats(&cl);
+    cur[PERF_LIFE_CTRL_MISSED]   = cl.missed;
+    cur[PERF_LIFE_CTRL_OVERRUNS] = cl.overruns;
+    cur[PERF_LIFE_CTRL_EXEC_MAX] = cl.exec.maxUs;
+
+    RtosStats_Summary_t sum = {0};
+    uint32_t            n   = RtosStats_Get(s_plTasks, RTOS_STATS_MAX_TASKS, &sum);
+
+    cur[PERF_LIFE_STACK_FREE_MIN] = UINT32_MAX;
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        if (s_plTasks[i].stackFree < cur[PERF_LIFE_STACK_FREE_MIN])
+            cur[PERF_LIFE_STACK_FREE_MIN] = s_plTasks[i].stackFree;
+    }
+    if ((n != 0U) && (sum.windows != 0U) && (sum.idlePermille <= 1000U))
+        cur[PERF_LIFE_CPU_PEAK] = 1000U - sum.idlePermille;
+
+    Log_Stats_t ls;
+    Log_GetStats(&ls);
+    cur[PERF_LIFE_LOG_DROPPED]   = ls.droppedLines;
+    cur[PERF_LIFE_LOG_PEAK_FILL] = ls.peakFill;
+
+    CanStats_Summary_t cs;
+    (void)CanStats_Get(&cs, NULL, 0U);
+    cur[PERF_LIFE_CAN_FIFO_OVERRUNS] = cs.fifoOverruns;
+
+    CanRing_t *rx = CAN_IF_GetRxRing();
+    if (rx != NULL)
+    {
+        CanRing_Stats_t rs;
+        CanRing_GetStats(rx, &rs);
+        cur[PERF_LIFE_CAN_RX_RING_DROPS] = rs.overflows;
+        cur[PERF_LIFE_CAN_RX_RING_PEAK]  = rs.highWater;
+    }
+
+    CAN_IF_TxStats_t tx;
+    CAN_IF_GetTxStats(&tx);
+    cur[PERF_LIFE_CAN_TX_DROPPED] = tx.dropped;
+    cur[PERF_LIFE_CAN_TX_PEAK]    = tx.highWater;
+
+    Crank_State_t ck;
+    Crank_Get(&ck);
+    cur[PERF_LIFE_CRANK_ISR_MAX] = ck.cyclesMax;
+}
+
+/** First sample: take the block over or start it from the flash log. */
+static void pl_start(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    s_plWarm = pl_valid(&s_plBlock);
+    for (uint32_t i = 0U; i < (PL_REC_COUNT * 2U); ++i)
+    {
+        uint32_t v = (s_plWarm != 0U) ? s_plBlock.value[i] : pl_default(i);
+
+        if (s_plKind[i] == PL_MIN)
+            s_plBlock.value[i] = (s_plNvm[i] < v) ? s_plNvm[i] : v;
+        else
+            s_plBlock.value[i] = (s_plNvm[i] > v) ? s_plNvm[i] : v;
+    }
+    s_plBlock.value[(s_plWarm != 0U) ? PERF_LIFE_WARM_RESETS : PERF_LIFE_COLD_STARTS]++;
+    pl_seal();
+
+    __set_PRIMASK(primask);
+}
+
+static void pl_fold(const uint32_t *cur)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    for (uint32_t i = 0U; i < PERF_LIFE_COUNT; ++i)
+    {
+        uint32_t *v = &s_plBlock.value[i];
+
+        switch (s_plKind[i])
+        {
+        case PL_SUM:
+        {
+            uint32_t d = (cur[i] >= s_plCur[i]) ? (cur[i] - s_plCur[i]) : cur[i];
+            *v = (*v > (UINT32_MAX - d)) ? UINT32_MAX : (*v + d);
+            break;
+        }
+        case PL_MAX:
+            if (cur[i] > *v)
+                *v = cur[i];
+            break;
+        case PL_MIN:
+            if (cur[i] < *v)
+                *v = cur[i];
+            break;
+        default:
+            break;
+        }
+        s_plCur[i] = cur[i];
+    }
+    pl_seal();
+
+    __set_PRIMASK(primask);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void pl_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if (s_plStarted == 0U)
+    {
+        CLI_IF_Print("Lifetime counters: no sample yet\r\n");
+        return;
+    }
+
+    CLI_IF_Printf("Lifetime counters, this boot %s\r\n",
+                  (s_plWarm != 0U) ? "kept the RAM block" : "started from flash");
+    CLI_IF_Print("Counter                lifetime   this boot  unit\r\n");
+
+    for (uint32_t i = 0U; i < PERF_LIFE_COUNT; ++i)
+    {
+        uint32_t life;
+        uint32_t boot = s_plCur[i];
+
+        (void)PerfLife_Get(i, &life);
+        if (s_plKind[i] == PL_BOOT)
+            CLI_IF_Printf("%-18s %12lu %11s  %s\r\n", s_plNames[i], (unsigned long)life, "-",
+                          s_plUnits[i]);
+        else if ((s_plKind[i] == PL_MIN) && (life == UINT32_MAX))
+            CLI_IF_Printf("%-18s %12s %11s  %s\r\n", s_plNames[i], "-", "-", s_plUnits[i]);
+        else
+            CLI_IF_Printf("%-18s %12lu %11lu  %s\r\n", s_plNames[i], (unsigned long)life,
+                          (unsigned long)boot, s_plUnits[i]);
+    }
+}
+
+static void pl_cmd_save(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CLI_IF_Printf("%lu records queued for flash\r\n", (unsigned long)PerfLife_Save());
+}
+
+static void pl_cmd_clear(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    PerfLife_Clear();
+    CLI_IF_Print("Lifetime counters cleared\r\n");
+}
+
+static const CliCommand_t s_plCmds[] =
+{
+    { "perf life",       "", 0U, pl_cmd_show,  "lifetime totals and extremes of the run-time figures" },
+    { "perf life save",  "", 0U, pl_cmd_save,  "write the lifetime counters to flash now" },
+    { "perf life clear", "", 0U, pl_cmd_clear, "clear the lifetime counters" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void PerfLife_Init(void)
+{
+    for (uint32_t i = 0U; i < (PL_REC_COUNT * 2U); ++i)
+    {
+        s_plNvm[i]    = pl_default(i);
+        s_plStored[i] = pl_default(i);
+    }
+    memset(s_plPending, 0, sizeof(s_plPending));
+
+    if (NvmLog_Register(&s_plClient) != HAL_OK)
+        LOG_ERROR(MAIN, "Lifetime counters not in the flash log, lost at a power loss");
+
+    CLI_IF_REGISTER_TABLE(s_plCmds);
+}
+
+void PerfLife_Event100ms(void)
+{
+    uint32_t cur[PERF_LIFE_COUNT];
+
+    if (s_plStarted == 0U)
+    {
+        pl_start();
+        s_plStarted = 1U;
+        s_plSaveMs  = HAL_GetTick();
+    }
+
+    pl_sample(cur);
+    pl_fold(cur);
+
+    uint32_t now = HAL_GetTick();
+    if ((now - s_plSaveMs) >= (PERF_LIFE_SAVE_MIN * 60000U))
+    {
+        s_plSaveMs = now;
+        (void)PerfLife_Save();
+    }
+}
+
+uint32_t PerfLife_Save(void)
+{
+    uint32_t queued = 0U;
+
+    if (s_plStarted == 0U)
+        return 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    for (uint32_t i = 0U; i < PL_REC_COUNT; ++i)
+    {
+        uint32_t c = 2U * i;
+
+        if ((s_plBlock.value[c] == s_plStored[c]) && (s_plBlock.value[c + 1U] == s_plStored[c + 1U]))
+            continue;
+        s_plStored[c]      = s_plBlock.value[c];
+        s_plStored[c + 1U] = s_plBlock.value[c + 1U];
+        s_plPending[i]     = 1U;
+        queued++;
+    }
+
+    __set_PRIMASK(primask);
+
+    if (queued != 0U)
+        NvmLog_Notify();
+    return queued;
+}
+
+void PerfLife_Clear(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint32_t i = 0U; i < (PL_REC_COUNT * 2U); ++i)
+        s_plBlock.value[i] = pl_default(i);
+    pl_seal();
+    __set_PRIMASK(primask);
+
+    (void)PerfLife_Save();
+}
+
+uint32_t PerfLife_Get(uint32_t id, uint32_t *value)
+{
+    if ((id >= PERF_LIFE_COUNT) || (s_plStarted == 0U))
+        return 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *value = s_plBlock.value[id];
+    __set_PRIMASK(primask);
+    return 1U;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file    platform_dma.c
+ * @brief   MPU region of the DMA section, cache enable and maintenance.
+ */
+
+#include "platform_dma.h"
+
+#if PLATFORM_DCACHE
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* DMA section, from the linker script. */
+extern uint8_t _ssram2[];
+extern uint8_t _esram2[];
+
+/* Set once by PlatformDma_Init(): the MPU maps the DMA section uncached. */
+static uint8_t s_pdNoCache = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** @return 1 when [addr, addr + len) is cached memory. */
+static uint8_t pd_cached(const void *addr, uint32_t len)
+{
+    uintptr_t a = (uintptr_t)addr;
+
+    if (len == 0U)
+        return 0U;
+    if ((s_pdNoCache != 0U) && (a >= (uintptr_t)_ssram2) && ((a + len) <= (uintptr_t)_esram2))
+        return 0U;
+    return 1U;
+}
+
+#if PLATFORM_DMA_NOCACHE
+/** Map the DMA section: normal memory, shareable, not cached, no execute. */
+static void pd_map_section(void)
+{
+    uint32_t base = (uint32_t)(uintptr_t)_ssram2;
+    uint32_t len  = (uint32_t)(_esram2 - _ssram2);
+    uint32_t size = PLATFORM_DMA_ALIGN;
+    uint32_t log2 = 5U;
+
+    while (size < len)
+    {
+        size <<= 1;
+        log2++;
+    }
+    if ((len == 0U) || ((base & (size - 1U)) != 0U))
+        return;
+
+    ARM_MPU_Disable();
+    ARM_MPU_SetRegion(ARM_MPU_RBAR(PLATFORM_DMA_MPU_REGION, base),
+                      ARM_MPU_RASR(1U, ARM_MPU_AP_FULL, 1U, 1U, 0U, 0U, 0U, log2 - 1U));
+    ARM_MPU_Enable(MPU_CTRL_PRIVDEFENA_Msk);
+    s_pdNoCache = 1U;
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void PlatformDma_Init(void)
+{
+#if PLATFORM_DMA_NOCACHE
+    pd_map_section();
+#endif
+    SCB_EnableICache();
+    SCB_EnableDCache();
+}
+
+void PlatformDma_CleanLines(const void *addr, uint32_t len)
+{
+    if (pd_cached(addr, len) != 0U)
+        SCB_CleanDCache_by_Addr((volatile void *)(uintptr_t)addr, (int32_t)len);
+    else
+        __DSB();
+}
+
+void PlatformDma_InvalidateLines(void *addr, uint32_t len)
+{
+    if (pd_cached(addr, len) != 0U)
+        SCB_InvalidateDCache_by_Addr(addr, (int32_t)len);
+}
+
+#else /* !PLATFORM_DCACHE */
+
+void PlatformDma_Init(void)
+{
+}
+
+#endif /* PLATFORM_DCACHE */
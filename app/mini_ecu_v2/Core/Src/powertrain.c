@@ -0,0 +1,153 @@
+/**
+ * @file    powertrain.c
+ * @brief   Torque map, gearbox and shift schedule lookups, and "pt".
+ */
+
+#include "powertrain.h"
+#include "vehicle_shared.h"
+#include "cal.h"
+#include "cli_if.h"
+#include "log.h"
+#include "lut.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define PT_PI               3.14159265f
+
+/* km/h -> wheel rpm: / 3.6 (m/s) / circumference * 60. */
+#define PT_KPH_TO_WHEEL_RPM (60.0f / (3.6f * POWERTRAIN_WHEEL_CIRC_M))
+
+_Static_assert(CAL_MAP_SIZE(PT_GEAR_RATIO) == POWERTRAIN_GEARS,
+               "PT_GEAR_RATIO needs one ratio per gear");
+_Static_assert(CAL_MAP_SIZE(PT_SHIFT_UP) == ((POWERTRAIN_GEARS - 1U) * POWERTRAIN_THROTTLE_POINTS),
+               "PT_SHIFT_UP needs a row per upshift, a column per throttle point");
+_Static_assert(CAL_MAP_SIZE(PT_TORQUE) == (POWERTRAIN_THROTTLE_POINTS * POWERTRAIN_RPM_POINTS),
+               "PT_TORQUE needs a row per throttle point, a column per rpm point");
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static const float s_ptThrottleBp[POWERTRAIN_THROTTLE_POINTS] = { POWERTRAIN_THROTTLE_AXIS };
+static const float s_ptRpmBp[POWERTRAIN_RPM_POINTS]           = { POWERTRAIN_RPM_AXIS };
+
+/* Axes and their reciprocals; written once by Powertrain_Init(). */
+static float         s_ptThrottleInv[POWERTRAIN_THROTTLE_POINTS - 1U];
+static float         s_ptRpmInv[POWERTRAIN_RPM_POINTS - 1U];
+static Lut_AxisF32_t s_ptThrottle;
+static Lut_AxisF32_t s_ptRpm;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t pt_gear(uint8_t gear)
+{
+    if (gear < 1U) return 1U;
+    if (gear > POWERTRAIN_GEARS) return (uint8_t)POWERTRAIN_GEARS;
+    return gear;
+}
+
+/** Upshift speed out of @p gear (1..POWERTRAIN_GEARS - 1) at @p pos. */
+static float pt_upshift(const float *up, uint8_t gear, const Lut_PosF32_t *pos)
+{
+    return Lut_Interp1AtF32(&up[(gear - 1U) * POWERTRAIN_THROTTLE_POINTS], pos);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void pt_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    VehicleState_t vs;
+    Vehicle_GetSnapshot(&vs);
+
+    uint8_t      gear = pt_gear(vs.gear);
+    const float *up   = CAL_MAP(PT_SHIFT_UP);
+    Lut_PosF32_t pos;
+
+    Lut_LocateF32(&s_ptThrottle, vs.throttle, &pos);
+
+    CLI_IF_Printf("Gear %u (ratio %.2f x %.2f), throttle %.0f %%, %u rpm, %.1f km/h\r\n",
+                  (unsigned)gear, (double)CAL_MAP(PT_GEAR_RATIO)[gear - 1U],
+                  (double)CAL_F(PT_FINAL_DRIVE), (double)(vs.throttle * 100.0f),
+                  (unsigned)vs.engine_rpm, (double)vs.speed_kph);
+    CLI_IF_Printf("Torque %.0f Nm, acceleration %.1f km/h/s before drag\r\n",
+                  (double)Powertrain_Torque((float)vs.engine_rpm, vs.throttle),
+                  (double)Powertrain_AccelKph(gear, (float)vs.engine_rpm, vs.throttle));
+
+    if (gear < POWERTRAIN_GEARS)
+        CLI_IF_Printf("Up at %.0f km/h", (double)pt_upshift(up, gear, &pos));
+    else
+        CLI_IF_Print("Top gear");
+    if (gear > 1U)
+        CLI_IF_Printf(", down below %.0f km/h",
+                      (double)(pt_upshift(up, (uint8_t)(gear - 1U), &pos) - CAL_F(PT_SHIFT_HYST)));
+    CLI_IF_Print(" (maps: 'cal map')\r\n");
+}
+
+static const CliCommand_t s_ptCmds[] =
+{
+    { "pt", "", 0U, pt_cmd_show, "powertrain: gear, torque, shift points" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void Powertrain_Init(void)
+{
+    if ((Lut_AxisInitF32(&s_ptThrottle, s_ptThrottleBp, s_ptThrottleInv,
+                         POWERTRAIN_THROTTLE_POINTS) != HAL_OK) ||
+        (Lut_AxisInitF32(&s_ptRpm, s_ptRpmBp, s_ptRpmInv, POWERTRAIN_RPM_POINTS) != HAL_OK))
+    {
+        LOG_ERROR(MAIN, "Powertrain axes do not increase");
+    }
+
+    CLI_IF_REGISTER_TABLE(s_ptCmds);
+}
+
+float Powertrain_Torque(float rpm, float throttle)
+{
+    return Lut_Interp2F32(&s_ptRpm, &s_ptThrottle, CAL_MAP(PT_TORQUE), rpm, throttle);
+}
+
+float Powertrain_AccelKph(uint8_t gear, float rpm, float throttle)
+{
+    /* F = T * ratio * final * efficiency / r, a = F / m, in km/h per s. */
+    const float radius = POWERTRAIN_WHEEL_CIRC_M / (2.0f * PT_PI);
+    float       ratio  = CAL_MAP(PT_GEAR_RATIO)[pt_gear(gear) - 1U] * CAL_F(PT_FINAL_DRIVE);
+    float       force  = Powertrain_Torque(rpm, throttle) * ratio * POWERTRAIN_EFFICIENCY / radius;
+
+    return (force / CAL_F(PT_MASS_KG)) * 3.6f;
+}
+
+uint8_t Powertrain_Shift(uint8_t gear, float speed_kph, float throttle)
+{
+    const float *up = CAL_MAP(PT_SHIFT_UP);
+    Lut_PosF32_t pos;
+
+    gear = pt_gear(gear);
+    Lut_LocateF32(&s_ptThrottle, throttle, &pos);
+
+    if ((gear < POWERTRAIN_GEARS) && (speed_kph >= pt_upshift(up, gear, &pos)))
+        return (uint8_t)(gear + 1U);
+    if ((gear > 1U) &&
+        (speed_kph < (pt_upshift(up, (uint8_t)(gear - 1U), &pos) - CAL_F(PT_SHIFT_HYST))))
+        return (uint8_t)(gear - 1U);
+    return gear;
+}
+
+float Powertrain_EngineRpm(uint8_t gear, float speed_kph)
+{
+    float rpm = speed_kph * PT_KPH_TO_WHEEL_RPM * CAL_MAP(PT_GEAR_RATIO)[pt_gear(gear) - 1U] *
+                CAL_F(PT_FINAL_DRIVE);
+
+    return (rpm > POWERTRAIN_IDLE_RPM) ? rpm : POWERTRAIN_IDLE_RPM;
+}
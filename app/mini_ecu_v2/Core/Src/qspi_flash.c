@@ -0,0 +1,498 @@
+/**
+ * @file    qspi_flash.c
+ * @brief   Quad-SPI NOR flash: commands, background program / erase state
+ *          machine and the memory-mapped mode.
+ */
+
+#include "qspi_flash.h"
+#include "platform_dma.h"
+#include "ramfunc.h"
+
+#if QSPI_FLASH_ENABLE
+
+_Static_assert((QSPI_FLASH_SIZE_LOG2 >= 20U) && (QSPI_FLASH_SIZE_LOG2 <= 28U),
+               "QSPI flash from 1 MB up to the 256 MB mapped window");
+
+/* -------------------------------------------------------------------------- */
+/* Commands                                                                   */
+/* -------------------------------------------------------------------------- */
+
+#define QF_CMD_WREN         0x06U
+#define QF_CMD_RDSR1        0x05U
+#define QF_CMD_RDSR2        0x35U
+#define QF_CMD_WRSR2        0x31U
+#define QF_CMD_JEDEC_ID     0x9FU
+#define QF_CMD_QUAD_PROGRAM 0x32U
+#define QF_CMD_QUAD_READ    0x6BU   /* 1-1-4, 8 dummy cycles */
+#define QF_CMD_SECTOR_ERASE 0x20U
+#define QF_CMD_CHIP_ERASE   0xC7U
+#define QF_CMD_RESET_ENABLE 0x66U
+#define QF_CMD_RESET        0x99U
+#define QF_CMD_WAKE         0xABU
+#define QF_CMD_ENTER_4B     0xB7U
+
+#define QF_SR1_WIP          0x01U
+#define QF_SR2_QE           0x02U
+#define QF_READ_DUMMY       8U
+
+#define QF_ADDR_BYTES       ((QSPI_FLASH_SIZE_LOG2 > 24U) ? 4U : 3U)
+
+/* CCR fields */
+#define QF_FMODE_WRITE      (0UL << QUADSPI_CCR_FMODE_Pos)
+#define QF_FMODE_READ       (1UL << QUADSPI_CCR_FMODE_Pos)
+#define QF_FMODE_POLL       (2UL << QUADSPI_CCR_FMODE_Pos)
+#define QF_FMODE_MAP        (3UL << QUADSPI_CCR_FMODE_Pos)
+#define QF_IMODE_1          (1UL << QUADSPI_CCR_IMODE_Pos)
+#define QF_ADMODE_1         (1UL << QUADSPI_CCR_ADMODE_Pos)
+#define QF_ADSIZE           ((QF_ADDR_BYTES - 1UL) << QUADSPI_CCR_ADSIZE_Pos)
+#define QF_DMODE_1          (1UL << QUADSPI_CCR_DMODE_Pos)
+#define QF_DMODE_4          (3UL << QUADSPI_CCR_DMODE_Pos)
+
+/* DMA2 Stream7 channel 3: QUADSPI */
+#define QF_DMA              DMA2_Stream7
+#define QF_DMA_FLAGS        (DMA_HIFCR_CTCIF7 | DMA_HIFCR_CHTIF7 | DMA_HIFCR_CTEIF7 | \
+                             DMA_HIFCR_CDMEIF7 | DMA_HIFCR_CFEIF7)
+
+#define QF_FLAGS            (QUADSPI_FCR_CTCF | QUADSPI_FCR_CTEF | QUADSPI_FCR_CSMF | QUADSPI_FCR_CTOF)
+
+/* Blocking commands at init: bound of each wait. */
+#define QF_TIMEOUT_MS       20U
+
+/* Steps of a background operation. */
+typedef enum
+{
+    QF_IDLE = 0,
+    QF_WREN,            /* write enable sent */
+    QF_DATA,            /* program data or erase command sent */
+    QF_POLL             /* polling WIP */
+} QfStep_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static volatile QfStep_t s_qfStep = QF_IDLE;
+static QspiFlash_Op_t    s_qfOp;
+static uint32_t          s_qfAddr;
+static const uint8_t    *s_qfData;
+static uint32_t          s_qfLen;          /* program bytes, or 0 = chip erase */
+static uint32_t          s_qfStart;        /* DWT at the start */
+static uint8_t           s_qfMapped;
+static QspiFlash_Stats_t s_qfStats;
+
+__weak void QspiFlash_DoneCallback(QspiFlash_Op_t op, HAL_StatusTypeDef status)
+{
+    (void)op;
+    (void)status;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Leave memory-mapped mode (or stop anything else) and clear the flags. */
+static void qf_abort(void)
+{
+    QUADSPI->CR |= QUADSPI_CR_ABORT;
+    for (uint32_t n = 0U; ((QUADSPI->CR & QUADSPI_CR_ABORT) != 0U) && (n < 100000U); ++n)
+    {
+    }
+    QUADSPI->CR &= ~(QUADSPI_CR_DMAEN | QUADSPI_CR_APMS);
+    QUADSPI->FCR = QF_FLAGS;
+    s_qfMapped   = 0U;
+}
+
+static HAL_StatusTypeDef qf_wait(uint32_t flag)
+{
+    uint32_t start = HAL_GetTick();
+
+    while ((QUADSPI->SR & flag) == 0U)
+    {
+        if ((HAL_GetTick() - start) > QF_TIMEOUT_MS)
+            return HAL_TIMEOUT;
+    }
+    QUADSPI->FCR = flag;       /* the FCR bits sit where the SR flags are */
+    return HAL_OK;
+}
+
+/** Blocking command with up to 4 data bytes in (@p rd) or out (@p wr). */
+static HAL_StatusTypeDef qf_command(uint8_t cmd, uint8_t *rd, const uint8_t *wr, uint32_t len)
+{
+    uint32_t ccr = QF_IMODE_1 | cmd;
+
+    qf_abort();
+    if (len > 0U)
+    {
+        QUADSPI->DLR = len - 1U;
+        ccr |= QF_DMODE_1 | ((rd != NULL) ? QF_FMODE_READ : QF_FMODE_WRITE);
+    }
+    QUADSPI->CCR = ccr;
+
+    for (uint32_t i = 0U; i < len; ++i)
+    {
+        if (rd != NULL)
+        {
+            uint32_t start = HAL_GetTick();
+            while ((QUADSPI->SR & QUADSPI_SR_FLEVEL) == 0U)
+            {
+                if ((HAL_GetTick() - start) > QF_TIMEOUT_MS)
+                    return HAL_TIMEOUT;
+            }
+            rd[i] = *(__IO uint8_t *)&QUADSPI->DR;
+        }
+        else
+        {
+            *(__IO uint8_t *)&QUADSPI->DR = wr[i];
+        }
+    }
+    return qf_wait(QUADSPI_SR_TCF);
+}
+
+/** Poll status register 1 in the peripheral until WIP clears. */
+static void qf_poll_start(uint8_t irq)
+{
+    QUADSPI->PSMKR = QF_SR1_WIP;
+    QUADSPI->PSMAR = 0U;
+    QUADSPI->PIR   = 32U;                   /* QSPI clocks between reads */
+    QUADSPI->DLR   = 0U;
+    QUADSPI->CR    = (QUADSPI->CR & ~QUADSPI_CR_SMIE) | QUADSPI_CR_APMS |
+                     ((irq != 0U) ? QUADSPI_CR_SMIE : 0U);
+    QUADSPI->CCR   = QF_FMODE_POLL | QF_DMODE_1 | QF_IMODE_1 | QF_CMD_RDSR1;
+}
+
+static HAL_StatusTypeDef qf_wait_ready(uint32_t timeoutMs)
+{
+    uint32_t start = HAL_GetTick();
+
+    qf_abort();
+    qf_poll_start(0U);
+    while ((QUADSPI->SR & QUADSPI_SR_SMF) == 0U)
+    {
+        if ((HAL_GetTick() - start) > timeoutMs)
+        {
+            qf_abort();
+            return HAL_TIMEOUT;
+        }
+    }
+    QUADSPI->FCR = QUADSPI_FCR_CSMF;
+    return HAL_OK;
+}
+
+static void qf_map(void)
+{
+    if (s_qfMapped != 0U)
+        return;
+    qf_abort();
+    QUADSPI->CCR = QF_FMODE_MAP | QF_DMODE_4 | (QF_READ_DUMMY << QUADSPI_CCR_DCYC_Pos) |
+                   QF_ADSIZE | QF_ADMODE_1 | QF_IMODE_1 | QF_CMD_QUAD_READ;
+    s_qfMapped = 1U;
+}
+
+static uint32_t qf_elapsed_us(void)
+{
+    return (DWT->CYCCNT - s_qfStart) / (SystemCoreClock / 1000000U);
+}
+
+/* ---- Background operation steps (interrupt, or the caller under PRIMASK) ---- */
+
+static void qf_step_wren(void)
+{
+    qf_abort();
+    QUADSPI->CR  |= QUADSPI_CR_TCIE | QUADSPI_CR_TEIE;
+    QUADSPI->CCR  = QF_FMODE_WRITE | QF_IMODE_1 | QF_CMD_WREN;
+    s_qfStep      = QF_WREN;
+}
+
+static void qf_step_data(void)
+{
+    QUADSPI->FCR = QF_FLAGS;
+
+    if (s_qfOp == QSPI_FLASH_OP_PROGRAM)
+    {
+        PlatformDma_Clean(s_qfData, s_qfLen);
+        QF_DMA->CR &= ~DMA_SxCR_EN;
+        DMA2->HIFCR    = QF_DMA_FLAGS;
+        QF_DMA->PAR    = (uint32_t)&QUADSPI->DR;
+        QF_DMA->M0AR   = (uint32_t)s_qfData;
+        QF_DMA->NDTR   = s_qfLen;
+        QF_DMA->FCR    = 0U;                /* direct mode, bytes */
+        QF_DMA->CR     = (3UL << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_DIR_0 | DMA_SxCR_MINC;
+
+        QUADSPI->DLR = s_qfLen - 1U;
+        QUADSPI->CCR = QF_FMODE_WRITE | QF_DMODE_4 | QF_ADSIZE | QF_ADMODE_1 |
+                       QF_IMODE_1 | QF_CMD_QUAD_PROGRAM;
+        QUADSPI->AR  = s_qfAddr;
+        QF_DMA->CR  |= DMA_SxCR_EN;
+        QUADSPI->CR |= QUADSPI_CR_DMAEN;
+    }
+    else if (s_qfLen == QSPI_FLASH_CHIP)
+    {
+        QUADSPI->CCR = QF_FMODE_WRITE | QF_IMODE_1 | QF_CMD_CHIP_ERASE;
+    }
+    else
+    {
+        QUADSPI->CCR = QF_FMODE_WRITE | QF_ADSIZE | QF_ADMODE_1 | QF_IMODE_1 | QF_CMD_SECTOR_ERASE;
+        QUADSPI->AR  = s_qfAddr;
+    }
+    s_qfStep = QF_DATA;
+}
+
+/** Back to idle and mapped. */
+static void qf_stop(void)
+{
+    QUADSPI->CR &= ~(QUADSPI_CR_TCIE | QUADSPI_CR_TEIE | QUADSPI_CR_SMIE | QUADSPI_CR_DMAEN);
+    QF_DMA->CR  &= ~DMA_SxCR_EN;
+    s_qfStep = QF_IDLE;
+    s_qfOp   = QSPI_FLASH_OP_NONE;
+    qf_map();
+}
+
+static void qf_finish(HAL_StatusTypeDef status)
+{
+    QspiFlash_Op_t op = s_qfOp;
+
+    qf_stop();
+
+    if (status != HAL_OK)
+    {
+        s_qfStats.errors++;
+    }
+    else if (op == QSPI_FLASH_OP_PROGRAM)
+    {
+        s_qfStats.programs++;
+        s_qfStats.lastOpUs = qf_elapsed_us();
+        if (s_qfStats.lastOpUs > s_qfStats.maxProgramUs)
+            s_qfStats.maxProgramUs = s_qfStats.lastOpUs;
+    }
+    else if (s_qfLen != QSPI_FLASH_CHIP)    /* a chip erase outlasts the DWT */
+    {
+        s_qfStats.erases++;
+        s_qfStats.lastOpUs = qf_elapsed_us();
+        if (s_qfStats.lastOpUs > s_qfStats.maxEraseUs)
+            s_qfStats.maxEraseUs = s_qfStats.lastOpUs;
+    }
+    else
+    {
+        s_qfStats.erases++;
+    }
+
+    QspiFlash_DoneCallback(op, status);
+}
+
+static HAL_StatusTypeDef qf_start(QspiFlash_Op_t op, uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    HAL_StatusTypeDef status = HAL_OK;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s_qfStep != QF_IDLE)
+    {
+        status = HAL_BUSY;
+    }
+    else
+    {
+        s_qfOp    = op;
+        s_qfAddr  = addr;
+        s_qfData  = data;
+        s_qfLen   = len;
+        s_qfStart = DWT->CYCCNT;
+        qf_step_wren();
+    }
+    __set_PRIMASK(primask);
+
+    return status;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef QspiFlash_Init(void)
+{
+    GPIO_InitTypeDef gpio = {0};
+    uint8_t          id[3];
+    uint32_t         hclk = HAL_RCC_GetHCLKFreq();
+    uint32_t         div  = (hclk + QSPI_FLASH_MAX_HZ - 1U) / QSPI_FLASH_MAX_HZ;
+
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+    __HAL_RCC_GPIOC_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    __HAL_RCC_QSPI_CLK_ENABLE();
+    __HAL_RCC_QSPI_FORCE_RESET();
+    __HAL_RCC_QSPI_RELEASE_RESET();
+
+    gpio.Mode      = GPIO_MODE_AF_PP;
+    gpio.Pull      = GPIO_NOPULL;
+    gpio.Speed     = GPIO_SPEED_FREQ_VERY_HIGH;
+    gpio.Alternate = GPIO_AF9_QSPI;
+    gpio.Pin       = GPIO_PIN_2;
+    HAL_GPIO_Init(GPIOB, &gpio);
+    gpio.Pull      = GPIO_PULLUP;
+    gpio.Pin       = GPIO_PIN_11;
+    HAL_GPIO_Init(GPIOC, &gpio);
+    gpio.Pull      = GPIO_NOPULL;
+    gpio.Alternate = GPIO_AF10_QSPI;
+    gpio.Pin       = GPIO_PIN_6 | GPIO_PIN_7;
+    HAL_GPIO_Init(GPIOA, &gpio);
+    gpio.Pin       = GPIO_PIN_4 | GPIO_PIN_5;
+    HAL_GPIO_Init(GPIOC, &gpio);
+
+    /* Bank 2, sample half a clock late, NCS high for 3 clocks. */
+    if (div == 0U)
+        div = 1U;
+    QUADSPI->CR  = ((div - 1U) << QUADSPI_CR_PRESCALER_Pos) | QUADSPI_CR_FSEL | QUADSPI_CR_SSHIFT;
+    QUADSPI->DCR = ((QSPI_FLASH_SIZE_LOG2 - 1U) << QUADSPI_DCR_FSIZE_Pos) | (2UL << QUADSPI_DCR_CSHT_Pos);
+    QUADSPI->CR |= QUADSPI_CR_EN;
+    s_qfStats.clockHz = hclk / div;
+
+    /* Out of deep power-down, then a software reset (tRST 30 us). */
+    (void)qf_command(QF_CMD_WAKE, NULL, NULL, 0U);
+    (void)qf_command(QF_CMD_RESET_ENABLE, NULL, NULL, 0U);
+    (void)qf_command(QF_CMD_RESET, NULL, NULL, 0U);
+    HAL_Delay(1U);
+
+    if (qf_command(QF_CMD_JEDEC_ID, id, NULL, 3U) != HAL_OK)
+        return HAL_ERROR;
+    s_qfStats.jedecId = ((uint32_t)id[0] << 16) | ((uint32_t)id[1] << 8) | id[2];
+    if ((s_qfStats.jedecId == 0U) || (s_qfStats.jedecId == 0xFFFFFFU))
+        return HAL_ERROR;
+
+#if QSPI_FLASH_QE_SR2
+    uint8_t sr2;
+    if (qf_command(QF_CMD_RDSR2, &sr2, NULL, 1U) != HAL_OK)
+        return HAL_ERROR;
+    if ((sr2 & QF_SR2_QE) == 0U)
+    {
+        sr2 |= QF_SR2_QE;
+        if ((qf_command(QF_CMD_WREN, NULL, NULL, 0U) != HAL_OK) ||
+            (qf_command(QF_CMD_WRSR2, NULL, &sr2, 1U) != HAL_OK) ||
+            (qf_wait_ready(QF_TIMEOUT_MS) != HAL_OK))
+        {
+            return HAL_ERROR;
+        }
+    }
+#endif
+
+    if ((QF_ADDR_BYTES == 4U) && (qf_command(QF_CMD_ENTER_4B, NULL, NULL, 0U) != HAL_OK))
+        return HAL_ERROR;
+
+    qf_map();
+
+    HAL_NVIC_SetPriority(QUADSPI_IRQn, QSPI_FLASH_IRQ_PRIO, 0U);
+    HAL_NVIC_EnableIRQ(QUADSPI_IRQn);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef QspiFlash_StartProgram(uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    if ((len == 0U) || (len > QSPI_FLASH_PAGE_SIZE) || (addr >= QSPI_FLASH_SIZE) ||
+        (((addr % QSPI_FLASH_PAGE_SIZE) + len) > QSPI_FLASH_PAGE_SIZE))
+    {
+        return HAL_ERROR;
+    }
+    return qf_start(QSPI_FLASH_OP_PROGRAM, addr, data, len);
+}
+
+HAL_StatusTypeDef QspiFlash_StartErase(uint32_t addr, uint32_t size)
+{
+    if ((size != QSPI_FLASH_CHIP) &&
+        ((size != QSPI_FLASH_SECTOR_SIZE) || (addr >= QSPI_FLASH_SIZE)))
+    {
+        return HAL_ERROR;
+    }
+    return qf_start(QSPI_FLASH_OP_ERASE, addr & ~(QSPI_FLASH_SECTOR_SIZE - 1U), NULL, size);
+}
+
+uint8_t QspiFlash_Busy(void)
+{
+    return (s_qfStep != QF_IDLE) ? 1U : 0U;
+}
+
+void QspiFlash_Abort(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s_qfStep != QF_IDLE)
+    {
+        qf_abort();
+        qf_stop();
+        s_qfStats.errors++;
+    }
+    __set_PRIMASK(primask);
+}
+
+const uint8_t *QspiFlash_Map(void)
+{
+    const uint8_t *base = NULL;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s_qfStep == QF_IDLE)
+    {
+        qf_map();
+        base = (const uint8_t *)QSPI_FLASH_MAP_BASE;
+    }
+    __set_PRIMASK(primask);
+
+    return base;
+}
+
+/* From the CAN RX path (ext_log.c), so in SRAM like it (ramfunc.h). */
+RAMFUNC void QspiFlash_Kick(void)
+{
+    NVIC_SetPendingIRQ(QUADSPI_IRQn);
+}
+
+void QspiFlash_GetStats(QspiFlash_Stats_t *st)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *st = s_qfStats;
+    __set_PRIMASK(primask);
+}
+
+void QspiFlash_IRQHandler(void)
+{
+    uint32_t sr = QUADSPI->SR;
+
+    if ((sr & QUADSPI_SR_TEF) != 0U)
+    {
+        qf_abort();
+        qf_finish(HAL_ERROR);
+        return;
+    }
+
+    switch (s_qfStep)
+    {
+    case QF_WREN:
+        if ((sr & QUADSPI_SR_TCF) != 0U)
+            qf_step_data();
+        break;
+
+    case QF_DATA:
+        if ((sr & QUADSPI_SR_TCF) != 0U)
+        {
+            QUADSPI->FCR = QUADSPI_FCR_CTCF;
+            QUADSPI->CR &= ~(QUADSPI_CR_DMAEN | QUADSPI_CR_TCIE);
+            QF_DMA->CR  &= ~DMA_SxCR_EN;
+            qf_poll_start(1U);
+            s_qfStep = QF_POLL;
+        }
+        break;
+
+    case QF_POLL:
+        if ((sr & QUADSPI_SR_SMF) != 0U)
+        {
+            QUADSPI->FCR = QUADSPI_FCR_CSMF;
+            qf_finish(HAL_OK);
+        }
+        break;
+
+    default:                                /* QspiFlash_Kick() */
+        QspiFlash_DoneCallback(QSPI_FLASH_OP_NONE, HAL_OK);
+        break;
+    }
+}
+
+#endif /* QSPI_FLASH_ENABLE */
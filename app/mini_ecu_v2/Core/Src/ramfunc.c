@@ -0,0 +1,51 @@
+/**
+ * @file    ramfunc.c
+ * @brief   Vector table in SRAM for the RAM-resident interrupt paths.
+ */
+
+#include "ramfunc.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/** 16 system exceptions plus the device interrupts up to FMPI2C1_ER. */
+#define RAMFUNC_VECTORS  (16U + (uint32_t)FMPI2C1_ER_IRQn + 1U)
+
+/* VTOR needs the table aligned to its size rounded up to a power of two. */
+_Static_assert((RAMFUNC_VECTORS * 4U) <= 512U, "RAM vector table alignment");
+
+/* Startup code and linker script. */
+extern const uint32_t g_pfnVectors[];
+extern uint32_t _sramfunc;
+extern uint32_t _eramfunc;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t s_ramVectors[RAMFUNC_VECTORS] __attribute__((aligned(512)));
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void RamFunc_Init(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    for (uint32_t i = 0U; i < RAMFUNC_VECTORS; ++i)
+        s_ramVectors[i] = g_pfnVectors[i];
+
+    SCB->VTOR = (uint32_t)s_ramVectors;
+    __DSB();
+    __ISB();
+
+    __set_PRIMASK(primask);
+}
+
+uint32_t RamFunc_CodeSize(void)
+{
+    return (uint32_t)&_eramfunc - (uint32_t)&_sramfunc;
+}
@@ -0,0 +1,359 @@
+/**
+ * @file    raster.c
+ * @brief   Raster tasks, runnable table and the "raster" CLI commands.
+ */
+
+#include "raster.h"
+#include "cli_if.h"
+#include "dtc.h"
+#include "log.h"
+#include "sys_config.h"
+#include "watchdog.h"
+#include "cmsis_os2.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    uint8_t      raster;        /* Raster_Id_t */
+    uint16_t     budgetUs;
+    const char  *name;
+    void       (*run)(void);
+} Raster_Runnable_t;
+
+typedef struct
+{
+    const char     *name;
+    uint32_t        periodMs;
+    osPriority_t    priority;
+    Watchdog_Task_t wdg;
+} Raster_Cfg_t;
+
+#define RS_ENTRY_(raster, fn, budgetUs)   { (uint8_t)RASTER_##raster, (budgetUs), #fn, fn },
+
+/* Period and priority of a raster task from SYS_TASK_TABLE. */
+#define RS_CFG_(task, wdg)   { #task, SYS_PERIOD_US_##task / 1000U, (osPriority_t)SYS_PRIO_##task, (wdg) }
+
+/* Runnables per raster, and the rasters that need a task, at compile time. */
+#define RS_IN_1MS_(raster, fn, budgetUs)   + ((RASTER_##raster == RASTER_1MS) ? 1U : 0U)
+#define RS_IN_10MS_(raster, fn, budgetUs)  + ((RASTER_##raster == RASTER_10MS) ? 1U : 0U)
+#define RS_IN_100MS_(raster, fn, budgetUs) + ((RASTER_##raster == RASTER_100MS) ? 1U : 0U)
+
+enum
+{
+    RS_TASKS = (((0U RASTER_RUNNABLE_TABLE(RS_IN_1MS_)) != 0U) ? 1U : 0U) +
+               (((0U RASTER_RUNNABLE_TABLE(RS_IN_10MS_)) != 0U) ? 1U : 0U) +
+               (((0U RASTER_RUNNABLE_TABLE(RS_IN_100MS_)) != 0U) ? 1U : 0U)
+};
+
+_Static_assert(RASTER_RUNNABLES > 0U, "RASTER_RUNNABLE_TABLE is empty");
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static const Raster_Runnable_t s_rsTable[RASTER_RUNNABLES] =
+{
+    RASTER_RUNNABLE_TABLE(RS_ENTRY_)
+};
+
+static const Raster_Cfg_t s_rsCfg[RASTER_COUNT] =
+{
+    RS_CFG_(Raster1ms,   WATCHDOG_TASK_RASTER1MS),
+    RS_CFG_(Raster10ms,  WATCHDOG_TASK_RASTER10MS),
+    RS_CFG_(Raster100ms, WATCHDOG_TASK_RASTER100MS),
+};
+
+/* Each raster's entries are written by its own task; readers copy under
+ * PRIMASK. */
+static Raster_RunStats_t s_rsRunStats[RASTER_RUNNABLES];
+static Raster_Stats_t    s_rsStats[RASTER_COUNT];
+
+/* Tick of the last run over budget (any raster), for the DTC to pass. */
+static volatile uint32_t s_rsOverTick = 0U;
+
+/* Tick all rasters count their releases from, so they stay in phase. */
+static uint32_t s_rsEpoch = 0U;
+
+/* Only the rasters with runnables get a control block and a stack. */
+static StaticTask_t s_rsTaskCb[RS_TASKS];
+static StackType_t  s_rsStack[RS_TASKS][RASTER_STACK_WORDS];
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t raster_us(uint32_t cycles)
+{
+    uint32_t cyclesPerUs = SystemCoreClock / 1000000U;
+
+    return cycles / ((cyclesPerUs != 0U) ? cyclesPerUs : 1U);
+}
+
+/* @return 1 if the run was over the runnable's budget. */
+static uint8_t raster_record(uint32_t index, uint32_t us)
+{
+    Raster_RunStats_t *st   = &s_rsRunStats[index];
+    uint8_t            over = (us > s_rsTable[index].budgetUs) ? 1U : 0U;
+
+    uint32_t b = 32U - __CLZ(us);
+    if (b >= RASTER_HIST_BUCKETS)
+        b = RASTER_HIST_BUCKETS - 1U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    st->calls++;
+    st->sumUs += us;
+    if (us > st->maxUs)
+        st->maxUs = us;
+    st->hist[b]++;
+    st->overBudget += over;
+    __set_PRIMASK(primask);
+
+    return over;
+}
+
+/* Budget monitor, once per cycle of a raster: fail on a run over budget,
+ * pass after RASTER_BUDGET_PASS_MS without one. Dtc_Set() returns at once
+ * while the result is unchanged. */
+static void raster_monitor(uint8_t over, uint32_t now)
+{
+    if (over != 0U)
+    {
+        s_rsOverTick = now;
+        Dtc_Set(DTC_RUNTIME_BUDGET, 1U);
+    }
+    else if ((now - s_rsOverTick) >= pdMS_TO_TICKS(RASTER_BUDGET_PASS_MS))
+    {
+        Dtc_Set(DTC_RUNTIME_BUDGET, 0U);
+    }
+}
+
+static void raster_task(void *argument)
+{
+    Raster_Id_t raster = (Raster_Id_t)(uintptr_t)argument;
+    uint32_t    period = pdMS_TO_TICKS(s_rsCfg[raster].periodMs);
+    uint32_t    next   = s_rsEpoch;
+
+    Watchdog_Start(s_rsCfg[raster].wdg);
+
+    for (;;)
+    {
+        next += period;
+        (void)osDelayUntil(next);
+
+        uint32_t t0   = DWT->CYCCNT;
+        uint8_t  over = 0U;
+
+        for (uint32_t i = 0U; i < RASTER_RUNNABLES; ++i)
+        {
+            if (s_rsTable[i].raster != (uint8_t)raster)
+                continue;
+
+            uint32_t t = DWT->CYCCNT;
+            s_rsTable[i].run();
+            uint32_t runUs = raster_us(DWT->CYCCNT - t);
+
+            if (raster_record(i, runUs) != 0U)
+            {
+                over = 1U;
+#if RASTER_BUDGET_LOG
+                LOG_WARN(MAIN, "%s: %lu us, budget %u us", s_rsTable[i].name,
+                         (unsigned long)runUs, (unsigned)s_rsTable[i].budgetUs);
+#endif
+            }
+        }
+
+        uint32_t us   = raster_us(DWT->CYCCNT - t0);
+        uint32_t now  = osKernelGetTickCount();
+        uint32_t late = now - next;
+
+        raster_monitor(over, now);
+
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        s_rsStats[raster].releases++;
+        if (us > s_rsStats[raster].maxUs)
+            s_rsStats[raster].maxUs = us;
+        if (late >= period)
+            s_rsStats[raster].overruns++;
+        __set_PRIMASK(primask);
+
+        /* Releases already past are dropped, not run back to back; the
+         * next one stays on the raster grid. */
+        if (late >= period)
+            next += (late / period) * period;
+
+        Watchdog_Checkin(s_rsCfg[raster].wdg);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void raster_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    Raster_Id_t       raster;
+    const char       *name;
+    Raster_RunStats_t rs;
+    Raster_Stats_t    st;
+
+    CLI_IF_Print("Raster  releases overruns   max_us\r\n");
+    for (uint32_t r = 0U; r < RASTER_COUNT; ++r)
+    {
+        (void)Raster_GetStats((Raster_Id_t)r, &st);
+        if (st.releases == 0U)
+            continue;
+
+        CLI_IF_Printf("%4lums %9lu %8lu %8lu\r\n", (unsigned long)s_rsCfg[r].periodMs,
+                      (unsigned long)st.releases, (unsigned long)st.overruns,
+                      (unsigned long)st.maxUs);
+    }
+
+    CLI_IF_Print("Runnable             raster     calls  mean_us   max_us budget  over\r\n");
+    for (uint32_t i = 0U; Raster_GetRunnable(i, &raster, &name, &rs) == HAL_OK; ++i)
+    {
+        CLI_IF_Printf("%-20s %4lums %9lu %8lu %8lu %6u %5lu\r\n", name,
+                      (unsigned long)s_rsCfg[raster].periodMs, (unsigned long)rs.calls,
+                      (unsigned long)((rs.calls != 0U) ? (rs.sumUs / rs.calls) : 0U),
+                      (unsigned long)rs.maxUs, (unsigned)s_rsTable[i].budgetUs,
+                      (unsigned long)rs.overBudget);
+    }
+}
+
+static void raster_cmd_hist(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    const char       *name;
+    Raster_RunStats_t rs;
+
+    for (uint32_t i = 0U; Raster_GetRunnable(i, NULL, &name, &rs) == HAL_OK; ++i)
+    {
+        if (rs.calls == 0U)
+            continue;
+
+        CLI_IF_Printf("%-20s budget %u us\r\n ", name, (unsigned)s_rsTable[i].budgetUs);
+        for (uint32_t b = 0U; b < RASTER_HIST_BUCKETS; ++b)
+        {
+            if (rs.hist[b] == 0U)
+                continue;
+
+            if (b == (RASTER_HIST_BUCKETS - 1U))
+                CLI_IF_Printf(" >=%lu:%lu", 1UL << (b - 1U), (unsigned long)rs.hist[b]);
+            else
+                CLI_IF_Printf(" <%lu:%lu", 1UL << b, (unsigned long)rs.hist[b]);
+        }
+        CLI_IF_Print("\r\n");
+    }
+}
+
+static void raster_cmd_reset(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    Raster_ResetStats();
+    CLI_IF_Print("Raster statistics cleared.\r\n");
+}
+
+static const CliCommand_t s_rsCmds[] =
+{
+    { "raster",       "", 0U, raster_cmd_show,  "raster runnables: execution time, overruns" },
+    { "raster hist",  "", 0U, raster_cmd_hist,  "runnable execution time histograms (us)" },
+    { "raster reset", "", 0U, raster_cmd_reset, "clear the raster statistics" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef Raster_Init(void)
+{
+    uint32_t task = 0U;
+
+    Raster_ResetStats();
+    s_rsEpoch = osKernelGetTickCount();
+
+    for (uint32_t r = 0U; r < RASTER_COUNT; ++r)
+    {
+        uint32_t n = 0U;
+
+        for (uint32_t i = 0U; i < RASTER_RUNNABLES; ++i)
+        {
+            if (s_rsTable[i].raster == (uint8_t)r)
+                n++;
+        }
+        if (n == 0U)
+            continue;
+
+        const osThreadAttr_t attr =
+        {
+            .name       = s_rsCfg[r].name,
+            .priority   = s_rsCfg[r].priority,
+            .cb_mem     = &s_rsTaskCb[task],
+            .cb_size    = sizeof(s_rsTaskCb[task]),
+            .stack_mem  = s_rsStack[task],
+            .stack_size = sizeof(s_rsStack[task])
+        };
+
+        if (osThreadNew(raster_task, (void *)(uintptr_t)r, &attr) == NULL)
+            return HAL_ERROR;
+        task++;
+    }
+
+    CLI_IF_REGISTER_TABLE(s_rsCmds);
+
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef Raster_GetRunnable(uint32_t index, Raster_Id_t *raster, const char **name,
+                                     Raster_RunStats_t *stats)
+{
+    if (index >= RASTER_RUNNABLES)
+        return HAL_ERROR;
+
+    if (raster != NULL)
+        *raster = (Raster_Id_t)s_rsTable[index].raster;
+    if (name != NULL)
+        *name = s_rsTable[index].name;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *stats = s_rsRunStats[index];
+    __set_PRIMASK(primask);
+
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef Raster_GetStats(Raster_Id_t raster, Raster_Stats_t *stats)
+{
+    if ((uint32_t)raster >= RASTER_COUNT)
+        return HAL_ERROR;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *stats = s_rsStats[raster];
+    __set_PRIMASK(primask);
+
+    return HAL_OK;
+}
+
+void Raster_ResetStats(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memset(s_rsRunStats, 0, sizeof(s_rsRunStats));
+    memset(s_rsStats, 0, sizeof(s_rsStats));
+    __set_PRIMASK(primask);
+}
@@ -0,0 +1,249 @@
+/**
+ * @file    rtos_stack.c
+ * @brief   Task stack sizes, main stack fill, stack guards, "stack" and "heap".
+ */
+
+#include "rtos_stack.h"
+#include "main.h"
+#include "cli_if.h"
+#include "ramfunc.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define STK_FILL          0xA5A5A5A5U   /* tskSTACK_FILL_BYTE in every byte */
+#define STK_MSP_MARGIN    32U           /* left unfilled below the caller's SP */
+
+_Static_assert(configRECORD_STACK_HIGH_ADDRESS == 1, "the stack size is taken from pxEndOfStack");
+_Static_assert(configUSE_TRACE_FACILITY == 1, "\"stack\" needs uxTaskGetSystemState()");
+
+#if RTOS_STACK_GUARD
+_Static_assert((RTOS_STACK_GUARD_SIZE >= 32U) &&
+               ((RTOS_STACK_GUARD_SIZE & (RTOS_STACK_GUARD_SIZE - 1U)) == 0U),
+               "an MPU region is a power of two of 32 bytes or more");
+
+/* Lowest guarded byte of the stack starting at a: regions are aligned to
+ * their size. */
+#define STK_GUARD_BASE(a)   (((uint32_t)(a) + RTOS_STACK_GUARD_SIZE - 1U) & ~(RTOS_STACK_GUARD_SIZE - 1U))
+
+/* Read-only for all (AP 110), never executed, normal memory like the
+ * default map's SRAM; SIZE is log2(bytes) - 1. */
+#define STK_GUARD_RASR      (MPU_RASR_XN_Msk | (6UL << MPU_RASR_AP_Pos) | MPU_RASR_C_Msk |   \
+                             MPU_RASR_B_Msk | (((uint32_t)__builtin_ctz(RTOS_STACK_GUARD_SIZE) - 1UL) \
+                                               << MPU_RASR_SIZE_Pos) | MPU_RASR_ENABLE_Msk)
+#endif
+
+/* Linker script: the main stack is the _Min_Stack_Size below _estack. */
+extern uint8_t _estack;
+extern uint8_t _Min_Stack_Size;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Bytes, by task number; written at task creation, read by CliTask. */
+static uint32_t s_stkBytes[RTOS_STACK_MAX_TASKS + 1U];
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t stack_msp_base(void)
+{
+    return (uint32_t)(uintptr_t)&_estack - (uint32_t)(uintptr_t)&_Min_Stack_Size;
+}
+
+/** Bytes at the bottom of the main stack still holding the fill. */
+static uint32_t stack_msp_free(void)
+{
+    const uint32_t *p   = (const uint32_t *)stack_msp_base();
+    const uint32_t *top = (const uint32_t *)(uintptr_t)&_estack;
+    uint32_t        n   = 0U;
+
+    while ((&p[n] < top) && (p[n] == STK_FILL))
+        n++;
+    return n * 4U;
+}
+
+/** Bytes from @p base lost to its guard: the alignment and the guard. */
+static uint32_t stack_guard_bytes(uint32_t base)
+{
+#if RTOS_STACK_GUARD
+    return STK_GUARD_BASE(base) + RTOS_STACK_GUARD_SIZE - base;
+#else
+    (void)base;
+    return 0U;
+#endif
+}
+
+static void stack_print(const char *name, uint32_t size, uint32_t free, uint32_t guard)
+{
+    uint32_t peak = (size > free) ? (size - free) : 0U;
+
+    /* The guard is filled and never reached: no part of the size. */
+    size = (size > guard) ? (size - guard) : 0U;
+    free = (free > guard) ? (free - guard) : 0U;
+
+    if (size == 0U)
+    {
+        CLI_IF_Printf("%-16s      -       -  %6lu     -\r\n", name, (unsigned long)free);
+        return;
+    }
+
+    CLI_IF_Printf("%-16s %6lu  %6lu  %6lu  %3lu%%%s\r\n", name, (unsigned long)size,
+                  (unsigned long)peak, (unsigned long)free,
+                  (unsigned long)((peak * 100U) / size),
+                  (free < RTOS_STACK_WARN_BYTES) ? "  LOW" : "");
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void stack_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    /* Static: CliTask has a small stack and is the only caller. */
+    static TaskStatus_t status[RTOS_STACK_MAX_TASKS];
+    uint32_t n = (uint32_t)uxTaskGetSystemState(status, RTOS_STACK_MAX_TASKS, NULL);
+
+    CLI_IF_Print("Task             Size B  Peak B  Free B  Used\r\n");
+
+    /* In creation order. */
+    for (uint32_t number = 1U; number <= RTOS_STACK_MAX_TASKS; ++number)
+    {
+        for (uint32_t i = 0U; i < n; ++i)
+        {
+            const TaskStatus_t *ts = &status[i];
+
+            if (ts->xTaskNumber != number)
+                continue;
+            stack_print(ts->pcTaskName, s_stkBytes[number],
+                        (uint32_t)ts->usStackHighWaterMark * sizeof(StackType_t),
+                        (s_stkBytes[number] != 0U) ? stack_guard_bytes((uint32_t)(uintptr_t)ts->pxStackBase) : 0U);
+        }
+    }
+    if (n == 0U)
+        CLI_IF_Printf("(more than %lu tasks, see RTOS_STACK_MAX_TASKS)\r\n",
+                      (unsigned long)RTOS_STACK_MAX_TASKS);
+
+    stack_print("MSP (ISRs)", (uint32_t)(uintptr_t)&_Min_Stack_Size, stack_msp_free(),
+                stack_guard_bytes(stack_msp_base()));
+}
+
+#if !RTOS_STATIC_ALLOC
+static void stack_cmd_heap(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    HeapStats_t hs;
+    vPortGetHeapStats(&hs);
+
+    /* Fragmentation: the share of the free bytes not in the largest block. */
+    size_t   fr   = hs.xAvailableHeapSpaceInBytes;
+    uint32_t frag = (fr != 0U) ? (uint32_t)(((fr - hs.xSizeOfLargestFreeBlockInBytes) * 100U) / fr) : 0U;
+
+    CLI_IF_Printf("Heap (%s) %lu B: free %lu, min ever %lu, largest block %lu\r\n",
+                  RTOS_HEAP_TLSF ? "tlsf" : "heap_4", (unsigned long)configTOTAL_HEAP_SIZE,
+                  (unsigned long)fr, (unsigned long)hs.xMinimumEverFreeBytesRemaining,
+                  (unsigned long)hs.xSizeOfLargestFreeBlockInBytes);
+    CLI_IF_Printf("Free blocks %lu (smallest %lu), fragmentation %lu%%, allocs %lu, frees %lu\r\n",
+                  (unsigned long)hs.xNumberOfFreeBlocks,
+                  (unsigned long)hs.xSizeOfSmallestFreeBlockInBytes, (unsigned long)frag,
+                  (unsigned long)hs.xNumberOfSuccessfulAllocations,
+                  (unsigned long)hs.xNumberOfSuccessfulFrees);
+}
+#endif
+
+static const CliCommand_t s_stkCmds[] =
+{
+    { "stack", "", 0U, stack_cmd_show, "per-task and interrupt stack size, peak use and headroom" },
+#if !RTOS_STATIC_ALLOC
+    { "heap",  "", 0U, stack_cmd_heap, "FreeRTOS heap: free, largest block, fragmentation" },
+#endif
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void RtosStack_Init(void)
+{
+    uint32_t *p;
+    uint32_t  end;
+
+    /* Interrupts off: they would push their frames into the part being
+     * filled. */
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    p   = (uint32_t *)stack_msp_base();
+    end = (__get_MSP() - STK_MSP_MARGIN) & ~3U;
+    while ((uint32_t)(uintptr_t)p < end)
+        *p++ = STK_FILL;
+
+#if RTOS_STACK_GUARD
+    /* Both regions start on the main stack's guard; the first task switched
+     * in moves the task region to its own stack. */
+    uint32_t msp = STK_GUARD_BASE(stack_msp_base());
+
+    MPU->CTRL = 0U;
+    MPU->RBAR = msp | MPU_RBAR_VALID_Msk | RTOS_STACK_GUARD_MSP_REGION;
+    MPU->RASR = STK_GUARD_RASR;
+    MPU->RBAR = msp | MPU_RBAR_VALID_Msk | RTOS_STACK_GUARD_REGION;
+    MPU->RASR = STK_GUARD_RASR;
+    MPU->CTRL = MPU_CTRL_PRIVDEFENA_Msk | MPU_CTRL_ENABLE_Msk;
+    __DSB();
+    __ISB();
+#endif
+
+    __set_PRIMASK(primask);
+
+    CLI_IF_REGISTER_TABLE(s_stkCmds);
+}
+
+void RtosStack_TaskCreate(uint32_t number, const void *base, const void *end)
+{
+    if (number <= RTOS_STACK_MAX_TASKS)
+        s_stkBytes[number] = (uint32_t)((uintptr_t)end - (uintptr_t)base) + sizeof(StackType_t);
+}
+
+#if RTOS_STACK_GUARD
+/* One store per switch; RBAR with VALID selects the region as well. The
+ * exception return that follows makes it take effect for the task. */
+RAMFUNC void RtosStack_GuardSwitch(const void *base)
+{
+    MPU->RBAR = STK_GUARD_BASE((uintptr_t)base) | MPU_RBAR_VALID_Msk | RTOS_STACK_GUARD_REGION;
+    __DSB();
+}
+#endif
+
+uint8_t RtosStack_GuardHit(uint32_t cfsr, uint32_t mmfar)
+{
+#if RTOS_STACK_GUARD
+    /* The guards are the only regions, and the default map allows every
+     * data access: a stacking fault can only have hit one of them. */
+    if ((cfsr & (SCB_CFSR_MSTKERR_Msk | SCB_CFSR_MLSPERR_Msk)) != 0U)
+        return 1U;
+    if ((cfsr & SCB_CFSR_MMARVALID_Msk) == 0U)
+        return 0U;
+
+    for (uint32_t region = RTOS_STACK_GUARD_REGION; region <= RTOS_STACK_GUARD_MSP_REGION; ++region)
+    {
+        MPU->RNR = region;
+        if ((mmfar - (MPU->RBAR & MPU_RBAR_ADDR_Msk)) < RTOS_STACK_GUARD_SIZE)
+            return 1U;
+    }
+    return 0U;
+#else
+    (void)cfsr;
+    (void)mmfar;
+    return 0U;
+#endif
+}
@@ -0,0 +1,241 @@
+/**
+ * @file    rtos_stats.c
+ * @brief   Windowed CPU load sampling from FreeRTOS run-time stats.
+ *
+ * Every RTOS_STATS_PERIOD_MS the timer callback (timer service task) reads
+ * uxTaskGetSystemState() and, per task, subtracts the run-time counter of
+ * the previous sample. Unsigned subtraction keeps the result right across
+ * CYCCNT wrap-around as long as a window is shorter than 2^32 cycles.
+ *
+ * The result is built in a staging table and copied to the published one
+ * inside a short critical section, so "top" (CliTask, higher priority than
+ * the timer task) never sees a half-written sample.
+ */
+
+#include "rtos_stats.h"
+#include "rtos_trace.h"
+#include "cli_if.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/** Raw kernel snapshot; static to keep it off the timer task stack. */
+static TaskStatus_t     s_status[RTOS_STATS_MAX_TASKS];
+
+/** Counters of each task at the previous sample, by task number. */
+typedef struct
+{
+    UBaseType_t number;
+    uint32_t    runTime;
+    uint32_t    frames;
+    uint32_t    fpuFrames;
+} RtosStats_Prev_t;
+
+static RtosStats_Prev_t s_prev[RTOS_STATS_MAX_TASKS];
+static uint32_t         s_prevCount = 0U;
+static uint32_t         s_prevTotal = 0U;
+static uint32_t         s_prevSwitches = 0U;
+
+static RtosStats_Task_t s_stage[RTOS_STATS_MAX_TASKS];
+
+/* Published sample (guarded by taskENTER_CRITICAL). */
+static RtosStats_Task_t    s_tasks[RTOS_STATS_MAX_TASKS];
+static uint32_t            s_taskCount = 0U;
+static RtosStats_Summary_t s_summary;
+
+/* Idle history for the rolling average. */
+static uint16_t s_idleHist[RTOS_STATS_IDLE_WINDOW];
+static uint32_t s_idleHistCount = 0U;
+static uint32_t s_idleHistNext  = 0U;
+
+/* Created with the native API: osTimerNew() would heap-allocate its
+ * callback wrapper even with static control-block memory. */
+static TimerHandle_t s_timer = NULL;
+static StaticTimer_t s_timerCb;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static const RtosStats_Prev_t *stats_prev(UBaseType_t number)
+{
+    /* Task created during the window: all of its counts are in this window. */
+    static const RtosStats_Prev_t none = { 0U, 0U, 0U, 0U };
+
+    for (uint32_t i = 0U; i < s_prevCount; ++i)
+    {
+        if (s_prev[i].number == number)
+            return &s_prev[i];
+    }
+    return &none;
+}
+
+static uint16_t stats_permille(uint32_t part, uint32_t whole)
+{
+    if (whole == 0U)
+        return 0U;
+
+    uint32_t p = (uint32_t)(((uint64_t)part * 1000U) / whole);
+    return (uint16_t)((p > 1000U) ? 1000U : p);
+}
+
+static void stats_sample(TimerHandle_t timer)
+{
+    (void)timer;
+
+    uint32_t total = 0U;
+    uint32_t n = (uint32_t)uxTaskGetSystemState(s_status, RTOS_STATS_MAX_TASKS, &total);
+    uint32_t window = total - s_prevTotal;
+    uint32_t switches = g_rtosSwitches;
+    TaskHandle_t idle = xTaskGetIdleTaskHandle();
+    uint16_t idlePermille = 0U;
+    uint32_t fpuFrames = 0U;
+
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        const TaskStatus_t     *ts   = &s_status[i];
+        const RtosStats_Prev_t *prev = stats_prev(ts->xTaskNumber);
+        uint32_t used = ts->ulRunTimeCounter - prev->runTime;
+
+        /* Tasks above RTOS_TRACE_MAX_TASKS share counter 0. */
+        uint32_t slot   = (ts->xTaskNumber <= RTOS_TRACE_MAX_TASKS) ? (uint32_t)ts->xTaskNumber : 0U;
+        uint32_t frames = g_rtosFrames[slot];
+        uint32_t fpu    = g_rtosFpuFrames[slot];
+
+        s_stage[i].name        = ts->pcTaskName;
+        s_stage[i].state       = (uint8_t)ts->eCurrentState;
+        s_stage[i].priority    = (uint8_t)ts->uxCurrentPriority;
+        s_stage[i].cpuPermille = stats_permille(used, window);
+        s_stage[i].stackFree   = (uint32_t)ts->usStackHighWaterMark * sizeof(StackType_t);
+        s_stage[i].frames      = frames - prev->frames;
+        s_stage[i].fpuFrames   = fpu - prev->fpuFrames;
+        fpuFrames += s_stage[i].fpuFrames;
+
+        if (ts->xHandle == idle)
+            idlePermille = s_stage[i].cpuPermille;
+
+        /* prev may be this entry: written last */
+        s_prev[i].number    = ts->xTaskNumber;
+        s_prev[i].runTime   = ts->ulRunTimeCounter;
+        s_prev[i].frames    = frames;
+        s_prev[i].fpuFrames = fpu;
+    }
+    s_prevCount = n;
+    s_prevTotal = total;
+
+    s_idleHist[s_idleHistNext] = idlePermille;
+    s_idleHistNext = (s_idleHistNext + 1U) % RTOS_STATS_IDLE_WINDOW;
+    if (s_idleHistCount < RTOS_STATS_IDLE_WINDOW)
+        s_idleHistCount++;
+
+    uint32_t idleSum = 0U;
+    for (uint32_t i = 0U; i < s_idleHistCount; ++i)
+        idleSum += s_idleHist[i];
+
+    taskENTER_CRITICAL();
+    memcpy(s_tasks, s_stage, n * sizeof(s_tasks[0]));
+    s_taskCount                = n;
+    s_summary.windows++;
+    s_summary.windowCycles     = window;
+    s_summary.idlePermille     = idlePermille;
+    s_summary.idleAvgPermille  = (uint16_t)(idleSum / s_idleHistCount);
+    s_summary.switches         = switches - s_prevSwitches;
+    s_summary.fpuFrames        = fpuFrames;
+    taskEXIT_CRITICAL();
+    s_prevSwitches = switches;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void stats_cmd_top(int argc, char *argv[])
+{
+    /* eTaskState order: running, ready, blocked, suspended, deleted. */
+    static const char stateChar[] = { '*', 'R', 'B', 'S', 'D', '?' };
+
+    (void)argc;
+    (void)argv;
+
+    /* Static: CliTask has a small stack and is the only caller. */
+    static RtosStats_Task_t tasks[RTOS_STATS_MAX_TASKS];
+    RtosStats_Summary_t sum;
+    uint32_t n = RtosStats_Get(tasks, RTOS_STATS_MAX_TASKS, &sum);
+
+    if (n == 0U)
+    {
+        CLI_IF_Print("No sample yet.\r\n");
+        return;
+    }
+
+    CLI_IF_Printf("Idle %u.%u%% (avg %u.%u%% over %lu s), window %lu cycles\r\n",
+                  (unsigned)(sum.idlePermille / 10U), (unsigned)(sum.idlePermille % 10U),
+                  (unsigned)(sum.idleAvgPermille / 10U), (unsigned)(sum.idleAvgPermille % 10U),
+                  (unsigned long)((RTOS_STATS_IDLE_WINDOW * RTOS_STATS_PERIOD_MS) / 1000U),
+                  (unsigned long)sum.windowCycles);
+    CLI_IF_Printf("%lu context switches/s, %lu with the FPU context\r\n",
+                  (unsigned long)((sum.switches * 1000U) / RTOS_STATS_PERIOD_MS),
+                  (unsigned long)((sum.fpuFrames * 1000U) / RTOS_STATS_PERIOD_MS));
+    CLI_IF_Print("Task             St Pri   CPU%  StackFree  Out/s   FPU%\r\n");
+
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        const RtosStats_Task_t *t = &tasks[i];
+        uint32_t st = (t->state < sizeof(stateChar)) ? t->state : (sizeof(stateChar) - 1U);
+        uint16_t fpu = stats_permille(t->fpuFrames, t->frames);
+
+        CLI_IF_Printf("%-16s %c  %3u  %3u.%u  %6lu B  %5lu  %3u.%u\r\n",
+                      (t->name != NULL) ? t->name : "?",
+                      stateChar[st],
+                      (unsigned)t->priority,
+                      (unsigned)(t->cpuPermille / 10U), (unsigned)(t->cpuPermille % 10U),
+                      (unsigned long)t->stackFree,
+                      (unsigned long)((t->frames * 1000U) / RTOS_STATS_PERIOD_MS),
+                      (unsigned)(fpu / 10U), (unsigned)(fpu % 10U));
+    }
+}
+
+static const CliCommand_t s_statsCmds[] =
+{
+    { "top", "", 0U, stats_cmd_top, "per-task CPU load, state, free stack and switches" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef RtosStats_Init(void)
+{
+    if (s_timer != NULL)
+        return HAL_OK;
+
+    s_timer = xTimerCreateStatic("RtosStats", pdMS_TO_TICKS(RTOS_STATS_PERIOD_MS),
+                                 pdTRUE, NULL, stats_sample, &s_timerCb);
+    if (s_timer == NULL)
+        return HAL_ERROR;
+
+    CLI_IF_REGISTER_TABLE(s_statsCmds);
+
+    /* Before the scheduler runs the command is queued without blocking. */
+    return (xTimerStart(s_timer, 0U) == pdPASS) ? HAL_OK : HAL_ERROR;
+}
+
+uint32_t RtosStats_Get(RtosStats_Task_t *tasks, uint32_t max, RtosStats_Summary_t *sum)
+{
+    if (tasks == NULL)
+        return 0U;
+
+    taskENTER_CRITICAL();
+    uint32_t n = (s_taskCount < max) ? s_taskCount : max;
+    memcpy(tasks, s_tasks, n * sizeof(tasks[0]));
+    if (sum != NULL)
+        *sum = s_summary;
+    taskEXIT_CRITICAL();
+
+    return n;
+}
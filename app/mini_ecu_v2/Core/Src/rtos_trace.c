@@ -0,0 +1,343 @@
+/**
+ * @file    rtos_trace.c
+ * @brief   Kernel event ring, queue numbering and "rtos trace".
+ */
+
+#include "rtos_trace.h"
+#include "main.h"
+#include "cli_if.h"
+#include "clock_gov.h"
+#include "log.h"
+#include "ramfunc.h"
+#include "cmsis_os2.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+_Static_assert((RTOS_TRACE_DEPTH >= 2U) && ((RTOS_TRACE_DEPTH & (RTOS_TRACE_DEPTH - 1U)) == 0U),
+               "RTOS_TRACE_DEPTH must be a power of two");
+_Static_assert(sizeof(RtosTrace_Rec_t) == 8U, "RtosTrace_Rec_t is the dump layout");
+_Static_assert(RTOS_TRACE_MAX_QUEUES <= 255U, "queue numbers are 8 bits");
+_Static_assert(RTOS_TRACE_EV_COUNT <= 256U, "events are 8 bits");
+
+#define RT_BIN_VERSION      1U
+#define RT_BIN_PER_FRAME    30U     /* records per 'R' frame (len <= 255) */
+
+typedef struct
+{
+    const void *handle;
+    const char *name;       /* from the queue registry, or NULL */
+    uint16_t    length;
+    uint8_t     type;       /* queueQUEUE_TYPE_* */
+} RtosTrace_Queue_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+volatile uint8_t g_rtosTraceOn = 0U;
+
+volatile uint32_t g_rtosSwitches   = 0U;
+void             *g_rtosSwitchLast = NULL;
+
+volatile uint32_t g_rtosFrames[RTOS_TRACE_MAX_TASKS + 1U];
+volatile uint32_t g_rtosFpuFrames[RTOS_TRACE_MAX_TASKS + 1U];
+
+/* Written by RtosTrace_Record() under PRIMASK; the CLI reads the ring only
+ * when stopped. */
+static RtosTrace_Rec_t   s_rtRing[RTOS_TRACE_DEPTH];
+static volatile uint32_t s_rtHead = 0U;     /* records written since start */
+static uint8_t           s_rtOnce = 0U;     /* stop when the ring is full */
+
+/* Zero-initialised, so queues created before RtosTrace_Init() are kept. */
+static RtosTrace_Queue_t s_rtQueues[RTOS_TRACE_MAX_QUEUES];
+static uint32_t          s_rtQueueCount = 0U;
+
+/** Kernel snapshot for the task names; static to keep it off CliTask's stack. */
+static TaskStatus_t      s_rtTasks[RTOS_TRACE_MAX_TASKS];
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Records held, oldest first from index (s_rtHead - count). */
+static uint32_t rt_count(void)
+{
+    return (s_rtHead < RTOS_TRACE_DEPTH) ? s_rtHead : RTOS_TRACE_DEPTH;
+}
+
+static const RtosTrace_Rec_t *rt_rec(uint32_t i)
+{
+    return &s_rtRing[(s_rtHead - rt_count() + i) & (RTOS_TRACE_DEPTH - 1U)];
+}
+
+static void rt_stop(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    g_rtosTraceOn = 0U;
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief Send @p len bytes on the CLI stream from where they are; returns
+ *        when the buffer is free again (Log_Send()).
+ *
+ * @return HAL_OK, or HAL_TIMEOUT if the log ring stayed full.
+ */
+static HAL_StatusTypeDef rt_emit(const void *data, uint32_t len)
+{
+    return Log_Send(LOG_STREAM_CLI, data, len, RTOS_TRACE_DUMP_TIMEOUT_MS);
+}
+
+/** Send one 0xFC | len | type | payload frame. */
+static HAL_StatusTypeDef rt_frame(uint8_t type, const void *payload, uint32_t len)
+{
+    uint8_t frame[3U + (RT_BIN_PER_FRAME * sizeof(RtosTrace_Rec_t))];
+
+    frame[0] = RTOS_TRACE_SYNC;
+    frame[1] = (uint8_t)(1U + len);
+    frame[2] = type;
+    memcpy(&frame[3], payload, len);
+
+    return rt_emit(frame, 3U + len);
+}
+
+/** 'T' per task that exists now; deleted tasks stay unnamed. */
+static HAL_StatusTypeDef rt_dump_tasks(void)
+{
+    UBaseType_t n = uxTaskGetSystemState(s_rtTasks, RTOS_TRACE_MAX_TASKS, NULL);
+
+    for (UBaseType_t i = 0U; i < n; ++i)
+    {
+        uint8_t p[2U + configMAX_TASK_NAME_LEN];
+        size_t  len = strnlen(s_rtTasks[i].pcTaskName, configMAX_TASK_NAME_LEN);
+
+        p[0] = (uint8_t)s_rtTasks[i].xTaskNumber;
+        p[1] = (uint8_t)s_rtTasks[i].uxBasePriority;
+        memcpy(&p[2], s_rtTasks[i].pcTaskName, len);
+        if (rt_frame('T', p, 2U + len) != HAL_OK)
+            return HAL_TIMEOUT;
+    }
+    return HAL_OK;
+}
+
+/** 'Q' per numbered queue. */
+static HAL_StatusTypeDef rt_dump_queues(void)
+{
+    for (uint32_t i = 0U; i < s_rtQueueCount; ++i)
+    {
+        const RtosTrace_Queue_t *q = &s_rtQueues[i];
+        uint8_t  p[4U + configMAX_TASK_NAME_LEN];
+        size_t   len = (q->name != NULL) ? strnlen(q->name, configMAX_TASK_NAME_LEN) : 0U;
+
+        p[0] = (uint8_t)(i + 1U);
+        p[1] = q->type;
+        memcpy(&p[2], &q->length, 2U);
+        if (len > 0U)
+            memcpy(&p[4], q->name, len);
+        if (rt_frame('Q', p, 4U + len) != HAL_OK)
+            return HAL_TIMEOUT;
+    }
+    return HAL_OK;
+}
+
+static HAL_StatusTypeDef rt_dump(uint32_t count)
+{
+    uint8_t  hdr[19];
+    uint16_t recSize     = (uint16_t)sizeof(RtosTrace_Rec_t);
+    uint32_t overwritten = s_rtHead - count;
+    uint32_t tickHz      = configTICK_RATE_HZ;
+
+    hdr[0] = RT_BIN_VERSION;
+    memcpy(&hdr[1], &recSize, 2U);
+    memcpy(&hdr[3], &count, 4U);
+    memcpy(&hdr[7], &overwritten, 4U);
+    memcpy(&hdr[11], &SystemCoreClock, 4U);
+    memcpy(&hdr[15], &tickHz, 4U);
+    if ((rt_frame('H', hdr, sizeof(hdr)) != HAL_OK) ||
+        (rt_dump_tasks() != HAL_OK) || (rt_dump_queues() != HAL_OK))
+    {
+        return HAL_TIMEOUT;
+    }
+
+    RtosTrace_Rec_t recs[RT_BIN_PER_FRAME];
+    uint32_t        n = 0U;
+
+    for (uint32_t i = 0U; i < count; ++i)
+    {
+        recs[n++] = *rt_rec(i);
+
+        if ((n == RT_BIN_PER_FRAME) || (i == (count - 1U)))
+        {
+            if (rt_frame('R', recs, n * sizeof(RtosTrace_Rec_t)) != HAL_OK)
+                return HAL_TIMEOUT;
+            n = 0U;
+        }
+    }
+
+    return rt_frame('E', &count, 4U);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void rt_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t head = s_rtHead;
+    uint32_t held = (head < RTOS_TRACE_DEPTH) ? head : RTOS_TRACE_DEPTH;
+
+    CLI_IF_Printf("Kernel trace %s%s: %lu events recorded, %lu of %lu held, %lu overwritten\r\n",
+                  (g_rtosTraceOn != 0U) ? "recording" : "stopped",
+                  (s_rtOnce != 0U) ? " (once)" : "",
+                  (unsigned long)head, (unsigned long)held,
+                  (unsigned long)RTOS_TRACE_DEPTH, (unsigned long)(head - held));
+    CLI_IF_Printf("%lu queues numbered, ticks %s\r\n", (unsigned long)s_rtQueueCount,
+                  (RTOS_TRACE_TICKS != 0) ? "recorded" : "not recorded");
+}
+
+static void rt_cmd_start(int argc, char *argv[])
+{
+    uint8_t once = 0U;
+
+    if ((argc == 1) && (strcmp(argv[0], "once") == 0))
+        once = 1U;
+    else if (argc != 0)
+    {
+        CLI_IF_Print("Usage: rtos trace start [once]\r\n");
+        return;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_rtHead      = 0U;
+    s_rtOnce      = once;
+    g_rtosTraceOn = 1U;
+    __set_PRIMASK(primask);
+
+    CLI_IF_Print((once != 0U) ? "Kernel trace recording until full\r\n"
+                              : "Kernel trace recording\r\n");
+}
+
+static void rt_cmd_stop(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    rt_stop();
+    CLI_IF_Printf("Kernel trace stopped, %lu events held\r\n", (unsigned long)rt_count());
+}
+
+static void rt_cmd_clear(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    g_rtosTraceOn = 0U;
+    s_rtHead      = 0U;
+    __set_PRIMASK(primask);
+
+    CLI_IF_Print("Kernel trace cleared\r\n");
+}
+
+static void rt_cmd_dump(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    rt_stop();
+#if CLOCK_GOV_ENABLE
+    ClockGov_Boost(0U);
+#endif
+
+    if (rt_dump(rt_count()) != HAL_OK)
+        CLI_IF_Print("\r\nKernel trace dump aborted: output not draining\r\n");
+}
+
+static const CliCommand_t s_rtCmds[] =
+{
+    { "rtos trace",       "",       0U, rt_cmd_show,  "kernel event recorder state" },
+    { "rtos trace start", "[once]", 0U, rt_cmd_start,
+      "record kernel events, overwriting or until full" },
+    { "rtos trace stop",  "",       0U, rt_cmd_stop,  "stop recording" },
+    { "rtos trace dump",  "",       0U, rt_cmd_dump,  "stop and send the trace (binary)" },
+    { "rtos trace clear", "",       0U, rt_cmd_clear, "empty the trace" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void RtosTrace_Init(void)
+{
+    g_rtosTraceOn = 0U;
+    s_rtHead      = 0U;
+    s_rtOnce      = 0U;
+
+    CLI_IF_REGISTER_TABLE(s_rtCmds);
+}
+
+RAMFUNC void RtosTrace_Record(uint32_t event, uint32_t obj, uint32_t arg)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (g_rtosTraceOn != 0U)
+    {
+        RtosTrace_Rec_t *r = &s_rtRing[s_rtHead & (RTOS_TRACE_DEPTH - 1U)];
+
+        r->cycles = DWT->CYCCNT;
+        r->event  = (uint8_t)event;
+        r->obj    = (uint8_t)obj;
+        r->arg    = (uint16_t)arg;
+        s_rtHead++;
+
+        if ((s_rtOnce != 0U) && (s_rtHead == RTOS_TRACE_DEPTH))
+            g_rtosTraceOn = 0U;
+    }
+
+    __set_PRIMASK(primask);
+}
+
+uint8_t RtosTrace_QueueCreate(const void *queue, uint8_t type, uint32_t length)
+{
+    uint8_t number = 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s_rtQueueCount < RTOS_TRACE_MAX_QUEUES)
+    {
+        RtosTrace_Queue_t *q = &s_rtQueues[s_rtQueueCount++];
+
+        q->handle = queue;
+        q->name   = NULL;
+        q->length = (uint16_t)length;
+        q->type   = type;
+        number    = (uint8_t)s_rtQueueCount;
+    }
+    __set_PRIMASK(primask);
+
+    return number;
+}
+
+void RtosTrace_QueueName(const void *queue, const char *name)
+{
+    for (uint32_t i = 0U; i < s_rtQueueCount; ++i)
+    {
+        if (s_rtQueues[i].handle == queue)
+        {
+            s_rtQueues[i].name = name;
+            return;
+        }
+    }
+}
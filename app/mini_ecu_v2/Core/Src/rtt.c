@@ -0,0 +1,207 @@
+/**
+ * @file    rtt.c
+ * @brief   RTT control block, up/down ring buffers and "rtt".
+ */
+
+#include "rtt.h"
+#include "cli_if.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+_Static_assert(RTT_UP_SIZE >= 16U, "RTT_UP_SIZE too small");
+_Static_assert(RTT_DOWN_SIZE >= 16U, "RTT_DOWN_SIZE too small");
+
+/** One ring; the layout of SEGGER_RTT_BUFFER_UP/DOWN. */
+typedef struct
+{
+    const char        *name;
+    uint8_t           *buf;
+    uint32_t           size;
+    volatile uint32_t  wrOff;   /* written by the producer */
+    volatile uint32_t  rdOff;   /* written by the consumer */
+    uint32_t           flags;
+} Rtt_Buffer_t;
+
+/** The layout of SEGGER_RTT_CB with one up and one down buffer. */
+typedef struct
+{
+    char         id[16];
+    int32_t      maxUp;
+    int32_t      maxDown;
+    Rtt_Buffer_t up[1];
+    Rtt_Buffer_t down[1];
+} Rtt_Cb_t;
+
+/* The probe reads 32-bit pointers; the SIL host build has wider ones. */
+_Static_assert((sizeof(void *) != 4U) || (sizeof(Rtt_Buffer_t) == 24U), "Rtt_Buffer_t is the RTT layout");
+_Static_assert((sizeof(void *) != 4U) || (sizeof(Rtt_Cb_t) == (24U + (2U * 24U))), "Rtt_Cb_t is the RTT layout");
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Not static: the probe finds the block by its ID or by this symbol. */
+Rtt_Cb_t g_rttCb __asm__("_SEGGER_RTT");
+
+static uint8_t  s_rttUp[RTT_UP_SIZE];
+static uint8_t  s_rttDown[RTT_DOWN_SIZE];
+
+static uint8_t  s_rttReady     = 0U;
+static uint32_t s_rttUpBytes   = 0U;
+static uint32_t s_rttDropped   = 0U;
+static uint32_t s_rttDownBytes = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Bytes free in @p b; one stays unused so full and empty differ. */
+static uint32_t rtt_free(const Rtt_Buffer_t *b)
+{
+    uint32_t wr = b->wrOff;
+    uint32_t rd = b->rdOff;
+
+    return (rd > wr) ? (rd - wr - 1U) : (b->size - (wr - rd) - 1U);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void rtt_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    Rtt_Stats_t st;
+    Rtt_GetStats(&st);
+
+    CLI_IF_Printf("RTT block at 0x%08lX: up %lu/%lu B unread, %lu B written, %lu dropped; "
+                  "down %lu B read\r\n",
+                  (unsigned long)(uintptr_t)&g_rttCb, (unsigned long)st.upFill,
+                  (unsigned long)st.upSize, (unsigned long)st.upBytes,
+                  (unsigned long)st.upDropped, (unsigned long)st.downBytes);
+}
+
+static const CliCommand_t s_rttCmds[] =
+{
+    { "rtt", "", 0U, rtt_cmd_show, "RTT channel: buffer fill and byte counts" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void Rtt_Init(void)
+{
+    if (s_rttReady != 0U)
+        return;
+
+    Rtt_Cb_t *cb = &g_rttCb;
+
+    cb->maxUp   = 1;
+    cb->maxDown = 1;
+
+    cb->up[0].name  = "Terminal";
+    cb->up[0].buf   = s_rttUp;
+    cb->up[0].size  = RTT_UP_SIZE;
+    cb->up[0].wrOff = 0U;
+    cb->up[0].rdOff = 0U;
+    cb->up[0].flags = RTT_MODE_NO_BLOCK_TRIM;
+
+    cb->down[0].name  = "Terminal";
+    cb->down[0].buf   = s_rttDown;
+    cb->down[0].size  = RTT_DOWN_SIZE;
+    cb->down[0].wrOff = 0U;
+    cb->down[0].rdOff = 0U;
+    cb->down[0].flags = RTT_MODE_NO_BLOCK_SKIP;
+
+    /* The ID goes in last and in pieces: a probe scanning RAM must not
+     * find a complete one before the buffers are valid, nor a copy of the
+     * string elsewhere (the rodata literal is "SEGGER" and "RTT" apart). */
+    __DMB();
+    memcpy(&cb->id[7], "RTT", 4U);
+    __DMB();
+    memcpy(&cb->id[0], "SEGGER", 6U);
+    __DMB();
+    cb->id[6] = ' ';
+    s_rttReady = 1U;
+
+    CLI_IF_REGISTER_TABLE(s_rttCmds);
+}
+
+uint32_t Rtt_Write(const uint8_t *data, uint32_t len)
+{
+    Rtt_Buffer_t *b = &g_rttCb.up[0];
+
+    if (s_rttReady == 0U)
+        return 0U;
+
+    uint32_t n  = rtt_free(b);
+    uint32_t wr = b->wrOff;
+
+    if (n > len)
+        n = len;
+
+    /* Up to the end of the buffer, then from its start. */
+    uint32_t first = b->size - wr;
+    if (first > n)
+        first = n;
+    memcpy(&b->buf[wr], data, first);
+    memcpy(b->buf, &data[first], n - first);
+
+    wr += n;
+    if (wr >= b->size)
+        wr -= b->size;
+
+    __DMB();          /* the data before the offset the probe polls */
+    b->wrOff = wr;
+
+    s_rttUpBytes += n;
+    s_rttDropped += len - n;
+    return n;
+}
+
+uint32_t Rtt_Read(uint8_t *dst, uint32_t size)
+{
+    Rtt_Buffer_t *b = &g_rttCb.down[0];
+
+    if (s_rttReady == 0U)
+        return 0U;
+
+    uint32_t wr = b->wrOff;
+    uint32_t rd = b->rdOff;
+    uint32_t n  = 0U;
+
+    if ((wr >= b->size) || (rd >= b->size))
+        return 0U;   /* the probe wrote a bad offset */
+
+    __DMB();          /* the offset before the data it covers */
+    while ((rd != wr) && (n < size))
+    {
+        dst[n++] = b->buf[rd];
+        rd = (rd + 1U < b->size) ? (rd + 1U) : 0U;
+    }
+    __DMB();
+    b->rdOff = rd;
+
+    s_rttDownBytes += n;
+    return n;
+}
+
+void Rtt_GetStats(Rtt_Stats_t *stats)
+{
+    if (stats == NULL)
+        return;
+
+    const Rtt_Buffer_t *b = &g_rttCb.up[0];
+
+    stats->upSize    = RTT_UP_SIZE - 1U;
+    stats->upFill    = (s_rttReady != 0U) ? ((RTT_UP_SIZE - 1U) - rtt_free(b)) : 0U;
+    stats->upBytes   = s_rttUpBytes;
+    stats->upDropped = s_rttDropped;
+    stats->downBytes = s_rttDownBytes;
+}
@@ -0,0 +1,417 @@
+/**
+ * @file    scenario.c
+ * @brief   Drive-cycle tables, the playback engine and the "scenario" commands.
+ */
+
+#include "scenario.h"
+#include "audit.h"
+#include "vehicle_shared.h"
+#include "cli_if.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(SCENARIO_MAX_SCALE <= 255U, "SCENARIO_MAX_SCALE must fit the status");
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* The profile speed is integrated in 1/40 km/h: a delta of 0.25 km/h per
+ * second is 1/40 km/h per 100 ms step. */
+#define SC_SPEED_DIV        40.0f
+#define SC_STEPS_PER_S      (1000U / SCENARIO_STEP_MS)
+
+_Static_assert(SCENARIO_STEP_MS == 100U, "the delta unit assumes 100 ms steps");
+
+#define SC_COUNT(a)         ((uint8_t)(sizeof(a) / sizeof((a)[0])))
+
+typedef struct
+{
+    const Scenario_Seg_t *segs;
+    uint8_t               count;
+    uint8_t               repeat;
+} Scenario_Part_t;
+
+typedef struct
+{
+    const char             *name;
+    const char             *help;
+    const Scenario_Part_t  *parts;
+    uint8_t                 partCount;
+    uint8_t                 eventCount;
+    const Scenario_Event_t *events;
+} Scenario_Def_t;
+
+/* -------------------------------------------------------------------------- */
+/* Drive cycles                                                               */
+/* -------------------------------------------------------------------------- */
+
+/* NEDC-like urban part (ECE-15 shape): 195 s, up to 50 km/h. The
+ * accelerations are rounded to the 0.25 km/h/s grid; not a certified cycle. */
+static const Scenario_Seg_t s_scUrban[] =
+{
+    { 11,   0 }, {  4,  15 }, {  8,   0 }, {  5, -12 },     /* 15 km/h */
+    { 21,   0 }, {  5,  12 }, {  2,   0 }, {  4,  17 },     /* 32 km/h */
+    { 24,   0 }, {  8, -16 },
+    { 21,   0 }, {  5,  12 }, {  2,   0 }, {  9,  12 },     /* 50 km/h */
+    {  2,   0 }, {  8,   4 }, { 12,   0 }, {  8,  -4 },
+    { 13,   0 }, { 12, -14 }, { 11,   0 },
+};
+
+/* NEDC-like extra-urban part: 336 s, up to 120 km/h. */
+static const Scenario_Seg_t s_scExtraUrban[] =
+{
+    { 20,   0 }, { 14,  20 }, { 50,   0 }, {  8, -10 },     /* 70, 50 km/h */
+    { 69,   0 }, { 10,   8 }, { 50,   0 }, { 15,   8 },     /* 70, 100 km/h */
+    { 30,   0 }, { 10,   8 }, { 10,   0 }, { 30, -16 },     /* 120 km/h */
+    { 20,   0 },
+};
+
+/* Short run for the fault timeline: 0 -> 100 km/h, cruise, stop; 115 s. */
+static const Scenario_Seg_t s_scCruise[] =
+{
+    {  5,   0 }, { 20,  20 }, { 60,   0 }, { 20, -20 }, { 10,   0 },
+};
+
+static const Scenario_Part_t s_scNedcParts[] =
+{
+    { s_scUrban,      SC_COUNT(s_scUrban),      4U },
+    { s_scExtraUrban, SC_COUNT(s_scExtraUrban), 1U },
+};
+
+static const Scenario_Part_t s_scUrbanParts[] =
+{
+    { s_scUrban, SC_COUNT(s_scUrban), 1U },
+};
+
+static const Scenario_Part_t s_scFaultParts[] =
+{
+    { s_scCruise, SC_COUNT(s_scCruise), 1U },
+};
+
+static const Scenario_Event_t s_scFaultEvents[] =
+{
+    { 300U, VEHICLE_FORCE_TEMP,  110,    0U,   0U },    /* coolant overheat */
+    { 500U, VEHICLE_FORCE_RPM,     0, 6000U,   0U },    /* RPM spike */
+    { 700U, VEHICLE_FORCE_SPEED,   0,    0U,   0U },    /* speed dropout */
+    { 701U, VEHICLE_FORCE_SPEED,   0,    0U,   0U },
+    { 900U, VEHICLE_FORCE_TEMP,   20,    0U,   0U },    /* coolant drop */
+};
+
+static const Scenario_Def_t s_scDefs[] =
+{
+    { "nedc",   "NEDC-like: 4 x urban + extra-urban, 1116 s",
+      s_scNedcParts, SC_COUNT(s_scNedcParts), 0U, NULL },
+    { "urban",  "NEDC-like urban part, 195 s",
+      s_scUrbanParts, SC_COUNT(s_scUrbanParts), 0U, NULL },
+    { "faults", "100 km/h run with overheat, RPM spike, speed dropout, 115 s",
+      s_scFaultParts, SC_COUNT(s_scFaultParts), SC_COUNT(s_scFaultEvents), s_scFaultEvents },
+};
+
+#define SC_DEFS     SC_COUNT(s_scDefs)
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Player, VehicleTask only. */
+static struct
+{
+    const Scenario_Def_t *def;
+    uint8_t               playing;
+    uint8_t               scale;
+    uint8_t               part;
+    uint8_t               rep;
+    uint8_t               seg;
+    uint16_t              segStep;      /* steps done in the segment */
+    uint16_t              event;        /* next event */
+    int32_t               speed;        /* profile speed, 1/40 km/h */
+    uint32_t              steps;        /* steps since the start */
+    uint32_t              budgetMs;     /* scaled time not yet stepped */
+    uint32_t              events;
+} s_sc;
+
+/* Requests from other tasks, taken at the next Scenario_Step(); PRIMASK. */
+static const Scenario_Def_t *s_scReqDef   = NULL;
+static uint8_t               s_scReqScale = 0U;
+static uint8_t               s_scReqStop  = 0U;
+
+/* Published after every Scenario_Step(); PRIMASK. */
+static Scenario_Status_t s_scStatus;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t scenario_length_ms(const Scenario_Def_t *def)
+{
+    uint32_t s = 0U;
+
+    for (uint32_t p = 0U; p < def->partCount; ++p)
+    {
+        uint32_t part = 0U;
+
+        for (uint32_t i = 0U; i < def->parts[p].count; ++i)
+            part += def->parts[p].segs[i].seconds;
+        s += part * def->parts[p].repeat;
+    }
+
+    return s * 1000U;
+}
+
+static const Scenario_Def_t *scenario_find(const char *name)
+{
+    for (uint32_t i = 0U; i < SC_DEFS; ++i)
+    {
+        if (strcmp(name, s_scDefs[i].name) == 0)
+            return &s_scDefs[i];
+    }
+
+    return NULL;
+}
+
+/** Current segment, moving on past finished ones; NULL at the end. */
+static const Scenario_Seg_t *scenario_segment(void)
+{
+    while (s_sc.part < s_sc.def->partCount)
+    {
+        const Scenario_Part_t *p = &s_sc.def->parts[s_sc.part];
+
+        if (s_sc.seg < p->count)
+        {
+            const Scenario_Seg_t *seg = &p->segs[s_sc.seg];
+
+            if (s_sc.segStep < ((uint32_t)seg->seconds * SC_STEPS_PER_S))
+                return seg;
+
+            s_sc.seg++;
+            s_sc.segStep = 0U;
+        }
+        else if (++s_sc.rep < p->repeat)
+        {
+            s_sc.seg = 0U;
+        }
+        else
+        {
+            s_sc.part++;
+            s_sc.rep = 0U;
+            s_sc.seg = 0U;
+        }
+    }
+
+    return NULL;
+}
+
+/** One SCENARIO_STEP_MS model step; 0 when the profile has ended. */
+static uint8_t scenario_model_step(VehicleState_t *vs)
+{
+    const Scenario_Seg_t *seg = scenario_segment();
+
+    if (seg == NULL)
+        return 0U;
+
+    /* The profile sets the speed; the pedal does not add to it. */
+    Vehicle_SetThrottle(vs, 0.0f);
+    Vehicle_Update(vs, (float)SCENARIO_STEP_MS / 1000.0f);
+
+    s_sc.speed += seg->delta;
+    s_sc.segStep++;
+    s_sc.steps++;
+    Vehicle_SetTargetSpeed(vs, (float)s_sc.speed / SC_SPEED_DIV);
+
+    /* Events due by now override the step's result. */
+    while ((s_sc.event < s_sc.def->eventCount) &&
+           (s_sc.def->events[s_sc.event].atDs <= s_sc.steps))
+    {
+        const Scenario_Event_t *ev = &s_sc.def->events[s_sc.event++];
+
+        Vehicle_Force(vs,
+                      (ev->mask & VEHICLE_FORCE_SPEED) ? (float)ev->speedKph    : vs->speed_kph,
+                      (ev->mask & VEHICLE_FORCE_RPM)   ? ev->rpm                 : vs->engine_rpm,
+                      (ev->mask & VEHICLE_FORCE_TEMP)  ? (float)ev->coolantC    : vs->coolant_temp_c);
+        s_sc.events++;
+    }
+
+    return 1U;
+}
+
+static void scenario_start(const Scenario_Def_t *def, uint8_t scale)
+{
+    memset(&s_sc, 0, sizeof(s_sc));
+    s_sc.def     = def;
+    s_sc.scale   = scale;
+    s_sc.playing = 1U;
+
+    LOG_INFO(VEH, "Scenario %s at %ux", def->name, (unsigned)scale);
+}
+
+static void scenario_publish(VehicleState_t *vs)
+{
+    Scenario_Status_t st;
+
+    st.playing  = s_sc.playing;
+    st.scale    = s_sc.scale;
+    st.name     = (s_sc.def != NULL) ? s_sc.def->name : NULL;
+    st.timeMs   = s_sc.steps * SCENARIO_STEP_MS;
+    st.lengthMs = (s_sc.def != NULL) ? scenario_length_ms(s_sc.def) : 0U;
+    st.events   = s_sc.events;
+    st.speedKph = (s_sc.playing != 0U) ? ((float)s_sc.speed / SC_SPEED_DIV) : vs->speed_kph;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_scStatus = st;
+    __set_PRIMASK(primask);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void scenario_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    Scenario_Status_t st;
+
+    for (uint32_t i = 0U; i < SC_DEFS; ++i)
+        CLI_IF_Printf("  %-8s %s\r\n", s_scDefs[i].name, s_scDefs[i].help);
+
+    Scenario_GetStatus(&st);
+    if (st.name == NULL)
+    {
+        CLI_IF_Print("No scenario played yet\r\n");
+        return;
+    }
+
+    CLI_IF_Printf("%s %s at %ux: %lu.%01lu / %lu s, profile %.1f km/h, %lu events\r\n",
+                  (st.playing != 0U) ? "Playing" : "Finished", st.name, (unsigned)st.scale,
+                  (unsigned long)(st.timeMs / 1000U), (unsigned long)((st.timeMs % 1000U) / 100U),
+                  (unsigned long)(st.lengthMs / 1000U), (double)st.speedKph,
+                  (unsigned long)st.events);
+}
+
+static void scenario_cmd_play(int argc, char *argv[])
+{
+    unsigned long scale = 1U;
+
+    if (argc > 1)
+    {
+        char *end;
+
+        scale = strtoul(argv[1], &end, 10);
+        if (*end != '\0')
+            scale = 0U;
+    }
+
+    if (Scenario_Play(argv[0], (uint32_t)scale) != HAL_OK)
+    {
+        CLI_IF_Printf("Unknown scenario or scale not 1..%u\r\n", (unsigned)SCENARIO_MAX_SCALE);
+        return;
+    }
+
+    Audit_Record(AUDIT_CMD_SCENARIO_PLAY, AUDIT_SRC_CLI, Audit_Text(argv[0]), (uint32_t)scale);
+    CLI_IF_Printf("Playing %s at %lux\r\n", argv[0], scale);
+}
+
+static void scenario_cmd_stop(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    Scenario_Stop();
+    Audit_Record(AUDIT_CMD_SCENARIO_STOP, AUDIT_SRC_CLI, 0U, 0U);
+    CLI_IF_Print("Scenario stopped.\r\n");
+}
+
+static const CliCommand_t s_scCmds[] =
+{
+    { "scenario",      "",               0U, scenario_cmd_show, "list drive cycles, playback state" },
+    { "scenario play", "<name> [scale]", 1U, scenario_cmd_play, "play a drive cycle (scale 1..100x)" },
+    { "scenario stop", "",               0U, scenario_cmd_stop, "stop the playback" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void Scenario_Init(void)
+{
+    CLI_IF_REGISTER_TABLE(s_scCmds);
+}
+
+HAL_StatusTypeDef Scenario_Play(const char *name, uint32_t scale)
+{
+    const Scenario_Def_t *def = scenario_find(name);
+
+    if ((def == NULL) || (scale == 0U) || (scale > SCENARIO_MAX_SCALE))
+        return HAL_ERROR;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_scReqDef   = def;
+    s_scReqScale = (uint8_t)scale;
+    s_scReqStop  = 0U;
+    __set_PRIMASK(primask);
+
+    return HAL_OK;
+}
+
+void Scenario_Stop(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_scReqDef  = NULL;
+    s_scReqStop = 1U;
+    __set_PRIMASK(primask);
+}
+
+uint8_t Scenario_Step(VehicleState_t *vs, uint32_t cycleMs)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const Scenario_Def_t *reqDef   = s_scReqDef;
+    uint8_t               reqScale = s_scReqScale;
+    uint8_t               reqStop  = s_scReqStop;
+    s_scReqDef  = NULL;
+    s_scReqStop = 0U;
+    __set_PRIMASK(primask);
+
+    if (reqStop != 0U)
+        s_sc.playing = 0U;
+    if (reqDef != NULL)
+        scenario_start(reqDef, reqScale);
+
+    if (s_sc.playing == 0U)
+    {
+        if (reqStop != 0U)
+            scenario_publish(vs);
+        return 0U;
+    }
+
+    s_sc.budgetMs += cycleMs * s_sc.scale;
+    while (s_sc.budgetMs >= SCENARIO_STEP_MS)
+    {
+        s_sc.budgetMs -= SCENARIO_STEP_MS;
+
+        if (scenario_model_step(vs) == 0U)
+        {
+            s_sc.playing = 0U;
+            LOG_INFO(VEH, "Scenario %s done, %lu events", s_sc.def->name,
+                     (unsigned long)s_sc.events);
+            break;
+        }
+    }
+
+    scenario_publish(vs);
+    return 1U;
+}
+
+void Scenario_GetStatus(Scenario_Status_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *out = s_scStatus;
+    __set_PRIMASK(primask);
+}
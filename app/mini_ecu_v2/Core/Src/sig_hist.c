@@ -0,0 +1,552 @@
+/**
+ * @file    sig_hist.c
+ * @brief   Signal history rings, incremental downsampling and "hist".
+ */
+
+#include "sig_hist.h"
+
+#if SIG_HIST_ENABLE
+
+#include "cli_if.h"
+#include "fmt.h"
+#include "sram_layout.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+_Static_assert(SIG_HIST_COUNT > 0U, "SIG_HIST_SIGNAL_TABLE is empty");
+_Static_assert((SIG_HIST_RAW_DEPTH > 0U) && (SIG_HIST_SEC_DEPTH > 0U) && (SIG_HIST_MIN_DEPTH > 0U),
+               "SIG_HIST_*_DEPTH must not be 0");
+
+/** Samples per second bucket, second buckets per minute bucket. */
+#define SH_SEC_SAMPLES      (SIG_HIST_SEC_MS / SIG_HIST_RAW_MS)
+#define SH_MIN_SECONDS      (SIG_HIST_MIN_MS / SIG_HIST_SEC_MS)
+
+/** Copies a reader tries before giving up on a busy writer. */
+#define SH_READ_TRIES       3U
+
+/** "hist show" buckets at most, and by default. */
+#define SH_SHOW_MAX         60U
+#define SH_SHOW_DEFAULT     10U
+
+#define SH_TLM_(name)       TLM_SIG_##name,
+#define SH_BIT_(name)       | (1UL << TLM_SIG_##name)
+
+/** The open bucket of one tier: the raw samples folded in so far. */
+typedef struct
+{
+    int32_t sum;
+    int16_t min;
+    int16_t max;
+} SigHist_Acc_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static const uint8_t  s_shTlm[SIG_HIST_COUNT] = { SIG_HIST_SIGNAL_TABLE(SH_TLM_) };
+static const uint32_t s_shMask                = 0UL SIG_HIST_SIGNAL_TABLE(SH_BIT_);
+
+static const uint32_t s_shDepth[SIG_HIST_TIERS] =
+    { SIG_HIST_RAW_DEPTH, SIG_HIST_SEC_DEPTH, SIG_HIST_MIN_DEPTH };
+static const uint32_t s_shWidthMs[SIG_HIST_TIERS] =
+    { SIG_HIST_RAW_MS, SIG_HIST_SEC_MS, SIG_HIST_MIN_MS };
+static const char *const s_shTierName[SIG_HIST_TIERS] = { "raw", "sec", "min" };
+
+/* Read only below the counts (sh_held()), so not zeroed at start-up. */
+NOCLEAR static int16_t          s_shRaw[SIG_HIST_COUNT][SIG_HIST_RAW_DEPTH];
+NOCLEAR static SigHist_Bucket_t s_shSec[SIG_HIST_COUNT][SIG_HIST_SEC_DEPTH];
+NOCLEAR static SigHist_Bucket_t s_shMin[SIG_HIST_COUNT][SIG_HIST_MIN_DEPTH];
+
+/* Open second and minute buckets, and the raw samples in each. */
+static SigHist_Acc_t    s_shAcc[SIG_HIST_COUNT][2];
+static uint32_t         s_shAccN[2];
+
+/* Seqlock over the rings (single writer, the 100 ms runnable): odd while
+ * the runnable writes; a reader copies again if it changed. */
+static volatile uint32_t s_shSeq = 0U;
+
+/* Per tier: buckets written since init (the next slot is count mod
+ * depth), the HAL tick the newest closed. */
+static volatile uint32_t s_shCount[SIG_HIST_TIERS];
+static volatile uint32_t s_shCloseMs[SIG_HIST_TIERS];
+
+/* -------------------------------------------------------------------------- */
+/* Helpers                                                                    */
+/* -------------------------------------------------------------------------- */
+
+static int16_t sh_raw(float v, float scale)
+{
+    float r = v / scale;
+
+    if (r >= 32767.0f)
+        return INT16_MAX;
+    if (r <= -32768.0f)
+        return INT16_MIN;
+    return (int16_t)lrintf(r);
+}
+
+/** sum / n rounded to the nearest, halves away from zero. */
+static int16_t sh_mean(int64_t sum, uint32_t n)
+{
+    int64_t half = (int64_t)(n / 2U);
+
+    return (int16_t)((sum >= 0) ? ((sum + half) / (int64_t)n) : -((-sum + half) / (int64_t)n));
+}
+
+static void sh_acc_reset(SigHist_Acc_t *acc)
+{
+    acc->sum = 0;
+    acc->min = INT16_MAX;
+    acc->max = INT16_MIN;
+}
+
+static void sh_acc_add(SigHist_Acc_t *acc, int32_t sum, int16_t min, int16_t max)
+{
+    acc->sum += sum;
+    if (min < acc->min)
+        acc->min = min;
+    if (max > acc->max)
+        acc->max = max;
+}
+
+static SigHist_Bucket_t sh_acc_bucket(const SigHist_Acc_t *acc, uint32_t n)
+{
+    SigHist_Bucket_t b = { acc->min, acc->max, sh_mean(acc->sum, n) };
+    return b;
+}
+
+static uint32_t sh_held(uint32_t tier)
+{
+    uint32_t count = s_shCount[tier];
+    return (count < s_shDepth[tier]) ? count : s_shDepth[tier];
+}
+
+/** Bucket @p back (0 = newest, below sh_held()) of @p tier. */
+static SigHist_Bucket_t sh_bucket(uint32_t hist, uint32_t tier, uint32_t back)
+{
+    uint32_t slot = (s_shCount[tier] - 1U - back) % s_shDepth[tier];
+
+    if (tier == SIG_HIST_TIER_RAW)
+    {
+        int16_t v = s_shRaw[hist][slot];
+        SigHist_Bucket_t b = { v, v, v };
+        return b;
+    }
+    return (tier == SIG_HIST_TIER_SEC) ? s_shSec[hist][slot] : s_shMin[hist][slot];
+}
+
+/** Close bucket @p tier: its slot is written before the count moves. */
+static void sh_close(uint32_t tier, uint32_t nowMs)
+{
+    s_shCount[tier]++;
+    s_shCloseMs[tier] = nowMs;
+}
+
+/**
+ * @brief Fold @p n buckets of @p tier from @p back into @p acc (mean
+ *        weighted by @p weight samples).
+ */
+static void sh_fold(uint32_t hist, uint32_t tier, uint32_t back, uint32_t n, uint32_t weight,
+                    SigHist_Bucket_t *acc, int64_t *sum)
+{
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        SigHist_Bucket_t b = sh_bucket(hist, tier, back + i);
+
+        if (b.min < acc->min)
+            acc->min = b.min;
+        if (b.max > acc->max)
+            acc->max = b.max;
+        *sum += (int64_t)b.mean * (int64_t)weight;
+    }
+}
+
+/** The last @p seconds as whole minutes and the seconds at both ends. */
+static uint32_t sh_range(uint32_t hist, uint32_t seconds, SigHist_Bucket_t *out)
+{
+    uint32_t secHeld = sh_held(SIG_HIST_TIER_SEC);
+    uint32_t minHeld = sh_held(SIG_HIST_TIER_MIN);
+    uint32_t open    = s_shCount[SIG_HIST_TIER_SEC] - (s_shCount[SIG_HIST_TIER_MIN] * SH_MIN_SECONDS);
+    int64_t  sum     = 0;
+    uint32_t covered;
+    uint32_t head;
+    uint32_t mins    = 0U;
+    uint32_t tail    = 0U;
+
+    out->min = INT16_MAX;
+    out->max = INT16_MIN;
+
+    /* The newest seconds, not yet in a closed minute. */
+    head = (seconds < open) ? seconds : open;
+    if (head > secHeld)
+        head = secHeld;
+    sh_fold(hist, SIG_HIST_TIER_SEC, 0U, head, 1U, out, &sum);
+
+    if (seconds > head)
+    {
+        mins = (seconds - head) / SH_MIN_SECONDS;
+        if (mins > minHeld)
+            mins = minHeld;
+        sh_fold(hist, SIG_HIST_TIER_MIN, 0U, mins, SH_MIN_SECONDS, out, &sum);
+
+        /* The oldest seconds, part of a minute: only while the sec ring
+         * still has them. */
+        if (mins == (seconds - head) / SH_MIN_SECONDS)
+        {
+            uint32_t back = head + (mins * SH_MIN_SECONDS);
+
+            tail = (seconds - head) % SH_MIN_SECONDS;
+            if (back + tail > secHeld)
+                tail = 0U;
+            sh_fold(hist, SIG_HIST_TIER_SEC, back, tail, 1U, out, &sum);
+        }
+    }
+
+    covered = head + (mins * SH_MIN_SECONDS) + tail;
+    if (covered == 0U)
+    {
+        out->min  = 0;
+        out->max  = 0;
+        out->mean = 0;
+        return 0U;
+    }
+    out->mean = sh_mean(sum, covered);
+    return covered;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+/** raw * scale as text, with the decimals the scale has (0.01: two). */
+static const char *sh_format(int16_t raw, float scale, char *buf, size_t len)
+{
+    uint32_t milli  = (uint32_t)lrintf(scale * 1000.0f);
+    int32_t  v      = (int32_t)raw * (int32_t)milli;
+    uint32_t mag    = (v < 0) ? (uint32_t)-v : (uint32_t)v;
+    uint32_t places = (milli % 10U != 0U) ? 3U : (milli % 100U != 0U) ? 2U : (milli % 1000U != 0U) ? 1U : 0U;
+    uint32_t div    = (places == 3U) ? 1U : (places == 2U) ? 10U : (places == 1U) ? 100U : 1000U;
+    uint32_t frac   = (mag % 1000U) / div;
+
+    if (places == 0U)
+        (void)FMT_SNPRINTF(buf, len, "%s%lu", (v < 0) ? "-" : "", (unsigned long)(mag / 1000U));
+    else
+        (void)FMT_SNPRINTF(buf, len, "%s%lu.%0*lu", (v < 0) ? "-" : "", (unsigned long)(mag / 1000U),
+                           (int)places, (unsigned long)frac);
+    return buf;
+}
+
+/** History named by a TLM signal name; prints why not and returns -1. */
+static int32_t sh_parse_signal(const char *name)
+{
+    int32_t sig  = TlmStream_FindSignal(name);
+    int32_t hist = (sig >= 0) ? SigHist_Find((uint32_t)sig) : -1;
+
+    if (hist < 0)
+        CLI_IF_Printf("No history of \"%s\", see \"hist\"\r\n", name);
+    return hist;
+}
+
+static void sh_cmd_show_all(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t bytes = (uint32_t)(sizeof(s_shRaw) + sizeof(s_shSec) + sizeof(s_shMin) + sizeof(s_shAcc));
+
+    CLI_IF_Printf("Signal history: %u signals, %lu bytes of RAM\r\n", (unsigned)SIG_HIST_COUNT,
+                  (unsigned long)bytes);
+    CLI_IF_Print(" tier  bucket   held / depth  newest\r\n");
+    for (uint32_t tier = 0U; tier < SIG_HIST_TIERS; ++tier)
+    {
+        uint32_t held = sh_held(tier);
+
+        CLI_IF_Printf(" %-4s  %6lu ms %5lu / %-5lu", s_shTierName[tier],
+                      (unsigned long)s_shWidthMs[tier], (unsigned long)held,
+                      (unsigned long)s_shDepth[tier]);
+        if (held != 0U)
+            CLI_IF_Printf("  %lu ms ago\r\n", (unsigned long)SigHist_Age((SigHist_Tier_t)tier));
+        else
+            CLI_IF_Print("  -\r\n");
+    }
+
+    CLI_IF_Print("Signals:");
+    for (uint32_t hist = 0U; hist < SIG_HIST_COUNT; ++hist)
+        CLI_IF_Printf(" %s", TlmStream_GetSignal(s_shTlm[hist])->text);
+    CLI_IF_Print("\r\n");
+}
+
+static void sh_cmd_show(int argc, char *argv[])
+{
+    int32_t  hist = sh_parse_signal(argv[0]);
+    uint32_t tier;
+    uint32_t n    = SH_SHOW_DEFAULT;
+
+    if (hist < 0)
+        return;
+    for (tier = 0U; tier < SIG_HIST_TIERS; ++tier)
+    {
+        if (strcmp(argv[1], s_shTierName[tier]) == 0)
+            break;
+    }
+    if (argc > 2)
+    {
+        char *end;
+        n = (uint32_t)strtoul(argv[2], &end, 10);
+        if ((end == argv[2]) || (*end != '\0'))
+            n = 0U;
+    }
+    if ((tier == SIG_HIST_TIERS) || (n == 0U) || (n > SH_SHOW_MAX))
+    {
+        CLI_IF_Printf("Usage: hist show <sig> <raw|sec|min> [<1..%u>]\r\n", (unsigned)SH_SHOW_MAX);
+        return;
+    }
+
+    /* CLI task only: kept off its stack. */
+    static SigHist_Bucket_t buf[SH_SHOW_MAX];
+    uint32_t                got;
+
+    if (SigHist_Read((uint32_t)hist, (SigHist_Tier_t)tier, 0U, n, buf, &got) != HAL_OK)
+    {
+        CLI_IF_Print("History busy, try again\r\n");
+        return;
+    }
+
+    const TlmStream_SigInfo_t *info = TlmStream_GetSignal(s_shTlm[hist]);
+    uint32_t age = SigHist_Age((SigHist_Tier_t)tier);
+    char     lo[16];
+    char     hi[16];
+    char     mean[16];
+
+    CLI_IF_Printf("%s (%s), %lu of %lu %s buckets, newest first\r\n", info->text, info->unit,
+                  (unsigned long)got, (unsigned long)sh_held(tier), s_shTierName[tier]);
+    CLI_IF_Print("    age s       min       max      mean\r\n");
+    for (uint32_t i = 0U; i < got; ++i)
+    {
+        uint32_t ms = age + (i * s_shWidthMs[tier]);
+
+        CLI_IF_Printf("%7lu.%lu %9s %9s %9s\r\n", (unsigned long)(ms / 1000U),
+                      (unsigned long)((ms % 1000U) / 100U),
+                      sh_format(buf[i].min, info->scale, lo, sizeof(lo)),
+                      sh_format(buf[i].max, info->scale, hi, sizeof(hi)),
+                      sh_format(buf[i].mean, info->scale, mean, sizeof(mean)));
+    }
+}
+
+static void sh_cmd_range(int argc, char *argv[])
+{
+    (void)argc;
+
+    int32_t  hist = sh_parse_signal(argv[0]);
+    char    *end;
+    uint32_t seconds = (uint32_t)strtoul(argv[1], &end, 10);
+
+    if (hist < 0)
+        return;
+    if ((end == argv[1]) || (*end != '\0') || (seconds == 0U))
+    {
+        CLI_IF_Print("Usage: hist range <sig> <seconds>\r\n");
+        return;
+    }
+
+    SigHist_Bucket_t r;
+    uint32_t         covered;
+
+    if (SigHist_Range((uint32_t)hist, seconds, &r, &covered) != HAL_OK)
+    {
+        CLI_IF_Print("History busy, try again\r\n");
+        return;
+    }
+    if (covered == 0U)
+    {
+        CLI_IF_Print("No closed second yet\r\n");
+        return;
+    }
+
+    const TlmStream_SigInfo_t *info = TlmStream_GetSignal(s_shTlm[hist]);
+    char lo[16];
+    char hi[16];
+    char mean[16];
+
+    CLI_IF_Printf("%s over the last %lu s: min %s, max %s, mean %s %s\r\n", info->text,
+                  (unsigned long)covered, sh_format(r.min, info->scale, lo, sizeof(lo)),
+                  sh_format(r.max, info->scale, hi, sizeof(hi)),
+                  sh_format(r.mean, info->scale, mean, sizeof(mean)), info->unit);
+    if (covered < seconds)
+        CLI_IF_Printf("(history holds %lu s of the %lu asked)\r\n", (unsigned long)covered,
+                      (unsigned long)seconds);
+}
+
+static const CliCommand_t s_shCmds[] =
+{
+    { "hist",       "", 0U, sh_cmd_show_all, "signal history tiers and signals" },
+    { "hist show",  "<sig> <raw|sec|min> [<n>]", 2U, sh_cmd_show,
+      "newest buckets of one tier" },
+    { "hist range", "<sig> <seconds>", 2U, sh_cmd_range,
+      "min / max / mean over the last seconds" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef SigHist_Init(void)
+{
+    for (uint32_t hist = 0U; hist < SIG_HIST_COUNT; ++hist)
+    {
+        sh_acc_reset(&s_shAcc[hist][0]);
+        sh_acc_reset(&s_shAcc[hist][1]);
+    }
+    CLI_IF_REGISTER_TABLE(s_shCmds);
+    return HAL_OK;
+}
+
+int32_t SigHist_Find(uint32_t tlmSig)
+{
+    for (uint32_t hist = 0U; hist < SIG_HIST_COUNT; ++hist)
+    {
+        if (s_shTlm[hist] == tlmSig)
+            return (int32_t)hist;
+    }
+    return -1;
+}
+
+uint32_t SigHist_Signal(uint32_t hist)
+{
+    return (hist < SIG_HIST_COUNT) ? s_shTlm[hist] : TLM_SIG_COUNT;
+}
+
+uint32_t SigHist_Held(SigHist_Tier_t tier)
+{
+    return (tier < SIG_HIST_TIERS) ? sh_held(tier) : 0U;
+}
+
+uint32_t SigHist_Age(SigHist_Tier_t tier)
+{
+    return (tier < SIG_HIST_TIERS) ? (HAL_GetTick() - s_shCloseMs[tier]) : 0U;
+}
+
+HAL_StatusTypeDef SigHist_Read(uint32_t hist, SigHist_Tier_t tier, uint32_t back,
+                               uint32_t count, SigHist_Bucket_t *out, uint32_t *got)
+{
+    if ((hist >= SIG_HIST_COUNT) || (tier >= SIG_HIST_TIERS) || (out == NULL) || (got == NULL))
+        return HAL_ERROR;
+
+    for (uint32_t tries = 0U; tries < SH_READ_TRIES; ++tries)
+    {
+        uint32_t seq = s_shSeq;
+        uint32_t held;
+        uint32_t n = 0U;
+
+        __DMB();
+        if ((seq & 1U) != 0U)
+            continue;
+
+        held = sh_held(tier);
+        if (back < held)
+            n = ((held - back) < count) ? (held - back) : count;
+        for (uint32_t i = 0U; i < n; ++i)
+            out[i] = sh_bucket(hist, tier, back + i);
+
+        __DMB();
+        if (s_shSeq == seq)
+        {
+            *got = n;
+            return HAL_OK;
+        }
+    }
+    return HAL_BUSY;
+}
+
+HAL_StatusTypeDef SigHist_Range(uint32_t hist, uint32_t seconds, SigHist_Bucket_t *out,
+                                uint32_t *covered)
+{
+    if ((hist >= SIG_HIST_COUNT) || (out == NULL) || (covered == NULL))
+        return HAL_ERROR;
+
+    for (uint32_t tries = 0U; tries < SH_READ_TRIES; ++tries)
+    {
+        uint32_t seq = s_shSeq;
+        uint32_t n;
+
+        __DMB();
+        if ((seq & 1U) != 0U)
+            continue;
+
+        n = sh_range(hist, seconds, out);
+
+        __DMB();
+        if (s_shSeq == seq)
+        {
+            *covered = n;
+            return HAL_OK;
+        }
+    }
+    return HAL_BUSY;
+}
+
+void SigHist_Event100ms(void)
+{
+    float    v[TLM_SIG_COUNT];
+    uint32_t now = HAL_GetTick();
+    uint32_t raw = s_shCount[SIG_HIST_TIER_RAW] % SIG_HIST_RAW_DEPTH;
+    uint32_t sec = s_shCount[SIG_HIST_TIER_SEC] % SIG_HIST_SEC_DEPTH;
+    uint32_t min = s_shCount[SIG_HIST_TIER_MIN] % SIG_HIST_MIN_DEPTH;
+    uint8_t  closeSec;
+    uint8_t  closeMin;
+
+    /* Sample outside the seqlock: the sources have locks of their own. */
+    TlmStream_ReadSignals(s_shMask, v);
+
+    closeSec = (uint8_t)((s_shAccN[0] + 1U) >= SH_SEC_SAMPLES);
+    closeMin = (uint8_t)(closeSec && ((s_shAccN[1] + s_shAccN[0] + 1U) >= (SH_SEC_SAMPLES * SH_MIN_SECONDS)));
+
+    s_shSeq++;
+    __DMB();
+
+    for (uint32_t hist = 0U; hist < SIG_HIST_COUNT; ++hist)
+    {
+        SigHist_Acc_t *as = &s_shAcc[hist][0];
+        SigHist_Acc_t *am = &s_shAcc[hist][1];
+        int16_t        x  = sh_raw(v[s_shTlm[hist]], TlmStream_GetSignal(s_shTlm[hist])->scale);
+
+        s_shRaw[hist][raw] = x;
+        sh_acc_add(as, x, x, x);
+        if (closeSec)
+        {
+            s_shSec[hist][sec] = sh_acc_bucket(as, SH_SEC_SAMPLES);
+            sh_acc_add(am, as->sum, as->min, as->max);
+            sh_acc_reset(as);
+            if (closeMin)
+            {
+                s_shMin[hist][min] = sh_acc_bucket(am, SH_SEC_SAMPLES * SH_MIN_SECONDS);
+                sh_acc_reset(am);
+            }
+        }
+    }
+
+    sh_close(SIG_HIST_TIER_RAW, now);
+    s_shAccN[0]++;
+    if (closeSec)
+    {
+        sh_close(SIG_HIST_TIER_SEC, now);
+        s_shAccN[1] += s_shAccN[0];
+        s_shAccN[0]  = 0U;
+        if (closeMin)
+        {
+            sh_close(SIG_HIST_TIER_MIN, now);
+            s_shAccN[1] = 0U;
+        }
+    }
+
+    __DMB();
+    s_shSeq++;
+}
+
+#endif /* SIG_HIST_ENABLE */
@@ -0,0 +1,383 @@
+/**
+ * @file    sigcond.c
+ * @brief   Signal conditioning stages and the static stage / state arrays.
+ */
+
+#include "sigcond.h"
+#include "dsp.h"
+#include <math.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/** Runtime form of a stage. */
+typedef struct
+{
+    uint8_t  type;          /* SigCond_StageType_t */
+    uint8_t  n;             /* as configured */
+    uint8_t  bad;           /* RANGE: implausible */
+    uint16_t count;         /* DECIMATE, AVERAGE: phase; RANGE: debounce run */
+    float    a;             /* RATE_LIMIT: step per sample; RANGE: minimum */
+    float    b;             /* RANGE: maximum */
+    float   *state;         /* MEDIAN history, RATE_LIMIT / RANGE last value,
+                               AVERAGE partial sum */
+    union
+    {
+        Dsp_FirF32_t    fir;
+        Dsp_BiquadF32_t iir;
+    } f;
+} SigCond_Stage_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static SigCond_Stage_t s_scStages[SIGCOND_MAX_STAGES];
+static float           s_scCoeffs[SIGCOND_COEFF_FLOATS];
+static float           s_scState[SIGCOND_STATE_FLOATS];
+static uint32_t        s_scStagesUsed = 0U;
+static uint32_t        s_scCoeffsUsed = 0U;
+static uint32_t        s_scStateUsed  = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Take @p n floats from a pool (NULL when it is exhausted). */
+static float *sigcond_take(float *pool, uint32_t *used, uint32_t size, uint32_t n)
+{
+    if ((size - *used) < n)
+        return NULL;
+
+    float *p = &pool[*used];
+    *used += n;
+    return p;
+}
+
+static HAL_StatusTypeDef sigcond_setup(SigCond_Stage_t *st, const SigCond_StageCfg_t *c,
+                                       float *rate, uint32_t *block)
+{
+    float *coeffs = NULL;
+
+    st->type  = c->type;
+    st->n     = c->n;
+    st->bad   = 0U;
+    st->count = 0U;
+    st->a     = c->a;
+    st->b     = c->b;
+    st->state = NULL;
+
+    switch (c->type)
+    {
+    case SIGCOND_FIR:
+        coeffs    = sigcond_take(s_scCoeffs, &s_scCoeffsUsed, SIGCOND_COEFF_FLOATS, c->n);
+        st->state = sigcond_take(s_scState, &s_scStateUsed, SIGCOND_STATE_FLOATS,
+                                 (uint32_t)c->n + *block - 1U);
+        if ((c->n < 2U) || (coeffs == NULL) || (st->state == NULL))
+            return HAL_ERROR;
+        Dsp_FirLowpassF32(coeffs, c->n, c->a, *rate);
+        Dsp_FirInitF32(&st->f.fir, c->n, coeffs, st->state, *block);
+        break;
+
+    case SIGCOND_BIQUAD:
+        coeffs    = sigcond_take(s_scCoeffs, &s_scCoeffsUsed, SIGCOND_COEFF_FLOATS,
+                                 (uint32_t)c->n * DSP_BIQUAD_COEFFS);
+        st->state = sigcond_take(s_scState, &s_scStateUsed, SIGCOND_STATE_FLOATS,
+                                 (uint32_t)c->n * 2U);
+        if ((c->n == 0U) || (coeffs == NULL) || (st->state == NULL))
+            return HAL_ERROR;
+        /* Butterworth: stage k of an order 2S design has
+         * Q = 1 / (2 sin((2k + 1) pi / 4S)). */
+        for (uint32_t k = 0U; k < c->n; ++k)
+        {
+            float q = 1.0f / (2.0f * sinf(((float)(2U * k + 1U) * 3.14159265f) /
+                                          (float)(4U * c->n)));
+
+            Dsp_BiquadLowpassF32(&coeffs[k * DSP_BIQUAD_COEFFS], c->a, *rate, q);
+        }
+        Dsp_BiquadInitF32(&st->f.iir, c->n, coeffs, st->state);
+        break;
+
+    case SIGCOND_DECIMATE:
+        if (c->n == 0U)
+            return HAL_ERROR;
+        *rate  /= (float)c->n;
+        *block  = (*block + c->n - 1U) / c->n;
+        break;
+
+    case SIGCOND_AVERAGE:
+        st->state = sigcond_take(s_scState, &s_scStateUsed, SIGCOND_STATE_FLOATS, 1U);
+        if ((c->n == 0U) || (st->state == NULL))
+            return HAL_ERROR;
+        st->state[0] = 0.0f;
+        *rate  /= (float)c->n;
+        *block  = (*block + c->n - 1U) / c->n;
+        break;
+
+    case SIGCOND_MEDIAN:
+        if (((c->n & 1U) == 0U) || (c->n > SIGCOND_MEDIAN_MAX))
+            return HAL_ERROR;
+        st->state = sigcond_take(s_scState, &s_scStateUsed, SIGCOND_STATE_FLOATS, c->n - 1U);
+        if ((c->n > 1U) && (st->state == NULL))
+            return HAL_ERROR;
+        break;
+
+    case SIGCOND_RATE_LIMIT:
+        st->a     = c->a / *rate;
+        st->state = sigcond_take(s_scState, &s_scStateUsed, SIGCOND_STATE_FLOATS, 1U);
+        if ((c->a <= 0.0f) || (st->state == NULL))
+            return HAL_ERROR;
+        break;
+
+    case SIGCOND_RANGE:
+        st->state = sigcond_take(s_scState, &s_scStateUsed, SIGCOND_STATE_FLOATS, 1U);
+        if ((c->n == 0U) || (c->a >= c->b) || (st->state == NULL))
+            return HAL_ERROR;
+        break;
+
+    default:
+        return HAL_ERROR;
+    }
+
+    return HAL_OK;
+}
+
+/**
+ * Boxcar mean of every st->n inputs; state[0] carries the partial sum of a
+ * group that spans two blocks. Returns the outputs left in @p buf.
+ */
+static uint32_t sigcond_average(SigCond_Stage_t *st, float *buf, uint32_t n)
+{
+    float    sum   = st->state[0];
+    float    scale = 1.0f / (float)st->n;
+    uint32_t out   = 0U;
+
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        sum += buf[i];
+        if (++st->count >= st->n)
+        {
+            st->count  = 0U;
+            buf[out++] = sum * scale;
+            sum        = 0.0f;
+        }
+    }
+
+    st->state[0] = sum;
+    return out;
+}
+
+/** Sliding median; state[0 .. n-2] are the previous inputs, oldest first. */
+static void sigcond_median(SigCond_Stage_t *st, float *buf, uint32_t n)
+{
+    float   *hist = st->state;
+    uint32_t w    = st->n;
+    float    win[SIGCOND_MEDIAN_MAX];
+
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        float x = buf[i];
+
+        /* Insertion sort of the window; at most 7 elements. */
+        for (uint32_t k = 0U; k < w; ++k)
+        {
+            float    v = (k < (w - 1U)) ? hist[k] : x;
+            uint32_t j = k;
+
+            for (; (j > 0U) && (win[j - 1U] > v); --j)
+                win[j] = win[j - 1U];
+            win[j] = v;
+        }
+        buf[i] = win[w / 2U];
+
+        for (uint32_t k = 1U; k < (w - 1U); ++k)
+            hist[k - 1U] = hist[k];
+        if (w > 1U)
+            hist[w - 2U] = x;
+    }
+}
+
+static uint8_t sigcond_rate_limit(SigCond_Stage_t *st, float *buf, uint32_t n)
+{
+    float   last    = st->state[0];
+    float   step    = st->a;
+    uint8_t limited = 0U;
+
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        float d = buf[i] - last;
+
+        if (d > step)
+        {
+            d = step;
+            limited = SIGCOND_ST_RATE;
+        }
+        else if (d < -step)
+        {
+            d = -step;
+            limited = SIGCOND_ST_RATE;
+        }
+        last  += d;
+        buf[i] = last;
+    }
+
+    st->state[0] = last;
+    return limited;
+}
+
+static void sigcond_range(SigCond_Stage_t *st, float *buf, uint32_t n)
+{
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        uint8_t out = ((buf[i] < st->a) || (buf[i] > st->b)) ? 1U : 0U;
+
+        /* Count the run of samples that disagree with the current state. */
+        if (out != st->bad)
+        {
+            if (++st->count >= st->n)
+            {
+                st->bad   = out;
+                st->count = 0U;
+            }
+        }
+        else
+        {
+            st->count = 0U;
+        }
+
+        if (out != 0U)
+            buf[i] = st->state[0];
+        else
+            st->state[0] = buf[i];
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef SigCond_Init(SigCond_Pipe_t *pipe, const SigCond_StageCfg_t *cfg,
+                               uint32_t count, float sampleHz, uint32_t blockSize)
+{
+    float    rate  = sampleHz;
+    uint32_t block = blockSize;
+
+    if ((pipe == NULL) || (cfg == NULL) || (count == 0U) ||
+        (count > (SIGCOND_MAX_STAGES - s_scStagesUsed)))
+        return HAL_ERROR;
+
+    pipe->first  = (uint16_t)s_scStagesUsed;
+    pipe->count  = (uint8_t)count;
+    pipe->status = 0U;
+
+    for (uint32_t i = 0U; i < count; ++i)
+    {
+        if (sigcond_setup(&s_scStages[pipe->first + i], &cfg[i], &rate, &block) != HAL_OK)
+            return HAL_ERROR;
+    }
+
+    s_scStagesUsed += count;
+    return HAL_OK;
+}
+
+uint32_t SigCond_Run(SigCond_Pipe_t *pipe, float *buf, uint32_t n)
+{
+    SigCond_Stage_t *st     = &s_scStages[pipe->first];
+    uint8_t          status = 0U;
+
+    for (uint32_t s = 0U; s < pipe->count; ++s, ++st)
+    {
+        switch (st->type)
+        {
+        case SIGCOND_FIR:
+            Dsp_FirF32(&st->f.fir, buf, buf, n);
+            break;
+
+        case SIGCOND_BIQUAD:
+            Dsp_BiquadF32(&st->f.iir, buf, buf, n);
+            break;
+
+        case SIGCOND_DECIMATE:
+        {
+            uint32_t out = 0U;
+
+            for (uint32_t i = 0U; i < n; ++i)
+            {
+                if (++st->count >= st->n)
+                {
+                    st->count  = 0U;
+                    buf[out++] = buf[i];
+                }
+            }
+            n = out;
+            break;
+        }
+
+        case SIGCOND_AVERAGE:
+            n = sigcond_average(st, buf, n);
+            break;
+
+        case SIGCOND_MEDIAN:
+            sigcond_median(st, buf, n);
+            break;
+
+        case SIGCOND_RATE_LIMIT:
+            status |= sigcond_rate_limit(st, buf, n);
+            break;
+
+        case SIGCOND_RANGE:
+            sigcond_range(st, buf, n);
+            if (st->bad != 0U)
+                status |= SIGCOND_ST_RANGE;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    pipe->status = status;
+    return n;
+}
+
+void SigCond_Reset(SigCond_Pipe_t *pipe, float x)
+{
+    SigCond_Stage_t *st = &s_scStages[pipe->first];
+
+    for (uint32_t s = 0U; s < pipe->count; ++s, ++st)
+    {
+        switch (st->type)
+        {
+        case SIGCOND_FIR:
+            Dsp_FirSettleF32(&st->f.fir, x);
+            break;
+
+        case SIGCOND_BIQUAD:
+            Dsp_BiquadSettleF32(&st->f.iir, x);
+            break;
+
+        case SIGCOND_MEDIAN:
+            for (uint32_t k = 0U; k < (st->n - 1U); ++k)
+                st->state[k] = x;
+            break;
+
+        case SIGCOND_RATE_LIMIT:
+        case SIGCOND_RANGE:
+            st->state[0] = x;
+            break;
+
+        case SIGCOND_AVERAGE:
+            st->state[0] = 0.0f;
+            break;
+
+        default:
+            break;
+        }
+
+        st->bad   = 0U;
+        st->count = 0U;
+    }
+
+    pipe->status = 0U;
+}
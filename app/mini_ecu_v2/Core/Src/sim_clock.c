@@ -0,0 +1,213 @@
+/**
+ * @file    sim_clock.c
+ * @brief   Simulation time base, step budget per release and "sim".
+ */
+
+#include "sim_clock.h"
+#include "audit.h"
+#include "cli_if.h"
+#include "log.h"
+#include "cmsis_os2.h"
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert((SIM_CLOCK_FREE_LOAD_PCT > 0U) && (SIM_CLOCK_FREE_LOAD_PCT < 100U),
+               "SIM_CLOCK_FREE_LOAD_PCT must be 1..99");
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Written by the control task (steps) and SimClock_SetScale() (any task),
+ * both under PRIMASK; 1 tick = 1 ms. At scale 1 the sim time is
+ * s_smSimMs plus the ticks since s_smBaseTick, otherwise s_smSimMs. */
+static uint32_t s_smScale    = 1U;
+static uint64_t s_smSimMs    = 0U;
+static uint64_t s_smSteps    = 0U;
+static uint32_t s_smBaseTick = 0U;
+static uint64_t s_smRunSim   = 0U;      /* sim time when the scale was set */
+static uint32_t s_smRunTick  = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Sim time at kernel tick @p tick; call with interrupts masked. */
+static uint64_t sim_now(uint32_t tick)
+{
+    if (s_smScale == 1U)
+        return s_smSimMs + (uint32_t)(tick - s_smBaseTick);
+
+    return s_smSimMs;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void sim_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    SimClock_Status_t st;
+
+    SimClock_GetStatus(&st);
+
+    uint64_t s = st.simMs / 1000U;
+
+    if (st.scale == SIM_CLOCK_SCALE_MAX)
+        CLI_IF_Print("Scale max");
+    else
+        CLI_IF_Printf("Scale %lux", (unsigned long)st.scale);
+
+    CLI_IF_Printf(", sim time %lu:%02u:%02u.%01u, %lu steps\r\n",
+                  (unsigned long)(s / 3600U), (unsigned)((s / 60U) % 60U), (unsigned)(s % 60U),
+                  (unsigned)((st.simMs % 1000U) / 100U), (unsigned long)st.steps);
+
+    if (st.runTicks != 0U)
+    {
+        CLI_IF_Printf("%.1fx real time over the last %lu s\r\n",
+                      (double)st.runSimMs / (double)st.runTicks,
+                      (unsigned long)(st.runTicks / 1000U));
+    }
+}
+
+static void sim_cmd_scale(int argc, char *argv[])
+{
+    (void)argc;
+
+    unsigned long scale = SIM_CLOCK_SCALE_MAX;
+
+    if (strcmp(argv[0], "max") != 0)
+    {
+        char *end = NULL;
+
+        scale = strtoul(argv[0], &end, 10);
+        if ((end == argv[0]) || (*end != '\0') || (scale == 0U))
+            scale = SIM_CLOCK_MAX_SCALE + 1U;
+    }
+
+    if (SimClock_SetScale((uint32_t)scale) != HAL_OK)
+    {
+        CLI_IF_Printf("Scale must be 1..%u or max\r\n", (unsigned)SIM_CLOCK_MAX_SCALE);
+        return;
+    }
+
+    Audit_Record(AUDIT_CMD_SIM_SCALE, AUDIT_SRC_CLI, (uint32_t)scale, 0U);
+    CLI_IF_Print("OK\r\n");
+}
+
+static const CliCommand_t s_smCmds[] =
+{
+    { "sim",       "",        0U, sim_cmd_show,  "simulation clock scale and sim time" },
+    { "sim scale", "<n|max>", 1U, sim_cmd_scale, "run the model at n x real time or flat out" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void SimClock_Init(void)
+{
+    uint32_t tick = osKernelGetTickCount();
+
+    s_smScale    = 1U;
+    s_smSimMs    = 0U;
+    s_smSteps    = 0U;
+    s_smBaseTick = tick;
+    s_smRunSim   = 0U;
+    s_smRunTick  = tick;
+
+    CLI_IF_REGISTER_TABLE(s_smCmds);
+}
+
+HAL_StatusTypeDef SimClock_SetScale(uint32_t scale)
+{
+    if (scale > SIM_CLOCK_MAX_SCALE)
+        return HAL_ERROR;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint32_t tick = osKernelGetTickCount();
+
+    /* Fold the real time elapsed at scale 1 in, then restart from here. */
+    s_smSimMs    = sim_now(tick);
+    s_smBaseTick = tick;
+    s_smScale    = scale;
+    s_smRunSim   = s_smSimMs;
+    s_smRunTick  = tick;
+
+    __set_PRIMASK(primask);
+
+    if (scale == SIM_CLOCK_SCALE_MAX)
+        LOG_INFO(VEH, "Sim clock free running");
+    else
+        LOG_INFO(VEH, "Sim clock at %lux", (unsigned long)scale);
+
+    return HAL_OK;
+}
+
+uint32_t SimClock_NowMs(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint64_t now = sim_now(osKernelGetTickCount());
+    __set_PRIMASK(primask);
+
+    return (uint32_t)now;
+}
+
+uint32_t SimClock_ToTicks(uint32_t simMs)
+{
+    uint32_t scale = s_smScale;
+
+    if ((simMs == osWaitForever) || (simMs == 0U) || (scale == 1U))
+        return simMs;
+
+    /* Free running has no fixed rate: look again on every tick. */
+    if (scale == SIM_CLOCK_SCALE_MAX)
+        return 1U;
+
+    uint32_t ticks = simMs / scale;
+    return (ticks != 0U) ? ticks : 1U;
+}
+
+void SimClock_Advance(uint32_t stepMs)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    s_smSteps++;
+    if (s_smScale != 1U)
+        s_smSimMs += stepMs;
+
+    __set_PRIMASK(primask);
+}
+
+uint8_t SimClock_Continue(uint32_t steps, uint32_t elapsedUs, uint32_t periodUs)
+{
+    uint32_t scale = s_smScale;
+
+    if (scale == SIM_CLOCK_SCALE_MAX)
+        return (elapsedUs < ((periodUs / 100U) * SIM_CLOCK_FREE_LOAD_PCT)) ? 1U : 0U;
+
+    return (steps < scale) ? 1U : 0U;
+}
+
+void SimClock_GetStatus(SimClock_Status_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint32_t tick = osKernelGetTickCount();
+
+    out->scale    = s_smScale;
+    out->simMs    = sim_now(tick);
+    out->steps    = s_smSteps;
+    out->runSimMs = (uint32_t)(out->simMs - s_smRunSim);
+    out->runTicks = tick - s_smRunTick;
+
+    __set_PRIMASK(primask);
+}
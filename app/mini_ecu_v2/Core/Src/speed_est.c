@@ -0,0 +1,353 @@
+/**
+ * @file    speed_est.c
+ * @brief   Speed / acceleration Kalman filter on the matrix kernels and
+ *          "sensor est". See speed_est.h.
+ */
+
+#include "speed_est.h"
+#include "cli_if.h"
+#include "dsp.h"
+#include "vsensor.h"
+#include <math.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define SE_DT           (1.0f / (float)VSENSOR_SAMPLE_HZ)
+
+/** Relative change of the gain below which it counts as converged. */
+#define SE_GAIN_TOL     1.0e-6f
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* SensorTask only, apart from SpeedEst_Init(). Row-major, preallocated;
+ * the Dsp_MatF32_t headers below point into them. */
+static float s_seXd[2];                 /* state [v, a] */
+static float s_sePd[4];                 /* covariance */
+static float s_seKd[2];                 /* gain */
+static float s_seFd[4];
+static float s_seFtd[4];
+static float s_seHd[2];
+static float s_seHtd[2];
+static float s_seQd[4];
+static float s_seRd[1];
+static float s_seId[4];
+static float s_seT1d[4];                /* scratch 2x2 */
+static float s_seT2d[4];
+static float s_seT3d[2];                /* scratch 2x1 */
+static float s_seSd[1];                 /* innovation covariance */
+static float s_seSid[1];
+
+static Dsp_MatF32_t s_seX, s_seP, s_seK, s_seF, s_seFt, s_seH, s_seHt, s_seQ, s_seR, s_seI;
+static Dsp_MatF32_t s_seT1, s_seT2, s_seT3, s_seS, s_seSi;
+static Dsp_MatF32_t s_seT1x;            /* s_seT1d as 2x1 */
+static Dsp_MatF32_t s_seT1h;            /* s_seT1d as 1x2 */
+
+static uint8_t  s_seRunning  = 0U;      /* a measurement started the filter */
+static uint32_t s_seCoastSmp = 0U;      /* samples since the last measurement */
+
+/* Published once per block; copied out under PRIMASK. */
+static SpeedEst_State_t s_seOut;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static void se_matrices_init(void)
+{
+    const float dt = SE_DT;
+    const float q  = SPEED_EST_JERK_PSD;
+
+    Dsp_MatInitF32(&s_seX,  2U, 1U, s_seXd);
+    Dsp_MatInitF32(&s_seP,  2U, 2U, s_sePd);
+    Dsp_MatInitF32(&s_seK,  2U, 1U, s_seKd);
+    Dsp_MatInitF32(&s_seF,  2U, 2U, s_seFd);
+    Dsp_MatInitF32(&s_seFt, 2U, 2U, s_seFtd);
+    Dsp_MatInitF32(&s_seH,  1U, 2U, s_seHd);
+    Dsp_MatInitF32(&s_seHt, 2U, 1U, s_seHtd);
+    Dsp_MatInitF32(&s_seQ,  2U, 2U, s_seQd);
+    Dsp_MatInitF32(&s_seR,  1U, 1U, s_seRd);
+    Dsp_MatInitF32(&s_seI,  2U, 2U, s_seId);
+    Dsp_MatInitF32(&s_seT1, 2U, 2U, s_seT1d);
+    Dsp_MatInitF32(&s_seT2, 2U, 2U, s_seT2d);
+    Dsp_MatInitF32(&s_seT3, 2U, 1U, s_seT3d);
+    Dsp_MatInitF32(&s_seS,  1U, 1U, s_seSd);
+    Dsp_MatInitF32(&s_seSi, 1U, 1U, s_seSid);
+    Dsp_MatInitF32(&s_seT1x, 2U, 1U, s_seT1d);
+    Dsp_MatInitF32(&s_seT1h, 1U, 2U, s_seT1d);
+
+    s_seFd[0] = 1.0f;  s_seFd[1] = dt;
+    s_seFd[2] = 0.0f;  s_seFd[3] = 1.0f;
+    (void)Dsp_MatTransF32(&s_seF, &s_seFt);
+
+    s_seHd[0] = 1.0f;  s_seHd[1] = 0.0f;
+    (void)Dsp_MatTransF32(&s_seH, &s_seHt);
+
+    /* White jerk integrated over one sample. */
+    s_seQd[0] = (q * dt * dt * dt) / 3.0f;
+    s_seQd[1] = (q * dt * dt) / 2.0f;
+    s_seQd[2] = s_seQd[1];
+    s_seQd[3] = q * dt;
+
+    s_seRd[0] = SPEED_EST_MEAS_VAR;
+
+    s_seId[0] = 1.0f;  s_seId[1] = 0.0f;
+    s_seId[2] = 0.0f;  s_seId[3] = 1.0f;
+}
+
+/** P from a restart: the measurement's variance, an acceleration unknown
+ *  to about 10 km/h/s. */
+static void se_cov_reset(void)
+{
+    s_sePd[0] = SPEED_EST_MEAS_VAR;
+    s_sePd[1] = 0.0f;
+    s_sePd[2] = 0.0f;
+    s_sePd[3] = 100.0f;
+}
+
+#if !SPEED_EST_STEADY
+/** x = F x. */
+static void se_predict_state(void)
+{
+    (void)Dsp_MatMultF32(&s_seF, &s_seX, &s_seT3);
+    s_seXd[0] = s_seT3d[0];
+    s_seXd[1] = s_seT3d[1];
+}
+#endif
+
+/** P = F P F' + Q. */
+static Dsp_Status_t se_predict_cov(void)
+{
+    Dsp_Status_t st = Dsp_MatMultF32(&s_seF, &s_seP, &s_seT1);
+
+    if (st == DSP_OK)
+        st = Dsp_MatMultF32(&s_seT1, &s_seFt, &s_seT2);
+    if (st == DSP_OK)
+        st = Dsp_MatAddF32(&s_seT2, &s_seQ, &s_seP);
+    return st;
+}
+
+/** K = P H' (H P H' + R)^-1, then P = (I - K H) P. */
+static Dsp_Status_t se_update_cov(void)
+{
+    Dsp_Status_t st = Dsp_MatMultF32(&s_seP, &s_seHt, &s_seT3);     /* P H' */
+
+    if (st == DSP_OK)
+        st = Dsp_MatMultF32(&s_seH, &s_seT3, &s_seS);               /* H P H' */
+    if (st == DSP_OK)
+        st = Dsp_MatAddF32(&s_seS, &s_seR, &s_seS);
+    if (st == DSP_OK)
+        st = Dsp_MatInverseF32(&s_seS, &s_seSi);
+    if (st == DSP_OK)
+        st = Dsp_MatMultF32(&s_seT3, &s_seSi, &s_seK);
+    if (st == DSP_OK)
+        st = Dsp_MatMultF32(&s_seK, &s_seH, &s_seT1);               /* K H */
+    if (st == DSP_OK)
+        st = Dsp_MatSubF32(&s_seI, &s_seT1, &s_seT1);
+    if (st == DSP_OK)
+        st = Dsp_MatMultF32(&s_seT1, &s_seP, &s_seT2);
+    if (st == DSP_OK)
+        (void)memcpy(s_sePd, s_seT2d, sizeof(s_sePd));
+    return st;
+}
+
+#if SPEED_EST_STEADY
+/**
+ * @brief Iterate the covariance until the gain settles.
+ *
+ * @return Iterations taken, SPEED_EST_RICCATI_MAX if it did not settle
+ *         (the last gain is kept).
+ */
+static uint32_t se_steady_gain(void)
+{
+    float last[2] = { 0.0f, 0.0f };
+
+    se_cov_reset();
+    for (uint32_t i = 1U; i <= SPEED_EST_RICCATI_MAX; ++i)
+    {
+        if ((se_predict_cov() != DSP_OK) || (se_update_cov() != DSP_OK))
+            return SPEED_EST_RICCATI_MAX;
+
+        float d = (fabsf(s_seKd[0] - last[0]) / fabsf(s_seKd[0])) +
+                  (fabsf(s_seKd[1] - last[1]) / fabsf(s_seKd[1]));
+        last[0] = s_seKd[0];
+        last[1] = s_seKd[1];
+        if ((i > 1U) && (d < SE_GAIN_TOL))
+            return i;
+    }
+    return SPEED_EST_RICCATI_MAX;
+}
+#endif
+
+/** One measurement @p z; @return z minus the prediction. */
+static float se_step(float z)
+{
+#if SPEED_EST_STEADY
+    /* Fixed gain with F = [1 dt; 0 1] and H = [1 0] written out. */
+    float v = s_seXd[0] + (s_seXd[1] * SE_DT);
+    float e = z - v;
+
+    s_seXd[0] = v + (s_seKd[0] * e);
+    s_seXd[1] = s_seXd[1] + (s_seKd[1] * e);
+    return e;
+#else
+    se_predict_state();
+    (void)se_predict_cov();
+    (void)se_update_cov();
+
+    /* x += K (z - H x) */
+    (void)Dsp_MatMultF32(&s_seH, &s_seX, &s_seS);
+    float e = z - s_seSd[0];
+    (void)Dsp_MatScaleF32(&s_seK, e, &s_seT1x);
+    (void)Dsp_MatAddF32(&s_seX, &s_seT1x, &s_seX);
+    return e;
+#endif
+}
+
+/** No measurement: predict only. */
+static void se_coast(void)
+{
+#if SPEED_EST_STEADY
+    s_seXd[0] += s_seXd[1] * SE_DT;
+#else
+    se_predict_state();
+    (void)se_predict_cov();
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void se_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    SpeedEst_State_t s;
+    SpeedEst_Get(&s);
+
+    CLI_IF_Printf("Speed estimate %.2f km/h, %+.2f km/h/s, %s, measured %lu ms ago\r\n",
+                  (double)s.speedKph, (double)s.accelKphS, (s.valid != 0U) ? "valid" : "INVALID",
+                  (unsigned long)(HAL_GetTick() - s.timeMs));
+#if SPEED_EST_STEADY
+    CLI_IF_Printf("Gain [%.5f %.4f], steady after %lu iterations%s\r\n",
+                  (double)s.gain[0], (double)s.gain[1], (unsigned long)s.gainIters,
+                  (s.gainIters >= SPEED_EST_RICCATI_MAX) ? " (not settled)" : "");
+#else
+    CLI_IF_Printf("Gain [%.5f %.4f], full recursion per sample\r\n",
+                  (double)s.gain[0], (double)s.gain[1]);
+#endif
+    CLI_IF_Printf("%lu samples, %lu coasted, %lu restarts, innovation max %.3f km/h\r\n",
+                  (unsigned long)s.samples, (unsigned long)s.coasted,
+                  (unsigned long)s.restarts, (double)s.innovMax);
+}
+
+static const CliCommand_t s_seCmds[] =
+{
+    { "sensor est", "", 0U, se_cmd_show, "Kalman speed estimate: state, gain, innovation" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void SpeedEst_Init(void)
+{
+    memset(&s_seOut, 0, sizeof(s_seOut));
+    se_matrices_init();
+
+#if SPEED_EST_STEADY
+    s_seOut.gainIters = se_steady_gain();
+#endif
+    se_cov_reset();
+    s_seOut.gain[0] = s_seKd[0];
+    s_seOut.gain[1] = s_seKd[1];
+
+    CLI_IF_REGISTER_TABLE(s_seCmds);
+}
+
+void SpeedEst_Block(const float *z, uint32_t n, uint8_t valid)
+{
+    uint32_t samples  = 0U;
+    uint32_t coasted  = 0U;
+    uint32_t restarts = 0U;
+    float    innovMax = 0.0f;
+
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        if ((valid == 0U) || (s_seRunning == 0U))
+        {
+            if (valid == 0U)
+            {
+                if (s_seRunning != 0U)
+                    se_coast();
+                s_seCoastSmp++;
+                coasted++;
+                continue;
+            }
+
+            /* First sample, or back after a coast that ran out. */
+            s_seXd[0]    = z[i];
+            s_seXd[1]    = 0.0f;
+            se_cov_reset();
+            s_seRunning  = 1U;
+            s_seCoastSmp = 0U;
+            samples++;
+            restarts++;
+            continue;
+        }
+
+        float e = fabsf(se_step(z[i]));
+        if (e > innovMax)
+            innovMax = e;
+        s_seCoastSmp = 0U;
+        samples++;
+    }
+
+    uint8_t ok = ((s_seRunning != 0U) &&
+                  (s_seCoastSmp <= ((SPEED_EST_COAST_MS * VSENSOR_SAMPLE_HZ) / 1000U))) ? 1U : 0U;
+    if (ok == 0U)
+        s_seRunning = 0U;
+
+    uint32_t now = HAL_GetTick();
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_seOut.speedKph  = (s_seXd[0] > 0.0f) ? s_seXd[0] : 0.0f;
+    s_seOut.accelKphS = s_seXd[1];
+    s_seOut.gain[0]   = s_seKd[0];
+    s_seOut.gain[1]   = s_seKd[1];
+    s_seOut.innovMax  = innovMax;
+    s_seOut.samples  += samples;
+    s_seOut.coasted  += coasted;
+    s_seOut.restarts += restarts;
+    if (samples != 0U)
+        s_seOut.timeMs = now;
+    s_seOut.valid     = ok;
+    __set_PRIMASK(primask);
+}
+
+uint8_t SpeedEst_GetKph(float *kph)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t valid = s_seOut.valid;
+    if (valid != 0U)
+        *kph = s_seOut.speedKph;
+    __set_PRIMASK(primask);
+
+    return valid;
+}
+
+void SpeedEst_Get(SpeedEst_State_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *out = s_seOut;
+    __set_PRIMASK(primask);
+}
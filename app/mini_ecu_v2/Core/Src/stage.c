@@ -0,0 +1,524 @@
+/**
+ * @file    stage.c
+ * @brief   Update image staging into the other slot, its coroutine and
+ *          "stage".
+ *
+ * TransferData (CanRxTask) is the only writer of the ring head and
+ * Stage_Coop() (BgTask) the only one of its tail; both are free-running
+ * byte counts. Stage_Begin() sets up a staging only while the coroutine is
+ * idle (IDLE, READY, FAILED) and hands it over by the state word; from then
+ * on the state is the coroutine's until it is idle again.
+ */
+
+#include "stage.h"
+#include "image_header.h"
+#include "boot_request.h"
+#include "crc.h"
+#include "vehicle_shared.h"
+#include "watchdog.h"
+#include "sram_layout.h"
+#include "cli_if.h"
+#include "log.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define ST_RING_MASK        (STAGE_RING_SIZE - 1U)
+
+_Static_assert((STAGE_RING_SIZE & ST_RING_MASK) == 0U, "STAGE_RING_SIZE must be a power of two");
+_Static_assert((STAGE_SLICE_WORDS > 0U) && (STAGE_SLICE_WORDS <= 64U),
+               "STAGE_SLICE_WORDS must be 1..64");
+
+typedef struct
+{
+    uint32_t id;        /* FLASH_SECTOR_x */
+    uint32_t addr;
+    uint32_t size;
+} Stage_Sector_t;
+
+typedef struct
+{
+    char                  name;
+    uint32_t              base;
+    uint32_t              size;
+    const Stage_Sector_t *sectors;
+    uint32_t              count;
+} Stage_Slot_t;
+
+/* The bootloader's slot table (boot_slot.c). */
+static const Stage_Sector_t s_stSectorsA[] =
+{
+    { FLASH_SECTOR_4, 0x08010000U,  64U * 1024U },
+    { FLASH_SECTOR_5, 0x08020000U, 128U * 1024U },
+};
+
+static const Stage_Sector_t s_stSectorsB[] =
+{
+    { FLASH_SECTOR_6, 0x08040000U, 128U * 1024U },
+    { FLASH_SECTOR_7, 0x08060000U, 128U * 1024U },
+};
+
+static const Stage_Slot_t s_stSlots[2] =
+{
+    { 'A', IMAGE_SLOT_A_ADDR, 192U * 1024U, s_stSectorsA, 2U },
+    { 'B', IMAGE_SLOT_B_ADDR, 256U * 1024U, s_stSectorsB, 2U },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static const Stage_Slot_t *s_stSlot = NULL;     /* the other slot, fixed at init */
+
+static volatile Stage_State_t s_stState = STAGE_IDLE;
+static volatile uint8_t       s_stAbort = 0U;
+
+/* Head and received: TransferData; tail and the rest: the coroutine. */
+NOCLEAR static uint8_t     s_stRing[STAGE_RING_SIZE];
+static volatile uint32_t   s_stHead;
+static volatile uint32_t   s_stTail;
+static Stage_Stats_t       s_stStats;
+static uint32_t            s_stSector;          /* next sector to erase */
+static uint8_t             s_stScanned;         /* s_stSector found not blank */
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t stage_busy(Stage_State_t state)
+{
+    return ((state == STAGE_ERASE) || (state == STAGE_WRITE) || (state == STAGE_VERIFY)) ? 1U : 0U;
+}
+
+static void stage_fail(const char *reason)
+{
+    s_stStats.reason = reason;
+    s_stState        = STAGE_FAILED;
+    LOG_WARN(MAIN, "Staging into slot %c failed: %s", s_stSlot->name, reason);
+}
+
+/** Fold a scheduler hold of @p cycles into @p maxUs. */
+static void stage_stall(uint32_t *maxUs, uint32_t cycles)
+{
+    uint32_t mhz = SystemCoreClock / 1000000U;
+    uint32_t us  = cycles / ((mhz != 0U) ? mhz : 1U);
+
+    if (us > *maxUs)
+        *maxUs = us;
+}
+
+/**
+ * Program @p n words at @p addr in one scheduler suspension.
+ *
+ * Unlock and lock are inside it as well, so no other flash user is
+ * switched in while this one holds the flash unlocked. HAL_FLASH_Program()
+ * and its busy wait run from SRAM (ramfunc.h).
+ */
+static HAL_StatusTypeDef stage_program(uint32_t addr, const uint32_t *words, uint32_t n)
+{
+    HAL_StatusTypeDef status = HAL_OK;
+    uint32_t          t0;
+
+    vTaskSuspendAll();
+    t0 = DWT->CYCCNT;
+    (void)HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                           FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+    for (uint32_t i = 0U; (i < n) && (status == HAL_OK); ++i)
+        status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr + (i * 4U), words[i]);
+    (void)HAL_FLASH_Lock();
+    stage_stall(&s_stStats.sliceMaxUs, DWT->CYCCNT - t0);
+    (void)xTaskResumeAll();
+
+    for (uint32_t i = 0U; (i < n) && (status == HAL_OK); ++i)
+    {
+        if (((const volatile uint32_t *)addr)[i] != words[i])
+            status = HAL_ERROR;
+    }
+
+    if (status != HAL_OK)
+        s_stStats.errors++;
+    return status;
+}
+
+/**
+ * Erase one sector: the one stall that cannot be sliced. Up to 2 s for
+ * 128 KB is more than the IWDG timeout at a fast LSI, so the IWDG is
+ * stretched for it and set back after each sector; WdgTask, late
+ * afterwards, restarts the deadlines.
+ */
+static HAL_StatusTypeDef stage_erase_sector(uint32_t sector)
+{
+    FLASH_EraseInitTypeDef erase = {0};
+    uint32_t               sectorError = 0U;
+    HAL_StatusTypeDef      status;
+    uint32_t               t0;
+
+    erase.TypeErase    = FLASH_TYPEERASE_SECTORS;
+    erase.Sector       = sector;
+    erase.NbSectors    = 1U;
+    erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+
+    Watchdog_Stretch();
+    vTaskSuspendAll();
+    t0 = DWT->CYCCNT;
+    (void)HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                           FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+    status = HAL_FLASHEx_Erase(&erase, &sectorError);
+    (void)HAL_FLASH_Lock();
+    stage_stall(&s_stStats.eraseMaxUs, DWT->CYCCNT - t0);
+    (void)xTaskResumeAll();
+    Watchdog_Restore();
+
+    if (status != HAL_OK)
+        s_stStats.errors++;
+    return status;
+}
+
+static uint8_t stage_blank(const Stage_Sector_t *sector)
+{
+    const volatile uint32_t *w = (const volatile uint32_t *)sector->addr;
+
+    for (uint32_t i = 0U; i < (sector->size / 4U); ++i)
+    {
+        if (w[i] != IMAGE_ERASED)
+            return 0U;
+    }
+    return 1U;
+}
+
+/** The erase stall is taken only while the vehicle stands still. */
+static uint8_t stage_window(void)
+{
+    VehicleState_t vs;
+
+    Vehicle_GetSnapshot(&vs);
+    return (vs.speed_kph < STAGE_ERASE_MAX_KPH) ? 1U : 0U;
+}
+
+/** Erase what is not blank yet; returns while waiting for a window. */
+static void stage_erase(void)
+{
+    while (s_stSector < s_stSlot->count)
+    {
+        const Stage_Sector_t *sector = &s_stSlot->sectors[s_stSector];
+
+        if (s_stAbort != 0U)
+        {
+            stage_fail("aborted");
+            return;
+        }
+
+        if ((s_stScanned == 0U) && (stage_blank(sector) != 0U))
+        {
+            s_stStats.blank++;
+            s_stSector++;
+            continue;
+        }
+        s_stScanned = 1U;
+
+        if (stage_window() == 0U)
+            return;
+        if (stage_erase_sector(sector->id) != HAL_OK)
+        {
+            stage_fail("erase failed");
+            return;
+        }
+        s_stStats.erased++;
+        s_stSector++;
+        s_stScanned = 0U;
+    }
+
+    s_stState = STAGE_WRITE;
+}
+
+/**
+ * Program one slice of the ring (STAGE_SLICE_WORDS words, one suspension);
+ * returns 0 once the ring is empty or the staging has ended.
+ */
+static uint8_t stage_write(void)
+{
+    uint32_t words[STAGE_SLICE_WORDS];
+    uint32_t n = (s_stHead - s_stTail) / 4U;
+
+    if (s_stAbort != 0U)
+    {
+        stage_fail("aborted");
+        return 0U;
+    }
+    if (n == 0U)
+    {
+        if (s_stStats.written == s_stStats.length)
+            s_stState = STAGE_VERIFY;
+        return 0U;
+    }
+    if (n > STAGE_SLICE_WORDS)
+        n = STAGE_SLICE_WORDS;
+
+    /* The head was published after its bytes (Stage_Write()). */
+    __DMB();
+    uint8_t *dst = (uint8_t *)words;
+    for (uint32_t i = 0U; i < (n * 4U); ++i)
+        dst[i] = s_stRing[(s_stTail + i) & ST_RING_MASK];
+
+    if (stage_program(s_stSlot->base + s_stStats.written, words, n) != HAL_OK)
+    {
+        stage_fail("program failed");
+        return 0U;
+    }
+    __DMB();
+    s_stTail = s_stTail + (n * 4U);
+    s_stStats.written += n * 4U;
+    return 1U;
+}
+
+/** Header, slot and CRC of the complete image, as the bootloader checks them. */
+static void stage_verify(void)
+{
+    uint32_t             base  = s_stSlot->base;
+    const ImageHeader_t *hdr   = IMAGE_HEADER_AT(base);
+    uint32_t             reset = ((const uint32_t *)base)[1];
+    uint32_t             end   = IMAGE_HEADER_OFFSET + (uint32_t)sizeof(ImageHeader_t);
+
+    if (hdr->magic != IMAGE_HEADER_MAGIC)
+    {
+        stage_fail("no image header");
+        return;
+    }
+    if ((hdr->length < end) || (hdr->length > s_stStats.length) || ((hdr->length & 3U) != 0U))
+    {
+        stage_fail("header length does not match the transfer");
+        return;
+    }
+    if ((reset < base) || (reset >= (base + s_stSlot->size)))
+    {
+        stage_fail("image not linked for this slot");
+        return;
+    }
+
+    uint32_t crc = Crc_Mpeg32(CRC32_INIT, (const uint32_t *)base, IMAGE_HEADER_OFFSET / 4U);
+    crc = Crc_Mpeg32(crc, (const uint32_t *)(base + end), (hdr->length - end) / 4U);
+    if (crc != hdr->crc32)
+    {
+        stage_fail("CRC mismatch");
+        return;
+    }
+
+    s_stState = STAGE_READY;
+    LOG_INFO(MAIN, "Staged v%lu.%lu.%lu in slot %c (%lu B), longest stall %lu us",
+             (unsigned long)((hdr->version >> 16) & 0xFFU),
+             (unsigned long)((hdr->version >> 8) & 0xFFU),
+             (unsigned long)(hdr->version & 0xFFU), s_stSlot->name,
+             (unsigned long)s_stStats.length,
+             (unsigned long)((s_stStats.eraseMaxUs > s_stStats.sliceMaxUs)
+                                 ? s_stStats.eraseMaxUs : s_stStats.sliceMaxUs));
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void stage_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    static const char *const names[] = { "idle", "erasing", "writing", "verifying", "ready", "failed" };
+    Stage_Stats_t st;
+
+    Stage_GetStats(&st);
+    CLI_IF_Printf("Stage %s into slot %c at 0x%08lX: %lu/%lu B received, %lu B programmed\r\n",
+                  names[st.state], s_stSlot->name, (unsigned long)st.base,
+                  (unsigned long)st.received, (unsigned long)st.length, (unsigned long)st.written);
+    CLI_IF_Printf("Sectors %lu erased, %lu blank; longest stall: slice %lu us, erase %lu ms\r\n",
+                  (unsigned long)st.erased, (unsigned long)st.blank,
+                  (unsigned long)st.sliceMaxUs, (unsigned long)(st.eraseMaxUs / 1000U));
+    if (st.state == STAGE_ERASE)
+        CLI_IF_Printf("Erase waits for a speed below %.1f km/h\r\n", (double)STAGE_ERASE_MAX_KPH);
+    if ((st.state == STAGE_FAILED) && (st.reason != NULL))
+        CLI_IF_Printf("Failed: %s\r\n", st.reason);
+    CLI_IF_Printf("Flash errors %lu\r\n", (unsigned long)st.errors);
+}
+
+static void stage_cmd_abort(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    Stage_Abort();
+    CLI_IF_Print("Staging aborted\r\n");
+}
+
+static void stage_cmd_activate(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if (Stage_Activate() != HAL_OK)
+    {
+        CLI_IF_Print("No verified image staged\r\n");
+        return;
+    }
+
+    CLI_IF_Printf("Slot %c activated, resetting into it...\r\n", s_stSlot->name);
+    BootRequest_Restart();
+}
+
+static const CliCommand_t s_stCmds[] =
+{
+    { "stage",          "", 0U, stage_cmd_show,     "image staging into the other slot" },
+    { "stage abort",    "", 0U, stage_cmd_abort,    "abandon the staging in progress" },
+    { "stage activate", "", 0U, stage_cmd_activate, "boot the staged image (on trial)" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef Stage_Init(void)
+{
+    uint32_t own = (uint32_t)&g_imageHeader - IMAGE_HEADER_OFFSET;
+
+    s_stSlot = &s_stSlots[(own == IMAGE_SLOT_A_ADDR) ? 1U : 0U];
+    memset(&s_stStats, 0, sizeof(s_stStats));
+    s_stStats.base = s_stSlot->base;
+
+    CLI_IF_REGISTER_TABLE(s_stCmds);
+    return HAL_OK;
+}
+
+void Stage_Coop(Coop_t *c)
+{
+    COOP_BEGIN(c);
+    for (;;)
+    {
+        COOP_WAIT_FLAGS(c, STAGE_FLAG, (s_stState == STAGE_ERASE) ? STAGE_ERASE_POLL_MS : COOP_FOREVER);
+
+        if (s_stState == STAGE_ERASE)
+            stage_erase();
+        /* A turn per slice, so the log and the flash log go on in between. */
+        while ((s_stState == STAGE_WRITE) && (stage_write() != 0U))
+            COOP_YIELD(c);
+        if (s_stState == STAGE_VERIFY)
+            stage_verify();
+    }
+    COOP_END(c);
+}
+
+uint32_t Stage_Target(void)
+{
+    return s_stSlot->base;
+}
+
+HAL_StatusTypeDef Stage_Begin(uint32_t length)
+{
+    if (s_stSlot == NULL)
+        return HAL_ERROR;
+
+    if (stage_busy(s_stState) != 0U)
+    {
+        Stage_Abort();
+        return HAL_BUSY;
+    }
+
+    if ((length == 0U) || ((length & 3U) != 0U) ||
+        (length > (s_stSlot->size - STAGE_SLOT_TAIL_SIZE)) ||
+        ((g_imageHeader.generation != IMAGE_ERASED) && (g_imageHeader.confirmed == IMAGE_ERASED)))
+    {
+        return HAL_ERROR;
+    }
+
+    s_stHead           = 0U;
+    s_stTail           = 0U;
+    s_stSector         = 0U;
+    s_stScanned        = 0U;
+    s_stAbort          = 0U;
+    s_stStats.length   = length;
+    s_stStats.received = 0U;
+    s_stStats.written  = 0U;
+    s_stStats.erased   = 0U;
+    s_stStats.blank    = 0U;
+    s_stStats.reason   = NULL;
+
+    __DMB();
+    s_stState = STAGE_ERASE;
+    Coop_Notify(STAGE_FLAG);
+
+    LOG_INFO(MAIN, "Staging %lu B into slot %c", (unsigned long)length, s_stSlot->name);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef Stage_Write(const uint8_t *data, uint32_t n)
+{
+    Stage_State_t state = s_stState;
+
+    if (((state != STAGE_ERASE) && (state != STAGE_WRITE)) || (s_stAbort != 0U) ||
+        (n > (s_stStats.length - s_stStats.received)))
+    {
+        return HAL_ERROR;
+    }
+    if (n > (STAGE_RING_SIZE - (s_stHead - s_stTail)))
+        return HAL_BUSY;
+
+    uint32_t head = s_stHead;
+    for (uint32_t i = 0U; i < n; ++i)
+        s_stRing[(head + i) & ST_RING_MASK] = data[i];
+
+    /* Bytes first; the coroutine reads them once it sees the head move. */
+    __DMB();
+    s_stHead            = head + n;
+    s_stStats.received += n;
+    Coop_Notify(STAGE_FLAG);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef Stage_End(void)
+{
+    Stage_State_t state = s_stState;
+
+    if (state == STAGE_READY)
+        return HAL_OK;
+    if ((stage_busy(state) == 0U) || (s_stAbort != 0U) ||
+        (s_stStats.received != s_stStats.length))
+    {
+        return HAL_ERROR;
+    }
+    return HAL_BUSY;
+}
+
+void Stage_Abort(void)
+{
+    if ((s_stSlot == NULL) || (stage_busy(s_stState) == 0U))
+        return;
+
+    s_stAbort = 1U;
+    Coop_Notify(STAGE_FLAG);
+}
+
+HAL_StatusTypeDef Stage_Activate(void)
+{
+    const ImageHeader_t *hdr = IMAGE_HEADER_AT(s_stSlot->base);
+    uint32_t             gen = g_imageHeader.generation;
+
+    if ((s_stState != STAGE_READY) || (hdr->generation != IMAGE_ERASED))
+        return HAL_ERROR;
+
+    /* One above the running image, as BootSlot_Activate() does. */
+    gen = (gen == IMAGE_ERASED) ? 1U : (gen + 1U);
+    if (stage_program((uint32_t)&hdr->generation, &gen, 1U) != HAL_OK)
+        return HAL_ERROR;
+
+    LOG_INFO(MAIN, "Slot %c activated, generation %lu", s_stSlot->name, (unsigned long)gen);
+    return HAL_OK;
+}
+
+void Stage_GetStats(Stage_Stats_t *out)
+{
+    *out       = s_stStats;
+    out->state = s_stState;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file    startup.c
+ * @brief   Early start-up for Reset_Handler and the start-up report.
+ */
+
+#include "startup.h"
+#include "boot_prof.h"
+#include "clock_cfg.h"
+#include "log.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* Linker script: the regions Reset_Handler copies, zeroes and skips. */
+extern uint32_t _sdata;
+extern uint32_t _edata;
+extern uint32_t _sramfunc;
+extern uint32_t _eramfunc;
+extern uint32_t _sbss;
+extern uint32_t _ebss;
+extern uint32_t _ssram2;
+extern uint32_t _esram2;
+extern uint32_t _snoclear;
+extern uint32_t _enoclear;
+
+#define SU_BYTES(s, e)  ((uint32_t)(uintptr_t)&(e) - (uint32_t)(uintptr_t)&(s))
+
+/* Reset_Handler marks these by number. */
+_Static_assert((BOOT_PROF_DATA == 2) && (BOOT_PROF_BSS == 3) && (BOOT_PROF_MAIN == 4),
+               "startup_stm32f446retx.s passes the boot profile points by number");
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void Startup_EarlyInit(void)
+{
+    BootProf_Begin();
+    ClockCfg_EarlyInit();
+    BootProf_Mark(BOOT_PROF_CLOCK_EARLY);
+}
+
+void Startup_Report(void)
+{
+    /* The RAM link puts .sram2 inside .bss. */
+    uint32_t zeroed = SU_BYTES(_sbss, _ebss);
+    if ((&_ssram2 < &_sbss) || (&_esram2 > &_ebss))
+        zeroed += SU_BYTES(_ssram2, _esram2);
+
+    LOG_INFO(MAIN, "Reset to main() %lu us; copied %lu B, zeroed %lu B, %lu B NOCLEAR (boot times)",
+             (unsigned long)BootProf_Us(BOOT_PROF_MAIN),
+             (unsigned long)(SU_BYTES(_sdata, _edata) + SU_BYTES(_sramfunc, _eramfunc)),
+             (unsigned long)zeroed, (unsigned long)SU_BYTES(_snoclear, _enoclear));
+}
@@ -24,6 +24,22 @@
 #include "task.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "low_power.h"
+#include "vsensor.h"
+#include "dma_copy.h"
+#include "ctrl_loop.h"
+#include "crank.h"
+#include "angle_sched.h"
+#include "pedal.h"
+#include "can_nm.h"
+#include "crash_dump.h"
+#include "rtos_trace.h"
+#include "can_if.h"
+#include "irq_bench.h"
+#include "usb_cdc.h"
+#include "qspi_flash.h"
+#include "watch.h"
+#include "pc_prof.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -58,8 +74,13 @@
 
 /* External variables --------------------------------------------------------*/
 extern CAN_HandleTypeDef hcan1;
+extern DMA_HandleTypeDef hdma_usart2_rx;
+extern DMA_HandleTypeDef hdma_usart2_tx;
 extern UART_HandleTypeDef huart2;
 /* USER CODE BEGIN EV */
+#if CAN_IF_NUM_BUSES > 1U
+extern CAN_HandleTypeDef hcan2;
+#endif
 
 /* USER CODE END EV */
 
@@ -81,86 +102,13 @@ void NMI_Handler(void)
   /* USER CODE END NonMaskableInt_IRQn 1 */
 }
 
-/**
-  * @brief This function handles Hard fault interrupt.
-  */
-void HardFault_Handler(void)
-{
-  /* USER CODE BEGIN HardFault_IRQn 0 */
-
-  /* USER CODE END HardFault_IRQn 0 */
-  while (1)
-  {
-    /* USER CODE BEGIN W1_HardFault_IRQn 0 */
-    /* USER CODE END W1_HardFault_IRQn 0 */
-  }
-}
-
-/**
-  * @brief This function handles Memory management fault.
-  */
-void MemManage_Handler(void)
-{
-  /* USER CODE BEGIN MemoryManagement_IRQn 0 */
-
-  /* USER CODE END MemoryManagement_IRQn 0 */
-  while (1)
-  {
-    /* USER CODE BEGIN W1_MemoryManagement_IRQn 0 */
-    /* USER CODE END W1_MemoryManagement_IRQn 0 */
-  }
-}
-
-/**
-  * @brief This function handles Pre-fetch fault, memory access fault.
-  */
-void BusFault_Handler(void)
-{
-  /* USER CODE BEGIN BusFault_IRQn 0 */
-
-  /* USER CODE END BusFault_IRQn 0 */
-  while (1)
-  {
-    /* USER CODE BEGIN W1_BusFault_IRQn 0 */
-    /* USER CODE END W1_BusFault_IRQn 0 */
-  }
-}
-
-/**
-  * @brief This function handles Undefined instruction or illegal state.
-  */
-void UsageFault_Handler(void)
-{
-  /* USER CODE BEGIN UsageFault_IRQn 0 */
-
-  /* USER CODE END UsageFault_IRQn 0 */
-  while (1)
-  {
-    /* USER CODE BEGIN W1_UsageFault_IRQn 0 */
-    /* USER CODE END W1_UsageFault_IRQn 0 */
-  }
-}
-
-/**
-  * @brief This function handles Debug monitor.
-  */
-void DebugMon_Handler(void)
-{
-  /* USER CODE BEGIN DebugMonitor_IRQn 0 */
-
-  /* USER CODE END DebugMonitor_IRQn 0 */
-  /* USER CODE BEGIN DebugMonitor_IRQn 1 */
-
-  /* USER CODE END DebugMonitor_IRQn 1 */
-}
-
 /**
   * @brief This function handles System tick timer.
   */
 void SysTick_Handler(void)
 {
   /* USER CODE BEGIN SysTick_IRQn 0 */
-
+  RTOS_TRACE_ISR_ENTER();
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
 #if (INCLUDE_xTaskGetSchedulerState == 1 )
@@ -172,7 +120,7 @@ void SysTick_Handler(void)
   }
 #endif /* INCLUDE_xTaskGetSchedulerState */
   /* USER CODE BEGIN SysTick_IRQn 1 */
-
+  RTOS_TRACE_ISR_EXIT();
   /* USER CODE END SysTick_IRQn 1 */
 }
 
@@ -183,17 +131,53 @@ void SysTick_Handler(void)
 /* please refer to the startup file (startup_stm32f4xx.s).                    */
 /******************************************************************************/
 
+/**
+  * @brief This function handles DMA1 stream5 global interrupt.
+  */
+void DMA1_Stream5_IRQHandler(void)
+{
+  /* USER CODE BEGIN DMA1_Stream5_IRQn 0 */
+  IRQ_BENCH_START(UART);
+  RTOS_TRACE_ISR_ENTER();
+  /* USER CODE END DMA1_Stream5_IRQn 0 */
+  HAL_DMA_IRQHandler(&hdma_usart2_rx);
+  /* USER CODE BEGIN DMA1_Stream5_IRQn 1 */
+  RTOS_TRACE_ISR_EXIT();
+  /* USER CODE END DMA1_Stream5_IRQn 1 */
+}
+
+/**
+  * @brief This function handles DMA1 stream6 global interrupt.
+  */
+void DMA1_Stream6_IRQHandler(void)
+{
+  /* USER CODE BEGIN DMA1_Stream6_IRQn 0 */
+  RTOS_TRACE_ISR_ENTER();
+  /* USER CODE END DMA1_Stream6_IRQn 0 */
+  HAL_DMA_IRQHandler(&hdma_usart2_tx);
+  /* USER CODE BEGIN DMA1_Stream6_IRQn 1 */
+  RTOS_TRACE_ISR_EXIT();
+  /* USER CODE END DMA1_Stream6_IRQn 1 */
+}
+
 /**
   * @brief This function handles CAN1 RX0 interrupt.
   */
 void CAN1_RX0_IRQHandler(void)
 {
   /* USER CODE BEGIN CAN1_RX0_IRQn 0 */
-
+  IRQ_BENCH_START(CAN);
+  RTOS_TRACE_ISR_ENTER();
+#if CAN_IF_RX_FAST_IRQ
+  /* Above the kernel: the ring only, no HAL dispatch (can_if.h) */
+  CAN_IF_RxIRQHandler(CAN_IF_BUS1, CAN_RX_FIFO0);
+  RTOS_TRACE_ISR_EXIT();
+  return;
+#endif
   /* USER CODE END CAN1_RX0_IRQn 0 */
   HAL_CAN_IRQHandler(&hcan1);
   /* USER CODE BEGIN CAN1_RX0_IRQn 1 */
-
+  RTOS_TRACE_ISR_EXIT();
   /* USER CODE END CAN1_RX0_IRQn 1 */
 }
 
@@ -203,11 +187,11 @@ void CAN1_RX0_IRQHandler(void)
 void CAN1_SCE_IRQHandler(void)
 {
   /* USER CODE BEGIN CAN1_SCE_IRQn 0 */
-
+  RTOS_TRACE_ISR_ENTER();
   /* USER CODE END CAN1_SCE_IRQn 0 */
   HAL_CAN_IRQHandler(&hcan1);
   /* USER CODE BEGIN CAN1_SCE_IRQn 1 */
-
+  RTOS_TRACE_ISR_EXIT();
   /* USER CODE END CAN1_SCE_IRQn 1 */
 }
 
@@ -217,14 +201,272 @@ void CAN1_SCE_IRQHandler(void)
 void USART2_IRQHandler(void)
 {
   /* USER CODE BEGIN USART2_IRQn 0 */
-
+  IRQ_BENCH_START(UART);
+  RTOS_TRACE_ISR_ENTER();
   /* USER CODE END USART2_IRQn 0 */
   HAL_UART_IRQHandler(&huart2);
   /* USER CODE BEGIN USART2_IRQn 1 */
-
+  RTOS_TRACE_ISR_EXIT();
   /* USER CODE END USART2_IRQn 1 */
 }
 
 /* USER CODE BEGIN 1 */
 
+/* The fault handlers are not generated (mini_ecu_v2.ioc): each records a
+   crash dump and resets (crash_dump.h). */
+
+/**
+  * @brief This function handles Hard fault interrupt.
+  */
+__attribute__((naked)) void HardFault_Handler(void)
+{
+  CRASH_DUMP_FAULT_ENTRY();
+}
+
+/**
+  * @brief This function handles Memory management fault.
+  */
+__attribute__((naked)) void MemManage_Handler(void)
+{
+  CRASH_DUMP_FAULT_ENTRY();
+}
+
+/**
+  * @brief This function handles Pre-fetch fault, memory access fault.
+  */
+__attribute__((naked)) void BusFault_Handler(void)
+{
+  CRASH_DUMP_FAULT_ENTRY();
+}
+
+/**
+  * @brief This function handles Undefined instruction or illegal state.
+  */
+__attribute__((naked)) void UsageFault_Handler(void)
+{
+  CRASH_DUMP_FAULT_ENTRY();
+}
+
+/**
+  * @brief This function handles Debug monitor: data watchpoint hits
+  *        (watch.h). Not generated either.
+  */
+#if WATCH_ENABLE
+__attribute__((naked)) void DebugMon_Handler(void)
+{
+  WATCH_DEBUGMON_ENTRY();
+}
+#else
+void DebugMon_Handler(void)
+{
+}
+#endif
+
+/**
+  * @brief This function handles CAN1 TX interrupt.
+  */
+void CAN1_TX_IRQHandler(void)
+{
+  RTOS_TRACE_ISR_ENTER();
+  HAL_CAN_IRQHandler(&hcan1);
+  CAN_IF_TxIRQHandler(CAN_IF_BUS1);
+  RTOS_TRACE_ISR_EXIT();
+}
+
+/**
+  * @brief This function handles CAN1 RX1 interrupt.
+  */
+void CAN1_RX1_IRQHandler(void)
+{
+  IRQ_BENCH_START(CAN);
+  RTOS_TRACE_ISR_ENTER();
+#if CAN_IF_RX_FAST_IRQ
+  CAN_IF_RxIRQHandler(CAN_IF_BUS1, CAN_RX_FIFO1);
+#else
+  HAL_CAN_IRQHandler(&hcan1);
+#endif
+  RTOS_TRACE_ISR_EXIT();
+}
+
+#if CAN_IF_NUM_BUSES > 1U
+/**
+  * @brief This function handles CAN2 TX interrupt.
+  */
+void CAN2_TX_IRQHandler(void)
+{
+  RTOS_TRACE_ISR_ENTER();
+  HAL_CAN_IRQHandler(&hcan2);
+  CAN_IF_TxIRQHandler(CAN_IF_BUS2);
+  RTOS_TRACE_ISR_EXIT();
+}
+
+/**
+  * @brief This function handles CAN2 RX0 interrupt (gateway, can_gw.h).
+  */
+void CAN2_RX0_IRQHandler(void)
+{
+  RTOS_TRACE_ISR_ENTER();
+#if CAN_IF_RX_FAST_IRQ
+  CAN_IF_RxIRQHandler(CAN_IF_BUS2, CAN_RX_FIFO0);
+#else
+  HAL_CAN_IRQHandler(&hcan2);
+#endif
+  RTOS_TRACE_ISR_EXIT();
+}
+
+/**
+  * @brief This function handles CAN2 SCE interrupt.
+  */
+void CAN2_SCE_IRQHandler(void)
+{
+  RTOS_TRACE_ISR_ENTER();
+  HAL_CAN_IRQHandler(&hcan2);
+  RTOS_TRACE_ISR_EXIT();
+}
+#endif
+
+#if CAN_IF_RX_FAST_IRQ
+/**
+  * @brief This function handles the CAN RX hand-off (HDMI-CEC vector, pended
+  *        by the CAN RX interrupts, can_if.h).
+  */
+void CEC_IRQHandler(void)
+{
+  RTOS_TRACE_ISR_ENTER();
+  CAN_IF_RxSwiIRQHandler();
+  RTOS_TRACE_ISR_EXIT();
+}
+#endif
+
+/**
+  * @brief This function handles the RTC wakeup interrupt through EXTI line 22.
+  */
+void RTC_WKUP_IRQHandler(void)
+{
+  RTOS_TRACE_ISR_ENTER();
+  LowPower_WakeupIRQHandler();
+  RTOS_TRACE_ISR_EXIT();
+}
+
+/**
+  * @brief This function handles DMA2 stream0 global interrupt (ADC1, vsensor.h).
+  */
+void DMA2_Stream0_IRQHandler(void)
+{
+  RTOS_TRACE_ISR_ENTER();
+  VSensor_DmaIRQHandler();
+  RTOS_TRACE_ISR_EXIT();
+}
+
+/**
+  * @brief This function handles DMA2 stream1 global interrupt (memory copies, dma_copy.h).
+  */
+void DMA2_Stream1_IRQHandler(void)
+{
+  RTOS_TRACE_ISR_ENTER();
+  DmaCopy_IRQHandler();
+  RTOS_TRACE_ISR_EXIT();
+}
+
+/**
+  * @brief This function handles the TIM4 global interrupt (crank tooth capture, crank.h;
+  *        crank-angle events, angle_sched.h).
+  */
+void TIM4_IRQHandler(void)
+{
+  RTOS_TRACE_ISR_ENTER();
+  if ((TIM4->SR & TIM_SR_CC1IF) != 0U)
+  {
+    Crank_CaptureIRQHandler();
+  }
+#if ANGLE_SCHED_ENABLE
+  AngleSched_CompareIRQHandler();
+#endif
+  RTOS_TRACE_ISR_EXIT();
+}
+
+/**
+  * @brief This function handles the TIM5 global interrupt (control loop, ctrl_loop.h).
+  */
+void TIM5_IRQHandler(void)
+{
+  RTOS_TRACE_ISR_ENTER();
+  CtrlLoop_TimerIRQHandler();
+  RTOS_TRACE_ISR_EXIT();
+}
+
+/**
+  * @brief This function handles EXTI lines 10 to 15 (B1 on line 13, pedal.h;
+  *        CAN1_RX on line 11 in bus sleep, can_nm.h).
+  */
+void EXTI15_10_IRQHandler(void)
+{
+  RTOS_TRACE_ISR_ENTER();
+  Pedal_ExtiIRQHandler();
+  CanNm_ExtiIRQHandler();
+  RTOS_TRACE_ISR_EXIT();
+}
+
+#if PC_PROF_ENABLE
+/**
+  * @brief This function handles the TIM6 global interrupt (PC sampling,
+  *        pc_prof.h). Naked: the sample is the stacked PC.
+  */
+__attribute__((naked)) void TIM6_DAC_IRQHandler(void)
+{
+  PC_PROF_TIM6_ENTRY();
+}
+#endif
+
+/**
+  * @brief This function handles the TIM7 global interrupt (pedal debounce).
+  */
+void TIM7_IRQHandler(void)
+{
+  RTOS_TRACE_ISR_ENTER();
+  Pedal_TimerIRQHandler();
+  RTOS_TRACE_ISR_EXIT();
+}
+
+#if IRQ_BENCH_ENABLE
+/**
+  * @brief This function handles EXTI line 4 (latency benchmark stimulus, irq_bench.h).
+  */
+void EXTI4_IRQHandler(void)
+{
+  IRQ_BENCH_END(EXTI);
+  RTOS_TRACE_ISR_ENTER();
+  IrqBench_ExtiIRQHandler();
+  RTOS_TRACE_ISR_EXIT();
+}
+#endif
+
+#if USB_CDC_ENABLE
+/**
+  * @brief This function handles the USB OTG interrupt (CDC console, usb_cdc.h).
+  */
+#if USB_CDC_USE_OTG_FS
+void OTG_FS_IRQHandler(void)
+#else
+void OTG_HS_IRQHandler(void)
+#endif
+{
+  RTOS_TRACE_ISR_ENTER();
+  UsbCdc_IRQHandler();
+  RTOS_TRACE_ISR_EXIT();
+}
+#endif
+
+#if QSPI_FLASH_ENABLE
+/**
+  * @brief This function handles the QUADSPI interrupt (flash operations, qspi_flash.h).
+  */
+void QUADSPI_IRQHandler(void)
+{
+  RTOS_TRACE_ISR_ENTER();
+  QspiFlash_IRQHandler();
+  RTOS_TRACE_ISR_EXIT();
+}
+#endif
+
 /* USER CODE END 1 */
@@ -0,0 +1,249 @@
+/**
+ * @file    sys_config.c
+ * @brief   RAM budget of the task and queue tables, the interrupt priority
+ *          checks, and "tasks" and "irqs".
+ */
+
+#include "sys_config.h"
+#include "vehicle_shared.h"
+#include "rtos_stack.h"
+#include "cli_if.h"
+#include "log.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    const char *name;
+    uint32_t    priority;
+    uint32_t    stackWords;
+    uint32_t    periodUs;
+    uint32_t    created;        /* SYS_BOOT, SYS_DEFERRED or SYS_MODULE */
+} SysConfig_Task_t;
+
+typedef struct
+{
+    const char *name;
+    uint32_t    depth;
+    uint32_t    itemBytes;
+} SysConfig_Queue_t;
+
+#define SC_TASK_ENTRY_(name, prio, words, periodUs, created)   \
+    { #name, (uint32_t)(prio), (words), (periodUs), (created) },
+#define SC_QUEUE_ENTRY_(name, depth, type)   { #name, (depth), (uint32_t)sizeof(type) },
+
+typedef struct
+{
+    const char *name;
+    IRQn_Type   irqn;
+    uint8_t     priority;
+    uint8_t     kind;           /* SYS_IRQ_KERNEL or SYS_IRQ_FAST */
+} SysConfig_Irq_t;
+
+#define SC_IRQ_ENTRY_(name, irqn, prio, kind)   { #name, (irqn), (uint8_t)(prio), (uint8_t)(kind) },
+
+/* A line on the wrong side of the syscall ceiling fails the build. */
+#define SC_IRQ_ASSERT_(name, irqn, prio, kind)                                      \
+    _Static_assert((prio) <= SYS_IRQ_LOWEST, "SYS_IRQ_TABLE: " #name " below the lowest priority"); \
+    _Static_assert(((kind) == SYS_IRQ_FAST) ? ((prio) < SYS_IRQ_CEILING)            \
+                                            : ((prio) >= SYS_IRQ_CEILING),          \
+                   "SYS_IRQ_TABLE: " #name " on the wrong side of the syscall ceiling");
+
+/* Last external vector of the STM32F446. */
+#define SC_IRQ_LAST       FMPI2C1_ER_IRQn
+
+/* Bytes of SRAM1 per line: stack and control block, storage and control
+ * block. */
+#define SC_TASK_BYTES_(name, prio, words, periodUs, created)   \
+    + ((words) * sizeof(StackType_t)) + sizeof(StaticTask_t)
+#define SC_QUEUE_BYTES_(name, depth, type)   + ((depth) * sizeof(type)) + sizeof(StaticQueue_t)
+
+/* Idle and timer task, from the static memory of cmsis_os2.c. */
+#define SC_KERNEL_BYTES   (((configMINIMAL_STACK_SIZE + configTIMER_TASK_STACK_DEPTH) * sizeof(StackType_t)) + \
+                           (2U * sizeof(StaticTask_t)))
+
+#define SC_RAM_BYTES      (SC_KERNEL_BYTES SYS_TASK_TABLE(SC_TASK_BYTES_) SYS_QUEUE_TABLE(SC_QUEUE_BYTES_))
+
+/* Tasks "stack" has to keep: the table's, idle, timer and the defaultTask
+ * of DEFAULT_TASK_MODE 1. */
+#define SC_KERNEL_TASKS   (2U + ((DEFAULT_TASK_MODE == 1) ? 1U : 0U))
+
+_Static_assert(SC_RAM_BYTES <= SYS_RAM_BUDGET, "SYS_TASK_TABLE and SYS_QUEUE_TABLE exceed SYS_RAM_BUDGET");
+_Static_assert((SYS_TASKS + SC_KERNEL_TASKS) <= RTOS_STACK_MAX_TASKS, "more tasks than RTOS_STACK_MAX_TASKS");
+SYS_IRQ_TABLE(SC_IRQ_ASSERT_)
+_Static_assert(SYS_IRQ_CEILING > 0, "the syscall ceiling must leave priority 0 above the kernel");
+#if WATCHDOG_ENABLE
+_Static_assert(SYS_PRIO_WdgTask > SYS_PRIO_Raster1ms, "WdgTask must preempt every supervised task");
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static const SysConfig_Task_t s_scTasks[] =
+{
+    SYS_TASK_TABLE(SC_TASK_ENTRY_)
+};
+
+static const SysConfig_Queue_t s_scQueues[] =
+{
+    SYS_QUEUE_TABLE(SC_QUEUE_ENTRY_)
+};
+
+static const SysConfig_Irq_t s_scIrqs[] =
+{
+    SYS_IRQ_TABLE(SC_IRQ_ENTRY_)
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Line of @p irqn, or NULL. */
+static const SysConfig_Irq_t *sc_irq_find(IRQn_Type irqn)
+{
+    for (uint32_t i = 0U; i < SYS_IRQS; ++i)
+    {
+        if (s_scIrqs[i].irqn == irqn)
+            return &s_scIrqs[i];
+    }
+    return NULL;
+}
+
+/** System exceptions have no enable bit: always in use. */
+static uint32_t sc_irq_enabled(IRQn_Type irqn)
+{
+    return ((int32_t)irqn < 0) ? 1U : NVIC_GetEnableIRQ(irqn);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI commands                                                               */
+/* -------------------------------------------------------------------------- */
+
+static void sys_cmd_tasks(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    static const char *const created[] = { "boot", "deferred", "module" };
+
+    CLI_IF_Print("Task            Prio  Stack B  Period us  Created\r\n");
+    for (uint32_t i = 0U; i < (uint32_t)(sizeof(s_scTasks) / sizeof(s_scTasks[0])); ++i)
+    {
+        const SysConfig_Task_t *t = &s_scTasks[i];
+
+        if (t->periodUs != 0U)
+            CLI_IF_Printf("%-15s %4lu %8lu %10lu  %s\r\n", t->name, (unsigned long)t->priority,
+                          (unsigned long)(t->stackWords * sizeof(StackType_t)),
+                          (unsigned long)t->periodUs, created[t->created]);
+        else
+            CLI_IF_Printf("%-15s %4lu %8lu      event  %s\r\n", t->name, (unsigned long)t->priority,
+                          (unsigned long)(t->stackWords * sizeof(StackType_t)), created[t->created]);
+    }
+
+    CLI_IF_Print("Queue           Depth  Item B\r\n");
+    for (uint32_t i = 0U; i < (uint32_t)(sizeof(s_scQueues) / sizeof(s_scQueues[0])); ++i)
+    {
+        CLI_IF_Printf("%-15s %5lu %7lu\r\n", s_scQueues[i].name, (unsigned long)s_scQueues[i].depth,
+                      (unsigned long)s_scQueues[i].itemBytes);
+    }
+
+    CLI_IF_Printf("%lu tasks, %lu B of %lu B budget (idle and timer %lu B)\r\n",
+                  (unsigned long)SYS_TASKS, (unsigned long)SC_RAM_BYTES,
+                  (unsigned long)SYS_RAM_BUDGET, (unsigned long)SC_KERNEL_BYTES);
+}
+
+static void sys_cmd_irqs(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    static const char *const kind[] = { "kernel", "fast" };
+
+    CLI_IF_Print("IRQ            Vec  Prio  NVIC  Kind    State\r\n");
+    for (uint32_t i = 0U; i < SYS_IRQS; ++i)
+    {
+        const SysConfig_Irq_t *q = &s_scIrqs[i];
+        uint32_t on  = sc_irq_enabled(q->irqn);
+        uint32_t cur = NVIC_GetPriority(q->irqn);
+
+        CLI_IF_Printf("%-13s %4ld %5lu %5lu  %-6s  %s\r\n", q->name, (long)q->irqn,
+                      (unsigned long)q->priority, (unsigned long)cur, kind[q->kind],
+                      (on == 0U) ? "off" : ((cur == q->priority) ? "on" : "on, MISMATCH"));
+    }
+
+    for (int32_t irq = 0; irq <= (int32_t)SC_IRQ_LAST; ++irq)
+    {
+        if ((NVIC_GetEnableIRQ((IRQn_Type)irq) != 0U) && (sc_irq_find((IRQn_Type)irq) == NULL))
+            CLI_IF_Printf("%-13s %4ld     - %5lu  -       on, NOT IN TABLE\r\n", "?", (long)irq,
+                          (unsigned long)NVIC_GetPriority((IRQn_Type)irq));
+    }
+
+    CLI_IF_Printf("%lu interrupts, ceiling %lu, %lu errors\r\n", (unsigned long)SYS_IRQS,
+                  (unsigned long)SYS_IRQ_CEILING, (unsigned long)SysConfig_CheckIrqs());
+}
+
+static const CliCommand_t s_scCmds[] =
+{
+    { "tasks", "", 0U, sys_cmd_tasks, "configured tasks and queues: priority, stack, period, RAM budget" },
+    { "irqs",  "", 0U, sys_cmd_irqs,  "interrupt priorities: SYS_IRQ_TABLE against the NVIC" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void SysConfig_Init(void)
+{
+    CLI_IF_REGISTER_TABLE(s_scCmds);
+}
+
+void SysConfig_ApplyIrqs(void)
+{
+    for (uint32_t i = 0U; i < SYS_IRQS; ++i)
+        NVIC_SetPriority(s_scIrqs[i].irqn, s_scIrqs[i].priority);
+}
+
+uint32_t SysConfig_CheckIrqs(void)
+{
+    uint32_t errors = 0U;
+
+    /* The ceiling compares preemption priorities: all 4 bits must be. */
+    if (NVIC_GetPriorityGrouping() != NVIC_PRIORITYGROUP_4)
+    {
+        LOG_ERROR(MAIN, "IRQ priority grouping %lu, not NVIC_PRIORITYGROUP_4",
+                  (unsigned long)NVIC_GetPriorityGrouping());
+        errors++;
+    }
+
+    for (uint32_t i = 0U; i < SYS_IRQS; ++i)
+    {
+        const SysConfig_Irq_t *q = &s_scIrqs[i];
+        uint32_t cur = NVIC_GetPriority(q->irqn);
+
+        if ((sc_irq_enabled(q->irqn) != 0U) && (cur != q->priority))
+        {
+            LOG_ERROR(MAIN, "IRQ %s at priority %lu, SYS_IRQ_TABLE %lu%s", q->name,
+                      (unsigned long)cur, (unsigned long)q->priority,
+                      ((q->kind == SYS_IRQ_KERNEL) && (cur < SYS_IRQ_CEILING)) ?
+                      ", above the syscall ceiling" : "");
+            errors++;
+        }
+    }
+
+    for (int32_t irq = 0; irq <= (int32_t)SC_IRQ_LAST; ++irq)
+    {
+        if ((NVIC_GetEnableIRQ((IRQn_Type)irq) != 0U) && (sc_irq_find((IRQn_Type)irq) == NULL))
+        {
+            LOG_ERROR(MAIN, "IRQ %ld enabled at priority %lu, not in SYS_IRQ_TABLE",
+                      (long)irq, (unsigned long)NVIC_GetPriority((IRQn_Type)irq));
+            errors++;
+        }
+    }
+    return errors;
+}
@@ -0,0 +1,649 @@
+/**
+ * @file    time_sync.c
+ * @brief   Microsecond timebase, SYNC/FUP master and slave, and "tsyn".
+ *
+ * The local counter and the global time model are shared with interrupts
+ * of any priority (CAN RX may run above the kernel, CAN_IF_RX_FAST_IRQ),
+ * so both are guarded by PRIMASK. The paths those interrupts take are in
+ * SRAM (ramfunc.h) and use no 64-bit division; the divisions of the FUP
+ * and of the rate run in CanTxTask and CanRxTask.
+ */
+
+#include "time_sync.h"
+#include "can_if.h"
+#include "can_sched.h"
+#include "cli_if.h"
+#include "clock_cfg.h"
+#include "log.h"
+#include "ramfunc.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define TS_US_PER_S         1000000U
+#define TS_OVS_MAX          3U          /* tsyn_ovs is 2 bits */
+
+/* Rate in Q32: (global - local) / local, 2^32 = 1. */
+#define TS_MAX_RATE_Q32     (((int64_t)TIME_SYNC_MAX_PPM << 32) / 1000000)
+
+typedef struct
+{
+    uint64_t local;
+    uint64_t global;
+} TimeSync_Pair_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t s_tsReady = 0U;          /* TIM4/TIM12 running */
+
+/* Local counter extension, PRIMASK; it starts at the HAL tick of
+ * TimeSync_Init(), so time stamps taken before go on without a step. */
+static uint64_t s_tsBase  = 0U;
+static uint32_t s_tsLast  = 0U;
+static uint32_t s_tsWraps = 0U;
+
+/* Global time model, PRIMASK: written by CanRxTask, read anywhere. */
+static uint8_t  s_tsMapped  = 0U;
+static uint64_t s_tsL0      = 0U;
+static uint64_t s_tsG0      = 0U;
+static int64_t  s_tsRateQ32 = 0;
+
+/* Slave: the stamp of the last SYNC, from the RX interrupt (PRIMASK). */
+static uint64_t s_tsRxStamp = 0U;
+static uint8_t  s_tsRxHdr   = 0U;       /* its byte 1: domain and sequence */
+static uint8_t  s_tsRxValid = 0U;
+
+/* Slave, CanRxTask: the SYNC waiting for its FUP and the last pairs. */
+static uint8_t         s_tsSyncWait = 0U;
+static uint8_t         s_tsSyncSeq  = 0U;
+static uint32_t        s_tsSyncSec  = 0U;
+static uint32_t        s_tsSyncTick = 0U;
+static uint64_t        s_tsSyncL    = 0U;
+static TimeSync_Pair_t s_tsPairs[TIME_SYNC_RATE_PAIRS];
+static uint32_t        s_tsPairCount = 0U;  /* since the last restart */
+
+#if TIME_SYNC_MASTER
+/* Master: the SYNC in flight, from CanTxTask to the TX interrupt and back
+ * (PRIMASK). */
+static uint8_t  s_tsSeq      = 0U;
+static uint8_t  s_tsTxArmed  = 0U;
+static uint8_t  s_tsTxSeq    = 0U;
+static uint32_t s_tsTxSec    = 0U;
+static uint64_t s_tsTxStamp  = 0U;
+static volatile uint8_t s_tsFupDue = 0U;
+#endif
+
+static volatile TimeSync_State_t s_tsState = TIME_SYNC_LOCAL;
+static TimeSync_Stats_t          s_tsStats;
+
+static const char *const s_tsStateNames[] =
+{
+    "local time (not synchronized)", "synchronized", "timeout", "time master"
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** TIM4 at 1 MHz, its updates counted by TIM12: one 32-bit counter. */
+static void ts_timer_init(void)
+{
+    __HAL_RCC_TIM4_CLK_ENABLE();
+    __HAL_RCC_TIM12_CLK_ENABLE();
+
+    /* UG loads the prescaler before TRGO follows the update events. */
+    TIM4->CR1  = 0U;
+    TIM4->PSC  = (ClockCfg_TimerHz() / TS_US_PER_S) - 1U;
+    TIM4->ARR  = 0xFFFFU;
+    TIM4->EGR  = TIM_EGR_UG;
+    TIM4->SR   = 0U;
+    TIM4->CR2  = TIM_CR2_MMS_1;
+
+    /* External clock mode 1 from ITR0 = TIM4 TRGO. */
+    TIM12->CR1  = 0U;
+    TIM12->SMCR = TIM_SMCR_SMS_0 | TIM_SMCR_SMS_1 | TIM_SMCR_SMS_2;
+    TIM12->ARR  = 0xFFFFU;
+    TIM12->CNT  = 0U;
+    TIM12->CR1  = TIM_CR1_CEN;
+
+    TIM4->CNT   = 0U;
+    TIM4->CR1   = TIM_CR1_CEN;
+}
+
+/**
+ * @brief Both timers as one microsecond count.
+ *
+ * TIM12 takes a few timer clocks to count a TIM4 update, so its value is
+ * taken only from the second microsecond of a TIM4 period on, and only if
+ * TIM4 did not wrap while it was read.
+ */
+RAMFUNC static uint32_t ts_counter(void)
+{
+    uint32_t lo;
+    uint32_t hi;
+
+    do
+    {
+        lo = TIM4->CNT;
+        hi = TIM12->CNT;
+    } while ((lo == 0U) || (TIM4->CNT < lo));
+
+    return (hi << 16) | lo;
+}
+
+/** Local time; caller holds PRIMASK. */
+RAMFUNC static uint64_t ts_local_locked(void)
+{
+    uint32_t now = ts_counter();
+
+    if (now < s_tsLast)
+        s_tsWraps++;
+    s_tsLast = now;
+
+    return s_tsBase + (((uint64_t)s_tsWraps << 32) | now);
+}
+
+/** Global time at @p local; caller holds PRIMASK. */
+RAMFUNC static uint64_t ts_map_locked(uint64_t local)
+{
+    if (s_tsMapped == 0U)
+        return local;
+
+    int64_t d = (int64_t)(local - s_tsL0);
+    return s_tsG0 + (uint64_t)(d + ((d * s_tsRateQ32) >> 32));
+}
+
+/** |@p v|, saturated to 32 bits. */
+static uint32_t ts_abs32(int64_t v)
+{
+    uint64_t a = (v < 0) ? (uint64_t)(-v) : (uint64_t)v;
+    return (a > 0xFFFFFFFFU) ? 0xFFFFFFFFU : (uint32_t)a;
+}
+
+/** Slave: one SYNC/FUP pair, @p local here and @p global on the master. */
+static void ts_apply(uint64_t local, uint64_t global)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t  mapped = s_tsMapped;
+    uint64_t pred   = ts_map_locked(local);
+    int64_t  rate   = s_tsRateQ32;
+    __set_PRIMASK(primask);
+
+    if (mapped != 0U)
+    {
+        int64_t  err = (int64_t)(global - pred);
+        uint32_t mag = ts_abs32(err);
+
+        s_tsStats.errUs = (mag > 0x7FFFFFFFU) ? ((err < 0) ? INT32_MIN : INT32_MAX) : (int32_t)err;
+        if (mag > TIME_SYNC_JUMP_US)
+        {
+            /* A step of the master (reboot) or a lost counter wrap: the
+             * old pairs no longer belong to this time. */
+            s_tsStats.jumps++;
+            s_tsPairCount = 0U;
+        }
+        else if ((s_tsState == TIME_SYNC_SYNCED) && (s_tsPairCount >= TIME_SYNC_RATE_PAIRS) &&
+                 (mag > s_tsStats.errMaxUs))
+        {
+            s_tsStats.errMaxUs = mag;
+        }
+    }
+
+    s_tsPairs[s_tsPairCount % TIME_SYNC_RATE_PAIRS].local  = local;
+    s_tsPairs[s_tsPairCount % TIME_SYNC_RATE_PAIRS].global = global;
+    s_tsPairCount++;
+
+    if (s_tsPairCount >= TIME_SYNC_RATE_PAIRS)
+    {
+        /* The oldest pair kept is the slot written next. */
+        const TimeSync_Pair_t *old = &s_tsPairs[s_tsPairCount % TIME_SYNC_RATE_PAIRS];
+        int64_t dl = (int64_t)(local - old->local);
+        int64_t dg = (int64_t)(global - old->global);
+
+        if (dl > 0)
+        {
+            int64_t r = ((dg - dl) * ((int64_t)1 << 32)) / dl;
+            if ((r <= TS_MAX_RATE_Q32) && (r >= -TS_MAX_RATE_Q32))
+            {
+                rate = r;
+            }
+            else
+            {
+                s_tsStats.jumps++;
+                s_tsPairCount = 0U;
+            }
+        }
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    s_tsL0      = local;
+    s_tsG0      = global;
+    s_tsRateQ32 = rate;
+    s_tsMapped  = 1U;
+    __set_PRIMASK(primask);
+
+    if (s_tsState != TIME_SYNC_SYNCED)
+        LOG_INFO(CAN, "TSYN: synchronized, offset %ld us",
+                 (long)(int32_t)(global - local));
+
+    s_tsState            = TIME_SYNC_SYNCED;
+    s_tsStats.ratePpb    = (int32_t)((rate * 1000000000) >> 32);
+    s_tsStats.offsetUs   = (int64_t)(global - local);
+    s_tsStats.lastPairMs = HAL_GetTick();
+    s_tsStats.pairs++;
+}
+
+/** CanRxTask: a SYNC or FUP on TIME_SYNC_CAN_ID. */
+static void ts_on_frame(const CAN_IF_Msg_t *msg, void *ctx)
+{
+    (void)ctx;
+
+    CanSig_TimeSync_t m;
+
+    if ((CAN_IF_MSG_LEN(msg) < CANSIG_TIME_SYNC_DLC) ||
+        (CanSig_TimeSync_Unpack(msg->Data, &m) == 0U))
+        return;
+
+    if ((TIME_SYNC_MASTER != 0) || (m.tsyn_domain != TIME_SYNC_DOMAIN))
+    {
+        s_tsStats.foreign++;
+        return;
+    }
+
+    if (m.tsyn_type == TIME_SYNC_TYPE_SYNC)
+    {
+        s_tsStats.syncs++;
+        if (s_tsSyncWait != 0U)
+            s_tsStats.fupLost++;
+        s_tsSyncWait = 0U;
+
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        uint8_t  valid = ((s_tsRxValid != 0U) && (s_tsRxHdr == msg->Data[1])) ? 1U : 0U;
+        uint64_t stamp = s_tsRxStamp;
+        s_tsRxValid = 0U;
+        __set_PRIMASK(primask);
+
+        if (valid == 0U)
+        {
+            s_tsStats.noStamp++;
+            return;
+        }
+
+        s_tsSyncWait = 1U;
+        s_tsSyncSeq  = m.tsyn_seq;
+        s_tsSyncSec  = m.tsyn_sec;
+        s_tsSyncTick = HAL_GetTick();
+        s_tsSyncL    = stamp;
+        return;
+    }
+
+    /* FUP */
+    s_tsStats.fups++;
+    if (s_tsSyncWait == 0U)
+        return;
+    s_tsSyncWait = 0U;
+
+    if ((m.tsyn_seq != s_tsSyncSeq) || (m.tsyn_usec >= TS_US_PER_S) ||
+        ((HAL_GetTick() - s_tsSyncTick) > TIME_SYNC_FUP_TIMEOUT_MS))
+    {
+        s_tsStats.fupLost++;
+        return;
+    }
+
+    uint64_t global = ((uint64_t)(s_tsSyncSec + m.tsyn_ovs) * TS_US_PER_S) + m.tsyn_usec;
+    ts_apply(s_tsSyncL, (uint64_t)((int64_t)global + TIME_SYNC_DELAY_US));
+}
+
+#if TIME_SYNC_MASTER
+
+/** CanTxTask: the SYNC, armed for its TX confirmation before it is queued. */
+static HAL_StatusTypeDef ts_sync_send(void *ctx)
+{
+    (void)ctx;
+
+    CanSig_TimeSync_t m;
+    uint8_t           data[CANSIG_TIME_SYNC_DLC];
+
+    m.tsyn_type   = TIME_SYNC_TYPE_SYNC;
+    m.tsyn_domain = TIME_SYNC_DOMAIN;
+    m.tsyn_seq    = s_tsSeq;
+    m.tsyn_sec    = (uint32_t)(TimeSync_LocalUs() / TS_US_PER_S);
+    (void)CanSig_TimeSync_Pack(data, &m);
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_tsTxArmed = 1U;
+    s_tsTxSeq   = m.tsyn_seq;
+    s_tsTxSec   = m.tsyn_sec;
+    __set_PRIMASK(primask);
+
+    if (CAN_IF_Transmit(TIME_SYNC_CAN_ID, data, CANSIG_TIME_SYNC_DLC) != HAL_OK)
+    {
+        s_tsTxArmed = 0U;
+        return HAL_ERROR;
+    }
+
+    s_tsSeq = (uint8_t)((s_tsSeq + 1U) & 0x0FU);
+    s_tsStats.syncs++;
+    return HAL_OK;
+}
+
+static uint8_t ts_fup_due(void *ctx)
+{
+    (void)ctx;
+    return s_tsFupDue;
+}
+
+/** CanTxTask: the FUP of the SYNC just confirmed. */
+static HAL_StatusTypeDef ts_fup_send(void *ctx)
+{
+    (void)ctx;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint64_t stamp = s_tsTxStamp;
+    uint8_t  seq   = s_tsTxSeq;
+    uint32_t sec   = s_tsTxSec;
+    __set_PRIMASK(primask);
+
+    uint64_t d = stamp - ((uint64_t)sec * TS_US_PER_S);
+    if (d >= ((uint64_t)(TS_OVS_MAX + 1U) * TS_US_PER_S))
+    {
+        /* Queued for more than the FUP can express: no pair this time. */
+        s_tsStats.noStamp++;
+        s_tsFupDue = 0U;
+        return HAL_OK;
+    }
+
+    CanSig_TimeSync_t m;
+    uint8_t           data[CANSIG_TIME_SYNC_DLC];
+
+    m.tsyn_type   = TIME_SYNC_TYPE_FUP;
+    m.tsyn_domain = TIME_SYNC_DOMAIN;
+    m.tsyn_seq    = seq;
+    m.tsyn_ovs    = (uint8_t)((uint32_t)d / TS_US_PER_S);
+    m.tsyn_usec   = (uint32_t)d % TS_US_PER_S;
+    (void)CanSig_TimeSync_Pack(data, &m);
+
+    /* Refused: stays due, CanSched retries. */
+    if (CAN_IF_Transmit(TIME_SYNC_CAN_ID, data, CANSIG_TIME_SYNC_DLC) != HAL_OK)
+        return HAL_ERROR;
+
+    s_tsFupDue = 0U;
+    s_tsStats.fups++;
+    return HAL_OK;
+}
+
+static const CanSched_Frame_t s_tsSyncFrame =
+{
+    .name     = "time sync",
+    .id       = TIME_SYNC_CAN_ID,
+    .cycleMs  = TIME_SYNC_CYCLE_MS,
+    .minGapMs = 0U,
+    .offsetMs = 0U,
+    .changed  = NULL,
+    .send     = ts_sync_send,
+    .ctx      = NULL,
+};
+
+static const CanSched_Frame_t s_tsFupFrame =
+{
+    .name     = "time sync fup",
+    .id       = TIME_SYNC_CAN_ID,
+    .cycleMs  = 0U,
+    .minGapMs = 0U,
+    .offsetMs = 0U,
+    .changed  = ts_fup_due,
+    .send     = ts_fup_send,
+    .ctx      = NULL,
+};
+
+#endif /* TIME_SYNC_MASTER */
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+/** "s.uuuuuu" of a time in microseconds. */
+static void ts_print_time(const char *label, uint64_t us)
+{
+    CLI_IF_Printf("%s%lu.%06lu s\r\n", label, (unsigned long)(us / TS_US_PER_S),
+                  (unsigned long)(us % TS_US_PER_S));
+}
+
+static void ts_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    TimeSync_Stats_t st;
+    TimeSync_GetStats(&st);
+
+    CLI_IF_Printf("Time sync domain %u on 0x%03X: %s\r\n", (unsigned)TIME_SYNC_DOMAIN,
+                  (unsigned)TIME_SYNC_CAN_ID, s_tsStateNames[st.state]);
+    ts_print_time("Global time  ", TimeSync_NowUs());
+    ts_print_time("Local time   ", TimeSync_LocalUs());
+
+    if (TIME_SYNC_MASTER != 0)
+    {
+        CLI_IF_Printf("SYNC sent %lu, FUP sent %lu, no stamp %lu, other masters %lu\r\n",
+                      (unsigned long)st.syncs, (unsigned long)st.fups,
+                      (unsigned long)st.noStamp, (unsigned long)st.foreign);
+        return;
+    }
+
+    uint64_t off = (st.offsetUs < 0) ? (uint64_t)(-st.offsetUs) : (uint64_t)st.offsetUs;
+    CLI_IF_Printf("Offset %s%lu.%06lu s, rate %ld ppb\r\n", (st.offsetUs < 0) ? "-" : "",
+                  (unsigned long)(off / TS_US_PER_S), (unsigned long)(off % TS_US_PER_S),
+                  (long)st.ratePpb);
+    CLI_IF_Printf("Accuracy: last %ld us, worst %lu us; last pair %lu ms ago\r\n",
+                  (long)st.errUs, (unsigned long)st.errMaxUs,
+                  (unsigned long)((st.pairs != 0U) ? (HAL_GetTick() - st.lastPairMs) : 0U));
+    CLI_IF_Printf("SYNC %lu, FUP %lu, pairs %lu; FUP lost %lu, no stamp %lu, jumps %lu, "
+                  "timeouts %lu, foreign %lu\r\n",
+                  (unsigned long)st.syncs, (unsigned long)st.fups, (unsigned long)st.pairs,
+                  (unsigned long)st.fupLost, (unsigned long)st.noStamp,
+                  (unsigned long)st.jumps, (unsigned long)st.timeouts,
+                  (unsigned long)st.foreign);
+}
+
+static void ts_cmd_reset(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if (TIME_SYNC_MASTER != 0)
+    {
+        CLI_IF_Print("This node is the time master\r\n");
+        return;
+    }
+
+    TimeSync_Reset();
+    CLI_IF_Print("Synchronization dropped; local time until the next pair\r\n");
+}
+
+static const CliCommand_t s_tsCmds[] =
+{
+    { "tsyn",       "", 0U, ts_cmd_show,  "time synchronization state and accuracy" },
+    { "tsyn reset", "", 0U, ts_cmd_reset, "drop the synchronization (slave)" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef TimeSync_Init(void)
+{
+    memset(&s_tsStats, 0, sizeof(s_tsStats));
+
+    s_tsBase = (uint64_t)HAL_GetTick() * 1000U;
+    ts_timer_init();
+    s_tsReady = 1U;
+
+#if TIME_SYNC_MASTER
+    s_tsState = TIME_SYNC_IS_MASTER;
+    if ((CanSched_Add(&s_tsSyncFrame) != HAL_OK) || (CanSched_Add(&s_tsFupFrame) != HAL_OK))
+        return HAL_ERROR;
+#endif
+
+    /* Also on the master: another master on the bus is counted. */
+    if (CAN_IF_RegisterHandler(TIME_SYNC_CAN_ID, 0x7FFU, ts_on_frame, NULL) != HAL_OK)
+        return HAL_ERROR;
+
+    if (CanFilters_Covers(0U, TIME_SYNC_CAN_ID, 0x7FFU) == 0U)
+        LOG_WARN(CAN, "Time sync ID 0x%03lX not in CAN_FILTER_TABLE", (unsigned long)TIME_SYNC_CAN_ID);
+
+    CLI_IF_REGISTER_TABLE(s_tsCmds);
+    return HAL_OK;
+}
+
+void TimeSync_Event100ms(void)
+{
+    if (s_tsReady == 0U)
+        return;
+
+    /* At least once per 2^32 us, so no counter wrap goes unseen. */
+    (void)TimeSync_LocalUs();
+
+    if ((s_tsState == TIME_SYNC_SYNCED) &&
+        ((HAL_GetTick() - s_tsStats.lastPairMs) >= TIME_SYNC_TIMEOUT_MS))
+    {
+        s_tsState = TIME_SYNC_TIMEOUT;
+        s_tsStats.timeouts++;
+        LOG_WARN(CAN, "TSYN: no time from the master for %lu ms", (unsigned long)TIME_SYNC_TIMEOUT_MS);
+    }
+}
+
+RAMFUNC uint64_t TimeSync_LocalUs(void)
+{
+    if (s_tsReady == 0U)
+        return (uint64_t)HAL_GetTick() * 1000U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint64_t t = ts_local_locked();
+    __set_PRIMASK(primask);
+    return t;
+}
+
+RAMFUNC uint64_t TimeSync_NowUs(void)
+{
+    if (s_tsReady == 0U)
+        return (uint64_t)HAL_GetTick() * 1000U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint64_t t = ts_map_locked(ts_local_locked());
+    __set_PRIMASK(primask);
+    return t;
+}
+
+RAMFUNC void TimeSync_NowMsUs(uint32_t *ms, uint32_t *us)
+{
+    uint64_t t  = TimeSync_NowUs();
+    uint32_t hi = (uint32_t)(t >> 32);
+    uint32_t lo = (uint32_t)t;
+
+    /* t / 1000 from 32-bit divisions: 2^32 = 4294967 * 1000 + 296. */
+    uint32_t rem = (hi * 296U) + (lo % 1000U);
+
+    *ms = (hi * 4294967U) + (lo / 1000U) + (rem / 1000U);
+    *us = rem % 1000U;
+}
+
+uint32_t TimeSync_NowMs(void)
+{
+    uint32_t ms;
+    uint32_t us;
+
+    TimeSync_NowMsUs(&ms, &us);
+    return ms;
+}
+
+RAMFUNC void TimeSync_OnCanRx(const uint8_t *data)
+{
+    if ((s_tsReady == 0U) || (data[0] != TIME_SYNC_TYPE_SYNC))
+        return;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_tsRxStamp = ts_local_locked();
+    s_tsRxHdr   = data[1];
+    s_tsRxValid = 1U;
+    __set_PRIMASK(primask);
+}
+
+RAMFUNC void TimeSync_OnTxConfirm(void)
+{
+#if TIME_SYNC_MASTER
+    /* Only a SYNC is armed; the confirmation of its FUP passes. */
+    if (s_tsTxArmed == 0U)
+        return;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_tsTxStamp = ts_local_locked();
+    s_tsTxArmed = 0U;
+    __set_PRIMASK(primask);
+
+    s_tsFupDue = 1U;
+    CanSched_Notify();
+#endif
+}
+
+void TimeSync_ClockChanged(uint64_t localUs)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    /* Never back: the counter may have run fast for part of the switch. */
+    uint64_t now = ts_local_locked();
+    if (localUs < now)
+        localUs = now;
+
+    /* Both stopped, so the update of UG is not counted; TIM12 sees it a
+       few timer clocks late. */
+    TIM12->CR1 = 0U;
+    TIM4->CR1  = 0U;
+    TIM4->PSC  = (ClockCfg_TimerHz() / TS_US_PER_S) - 1U;
+    TIM4->EGR  = TIM_EGR_UG;
+    for (uint32_t n = 0U; n < 8U; ++n)
+        (void)TIM12->CNT;
+    TIM4->SR    = 0U;
+    TIM12->CNT  = 0U;
+    TIM4->CNT   = 0U;
+    s_tsWraps   = 0U;
+    s_tsLast    = 0U;
+    s_tsBase    = localUs;
+    TIM12->CR1  = TIM_CR1_CEN;
+    TIM4->CR1   = TIM_CR1_CEN;
+
+    __set_PRIMASK(primask);
+}
+
+void TimeSync_Reset(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_tsMapped  = 0U;
+    s_tsRateQ32 = 0;
+    __set_PRIMASK(primask);
+
+    s_tsSyncWait  = 0U;
+    s_tsPairCount = 0U;
+    if (TIME_SYNC_MASTER == 0)
+        s_tsState = TIME_SYNC_LOCAL;
+}
+
+void TimeSync_GetStats(TimeSync_Stats_t *out)
+{
+    *out       = s_tsStats;
+    out->state = s_tsState;
+}
@@ -0,0 +1,279 @@
+/**
+ * @file    timer_wheel.c
+ * @brief   Hierarchical timer wheel and "wheel". See timer_wheel.h.
+ *
+ * The slots are singly linked lists with a back pointer to the link that
+ * points at each timer (pprev), so a timer unlinks in O(1) wherever it is:
+ * in a slot, or in the list a tick has taken out to fire or to cascade.
+ * s_twJiffies is the next tick to process; timers are placed relative to
+ * it, as the kernel's classic wheel does.
+ */
+
+#include "timer_wheel.h"
+#include "cli_if.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define TW_SLOTS    (1UL << TIMER_WHEEL_BITS)
+#define TW_MASK     (TW_SLOTS - 1UL)
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Changed with interrupts masked. */
+static TimerWheel_Timer_t *s_twSlots[TIMER_WHEEL_LEVELS][TW_SLOTS];
+static uint32_t            s_twJiffies = 0U;
+static TimerWheel_Stats_t  s_twStats;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Interrupts masked. */
+static void tw_link(TimerWheel_Timer_t **head, TimerWheel_Timer_t *t)
+{
+    t->next = *head;
+    if (t->next != NULL)
+        t->next->pprev = &t->next;
+    *head    = t;
+    t->pprev = head;
+}
+
+/** Interrupts masked; @p t is linked. */
+static void tw_unlink(TimerWheel_Timer_t *t)
+{
+    *t->pprev = t->next;
+    if (t->next != NULL)
+        t->next->pprev = t->pprev;
+    t->next  = NULL;
+    t->pprev = NULL;
+}
+
+/** Move a whole slot to @p list in O(1). Interrupts masked. */
+static void tw_take(TimerWheel_Timer_t **head, TimerWheel_Timer_t **list)
+{
+    *list = *head;
+    if (*list != NULL)
+        (*list)->pprev = list;
+    *head = NULL;
+}
+
+/** Into the lowest level that spans its delay. Interrupts masked. */
+static void tw_insert(TimerWheel_Timer_t *t)
+{
+    uint32_t delta = t->expires - s_twJiffies;
+    uint32_t level = 0U;
+    uint32_t slot;
+
+    if ((int32_t)delta < 0)
+    {
+        /* Overdue: the slot the next tick fires. */
+        slot = s_twJiffies & TW_MASK;
+    }
+    else
+    {
+        if (delta > TIMER_WHEEL_MAX_MS)
+        {
+            t->expires = s_twJiffies + TIMER_WHEEL_MAX_MS;
+            s_twStats.clamped++;
+        }
+        while ((level < (TIMER_WHEEL_LEVELS - 1U)) &&
+               ((t->expires - s_twJiffies) >= (1UL << (TIMER_WHEEL_BITS * (level + 1U)))))
+        {
+            level++;
+        }
+        slot = (t->expires >> (TIMER_WHEEL_BITS * level)) & TW_MASK;
+    }
+
+    tw_link(&s_twSlots[level][slot], t);
+}
+
+/** Spread slot @p slot of @p level over the levels below, one timer per
+ *  interrupt lock. */
+static void tw_cascade(uint32_t level, uint32_t slot)
+{
+    TimerWheel_Timer_t *list;
+    uint32_t            primask = __get_PRIMASK();
+
+    __disable_irq();
+    tw_take(&s_twSlots[level][slot], &list);
+    __set_PRIMASK(primask);
+
+    for (;;)
+    {
+        __disable_irq();
+        TimerWheel_Timer_t *t = list;
+        if (t == NULL)
+        {
+            __set_PRIMASK(primask);
+            return;
+        }
+        tw_unlink(t);
+        tw_insert(t);
+        s_twStats.cascaded++;
+        __set_PRIMASK(primask);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void wheel_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    TimerWheel_Stats_t st;
+    uint32_t           used[TIMER_WHEEL_LEVELS];
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    st = s_twStats;
+    for (uint32_t l = 0U; l < TIMER_WHEEL_LEVELS; ++l)
+    {
+        used[l] = 0U;
+        for (uint32_t i = 0U; i < TW_SLOTS; ++i)
+            used[l] += (s_twSlots[l][i] != NULL) ? 1U : 0U;
+    }
+    __set_PRIMASK(primask);
+
+    CLI_IF_Printf("Timer wheel: %u levels of %lu slots, 1 ms, up to %lu s\r\n",
+                  (unsigned)TIMER_WHEEL_LEVELS, (unsigned long)TW_SLOTS,
+                  (unsigned long)(TIMER_WHEEL_MAX_MS / 1000U));
+    CLI_IF_Printf("Running %lu (max %lu), slots in use:", (unsigned long)st.running,
+                  (unsigned long)st.runningMax);
+    for (uint32_t l = 0U; l < TIMER_WHEEL_LEVELS; ++l)
+        CLI_IF_Printf(" %lu", (unsigned long)used[l]);
+    CLI_IF_Print("\r\n");
+    CLI_IF_Printf("Started %lu, stopped %lu, fired %lu (max %lu per tick), cascaded %lu, "
+                  "clamped %lu\r\n",
+                  (unsigned long)st.started, (unsigned long)st.stopped, (unsigned long)st.fired,
+                  (unsigned long)st.firedMax, (unsigned long)st.cascaded,
+                  (unsigned long)st.clamped);
+    CLI_IF_Printf("Ticks caught up after a late release: %lu\r\n", (unsigned long)st.caughtUp);
+}
+
+static const CliCommand_t s_twCmds[] =
+{
+    { "wheel", "", 0U, wheel_cmd_show, "protocol timer wheel: timers running, fired, cascaded" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void TimerWheel_Init(void)
+{
+    s_twJiffies = HAL_GetTick();
+    CLI_IF_REGISTER_TABLE(s_twCmds);
+}
+
+void TimerWheel_Setup(TimerWheel_Timer_t *t, TimerWheel_Fn_t fn, void *ctx)
+{
+    t->next  = NULL;
+    t->pprev = NULL;
+    t->fn    = fn;
+    t->ctx   = ctx;
+}
+
+void TimerWheel_Start(TimerWheel_Timer_t *t, uint32_t ms)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (t->pprev != NULL)
+        tw_unlink(t);
+    else if (++s_twStats.running > s_twStats.runningMax)
+        s_twStats.runningMax = s_twStats.running;
+    t->expires = HAL_GetTick() + ((ms != 0U) ? ms : 1U);
+    tw_insert(t);
+    s_twStats.started++;
+    __set_PRIMASK(primask);
+}
+
+void TimerWheel_Stop(TimerWheel_Timer_t *t)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (t->pprev != NULL)
+    {
+        tw_unlink(t);
+        s_twStats.running--;
+        s_twStats.stopped++;
+    }
+    __set_PRIMASK(primask);
+}
+
+uint8_t TimerWheel_IsRunning(const TimerWheel_Timer_t *t)
+{
+    return (t->pprev != NULL) ? 1U : 0U;
+}
+
+void TimerWheel_Event1ms(void)
+{
+    uint32_t now     = HAL_GetTick();
+    uint32_t ticks   = 0U;
+    uint32_t primask = __get_PRIMASK();
+
+    while ((int32_t)(now - s_twJiffies) >= 0)
+    {
+        TimerWheel_Timer_t *due;
+        uint32_t            fired = 0U;
+
+        /* Level 0 came round: the next slot of each level above, from the
+         * bottom, as long as that level came round as well. */
+        if ((s_twJiffies & TW_MASK) == 0U)
+        {
+            for (uint32_t level = 1U; level < TIMER_WHEEL_LEVELS; ++level)
+            {
+                uint32_t slot = (s_twJiffies >> (TIMER_WHEEL_BITS * level)) & TW_MASK;
+
+                tw_cascade(level, slot);
+                if (slot != 0U)
+                    break;
+            }
+        }
+
+        __disable_irq();
+        tw_take(&s_twSlots[0][s_twJiffies & TW_MASK], &due);
+        s_twJiffies++;
+        __set_PRIMASK(primask);
+
+        for (;;)
+        {
+            __disable_irq();
+            TimerWheel_Timer_t *t = due;
+            if (t == NULL)
+            {
+                __set_PRIMASK(primask);
+                break;
+            }
+            tw_unlink(t);
+            s_twStats.running--;
+            s_twStats.fired++;
+            __set_PRIMASK(primask);
+
+            t->fn(t->ctx);
+            fired++;
+        }
+
+        if (fired > s_twStats.firedMax)
+            s_twStats.firedMax = fired;
+        ticks++;
+    }
+
+    if (ticks > 1U)
+        s_twStats.caughtUp += ticks - 1U;
+}
+
+void TimerWheel_GetStats(TimerWheel_Stats_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *out = s_twStats;
+    __set_PRIMASK(primask);
+}
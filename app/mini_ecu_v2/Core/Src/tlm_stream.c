@@ -0,0 +1,552 @@
+/**
+ * @file    tlm_stream.c
+ * @brief   Binary telemetry stream: sampling, COBS framing and "tlm".
+ */
+
+#include "tlm_stream.h"
+#include "can_sigcache.h"
+#include "can_stats.h"
+#include "cli_if.h"
+#include "crc.h"
+#include "log.h"
+#include "pedal.h"
+#include "rtos_stats.h"
+#include "time_sync.h"
+#include "vehicle_shared.h"
+#include "vsensor.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if TLM_STREAM_ENABLE
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/** Longest signal name / unit in a descriptor. */
+#define TLM_TEXT_MAX        15U
+
+/** type + seq + tick + values, a descriptor and another module's frame,
+ *  before the CRC. */
+#define TLM_SAMPLE_MAX      (1U + 2U + 4U + (2U * TLM_SIG_COUNT))
+#define TLM_DESC_MAX        (1U + 4U + 2U + 4U + 2U + (2U * TLM_TEXT_MAX))
+#define TLM_MAX_(a, b)      (((a) > (b)) ? (a) : (b))
+#define TLM_RAW_MAX         TLM_MAX_(TLM_MAX_(TLM_SAMPLE_MAX, TLM_DESC_MAX), TLM_FRAME_MAX)
+
+/** On the wire: CRC, one COBS code byte per 254 and the two delimiters. */
+#define TLM_WIRE_LEN(n)     ((n) + 2U + (((n) + 2U) / 254U) + 1U + 2U)
+#define TLM_WIRE_MAX        TLM_WIRE_LEN(TLM_RAW_MAX)
+
+/** Wire bytes of a sample of @p count signals. */
+#define TLM_SAMPLE_WIRE(count)  TLM_WIRE_LEN(1U + 2U + 4U + (2U * (uint32_t)(count)))
+
+_Static_assert(TLM_WIRE_MAX <= LOG_TX_CHUNK_SIZE,
+               "a telemetry frame must fit one log record");
+
+/* Signals read from each source, so one sample copies each source once. */
+#define TLM_BIT(name)       (1UL << TLM_SIG_##name)
+
+#define TLM_SRC_VEHICLE     (TLM_BIT(SPEED) | TLM_BIT(RPM) | TLM_BIT(COOLANT))
+#define TLM_SRC_CACHE       (TLM_BIT(CAN_SPEED) | TLM_BIT(CAN_RPM) | TLM_BIT(CAN_COOLANT) | \
+                             TLM_BIT(CAN_AGE))
+#define TLM_SRC_SENSOR      (TLM_BIT(SENS_SPEED) | TLM_BIT(SENS_RPM) | TLM_BIT(SENS_COOLANT) | \
+                             TLM_BIT(RAW_SPEED) | TLM_BIT(RAW_RPM) | TLM_BIT(RAW_COOLANT) |    \
+                             TLM_BIT(SENS_STATUS))
+#define TLM_SRC_PEDAL       (TLM_BIT(THROTTLE) | TLM_BIT(PEDAL))
+#define TLM_SRC_BUS         (TLM_BIT(BUS_LOAD) | TLM_BIT(CAN_TEC) | TLM_BIT(CAN_REC))
+#define TLM_SRC_CPU         (TLM_BIT(CPU_IDLE))
+#define TLM_SRC_LOG         (TLM_BIT(LOG_FILL))
+
+#define TLM_SIG_INFO_(name, text, unit, scale)  { text, unit, scale },
+
+static const TlmStream_SigInfo_t s_tlmSigs[TLM_SIG_COUNT] = { TLM_SIGNAL_TABLE(TLM_SIG_INFO_) };
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static UART_HandleTypeDef *s_tlmUart = NULL;
+
+/* Written by "tlm start" while stopped; read by the runnable while running. */
+static volatile uint8_t    s_tlmRunning  = 0U;
+static uint32_t            s_tlmMask     = 0U;
+static uint8_t             s_tlmCount    = 0U;
+static uint32_t            s_tlmPeriodMs = 0U;
+
+/* Runnable only. */
+static uint32_t            s_tlmCountdown = 0U;
+static uint32_t            s_tlmDescMs    = 0U;
+static uint16_t            s_tlmSeq       = 0U;
+
+static volatile uint32_t   s_tlmSamples = 0U;
+static volatile uint32_t   s_tlmDropped = 0U;
+static volatile uint32_t   s_tlmBytes   = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Append the CRC to @p raw (len bytes, room for 2 more), COBS-encode
+ *        it between zero delimiters and queue it for the console.
+ */
+static HAL_StatusTypeDef tlm_send(uint8_t *raw, uint32_t len)
+{
+    uint8_t  wire[TLM_WIRE_MAX];
+    uint16_t crc = Crc_Ccitt16(CRC16_INIT, raw, len);
+
+    raw[len++] = (uint8_t)crc;
+    raw[len++] = (uint8_t)(crc >> 8);
+
+    uint32_t out  = 1U;
+    uint32_t code = out++;      /* position of the current code byte */
+
+    wire[0] = 0U;
+    wire[code] = 1U;
+    for (uint32_t i = 0U; i < len; ++i)
+    {
+        if (raw[i] == 0U)
+        {
+            code       = out++;
+            wire[code] = 1U;
+            continue;
+        }
+        wire[out++] = raw[i];
+        if (++wire[code] == 0xFFU)
+        {
+            code       = out++;
+            wire[code] = 1U;
+        }
+    }
+    wire[out++] = 0U;
+
+    if (Log_WriteStream(LOG_STREAM_TLM, (const char *)wire, out) != HAL_OK)
+    {
+        s_tlmDropped++;
+        return HAL_BUSY;
+    }
+    s_tlmBytes += out;
+    return HAL_OK;
+}
+
+static int16_t tlm_raw(float v, float scale)
+{
+    float r = v / scale;
+
+    if (r >= 32767.0f)
+        return INT16_MAX;
+    if (r <= -32768.0f)
+        return INT16_MIN;
+    return (int16_t)lrintf(r);
+}
+
+/** Physical values of the signals in @p mask; the others are left alone. */
+static void tlm_read(uint32_t mask, float *v)
+{
+    if ((mask & TLM_SRC_VEHICLE) != 0U)
+    {
+        VehicleState_t vs;
+        Vehicle_GetSnapshot(&vs);
+        v[TLM_SIG_SPEED]   = vs.speed_kph;
+        v[TLM_SIG_RPM]     = (float)vs.engine_rpm;
+        v[TLM_SIG_COOLANT] = vs.coolant_temp_c;
+    }
+    if ((mask & TLM_SRC_CACHE) != 0U)
+    {
+        CanSigCache_Entry_t e;
+
+        (void)CanSigCache_Read(CAN_SIG_SPEED, &e);
+        v[TLM_SIG_CAN_SPEED] = e.value;
+        v[TLM_SIG_CAN_AGE]   = (e.seq != 0U) ? (float)(HAL_GetTick() - e.timeMs) : 32767.0f;
+        (void)CanSigCache_Read(CAN_SIG_RPM, &e);
+        v[TLM_SIG_CAN_RPM] = e.value;
+        (void)CanSigCache_Read(CAN_SIG_COOLANT, &e);
+        v[TLM_SIG_CAN_COOLANT] = e.value;
+    }
+    if ((mask & TLM_SRC_SENSOR) != 0U)
+    {
+        VSensor_Reading_t r;
+        VSensor_Get(&r);
+        v[TLM_SIG_SENS_SPEED]   = r.ch[VSENSOR_CH_SPEED].value;
+        v[TLM_SIG_SENS_RPM]     = r.ch[VSENSOR_CH_RPM].value;
+        v[TLM_SIG_SENS_COOLANT] = r.ch[VSENSOR_CH_COOLANT].value;
+        v[TLM_SIG_RAW_SPEED]    = (float)r.ch[VSENSOR_CH_SPEED].raw;
+        v[TLM_SIG_RAW_RPM]      = (float)r.ch[VSENSOR_CH_RPM].raw;
+        v[TLM_SIG_RAW_COOLANT]  = (float)r.ch[VSENSOR_CH_COOLANT].raw;
+        /* 5 status bits per channel, speed in the lowest. */
+        v[TLM_SIG_SENS_STATUS]  = (float)((uint32_t)r.ch[VSENSOR_CH_SPEED].status |
+                                          ((uint32_t)r.ch[VSENSOR_CH_RPM].status << 5) |
+                                          ((uint32_t)r.ch[VSENSOR_CH_COOLANT].status << 10));
+    }
+    if ((mask & TLM_SRC_PEDAL) != 0U)
+    {
+        Pedal_State_t p;
+        Pedal_Get(&p);
+        v[TLM_SIG_THROTTLE] = p.throttle * 100.0f;
+        v[TLM_SIG_PEDAL]    = (float)p.pressed;
+    }
+    if ((mask & TLM_SRC_BUS) != 0U)
+    {
+        CanStats_Summary_t s;
+        (void)CanStats_Get(&s, NULL, 0U);
+        v[TLM_SIG_BUS_LOAD] = (float)s.loadPermille / 10.0f;
+        v[TLM_SIG_CAN_TEC]  = (float)s.tec;
+        v[TLM_SIG_CAN_REC]  = (float)s.rec;
+    }
+    if ((mask & TLM_SRC_CPU) != 0U)
+    {
+        RtosStats_Task_t    t;
+        RtosStats_Summary_t s;
+
+        memset(&s, 0, sizeof(s));
+        (void)RtosStats_Get(&t, 1U, &s);
+        v[TLM_SIG_CPU_IDLE] = (float)s.idlePermille / 10.0f;
+    }
+    if ((mask & TLM_SRC_LOG) != 0U)
+    {
+        Log_Stats_t s;
+        Log_GetStats(&s);
+        v[TLM_SIG_LOG_FILL] = (float)s.fill;
+    }
+}
+
+static void tlm_send_descriptors(void)
+{
+    uint8_t  raw[TLM_DESC_MAX + 2U];
+    uint32_t index = 0U;
+
+    for (uint32_t sig = 0U; sig < TLM_SIG_COUNT; ++sig)
+    {
+        if ((s_tlmMask & (1UL << sig)) == 0U)
+            continue;
+
+        const TlmStream_SigInfo_t *info = &s_tlmSigs[sig];
+        uint16_t period = (uint16_t)s_tlmPeriodMs;
+        size_t   nlen   = strnlen(info->text, TLM_TEXT_MAX);
+        size_t   ulen   = strnlen(info->unit, TLM_TEXT_MAX);
+        uint32_t n      = 0U;
+
+        raw[n++] = TLM_FRAME_DESC;
+        raw[n++] = TLM_DESC_VERSION;
+        raw[n++] = (uint8_t)index++;
+        raw[n++] = s_tlmCount;
+        raw[n++] = (uint8_t)sig;
+        memcpy(&raw[n], &period, 2U);       n += 2U;
+        memcpy(&raw[n], &info->scale, 4U);  n += 4U;
+        raw[n++] = (uint8_t)nlen;
+        memcpy(&raw[n], info->text, nlen);  n += (uint32_t)nlen;
+        raw[n++] = (uint8_t)ulen;
+        memcpy(&raw[n], info->unit, ulen);  n += (uint32_t)ulen;
+
+        (void)tlm_send(raw, n);
+    }
+}
+
+static void tlm_send_sample(void)
+{
+    float    v[TLM_SIG_COUNT];
+    uint8_t  raw[TLM_SAMPLE_MAX + 2U];
+    uint32_t now = TimeSync_NowMs();
+    uint32_t n   = 0U;
+
+    tlm_read(s_tlmMask, v);
+
+    raw[n++] = TLM_FRAME_SAMPLE;
+    memcpy(&raw[n], &s_tlmSeq, 2U);  n += 2U;
+    memcpy(&raw[n], &now, 4U);       n += 4U;
+    for (uint32_t sig = 0U; sig < TLM_SIG_COUNT; ++sig)
+    {
+        if ((s_tlmMask & (1UL << sig)) == 0U)
+            continue;
+        int16_t r = tlm_raw(v[sig], s_tlmSigs[sig].scale);
+        memcpy(&raw[n], &r, 2U);
+        n += 2U;
+    }
+
+    s_tlmSeq++;
+    s_tlmSamples++;
+    (void)tlm_send(raw, n);
+}
+
+/** Link the stream would use, in permille of the UART (0 if not on the UART). */
+static uint32_t tlm_link_permille(uint32_t frameBytes, uint32_t periodMs)
+{
+    Log_TransportId_t tp = Log_GetTransport(LOG_STREAM_TLM);
+
+    if (((tp != LOG_TRANSPORT_UART) && (tp != LOG_TRANSPORT_UART_DMA)) ||
+        (s_tlmUart == NULL) || (s_tlmUart->Init.BaudRate == 0U))
+        return 0U;
+
+    /* 8N1: 10 bits per byte. */
+    uint64_t bits = ((uint64_t)frameBytes * 10U * 1000U) / periodMs;
+    return (uint32_t)((bits * 1000U) / s_tlmUart->Init.BaudRate);
+}
+
+/** Signal named by the @p len bytes at @p name, or TLM_SIG_COUNT. */
+static uint32_t tlm_find(const char *name, size_t len)
+{
+    uint32_t sig;
+
+    for (sig = 0U; sig < TLM_SIG_COUNT; ++sig)
+    {
+        if ((strlen(s_tlmSigs[sig].text) == len) &&
+            (strncmp(s_tlmSigs[sig].text, name, len) == 0))
+            break;
+    }
+    return sig;
+}
+
+/** Parse "all" or "speed,rpm,..." into a mask; 0 on an unknown name. */
+static uint32_t tlm_parse_signals(const char *list)
+{
+    uint32_t mask = 0U;
+
+    if (strcmp(list, "all") == 0)
+        return (TLM_SIG_COUNT >= 32U) ? 0xFFFFFFFFUL : ((1UL << TLM_SIG_COUNT) - 1UL);
+
+    while (*list != '\0')
+    {
+        const char *end = strchr(list, ',');
+        size_t      len = (end != NULL) ? (size_t)(end - list) : strlen(list);
+        uint32_t    sig = tlm_find(list, len);
+
+        if (sig == TLM_SIG_COUNT)
+            return 0U;
+
+        mask |= 1UL << sig;
+        list += len;
+        if (*list == ',')
+            list++;
+    }
+    return mask;
+}
+
+static uint32_t tlm_popcount(uint32_t v)
+{
+    uint32_t n = 0U;
+
+    for (; v != 0U; v &= v - 1U)
+        n++;
+    return n;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void tlm_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    TlmStream_Stats_t st;
+    TlmStream_GetStats(&st);
+
+    if (st.count == 0U)
+    {
+        CLI_IF_Print("Telemetry stream off (\"tlm start <hz>\")\r\n");
+        return;
+    }
+
+    uint32_t link = tlm_link_permille(st.frameBytes, st.periodMs);
+
+    CLI_IF_Printf("Telemetry stream %s: %lu signals every %u ms, %lu bytes per sample, "
+                  "%lu.%lu%% of the UART\r\n",
+                  (st.running != 0U) ? "on" : "off", (unsigned long)st.count,
+                  (unsigned)st.periodMs, (unsigned long)st.frameBytes,
+                  (unsigned long)(link / 10U), (unsigned long)(link % 10U));
+    CLI_IF_Printf("%lu samples, %lu frames dropped (ring full), %lu bytes queued\r\n",
+                  (unsigned long)st.samples, (unsigned long)st.dropped,
+                  (unsigned long)st.bytes);
+
+    CLI_IF_Print("Signals:");
+    for (uint32_t sig = 0U; sig < TLM_SIG_COUNT; ++sig)
+    {
+        if ((st.mask & (1UL << sig)) != 0U)
+            CLI_IF_Printf(" %s", s_tlmSigs[sig].text);
+    }
+    CLI_IF_Print("\r\n");
+}
+
+static void tlm_cmd_list(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CLI_IF_Print(" id  name          unit   scale\r\n");
+    for (uint32_t sig = 0U; sig < TLM_SIG_COUNT; ++sig)
+    {
+        const TlmStream_SigInfo_t *info = &s_tlmSigs[sig];
+        uint32_t milli = (uint32_t)lrintf(info->scale * 1000.0f);
+
+        CLI_IF_Printf("%3lu  %-13s %-6s %lu.%03lu\r\n", (unsigned long)sig, info->text,
+                      info->unit, (unsigned long)(milli / 1000U),
+                      (unsigned long)(milli % 1000U));
+    }
+}
+
+static void tlm_cmd_start(int argc, char *argv[])
+{
+    char    *end;
+    uint32_t hz   = (uint32_t)strtoul(argv[0], &end, 10);
+    uint32_t mask = tlm_parse_signals((argc > 1) ? argv[1] : "all");
+
+    if ((end == argv[0]) || (*end != '\0') || (hz == 0U) || (hz > TLM_RATE_MAX))
+    {
+        CLI_IF_Printf("Usage: tlm start <1..%u hz> [<sig,...>|all]\r\n", (unsigned)TLM_RATE_MAX);
+        return;
+    }
+    if (mask == 0U)
+    {
+        CLI_IF_Print("Unknown signal, see \"tlm list\"\r\n");
+        return;
+    }
+
+    uint32_t periodMs = 1000U / hz;
+    HAL_StatusTypeDef status = TlmStream_Start(mask, periodMs);
+
+    if (status == HAL_BUSY)
+    {
+        uint32_t link = tlm_link_permille(TLM_SAMPLE_WIRE(tlm_popcount(mask)), periodMs);
+        CLI_IF_Printf("Needs %lu.%lu%% of the UART (max %u%%): fewer signals or a lower rate\r\n",
+                      (unsigned long)(link / 10U), (unsigned long)(link % 10U),
+                      (unsigned)TLM_LINK_PERCENT);
+        return;
+    }
+    if (status != HAL_OK)
+    {
+        CLI_IF_Print("Cannot start the stream\r\n");
+        return;
+    }
+
+    CLI_IF_Printf("Streaming %u signals at %lu Hz\r\n", (unsigned)s_tlmCount,
+                  (unsigned long)(1000U / periodMs));
+}
+
+static void tlm_cmd_stop(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    TlmStream_Stop();
+    CLI_IF_Printf("Telemetry stream off, %lu samples\r\n", (unsigned long)s_tlmSamples);
+}
+
+static const CliCommand_t s_tlmCmds[] =
+{
+    { "tlm",       "", 0U, tlm_cmd_show, "binary telemetry stream state" },
+    { "tlm list",  "", 0U, tlm_cmd_list, "streamable signals" },
+    { "tlm start", "<hz> [<sig,...>|all]", 1U, tlm_cmd_start,
+      "stream signals as COBS frames (tools/tlm_plot.py)" },
+    { "tlm stop",  "", 0U, tlm_cmd_stop, "stop the telemetry stream" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef TlmStream_Init(UART_HandleTypeDef *huart)
+{
+    if (huart == NULL)
+        return HAL_ERROR;
+
+    s_tlmUart    = huart;
+    s_tlmRunning = 0U;
+    s_tlmMask    = 0U;
+    s_tlmCount   = 0U;
+
+    CLI_IF_REGISTER_TABLE(s_tlmCmds);
+
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef TlmStream_Start(uint32_t mask, uint32_t periodMs)
+{
+    mask &= (TLM_SIG_COUNT >= 32U) ? 0xFFFFFFFFUL : ((1UL << TLM_SIG_COUNT) - 1UL);
+    if ((mask == 0U) || (periodMs == 0U) || (periodMs > UINT16_MAX))
+        return HAL_ERROR;
+
+    uint32_t count = tlm_popcount(mask);
+
+    if (tlm_link_permille(TLM_SAMPLE_WIRE(count), periodMs) > (TLM_LINK_PERCENT * 10U))
+        return HAL_BUSY;
+
+    TlmStream_Stop();
+
+    s_tlmMask      = mask;
+    s_tlmCount     = (uint8_t)count;
+    s_tlmPeriodMs  = periodMs;
+    s_tlmCountdown = 0U;
+    s_tlmDescMs    = TLM_DESC_PERIOD_MS;   /* descriptors before the first sample */
+    s_tlmSeq       = 0U;
+    s_tlmSamples   = 0U;
+    s_tlmDropped   = 0U;
+    s_tlmBytes     = 0U;
+    __DMB();
+    s_tlmRunning   = 1U;
+
+    return HAL_OK;
+}
+
+void TlmStream_Stop(void)
+{
+    s_tlmRunning = 0U;
+    __DMB();
+}
+
+void TlmStream_GetStats(TlmStream_Stats_t *out)
+{
+    out->running    = s_tlmRunning;
+    out->count      = s_tlmCount;
+    out->periodMs   = (uint16_t)s_tlmPeriodMs;
+    out->mask       = s_tlmMask;
+    out->samples    = s_tlmSamples;
+    out->dropped    = s_tlmDropped;
+    out->bytes      = s_tlmBytes;
+    out->frameBytes = TLM_SAMPLE_WIRE(s_tlmCount);
+}
+
+const TlmStream_SigInfo_t *TlmStream_GetSignal(uint32_t sig)
+{
+    return (sig < TLM_SIG_COUNT) ? &s_tlmSigs[sig] : NULL;
+}
+
+int32_t TlmStream_FindSignal(const char *name)
+{
+    uint32_t sig = tlm_find(name, strlen(name));
+
+    return (sig < TLM_SIG_COUNT) ? (int32_t)sig : -1;
+}
+
+void TlmStream_ReadSignals(uint32_t mask, float *v)
+{
+    tlm_read(mask, v);
+}
+
+HAL_StatusTypeDef TlmStream_SendFrame(uint8_t *raw, uint32_t len)
+{
+    if ((raw == NULL) || (len == 0U) || (len > TLM_FRAME_MAX))
+        return HAL_ERROR;
+    return tlm_send(raw, len);
+}
+
+void TlmStream_Event1ms(void)
+{
+    if (s_tlmRunning == 0U)
+        return;
+
+    if (++s_tlmDescMs >= TLM_DESC_PERIOD_MS)
+    {
+        s_tlmDescMs = 0U;
+        tlm_send_descriptors();
+    }
+    if (s_tlmCountdown == 0U)
+    {
+        s_tlmCountdown = s_tlmPeriodMs;
+        tlm_send_sample();
+    }
+    s_tlmCountdown--;
+}
+
+#endif /* TLM_STREAM_ENABLE */
@@ -0,0 +1,427 @@
+/**
+ * @file    trip.c
+ * @brief   Trip and odometer counters, their flash log client and "trip".
+ */
+
+#include "trip.h"
+#include "nvm_log.h"
+#include "cal.h"
+#include "can_if.h"
+#include "can_sched.h"
+#include "cli_if.h"
+#include "log.h"
+#include "fmt.h"
+#include <stdio.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* Records: key = TRIP_KEY_BASE + entry, aux = TRIP_REC_VERSION. */
+#define TRIP_KEY_BASE       0x0001U
+#define TRIP_REC_VERSION    1U
+
+typedef enum
+{
+    TRIP_REC_ODO = 0,       /* odometer m, total driving s */
+    TRIP_REC_TRIP,          /* trip m, trip driving s */
+    TRIP_REC_PEAK,          /* trip max rpm, trip s above TRIP_HOT_C */
+    TRIP_REC_COUNT
+} Trip_Rec_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Counters (live) and what was last queued for the log (stored, pending =
+ * not yet written). Written under PRIMASK by VehicleTask, Trip_Save() /
+ * Trip_Reset() (any task) and NvmTask. */
+static uint32_t s_trLive[TRIP_REC_COUNT][2];
+static uint32_t s_trStored[TRIP_REC_COUNT][2];
+static uint8_t  s_trPending[TRIP_REC_COUNT];
+
+/* VehicleTask's fractions of a metre and a second, and the save timing. */
+static float    s_trFracM    = 0.0f;
+static uint32_t s_trDriveMs  = 0U;
+static uint32_t s_trHotMs    = 0U;
+static uint32_t s_trStillMs  = 0U;
+static uint8_t  s_trDrove    = 0U;      /* moved since the last save */
+static uint32_t s_trCheckMs  = 0U;      /* last periodic save */
+
+static uint32_t s_trSaves      = 0U;
+static uint32_t s_trLastSaveMs = 0U;
+
+/* Group of the next trip data frame (CanTxTask). */
+static uint8_t  s_trDataGroup  = 0U;
+
+/* The groups are sent in turn, 0 .. GROUP_COUNT - 1. */
+_Static_assert(CANSIG_TRIP_DATA_GROUP_MAX + 1U == CANSIG_TRIP_DATA_GROUP_COUNT,
+               "TripData groups must be numbered from 0 without gaps");
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static void trip_restore(const NvmLog_Record_t *rec)
+{
+    uint32_t i = (uint32_t)rec->key - TRIP_KEY_BASE;
+
+    /* Another format (the layout changed) is left out; the next copy
+     * drops it. */
+    if ((i >= TRIP_REC_COUNT) || (rec->aux != TRIP_REC_VERSION))
+        return;
+
+    s_trLive[i][0]   = rec->data[0];
+    s_trLive[i][1]   = rec->data[1];
+    s_trStored[i][0] = rec->data[0];
+    s_trStored[i][1] = rec->data[1];
+}
+
+static uint8_t trip_take(uint32_t i, uint8_t all, NvmLog_Record_t *rec)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    /* An entry back at zero (a new trip) is written once, then dropped. */
+    uint8_t take = (all != 0U) ? (uint8_t)((s_trStored[i][0] != 0U) || (s_trStored[i][1] != 0U))
+                               : s_trPending[i];
+    rec->key     = (uint16_t)(TRIP_KEY_BASE + i);
+    rec->aux     = TRIP_REC_VERSION;
+    rec->data[0] = s_trStored[i][0];
+    rec->data[1] = s_trStored[i][1];
+    s_trPending[i] = 0U;
+
+    __set_PRIMASK(primask);
+    return take;
+}
+
+static void trip_retry(uint32_t i)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_trPending[i] = 1U;
+    __set_PRIMASK(primask);
+}
+
+static const NvmLog_Client_t s_trClient =
+{
+    .tag     = NVM_LOG_TAG_TRIP,
+    .count   = TRIP_REC_COUNT,
+    .restore = trip_restore,
+    .take    = trip_take,
+    .retry   = trip_retry,
+};
+
+/** CanTxTask: send the odometer; CAN_IF_Transmit() adds the MAC. */
+static HAL_StatusTypeDef trip_odo_send(void *ctx)
+{
+    (void)ctx;
+
+    Trip_Stats_t      st;
+    CanSig_Odometer_t m;
+    uint8_t           data[CANSIG_ODOMETER_DLC];
+
+    Trip_GetStats(&st);
+    memset(&m, 0, sizeof(m));
+    m.odometer_m = st.odometerM;
+    CanSig_Odometer_Pack(data, &m);
+
+    return CAN_IF_Transmit(CANSIG_ODOMETER_ID, data, CANSIG_ODOMETER_DLC);
+}
+
+static uint32_t trip_sat(uint32_t v, uint32_t max)
+{
+    return (v < max) ? v : max;
+}
+
+/** @p num / @p den rounded to nearest, saturated at @p max; integers only. */
+static uint32_t trip_div(uint64_t num, uint32_t den, uint32_t max)
+{
+    uint64_t q = (num + (den / 2U)) / den;
+    return (q < max) ? (uint32_t)q : max;
+}
+
+/** CanTxTask: send the next group of the trip data frame. In raw units
+ *  (0.1 km, 0.1 h, 0.1 km/h) so CanTxTask stays off the FPU (rtos_fpu.h). */
+static HAL_StatusTypeDef trip_data_send(void *ctx)
+{
+    (void)ctx;
+
+    Trip_Stats_t          st;
+    CanSig_TripData_Raw_t m;
+    uint8_t               data[CANSIG_TRIP_DATA_DLC];
+
+    _Static_assert(((int)CANSIG_TRIP_DATA_TRIP_KM_SCALE == 10) &&
+                   ((int)CANSIG_TRIP_DATA_TOTAL_DRIVE_H_SCALE == 10) &&
+                   ((int)CANSIG_TRIP_DATA_TRIP_AVG_KPH_SCALE == 10),
+                   "trip_data_send() assumes 0.1 units");
+
+    Trip_GetStats(&st);
+    memset(&m, 0, sizeof(m));
+    m.trip_mux = s_trDataGroup;
+    if (m.trip_mux == 0U)
+    {
+        m.trip_km      = trip_div(st.tripM, 100U, CANSIG_TRIP_DATA_TRIP_KM_RAW_MAX);
+        m.trip_drive_s = trip_sat(st.tripDriveS, CANSIG_TRIP_DATA_TRIP_DRIVE_S_RAW_MAX);
+        m.trip_max_rpm = (uint16_t)trip_sat(st.tripMaxRpm, CANSIG_TRIP_DATA_TRIP_MAX_RPM_RAW_MAX);
+    }
+    else
+    {
+        m.total_drive_h = trip_div(st.totalDriveS, 360U, CANSIG_TRIP_DATA_TOTAL_DRIVE_H_RAW_MAX);
+        m.trip_hot_s    = trip_sat(st.tripHotS, CANSIG_TRIP_DATA_TRIP_HOT_S_RAW_MAX);
+        /* m / s x 3.6 in 0.1 km/h */
+        m.trip_avg_kph  = (st.tripDriveS != 0U)
+                          ? (uint16_t)trip_div((uint64_t)st.tripM * 36U, st.tripDriveS,
+                                               CANSIG_TRIP_DATA_TRIP_AVG_KPH_RAW_MAX)
+                          : 0U;
+    }
+    (void)CanSig_TripData_PackRaw(data, &m);
+
+    HAL_StatusTypeDef status = CAN_IF_Transmit(CANSIG_TRIP_DATA_ID, data, CANSIG_TRIP_DATA_DLC);
+    if (status == HAL_OK)
+        s_trDataGroup = (uint8_t)((s_trDataGroup + 1U) % CANSIG_TRIP_DATA_GROUP_COUNT);
+    return status;
+}
+
+static const CanSched_Frame_t s_trOdoFrame =
+{
+    .name     = "odometer",
+    .id       = CANSIG_ODOMETER_ID,
+    .cycleMs  = TRIP_ODO_CYCLE_MS,
+    .minGapMs = 0U,
+    .offsetMs = TRIP_ODO_OFFSET_MS,
+    .changed  = NULL,
+    .send     = trip_odo_send,
+    .ctx      = NULL,
+};
+
+static const CanSched_Frame_t s_trDataFrame =
+{
+    .name     = "trip data",
+    .id       = CANSIG_TRIP_DATA_ID,
+    .cycleMs  = TRIP_DATA_CYCLE_MS,
+    .minGapMs = 0U,
+    .offsetMs = TRIP_DATA_OFFSET_MS,
+    .changed  = NULL,
+    .send     = trip_data_send,
+    .ctx      = NULL,
+};
+
+/** @p s as h:mm:ss. */
+static const char *trip_hms(uint32_t s, char *buf, size_t len)
+{
+    (void)FMT_SNPRINTF(buf, len, "%lu:%02lu:%02lu", (unsigned long)(s / 3600U),
+                       (unsigned long)((s / 60U) % 60U), (unsigned long)(s % 60U));
+    return buf;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void trip_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    Trip_Stats_t st;
+    char         t1[16];
+    char         t2[16];
+
+    Trip_GetStats(&st);
+
+    /* Average in 0.1 km/h: m / s * 3.6. */
+    uint32_t avg = (st.tripDriveS != 0U)
+                   ? (uint32_t)(((uint64_t)st.tripM * 36U) / st.tripDriveS) : 0U;
+
+    CLI_IF_Printf("Odometer %lu.%lu km, %s driving\r\n", (unsigned long)(st.odometerM / 1000U),
+                  (unsigned long)((st.odometerM % 1000U) / 100U),
+                  trip_hms(st.totalDriveS, t1, sizeof(t1)));
+    CLI_IF_Printf("Trip     %lu.%lu km in %s, average %lu.%lu km/h\r\n",
+                  (unsigned long)(st.tripM / 1000U), (unsigned long)((st.tripM % 1000U) / 100U),
+                  trip_hms(st.tripDriveS, t1, sizeof(t1)), (unsigned long)(avg / 10U),
+                  (unsigned long)(avg % 10U));
+    CLI_IF_Printf("         max %lu rpm, %s with the coolant above %ld C\r\n",
+                  (unsigned long)st.tripMaxRpm, trip_hms(st.tripHotS, t2, sizeof(t2)),
+                  (long)lrintf(CAL_F(TRIP_HOT_C)));
+
+    if (st.saves == 0U)
+        CLI_IF_Print("Not saved since boot");
+    else
+        CLI_IF_Printf("Saved %lu times since boot, last %lu s ago", (unsigned long)st.saves,
+                      (unsigned long)((HAL_GetTick() - st.lastSaveMs) / 1000U));
+    CLI_IF_Printf(" (every %lu min while driving, at standstill, 'trip save')\r\n",
+                  (unsigned long)CAL_U(TRIP_SAVE_MIN));
+}
+
+static void trip_cmd_reset(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    Trip_Reset();
+    CLI_IF_Print("New trip started\r\n");
+}
+
+static void trip_cmd_save(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CLI_IF_Printf("%lu records queued for flash\r\n", (unsigned long)Trip_Save());
+}
+
+static const CliCommand_t s_trCmds[] =
+{
+    { "trip",       "", 0U, trip_cmd_show,  "odometer and trip computer" },
+    { "trip reset", "", 0U, trip_cmd_reset, "start a new trip" },
+    { "trip save",  "", 0U, trip_cmd_save,  "write the trip counters to flash now" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void Trip_Init(void)
+{
+    memset(s_trLive, 0, sizeof(s_trLive));
+    memset(s_trStored, 0, sizeof(s_trStored));
+    memset(s_trPending, 0, sizeof(s_trPending));
+
+    if (NvmLog_Register(&s_trClient) != HAL_OK)
+        LOG_ERROR(MAIN, "Trip counters not in the flash log, not kept over a reset");
+
+    CLI_IF_REGISTER_TABLE(s_trCmds);
+}
+
+HAL_StatusTypeDef Trip_CanInit(void)
+{
+    HAL_StatusTypeDef status = CanSched_Add(&s_trOdoFrame);
+
+    if (status == HAL_OK)
+        status = CanSched_Add(&s_trDataFrame);
+    return status;
+}
+
+void Trip_Update(const VehicleState_t *vs, uint32_t stepMs)
+{
+    uint8_t  moving = (vs->speed_kph >= TRIP_MOVING_KPH) ? 1U : 0U;
+    uint32_t metres;
+    uint32_t driveS = 0U;
+    uint32_t hotS   = 0U;
+
+    /* km/h x ms / 3600 = m */
+    if (moving != 0U)
+        s_trFracM += vs->speed_kph * (float)stepMs / 3600.0f;
+    metres     = (uint32_t)s_trFracM;
+    s_trFracM -= (float)metres;
+
+    if (moving != 0U)
+    {
+        s_trDriveMs += stepMs;
+        driveS       = s_trDriveMs / 1000U;
+        s_trDriveMs %= 1000U;
+    }
+    if (vs->coolant_temp_c > CAL_F(TRIP_HOT_C))
+    {
+        s_trHotMs += stepMs;
+        hotS       = s_trHotMs / 1000U;
+        s_trHotMs %= 1000U;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    s_trLive[TRIP_REC_ODO][0]  += metres;
+    s_trLive[TRIP_REC_ODO][1]  += driveS;
+    s_trLive[TRIP_REC_TRIP][0] += metres;
+    s_trLive[TRIP_REC_TRIP][1] += driveS;
+    if (vs->engine_rpm > s_trLive[TRIP_REC_PEAK][0])
+        s_trLive[TRIP_REC_PEAK][0] = vs->engine_rpm;
+    s_trLive[TRIP_REC_PEAK][1] += hotS;
+
+    __set_PRIMASK(primask);
+
+    /* Standing still after a drive: the trip is likely over. */
+    if (moving != 0U)
+    {
+        s_trDrove   = 1U;
+        s_trStillMs = 0U;
+    }
+    else if (s_trDrove != 0U)
+    {
+        s_trStillMs += stepMs;
+        if (s_trStillMs >= TRIP_STOP_SAVE_MS)
+        {
+            s_trDrove = 0U;
+            (void)Trip_Save();
+        }
+    }
+
+    uint32_t now = HAL_GetTick();
+    if ((now - s_trCheckMs) >= (CAL_U(TRIP_SAVE_MIN) * 60000U))
+    {
+        s_trCheckMs = now;
+        (void)Trip_Save();
+    }
+}
+
+uint32_t Trip_Save(void)
+{
+    uint32_t queued = 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    for (uint32_t i = 0U; i < TRIP_REC_COUNT; ++i)
+    {
+        if ((s_trLive[i][0] == s_trStored[i][0]) && (s_trLive[i][1] == s_trStored[i][1]))
+            continue;
+        s_trStored[i][0] = s_trLive[i][0];
+        s_trStored[i][1] = s_trLive[i][1];
+        s_trPending[i]   = 1U;
+        queued++;
+    }
+    if (queued != 0U)
+    {
+        s_trSaves++;
+        s_trLastSaveMs = HAL_GetTick();
+    }
+
+    __set_PRIMASK(primask);
+
+    if (queued != 0U)
+        NvmLog_Notify();
+    return queued;
+}
+
+void Trip_Reset(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    memset(s_trLive[TRIP_REC_TRIP], 0, sizeof(s_trLive[TRIP_REC_TRIP]));
+    memset(s_trLive[TRIP_REC_PEAK], 0, sizeof(s_trLive[TRIP_REC_PEAK]));
+
+    __set_PRIMASK(primask);
+
+    (void)Trip_Save();
+}
+
+void Trip_GetStats(Trip_Stats_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    out->odometerM   = s_trLive[TRIP_REC_ODO][0];
+    out->totalDriveS = s_trLive[TRIP_REC_ODO][1];
+    out->tripM       = s_trLive[TRIP_REC_TRIP][0];
+    out->tripDriveS  = s_trLive[TRIP_REC_TRIP][1];
+    out->tripMaxRpm  = s_trLive[TRIP_REC_PEAK][0];
+    out->tripHotS    = s_trLive[TRIP_REC_PEAK][1];
+    out->saves       = s_trSaves;
+    out->lastSaveMs  = s_trLastSaveMs;
+
+    __set_PRIMASK(primask);
+}
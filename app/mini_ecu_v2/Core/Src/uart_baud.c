@@ -0,0 +1,294 @@
+/**
+ * @file    uart_baud.c
+ * @brief   Console baud rate switching: divider, hand-over and "baud".
+ */
+
+#include "uart_baud.h"
+#include "cli_if.h"
+#include "log.h"
+#include "cmsis_os2.h"
+#include <stdlib.h>
+
+#if UART_BAUD_ENABLE
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static UART_HandleTypeDef *s_ubUart = NULL;
+
+/* Set by CliTask, checked by the 100 ms runnable under PRIMASK. */
+static volatile uint8_t    s_ubPending = 0U;
+static uint32_t            s_ubSwitchTick = 0U;
+static UartBaud_Setting_t  s_ubPrev;      /* rate to go back to */
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Program BRR and OVER8; the caller makes sure nothing is being sent. */
+static void ub_apply(const UartBaud_Setting_t *set)
+{
+    USART_TypeDef *u = s_ubUart->Instance;
+
+    CLEAR_BIT(u->CR1, USART_CR1_UE);
+    if (set->over8 != 0U)
+        SET_BIT(u->CR1, USART_CR1_OVER8);
+    else
+        CLEAR_BIT(u->CR1, USART_CR1_OVER8);
+    u->BRR = set->brr;
+    SET_BIT(u->CR1, USART_CR1_UE);
+
+    s_ubUart->Init.BaudRate     = set->baud;
+    s_ubUart->Init.OverSampling = (set->over8 != 0U) ? UART_OVERSAMPLING_8 : UART_OVERSAMPLING_16;
+}
+
+/** The rate the UART runs at now, as a setting. */
+static void ub_current(UartBaud_Setting_t *out)
+{
+    (void)UartBaud_Compute(HAL_RCC_GetPCLK1Freq(), s_ubUart->Init.BaudRate, out);
+}
+
+/** Print "<int>.<tenth> %" of a signed permille value. */
+static void ub_print_err(int32_t permille)
+{
+    uint32_t mag = (uint32_t)((permille < 0) ? -permille : permille);
+
+    CLI_IF_Printf("%c%lu.%lu %%", (permille < 0) ? '-' : '+',
+                  (unsigned long)(mag / 10U), (unsigned long)(mag % 10U));
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void ub_cmd_show(void)
+{
+    UartBaud_Setting_t set;
+    uint32_t pclk = HAL_RCC_GetPCLK1Freq();
+
+    ub_current(&set);
+    CLI_IF_Printf("Console %lu baud: BRR 0x%04lx, OVER%u, actual %lu (",
+                  (unsigned long)set.baud, (unsigned long)s_ubUart->Instance->BRR,
+                  ((s_ubUart->Instance->CR1 & USART_CR1_OVER8) != 0U) ? 8U : 16U,
+                  (unsigned long)set.actual);
+    ub_print_err(set.errPermille);
+    CLI_IF_Printf(")\r\nPCLK1 %lu Hz: %lu..%lu baud within %u.%u %%\r\n",
+                  (unsigned long)pclk, (unsigned long)UART_BAUD_MIN,
+                  (unsigned long)(pclk / 8U),
+                  (unsigned)(UART_BAUD_MAX_ERR_PERMILLE / 10U),
+                  (unsigned)(UART_BAUD_MAX_ERR_PERMILLE % 10U));
+    if (s_ubPending != 0U)
+    {
+        CLI_IF_Printf("Not confirmed yet, back to %lu baud in %lu ms\r\n",
+                      (unsigned long)s_ubPrev.baud,
+                      (unsigned long)(UART_BAUD_CONFIRM_MS - (HAL_GetTick() - s_ubSwitchTick)));
+    }
+}
+
+static void ub_cmd_set(const char *arg)
+{
+    char              *end;
+    uint32_t           baud = (uint32_t)strtoul(arg, &end, 10);
+    UartBaud_Setting_t set;
+
+    if ((end == arg) || (*end != '\0'))
+    {
+        CLI_IF_Print("Usage: baud <rate> | baud ok\r\n");
+        return;
+    }
+    if (UartBaud_Compute(HAL_RCC_GetPCLK1Freq(), baud, &set) != HAL_OK)
+    {
+        CLI_IF_Printf("%lu baud not reachable from PCLK1 (actual %lu, ",
+                      (unsigned long)baud, (unsigned long)set.actual);
+        ub_print_err(set.errPermille);
+        CLI_IF_Print("), see \"baud\"\r\n");
+        return;
+    }
+
+    CLI_IF_Printf("Switching to %lu baud (actual %lu, ", (unsigned long)baud,
+                  (unsigned long)set.actual);
+    ub_print_err(set.errPermille);
+    CLI_IF_Printf("); send \"baud ok\" at the new rate within %u ms\r\n",
+                  (unsigned)UART_BAUD_CONFIRM_MS);
+
+    if (UartBaud_Request(baud) == HAL_TIMEOUT)
+        CLI_IF_Print("Output did not drain, rate unchanged\r\n");
+}
+
+static void ub_cmd_baud(int argc, char *argv[])
+{
+    if (argc == 0)
+        ub_cmd_show();
+    else
+        ub_cmd_set(argv[0]);
+}
+
+static void ub_cmd_ok(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if (UartBaud_Confirm() != HAL_OK)
+    {
+        CLI_IF_Print("No baud switch pending\r\n");
+        return;
+    }
+    CLI_IF_Printf("Console at %lu baud\r\n", (unsigned long)UartBaud_Get());
+}
+
+static const CliCommand_t s_ubCmds[] =
+{
+    { "baud",    "[<rate>]", 0U, ub_cmd_baud, "console baud rate, or switch it" },
+    { "baud ok", "",         0U, ub_cmd_ok,   "confirm a baud switch" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef UartBaud_Init(UART_HandleTypeDef *huart)
+{
+    if (huart == NULL)
+        return HAL_ERROR;
+
+    s_ubUart    = huart;
+    s_ubPending = 0U;
+
+    CLI_IF_REGISTER_TABLE(s_ubCmds);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef UartBaud_Compute(uint32_t pclkHz, uint32_t baud, UartBaud_Setting_t *out)
+{
+    uint32_t div;
+
+    out->baud        = baud;
+    out->actual      = 0U;
+    out->brr         = 0U;
+    out->over8       = 0U;
+    out->errPermille = 0;
+
+    if ((baud < UART_BAUD_MIN) || (baud > (pclkHz / 8U)))
+        return HAL_ERROR;
+
+    /* Whole UART clocks per bit; BRR holds it in 1/16 (or 1/8) units. */
+    div = (pclkHz + (baud / 2U)) / baud;
+    if (div < 8U)
+        return HAL_ERROR;
+
+    out->over8  = (div < 16U) ? 1U : 0U;
+    out->brr    = (out->over8 != 0U) ? (((div & ~7U) << 1U) | (div & 7U)) : div;
+    out->actual = pclkHz / div;
+    out->errPermille = (int16_t)(((int64_t)out->actual - (int64_t)baud) * 1000 / (int64_t)baud);
+
+    if (abs(out->errPermille) > (int32_t)UART_BAUD_MAX_ERR_PERMILLE)
+        return HAL_ERROR;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef UartBaud_Request(uint32_t baud)
+{
+    UartBaud_Setting_t set;
+
+    if ((s_ubUart == NULL) ||
+        (UartBaud_Compute(HAL_RCC_GetPCLK1Freq(), baud, &set) != HAL_OK))
+    {
+        return HAL_ERROR;
+    }
+
+    /* Let the announcement go out at the old rate. With CliTask above
+     * LogTask nothing new starts between the check and the switch. */
+    uint32_t start = HAL_GetTick();
+    while ((Log_TxIdle() == 0U) || (__HAL_UART_GET_FLAG(s_ubUart, UART_FLAG_TC) == 0U))
+    {
+        if ((HAL_GetTick() - start) >= UART_BAUD_DRAIN_MS)
+            return HAL_TIMEOUT;
+        (void)osDelay(1U);
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s_ubPending == 0U)
+        ub_current(&s_ubPrev);      /* a second request keeps the confirmed rate */
+    ub_apply(&set);
+    s_ubSwitchTick = HAL_GetTick();
+    s_ubPending    = 1U;
+    __set_PRIMASK(primask);
+
+    LOG_INFO(CLI, "Console switched to %lu baud, waiting for \"baud ok\"", (unsigned long)baud);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef UartBaud_Confirm(void)
+{
+    HAL_StatusTypeDef status = HAL_ERROR;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s_ubPending != 0U)
+    {
+        s_ubPending = 0U;
+        status      = HAL_OK;
+    }
+    __set_PRIMASK(primask);
+
+    return status;
+}
+
+uint32_t UartBaud_Get(void)
+{
+    return (s_ubUart != NULL) ? s_ubUart->Init.BaudRate : 0U;
+}
+
+void UartBaud_Event100ms(void)
+{
+    if ((s_ubPending == 0U) || ((HAL_GetTick() - s_ubSwitchTick) < UART_BAUD_CONFIRM_MS))
+        return;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t revert = s_ubPending;
+    if (revert != 0U)
+    {
+        /* The host is not listening at the new rate, so a chunk cut by
+         * the switch back is lost either way. */
+        ub_apply(&s_ubPrev);
+        s_ubPending = 0U;
+    }
+    __set_PRIMASK(primask);
+
+    if (revert != 0U)
+        LOG_WARN(CLI, "Baud switch not confirmed, back to %lu baud", (unsigned long)s_ubPrev.baud);
+}
+
+uint8_t UartBaud_Fits(uint32_t pclkHz)
+{
+    UartBaud_Setting_t set;
+
+    if (s_ubUart == NULL)
+        return 1U;
+    if (UartBaud_Compute(pclkHz, s_ubUart->Init.BaudRate, &set) != HAL_OK)
+        return 0U;
+    if ((s_ubPending != 0U) && (UartBaud_Compute(pclkHz, s_ubPrev.baud, &set) != HAL_OK))
+        return 0U;
+    return 1U;
+}
+
+void UartBaud_Retime(void)
+{
+    UartBaud_Setting_t set;
+
+    if (s_ubUart == NULL)
+        return;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    ub_current(&set);
+    ub_apply(&set);
+    if (s_ubPending != 0U)
+        (void)UartBaud_Compute(HAL_RCC_GetPCLK1Freq(), s_ubPrev.baud, &s_ubPrev);
+    __set_PRIMASK(primask);
+}
+
+#endif /* UART_BAUD_ENABLE */
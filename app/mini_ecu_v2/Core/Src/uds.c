@@ -0,0 +1,1308 @@
+/**
+ * @file    uds.c
+ * @brief   UDS services on the diagnostic ISO-TP channel and "uds".
+ */
+
+#include "uds.h"
+#include "audit.h"
+#include "isotp.h"
+#include "can_if.h"
+#include "can_sigcache.h"
+#include "can_stats.h"
+#include "can_ring.h"
+#include "can_sched.h"
+#include "mem_pool.h"
+#include "boot_request.h"
+#include "stage.h"
+#include "image_header.h"
+#include "dtc.h"
+#include "freeze_frame.h"
+#include "crash_dump.h"
+#include "cal.h"
+#include "scenario.h"
+#include "sig_hist.h"
+#include "obd.h"
+#include "perf_life.h"
+#include "metrics.h"
+#include "cli_if.h"
+#include "log.h"
+#include "fmt.h"
+#include <stdio.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define UDS_SID_SESSION_CONTROL   0x10U
+#define UDS_SID_CLEAR_DTC         0x14U
+#define UDS_SID_READ_DTC          0x19U
+#define UDS_SID_READ_DID          0x22U
+#define UDS_SID_READ_PERIODIC     0x2AU
+#define UDS_SID_WRITE_DID         0x2EU
+#define UDS_SID_ROUTINE_CONTROL   0x31U
+#define UDS_SID_REQUEST_DOWNLOAD  0x34U
+#define UDS_SID_TRANSFER_DATA     0x36U
+#define UDS_SID_TRANSFER_EXIT     0x37U
+#define UDS_SID_TESTER_PRESENT    0x3EU
+
+#define UDS_POSITIVE_OFFSET       0x40U
+#define UDS_NEGATIVE_RESPONSE     0x7FU
+#define UDS_SPRMIB                0x80U   /* suppressPosRspMsgIndicationBit */
+
+#define UDS_NRC_SERVICE           0x11U   /* serviceNotSupported */
+#define UDS_NRC_SUBFUNCTION       0x12U   /* subFunctionNotSupported */
+#define UDS_NRC_LENGTH            0x13U   /* incorrectMessageLengthOrInvalidFormat */
+#define UDS_NRC_TOO_LONG          0x14U   /* responseTooLong */
+#define UDS_NRC_BUSY              0x21U   /* busyRepeatRequest */
+#define UDS_NRC_SEQUENCE          0x24U   /* requestSequenceError */
+#define UDS_NRC_OUT_OF_RANGE      0x31U   /* requestOutOfRange */
+#define UDS_NRC_NOT_ACCEPTED      0x70U   /* uploadDownloadNotAccepted */
+#define UDS_NRC_SUSPENDED         0x71U   /* transferDataSuspended */
+#define UDS_NRC_PROGRAMMING       0x72U   /* generalProgrammingFailure */
+#define UDS_NRC_BLOCK_COUNTER     0x73U   /* wrongBlockSequenceCounter */
+#define UDS_NRC_SUB_IN_SESSION    0x7EU   /* subFunctionNotSupportedInActiveSession */
+#define UDS_NRC_SERVICE_IN_SESSION 0x7FU  /* serviceNotSupportedInActiveSession */
+
+#define UDS_SESSION_DEFAULT       0x01U
+#define UDS_SESSION_PROGRAMMING   0x02U
+#define UDS_SESSION_EXTENDED      0x03U
+
+/* Sessions a service is allowed in (bit per session). */
+#define UDS_IN_DEFAULT            (1U << UDS_SESSION_DEFAULT)
+#define UDS_IN_EXTENDED           (1U << UDS_SESSION_EXTENDED)
+#define UDS_IN_ANY                (UDS_IN_DEFAULT | UDS_IN_EXTENDED | (1U << UDS_SESSION_PROGRAMMING))
+
+/* ReadDTCInformation */
+#define UDS_DTC_COUNT_BY_MASK     0x01U
+#define UDS_DTC_BY_MASK           0x02U
+#define UDS_DTC_SNAPSHOT_IDS      0x03U
+#define UDS_DTC_SNAPSHOT          0x04U
+#define UDS_DTC_SUPPORTED         0x0AU
+#define UDS_DTC_AVAILABILITY      (DTC_ST_ACTIVE | DTC_ST_CONFIRMED)
+#define UDS_DTC_FORMAT_14229      0x01U
+#define UDS_DTC_SNAPSHOT_RECORD   0x01U   /* DTC entry: speed, rpm, coolant */
+#define UDS_DTC_SNAPSHOT_CACHE    0x02U   /* freeze frame: the signal DIDs then */
+#define UDS_DTC_SNAPSHOT_HISTORY  0x03U   /* freeze frame: UDS_DID_FREEZE_HIST */
+#define UDS_DTC_SNAPSHOT_ALL      0xFFU
+
+/* RoutineControl */
+#define UDS_ROUTINE_START         0x01U
+#define UDS_ROUTINE_STOP          0x02U
+#define UDS_ROUTINE_RESULTS       0x03U
+#define UDS_SCENARIO_NAME_MAX     15U
+#define UDS_HIST_REQ_LEN          9U      /* rid, signal, tier, back (u16), count */
+#define UDS_HIST_RSP_HDR          7U      /* sub, rid, signal, tier, count */
+#define UDS_HIST_MAX_BUCKETS      ((UDS_RSP_MAX - UDS_HIST_RSP_HDR) / 6U)
+#define UDS_AUDIT_REQ_LEN         7U      /* rid, back (u16), count */
+#define UDS_AUDIT_RSP_HDR         5U      /* sub, rid, count */
+#define UDS_AUDIT_MAX_EVENTS      ((UDS_RSP_MAX - UDS_AUDIT_RSP_HDR) / 16U)
+
+/* ReadDataByPeriodicIdentifier: transmissionMode */
+#define UDS_PERIODIC_SLOW         0x01U
+#define UDS_PERIODIC_MEDIUM       0x02U
+#define UDS_PERIODIC_FAST         0x03U
+#define UDS_PERIODIC_STOP         0x04U
+
+/* RequestDownload: no compression or encryption, 4-byte address and size. */
+#define UDS_DOWNLOAD_FORMAT       0x00U
+#define UDS_DOWNLOAD_ALFID        0x44U
+#define UDS_DOWNLOAD_REQ_LEN      11U
+/* TransferData request bytes the tester may send: SID, counter, data. */
+#define UDS_TRANSFER_BLOCK_MAX    UDS_RSP_MAX
+#define UDS_NO_BLOCK              0x100U  /* no 0x36 accepted yet: next is 0x01 */
+
+/* Longest single DID value (a load collective row). */
+#define UDS_DID_MAX_LEN           32U
+#define UDS_DID_CRASH_LEN         26U
+#define UDS_DID_CAN_STATS_LEN     28U
+#define UDS_DID_STAGE_LEN         18U
+#define UDS_NOT_AVAILABLE         0xFFFFU
+
+/* Response buffer: one pool block of the largest class. */
+#define UDS_RSP_MAX               MEM_POOL_MAX_BLOCK
+
+/**
+ * A service: fills @p rsp from the request (SID included in both) and
+ * returns 0, or the NRC. Sub-function services get their sub-function with
+ * the SPRMIB bit cleared.
+ */
+typedef uint8_t (*Uds_Handler_t)(const uint8_t *req, uint16_t len, uint8_t *rsp, uint16_t *rspLen);
+
+typedef struct
+{
+    uint8_t       sid;
+    uint8_t       sessions;     /* UDS_IN_* */
+    uint8_t       subFunction;  /* honours the SPRMIB bit */
+    Uds_Handler_t fn;
+} Uds_Service_t;
+
+typedef struct
+{
+    uint16_t             did;
+    CanSigCache_Signal_t sig;
+    float                scale;
+    float                offset;
+} Uds_SignalDid_t;
+
+#define UDS_SIGNAL_DID_(did, sig, scale, offset)   { did, sig, scale, offset },
+static const Uds_SignalDid_t s_udsSignalDids[] = { UDS_SIGNAL_DID_TABLE(UDS_SIGNAL_DID_) };
+
+#define UDS_SIGNAL_DID_COUNT  (sizeof(s_udsSignalDids) / sizeof(s_udsSignalDids[0]))
+
+/* Signal DID 0x01xx streams as periodic DID 0xF2xx. */
+#define UDS_SIGNAL_DID_CHECK_(did, sig, scale, offset)                            \
+    _Static_assert(((did) & 0xFF00U) == 0x0100U, "signal DID outside 0x0100..0x01FF");
+UDS_SIGNAL_DID_TABLE(UDS_SIGNAL_DID_CHECK_)
+
+/**
+ * A 0x2A rate: one entry of the TX scheduler, which sends the signal DIDs
+ * scheduled at it. @p next is where a send cut short by a full TX queue
+ * goes on (CanTxTask only).
+ */
+typedef struct
+{
+    uint8_t mode;           /* UDS_PERIODIC_SLOW .. _FAST */
+    uint8_t next;
+} Uds_PeriodicRate_t;
+
+/* 0x19 04 with every record: DTC, record 01, the signal DIDs, the history. */
+#define UDS_SNAPSHOT_RSP_LEN  (6U + 14U + (2U + (4U * UDS_SIGNAL_DID_COUNT)) + \
+                               (7U + (2U * FREEZE_FRAME_ROWS * FREEZE_FRAME_SIGNALS)))
+_Static_assert(UDS_SNAPSHOT_RSP_LEN <= UDS_RSP_MAX, "a freeze frame does not fit one UDS response");
+_Static_assert((UDS_DID_CAN_STATS_LEN <= UDS_DID_MAX_LEN) &&
+               ((4U * LOAD_COLL_SPEED_BINS) <= UDS_DID_MAX_LEN) &&
+               ((4U * LOAD_COLL_TEMP_BINS) <= UDS_DID_MAX_LEN), "UDS_DID_MAX_LEN too short");
+_Static_assert(UDS_DID_LOAD_TEMP <= 0x016FU, "load collective DIDs past 0x016F");
+_Static_assert((UDS_DID_PERF_LIFE_BASE + PERF_LIFE_COUNT) <= 0x0190U,
+               "lifetime counter DIDs past 0x018F");
+_Static_assert((UDS_DID_METRICS_BASE + METRICS_COUNT) <= 0x01C0U, "metric DIDs past 0x01BF");
+_Static_assert((4U * METRICS_HIST_BUCKETS) <= UDS_DID_MAX_LEN, "UDS_DID_MAX_LEN too short");
+_Static_assert((1U + (OBD_MAX_PIDS * (1U + OBD_PID_MAX_LEN))) <= UDS_RSP_MAX,
+               "a service 01 response does not fit one UDS response");
+
+typedef struct
+{
+    uint32_t requests;
+    uint32_t positive;
+    uint32_t negative;
+    uint32_t suppressed;    /* no response: SPRMIB or functional NRC */
+    uint32_t noBuffer;      /* request dropped, pool empty */
+    uint32_t busy;          /* response dropped, channel still sending */
+    uint32_t timeouts;      /* S3 expiries */
+} Uds_Stats_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static IsoTp_Channel_t s_udsChannel =
+{
+    .rxId   = UDS_CAN_REQ_ID,
+    .txId   = UDS_CAN_RESP_ID,
+    .funcId = UDS_CAN_FUNC_ID,
+    .bs     = 0U,
+    .stmin  = 0U,
+};
+
+/* Written in CanRxTask only. */
+static uint8_t     s_udsSession     = UDS_SESSION_DEFAULT;
+static uint32_t    s_udsLastRequest = 0U;
+static uint8_t     s_udsEnterUpdate = 0U;
+static uint8_t     s_udsRestart     = 0U;
+static uint8_t     s_udsDownload    = 0U;     /* 0x34 accepted, 0x37 not yet */
+static uint16_t    s_udsBlock       = UDS_NO_BLOCK;  /* last accepted 0x36 counter */
+static Uds_Stats_t s_udsStats;
+
+/* Freeze frame being answered (0x19 03 / 04); CanRxTask only, and too
+ * large for its stack. */
+static FreezeFrame_t s_udsFrame;
+
+/* 0x2A mode of each signal DID, 0 = not scheduled. Written by CanRxTask,
+ * read by CanTxTask: one byte each, a change applies from the next send
+ * of the rate. */
+static volatile uint8_t s_udsPeriodicMode[UDS_SIGNAL_DID_COUNT];
+
+static Uds_PeriodicRate_t s_udsRates[3] =
+{
+    { UDS_PERIODIC_SLOW,   0U },
+    { UDS_PERIODIC_MEDIUM, 0U },
+    { UDS_PERIODIC_FAST,   0U },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static void uds_put16(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void uds_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint32_t uds_get32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/** A download left open by the tester: the staging stops where it got. */
+static void uds_end_download(void)
+{
+    if (s_udsDownload == 0U)
+        return;
+    s_udsDownload = 0U;
+    Stage_Abort();
+    LOG_WARN(CAN, "UDS: download abandoned");
+}
+
+/** Signal DID of periodic DID 0xF2 @p pdid, -1 without one. */
+static int32_t uds_periodic_index(uint8_t pdid)
+{
+    for (uint32_t i = 0U; i < UDS_SIGNAL_DID_COUNT; ++i)
+    {
+        if (s_udsSignalDids[i].did == (0x0100U | pdid))
+            return (int32_t)i;
+    }
+    return -1;
+}
+
+/** End every 0x2A subscription (the extended session ended). */
+static void uds_periodic_stop_all(void)
+{
+    for (uint32_t i = 0U; i < UDS_SIGNAL_DID_COUNT; ++i)
+        s_udsPeriodicMode[i] = 0U;
+}
+
+/** Physical value to the unsigned 16-bit DID form. */
+static uint16_t uds_scale(float value, float scale, float offset)
+{
+    float v = (value + offset) * scale + 0.5f;
+
+    if (v < 0.0f)
+        return 0U;
+    if (v > (float)(UDS_NOT_AVAILABLE - 1U))
+        return (uint16_t)(UDS_NOT_AVAILABLE - 1U);
+    return (uint16_t)v;
+}
+
+static int32_t uds_cal_id(uint16_t did)
+{
+    if ((did & 0xF000U) != UDS_DID_CAL_BASE)
+        return -1;
+    return Cal_FindKey((uint16_t)(did - UDS_DID_CAL_BASE));
+}
+
+/**
+ * Value of @p did into @p out (UDS_DID_MAX_LEN bytes).
+ *
+ * @return Its length, 0 for a DID this ECU does not have.
+ */
+static uint16_t uds_read_did(uint16_t did, uint8_t *out)
+{
+    for (uint32_t i = 0U; i < UDS_SIGNAL_DID_COUNT; ++i)
+    {
+        const Uds_SignalDid_t *d = &s_udsSignalDids[i];
+        CanSigCache_Entry_t    e;
+
+        /* A periodic DID reads as its signal DID. */
+        if ((d->did != did) && ((UDS_DID_PERIODIC_BASE | (d->did & 0x00FFU)) != did))
+            continue;
+
+        (void)CanSigCache_Read(d->sig, &e);
+        uds_put16(out, (CanSigCache_IsStale(&e, HAL_GetTick()) != 0U)
+                           ? UDS_NOT_AVAILABLE : uds_scale(e.value, d->scale, d->offset));
+        return 2U;
+    }
+
+    int32_t cal = uds_cal_id(did);
+    if (cal >= 0)
+    {
+        uds_put32(out, g_calValues[cal].u);
+        return 4U;
+    }
+
+    if (did == UDS_DID_CRASH)
+    {
+        const CrashDump_t *rec = CrashDump_Get();
+
+        memset(out, 0, UDS_DID_CRASH_LEN);
+        if (rec == NULL)
+            return UDS_DID_CRASH_LEN;
+
+        uint32_t addr = ((rec->cfsr & SCB_CFSR_MMARVALID_Msk) != 0U) ? rec->mmfar :
+                        ((rec->cfsr & SCB_CFSR_BFARVALID_Msk) != 0U) ? rec->bfar : 0U;
+
+        out[0] = (rec->count > 0xFFU) ? 0xFFU : (uint8_t)rec->count;
+        out[1] = (uint8_t)rec->cause;
+        uds_put32(&out[2], rec->pc);
+        uds_put32(&out[6], rec->lr);
+        uds_put32(&out[10], rec->cfsr);
+        uds_put32(&out[14], rec->hfsr);
+        uds_put32(&out[18], addr);
+        uds_put32(&out[22], rec->uptimeMs);
+        return UDS_DID_CRASH_LEN;
+    }
+
+    if (did == UDS_DID_CAN_STATS)
+    {
+        CanStats_Summary_t s;
+        CanRing_Stats_t    ring = {0};
+        CanRing_t         *rx   = CAN_IF_GetRxRing();
+        uint32_t           errors = 0U;
+
+        (void)CanStats_Get(&s, NULL, 0U);
+        if (rx != NULL)
+            CanRing_GetStats(rx, &ring);
+        for (uint32_t i = 1U; i < CAN_STATS_LEC_COUNT; ++i)
+            errors += s.lec[i];
+
+        uds_put32(&out[0], s.rxFrames);
+        uds_put32(&out[4], s.txFrames);
+        uds_put32(&out[8], s.fifoOverruns);
+        uds_put32(&out[12], ring.overflows);
+        uds_put32(&out[16], errors);
+        uds_put32(&out[20], s.entered[CAN_STATS_BUSOFF]);
+        uds_put16(&out[24], s.peakLoadPermille);
+        out[26] = s.tec;
+        out[27] = s.rec;
+        return UDS_DID_CAN_STATS_LEN;
+    }
+
+    if (did == UDS_DID_STAGE)
+    {
+        Stage_Stats_t st;
+
+        Stage_GetStats(&st);
+        uds_put32(&out[0], st.base);
+        out[4] = (uint8_t)st.state;
+        out[5] = (uint8_t)st.erased;
+        uds_put32(&out[6], st.written);
+        uds_put32(&out[10], st.sliceMaxUs);
+        uds_put32(&out[14], st.eraseMaxUs);
+        return UDS_DID_STAGE_LEN;
+    }
+
+    if ((did >= UDS_DID_LOAD_BASE) && (did <= UDS_DID_LOAD_TEMP))
+    {
+        uint32_t cells[UDS_DID_MAX_LEN / 4U];
+        uint32_t n = LoadColl_GetRow((uint32_t)did - UDS_DID_LOAD_BASE, cells);
+
+        for (uint32_t i = 0U; i < n; ++i)
+            uds_put32(&out[4U * i], cells[i]);
+        return (uint16_t)(4U * n);
+    }
+
+    if ((did >= UDS_DID_PERF_LIFE_BASE) &&
+        (did < (UDS_DID_PERF_LIFE_BASE + PERF_LIFE_COUNT)))
+    {
+        uint32_t v;
+
+        if (PerfLife_Get((uint32_t)did - UDS_DID_PERF_LIFE_BASE, &v) == 0U)
+            return 0U;
+        uds_put32(out, v);
+        return 4U;
+    }
+
+    if ((did >= UDS_DID_METRICS_BASE) && (did < (UDS_DID_METRICS_BASE + METRICS_COUNT)))
+        return Metrics_Read((uint32_t)did - UDS_DID_METRICS_BASE, out);
+
+    if (did == UDS_DID_SESSION)
+    {
+        out[0] = s_udsSession;
+        return 1U;
+    }
+
+    if (did == UDS_DID_SW_VERSION)
+    {
+        char v[UDS_DID_MAX_LEN + 1U];
+        int  n = FMT_SNPRINTF(v, sizeof(v), "%lu.%lu.%lu",
+                              (unsigned long)((g_imageHeader.version >> 16) & 0xFFU),
+                              (unsigned long)((g_imageHeader.version >> 8) & 0xFFU),
+                              (unsigned long)(g_imageHeader.version & 0xFFU));
+        memcpy(out, v, (size_t)n);
+        return (uint16_t)n;
+    }
+
+    return 0U;
+}
+
+/** DTC record of ReadDTCInformation: 3-byte DTC (code, FTB 0) and status. */
+static uint16_t uds_put_dtc(uint8_t *p, const Dtc_Info_t *info)
+{
+    uds_put16(p, info->code);
+    p[2] = 0x00U;
+    p[3] = (uint8_t)(info->status & UDS_DTC_AVAILABILITY);
+    return 4U;
+}
+
+/** Signal DID of @p sig, NULL without one. */
+static const Uds_SignalDid_t *uds_signal_did(uint32_t sig)
+{
+    for (uint32_t i = 0U; i < UDS_SIGNAL_DID_COUNT; ++i)
+    {
+        if ((uint32_t)s_udsSignalDids[i].sig == sig)
+            return &s_udsSignalDids[i];
+    }
+    return NULL;
+}
+
+/** Snapshot record 02 at rsp[pos]: the signal DIDs as the cache held them
+ *  at the capture. Returns the new offset. */
+static uint16_t uds_put_frame_cache(uint8_t *rsp, uint16_t pos, const FreezeFrame_t *f)
+{
+    uint8_t *p = &rsp[pos];
+
+    p[0] = UDS_DTC_SNAPSHOT_CACHE;
+    p[1] = (uint8_t)UDS_SIGNAL_DID_COUNT;
+    p   += 2;
+
+    for (uint32_t i = 0U; i < UDS_SIGNAL_DID_COUNT; ++i)
+    {
+        const Uds_SignalDid_t     *d = &s_udsSignalDids[i];
+        const CanSigCache_Entry_t *e = &f->cache[d->sig];
+
+        uds_put16(p, d->did);
+        uds_put16(&p[2], (CanSigCache_IsStale(e, f->timeMs) != 0U)
+                             ? UDS_NOT_AVAILABLE : uds_scale(e->value, d->scale, d->offset));
+        p += 4;
+    }
+    return (uint16_t)(pos + 2U + (4U * UDS_SIGNAL_DID_COUNT));
+}
+
+/** Snapshot record 03: UDS_DID_FREEZE_HIST. Returns the new offset. */
+static uint16_t uds_put_frame_history(uint8_t *rsp, uint16_t pos, const FreezeFrame_t *f)
+{
+    uint8_t *p = &rsp[pos];
+    uint16_t n = 7U;
+
+    p[0] = UDS_DTC_SNAPSHOT_HISTORY;
+    p[1] = 1U;
+    uds_put16(&p[2], UDS_DID_FREEZE_HIST);
+    p[4] = f->rows;
+    uds_put16(&p[5], (uint16_t)FREEZE_FRAME_ROW_MS);
+
+    for (uint32_t r = 0U; r < f->rows; ++r)
+    {
+        for (uint32_t c = 0U; c < FREEZE_FRAME_SIGNALS; ++c)
+        {
+            const Uds_SignalDid_t *d = uds_signal_did(FreezeFrame_Signal(c));
+
+            uds_put16(&p[n], (d != NULL) ? uds_scale(f->hist[r][c], d->scale, d->offset)
+                                         : uds_scale(f->hist[r][c], 1.0f, 0.0f));
+            n = (uint16_t)(n + 2U);
+        }
+    }
+    return (uint16_t)(pos + n);
+}
+
+/* -------------------------------------------------------------------------- */
+/* Services                                                                   */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t uds_session_control(const uint8_t *req, uint16_t len, uint8_t *rsp, uint16_t *rspLen)
+{
+    if (len != 2U)
+        return UDS_NRC_LENGTH;
+
+    uint8_t session = req[1] & 0x7FU;
+    if ((session != UDS_SESSION_DEFAULT) && (session != UDS_SESSION_PROGRAMMING) &&
+        (session != UDS_SESSION_EXTENDED))
+    {
+        return UDS_NRC_SUBFUNCTION;
+    }
+
+    if (session != s_udsSession)
+        LOG_INFO(CAN, "UDS session %u -> %u", (unsigned)s_udsSession, (unsigned)session);
+    if (session != UDS_SESSION_EXTENDED)
+    {
+        uds_end_download();
+        uds_periodic_stop_all();
+    }
+    s_udsSession = session;
+
+    /* Reset into the bootloader once the response is out. */
+    if (session == UDS_SESSION_PROGRAMMING)
+        s_udsEnterUpdate = 1U;
+
+    rsp[1] = session;
+    uds_put16(&rsp[2], UDS_P2_MS);
+    uds_put16(&rsp[4], UDS_P2_EXT_MS / 10U);
+    *rspLen = 6U;
+    return 0U;
+}
+
+static uint8_t uds_tester_present(const uint8_t *req, uint16_t len, uint8_t *rsp, uint16_t *rspLen)
+{
+    if (len != 2U)
+        return UDS_NRC_LENGTH;
+    if ((req[1] & 0x7FU) != 0x00U)
+        return UDS_NRC_SUBFUNCTION;
+
+    rsp[1]  = 0x00U;
+    *rspLen = 2U;
+    return 0U;
+}
+
+static uint8_t uds_read_dids(const uint8_t *req, uint16_t len, uint8_t *rsp, uint16_t *rspLen)
+{
+    if ((len < 3U) || (((len - 1U) & 1U) != 0U) || (((len - 1U) / 2U) > UDS_MAX_READ_DIDS))
+        return UDS_NRC_LENGTH;
+
+    uint16_t pos = 1U;
+
+    for (uint16_t i = 1U; i < len; i = (uint16_t)(i + 2U))
+    {
+        uint16_t did = (uint16_t)((req[i] << 8) | req[i + 1U]);
+
+        if (pos + 2U + UDS_DID_MAX_LEN > UDS_RSP_MAX)
+            return UDS_NRC_TOO_LONG;
+
+        uint16_t n = uds_read_did(did, &rsp[pos + 2U]);
+        if (n == 0U)
+            continue;    /* unknown DIDs are left out */
+
+        uds_put16(&rsp[pos], did);
+        pos = (uint16_t)(pos + 2U + n);
+    }
+
+    if (pos == 1U)
+        return UDS_NRC_OUT_OF_RANGE;
+    *rspLen = pos;
+    return 0U;
+}
+
+static uint8_t uds_read_periodic(const uint8_t *req, uint16_t len, uint8_t *rsp, uint16_t *rspLen)
+{
+    if (len < 2U)
+        return UDS_NRC_LENGTH;
+
+    uint8_t mode = req[1];
+    if ((mode < UDS_PERIODIC_SLOW) || (mode > UDS_PERIODIC_STOP))
+        return UDS_NRC_OUT_OF_RANGE;
+    if (((mode != UDS_PERIODIC_STOP) && (len < 3U)) || ((len - 2U) > UDS_SIGNAL_DID_COUNT))
+        return UDS_NRC_LENGTH;
+
+    /* All or nothing: every pDID must exist before any is scheduled. */
+    for (uint16_t i = 2U; i < len; ++i)
+    {
+        if (uds_periodic_index(req[i]) < 0)
+            return UDS_NRC_OUT_OF_RANGE;
+    }
+
+    if ((mode == UDS_PERIODIC_STOP) && (len == 2U))
+        uds_periodic_stop_all();
+    for (uint16_t i = 2U; i < len; ++i)
+        s_udsPeriodicMode[uds_periodic_index(req[i])] = (mode == UDS_PERIODIC_STOP) ? 0U : mode;
+
+    (void)rsp;
+    *rspLen = 1U;
+    return 0U;
+}
+
+static uint8_t uds_write_did(const uint8_t *req, uint16_t len, uint8_t *rsp, uint16_t *rspLen)
+{
+    if (len < 3U)
+        return UDS_NRC_LENGTH;
+
+    uint16_t did = (uint16_t)((req[1] << 8) | req[2]);
+    int32_t  cal = uds_cal_id(did);
+    if (cal < 0)
+        return UDS_NRC_OUT_OF_RANGE;
+    if (len != 7U)
+        return UDS_NRC_LENGTH;
+
+    Cal_Value_t v;
+    v.u = ((uint32_t)req[3] << 24) | ((uint32_t)req[4] << 16) |
+          ((uint32_t)req[5] << 8) | (uint32_t)req[6];
+    if (Cal_Set((Cal_Id_t)cal, v) != HAL_OK)
+        return UDS_NRC_OUT_OF_RANGE;
+    Audit_Record(AUDIT_CMD_CAL_SET, AUDIT_SRC_UDS, (uint32_t)cal, v.u);
+
+    uds_put16(&rsp[1], did);
+    *rspLen = 3U;
+    return 0U;
+}
+
+static uint8_t uds_read_dtc(const uint8_t *req, uint16_t len, uint8_t *rsp, uint16_t *rspLen)
+{
+    if (len < 2U)
+        return UDS_NRC_LENGTH;
+
+    uint8_t  sub   = req[1] & 0x7FU;
+    uint16_t pos   = 3U;
+    uint16_t count = 0U;
+
+    rsp[1] = sub;
+    rsp[2] = UDS_DTC_AVAILABILITY;
+
+    switch (sub)
+    {
+        case UDS_DTC_COUNT_BY_MASK:
+        case UDS_DTC_BY_MASK:
+        case UDS_DTC_SUPPORTED:
+        {
+            uint8_t mask = 0xFFU;
+
+            if (sub != UDS_DTC_SUPPORTED)
+            {
+                if (len != 3U)
+                    return UDS_NRC_LENGTH;
+                mask = req[2];
+            }
+            else if (len != 2U)
+            {
+                return UDS_NRC_LENGTH;
+            }
+
+            for (uint32_t i = 0U; i < DTC_COUNT; ++i)
+            {
+                Dtc_Info_t info;
+
+                (void)Dtc_Get((Dtc_Id_t)i, &info);
+                if ((sub != UDS_DTC_SUPPORTED) && ((info.status & mask & UDS_DTC_AVAILABILITY) == 0U))
+                    continue;
+
+                count++;
+                if (sub != UDS_DTC_COUNT_BY_MASK)
+                    pos = (uint16_t)(pos + uds_put_dtc(&rsp[pos], &info));
+            }
+
+            if (sub == UDS_DTC_COUNT_BY_MASK)
+            {
+                rsp[3] = UDS_DTC_FORMAT_14229;
+                uds_put16(&rsp[4], count);
+                pos = 6U;
+            }
+            break;
+        }
+
+        case UDS_DTC_SNAPSHOT_IDS:
+        {
+            if (len != 2U)
+                return UDS_NRC_LENGTH;
+
+            pos = 2U;
+            for (uint32_t i = 0U; i < DTC_COUNT; ++i)
+            {
+                Dtc_Info_t info;
+
+                (void)Dtc_Get((Dtc_Id_t)i, &info);
+                if (info.occurrences == 0U)
+                    continue;
+
+                uint8_t last = (FreezeFrame_Get(info.code, &s_udsFrame) == HAL_OK)
+                                   ? UDS_DTC_SNAPSHOT_HISTORY : UDS_DTC_SNAPSHOT_RECORD;
+                for (uint8_t r = UDS_DTC_SNAPSHOT_RECORD; r <= last; ++r)
+                {
+                    uds_put16(&rsp[pos], info.code);
+                    rsp[pos + 2U] = 0x00U;
+                    rsp[pos + 3U] = r;
+                    pos = (uint16_t)(pos + 4U);
+                }
+            }
+            break;
+        }
+
+        case UDS_DTC_SNAPSHOT:
+        {
+            if (len != 6U)
+                return UDS_NRC_LENGTH;
+
+            uint16_t code   = (uint16_t)((req[2] << 8) | req[3]);
+            uint8_t  record = req[5];
+            uint32_t i      = 0U;
+            Dtc_Info_t info;
+
+            for (; i < DTC_COUNT; ++i)
+            {
+                (void)Dtc_Get((Dtc_Id_t)i, &info);
+                if (info.code == code)
+                    break;
+            }
+            if ((i >= DTC_COUNT) || (req[4] != 0x00U) ||
+                (((record < UDS_DTC_SNAPSHOT_RECORD) || (record > UDS_DTC_SNAPSHOT_HISTORY)) &&
+                 (record != UDS_DTC_SNAPSHOT_ALL)))
+            {
+                return UDS_NRC_OUT_OF_RANGE;
+            }
+
+            pos = (uint16_t)(2U + uds_put_dtc(&rsp[2], &info));
+            if (info.occurrences == 0U)
+                break;
+
+            /* The DTC entry's freeze frame, as the signal DIDs. */
+            if ((record == UDS_DTC_SNAPSHOT_RECORD) || (record == UDS_DTC_SNAPSHOT_ALL))
+            {
+                rsp[pos++] = UDS_DTC_SNAPSHOT_RECORD;
+                rsp[pos++] = 3U;
+                uds_put16(&rsp[pos], 0x0100U);
+                uds_put16(&rsp[pos + 2U], uds_scale((float)info.speedKph, 100.0f, 0.0f));
+                uds_put16(&rsp[pos + 4U], 0x0101U);
+                uds_put16(&rsp[pos + 6U], info.rpm);
+                uds_put16(&rsp[pos + 8U], 0x0102U);
+                uds_put16(&rsp[pos + 10U], uds_scale((float)info.coolantC, 10.0f, 40.0f));
+                pos = (uint16_t)(pos + 12U);
+            }
+
+            if ((record == UDS_DTC_SNAPSHOT_RECORD) ||
+                (FreezeFrame_Get(code, &s_udsFrame) != HAL_OK))
+            {
+                break;
+            }
+            if ((record == UDS_DTC_SNAPSHOT_CACHE) || (record == UDS_DTC_SNAPSHOT_ALL))
+                pos = uds_put_frame_cache(rsp, pos, &s_udsFrame);
+            if ((record == UDS_DTC_SNAPSHOT_HISTORY) || (record == UDS_DTC_SNAPSHOT_ALL))
+                pos = uds_put_frame_history(rsp, pos, &s_udsFrame);
+            break;
+        }
+
+        default:
+            return UDS_NRC_SUBFUNCTION;
+    }
+
+    *rspLen = pos;
+    return 0U;
+}
+
+static uint8_t uds_clear_dtc(const uint8_t *req, uint16_t len, uint8_t *rsp, uint16_t *rspLen)
+{
+    (void)rsp;
+
+    if (len != 4U)
+        return UDS_NRC_LENGTH;
+    if ((req[1] != 0xFFU) || (req[2] != 0xFFU) || (req[3] != 0xFFU))
+        return UDS_NRC_OUT_OF_RANGE;
+
+    Dtc_Clear();
+    CrashDump_Clear();
+    Audit_Record(AUDIT_CMD_DTC_CLEAR, AUDIT_SRC_UDS, 0U, 0U);
+    LOG_INFO(CAN, "UDS: DTCs and crash record cleared");
+    *rspLen = 1U;
+    return 0U;
+}
+
+static uint8_t uds_request_download(const uint8_t *req, uint16_t len, uint8_t *rsp, uint16_t *rspLen)
+{
+    if (len != UDS_DOWNLOAD_REQ_LEN)
+        return UDS_NRC_LENGTH;
+    if ((req[1] != UDS_DOWNLOAD_FORMAT) || (req[2] != UDS_DOWNLOAD_ALFID) ||
+        (uds_get32(&req[3]) != Stage_Target()))
+    {
+        return UDS_NRC_OUT_OF_RANGE;
+    }
+
+    HAL_StatusTypeDef status = Stage_Begin(uds_get32(&req[7]));
+    if (status == HAL_BUSY)
+        return UDS_NRC_BUSY;    /* the earlier staging is being aborted */
+    if (status != HAL_OK)
+        return UDS_NRC_NOT_ACCEPTED;
+
+    s_udsDownload = 1U;
+    s_udsBlock    = UDS_NO_BLOCK;
+
+    rsp[1] = 0x20U;             /* maxNumberOfBlockLength in 2 bytes */
+    uds_put16(&rsp[2], UDS_TRANSFER_BLOCK_MAX);
+    *rspLen = 4U;
+    return 0U;
+}
+
+static uint8_t uds_transfer_data(const uint8_t *req, uint16_t len, uint8_t *rsp, uint16_t *rspLen)
+{
+    if (len < 2U)
+        return UDS_NRC_LENGTH;
+    if (s_udsDownload == 0U)
+        return UDS_NRC_SEQUENCE;
+
+    uint8_t counter = req[1];
+
+    rsp[1]  = counter;
+    *rspLen = 2U;
+
+    /* The block accepted last, again: its response was lost. */
+    if (counter == s_udsBlock)
+        return 0U;
+    if (counter != (uint8_t)(s_udsBlock + 1U))
+        return UDS_NRC_BLOCK_COUNTER;
+    if (len < 3U)
+        return UDS_NRC_LENGTH;
+
+    /* Busy: the ring is full while the staging erases or programs; the
+     * tester repeats the block. */
+    HAL_StatusTypeDef status = Stage_Write(&req[2], (uint32_t)len - 2U);
+    if (status == HAL_BUSY)
+        return UDS_NRC_BUSY;
+    if (status != HAL_OK)
+    {
+        s_udsDownload = 0U;
+        return UDS_NRC_SUSPENDED;
+    }
+
+    s_udsBlock = counter;
+    return 0U;
+}
+
+static uint8_t uds_transfer_exit(const uint8_t *req, uint16_t len, uint8_t *rsp, uint16_t *rspLen)
+{
+    (void)req;
+    (void)rsp;
+
+    if (len != 1U)
+        return UDS_NRC_LENGTH;
+    if (s_udsDownload == 0U)
+        return UDS_NRC_SEQUENCE;
+
+    /* Busy until the last block is programmed and the image checked. */
+    HAL_StatusTypeDef status = Stage_End();
+    if (status == HAL_BUSY)
+        return UDS_NRC_BUSY;
+
+    s_udsDownload = 0U;
+    if (status != HAL_OK)
+        return UDS_NRC_PROGRAMMING;
+
+    *rspLen = 1U;
+    return 0U;
+}
+
+#if OBD_ENABLE
+/** OBD-II service 01 (obd.h): the same framing as a UDS service. */
+static uint8_t uds_obd_current_data(const uint8_t *req, uint16_t len, uint8_t *rsp, uint16_t *rspLen)
+{
+    if ((len < 2U) || (len > (1U + OBD_MAX_PIDS)))
+        return UDS_NRC_LENGTH;
+
+    uint16_t n = Obd_CurrentData(&req[1], (uint16_t)(len - 1U), &rsp[1]);
+    if (n == 0U)
+        return UDS_NRC_OUT_OF_RANGE;
+
+    *rspLen = (uint16_t)(1U + n);
+    return 0U;
+}
+#endif
+
+static uint8_t uds_routine_control(const uint8_t *req, uint16_t len, uint8_t *rsp, uint16_t *rspLen)
+{
+    if (len < 4U)
+        return UDS_NRC_LENGTH;
+
+    uint8_t  sub = req[1] & 0x7FU;
+    uint16_t rid = (uint16_t)((req[2] << 8) | req[3]);
+
+    if ((sub < UDS_ROUTINE_START) || (sub > UDS_ROUTINE_RESULTS))
+        return UDS_NRC_SUBFUNCTION;
+
+    rsp[1] = sub;
+    uds_put16(&rsp[2], rid);
+    *rspLen = 4U;
+
+    if (rid == UDS_RID_CAL_COMMIT)
+    {
+        if (sub != UDS_ROUTINE_START)
+            return UDS_NRC_SUBFUNCTION;
+        if (len != 4U)
+            return UDS_NRC_LENGTH;
+
+        uint32_t queued = Cal_Commit();
+        Audit_Record(AUDIT_CMD_CAL_COMMIT, AUDIT_SRC_UDS, queued, 0U);
+        rsp[4]  = (uint8_t)((queued > 0xFFU) ? 0xFFU : queued);
+        *rspLen = 5U;
+        return 0U;
+    }
+
+    if (rid == UDS_RID_SCENARIO)
+    {
+        if (sub == UDS_ROUTINE_START)
+        {
+            char name[UDS_SCENARIO_NAME_MAX + 1U];
+            uint16_t n = (uint16_t)(len - 4U);
+
+            if ((n == 0U) || (n > UDS_SCENARIO_NAME_MAX))
+                return UDS_NRC_LENGTH;
+            memcpy(name, &req[4], n);
+            name[n] = '\0';
+
+            if (Scenario_Play(name, 1U) != HAL_OK)
+                return UDS_NRC_OUT_OF_RANGE;
+            Audit_Record(AUDIT_CMD_SCENARIO_PLAY, AUDIT_SRC_UDS, Audit_Text(name), 1U);
+            LOG_INFO(CAN, "UDS: scenario %s started", name);
+            return 0U;
+        }
+
+        if (len != 4U)
+            return UDS_NRC_LENGTH;
+
+        if (sub == UDS_ROUTINE_STOP)
+        {
+            Scenario_Stop();
+            Audit_Record(AUDIT_CMD_SCENARIO_STOP, AUDIT_SRC_UDS, 0U, 0U);
+            return 0U;
+        }
+
+        Scenario_Status_t st;
+        Scenario_GetStatus(&st);
+        rsp[4] = st.playing;
+        uds_put32(&rsp[5], st.timeMs);
+        *rspLen = 9U;
+        return 0U;
+    }
+
+    if (rid == UDS_RID_STAGE_ACTIVATE)
+    {
+        if (sub != UDS_ROUTINE_START)
+            return UDS_NRC_SUBFUNCTION;
+        if (len != 4U)
+            return UDS_NRC_LENGTH;
+        if (Stage_Activate() != HAL_OK)
+            return UDS_NRC_SEQUENCE;
+
+        /* Reset into it once the response is out. */
+        s_udsRestart = 1U;
+        return 0U;
+    }
+
+    if (rid == UDS_RID_AUDIT)
+    {
+        if (sub != UDS_ROUTINE_START)
+            return UDS_NRC_SUBFUNCTION;
+        if (len != UDS_AUDIT_REQ_LEN)
+            return UDS_NRC_LENGTH;
+
+        uint16_t back  = (uint16_t)((req[4] << 8) | req[5]);
+        uint32_t count = req[6];
+
+        if (count == 0U)
+            return UDS_NRC_OUT_OF_RANGE;
+        if (count > UDS_AUDIT_MAX_EVENTS)
+            count = UDS_AUDIT_MAX_EVENTS;
+
+        /* CanRxTask only: kept off its stack. */
+        static Audit_Event_t ev[UDS_AUDIT_MAX_EVENTS];
+        uint32_t             got = Audit_Read(back, count, ev);
+        uint16_t             pos = UDS_AUDIT_RSP_HDR;
+
+        rsp[4] = (uint8_t)got;
+        for (uint32_t i = 0U; i < got; ++i)
+        {
+            uds_put32(&rsp[pos], ev[i].timeMs);
+            uds_put16(&rsp[pos + 4U], ev[i].seq);
+            rsp[pos + 6U] = ev[i].cmd;
+            rsp[pos + 7U] = ev[i].src;
+            uds_put32(&rsp[pos + 8U], ev[i].arg[0]);
+            uds_put32(&rsp[pos + 12U], ev[i].arg[1]);
+            pos = (uint16_t)(pos + 16U);
+        }
+        *rspLen = pos;
+        return 0U;
+    }
+
+#if SIG_HIST_ENABLE
+    if (rid == UDS_RID_SIG_HIST)
+    {
+        if (sub != UDS_ROUTINE_START)
+            return UDS_NRC_SUBFUNCTION;
+        if (len != UDS_HIST_REQ_LEN)
+            return UDS_NRC_LENGTH;
+
+        int32_t  hist  = SigHist_Find(req[4]);
+        uint8_t  tier  = req[5];
+        uint16_t back  = (uint16_t)((req[6] << 8) | req[7]);
+        uint32_t count = req[8];
+
+        if ((hist < 0) || (tier >= (uint8_t)SIG_HIST_TIERS) || (count == 0U))
+            return UDS_NRC_OUT_OF_RANGE;
+        if (count > UDS_HIST_MAX_BUCKETS)
+            count = UDS_HIST_MAX_BUCKETS;
+
+        /* CanRxTask only: kept off its stack. */
+        static SigHist_Bucket_t b[UDS_HIST_MAX_BUCKETS];
+        uint32_t                got;
+
+        if (SigHist_Read((uint32_t)hist, (SigHist_Tier_t)tier, back, count, b, &got) != HAL_OK)
+            return UDS_NRC_BUSY;
+
+        uint16_t pos = UDS_HIST_RSP_HDR;
+
+        rsp[4] = req[4];
+        rsp[5] = tier;
+        rsp[6] = (uint8_t)got;
+        for (uint32_t i = 0U; i < got; ++i)
+        {
+            uds_put16(&rsp[pos], (uint16_t)b[i].min);
+            uds_put16(&rsp[pos + 2U], (uint16_t)b[i].max);
+            uds_put16(&rsp[pos + 4U], (uint16_t)b[i].mean);
+            pos = (uint16_t)(pos + 6U);
+        }
+        *rspLen = pos;
+        return 0U;
+    }
+#endif
+
+    return UDS_NRC_OUT_OF_RANGE;
+}
+
+static const Uds_Service_t s_udsServices[] =
+{
+#if OBD_ENABLE
+    { OBD_SID_CURRENT_DATA,     UDS_IN_ANY,                       0U, uds_obd_current_data },
+#endif
+    { UDS_SID_SESSION_CONTROL,  UDS_IN_ANY,                       1U, uds_session_control  },
+    { UDS_SID_TESTER_PRESENT,   UDS_IN_ANY,                       1U, uds_tester_present   },
+    { UDS_SID_READ_DID,         UDS_IN_ANY,                       0U, uds_read_dids        },
+    { UDS_SID_READ_PERIODIC,    UDS_IN_EXTENDED,                  0U, uds_read_periodic    },
+    { UDS_SID_WRITE_DID,        UDS_IN_EXTENDED,                  0U, uds_write_did        },
+    { UDS_SID_READ_DTC,         UDS_IN_DEFAULT | UDS_IN_EXTENDED, 1U, uds_read_dtc         },
+    { UDS_SID_CLEAR_DTC,        UDS_IN_DEFAULT | UDS_IN_EXTENDED, 0U, uds_clear_dtc        },
+    { UDS_SID_ROUTINE_CONTROL,  UDS_IN_EXTENDED,                  1U, uds_routine_control  },
+    { UDS_SID_REQUEST_DOWNLOAD, UDS_IN_EXTENDED,                  0U, uds_request_download },
+    { UDS_SID_TRANSFER_DATA,    UDS_IN_EXTENDED,                  0U, uds_transfer_data    },
+    { UDS_SID_TRANSFER_EXIT,    UDS_IN_EXTENDED,                  0U, uds_transfer_exit    },
+};
+
+#define UDS_SERVICE_COUNT  (sizeof(s_udsServices) / sizeof(s_udsServices[0]))
+
+/** NRCs a functional request never gets (ISO 14229-1, 7.5). */
+static uint8_t uds_functional_silent(uint8_t nrc)
+{
+    return ((nrc == UDS_NRC_SERVICE) || (nrc == UDS_NRC_SUBFUNCTION) ||
+            (nrc == UDS_NRC_OUT_OF_RANGE) || (nrc == UDS_NRC_SUB_IN_SESSION) ||
+            (nrc == UDS_NRC_SERVICE_IN_SESSION)) ? 1U : 0U;
+}
+
+/** CanRxTask: a complete request PDU on the physical or functional ID. */
+static void uds_on_pdu(uint32_t id, uint8_t *data, uint16_t len, void *ctx)
+{
+    (void)ctx;
+
+    uint32_t now        = HAL_GetTick();
+    uint8_t  functional = (id == UDS_CAN_FUNC_ID) ? 1U : 0U;
+
+    s_udsStats.requests++;
+
+    /* S3 is checked on arrival: a request after the timeout finds the
+     * default session. */
+    if ((s_udsSession != UDS_SESSION_DEFAULT) && ((now - s_udsLastRequest) > UDS_S3_TIMEOUT_MS))
+    {
+        LOG_INFO(CAN, "UDS session %u timed out", (unsigned)s_udsSession);
+        uds_end_download();
+        uds_periodic_stop_all();
+        s_udsSession = UDS_SESSION_DEFAULT;
+        s_udsStats.timeouts++;
+    }
+    s_udsLastRequest = now;
+
+    uint8_t *rsp = (uint8_t *)MemPool_Alloc(UDS_RSP_MAX);
+    if (rsp == NULL)
+    {
+        (void)MemPool_Free(data);
+        s_udsStats.noBuffer++;
+        return;
+    }
+
+    const Uds_Service_t *svc = NULL;
+    uint16_t rspLen = 1U;
+    uint8_t  sid    = data[0];
+    uint8_t  nrc    = UDS_NRC_SERVICE;
+
+    for (uint32_t i = 0U; i < UDS_SERVICE_COUNT; ++i)
+    {
+        if (s_udsServices[i].sid == sid)
+        {
+            svc = &s_udsServices[i];
+            break;
+        }
+    }
+
+    rsp[0] = (uint8_t)(sid + UDS_POSITIVE_OFFSET);
+    if (svc != NULL)
+    {
+        nrc = ((svc->sessions & (1U << s_udsSession)) == 0U)
+                  ? UDS_NRC_SERVICE_IN_SESSION : svc->fn(data, len, rsp, &rspLen);
+    }
+
+    uint8_t silent = ((nrc == 0U) && (svc->subFunction != 0U) && (len >= 2U) &&
+                      ((data[1] & UDS_SPRMIB) != 0U)) ? 1U : 0U;
+    if ((nrc != 0U) && (functional != 0U))
+        silent = uds_functional_silent(nrc);
+    (void)MemPool_Free(data);
+
+    if (nrc != 0U)
+    {
+        s_udsStats.negative++;
+        rsp[0] = UDS_NEGATIVE_RESPONSE;
+        rsp[1] = sid;
+        rsp[2] = nrc;
+        rspLen = 3U;
+    }
+    else
+    {
+        s_udsStats.positive++;
+    }
+
+    if (silent != 0U)
+    {
+        (void)MemPool_Free(rsp);
+        s_udsStats.suppressed++;
+    }
+    else if (IsoTp_SendBlock(&s_udsChannel, rsp, rspLen) != HAL_OK)
+    {
+        s_udsStats.busy++;
+    }
+
+    if (s_udsEnterUpdate != 0U)
+    {
+        s_udsEnterUpdate = 0U;
+        LOG_WARN(CAN, "Programming session requested on 0x%03lX, resetting into bootloader",
+                 (unsigned long)id);
+        BootRequest_EnterUpdate();
+    }
+
+    if (s_udsRestart != 0U)
+    {
+        s_udsRestart = 0U;
+        LOG_WARN(CAN, "Staged image activated on 0x%03lX, resetting into it", (unsigned long)id);
+        BootRequest_Restart();
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* Periodic DIDs (0x2A)                                                       */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * One scheduler send of a rate (CanTxTask): a type 2 frame, pDID and value,
+ * for each signal DID at the rate. A full TX queue cuts it short; the
+ * scheduler retries and the rate goes on from the DID it stopped at.
+ */
+static HAL_StatusTypeDef uds_periodic_send(void *ctx)
+{
+    Uds_PeriodicRate_t *rate = (Uds_PeriodicRate_t *)ctx;
+
+    /* S3 is otherwise only checked by the next request. */
+    if ((HAL_GetTick() - s_udsLastRequest) > UDS_S3_TIMEOUT_MS)
+    {
+        uds_periodic_stop_all();
+        rate->next = 0U;
+        return HAL_OK;
+    }
+
+    for (uint32_t i = rate->next; i < UDS_SIGNAL_DID_COUNT; ++i)
+    {
+        if (s_udsPeriodicMode[i] != rate->mode)
+            continue;
+
+        uint8_t  data[1U + UDS_DID_MAX_LEN];
+        uint16_t n = uds_read_did(s_udsSignalDids[i].did, &data[1]);
+
+        data[0] = (uint8_t)(s_udsSignalDids[i].did & 0x00FFU);
+        if (CAN_IF_Transmit(UDS_CAN_PERIODIC_ID, data, (uint8_t)(1U + n)) != HAL_OK)
+        {
+            rate->next = (uint8_t)i;
+            return HAL_BUSY;
+        }
+        METRIC_INC(UDS_PERIODIC_FRAMES);
+    }
+
+    rate->next = 0U;
+    return HAL_OK;
+}
+
+#define UDS_PERIODIC_FRAME_(rate, label, period, phase)                           \
+    {                                                                             \
+        .name     = "uds 2A " label,                                              \
+        .id       = UDS_CAN_PERIODIC_ID,                                          \
+        .cycleMs  = (period),                                                     \
+        .minGapMs = 0U,                                                           \
+        .offsetMs = (phase),                                                      \
+        .changed  = NULL,                                                         \
+        .send     = uds_periodic_send,                                            \
+        .ctx      = &s_udsRates[rate],                                            \
+    }
+
+static const CanSched_Frame_t s_udsPeriodicFrame[3] =
+{
+    UDS_PERIODIC_FRAME_(0, "slow",   UDS_PERIODIC_SLOW_MS,   7U),
+    UDS_PERIODIC_FRAME_(1, "medium", UDS_PERIODIC_MEDIUM_MS, 5U),
+    UDS_PERIODIC_FRAME_(2, "fast",   UDS_PERIODIC_FAST_MS,   3U),
+};
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void uds_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    static const char *const names[] = { "?", "default", "programming", "extended" };
+
+    CLI_IF_Printf("Session %s, last request %lu ms ago, S3 %u ms\r\n",
+                  names[(s_udsSession <= UDS_SESSION_EXTENDED) ? s_udsSession : 0U],
+                  (unsigned long)(HAL_GetTick() - s_udsLastRequest), (unsigned)UDS_S3_TIMEOUT_MS);
+    CLI_IF_Printf("Requests %lu: positive %lu, negative %lu, unanswered %lu, S3 timeouts %lu\r\n",
+                  (unsigned long)s_udsStats.requests, (unsigned long)s_udsStats.positive,
+                  (unsigned long)s_udsStats.negative, (unsigned long)s_udsStats.suppressed,
+                  (unsigned long)s_udsStats.timeouts);
+    CLI_IF_Printf("Dropped: %lu no buffer, %lu channel busy; ISO-TP %lu RX, %lu TX abandoned\r\n",
+                  (unsigned long)s_udsStats.noBuffer, (unsigned long)s_udsStats.busy,
+                  (unsigned long)s_udsChannel.dropped, (unsigned long)s_udsChannel.txAborted);
+
+    static const char *const rates[] = { "", "slow", "medium", "fast" };
+    uint32_t subscribed = 0U;
+
+    for (uint32_t i = 0U; i < UDS_SIGNAL_DID_COUNT; ++i)
+    {
+        uint8_t mode = s_udsPeriodicMode[i];
+        if ((mode == 0U) || (mode > UDS_PERIODIC_FAST))
+            continue;
+        CLI_IF_Printf("  pDID 0x%02X (DID 0x%04X) %s\r\n", (unsigned)(s_udsSignalDids[i].did & 0x00FFU),
+                      (unsigned)s_udsSignalDids[i].did, rates[mode]);
+        subscribed++;
+    }
+    CLI_IF_Printf("Periodic: %lu DIDs on 0x%03X\r\n", (unsigned long)subscribed,
+                  (unsigned)UDS_CAN_PERIODIC_ID);
+}
+
+static const CliCommand_t s_udsCmds[] =
+{
+    { "uds", "", 0U, uds_cmd_show, "diagnostic session and request counts" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef Uds_Init(void)
+{
+    memset(&s_udsStats, 0, sizeof(s_udsStats));
+    s_udsSession = UDS_SESSION_DEFAULT;
+
+    CLI_IF_REGISTER_TABLE(s_udsCmds);
+#if OBD_ENABLE
+    Obd_Init();
+#endif
+
+    if ((IsoTp_Open(&s_udsChannel) != HAL_OK) ||
+        (CAN_IF_RegisterPduHandler(UDS_CAN_REQ_ID, uds_on_pdu, NULL) != HAL_OK) ||
+        (CAN_IF_RegisterPduHandler(UDS_CAN_FUNC_ID, uds_on_pdu, NULL) != HAL_OK))
+    {
+        return HAL_ERROR;
+    }
+
+    uds_periodic_stop_all();
+    for (uint32_t i = 0U; i < 3U; ++i)
+    {
+        if (CanSched_Add(&s_udsPeriodicFrame[i]) != HAL_OK)
+            return HAL_ERROR;
+    }
+
+    return HAL_OK;
+}
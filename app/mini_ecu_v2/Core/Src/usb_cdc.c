@@ -0,0 +1,1226 @@
+/**
+ * @file    usb_cdc.c
+ * @brief   USB CDC-ACM console: OTG device core in slave mode, EP0 control,
+ *          bulk data endpoints and "usb".
+ */
+
+#include "usb_cdc.h"
+#include "cli_if.h"
+#include <string.h>
+
+#if USB_CDC_ENABLE
+
+/* -------------------------------------------------------------------------- */
+/* Core selection                                                             */
+/* -------------------------------------------------------------------------- */
+
+#if USB_CDC_USE_OTG_FS
+#define UC_OTG          USB_OTG_FS
+#define UC_IRQn         OTG_FS_IRQn
+#define UC_GPIO         GPIOA
+#define UC_PINS         (GPIO_PIN_11 | GPIO_PIN_12)
+#define UC_AF           GPIO_AF10_OTG_FS
+#define UC_CORE_NAME    "OTG_FS, PA11/PA12"
+#define UC_CLK_ENABLE() do { __HAL_RCC_GPIOA_CLK_ENABLE(); __HAL_RCC_USB_OTG_FS_CLK_ENABLE(); } while (0)
+#else
+#define UC_OTG          USB_OTG_HS
+#define UC_IRQn         OTG_HS_IRQn
+#define UC_GPIO         GPIOB
+#define UC_PINS         (GPIO_PIN_14 | GPIO_PIN_15)
+#define UC_AF           GPIO_AF12_OTG_HS_FS
+#define UC_CORE_NAME    "OTG_HS FS PHY, PB14/PB15"
+/* The ULPI clock stays off: with it on in sleep the core never suspends. */
+#define UC_CLK_ENABLE() do { __HAL_RCC_GPIOB_CLK_ENABLE(); __HAL_RCC_USB_OTG_HS_CLK_ENABLE();   \
+                             __HAL_RCC_USB_OTG_HS_ULPI_CLK_SLEEP_DISABLE();                     \
+                             __HAL_RCC_USB_OTG_HS_CLK_SLEEP_ENABLE(); } while (0)
+#endif
+
+#define UC_BASE         ((uint32_t)UC_OTG)
+#define UC_DEV          ((USB_OTG_DeviceTypeDef *)(UC_BASE + USB_OTG_DEVICE_BASE))
+#define UC_IN(ep)       ((USB_OTG_INEndpointTypeDef *)(UC_BASE + USB_OTG_IN_ENDPOINT_BASE + ((ep) * USB_OTG_EP_REG_SIZE)))
+#define UC_OUT(ep)      ((USB_OTG_OUTEndpointTypeDef *)(UC_BASE + USB_OTG_OUT_ENDPOINT_BASE + ((ep) * USB_OTG_EP_REG_SIZE)))
+#define UC_FIFO(ep)     (*(__IO uint32_t *)(UC_BASE + USB_OTG_FIFO_BASE + ((ep) * USB_OTG_FIFO_SIZE)))
+#define UC_PCGCCTL      (*(__IO uint32_t *)(UC_BASE + USB_OTG_PCGCCTL_BASE))
+
+/* -------------------------------------------------------------------------- */
+/* Endpoints and FIFO RAM                                                     */
+/* -------------------------------------------------------------------------- */
+
+#define UC_EP0_SIZE         64U
+#define UC_DATA_SIZE        64U     /* bulk, full speed */
+#define UC_NOTIFY_SIZE      8U
+#define UC_EP_DATA          1U
+#define UC_EP_NOTIFY        2U
+#define UC_EP_COUNT         4U      /* endpoints reset at init (both cores have more) */
+
+/* FIFO RAM in words: the shared RX FIFO, then one TX FIFO per IN endpoint.
+ * Sized for the 320 words of OTG_FS so both cores use the same layout. */
+#define UC_RXFIFO_WORDS     128U
+#define UC_TX0_WORDS        16U
+#define UC_TX1_WORDS        128U
+#define UC_TX2_WORDS        16U
+
+_Static_assert((UC_RXFIFO_WORDS + UC_TX0_WORDS + UC_TX1_WORDS + UC_TX2_WORDS) <= 320U,
+               "USB FIFO layout exceeds the OTG_FS FIFO RAM");
+_Static_assert(((USB_CDC_RX_SIZE & (USB_CDC_RX_SIZE - 1U)) == 0U) &&
+               (USB_CDC_RX_SIZE >= (2U * UC_DATA_SIZE)),
+               "USB_CDC_RX_SIZE must be a power of two of at least two packets");
+
+/* Upper bound of the register polls (reset, flush, endpoint disable). */
+#define UC_SPIN             200000U
+
+/* -------------------------------------------------------------------------- */
+/* Requests                                                                   */
+/* -------------------------------------------------------------------------- */
+
+#define UC_REQ_TYPE_MASK        0x60U
+#define UC_REQ_TYPE_STANDARD    0x00U
+#define UC_REQ_TYPE_CLASS       0x20U
+#define UC_REQ_RECIP_MASK       0x1FU
+#define UC_REQ_RECIP_DEVICE     0x00U
+#define UC_REQ_RECIP_INTERFACE  0x01U
+#define UC_REQ_RECIP_ENDPOINT   0x02U
+
+#define UC_REQ_GET_STATUS       0x00U
+#define UC_REQ_CLEAR_FEATURE    0x01U
+#define UC_REQ_SET_FEATURE      0x03U
+#define UC_REQ_SET_ADDRESS      0x05U
+#define UC_REQ_GET_DESCRIPTOR   0x06U
+#define UC_REQ_GET_CONFIG       0x08U
+#define UC_REQ_SET_CONFIG       0x09U
+#define UC_REQ_GET_INTERFACE    0x0AU
+#define UC_REQ_SET_INTERFACE    0x0BU
+
+#define UC_CDC_SET_LINE_CODING  0x20U
+#define UC_CDC_GET_LINE_CODING  0x21U
+#define UC_CDC_SET_LINE_STATE   0x22U
+#define UC_CDC_SEND_BREAK       0x23U
+
+#define UC_DESC_DEVICE          0x01U
+#define UC_DESC_CONFIG          0x02U
+#define UC_DESC_STRING          0x03U
+
+#define UC_FEATURE_EP_HALT      0x00U
+
+/* GRXSTSP packet status */
+#define UC_RXSTS_OUT_DATA       2U
+#define UC_RXSTS_SETUP_DATA     6U
+
+typedef struct
+{
+    uint8_t  bmRequestType;
+    uint8_t  bRequest;
+    uint16_t wValue;
+    uint16_t wIndex;
+    uint16_t wLength;
+} UcSetup_t;
+
+_Static_assert(sizeof(UcSetup_t) == 8U, "SETUP packet layout");
+
+typedef enum
+{
+    UC_EP0_IDLE = 0,        /* waiting for SETUP */
+    UC_EP0_DATA_IN,
+    UC_EP0_DATA_OUT,
+    UC_EP0_STATUS_IN,
+    UC_EP0_STATUS_OUT
+} UcEp0Stage_t;
+
+/* -------------------------------------------------------------------------- */
+/* Descriptors                                                                */
+/* -------------------------------------------------------------------------- */
+
+#define UC_LE16(v)      (uint8_t)((v) & 0xFFU), (uint8_t)(((v) >> 8) & 0xFFU)
+
+static const uint8_t s_ucDeviceDesc[18] =
+{
+    18U, UC_DESC_DEVICE,
+    UC_LE16(0x0200U),           /* bcdUSB 2.0 */
+    0x02U, 0x00U, 0x00U,        /* CDC, class on the interfaces */
+    UC_EP0_SIZE,
+    UC_LE16(USB_CDC_VID),
+    UC_LE16(USB_CDC_PID),
+    UC_LE16(0x0200U),           /* bcdDevice */
+    1U, 2U, 3U,                 /* manufacturer, product, serial */
+    1U                          /* configurations */
+};
+
+#define UC_CONFIG_LEN   67U
+
+static const uint8_t s_ucConfigDesc[UC_CONFIG_LEN] =
+{
+    9U, UC_DESC_CONFIG, UC_LE16(UC_CONFIG_LEN), 2U, 1U, 0U,
+    0x80U, 50U,                 /* bus powered, 100 mA */
+
+    /* Interface 0: communication class, ACM */
+    9U, 0x04U, 0U, 0U, 1U, 0x02U, 0x02U, 0x01U, 0U,
+    5U, 0x24U, 0x00U, UC_LE16(0x0110U),         /* header, CDC 1.10 */
+    5U, 0x24U, 0x01U, 0x00U, 1U,                /* call management */
+    4U, 0x24U, 0x02U, 0x02U,                    /* ACM: line coding and state */
+    5U, 0x24U, 0x06U, 0U, 1U,                   /* union: 0 controls 1 */
+    7U, 0x05U, 0x80U | UC_EP_NOTIFY, 0x03U, UC_LE16(UC_NOTIFY_SIZE), 16U,
+
+    /* Interface 1: data class */
+    9U, 0x04U, 1U, 0U, 2U, 0x0AU, 0x00U, 0x00U, 0U,
+    7U, 0x05U, UC_EP_DATA, 0x02U, UC_LE16(UC_DATA_SIZE), 0U,
+    7U, 0x05U, 0x80U | UC_EP_DATA, 0x02U, UC_LE16(UC_DATA_SIZE), 0U
+};
+
+static const uint8_t s_ucLangDesc[4] = { 4U, UC_DESC_STRING, UC_LE16(0x0409U) };
+
+#define UC_STR_MAX      24U     /* the serial: 96-bit UID in hex */
+
+static const char *const s_ucStrings[2] = { "Mini ECU", "Mini ECU console" };
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static volatile UsbCdc_State_t s_ucState = USB_CDC_DETACHED;
+static UsbCdc_State_t  s_ucResumeState;    /* state before a suspend */
+static uint8_t         s_ucConfig;
+static uint8_t         s_ucDtr;            /* DTR as last set by the host */
+static volatile uint8_t s_ucOpen;
+static uint32_t        s_ucTrdt;
+
+static uint8_t  s_ucStrDesc[3][2U + (2U * UC_STR_MAX)];
+
+/* Line coding: dwDTERate, bCharFormat, bParityType, bDataBits */
+static uint8_t  s_ucLine[7] = { UC_LE16(0xC200U), UC_LE16(0x0001U), 0U, 0U, 8U };
+
+/* EP0 */
+static UcSetup_t      s_ucSetup;
+static uint32_t       s_ucSetupRaw[2];
+static UcEp0Stage_t   s_ucEp0Stage;
+static const uint8_t *s_ucEp0Data;
+static uint32_t       s_ucEp0Left;
+static uint8_t        s_ucEp0Zlp;
+static uint8_t        s_ucEp0Buf[2];
+static uint8_t        s_ucEp0Out[UC_EP0_SIZE];
+static uint32_t       s_ucEp0OutLen;
+
+/* EP1 IN: one transfer from the caller's buffer */
+static volatile uint8_t s_ucTxBusy;
+static const uint8_t   *s_ucTxData;
+static uint32_t         s_ucTxLeft;        /* not yet in the FIFO */
+static uint32_t         s_ucTxLen;
+static uint8_t          s_ucTxZlp;
+static uint32_t         s_ucTxPkt;         /* PKTCNT at the last SOF */
+static uint32_t         s_ucTxIdle;        /* frames without a packet taken */
+
+/* EP1 OUT ring */
+static uint8_t           s_ucRx[USB_CDC_RX_SIZE];
+static volatile uint32_t s_ucRxHead;
+static volatile uint32_t s_ucRxTail;
+static volatile uint8_t  s_ucRxArmed;
+
+static UsbCdc_Stats_t s_ucStats;
+
+/* -------------------------------------------------------------------------- */
+/* Weak callbacks                                                             */
+/* -------------------------------------------------------------------------- */
+
+__weak void UsbCdc_TxCpltCallback(void)
+{
+}
+
+__weak void UsbCdc_RxCallback(void)
+{
+}
+
+__weak void UsbCdc_LineStateCallback(uint8_t open)
+{
+    (void)open;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Core helpers                                                               */
+/* -------------------------------------------------------------------------- */
+
+/** TRDT (USB turnaround, in PHY clocks) for the AHB clock, 0 below 14.2 MHz. */
+static uint32_t uc_trdt(uint32_t hclk)
+{
+    static const struct { uint32_t minHz; uint8_t trdt; } table[] =
+    {
+        { 32000000U, 0x6U }, { 27700000U, 0x7U }, { 24000000U, 0x8U },
+        { 21800000U, 0x9U }, { 20000000U, 0xAU }, { 18500000U, 0xBU },
+        { 17200000U, 0xCU }, { 16000000U, 0xDU }, { 15000000U, 0xEU },
+        { 14200000U, 0xFU },
+    };
+
+    for (uint32_t i = 0U; i < (uint32_t)(sizeof(table) / sizeof(table[0])); ++i)
+    {
+        if (hclk >= table[i].minHz)
+            return table[i].trdt;
+    }
+    return 0U;
+}
+
+/** PLLSAI: 2 MHz in, 192 MHz VCO, P = 48 MHz; CK48 from it. */
+static HAL_StatusTypeDef uc_clock_48(void)
+{
+    /* Left alone when something else already runs it. */
+    if ((RCC->CR & RCC_CR_PLLSAIRDY) == 0U)
+    {
+        uint32_t src = ((RCC->PLLCFGR & RCC_PLLCFGR_PLLSRC) != 0U) ? HSE_VALUE : HSI_VALUE;
+
+        RCC->PLLSAICFGR = ((src / 2000000U) << RCC_PLLSAICFGR_PLLSAIM_Pos) |
+                          (96U << RCC_PLLSAICFGR_PLLSAIN_Pos) |
+                          (1U << RCC_PLLSAICFGR_PLLSAIP_Pos) |      /* /4 */
+                          (4U << RCC_PLLSAICFGR_PLLSAIQ_Pos);
+        RCC->CR |= RCC_CR_PLLSAION;
+
+        uint32_t start = HAL_GetTick();
+        while ((RCC->CR & RCC_CR_PLLSAIRDY) == 0U)
+        {
+            if ((HAL_GetTick() - start) > 2U)
+                return HAL_ERROR;
+        }
+    }
+    RCC->DCKCFGR2 |= RCC_DCKCFGR2_CK48MSEL;
+    return HAL_OK;
+}
+
+static HAL_StatusTypeDef uc_core_reset(void)
+{
+    uint32_t n = 0U;
+
+    while ((UC_OTG->GRSTCTL & USB_OTG_GRSTCTL_AHBIDL) == 0U)
+    {
+        if (++n > UC_SPIN)
+            return HAL_ERROR;
+    }
+    UC_OTG->GRSTCTL |= USB_OTG_GRSTCTL_CSRST;
+    while ((UC_OTG->GRSTCTL & USB_OTG_GRSTCTL_CSRST) != 0U)
+    {
+        if (++n > UC_SPIN)
+            return HAL_ERROR;
+    }
+    return HAL_OK;
+}
+
+/** Flush TX FIFO @p num (0x10 = all). */
+static void uc_flush_tx(uint32_t num)
+{
+    UC_OTG->GRSTCTL = USB_OTG_GRSTCTL_TXFFLSH | (num << USB_OTG_GRSTCTL_TXFNUM_Pos);
+    for (uint32_t n = 0U; ((UC_OTG->GRSTCTL & USB_OTG_GRSTCTL_TXFFLSH) != 0U) && (n < UC_SPIN); ++n)
+    {
+    }
+}
+
+static void uc_flush_rx(void)
+{
+    UC_OTG->GRSTCTL = USB_OTG_GRSTCTL_RXFFLSH;
+    for (uint32_t n = 0U; ((UC_OTG->GRSTCTL & USB_OTG_GRSTCTL_RXFFLSH) != 0U) && (n < UC_SPIN); ++n)
+    {
+    }
+}
+
+/** Copy @p len bytes into the TX FIFO of @p ep, a word at a time. */
+static void uc_fifo_write(uint32_t ep, const uint8_t *src, uint32_t len)
+{
+    for (uint32_t i = 0U; i < len; i += 4U)
+    {
+        uint32_t word = 0U;
+        uint32_t n    = ((len - i) < 4U) ? (len - i) : 4U;
+
+        memcpy(&word, &src[i], n);
+        UC_FIFO(ep) = word;
+    }
+}
+
+/** Pop @p len bytes from the RX FIFO; bytes past @p size are dropped. */
+static void uc_fifo_read(uint8_t *dst, uint32_t size, uint32_t len)
+{
+    for (uint32_t i = 0U; i < len; i += 4U)
+    {
+        uint32_t word = UC_FIFO(0U);
+
+        for (uint32_t b = 0U; (b < 4U) && ((i + b) < len); ++b)
+        {
+            if ((i + b) < size)
+                dst[i + b] = (uint8_t)(word >> (8U * b));
+        }
+    }
+}
+
+/** Stop a running IN endpoint and flush what it had in its FIFO. */
+static void uc_in_disable(uint32_t ep)
+{
+    if ((UC_IN(ep)->DIEPCTL & USB_OTG_DIEPCTL_EPENA) != 0U)
+    {
+        UC_IN(ep)->DIEPCTL |= USB_OTG_DIEPCTL_SNAK;
+        for (uint32_t n = 0U; ((UC_IN(ep)->DIEPINT & USB_OTG_DIEPINT_INEPNE) == 0U) && (n < UC_SPIN); ++n)
+        {
+        }
+        UC_IN(ep)->DIEPCTL |= USB_OTG_DIEPCTL_EPDIS | USB_OTG_DIEPCTL_SNAK;
+        for (uint32_t n = 0U; ((UC_IN(ep)->DIEPINT & USB_OTG_DIEPINT_EPDISD) == 0U) && (n < UC_SPIN); ++n)
+        {
+        }
+    }
+    UC_IN(ep)->DIEPINT = USB_OTG_DIEPINT_INEPNE | USB_OTG_DIEPINT_EPDISD | USB_OTG_DIEPINT_XFRC;
+    uc_flush_tx(ep);
+}
+
+/* -------------------------------------------------------------------------- */
+/* EP1 IN (ISR context or under PRIMASK)                                      */
+/* -------------------------------------------------------------------------- */
+
+/** Program EP1 IN for @p len bytes (0 = a zero-length packet). */
+static void uc_tx_xfer(uint32_t len)
+{
+    uint32_t pkts = (len == 0U) ? 1U : ((len + UC_DATA_SIZE - 1U) / UC_DATA_SIZE);
+
+    UC_IN(UC_EP_DATA)->DIEPTSIZ = (pkts << USB_OTG_DIEPTSIZ_PKTCNT_Pos) | len;
+    UC_IN(UC_EP_DATA)->DIEPCTL |= USB_OTG_DIEPCTL_CNAK | USB_OTG_DIEPCTL_EPENA;
+    if (len > 0U)
+        UC_DEV->DIEPEMPMSK |= 1UL << UC_EP_DATA;
+    s_ucTxPkt  = pkts;
+    s_ucTxIdle = 0U;
+}
+
+static void uc_tx_done(void)
+{
+    s_ucTxBusy = 0U;
+    UC_DEV->DIEPEMPMSK &= ~(1UL << UC_EP_DATA);
+    UC_OTG->GINTMSK    &= ~USB_OTG_GINTMSK_SOFM;
+    UsbCdc_TxCpltCallback();
+}
+
+static void uc_tx_abort(void)
+{
+    if (s_ucTxBusy == 0U)
+        return;
+    uc_in_disable(UC_EP_DATA);
+    uc_tx_done();
+}
+
+/** TX FIFO empty: add whole packets while they fit. */
+static void uc_tx_fill(void)
+{
+    while (s_ucTxLeft > 0U)
+    {
+        uint32_t n = (s_ucTxLeft < UC_DATA_SIZE) ? s_ucTxLeft : UC_DATA_SIZE;
+
+        if ((UC_IN(UC_EP_DATA)->DTXFSTS & USB_OTG_DTXFSTS_INEPTFSAV) < ((n + 3U) / 4U))
+            return;                         /* the next FIFO-empty interrupt */
+        uc_fifo_write(UC_EP_DATA, s_ucTxData, n);
+        s_ucTxData += n;
+        s_ucTxLeft -= n;
+    }
+    UC_DEV->DIEPEMPMSK &= ~(1UL << UC_EP_DATA);
+}
+
+static void uc_tx_complete(void)
+{
+    if (s_ucTxBusy == 0U)
+        return;
+    if (s_ucTxZlp != 0U)
+    {
+        s_ucTxZlp = 0U;
+        uc_tx_xfer(0U);
+        return;
+    }
+    s_ucStats.txBytes += s_ucTxLen;
+    s_ucStats.txTransfers++;
+    uc_tx_done();
+}
+
+/** Start of frame, enabled while a transfer runs: the timeout. */
+static void uc_sof(void)
+{
+    if (s_ucTxBusy == 0U)
+        return;
+
+    uint32_t pkt = (UC_IN(UC_EP_DATA)->DIEPTSIZ & USB_OTG_DIEPTSIZ_PKTCNT) >> USB_OTG_DIEPTSIZ_PKTCNT_Pos;
+    if (pkt != s_ucTxPkt)
+    {
+        s_ucTxPkt  = pkt;
+        s_ucTxIdle = 0U;
+    }
+    else if (++s_ucTxIdle >= USB_CDC_TX_TIMEOUT_MS)
+    {
+        s_ucStats.txTimeouts++;
+        uc_tx_abort();
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* EP1 OUT                                                                    */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t uc_rx_room(void)
+{
+    return USB_CDC_RX_SIZE - (s_ucRxHead - s_ucRxTail);
+}
+
+/** Accept one more packet; the caller checked the ring has room for it. */
+static void uc_rx_arm(void)
+{
+    UC_OUT(UC_EP_DATA)->DOEPTSIZ = (1UL << USB_OTG_DOEPTSIZ_PKTCNT_Pos) | UC_DATA_SIZE;
+    UC_OUT(UC_EP_DATA)->DOEPCTL |= USB_OTG_DOEPCTL_CNAK | USB_OTG_DOEPCTL_EPENA;
+    s_ucRxArmed = 1U;
+}
+
+static void uc_rx_store(uint32_t len)
+{
+    uint32_t head = s_ucRxHead;
+
+    for (uint32_t i = 0U; i < len; i += 4U)
+    {
+        uint32_t word = UC_FIFO(0U);
+
+        for (uint32_t b = 0U; (b < 4U) && ((i + b) < len); ++b)
+        {
+            if ((head - s_ucRxTail) < USB_CDC_RX_SIZE)
+            {
+                s_ucRx[head & (USB_CDC_RX_SIZE - 1U)] = (uint8_t)(word >> (8U * b));
+                head++;
+            }
+        }
+    }
+    s_ucStats.rxBytes += head - s_ucRxHead;
+    s_ucRxHead = head;
+}
+
+static void uc_rx_complete(void)
+{
+    s_ucRxArmed = 0U;
+    if (uc_rx_room() >= UC_DATA_SIZE)
+        uc_rx_arm();
+    else
+        s_ucStats.rxFull++;                 /* NAK until UsbCdc_Read() */
+    UsbCdc_RxCallback();
+}
+
+/* -------------------------------------------------------------------------- */
+/* Port state                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/** Open when configured with DTR set; closing ends a running transfer. */
+static void uc_set_open(uint8_t dtr)
+{
+    uint8_t was  = s_ucOpen;
+    uint8_t open = ((dtr != 0U) && (s_ucState == USB_CDC_CONFIGURED)) ? 1U : 0U;
+
+    s_ucOpen = open;
+    if (open == 0U)
+        uc_tx_abort();
+    if (open != was)
+        UsbCdc_LineStateCallback(open);
+}
+
+static void uc_configure(uint8_t cfg)
+{
+    if ((cfg != 0U) && (s_ucConfig == 0U))
+    {
+        UC_IN(UC_EP_DATA)->DIEPCTL = USB_OTG_DIEPCTL_USBAEP | USB_OTG_DIEPCTL_SD0PID_SEVNFRM |
+                                     (2UL << USB_OTG_DIEPCTL_EPTYP_Pos) |
+                                     (UC_EP_DATA << USB_OTG_DIEPCTL_TXFNUM_Pos) | UC_DATA_SIZE;
+        UC_IN(UC_EP_NOTIFY)->DIEPCTL = USB_OTG_DIEPCTL_USBAEP | USB_OTG_DIEPCTL_SD0PID_SEVNFRM |
+                                       (3UL << USB_OTG_DIEPCTL_EPTYP_Pos) |
+                                       (UC_EP_NOTIFY << USB_OTG_DIEPCTL_TXFNUM_Pos) | UC_NOTIFY_SIZE;
+        UC_OUT(UC_EP_DATA)->DOEPCTL = USB_OTG_DOEPCTL_USBAEP | USB_OTG_DOEPCTL_SD0PID_SEVNFRM |
+                                      (2UL << USB_OTG_DOEPCTL_EPTYP_Pos) | UC_DATA_SIZE;
+        s_ucState = USB_CDC_CONFIGURED;
+        if (uc_rx_room() >= UC_DATA_SIZE)
+            uc_rx_arm();
+    }
+    else if ((cfg == 0U) && (s_ucConfig != 0U))
+    {
+        s_ucState = USB_CDC_ADDRESSED;
+        uc_set_open(0U);
+        UC_IN(UC_EP_DATA)->DIEPCTL    &= ~USB_OTG_DIEPCTL_USBAEP;
+        UC_IN(UC_EP_NOTIFY)->DIEPCTL  &= ~USB_OTG_DIEPCTL_USBAEP;
+        UC_OUT(UC_EP_DATA)->DOEPCTL   &= ~USB_OTG_DOEPCTL_USBAEP;
+        s_ucRxArmed = 0U;
+    }
+    s_ucConfig = cfg;
+}
+
+/* -------------------------------------------------------------------------- */
+/* EP0 control transfers                                                      */
+/* -------------------------------------------------------------------------- */
+
+/** EP0 OUT: SETUP packets always, plus one data packet when @p enable. */
+static void uc_ep0_out(uint8_t enable)
+{
+    UC_OUT(0U)->DOEPTSIZ = (3UL << USB_OTG_DOEPTSIZ_STUPCNT_Pos) |
+                           (1UL << USB_OTG_DOEPTSIZ_PKTCNT_Pos) | UC_EP0_SIZE;
+    if (enable != 0U)
+        UC_OUT(0U)->DOEPCTL |= USB_OTG_DOEPCTL_CNAK | USB_OTG_DOEPCTL_EPENA;
+}
+
+static void uc_ep0_in_next(void)
+{
+    uint32_t n = (s_ucEp0Left < UC_EP0_SIZE) ? s_ucEp0Left : UC_EP0_SIZE;
+
+    UC_IN(0U)->DIEPTSIZ = (1UL << USB_OTG_DIEPTSIZ_PKTCNT_Pos) | n;
+    UC_IN(0U)->DIEPCTL |= USB_OTG_DIEPCTL_CNAK | USB_OTG_DIEPCTL_EPENA;
+    uc_fifo_write(0U, s_ucEp0Data, n);      /* one packet fits the EP0 FIFO */
+    s_ucEp0Data += n;
+    s_ucEp0Left -= n;
+}
+
+/** Data stage IN of at most @p wLength bytes, then status OUT. */
+static void uc_ep0_send(const uint8_t *data, uint32_t len, uint16_t wLength)
+{
+    if (len > wLength)
+        len = wLength;
+    s_ucEp0Data  = data;
+    s_ucEp0Left  = len;
+    s_ucEp0Zlp   = ((len != 0U) && (len < wLength) && ((len % UC_EP0_SIZE) == 0U)) ? 1U : 0U;
+    s_ucEp0Stage = UC_EP0_DATA_IN;
+    uc_ep0_in_next();
+}
+
+static void uc_ep0_status_in(void)
+{
+    s_ucEp0Stage = UC_EP0_STATUS_IN;
+    UC_IN(0U)->DIEPTSIZ = 1UL << USB_OTG_DIEPTSIZ_PKTCNT_Pos;
+    UC_IN(0U)->DIEPCTL |= USB_OTG_DIEPCTL_CNAK | USB_OTG_DIEPCTL_EPENA;
+}
+
+/** Request not supported: STALL both directions until the next SETUP. */
+static void uc_ep0_stall(void)
+{
+    s_ucEp0Stage = UC_EP0_IDLE;
+    UC_IN(0U)->DIEPCTL  |= USB_OTG_DIEPCTL_STALL;
+    UC_OUT(0U)->DOEPCTL |= USB_OTG_DOEPCTL_STALL;
+    uc_ep0_out(0U);
+}
+
+/** Endpoint register of a wIndex endpoint address, NULL for none of ours. */
+static __IO uint32_t *uc_ep_ctl(uint16_t wIndex)
+{
+    uint32_t ep = wIndex & 0x7FU;
+
+    if ((wIndex & 0x80U) != 0U)
+        return ((ep == UC_EP_DATA) || (ep == UC_EP_NOTIFY)) ? &UC_IN(ep)->DIEPCTL : NULL;
+    return (ep == UC_EP_DATA) ? &UC_OUT(ep)->DOEPCTL : NULL;
+}
+
+static void uc_get_descriptor(void)
+{
+    uint8_t type  = (uint8_t)(s_ucSetup.wValue >> 8);
+    uint8_t index = (uint8_t)(s_ucSetup.wValue & 0xFFU);
+
+    if (type == UC_DESC_DEVICE)
+        uc_ep0_send(s_ucDeviceDesc, sizeof(s_ucDeviceDesc), s_ucSetup.wLength);
+    else if (type == UC_DESC_CONFIG)
+        uc_ep0_send(s_ucConfigDesc, sizeof(s_ucConfigDesc), s_ucSetup.wLength);
+    else if ((type == UC_DESC_STRING) && (index == 0U))
+        uc_ep0_send(s_ucLangDesc, sizeof(s_ucLangDesc), s_ucSetup.wLength);
+    else if ((type == UC_DESC_STRING) && (index <= 3U))
+        uc_ep0_send(s_ucStrDesc[index - 1U], s_ucStrDesc[index - 1U][0], s_ucSetup.wLength);
+    else
+        uc_ep0_stall();                     /* device qualifier too: FS only */
+}
+
+static void uc_std_request(void)
+{
+    uint8_t       recip = s_ucSetup.bmRequestType & UC_REQ_RECIP_MASK;
+    __IO uint32_t *ctl  = uc_ep_ctl(s_ucSetup.wIndex);
+
+    switch (s_ucSetup.bRequest)
+    {
+    case UC_REQ_GET_STATUS:
+        s_ucEp0Buf[0] = 0U;
+        s_ucEp0Buf[1] = 0U;
+        if ((recip == UC_REQ_RECIP_ENDPOINT) && (ctl != NULL) &&
+            ((*ctl & USB_OTG_DIEPCTL_STALL) != 0U))
+        {
+            s_ucEp0Buf[0] = 1U;
+        }
+        uc_ep0_send(s_ucEp0Buf, 2U, s_ucSetup.wLength);
+        break;
+
+    case UC_REQ_CLEAR_FEATURE:
+    case UC_REQ_SET_FEATURE:
+        if ((recip == UC_REQ_RECIP_ENDPOINT) && (s_ucSetup.wValue == UC_FEATURE_EP_HALT))
+        {
+            if (ctl == NULL)
+            {
+                uc_ep0_stall();
+                break;
+            }
+            if (s_ucSetup.bRequest == UC_REQ_SET_FEATURE)
+                *ctl |= USB_OTG_DIEPCTL_STALL;
+            else
+                *ctl = (*ctl & ~USB_OTG_DIEPCTL_STALL) | USB_OTG_DIEPCTL_SD0PID_SEVNFRM;
+        }
+        uc_ep0_status_in();                 /* remote wakeup: accepted, not used */
+        break;
+
+    case UC_REQ_SET_ADDRESS:
+        /* The core answers the status stage at the old address. */
+        UC_DEV->DCFG = (UC_DEV->DCFG & ~USB_OTG_DCFG_DAD) |
+                       (((uint32_t)s_ucSetup.wValue & 0x7FU) << USB_OTG_DCFG_DAD_Pos);
+        s_ucState = (s_ucSetup.wValue != 0U) ? USB_CDC_ADDRESSED : USB_CDC_DEFAULT;
+        uc_ep0_status_in();
+        break;
+
+    case UC_REQ_GET_DESCRIPTOR:
+        uc_get_descriptor();
+        break;
+
+    case UC_REQ_GET_CONFIG:
+        s_ucEp0Buf[0] = s_ucConfig;
+        uc_ep0_send(s_ucEp0Buf, 1U, s_ucSetup.wLength);
+        break;
+
+    case UC_REQ_SET_CONFIG:
+        if ((s_ucSetup.wValue > 1U) || (s_ucState == USB_CDC_DEFAULT))
+        {
+            uc_ep0_stall();
+            break;
+        }
+        uc_configure((uint8_t)s_ucSetup.wValue);
+        uc_ep0_status_in();
+        break;
+
+    case UC_REQ_GET_INTERFACE:
+        s_ucEp0Buf[0] = 0U;
+        uc_ep0_send(s_ucEp0Buf, 1U, s_ucSetup.wLength);
+        break;
+
+    case UC_REQ_SET_INTERFACE:
+        if (s_ucSetup.wValue != 0U)
+            uc_ep0_stall();
+        else
+            uc_ep0_status_in();
+        break;
+
+    default:
+        uc_ep0_stall();
+        break;
+    }
+}
+
+static void uc_cdc_request(void)
+{
+    switch (s_ucSetup.bRequest)
+    {
+    case UC_CDC_SET_LINE_CODING:
+        s_ucEp0Stage  = UC_EP0_DATA_OUT;
+        s_ucEp0OutLen = 0U;
+        uc_ep0_out(1U);
+        break;
+
+    case UC_CDC_GET_LINE_CODING:
+        uc_ep0_send(s_ucLine, sizeof(s_ucLine), s_ucSetup.wLength);
+        break;
+
+    case UC_CDC_SET_LINE_STATE:
+        s_ucDtr = (uint8_t)(s_ucSetup.wValue & 0x01U);
+        uc_ep0_status_in();
+        uc_set_open(s_ucDtr);
+        break;
+
+    case UC_CDC_SEND_BREAK:
+        uc_ep0_status_in();
+        break;
+
+    default:
+        uc_ep0_stall();
+        break;
+    }
+}
+
+static void uc_setup(void)
+{
+    memcpy(&s_ucSetup, s_ucSetupRaw, sizeof(s_ucSetup));
+    s_ucEp0Stage = UC_EP0_IDLE;
+    uc_ep0_out(0U);                         /* SETUP count back to 3 */
+
+    uint8_t type  = s_ucSetup.bmRequestType & UC_REQ_TYPE_MASK;
+    uint8_t recip = s_ucSetup.bmRequestType & UC_REQ_RECIP_MASK;
+
+    if (type == UC_REQ_TYPE_STANDARD)
+        uc_std_request();
+    else if ((type == UC_REQ_TYPE_CLASS) && (recip == UC_REQ_RECIP_INTERFACE))
+        uc_cdc_request();
+    else
+        uc_ep0_stall();
+}
+
+static void uc_ep0_in_done(void)
+{
+    if (s_ucEp0Stage == UC_EP0_DATA_IN)
+    {
+        if (s_ucEp0Left > 0U)
+        {
+            uc_ep0_in_next();
+        }
+        else if (s_ucEp0Zlp != 0U)
+        {
+            s_ucEp0Zlp = 0U;
+            uc_ep0_in_next();               /* short transfer ends with a ZLP */
+        }
+        else
+        {
+            s_ucEp0Stage = UC_EP0_STATUS_OUT;
+            uc_ep0_out(1U);
+        }
+    }
+    else if (s_ucEp0Stage == UC_EP0_STATUS_IN)
+    {
+        s_ucEp0Stage = UC_EP0_IDLE;
+    }
+}
+
+static void uc_ep0_out_done(void)
+{
+    if (s_ucEp0Stage == UC_EP0_DATA_OUT)
+    {
+        if ((s_ucSetup.bRequest == UC_CDC_SET_LINE_CODING) && (s_ucEp0OutLen >= sizeof(s_ucLine)))
+            memcpy(s_ucLine, s_ucEp0Out, sizeof(s_ucLine));
+        uc_ep0_status_in();
+    }
+    else if (s_ucEp0Stage == UC_EP0_STATUS_OUT)
+    {
+        s_ucEp0Stage = UC_EP0_IDLE;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* Bus events (ISR context)                                                   */
+/* -------------------------------------------------------------------------- */
+
+static void uc_bus_reset(void)
+{
+    s_ucDtr = 0U;
+    uc_set_open(0U);
+
+    UC_DEV->DCTL &= ~USB_OTG_DCTL_RWUSIG;
+    uc_flush_tx(0x10U);
+    for (uint32_t ep = 0U; ep < UC_EP_COUNT; ++ep)
+    {
+        UC_IN(ep)->DIEPINT  = 0xFB7FU;
+        UC_IN(ep)->DIEPCTL &= ~USB_OTG_DIEPCTL_STALL;
+        UC_OUT(ep)->DOEPINT = 0xFB7FU;
+        UC_OUT(ep)->DOEPCTL &= ~USB_OTG_DOEPCTL_STALL;
+        UC_OUT(ep)->DOEPCTL |= USB_OTG_DOEPCTL_SNAK;
+        if (ep != 0U)
+        {
+            UC_IN(ep)->DIEPCTL  &= ~USB_OTG_DIEPCTL_USBAEP;
+            UC_OUT(ep)->DOEPCTL &= ~USB_OTG_DOEPCTL_USBAEP;
+        }
+    }
+
+    UC_DEV->DAINT      = 0xFFFFFFFFU;
+    UC_DEV->DAINTMSK   = (1UL << 0) | (1UL << UC_EP_DATA) | (1UL << 16) | (1UL << (16U + UC_EP_DATA));
+    UC_DEV->DOEPMSK    = USB_OTG_DOEPMSK_STUPM | USB_OTG_DOEPMSK_XFRCM;
+    UC_DEV->DIEPMSK    = USB_OTG_DIEPMSK_XFRCM | USB_OTG_DIEPMSK_TOM;
+    UC_DEV->DIEPEMPMSK = 0U;
+    UC_DEV->DCFG      &= ~USB_OTG_DCFG_DAD;
+    uc_ep0_out(0U);
+
+    s_ucState    = USB_CDC_DEFAULT;
+    s_ucConfig   = 0U;
+    s_ucEp0Stage = UC_EP0_IDLE;
+    s_ucRxArmed  = 0U;
+    s_ucStats.resets++;
+}
+
+static void uc_enum_done(void)
+{
+    /* Again here: the clock profile may have changed since init. */
+    s_ucTrdt = uc_trdt(HAL_RCC_GetHCLKFreq());
+    if (s_ucTrdt == 0U)
+        s_ucTrdt = 0xFU;
+    UC_OTG->GUSBCFG = (UC_OTG->GUSBCFG & ~USB_OTG_GUSBCFG_TRDT) |
+                      (s_ucTrdt << USB_OTG_GUSBCFG_TRDT_Pos);
+    UC_IN(0U)->DIEPCTL &= ~USB_OTG_DIEPCTL_MPSIZ;   /* 64 bytes */
+    UC_DEV->DCTL |= USB_OTG_DCTL_CGINAK;
+}
+
+static void uc_rx_level(void)
+{
+    uint32_t sts    = UC_OTG->GRXSTSP;
+    uint32_t ep     = sts & USB_OTG_GRXSTSP_EPNUM;
+    uint32_t len    = (sts & USB_OTG_GRXSTSP_BCNT) >> USB_OTG_GRXSTSP_BCNT_Pos;
+    uint32_t pktsts = (sts & USB_OTG_GRXSTSP_PKTSTS) >> USB_OTG_GRXSTSP_PKTSTS_Pos;
+
+    if (pktsts == UC_RXSTS_SETUP_DATA)
+    {
+        uc_fifo_read((uint8_t *)s_ucSetupRaw, sizeof(s_ucSetupRaw), len);
+    }
+    else if ((pktsts == UC_RXSTS_OUT_DATA) && (len > 0U))
+    {
+        if (ep == UC_EP_DATA)
+        {
+            uc_rx_store(len);
+        }
+        else
+        {
+            uc_fifo_read(&s_ucEp0Out[s_ucEp0OutLen], sizeof(s_ucEp0Out) - s_ucEp0OutLen, len);
+            s_ucEp0OutLen += (len < (sizeof(s_ucEp0Out) - s_ucEp0OutLen)) ? len : (sizeof(s_ucEp0Out) - s_ucEp0OutLen);
+        }
+    }
+}
+
+static void uc_out_ep(void)
+{
+    uint32_t daint = (UC_DEV->DAINT & UC_DEV->DAINTMSK) >> 16;
+
+    if ((daint & 1U) != 0U)
+    {
+        uint32_t ints = UC_OUT(0U)->DOEPINT;
+
+        UC_OUT(0U)->DOEPINT = ints;
+        if ((ints & USB_OTG_DOEPINT_XFRC) != 0U)
+            uc_ep0_out_done();
+        if ((ints & USB_OTG_DOEPINT_STUP) != 0U)
+            uc_setup();
+    }
+    if ((daint & (1UL << UC_EP_DATA)) != 0U)
+    {
+        uint32_t ints = UC_OUT(UC_EP_DATA)->DOEPINT;
+
+        UC_OUT(UC_EP_DATA)->DOEPINT = ints;
+        if ((ints & USB_OTG_DOEPINT_XFRC) != 0U)
+            uc_rx_complete();
+    }
+}
+
+static void uc_in_ep(void)
+{
+    uint32_t daint = UC_DEV->DAINT & UC_DEV->DAINTMSK & 0xFFFFU;
+
+    if ((daint & 1U) != 0U)
+    {
+        uint32_t ints = UC_IN(0U)->DIEPINT & (USB_OTG_DIEPINT_XFRC | USB_OTG_DIEPINT_TOC);
+
+        UC_IN(0U)->DIEPINT = ints;
+        if ((ints & USB_OTG_DIEPINT_XFRC) != 0U)
+            uc_ep0_in_done();
+    }
+    if ((daint & (1UL << UC_EP_DATA)) != 0U)
+    {
+        uint32_t ints = UC_IN(UC_EP_DATA)->DIEPINT;
+
+        UC_IN(UC_EP_DATA)->DIEPINT = ints & (USB_OTG_DIEPINT_XFRC | USB_OTG_DIEPINT_TOC);
+        if ((ints & USB_OTG_DIEPINT_XFRC) != 0U)
+            uc_tx_complete();
+        /* TXFE is a level: it counts only while its DIEPEMPMSK bit is set. */
+        if (((ints & USB_OTG_DIEPINT_TXFE) != 0U) &&
+            ((UC_DEV->DIEPEMPMSK & (1UL << UC_EP_DATA)) != 0U))
+        {
+            uc_tx_fill();
+        }
+    }
+}
+
+static void uc_suspend(void)
+{
+    if ((s_ucState == USB_CDC_DETACHED) || (s_ucState == USB_CDC_SUSPENDED))
+        return;
+    s_ucResumeState = s_ucState;
+    s_ucState       = USB_CDC_SUSPENDED;
+    s_ucStats.suspends++;
+    uc_set_open(0U);                        /* also what an unplugged cable looks like */
+}
+
+static void uc_resume(void)
+{
+    if (s_ucState != USB_CDC_SUSPENDED)
+        return;
+    s_ucState = s_ucResumeState;
+    uc_set_open(s_ucDtr);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static const char *const s_ucStateNames[] =
+{
+    "detached", "default", "addressed", "configured", "suspended"
+};
+
+static void uc_cmd_usb(int argc, char *argv[])
+{
+    static const char parity[] = "NOEMS";
+    UsbCdc_Stats_t st;
+
+    (void)argc;
+    (void)argv;
+
+    UsbCdc_GetStats(&st);
+    CLI_IF_Printf("USB CDC (" UC_CORE_NAME "): %s, port %s\r\n",
+                  s_ucStateNames[st.state], (st.open != 0U) ? "open" : "closed");
+    CLI_IF_Printf("Host line coding: %lu %u%c%s (not used)\r\n",
+                  (unsigned long)st.lineBaud, (unsigned)st.lineBits,
+                  (st.lineParity < 5U) ? parity[st.lineParity] : '?',
+                  (st.lineStop == 0U) ? "1" : ((st.lineStop == 1U) ? "1.5" : "2"));
+    CLI_IF_Printf("IN  %lu B in %lu transfers, %lu timeouts, %lu B dropped while closed\r\n",
+                  (unsigned long)st.txBytes, (unsigned long)st.txTransfers,
+                  (unsigned long)st.txTimeouts, (unsigned long)st.txDropped);
+    CLI_IF_Printf("OUT %lu B, ring full %lu times; %lu bus resets, %lu suspends\r\n",
+                  (unsigned long)st.rxBytes, (unsigned long)st.rxFull,
+                  (unsigned long)st.resets, (unsigned long)st.suspends);
+}
+
+static const CliCommand_t s_ucCmds[] =
+{
+    { "usb", "", 0U, uc_cmd_usb, "USB CDC console state and counters" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/** String descriptors; the serial is the 96-bit device UID in hex. */
+static void uc_strings(void)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    char     serial[UC_STR_MAX + 1U];
+    uint32_t uid[3] = { READ_REG(*((uint32_t *)UID_BASE)),
+                        READ_REG(*((uint32_t *)(UID_BASE + 4U))),
+                        READ_REG(*((uint32_t *)(UID_BASE + 8U))) };
+
+    for (uint32_t i = 0U; i < UC_STR_MAX; ++i)
+        serial[i] = hex[(uid[i / 8U] >> (28U - (4U * (i % 8U)))) & 0xFU];
+    serial[UC_STR_MAX] = '\0';
+
+    for (uint32_t s = 0U; s < 3U; ++s)
+    {
+        const char *text = (s < 2U) ? s_ucStrings[s] : serial;
+        uint32_t    n    = (uint32_t)strlen(text);
+
+        if (n > UC_STR_MAX)
+            n = UC_STR_MAX;
+        s_ucStrDesc[s][0] = (uint8_t)(2U + (2U * n));
+        s_ucStrDesc[s][1] = UC_DESC_STRING;
+        for (uint32_t i = 0U; i < n; ++i)
+        {
+            s_ucStrDesc[s][2U + (2U * i)] = (uint8_t)text[i];
+            s_ucStrDesc[s][3U + (2U * i)] = 0U;
+        }
+    }
+}
+
+HAL_StatusTypeDef UsbCdc_Init(void)
+{
+    GPIO_InitTypeDef gpio = {0};
+
+    s_ucTrdt = uc_trdt(HAL_RCC_GetHCLKFreq());
+    if ((s_ucTrdt == 0U) || (uc_clock_48() != HAL_OK))
+        return HAL_ERROR;
+    uc_strings();
+
+    UC_CLK_ENABLE();
+    gpio.Pin       = UC_PINS;
+    gpio.Mode      = GPIO_MODE_AF_PP;
+    gpio.Pull      = GPIO_NOPULL;
+    gpio.Speed     = GPIO_SPEED_FREQ_VERY_HIGH;
+    gpio.Alternate = UC_AF;
+    HAL_GPIO_Init(UC_GPIO, &gpio);
+
+    /* Core: embedded FS PHY, reset, device mode without VBUS sensing. */
+    UC_OTG->GAHBCFG &= ~USB_OTG_GAHBCFG_GINT;
+    UC_OTG->GUSBCFG |= USB_OTG_GUSBCFG_PHYSEL;
+    if (uc_core_reset() != HAL_OK)
+        return HAL_ERROR;
+    UC_OTG->GCCFG    = USB_OTG_GCCFG_PWRDWN;
+    UC_OTG->GOTGCTL |= USB_OTG_GOTGCTL_BVALOEN | USB_OTG_GOTGCTL_BVALOVAL;
+    UC_OTG->GUSBCFG  = (UC_OTG->GUSBCFG & ~(USB_OTG_GUSBCFG_FHMOD | USB_OTG_GUSBCFG_TRDT)) |
+                       USB_OTG_GUSBCFG_FDMOD | (s_ucTrdt << USB_OTG_GUSBCFG_TRDT_Pos);
+    HAL_Delay(50U);                         /* forced mode takes up to 25 ms */
+
+    UC_PCGCCTL    = 0U;
+    UC_DEV->DCTL |= USB_OTG_DCTL_SDIS;      /* off the bus while setting up */
+    UC_DEV->DCFG  = (UC_DEV->DCFG & ~USB_OTG_DCFG_DSPD) | (3UL << USB_OTG_DCFG_DSPD_Pos);
+
+    UC_OTG->GRXFSIZ             = UC_RXFIFO_WORDS;
+    UC_OTG->DIEPTXF0_HNPTXFSIZ  = (UC_TX0_WORDS << 16) | UC_RXFIFO_WORDS;
+    UC_OTG->DIEPTXF[0]          = (UC_TX1_WORDS << 16) | (UC_RXFIFO_WORDS + UC_TX0_WORDS);
+    UC_OTG->DIEPTXF[1]          = (UC_TX2_WORDS << 16) | (UC_RXFIFO_WORDS + UC_TX0_WORDS + UC_TX1_WORDS);
+    uc_flush_tx(0x10U);
+    uc_flush_rx();
+
+    UC_DEV->DIEPMSK  = 0U;
+    UC_DEV->DOEPMSK  = 0U;
+    UC_DEV->DAINTMSK = 0U;
+    UC_DEV->DAINT    = 0xFFFFFFFFU;
+    for (uint32_t ep = 0U; ep < UC_EP_COUNT; ++ep)
+    {
+        UC_IN(ep)->DIEPCTL   = ((UC_IN(ep)->DIEPCTL & USB_OTG_DIEPCTL_EPENA) != 0U)
+                               ? (USB_OTG_DIEPCTL_EPDIS | USB_OTG_DIEPCTL_SNAK) : 0U;
+        UC_IN(ep)->DIEPTSIZ  = 0U;
+        UC_IN(ep)->DIEPINT   = 0xFB7FU;
+        UC_OUT(ep)->DOEPCTL  = ((UC_OUT(ep)->DOEPCTL & USB_OTG_DOEPCTL_EPENA) != 0U)
+                               ? (USB_OTG_DOEPCTL_EPDIS | USB_OTG_DOEPCTL_SNAK) : 0U;
+        UC_OUT(ep)->DOEPTSIZ = 0U;
+        UC_OUT(ep)->DOEPINT  = 0xFB7FU;
+    }
+
+    /* SOF is added only while an IN transfer runs (the timeout). */
+    UC_OTG->GINTSTS  = 0xFFFFFFFFU;
+    UC_OTG->GINTMSK  = USB_OTG_GINTMSK_USBRST | USB_OTG_GINTMSK_ENUMDNEM |
+                       USB_OTG_GINTMSK_RXFLVLM | USB_OTG_GINTMSK_IEPINT |
+                       USB_OTG_GINTMSK_OEPINT | USB_OTG_GINTMSK_USBSUSPM |
+                       USB_OTG_GINTMSK_WUIM;
+    UC_OTG->GAHBCFG |= USB_OTG_GAHBCFG_GINT;
+
+    HAL_NVIC_SetPriority(UC_IRQn, USB_CDC_IRQ_PRIO, 0U);
+    HAL_NVIC_EnableIRQ(UC_IRQn);
+
+    CLI_IF_REGISTER_TABLE(s_ucCmds);
+
+    UC_DEV->DCTL &= ~USB_OTG_DCTL_SDIS;     /* pull-up on D+: the host resets us */
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef UsbCdc_Transmit(const uint8_t *data, uint32_t len)
+{
+    HAL_StatusTypeDef status = HAL_OK;
+
+    if ((len == 0U) || (len > (USB_OTG_DIEPTSIZ_PKTCNT_Msk >> USB_OTG_DIEPTSIZ_PKTCNT_Pos) * UC_DATA_SIZE))
+        return HAL_ERROR;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s_ucOpen == 0U)
+    {
+        status = HAL_ERROR;
+    }
+    else if (s_ucTxBusy != 0U)
+    {
+        status = HAL_BUSY;
+    }
+    else
+    {
+        s_ucTxBusy = 1U;
+        s_ucTxData = data;
+        s_ucTxLeft = len;
+        s_ucTxLen  = len;
+        s_ucTxZlp  = ((len % UC_DATA_SIZE) == 0U) ? 1U : 0U;
+        uc_tx_xfer(len);
+        UC_OTG->GINTMSK |= USB_OTG_GINTMSK_SOFM;
+    }
+    __set_PRIMASK(primask);
+
+    return status;
+}
+
+void UsbCdc_Write(const uint8_t *data, uint32_t len, uint32_t timeoutMs)
+{
+    if (UsbCdc_Transmit(data, len) != HAL_OK)
+    {
+        s_ucStats.txDropped += len;
+        return;
+    }
+
+    uint32_t start = HAL_GetTick();
+    while ((s_ucTxBusy != 0U) && ((HAL_GetTick() - start) < timeoutMs))
+    {
+    }
+
+    /* @p data is the caller's again on return. */
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s_ucTxBusy != 0U)
+    {
+        s_ucStats.txTimeouts++;
+        uc_tx_abort();
+    }
+    __set_PRIMASK(primask);
+}
+
+uint32_t UsbCdc_Read(uint8_t *dst, uint32_t size)
+{
+    uint32_t tail = s_ucRxTail;
+    uint32_t n    = s_ucRxHead - tail;
+
+    if (n > size)
+        n = size;
+    for (uint32_t i = 0U; i < n; ++i)
+        dst[i] = s_ucRx[(tail + i) & (USB_CDC_RX_SIZE - 1U)];
+    s_ucRxTail = tail + n;
+
+    /* The endpoint was left NAKing for lack of room. */
+    if ((s_ucRxArmed == 0U) && (uc_rx_room() >= UC_DATA_SIZE))
+    {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        if ((s_ucRxArmed == 0U) && (s_ucState == USB_CDC_CONFIGURED))
+            uc_rx_arm();
+        __set_PRIMASK(primask);
+    }
+    return n;
+}
+
+void UsbCdc_ClockChanged(void)
+{
+    uint32_t trdt = uc_trdt(HAL_RCC_GetHCLKFreq());
+
+    /* Not before UsbCdc_Init(); the turnaround is read per transaction. */
+    if ((s_ucTrdt == 0U) || (trdt == 0U))
+        return;
+    s_ucTrdt = trdt;
+    UC_OTG->GUSBCFG = (UC_OTG->GUSBCFG & ~USB_OTG_GUSBCFG_TRDT) |
+                      (s_ucTrdt << USB_OTG_GUSBCFG_TRDT_Pos);
+}
+
+uint8_t UsbCdc_IsOpen(void)
+{
+    return s_ucOpen;
+}
+
+void UsbCdc_GetStats(UsbCdc_Stats_t *st)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *st = s_ucStats;
+    __set_PRIMASK(primask);
+
+    st->state      = s_ucState;
+    st->open       = s_ucOpen;
+    st->lineBaud   = (uint32_t)s_ucLine[0] | ((uint32_t)s_ucLine[1] << 8) |
+                     ((uint32_t)s_ucLine[2] << 16) | ((uint32_t)s_ucLine[3] << 24);
+    st->lineStop   = s_ucLine[4];
+    st->lineParity = s_ucLine[5];
+    st->lineBits   = s_ucLine[6];
+}
+
+void UsbCdc_IRQHandler(void)
+{
+    uint32_t sts = UC_OTG->GINTSTS & UC_OTG->GINTMSK;
+
+    if ((sts & USB_OTG_GINTSTS_USBRST) != 0U)
+    {
+        UC_OTG->GINTSTS = USB_OTG_GINTSTS_USBRST;
+        uc_bus_reset();
+    }
+    if ((sts & USB_OTG_GINTSTS_ENUMDNE) != 0U)
+    {
+        UC_OTG->GINTSTS = USB_OTG_GINTSTS_ENUMDNE;
+        uc_enum_done();
+    }
+    /* RXFLVL clears itself as the FIFO is popped. */
+    while ((UC_OTG->GINTSTS & USB_OTG_GINTSTS_RXFLVL) != 0U)
+        uc_rx_level();
+    if ((sts & USB_OTG_GINTSTS_OEPINT) != 0U)
+        uc_out_ep();
+    if ((sts & USB_OTG_GINTSTS_IEPINT) != 0U)
+        uc_in_ep();
+    if ((sts & USB_OTG_GINTSTS_SOF) != 0U)
+    {
+        UC_OTG->GINTSTS = USB_OTG_GINTSTS_SOF;
+        uc_sof();
+    }
+    if ((sts & USB_OTG_GINTSTS_USBSUSP) != 0U)
+    {
+        UC_OTG->GINTSTS = USB_OTG_GINTSTS_USBSUSP;
+        uc_suspend();
+    }
+    if ((sts & USB_OTG_GINTSTS_WKUINT) != 0U)
+    {
+        UC_OTG->GINTSTS = USB_OTG_GINTSTS_WKUINT;
+        uc_resume();
+    }
+}
+
+#endif /* USB_CDC_ENABLE */
@@ -20,6 +20,83 @@
  */
 
 #include "vehicle.h"
+#include "cal.h"
+#include "perf.h"
+#include "powertrain.h"
+#include "main.h"
+#include <math.h>
+
+/* -------------------------------------------------------------
+ * Step coefficients
+ *
+ * The calibration gains are given per VEHICLE_REF_STEP_S. As rate
+ * constants k = -ln(kept per reference step) / VEHICLE_REF_STEP_S, a step
+ * of dt keeps exp(-k * dt) of the error in place of the gain, so N steps
+ * of dt / N follow the same curve as one step of dt. The exponentials are
+ * worked out once per step size and calibration: the cache holds the last
+ * two (the control loop and a 100 ms caller such as the scenario or the
+ * benchmarks), copied under PRIMASK since any task may update a model.
+ * ------------------------------------------------------------- */
+#define VEH_COOL_C_PER_S   0.1f    /* idle cooling, 0.01 C per 0.1 s */
+#define VEH_WARM_GAIN      0.05f   /* warm-up convergence per reference step */
+#define VEH_AMBIENT_C      20.0f   /* the fan cools toward this */
+
+typedef struct
+{
+    float dt_s;                    /* key: step and the gains in cal.h */
+    float decay;
+    float lag;
+    float speed_keep;              /* exp(-k_decay * dt) */
+    float rpm_gain;                /* 1 - exp(-k_lag * dt) */
+    float warm_gain;               /* 1 - exp(-k_warm * dt) */
+} VehicleCoeffs_t;
+
+static VehicleCoeffs_t s_vehCoeffs[2];
+static uint8_t         s_vehCoeffsNext = 0U;
+
+/** exp(-k * dt) for k = -ln(keep) / VEHICLE_REF_STEP_S. */
+static float vehicle_keep(float keep, float dt_s)
+{
+    if (keep <= 0.0f) return 0.0f;
+    if (keep >= 1.0f) return 1.0f;
+
+    float k = -logf(keep) / VEHICLE_REF_STEP_S;
+    return expf(-k * dt_s);
+}
+
+static void vehicle_coeffs(float dt_s, VehicleCoeffs_t *c)
+{
+    const float decay = CAL_F(VEH_DECAY);
+    const float lag   = CAL_F(VEH_RPM_LAG);
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint32_t i = 0U; i < 2U; ++i)
+    {
+        if ((s_vehCoeffs[i].dt_s == dt_s) && (s_vehCoeffs[i].decay == decay) &&
+            (s_vehCoeffs[i].lag == lag))
+        {
+            *c = s_vehCoeffs[i];
+            __set_PRIMASK(primask);
+            return;
+        }
+    }
+    __set_PRIMASK(primask);
+
+    /* New step size or gains: outside the critical section. */
+    c->dt_s       = dt_s;
+    c->decay      = decay;
+    c->lag        = lag;
+    c->speed_keep = vehicle_keep(decay, dt_s);
+    c->rpm_gain   = 1.0f - vehicle_keep(1.0f - lag, dt_s);
+    c->warm_gain  = 1.0f - vehicle_keep(1.0f - VEH_WARM_GAIN, dt_s);
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    s_vehCoeffs[s_vehCoeffsNext] = *c;
+    s_vehCoeffsNext ^= 1U;
+    __set_PRIMASK(primask);
+}
 
 /* -------------------------------------------------------------
  * Helper: float clamp
@@ -42,62 +119,114 @@ void Vehicle_Init(VehicleState_t *vs)
     vs->speed_kph        = 0.0f;
     vs->engine_rpm       = 800;
     vs->coolant_temp_c   = 30.0f;  /* Cold engine start */
+    vs->throttle         = 0.0f;
+    vs->gear             = 1U;
+    vs->fan              = 0.0f;
 }
 
 /* -------------------------------------------------------------
  * Physics Model Explanation
  * -------------------------------------------------------------
  *
+ * The tuning constants are calibration parameters (cal.h, "cal"); the
+ * defaults are given below, per 0.1 s (VEHICLE_REF_STEP_S). A step of
+ * dt applies each gain as exp(-k * dt) (see "Step coefficients"), so the
+ * model behaves the same at any update rate.
+ *
  * SPEED:
- *   - Natural decay proportional to current speed (rolling resistance).
+ *   - The throttle drives it up, with VEHICLE_POWERTRAIN by the wheel
+ *     torque of the engine in the engaged gear (powertrain.h):
+ *         speed += Powertrain_AccelKph(gear, rpm, throttle) * dt
+ *     otherwise by VEHICLE_PEDAL_KPH_PER_S * throttle * dt.
+ *   - Natural decay proportional to current speed (rolling resistance):
+ *         speed *= 0.98 (VEH_DECAY) per 0.1 s
  *   - Hard-clamped between 0 and 200 km/h.
  *
  * RPM:
- *   - Follows speed using a simple linear map:
- *         target_rpm = 800 + (speed * 50)
- *     (50 RPM per km/h gives 5800 RPM at 100 km/h, realistic enough)
+ *   - Follows speed through the gear the shift schedule picks:
+ *         target_rpm = Powertrain_EngineRpm(gear, speed), at least 800
+ *     or, without VEHICLE_POWERTRAIN, a simple linear map:
+ *         target_rpm = 800 + (speed * 50) (VEH_RPM_PER_KPH)
  *
  *   - First-order lag to simulate engine inertia:
- *         rpm += (target_rpm - rpm) * 0.3
+ *         rpm += (target_rpm - rpm) * 0.3 (VEH_RPM_LAG) per 0.1 s
  *
  *   - Clamped between 600 and 6000 rpm.
  *
  * COOLANT TEMP:
- *   - Gradually rises toward ~90°C at rate proportional to engine load.
- *   - Slowly cools if the engine is below operating RPM and stationary.
+ *   - Gradually rises toward ~90°C (VEH_WARMUP_C), 5 % of the way per
+ *     0.1 s, while the engine is loaded.
+ *   - Slowly cools (0.1 °C/s) if the engine is below operating RPM.
+ *   - VEHICLE_FAN: the loaded engine heats toward VEH_WARMUP_C +
+ *     VEHICLE_FAN_SOAK_C instead, and the radiator fan removes
+ *         fan * VEHICLE_FAN_RATE * (coolant - 20 °C) per second,
+ *     so the coolant only stays at the operating temperature while the
+ *     ECU runs the fan (fan_ctrl.h), about half duty under load.
  -------------------------------------------------------------- */
 void Vehicle_Update(VehicleState_t *vs, float dt_s)
 {
     if (!vs || dt_s <= 0.0f) return;
 
-    /* --- 1. SPEED DECAY ------------------------------------ */
-    /* Very simple model: coast down by 2% per update. */
-    vs->speed_kph *= 0.98f;
+    PERF_BEGIN(VEH_UPDATE);
+
+    VehicleCoeffs_t c;
+    vehicle_coeffs(dt_s, &c);
+
+    /* --- 1. THROTTLE AND SPEED DECAY ----------------------- */
+    if (vs->throttle > 0.0f)
+    {
+#if VEHICLE_POWERTRAIN
+        vs->speed_kph += Powertrain_AccelKph(vs->gear, (float)vs->engine_rpm, vs->throttle) * dt_s;
+#else
+        vs->speed_kph += VEHICLE_PEDAL_KPH_PER_S * vs->throttle * dt_s;
+#endif
+    }
+
+    /* Very simple model: coast down by 2% per 0.1 s. */
+    vs->speed_kph *= c.speed_keep;
     vs->speed_kph = clamp_f(vs->speed_kph, 0.0f, 200.0f);
 
     /* --- 2. RPM FOLLOWS SPEED ------------------------------ */
-    float target_rpm = 800.0f + (vs->speed_kph * 50.0f);
+#if VEHICLE_POWERTRAIN
+    vs->gear = Powertrain_Shift(vs->gear, vs->speed_kph, vs->throttle);
+    float target_rpm = Powertrain_EngineRpm(vs->gear, vs->speed_kph);
+#else
+    float target_rpm = 800.0f + (vs->speed_kph * CAL_F(VEH_RPM_PER_KPH));
+#endif
 
-    /* Engine inertia modeled as 30% convergence per update. */
-    vs->engine_rpm += (uint16_t)((target_rpm - vs->engine_rpm) * 0.3f);
+    /* Engine inertia modeled as 30% convergence per 0.1 s.
+     * Done in float and clamped before narrowing: the delta is negative
+     * whenever RPM has to fall, and must not be cast to uint16_t alone. */
+    float rpm = (float)vs->engine_rpm;
+    rpm += (target_rpm - rpm) * c.rpm_gain;
 
-    vs->engine_rpm = (uint16_t)clamp_f(vs->engine_rpm, 600.0f, 6000.0f);
+    vs->engine_rpm = (uint16_t)clamp_f(rpm, 600.0f, 6000.0f);
 
     /* --- 3. COOLANT TEMPERATURE ---------------------------- */
-    float warmup_target = 90.0f;  /* Typical operating temp */
+    float warmup_target = CAL_F(VEH_WARMUP_C);  /* Typical operating temp */
+#if VEHICLE_FAN
+    warmup_target += VEHICLE_FAN_SOAK_C;
+#endif
 
     if (vs->engine_rpm > 1000)
     {
         /* Warm up faster when engine is loaded */
-        vs->coolant_temp_c += (warmup_target - vs->coolant_temp_c) * 0.05f;
+        vs->coolant_temp_c += (warmup_target - vs->coolant_temp_c) * c.warm_gain;
     }
     else
     {
         /* Slight cooling when idling */
-        vs->coolant_temp_c -= 0.01f;
+        vs->coolant_temp_c -= VEH_COOL_C_PER_S * dt_s;
     }
 
+#if VEHICLE_FAN
+    /* Forced air through the radiator; fan * rate * dt stays far below 1. */
+    vs->coolant_temp_c -= vs->fan * VEHICLE_FAN_RATE * (vs->coolant_temp_c - VEH_AMBIENT_C) * dt_s;
+#endif
+
     vs->coolant_temp_c = clamp_f(vs->coolant_temp_c, 20.0f, 110.0f);
+
+    PERF_END(VEH_UPDATE);
 }
 
 void Vehicle_SetTargetSpeed(VehicleState_t *vs, float speed_kph)
@@ -107,6 +236,20 @@ void Vehicle_SetTargetSpeed(VehicleState_t *vs, float speed_kph)
     vs->speed_kph = clamp_f(speed_kph, 0.0f, 200.0f);
 }
 
+void Vehicle_SetThrottle(VehicleState_t *vs, float throttle)
+{
+    if (!vs) return;
+
+    vs->throttle = clamp_f(throttle, 0.0f, 1.0f);
+}
+
+void Vehicle_SetFan(VehicleState_t *vs, float duty)
+{
+    if (!vs) return;
+
+    vs->fan = clamp_f(duty, 0.0f, 1.0f);
+}
+
 void Vehicle_Force(VehicleState_t *vs, float speed, uint16_t rpm, float temp_c)
 {
     if (!vs) return;
@@ -0,0 +1,161 @@
+/**
+ * @file    vehicle_fleet.c
+ * @brief   Structure-of-arrays vehicle fleet model.
+ *
+ * The constants and step order are those of Vehicle_Update(); see the
+ * "Physics Model Explanation" in vehicle.c. The fleet has no radiator fan:
+ * its coolant is that of VEHICLE_FAN = 0.
+ */
+
+#include "vehicle_fleet.h"
+#include "can_if.h"
+
+#if VEHICLE_FLEET_USE_DSP
+#include "arm_math.h"
+#endif
+
+/* -------------------------------------------------------------
+ * Model constants (shared with vehicle.c)
+ * ------------------------------------------------------------- */
+#define VF_SPEED_DECAY     0.98f
+#define VF_SPEED_MAX       200.0f
+#define VF_RPM_BASE        800.0f
+#define VF_RPM_PER_KPH     50.0f
+#define VF_RPM_GAIN        0.3f
+#define VF_RPM_MIN         600.0f
+#define VF_RPM_MAX         6000.0f
+#define VF_TEMP_WARM       90.0f
+#define VF_TEMP_GAIN       0.05f
+#define VF_IDLE_COOL       0.01f
+#define VF_TEMP_MIN        20.0f
+#define VF_TEMP_MAX        110.0f
+
+static float clamp_f(float v, float min, float max)
+{
+    if (v < min) return min;
+    if (v > max) return max;
+    return v;
+}
+
+void VehicleFleet_Init(VehicleFleet_t *fleet, uint32_t count)
+{
+    if (!fleet) return;
+
+    fleet->count  = (count > VEHICLE_FLEET_MAX) ? VEHICLE_FLEET_MAX : count;
+    fleet->txNext = 0U;
+
+    for (uint32_t i = 0U; i < fleet->count; i++)
+    {
+        fleet->speed_kph[i]      = 0.0f;
+        fleet->rpm[i]            = 800.0f;
+        fleet->coolant_temp_c[i] = 30.0f;
+    }
+}
+
+void VehicleFleet_Update(VehicleFleet_t *fleet, float dt_s)
+{
+    if (!fleet || dt_s <= 0.0f) return;
+
+    const uint32_t n = fleet->count;
+    float *speed = fleet->speed_kph;
+    float *rpm   = fleet->rpm;
+    float *temp  = fleet->coolant_temp_c;
+
+#if VEHICLE_FLEET_USE_DSP
+    float *tmp = fleet->scratch;
+
+    /* --- 1. SPEED DECAY ------------------------------------ */
+    arm_scale_f32(speed, VF_SPEED_DECAY, speed, n);
+    arm_clip_f32(speed, speed, 0.0f, VF_SPEED_MAX, n);
+
+    /* --- 2. RPM FOLLOWS SPEED ------------------------------ */
+    arm_scale_f32(speed, VF_RPM_PER_KPH, tmp, n);
+    arm_offset_f32(tmp, VF_RPM_BASE, tmp, n);             /* target   */
+    arm_sub_f32(tmp, rpm, tmp, n);                        /* - rpm    */
+    arm_scale_f32(tmp, VF_RPM_GAIN, tmp, n);              /* * gain   */
+    arm_add_f32(rpm, tmp, rpm, n);
+    arm_clip_f32(rpm, rpm, VF_RPM_MIN, VF_RPM_MAX, n);
+
+    /* --- 3. COOLANT TEMPERATURE (data-dependent branch) ---- */
+    for (uint32_t i = 0U; i < n; i++)
+    {
+        float t = temp[i];
+        t = (rpm[i] > 1000.0f) ? (t + ((VF_TEMP_WARM - t) * VF_TEMP_GAIN))
+                               : (t - VF_IDLE_COOL);
+        temp[i] = clamp_f(t, VF_TEMP_MIN, VF_TEMP_MAX);
+    }
+#else
+    for (uint32_t i = 0U; i < n; i++)
+    {
+        /* --- 1. SPEED DECAY -------------------------------- */
+        float s = clamp_f(speed[i] * VF_SPEED_DECAY, 0.0f, VF_SPEED_MAX);
+
+        /* --- 2. RPM FOLLOWS SPEED -------------------------- */
+        float target = VF_RPM_BASE + (s * VF_RPM_PER_KPH);
+        float r      = clamp_f(rpm[i] + ((target - rpm[i]) * VF_RPM_GAIN),
+                               VF_RPM_MIN, VF_RPM_MAX);
+
+        /* --- 3. COOLANT TEMPERATURE ------------------------ */
+        float t = temp[i];
+        t = (r > 1000.0f) ? (t + ((VF_TEMP_WARM - t) * VF_TEMP_GAIN))
+                          : (t - VF_IDLE_COOL);
+
+        speed[i] = s;
+        rpm[i]   = r;
+        temp[i]  = clamp_f(t, VF_TEMP_MIN, VF_TEMP_MAX);
+    }
+#endif
+}
+
+void VehicleFleet_SetTargetSpeed(VehicleFleet_t *fleet, uint32_t idx, float speed_kph)
+{
+    if (!fleet || idx >= fleet->count) return;
+
+    fleet->speed_kph[idx] = clamp_f(speed_kph, 0.0f, VF_SPEED_MAX);
+}
+
+void VehicleFleet_AddSpeed(VehicleFleet_t *fleet, float delta_kph)
+{
+    if (!fleet) return;
+
+#if VEHICLE_FLEET_USE_DSP
+    arm_offset_f32(fleet->speed_kph, delta_kph, fleet->speed_kph, fleet->count);
+    arm_clip_f32(fleet->speed_kph, fleet->speed_kph, 0.0f, VF_SPEED_MAX, fleet->count);
+#else
+    for (uint32_t i = 0U; i < fleet->count; i++)
+    {
+        fleet->speed_kph[i] = clamp_f(fleet->speed_kph[i] + delta_kph, 0.0f, VF_SPEED_MAX);
+    }
+#endif
+}
+
+void VehicleFleet_Get(const VehicleFleet_t *fleet, uint32_t idx, VehicleState_t *out)
+{
+    if (!fleet || !out || idx >= fleet->count) return;
+
+    out->speed_kph      = fleet->speed_kph[idx];
+    out->engine_rpm     = (uint16_t)fleet->rpm[idx];
+    out->coolant_temp_c = fleet->coolant_temp_c[idx];
+}
+
+uint32_t VehicleFleet_SendTelemetry(VehicleFleet_t *fleet)
+{
+    if (!fleet || fleet->count == 0U) return 0U;
+
+    uint32_t sent = 0U;
+
+    while (sent < fleet->count)
+    {
+        uint32_t       idx = fleet->txNext;
+        VehicleState_t vs;
+
+        VehicleFleet_Get(fleet, idx, &vs);
+        if (CAN_IF_SendTelemetryId(VEHICLE_FLEET_ID_BASE + idx, &vs) != HAL_OK)
+            break;   /* queue full: resume here next time */
+
+        fleet->txNext = (idx + 1U < fleet->count) ? (idx + 1U) : 0U;
+        sent++;
+    }
+
+    return sent;
+}
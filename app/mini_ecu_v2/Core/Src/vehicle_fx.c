@@ -0,0 +1,125 @@
+/**
+ * @file    vehicle_fx.c
+ * @brief   Fixed-point implementation of the vehicle dynamics model.
+ *
+ * Mirrors vehicle.c; see the "Physics Model Explanation" there. The gains
+ * are Q2.30 so that their rounding error (< 1e-9) does not accumulate over
+ * thousands of steps the way a Q16 0.98 (4 ppm off per step) would.
+ * Q16 x Q30 products use a 64-bit intermediate (a single SMULL on
+ * Cortex-M4) and are rounded back to Q16.
+ */
+
+#include "vehicle_fx.h"
+
+/* -------------------------------------------------------------
+ * Model constants
+ * ------------------------------------------------------------- */
+#define Q30_CONST(x)        ((int32_t)(((x) * 1073741824.0) + 0.5))
+
+#define VFX_SPEED_DECAY     Q30_CONST(0.98)
+#define VFX_RPM_GAIN        Q30_CONST(0.3)
+#define VFX_TEMP_GAIN       Q30_CONST(0.05)
+#define VFX_IDLE_COOL       Q16_CONST(0.01)
+
+#define VFX_SPEED_MAX       Q16_FROM_INT(200)
+#define VFX_RPM_BASE        Q16_FROM_INT(800)
+#define VFX_RPM_PER_KPH     50
+#define VFX_RPM_MIN         600
+#define VFX_RPM_MAX         6000
+#define VFX_TEMP_WARM       Q16_FROM_INT(90)
+#define VFX_TEMP_MIN        Q16_FROM_INT(20)
+#define VFX_TEMP_MAX        Q16_FROM_INT(110)
+
+/* -------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------- */
+/** Q16 value times Q2.30 gain, rounded to Q16. */
+static q16_t q16_mul_gain(q16_t a, int32_t gain)
+{
+    int64_t p = (int64_t)a * gain;
+    return (q16_t)((p + (1 << 29)) >> 30);
+}
+
+static int32_t clamp_i(int32_t v, int32_t min, int32_t max)
+{
+    if (v < min) return min;
+    if (v > max) return max;
+    return v;
+}
+
+void VehicleFx_Init(VehicleStateFx_t *vs)
+{
+    if (!vs) return;
+
+    vs->speed_kph      = 0;
+    vs->engine_rpm     = 800;
+    vs->coolant_temp_c = Q16_FROM_INT(30);  /* Cold engine start */
+}
+
+void VehicleFx_Update(VehicleStateFx_t *vs, uint32_t dt_ms)
+{
+    if (!vs || dt_ms == 0U) return;
+
+    /* --- 1. SPEED DECAY ------------------------------------ */
+    vs->speed_kph = q16_mul_gain(vs->speed_kph, VFX_SPEED_DECAY);
+    vs->speed_kph = clamp_i(vs->speed_kph, 0, VFX_SPEED_MAX);
+
+    /* --- 2. RPM FOLLOWS SPEED ------------------------------ */
+    /* Max 800 + 200 * 50 = 10800 rpm, i.e. < 2^31 in Q16. */
+    q16_t target_rpm = VFX_RPM_BASE + (vs->speed_kph * VFX_RPM_PER_KPH);
+    q16_t rpm        = Q16_FROM_INT(vs->engine_rpm);
+
+    rpm += q16_mul_gain(target_rpm - rpm, VFX_RPM_GAIN);
+
+    /* Truncate like the float model's (uint16_t) cast; rpm > 0 here. */
+    vs->engine_rpm = (uint16_t)clamp_i(Q16_TO_INT(rpm), VFX_RPM_MIN, VFX_RPM_MAX);
+
+    /* --- 3. COOLANT TEMPERATURE ---------------------------- */
+    if (vs->engine_rpm > 1000)
+    {
+        vs->coolant_temp_c += q16_mul_gain(VFX_TEMP_WARM - vs->coolant_temp_c, VFX_TEMP_GAIN);
+    }
+    else
+    {
+        vs->coolant_temp_c -= VFX_IDLE_COOL;
+    }
+
+    vs->coolant_temp_c = clamp_i(vs->coolant_temp_c, VFX_TEMP_MIN, VFX_TEMP_MAX);
+}
+
+void VehicleFx_SetTargetSpeed(VehicleStateFx_t *vs, q16_t speed_kph)
+{
+    if (!vs) return;
+
+    vs->speed_kph = clamp_i(speed_kph, 0, VFX_SPEED_MAX);
+}
+
+void VehicleFx_Force(VehicleStateFx_t *vs, q16_t speed, uint16_t rpm, q16_t temp_c)
+{
+    if (!vs) return;
+
+    vs->speed_kph      = clamp_i(speed, 0, VFX_SPEED_MAX);
+    vs->engine_rpm     = (uint16_t)clamp_i(rpm, VFX_RPM_MIN, VFX_RPM_MAX);
+    vs->coolant_temp_c = clamp_i(temp_c, VFX_TEMP_MIN, VFX_TEMP_MAX);
+}
+
+void VehicleFx_ToFloat(const VehicleStateFx_t *in, VehicleState_t *out)
+{
+    if (!in || !out) return;
+
+    out->speed_kph      = (float)in->speed_kph / (float)Q16_ONE;
+    out->engine_rpm     = in->engine_rpm;
+    out->coolant_temp_c = (float)in->coolant_temp_c / (float)Q16_ONE;
+}
+
+void VehicleFx_FromFloat(const VehicleState_t *in, VehicleStateFx_t *out)
+{
+    if (!in || !out) return;
+
+    float s = in->speed_kph * (float)Q16_ONE;
+    float t = in->coolant_temp_c * (float)Q16_ONE;
+
+    out->speed_kph      = (q16_t)((s >= 0.0f) ? (s + 0.5f) : (s - 0.5f));
+    out->engine_rpm     = in->engine_rpm;
+    out->coolant_temp_c = (q16_t)((t >= 0.0f) ? (t + 0.5f) : (t - 0.5f));
+}
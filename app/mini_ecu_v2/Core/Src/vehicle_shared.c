@@ -0,0 +1,118 @@
+/**
+ * @file    vehicle_shared.c
+ * @brief   Vehicle snapshot on the VEHICLE topic and command mailbox.
+ */
+
+#include "vehicle_shared.h"
+#include "msg_bus.h"
+#include "speed_est.h"
+#include "cmsis_os2.h"
+#include "FreeRTOS.h"
+#include "queue.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static osMessageQueueId_t s_cmdQueue = NULL;
+
+/* Mailbox memory supplied statically (no RTOS heap use). */
+static StaticQueue_t s_cmdQueueCb;
+static uint8_t       s_cmdQueueMem[VEHICLE_CMD_QUEUE_LEN * sizeof(VehicleCmd_t)];
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef Vehicle_SharedInit(void)
+{
+    if (s_cmdQueue != NULL)
+        return HAL_OK;
+
+    const osMessageQueueAttr_t attr = {
+        .name    = "VehicleCmd",
+        .cb_mem  = &s_cmdQueueCb,
+        .cb_size = sizeof(s_cmdQueueCb),
+        .mq_mem  = s_cmdQueueMem,
+        .mq_size = sizeof(s_cmdQueueMem),
+    };
+
+    s_cmdQueue = osMessageQueueNew(VEHICLE_CMD_QUEUE_LEN, sizeof(VehicleCmd_t), &attr);
+    return (s_cmdQueue != NULL) ? HAL_OK : HAL_ERROR;
+}
+
+void Vehicle_Publish(const VehicleState_t *vs)
+{
+    if (vs == NULL)
+        return;
+
+    CanSig_VehicleTelemetry_t m =
+    {
+        .speed_kph      = vs->speed_kph,
+        .engine_rpm     = vs->engine_rpm,
+        .coolant_temp_c = vs->coolant_temp_c,
+    };
+    CanSig_VehicleTelemetry_Raw_t raw;
+
+#if SPEED_EST_TELEMETRY
+    /* The measured speed, filtered, once the sensor has produced one */
+    (void)SpeedEst_GetKph(&m.speed_kph);
+#endif
+
+    CanSig_VehicleTelemetry_ToRaw(&m, &raw);
+
+    /* Telemetry first: a VEHICLE subscriber finds it up to date */
+    MsgBus_Write(MSG_TOPIC_TELEMETRY, &raw);
+    MsgBus_Write(MSG_TOPIC_VEHICLE, vs);
+}
+
+void Vehicle_GetSnapshot(VehicleState_t *out)
+{
+    if (out == NULL)
+        return;
+
+    (void)MsgBus_Read(MSG_TOPIC_VEHICLE, out);
+}
+
+void Vehicle_GetTelemetry(CanSig_VehicleTelemetry_Raw_t *out)
+{
+    if (out == NULL)
+        return;
+
+    (void)MsgBus_Read(MSG_TOPIC_TELEMETRY, out);
+}
+
+HAL_StatusTypeDef Vehicle_PostCommand(const VehicleCmd_t *cmd)
+{
+    if ((cmd == NULL) || (s_cmdQueue == NULL))
+        return HAL_ERROR;
+
+    return (osMessageQueuePut(s_cmdQueue, cmd, 0U, 0U) == osOK) ? HAL_OK : HAL_BUSY;
+}
+
+uint32_t Vehicle_ApplyCommands(VehicleState_t *vs)
+{
+    VehicleCmd_t cmd;
+    uint32_t     n = 0U;
+
+    if ((vs == NULL) || (s_cmdQueue == NULL))
+        return 0U;
+
+    while (osMessageQueueGet(s_cmdQueue, &cmd, NULL, 0U) == osOK)
+    {
+        if (cmd.type == (uint8_t)VEHICLE_CMD_SET_SPEED)
+        {
+            Vehicle_SetTargetSpeed(vs, cmd.speed_kph);
+        }
+        else if (cmd.type == (uint8_t)VEHICLE_CMD_FORCE)
+        {
+            Vehicle_Force(vs,
+                          (cmd.mask & VEHICLE_FORCE_SPEED) ? cmd.speed_kph      : vs->speed_kph,
+                          (cmd.mask & VEHICLE_FORCE_RPM)   ? cmd.engine_rpm     : vs->engine_rpm,
+                          (cmd.mask & VEHICLE_FORCE_TEMP)  ? cmd.coolant_temp_c : vs->coolant_temp_c);
+        }
+        n++;
+    }
+
+    return n;
+}
@@ -0,0 +1,815 @@
+/**
+ * @file    vsensor.c
+ * @brief   Virtual sensor double buffer, block consumer, sources and
+ *          "sensor".
+ *
+ * The source side (DMA interrupt or the simulation timer) only fills a
+ * half and marks it pending under PRIMASK. The consumer task owns the
+ * pipelines and the diagnostics and publishes through a two-copy sequence
+ * counter, as vehicle_shared.c does.
+ */
+
+#include "vsensor.h"
+#include "audit.h"
+#include "can_sigcache.h"
+#include "cli_if.h"
+#include "clock_cfg.h"
+#include "dtc.h"
+#include "log.h"
+#include "perf.h"
+#include "platform_dma.h"
+#include "sigcond.h"
+#include "speed_est.h"
+#include "sys_config.h"
+#include "vehicle_shared.h"
+#include "wheel_pulse.h"
+#include "FreeRTOS.h"
+#include "timers.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+_Static_assert((VSENSOR_BLOCK % 4U) == 0U, "VSENSOR_BLOCK must be a multiple of 4");
+_Static_assert(((VSENSOR_BLOCK * 1000U) % VSENSOR_SAMPLE_HZ) == 0U,
+               "VSENSOR_BLOCK scans must take a whole number of ms");
+
+/** Block period (ms); the simulation timer and the overrun deadline. */
+#define VS_BLOCK_MS         ((VSENSOR_BLOCK * 1000U) / VSENSOR_SAMPLE_HZ)
+
+/* Sensor output span: 5 % .. 95 % of full scale; outside 2 % .. 98 % the
+ * input is open or shorted. */
+#define VS_COUNTS_LO        205.0f
+#define VS_COUNTS_HI        3890.0f
+#define VS_DIAG_LOW         82U
+#define VS_DIAG_HIGH        4013U
+
+/* Conditioning per channel. The low-pass is also the anti-alias filter of
+ * the decimation, so median, rate limit and range check run at 125 Hz
+ * (31.25 Hz for coolant). Rate limits sit above what the vehicle model can
+ * do; range limits are the plausible span inside the sensor range. */
+static const SigCond_StageCfg_t s_vsSpeedPipe[] =
+{
+    SIGCOND_STAGE_FIR(32U, 20.0f),
+    SIGCOND_STAGE_DECIMATE(8U),
+    SIGCOND_STAGE_MEDIAN(5U),
+    SIGCOND_STAGE_RATE_LIMIT(60.0f),
+    SIGCOND_STAGE_RANGE(0.0f, 260.0f, 4U),
+};
+
+static const SigCond_StageCfg_t s_vsRpmPipe[] =
+{
+    SIGCOND_STAGE_BIQUAD(2U, 25.0f),
+    SIGCOND_STAGE_DECIMATE(8U),
+    SIGCOND_STAGE_MEDIAN(3U),
+    SIGCOND_STAGE_RATE_LIMIT(4000.0f),
+    SIGCOND_STAGE_RANGE(0.0f, 7000.0f, 4U),
+};
+
+static const SigCond_StageCfg_t s_vsCoolantPipe[] =
+{
+    SIGCOND_STAGE_BIQUAD(2U, 2.0f),
+    SIGCOND_STAGE_DECIMATE(32U),
+    SIGCOND_STAGE_RATE_LIMIT(5.0f),
+    SIGCOND_STAGE_RANGE(-30.0f, 130.0f, 2U),
+};
+
+#if VSENSOR_PEDAL
+/* The F4 ADC has no hardware oversampling: the mean of 8 scans is, at
+ * 4 kB of DMA per second for all channels, an eighth of the noise power
+ * and 125 Hz, plenty for a foot. No rate limit, a pedal may be let go. */
+static const SigCond_StageCfg_t s_vsPedalPipe[] =
+{
+    SIGCOND_STAGE_AVERAGE(8U),
+    SIGCOND_STAGE_MEDIAN(3U),
+    SIGCOND_STAGE_RANGE(-2.0f, 102.0f, 4U),
+};
+
+#define VS_CH_NAMES         "speed|rpm|coolant|pedal"
+#else
+#define VS_CH_NAMES         "speed|rpm|coolant"
+#endif
+
+#define VS_STAGES(tbl)      (tbl), (uint8_t)(sizeof(tbl) / sizeof((tbl)[0]))
+
+typedef struct
+{
+    const char               *name;
+    const char               *unit;
+    float                     physMin;      /* at VS_COUNTS_LO */
+    float                     physMax;      /* at VS_COUNTS_HI */
+    float                     noise;        /* peak simulated noise (counts) */
+    const SigCond_StageCfg_t *pipe;
+    uint8_t                   stages;
+    uint8_t                   adcChannel;   /* ADC1 input */
+    uint8_t                   sig;          /* CanSigCache_Signal_t, VS_SIG_NONE */
+    uint8_t                   dtcCircuit;   /* Dtc_Id_t of LOW / HIGH */
+    uint8_t                   dtcRange;     /* Dtc_Id_t of STUCK / IMPLAUSIBLE */
+} VSensor_Config_t;
+
+/** A channel that is not in the signal cache. */
+#define VS_SIG_NONE         0xFFU
+
+static const VSensor_Config_t s_vsCfg[VSENSOR_CH_COUNT] =
+{
+    [VSENSOR_CH_SPEED]   = { "speed",   "km/h",    0.0f,  300.0f, 6.0f, VS_STAGES(s_vsSpeedPipe),
+                             0U, (uint8_t)CAN_SIG_SENS_SPEED,
+                             (uint8_t)DTC_SPEED_CIRCUIT, (uint8_t)DTC_SPEED_RANGE },
+    [VSENSOR_CH_RPM]     = { "rpm",     "rpm",     0.0f, 8000.0f, 8.0f, VS_STAGES(s_vsRpmPipe),
+                             1U, (uint8_t)CAN_SIG_SENS_RPM,
+                             (uint8_t)DTC_RPM_CIRCUIT, (uint8_t)DTC_RPM_RANGE },
+    [VSENSOR_CH_COOLANT] = { "coolant", "degC",  -40.0f,  150.0f, 3.0f, VS_STAGES(s_vsCoolantPipe),
+                             4U, (uint8_t)CAN_SIG_SENS_COOLANT,
+                             (uint8_t)DTC_COOLANT_CIRCUIT, (uint8_t)DTC_COOLANT_RANGE },
+#if VSENSOR_PEDAL
+    [VSENSOR_CH_PEDAL]   = { "pedal",   "%",       0.0f,  100.0f, 4.0f, VS_STAGES(s_vsPedalPipe),
+                             10U, VS_SIG_NONE,
+                             (uint8_t)DTC_PEDAL_CIRCUIT, (uint8_t)DTC_PEDAL_RANGE },
+#endif
+};
+
+/** Status bits that keep a channel's value out of the signal cache. */
+#define VS_ST_INVALID       (VSENSOR_ST_LOW | VSENSOR_ST_HIGH | VSENSOR_ST_STUCK | \
+                             VSENSOR_ST_IMPLAUSIBLE)
+
+static const char *const s_vsFaultNames[VSENSOR_FAULT_COUNT] =
+{
+    "none", "open", "short", "stuck", "noisy"
+};
+
+/** Consumer-side state of a channel. */
+typedef struct
+{
+    SigCond_Pipe_t  pipe;
+    uint16_t        hold;       /* last count before a STUCK fault */
+    uint8_t         flatBlocks;
+    uint8_t         resync;     /* reset the pipeline on the next valid block */
+} VSensor_Filt_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Scan-interleaved, as ADC1 scan + DMA writes it. SRAM2 keeps the DMA
+ * writes off the bus slave the CPU works in (sram_layout.h). */
+PLATFORM_DMA_BUFFER static uint16_t s_vsBuf[2][VSENSOR_BLOCK][VSENSOR_CH_COUNT];
+
+_Static_assert((sizeof(s_vsBuf[0]) % PLATFORM_DMA_ALIGN) == 0U, "VSENSOR_BLOCK: whole cache lines per half");
+
+/* Source side; s_vsPending / s_vsOverruns under PRIMASK. */
+static volatile uint32_t s_vsPending   = 0U;
+static volatile uint32_t s_vsOverruns  = 0U;
+static volatile uint32_t s_vsDmaErrors = 0U;
+static osThreadId_t      s_vsConsumer  = NULL;
+static volatile uint8_t  s_vsFault[VSENSOR_CH_COUNT];
+
+/* Consumer task only. */
+static VSensor_Filt_t    s_vsFilt[VSENSOR_CH_COUNT];
+static float             s_vsBlock[VSENSOR_BLOCK];
+static VSensor_Reading_t s_vsWork;
+static uint32_t          s_vsNext     = 0U;
+static uint32_t          s_vsFaultRng = 0x2545F491U;
+
+/* Published; written by the consumer, read by VSensor_Get(). */
+static VSensor_Reading_t s_vsCopy[2];
+static volatile uint32_t s_vsSeq = 0U;
+
+#if VSENSOR_PEDAL
+/* Simulated pedal position (%), "sensor pedal"; truth for "sensor". */
+static volatile float    s_vsSimPedal = 0.0f;
+#endif
+
+#if VSENSOR_SOURCE == VSENSOR_SOURCE_SIM
+/* Timer task only. Created with the native API, as in rtos_stats.c. */
+static TimerHandle_t     s_simTimer = NULL;
+static StaticTimer_t     s_simTimerCb;
+static float             s_simLast[VSENSOR_CH_COUNT];
+static uint32_t          s_simHalf = 0U;
+static uint32_t          s_simRng  = 0x9E3779B9U;
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t vsensor_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/** Triangular noise in (-peak, peak): the sum of two uniform variates. */
+static float vsensor_noise(uint32_t *state, float peak)
+{
+    float u1 = (float)(vsensor_rand(state) >> 8) * (1.0f / 16777216.0f);
+    float u2 = (float)(vsensor_rand(state) >> 8) * (1.0f / 16777216.0f);
+
+    return (u1 - u2) * peak;
+}
+
+static float vsensor_to_counts(VSensor_Ch_t ch, float phys)
+{
+    const VSensor_Config_t *c = &s_vsCfg[ch];
+
+    return VS_COUNTS_LO + (((phys - c->physMin) * (VS_COUNTS_HI - VS_COUNTS_LO)) /
+                           (c->physMax - c->physMin));
+}
+
+static uint16_t vsensor_quantise(float counts)
+{
+    if (counts <= 0.0f)
+        return 0U;
+    if (counts >= (float)VSENSOR_COUNTS_MAX)
+        return (uint16_t)VSENSOR_COUNTS_MAX;
+    return (uint16_t)(counts + 0.5f);
+}
+
+/**
+ * @brief A half is full (DMA interrupt or simulation timer).
+ */
+static void vsensor_half_done(uint32_t half)
+{
+    uint32_t bit = 1UL << half;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if ((s_vsPending & bit) != 0U)
+        s_vsOverruns++;
+    s_vsPending |= bit;
+    __set_PRIMASK(primask);
+
+    if (s_vsConsumer != NULL)
+        (void)osThreadFlagsSet(s_vsConsumer, VSENSOR_FLAG);
+}
+
+static void vsensor_publish(const VSensor_Reading_t *r)
+{
+    s_vsSeq++;
+    __DMB();
+    s_vsCopy[0] = *r;
+    __DMB();
+    s_vsSeq++;
+    __DMB();
+    s_vsCopy[1] = *r;
+    __DMB();
+}
+
+/**
+ * @brief Fault injection, diagnostics and conditioning of one channel's
+ *        samples in half @p half.
+ */
+static void vsensor_process_channel(VSensor_Ch_t ch, uint32_t half)
+{
+    const VSensor_Config_t *c     = &s_vsCfg[ch];
+    VSensor_Filt_t         *f     = &s_vsFilt[ch];
+    VSensor_Channel_t      *out   = &s_vsWork.ch[ch];
+    uint8_t                 fault = s_vsFault[ch];
+    uint16_t                lo    = 0xFFFFU;
+    uint16_t                hi    = 0U;
+    uint16_t                last  = 0U;
+
+    /* Counts to engineering units as one multiply-add per sample. */
+    float gain   = (c->physMax - c->physMin) / (VS_COUNTS_HI - VS_COUNTS_LO);
+    float offset = c->physMin - (VS_COUNTS_LO * gain);
+
+    for (uint32_t n = 0U; n < VSENSOR_BLOCK; ++n)
+    {
+        uint16_t v = s_vsBuf[half][n][ch];
+
+        switch (fault)
+        {
+        case VSENSOR_FAULT_OPEN:
+            v = 0U;
+            break;
+        case VSENSOR_FAULT_SHORT:
+            v = (uint16_t)VSENSOR_COUNTS_MAX;
+            break;
+        case VSENSOR_FAULT_STUCK:
+            v = f->hold;
+            break;
+        case VSENSOR_FAULT_NOISY:
+            v = vsensor_quantise((float)v + vsensor_noise(&s_vsFaultRng, (float)VSENSOR_NOISY_COUNTS));
+            break;
+        default:
+            f->hold = v;
+            break;
+        }
+
+        if (v < lo)
+            lo = v;
+        if (v > hi)
+            hi = v;
+        last = v;
+        s_vsBlock[n] = ((float)v * gain) + offset;
+    }
+
+    uint8_t status = 0U;
+
+    if (lo < VS_DIAG_LOW)
+        status |= VSENSOR_ST_LOW;
+    if (hi > VS_DIAG_HIGH)
+        status |= VSENSOR_ST_HIGH;
+
+    if (hi != lo)
+        f->flatBlocks = 0U;
+    else if (f->flatBlocks < VSENSOR_STUCK_BLOCKS)
+        f->flatBlocks++;
+    if (f->flatBlocks >= VSENSOR_STUCK_BLOCKS)
+        status |= VSENSOR_ST_STUCK;
+
+    out->raw    = last;
+    out->rawMin = lo;
+    out->rawMax = hi;
+    out->fault  = fault;
+
+    /* The estimator takes the raw samples, before the pipeline filters them,
+     * and coasts over a block the diagnostics reject. */
+    if (ch == VSENSOR_CH_SPEED)
+        SpeedEst_Block(s_vsBlock, VSENSOR_BLOCK, (status == 0U) ? 1U : 0U);
+
+    /* Open or shorted: hold the last value, and restart the pipeline when
+     * the signal is back instead of slewing from the fault level. */
+    if ((status & (VSENSOR_ST_LOW | VSENSOR_ST_HIGH)) != 0U)
+    {
+        f->resync = 1U;
+        out->status = status;
+        return;
+    }
+
+    if (f->resync != 0U)
+        SigCond_Reset(&f->pipe, s_vsBlock[0]);
+    f->resync = 0U;
+
+    uint32_t n = SigCond_Run(&f->pipe, s_vsBlock, VSENSOR_BLOCK);
+    if (n > 0U)
+        out->value = s_vsBlock[n - 1U];
+
+    if ((f->pipe.status & SIGCOND_ST_RANGE) != 0U)
+        status |= VSENSOR_ST_IMPLAUSIBLE;
+    if ((f->pipe.status & SIGCOND_ST_RATE) != 0U)
+        status |= VSENSOR_ST_RATE;
+    out->status = status;
+}
+
+static HAL_StatusTypeDef vsensor_pipes_init(void)
+{
+    for (uint32_t ch = 0U; ch < VSENSOR_CH_COUNT; ++ch)
+    {
+        const VSensor_Config_t *c = &s_vsCfg[ch];
+        VSensor_Filt_t         *f = &s_vsFilt[ch];
+
+        if (SigCond_Init(&f->pipe, c->pipe, c->stages, (float)VSENSOR_SAMPLE_HZ,
+                         VSENSOR_BLOCK) != HAL_OK)
+            return HAL_ERROR;
+
+        /* The first block resets the pipeline to its first sample. */
+        f->resync = 1U;
+        s_vsWork.ch[ch].value = c->physMin;
+    }
+
+    return HAL_OK;
+}
+
+/** Publish the valid channels to the signal cache, one update per block. */
+static void vsensor_to_sigcache(void)
+{
+    float    values[CAN_SIG_COUNT];
+    uint32_t mask = 0U;
+
+    for (uint32_t ch = 0U; ch < VSENSOR_CH_COUNT; ++ch)
+    {
+        if ((s_vsCfg[ch].sig == VS_SIG_NONE) ||
+            ((s_vsWork.ch[ch].status & VS_ST_INVALID) != 0U))
+            continue;
+        values[s_vsCfg[ch].sig] = s_vsWork.ch[ch].value;
+        mask |= CAN_SIG_BIT(s_vsCfg[ch].sig);
+    }
+
+    (void)CanSigCache_Update(mask, values);
+}
+
+/** Report the diagnostic window and plausibility results (dtc.h). */
+static void vsensor_to_dtc(void)
+{
+    for (uint32_t ch = 0U; ch < VSENSOR_CH_COUNT; ++ch)
+    {
+        uint8_t st = s_vsWork.ch[ch].status;
+
+        Dtc_Set((Dtc_Id_t)s_vsCfg[ch].dtcCircuit,
+                ((st & (VSENSOR_ST_LOW | VSENSOR_ST_HIGH)) != 0U) ? 1U : 0U);
+        Dtc_Set((Dtc_Id_t)s_vsCfg[ch].dtcRange,
+                ((st & (VSENSOR_ST_STUCK | VSENSOR_ST_IMPLAUSIBLE)) != 0U) ? 1U : 0U);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* Simulation source                                                          */
+/* -------------------------------------------------------------------------- */
+
+#if VSENSOR_SOURCE == VSENSOR_SOURCE_SIM
+
+/**
+ * @brief Fill the next half from the vehicle state (timer task), ramping
+ *        from the previous block's state so the samples have no steps.
+ */
+static void vsensor_sim_fill(TimerHandle_t timer)
+{
+    (void)timer;
+
+    VehicleState_t vs;
+    float          target[VSENSOR_CH_COUNT];
+    float          step[VSENSOR_CH_COUNT];
+
+    Vehicle_GetSnapshot(&vs);
+    target[VSENSOR_CH_SPEED]   = vsensor_to_counts(VSENSOR_CH_SPEED, vs.speed_kph);
+    target[VSENSOR_CH_RPM]     = vsensor_to_counts(VSENSOR_CH_RPM, (float)vs.engine_rpm);
+    target[VSENSOR_CH_COOLANT] = vsensor_to_counts(VSENSOR_CH_COOLANT, vs.coolant_temp_c);
+#if VSENSOR_PEDAL
+    target[VSENSOR_CH_PEDAL]   = vsensor_to_counts(VSENSOR_CH_PEDAL, s_vsSimPedal);
+#endif
+
+    for (uint32_t ch = 0U; ch < VSENSOR_CH_COUNT; ++ch)
+        step[ch] = (target[ch] - s_simLast[ch]) / (float)VSENSOR_BLOCK;
+
+    uint16_t (*scan)[VSENSOR_CH_COUNT] = s_vsBuf[s_simHalf];
+
+    for (uint32_t n = 0U; n < VSENSOR_BLOCK; ++n)
+    {
+        for (uint32_t ch = 0U; ch < VSENSOR_CH_COUNT; ++ch)
+        {
+            float v = s_simLast[ch] + (step[ch] * (float)(n + 1U)) +
+                      vsensor_noise(&s_simRng, s_vsCfg[ch].noise);
+
+            scan[n][ch] = vsensor_quantise(v);
+        }
+    }
+
+    for (uint32_t ch = 0U; ch < VSENSOR_CH_COUNT; ++ch)
+        s_simLast[ch] = target[ch];
+
+    vsensor_half_done(s_simHalf);
+    s_simHalf ^= 1U;
+}
+
+static HAL_StatusTypeDef vsensor_source_init(void)
+{
+    VehicleState_t vs;
+
+    Vehicle_GetSnapshot(&vs);
+    s_simLast[VSENSOR_CH_SPEED]   = vsensor_to_counts(VSENSOR_CH_SPEED, vs.speed_kph);
+    s_simLast[VSENSOR_CH_RPM]     = vsensor_to_counts(VSENSOR_CH_RPM, (float)vs.engine_rpm);
+    s_simLast[VSENSOR_CH_COOLANT] = vsensor_to_counts(VSENSOR_CH_COOLANT, vs.coolant_temp_c);
+#if VSENSOR_PEDAL
+    s_simLast[VSENSOR_CH_PEDAL]   = vsensor_to_counts(VSENSOR_CH_PEDAL, s_vsSimPedal);
+#endif
+
+    s_simTimer = xTimerCreateStatic("VSensor", pdMS_TO_TICKS(VS_BLOCK_MS), pdTRUE, NULL,
+                                    vsensor_sim_fill, &s_simTimerCb);
+    return (s_simTimer != NULL) ? HAL_OK : HAL_ERROR;
+}
+
+static HAL_StatusTypeDef vsensor_source_start(void)
+{
+    return (xTimerStart(s_simTimer, 0U) == pdPASS) ? HAL_OK : HAL_ERROR;
+}
+
+#endif /* VSENSOR_SOURCE_SIM */
+
+/* -------------------------------------------------------------------------- */
+/* ADC1 source                                                                */
+/* -------------------------------------------------------------------------- */
+
+#if VSENSOR_SOURCE == VSENSOR_SOURCE_ADC1
+
+/* ADC_CR2 EXTSEL for TIM2 TRGO; SMPR sample time 84 cycles. */
+#define VS_ADC_EXTSEL_TIM2  6U
+#define VS_ADC_SMP_84       4U
+
+#define VS_DMA_S0_FLAGS     (DMA_LIFCR_CFEIF0 | DMA_LIFCR_CDMEIF0 | DMA_LIFCR_CTEIF0 | \
+                             DMA_LIFCR_CHTIF0 | DMA_LIFCR_CTCIF0)
+
+static HAL_StatusTypeDef vsensor_source_init(void)
+{
+    GPIO_InitTypeDef gpio  = {0};
+    uint32_t         sqr3  = 0U;
+    uint32_t         smpr1 = 0U;
+    uint32_t         smpr2 = 0U;
+
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    __HAL_RCC_ADC1_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    __HAL_RCC_TIM2_CLK_ENABLE();
+
+    gpio.Pin  = GPIO_PIN_0 | GPIO_PIN_1 | GPIO_PIN_4;
+    gpio.Mode = GPIO_MODE_ANALOG;
+    gpio.Pull = GPIO_NOPULL;
+    HAL_GPIO_Init(GPIOA, &gpio);
+
+#if VSENSOR_PEDAL
+    __HAL_RCC_GPIOC_CLK_ENABLE();
+    gpio.Pin = GPIO_PIN_0;
+    HAL_GPIO_Init(GPIOC, &gpio);
+#endif
+
+    /* SMPR2 holds the sample times of IN0..IN9, SMPR1 those of IN10..IN18. */
+    for (uint32_t ch = 0U; ch < VSENSOR_CH_COUNT; ++ch)
+    {
+        uint32_t in = s_vsCfg[ch].adcChannel;
+
+        sqr3 |= in << (5U * ch);
+        if (in >= 10U)
+            smpr1 |= VS_ADC_SMP_84 << (3U * (in - 10U));
+        else
+            smpr2 |= VS_ADC_SMP_84 << (3U * in);
+    }
+
+    /* ADCCLK = PCLK2 / 4: 22.5 MHz at 180 MHz, within the 36 MHz limit. */
+    ADC->CCR    = (ADC->CCR & ~ADC_CCR_ADCPRE) | ADC_CCR_ADCPRE_0;
+    ADC1->CR1   = ADC_CR1_SCAN;
+    ADC1->SMPR1 = smpr1;
+    ADC1->SMPR2 = smpr2;
+    ADC1->SQR1  = (VSENSOR_CH_COUNT - 1U) << ADC_SQR1_L_Pos;
+    ADC1->SQR3  = sqr3;
+    ADC1->CR2   = ADC_CR2_DMA | ADC_CR2_DDS | ADC_CR2_EXTEN_0 |
+                  (VS_ADC_EXTSEL_TIM2 << ADC_CR2_EXTSEL_Pos);
+
+    /* DMA2 Stream0 channel 0 = ADC1: halfwords, circular over both halves. */
+    DMA2_Stream0->CR = 0U;
+    while ((DMA2_Stream0->CR & DMA_SxCR_EN) != 0U)
+    {
+    }
+    DMA2->LIFCR          = VS_DMA_S0_FLAGS;
+    DMA2_Stream0->PAR    = (uint32_t)&ADC1->DR;
+    DMA2_Stream0->M0AR   = (uint32_t)&s_vsBuf[0][0][0];
+    DMA2_Stream0->NDTR   = 2U * VSENSOR_BLOCK * VSENSOR_CH_COUNT;
+    DMA2_Stream0->FCR    = 0U;
+    DMA2_Stream0->CR     = DMA_SxCR_PL_1 | DMA_SxCR_MSIZE_0 | DMA_SxCR_PSIZE_0 |
+                           DMA_SxCR_MINC | DMA_SxCR_CIRC |
+                           DMA_SxCR_HTIE | DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+
+    /* TIM2 update -> TRGO at VSENSOR_SAMPLE_HZ. */
+    TIM2->CR1 = 0U;
+    TIM2->PSC = 0U;
+    TIM2->ARR = (ClockCfg_TimerHz() / VSENSOR_SAMPLE_HZ) - 1U;
+    TIM2->CR2 = TIM_CR2_MMS_1;
+    TIM2->EGR = TIM_EGR_UG;
+
+    HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, SYS_IRQ_PRIO_VSensor, 0U);
+    HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+
+    return HAL_OK;
+}
+
+static HAL_StatusTypeDef vsensor_source_start(void)
+{
+    DMA2_Stream0->CR |= DMA_SxCR_EN;
+    ADC1->CR2        |= ADC_CR2_ADON;
+    TIM2->CR1        |= TIM_CR1_CEN;
+
+    return HAL_OK;
+}
+
+#endif /* VSENSOR_SOURCE_ADC1 */
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void vsensor_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    VSensor_Reading_t r;
+    VehicleState_t    vs;
+    float             truth[VSENSOR_CH_COUNT];
+
+    VSensor_Get(&r);
+    Vehicle_GetSnapshot(&vs);
+    truth[VSENSOR_CH_SPEED]   = vs.speed_kph;
+    truth[VSENSOR_CH_RPM]     = (float)vs.engine_rpm;
+    truth[VSENSOR_CH_COOLANT] = vs.coolant_temp_c;
+#if VSENSOR_PEDAL
+    truth[VSENSOR_CH_PEDAL]   = s_vsSimPedal;
+#endif
+
+    CLI_IF_Printf("%s source, %u Hz, %u-scan blocks: %lu blocks, %lu overruns",
+                  (VSENSOR_SOURCE == VSENSOR_SOURCE_ADC1) ? "ADC1" : "Simulated",
+                  (unsigned)VSENSOR_SAMPLE_HZ, (unsigned)VSENSOR_BLOCK,
+                  (unsigned long)r.blocks, (unsigned long)r.overruns);
+    if (VSENSOR_SOURCE == VSENSOR_SOURCE_ADC1)
+        CLI_IF_Printf(", %lu DMA errors", (unsigned long)r.dmaErrors);
+    CLI_IF_Print("\r\nChannel      truth   measured unit   raw  min  max  fault  status\r\n");
+
+    for (uint32_t ch = 0U; ch < VSENSOR_CH_COUNT; ++ch)
+    {
+        const VSensor_Channel_t *c = &r.ch[ch];
+
+        CLI_IF_Printf("%-8s %9.1f %10.1f %-5s %4u %4u %4u  %-5s  %s%s%s%s%s%s\r\n",
+                      s_vsCfg[ch].name, (double)truth[ch], (double)c->value, s_vsCfg[ch].unit,
+                      (unsigned)c->raw, (unsigned)c->rawMin, (unsigned)c->rawMax,
+                      s_vsFaultNames[c->fault],
+                      (c->status == 0U) ? "ok" : "",
+                      ((c->status & VSENSOR_ST_LOW) != 0U) ? "low " : "",
+                      ((c->status & VSENSOR_ST_HIGH) != 0U) ? "high " : "",
+                      ((c->status & VSENSOR_ST_STUCK) != 0U) ? "stuck " : "",
+                      ((c->status & VSENSOR_ST_IMPLAUSIBLE) != 0U) ? "implausible " : "",
+                      ((c->status & VSENSOR_ST_RATE) != 0U) ? "rate" : "");
+    }
+}
+
+static void vsensor_cmd_fault(int argc, char *argv[])
+{
+    (void)argc;
+
+    uint32_t ch    = VSENSOR_CH_COUNT;
+    uint32_t fault = VSENSOR_FAULT_COUNT;
+
+    for (uint32_t i = 0U; i < VSENSOR_CH_COUNT; ++i)
+    {
+        if (strcmp(argv[0], s_vsCfg[i].name) == 0)
+            ch = i;
+    }
+    for (uint32_t i = 0U; i < VSENSOR_FAULT_COUNT; ++i)
+    {
+        if (strcmp(argv[1], s_vsFaultNames[i]) == 0)
+            fault = i;
+    }
+
+    if (VSensor_SetFault((VSensor_Ch_t)ch, (VSensor_Fault_t)fault) != HAL_OK)
+    {
+        CLI_IF_Print("Channel: " VS_CH_NAMES ", fault: none|open|short|stuck|noisy\r\n");
+        return;
+    }
+
+    Audit_Record(AUDIT_CMD_SENSOR_FAULT, AUDIT_SRC_CLI, ch, fault);
+    CLI_IF_Printf("%s: fault %s\r\n", s_vsCfg[ch].name, s_vsFaultNames[fault]);
+}
+
+#if VSENSOR_PEDAL && (VSENSOR_SOURCE == VSENSOR_SOURCE_SIM)
+static void vsensor_cmd_pedal(int argc, char *argv[])
+{
+    (void)argc;
+
+    char *end = NULL;
+    float pct = strtof(argv[0], &end);
+
+    if ((end == argv[0]) || (*end != '\0') || (pct < 0.0f) || (pct > 100.0f))
+    {
+        CLI_IF_Print("Position: 0..100 (%)\r\n");
+        return;
+    }
+
+    s_vsSimPedal = pct;
+    CLI_IF_Printf("Simulated pedal sensor at %.1f %%\r\n", (double)pct);
+}
+#endif
+
+static const CliCommand_t s_vsCmds[] =
+{
+    { "sensor",       "",               0U, vsensor_cmd_show,  "virtual sensors: truth vs measurement" },
+    { "sensor fault", "<chan> <fault>", 2U, vsensor_cmd_fault, "inject a sensor fault (none clears)" },
+#if VSENSOR_PEDAL && (VSENSOR_SOURCE == VSENSOR_SOURCE_SIM)
+    { "sensor pedal", "<pct>",          1U, vsensor_cmd_pedal, "move the simulated pedal sensor" },
+#endif
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef VSensor_Init(void)
+{
+    if (vsensor_pipes_init() != HAL_OK)
+        return HAL_ERROR;
+    vsensor_publish(&s_vsWork);
+
+    if (vsensor_source_init() != HAL_OK)
+        return HAL_ERROR;
+
+    CLI_IF_REGISTER_TABLE(s_vsCmds);
+
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef VSensor_Start(osThreadId_t consumer)
+{
+    if (consumer == NULL)
+        return HAL_ERROR;
+
+    s_vsConsumer = consumer;
+    return vsensor_source_start();
+}
+
+void VSensor_Task(void)
+{
+    (void)osThreadFlagsWait(VSENSOR_FLAG, osFlagsWaitAny, osWaitForever);
+
+    /* Halves complete in order, so take them in order; both are pending
+     * after an overrun. */
+    for (;;)
+    {
+        uint32_t bit = 1UL << s_vsNext;
+
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        uint32_t ready = s_vsPending & bit;
+        s_vsPending &= ~bit;
+        __set_PRIMASK(primask);
+
+        if (ready == 0U)
+            break;
+
+        PERF_BEGIN(SENSOR_BLOCK);
+        for (uint32_t ch = 0U; ch < VSENSOR_CH_COUNT; ++ch)
+            vsensor_process_channel((VSensor_Ch_t)ch, s_vsNext);
+        PERF_END(SENSOR_BLOCK);
+
+        s_vsWork.blocks++;
+        s_vsWork.overruns  = s_vsOverruns;
+        s_vsWork.dmaErrors = s_vsDmaErrors;
+        vsensor_publish(&s_vsWork);
+        WheelPulse_Block();
+        vsensor_to_sigcache();
+        vsensor_to_dtc();
+#if VSENSOR_PEDAL
+        Pedal_OnSensor(s_vsWork.ch[VSENSOR_CH_PEDAL].value,
+                       ((s_vsWork.ch[VSENSOR_CH_PEDAL].status & VS_ST_INVALID) == 0U) ? 1U : 0U);
+#endif
+
+        s_vsNext ^= 1U;
+    }
+}
+
+void VSensor_Get(VSensor_Reading_t *out)
+{
+    uint32_t seq;
+
+    if (out == NULL)
+        return;
+
+    do
+    {
+        seq = s_vsSeq;
+        __DMB();
+        *out = s_vsCopy[seq & 1U];
+        __DMB();
+    } while (s_vsSeq != seq);
+}
+
+HAL_StatusTypeDef VSensor_SetFault(VSensor_Ch_t ch, VSensor_Fault_t fault)
+{
+    if (((uint32_t)ch >= VSENSOR_CH_COUNT) || ((uint32_t)fault >= VSENSOR_FAULT_COUNT))
+        return HAL_ERROR;
+
+    s_vsFault[ch] = (uint8_t)fault;
+    LOG_INFO(VEH, "Sensor %s: fault %s", s_vsCfg[ch].name, s_vsFaultNames[fault]);
+    return HAL_OK;
+}
+
+const char *VSensor_ChannelName(VSensor_Ch_t ch)
+{
+    return ((uint32_t)ch < VSENSOR_CH_COUNT) ? s_vsCfg[ch].name : "?";
+}
+
+void VSensor_ClockChanged(void)
+{
+#if VSENSOR_SOURCE == VSENSOR_SOURCE_ADC1
+    /* The prescaler stays 0, so no update event: no extra conversion. */
+    ClockCfg_RetimeTimer(TIM2, 0U, (ClockCfg_TimerHz() / VSENSOR_SAMPLE_HZ) - 1U);
+#endif
+}
+
+void VSensor_DmaIRQHandler(void)
+{
+#if VSENSOR_SOURCE == VSENSOR_SOURCE_ADC1
+    uint32_t isr = DMA2->LISR;
+
+    /* A transfer error disables the stream; it stays off until reset. */
+    if ((isr & DMA_LISR_TEIF0) != 0U)
+    {
+        DMA2->LIFCR = DMA_LIFCR_CTEIF0;
+        s_vsDmaErrors++;
+    }
+    /* The stream is in the other half now, so the lines stay valid. */
+    if ((isr & DMA_LISR_HTIF0) != 0U)
+    {
+        DMA2->LIFCR = DMA_LIFCR_CHTIF0;
+        PlatformDma_Invalidate(s_vsBuf[0], (uint32_t)sizeof(s_vsBuf[0]));
+        vsensor_half_done(0U);
+    }
+    if ((isr & DMA_LISR_TCIF0) != 0U)
+    {
+        DMA2->LIFCR = DMA_LIFCR_CTCIF0;
+        PlatformDma_Invalidate(s_vsBuf[1], (uint32_t)sizeof(s_vsBuf[1]));
+        vsensor_half_done(1U);
+    }
+#endif
+}
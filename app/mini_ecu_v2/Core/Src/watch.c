@@ -0,0 +1,529 @@
+/**
+ * @file    watch.c
+ * @brief   DWT data watchpoints, the DebugMonitor handler and "watch".
+ *
+ * A slot uses comparator n: COMPn holds the address, MASKn the number of
+ * low address bits ignored (the range), FUNCTIONn the access that raises
+ * a debug event (ARMv7-M ARM C1.8.17). With DEMCR.MON_EN set and no
+ * halting debugger the event is the DebugMonitor exception; the handler
+ * finds the slots by their FUNCTION.MATCHED bit, which the read clears.
+ */
+
+#include "watch.h"
+
+#if WATCH_ENABLE
+
+#include "cli_if.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* Comparator n: COMP, MASK, FUNCTION every 16 bytes from COMP0. */
+#define WATCH_DWT_COMP(n)      (*(&DWT->COMP0 + (4U * (n))))
+#define WATCH_DWT_MASK(n)      (*(&DWT->MASK0 + (4U * (n))))
+#define WATCH_DWT_FUNCTION(n)  (*(&DWT->FUNCTION0 + (4U * (n))))
+
+/* FUNCTION values: watchpoint debug event on the access. */
+#define WATCH_FN_OFF           0x0U
+#define WATCH_FN_READ          0x5U
+#define WATCH_FN_WRITE         0x6U
+#define WATCH_FN_READ_WRITE    0x7U
+
+#define WATCH_SRAM_END         (SRAM2_BASE + 0x4000UL)
+#define WATCH_NAME_TABLES      4U
+
+/* Stacked exception frame: R0-R3, R12, LR, PC, xPSR. */
+#define WATCH_FRAME_LR         5U
+#define WATCH_FRAME_PC         6U
+#define WATCH_FRAME_XPSR       7U
+#define WATCH_XPSR_EXC_MASK    0x1FFU
+
+_Static_assert((WATCH_DEPTH & (WATCH_DEPTH - 1U)) == 0U, "WATCH_DEPTH must be a power of two");
+_Static_assert((WATCH_SLOTS >= 1U) && (WATCH_SLOTS <= 4U), "the Cortex-M4 DWT has 4 comparators");
+
+typedef struct
+{
+    uintptr_t   addr;
+    uint32_t    hits;
+    uint8_t     size;
+    uint8_t     kind;           /* Watch_Kind_t */
+    uint8_t     armed;
+    const char *name;           /* NULL: a plain address */
+} Watch_Slot_t;
+
+/** Hits of one writer PC. */
+typedef struct
+{
+    uint32_t pc;
+    uint32_t lr;
+    uint32_t hits;
+    void    *task;
+    uint16_t exc;
+    uint8_t  slot;
+} Watch_Pc_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static const uint8_t s_wFn[] = { WATCH_FN_WRITE, WATCH_FN_READ, WATCH_FN_READ_WRITE };
+static const char *const s_wKindNames[] = { "w", "r", "rw" };
+
+/* Slots: written by CliTask under PRIMASK; the handler counts hits. */
+static Watch_Slot_t  s_wSlots[WATCH_SLOTS];
+
+/* Written by the handler only, above every interrupt; PRIMASK holds it
+ * off while a reader copies. */
+static Watch_Rec_t   s_wRing[WATCH_DEPTH];
+static uint32_t      s_wCount = 0U;
+static Watch_Pc_t    s_wPcs[WATCH_PCS];
+static uint32_t      s_wPcCount  = 0U;
+static uint32_t      s_wPcOthers = 0U;  /* hits of PCs past WATCH_PCS */
+
+static const Watch_Target_t *s_wTables[WATCH_NAME_TABLES];
+static uint32_t              s_wTableLen[WATCH_NAME_TABLES];
+static uint32_t              s_wTableCount = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t watch_comparators(void)
+{
+    uint32_t n = (DWT->CTRL & DWT_CTRL_NUMCOMP_Msk) >> DWT_CTRL_NUMCOMP_Pos;
+    return (n < WATCH_SLOTS) ? n : WATCH_SLOTS;
+}
+
+static uint8_t watch_any_armed(void)
+{
+    for (uint32_t i = 0U; i < WATCH_SLOTS; ++i)
+    {
+        if (s_wSlots[i].armed != 0U)
+            return 1U;
+    }
+    return 0U;
+}
+
+static uint32_t watch_value(const Watch_Slot_t *s)
+{
+    switch (s->size)
+    {
+    case 1U:
+        return *(volatile const uint8_t *)s->addr;
+    case 2U:
+        return *(volatile const uint16_t *)s->addr;
+    default:
+        return *(volatile const uint32_t *)s->addr;
+    }
+}
+
+static void watch_count_pc(const Watch_Rec_t *r)
+{
+    for (uint32_t i = 0U; i < s_wPcCount; ++i)
+    {
+        Watch_Pc_t *p = &s_wPcs[i];
+
+        if ((p->pc == r->pc) && (p->slot == r->slot))
+        {
+            p->hits++;
+            p->lr   = r->lr;
+            p->task = r->task;
+            p->exc  = r->exc;
+            return;
+        }
+    }
+
+    if (s_wPcCount >= WATCH_PCS)
+    {
+        s_wPcOthers++;
+        return;
+    }
+
+    Watch_Pc_t *p = &s_wPcs[s_wPcCount++];
+    p->pc   = r->pc;
+    p->lr   = r->lr;
+    p->hits = 1U;
+    p->task = r->task;
+    p->exc  = r->exc;
+    p->slot = r->slot;
+}
+
+static const Watch_Target_t *watch_find(const char *name)
+{
+    for (uint32_t t = 0U; t < s_wTableCount; ++t)
+    {
+        for (uint32_t i = 0U; i < s_wTableLen[t]; ++i)
+        {
+            if (strcmp(s_wTables[t][i].name, name) == 0)
+                return &s_wTables[t][i];
+        }
+    }
+    return NULL;
+}
+
+/** Task name or "irq <n>" of a writer. */
+static void watch_print_writer(uint16_t exc, void *task)
+{
+    if (exc >= 16U)
+        CLI_IF_Printf("irq %u", (unsigned)(exc - 16U));
+    else if (exc != 0U)
+        CLI_IF_Printf("exc %u", (unsigned)exc);
+    else
+        CLI_IF_Print((task != NULL) ? pcTaskGetName((TaskHandle_t)task) : "-");
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void watch_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    /* CliTask only: kept off its stack. */
+    static Watch_Pc_t pcs[WATCH_PCS];
+    uint32_t          nPcs;
+    uint32_t          others;
+    uint32_t          total;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memcpy(pcs, s_wPcs, sizeof(pcs));
+    nPcs   = s_wPcCount;
+    others = s_wPcOthers;
+    total  = s_wCount;
+    __set_PRIMASK(primask);
+
+    CLI_IF_Printf("DWT comparators %lu, DebugMonitor %s\r\n", (unsigned long)watch_comparators(),
+                  ((CoreDebug->DEMCR & CoreDebug_DEMCR_MON_EN_Msk) != 0U) ? "on" : "off");
+    if ((CoreDebug->DHCSR & CoreDebug_DHCSR_C_DEBUGEN_Msk) != 0U)
+        CLI_IF_Print("A debugger is attached: a match halts the core, nothing is recorded\r\n");
+
+    CLI_IF_Print("slot  address     bytes  kind  target            hits\r\n");
+    for (uint32_t i = 0U; i < WATCH_SLOTS; ++i)
+    {
+        const Watch_Slot_t *s = &s_wSlots[i];
+
+        if (s->armed == 0U)
+        {
+            CLI_IF_Printf("%-4lu  -\r\n", (unsigned long)i);
+            continue;
+        }
+        CLI_IF_Printf("%-4lu  0x%08lX  %5u  %-4s  %-16s %5lu\r\n", (unsigned long)i,
+                      (unsigned long)s->addr, (unsigned)s->size, s_wKindNames[s->kind],
+                      (s->name != NULL) ? s->name : "-", (unsigned long)s->hits);
+    }
+
+    if (nPcs == 0U)
+    {
+        CLI_IF_Print("No hits\r\n");
+        return;
+    }
+
+    CLI_IF_Print("Writers:  pc          lr            hits  slot  last by\r\n");
+    for (uint32_t i = 0U; i < nPcs; ++i)
+    {
+        CLI_IF_Printf("          0x%08lX  0x%08lX  %6lu  %-4u  ", (unsigned long)pcs[i].pc,
+                      (unsigned long)pcs[i].lr, (unsigned long)pcs[i].hits,
+                      (unsigned)pcs[i].slot);
+        watch_print_writer(pcs[i].exc, pcs[i].task);
+        CLI_IF_Print("\r\n");
+    }
+    CLI_IF_Printf("%lu hits, %lu from other PCs; the PC is just after the access "
+                  "(addr2line)\r\n", (unsigned long)total, (unsigned long)others);
+}
+
+static void watch_cmd_set(int argc, char *argv[])
+{
+    char    *end;
+    uint32_t slot = (uint32_t)strtoul(argv[0], &end, 10);
+
+    if ((*end != '\0') || (slot >= watch_comparators()))
+    {
+        CLI_IF_Printf("Slot 0..%lu\r\n", (unsigned long)watch_comparators() - 1U);
+        return;
+    }
+
+    const Watch_Target_t *t    = watch_find(argv[1]);
+    uintptr_t             addr = 0U;
+    uint32_t              size = 4U;
+
+    if (t != NULL)
+    {
+        addr = (uintptr_t)t->addr;
+        size = t->size;
+    }
+    else
+    {
+        addr = (uintptr_t)strtoul(argv[1], &end, 0);
+        if (*end != '\0')
+        {
+            CLI_IF_Printf("Unknown target '%s' (watch names)\r\n", argv[1]);
+            return;
+        }
+    }
+
+    Watch_Kind_t kind = WATCH_WRITE;
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "w") == 0)
+            kind = WATCH_WRITE;
+        else if (strcmp(argv[i], "r") == 0)
+            kind = WATCH_READ;
+        else if (strcmp(argv[i], "rw") == 0)
+            kind = WATCH_READ_WRITE;
+        else
+        {
+            size = (uint32_t)strtoul(argv[i], &end, 10);
+            if (*end != '\0')
+            {
+                CLI_IF_Print("Usage: watch set <slot> <name|addr> [bytes] [w|r|rw]\r\n");
+                return;
+            }
+        }
+    }
+
+    if (Watch_Set(slot, addr, size, kind) != HAL_OK)
+    {
+        CLI_IF_Printf("Cannot watch %lu bytes at 0x%08lX: 1..%u bytes, a power of two, "
+                      "aligned, in SRAM\r\n", (unsigned long)size, (unsigned long)addr,
+                      (unsigned)WATCH_MAX_BYTES);
+        return;
+    }
+    s_wSlots[slot].name = (t != NULL) ? t->name : NULL;
+
+    CLI_IF_Printf("Slot %lu: %s of %lu bytes at 0x%08lX\r\n", (unsigned long)slot,
+                  (kind == WATCH_WRITE) ? "writes" : ((kind == WATCH_READ) ? "reads" : "accesses"),
+                  (unsigned long)size, (unsigned long)addr);
+    if ((CoreDebug->DHCSR & CoreDebug_DHCSR_C_DEBUGEN_Msk) != 0U)
+        CLI_IF_Print("A debugger is attached: a match halts the core\r\n");
+}
+
+static void watch_cmd_clear(int argc, char *argv[])
+{
+    if (argc == 0)
+    {
+        for (uint32_t i = 0U; i < WATCH_SLOTS; ++i)
+            Watch_Clear(i);
+        CLI_IF_Print("All slots disarmed\r\n");
+        return;
+    }
+
+    char    *end;
+    uint32_t slot = (uint32_t)strtoul(argv[0], &end, 10);
+
+    if ((*end != '\0') || (slot >= WATCH_SLOTS))
+    {
+        CLI_IF_Print("Usage: watch clear [<slot>]\r\n");
+        return;
+    }
+    Watch_Clear(slot);
+    CLI_IF_Printf("Slot %lu disarmed\r\n", (unsigned long)slot);
+}
+
+static void watch_cmd_log(int argc, char *argv[])
+{
+    uint32_t want = WATCH_DEPTH;
+
+    if (argc > 0)
+    {
+        char *end;
+
+        want = (uint32_t)strtoul(argv[0], &end, 10);
+        if ((*end != '\0') || (want == 0U))
+        {
+            CLI_IF_Print("Usage: watch log [<n>]\r\n");
+            return;
+        }
+    }
+
+    /* CliTask only: kept off its stack. */
+    static Watch_Rec_t rec[WATCH_DEPTH];
+    uint32_t           n = Watch_Read(want, rec);
+
+    if (n == 0U)
+    {
+        CLI_IF_Print("No hits\r\n");
+        return;
+    }
+
+    CLI_IF_Print("   time ms      cycles  slot  pc          lr          value       by\r\n");
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        const Watch_Rec_t *r = &rec[i];
+
+        CLI_IF_Printf("%10lu  %10lu  %-4u  0x%08lX  0x%08lX  0x%08lX  ", (unsigned long)r->timeMs,
+                      (unsigned long)r->cycles, (unsigned)r->slot, (unsigned long)r->pc,
+                      (unsigned long)r->lr, (unsigned long)r->value);
+        watch_print_writer(r->exc, r->task);
+        CLI_IF_Print("\r\n");
+    }
+}
+
+static void watch_cmd_names(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if (s_wTableCount == 0U)
+    {
+        CLI_IF_Print("No named targets; give an SRAM address\r\n");
+        return;
+    }
+
+    for (uint32_t t = 0U; t < s_wTableCount; ++t)
+    {
+        for (uint32_t i = 0U; i < s_wTableLen[t]; ++i)
+        {
+            const Watch_Target_t *w = &s_wTables[t][i];
+
+            CLI_IF_Printf("%-16s 0x%08lX  %u bytes\r\n", w->name, (unsigned long)(uintptr_t)w->addr,
+                          (unsigned)w->size);
+        }
+    }
+}
+
+static const CliCommand_t s_wCmds[] =
+{
+    { "watch",       "",                                 0U, watch_cmd_show,
+      "data watchpoints and the hits per writer PC" },
+    { "watch set",   "<slot> <name|addr> [bytes] [w|r|rw]", 2U, watch_cmd_set,
+      "trap accesses to a variable (DWT comparator)" },
+    { "watch clear", "[<slot>]",                         0U, watch_cmd_clear,
+      "disarm one watchpoint or all" },
+    { "watch log",   "[<n>]",                            0U, watch_cmd_log,
+      "trapped accesses, newest first" },
+    { "watch names", "",                                 0U, watch_cmd_names,
+      "named watch targets" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void Watch_Init(void)
+{
+    /* Above every interrupt, so a writer in an ISR is caught in place. */
+    HAL_NVIC_SetPriority(DebugMonitor_IRQn, WATCH_IRQ_PRIO, 0U);
+
+    CLI_IF_REGISTER_TABLE(s_wCmds);
+}
+
+HAL_StatusTypeDef Watch_Register(const Watch_Target_t *targets, uint32_t count)
+{
+    if ((targets == NULL) || (s_wTableCount >= WATCH_NAME_TABLES))
+        return HAL_ERROR;
+
+    s_wTables[s_wTableCount]   = targets;
+    s_wTableLen[s_wTableCount] = count;
+    s_wTableCount++;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef Watch_Set(uint32_t slot, uintptr_t addr, uint32_t size, Watch_Kind_t kind)
+{
+    if ((slot >= watch_comparators()) || ((uint32_t)kind > (uint32_t)WATCH_READ_WRITE) ||
+        (size == 0U) || (size > WATCH_MAX_BYTES) || ((size & (size - 1U)) != 0U) ||
+        ((addr & (size - 1U)) != 0U) || (addr < SRAM1_BASE) || ((addr + size) > WATCH_SRAM_END))
+    {
+        return HAL_ERROR;
+    }
+
+    uint32_t mask = 0U;
+    while ((1UL << mask) < size)
+        mask++;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    WATCH_DWT_FUNCTION(slot) = WATCH_FN_OFF;
+    WATCH_DWT_COMP(slot)     = (uint32_t)addr;
+    WATCH_DWT_MASK(slot)     = mask;
+    (void)WATCH_DWT_FUNCTION(slot);     /* clears a stale MATCHED */
+
+    Watch_Slot_t *s = &s_wSlots[slot];
+    s->addr  = addr;
+    s->size  = (uint8_t)size;
+    s->kind  = (uint8_t)kind;
+    s->hits  = 0U;
+    s->name  = NULL;
+    s->armed = 1U;
+
+    WATCH_DWT_FUNCTION(slot) = s_wFn[kind];
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_MON_EN_Msk;
+
+    __set_PRIMASK(primask);
+    return HAL_OK;
+}
+
+void Watch_Clear(uint32_t slot)
+{
+    if (slot >= WATCH_SLOTS)
+        return;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    WATCH_DWT_FUNCTION(slot) = WATCH_FN_OFF;
+    s_wSlots[slot].armed = 0U;
+    if (watch_any_armed() == 0U)
+        CoreDebug->DEMCR &= ~CoreDebug_DEMCR_MON_EN_Msk;
+
+    __set_PRIMASK(primask);
+}
+
+uint32_t Watch_Read(uint32_t count, Watch_Rec_t *out)
+{
+    uint32_t got = 0U;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint32_t held = (s_wCount < WATCH_DEPTH) ? s_wCount : WATCH_DEPTH;
+    for (uint32_t i = 0U; (i < held) && (got < count); ++i)
+        out[got++] = s_wRing[(s_wCount - 1U - i) & (WATCH_DEPTH - 1U)];
+
+    __set_PRIMASK(primask);
+    return got;
+}
+
+void Watch_DebugMon(const uint32_t *frame)
+{
+    uint32_t dfsr = SCB->DFSR;
+
+    SCB->DFSR = dfsr;           /* write-one-to-clear */
+    if ((dfsr & SCB_DFSR_DWTTRAP_Msk) == 0U)
+        return;
+
+    for (uint32_t i = 0U; i < WATCH_SLOTS; ++i)
+    {
+        Watch_Slot_t *s = &s_wSlots[i];
+
+        if ((s->armed == 0U) || ((WATCH_DWT_FUNCTION(i) & DWT_FUNCTION_MATCHED_Msk) == 0U))
+            continue;
+
+        Watch_Rec_t *r = &s_wRing[s_wCount & (WATCH_DEPTH - 1U)];
+        r->cycles = DWT->CYCCNT;
+        r->timeMs = HAL_GetTick();
+        r->pc     = frame[WATCH_FRAME_PC];
+        r->lr     = frame[WATCH_FRAME_LR];
+        r->value  = watch_value(s);
+        r->task   = xTaskGetCurrentTaskHandle();
+        r->exc    = (uint16_t)(frame[WATCH_FRAME_XPSR] & WATCH_XPSR_EXC_MASK);
+        r->slot   = (uint8_t)i;
+        s_wCount++;
+        s->hits++;
+
+        watch_count_pc(r);
+    }
+}
+
+#endif /* WATCH_ENABLE */
@@ -0,0 +1,289 @@
+/**
+ * @file    watchdog.c
+ * @brief   IWDG, WdgTask supervising the task check-ins, "wdg" commands.
+ */
+
+#include "watchdog.h"
+#include "crash_dump.h"
+#include "cli_if.h"
+#include "log.h"
+#include "sys_config.h"
+#include "cmsis_os2.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* IWDG keys (RM0390 19.4) */
+#define WD_KEY_RELOAD       0xAAAAU
+#define WD_KEY_ACCESS       0x5555U
+#define WD_KEY_START        0xCCCCU
+
+/* LSI / 32: one count per ms at the nominal 32 kHz. */
+#define WD_LSI_HZ           32000U
+#define WD_PR_DIV32         3U
+#define WD_RELOAD           (((WATCHDOG_TIMEOUT_MS * (WD_LSI_HZ / 32U)) / 1000U) - 1U)
+
+/* Watchdog_Stretch(): LSI / 256, full reload. The LSI runs at 17..47 kHz
+ * (datasheet), so this lasts 4096 * 256 / 47 kHz = 22 s or more against the
+ * 2 s worst-case 128 KB sector erase. */
+#define WD_PR_DIV256        6U
+#define WD_LSI_MAX_HZ       47000U
+#define WD_STRETCH_MIN_MS   (((IWDG_RLR_RL + 1U) * 256U) / (WD_LSI_MAX_HZ / 1000U))
+
+_Static_assert((WD_RELOAD > 0U) && (WD_RELOAD <= IWDG_RLR_RL), "WATCHDOG_TIMEOUT_MS out of the IWDG range");
+_Static_assert(WD_STRETCH_MIN_MS >= (4U * WATCHDOG_ERASE_MAX_MS), "a stretched IWDG must outlast a sector erase");
+_Static_assert(WATCHDOG_TIMEOUT_MS >= (4U * WATCHDOG_CHECK_MS), "the IWDG must outlast several checks");
+
+typedef struct
+{
+    const char *name;
+    uint32_t    deadlineMs;
+} Wd_Cfg_t;
+
+typedef struct
+{
+    TaskHandle_t handle;       /* NULL until Watchdog_Start() */
+    uint32_t     lastMs;       /* Tick of the last check-in seen */
+    uint32_t     maxGapMs;     /* Longest time between two check-ins */
+} Wd_Entry_t;
+
+#define WD_CFG_(name, text, deadlineMs)   { (text), (deadlineMs) },
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+volatile uint32_t g_watchdogAlive = 0U;
+
+static const Wd_Cfg_t s_wdCfg[WATCHDOG_TASK_COUNT] = { WATCHDOG_TASK_TABLE(WD_CFG_) };
+
+/* Written by WdgTask, and by Watchdog_Start() under PRIMASK; readers copy
+ * under PRIMASK. */
+static Wd_Entry_t s_wdEntry[WATCHDOG_TASK_COUNT];
+static uint32_t   s_wdKicks  = 0U;
+static uint8_t    s_wdRunning = 0U;  /* IWDG started: its LSI domain answers */
+static uint32_t   s_wdStalls = 0U;   /* Late WdgTask runs, deadlines restarted */
+
+static StaticTask_t s_wdTaskCb;
+static StackType_t  s_wdStack[SYS_WORDS_WdgTask];
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** New PR / RLR, then a reload with them; the IWDG is running. */
+static void wd_set(uint32_t pr, uint32_t rlr)
+{
+    IWDG->KR  = WD_KEY_RELOAD;
+    IWDG->KR  = WD_KEY_ACCESS;
+    IWDG->PR  = pr;
+    IWDG->RLR = rlr;
+    while ((IWDG->SR & (IWDG_SR_PVU | IWDG_SR_RVU)) != 0U)
+    {
+    }
+    IWDG->KR  = WD_KEY_RELOAD;
+}
+
+/** Take the check-in bits and clear them. */
+static uint32_t wd_take(void)
+{
+    uint32_t bits;
+
+    do
+    {
+        bits = __LDREXW(&g_watchdogAlive);
+    } while (__STREXW(0U, &g_watchdogAlive) != 0U);
+
+    return bits;
+}
+
+/** @p task is late: log it, record it and reset. */
+static void __attribute__((noreturn)) wd_expire(uint32_t task, uint32_t nowMs)
+{
+    LOG_ERROR(MAIN, "Watchdog: %s has not checked in for %lu ms (deadline %lu ms)",
+              s_wdCfg[task].name, (unsigned long)(nowMs - s_wdEntry[task].lastMs),
+              (unsigned long)s_wdCfg[task].deadlineMs);
+    CrashDump_Watchdog(s_wdEntry[task].handle);
+}
+
+static void wd_task(void *argument)
+{
+    (void)argument;
+
+    uint32_t period = pdMS_TO_TICKS(WATCHDOG_CHECK_MS);
+    uint32_t next   = osKernelGetTickCount();
+    uint32_t prev   = next;
+
+    for (;;)
+    {
+        next += period;
+        (void)osDelayUntil(next);
+
+        uint32_t now     = osKernelGetTickCount();
+        uint32_t alive   = wd_take();
+        uint8_t  stalled = ((now - prev) > (2U * period)) ? 1U : 0U;
+
+        prev = now;
+
+        for (uint32_t i = 0U; i < WATCHDOG_TASK_COUNT; ++i)
+        {
+            Wd_Entry_t *e = &s_wdEntry[i];
+
+            if (e->handle == NULL)
+                continue;
+
+            if (((alive & (1UL << i)) != 0U) || (stalled != 0U))
+            {
+                uint32_t gap = now - e->lastMs;
+
+                uint32_t primask = __get_PRIMASK();
+                __disable_irq();
+                if (gap > e->maxGapMs)
+                    e->maxGapMs = gap;
+                e->lastMs = now;
+                __set_PRIMASK(primask);
+            }
+            else if ((now - e->lastMs) > s_wdCfg[i].deadlineMs)
+            {
+                wd_expire(i, now);
+            }
+        }
+
+        IWDG->KR = WD_KEY_RELOAD;
+        s_wdKicks++;
+
+        /* Nothing ran for a while (scheduler suspended for a flash erase):
+         * back on the grid from now rather than catching up. */
+        if (stalled != 0U)
+        {
+            s_wdStalls++;
+            next = now;
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void wd_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t now = osKernelGetTickCount();
+
+    CLI_IF_Printf("IWDG %lu ms, check every %lu ms: %lu kicks, %lu stalls\r\n",
+                  (unsigned long)WATCHDOG_TIMEOUT_MS, (unsigned long)WATCHDOG_CHECK_MS,
+                  (unsigned long)s_wdKicks, (unsigned long)s_wdStalls);
+    CLI_IF_Print("Task          deadline   last_ms max_gap_ms\r\n");
+    for (uint32_t i = 0U; i < WATCHDOG_TASK_COUNT; ++i)
+    {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        Wd_Entry_t e = s_wdEntry[i];
+        __set_PRIMASK(primask);
+
+        if (e.handle == NULL)
+        {
+            CLI_IF_Printf("%-12s %9lu  not started\r\n", s_wdCfg[i].name,
+                          (unsigned long)s_wdCfg[i].deadlineMs);
+            continue;
+        }
+        CLI_IF_Printf("%-12s %9lu %9lu %10lu\r\n", s_wdCfg[i].name,
+                      (unsigned long)s_wdCfg[i].deadlineMs, (unsigned long)(now - e.lastMs),
+                      (unsigned long)e.maxGapMs);
+    }
+}
+
+/** Stop a supervised task, to see the watchdog catch it. */
+static void wd_cmd_test(int argc, char *argv[])
+{
+    (void)argc;
+
+    for (uint32_t i = 0U; i < WATCHDOG_TASK_COUNT; ++i)
+    {
+        if (strcmp(argv[0], s_wdCfg[i].name) != 0)
+            continue;
+
+        if (s_wdEntry[i].handle == NULL)
+        {
+            CLI_IF_Printf("%s is not supervised\r\n", s_wdCfg[i].name);
+            return;
+        }
+        CLI_IF_Printf("Suspending %s, reset in about %lu ms\r\n", s_wdCfg[i].name,
+                      (unsigned long)s_wdCfg[i].deadlineMs);
+        vTaskSuspend(s_wdEntry[i].handle);
+        return;
+    }
+
+    CLI_IF_Print("Unknown task, see \"wdg\"\r\n");
+}
+
+static const CliCommand_t s_wdCmds[] =
+{
+    { "wdg",      "",       0U, wd_cmd_show, "Watchdog: task deadlines and check-ins" },
+    { "wdg test", "<task>", 1U, wd_cmd_test, "Suspend a supervised task (resets the ECU)" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef Watchdog_Init(void)
+{
+    const osThreadAttr_t attr =
+    {
+        .name       = "WdgTask",
+        .priority   = (osPriority_t)SYS_PRIO_WdgTask,
+        .cb_mem     = &s_wdTaskCb,
+        .cb_size    = sizeof(s_wdTaskCb),
+        .stack_mem  = s_wdStack,
+        .stack_size = sizeof(s_wdStack)
+    };
+
+    if (osThreadNew(wd_task, NULL, &attr) == NULL)
+        return HAL_ERROR;
+
+    /* Stopped with the core under a debugger, like the breakpoints. */
+    DBGMCU->APB1FZ |= DBGMCU_APB1_FZ_DBG_IWDG_STOP;
+
+    /* Starting the IWDG turns the LSI on. PR and RLR are written in the LSI
+     * domain; the update flags clear within a few LSI cycles. */
+    IWDG->KR  = WD_KEY_START;
+    wd_set(WD_PR_DIV32, WD_RELOAD);
+    s_wdRunning = 1U;
+
+    CLI_IF_REGISTER_TABLE(s_wdCmds);
+
+    return HAL_OK;
+}
+
+void Watchdog_Stretch(void)
+{
+    if (s_wdRunning != 0U)
+        wd_set(WD_PR_DIV256, IWDG_RLR_RL);
+}
+
+void Watchdog_Restore(void)
+{
+    if (s_wdRunning != 0U)
+        wd_set(WD_PR_DIV32, WD_RELOAD);
+}
+
+void Watchdog_Start(Watchdog_Task_t task)
+{
+    if ((uint32_t)task >= WATCHDOG_TASK_COUNT)
+        return;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_wdEntry[task].lastMs   = osKernelGetTickCount();
+    s_wdEntry[task].maxGapMs = 0U;
+    s_wdEntry[task].handle   = xTaskGetCurrentTaskHandle();
+    __set_PRIMASK(primask);
+}
@@ -0,0 +1,366 @@
+/**
+ * @file    wheel_pulse.c
+ * @brief   Wheel-speed pulse generator (TIM11), DMA input capture (TIM1)
+ *          and "sensor pulse". See wheel_pulse.h.
+ */
+
+#include "wheel_pulse.h"
+#include "cli_if.h"
+#include "clock_cfg.h"
+#include "platform_dma.h"
+#include "vehicle_shared.h"
+#include <string.h>
+
+#if WHEEL_PULSE_ENABLE
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define WP_AF_TIM11         3U          /* PB9 = TIM11_CH1 */
+#define WP_AF_TIM1          1U          /* PA8 = TIM1_CH1 */
+
+/* DMA2 Stream3 channel 6 = TIM1_CH1. */
+#define WP_DMA              DMA2_Stream3
+#define WP_DMA_CHSEL        6U
+#define WP_DMA_S3_FLAGS     (DMA_LIFCR_CFEIF3 | DMA_LIFCR_CDMEIF3 | DMA_LIFCR_CTEIF3 | \
+                             DMA_LIFCR_CHTIF3 | DMA_LIFCR_CTCIF3)
+
+/** Pulse frequency per km/h. */
+#define WP_HZ_PER_KPH       (((float)WHEEL_PULSE_TEETH * 1000.0f) / \
+                             (3.6f * (float)WHEEL_PULSE_CIRC_MM))
+
+/** Slowest pulse train the capture follows; the generator stops below. */
+#define WP_MIN_HZ           (1000.0f / (float)WHEEL_PULSE_TIMEOUT_MS)
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Written by DMA2 Stream3 only. */
+PLATFORM_DMA_BUFFER static uint16_t s_wpRing[WHEEL_PULSE_RING];
+
+_Static_assert((sizeof(s_wpRing) % PLATFORM_DMA_ALIGN) == 0U, "WHEEL_PULSE_RING: whole cache lines");
+
+/* SensorTask only. */
+static WheelPulse_Reading_t s_wpWork;
+static uint32_t s_wpTail   = 0U;        /* next ring entry to read */
+static uint16_t s_wpLast   = 0U;        /* timestamp of the last edge ... */
+static uint8_t  s_wpChain  = 0U;        /* ... if the next one may be differenced to it */
+static uint32_t s_wpLastMs = 0U;        /* tick of the block that took it */
+static uint32_t s_wpGenMs  = 0U;        /* tick the generator last started */
+static float    s_wpHz     = 0.0f;      /* from the last periods */
+
+/* A clock change breaks the chain; set by the governor. */
+static volatile uint8_t s_wpResync = 0U;
+
+/* Published; readers copy under PRIMASK. */
+static WheelPulse_Reading_t s_wpCopy;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** TIM11 PSC / ARR for @p hz, not below WP_MIN_HZ. */
+static void wp_gen_timing(float hz, uint32_t *psc, uint32_t *arr)
+{
+    uint32_t counts = (uint32_t)((float)ClockCfg_Apb2TimerHz() / hz);
+
+    *psc = (counts - 1U) / 65536U;
+    *arr = (counts / (*psc + 1U)) - 1U;
+}
+
+/** Period and duty together at the next update, as fan_ctrl.c does. */
+static void wp_gen_write(uint32_t psc, uint32_t arr, uint32_t ccr)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    TIM11->CR1 |= TIM_CR1_UDIS;
+    TIM11->PSC  = psc;
+    TIM11->ARR  = arr;
+    TIM11->CCR1 = ccr;
+    TIM11->CR1 &= ~TIM_CR1_UDIS;
+    __set_PRIMASK(primask);
+}
+
+/** Put @p hz on PB9; below WP_MIN_HZ the pin stays low. */
+static void wp_generate(float hz, uint32_t now)
+{
+    uint32_t psc = TIM11->PSC;
+    uint32_t arr = TIM11->ARR;
+    uint32_t ccr = 0U;
+
+    if (hz >= WP_MIN_HZ)
+    {
+        wp_gen_timing(hz, &psc, &arr);
+        ccr = (arr + 1U) / 2U;
+        if (s_wpWork.genHz == 0.0f)
+            s_wpGenMs = now;
+    }
+    else
+    {
+        hz = 0.0f;
+    }
+
+    if ((psc != TIM11->PSC) || (arr != TIM11->ARR) || (ccr != TIM11->CCR1))
+        wp_gen_write(psc, arr, ccr);
+
+    s_wpWork.genHz = (ccr != 0U) ? ((float)ClockCfg_Apb2TimerHz() / ((float)(psc + 1U) * (float)(arr + 1U)))
+                                 : 0.0f;
+}
+
+/** Take the edges the DMA wrote since the last block. */
+static void wp_capture(uint32_t now)
+{
+    WheelPulse_Reading_t *w = &s_wpWork;
+    uint32_t head  = (WHEEL_PULSE_RING - WP_DMA->NDTR) % WHEEL_PULSE_RING;
+    uint32_t edges = 0U;
+    uint32_t n     = 0U;
+    uint32_t sum   = 0U;
+    uint32_t dMin  = 0xFFFFFFFFU;
+    uint32_t dMax  = 0U;
+
+    if ((TIM1->SR & TIM_SR_CC1OF) != 0U)
+    {
+        TIM1->SR = ~TIM_SR_CC1OF;
+        w->overcaptures++;
+    }
+
+    if (s_wpResync != 0U)
+    {
+        s_wpResync = 0U;
+        s_wpChain  = 0U;
+        w->resyncs++;
+    }
+
+    /* Past the timeout the counter may have wrapped since the last edge. */
+    uint8_t timedOut = ((now - s_wpLastMs) > WHEEL_PULSE_TIMEOUT_MS) ? 1U : 0U;
+    if (timedOut != 0U)
+        s_wpChain = 0U;
+
+    /* The whole ring: the CPU never writes it. */
+    if (s_wpTail != head)
+        PlatformDma_Invalidate(s_wpRing, (uint32_t)sizeof(s_wpRing));
+
+    while (s_wpTail != head)
+    {
+        uint16_t t = s_wpRing[s_wpTail];
+
+        s_wpTail = (s_wpTail + 1U) % WHEEL_PULSE_RING;
+        if (s_wpChain != 0U)
+        {
+            uint32_t d = (uint16_t)(t - s_wpLast);
+
+            sum += d;
+            n++;
+            if (d < dMin)
+                dMin = d;
+            if (d > dMax)
+                dMax = d;
+        }
+        s_wpLast  = t;
+        s_wpChain = 1U;
+        edges++;
+    }
+
+    float hz = s_wpHz;
+
+    if (edges != 0U)
+    {
+        s_wpLastMs = now;
+        if ((n != 0U) && (sum != 0U))
+            hz = ((float)n * (float)WHEEL_PULSE_TICK_HZ) / (float)sum;
+        s_wpHz = hz;
+    }
+    else if (timedOut != 0U)
+    {
+        if (s_wpHz != 0.0f)
+            w->standstills++;
+        s_wpHz = 0.0f;
+        hz     = 0.0f;
+    }
+    else
+    {
+        /* No edge yet: the wheel turns at most once per time waited. */
+        float bound = 1000.0f / (float)((now - s_wpLastMs) + 1U);
+        if (hz > bound)
+            hz = bound;
+    }
+
+    w->hz          = hz;
+    w->speedKph    = hz / WP_HZ_PER_KPH;
+    w->blockEdges  = (uint16_t)edges;
+    w->edges      += edges;
+    w->periodMinUs = (n != 0U) ? (uint32_t)(((uint64_t)dMin * 1000000U) / WHEEL_PULSE_TICK_HZ) : 0U;
+    w->periodMaxUs = (n != 0U) ? (uint32_t)(((uint64_t)dMax * 1000000U) / WHEEL_PULSE_TICK_HZ) : 0U;
+    w->noSignal    = ((w->genHz != 0.0f) && (timedOut != 0U) && (edges == 0U) &&
+                      ((now - s_wpGenMs) > WHEEL_PULSE_TIMEOUT_MS)) ? 1U : 0U;
+    w->valid       = (w->noSignal == 0U) ? 1U : 0U;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void wp_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    WheelPulse_Reading_t r;
+    WheelPulse_Get(&r);
+
+    CLI_IF_Printf("Wheel pulses, %u teeth, %u mm, %.2f Hz per km/h: TIM11 PB9 -> TIM1 PA8\r\n",
+                  (unsigned)WHEEL_PULSE_TEETH, (unsigned)WHEEL_PULSE_CIRC_MM, (double)WP_HZ_PER_KPH);
+    CLI_IF_Printf("  generated %9.2f Hz  %7.2f km/h\r\n",
+                  (double)r.genHz, (double)(r.genHz / WP_HZ_PER_KPH));
+    CLI_IF_Printf("  measured  %9.2f Hz  %7.2f km/h  %s\r\n", (double)r.hz, (double)r.speedKph,
+                  (r.noSignal != 0U) ? "NO SIGNAL" : ((r.hz == 0.0f) ? "standstill" : "valid"));
+    CLI_IF_Printf("Last block %u edges, period %lu..%lu us; %lu edges in %lu blocks\r\n",
+                  (unsigned)r.blockEdges, (unsigned long)r.periodMinUs, (unsigned long)r.periodMaxUs,
+                  (unsigned long)r.edges, (unsigned long)r.blocks);
+    CLI_IF_Printf("%lu standstills, %lu overcaptures, %lu resyncs\r\n",
+                  (unsigned long)r.standstills, (unsigned long)r.overcaptures,
+                  (unsigned long)r.resyncs);
+}
+
+static const CliCommand_t s_wpCmds[] =
+{
+    { "sensor pulse", "", 0U, wp_cmd_show, "wheel-speed pulses: generated vs captured" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef WheelPulse_Init(void)
+{
+    GPIO_InitTypeDef gpio = {0};
+    uint32_t         psc;
+    uint32_t         arr;
+
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    __HAL_RCC_TIM1_CLK_ENABLE();
+    __HAL_RCC_TIM11_CLK_ENABLE();
+
+    gpio.Pin       = GPIO_PIN_9;
+    gpio.Mode      = GPIO_MODE_AF_PP;
+    gpio.Pull      = GPIO_NOPULL;
+    gpio.Speed     = GPIO_SPEED_FREQ_LOW;
+    gpio.Alternate = WP_AF_TIM11;
+    HAL_GPIO_Init(GPIOB, &gpio);
+
+    /* Without the jumper the input rests low instead of floating. */
+    gpio.Pin       = GPIO_PIN_8;
+    gpio.Pull      = GPIO_PULLDOWN;
+    gpio.Alternate = WP_AF_TIM1;
+    HAL_GPIO_Init(GPIOA, &gpio);
+
+    /* TIM11: PWM mode 1, everything preloaded; low until the first block. */
+    wp_gen_timing(WP_MIN_HZ, &psc, &arr);
+    TIM11->CR1   = TIM_CR1_ARPE;
+    TIM11->PSC   = psc;
+    TIM11->ARR   = arr;
+    TIM11->CCR1  = 0U;
+    TIM11->CCMR1 = TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1 | TIM_CCMR1_OC1PE;
+    TIM11->CCER  = TIM_CCER_CC1E;
+    TIM11->EGR   = TIM_EGR_UG;
+    TIM11->CR1  |= TIM_CR1_CEN;
+
+    /* DMA2 Stream3: CCR1 to the ring, halfwords, circular, no interrupts. */
+    WP_DMA->CR = 0U;
+    while ((WP_DMA->CR & DMA_SxCR_EN) != 0U)
+    {
+    }
+    DMA2->LIFCR  = WP_DMA_S3_FLAGS;
+    WP_DMA->PAR  = (uint32_t)&TIM1->CCR1;
+    WP_DMA->M0AR = (uint32_t)&s_wpRing[0];
+    WP_DMA->NDTR = WHEEL_PULSE_RING;
+    WP_DMA->FCR  = 0U;
+    WP_DMA->CR   = (WP_DMA_CHSEL << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_MSIZE_0 | DMA_SxCR_PSIZE_0 |
+                   DMA_SxCR_MINC | DMA_SxCR_CIRC;
+    WP_DMA->CR  |= DMA_SxCR_EN;
+
+    /* TIM1: free-running 16-bit count at WHEEL_PULSE_TICK_HZ; CH1 latches
+     * rising edges of TI1 (8-sample filter) and requests the DMA. */
+    TIM1->CR1   = 0U;
+    TIM1->PSC   = (ClockCfg_Apb2TimerHz() / WHEEL_PULSE_TICK_HZ) - 1U;
+    TIM1->ARR   = 0xFFFFU;
+    TIM1->CCMR1 = TIM_CCMR1_CC1S_0 | TIM_CCMR1_IC1F_1 | TIM_CCMR1_IC1F_0;
+    TIM1->CCER  = TIM_CCER_CC1E;
+    TIM1->DIER  = TIM_DIER_CC1DE;
+    TIM1->EGR   = TIM_EGR_UG;
+    TIM1->SR    = 0U;
+    TIM1->CR1   = TIM_CR1_CEN;
+
+    s_wpLastMs = HAL_GetTick();
+
+    CLI_IF_REGISTER_TABLE(s_wpCmds);
+
+    return HAL_OK;
+}
+
+void WheelPulse_Block(void)
+{
+    VehicleState_t vs;
+    uint32_t       now = HAL_GetTick();
+
+    Vehicle_GetSnapshot(&vs);
+    wp_generate(vs.speed_kph * WP_HZ_PER_KPH, now);
+    wp_capture(now);
+    s_wpWork.blocks++;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_wpCopy = s_wpWork;
+    __set_PRIMASK(primask);
+}
+
+void WheelPulse_Get(WheelPulse_Reading_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *out = s_wpCopy;
+    __set_PRIMASK(primask);
+}
+
+void WheelPulse_ClockChanged(void)
+{
+    uint32_t psc;
+    uint32_t arr;
+
+    /* Same frequency from the new clock; the next block refines it. */
+    if (TIM11->CCR1 != 0U)
+    {
+        wp_gen_timing((s_wpCopy.genHz >= WP_MIN_HZ) ? s_wpCopy.genHz : WP_MIN_HZ, &psc, &arr);
+        wp_gen_write(psc, arr, (arr + 1U) / 2U);
+    }
+
+    /* Ticks before and after the switch do not difference. */
+    ClockCfg_RetimeTimer(TIM1, (ClockCfg_Apb2TimerHz() / WHEEL_PULSE_TICK_HZ) - 1U, 0xFFFFU);
+    s_wpResync = 1U;
+}
+
+#else /* !WHEEL_PULSE_ENABLE */
+
+HAL_StatusTypeDef WheelPulse_Init(void)
+{
+    return HAL_OK;
+}
+
+void WheelPulse_Block(void)
+{
+}
+
+void WheelPulse_Get(WheelPulse_Reading_t *out)
+{
+    memset(out, 0, sizeof(*out));
+}
+
+void WheelPulse_ClockChanged(void)
+{
+}
+
+#endif /* WHEEL_PULSE_ENABLE */
@@ -0,0 +1,763 @@
+/**
+ * @file    xcp.c
+ * @brief   XCP-on-CAN command processor, DAQ sampling and "xcp".
+ */
+
+#include "xcp.h"
+#include "can_if.h"
+#include "cal.h"
+#include "cli_if.h"
+#include "log.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define XCP_CMD_CONNECT                 0xFFU
+#define XCP_CMD_DISCONNECT              0xFEU
+#define XCP_CMD_GET_STATUS              0xFDU
+#define XCP_CMD_SYNCH                   0xFCU
+#define XCP_CMD_SET_MTA                 0xF6U
+#define XCP_CMD_UPLOAD                  0xF5U
+#define XCP_CMD_SHORT_UPLOAD            0xF4U
+#define XCP_CMD_DOWNLOAD                0xF0U
+#define XCP_CMD_SET_DAQ_PTR             0xE2U
+#define XCP_CMD_WRITE_DAQ               0xE1U
+#define XCP_CMD_SET_DAQ_LIST_MODE       0xE0U
+#define XCP_CMD_START_STOP_DAQ_LIST     0xDEU
+#define XCP_CMD_START_STOP_SYNCH        0xDDU
+#define XCP_CMD_GET_DAQ_CLOCK           0xDCU
+#define XCP_CMD_GET_DAQ_PROCESSOR_INFO  0xDAU
+#define XCP_CMD_GET_DAQ_RESOLUTION_INFO 0xD9U
+#define XCP_CMD_FREE_DAQ                0xD6U
+#define XCP_CMD_ALLOC_DAQ               0xD5U
+#define XCP_CMD_ALLOC_ODT               0xD4U
+#define XCP_CMD_ALLOC_ODT_ENTRY         0xD3U
+
+#define XCP_PID_RES                     0xFFU
+#define XCP_PID_ERR                     0xFEU
+
+#define XCP_ERR_CMD_SYNCH               0x00U
+#define XCP_ERR_DAQ_ACTIVE              0x11U
+#define XCP_ERR_CMD_UNKNOWN             0x20U
+#define XCP_ERR_CMD_SYNTAX              0x21U
+#define XCP_ERR_OUT_OF_RANGE            0x22U
+#define XCP_ERR_ACCESS_DENIED           0x24U
+#define XCP_ERR_MODE_NOT_VALID          0x27U
+#define XCP_ERR_SEQUENCE                0x29U
+#define XCP_ERR_DAQ_CONFIG              0x2AU
+#define XCP_ERR_MEMORY_OVERFLOW         0x30U
+
+#define XCP_RESOURCE_CAL_PAG            0x01U
+#define XCP_RESOURCE_DAQ                0x04U
+#define XCP_SESSION_DAQ_RUNNING         0x40U
+
+/* DAQ list mode bits (SET_DAQ_LIST_MODE). */
+#define XCP_DAQ_MODE_DIRECTION          0x02U   /* STIM: not supported */
+#define XCP_DAQ_MODE_TIMESTAMP          0x10U
+#define XCP_DAQ_MODE_PID_OFF            0x20U   /* not supported */
+
+/* GET_DAQ_PROCESSOR_INFO: dynamic, prescaler, timestamps; absolute ODT
+ * numbers as PID. Timestamps: 2 bytes, unit 10 us, 1 tick per unit. */
+#define XCP_DAQ_PROPERTIES              0x13U
+#define XCP_DAQ_KEY_BYTE                0x00U
+#define XCP_TIMESTAMP_MODE              0x42U
+#define XCP_TIMESTAMP_SIZE              2U
+
+#define XCP_MAX_CTO                     8U
+#define XCP_MAX_DTO                     8U
+#define XCP_ODT_PAYLOAD                 (XCP_MAX_DTO - 1U)
+#define XCP_UPLOAD_MAX                  (XCP_MAX_CTO - 1U)
+
+/* Allocation sequence of the dynamic DAQ commands. */
+#define XCP_ALLOC_FREED                 0U
+#define XCP_ALLOC_DAQ                   1U
+#define XCP_ALLOC_ODT                   2U
+#define XCP_ALLOC_ENTRY                 3U
+
+/* Memory the tool may read: SRAM1 + SRAM2, and the flash. */
+#define XCP_RAM_START                   SRAM1_BASE
+#define XCP_RAM_END                     (SRAM2_BASE + (16U * 1024U))
+#define XCP_FLASH_START                 FLASH_BASE
+#define XCP_FLASH_END                   (FLASH_END + 1U)
+
+_Static_assert((XCP_MAX_ODT + XCP_MAX_DAQ) <= 0xFCU, "absolute ODT numbers must stay below 0xFC");
+_Static_assert(XCP_MAX_ODT_ENTRIES <= 0xFFU, "ODT entry indices are 8-bit");
+
+typedef struct
+{
+    uint32_t addr;
+    uint8_t  size;
+} Xcp_Entry_t;
+
+typedef struct
+{
+    uint8_t first;          /* into s_xcpEntries */
+    uint8_t count;
+} Xcp_Odt_t;
+
+typedef struct
+{
+    uint8_t          firstOdt;  /* into s_xcpOdts, also the first PID */
+    uint8_t          odts;
+    uint8_t          mode;
+    uint8_t          event;
+    uint8_t          prescaler;
+    uint8_t          countdown; /* written by the event's task */
+    uint8_t          selected;
+    volatile uint8_t running;
+} Xcp_Daq_t;
+
+typedef struct
+{
+    uint32_t samples;
+    uint32_t frames;
+    uint32_t overruns;      /* samples cut short by a full TX queue */
+} Xcp_EventStats_t;
+
+#define XCP_EVENT_TEXT_(name, text, cycleMs)   text,
+static const char *const s_xcpEventTexts[XCP_EVENT_COUNT] = { XCP_EVENT_TABLE(XCP_EVENT_TEXT_) };
+
+#define XCP_EVENT_CYCLE_(name, text, cycleMs)  (cycleMs),
+static const uint16_t s_xcpEventCycles[XCP_EVENT_COUNT] = { XCP_EVENT_TABLE(XCP_EVENT_CYCLE_) };
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Configuration: written by CanRxTask (commands) only while no list runs;
+ * the event tasks read it while the lists run. */
+static Xcp_Entry_t s_xcpEntries[XCP_MAX_ODT_ENTRIES];
+static Xcp_Odt_t   s_xcpOdts[XCP_MAX_ODT];
+static Xcp_Daq_t   s_xcpDaqs[XCP_MAX_DAQ];
+static uint8_t     s_xcpDaqCount   = 0U;
+static uint8_t     s_xcpOdtCount   = 0U;
+static uint8_t     s_xcpEntryCount = 0U;
+static uint8_t     s_xcpAlloc      = XCP_ALLOC_FREED;
+
+/* Lists running; the event fast path checks only this. */
+static volatile uint8_t s_xcpRunning = 0U;
+
+/* Session, CanRxTask only. */
+static uint8_t  s_xcpConnected = 0U;
+static uint32_t s_xcpMta       = 0U;
+static uint8_t  s_xcpPtrValid  = 0U;
+static uint8_t  s_xcpPtrDaq    = 0U;
+static uint8_t  s_xcpPtrOdt    = 0U;
+static uint8_t  s_xcpPtrEntry  = 0U;
+static uint32_t s_xcpCommands  = 0U;
+static uint32_t s_xcpErrors    = 0U;
+
+/* One entry per event, written by that event's task. */
+static Xcp_EventStats_t s_xcpEventStats[XCP_EVENT_COUNT];
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t xcp_get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void xcp_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/** DAQ clock in 10 us units: HAL tick plus the SysTick fraction. */
+static uint32_t xcp_clock(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint32_t val = SysTick->VAL;
+    uint32_t ms  = HAL_GetTick();
+
+    /* A reload since the last tick shows as a pending SysTick. */
+    if ((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0U)
+    {
+        val = SysTick->VAL;
+        ms++;
+    }
+    uint32_t load = SysTick->LOAD;
+
+    __set_PRIMASK(primask);
+
+    return (ms * 100U) + ((val <= load) ? (((load - val) * 100U) / (load + 1U)) : 0U);
+}
+
+static uint8_t xcp_readable(uint32_t addr, uint32_t len)
+{
+    if ((addr >= XCP_RAM_START) && (addr < XCP_RAM_END) && (len <= XCP_RAM_END - addr))
+        return 1U;
+    if ((addr >= XCP_FLASH_START) && (addr < XCP_FLASH_END) && (len <= XCP_FLASH_END - addr))
+        return 1U;
+    return 0U;
+}
+
+/** ODT payload of list @p daq fits the frames and the list has an event. */
+static uint8_t xcp_daq_valid(const Xcp_Daq_t *daq)
+{
+    if ((daq->odts == 0U) || (daq->event >= XCP_EVENT_COUNT))
+        return 0U;
+
+    for (uint32_t o = 0U; o < daq->odts; ++o)
+    {
+        const Xcp_Odt_t *odt = &s_xcpOdts[daq->firstOdt + o];
+        uint32_t room = XCP_ODT_PAYLOAD;
+        uint32_t used = 0U;
+
+        if ((o == 0U) && ((daq->mode & XCP_DAQ_MODE_TIMESTAMP) != 0U))
+            room -= XCP_TIMESTAMP_SIZE;
+
+        for (uint32_t e = 0U; e < odt->count; ++e)
+        {
+            if (s_xcpEntries[odt->first + e].size == 0U)
+                return 0U;    /* never written */
+            used += s_xcpEntries[odt->first + e].size;
+        }
+        if ((odt->count == 0U) || (used > room))
+            return 0U;
+    }
+
+    return 1U;
+}
+
+static void xcp_update_running(void)
+{
+    uint8_t running = 0U;
+
+    for (uint32_t d = 0U; d < s_xcpDaqCount; ++d)
+        running |= s_xcpDaqs[d].running;
+    s_xcpRunning = running;
+}
+
+static void xcp_stop_all(void)
+{
+    for (uint32_t d = 0U; d < s_xcpDaqCount; ++d)
+    {
+        s_xcpDaqs[d].running  = 0U;
+        s_xcpDaqs[d].selected = 0U;
+    }
+    s_xcpRunning = 0U;
+}
+
+static uint8_t xcp_start(Xcp_Daq_t *daq)
+{
+    if (xcp_daq_valid(daq) == 0U)
+        return XCP_ERR_DAQ_CONFIG;
+
+    daq->countdown = 0U;
+    daq->running   = 1U;
+    return 0U;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Commands                                                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * One command (@p len bytes in @p cmd) into @p res.
+ *
+ * @return 0 and the response length in @p resLen, or the XCP error code.
+ */
+static uint8_t xcp_command(const uint8_t *cmd, uint8_t len, uint8_t *res, uint8_t *resLen)
+{
+    *resLen = 1U;
+
+    switch (cmd[0])
+    {
+        case XCP_CMD_CONNECT:
+            s_xcpConnected = 1U;
+            res[1] = XCP_RESOURCE_CAL_PAG | XCP_RESOURCE_DAQ;
+            res[2] = 0x00U;                 /* Intel byte order, byte granularity */
+            res[3] = XCP_MAX_CTO;
+            res[4] = XCP_MAX_DTO;
+            res[5] = 0x00U;
+            res[6] = 0x01U;                 /* protocol layer version */
+            res[7] = 0x01U;                 /* transport layer version */
+            *resLen = 8U;
+            LOG_INFO(CAN, "XCP connected");
+            return 0U;
+
+        case XCP_CMD_DISCONNECT:
+            xcp_stop_all();
+            s_xcpConnected = 0U;
+            LOG_INFO(CAN, "XCP disconnected");
+            return 0U;
+
+        case XCP_CMD_GET_STATUS:
+            res[1] = (s_xcpRunning != 0U) ? XCP_SESSION_DAQ_RUNNING : 0x00U;
+            res[2] = 0x00U;                 /* no seed & key protection */
+            res[3] = 0x00U;
+            res[4] = 0x00U;
+            res[5] = 0x00U;
+            *resLen = 6U;
+            return 0U;
+
+        case XCP_CMD_SYNCH:
+            return XCP_ERR_CMD_SYNCH;
+
+        case XCP_CMD_SET_MTA:
+            if (len < 8U)
+                return XCP_ERR_CMD_SYNTAX;
+            s_xcpMta = xcp_get32(&cmd[4]);
+            return 0U;
+
+        case XCP_CMD_UPLOAD:
+        case XCP_CMD_SHORT_UPLOAD:
+        {
+            if ((len < 2U) || ((cmd[0] == XCP_CMD_SHORT_UPLOAD) && (len < 8U)))
+                return XCP_ERR_CMD_SYNTAX;
+
+            uint8_t  n    = cmd[1];
+            uint32_t addr = (cmd[0] == XCP_CMD_SHORT_UPLOAD) ? xcp_get32(&cmd[4]) : s_xcpMta;
+
+            if ((n == 0U) || (n > XCP_UPLOAD_MAX))
+                return XCP_ERR_OUT_OF_RANGE;
+            if (xcp_readable(addr, n) == 0U)
+                return XCP_ERR_ACCESS_DENIED;
+
+            memcpy(&res[1], (const void *)(uintptr_t)addr, n);
+            s_xcpMta = addr + n;
+            *resLen  = (uint8_t)(1U + n);
+            return 0U;
+        }
+
+        case XCP_CMD_DOWNLOAD:
+        {
+            /* Only whole calibration values, through the range check. */
+            uint32_t base = (uint32_t)(uintptr_t)&g_calValues[0];
+            uint32_t off  = s_xcpMta - base;
+
+            if ((len < 2U) || (len < 2U + cmd[1]))
+                return XCP_ERR_CMD_SYNTAX;
+            if ((cmd[1] != sizeof(Cal_Value_t)) || (s_xcpMta < base) ||
+                (off >= sizeof(g_calValues)) || ((off % sizeof(Cal_Value_t)) != 0U))
+            {
+                return XCP_ERR_ACCESS_DENIED;
+            }
+
+            Cal_Value_t v;
+            v.u = xcp_get32(&cmd[2]);
+            if (Cal_Set((Cal_Id_t)(off / sizeof(Cal_Value_t)), v) != HAL_OK)
+                return XCP_ERR_OUT_OF_RANGE;
+            s_xcpMta += sizeof(Cal_Value_t);
+            return 0U;
+        }
+
+        case XCP_CMD_FREE_DAQ:
+            xcp_stop_all();
+            s_xcpDaqCount   = 0U;
+            s_xcpOdtCount   = 0U;
+            s_xcpEntryCount = 0U;
+            s_xcpPtrValid   = 0U;
+            s_xcpAlloc      = XCP_ALLOC_FREED;
+            return 0U;
+
+        case XCP_CMD_ALLOC_DAQ:
+        {
+            if (len < 4U)
+                return XCP_ERR_CMD_SYNTAX;
+
+            uint16_t count = (uint16_t)(cmd[2] | (cmd[3] << 8));
+            if (s_xcpAlloc != XCP_ALLOC_FREED)
+                return XCP_ERR_SEQUENCE;
+            if (count > XCP_MAX_DAQ)
+                return XCP_ERR_MEMORY_OVERFLOW;
+
+            memset(s_xcpDaqs, 0, sizeof(s_xcpDaqs));
+            for (uint32_t d = 0U; d < count; ++d)
+                s_xcpDaqs[d].prescaler = 1U;
+            s_xcpDaqCount = (uint8_t)count;
+            s_xcpAlloc    = XCP_ALLOC_DAQ;
+            return 0U;
+        }
+
+        case XCP_CMD_ALLOC_ODT:
+        {
+            if (len < 5U)
+                return XCP_ERR_CMD_SYNTAX;
+
+            uint16_t d = (uint16_t)(cmd[2] | (cmd[3] << 8));
+            uint8_t  n = cmd[4];
+            if ((s_xcpAlloc != XCP_ALLOC_DAQ) && (s_xcpAlloc != XCP_ALLOC_ODT))
+                return XCP_ERR_SEQUENCE;
+            if ((d >= s_xcpDaqCount) || (s_xcpDaqs[d].odts != 0U))
+                return XCP_ERR_OUT_OF_RANGE;
+            if (n > XCP_MAX_ODT - s_xcpOdtCount)
+                return XCP_ERR_MEMORY_OVERFLOW;
+
+            s_xcpDaqs[d].firstOdt = s_xcpOdtCount;
+            s_xcpDaqs[d].odts     = n;
+            for (uint32_t o = 0U; o < n; ++o)
+            {
+                s_xcpOdts[s_xcpOdtCount + o].first = 0U;
+                s_xcpOdts[s_xcpOdtCount + o].count = 0U;
+            }
+            s_xcpOdtCount = (uint8_t)(s_xcpOdtCount + n);
+            s_xcpAlloc    = XCP_ALLOC_ODT;
+            return 0U;
+        }
+
+        case XCP_CMD_ALLOC_ODT_ENTRY:
+        {
+            if (len < 6U)
+                return XCP_ERR_CMD_SYNTAX;
+
+            uint16_t d = (uint16_t)(cmd[2] | (cmd[3] << 8));
+            uint8_t  o = cmd[4];
+            uint8_t  n = cmd[5];
+            if ((s_xcpAlloc != XCP_ALLOC_ODT) && (s_xcpAlloc != XCP_ALLOC_ENTRY))
+                return XCP_ERR_SEQUENCE;
+            if ((d >= s_xcpDaqCount) || (o >= s_xcpDaqs[d].odts))
+                return XCP_ERR_OUT_OF_RANGE;
+
+            Xcp_Odt_t *odt = &s_xcpOdts[s_xcpDaqs[d].firstOdt + o];
+            if (odt->count != 0U)
+                return XCP_ERR_OUT_OF_RANGE;
+            if (n > XCP_MAX_ODT_ENTRIES - s_xcpEntryCount)
+                return XCP_ERR_MEMORY_OVERFLOW;
+
+            odt->first = s_xcpEntryCount;
+            odt->count = n;
+            memset(&s_xcpEntries[s_xcpEntryCount], 0, n * sizeof(Xcp_Entry_t));
+            s_xcpEntryCount = (uint8_t)(s_xcpEntryCount + n);
+            s_xcpAlloc      = XCP_ALLOC_ENTRY;
+            return 0U;
+        }
+
+        case XCP_CMD_SET_DAQ_PTR:
+        {
+            if (len < 6U)
+                return XCP_ERR_CMD_SYNTAX;
+
+            uint16_t d = (uint16_t)(cmd[2] | (cmd[3] << 8));
+            if ((d >= s_xcpDaqCount) || (cmd[4] >= s_xcpDaqs[d].odts) ||
+                (cmd[5] >= s_xcpOdts[s_xcpDaqs[d].firstOdt + cmd[4]].count))
+            {
+                return XCP_ERR_OUT_OF_RANGE;
+            }
+            if (s_xcpDaqs[d].running != 0U)
+                return XCP_ERR_DAQ_ACTIVE;
+
+            s_xcpPtrDaq   = (uint8_t)d;
+            s_xcpPtrOdt   = cmd[4];
+            s_xcpPtrEntry = cmd[5];
+            s_xcpPtrValid = 1U;
+            return 0U;
+        }
+
+        case XCP_CMD_WRITE_DAQ:
+        {
+            if (len < 8U)
+                return XCP_ERR_CMD_SYNTAX;
+
+            uint8_t  size = cmd[2];
+            uint32_t addr = xcp_get32(&cmd[4]);
+            if (s_xcpPtrValid == 0U)
+                return XCP_ERR_SEQUENCE;
+            if (s_xcpDaqs[s_xcpPtrDaq].running != 0U)
+                return XCP_ERR_DAQ_ACTIVE;
+            if ((cmd[1] != 0xFFU) || (size == 0U) || (size > XCP_ODT_PAYLOAD))
+                return XCP_ERR_OUT_OF_RANGE;
+            if (xcp_readable(addr, size) == 0U)
+                return XCP_ERR_ACCESS_DENIED;
+
+            const Xcp_Odt_t *odt = &s_xcpOdts[s_xcpDaqs[s_xcpPtrDaq].firstOdt + s_xcpPtrOdt];
+            s_xcpEntries[odt->first + s_xcpPtrEntry].addr = addr;
+            s_xcpEntries[odt->first + s_xcpPtrEntry].size = size;
+
+            /* The pointer moves on; past the last entry it is invalid. */
+            if (++s_xcpPtrEntry >= odt->count)
+                s_xcpPtrValid = 0U;
+            return 0U;
+        }
+
+        case XCP_CMD_SET_DAQ_LIST_MODE:
+        {
+            if (len < 8U)
+                return XCP_ERR_CMD_SYNTAX;
+
+            uint8_t  mode  = cmd[1];
+            uint16_t d     = (uint16_t)(cmd[2] | (cmd[3] << 8));
+            uint16_t event = (uint16_t)(cmd[4] | (cmd[5] << 8));
+            if ((d >= s_xcpDaqCount) || (event >= XCP_EVENT_COUNT))
+                return XCP_ERR_OUT_OF_RANGE;
+            if ((mode & (XCP_DAQ_MODE_DIRECTION | XCP_DAQ_MODE_PID_OFF)) != 0U)
+                return XCP_ERR_MODE_NOT_VALID;
+            if (s_xcpDaqs[d].running != 0U)
+                return XCP_ERR_DAQ_ACTIVE;
+
+            s_xcpDaqs[d].mode      = mode;
+            s_xcpDaqs[d].event     = (uint8_t)event;
+            s_xcpDaqs[d].prescaler = (cmd[6] == 0U) ? 1U : cmd[6];
+            return 0U;
+        }
+
+        case XCP_CMD_START_STOP_DAQ_LIST:
+        {
+            if (len < 4U)
+                return XCP_ERR_CMD_SYNTAX;
+
+            uint16_t d = (uint16_t)(cmd[2] | (cmd[3] << 8));
+            uint8_t  err = 0U;
+            if (d >= s_xcpDaqCount)
+                return XCP_ERR_OUT_OF_RANGE;
+
+            if (cmd[1] == 0x00U)
+                s_xcpDaqs[d].running = 0U;
+            else if (cmd[1] == 0x01U)
+                err = xcp_start(&s_xcpDaqs[d]);
+            else if (cmd[1] == 0x02U)
+                s_xcpDaqs[d].selected = 1U;
+            else
+                return XCP_ERR_MODE_NOT_VALID;
+            xcp_update_running();
+            if (err != 0U)
+                return err;
+
+            res[1]  = s_xcpDaqs[d].firstOdt;
+            *resLen = 2U;
+            return 0U;
+        }
+
+        case XCP_CMD_START_STOP_SYNCH:
+        {
+            if (len < 2U)
+                return XCP_ERR_CMD_SYNTAX;
+            if (cmd[1] > 0x02U)
+                return XCP_ERR_MODE_NOT_VALID;
+
+            uint8_t err = 0U;
+            if (cmd[1] == 0x00U)
+                xcp_stop_all();
+
+            /* Check every selected list before starting any. */
+            for (uint32_t d = 0U; (cmd[1] == 0x01U) && (d < s_xcpDaqCount); ++d)
+            {
+                if ((s_xcpDaqs[d].selected != 0U) && (xcp_daq_valid(&s_xcpDaqs[d]) == 0U))
+                    err = XCP_ERR_DAQ_CONFIG;
+            }
+            for (uint32_t d = 0U; (err == 0U) && (d < s_xcpDaqCount); ++d)
+            {
+                if (s_xcpDaqs[d].selected == 0U)
+                    continue;
+                if (cmd[1] == 0x01U)
+                    (void)xcp_start(&s_xcpDaqs[d]);
+                else
+                    s_xcpDaqs[d].running = 0U;
+                s_xcpDaqs[d].selected = 0U;
+            }
+            xcp_update_running();
+            return err;
+        }
+
+        case XCP_CMD_GET_DAQ_CLOCK:
+            res[1] = 0x00U;
+            res[2] = 0x00U;
+            res[3] = 0x00U;
+            xcp_put32(&res[4], xcp_clock());
+            *resLen = 8U;
+            return 0U;
+
+        case XCP_CMD_GET_DAQ_PROCESSOR_INFO:
+            res[1] = XCP_DAQ_PROPERTIES;
+            res[2] = (uint8_t)XCP_MAX_DAQ;
+            res[3] = 0x00U;
+            res[4] = (uint8_t)XCP_EVENT_COUNT;
+            res[5] = 0x00U;
+            res[6] = 0x00U;                 /* no predefined lists */
+            res[7] = XCP_DAQ_KEY_BYTE;
+            *resLen = 8U;
+            return 0U;
+
+        case XCP_CMD_GET_DAQ_RESOLUTION_INFO:
+            res[1] = 1U;                    /* entry granularity: bytes */
+            res[2] = XCP_ODT_PAYLOAD;       /* largest entry */
+            res[3] = 1U;
+            res[4] = 0U;                    /* no STIM */
+            res[5] = XCP_TIMESTAMP_MODE;
+            res[6] = 1U;
+            res[7] = 0U;
+            *resLen = 8U;
+            return 0U;
+
+        default:
+            return XCP_ERR_CMD_UNKNOWN;
+    }
+}
+
+/** CanRxTask: one command frame. */
+static void xcp_on_frame(const CAN_IF_Msg_t *msg, void *ctx)
+{
+    (void)ctx;
+
+    uint8_t len = CAN_IF_MSG_LEN(msg);
+    if (CAN_IF_MSG_IS_RTR(msg) || (len == 0U))
+        return;
+
+    /* Until CONNECT the slave is silent. */
+    if ((s_xcpConnected == 0U) && (msg->Data[0] != XCP_CMD_CONNECT))
+        return;
+
+    uint8_t res[XCP_MAX_CTO];
+    uint8_t resLen = 1U;
+
+    s_xcpCommands++;
+    uint8_t err = xcp_command(msg->Data, len, res, &resLen);
+
+    if (err != 0U)
+    {
+        s_xcpErrors++;
+        res[0] = XCP_PID_ERR;
+        res[1] = err;
+        resLen = 2U;
+    }
+    else
+    {
+        res[0] = XCP_PID_RES;
+    }
+
+    (void)CAN_IF_Transmit(XCP_CAN_RES_ID, res, resLen);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CLI                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static void xcp_cmd_show(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    CLI_IF_Printf("XCP %s on 0x%03X / 0x%03X, %lu commands, %lu errors\r\n",
+                  (s_xcpConnected != 0U) ? "connected" : "idle",
+                  (unsigned)XCP_CAN_CMD_ID, (unsigned)XCP_CAN_RES_ID,
+                  (unsigned long)s_xcpCommands, (unsigned long)s_xcpErrors);
+    CLI_IF_Printf("DAQ lists %u/%u, ODTs %u/%u, entries %u/%u\r\n",
+                  (unsigned)s_xcpDaqCount, (unsigned)XCP_MAX_DAQ,
+                  (unsigned)s_xcpOdtCount, (unsigned)XCP_MAX_ODT,
+                  (unsigned)s_xcpEntryCount, (unsigned)XCP_MAX_ODT_ENTRIES);
+
+    for (uint32_t d = 0U; d < s_xcpDaqCount; ++d)
+    {
+        const Xcp_Daq_t *daq = &s_xcpDaqs[d];
+        uint32_t entries = 0U;
+        uint32_t bytes   = 0U;
+
+        for (uint32_t o = 0U; o < daq->odts; ++o)
+        {
+            const Xcp_Odt_t *odt = &s_xcpOdts[daq->firstOdt + o];
+
+            entries += odt->count;
+            for (uint32_t e = 0U; e < odt->count; ++e)
+                bytes += s_xcpEntries[odt->first + e].size;
+        }
+
+        CLI_IF_Printf("  DAQ %lu: %-13s /%-3u %2u ODTs %3lu entries %3lu bytes%s%s\r\n",
+                      (unsigned long)d,
+                      (daq->event < XCP_EVENT_COUNT) ? s_xcpEventTexts[daq->event] : "?",
+                      (unsigned)daq->prescaler, (unsigned)daq->odts,
+                      (unsigned long)entries, (unsigned long)bytes,
+                      ((daq->mode & XCP_DAQ_MODE_TIMESTAMP) != 0U) ? ", timestamp" : "",
+                      (daq->running != 0U) ? ", running" : "");
+    }
+
+    CLI_IF_Print("Event          cycle   samples    frames  overruns\r\n");
+    for (uint32_t i = 0U; i < XCP_EVENT_COUNT; ++i)
+    {
+        Xcp_EventStats_t st = s_xcpEventStats[i];
+
+        CLI_IF_Printf("%-13s %4u ms %9lu %9lu %9lu\r\n", s_xcpEventTexts[i],
+                      (unsigned)s_xcpEventCycles[i], (unsigned long)st.samples,
+                      (unsigned long)st.frames, (unsigned long)st.overruns);
+    }
+}
+
+static const CliCommand_t s_xcpCmds[] =
+{
+    { "xcp", "", 0U, xcp_cmd_show, "XCP connection, DAQ lists and event counts" },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef Xcp_Init(void)
+{
+    memset(s_xcpEventStats, 0, sizeof(s_xcpEventStats));
+
+    CLI_IF_REGISTER_TABLE(s_xcpCmds);
+
+    return CAN_IF_RegisterHandler(XCP_CAN_CMD_ID, 0x7FFU, xcp_on_frame, NULL);
+}
+
+void Xcp_Event(Xcp_Event_t event)
+{
+    if ((s_xcpRunning == 0U) || ((uint32_t)event >= XCP_EVENT_COUNT))
+        return;
+
+    Xcp_EventStats_t *st = &s_xcpEventStats[event];
+    uint16_t ts = (uint16_t)xcp_clock();
+
+    for (uint32_t d = 0U; d < s_xcpDaqCount; ++d)
+    {
+        Xcp_Daq_t *daq = &s_xcpDaqs[d];
+
+        if ((daq->running == 0U) || (daq->event != (uint8_t)event))
+            continue;
+        if (++daq->countdown < daq->prescaler)
+            continue;
+        daq->countdown = 0U;
+        st->samples++;
+
+        for (uint32_t o = 0U; o < daq->odts; ++o)
+        {
+            const Xcp_Odt_t *odt = &s_xcpOdts[daq->firstOdt + o];
+            uint8_t f[XCP_MAX_DTO];
+            uint8_t n = 0U;
+
+            f[n++] = (uint8_t)(daq->firstOdt + o);
+            if ((o == 0U) && ((daq->mode & XCP_DAQ_MODE_TIMESTAMP) != 0U))
+            {
+                f[n++] = (uint8_t)ts;
+                f[n++] = (uint8_t)(ts >> 8);
+            }
+            for (uint32_t e = 0U; e < odt->count; ++e)
+            {
+                const Xcp_Entry_t *en = &s_xcpEntries[odt->first + e];
+
+                memcpy(&f[n], (const void *)(uintptr_t)en->addr, en->size);
+                n = (uint8_t)(n + en->size);
+            }
+
+            if (CAN_IF_Transmit(XCP_CAN_RES_ID | CAN_IF_TX_IN_ORDER, f, n) != HAL_OK)
+            {
+                st->overruns++;
+                break;
+            }
+            st->frames++;
+        }
+    }
+}
+
+void Xcp_Event1ms(void)
+{
+    Xcp_Event(XCP_EVENT_1MS);
+}
+
+void Xcp_Event10ms(void)
+{
+    Xcp_Event(XCP_EVENT_10MS);
+}
+
+void Xcp_Event100ms(void)
+{
+    Xcp_Event(XCP_EVENT_100MS);
+}
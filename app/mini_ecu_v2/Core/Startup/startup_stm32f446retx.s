@@ -43,6 +43,16 @@ defined in linker script */
 .word  _sbss
 /* end address for the .bss section. defined in linker script */
 .word  _ebss
+/* start address for the initialization values of the .ramfunc section */
+.word  _siramfunc
+/* start address for the .ramfunc section (code executed from SRAM) */
+.word  _sramfunc
+/* end address for the .ramfunc section */
+.word  _eramfunc
+/* start address for the SRAM2 DMA buffers (sram_layout.h) */
+.word  _ssram2
+/* end address for the SRAM2 DMA buffers */
+.word  _esram2
 /* stack used for SystemInit_ExtMemCtl; always internal RAM used */
 
 /**
@@ -63,44 +73,104 @@ Reset_Handler:
 /* Call the clock system initialization function.*/
   bl  SystemInit  
 
+/* Boot profile and the clock profile before the memory loops, so they
+   run at the full core clock (startup.h). Runs before .data/.bss exist. */
+  bl  Startup_EarlyInit
+
 /* Copy the data segment initializers from flash to SRAM */  
   ldr r0, =_sdata
   ldr r1, =_edata
   ldr r2, =_sidata
-  movs r3, #0
-  b LoopCopyDataInit
+  bl  Startup_CopyWords
 
-CopyDataInit:
-  ldr r4, [r2, r3]
-  str r4, [r0, r3]
-  adds r3, r3, #4
+/* Copy the RAM-resident code (ramfunc.h) from flash to SRAM */
+  ldr r0, =_sramfunc
+  ldr r1, =_eramfunc
+  ldr r2, =_siramfunc
+  bl  Startup_CopyWords
 
-LoopCopyDataInit:
-  adds r4, r0, r3
-  cmp r4, r1
-  bcc CopyDataInit
+  movs r0, #2             /* BOOT_PROF_DATA (boot_prof.h) */
+  bl  BootProf_Mark
   
 /* Zero fill the bss segment. */
-  ldr r2, =_sbss
-  ldr r4, =_ebss
-  movs r3, #0
-  b LoopFillZerobss
+  ldr r0, =_sbss
+  ldr r1, =_ebss
+  bl  Startup_ZeroWords
 
-FillZerobss:
-  str  r3, [r2]
-  adds r2, r2, #4
+/* Zero fill the SRAM2 DMA buffers. */
+  ldr r0, =_ssram2
+  ldr r1, =_esram2
+  bl  Startup_ZeroWords
 
-LoopFillZerobss:
-  cmp r2, r4
-  bcc FillZerobss
+  movs r0, #3             /* BOOT_PROF_BSS */
+  bl  BootProf_Mark
   
 /* Call static constructors */
     bl __libc_init_array
+  movs r0, #4             /* BOOT_PROF_MAIN */
+  bl  BootProf_Mark
 /* Call the application's entry point.*/
   bl  main
   bx  lr    
 .size  Reset_Handler, .-Reset_Handler
 
+/**
+ * @brief  Copy words from r2 to [r0, r1), 16 bytes per LDM/STM pair, then
+ *         a word at a time. All three 4-byte aligned, r1 >= r0.
+ *         Clobbers r0-r3.
+*/
+    .section  .text.Startup_CopyWords
+  .type  Startup_CopyWords, %function
+Startup_CopyWords:
+  push {r4-r7}
+  b   CopyWords4Test
+CopyWords4:
+  ldmia r2!, {r4-r7}
+  stmia r0!, {r4-r7}
+CopyWords4Test:
+  subs r3, r1, r0
+  cmp  r3, #16
+  bhs  CopyWords4
+  b   CopyWords1Test
+CopyWords1:
+  ldr  r4, [r2], #4
+  str  r4, [r0], #4
+CopyWords1Test:
+  cmp  r0, r1
+  bcc  CopyWords1
+  pop  {r4-r7}
+  bx   lr
+.size  Startup_CopyWords, .-Startup_CopyWords
+
+/**
+ * @brief  Zero [r0, r1), 16 bytes per STM, then a word at a time. Both
+ *         4-byte aligned, r1 >= r0. Clobbers r0-r3 and r12.
+*/
+    .section  .text.Startup_ZeroWords
+  .type  Startup_ZeroWords, %function
+Startup_ZeroWords:
+  push {r4-r5}
+  movs r2, #0
+  movs r3, #0
+  movs r4, #0
+  movs r5, #0
+  b   ZeroWords4Test
+ZeroWords4:
+  stmia r0!, {r2-r5}
+ZeroWords4Test:
+  subs r12, r1, r0
+  cmp  r12, #16
+  bhs  ZeroWords4
+  b   ZeroWords1Test
+ZeroWords1:
+  str  r2, [r0], #4
+ZeroWords1Test:
+  cmp  r0, r1
+  bcc  ZeroWords1
+  pop  {r4-r5}
+  bx   lr
+.size  Startup_ZeroWords, .-Startup_ZeroWords
+
 /**
  * @brief  This is the code that gets called when the processor receives an 
  *         unexpected interrupt.  This simply enters an infinite loop, preserving
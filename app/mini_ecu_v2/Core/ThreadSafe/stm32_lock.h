@@ -245,7 +245,8 @@ static inline void stm32_lock_release(LockingData_t *lock)
 #include <FreeRTOS.h>
 #include <task.h>
 
-#if defined (__GNUC__) && !defined (__CC_ARM) && configUSE_NEWLIB_REENTRANT == 0
+/* FMT_PRINTF builds (fmt.h) drop the per-task reent on purpose. */
+#if defined (__GNUC__) && !defined (__CC_ARM) && configUSE_NEWLIB_REENTRANT == 0 && !FMT_PRINTF
 #warning Please set configUSE_NEWLIB_REENTRANT to 1 in FreeRTOSConfig.h, otherwise newlib will not be thread-safe
 #endif /* defined (__GNUC__) && !defined (__CC_ARM) && configUSE_NEWLIB_REENTRANT == 0 */
 
@@ -0,0 +1,835 @@
+/**
+ * @file    bench.c
+ * @brief   Host benchmarks of the application core hot paths (make sil-bench).
+ *
+ * Each benchmark runs its operation in batches and reports the best batch
+ * (least disturbed by the host OS) in ns per operation:
+ *
+ *   vehicle_update      Vehicle_Update() at 100 ms steps
+ *   telemetry_encode    CAN_IF_SendTelemetry() into a free mailbox
+ *   telemetry_loopback  encode + FIFO0 ISR drain + ring + CAN_IF_ProcessRxMsg()
+ *                       into a handler that decodes the frame
+ *   log_format          LOG_INFO() with three integers, formatted, queued and
+ *                       flushed to the UART sink
+ *   cli_dispatch        "veh speed 42" through the RX DMA buffer, line editor,
+ *                       tokenizer and command lookup, plus the mailbox drain
+ *   cli_rpc             the same as a VEH_SPEED request frame (cli_rpc.h):
+ *                       COBS, CRC, handler and the response frame
+ *
+ * Usage:
+ *   mini_ecu_sil [-n <iterations>] [-v] [--baseline <file>] [--tolerance <pct>]
+ *   mini_ecu_sil --soak <hours> [-v]
+ *   mini_ecu_sil --replay <candump.log> [--speed <factor>|fast] [--from <s>] [--to <s>] [-v]
+ *   mini_ecu_sil --bus <nodes> [--seconds <s>] [--bitrate <bit/s>] [-v]
+ *   mini_ecu_sil --socketcan <ifname> [--seconds <s>] [-v]
+ *   mini_ecu_sil --fleet <vehicles> [--steps <n>] [--threads <max>]
+ *
+ * -v echoes the firmware's UART output (log lines, CLI replies) to stdout.
+ *
+ * --soak runs no benchmarks: it plays the NEDC-like cycle (scenario.h) back
+ * to back for <hours> of sim time with the sim clock free running
+ * (sim_clock.h), the telemetry scheduled on sim time as on the target, and
+ * reports the speed-up over real time.
+ *
+ * --replay runs no benchmarks: it streams a candump log ("candump -l", or
+ * tools/can_replay.py -o for ASC and binary traces) through the replay
+ * engine (can_replay.h) into the RX ring and CAN_IF_ProcessRxMsg(), in
+ * sim time at <factor> x the original rate (default 1) or with fast as
+ * fast as the host takes them, and reports the counters and the host time
+ * per frame. The log is memory-mapped and parsed in place (sil_trace.h),
+ * so a multi-GB trace starts at once; --from / --to replay the window of
+ * <s> seconds after its first record, found by bisection.
+ *
+ * --bus runs no benchmarks: it puts the ECU on the virtual CAN bus
+ * (sil_bus.h) with <nodes> simulated nodes, each sending one 8-byte frame
+ * every 10..100 ms on its own ID (0x0C0 upwards, around the telemetry's
+ * 0x100), for <s> seconds (default 10) at <bit/s> (default CAN_IF_BITRATE),
+ * and reports the bus load, arbitration losses, drops and frame latency
+ * of the ECU and of the nodes, and the ECU's RX ring.
+ *
+ * --socketcan runs no benchmarks: it puts the ECU's CAN1 on a Linux CAN
+ * interface (sil_sock.h; vcan0 or an adapter) and runs the firmware in
+ * real time for <s> seconds (default 10, 0 = until Ctrl-C), so candump,
+ * cangen and the HIL tools talk to it, then reports the frames and the
+ * syscalls they took, the kernel-to-FIFO0 latency and the ECU's RX ring.
+ *
+ * --fleet runs no benchmarks: it steps <vehicles> vehicles of the fleet
+ * model (sil_fleet.h) <n> times (default 1000) on 1, 2, 4 ... <max> worker
+ * threads (default: the online CPUs) and reports vehicle-steps/s per
+ * thread count, per thread and the speed-up over one thread. The frames
+ * must be the same for every thread count (exit 1 otherwise).
+ *
+ * The output lines ("<name> <ns/op>") can be saved as a baseline; with
+ * --baseline the run fails (exit 1) if any benchmark is more than
+ * <pct> percent (default 25) slower than the baseline value.
+ */
+
+#include "sil.h"
+#include "sil_bus.h"
+#include "sil_fleet.h"
+#include "sil_sock.h"
+#include "sil_trace.h"
+#include "can_if.h"
+#include "can_alarm.h"
+#include "can_replay.h"
+#include "cli_if.h"
+#include "log.h"
+#include "can_sched.h"
+#include "can_stats.h"
+#include "mem_pool.h"
+#include "powertrain.h"
+#include "scenario.h"
+#include "sim_clock.h"
+#include "vehicle.h"
+#include "vehicle_shared.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define BENCH_BATCHES        7U
+#define BENCH_DEFAULT_ITERS  20000U
+#define BENCH_MAX            8U
+
+typedef void (*BenchFn_t)(uint32_t iters);
+
+typedef struct
+{
+    const char *name;
+    BenchFn_t   fn;
+    double      iterScale;   /**< Relative to -n (slow paths run fewer ops). */
+} Bench_t;
+
+typedef struct
+{
+    const char *name;
+    double      nsPerOp;
+} BenchResult_t;
+
+static VehicleState_t        s_vs;
+static volatile uint32_t     s_sink;
+static VehicleState_t        s_decoded;
+static volatile sig_atomic_t s_stop;      /* SIGINT in --socketcan */
+
+/* -------------------------------------------------------------------------- */
+/* Helpers                                                                    */
+/* -------------------------------------------------------------------------- */
+
+static double bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double)ts.tv_sec * 1e9) + (double)ts.tv_nsec;
+}
+
+/**
+ * @brief Telemetry decoder for the loopback benchmark (inverse of
+ *        CAN_IF_SendTelemetryId()).
+ */
+static void bench_on_telemetry(const CAN_IF_Msg_t *msg, void *ctx)
+{
+    VehicleState_t            *out = (VehicleState_t *)ctx;
+    CanSig_VehicleTelemetry_t  m;
+
+    if (CAN_IF_MSG_LEN(msg) < CANSIG_VEHICLE_TELEMETRY_DLC)
+        return;
+
+    CanSig_VehicleTelemetry_Unpack(msg->Data, &m);
+    out->speed_kph      = m.speed_kph;
+    out->engine_rpm     = m.engine_rpm;
+    out->coolant_temp_c = m.coolant_temp_c;
+}
+
+static void bench_drain_can_rx(void)
+{
+    CanRing_t *ring = CAN_IF_GetRxRing();
+    void      *batch;
+    uint32_t   n;
+
+    while ((n = CanRing_PeekBatch(ring, &batch, CAN_IF_RX_BATCH)) > 0U)
+    {
+        const CAN_IF_Msg_t *msg = (const CAN_IF_Msg_t *)batch;
+
+        for (uint32_t i = 0U; i < n; ++i)
+            CAN_IF_ProcessRxMsg(&msg[i]);
+        CanRing_ReleaseBatch(ring, n);
+    }
+}
+
+static void bench_cli_line(const char *line)
+{
+    Sil_UartRx(line, (uint32_t)strlen(line));
+    CLI_IF_Task();
+}
+
+/* -------------------------------------------------------------------------- */
+/* Benchmarks                                                                 */
+/* -------------------------------------------------------------------------- */
+
+static void bench_vehicle_update(uint32_t iters)
+{
+    for (uint32_t i = 0U; i < iters; i++)
+    {
+        /* Keep the model away from its clamps so every branch stays live. */
+        if ((i & 63U) == 0U)
+            Vehicle_SetTargetSpeed(&s_vs, 80.0f);
+        Vehicle_Update(&s_vs, 0.1f);
+    }
+    s_sink = s_vs.engine_rpm;
+}
+
+static void bench_telemetry_encode(uint32_t iters)
+{
+    Sil_CanLoopback(0U);
+    for (uint32_t i = 0U; i < iters; i++)
+    {
+        s_vs.engine_rpm = (uint16_t)(800U + (i & 1023U));
+        CAN_IF_SendTelemetry(&s_vs);
+    }
+    s_sink = Sil_CanTxCount();
+}
+
+static void bench_telemetry_loopback(uint32_t iters)
+{
+    Sil_CanLoopback(1U);
+    for (uint32_t i = 0U; i < iters; i++)
+    {
+        s_vs.engine_rpm = (uint16_t)(800U + (i & 1023U));
+        CAN_IF_SendTelemetry(&s_vs);
+        bench_drain_can_rx();
+    }
+    Sil_CanLoopback(0U);
+    s_sink = s_decoded.engine_rpm;
+}
+
+static void bench_log_format(uint32_t iters)
+{
+    for (uint32_t i = 0U; i < iters; i++)
+    {
+        LOG_INFO(VEH, "speed=%lu rpm=%u temp=%d",
+                 (unsigned long)i, (unsigned)(i & 0xFFFU), (int)(i & 0x7FU) - 20);
+    }
+    s_sink = Sil_UartTxBytes();
+}
+
+static void bench_cli_dispatch(uint32_t iters)
+{
+    for (uint32_t i = 0U; i < iters; i++)
+    {
+        bench_cli_line("veh speed 42\r");
+        (void)Vehicle_ApplyCommands(&s_vs);
+    }
+    s_sink = (uint32_t)s_vs.speed_kph;
+}
+
+static void bench_cli_rpc(uint32_t iters)
+{
+    /* VEH_SPEED 42.0, seq 1 (tools/cli_rpc.py request()). */
+    static const uint8_t frame[] =
+    {
+        0x00, 0x06, 0x51, 0x01, 0x11, 0x01, 0x04, 0x01, 0x05, 0x28, 0x42, 0xD0, 0x1C, 0x00
+    };
+
+    for (uint32_t i = 0U; i < iters; i++)
+    {
+        Sil_UartRx((const char *)frame, (uint32_t)sizeof(frame));
+        CLI_IF_Task();
+        (void)Vehicle_ApplyCommands(&s_vs);
+    }
+    s_sink = (uint32_t)s_vs.speed_kph;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Soak run                                                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Play "nedc" back to back for @p hours of sim time, flat out.
+ *
+ * @return Non-zero if the model or the telemetry did not run.
+ */
+static int bench_soak(uint32_t hours)
+{
+    const uint64_t target = (uint64_t)hours * 3600000U;
+    uint64_t       simMs  = 0U;
+    uint32_t       cycles = 0U;
+    uint32_t       tx0    = Sil_CanTxCount();
+    float          maxKph = 0.0f;
+
+    (void)SimClock_SetScale(SIM_CLOCK_SCALE_MAX);
+
+    double t0 = bench_now_ns();
+
+    while (simMs < target)
+    {
+        /* Same step as VehicleTask at 10 Hz, minus the pedal. */
+        if (Scenario_Step(&s_vs, SCENARIO_STEP_MS) == 0U)
+        {
+            (void)Scenario_Play("nedc", 1U);
+            cycles++;
+            continue;
+        }
+        Vehicle_Publish(&s_vs);
+        SimClock_Advance(SCENARIO_STEP_MS);
+        simMs += SCENARIO_STEP_MS;
+        CanAlarm_Check(&s_vs);
+
+        (void)CanSched_Run(SimClock_NowMs());
+
+        if (s_vs.speed_kph > maxKph)
+            maxKph = s_vs.speed_kph;
+    }
+
+    double   wallS  = (bench_now_ns() - t0) / 1e9;
+    uint32_t frames = Sil_CanTxCount() - tx0;
+
+    CanAlarm_Stats_t alarms;
+    CanAlarm_GetStats(&alarms);
+
+    printf("soak %lu h sim in %.2f s (%.0fx real time): %lu cycles, %lu frames, max %.1f km/h, "
+           "%lu alarm edges\n",
+           (unsigned long)hours, wallS, ((double)simMs / 1000.0) / ((wallS > 0.0) ? wallS : 1e-9),
+           (unsigned long)cycles, (unsigned long)frames, (double)maxKph,
+           (unsigned long)alarms.edges);
+
+    return ((frames == 0U) || (maxKph <= 0.0f)) ? 1 : 0;
+}
+
+/**
+ * @brief Replay the window @p fromUs..@p toUs (0 = end) of @p path at
+ *        @p speed (1/1000, or CAN_REPLAY_FAST) in sim time.
+ *
+ * @return Non-zero if the file cannot be read or held no frame.
+ */
+static int bench_replay(const char *path, uint32_t speed, uint64_t fromUs, uint64_t toUs)
+{
+    static SilTrace_t tr;
+
+    double tOpen = bench_now_ns();
+    if (SilTrace_Open(&tr, path) != 0)
+    {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    SilTrace_Window(&tr, fromUs, toUs);
+    printf("trace %.1f MB mapped, window at byte %lu..%lu after %lu line probes in %.1f us\n",
+           (double)tr.size / 1e6, (unsigned long)tr.pos, (unsigned long)tr.end,
+           (unsigned long)tr.probes, (bench_now_ns() - tOpen) / 1e3);
+
+    CanReplay_Stats_t  st;
+    CanRing_Stats_t    ring;
+    CanStats_Summary_t sum;
+    uint32_t           rx0;
+
+    (void)CanStats_Get(&sum, NULL, 0U);
+    rx0 = sum.rxFrames;
+
+    double t0 = bench_now_ns();
+
+    CanReplay_Begin(SilTrace_Next, &tr, speed, HAL_GetTick());
+    while (CanReplay_Poll(HAL_GetTick()) != 0U)
+    {
+        /* CanRxTask's turn; in paced mode the next tick is the next poll. */
+        bench_drain_can_rx();
+        if (speed != CAN_REPLAY_FAST)
+            Sil_AdvanceMs(1U);
+    }
+    bench_drain_can_rx();
+
+    double ns = bench_now_ns() - t0;
+    SilTrace_Close(&tr);
+    CanReplay_GetStats(&st);
+    CanRing_GetStats(CAN_IF_GetRxRing(), &ring);
+    (void)CanStats_Get(&sum, NULL, 0U);
+
+    printf("replay %lu frames (%lu rx) in %lu ms sim, trace span %lu ms: "
+           "%lu filtered, %lu dropped, %lu waits, max %lu ms late, high water %lu of %lu\n",
+           (unsigned long)st.frames, (unsigned long)(sum.rxFrames - rx0),
+           (unsigned long)st.elapsedMs, (unsigned long)st.traceMs, (unsigned long)st.filtered,
+           (unsigned long)st.ringFull, (unsigned long)st.waits, (unsigned long)st.maxLateMs,
+           (unsigned long)ring.highWater, (unsigned long)ring.capacity);
+    printf("%-20s %10.1f ns/frame\n", "replay",
+           ns / (double)((st.frames != 0U) ? st.frames : 1U));
+
+    return (st.frames == 0U) ? 1 : 0;
+}
+
+/** ID of simulated node @p n: from 0x0C0 up, past the ECU's own IDs. */
+static uint32_t bench_bus_id(uint32_t n)
+{
+    uint32_t id = 0x0C0U;
+
+    for (uint32_t i = 1U; ; ++id)
+    {
+        if ((id == CANSIG_VEHICLE_TELEMETRY_ID) || (id == CANSIG_ODOMETER_ID) ||
+            (id == CANSIG_TRIP_DATA_ID))
+            continue;
+        if (i++ == n)
+            return id;
+    }
+}
+
+/**
+ * @brief The ECU and @p nodes simulated nodes on the virtual bus for
+ *        @p seconds of sim time.
+ *
+ * @return Non-zero if the ECU sent or received nothing.
+ */
+static int bench_bus(uint32_t nodes, uint32_t seconds, uint32_t bitrate)
+{
+    SilBus_Stats_t     bus;
+    SilBus_NodeStats_t ecu;
+    SilBus_NodeStats_t all;
+    SilBus_NodeStats_t first;
+    SilBus_NodeStats_t last;
+    CanRing_Stats_t    ring;
+    CanStats_Summary_t sum;
+
+    SilBus_Init(bitrate);
+    for (uint32_t n = 1U; n <= nodes; ++n)
+    {
+        SilBus_Traffic_t t =
+        {
+            .id       = bench_bus_id(n),
+            .dlc      = 8U,
+            .periodUs = 10000U * (1U + (n % 10U)),
+            .offsetUs = (n * 137U) % 10000U,
+        };
+
+        if (SilBus_AddNode(&t) == 0U)
+        {
+            fprintf(stderr, "bus: at most %u nodes\n", (unsigned)SIL_BUS_MAX_NODES);
+            return 2;
+        }
+    }
+    (void)CanStats_Get(&sum, NULL, 0U);
+
+    uint32_t rx0 = sum.rxFrames;
+    double   t0  = bench_now_ns();
+
+    for (uint32_t ms = 0U; ms < (seconds * 1000U); ++ms)
+    {
+        /* The firmware's turn (CanTxTask, CanRxTask), then a ms of bus. */
+        (void)CanSched_Run(SimClock_NowMs());
+        bench_drain_can_rx();
+        SilBus_Run(1000U);
+        Sil_AdvanceMs(1U);
+    }
+    bench_drain_can_rx();
+
+    double wallS = (bench_now_ns() - t0) / 1e9;
+
+    SilBus_GetStats(&bus);
+    (void)SilBus_GetNode(0U, &ecu);
+    memset(&all, 0, sizeof(all));
+    memset(&first, 0, sizeof(first));
+    memset(&last, 0, sizeof(last));
+    for (uint32_t n = 1U; n <= nodes; ++n)
+    {
+        SilBus_NodeStats_t st;
+
+        (void)SilBus_GetNode(n, &st);
+        all.sent     += st.sent;
+        all.dropped  += st.dropped;
+        all.lost     += st.lost;
+        all.sumLatUs += st.sumLatUs;
+        if (st.maxLatUs > all.maxLatUs)
+        {
+            all.maxLatUs = st.maxLatUs;
+            all.id       = st.id;
+        }
+        if (n == 1U)
+            first = st;
+        last = st;
+    }
+    CanRing_GetStats(CAN_IF_GetRxRing(), &ring);
+    (void)CanStats_Get(&sum, NULL, 0U);
+
+    printf("bus %lu nodes + ECU, %lu s at %lu bit/s in %.2f s host (%.0fx real time): "
+           "%lu frames, load %.1f %%\n",
+           (unsigned long)nodes, (unsigned long)seconds, (unsigned long)bus.bitrate, wallS,
+           (double)seconds / ((wallS > 0.0) ? wallS : 1e-9), (unsigned long)bus.frames,
+           100.0 * (double)bus.busyBits / ((double)bus.timeUs * (double)bus.bitrate / 1e6));
+    printf("ECU:   %lu sent, %lu arbitrations lost, latency mean %.0f us, max %lu us\n",
+           (unsigned long)ecu.sent, (unsigned long)ecu.lost,
+           (double)ecu.sumLatUs / (double)((ecu.sent != 0U) ? ecu.sent : 1U),
+           (unsigned long)ecu.maxLatUs);
+    printf("nodes: %lu sent, %lu dropped, %lu arbitrations lost, latency mean %.0f us, "
+           "max %lu us (0x%03lX); 0x%03lX max %lu us, 0x%03lX max %lu us\n",
+           (unsigned long)all.sent, (unsigned long)all.dropped, (unsigned long)all.lost,
+           (double)all.sumLatUs / (double)((all.sent != 0U) ? all.sent : 1U),
+           (unsigned long)all.maxLatUs, (unsigned long)all.id, (unsigned long)first.id,
+           (unsigned long)first.maxLatUs, (unsigned long)last.id, (unsigned long)last.maxLatUs);
+    printf("ECU RX: %lu frames, ring high water %lu of %lu, %lu dropped, %lu FIFO overruns\n",
+           (unsigned long)(sum.rxFrames - rx0), (unsigned long)ring.highWater,
+           (unsigned long)ring.capacity, (unsigned long)ring.overflows,
+           (unsigned long)Sil_CanRxOverruns());
+
+    return ((ecu.sent == 0U) || ((nodes != 0U) && (sum.rxFrames == rx0))) ? 1 : 0;
+}
+
+static void bench_on_sigint(int sig)
+{
+    (void)sig;
+    s_stop = 1;
+}
+
+/**
+ * @brief The ECU on SocketCAN interface @p ifname for @p seconds of real
+ *        time (0: until SIGINT).
+ *
+ * @return Non-zero if the interface could not be opened or nothing was sent.
+ */
+static int bench_socketcan(const char *ifname, uint32_t seconds)
+{
+    SilSock_Stats_t    st;
+    CanRing_Stats_t    ring;
+    CanStats_Summary_t sum;
+
+    if (SilSock_Open(ifname) != 0)
+    {
+        fprintf(stderr, "socketcan: %s: %s\n", ifname, strerror(errno));
+        return 1;
+    }
+    (void)signal(SIGINT, bench_on_sigint);
+    printf("ECU on %s%s\n", ifname, (seconds == 0U) ? " until Ctrl-C" : "");
+    fflush(stdout);
+
+    (void)CanStats_Get(&sum, NULL, 0U);
+
+    uint32_t rx0   = sum.rxFrames;
+    double   t0    = bench_now_ns();
+    uint32_t simMs = 0U;
+
+    while ((s_stop == 0) && ((seconds == 0U) || (simMs < (seconds * 1000U))))
+    {
+        /* Wait for frames up to the next tick, or take batches while full. */
+        while (SilSock_Poll(1U) == SIL_SOCK_BATCH)
+            bench_drain_can_rx();
+        bench_drain_can_rx();
+
+        uint32_t nowMs = (uint32_t)((bench_now_ns() - t0) / 1e6);
+        if (nowMs != simMs)
+        {
+            Sil_AdvanceMs(nowMs - simMs);
+            simMs = nowMs;
+            (void)CanSched_Run(SimClock_NowMs());
+        }
+    }
+    SilSock_Close();
+    (void)signal(SIGINT, SIG_DFL);
+
+    SilSock_GetStats(&st);
+    CanRing_GetStats(CAN_IF_GetRxRing(), &ring);
+    (void)CanStats_Get(&sum, NULL, 0U);
+
+    printf("%.1f s: TX %lu frames in %lu sendmmsg (%lu blocked), RX %lu frames in %lu "
+           "recvmmsg (%lu dropped)\n",
+           (double)simMs / 1000.0, (unsigned long)st.txFrames, (unsigned long)st.txCalls,
+           (unsigned long)st.txBlocked, (unsigned long)st.rxFrames, (unsigned long)st.rxCalls,
+           (unsigned long)st.rxErrors);
+    printf("kernel to FIFO0: mean %.0f us, max %lu us\n",
+           (double)st.rxLatSumUs / (double)((st.rxFrames != 0U) ? st.rxFrames : 1U),
+           (unsigned long)st.rxLatMaxUs);
+    printf("ECU RX: %lu frames, ring high water %lu of %lu, %lu dropped, %lu FIFO overruns\n",
+           (unsigned long)(sum.rxFrames - rx0), (unsigned long)ring.highWater,
+           (unsigned long)ring.capacity, (unsigned long)ring.overflows,
+           (unsigned long)Sil_CanRxOverruns());
+
+    return (st.txFrames == 0U) ? 1 : 0;
+}
+
+/**
+ * @brief @p steps of @p vehicles on @p threads workers.
+ *
+ * @return Vehicle-steps per second; the checksum of the frames in @p sum.
+ */
+static double bench_fleet_run(uint32_t vehicles, uint32_t steps, uint32_t threads,
+                              uint64_t *sum)
+{
+    if (SilFleet_Start(vehicles, threads) != 0)
+        return 0.0;
+
+    double   t0     = bench_now_ns();
+    uint32_t frames = 0U;
+
+    for (uint32_t k = 0U; k < steps; ++k)
+    {
+        const SilFleet_Frame_t *f;
+
+        /* The workers are parked: their frame blocks are ours to read. */
+        SilFleet_Step(0.1f);
+        for (uint32_t t = 0U; t < threads; ++t)
+            frames += SilFleet_Frames(t, &f);
+    }
+
+    double ns = bench_now_ns() - t0;
+
+    *sum = SilFleet_Checksum();
+    SilFleet_Stop();
+    s_sink = frames;
+    return ((double)vehicles * (double)steps * 1e9) / ns;
+}
+
+static int bench_fleet(uint32_t vehicles, uint32_t steps, uint32_t maxThreads)
+{
+    uint64_t first = 0U;
+    double   one   = 0.0;
+    int      rc    = 0;
+
+    if (maxThreads == 0U)
+    {
+        long cpus  = sysconf(_SC_NPROCESSORS_ONLN);
+        maxThreads = (cpus > 0) ? (uint32_t)cpus : 1U;
+    }
+    if (maxThreads > SIL_FLEET_MAX_THREADS)
+        maxThreads = SIL_FLEET_MAX_THREADS;
+
+    printf("fleet %lu vehicles, %lu steps\n", (unsigned long)vehicles, (unsigned long)steps);
+    printf("threads  vehicle-steps/s  per thread  speed-up  checksum\n");
+    for (uint32_t t = 1U; t <= maxThreads; t = ((t < maxThreads) && ((t * 2U) > maxThreads))
+                                                ? maxThreads : (t * 2U))
+    {
+        uint64_t sum  = 0U;
+        double   rate = bench_fleet_run(vehicles, steps, t, &sum);
+
+        if (rate <= 0.0)
+        {
+            fprintf(stderr, "fleet: %lu threads could not be started\n", (unsigned long)t);
+            return 1;
+        }
+        if (t == 1U)
+        {
+            first = sum;
+            one   = rate;
+        }
+        printf("%7lu  %15.3e  %10.3e  %7.2fx  %016llx%s\n", (unsigned long)t, rate,
+               rate / (double)t, rate / one, (unsigned long long)sum,
+               (sum != first) ? "  MISMATCH" : "");
+        if (sum != first)
+            rc = 1;
+        if (t == maxThreads)
+            break;
+    }
+    return rc;
+}
+
+static const Bench_t s_benches[] =
+{
+    { "vehicle_update",     bench_vehicle_update,     10.0 },
+    { "telemetry_encode",   bench_telemetry_encode,   1.0  },
+    { "telemetry_loopback", bench_telemetry_loopback, 1.0  },
+    { "log_format",         bench_log_format,         1.0  },
+    { "cli_dispatch",       bench_cli_dispatch,       1.0  },
+    { "cli_rpc",            bench_cli_rpc,            1.0  },
+};
+
+#define BENCH_COUNT  (sizeof(s_benches) / sizeof(s_benches[0]))
+
+/* -------------------------------------------------------------------------- */
+/* Runner                                                                     */
+/* -------------------------------------------------------------------------- */
+
+static double bench_run(const Bench_t *b, uint32_t iters)
+{
+    double best = 0.0;
+
+    b->fn(iters / 10U + 1U);   /* warm caches and branch predictors */
+
+    for (uint32_t r = 0U; r < BENCH_BATCHES; r++)
+    {
+        double t0 = bench_now_ns();
+        b->fn(iters);
+        double ns = (bench_now_ns() - t0) / (double)iters;
+
+        if ((r == 0U) || (ns < best))
+            best = ns;
+    }
+
+    return best;
+}
+
+/**
+ * @brief Compare against "<name> <ns/op>" lines of a baseline file.
+ *
+ * @return Number of regressions beyond @p tolerancePct.
+ */
+static uint32_t bench_check(const char *path, const BenchResult_t *res, uint32_t n,
+                            double tolerancePct)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        fprintf(stderr, "cannot open baseline %s\n", path);
+        return 1U;
+    }
+
+    uint32_t regressions = 0U;
+    char     name[64];
+    double   base;
+
+    while (fscanf(f, "%63s %lf%*[^\n]", name, &base) == 2)
+    {
+        for (uint32_t i = 0U; i < n; i++)
+        {
+            if ((strcmp(name, res[i].name) != 0) || (base <= 0.0))
+                continue;
+
+            double pct = ((res[i].nsPerOp - base) * 100.0) / base;
+            if (pct > tolerancePct)
+            {
+                printf("REGRESSION %s: %.1f ns/op vs %.1f baseline (+%.0f%%)\n",
+                       name, res[i].nsPerOp, base, pct);
+                regressions++;
+            }
+        }
+    }
+
+    fclose(f);
+    return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t    iters     = BENCH_DEFAULT_ITERS;
+    const char *baseline  = NULL;
+    double      tolerance = 25.0;
+    uint32_t    soakHours = 0U;
+    const char *replay    = NULL;
+    uint32_t    speed     = 1000U;
+    double      fromS     = 0.0;
+    double      toS       = 0.0;
+    uint32_t    busNodes  = 0U;
+    uint8_t     bus       = 0U;
+    uint32_t    seconds   = 10U;
+    const char *canIf     = NULL;
+    uint32_t    fleet     = 0U;
+    uint32_t    steps     = 1000U;
+    uint32_t    threads   = 0U;
+    uint32_t    bitrate   = CAN_IF_BITRATE;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc))
+            iters = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-v") == 0)
+            Sil_UartEcho(1U);
+        else if ((strcmp(argv[i], "--baseline") == 0) && (i + 1 < argc))
+            baseline = argv[++i];
+        else if ((strcmp(argv[i], "--tolerance") == 0) && (i + 1 < argc))
+            tolerance = atof(argv[++i]);
+        else if ((strcmp(argv[i], "--soak") == 0) && (i + 1 < argc))
+            soakHours = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if ((strcmp(argv[i], "--replay") == 0) && (i + 1 < argc))
+            replay = argv[++i];
+        else if ((strcmp(argv[i], "--from") == 0) && (i + 1 < argc))
+            fromS = atof(argv[++i]);
+        else if ((strcmp(argv[i], "--to") == 0) && (i + 1 < argc))
+            toS = atof(argv[++i]);
+        else if ((strcmp(argv[i], "--bus") == 0) && (i + 1 < argc))
+        {
+            busNodes = (uint32_t)strtoul(argv[++i], NULL, 10);
+            bus      = 1U;
+        }
+        else if ((strcmp(argv[i], "--seconds") == 0) && (i + 1 < argc))
+            seconds = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if ((strcmp(argv[i], "--fleet") == 0) && (i + 1 < argc))
+            fleet = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if ((strcmp(argv[i], "--steps") == 0) && (i + 1 < argc))
+            steps = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if ((strcmp(argv[i], "--threads") == 0) && (i + 1 < argc))
+            threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if ((strcmp(argv[i], "--socketcan") == 0) && (i + 1 < argc))
+            canIf = argv[++i];
+        else if ((strcmp(argv[i], "--bitrate") == 0) && (i + 1 < argc))
+            bitrate = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if ((strcmp(argv[i], "--speed") == 0) && (i + 1 < argc))
+        {
+            i++;
+            speed = (strcmp(argv[i], "fast") == 0) ? CAN_REPLAY_FAST
+                                                   : (uint32_t)((atof(argv[i]) * 1000.0) + 0.5);
+            if ((strcmp(argv[i], "fast") != 0) && (speed == 0U))
+                speed = 1U;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-n <iterations>] [-v] [--baseline <file>] "
+                            "[--tolerance <pct>]\n"
+                            "       %s --soak <hours> [-v]\n"
+                            "       %s --replay <candump.log> [--speed <factor>|fast] "
+                            "[--from <s>] [--to <s>] [-v]\n"
+                            "       %s --bus <nodes> [--seconds <s>] [--bitrate <bit/s>] [-v]\n"
+                            "       %s --socketcan <ifname> [--seconds <s>] [-v]\n"
+                            "       %s --fleet <vehicles> [--steps <n>] [--threads <max>]\n",
+                    argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+            return 2;
+        }
+    }
+    if (iters == 0U)
+        iters = 1U;
+
+    /* Same bring-up order as main.c, minus clocks and tasks. */
+    Sil_Init();
+    Log_Init(&huart2);
+    Log_SetLevel(LOG_LEVEL_INFO);
+    Powertrain_Init();
+    Vehicle_Init(&s_vs);
+    Vehicle_Publish(&s_vs);
+    MemPool_Init();
+    if ((CAN_IF_Init() != HAL_OK) || (Vehicle_SharedInit() != HAL_OK))
+    {
+        fprintf(stderr, "init failed\n");
+        return 1;
+    }
+    CLI_IF_Init(&huart2);
+    CanAlarm_Init();
+    (void)CanReplay_Init();
+    Scenario_Init();
+    SimClock_Init();
+    (void)CAN_IF_RegisterHandler(CAN_IF_TELEMETRY_ID, 0x7FFU, bench_on_telemetry, &s_decoded);
+
+    /* First pass binds CliTask's thread id; then stop the dashboard. */
+    CLI_IF_Task();
+    bench_cli_line("dash rate 0\r");
+
+    if (soakHours != 0U)
+        return bench_soak(soakHours);
+    if (replay != NULL)
+        return bench_replay(replay, speed, (fromS > 0.0) ? (uint64_t)(fromS * 1e6) : 0U,
+                            (toS > 0.0) ? (uint64_t)(toS * 1e6) : 0U);
+    if (bus != 0U)
+        return bench_bus(busNodes, seconds, bitrate);
+    if (canIf != NULL)
+        return bench_socketcan(canIf, seconds);
+    if (fleet != 0U)
+        return bench_fleet(fleet, (steps != 0U) ? steps : 1U, threads);
+
+    BenchResult_t res[BENCH_MAX];
+
+    for (uint32_t i = 0U; i < BENCH_COUNT; i++)
+    {
+        uint32_t n = (uint32_t)((double)iters * s_benches[i].iterScale);
+
+        res[i].name    = s_benches[i].name;
+        res[i].nsPerOp = bench_run(&s_benches[i], (n > 0U) ? n : 1U);
+        printf("%-20s %10.1f ns/op\n", res[i].name, res[i].nsPerOp);
+    }
+
+    if ((s_decoded.engine_rpm == 0U) || (s_vs.speed_kph <= 0.0f))
+    {
+        fprintf(stderr, "benchmark paths did not run (loopback or CLI broken)\n");
+        return 1;
+    }
+
+    if ((baseline != NULL) && (bench_check(baseline, res, BENCH_COUNT, tolerance) > 0U))
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,38 @@
+/**
+ * @file    FreeRTOS.h
+ * @brief   Host (SIL) stand-in: the static object types the core declares.
+ */
+
+#ifndef SIL_FREERTOS_H
+#define SIL_FREERTOS_H
+
+#include <stdint.h>
+
+/** Opaque storage for a statically allocated queue (layout unused). */
+typedef struct
+{
+    void    *storage;
+    uint32_t words[18];
+} StaticQueue_t;
+
+/* Software timers: the SIL has no timer service, creation fails. */
+typedef uint32_t TickType_t;
+typedef void    *TimerHandle_t;
+typedef void   (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+typedef struct
+{
+    void    *storage;
+    uint32_t words[10];
+} StaticTimer_t;
+
+#define pdTRUE              1
+#define pdPASS              1
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+
+TimerHandle_t xTimerCreateStatic(const char *name, TickType_t period, int autoReload,
+                                 void *id, TimerCallbackFunction_t callback,
+                                 StaticTimer_t *buffer);
+int xTimerStart(TimerHandle_t timer, TickType_t wait);
+
+#endif /* SIL_FREERTOS_H */
@@ -0,0 +1,11 @@
+/**
+ * @file    queue.h
+ * @brief   Host (SIL) stand-in; everything needed lives in FreeRTOS.h.
+ */
+
+#ifndef SIL_QUEUE_H
+#define SIL_QUEUE_H
+
+#include "FreeRTOS.h"
+
+#endif /* SIL_QUEUE_H */
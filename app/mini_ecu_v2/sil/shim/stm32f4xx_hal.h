@@ -0,0 +1,405 @@
+/**
+ * @file    stm32f4xx_hal.h
+ * @brief   Host (SIL) stand-in for the STM32F4 HAL and CMSIS core headers.
+ *
+ * Declares only what the application core compiled by "make sil" uses:
+ * HAL status and handle types, CAN/UART/DMA constants with their real
+ * values, and the Cortex-M intrinsics. Peripheral registers are plain
+ * structs in host RAM; behaviour lives in sil_hal.c.
+ *
+ * The host build is single-threaded, so exclusive accesses always succeed
+ * and interrupt masking only tracks the PRIMASK value.
+ */
+
+#ifndef SIL_STM32F4XX_HAL_H
+#define SIL_STM32F4XX_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Common                                                                     */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    HAL_OK      = 0x00U,
+    HAL_ERROR   = 0x01U,
+    HAL_BUSY    = 0x02U,
+    HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum { DISABLE = 0U, ENABLE = !DISABLE } FunctionalState;
+
+#define GPIO_PIN_2    ((uint16_t)0x0004U)
+#define GPIO_PIN_3    ((uint16_t)0x0008U)
+#define GPIO_PIN_5    ((uint16_t)0x0020U)
+#define GPIO_PIN_13   ((uint16_t)0x2000U)
+#define GPIO_PIN_14   ((uint16_t)0x4000U)
+
+extern uint32_t SystemCoreClock;
+
+uint32_t HAL_GetTick(void);
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+
+/* -------------------------------------------------------------------------- */
+/* Cortex-M core                                                              */
+/* -------------------------------------------------------------------------- */
+
+extern uint32_t g_silPrimask;
+
+#define __DMB()                  __sync_synchronize()
+#define __DSB()                  __sync_synchronize()
+#define __ISB()                  __sync_synchronize()
+#define __NOP()                  do { } while (0)
+#define __LDREXW(ptr)            (*(ptr))
+#define __STREXW(val, ptr)       ((*(ptr) = (val)), 0U)
+#define __CLREX()                do { } while (0)
+#define __CLZ(x)                 (((x) == 0U) ? 32U : (uint32_t)__builtin_clz(x))
+#define __get_PRIMASK()          (g_silPrimask)
+#define __set_PRIMASK(v)         (g_silPrimask = (v))
+#define __disable_irq()          (g_silPrimask = 1U)
+#define __enable_irq()           (g_silPrimask = 0U)
+
+/* Pending an interrupt runs it at once (sil_hal.c), as an enabled one
+ * above the caller would. */
+typedef int32_t IRQn_Type;
+
+#define CAN1_TX_IRQn             ((IRQn_Type)19)
+
+void NVIC_SetPendingIRQ(IRQn_Type irq);
+
+typedef struct
+{
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+    volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+typedef struct
+{
+    volatile uint32_t CTRL;
+    volatile uint32_t LOAD;
+    volatile uint32_t VAL;
+} SysTick_Type;
+
+typedef struct
+{
+    volatile uint32_t ICSR;
+} SCB_Type;
+
+/* Trace blocks of the "itm" log transport; TER stays 0, so it drops. */
+typedef struct
+{
+    union
+    {
+        volatile uint8_t  u8;
+        volatile uint32_t u32;
+    } PORT[32];
+    volatile uint32_t TER;
+    volatile uint32_t TPR;
+    volatile uint32_t TCR;
+    volatile uint32_t LAR;
+} ITM_Type;
+
+typedef struct
+{
+    volatile uint32_t CSPSR;
+    volatile uint32_t ACPR;
+    volatile uint32_t SPPR;
+    volatile uint32_t FFCR;
+} TPI_Type;
+
+typedef struct
+{
+    volatile uint32_t CR;
+} DBGMCU_TypeDef;
+
+typedef struct
+{
+    volatile uint32_t KR;
+    volatile uint32_t PR;
+    volatile uint32_t RLR;
+    volatile uint32_t SR;
+} IWDG_TypeDef;
+
+extern DWT_Type       g_silDwt;
+extern CoreDebug_Type g_silCoreDebug;
+extern SysTick_Type   g_silSysTick;
+extern SCB_Type       g_silScb;
+extern ITM_Type       g_silItm;
+extern TPI_Type       g_silTpi;
+extern DBGMCU_TypeDef g_silDbgmcu;
+extern IWDG_TypeDef   g_silIwdg;
+
+#define DWT                          (&g_silDwt)
+#define CoreDebug                    (&g_silCoreDebug)
+#define SysTick                      (&g_silSysTick)
+#define SCB                          (&g_silScb)
+#define ITM                          (&g_silItm)
+#define TPI                          (&g_silTpi)
+#define DBGMCU                       (&g_silDbgmcu)
+#define IWDG                         (&g_silIwdg)
+#define ITM_TCR_ITMENA_Msk           (1UL << 0)
+#define ITM_TCR_TraceBusID_Pos       16U
+#define DBGMCU_CR_TRACE_IOEN         (1UL << 5)
+#define SCB_ICSR_PENDSTSET_Msk       (1UL << 26)
+#define DWT_CTRL_CYCCNTENA_Msk       (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk   (1UL << 24)
+
+/* -------------------------------------------------------------------------- */
+/* DMA                                                                        */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    volatile uint32_t CR;
+    volatile uint32_t NDTR;
+} DMA_Stream_TypeDef;
+
+typedef struct
+{
+    DMA_Stream_TypeDef *Instance;
+} DMA_HandleTypeDef;
+
+#define DMA_SxCR_EN                     (1UL << 0)
+#define DMA_IT_HT                       (1UL << 3)
+#define __HAL_DMA_GET_COUNTER(h)        ((h)->Instance->NDTR)
+#define __HAL_DMA_DISABLE_IT(h, it)     ((h)->Instance->CR &= ~(it))
+
+/* -------------------------------------------------------------------------- */
+/* UART                                                                       */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    HAL_UART_STATE_RESET   = 0x00U,
+    HAL_UART_STATE_READY   = 0x20U,
+    HAL_UART_STATE_BUSY_RX = 0x22U
+} HAL_UART_StateTypeDef;
+
+typedef struct
+{
+    DMA_HandleTypeDef              *hdmarx;
+    volatile HAL_UART_StateTypeDef  gState;
+    volatile HAL_UART_StateTypeDef  RxState;
+} UART_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData,
+                                    uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData,
+                                        uint16_t Size);
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *pData,
+                                               uint16_t Size);
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart);
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size);
+
+/* -------------------------------------------------------------------------- */
+/* TIM                                                                        */
+/* -------------------------------------------------------------------------- */
+
+/* Named by clock_cfg.h only; the host has no timers to retime. */
+typedef struct
+{
+    volatile uint32_t CR1;
+    volatile uint32_t CNT;
+    volatile uint32_t PSC;
+    volatile uint32_t ARR;
+} TIM_TypeDef;
+
+/* -------------------------------------------------------------------------- */
+/* CAN                                                                        */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    volatile uint32_t TIR;
+    volatile uint32_t TDTR;
+    volatile uint32_t TDLR;
+    volatile uint32_t TDHR;
+} CAN_TxMailBox_TypeDef;
+
+typedef struct
+{
+    volatile uint32_t FR1;
+    volatile uint32_t FR2;
+} CAN_FilterRegister_TypeDef;
+
+/* Filters are not emulated: received frames report FMI 0xFF (no entry). */
+typedef struct
+{
+    volatile uint32_t          MCR;
+    volatile uint32_t          TSR;
+    volatile uint32_t          ESR;
+    volatile uint32_t          BTR;
+    CAN_TxMailBox_TypeDef      sTxMailBox[3];
+    volatile uint32_t          FA1R;
+    CAN_FilterRegister_TypeDef sFilterRegister[28];
+} CAN_TypeDef;
+
+#define CAN_MCR_SLEEP                (1UL << 1)
+#define CAN_MCR_TXFP                 (1UL << 2)
+
+#define CAN_TSR_RQCP0                (1UL << 0)   /* not modelled: no TX-complete interrupt */
+#define CAN_TSR_CODE_Pos             (24U)
+#define CAN_TSR_CODE                 (0x3UL << CAN_TSR_CODE_Pos)
+#define CAN_TSR_TME_Pos              (26U)
+#define CAN_TSR_TME                  (0x7UL << CAN_TSR_TME_Pos)
+
+#define CAN_TI0R_TXRQ                (1UL << 0)
+#define CAN_TI0R_RTR                 (1UL << 1)
+#define CAN_TI0R_IDE                 (1UL << 2)
+#define CAN_TI0R_EXID_Pos            (3U)
+#define CAN_TI0R_STID_Pos            (21U)
+#define CAN_TDT0R_DLC                (0xFUL)
+
+typedef struct
+{
+    uint32_t Prescaler;
+    uint32_t Mode;
+    uint32_t SyncJumpWidth;
+    uint32_t TimeSeg1;
+    uint32_t TimeSeg2;
+} CAN_InitTypeDef;
+
+typedef enum
+{
+    HAL_CAN_STATE_RESET     = 0x00U,
+    HAL_CAN_STATE_READY     = 0x01U,
+    HAL_CAN_STATE_LISTENING = 0x02U,
+    HAL_CAN_STATE_ERROR     = 0x05U
+} HAL_CAN_StateTypeDef;
+
+typedef struct
+{
+    CAN_TypeDef                   *Instance;
+    CAN_InitTypeDef                Init;
+    volatile HAL_CAN_StateTypeDef  State;
+    volatile uint32_t              ErrorCode;
+} CAN_HandleTypeDef;
+
+typedef struct
+{
+    uint32_t StdId;
+    uint32_t ExtId;
+    uint32_t IDE;
+    uint32_t RTR;
+    uint32_t DLC;
+    FunctionalState TransmitGlobalTime;
+} CAN_TxHeaderTypeDef;
+
+typedef struct
+{
+    uint32_t StdId;
+    uint32_t ExtId;
+    uint32_t IDE;
+    uint32_t RTR;
+    uint32_t DLC;
+    uint32_t Timestamp;
+    uint32_t FilterMatchIndex;
+} CAN_RxHeaderTypeDef;
+
+typedef struct
+{
+    uint32_t FilterIdHigh;
+    uint32_t FilterIdLow;
+    uint32_t FilterMaskIdHigh;
+    uint32_t FilterMaskIdLow;
+    uint32_t FilterFIFOAssignment;
+    uint32_t FilterBank;
+    uint32_t FilterMode;
+    uint32_t FilterScale;
+    uint32_t FilterActivation;
+    uint32_t SlaveStartFilterBank;
+} CAN_FilterTypeDef;
+
+#define CAN_ESR_EWGF                 (1UL << 0)
+#define CAN_ESR_EPVF                 (1UL << 1)
+#define CAN_ESR_BOFF                 (1UL << 2)
+#define CAN_ESR_TEC_Pos              (16U)
+#define CAN_ESR_REC_Pos              (24U)
+
+#define CAN_BTR_BRP_Pos              (0U)
+#define CAN_BTR_TS1_Pos              (16U)
+#define CAN_BTR_TS2_Pos              (20U)
+#define CAN_BTR_SJW_Pos              (24U)
+
+#define CAN_MODE_NORMAL              (0x00000000U)
+#define CAN_MODE_LOOPBACK            (1UL << 30)
+#define CAN_MODE_SILENT              (1UL << 31)
+#define CAN_MODE_SILENT_LOOPBACK     (CAN_MODE_LOOPBACK | CAN_MODE_SILENT)
+
+#define CAN_ID_STD                   (0x00000000U)
+#define CAN_ID_EXT                   (0x00000004U)
+#define CAN_RTR_DATA                 (0x00000000U)
+#define CAN_RTR_REMOTE               (0x00000002U)
+
+#define CAN_RX_FIFO0                 (0x00000000U)
+#define CAN_RX_FIFO1                 (0x00000001U)
+#define CAN_FILTER_FIFO0             (0x00000000U)
+#define CAN_FILTER_FIFO1             (0x00000001U)
+
+#define CAN_FILTERMODE_IDMASK        (0x00000000U)
+#define CAN_FILTERMODE_IDLIST        (0x00000001U)
+#define CAN_FILTERSCALE_16BIT        (0x00000000U)
+#define CAN_FILTERSCALE_32BIT        (0x00000001U)
+
+#define CAN_IT_TX_MAILBOX_EMPTY      (1UL << 0)
+#define CAN_IT_RX_FIFO0_MSG_PENDING  (1UL << 1)
+#define CAN_IT_RX_FIFO1_MSG_PENDING  (1UL << 4)
+#define CAN_IT_ERROR_WARNING         (1UL << 8)
+#define CAN_IT_ERROR_PASSIVE         (1UL << 9)
+#define CAN_IT_BUSOFF                (1UL << 10)
+#define CAN_IT_LAST_ERROR_CODE       (1UL << 11)
+#define CAN_IT_ERROR                 (1UL << 15)
+#define CAN_IT_WAKEUP                (1UL << 16)
+
+#define HAL_CAN_ERROR_NONE           (0x00000000U)
+#define HAL_CAN_ERROR_BOF            (0x00000004U)
+#define HAL_CAN_ERROR_STF            (0x00000008U)
+#define HAL_CAN_ERROR_FOR            (0x00000010U)
+#define HAL_CAN_ERROR_ACK            (0x00000020U)
+#define HAL_CAN_ERROR_BR             (0x00000040U)
+#define HAL_CAN_ERROR_BD             (0x00000080U)
+#define HAL_CAN_ERROR_CRC            (0x00000100U)
+#define HAL_CAN_ERROR_RX_FOV0        (0x00000200U)
+#define HAL_CAN_ERROR_RX_FOV1        (0x00000400U)
+
+#define CAN_TX_MAILBOX0              (0x00000001U)
+#define CAN_TX_MAILBOX1              (0x00000002U)
+#define CAN_TX_MAILBOX2              (0x00000004U)
+
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan, const CAN_FilterTypeDef *sFilterConfig);
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_Stop(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef *hcan, uint32_t ActiveITs);
+HAL_StatusTypeDef HAL_CAN_RequestSleep(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_WakeUp(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan, const CAN_TxHeaderTypeDef *pHeader,
+                                       const uint8_t aData[], uint32_t *pTxMailbox);
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel(const CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_AbortTxRequest(CAN_HandleTypeDef *hcan, uint32_t TxMailboxes);
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan, uint32_t RxFifo,
+                                       CAN_RxHeaderTypeDef *pHeader, uint8_t aData[]);
+uint32_t HAL_CAN_GetRxFifoFillLevel(const CAN_HandleTypeDef *hcan, uint32_t RxFifo);
+HAL_CAN_StateTypeDef HAL_CAN_GetState(const CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_ResetError(CAN_HandleTypeDef *hcan);
+void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIL_STM32F4XX_HAL_H */
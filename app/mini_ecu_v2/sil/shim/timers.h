@@ -0,0 +1,11 @@
+/**
+ * @file    timers.h
+ * @brief   Host (SIL) stand-in; everything needed lives in FreeRTOS.h.
+ */
+
+#ifndef SIL_TIMERS_H
+#define SIL_TIMERS_H
+
+#include "FreeRTOS.h"
+
+#endif /* SIL_TIMERS_H */
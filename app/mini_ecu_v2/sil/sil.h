@@ -0,0 +1,101 @@
+/**
+ * @file    sil.h
+ * @brief   Host (SIL) harness controls on top of the HAL / RTOS shims.
+ *
+ * The shims in sil_hal.c stand in for the STM32 HAL and CMSIS-RTOS2 so the
+ * application core links into a single-threaded host program:
+ *
+ *   - Time only moves with Sil_AdvanceMs().
+ *   - The kernel reports "not running", so Log_* flushes synchronously
+ *     through HAL_UART_Transmit() into the UART sink.
+ *   - Bytes given to Sil_UartRx() land in the CLI's circular RX DMA buffer
+ *     and raise the IDLE-line event.
+ *   - CAN frames are accepted by a free mailbox at once. With loopback on,
+ *     each one is also queued in the emulated RX FIFO0 and the FIFO0
+ *     interrupt callback runs. Acceptance filters are not emulated; frames
+ *     carry an out-of-range filter match index, so dispatch uses the ID
+ *     lookup. On the virtual bus (sil_bus.h) the mailboxes contend with
+ *     the simulated nodes instead and complete when their frame ends; on
+ *     a SocketCAN interface (sil_sock.h) they go out on it and its frames
+ *     come in, loopback or not.
+ *   - Thread flags never block: a wait returns the pending flags or a
+ *     timeout. Message queues are plain rings over the caller's memory.
+ *   - There is no flash log (nvm_log.c): calibration runs on its table
+ *     defaults and "cal commit" writes nothing.
+ */
+
+#ifndef SIL_H
+#define SIL_H
+
+#include "main.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Handles the application expects from main.c. */
+extern CAN_HandleTypeDef  hcan1;
+extern UART_HandleTypeDef huart2;
+
+/**
+ * @brief Reset the emulated peripherals (call before the module inits).
+ */
+void Sil_Init(void);
+
+/**
+ * @brief Advance HAL_GetTick() / osKernelGetTickCount().
+ */
+void Sil_AdvanceMs(uint32_t ms);
+
+/**
+ * @brief Feed bytes into the CLI UART as if received by the RX DMA.
+ */
+void Sil_UartRx(const char *data, uint32_t len);
+
+/**
+ * @brief Echo UART output to stdout (default off).
+ */
+void Sil_UartEcho(uint8_t enable);
+
+/**
+ * @brief Bytes sent on the UART so far.
+ */
+uint32_t Sil_UartTxBytes(void);
+
+/**
+ * @brief Enable or disable CAN loopback delivery into RX FIFO0.
+ */
+void Sil_CanLoopback(uint8_t enable);
+
+/**
+ * @brief Frames sent from the CAN1 mailboxes so far.
+ */
+uint32_t Sil_CanTxCount(void);
+
+/**
+ * @brief Receive a frame (CAN_IF key) into RX FIFO0 and run its interrupt.
+ */
+void Sil_CanReceive(uint32_t key, uint8_t dlc, const uint8_t *data);
+
+/**
+ * @brief Frames lost to a full RX FIFO0.
+ */
+uint32_t Sil_CanRxOverruns(void);
+
+/**
+ * @brief The virtual bus sent CAN1 mailbox @p mailbox: free it and run
+ *        the TX interrupt.
+ */
+void Sil_CanTxDone(uint32_t mailbox);
+
+/**
+ * @brief Bus time (sil_bus.h) at which @p mailbox was requested.
+ */
+uint64_t Sil_CanTxQueuedNs(uint32_t mailbox);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIL_H */
@@ -0,0 +1,390 @@
+/**
+ * @file    sil_bus.c
+ * @brief   Host (SIL) virtual CAN bus. See sil_bus.h for the model.
+ */
+
+#include "sil_bus.h"
+#include "sil.h"
+#include "can_if.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* CRC delimiter, ACK slot and delimiter, EOF, intermission. */
+#define SB_TAIL_BITS     13U
+
+#define SB_NONE          0xFFFFFFFFU
+
+/* What every simulated node sends: the content sets its stuff bits. */
+static const uint8_t s_sbPayload[8] = { 0x55U, 0xAAU, 0x00U, 0xFFU, 0x12U, 0x34U, 0x56U, 0x78U };
+
+typedef struct
+{
+    uint64_t queuedNs;
+} SbEntry_t;
+
+typedef struct
+{
+    SilBus_Traffic_t   t;
+    SilBus_NodeStats_t st;
+    uint64_t           nextNs;     /* next frame due */
+    uint32_t           arb;        /* arbitration field of its frame */
+    uint32_t           bits;       /* and its length; the content is fixed */
+    SbEntry_t          q[SIL_BUS_NODE_QUEUE];
+    uint32_t           head;
+    uint32_t           count;
+} SbNode_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static SbNode_t           s_sbNodes[SIL_BUS_MAX_NODES];
+static uint32_t           s_sbCount    = 0U;
+static SilBus_NodeStats_t s_sbEcu;
+static uint8_t            s_sbAttached = 0U;
+static uint32_t           s_sbBitrate  = 500000U;
+static uint64_t           s_sbNowNs    = 0U;
+static uint64_t           s_sbIdleNs   = 0U;   /* bus free again */
+static uint64_t           s_sbBusyBits = 0U;
+static uint32_t           s_sbFrames   = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint64_t sb_bits_ns(uint64_t bits)
+{
+    return (bits * 1000000000ULL) / s_sbBitrate;
+}
+
+/**
+ * @brief Arbitration field as one number, lowest wins: base ID, then
+ *        RTR/SRR, IDE, the extended bits and the extended RTR.
+ */
+static uint32_t sb_arb(uint32_t key)
+{
+    uint32_t rtr = ((key & CAN_IF_ID_RTR) != 0U) ? 1U : 0U;
+
+    if ((key & CAN_IF_ID_EXT) == 0U)
+        return ((key & 0x7FFU) << 21) | (rtr << 20);
+
+    uint32_t id = key & CAN_IF_ID_MASK;
+    return ((id >> 18) << 21) | (1UL << 20) | (1UL << 19) | ((id & 0x3FFFFU) << 1) | rtr;
+}
+
+static void sb_put(uint8_t *bits, uint32_t *n, uint32_t v, uint32_t width)
+{
+    while (width-- > 0U)
+        bits[(*n)++] = (uint8_t)((v >> width) & 1U);
+}
+
+/** Bits on the wire of a data or remote frame, stuff bits of this content included. */
+static uint32_t sb_frame_bits(uint32_t key, uint8_t dlc, const uint8_t *data)
+{
+    uint8_t  bits[160];
+    uint32_t n   = 0U;
+    uint32_t id  = key & CAN_IF_ID_MASK;
+    uint32_t rtr = ((key & CAN_IF_ID_RTR) != 0U) ? 1U : 0U;
+    uint32_t len = (rtr != 0U) ? 0U : ((dlc > 8U) ? 8U : dlc);
+
+    sb_put(bits, &n, 0U, 1U);                           /* SOF */
+    if ((key & CAN_IF_ID_EXT) == 0U)
+    {
+        sb_put(bits, &n, id & 0x7FFU, 11U);
+        sb_put(bits, &n, rtr, 1U);
+        sb_put(bits, &n, 0U, 2U);                       /* IDE, r0 */
+    }
+    else
+    {
+        sb_put(bits, &n, id >> 18, 11U);
+        sb_put(bits, &n, 3U, 2U);                       /* SRR, IDE */
+        sb_put(bits, &n, id & 0x3FFFFU, 18U);
+        sb_put(bits, &n, rtr, 1U);
+        sb_put(bits, &n, 0U, 2U);                       /* r1, r0 */
+    }
+    sb_put(bits, &n, dlc & 0x0FU, 4U);
+    for (uint32_t i = 0U; i < len; ++i)
+        sb_put(bits, &n, data[i], 8U);
+
+    uint32_t crc = 0U;
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        uint32_t next = bits[i] ^ ((crc >> 14) & 1U);
+
+        crc = (crc << 1) & 0x7FFFU;
+        if (next != 0U)
+            crc ^= 0x4599U;
+    }
+    sb_put(bits, &n, crc, 15U);
+
+    /* After five equal bits the sender inserts the opposite one, which
+     * starts the next run. */
+    uint32_t stuff = 0U;
+    uint32_t run   = 1U;
+    uint8_t  prev  = bits[0];
+    for (uint32_t i = 1U; i < n; ++i)
+    {
+        if (bits[i] == prev)
+            run++;
+        else
+        {
+            prev = bits[i];
+            run  = 1U;
+        }
+        if (run == 5U)
+        {
+            stuff++;
+            prev = (uint8_t)(prev ^ 1U);
+            run  = 1U;
+        }
+    }
+    return n + stuff + SB_TAIL_BITS;
+}
+
+static void sb_latency(SilBus_NodeStats_t *st, uint64_t queuedNs, uint64_t endNs)
+{
+    uint32_t us = (uint32_t)((endNs - queuedNs) / 1000U);
+
+    st->sent++;
+    st->sumLatUs += us;
+    if (us > st->maxLatUs)
+        st->maxLatUs = us;
+}
+
+/** CAN_IF key of the ECU's mailbox @p mb. */
+static uint32_t sb_mailbox_key(uint32_t mb)
+{
+    uint32_t tir = hcan1.Instance->sTxMailBox[mb].TIR;
+    uint32_t key = ((tir & CAN_TI0R_IDE) != 0U) ? ((tir >> CAN_TI0R_EXID_Pos) | CAN_IF_ID_EXT)
+                                                : (tir >> CAN_TI0R_STID_Pos);
+
+    return ((tir & CAN_TI0R_RTR) != 0U) ? (key | CAN_IF_ID_RTR) : key;
+}
+
+/** Queue the frames of every node due by @p now. */
+static void sb_generate(uint64_t now)
+{
+    for (uint32_t i = 0U; i < s_sbCount; ++i)
+    {
+        SbNode_t *node = &s_sbNodes[i];
+
+        while (node->nextNs <= now)
+        {
+            if (node->count == SIL_BUS_NODE_QUEUE)
+                node->st.dropped++;
+            else
+                node->q[(node->head + node->count++) % SIL_BUS_NODE_QUEUE].queuedNs = node->nextNs;
+            node->nextNs += (uint64_t)node->t.periodUs * 1000U;
+        }
+    }
+}
+
+/** Earliest frame due on any node. */
+static uint64_t sb_next_due(void)
+{
+    uint64_t next = UINT64_MAX;
+
+    for (uint32_t i = 0U; i < s_sbCount; ++i)
+    {
+        if (s_sbNodes[i].nextNs < next)
+            next = s_sbNodes[i].nextNs;
+    }
+    return next;
+}
+
+/**
+ * @brief Arbitrate among the node queue heads and the ECU's mailboxes.
+ *
+ * @return Winning node index, SB_NONE if nothing is pending, s_sbCount for
+ *         the ECU; its lowest pending mailbox in @p ecuMb, or SB_NONE.
+ */
+static uint32_t sb_arbitrate(uint32_t *ecuMb)
+{
+    uint32_t best    = SB_NONE;
+    uint64_t bestArb = UINT64_MAX;
+
+    *ecuMb = SB_NONE;
+    for (uint32_t i = 0U; i < s_sbCount; ++i)
+    {
+        if (s_sbNodes[i].count == 0U)
+            continue;
+        if (s_sbNodes[i].arb < bestArb)
+        {
+            bestArb = s_sbNodes[i].arb;
+            best    = i;
+        }
+    }
+
+    /* bxCAN offers its lowest pending identifier (TXFP = 0). */
+    uint64_t ecuArb = UINT64_MAX;
+    for (uint32_t mb = 0U; (hcan1.State == HAL_CAN_STATE_LISTENING) && (mb < 3U); ++mb)
+    {
+        if ((hcan1.Instance->sTxMailBox[mb].TIR & CAN_TI0R_TXRQ) == 0U)
+            continue;
+        if (sb_arb(sb_mailbox_key(mb)) < ecuArb)
+        {
+            ecuArb = sb_arb(sb_mailbox_key(mb));
+            *ecuMb = mb;
+        }
+    }
+    if (ecuArb < bestArb)
+        best = s_sbCount;
+    return best;
+}
+
+/** Send the ECU's mailbox @p mb; it is delivered to nobody (no loopback). */
+static uint32_t sb_ecu_frame(uint32_t mb, uint64_t *queuedNs)
+{
+    const CAN_TxMailBox_TypeDef *m   = &hcan1.Instance->sTxMailBox[mb];
+    uint32_t                     key = sb_mailbox_key(mb);
+    uint8_t                      data[8];
+
+    memcpy(&data[0], (const void *)&m->TDLR, 4U);
+    memcpy(&data[4], (const void *)&m->TDHR, 4U);
+
+    s_sbEcu.id = key;
+    *queuedNs  = Sil_CanTxQueuedNs(mb);
+    return sb_frame_bits(key, (uint8_t)(m->TDTR & 0x0FU), data);
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void SilBus_Init(uint32_t bitrate)
+{
+    memset(s_sbNodes, 0, sizeof(s_sbNodes));
+    memset(&s_sbEcu, 0, sizeof(s_sbEcu));
+    s_sbCount    = 0U;
+    s_sbBitrate  = (bitrate != 0U) ? bitrate : 500000U;
+    s_sbNowNs    = 0U;
+    s_sbIdleNs   = 0U;
+    s_sbBusyBits = 0U;
+    s_sbFrames   = 0U;
+    s_sbAttached = 1U;
+}
+
+uint32_t SilBus_AddNode(const SilBus_Traffic_t *traffic)
+{
+    if ((s_sbCount >= SIL_BUS_MAX_NODES) || (traffic->periodUs == 0U))
+        return 0U;
+
+    SbNode_t *node = &s_sbNodes[s_sbCount];
+
+    memset(node, 0, sizeof(*node));
+    node->t      = *traffic;
+    node->st.id  = traffic->id;
+    node->nextNs = s_sbNowNs + ((uint64_t)traffic->offsetUs * 1000U);
+    node->arb    = sb_arb(traffic->id);
+    node->bits   = sb_frame_bits(traffic->id, traffic->dlc, s_sbPayload);
+    return ++s_sbCount;
+}
+
+void SilBus_Run(uint32_t us)
+{
+    uint64_t end = s_sbNowNs + ((uint64_t)us * 1000U);
+
+    while (s_sbNowNs < end)
+    {
+        /* A frame on the bus: nothing happens until it ends. */
+        if (s_sbIdleNs > s_sbNowNs)
+        {
+            s_sbNowNs = (s_sbIdleNs < end) ? s_sbIdleNs : end;
+            continue;
+        }
+
+        sb_generate(s_sbNowNs);
+
+        uint32_t mb;
+        uint32_t win = sb_arbitrate(&mb);
+
+        if (win == SB_NONE)
+        {
+            /* Idle until the next node frame; the ECU queues only between
+             * two SilBus_Run() calls. */
+            uint64_t next = sb_next_due();
+
+            s_sbNowNs = (next < end) ? next : end;
+            continue;
+        }
+
+        uint64_t queuedNs;
+        uint32_t bits;
+
+        if (win == s_sbCount)
+            bits = sb_ecu_frame(mb, &queuedNs);
+        else
+        {
+            SbNode_t *node = &s_sbNodes[win];
+
+            queuedNs = node->q[node->head].queuedNs;
+            bits     = node->bits;
+        }
+
+        /* Everyone else with a frame pending backs off to receive. */
+        for (uint32_t i = 0U; i < s_sbCount; ++i)
+        {
+            if ((i != win) && (s_sbNodes[i].count != 0U))
+                s_sbNodes[i].st.lost++;
+        }
+        if ((win != s_sbCount) && (mb != SB_NONE))
+            s_sbEcu.lost++;
+
+        uint64_t frameEnd = s_sbNowNs + sb_bits_ns(bits);
+
+        s_sbIdleNs    = frameEnd;
+        s_sbBusyBits += bits;
+        s_sbFrames++;
+        s_sbNowNs     = frameEnd;
+
+        if (win == s_sbCount)
+        {
+            sb_latency(&s_sbEcu, queuedNs, frameEnd);
+            Sil_CanTxDone(mb);
+        }
+        else
+        {
+            SbNode_t *node = &s_sbNodes[win];
+
+            node->head = (node->head + 1U) % SIL_BUS_NODE_QUEUE;
+            node->count--;
+            sb_latency(&node->st, queuedNs, frameEnd);
+            Sil_CanReceive(node->t.id, node->t.dlc, s_sbPayload);
+        }
+    }
+}
+
+uint8_t SilBus_Attached(void)
+{
+    return s_sbAttached;
+}
+
+uint64_t SilBus_NowNs(void)
+{
+    return s_sbNowNs;
+}
+
+void SilBus_GetStats(SilBus_Stats_t *out)
+{
+    out->timeUs   = s_sbNowNs / 1000U;
+    out->busyBits = s_sbBusyBits;
+    out->frames   = s_sbFrames;
+    out->nodes    = s_sbCount;
+    out->bitrate  = s_sbBitrate;
+}
+
+uint8_t SilBus_GetNode(uint32_t node, SilBus_NodeStats_t *out)
+{
+    if (node == 0U)
+    {
+        *out = s_sbEcu;
+        return 1U;
+    }
+    if (node > s_sbCount)
+        return 0U;
+    *out = s_sbNodes[node - 1U].st;
+    return 1U;
+}
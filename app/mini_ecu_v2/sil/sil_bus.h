@@ -0,0 +1,116 @@
+/**
+ * @file    sil_bus.h
+ * @brief   Host (SIL) virtual CAN bus: the ECU's CAN1 and many simulated
+ *          nodes on one arbitrating bus.
+ *
+ * The firmware under test is node 0: its three mailboxes (sil_hal.c)
+ * contend on the bus instead of completing at once, and what the other
+ * nodes send lands in its RX FIFO0, three frames deep like bxCAN. Every
+ * other node is a traffic model: one periodic data frame with its own
+ * period and phase, queued in a small FIFO; a frame still queued when the
+ * next is due is dropped, as an ECU whose task cannot keep up does.
+ *
+ * SilBus_Run() moves bus time on in whole bits at SilBus_Init()'s rate.
+ * Whenever the bus is idle the lowest pending arbitration field wins
+ * (11-bit ID, RTR and IDE, then the 18 extended bits, as on the wire);
+ * every node that had a frame pending and lost counts an arbitration loss.
+ * A frame takes its exact length: header, data, CRC-15 and the stuff bits
+ * of that content, then CRC delimiter, ACK, EOF and the 3-bit intermission.
+ * Error frames, bus-off and identical IDs of two nodes are not modelled.
+ *
+ * The harness is single-threaded: the firmware runs between two
+ * SilBus_Run() calls and the bus between, so the queues need no locks.
+ * Per node the statistics give frames sent and dropped, arbitration
+ * losses and the latency from queuing (AddTxMessage for node 0) to the end
+ * of the frame; the bus gives its load. "mini_ecu_sil --bus <nodes>" runs
+ * the ECU against that many nodes (bench.c).
+ */
+
+#ifndef SIL_BUS_H
+#define SIL_BUS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Simulated nodes, node 0 (the ECU) not counted. */
+#ifndef SIL_BUS_MAX_NODES
+#define SIL_BUS_MAX_NODES   1024U
+#endif
+
+/** Frames a simulated node holds before it drops one. */
+#ifndef SIL_BUS_NODE_QUEUE
+#define SIL_BUS_NODE_QUEUE  4U
+#endif
+
+/** Traffic of one simulated node. */
+typedef struct
+{
+    uint32_t id;          /**< CAN_IF_ID_EXT set for a 29-bit identifier. */
+    uint8_t  dlc;
+    uint32_t periodUs;
+    uint32_t offsetUs;    /**< First frame after this much bus time. */
+} SilBus_Traffic_t;
+
+typedef struct
+{
+    uint32_t id;          /**< Node 0: the last frame sent. */
+    uint32_t sent;
+    uint32_t dropped;     /**< Queue full when the next frame was due. */
+    uint32_t lost;        /**< Arbitrations lost. */
+    uint32_t maxLatUs;    /**< Queued to end of frame. */
+    uint64_t sumLatUs;
+} SilBus_NodeStats_t;
+
+typedef struct
+{
+    uint64_t timeUs;      /**< Bus time since SilBus_Init(). */
+    uint64_t busyBits;    /**< Bits of frames and intermission. */
+    uint32_t frames;
+    uint32_t nodes;
+    uint32_t bitrate;
+} SilBus_Stats_t;
+
+/**
+ * @brief Start an empty bus at @p bitrate and attach the ECU's CAN1 as
+ *        node 0 (its frames no longer complete at once).
+ */
+void SilBus_Init(uint32_t bitrate);
+
+/**
+ * @brief Add a simulated node.
+ *
+ * @return Its node number (1..SIL_BUS_MAX_NODES), or 0 if the bus is full.
+ */
+uint32_t SilBus_AddNode(const SilBus_Traffic_t *traffic);
+
+/**
+ * @brief Let @p us of bus time pass; the frames that end meanwhile are
+ *        delivered (and the ECU's mailboxes refilled) as they end.
+ */
+void SilBus_Run(uint32_t us);
+
+/**
+ * @brief 1 once SilBus_Init() has attached the ECU.
+ */
+uint8_t SilBus_Attached(void);
+
+/**
+ * @brief Bus time now (ns), for queue stamps.
+ */
+uint64_t SilBus_NowNs(void);
+
+void SilBus_GetStats(SilBus_Stats_t *out);
+
+/**
+ * @brief Figures of node @p node (0 = the ECU). @return 0 if no such node.
+ */
+uint8_t SilBus_GetNode(uint32_t node, SilBus_NodeStats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIL_BUS_H */
@@ -0,0 +1,270 @@
+/**
+ * @file    sil_fleet.c
+ * @brief   Host (SIL) sharded fleet simulation. See sil_fleet.h.
+ */
+
+#include "sil_fleet.h"
+#include "vehicle_fleet.h"
+#include "can_if.h"
+#include "can_signals.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define SF_FNV_BASIS   0xCBF29CE484222325ULL
+#define SF_FNV_PRIME   0x100000001B3ULL
+
+/* Pedal of block b at step k: SF_PEDAL_KPH per step for half of every
+ * SF_PEDAL_STEPS, phase shifted by the block. */
+#define SF_PEDAL_STEPS  50U
+#define SF_PEDAL_KPH    2.5f
+
+/** One worker and its shard; a cache line of its own. */
+typedef struct
+{
+    _Alignas(64) pthread_t thread;
+    uint32_t          firstBlock;
+    uint32_t          blocks;
+    uint32_t          first;       /* first vehicle */
+    uint32_t          count;
+    VehicleFleet_t   *fleet;       /* blocks, its own memory */
+    SilFleet_Frame_t *frames;      /* count frames of the last step */
+    uint64_t         *hash;        /* per vehicle, FNV-1a of its frames */
+    int               ok;
+} SfWorker_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static SfWorker_t        s_sfWorkers[SIL_FLEET_MAX_THREADS];
+static uint32_t          s_sfThreads = 0U;
+static pthread_barrier_t s_sfGo;
+static pthread_barrier_t s_sfDone;
+
+/* Written by the caller only while the workers are parked in s_sfGo. */
+static float    s_sfDt   = 0.0f;
+static uint32_t s_sfStep = 0U;
+static uint8_t  s_sfQuit = 0U;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Vehicle @p v's frame ID: 29-bit once the 11-bit range is used up. */
+static uint32_t sf_frame_id(uint32_t v)
+{
+    uint32_t id = VEHICLE_FLEET_ID_BASE + v;
+
+    return (id > 0x7FFU) ? (id | CAN_IF_ID_EXT) : id;
+}
+
+/** Its blocks, frames and hashes from the worker itself (first touch). */
+static int sf_alloc(SfWorker_t *w)
+{
+    w->fleet  = calloc(w->blocks, sizeof(VehicleFleet_t));
+    w->frames = calloc(w->count, sizeof(SilFleet_Frame_t));
+    w->hash   = malloc(w->count * sizeof(uint64_t));
+    if ((w->fleet == NULL) || (w->frames == NULL) || (w->hash == NULL))
+        return 0;
+
+    for (uint32_t b = 0U; b < w->blocks; ++b)
+    {
+        VehicleFleet_t *f = &w->fleet[b];
+        uint32_t        v0 = (w->firstBlock + b) * VEHICLE_FLEET_MAX;
+        uint32_t        n  = w->first + w->count - v0;
+
+        VehicleFleet_Init(f, (n > VEHICLE_FLEET_MAX) ? VEHICLE_FLEET_MAX : n);
+        for (uint32_t i = 0U; i < f->count; ++i)
+            VehicleFleet_SetTargetSpeed(f, i, (float)(((v0 + i) * 3U) % 200U));
+    }
+    for (uint32_t i = 0U; i < w->count; ++i)
+        w->hash[i] = SF_FNV_BASIS;
+    return 1;
+}
+
+static void sf_step(SfWorker_t *w, float dt_s, uint32_t step)
+{
+    SilFleet_Frame_t *out  = w->frames;
+    uint64_t         *hash = w->hash;
+
+    for (uint32_t b = 0U; b < w->blocks; ++b)
+    {
+        VehicleFleet_t *f  = &w->fleet[b];
+        uint32_t        gb = w->firstBlock + b;
+        uint32_t        v0 = gb * VEHICLE_FLEET_MAX;
+
+        if (((step + gb) % SF_PEDAL_STEPS) < (SF_PEDAL_STEPS / 2U))
+            VehicleFleet_AddSpeed(f, SF_PEDAL_KPH);
+        VehicleFleet_Update(f, dt_s);
+
+        for (uint32_t i = 0U; i < f->count; ++i, ++out, ++hash)
+        {
+            const CanSig_VehicleTelemetry_t m =
+            {
+                .speed_kph      = f->speed_kph[i],
+                .engine_rpm     = (uint16_t)f->rpm[i],
+                .coolant_temp_c = f->coolant_temp_c[i],
+            };
+            uint64_t h = *hash;
+
+            out->id  = sf_frame_id(v0 + i);
+            out->dlc = CANSIG_VEHICLE_TELEMETRY_DLC;
+            CanSig_VehicleTelemetry_Pack(out->data, &m);
+            for (uint32_t k = 0U; k < CANSIG_VEHICLE_TELEMETRY_DLC; ++k)
+                h = (h ^ out->data[k]) * SF_FNV_PRIME;
+            *hash = h;
+        }
+    }
+}
+
+static void *sf_worker(void *arg)
+{
+    SfWorker_t *w = (SfWorker_t *)arg;
+
+    w->ok = sf_alloc(w);
+    (void)pthread_barrier_wait(&s_sfDone);
+
+    for (;;)
+    {
+        (void)pthread_barrier_wait(&s_sfGo);
+        if (s_sfQuit != 0U)
+            break;
+        sf_step(w, s_sfDt, s_sfStep);
+        (void)pthread_barrier_wait(&s_sfDone);
+    }
+    return NULL;
+}
+
+static void sf_free(void)
+{
+    for (uint32_t t = 0U; t < SIL_FLEET_MAX_THREADS; ++t)
+    {
+        free(s_sfWorkers[t].fleet);
+        free(s_sfWorkers[t].frames);
+        free(s_sfWorkers[t].hash);
+    }
+    memset(s_sfWorkers, 0, sizeof(s_sfWorkers));
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+int SilFleet_Start(uint32_t vehicles, uint32_t threads)
+{
+    uint32_t blocks = (vehicles + VEHICLE_FLEET_MAX - 1U) / VEHICLE_FLEET_MAX;
+
+    if (s_sfThreads != 0U)
+        SilFleet_Stop();
+    if (vehicles == 0U)
+        return -1;
+    if (threads > SIL_FLEET_MAX_THREADS)
+        threads = SIL_FLEET_MAX_THREADS;
+    if (threads > blocks)
+        threads = blocks;
+    if (threads == 0U)
+        threads = 1U;
+
+    memset(s_sfWorkers, 0, sizeof(s_sfWorkers));
+    s_sfStep = 0U;
+    s_sfQuit = 0U;
+
+    /* Whole blocks per worker, the first ones one more. */
+    uint32_t block = 0U;
+    for (uint32_t t = 0U; t < threads; ++t)
+    {
+        SfWorker_t *w = &s_sfWorkers[t];
+        uint32_t    n = (blocks / threads) + ((t < (blocks % threads)) ? 1U : 0U);
+        uint32_t    v = block * VEHICLE_FLEET_MAX;
+        uint32_t    e = (block + n) * VEHICLE_FLEET_MAX;
+
+        w->firstBlock = block;
+        w->blocks     = n;
+        w->first      = v;
+        w->count      = ((e < vehicles) ? e : vehicles) - v;
+        block        += n;
+    }
+
+    if ((pthread_barrier_init(&s_sfGo, NULL, threads + 1U) != 0) ||
+        (pthread_barrier_init(&s_sfDone, NULL, threads + 1U) != 0))
+        return -1;
+
+    for (uint32_t t = 0U; t < threads; ++t)
+    {
+        if (pthread_create(&s_sfWorkers[t].thread, NULL, sf_worker, &s_sfWorkers[t]) != 0)
+        {
+            /* The workers started wait in s_sfDone for a full count and
+             * cannot be released: give up as Error_Handler() does. */
+            abort();
+        }
+    }
+    s_sfThreads = threads;
+    (void)pthread_barrier_wait(&s_sfDone);
+
+    for (uint32_t t = 0U; t < threads; ++t)
+    {
+        if (s_sfWorkers[t].ok == 0)
+        {
+            SilFleet_Stop();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void SilFleet_Stop(void)
+{
+    if (s_sfThreads == 0U)
+        return;
+
+    s_sfQuit = 1U;
+    (void)pthread_barrier_wait(&s_sfGo);
+    for (uint32_t t = 0U; t < s_sfThreads; ++t)
+        (void)pthread_join(s_sfWorkers[t].thread, NULL);
+    (void)pthread_barrier_destroy(&s_sfGo);
+    (void)pthread_barrier_destroy(&s_sfDone);
+    sf_free();
+    s_sfThreads = 0U;
+}
+
+void SilFleet_Step(float dt_s)
+{
+    if (s_sfThreads == 0U)
+        return;
+
+    s_sfDt = dt_s;
+    (void)pthread_barrier_wait(&s_sfGo);
+    (void)pthread_barrier_wait(&s_sfDone);
+    s_sfStep++;
+}
+
+uint32_t SilFleet_Frames(uint32_t thread, const SilFleet_Frame_t **frames)
+{
+    if (thread >= s_sfThreads)
+        return 0U;
+
+    *frames = s_sfWorkers[thread].frames;
+    return s_sfWorkers[thread].count;
+}
+
+uint64_t SilFleet_Checksum(void)
+{
+    uint64_t h = SF_FNV_BASIS;
+
+    for (uint32_t t = 0U; t < s_sfThreads; ++t)
+    {
+        const SfWorker_t *w = &s_sfWorkers[t];
+
+        for (uint32_t i = 0U; i < w->count; ++i)
+        {
+            for (uint32_t k = 0U; k < 8U; ++k)
+                h = (h ^ ((w->hash[i] >> (8U * k)) & 0xFFU)) * SF_FNV_PRIME;
+        }
+    }
+    return h;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file    sil_fleet.h
+ * @brief   Host (SIL) fleet simulation sharded over worker threads.
+ *
+ * Many vehicles of the fleet model (vehicle_fleet.h) are split into
+ * VehicleFleet_t blocks of VEHICLE_FLEET_MAX, and the blocks into one
+ * contiguous shard per worker thread. Each worker allocates its own blocks
+ * and output, so the structure-of-arrays state it walks is in its own
+ * memory and no two threads write the same cache line.
+ *
+ * SilFleet_Step() is one 100 ms tick of every vehicle: the workers are
+ * released through a barrier, each steps its blocks (the pedal input, then
+ * VehicleFleet_Update()) and packs every vehicle's telemetry frame
+ * (VEHICLE_FLEET_ID_BASE + vehicle as VehicleFleet_SendTelemetry(), 29-bit
+ * past 0x7FF) into its own frame block, and a second barrier returns once
+ * all are done.
+ * Between two steps the calling thread owns every output: it reads the
+ * frame blocks with SilFleet_Frames() without locks or atomics, and the
+ * workers are parked in the barrier.
+ *
+ * The pedal input depends only on the vehicle and the step, and the
+ * workers never share state, so the frames are the same for any thread
+ * count; SilFleet_Checksum() proves it ("mini_ecu_sil --fleet", bench.c).
+ * The CAN_IF queues and the single-vehicle model are not touched: they
+ * stay the firmware's, on the calling thread.
+ */
+
+#ifndef SIL_FLEET_H
+#define SIL_FLEET_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Worker threads at most. */
+#ifndef SIL_FLEET_MAX_THREADS
+#define SIL_FLEET_MAX_THREADS  64U
+#endif
+
+/** One vehicle's telemetry frame of a step. */
+typedef struct
+{
+    uint32_t id;
+    uint8_t  dlc;
+    uint8_t  data[8];
+} SilFleet_Frame_t;
+
+/**
+ * @brief Start @p threads workers (clamped to 1..SIL_FLEET_MAX_THREADS)
+ *        over @p vehicles vehicles at idle, spread over the speed range.
+ *
+ * @return 0, or -1 for no vehicles or if memory could not be had.
+ */
+int SilFleet_Start(uint32_t vehicles, uint32_t threads);
+
+/**
+ * @brief Stop and join the workers and free the shards.
+ */
+void SilFleet_Stop(void);
+
+/**
+ * @brief Step every vehicle once by @p dt_s and pack its frame.
+ */
+void SilFleet_Step(float dt_s);
+
+/**
+ * @brief Frame block of worker @p thread from the last step.
+ *
+ * @return Its frame count (0 for no such worker).
+ */
+uint32_t SilFleet_Frames(uint32_t thread, const SilFleet_Frame_t **frames);
+
+/**
+ * @brief FNV-1a of each vehicle's frames since SilFleet_Start(), folded
+ *        in vehicle order.
+ */
+uint64_t SilFleet_Checksum(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIL_FLEET_H */
@@ -0,0 +1,768 @@
+/**
+ * @file    sil_hal.c
+ * @brief   Host (SIL) implementations of the HAL and CMSIS-RTOS2 calls used
+ *          by the application core. See sil.h for the behaviour.
+ */
+
+#include "sil.h"
+#include "sil_bus.h"
+#include "sil_sock.h"
+#include "cmsis_os2.h"
+#include "boot_prof.h"
+#include "can_if.h"
+#include "clock_gov.h"
+#include "low_power.h"
+#include "nvm_log.h"
+#include "rtos_stats.h"
+#include "stage.h"
+#include "time_sync.h"
+#include "vsensor.h"
+#include "FreeRTOS.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Emulated core and peripherals                                              */
+/* -------------------------------------------------------------------------- */
+
+uint32_t       SystemCoreClock = 180000000U;
+uint32_t       g_silPrimask    = 0U;
+DWT_Type       g_silDwt;
+CoreDebug_Type g_silCoreDebug;
+SysTick_Type   g_silSysTick;
+SCB_Type       g_silScb;
+ITM_Type       g_silItm;
+TPI_Type       g_silTpi;
+DBGMCU_TypeDef g_silDbgmcu;
+IWDG_TypeDef   g_silIwdg;
+
+static CAN_TypeDef        s_can1;
+static DMA_Stream_TypeDef s_dmaRxStream;
+static DMA_HandleTypeDef  s_dmaRx = { &s_dmaRxStream };
+
+CAN_HandleTypeDef  hcan1  = { &s_can1, { 0U, CAN_MODE_LOOPBACK, 0U, 0U, 0U },
+                              HAL_CAN_STATE_READY, 0U };
+UART_HandleTypeDef huart2 = { &s_dmaRx, HAL_UART_STATE_READY, HAL_UART_STATE_READY };
+
+static uint32_t s_tick = 0U;
+
+/* UART */
+static uint8_t  s_uartEcho    = 0U;
+static uint32_t s_uartTxBytes = 0U;
+static uint8_t *s_uartRxBuf   = NULL;
+static uint16_t s_uartRxSize  = 0U;
+
+/* CAN: RX FIFO0 holds three frames, like bxCAN. */
+#define SIL_CAN_FIFO_DEPTH  3U
+
+typedef struct
+{
+    CAN_RxHeaderTypeDef hdr;
+    uint8_t             data[8];
+} SilCanFrame_t;
+
+static SilCanFrame_t s_canFifo[SIL_CAN_FIFO_DEPTH];
+static uint32_t      s_canFifoCount = 0U;
+static uint8_t       s_canLoopback  = 0U;
+static uint32_t      s_canTxCount   = 0U;
+static uint32_t      s_canOverruns  = 0U;
+static uint64_t      s_canTxAtNs[3];          /* AddTxMessage, bus time */
+
+/* RTOS */
+static uint32_t s_threadFlags = 0U;
+static uint32_t s_threadId    = 1U;   /* any non-NULL id */
+
+typedef struct
+{
+    uint8_t *mem;
+    uint32_t msgSize;
+    uint32_t msgCount;
+    uint32_t head;
+    uint32_t count;
+} SilQueue_t;
+
+#define SIL_MAX_QUEUES  4U
+
+static SilQueue_t s_queues[SIL_MAX_QUEUES];
+static uint32_t   s_queueCount = 0U;
+
+/** TME bits from the mailboxes' TXRQ and CODE = the lowest empty one, like bxCAN. */
+static void sil_can_tsr_update(CAN_TypeDef *can)
+{
+    uint32_t tsr  = 0U;
+    uint32_t code = 0U;
+
+    for (uint32_t mb = 3U; mb-- > 0U;)
+    {
+        if ((can->sTxMailBox[mb].TIR & CAN_TI0R_TXRQ) == 0U)
+        {
+            tsr |= 1UL << (CAN_TSR_TME_Pos + mb);
+            code = mb;
+        }
+    }
+    can->TSR = tsr | (code << CAN_TSR_CODE_Pos);
+}
+
+/**
+ * @brief Without the virtual bus: complete every requested mailbox of a
+ *        started CAN1 at once; in loopback it is received into FIFO0 as
+ *        well, on a SocketCAN interface (sil_sock.h) it is batched for the
+ *        socket. On the bus (sil_bus.h) the mailboxes wait for it.
+ *
+ * @return Frames sent.
+ */
+static uint32_t sil_can_transmit(void)
+{
+    uint32_t sent = 0U;
+
+    if ((hcan1.State != HAL_CAN_STATE_LISTENING) || (SilBus_Attached() != 0U))
+        return 0U;
+
+    for (uint32_t mb = 0U; mb < 3U; ++mb)
+    {
+        CAN_TxMailBox_TypeDef *m = &s_can1.sTxMailBox[mb];
+
+        if ((m->TIR & CAN_TI0R_TXRQ) == 0U)
+            continue;
+
+        uint8_t  data[8];
+        uint8_t  dlc = (uint8_t)(m->TDTR & 0xFU);
+        uint32_t key = ((m->TIR & CAN_TI0R_IDE) != 0U)
+                       ? ((m->TIR >> CAN_TI0R_EXID_Pos) | CAN_IF_ID_EXT)
+                       : (m->TIR >> CAN_TI0R_STID_Pos);
+
+        if ((m->TIR & CAN_TI0R_RTR) != 0U)
+            key |= CAN_IF_ID_RTR;
+        memcpy(&data[0], (const void *)&m->TDLR, 4U);
+        memcpy(&data[4], (const void *)&m->TDHR, 4U);
+
+        /* Socket queue full: the mailbox waits, SilSock_Poll() retries. */
+        if ((SilSock_Attached() != 0U) && (SilSock_Send(key, dlc, data) == 0U))
+            break;
+
+        m->TIR &= ~CAN_TI0R_TXRQ;
+        s_canTxCount++;
+        sent++;
+
+        if ((s_canLoopback != 0U) && (SilSock_Attached() == 0U))
+            Sil_CanReceive(key, dlc, data);
+    }
+    sil_can_tsr_update(&s_can1);
+    return sent;
+}
+
+void NVIC_SetPendingIRQ(IRQn_Type irq)
+{
+    /* Pended again while it runs: once more when it returns, like the NVIC. */
+    static uint8_t active  = 0U;
+    static uint8_t pending = 0U;
+
+    if (irq != CAN1_TX_IRQn)
+        return;
+    if (active != 0U)
+    {
+        pending = 1U;
+        return;
+    }
+
+    active = 1U;
+    do
+    {
+        pending = 0U;
+        CAN_IF_TxIRQHandler(CAN_IF_BUS1);
+        /* A completed mailbox raises the TX interrupt again, which
+         * refills it (frames held back for busy mailboxes or for
+         * CAN_IF_TX_IN_ORDER). */
+        if (sil_can_transmit() != 0U)
+            pending = 1U;
+    } while (pending != 0U);
+    active = 0U;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Harness controls                                                           */
+/* -------------------------------------------------------------------------- */
+
+void Sil_Init(void)
+{
+    memset(&s_can1, 0, sizeof(s_can1));
+    sil_can_tsr_update(&s_can1);
+    memset(&s_dmaRxStream, 0, sizeof(s_dmaRxStream));
+    hcan1.State          = HAL_CAN_STATE_READY;
+    hcan1.Init.Mode      = CAN_MODE_LOOPBACK;
+    huart2.gState        = HAL_UART_STATE_READY;
+    huart2.RxState       = HAL_UART_STATE_READY;
+    s_tick               = 0U;
+    s_canFifoCount       = 0U;
+    s_canOverruns        = 0U;
+    s_threadFlags        = 0U;
+}
+
+void Sil_AdvanceMs(uint32_t ms)
+{
+    s_tick += ms;
+}
+
+void Sil_UartRx(const char *data, uint32_t len)
+{
+    if ((s_uartRxBuf == NULL) || (s_uartRxSize == 0U))
+        return;
+
+    for (uint32_t i = 0U; i < len; i++)
+    {
+        uint32_t pos = s_uartRxSize - s_dmaRxStream.NDTR;
+        s_uartRxBuf[pos] = (uint8_t)data[i];
+
+        /* Circular mode: the counter reloads after the last byte. */
+        s_dmaRxStream.NDTR = (s_dmaRxStream.NDTR > 1U) ? (s_dmaRxStream.NDTR - 1U)
+                                                       : s_uartRxSize;
+    }
+
+    HAL_UARTEx_RxEventCallback(&huart2, (uint16_t)(s_uartRxSize - s_dmaRxStream.NDTR));
+}
+
+void Sil_UartEcho(uint8_t enable)
+{
+    s_uartEcho = enable;
+}
+
+uint32_t Sil_UartTxBytes(void)
+{
+    return s_uartTxBytes;
+}
+
+void Sil_CanLoopback(uint8_t enable)
+{
+    s_canLoopback = enable;
+}
+
+uint32_t Sil_CanTxCount(void)
+{
+    return s_canTxCount;
+}
+
+void Sil_CanReceive(uint32_t key, uint8_t dlc, const uint8_t *data)
+{
+    if (s_canFifoCount >= SIL_CAN_FIFO_DEPTH)
+    {
+        s_canOverruns++;
+        return;
+    }
+
+    SilCanFrame_t *f = &s_canFifo[s_canFifoCount++];
+    memset(f, 0, sizeof(*f));
+    if ((key & CAN_IF_ID_EXT) != 0U)
+    {
+        f->hdr.ExtId = key & CAN_IF_ID_MASK;
+        f->hdr.IDE   = CAN_ID_EXT;
+    }
+    else
+    {
+        f->hdr.StdId = key & 0x7FFU;
+        f->hdr.IDE   = CAN_ID_STD;
+    }
+    f->hdr.RTR              = ((key & CAN_IF_ID_RTR) != 0U) ? CAN_RTR_REMOTE : CAN_RTR_DATA;
+    f->hdr.DLC              = dlc & 0xFU;
+    f->hdr.FilterMatchIndex = 0xFFU;
+    memcpy(f->data, data, 8U);
+
+    /* The frame is "received" at once: run the FIFO0 interrupt. */
+    HAL_CAN_RxFifo0MsgPendingCallback(&hcan1);
+}
+
+uint32_t Sil_CanRxOverruns(void)
+{
+    return s_canOverruns;
+}
+
+void Sil_CanTxDone(uint32_t mailbox)
+{
+    s_can1.sTxMailBox[mailbox].TIR &= ~CAN_TI0R_TXRQ;
+    s_canTxCount++;
+    sil_can_tsr_update(&s_can1);
+
+    /* The TX interrupt refills the mailbox. */
+    NVIC_SetPendingIRQ(CAN1_TX_IRQn);
+}
+
+uint64_t Sil_CanTxQueuedNs(uint32_t mailbox)
+{
+    return s_canTxAtNs[mailbox];
+}
+
+void Error_Handler(void)
+{
+    fprintf(stderr, "Error_Handler called\n");
+    abort();
+}
+
+/* -------------------------------------------------------------------------- */
+/* HAL                                                                        */
+/* -------------------------------------------------------------------------- */
+
+uint32_t HAL_GetTick(void)
+{
+    return s_tick;
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+    return SystemCoreClock / 4U;
+}
+
+static void sil_uart_sink(const uint8_t *data, uint16_t size)
+{
+    s_uartTxBytes += size;
+    if (s_uartEcho != 0U)
+        (void)fwrite(data, 1U, size, stdout);
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData,
+                                    uint16_t Size, uint32_t Timeout)
+{
+    (void)huart;
+    (void)Timeout;
+
+    sil_uart_sink(pData, Size);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData,
+                                        uint16_t Size)
+{
+    sil_uart_sink(pData, Size);
+    HAL_UART_TxCpltCallback(huart);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *pData,
+                                               uint16_t Size)
+{
+    if ((pData == NULL) || (Size == 0U))
+        return HAL_ERROR;
+
+    s_uartRxBuf        = pData;
+    s_uartRxSize       = Size;
+    s_dmaRxStream.NDTR = Size;
+    s_dmaRxStream.CR  |= DMA_SxCR_EN | DMA_IT_HT;
+    huart->RxState     = HAL_UART_STATE_BUSY_RX;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart)
+{
+    s_dmaRxStream.CR &= ~DMA_SxCR_EN;
+    huart->RxState    = HAL_UART_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan, const CAN_FilterTypeDef *sFilterConfig)
+{
+    (void)hcan;
+    (void)sFilterConfig;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef *hcan)
+{
+    hcan->State = HAL_CAN_STATE_LISTENING;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_Stop(CAN_HandleTypeDef *hcan)
+{
+    hcan->State = HAL_CAN_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef *hcan, uint32_t ActiveITs)
+{
+    (void)hcan;
+    (void)ActiveITs;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_RequestSleep(CAN_HandleTypeDef *hcan)
+{
+    (void)hcan;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_WakeUp(CAN_HandleTypeDef *hcan)
+{
+    (void)hcan;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan, const CAN_TxHeaderTypeDef *pHeader,
+                                       const uint8_t aData[], uint32_t *pTxMailbox)
+{
+    CAN_TypeDef *can = hcan->Instance;
+
+    if (((hcan->State != HAL_CAN_STATE_READY) && (hcan->State != HAL_CAN_STATE_LISTENING)) ||
+        ((can->TSR & CAN_TSR_TME) == 0U))
+        return HAL_ERROR;
+
+    uint32_t               mb = (can->TSR & CAN_TSR_CODE) >> CAN_TSR_CODE_Pos;
+    CAN_TxMailBox_TypeDef *m  = &can->sTxMailBox[mb];
+
+    m->TDTR = pHeader->DLC & CAN_TDT0R_DLC;
+    memcpy((void *)&m->TDLR, &aData[0], 4U);
+    memcpy((void *)&m->TDHR, &aData[4], 4U);
+    m->TIR  = ((pHeader->IDE == CAN_ID_EXT) ? ((pHeader->ExtId << CAN_TI0R_EXID_Pos) | CAN_TI0R_IDE)
+                                            : (pHeader->StdId << CAN_TI0R_STID_Pos)) |
+              ((pHeader->RTR == CAN_RTR_REMOTE) ? CAN_TI0R_RTR : 0U) | CAN_TI0R_TXRQ;
+    s_canTxAtNs[mb] = SilBus_NowNs();
+    sil_can_tsr_update(can);
+
+    *pTxMailbox = 1UL << mb;
+    return HAL_OK;
+}
+
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel(const CAN_HandleTypeDef *hcan)
+{
+    uint32_t tme = (hcan->Instance->TSR & CAN_TSR_TME) >> CAN_TSR_TME_Pos;
+
+    return (tme & 1U) + ((tme >> 1) & 1U) + ((tme >> 2) & 1U);
+}
+
+HAL_StatusTypeDef HAL_CAN_AbortTxRequest(CAN_HandleTypeDef *hcan, uint32_t TxMailboxes)
+{
+    for (uint32_t mb = 0U; mb < 3U; ++mb)
+    {
+        if ((TxMailboxes & (1UL << mb)) != 0U)
+            hcan->Instance->sTxMailBox[mb].TIR &= ~CAN_TI0R_TXRQ;
+    }
+    sil_can_tsr_update(hcan->Instance);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan, uint32_t RxFifo,
+                                       CAN_RxHeaderTypeDef *pHeader, uint8_t aData[])
+{
+    (void)hcan;
+
+    if ((RxFifo != CAN_RX_FIFO0) || (s_canFifoCount == 0U))
+        return HAL_ERROR;
+
+    *pHeader = s_canFifo[0].hdr;
+    memcpy(aData, s_canFifo[0].data, 8U);
+
+    s_canFifoCount--;
+    memmove(&s_canFifo[0], &s_canFifo[1], s_canFifoCount * sizeof(s_canFifo[0]));
+    return HAL_OK;
+}
+
+uint32_t HAL_CAN_GetRxFifoFillLevel(const CAN_HandleTypeDef *hcan, uint32_t RxFifo)
+{
+    (void)hcan;
+    return (RxFifo == CAN_RX_FIFO0) ? s_canFifoCount : 0U;
+}
+
+HAL_CAN_StateTypeDef HAL_CAN_GetState(const CAN_HandleTypeDef *hcan)
+{
+    return hcan->State;
+}
+
+HAL_StatusTypeDef HAL_CAN_ResetError(CAN_HandleTypeDef *hcan)
+{
+    hcan->ErrorCode = HAL_CAN_ERROR_NONE;
+    return HAL_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CMSIS-RTOS2                                                                */
+/* -------------------------------------------------------------------------- */
+
+osStatus_t osKernelInitialize(void)
+{
+    return osOK;
+}
+
+osKernelState_t osKernelGetState(void)
+{
+    return osKernelReady;
+}
+
+uint32_t osKernelGetTickCount(void)
+{
+    return s_tick;
+}
+
+osStatus_t osDelay(uint32_t ticks)
+{
+    /* Nothing else runs on the host: waiting is just time passing. */
+    s_tick += ticks;
+    return osOK;
+}
+
+osThreadId_t osThreadGetId(void)
+{
+    return (osThreadId_t)&s_threadId;
+}
+
+osPriority_t osThreadGetPriority(osThreadId_t thread_id)
+{
+    (void)thread_id;
+    return osPriorityNormal;
+}
+
+osStatus_t osThreadSetPriority(osThreadId_t thread_id, osPriority_t priority)
+{
+    (void)thread_id;
+    (void)priority;
+    return osOK;
+}
+
+osStatus_t osThreadYield(void)
+{
+    return osOK;
+}
+
+uint32_t osThreadFlagsSet(osThreadId_t thread_id, uint32_t flags)
+{
+    (void)thread_id;
+
+    s_threadFlags |= flags;
+    return s_threadFlags;
+}
+
+uint32_t osThreadFlagsClear(uint32_t flags)
+{
+    uint32_t old = s_threadFlags;
+
+    s_threadFlags &= ~flags;
+    return old;
+}
+
+uint32_t osThreadFlagsWait(uint32_t flags, uint32_t options, uint32_t timeout)
+{
+    (void)options;
+    (void)timeout;
+
+    uint32_t got = s_threadFlags & flags;
+    if (got == 0U)
+        return osFlagsErrorTimeout;
+
+    s_threadFlags &= ~got;
+    return got;
+}
+
+osMessageQueueId_t osMessageQueueNew(uint32_t msg_count, uint32_t msg_size,
+                                     const osMessageQueueAttr_t *attr)
+{
+    if ((attr == NULL) || (attr->mq_mem == NULL) ||
+        (attr->mq_size < (msg_count * msg_size)) || (s_queueCount >= SIL_MAX_QUEUES))
+        return NULL;
+
+    SilQueue_t *q = &s_queues[s_queueCount++];
+    q->mem      = (uint8_t *)attr->mq_mem;
+    q->msgSize  = msg_size;
+    q->msgCount = msg_count;
+    q->head     = 0U;
+    q->count    = 0U;
+    return (osMessageQueueId_t)q;
+}
+
+osStatus_t osMessageQueuePut(osMessageQueueId_t mq_id, const void *msg_ptr,
+                             uint8_t msg_prio, uint32_t timeout)
+{
+    SilQueue_t *q = (SilQueue_t *)mq_id;
+    (void)msg_prio;
+    (void)timeout;
+
+    if ((q == NULL) || (msg_ptr == NULL))
+        return osErrorParameter;
+    if (q->count >= q->msgCount)
+        return osErrorResource;
+
+    uint32_t slot = (q->head + q->count) % q->msgCount;
+    memcpy(&q->mem[slot * q->msgSize], msg_ptr, q->msgSize);
+    q->count++;
+    return osOK;
+}
+
+osStatus_t osMessageQueueGet(osMessageQueueId_t mq_id, void *msg_ptr,
+                             uint8_t *msg_prio, uint32_t timeout)
+{
+    SilQueue_t *q = (SilQueue_t *)mq_id;
+    (void)timeout;
+
+    if ((q == NULL) || (msg_ptr == NULL))
+        return osErrorParameter;
+    if (q->count == 0U)
+        return osErrorResource;
+
+    memcpy(msg_ptr, &q->mem[q->head * q->msgSize], q->msgSize);
+    q->head = (q->head + 1U) % q->msgCount;
+    q->count--;
+    if (msg_prio != NULL)
+        *msg_prio = 0U;
+    return osOK;
+}
+
+/* -------------------------------------------------------------------------- */
+/* FreeRTOS                                                                   */
+/* -------------------------------------------------------------------------- */
+
+TimerHandle_t xTimerCreateStatic(const char *name, TickType_t period, int autoReload,
+                                 void *id, TimerCallbackFunction_t callback,
+                                 StaticTimer_t *buffer)
+{
+    (void)name;
+    (void)period;
+    (void)autoReload;
+    (void)id;
+    (void)callback;
+    (void)buffer;
+    return NULL;
+}
+
+int xTimerStart(TimerHandle_t timer, TickType_t wait)
+{
+    (void)timer;
+    (void)wait;
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Flash log                                                                  */
+/* -------------------------------------------------------------------------- */
+
+/* The host has no flash: calibration keeps its defaults, commits go nowhere. */
+HAL_StatusTypeDef NvmLog_Register(const NvmLog_Client_t *client)
+{
+    (void)client;
+    return HAL_OK;
+}
+
+void NvmLog_Notify(void)
+{
+}
+
+/* -------------------------------------------------------------------------- */
+/* Update staging                                                             */
+/* -------------------------------------------------------------------------- */
+
+/* No other slot to stage into: the RPC STAGE_* requests are refused. */
+uint32_t Stage_Target(void)
+{
+    return 0U;
+}
+
+HAL_StatusTypeDef Stage_Begin(uint32_t length)
+{
+    (void)length;
+    return HAL_ERROR;
+}
+
+HAL_StatusTypeDef Stage_Write(const uint8_t *data, uint32_t n)
+{
+    (void)data;
+    (void)n;
+    return HAL_ERROR;
+}
+
+HAL_StatusTypeDef Stage_End(void)
+{
+    return HAL_ERROR;
+}
+
+void Stage_GetStats(Stage_Stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->state = STAGE_IDLE;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Time synchronization                                                       */
+/* -------------------------------------------------------------------------- */
+
+/* No TIM4/TIM12 and no other node: the local and the global time are the
+ * simulated tick. */
+uint64_t TimeSync_LocalUs(void)
+{
+    return (uint64_t)HAL_GetTick() * 1000U;
+}
+
+void TimeSync_NowMsUs(uint32_t *ms, uint32_t *us)
+{
+    *ms = HAL_GetTick();
+    *us = 0U;
+}
+
+uint32_t TimeSync_NowMs(void)
+{
+    return HAL_GetTick();
+}
+
+void TimeSync_OnCanRx(const uint8_t *data)
+{
+    (void)data;
+}
+
+void TimeSync_OnTxConfirm(void)
+{
+}
+
+/* -------------------------------------------------------------------------- */
+/* Clock governor                                                             */
+/* -------------------------------------------------------------------------- */
+
+/* One simulated clock: nothing to boost. */
+void ClockGov_Boost(uint32_t ms)
+{
+    (void)ms;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Low power                                                                  */
+/* -------------------------------------------------------------------------- */
+
+/* The host never stops: no wake-up to time a frame against. */
+void LowPower_OnCanRx(void)
+{
+}
+
+/* -------------------------------------------------------------------------- */
+/* Boot profile                                                               */
+/* -------------------------------------------------------------------------- */
+
+/* No reset to time: the first telemetry frame is not a boot point here. */
+void BootProf_Mark(uint32_t point)
+{
+    (void)point;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Task statistics                                                            */
+/* -------------------------------------------------------------------------- */
+
+/* No scheduler and no run-time counters: no window is ever sampled. */
+uint32_t RtosStats_Get(RtosStats_Task_t *tasks, uint32_t max, RtosStats_Summary_t *sum)
+{
+    (void)tasks;
+    (void)max;
+    if (sum != NULL)
+        memset(sum, 0, sizeof(*sum));
+    return 0U;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Virtual sensors                                                            */
+/* -------------------------------------------------------------------------- */
+
+/* No sampled channels: a sensor fault of the fault engine goes nowhere. */
+HAL_StatusTypeDef VSensor_SetFault(VSensor_Ch_t ch, VSensor_Fault_t fault)
+{
+    (void)fault;
+    return ((uint32_t)ch < VSENSOR_CH_COUNT) ? HAL_OK : HAL_ERROR;
+}
+
+const char *VSensor_ChannelName(VSensor_Ch_t ch)
+{
+    static const char *const names[VSENSOR_CH_COUNT] = { "speed", "rpm", "coolant" };
+
+    return ((uint32_t)ch < VSENSOR_CH_COUNT) ? names[ch] : "?";
+}
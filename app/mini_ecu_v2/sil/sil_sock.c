@@ -0,0 +1,298 @@
+/**
+ * @file    sil_sock.c
+ * @brief   Host (SIL) SocketCAN backend. See sil_sock.h.
+ */
+
+#define _GNU_SOURCE     /* recvmmsg(), sendmmsg() */
+
+#include "sil_sock.h"
+#include "sil.h"
+#include "can_if.h"
+#include <errno.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static SilSock_Stats_t s_ssStats;
+
+#ifdef __linux__
+
+/* Control buffer of one received frame: its SCM_TIMESTAMPNS. */
+#define SS_CMSG_SIZE  CMSG_SPACE(sizeof(struct timespec))
+
+static int s_ssFd = -1;
+
+static struct can_frame s_ssTx[SIL_SOCK_BATCH];
+static struct iovec     s_ssTxIov[SIL_SOCK_BATCH];
+static struct mmsghdr   s_ssTxMsg[SIL_SOCK_BATCH];
+static uint32_t         s_ssTxCount = 0U;
+
+static struct can_frame s_ssRx[SIL_SOCK_BATCH];
+static struct iovec     s_ssRxIov[SIL_SOCK_BATCH];
+static struct mmsghdr   s_ssRxMsg[SIL_SOCK_BATCH];
+static uint8_t          s_ssRxCmsg[SIL_SOCK_BATCH][SS_CMSG_SIZE];
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Send the TX batch; what the kernel does not take moves to the
+ *        front and stays batched.
+ *
+ * @return 1 if the batch is empty afterwards.
+ */
+static uint8_t ss_flush(void)
+{
+    uint32_t done = 0U;
+
+    while (done < s_ssTxCount)
+    {
+        int n = sendmmsg(s_ssFd, &s_ssTxMsg[done], s_ssTxCount - done, MSG_DONTWAIT);
+
+        s_ssStats.txCalls++;
+        if (n <= 0)
+        {
+            if ((n < 0) && (errno == EINTR))
+                continue;
+            s_ssStats.txBlocked++;
+            break;
+        }
+        done += (uint32_t)n;
+    }
+
+    s_ssStats.txFrames += done;
+    s_ssTxCount        -= done;
+    if ((done != 0U) && (s_ssTxCount != 0U))
+        memmove(&s_ssTx[0], &s_ssTx[done], s_ssTxCount * sizeof(s_ssTx[0]));
+    return (s_ssTxCount == 0U) ? 1U : 0U;
+}
+
+static uint64_t ss_realtime_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+/** Kernel receive time of message @p i (ns, CLOCK_REALTIME), 0 if none. */
+static uint64_t ss_rx_stamp(uint32_t i)
+{
+    struct msghdr *mh = &s_ssRxMsg[i].msg_hdr;
+
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(mh); c != NULL; c = CMSG_NXTHDR(mh, c))
+    {
+        if ((c->cmsg_level == SOL_SOCKET) && (c->cmsg_type == SCM_TIMESTAMPNS))
+        {
+            struct timespec ts;
+
+            memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+        }
+    }
+    return 0U;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+int SilSock_Open(const char *ifname)
+{
+    struct sockaddr_can addr;
+    int                 off = 0;
+    int                 on  = 1;
+
+    if (s_ssFd >= 0)
+        SilSock_Close();
+
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family  = AF_CAN;
+    addr.can_ifindex = (int)if_nametoindex(ifname);
+    if (addr.can_ifindex == 0)
+        return -1;
+
+    int fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (fd < 0)
+        return -1;
+
+    /* Not our own frames back; kernel receive stamps on the rest. */
+    if ((setsockopt(fd, SOL_CAN_RAW, CAN_RAW_RECV_OWN_MSGS, &off, sizeof(off)) != 0) ||
+        (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) != 0) ||
+        (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0))
+    {
+        int err = errno;
+
+        (void)close(fd);
+        errno = err;
+        return -1;
+    }
+
+    for (uint32_t i = 0U; i < SIL_SOCK_BATCH; ++i)
+    {
+        s_ssTxIov[i].iov_base = &s_ssTx[i];
+        s_ssTxIov[i].iov_len  = sizeof(s_ssTx[i]);
+        s_ssRxIov[i].iov_base = &s_ssRx[i];
+        s_ssRxIov[i].iov_len  = sizeof(s_ssRx[i]);
+    }
+    memset(&s_ssStats, 0, sizeof(s_ssStats));
+    s_ssTxCount = 0U;
+    s_ssFd      = fd;
+    return 0;
+}
+
+void SilSock_Close(void)
+{
+    if (s_ssFd < 0)
+        return;
+
+    (void)ss_flush();
+    (void)close(s_ssFd);
+    s_ssFd      = -1;
+    s_ssTxCount = 0U;
+}
+
+uint8_t SilSock_Attached(void)
+{
+    return (s_ssFd >= 0) ? 1U : 0U;
+}
+
+uint8_t SilSock_Send(uint32_t key, uint8_t dlc, const uint8_t *data)
+{
+    if ((s_ssTxCount >= SIL_SOCK_BATCH) && (ss_flush() == 0U) &&
+        (s_ssTxCount >= SIL_SOCK_BATCH))
+        return 0U;
+
+    struct can_frame *f = &s_ssTx[s_ssTxCount];
+
+    memset(f, 0, sizeof(*f));
+    f->can_id  = ((key & CAN_IF_ID_EXT) != 0U) ? ((key & CAN_IF_ID_MASK) | CAN_EFF_FLAG)
+                                               : (key & CAN_SFF_MASK);
+    if ((key & CAN_IF_ID_RTR) != 0U)
+        f->can_id |= CAN_RTR_FLAG;
+    f->can_dlc = (uint8_t)((dlc > 8U) ? 8U : dlc);
+    memcpy(f->data, data, 8U);
+
+    memset(&s_ssTxMsg[s_ssTxCount], 0, sizeof(s_ssTxMsg[0]));
+    s_ssTxMsg[s_ssTxCount].msg_hdr.msg_iov    = &s_ssTxIov[s_ssTxCount];
+    s_ssTxMsg[s_ssTxCount].msg_hdr.msg_iovlen = 1U;
+    s_ssTxCount++;
+    return 1U;
+}
+
+uint32_t SilSock_Poll(uint32_t timeoutMs)
+{
+    struct pollfd pfd = { s_ssFd, POLLIN, 0 };
+
+    if (s_ssFd < 0)
+        return 0U;
+
+    /* A batch the kernel took makes room for the mailboxes held back. */
+    uint8_t held = (s_ssTxCount != 0U) ? 1U : 0U;
+    if ((ss_flush() != 0U) && (held != 0U))
+        NVIC_SetPendingIRQ(CAN1_TX_IRQn);
+
+    if (poll(&pfd, 1, (int)timeoutMs) <= 0)
+        return 0U;
+
+    for (uint32_t i = 0U; i < SIL_SOCK_BATCH; ++i)
+    {
+        memset(&s_ssRxMsg[i], 0, sizeof(s_ssRxMsg[i]));
+        s_ssRxMsg[i].msg_hdr.msg_iov        = &s_ssRxIov[i];
+        s_ssRxMsg[i].msg_hdr.msg_iovlen     = 1U;
+        s_ssRxMsg[i].msg_hdr.msg_control    = s_ssRxCmsg[i];
+        s_ssRxMsg[i].msg_hdr.msg_controllen = SS_CMSG_SIZE;
+    }
+
+    int n = recvmmsg(s_ssFd, s_ssRxMsg, SIL_SOCK_BATCH, MSG_DONTWAIT, NULL);
+    if (n <= 0)
+        return 0U;
+
+    uint64_t now = ss_realtime_ns();
+    uint32_t got = 0U;
+
+    s_ssStats.rxCalls++;
+    for (uint32_t i = 0U; i < (uint32_t)n; ++i)
+    {
+        const struct can_frame *f = &s_ssRx[i];
+
+        if ((s_ssRxMsg[i].msg_len != sizeof(*f)) || ((f->can_id & CAN_ERR_FLAG) != 0U))
+        {
+            s_ssStats.rxErrors++;
+            continue;
+        }
+
+        uint32_t key = ((f->can_id & CAN_EFF_FLAG) != 0U)
+                       ? ((f->can_id & CAN_EFF_MASK) | CAN_IF_ID_EXT)
+                       : (f->can_id & CAN_SFF_MASK);
+        if ((f->can_id & CAN_RTR_FLAG) != 0U)
+            key |= CAN_IF_ID_RTR;
+
+        uint64_t at = ss_rx_stamp(i);
+        if ((at != 0U) && (now > at))
+        {
+            uint32_t us = (uint32_t)((now - at) / 1000U);
+
+            s_ssStats.rxLatSumUs += us;
+            if (us > s_ssStats.rxLatMaxUs)
+                s_ssStats.rxLatMaxUs = us;
+        }
+
+        Sil_CanReceive(key, (uint8_t)((f->can_dlc > 8U) ? 8U : f->can_dlc), f->data);
+        s_ssStats.rxFrames++;
+        got++;
+    }
+    return ((uint32_t)n == SIL_SOCK_BATCH) ? SIL_SOCK_BATCH : got;
+}
+
+#else /* !__linux__ */
+
+int SilSock_Open(const char *ifname)
+{
+    (void)ifname;
+    errno = ENOSYS;
+    return -1;
+}
+
+void SilSock_Close(void)
+{
+}
+
+uint8_t SilSock_Attached(void)
+{
+    return 0U;
+}
+
+uint8_t SilSock_Send(uint32_t key, uint8_t dlc, const uint8_t *data)
+{
+    (void)key;
+    (void)dlc;
+    (void)data;
+    return 0U;
+}
+
+uint32_t SilSock_Poll(uint32_t timeoutMs)
+{
+    (void)timeoutMs;
+    return 0U;
+}
+
+#endif /* __linux__ */
+
+void SilSock_GetStats(SilSock_Stats_t *out)
+{
+    *out = s_ssStats;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file    sil_sock.h
+ * @brief   Host (SIL) SocketCAN backend: the ECU's CAN1 on a Linux CAN
+ *          interface (vcan0 or a real adapter).
+ *
+ * Once SilSock_Open() has bound a raw CAN socket to the interface, the
+ * frames the firmware puts into its CAN1 mailboxes go out on it and the
+ * frames other programs send on it (cangen, candump -l | canplayer,
+ * tools/can_hil.py) land in the emulated RX FIFO0 and run its interrupt,
+ * so the unchanged can_if.c talks to them. The ECU does not receive its
+ * own frames; the other sockets on the interface see them as usual.
+ *
+ * Nothing is one syscall per frame: the mailboxes complete into a TX
+ * batch that SilSock_Poll() (or a full batch) hands to sendmmsg(), and
+ * SilSock_Poll() takes up to SIL_SOCK_BATCH received frames with one
+ * recvmmsg(). If the kernel does not take the batch (ENOBUFS, EAGAIN:
+ * the interface queue is full), the mailboxes stay requested until it
+ * does, as they would on a busy bus. Every received frame carries its
+ * kernel timestamp (SO_TIMESTAMPNS); the statistics give the time from
+ * there to the FIFO0 interrupt.
+ *
+ * Classic CAN only; error frames are counted and dropped. Linux only: on
+ * other hosts SilSock_Open() fails with ENOSYS. The harness stays
+ * single-threaded, the bench loop calls SilSock_Poll() between firmware
+ * passes ("mini_ecu_sil --socketcan vcan0", bench.c).
+ */
+
+#ifndef SIL_SOCK_H
+#define SIL_SOCK_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Frames per sendmmsg() / recvmmsg(); at most half the RX ring, so one
+ *  batch always fits between two drains. */
+#ifndef SIL_SOCK_BATCH
+#define SIL_SOCK_BATCH  32U
+#endif
+
+typedef struct
+{
+    uint32_t rxFrames;
+    uint32_t rxCalls;      /**< recvmmsg() calls that returned frames. */
+    uint32_t rxErrors;     /**< Error frames and short reads, dropped. */
+    uint32_t txFrames;
+    uint32_t txCalls;      /**< sendmmsg() calls. */
+    uint32_t txBlocked;    /**< Batches the kernel did not (fully) take. */
+    uint32_t rxLatMaxUs;   /**< Kernel timestamp to FIFO0 interrupt. */
+    uint64_t rxLatSumUs;
+} SilSock_Stats_t;
+
+/**
+ * @brief Bind a raw CAN socket to @p ifname and attach the ECU's CAN1.
+ *
+ * @return 0, or -1 with errno set.
+ */
+int SilSock_Open(const char *ifname);
+
+/**
+ * @brief Send what is batched, close the socket and detach CAN1.
+ */
+void SilSock_Close(void);
+
+/**
+ * @brief 1 while CAN1 is on the socket.
+ */
+uint8_t SilSock_Attached(void);
+
+/**
+ * @brief Add a frame (CAN_IF key) of a completed mailbox to the TX batch,
+ *        flushing a full one.
+ *
+ * @return 1 if taken; 0 if the kernel takes nothing now (keep the mailbox).
+ */
+uint8_t SilSock_Send(uint32_t key, uint8_t dlc, const uint8_t *data);
+
+/**
+ * @brief Hand the TX batch to the kernel, wait up to @p timeoutMs for
+ *        frames and receive one batch into RX FIFO0.
+ *
+ * @return Frames received (SIL_SOCK_BATCH: more may be waiting).
+ */
+uint32_t SilSock_Poll(uint32_t timeoutMs);
+
+void SilSock_GetStats(SilSock_Stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIL_SOCK_H */
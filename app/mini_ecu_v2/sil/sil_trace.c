@@ -0,0 +1,214 @@
+/**
+ * @file    sil_trace.c
+ * @brief   Host (SIL) candump log reader on a memory mapping. See sil_trace.h.
+ */
+
+#include "sil_trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t st_blank(char c)
+{
+    return ((c == ' ') || (c == '\t')) ? 1U : 0U;
+}
+
+/** Offset of the first line start at or after @p off. */
+static size_t st_line_start(const SilTrace_t *t, size_t off)
+{
+    if ((off == 0U) || (off >= t->size) || (t->base[off - 1U] == '\n'))
+        return (off < t->size) ? off : t->size;
+
+    const char *nl = memchr(&t->base[off], '\n', t->size - off);
+    return (nl != NULL) ? (size_t)(nl - t->base) + 1U : t->size;
+}
+
+/**
+ * @brief Parse the line from @p line to @p lim (its newline or the end of
+ *        the copy) in place: "<time> <iface> <frame>".
+ */
+static uint8_t st_parse(const char *line, const char *lim, CanTrace_Rec_t *rec, uint64_t *us)
+{
+    const char *field[3];
+    const char *p = line;
+
+    for (uint32_t i = 0U; i < 3U; ++i)
+    {
+        while ((p < lim) && (st_blank(*p) != 0U))
+            p++;
+        if ((p >= lim) || (*p == '\r'))
+            return 0U;
+        field[i] = p;
+        while ((p < lim) && (st_blank(*p) == 0U) && (*p != '\r'))
+            p++;
+    }
+
+    if (CanTrace_ParseLine(field[0], field[2], rec) == 0U)
+        return 0U;
+
+    /* rec->timeMs wraps for epoch stamps; the seeks compare in 64 bits. */
+    const char *s   = (*field[0] == '(') ? (field[0] + 1) : field[0];
+    char       *end;
+    uint64_t    sec = strtoull(s, &end, 10);
+    *us = (sec * 1000000ULL) + strtoul(end + 1, NULL, 10);
+    return 1U;
+}
+
+/**
+ * @brief Parse the line at @p off; @p next gets the start of the line
+ *        after it.
+ */
+static uint8_t st_read(SilTrace_t *t, size_t off, size_t *next, CanTrace_Rec_t *rec, uint64_t *us)
+{
+    const char *line = &t->base[off];
+    const char *nl   = memchr(line, '\n', t->size - off);
+
+    if (nl != NULL)
+    {
+        *next = (size_t)(nl - t->base) + 1U;
+        return st_parse(line, nl, rec, us);
+    }
+
+    /* Unterminated last line: parsed from a NUL-terminated copy. */
+    size_t len = t->size - off;
+    if (len >= sizeof(t->tail))
+        len = sizeof(t->tail) - 1U;
+    memcpy(t->tail, line, len);
+    t->tail[len] = '\0';
+    *next = t->size;
+    return st_parse(t->tail, &t->tail[len], rec, us);
+}
+
+/** Offset of the first record at or after line start @p off and below @p lim. */
+static size_t st_first(SilTrace_t *t, size_t off, size_t lim, uint64_t *us)
+{
+    CanTrace_Rec_t rec;
+
+    while (off < lim)
+    {
+        size_t next;
+
+        t->probes++;
+        if (st_read(t, off, &next, &rec, us) != 0U)
+            return off;
+        off = next;
+    }
+    return lim;
+}
+
+/** Offset of the first record at @p us or later (the log in time order). */
+static size_t st_lower_bound(SilTrace_t *t, uint64_t us)
+{
+    /* Records starting below lo are earlier than us, those from hi on are not. */
+    size_t lo = 0U;
+    size_t hi = t->size;
+
+    while (lo < hi)
+    {
+        size_t   mid  = lo + ((hi - lo) / 2U);
+        size_t   line = st_line_start(t, mid);
+        uint64_t at   = 0U;
+        size_t   rec  = (line < hi) ? st_first(t, line, hi, &at) : hi;
+
+        if (rec >= hi)
+            hi = mid;           /* no record starts in [mid, hi) */
+        else if (at >= us)
+            hi = rec;
+        else
+            lo = rec + 1U;
+    }
+    return st_line_start(t, hi);
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+int SilTrace_Open(SilTrace_t *t, const char *path)
+{
+    struct stat st;
+
+    memset(t, 0, sizeof(*t));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0)
+    {
+        (void)close(fd);
+        return -1;
+    }
+    if (st.st_size == 0)
+    {
+        (void)close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    (void)close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    t->base = (const char *)map;
+    t->size = (size_t)st.st_size;
+    t->end  = t->size;
+
+    t->pos = st_first(t, 0U, t->size, &t->firstUs);
+    if (t->pos >= t->size)
+    {
+        SilTrace_Close(t);
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* The replay walks it front to back: read ahead. */
+    (void)posix_madvise(map, t->size, POSIX_MADV_SEQUENTIAL);
+    return 0;
+}
+
+void SilTrace_Window(SilTrace_t *t, uint64_t fromUs, uint64_t toUs)
+{
+    t->pos = st_lower_bound(t, t->firstUs + fromUs);
+    t->end = (toUs != 0U) ? st_lower_bound(t, t->firstUs + toUs) : t->size;
+    if (t->end < t->pos)
+        t->end = t->pos;
+}
+
+uint8_t SilTrace_Next(void *ctx, CanTrace_Rec_t *rec)
+{
+    SilTrace_t *t = (SilTrace_t *)ctx;
+    uint64_t    us;
+
+    while (t->pos < t->end)
+    {
+        size_t  next;
+        uint8_t ok = st_read(t, t->pos, &next, rec, &us);
+
+        t->pos = next;
+        if (ok != 0U)
+        {
+            t->records++;
+            return 1U;
+        }
+    }
+    return 0U;
+}
+
+void SilTrace_Close(SilTrace_t *t)
+{
+    if (t->base != NULL)
+        (void)munmap((void *)t->base, t->size);
+    t->base = NULL;
+    t->size = 0U;
+    t->pos  = 0U;
+    t->end  = 0U;
+}
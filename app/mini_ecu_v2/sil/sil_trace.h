@@ -0,0 +1,81 @@
+/**
+ * @file    sil_trace.h
+ * @brief   Host (SIL) candump log reader on a memory mapping, for --replay.
+ *
+ * Field traces run to gigabytes, so the log is not read into memory: the
+ * file is mapped read-only and each record is parsed where it lies when
+ * the replay engine asks for it (CanTrace_ParseLine() takes the fields in
+ * place), with no line buffer and no copy. Opening costs one mmap(),
+ * whatever the size; the kernel pages the log in as the replay walks it.
+ *
+ * A window of the trace ("--from <s> --to <s>", times from its first
+ * record) is found by bisection over the byte offsets of the mapping: a
+ * probe steps to the next line start and reads its time, so a seek parses
+ * about log2(size) lines and touches as many pages. That needs the log in
+ * time order, as candump and tools/can_replay.py -o write it.
+ *
+ * Lines that do not parse (comments, other formats) are skipped. Only the
+ * last line, if the file does not end with a newline, is copied, so the
+ * parser never reads past the mapping.
+ */
+
+#ifndef SIL_TRACE_H
+#define SIL_TRACE_H
+
+#include "can_trace.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Longest candump line kept for an unterminated last line. */
+#ifndef SIL_TRACE_LINE_MAX
+#define SIL_TRACE_LINE_MAX  160U
+#endif
+
+typedef struct
+{
+    const char *base;       /**< Mapping, NULL for an empty file. */
+    size_t      size;
+    size_t      pos;        /**< Next line to parse. */
+    size_t      end;        /**< End of the window. */
+    uint64_t    firstUs;    /**< Time of the first record. */
+    uint32_t    records;    /**< Records returned. */
+    uint32_t    probes;     /**< Lines parsed by the seeks. */
+    char        tail[SIL_TRACE_LINE_MAX];
+} SilTrace_t;
+
+/**
+ * @brief Map @p path; the window is the whole log.
+ *
+ * @return 0, or -1 with errno set (EINVAL: no record in the file).
+ */
+int SilTrace_Open(SilTrace_t *t, const char *path);
+
+/**
+ * @brief Narrow the window to the records from @p fromUs up to, not
+ *        including, @p toUs after the first record (0 = to the end).
+ *        O(log size) probes.
+ */
+void SilTrace_Window(SilTrace_t *t, uint64_t fromUs, uint64_t toUs);
+
+/**
+ * @brief Next record of the window; a CanReplay_Next_t with @p ctx the
+ *        SilTrace_t.
+ *
+ * @return 1 if @p rec was filled, 0 at the end of the window.
+ */
+uint8_t SilTrace_Next(void *ctx, CanTrace_Rec_t *rec);
+
+/**
+ * @brief Unmap the log.
+ */
+void SilTrace_Close(SilTrace_t *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIL_TRACE_H */
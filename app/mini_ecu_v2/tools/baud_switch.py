@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""
+baud_switch.py - Move the Mini ECU console UART to a faster rate ("baud").
+
+The ECU side is described in Core/Inc/uart_baud.h: "baud <rate>" is
+answered at the current rate, the ECU then switches and goes back unless
+"baud ok" arrives at the new rate within UART_BAUD_CONFIRM_MS. switch()
+does the host half on an open pyserial port and is used by the other
+tools (uart_mux.py --speed); run on its own it switches and exits, and
+the console stays at the new rate for a terminal opened after it.
+
+Usage:
+    baud_switch.py --port /dev/ttyACM0 921600
+    baud_switch.py --port /dev/ttyACM0 --baud 921600 115200    # back down
+
+On the 180 MHz profile (PCLK1 45 MHz) 921600, 2250000 and 3000000 are in
+tolerance, 2000000 is not; "baud" on the CLI prints the limits.
+"""
+
+import argparse
+import sys
+import time
+
+CONFIRM_S = 2.0         # UART_BAUD_CONFIRM_MS
+
+
+def _read_until(ser, marks, timeout):
+    """Read until one of marks shows up; return (mark, text) or (None, text)."""
+    text = b""
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        text += ser.read(ser.in_waiting or 1)
+        for mark in marks:
+            if mark in text:
+                return mark, text
+    return None, text
+
+
+def switch(ser, baud, log=sys.stderr):
+    """Switch the ECU and ser to baud; False (ser at its old rate) if it fails."""
+    old = ser.baudrate
+    ser.timeout = 0.05
+    ser.reset_input_buffer()
+    ser.write(b"\r\nbaud %u\r\n" % baud)
+    mark, text = _read_until(ser, (b"at the new rate within", b"not reachable", b"Unknown command"), 1.0)
+    if mark == b"at the new rate within" and not text.endswith(b" ms\r\n"):
+        _, rest = _read_until(ser, (b" ms\r\n",), 0.5)
+        text += rest
+    if mark != b"at the new rate within":
+        lines = text.decode(errors="replace").strip().splitlines()
+        log.write("baud: ECU refused %u: %s\n" % (baud, lines[-1] if lines else "no reply"))
+        return False
+
+    # The ECU switches once this line is out; the prompt follows at the new rate.
+    ser.flush()
+    ser.baudrate = baud
+    time.sleep(0.05)
+    ser.reset_input_buffer()
+    ser.write(b"\r\nbaud ok\r\n")
+    mark, _ = _read_until(ser, (b"Console at",), 1.0)
+    if mark is None:
+        time.sleep(CONFIRM_S)       # let the ECU time out and go back
+        ser.baudrate = old
+        ser.reset_input_buffer()
+        log.write("baud: no confirmation at %u, back at %u\n" % (baud, old))
+        return False
+    log.write("baud: console at %u\n" % baud)
+    return True
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Switch the Mini ECU console baud rate.")
+    ap.add_argument("rate", type=int, help="new baud rate")
+    ap.add_argument("--port", required=True, help="serial port (needs pyserial)")
+    ap.add_argument("--baud", type=int, default=115200, help="current rate")
+    args = ap.parse_args()
+
+    import serial  # pylint: disable=import-outside-toplevel
+    with serial.Serial(args.port, args.baud, timeout=0.05) as ser:
+        return 0 if switch(ser, args.rate) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
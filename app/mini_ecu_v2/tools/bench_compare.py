@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""
+bench_compare.py - Compare reports of the on-target microbenchmarks.
+
+The bench image ("make bench", micro_bench.h) prints its report on the
+console after boot and on "bench micro":
+
+    # fw 0.3.0 dev 0x421 rev 0x1000 core 180000000 profile 180MHz ws 5
+    bench <name> <best cycles/op> <mean cycles/op> <ops per batch>
+
+Any other lines are ignored, so a whole console capture can be passed; if
+it holds several reports the last one counts. With one file the report is
+printed as a table; with --baseline every benchmark is compared on its
+best figure and the script exits 1 if one is more than --tolerance percent
+(default 10) slower, or missing.
+
+Usage:
+    bench_compare.py capture.txt [--baseline baseline.txt] [--tolerance 10]
+
+Only the Python standard library is needed.
+"""
+
+import argparse
+import sys
+
+
+def load_report(path):
+    """Return ({name: (best, mean, ops)}, header lines) of the last report."""
+    results = {}
+    header = []
+    with open(path, encoding="utf-8", errors="replace") as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith("# micro bench"):
+                results, header = {}, []
+            if line.startswith("# fw"):
+                header.append(line[2:])
+            fields = line.split()
+            if len(fields) != 5 or fields[0] != "bench":
+                continue
+            try:
+                results[fields[1]] = (float(fields[2]), float(fields[3]), int(fields[4]))
+            except ValueError:
+                continue
+
+    if not results:
+        raise SystemExit("%s: no \"bench\" lines found" % path)
+    return results, header
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Compare Mini ECU microbenchmark reports.")
+    ap.add_argument("report", help="console capture with a \"bench micro\" report")
+    ap.add_argument("--baseline", help="earlier capture to compare against")
+    ap.add_argument("--tolerance", type=float, default=10.0,
+                    help="allowed slow-down of the best figure in percent")
+    args = ap.parse_args()
+
+    cur, cur_hdr = load_report(args.report)
+    if args.baseline is None:
+        for line in cur_hdr:
+            print(line)
+        print("%-20s %10s %10s %6s" % ("benchmark", "best", "mean", "ops"))
+        for name, (best, mean, ops) in cur.items():
+            print("%-20s %10.1f %10.1f %6u" % (name, best, mean, ops))
+        return 0
+
+    base, base_hdr = load_report(args.baseline)
+    if base_hdr != cur_hdr:
+        print("note: builds differ\n  baseline %s\n  current  %s"
+              % ("; ".join(base_hdr), "; ".join(cur_hdr)))
+
+    failed = 0
+    print("%-20s %10s %10s %8s" % ("benchmark", "baseline", "current", "change"))
+    for name, (bbest, _, _) in base.items():
+        if name not in cur:
+            print("%-20s %10.1f %10s %8s  MISSING" % (name, bbest, "-", "-"))
+            failed += 1
+            continue
+        best = cur[name][0]
+        change = 100.0 * (best - bbest) / bbest if bbest > 0 else 0.0
+        flag = ""
+        if change > args.tolerance:
+            flag = "  REGRESSION"
+            failed += 1
+        print("%-20s %10.1f %10.1f %+7.1f%%%s" % (name, bbest, best, change, flag))
+    for name in cur:
+        if name not in base:
+            print("%-20s %10s %10.1f %8s  new" % (name, "-", cur[name][0], "-"))
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
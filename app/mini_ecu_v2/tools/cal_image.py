@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+"""
+cal_image.py - Show and replace the calibration tables of a built image.
+
+The application .bin carries its calibration image (Core/Inc/cal_image.h)
+at offset 0x240: a header (magic "CALI", layout, entry count, dataset
+version, length, CRC), a directory of tables (name, record key, rows,
+cols, offset of the cells) and the cells, little-endian floats row by row.
+The ECU reads the tables in place; this tool puts another dataset into a
+.bin without rebuilding it:
+
+    cal_image.py show build/release/mini_ecu_v2.bin
+    cal_image.py show mini_ecu_v2.bin --csv PT_TORQUE > torque.csv
+    cal_image.py set mini_ecu_v2.bin PT_TORQUE=torque.csv --version 7
+
+"set" takes one CSV per table, rows x cols numbers, and stamps the
+calibration CRC. It cannot change a table's size, and the ECU checks the
+ranges of cal.h at boot (a table out of range falls back to its built-in
+default, "cal image" shows which). Run image_stamp.py on the result
+afterwards: the image CRC and signature cover the calibration area too.
+
+Only the Python standard library is needed.
+"""
+
+import argparse
+import csv
+import struct
+import sys
+
+CAL_OFFSET = 0x240
+CAL_SIZE = 0x800
+CAL_MAGIC = 0x494C4143          # "CALI"
+CAL_LAYOUT = 1
+HEADER_FMT = "<IHHIII"          # magic, layout, count, version, length, crc32
+HEADER_SIZE = struct.calcsize(HEADER_FMT)
+CRC_OFFSET = HEADER_SIZE - 4
+ENTRY_FMT = "<16sHBBI"          # name, key, rows, cols, offset
+ENTRY_SIZE = struct.calcsize(ENTRY_FMT)
+ERASED = 0xFFFFFFFF
+
+POLY = 0x04C11DB7
+
+
+def stm32_crc(data, crc=0xFFFFFFFF):
+    """CRC of the STM32 CRC unit fed with little-endian words of data."""
+    for (word,) in struct.iter_unpack("<I", data):
+        crc ^= word
+        for _ in range(32):
+            crc = ((crc << 1) ^ POLY) & 0xFFFFFFFF if crc & 0x80000000 else (crc << 1) & 0xFFFFFFFF
+    return crc
+
+
+def header(image):
+    """(magic, layout, count, version, length, crc32) of the image's calibration image."""
+    if len(image) < CAL_OFFSET + HEADER_SIZE:
+        return None
+    return struct.unpack_from(HEADER_FMT, image, CAL_OFFSET)
+
+
+def cal_crc(image, length):
+    cal = bytes(image[CAL_OFFSET:CAL_OFFSET + length])
+    return stm32_crc(cal[CRC_OFFSET + 4:], stm32_crc(cal[:CRC_OFFSET]))
+
+
+def check(image):
+    """Status text as the ECU's CalImage_Check(), or None without an image."""
+    hdr = header(image)
+    if hdr is None or hdr[0] != CAL_MAGIC:
+        return None
+    _, layout, count, _, length, crc = hdr
+    if layout != CAL_LAYOUT:
+        return "other layout %u" % layout
+    if length > CAL_SIZE or length % 4 or length < HEADER_SIZE + count * ENTRY_SIZE \
+            or CAL_OFFSET + length > len(image):
+        return "bad length %u" % length
+    if crc == ERASED:
+        return "not stamped"
+    return "ok" if crc == cal_crc(image, length) else "CRC MISMATCH"
+
+
+def stamp(image):
+    """Write the calibration CRC into @image (bytearray); False without an image."""
+    hdr = header(image)
+    if hdr is None or hdr[0] != CAL_MAGIC or hdr[4] > CAL_SIZE or CAL_OFFSET + hdr[4] > len(image):
+        return False
+    struct.pack_into("<I", image, CAL_OFFSET + CRC_OFFSET, cal_crc(image, hdr[4]))
+    return True
+
+
+def tables(image):
+    """[(name, key, rows, cols, offset of the cells in the .bin)]."""
+    count = header(image)[2]
+    out = []
+    for i in range(count):
+        name, key, rows, cols, off = struct.unpack_from(
+            ENTRY_FMT, image, CAL_OFFSET + HEADER_SIZE + i * ENTRY_SIZE)
+        out.append((name.rstrip(b"\0").decode(), key, rows, cols, CAL_OFFSET + off))
+    return out
+
+
+def cells(image, table):
+    _, _, rows, cols, off = table
+    return list(struct.unpack_from("<%uf" % (rows * cols), image, off))
+
+
+def load(path):
+    with open(path, "rb") as f:
+        image = bytearray(f.read())
+    status = check(image)
+    if status is None:
+        raise SystemExit("%s: no calibration image at 0x%X" % (path, CAL_OFFSET))
+    if status.startswith(("other", "bad")):
+        raise SystemExit("%s: calibration image: %s" % (path, status))
+    return image, status
+
+
+def show(args):
+    image, status = load(args.bin)
+    found = {t[0]: t for t in tables(image)}
+    if args.csv:
+        if args.csv not in found:
+            raise SystemExit("%s: no table %s" % (args.bin, args.csv))
+        t = found[args.csv]
+        values = cells(image, t)
+        w = csv.writer(sys.stdout, lineterminator="\n")
+        for r in range(t[2]):
+            w.writerow(["%.9g" % v for v in values[r * t[3]:(r + 1) * t[3]]])
+        return 0
+
+    _, _, count, version, length, crc = header(image)
+    print("%s: calibration image at 0x%X: dataset %u, %u of %u B, %u tables, CRC 0x%08X %s"
+          % (args.bin, CAL_OFFSET, version, length, CAL_SIZE, count, crc, status))
+    for t in found.values():
+        name, key, rows, cols, _ = t
+        values = cells(image, t)
+        print("\n%s (key 0x%04X, %u x %u)" % (name, key, rows, cols))
+        for r in range(rows):
+            print("  " + " ".join("%8.6g" % v for v in values[r * cols:(r + 1) * cols]))
+    return 0 if status in ("ok", "not stamped") else 1
+
+
+def read_csv(path, rows, cols):
+    with open(path, newline="") as f:
+        grid = [[float(x) for x in row if x.strip()] for row in csv.reader(f)
+                if row and not row[0].lstrip().startswith("#")]
+    if len(grid) != rows or any(len(row) != cols for row in grid):
+        raise SystemExit("%s: want %u rows of %u values" % (path, rows, cols))
+    return [v for row in grid for v in row]
+
+
+def set_tables(args):
+    image, _ = load(args.bin)
+    found = {t[0]: t for t in tables(image)}
+    for spec in args.table:
+        name, _, path = spec.partition("=")
+        if name not in found or not path:
+            raise SystemExit("want NAME=FILE.csv with NAME one of %s" % ", ".join(found))
+        t = found[name]
+        struct.pack_into("<%uf" % (t[2] * t[3]), image, t[4], *read_csv(path, t[2], t[3]))
+    if args.version is not None:
+        struct.pack_into("<I", image, CAL_OFFSET + 8, args.version)
+    stamp(image)
+
+    with open(args.output or args.bin, "wb") as f:
+        f.write(image)
+    hdr = header(image)
+    print("%s: dataset %u, CRC 0x%08X; run image_stamp.py on it before flashing"
+          % (args.output or args.bin, hdr[3], hdr[5]))
+    return 0
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Show and replace the calibration tables of an image.")
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    p = sub.add_parser("show", help="header and tables")
+    p.add_argument("bin")
+    p.add_argument("--csv", metavar="NAME", help="print one table as CSV")
+    p = sub.add_parser("set", help="replace tables from CSV files")
+    p.add_argument("bin")
+    p.add_argument("table", nargs="+", help="NAME=FILE.csv")
+    p.add_argument("--version", type=int, help="dataset version to store")
+    p.add_argument("-o", "--output", help="output file (default: in place)")
+    args = ap.parse_args()
+    return show(args) if args.cmd == "show" else set_tables(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,375 @@
+#!/usr/bin/env python3
+"""
+can_hil.py - Throughput and latency test of a Mini ECU on a real CAN bus.
+
+Loads the bus from a Linux SocketCAN adapter with one traffic pattern while
+probing the ECU's diagnostic server, and reads the ECU's own CAN counters
+(UDS DID 0x0130, uds.h) before and after:
+
+    ip link set can0 up type can bitrate 500000 restart-ms 100
+
+    can_hil.py can0 --pattern load --duration 10            # 100 % bus load
+    can_hil.py can0 --pattern burst --burst 32 --gap 20      # 32 frames / 20 ms
+    can_hil.py can0 --pattern random --rate 2000 --json r.json
+    can_hil.py can0 --pattern load --max-lost 0 --max-p99 5  # pass / fail
+
+Patterns:
+    load     DLC 8 frames on --id back to back; the adapter's queue is kept
+             full, so the bus runs at what the line rate allows.
+    burst    --burst frames back to back on --id, then --gap ms of silence.
+    random   standard and extended IDs and DLCs at random, paced to --rate
+             frames/s. IDs the ECU's protocols answer (diagnostics, XCP,
+             J1939, telemetry, the bench ID) are never drawn, so the frames
+             the ECU accepts land in the unhandled 0x000..0x0FF range.
+    steady   DLC 8 frames on --id, paced to --rate frames/s.
+
+During the run a TesterPresent (0x3E 00) is sent --probe-hz times a second
+and its round trip recorded; it takes FIFO1 and CanRxTask like every
+diagnostic request. The default --id, 0x7F0 (can_bench.h, unused outside
+the loopback modes), puts the load on FIFO0; an --id in 0x000..0x0FF, and
+the random pattern, share FIFO1 with the probes. The
+round trip includes the adapter's own latency, so compare runs on the same
+adapter.
+
+The report gives the frames sent and the rate, the frames the ECU should
+have accepted (by a copy of CAN_FILTER_TABLE, can_filters.h) against its RX
+count, the frames lost (missing from that count, or dropped by a full RX
+ring), its FIFO overrun events, error frames, bus-off entries, peak
+load, TEC / REC, the probe percentiles and the error frames the adapter
+saw. --max-lost and --max-p99 make it exit 1 when exceeded, so the figures
+of docs/can-protocol.md can be checked on a bus in CI.
+
+SocketCAN cannot put error frames on the bus. For an error run use a
+disturber (or unplug the termination during the run): the ECU's error and
+bus-off counters and the adapter's error frames show its effect, and the
+probes show the recovery.
+
+--cli /dev/ttyACMx also captures "can stats" from the console before and
+after (needs pyserial). Otherwise only the Python standard library is used.
+"""
+
+import argparse
+import errno
+import json
+import os
+import random
+import select
+import socket
+import struct
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from can_update import Bus, IsoTp, REQ_BASE, RESP_BASE, FUNC_ID  # noqa: E402
+
+DID_CAN_STATS = 0x0130
+CAN_STATS_FMT = ">6IHBB"
+CAN_STATS_KEYS = ("rx", "tx", "fifo_overruns", "ring_overflows", "error_frames",
+                  "bus_off", "peak_load_permille", "tec", "rec")
+
+CAN_FRAME_FMT = "=IB3x8s"
+CAN_EFF_FLAG = 0x80000000
+CAN_ERR_FLAG = 0x20000000
+CAN_ERR_MASK = 0x1FFFFFFF
+
+# The loopback benchmark ID (can_bench.h): accepted into FIFO0 and unused
+# outside the loopback modes.
+BENCH_ID = 0x7F0
+UDS_TIMEOUT = 0.5
+
+
+# ---------------------------------------------------------------------------
+# ECU model
+# ---------------------------------------------------------------------------
+
+def accepted(can_id, ext, node):
+    """True if CAN_FILTER_TABLE of can_filters.h passes the frame."""
+    if ext:
+        return (can_id & 0xFF00) == 0xFF00 or (can_id & 0xF800) == 0x8000
+    return ((can_id & 0x700) == 0 or
+            can_id in (0x100, FUNC_ID, REQ_BASE + node, 0x600 + node, BENCH_ID))
+
+
+def handled(can_id, ext, node):
+    """True for IDs a protocol of the ECU acts on; not drawn by "random"."""
+    if ext:
+        return accepted(can_id, ext, node)
+    return can_id >= 0x100 and accepted(can_id, ext, node)
+
+
+# ---------------------------------------------------------------------------
+# Traffic
+# ---------------------------------------------------------------------------
+
+class Traffic(threading.Thread):
+    """Sends one pattern on its own socket until stop is set."""
+
+    def __init__(self, iface, args):
+        super().__init__(daemon=True)
+        self.sock = socket.socket(socket.AF_CAN, socket.SOCK_RAW, socket.CAN_RAW)
+        self.sock.setsockopt(socket.SOL_CAN_RAW, socket.CAN_RAW_FILTER, b"")
+        self.sock.bind((iface,))
+        self.args = args
+        self.stop = threading.Event()
+        self.sent = 0
+        self.expected = 0
+        self.busy = 0
+        self.rand = random.Random(args.seed)
+
+    def _send(self, can_id, ext, payload):
+        raw = (can_id | CAN_EFF_FLAG) if ext else can_id
+        frame = struct.pack(CAN_FRAME_FMT, raw, len(payload), payload.ljust(8, b"\0"))
+        while not self.stop.is_set():
+            try:
+                self.sock.send(frame)
+                break
+            except OSError as e:
+                if e.errno != errno.ENOBUFS:
+                    raise
+                self.busy += 1                   # adapter queue full: wait for it
+                select.select([], [self.sock], [], 0.01)
+        else:
+            return
+        self.sent += 1
+        if accepted(can_id, ext, self.args.node):
+            self.expected += 1
+
+    def _frame(self, seq):
+        a = self.args
+        if a.pattern != "random":
+            return a.id, False, struct.pack("<I", seq & 0xFFFFFFFF) + bytes(4)
+        while True:
+            ext = self.rand.random() < 0.25
+            can_id = self.rand.getrandbits(29 if ext else 11)
+            if not handled(can_id, ext, a.node):
+                break
+        return can_id, ext, bytes(self.rand.getrandbits(8) for _ in range(self.rand.randint(0, 8)))
+
+    def run(self):
+        a = self.args
+        seq = 0
+        period = 1.0 / a.rate if a.pattern in ("random", "steady") and a.rate > 0 else 0.0
+        t_next = time.monotonic()
+        while not self.stop.is_set():
+            if a.pattern == "burst":
+                for _ in range(a.burst):
+                    self._send(*self._frame(seq))
+                    seq += 1
+                self.stop.wait(a.gap / 1000.0)
+                continue
+            self._send(*self._frame(seq))
+            seq += 1
+            if period:
+                t_next += period
+                delay = t_next - time.monotonic()
+                if delay > 0:
+                    self.stop.wait(delay)
+
+
+class ErrorMonitor(threading.Thread):
+    """Counts the error frames the adapter reports, by class bit."""
+
+    def __init__(self, iface):
+        super().__init__(daemon=True)
+        self.sock = socket.socket(socket.AF_CAN, socket.SOCK_RAW, socket.CAN_RAW)
+        self.sock.setsockopt(socket.SOL_CAN_RAW, socket.CAN_RAW_FILTER, b"")
+        self.sock.setsockopt(socket.SOL_CAN_RAW, socket.CAN_RAW_ERR_FILTER,
+                             struct.pack("=I", CAN_ERR_MASK))
+        self.sock.bind((iface,))
+        self.stop = threading.Event()
+        self.frames = 0
+        self.classes = {}
+
+    def run(self):
+        while not self.stop.is_set():
+            ready, _, _ = select.select([self.sock], [], [], 0.1)
+            if not ready:
+                continue
+            can_id, _, _ = struct.unpack(CAN_FRAME_FMT, self.sock.recv(16))
+            if can_id & CAN_ERR_FLAG:
+                self.frames += 1
+                for bit in range(16):
+                    if can_id & (1 << bit):
+                        self.classes[bit] = self.classes.get(bit, 0) + 1
+
+
+# ---------------------------------------------------------------------------
+# Diagnostics
+# ---------------------------------------------------------------------------
+
+class CountingBus(Bus):
+    """Bus that counts the frames sent, all of which the ECU accepts."""
+
+    sent = 0
+
+    def send(self, can_id, data):
+        self.sent += 1
+        super().send(can_id, data)
+
+
+class Ecu:
+    def __init__(self, iface, node):
+        self.node = node
+        self.bus = CountingBus(iface, [RESP_BASE + node])
+        self.tp = IsoTp(self.bus, 0, 0.0)
+
+    def _tx_of(self, resp_id):
+        return REQ_BASE + (resp_id - RESP_BASE)
+
+    def request(self, pdu):
+        """Send one UDS request and return the positive response or None."""
+        self.tp.done.clear()
+        self.tp.send(REQ_BASE + self.node, pdu, self._tx_of, fc_id=RESP_BASE + self.node)
+        deadline = time.monotonic() + UDS_TIMEOUT
+        while True:
+            got = self.tp.poll(deadline - time.monotonic(), self._tx_of)
+            if got is None:
+                return None
+            rsp = got[1]
+            if rsp and rsp[0] == pdu[0] + 0x40:
+                return rsp
+            if len(rsp) >= 3 and rsp[0] == 0x7F and rsp[2] == 0x78:
+                deadline = time.monotonic() + UDS_TIMEOUT    # response pending
+                continue
+            if rsp and rsp[0] == 0x7F:
+                return None
+
+    def can_stats(self):
+        rsp = self.request(bytes([0x22, DID_CAN_STATS >> 8, DID_CAN_STATS & 0xFF]))
+        size = struct.calcsize(CAN_STATS_FMT)
+        if rsp is None or len(rsp) < 3 + size:
+            raise SystemExit("node %u: no answer to DID 0x%04X (firmware too old?)"
+                             % (self.node, DID_CAN_STATS))
+        return dict(zip(CAN_STATS_KEYS, struct.unpack_from(CAN_STATS_FMT, rsp, 3)))
+
+    def probe(self):
+        """TesterPresent round trip in seconds, None on a timeout."""
+        t0 = time.monotonic()
+        if self.request(bytes([0x3E, 0x00])) is None:
+            return None
+        return time.monotonic() - t0
+
+
+def cli_capture(port, baud):
+    import serial  # pylint: disable=import-outside-toplevel
+    with serial.Serial(port, baud, timeout=0.5) as ser:
+        ser.reset_input_buffer()
+        ser.write(b"can stats\r\n")
+        out = ser.read(4096)
+    return out.decode(errors="replace")
+
+
+# ---------------------------------------------------------------------------
+# Report
+# ---------------------------------------------------------------------------
+
+def percentile(values, p):
+    if not values:
+        return None
+    s = sorted(values)
+    return s[min(len(s) - 1, int(p / 100.0 * len(s)))]
+
+
+def ms(v):
+    return "-" if v is None else "%.2f" % (v * 1000.0)
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Load a Mini ECU on a real CAN bus and report.")
+    ap.add_argument("iface", help="SocketCAN interface, e.g. can0")
+    ap.add_argument("--node", type=int, default=0, help="CAN_NODE_ID of the ECU")
+    ap.add_argument("--pattern", choices=("load", "burst", "random", "steady"), default="load")
+    ap.add_argument("--duration", type=float, default=10.0, help="seconds of traffic")
+    ap.add_argument("--id", type=lambda s: int(s, 0), default=BENCH_ID,
+                    help="ID of load / burst / steady (default 0x%03X)" % BENCH_ID)
+    ap.add_argument("--rate", type=float, default=1000.0,
+                    help="frames/s of random / steady (0 = unpaced)")
+    ap.add_argument("--burst", type=int, default=32, help="frames per burst")
+    ap.add_argument("--gap", type=float, default=20.0, help="ms between bursts")
+    ap.add_argument("--probe-hz", type=float, default=20.0, help="TesterPresent probes per second")
+    ap.add_argument("--seed", type=int, default=1, help="seed of the random pattern")
+    ap.add_argument("--max-lost", type=int, help="fail if more accepted frames were lost")
+    ap.add_argument("--max-p99", type=float, help="fail if the p99 probe round trip exceeds (ms)")
+    ap.add_argument("--json", help="also write the results to this file")
+    ap.add_argument("--cli", help="serial console to capture \"can stats\" from (pyserial)")
+    ap.add_argument("--baud", type=int, default=115200)
+    args = ap.parse_args()
+
+    if args.pattern != "random" and args.id != BENCH_ID and handled(args.id, False, args.node):
+        ap.error("--id 0x%03X is used by a protocol of the ECU" % args.id)
+
+    ecu = Ecu(args.iface, args.node)
+    cli_before = cli_capture(args.cli, args.baud) if args.cli else None
+    before = ecu.can_stats()
+    own_before = ecu.bus.sent - 1                # its FC arrives after the snapshot
+
+    traffic = Traffic(args.iface, args)
+    errors = ErrorMonitor(args.iface)
+    errors.start()
+    t0 = time.monotonic()
+    traffic.start()
+
+    rtts, timeouts = [], 0
+    while time.monotonic() - t0 < args.duration:
+        rtt = ecu.probe()
+        if rtt is None:
+            timeouts += 1
+        else:
+            rtts.append(rtt)
+        time.sleep(max(0.0, 1.0 / args.probe_hz - (rtt or UDS_TIMEOUT)))
+
+    traffic.stop.set()
+    traffic.join()
+    seconds = time.monotonic() - t0
+    time.sleep(0.2)                              # let the ECU drain its queues
+    own = ecu.bus.sent - own_before + 1          # probes, FC frames, the read below
+    after = ecu.can_stats()
+    errors.stop.set()
+    errors.join()
+    cli_after = cli_capture(args.cli, args.baud) if args.cli else None
+
+    delta = {k: (after[k] - before[k]) & 0xFFFFFFFF for k in CAN_STATS_KEYS[:6]}
+    expected = traffic.expected + own
+    # Frames missing from the RX count were lost in the hardware FIFO,
+    # ring overflows after they were counted.
+    lost = max(0, expected - delta["rx"]) + delta["ring_overflows"]
+    p50, p90, p99 = (percentile(rtts, p) for p in (50, 90, 99))
+
+    print("pattern %s, %.1f s: %u frames sent (%.0f /s), %u waits for the adapter queue"
+          % (args.pattern, seconds, traffic.sent, traffic.sent / seconds, traffic.busy))
+    print("ECU: %u of %u accepted frames received, %u lost, %u FIFO overruns, "
+          "%u RX ring overflows" % (delta["rx"], expected, lost, delta["fifo_overruns"],
+                                   delta["ring_overflows"]))
+    print("ECU: %u error frames, %u bus-off, peak load %.1f %%, TEC %u REC %u, %u frames sent"
+          % (delta["error_frames"], delta["bus_off"], after["peak_load_permille"] / 10.0,
+             after["tec"], after["rec"], delta["tx"]))
+    print("probe: %u round trips, %u timeouts, p50 %s p90 %s p99 %s max %s ms"
+          % (len(rtts), timeouts, ms(p50), ms(p90), ms(p99), ms(max(rtts) if rtts else None)))
+    print("adapter: %u error frames%s" % (errors.frames, "".join(
+        " [class 0x%03X: %u]" % (1 << b, n) for b, n in sorted(errors.classes.items()))))
+    if cli_before is not None:
+        print("\n-- can stats before --\n%s\n-- can stats after --\n%s"
+              % (cli_before.strip(), cli_after.strip()))
+
+    failed = []
+    if args.max_lost is not None and lost > args.max_lost:
+        failed.append("lost %u > %u" % (lost, args.max_lost))
+    if args.max_p99 is not None and (p99 is None or p99 * 1000.0 > args.max_p99):
+        failed.append("p99 %s ms > %.2f ms" % (ms(p99), args.max_p99))
+
+    if args.json:
+        with open(args.json, "w", encoding="utf-8") as f:
+            json.dump({"pattern": args.pattern, "seconds": seconds, "sent": traffic.sent,
+                       "adapter_busy": traffic.busy, "expected": expected, "lost": lost,
+                       "ecu": delta, "ecu_after": after, "probe_ms": [r * 1000.0 for r in rtts],
+                       "probe_timeouts": timeouts, "adapter_errors": errors.frames,
+                       "failed": failed}, f, indent=1)
+
+    for reason in failed:
+        print("FAIL: " + reason)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
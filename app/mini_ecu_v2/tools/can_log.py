@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""
+can_log.py - Rebuild the Mini ECU log streams sent over CAN ("can" transport).
+
+With a stream on the "can" log transport (see Core/Inc/can_log.h) the ECU
+sends its bytes as frames on 0x7F8 + node:
+
+    byte 0     bits 7..6 stream, bits 5..0 sequence number
+    bytes 1..  stream bytes (DLC - 1 of them)
+
+    stream 0  log lines          (text, or tokenized frames for log_decode.py)
+    stream 1  CLI output         (replies, "rtos trace dump" for rtos_trace.py)
+    stream 2  binary telemetry   (tlm_plot.py)
+
+The tool reads a candump log (candump -L, or "can_replay.py -o"), writes
+the CLI output to stdout, the log lines to stderr (or --lines FILE) and
+the telemetry as is to --tlm FILE, and counts the frames lost by the gaps
+in the sequence numbers, which also count what the ECU had to drop. A log
+file is memory-mapped (trace_map.py), not read in; --start / --end take the
+window of S seconds after its first record without reading up to it.
+
+Usage:
+    candump -L can0,7F8:7FF | can_log.py
+    can_log.py bench.log --lines log.bin --tlm run.tlm
+    can_log.py bench.log --node 2 --cli trace.bin
+    can_log.py field.log --start 3600 --end 3660 --lines hour1.bin
+
+Only the Python standard library is needed.
+"""
+
+import argparse
+import re
+import sys
+
+import trace_map
+
+CANDUMP_RE = re.compile(r"^\((\d+)\.(\d{6})\)\s+\S+\s+([0-9A-Fa-f]{1,8})#([0-9A-Fa-f]*)\s*$")
+
+LOG_ID = 0x7F8
+SEQ_MASK = 0x3F
+
+
+class Splitter:
+    def __init__(self, sinks):
+        self.sinks = sinks      # stream -> callable(bytes)
+        self.seq = None
+        self.frames = 0
+        self.lost = 0
+
+    def frame(self, data):
+        if not data:
+            return
+        seq = data[0] & SEQ_MASK
+        if self.seq is not None:
+            self.lost += (seq - self.seq - 1) & SEQ_MASK
+        self.seq = seq
+        self.frames += 1
+        stream = data[0] >> 6
+        if stream in self.sinks:
+            self.sinks[stream](data[1:])
+
+
+def writer(stream, binary):
+    def write(data):
+        if binary:
+            stream.write(data)
+        else:
+            stream.write(data.decode(errors="replace"))
+        stream.flush()
+    return write
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Rebuild the Mini ECU log streams from CAN frames.")
+    ap.add_argument("input", nargs="?", help="candump log (default: stdin)")
+    ap.add_argument("--node", type=int, default=0, help="CAN_NODE_ID of the ECU (default 0)")
+    ap.add_argument("--lines", help="write the log lines to FILE (binary) instead of stderr")
+    ap.add_argument("--cli", help="write the CLI output to FILE (binary) instead of stdout")
+    ap.add_argument("--tlm", help="write the telemetry stream to FILE")
+    ap.add_argument("--start", type=float, metavar="S",
+                    help="input file from S seconds after its first record")
+    ap.add_argument("--end", type=float, metavar="S",
+                    help="input file up to S seconds after its first record")
+    args = ap.parse_args()
+
+    ident = LOG_ID + args.node
+    files = []
+
+    def sink(path, default):
+        if path is None:
+            return writer(default, False)
+        f = open(path, "wb")
+        files.append(f)
+        return writer(f, True)
+
+    sinks = {0: sink(args.lines, sys.stderr), 1: sink(args.cli, sys.stdout)}
+    if args.tlm:
+        sinks[2] = sink(args.tlm, None)
+    split = Splitter(sinks)
+
+    try:
+        if args.input:
+            # Mapped and decoded as it goes; the window found by bisection.
+            with trace_map.TraceMap(args.input, "candump") as tm:
+                start, end = tm.window(args.start, args.end)
+                for _, rid, _, data in tm.records(start, end):
+                    if rid == ident:
+                        split.frame(data)
+        else:
+            for line in sys.stdin:
+                m = CANDUMP_RE.match(line.strip())
+                if not m or int(m.group(3), 16) != ident or len(m.group(3)) == 8:
+                    continue
+                split.frame(bytes.fromhex(m.group(4)))
+    except KeyboardInterrupt:
+        pass
+    finally:
+        for f in files:
+            f.close()
+
+    sys.stderr.write("\ncan_log: %u frames on 0x%03X, %u lost\n" % (split.frames, ident, split.lost))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
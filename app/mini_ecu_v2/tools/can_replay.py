@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+"""
+can_replay.py - Prepare a CAN trace for "can replay" or the SIL --replay.
+
+Reads a trace in any of the formats the bench produces:
+
+    candump log    (1436509052.249713) can0 123#1122334455667788
+    Vector ASC     0.012345 1  18DAF110x       Rx   d 8 11 22 33 44 55 66 77 88
+    binary dump    a "can trace dump bin" capture (see can_trace.py)
+
+and either writes it as a candump log with the times starting at zero, for
+the SIL build:
+
+    can_replay.py trace.asc -o trace.log
+    build/sil/mini_ecu_sil --replay trace.log --speed 10
+
+or loads it into the ECU's trace ring ("can trace clear", then one "can
+trace add" per record) and, with --run, replays it there:
+
+    can_replay.py trace.asc --port /dev/ttyACM0 --run 1
+    can_replay.py capture.bin --port /dev/ttyACM0 --run fast
+
+The ring holds CAN_TRACE_DEPTH (1024) records; longer traces are cut to
+their first --depth records. The format is guessed from the content unless
+--format is given. Text traces are memory-mapped and decoded as they are
+written (trace_map.py), so a multi-GB field trace is not read into memory;
+--start / --end take the window of S seconds after its first record, found
+by bisection:
+
+    can_replay.py field.log --start 3600 --end 3660 -o hour1.log
+
+Only the Python standard library is needed; --port requires pyserial.
+"""
+
+import argparse
+import io
+import itertools
+import sys
+import time
+
+import can_trace
+import trace_map
+
+ID_EXT = can_trace.ID_EXT
+ID_RTR = can_trace.ID_RTR
+ID_MASK = can_trace.ID_MASK
+
+PROMPT = b"> "
+
+
+# ---------------------------------------------------------------------------
+# Readers: TraceMap.records() yields (time in us, id | ID_EXT | ID_RTR, dlc, data)
+# ---------------------------------------------------------------------------
+
+def read_binary(raw):
+    out = io.StringIO()
+    dec = can_trace.Decoder(out, "can0")
+    dec.feed(raw)
+    if not dec.done:
+        sys.stderr.write("trace: no end frame, dump incomplete\n")
+    return trace_map.TraceMap(fmt="candump", data=out.getvalue().encode())
+
+
+def load(path, fmt):
+    """Text traces are mapped (trace_map.py); a binary dump is one ring of
+    records, decoded in memory."""
+    if fmt is None:
+        with open(path, "rb") as f:
+            fmt = trace_map.guess(f.read(trace_map.HEAD))
+    if fmt == "bin":
+        with open(path, "rb") as f:
+            return read_binary(f.read())
+    return trace_map.TraceMap(path, fmt)
+
+
+# ---------------------------------------------------------------------------
+# Writers
+# ---------------------------------------------------------------------------
+
+def frame_text(ident, dlc, data):
+    sid = ident & ID_MASK
+    name = ("%08X" % sid) if ident & ID_EXT else ("%03X" % sid)
+    if ident & ID_RTR:
+        return "%s#R%s" % (name, dlc if dlc else "")
+    return "%s#%s" % (name, data.hex().upper())
+
+
+def stamp_text(us):
+    return "%u.%06u" % (us // 1000000, us % 1000000)
+
+
+def wait_prompt(ser, timeout=2.0):
+    buf = bytearray()
+    end = time.monotonic() + timeout
+    while time.monotonic() < end:
+        buf += ser.read(256)
+        if buf.endswith(PROMPT):
+            return buf.decode(errors="replace")
+    raise SystemExit("no CLI prompt (got %r)" % bytes(buf[-80:]))
+
+
+def upload(port, baud, recs, run):
+    import serial  # pylint: disable=import-outside-toplevel
+    with serial.Serial(port, baud, timeout=0.05) as ser:
+        ser.reset_input_buffer()
+        ser.write(b"\r\n")
+        wait_prompt(ser)
+        ser.write(b"can trace clear\r\n")
+        wait_prompt(ser)
+
+        # One line at a time: the CLI answers each with its prompt.
+        for i, (us, ident, dlc, data) in enumerate(recs):
+            ser.write(("can trace add %s %s\r\n" % (stamp_text(us), frame_text(ident, dlc, data)))
+                      .encode())
+            reply = wait_prompt(ser)
+            if "Usage" in reply or "Trace is" in reply:
+                raise SystemExit("record %u refused: %s" % (i, reply.strip()))
+            if i % 100 == 99:
+                sys.stderr.write("\rloaded %u/%u" % (i + 1, len(recs)))
+        sys.stderr.write("\rloaded %u records\n" % len(recs))
+
+        if run is None:
+            return 0
+        ser.write(("can replay %s\r\n" % run).encode())
+        reply = wait_prompt(ser, timeout=max(10.0, recs[-1][0] / 1e6 * 2 + 10.0)
+                            if recs else 10.0)
+        for line in reply.splitlines()[1:-1]:
+            print(line.strip())
+        return 0 if "Done" in reply else 1
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Convert or load a CAN trace for replay.")
+    ap.add_argument("input", help="candump log, Vector ASC or binary trace dump")
+    ap.add_argument("--format", choices=("candump", "asc", "bin"), help="input format")
+    ap.add_argument("-o", "--output", help="write a candump log (for the SIL --replay)")
+    ap.add_argument("--iface", default="can0", help="interface name in the log")
+    ap.add_argument("--start", type=float, metavar="S",
+                    help="from S seconds after the first record (seek, no full read)")
+    ap.add_argument("--end", type=float, metavar="S",
+                    help="up to S seconds after the first record")
+    ap.add_argument("--port", help="load the trace into the ECU over its console (pyserial)")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("--depth", type=int, default=1024, help="trace ring size of the ECU")
+    ap.add_argument("--run", metavar="SPEED",
+                    help="after loading, \"can replay SPEED\" (factor or fast)")
+    args = ap.parse_args()
+
+    tm = load(args.input, args.format)
+    start, end = tm.window(args.start, args.end)
+    first = next(tm.records(start, end), None)
+    if first is None:
+        raise SystemExit("%s: no frames found" % args.input)
+
+    # Times from zero: short CLI lines, and no wrap of the ECU's ms stamps.
+    t0 = first[0]
+
+    def shifted():
+        for us, ident, dlc, data in tm.records(start, end):
+            yield us - t0, ident, dlc, data
+
+    if args.output:
+        frames = 0
+        span = 0
+        with open(args.output, "w") as out:
+            for us, ident, dlc, data in shifted():
+                out.write("(%s) %s %s\n" % (stamp_text(us), args.iface,
+                                            frame_text(ident, dlc, data)))
+                frames += 1
+                span = max(span, us)
+        sys.stderr.write("trace: %u frames over %.3f s\n" % (frames, span / 1e6))
+
+    if args.port:
+        recs = list(itertools.islice(shifted(), args.depth + 1))
+        if len(recs) > args.depth:
+            sys.stderr.write("trace: only the first %u frames fit the ECU's ring\n"
+                             % args.depth)
+            recs = recs[:args.depth]
+        return upload(args.port, args.baud, recs, args.run)
+
+    if not args.output:
+        ap.error("give -o and/or --port")
+    return 0
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(main())
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,219 @@
+#!/usr/bin/env python3
+"""
+can_trace.py - Turn a Mini ECU "can trace dump bin|pack" capture into a candump log.
+
+The binary dump (see Core/Inc/can_trace.h) is a sequence of frames mixed
+into the normal UART output:
+
+    0xFD | len | type | payload
+
+    'H'  version (u8), record size (u16), records (u32), overwritten (u32),
+         bitrate (u32)
+    'R'  records: time ms (u32), time us (u16), dlc (u8), flags (u8),
+         id (u32, bit 31 = 29-bit, bit 30 = remote), data (8 bytes)
+    'E'  records sent (u32)
+
+"dump pack" sends header version 2 (record size 0, plus the dictionary size
+- 1 as u8) and the records packed in 'P' frames: tag (DLC bits 0-3, RTR 4,
+flags 5-6, new ID 7), zigzag varint time delta in us, the ID as a varint of
+(id << 1 | 29-bit) if new (it takes the next dictionary slot, round robin)
+or its slot (u8), then DLC data bytes. The decoder keeps the same dictionary
+and time, so it streams: each record is written as its frame arrives.
+
+Everything outside the frames (CLI prompt, log lines, and the 0xFE frames of
+tokenized logging) is skipped. The output is one candump log line per
+record and is read directly by canplayer and log2asc:
+
+    (12.345678) can0 123#1122334455667788
+
+Usage:
+    can_trace.py capture.bin [-o trace.log] [--iface can0]
+    can_trace.py --port /dev/ttyACM0 [--baud 115200] -o trace.log
+    cat capture.bin | can_trace.py
+
+Only the Python standard library is needed; --port requires pyserial.
+"""
+
+import argparse
+import struct
+import sys
+
+SYNC = 0xFD
+LOG_TOK_SYNC = 0xFE
+
+REC = struct.Struct("<IHBBI8s")
+HDR = struct.Struct("<BHIII")
+
+VERSION_BIN = 1
+VERSION_PACK = 2
+
+TAG_DLC = 0x0F
+TAG_RTR = 0x10
+TAG_FLAGS_POS = 5
+TAG_NEW_ID = 0x80
+
+ID_EXT = 0x80000000
+ID_RTR = 0x40000000
+ID_MASK = 0x1FFFFFFF
+
+F_FIFO1 = 0x01
+F_RING_FULL = 0x02
+
+
+class Decoder:
+    def __init__(self, out, iface):
+        self.out = out
+        self.iface = iface
+        self.buf = bytearray()
+        self.expected = None
+        self.records = 0
+        self.ring_full = 0
+        self.done = False
+        self.version = VERSION_BIN
+        self.bytes = 0
+        self.dict = []
+        self.dict_size = 0
+        self.dict_next = 0
+        self.last_us = 0
+
+    def feed(self, data):
+        self.buf += data
+
+        while self.buf:
+            starts = [i for i in (self.buf.find(bytes([SYNC])),
+                                  self.buf.find(bytes([LOG_TOK_SYNC]))) if i >= 0]
+            if not starts:
+                self.buf.clear()
+                return
+            del self.buf[:min(starts)]
+
+            if len(self.buf) < 2 or len(self.buf) < 2 + self.buf[1]:
+                return  # wait for the rest of the frame
+
+            sync, n = self.buf[0], self.buf[1]
+            frame = bytes(self.buf[2:2 + n])
+            del self.buf[:2 + n]
+            if sync == SYNC and frame:
+                self.bytes += 2 + n
+                self.frame(frame[0:1], frame[1:])
+
+    def frame(self, kind, payload):
+        if kind == b"H" and len(payload) >= HDR.size:
+            version, rec_size, count, overwritten, bitrate = HDR.unpack_from(payload)
+            if version == VERSION_PACK and len(payload) > HDR.size:
+                self.dict_size = payload[HDR.size] + 1
+                self.dict, self.dict_next, self.last_us = [], 0, 0
+            elif version != VERSION_BIN or rec_size != REC.size:
+                raise SystemExit("unsupported trace format (version %u, %u-byte records)"
+                                 % (version, rec_size))
+            self.version = version
+            self.expected = count
+            sys.stderr.write("trace: %u records at %u bit/s, %u older ones overwritten\n"
+                             % (count, bitrate, overwritten))
+        elif kind == b"R":
+            for off in range(0, len(payload) - REC.size + 1, REC.size):
+                self.record(*REC.unpack_from(payload, off))
+        elif kind == b"P" and self.version == VERSION_PACK:
+            self.packed(payload)
+        elif kind == b"E" and len(payload) >= 4:
+            sent, = struct.unpack_from("<I", payload)
+            if self.expected is not None and self.records != sent:
+                sys.stderr.write("trace: %u of %u records received\n" % (self.records, sent))
+            if self.records and self.version == VERSION_PACK:
+                raw = self.records * REC.size + 3 * -(-self.records // 12)
+                sys.stderr.write("trace: %u bytes, %.1f per record, %.1fx less than 'bin'\n"
+                                 % (self.bytes, self.bytes / self.records, raw / self.bytes))
+            self.done = True
+
+    @staticmethod
+    def varint(payload, off):
+        value, shift = 0, 0
+        while True:
+            b = payload[off]
+            off += 1
+            value |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return value, off
+
+    def packed(self, payload):
+        off = 0
+        while off < len(payload):
+            tag = payload[off]
+            zz, off = self.varint(payload, off + 1)
+            self.last_us += (zz >> 1) ^ -(zz & 1)
+            if tag & TAG_NEW_ID:
+                v, off = self.varint(payload, off)
+                key = (v >> 1) | (ID_EXT if v & 1 else 0)
+                if len(self.dict) < self.dict_size:
+                    self.dict.append(key)
+                else:
+                    self.dict[self.dict_next] = key
+                self.dict_next = (self.dict_next + 1) % self.dict_size
+            else:
+                key = self.dict[payload[off]]
+                off += 1
+            dlc = tag & TAG_DLC
+            if tag & TAG_RTR:
+                key |= ID_RTR
+                data = b""
+            else:
+                data = bytes(payload[off:off + dlc])
+                off += dlc
+            us = self.last_us
+            self.record(us // 1000, us % 1000, dlc, (tag >> TAG_FLAGS_POS) & 0x03, key,
+                        data.ljust(8, b"\0"))
+
+    def record(self, ms, us, dlc, flags, ident, data):
+        sid = ident & ID_MASK
+        name = ("%08X" % sid) if ident & ID_EXT else ("%03X" % sid)
+        body = "R" if ident & ID_RTR else data[:min(dlc, 8)].hex().upper()
+
+        self.out.write("(%u.%06u) %s %s#%s\n"
+                       % (ms // 1000, (ms % 1000) * 1000 + us, self.iface, name, body))
+        self.records += 1
+        if flags & F_RING_FULL:
+            self.ring_full += 1
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Decode a Mini ECU binary CAN trace dump.")
+    ap.add_argument("input", nargs="?", help="captured UART stream (default: stdin)")
+    ap.add_argument("-o", "--output", help="candump log file (default: stdout)")
+    ap.add_argument("--iface", default="can0", help="interface name in the log")
+    ap.add_argument("--port", help="read live from a serial port (needs pyserial)")
+    ap.add_argument("--baud", type=int, default=115200)
+    args = ap.parse_args()
+
+    out = open(args.output, "w") if args.output else sys.stdout
+    dec = Decoder(out, args.iface)
+
+    with out:
+        if args.port:
+            import serial  # pylint: disable=import-outside-toplevel
+            with serial.Serial(args.port, args.baud, timeout=0.1) as ser:
+                while not dec.done:
+                    dec.feed(ser.read(256))
+        else:
+            src = open(args.input, "rb") if args.input else sys.stdin.buffer
+            with src:
+                while not dec.done:
+                    chunk = src.read(256)
+                    if not chunk:
+                        break
+                    dec.feed(chunk)
+
+    if dec.ring_full:
+        sys.stderr.write("trace: %u frames were dropped by the RX ring (CanRxTask behind)\n"
+                         % dec.ring_full)
+    if not dec.done:
+        sys.stderr.write("trace: no end frame, dump incomplete\n")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(main())
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,520 @@
+#!/usr/bin/env python3
+"""
+can_update.py - Flash one or many ECUs through the bootloader over CAN (ISO-TP).
+
+Needs a Linux SocketCAN interface at the bootloader's BOOT_CAN_BITRATE:
+
+    ip link set can0 up type can bitrate 500000
+
+    can_update.py can0 build/release/mini_ecu_v2.bin                # node 0
+    can_update.py can0 mini_ecu_v2.bin --request                    # app running
+    can_update.py can0 mini_ecu_v2.bin --node 0 --node 1 --node 2 --multicast
+    can_update.py can0 --node 1 --info                              # query only
+
+Request PDUs are "cmd, 0, seq (u16), data" on 0x7E0 + node, responses
+"cmd, status, seq (u16), u32 values" on 0x7E8 + node, as described in the
+bootloader's boot_can.h. The command set and status codes are those of the
+UART protocol (fw_update.py).
+
+Physical transfers follow ISO 15765-2 flow control: the ECU grants each
+chunk with an FC frame, the next chunk's First Frame goes out while the
+previous one is being programmed.
+
+--multicast sends ERASE, every WRITE chunk and GO once on the functional
+ID 0x7DF. No FC is exchanged there (every ECU receives with the agreed
+block size 0 and --mc-stmin), so all ECUs on the bus are programmed by one
+transfer, with --mc-gap between chunks for the flash to catch up. Each ECU
+is then asked for DONE physically; chunks it missed are resent to it alone
+until its image verifies.
+
+Unless --full is given, every ECU first reports the CRC of each application
+sector (HASH) and only the sectors that differ from the image are erased
+and written. With --multicast the union of the changed chunks is sent, and
+each ECU skips the chunks of the sectors it kept.
+
+All nodes of one run must write the same A/B slot (INFO target, protocol
+3); the image for it is picked as in fw_update.py. Nodes running from
+different slots are updated in separate runs.
+
+Protocol 5 bootloaders get physical transfers LZ4-compressed (ZWRITE, as
+in fw_update.py), each ECU its own stream from its first changed sector;
+the pieces must arrive in order, so a lost one is sent again with the
+ones behind it. --multicast and --no-compress send plain chunks.
+
+Protocol 7 nodes that hold an interrupted transfer of the same image
+(INFO transfer record, see fw_update.py) repeat its ERASE, which erases
+nothing, and get only the chunks still missing; --full starts over.
+
+--request first sends DiagnosticSessionControl(programmingSession),
+0x10 0x02, to the running application so it resets into the bootloader.
+"""
+
+import argparse
+import os
+import select
+import socket
+import struct
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import fw_update  # noqa: E402
+from fw_update import (CMD_INFO, CMD_ERASE, CMD_WRITE, CMD_DONE, CMD_GO,  # noqa: E402
+                       CMD_HASH, CMD_ZWRITE, PROTO_DELTA, PROTO_SLOTS, PROTO_ZWRITE,
+                       ALL_SECTORS, ST_OK, ST_SEQ, IMAGE_RESULT, erase_payload, load_image,
+                       resume_plan, sector_plan, slot_image, status_str, version_str, zstream)
+
+REQ_BASE = 0x7E0
+RESP_BASE = 0x7E8
+FUNC_ID = 0x7DF
+
+ST_INCOMPLETE = fw_update.STATUS.index("incomplete")
+
+PAD = 0xCC
+N_TIMEOUT = 1.0          # N_Bs / N_Cr (s)
+
+CAN_FRAME_FMT = "=IB3x8s"
+
+
+# ---------------------------------------------------------------------------
+# SocketCAN
+# ---------------------------------------------------------------------------
+
+class Bus:
+    """Raw SocketCAN socket: send(id, data), recv(timeout) -> (id, data) or None."""
+
+    def __init__(self, iface, rx_ids):
+        self.sock = socket.socket(socket.AF_CAN, socket.SOCK_RAW, socket.CAN_RAW)
+        filters = b"".join(struct.pack("=II", i, socket.CAN_SFF_MASK) for i in rx_ids)
+        self.sock.setsockopt(socket.SOL_CAN_RAW, socket.CAN_RAW_FILTER, filters)
+        self.sock.bind((iface,))
+
+    def send(self, can_id, data):
+        data = bytes(data) + bytes([PAD]) * (8 - len(data))
+        self.sock.send(struct.pack(CAN_FRAME_FMT, can_id, 8, data))
+
+    def recv(self, timeout):
+        ready, _, _ = select.select([self.sock], [], [], max(timeout, 0))
+        if not ready:
+            return None
+        can_id, dlc, data = struct.unpack(CAN_FRAME_FMT, self.sock.recv(16))
+        return can_id & socket.CAN_SFF_MASK, data[:dlc]
+
+
+# ---------------------------------------------------------------------------
+# ISO-TP
+# ---------------------------------------------------------------------------
+
+def stmin_encode(seconds):
+    if seconds <= 0:
+        return 0
+    if seconds < 0.001:
+        return 0xF0 + max(1, min(9, int(round(seconds * 10000))))
+    return min(127, int(round(seconds * 1000)))
+
+
+def stmin_decode(value):
+    if value <= 0x7F:
+        return value / 1000.0
+    if 0xF1 <= value <= 0xF9:
+        return (value - 0xF0) / 10000.0
+    return 0.127
+
+
+class IsoTp:
+    """ISO-TP on several response IDs at once; completed PDUs are queued."""
+
+    def __init__(self, bus, bs, stmin):
+        self.bus = bus
+        self.bs = bs
+        self.stmin = stmin_encode(stmin)
+        self.rx = {}             # response id -> [buffer, length, next sn, CFs left in block]
+        self.done = []           # (response id, pdu)
+
+    def _fc(self, tx_id):
+        self.bus.send(tx_id, bytes([0x30, self.bs, self.stmin]))
+
+    def _frame(self, can_id, d, tx_of):
+        """Feed one received frame; returns (fs, bs, stmin) for an FC frame."""
+        if not d:
+            return None
+        pci = d[0] >> 4
+        if pci == 0:
+            n = d[0] & 0x0F
+            if 0 < n < len(d):
+                self.rx.pop(can_id, None)
+                self.done.append((can_id, bytes(d[1:1 + n])))
+        elif pci == 1 and len(d) == 8:
+            n = ((d[0] & 0x0F) << 8) | d[1]
+            self.rx[can_id] = [bytearray(d[2:8]), n, 1, self.bs]
+            self._fc(tx_of(can_id))
+        elif pci == 2 and can_id in self.rx:
+            st = self.rx[can_id]
+            if d[0] & 0x0F != st[2]:
+                del self.rx[can_id]      # lost frame; the request is repeated
+                return None
+            st[0] += d[1:1 + min(7, st[1] - len(st[0]))]
+            st[2] = (st[2] + 1) & 0x0F
+            if len(st[0]) >= st[1]:
+                del self.rx[can_id]
+                self.done.append((can_id, bytes(st[0])))
+            elif self.bs:
+                st[3] -= 1
+                if st[3] == 0:
+                    st[3] = self.bs
+                    self._fc(tx_of(can_id))
+        elif pci == 3:
+            return d[0] & 0x0F, d[1], stmin_decode(d[2])
+        return None
+
+    def poll(self, timeout, tx_of, want_fc=None):
+        """Wait for a completed PDU (or, with want_fc set, an FC on that ID)."""
+        deadline = time.monotonic() + timeout
+        while True:
+            if want_fc is None and self.done:
+                return self.done.pop(0)
+            frame = self.bus.recv(deadline - time.monotonic())
+            if frame is None:
+                return None
+            fc = self._frame(frame[0], frame[1], tx_of)
+            if fc is not None and frame[0] == want_fc:
+                return fc
+
+    def send(self, tx_id, data, tx_of, fc_id=None, stmin=0.0):
+        """Send one PDU; fc_id None = functional, stream without flow control."""
+        if len(data) <= 7:
+            self.bus.send(tx_id, bytes([len(data)]) + data)
+            return True
+        self.bus.send(tx_id, bytes([0x10 | (len(data) >> 8), len(data) & 0xFF]) + data[:6])
+        pos, sn, bs = 6, 1, 0
+        while pos < len(data):
+            if fc_id is not None:
+                while True:
+                    fc = self.poll(N_TIMEOUT, tx_of, want_fc=fc_id)
+                    if fc is None or fc[0] == 2:
+                        return False             # N_Bs timeout or overflow
+                    if fc[0] == 0:
+                        _, bs, stmin = fc
+                        break
+            sent = 0
+            while pos < len(data) and (bs == 0 or sent < bs):
+                if sent and stmin:
+                    time.sleep(stmin)
+                self.bus.send(tx_id, bytes([0x20 | sn]) + data[pos:pos + 7])
+                pos, sn, sent = pos + 7, (sn + 1) & 0x0F, sent + 1
+        return True
+
+
+# ---------------------------------------------------------------------------
+# Update protocol
+# ---------------------------------------------------------------------------
+
+def node_of(resp_id):
+    return resp_id - RESP_BASE
+
+
+def tx_of(resp_id):
+    return REQ_BASE + node_of(resp_id)
+
+
+def request(cmd, seq=0, payload=b""):
+    return struct.pack("<BBH", cmd, 0, seq) + payload
+
+
+def decode(pdu):
+    cmd, status, seq = struct.unpack_from("<BBH", pdu)
+    values = struct.unpack_from("<%dI" % ((len(pdu) - 4) // 4), pdu, 4)
+    return cmd, seq, [status] + list(values)
+
+
+class Ecus:
+    def __init__(self, tp, nodes):
+        self.tp = tp
+        self.nodes = nodes
+
+    def send(self, node, cmd, seq=0, payload=b""):
+        return self.tp.send(REQ_BASE + node, request(cmd, seq, payload), tx_of,
+                            fc_id=RESP_BASE + node)
+
+    def recv(self, timeout):
+        """Next response as (node, cmd, seq, [status, values...]) or None."""
+        got = self.tp.poll(timeout, tx_of)
+        if got is None:
+            return None
+        return (node_of(got[0]),) + decode(got[1])
+
+    def collect(self, cmd, nodes, timeout, seq=None):
+        """Responses to @cmd (and @seq) from every node in @nodes -> {node: values}."""
+        replies = {}
+        deadline = time.monotonic() + timeout
+        while len(replies) < len(nodes):
+            got = self.recv(deadline - time.monotonic())
+            if got is None:
+                break
+            node, rcmd, rseq, values = got
+            if rcmd == cmd and node in nodes and seq in (None, rseq):
+                replies[node] = values
+        return replies
+
+    def call(self, node, cmd, payload=b"", timeout=1.0, retries=3, seq=0):
+        for _ in range(retries):
+            if self.send(node, cmd, seq, payload):
+                reply = self.collect(cmd, [node], timeout, seq)
+                if node in reply:
+                    return reply[node]
+        raise SystemExit("node %u: no reply to command %d" % (node, cmd))
+
+
+def enter_bootloader(ecus, nodes, multicast):
+    """Programming session request to the application, then wait for INFO."""
+    if multicast:
+        ecus.tp.send(FUNC_ID, bytes([0x10, 0x02]), tx_of)
+    else:
+        for node in nodes:
+            ecus.tp.send(REQ_BASE + node, bytes([0x10, 0x02]), tx_of)
+    time.sleep(0.5)
+    ecus.tp.done.clear()
+    for node in nodes:
+        ecus.call(node, CMD_INFO, retries=10)
+
+
+def write_physical(ecus, node, image, chunk, chunks, max_retries):
+    """Chunks to one ECU; two in flight (one programming, one on the wire)."""
+    pending = list(chunks)
+    inflight = {}
+    retries = {}
+    while pending or inflight:
+        if pending and len(inflight) < 2:
+            seq = pending.pop(0)
+            if ecus.send(node, CMD_WRITE, seq, image[seq * chunk:(seq + 1) * chunk]):
+                inflight[seq] = time.monotonic()
+            else:
+                pending.insert(0, seq)
+                retries[seq] = retries.get(seq, 0) + 1
+        got = ecus.recv(0.0 if pending and len(inflight) < 2 else 0.05)
+        if got is not None and got[0] == node and got[1] == CMD_WRITE and got[2] in inflight:
+            seq, status = got[2], got[3][0]
+            del inflight[seq]
+            if status != ST_OK:
+                raise SystemExit("node %u chunk %u: %s" % (node, seq, status_str(status)))
+        for seq, sent in list(inflight.items()):
+            if time.monotonic() - sent > N_TIMEOUT:
+                del inflight[seq]
+                pending.insert(0, seq)
+                retries[seq] = retries.get(seq, 0) + 1
+        for seq, n in retries.items():
+            if n > max_retries:
+                raise SystemExit("node %u chunk %u: giving up after %u retries"
+                                 % (node, seq, max_retries))
+    return sum(retries.values())
+
+
+def write_stream_physical(ecus, node, pieces, max_retries):
+    """ZWRITE pieces to one ECU, two in flight; after a loss back to the
+    piece it expects. Returns the pieces resent."""
+    base = nxt = 0
+    sent = {}
+    resent = 0
+
+    def rewind(to, why):
+        nonlocal nxt, resent
+        resent += max(nxt - to, 1)
+        if resent > max_retries * 8:
+            raise SystemExit("node %u piece %u: giving up (%s)" % (node, to, why))
+        nxt = to
+        sent.clear()
+
+    while base < len(pieces):
+        if nxt < len(pieces) and nxt < base + 2:
+            if ecus.send(node, CMD_ZWRITE, nxt, pieces[nxt]):
+                sent[nxt] = time.monotonic()
+                nxt += 1
+            else:
+                rewind(nxt, "no flow control")
+        got = ecus.recv(0.0 if nxt < min(len(pieces), base + 2) else 0.05)
+        if got is not None and got[0] == node and got[1] == CMD_ZWRITE:
+            seq, values = got[2], got[3]
+            sent.pop(seq, None)
+            if values[0] == ST_OK:
+                base = max(base, values[1])
+            elif values[0] == ST_SEQ:
+                base = max(base, values[1])
+                rewind(values[1], "out of sequence")
+            else:
+                raise SystemExit("node %u piece %u: %s" % (node, seq, status_str(values[0])))
+        if sent and time.monotonic() - min(sent.values()) > N_TIMEOUT:
+            rewind(base, "timeout")
+    return resent
+
+
+def write_multicast(ecus, image, chunk, chunks, stmin, gap):
+    count = len(chunks)
+    for done, seq in enumerate(chunks, 1):
+        ecus.tp.send(FUNC_ID, request(CMD_WRITE, seq, image[seq * chunk:(seq + 1) * chunk]),
+                     tx_of, stmin=stmin)
+        time.sleep(gap)
+        if done % 32 == 0 or done == count:
+            sys.stdout.write("\r  %3u %%  %u/%u chunks" % (100 * done // count, done, count))
+            sys.stdout.flush()
+    print()
+
+
+def finish(ecus, node, image, chunk, crc, max_retries):
+    """DONE; resend whatever the ECU reports missing until it verifies."""
+    resent = 0
+    while True:
+        status, result, value = ecus.call(node, CMD_DONE, timeout=2.0)[:3]
+        if status == ST_OK:
+            return value, resent
+        if status != ST_INCOMPLETE or resent >= max_retries * 8:
+            raise SystemExit("node %u: done: %s (%s, CRC 0x%08X, expected 0x%08X)"
+                             % (node, status_str(status),
+                                IMAGE_RESULT[result] if result < len(IMAGE_RESULT) else result,
+                                value, crc))
+        resent += 1
+        write_physical(ecus, node, image, chunk, [value], max_retries)
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Update Mini ECUs over CAN (ISO-TP).")
+    ap.add_argument("iface", help="SocketCAN interface, e.g. can0")
+    ap.add_argument("bin", nargs="?", help="application .bin")
+    ap.add_argument("--node", type=int, action="append",
+                    help="BOOT_CAN_NODE of a target (repeat for several; default 0)")
+    ap.add_argument("--multicast", action="store_true",
+                    help="one functional transfer for all nodes")
+    ap.add_argument("--request", action="store_true",
+                    help="ask the running application to enter the bootloader first")
+    ap.add_argument("--bs", type=int, default=0, help="block size in our FC frames")
+    ap.add_argument("--stmin", type=float, default=0.0,
+                    help="STmin in our FC frames (seconds)")
+    ap.add_argument("--mc-stmin", type=float, default=0.0,
+                    help="gap between multicast consecutive frames (seconds)")
+    ap.add_argument("--mc-gap", type=float, default=0.010,
+                    help="pause after each multicast chunk for programming (seconds)")
+    ap.add_argument("--retries", type=int, default=8, help="resends per chunk")
+    ap.add_argument("--full", action="store_true",
+                    help="erase and write every sector, not only the changed ones")
+    ap.add_argument("--no-compress", action="store_true",
+                    help="send plain chunks even to protocol 5 bootloaders")
+    ap.add_argument("--info", action="store_true", help="only print bootloader info")
+    ap.add_argument("--no-go", action="store_true", help="do not reset into the new image")
+    args = ap.parse_args()
+
+    nodes = sorted(set(args.node or [0]))
+    if not args.info and not args.bin:
+        ap.error("an image is required unless --info is given")
+
+    bus = Bus(args.iface, [RESP_BASE + n for n in nodes])
+    ecus = Ecus(IsoTp(bus, args.bs, args.stmin), nodes)
+
+    if args.request:
+        enter_bootloader(ecus, nodes, args.multicast)
+
+    chunk = 0
+    delta = not args.full
+    zwrite = not (args.no_compress or args.multicast)
+    targets = {}
+    infos = {}
+    for node in nodes:
+        info = infos[node] = ecus.call(node, CMD_INFO)
+        _, proto, chunk, _, app_max, app_version, state = info[:7]
+        delta = delta and proto >= PROTO_DELTA
+        zwrite = zwrite and proto >= PROTO_ZWRITE
+        targets[node] = info[7] if proto >= PROTO_SLOTS else None
+        print("node %u: protocol %u, %u B chunks, target %s, %u KB, image %s (%s)"
+              % (node, proto, chunk,
+                 "0x%08X" % targets[node] if targets[node] is not None else "app area",
+                 app_max // 1024, version_str(app_version) if app_version else "none",
+                 IMAGE_RESULT[state] if state < len(IMAGE_RESULT) else state))
+    if args.info:
+        return
+
+    if len(set(targets.values())) > 1:
+        raise SystemExit("nodes write different slots (%s), update them in separate runs"
+                         % ", ".join("%u: 0x%08X" % (n, t) if t is not None else "%u: -" % n
+                                     for n, t in sorted(targets.items())))
+    target = targets[nodes[0]]
+    if target is not None:
+        args.bin, slot = slot_image(args.bin, target)
+        print("target slot %s: %s" % (slot, args.bin))
+    image, version, crc = load_image(args.bin)
+    if len(image) > app_max:
+        raise SystemExit("%s: %u B does not fit the %u B app area" % (args.bin, len(image), app_max))
+    count = (len(image) + chunk - 1) // chunk
+    t_start = time.monotonic()
+
+    tag = fw_update.image_stamp.stm32_crc(image)
+    chunks = {node: list(range(count)) for node in nodes}
+    if delta:
+        # Each ECU erases its own changed sectors, so ERASE goes out physically.
+        replies = {}
+        for node in nodes:
+            resume = resume_plan(infos[node], image, chunk)
+            if resume is not None:
+                mask, chunks[node] = resume
+                print("node %u: resuming an interrupted transfer, %u of %u chunks missing"
+                      % (node, len(chunks[node]), count))
+            else:
+                mask, chunks[node], compared = sector_plan(
+                    lambda sector: ecus.call(node, CMD_HASH, seq=sector), image, chunk)
+                print("node %u: %u of %u sectors differ from the image"
+                      % (node, bin(mask).count("1"), compared))
+            erase = erase_payload(infos[node][1], len(image), mask, tag)
+            replies[node] = ecus.call(node, CMD_ERASE, erase, timeout=15.0, retries=1)
+    elif args.multicast:
+        erase = erase_payload(min(infos[n][1] for n in nodes), len(image), ALL_SECTORS, tag)
+        ecus.tp.send(FUNC_ID, request(CMD_ERASE, 0, erase), tx_of)
+        replies = ecus.collect(CMD_ERASE, nodes, 15.0)
+    else:
+        replies = {n: ecus.call(n, CMD_ERASE, erase_payload(infos[n][1], len(image),
+                                                            ALL_SECTORS, tag),
+                                timeout=15.0, retries=1) for n in nodes}
+    for node in nodes:
+        if node not in replies or replies[node][0] != ST_OK:
+            raise SystemExit("node %u: erase: %s"
+                             % (node, status_str(replies[node][0]) if node in replies
+                                else "no reply"))
+        print("node %u: erased %u sectors in %.2f s"
+              % (node, replies[node][2], replies[node][1] / 1000.0))
+
+    union = sorted(set().union(*chunks.values()))
+    size = min(len(union) * chunk, len(image))
+    print("writing %s %s, %u of %u B to node%s %s%s"
+          % (args.bin, version_str(version), size, len(image), "s" if len(nodes) > 1 else "",
+             ", ".join(map(str, nodes)), " (multicast)" if args.multicast else ""))
+    t0 = time.monotonic()
+    if args.multicast:
+        if union:
+            write_multicast(ecus, image, chunk, union, args.mc_stmin, args.mc_gap)
+    else:
+        for node in nodes:
+            pieces = zstream(image, chunk, chunks[node]) if zwrite else None
+            if pieces:
+                resent = write_stream_physical(ecus, node, pieces, args.retries)
+                print("node %u: written as %u B LZ4, %u pieces resent"
+                      % (node, sum(len(p) for p in pieces), resent))
+            else:
+                resent = write_physical(ecus, node, image, chunk, chunks[node], args.retries)
+                print("node %u: written, %u chunks resent" % (node, resent))
+    seconds = time.monotonic() - t0
+    print("transfer %.2f s (%.1f KB/s)" % (seconds, size / 1024.0 / max(seconds, 1e-6)))
+
+    for node in nodes:
+        ecu_crc, resent = finish(ecus, node, image, chunk, crc, args.retries)
+        print("node %u: image verified, CRC 0x%08X%s"
+              % (node, ecu_crc, ", %u missed chunks resent" % resent if resent else ""))
+    print("total %.2f s" % (time.monotonic() - t_start))
+
+    if not args.no_go:
+        if args.multicast:
+            ecus.tp.send(FUNC_ID, request(CMD_GO), tx_of)
+        else:
+            for node in nodes:
+                ecus.call(node, CMD_GO)
+        print("reset into the new image" + (" (on trial until it confirms itself)"
+                                            if target is not None else ""))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,225 @@
+#!/usr/bin/env python3
+"""
+cli_rpc.py - Binary RPC client for the Mini ECU console ("rpc").
+
+The ECU side is described in Core/Inc/cli_rpc.h: one COBS frame per
+request and per response, framed as the telemetry (tlm_plot.py),
+
+    request   0x00 | COBS('Q' | seq | cmd | TLV... | CRC-16) | 0x00
+    response  0x00 | COBS('P' | seq | cmd | status | TLV... | CRC-16) | 0x00
+
+with TLVs of tag (u8), length (u8), value. Console text around the frames
+(prompt, log lines, dashboard) is skipped. Rpc.call() is the building
+block for test scripts; run on its own the tool sends one request:
+
+Usage:
+    cli_rpc.py --port /dev/ttyACM0 ping -n 100        # round-trip times
+    cli_rpc.py --port /dev/ttyACM0 exec "can stats"   # any text command
+    cli_rpc.py --port /dev/ttyACM0 veh
+    cli_rpc.py --port /dev/ttyACM0 speed 80
+    cli_rpc.py --port /dev/ttyACM0 log-level --module CAN 3
+    cli_rpc.py --port /dev/ttyACM0 stats
+    cli_rpc.py --port /dev/ttyACM0 cal-get VEH_DECAY
+    cli_rpc.py --port /dev/ttyACM0 cal-set VEH_DECAY 0.95
+
+Needs pyserial.
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+from tlm_plot import cobs_decode, crc16
+
+REQ = 0x51              # 'Q'
+RESP = 0x50             # 'P'
+
+PING, EXEC, VEH_GET, VEH_SPEED, LOG_LEVEL, STATS, CAL_GET, CAL_SET, CAL_COMMIT = (
+    0x01, 0x02, 0x10, 0x11, 0x20, 0x21, 0x30, 0x31, 0x32)
+STAGE_BEGIN, STAGE_DATA, STAGE_END = 0x40, 0x41, 0x42
+
+STATUS = {0: "ok", 1: "unknown command", 2: "bad argument", 3: "refused"}
+
+STATS_TAGS = {1: "uptime ms", 2: "log lines dropped", 3: "cli dropped", 4: "tlm dropped",
+              5: "CAN RX", 6: "CAN TX", 7: "CAN state", 8: "TEC", 9: "REC",
+              10: "FIFO overruns"}
+
+
+def cobs_encode(data):
+    out = bytearray(b"\x00")
+    block = bytearray()
+    for b in data:
+        if b == 0:
+            out += bytes([len(block) + 1]) + block
+            block = bytearray()
+            continue
+        block.append(b)
+        if len(block) == 254:
+            out += b"\xff" + block
+            block = bytearray()
+    out += bytes([len(block) + 1]) + block + b"\x00"
+    return bytes(out)
+
+
+def tlv(tag, value):
+    return bytes([tag, len(value)]) + value
+
+
+def u8(v):
+    return struct.pack("<B", v)
+
+
+def u16(v):
+    return struct.pack("<H", v)
+
+
+def u32(v):
+    return struct.pack("<I", v)
+
+
+def f32(v):
+    return struct.pack("<f", v)
+
+
+def request(seq, cmd, args=b""):
+    """Wire bytes of one request."""
+    raw = bytes([REQ, seq & 0xFF, cmd]) + args
+    return cobs_encode(raw + struct.pack("<H", crc16(raw)))
+
+
+def parse(chunk):
+    """(seq, cmd, status, {tag: [value, ...]}) of a response chunk, or None."""
+    raw = cobs_decode(chunk)
+    if raw is None or len(raw) < 6 or raw[0] != RESP:
+        return None
+    if crc16(raw[:-2]) != struct.unpack("<H", raw[-2:])[0]:
+        return None
+    tags = {}
+    pos, body = 0, raw[4:-2]
+    while pos + 2 <= len(body):
+        tag, n = body[pos], body[pos + 1]
+        tags.setdefault(tag, []).append(bytes(body[pos + 2:pos + 2 + n]))
+        pos += 2 + n
+    return raw[1], raw[2], raw[3], tags
+
+
+class Rpc:
+    def __init__(self, ser, timeout=1.0):
+        self.ser = ser
+        self.timeout = timeout
+        self.seq = 0
+        self.buf = bytearray()
+
+    def call(self, cmd, args=b""):
+        """Send a request; return (status, tags) or raise TimeoutError."""
+        self.seq = (self.seq + 1) & 0xFF
+        self.ser.write(request(self.seq, cmd, args))
+        deadline = time.monotonic() + self.timeout
+        while time.monotonic() < deadline:
+            self.buf += self.ser.read(self.ser.in_waiting or 1)
+            while True:
+                start = self.buf.find(b"\x00")
+                end = self.buf.find(b"\x00", start + 1) if start >= 0 else -1
+                if end < 0:
+                    break
+                resp = parse(bytes(self.buf[start + 1:end])) if end > start + 1 else None
+                if resp is None:
+                    del self.buf[:end]          # text: its last zero may open a frame
+                    continue
+                del self.buf[:end + 1]
+                if resp[0] == self.seq and resp[1] == cmd:
+                    return resp[2], resp[3]
+        raise TimeoutError("no response to command 0x%02X" % cmd)
+
+
+def _num(value):
+    return {1: "<B", 2: "<H", 4: "<I"}.get(len(value), None)
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Binary RPC client for the Mini ECU console.")
+    ap.add_argument("--port", required=True, help="serial port (needs pyserial)")
+    ap.add_argument("--baud", type=int, default=115200)
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    p = sub.add_parser("ping")
+    p.add_argument("-n", type=int, default=1, help="requests, for round-trip statistics")
+    sub.add_parser("exec").add_argument("line")
+    sub.add_parser("veh")
+    sub.add_parser("speed").add_argument("kph", type=float)
+    p = sub.add_parser("log-level")
+    p.add_argument("--module")
+    p.add_argument("level", type=int, nargs="?")
+    sub.add_parser("stats")
+    sub.add_parser("cal-get").add_argument("name")
+    p = sub.add_parser("cal-set")
+    p.add_argument("name")
+    p.add_argument("value")
+    sub.add_parser("cal-commit")
+    args = ap.parse_args()
+
+    import serial  # pylint: disable=import-outside-toplevel
+    with serial.Serial(args.port, args.baud, timeout=0.01) as ser:
+        rpc = Rpc(ser)
+
+        if args.cmd == "ping":
+            times = []
+            for _ in range(args.n):
+                t0 = time.perf_counter()
+                status, tags = rpc.call(PING)
+                times.append((time.perf_counter() - t0) * 1e3)
+            up = struct.unpack("<I", tags[1][0])[0]
+            print("uptime %u ms, protocol %u; round trip min %.2f mean %.2f max %.2f ms over %u"
+                  % (up, tags[2][0][0], min(times), sum(times) / len(times), max(times), len(times)))
+            return 0
+
+        if args.cmd == "exec":
+            status, tags = rpc.call(EXEC, tlv(1, args.line.encode()))
+            sys.stdout.write(b"".join(tags.get(1, [])).decode(errors="replace"))
+            if 2 in tags:
+                sys.stdout.write("[%u bytes cut]\n" % struct.unpack("<I", tags[2][0])[0])
+        elif args.cmd == "veh":
+            status, tags = rpc.call(VEH_GET)
+            if status == 0:
+                print("speed %.1f km/h, rpm %u, coolant %.1f C, throttle %.2f, gear %u" % (
+                    struct.unpack("<f", tags[1][0])[0], struct.unpack("<H", tags[2][0])[0],
+                    struct.unpack("<f", tags[3][0])[0], struct.unpack("<f", tags[4][0])[0],
+                    tags[5][0][0]))
+        elif args.cmd == "speed":
+            status, _ = rpc.call(VEH_SPEED, tlv(1, f32(args.kph)))
+        elif args.cmd == "log-level":
+            req = tlv(1, args.module.encode()) if args.module else b""
+            if args.level is not None:
+                req += tlv(2, u8(args.level))
+            status, tags = rpc.call(LOG_LEVEL, req)
+            if status == 0:
+                print("level %u" % tags[2][0][0])
+        elif args.cmd == "stats":
+            status, tags = rpc.call(STATS)
+            for tag in sorted(tags):
+                value = tags[tag][0]
+                print("%-18s %u" % (STATS_TAGS.get(tag, "tag %u" % tag),
+                                    struct.unpack(_num(value), value)[0]))
+        elif args.cmd == "cal-get":
+            status, tags = rpc.call(CAL_GET, tlv(1, args.name.encode()))
+            if status == 0:
+                value = struct.unpack("<f", tags[3][0])[0] if 3 in tags else \
+                    struct.unpack("<I", tags[4][0])[0]
+                print("%s (0x%04X) = %s" % (args.name, struct.unpack("<H", tags[2][0])[0], value))
+        elif args.cmd == "cal-set":
+            value = tlv(3, f32(float(args.value))) if "." in args.value else tlv(4, u32(int(args.value, 0)))
+            status, _ = rpc.call(CAL_SET, tlv(1, args.name.encode()) + value)
+            if status == 2 and "." not in args.value:     # a float parameter given as integer
+                status, _ = rpc.call(CAL_SET, tlv(1, args.name.encode()) + tlv(3, f32(float(args.value))))
+        else:
+            status, tags = rpc.call(CAL_COMMIT)
+            if status == 0:
+                print("%u values queued" % struct.unpack("<I", tags[1][0])[0])
+
+        if status != 0:
+            sys.stderr.write("rpc: %s\n" % STATUS.get(status, "status %u" % status))
+        return 0 if status == 0 else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
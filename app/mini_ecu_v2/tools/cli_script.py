@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""
+cli_script.py - Upload a CLI script to the Mini ECU, run it, print the report.
+
+The ECU side is described in Core/Inc/cli_script.h: "script load <bytes>
+<crc>" takes the next bytes without echo, checks the CRC-16/CCITT-FALSE
+and the repeat/end structure; "script run" runs it in CliTask and ends
+with "Script done: ..."; "script report" lists per command line the runs
+and the last, mean and largest time in us.
+
+Usage:
+    cli_script.py --port /dev/ttyACM0 rig.cli
+    cli_script.py --port /dev/ttyACM0 --load-only rig.cli
+    cli_script.py --port /dev/ttyACM0 --timeout 600 soak.cli    # long run
+
+A script of "repeat 0" runs until "script stop"; Ctrl-C sends that.
+"""
+
+import argparse
+import sys
+import time
+
+SIZE = 2048             # CLI_SCRIPT_SIZE
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def _read_until(ser, marks, timeout, out=None):
+    """Read until one of marks shows up; return (mark, text) or (None, text)."""
+    text = b""
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        chunk = ser.read(ser.in_waiting or 1)
+        if out is not None and chunk:
+            out.write(chunk.decode(errors="replace"))
+            out.flush()
+        text += chunk
+        for mark in marks:
+            if mark in text:
+                return mark, text
+    return None, text
+
+
+def load(ser, data, log=sys.stderr):
+    """Upload data; True if the ECU accepted it."""
+    ser.reset_input_buffer()
+    ser.write(b"\r\nscript load %u %04X\r\n" % (len(data), crc16(data)))
+    mark, text = _read_until(ser, (b"Send ", b"must be", b"Unknown command"), 1.0)
+    if mark != b"Send ":
+        log.write("script: ECU refused the upload: %s\n" % text.decode(errors="replace").strip())
+        return False
+    _read_until(ser, (b" bytes\r\n",), 0.5)
+    ser.write(data)
+    mark, text = _read_until(ser, (b"Script: ", b"Script rejected", b"timed out"), 2.0 + len(data) / 1000.0)
+    _, rest = _read_until(ser, (b"\r\n",), 0.5)
+    line = (text + rest).decode(errors="replace").strip().splitlines()
+    log.write("%s\n" % (line[-1] if line else "script: no reply"))
+    return mark == b"Script: "
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Upload and run a Mini ECU CLI script.")
+    ap.add_argument("script", help="script file, one CLI command per line")
+    ap.add_argument("--port", required=True, help="serial port (needs pyserial)")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("--timeout", type=float, default=60.0, help="longest run (s)")
+    ap.add_argument("--load-only", action="store_true", help="upload, do not run")
+    args = ap.parse_args()
+
+    with open(args.script, "rb") as f:
+        data = f.read().replace(b"\r\n", b"\n")
+    if not data or len(data) >= SIZE:
+        sys.stderr.write("script: %u bytes, must be 1..%u\n" % (len(data), SIZE - 1))
+        return 1
+
+    import serial  # pylint: disable=import-outside-toplevel
+    with serial.Serial(args.port, args.baud, timeout=0.05) as ser:
+        if not load(ser, data):
+            return 1
+        if args.load_only:
+            return 0
+
+        ser.write(b"script run\r\n")
+        try:
+            mark, _ = _read_until(ser, (b"Script done", b"Script stopped"), args.timeout, sys.stdout)
+        except KeyboardInterrupt:
+            mark = None
+        if mark is None:
+            ser.write(b"\r\nscript stop\r\n")
+            _read_until(ser, (b"Script stopped", b"not running"), 1.0, sys.stdout)
+        _read_until(ser, (b"> ",), 1.0, sys.stdout)
+
+        ser.write(b"script report\r\n")
+        _, text = _read_until(ser, (b"\r\n> ",), 2.0)
+        sys.stdout.write(text.decode(errors="replace").split("\r\n", 1)[-1].rsplit("\r\n> ", 1)[0] + "\n")
+        return 0 if mark == b"Script done" else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
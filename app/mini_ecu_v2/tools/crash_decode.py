@@ -0,0 +1,290 @@
+#!/usr/bin/env python3
+"""
+crash_decode.py - Decode a Mini ECU crash record on the host.
+
+After a fault, Error_Handler(), a failed configASSERT() or a missed watchdog
+deadline the firmware keeps a CrashDump_t in no-init RAM (see
+Core/Inc/crash_dump.h). "crash raw" prints it in hex:
+
+    crash raw 784 bytes
+    0000: 4352534801000000...
+    0020: ...
+
+This tool reads those lines from a console capture, checks the record and
+prints the registers, fault status bits, stack and log. Given the firmware
+ELF it also names the function of PC, LR and of the stack words that point
+into code (with file:line when arm-none-eabi-addr2line is on the PATH), and
+rebuilds a tokenized log (LOG_TOKENIZED=1) through log_decode.py.
+
+Usage:
+    crash_decode.py capture.txt
+    crash_decode.py capture.txt --elf mini_ecu_v2.elf
+    cat capture.txt | crash_decode.py --elf mini_ecu_v2.elf
+
+Other lines in the capture are ignored. Only the Python standard library
+is needed.
+"""
+
+import argparse
+import bisect
+import os
+import re
+import shutil
+import struct
+import subprocess
+import sys
+
+MAGIC = 0x48535243
+VERSION = 1
+TASK_LEN = 16
+
+# CRASH_DUMP_CAUSE_TABLE
+CAUSES = ["none", "HardFault", "MemManage", "BusFault", "UsageFault",
+          "Error_Handler", "configASSERT", "Watchdog", "StackOverflow"]
+
+# flags
+FRAME = 0x01
+IN_HANDLER = 0x02
+FP_FRAME = 0x04
+
+CFSR_BITS = [
+    (0, "IACCVIOL"), (1, "DACCVIOL"), (3, "MUNSTKERR"), (4, "MSTKERR"),
+    (5, "MLSPERR"), (7, "MMARVALID"),
+    (8, "IBUSERR"), (9, "PRECISERR"), (10, "IMPRECISERR"), (11, "UNSTKERR"),
+    (12, "STKERR"), (13, "LSPERR"), (15, "BFARVALID"),
+    (16, "UNDEFINSTR"), (17, "INVSTATE"), (18, "INVPC"), (19, "NOCP"),
+    (24, "UNALIGNED"), (25, "DIVBYZERO"),
+]
+HFSR_BITS = [(1, "VECTTBL"), (30, "FORCED"), (31, "DEBUGEVT")]
+
+MMARVALID = 1 << 7
+BFARVALID = 1 << 15
+
+# Flash of the STM32F446RE: stack words in here may be return addresses.
+FLASH_BASE = 0x08000000
+FLASH_END = 0x08080000
+
+HEADER_RE = re.compile(r"crash raw (\d+) bytes")
+LINE_RE = re.compile(r"^\s*([0-9A-Fa-f]{4}):\s*([0-9A-Fa-f]+)\s*$")
+
+
+# ---------------------------------------------------------------------------
+# Capture
+# ---------------------------------------------------------------------------
+
+def read_record(lines):
+    """Return the bytes of the last "crash raw" dump in lines."""
+    size = None
+    data = None
+
+    for line in lines:
+        m = HEADER_RE.search(line)
+        if m:
+            size = int(m.group(1))
+            data = bytearray()
+            continue
+        if data is None:
+            continue
+        m = LINE_RE.match(line)
+        if not m:
+            continue
+        off = int(m.group(1), 16)
+        if off != len(data):
+            raise SystemExit("offset 0x%04x: expected 0x%04x (lines lost?)" % (off, len(data)))
+        data += bytes.fromhex(m.group(2))
+
+    if data is None:
+        raise SystemExit("no \"crash raw\" output in the input")
+    if len(data) != size:
+        raise SystemExit("record has %u of %u bytes (capture cut short?)" % (len(data), size))
+    return bytes(data)
+
+
+def unpack(data, stack_words, log_bytes):
+    """Split a CrashDump_t (little-endian) into a dict."""
+    fmt = "<7I13I9I%ds I%dI I%ds I" % (TASK_LEN, stack_words, log_bytes)
+    if struct.calcsize(fmt) != len(data):
+        raise SystemExit("record is %u bytes, layout with %u stack words and %u log bytes is %u "
+                         "(see --stack-words / --log-bytes)"
+                         % (len(data), stack_words, log_bytes, struct.calcsize(fmt)))
+
+    v = list(struct.unpack(fmt, data))
+    rec = {}
+    for name in ("magic", "version", "cause", "flags", "count", "bootsSince", "uptimeMs"):
+        rec[name] = v.pop(0)
+    rec["r"] = [v.pop(0) for _ in range(13)]
+    for name in ("sp", "lr", "pc", "xpsr", "excReturn", "cfsr", "hfsr", "mmfar", "bfar"):
+        rec[name] = v.pop(0)
+    rec["task"] = v.pop(0).split(b"\0", 1)[0].decode(errors="replace")
+    rec["stackWords"] = v.pop(0)
+    rec["stack"] = [v.pop(0) for _ in range(stack_words)]
+    rec["logLen"] = v.pop(0)
+    rec["log"] = v.pop(0)
+    rec["check"] = v.pop(0)
+
+    words = struct.unpack("<%dI" % (len(data) // 4 - 1), data[:-4])
+    acc = 0
+    for w in words:
+        acc ^= w
+    rec["checkOk"] = ((~acc) & 0xFFFFFFFF) == rec["check"]
+    return rec
+
+
+# ---------------------------------------------------------------------------
+# ELF
+# ---------------------------------------------------------------------------
+
+class Symbols:
+    """Function symbols of a 32-bit LE ELF, plus addr2line if available."""
+
+    def __init__(self, path):
+        self.path = path
+        self.addrs = []
+        self.syms = []
+        self.addr2line = shutil.which("arm-none-eabi-addr2line")
+
+        with open(path, "rb") as f:
+            elf = f.read()
+        if elf[:4] != b"\x7fELF" or elf[4] != 1 or elf[5] != 1:
+            raise SystemExit("%s: not a 32-bit little-endian ELF" % path)
+
+        e_shoff, = struct.unpack_from("<I", elf, 0x20)
+        e_shentsize, e_shnum, _ = struct.unpack_from("<HHH", elf, 0x2E)
+
+        def section(i):
+            return struct.unpack_from("<IIIIIIIIII", elf, e_shoff + i * e_shentsize)
+
+        funcs = []
+        for i in range(e_shnum):
+            sh = section(i)
+            if sh[1] != 2:  # SHT_SYMTAB
+                continue
+            strtab = section(sh[6])
+            for off in range(sh[4], sh[4] + sh[5], 16):
+                st_name, st_value, st_size, st_info = struct.unpack_from("<IIIB", elf, off)
+                if (st_info & 0xF) != 2 or st_value == 0:  # STT_FUNC
+                    continue
+                start = strtab[4] + st_name
+                name = elf[start:elf.index(b"\0", start)].decode(errors="replace")
+                funcs.append((st_value & ~1, st_size, name))
+
+        funcs.sort()
+        self.addrs = [f[0] for f in funcs]
+        self.syms = funcs
+
+    def name(self, addr):
+        """Return "func+0xoff [file:line]" for a code address, or None."""
+        addr &= ~1
+        i = bisect.bisect_right(self.addrs, addr) - 1
+        if i < 0:
+            return None
+        start, size, name = self.syms[i]
+        if addr >= start + max(size, 2):
+            return None
+
+        text = "%s+0x%x" % (name, addr - start)
+        if self.addr2line:
+            out = subprocess.run([self.addr2line, "-e", self.path, "0x%x" % addr],
+                                 capture_output=True, text=True, check=False).stdout.strip()
+            if out and not out.startswith("??"):
+                text += " [%s]" % out
+        return text
+
+
+# ---------------------------------------------------------------------------
+# Report
+# ---------------------------------------------------------------------------
+
+def bit_names(value, bits):
+    names = [name for bit, name in bits if value & (1 << bit)]
+    return " ".join(names) if names else "-"
+
+
+def code_addr(addr):
+    return FLASH_BASE <= addr < FLASH_END and (addr & 1)
+
+
+def report(rec, syms, elf, out):
+    def sym(addr):
+        name = syms.name(addr) if syms else None
+        return "  " + name if name else ""
+
+    cause = CAUSES[rec["cause"]] if rec["cause"] < len(CAUSES) else "cause %u" % rec["cause"]
+    out.write("Crash #%u, %u boot(s) ago: %s after %u ms\n"
+              % (rec["count"], rec["bootsSince"], cause, rec["uptimeMs"]))
+    if rec["flags"] & IN_HANDLER:
+        out.write("In exception %u (task %s interrupted)\n" % (rec["xpsr"] & 0x1FF, rec["task"] or "-"))
+    else:
+        out.write("In task %s\n" % (rec["task"] or "- (scheduler not started)"))
+
+    out.write("PC   0x%08X%s\n" % (rec["pc"], sym(rec["pc"])))
+    out.write("LR   0x%08X%s\n" % (rec["lr"], sym(rec["lr"])))
+    out.write("SP   0x%08X\n" % rec["sp"])
+
+    if rec["flags"] & FRAME:
+        out.write("xPSR 0x%08X  EXC_RETURN 0x%08X%s\n"
+                  % (rec["xpsr"], rec["excReturn"], " (FP frame)" if rec["flags"] & FP_FRAME else ""))
+        for i in range(0, 13, 4):
+            out.write("  ".join("R%-2u  0x%08X" % (j, rec["r"][j]) for j in range(i, min(i + 4, 13))) + "\n")
+    elif rec["cause"] <= CAUSES.index("UsageFault"):
+        out.write("No exception frame (stacking fault or SP outside RAM)\n")
+
+    out.write("CFSR 0x%08X %s\n" % (rec["cfsr"], bit_names(rec["cfsr"], CFSR_BITS)))
+    out.write("HFSR 0x%08X %s\n" % (rec["hfsr"], bit_names(rec["hfsr"], HFSR_BITS)))
+    if rec["cfsr"] & MMARVALID:
+        out.write("MMFAR 0x%08X\n" % rec["mmfar"])
+    if rec["cfsr"] & BFARVALID:
+        out.write("BFAR 0x%08X\n" % rec["bfar"])
+
+    words = min(rec["stackWords"], len(rec["stack"]))
+    out.write("Stack (%u words from SP):\n" % words)
+    for i in range(words):
+        w = rec["stack"][i]
+        note = sym(w) if code_addr(w) else ""
+        out.write("  0x%08X: %08X%s\n" % (rec["sp"] + 4 * i, w, note))
+
+    log = rec["log"][:min(rec["logLen"], len(rec["log"]))]
+    out.write("Log (last %u bytes):\n" % len(log))
+    if elf and b"\xfe" in log:
+        sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+        import log_decode  # pylint: disable=import-outside-toplevel
+        try:
+            fmt = log_decode.load_fmt_section(elf)
+        except SystemExit:
+            fmt = None
+        if fmt is not None:
+            # The snapshot may start inside a frame; the decoder resyncs.
+            log_decode.Decoder(fmt, out).feed(log)
+            out.write("\n")
+            return
+    out.write(log.decode(errors="replace").replace("\r\n", "\n"))
+    out.write("\n")
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Decode a Mini ECU \"crash raw\" dump.")
+    ap.add_argument("input", nargs="?", help="console capture with the dump (default: stdin)")
+    ap.add_argument("--elf", help="firmware ELF, to name code addresses and decode tokenized logs")
+    ap.add_argument("--stack-words", type=int, default=32, help="CRASH_DUMP_STACK_WORDS")
+    ap.add_argument("--log-bytes", type=int, default=512, help="CRASH_DUMP_LOG_BYTES")
+    args = ap.parse_args()
+
+    if args.input:
+        with open(args.input, "r", errors="replace") as f:
+            data = read_record(f)
+    else:
+        data = read_record(sys.stdin)
+
+    rec = unpack(data, args.stack_words, args.log_bytes)
+    if rec["magic"] != MAGIC:
+        raise SystemExit("bad magic 0x%08x" % rec["magic"])
+    if rec["version"] != VERSION:
+        raise SystemExit("record version %u, this tool reads %u" % (rec["version"], VERSION))
+    if not rec["checkOk"]:
+        print("warning: check word mismatch, the record may be damaged", file=sys.stderr)
+
+    report(rec, Symbols(args.elf) if args.elf else None, args.elf, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,789 @@
+#!/usr/bin/env python3
+"""
+dbc_gen.py - Generate CAN signal pack/unpack code from a DBC file.
+
+Reads the messages (BO_) and signals (SG_) of a DBC file and writes a C
+header with, per message:
+  - its identifier (CAN_IF_ID_EXT set for 29-bit IDs) and DLC,
+  - per-signal scale, offset and range constants,
+  - a struct of physical values (float, or an integer type for signals with
+    factor 1 and offset 0),
+  - static inline Pack/Unpack functions. Each payload byte is a single
+    expression of shifts and masks computed here, so the functions have
+    no loops or branches and inline into the caller,
+  - for a message with scaled signals, a struct of the raw integers with
+    ToRaw (physical to raw, rounded as Pack) and PackRaw/UnpackRaw, which
+    move raw values without floating point (tasks that keep off the FPU,
+    rtos_fpu.h),
+  - for C++17, the non-multiplexed messages once more as cansig::Frame
+    layouts of can_signal.hpp, whose static_asserts repeat the layout
+    checks in the compiler ("make hpp-check").
+
+Everything that can be checked before the C compiler runs is checked here
+and stops the build: signals that overlap or do not fit the DLC, ranges
+that the raw width or sign cannot hold, duplicate IDs or names. The header
+adds static asserts for the raw limits so a hand edit cannot drift.
+
+Supported: little-endian (@1) and big-endian (@0) signals of 1..32 bits
+at any bit position, signed and unsigned, comments (CM_ BO_ / CM_ SG_)
+and simple multiplexing: one selector signal (M) per message and signal
+groups (m0, m1, ...) that share the payload bits left over by the
+ungrouped signals. Pack writes the group the selector names, Unpack
+decodes the selector and then only that group, through one switch on the
+selector (a jump table for dense values). Extended multiplexing (mNM)
+and value tables are rejected or ignored.
+
+Physical to raw conversion rounds to nearest (copysignf, no branch), so a
+decoded value packs back to the same raw value for any factor.
+
+A message of more than 8 bytes is a CAN FD frame: its size must be one of
+the FD payload lengths (12, 16, 20, 24, 32, 48, 64), and it needs
+CAN_IF_FD and an FD controller (can_if.h). Pack and Unpack are the same
+byte expressions at any length; the cansig::Frame layouts cover the
+classic messages only.
+
+Usage:
+    dbc_gen.py Core/mini_ecu.dbc -o Core/Inc/can_signals.h
+    dbc_gen.py Core/mini_ecu.dbc --check -o Core/Inc/can_signals.h
+
+Only the Python standard library is needed.
+"""
+
+import argparse
+import fractions
+import os
+import re
+import sys
+
+ID_EXT = 0x80000000
+CLASSIC_DLEN = 8
+FD_LENGTHS = tuple(range(CLASSIC_DLEN + 1)) + (12, 16, 20, 24, 32, 48, 64)
+
+BO_RE = re.compile(r"^BO_\s+(\d+)\s+(\w+)\s*:\s*(\d+)\s+(\w+)")
+SG_RE = re.compile(r"^SG_\s+(\w+)\s*(\S*)\s*:\s*(\d+)\|(\d+)@([01])([+-])\s*"
+                   r"\(\s*([^,]+),\s*([^)]+)\)\s*\[\s*([^|]+)\|([^\]]+)\]\s*\"([^\"]*)\"")
+CM_RE = re.compile(r"^CM_\s+(BO_|SG_)\s+(\d+)\s+(?:(\w+)\s+)?\"([^\"]*)\"\s*;")
+
+
+class Signal(object):
+    def __init__(self, name, start, length, little, signed, factor, offset, lo, hi, unit):
+        self.name = name
+        self.start = start
+        self.length = length
+        self.little = little
+        self.signed = signed
+        self.factor = factor
+        self.offset = offset
+        self.lo = lo
+        self.hi = hi
+        self.unit = unit
+        self.comment = ""
+        self.mux = None         # None, "M" for the selector, or a group value
+
+    def bits(self):
+        """Payload bit (byte * 8 + bit) of each raw bit, LSB first."""
+        if self.little:
+            return [self.start + i for i in range(self.length)]
+
+        # Big-endian: start is the MSB, counting down within a byte and
+        # continuing at bit 7 of the next byte.
+        seq, pos = [], self.start
+        for _ in range(self.length):
+            seq.append(pos)
+            pos = pos + 15 if pos % 8 == 0 else pos - 1
+        return list(reversed(seq))
+
+    def is_integer(self):
+        return (self.factor == 1.0 and self.offset == 0.0
+                and self.lo == int(self.lo) and self.hi == int(self.hi))
+
+
+class Message(object):
+    def __init__(self, can_id, name, dlc):
+        self.can_id = can_id
+        self.name = name
+        self.dlc = dlc
+        self.signals = []
+        self.comment = ""
+
+    def selector(self):
+        return next((s for s in self.signals if s.mux == "M"), None)
+
+    def groups(self):
+        """Group values of a multiplexed message, ascending."""
+        return sorted(set(s.mux for s in self.signals if isinstance(s.mux, int)))
+
+    def plain(self):
+        """Signals outside any group, the selector included."""
+        return [s for s in self.signals if not isinstance(s.mux, int)]
+
+    def group(self, value):
+        return [s for s in self.signals if s.mux == value]
+
+
+# ---------------------------------------------------------------------------
+# DBC
+# ---------------------------------------------------------------------------
+
+def fail(path, line, msg):
+    raise SystemExit("%s:%s: %s" % (path, line, msg))
+
+
+def parse(path):
+    messages, current = [], None
+
+    with open(path) as f:
+        lines = f.read().splitlines()
+
+    for n, raw in enumerate(lines, 1):
+        line = raw.strip()
+
+        m = BO_RE.match(line)
+        if m:
+            can_id = int(m.group(1))
+            if can_id & ID_EXT:
+                can_id = ID_EXT | (can_id & 0x1FFFFFFF)
+            elif can_id > 0x7FF:
+                fail(path, n, "standard ID 0x%X above 0x7FF" % can_id)
+            current = Message(can_id, m.group(2), int(m.group(3)))
+            if current.dlc not in FD_LENGTHS:
+                fail(path, n, "%s: %u bytes, not a CAN FD payload length (0..8, %s)"
+                     % (current.name, current.dlc,
+                        ", ".join(str(x) for x in FD_LENGTHS[CLASSIC_DLEN + 1:])))
+            messages.append(current)
+            continue
+
+        if line.startswith("SG_"):
+            m = SG_RE.match(line)
+            if not m:
+                fail(path, n, "cannot parse signal: %s" % line)
+            if current is None:
+                fail(path, n, "signal outside a message")
+            sig = Signal(m.group(1), int(m.group(3)), int(m.group(4)),
+                         m.group(5) == "1", m.group(6) == "-",
+                         float(m.group(7)), float(m.group(8)),
+                         float(m.group(9)), float(m.group(10)), m.group(11))
+            sig.mux = parse_mux(path, n, sig.name, m.group(2))
+            check_signal(path, n, current, sig)
+            current.signals.append(sig)
+            continue
+
+        m = CM_RE.match(line)
+        if m:
+            can_id = int(m.group(2))
+            if can_id & ID_EXT:
+                can_id = ID_EXT | (can_id & 0x1FFFFFFF)
+            msg = next((x for x in messages if x.can_id == can_id), None)
+            if msg is None:
+                fail(path, n, "comment for unknown message %u" % can_id)
+            if m.group(1) == "BO_":
+                msg.comment = m.group(4)
+            else:
+                sig = next((s for s in msg.signals if s.name == m.group(3)), None)
+                if sig is None:
+                    fail(path, n, "comment for unknown signal %s" % m.group(3))
+                sig.comment = m.group(4)
+            continue
+
+        if line and not line.startswith(("VERSION", "NS_", "BS_", "BU_", "VAL_", "BA_")) \
+                and raw[:1] not in (" ", "\t"):
+            current = None
+
+    check_messages(path, messages)
+    return messages
+
+
+def parse_mux(path, n, name, text):
+    if not text:
+        return None
+    if text == "M":
+        return "M"
+    m = re.match(r"^m(\d+)$", text)
+    if not m:
+        fail(path, n, "%s: multiplexer \"%s\" not supported (only M and m<n>)" % (name, text))
+    return int(m.group(1))
+
+
+def raw_limits(sig):
+    if sig.signed:
+        return -(1 << (sig.length - 1)), (1 << (sig.length - 1)) - 1
+    return 0, (1 << sig.length) - 1
+
+
+def to_raw(sig, value):
+    return (value - sig.offset) / sig.factor
+
+
+def check_signal(path, n, msg, sig):
+    if not 1 <= sig.length <= 32:
+        fail(path, n, "%s: %u bits, only 1..32 are supported" % (sig.name, sig.length))
+    if sig.factor == 0.0:
+        fail(path, n, "%s: factor 0" % sig.name)
+
+    bits = sig.bits()
+    if min(bits) < 0 or max(bits) >= msg.dlc * 8:
+        fail(path, n, "%s: does not fit the %u byte payload of %s"
+             % (sig.name, msg.dlc, msg.name))
+
+    for other in msg.signals:
+        if other.name == sig.name:
+            fail(path, n, "%s: defined twice in %s" % (sig.name, msg.name))
+        # Signals of different groups are never in the same frame.
+        if isinstance(sig.mux, int) and isinstance(other.mux, int) and sig.mux != other.mux:
+            continue
+        if set(bits) & set(other.bits()):
+            fail(path, n, "%s overlaps %s in %s" % (sig.name, other.name, msg.name))
+
+    if sig.mux == "M":
+        if msg.selector() is not None:
+            fail(path, n, "%s: second multiplexer in %s" % (sig.name, msg.name))
+        if sig.signed or not sig.is_integer():
+            fail(path, n, "%s: a multiplexer must be unsigned with factor 1, offset 0" % sig.name)
+    elif isinstance(sig.mux, int) and sig.mux > 0xFFFFFFFF:
+        fail(path, n, "%s: group %u above 32 bits" % (sig.name, sig.mux))
+
+    # [0|0] is the DBC way of saying "no range".
+    if sig.lo == 0.0 and sig.hi == 0.0:
+        return
+    if sig.lo > sig.hi:
+        fail(path, n, "%s: minimum above maximum" % sig.name)
+
+    lo, hi = raw_limits(sig)
+    eps = 1e-6 * max(1.0, abs(lo), abs(hi))
+    for value in (sig.lo, sig.hi):
+        r = to_raw(sig, value)
+        if r < lo - eps or r > hi + eps:
+            fail(path, n, "%s: %g %s is raw %g, outside %d..%d of a %u-bit %s signal"
+                 % (sig.name, value, sig.unit, r, lo, hi, sig.length,
+                    "signed" if sig.signed else "unsigned"))
+
+
+def check_messages(path, messages):
+    seen_id, seen_name = {}, {}
+    for msg in messages:
+        if msg.can_id in seen_id:
+            fail(path, "-", "%s and %s share ID 0x%X" % (seen_id[msg.can_id], msg.name, msg.can_id))
+        if msg.name in seen_name:
+            fail(path, "-", "message %s defined twice" % msg.name)
+        seen_id[msg.can_id] = msg.name
+        seen_name[msg.name] = msg
+
+        sel = msg.selector()
+        groups = msg.groups()
+        if groups and sel is None:
+            fail(path, "-", "%s: multiplexed signals without a multiplexer (M)" % msg.name)
+        if sel is not None and not groups:
+            fail(path, "-", "%s: multiplexer %s without multiplexed signals" % (msg.name, sel.name))
+        if sel is not None and groups[-1] > raw_limits(sel)[1]:
+            fail(path, "-", "%s: group %u does not fit the %u-bit multiplexer %s"
+                 % (msg.name, groups[-1], sel.length, sel.name))
+
+
+# ---------------------------------------------------------------------------
+# C output
+# ---------------------------------------------------------------------------
+
+def upper(name):
+    return re.sub(r"(?<=[a-z0-9])(?=[A-Z])", "_", name).upper()
+
+
+def c_float(value):
+    text = "%.9g" % value
+    if not re.search(r"[.eE]", text):
+        text += ".0"
+    return text + "f"
+
+
+def c_int_type(sig):
+    width = 8 if sig.length <= 8 else 16 if sig.length <= 16 else 32
+    return ("int%u_t" if sig.signed else "uint%u_t") % width
+
+
+def phys_type(sig):
+    return c_int_type(sig) if sig.is_integer() else "float"
+
+
+def pieces(sig):
+    """(byte, bit in byte, first raw bit, count) runs of one signal."""
+    runs = []
+    for i, pos in enumerate(sig.bits()):
+        byte, bit = divmod(pos, 8)
+        if runs and runs[-1][0] == byte and runs[-1][1] + runs[-1][3] == bit \
+                and runs[-1][2] + runs[-1][3] == i:
+            b, p, r, c = runs[-1]
+            runs[-1] = (b, p, r, c + 1)
+        else:
+            runs.append((byte, bit, i, 1))
+    return runs
+
+
+def pack_term(sig, bit, first, count):
+    expr = sig.name
+    if first:
+        expr = "(%s >> %u)" % (expr, first)
+    # Raw bits above the run would land inside this byte: mask them off.
+    if first + count < sig.length and bit + count < 8:
+        expr = "(%s & 0x%XU)" % (expr, (1 << count) - 1)
+    if bit:
+        expr = "(%s << %u)" % (expr, bit)
+    return expr
+
+
+def unpack_term(byte, bit, first, count):
+    expr = "(uint32_t)data[%u]" % byte
+    if bit:
+        expr = "(%s >> %u)" % (expr, bit)
+    if bit + count < 8:
+        expr = "(%s & 0x%XU)" % (expr, (1 << count) - 1)
+    if first:
+        expr = "(%s << %u)" % (expr, first)
+    return expr
+
+
+def emit_message(out, msg):
+    P = "CANSIG_" + upper(msg.name)
+    T = "CanSig_%s_t" % msg.name
+    name_w = max([len(s.name) for s in msg.signals] + [1])
+
+    out.append("/* " + ("-" * 74) + " */")
+    title = "%s (0x%X%s, %u bytes%s)" % (msg.name, msg.can_id & 0x1FFFFFFF,
+                                         " ext" if msg.can_id & ID_EXT else "", msg.dlc,
+                                         ", FD" if msg.dlc > CLASSIC_DLEN else "")
+    out.append("/* %-74s */" % title)
+    out.append("/* " + ("-" * 74) + " */")
+    out.append("")
+    if msg.comment:
+        out.append("/* %s */" % msg.comment)
+    sel = msg.selector()
+    def_w = max([len(P) + len(upper(s.name)) + 9 for s in msg.signals] +
+                [len(P) + (12 if sel is not None else 4)])
+
+    def define(name, value):
+        out.append("#define %-*s %s" % (def_w, name, value))
+
+    define(P + "_ID", "0x%XU" % msg.can_id)
+    define(P + "_DLC", "%uU" % msg.dlc)
+    if sel is not None:
+        define(P + "_GROUP_COUNT", "%uU" % len(msg.groups()))
+        define(P + "_GROUP_MAX", "%uU" % msg.groups()[-1])
+    out.append("")
+
+    for sig in msg.signals:
+        S = "%s_%s" % (P, upper(sig.name))
+        lo, hi = raw_limits(sig)
+        desc = "%u-bit %s, %s from bit %u" % (sig.length, "signed" if sig.signed else "unsigned",
+                                             "LE" if sig.little else "BE", sig.start)
+        if sig.mux == "M":
+            desc += ", multiplexer"
+        elif sig.mux is not None:
+            desc += ", group %u" % sig.mux
+        out.append("/* %s: %s%s */" % (sig.name, (sig.comment + ", ") if sig.comment else "", desc))
+        if not sig.is_integer():
+            define(S + "_FACTOR", c_float(sig.factor))
+            define(S + "_SCALE", c_float(1.0 / sig.factor))
+            define(S + "_OFFSET", c_float(sig.offset))
+        if not (sig.lo == 0.0 and sig.hi == 0.0):
+            define(S + "_MIN", c_float(sig.lo))
+            define(S + "_MAX", c_float(sig.hi))
+        define(S + "_RAW_MIN", "(%d)" % lo)
+        define(S + "_RAW_MAX", "(%d%s)" % (hi, "" if sig.signed else "U"))
+        out.append("")
+
+    for sig in msg.signals:
+        S = "%s_%s" % (P, upper(sig.name))
+        lo, hi = raw_limits(sig)
+        out.append("CANSIG_STATIC_ASSERT((%s_RAW_MIN == %d) &&" % (S, lo))
+        out.append("                     (%s_RAW_MAX == 0x%X%s)," % (S, hi, "" if sig.signed else "U"))
+        out.append("                     \"%s.%s: raw range does not match %u bits\");"
+                   % (msg.name, sig.name, sig.length))
+    if msg.signals:
+        out.append("")
+
+    out.append("typedef struct")
+    out.append("{")
+    type_w = max([len(phys_type(s)) for s in msg.signals] + [1])
+    for sig in msg.signals:
+        field = "%-*s %s;" % (type_w, phys_type(sig), sig.name)
+        note = sig.unit or "-"
+        if not (sig.lo == 0.0 and sig.hi == 0.0):
+            note += ", %g .. %g" % (sig.lo, sig.hi)
+        if isinstance(sig.mux, int):
+            note += ", group %u" % sig.mux
+        out.append("    %-*s /**< %s */" % (type_w + name_w + 2, field, note))
+    if not msg.signals:
+        out.append("    uint8_t unused;")
+    out.append("} %s;" % T)
+    out.append("")
+
+    if msg.selector() is None:
+        emit_pack(out, msg, P, T, name_w)
+        emit_unpack(out, msg, P, T, name_w)
+    else:
+        emit_mux_pack(out, msg, P, T, name_w)
+        emit_mux_unpack(out, msg, P, T, name_w)
+    if has_scaled(msg):
+        emit_raw(out, msg, P, T, name_w)
+
+
+def has_scaled(msg):
+    return any(not s.is_integer() for s in msg.signals)
+
+
+def to_raw_expr(P, sig):
+    """Raw value of physical m->sig, rounded to nearest, not masked."""
+    S = "%s_%s" % (P, upper(sig.name))
+    value = "m->%s" % sig.name
+    if sig.is_integer():
+        return "(uint32_t)%s(%s)" % ("(int32_t)" if sig.signed else "", value)
+    if sig.offset != 0.0:
+        value = "(%s - %s_OFFSET)" % (value, S)
+    value = "%s * %s_SCALE" % (value, S)
+    if sig.signed:
+        return "(uint32_t)cansig_round(%s)" % value
+    return "(uint32_t)(%s + 0.5f)" % value
+
+
+def pack_raw(out, P, sigs, name_w, ind, as_raw=False):
+    """Raw value of each signal of @p sigs from m->, masked to its width;
+    with @p as_raw the fields already hold raw values."""
+    for sig in sigs:
+        mask = "" if sig.length == 32 else " & 0x%XU" % ((1 << sig.length) - 1)
+        if as_raw:
+            value = "(uint32_t)%s(m->%s)" % ("(int32_t)" if sig.signed else "", sig.name)
+        else:
+            value = to_raw_expr(P, sig)
+        line = "%suint32_t %-*s = %s%s;" % (ind, name_w, sig.name, value, mask)
+        if len(line) > 100:
+            line = "%suint32_t %s =\n%s    %s%s;" % (ind, sig.name, ind, value, mask)
+        out.append(line)
+
+
+def pack_bytes(out, sigs, dlc, ind):
+    """One store per payload byte, ORing the runs of @p sigs in it."""
+    for byte in range(dlc):
+        terms = []
+        for sig in sigs:
+            for b, bit, first, count in pieces(sig):
+                if b == byte:
+                    terms.append(pack_term(sig, bit, first, count))
+        if not terms:
+            value = "0U"
+        elif len(terms) == 1 and terms[0].startswith("("):
+            value = "(uint8_t)" + terms[0]
+        else:
+            value = "(uint8_t)(" + " | ".join(terms) + ")"
+        out.append("%sdata[%u] = %s;" % (ind, byte, value))
+
+
+def unpack_raw(out, sigs, name_w, ind):
+    for sig in sigs:
+        terms = [unpack_term(b, bit, first, count) for b, bit, first, count in pieces(sig)]
+        line = "%suint32_t %-*s = %s;" % (ind, name_w, sig.name, " | ".join(terms))
+        if len(line) > 100:
+            line = "%suint32_t %-*s = %s;" % (ind, name_w, sig.name,
+                                             (" |\n%*s" % (len(ind) + name_w + 12, "")).join(terms))
+        out.append(line)
+
+
+def unpack_assign(out, P, sigs, name_w, ind, as_raw=False):
+    for sig in sigs:
+        S = "%s_%s" % (P, upper(sig.name))
+        raw = sig.name
+        if sig.signed and sig.length < 32:
+            sign = "0x%XU" % (1 << (sig.length - 1))
+            raw = "(int32_t)((%s ^ %s) - %s)" % (sig.name, sign, sign)
+        elif sig.signed:
+            raw = "(int32_t)%s" % sig.name
+        if sig.is_integer() or as_raw:
+            value = "(%s)%s" % (c_int_type(sig) if as_raw else phys_type(sig), raw)
+        else:
+            value = "(float)%s * %s_FACTOR" % (raw, S)
+            if sig.offset != 0.0:
+                value += " + %s_OFFSET" % S
+        line = "%sm->%-*s = %s;" % (ind, name_w, sig.name, value)
+        if len(line) > 100 and " * " in value:
+            head, tail = value.split(" * ", 1)
+            line = "%sm->%-*s = %s *\n%*s%s;" % (ind, name_w, sig.name, head,
+                                                len(ind) + name_w + 6, "", tail)
+        out.append(line)
+
+
+def emit_pack(out, msg, P, T, name_w, as_raw=False):
+    sfx = "Raw" if as_raw else ""
+    out.append("/** Encode %s@p m into the first %s bytes of @p data. */"
+               % ("raw " if as_raw else "", P + "_DLC"))
+    out.append("static inline void CanSig_%s_Pack%s(uint8_t *data, const %s *m)" % (msg.name, sfx, T))
+    out.append("{")
+    pack_raw(out, P, msg.signals, name_w, "    ", as_raw)
+    if msg.signals:
+        out.append("")
+    pack_bytes(out, msg.signals, msg.dlc, "    ")
+    out.append("}")
+    out.append("")
+
+
+def emit_unpack(out, msg, P, T, name_w, as_raw=False):
+    sfx = "Raw" if as_raw else ""
+    out.append("/** Decode @p data (at least %s bytes) into %s@p m. */"
+               % (P + "_DLC", "raw " if as_raw else ""))
+    out.append("static inline void CanSig_%s_Unpack%s(const uint8_t *data, %s *m)" % (msg.name, sfx, T))
+    out.append("{")
+    if not msg.signals:
+        out.append("    (void)data;")
+        out.append("    (void)m;")
+    unpack_raw(out, msg.signals, name_w, "    ")
+    if msg.signals:
+        out.append("")
+    unpack_assign(out, P, msg.signals, name_w, "    ", as_raw)
+    out.append("}")
+    out.append("")
+
+
+def emit_mux_pack(out, msg, P, T, name_w, as_raw=False):
+    sel = msg.selector()
+    plain = msg.plain()
+    sfx = "Raw" if as_raw else ""
+
+    out.append("/**")
+    out.append(" * @brief Encode %s@p m into the first %s bytes of @p data: the"
+               % ("raw " if as_raw else "", P + "_DLC"))
+    out.append(" *        ungrouped signals and the group m->%s selects." % sel.name)
+    out.append(" *")
+    out.append(" * @return 1, or 0 if %s selects no group (the rest is encoded)." % sel.name)
+    out.append(" */")
+    out.append("static inline uint8_t CanSig_%s_Pack%s(uint8_t *data, const %s *m)" % (msg.name, sfx, T))
+    out.append("{")
+    pack_raw(out, P, plain, name_w, "    ", as_raw)
+    out.append("")
+    out.append("    switch (%s)" % sel.name)
+    out.append("    {")
+    for value in msg.groups():
+        group = msg.group(value)
+        out.append("    case %uU:" % value)
+        out.append("    {")
+        pack_raw(out, P, group, name_w, "        ", as_raw)
+        out.append("")
+        pack_bytes(out, plain + group, msg.dlc, "        ")
+        out.append("        return 1U;")
+        out.append("    }")
+    out.append("    default:")
+    out.append("        break;")
+    out.append("    }")
+    out.append("")
+    pack_bytes(out, plain, msg.dlc, "    ")
+    out.append("    return 0U;")
+    out.append("}")
+    out.append("")
+
+
+def emit_mux_unpack(out, msg, P, T, name_w, as_raw=False):
+    sel = msg.selector()
+    plain = msg.plain()
+    sfx = "Raw" if as_raw else ""
+
+    out.append("/**")
+    out.append(" * @brief Decode @p data (at least %s bytes) into %s@p m: the"
+               % (P + "_DLC", "raw " if as_raw else ""))
+    out.append(" *        ungrouped signals and the group %s selects. The fields of" % sel.name)
+    out.append(" *        the other groups keep their values.")
+    out.append(" *")
+    out.append(" * @return 1, or 0 if %s selects no group." % sel.name)
+    out.append(" */")
+    out.append("static inline uint8_t CanSig_%s_Unpack%s(const uint8_t *data, %s *m)" % (msg.name, sfx, T))
+    out.append("{")
+    unpack_raw(out, plain, name_w, "    ")
+    out.append("")
+    unpack_assign(out, P, plain, name_w, "    ", as_raw)
+    out.append("")
+    out.append("    switch (%s)" % sel.name)
+    out.append("    {")
+    for value in msg.groups():
+        group = msg.group(value)
+        out.append("    case %uU:" % value)
+        out.append("    {")
+        unpack_raw(out, group, name_w, "        ")
+        out.append("")
+        unpack_assign(out, P, group, name_w, "        ", as_raw)
+        out.append("        return 1U;")
+        out.append("    }")
+    out.append("    default:")
+    out.append("        return 0U;")
+    out.append("    }")
+    out.append("}")
+    out.append("")
+
+
+def emit_raw(out, msg, P, T, name_w):
+    """Raw struct, ToRaw and the PackRaw/UnpackRaw pair of a scaled message."""
+    R = "CanSig_%s_Raw_t" % msg.name
+    type_w = max(len(c_int_type(s)) for s in msg.signals)
+
+    out.append("/** Raw values of %s, as on the bus. */" % msg.name)
+    out.append("typedef struct")
+    out.append("{")
+    for sig in msg.signals:
+        field = "%-*s %s;" % (type_w, c_int_type(sig), sig.name)
+        note = "raw"
+        if not sig.is_integer():
+            note = "x %s_%s_FACTOR" % (P, upper(sig.name))
+            if sig.offset != 0.0:
+                note += " + OFFSET"
+        if isinstance(sig.mux, int):
+            note += ", group %u" % sig.mux
+        out.append("    %-*s /**< %s */" % (type_w + name_w + 2, field, note))
+    out.append("} %s;" % R)
+    out.append("")
+
+    out.append("/** Raw values of @p m, rounded as %s_Pack() rounds them. */" % ("CanSig_" + msg.name))
+    head = "static inline void CanSig_%s_ToRaw(" % msg.name
+    out.append("%sconst %s *m,\n%*s%s *r)" % (head, T, len(head), "", R))
+    out.append("{")
+    for sig in msg.signals:
+        if sig.is_integer():
+            value = "m->%s" % sig.name
+        elif sig.signed:
+            value = "(%s)%s" % (c_int_type(sig), to_raw_expr(P, sig)[len("(uint32_t)"):])
+        elif c_int_type(sig) == "uint32_t":
+            value = to_raw_expr(P, sig)
+        else:
+            value = "(%s)%s" % (c_int_type(sig), to_raw_expr(P, sig))
+        line = "    r->%-*s = %s;" % (name_w, sig.name, value)
+        if len(line) > 100:
+            line = "    r->%s =\n        %s;" % (sig.name, value)
+        out.append(line)
+    out.append("}")
+    out.append("")
+
+    if msg.selector() is None:
+        emit_pack(out, msg, P, R, name_w, True)
+        emit_unpack(out, msg, P, R, name_w, True)
+    else:
+        emit_mux_pack(out, msg, P, R, name_w, True)
+        emit_mux_unpack(out, msg, P, R, name_w, True)
+
+
+def cpp_ratio(value):
+    q = fractions.Fraction(repr(float(value)))
+    if q.denominator == 1:
+        return "std::ratio<%d>" % q.numerator
+    return "std::ratio<%d, %d>" % (q.numerator, q.denominator)
+
+
+def emit_cpp(out, messages):
+    """cansig::Frame layouts (can_signal.hpp) of the non-multiplexed classic messages."""
+    out.append("")
+    out.append("#if defined(__cplusplus) && (__cplusplus >= 201703L)")
+    out.append("")
+    out.append("#include \"can_signal.hpp\"")
+    out.append("")
+    out.append("namespace cansig")
+    out.append("{")
+    for msg in messages:
+        if msg.selector() is not None or msg.dlc > CLASSIC_DLEN:
+            continue
+        out.append("")
+        out.append("/** %s (0x%X), the layout of CanSig_%s_Pack(). */"
+                   % (msg.name, msg.can_id & ~ID_EXT, msg.name))
+        out.append("struct %s : Frame<CANSIG_%s_DLC," % (msg.name, upper(msg.name)))
+        for i, sig in enumerate(msg.signals):
+            args = ["%uU" % sig.start, "%uU" % sig.length,
+                    "ByteOrder::Intel" if sig.little else "ByteOrder::Motorola",
+                    "true" if sig.signed else "false",
+                    cpp_ratio(sig.factor), cpp_ratio(sig.offset),
+                    cpp_ratio(sig.lo), cpp_ratio(sig.hi)]
+            end = ">" if i == len(msg.signals) - 1 else ","
+            out.append("    Signal<%s>%s" % (", ".join(args), end))
+        out.append("{")
+        out.append("    enum Sig : std::size_t { %s };" % ", ".join(s.name for s in msg.signals))
+        out.append("};")
+    out.append("")
+    out.append("} /* namespace cansig */")
+    out.append("")
+    out.append("#endif /* __cplusplus >= 201703L */")
+
+
+def generate(messages, dbc_path):
+    out = []
+    out.append("/**")
+    out.append(" * @file    can_signals.h")
+    out.append(" * @brief   CAN signal pack/unpack generated from %s." % os.path.basename(dbc_path))
+    out.append(" *")
+    out.append(" * GENERATED by tools/dbc_gen.py - do not edit. Change the DBC file and run")
+    out.append(" * \"make dbc\".")
+    out.append(" *")
+    out.append(" * Pack converts physical values to raw with a constant multiply, rounded")
+    out.append(" * to nearest; Unpack multiplies by the factor. Values outside a signal's")
+    out.append(" * _MIN/_MAX are not clamped.")
+    out.append(" *")
+    out.append(" * A message with scaled signals also has a _Raw_t struct of the integers")
+    out.append(" * on the bus: ToRaw rounds a physical struct into it once, PackRaw and")
+    out.append(" * UnpackRaw move it without floating point (rtos_fpu.h).")
+    if any(m.selector() is not None for m in messages):
+        out.append(" *")
+        out.append(" * A multiplexed message has one struct for all its groups; Pack and Unpack")
+        out.append(" * switch once on the selector and handle only the group it names.")
+    out.append(" */")
+    out.append("")
+    out.append("#ifndef CAN_SIGNALS_H")
+    out.append("#define CAN_SIGNALS_H")
+    out.append("")
+    rounds = any(s.signed and not s.is_integer() for m in messages for s in m.signals)
+    if rounds:
+        out.append("#include <math.h>")
+    out.append("#include <stdint.h>")
+    out.append("")
+    out.append("#ifdef __cplusplus")
+    out.append("extern \"C\" {")
+    out.append("#define CANSIG_STATIC_ASSERT(cond, msg)     static_assert(cond, msg)")
+    out.append("#else")
+    out.append("#define CANSIG_STATIC_ASSERT(cond, msg)     _Static_assert(cond, msg)")
+    out.append("#endif")
+    out.append("")
+    if rounds:
+        out.append("/** Round to nearest, halves away from zero, without a branch. */")
+        out.append("static inline int32_t cansig_round(float v)")
+        out.append("{")
+        out.append("    return (int32_t)(v + copysignf(0.5f, v));")
+        out.append("}")
+        out.append("")
+    for msg in messages:
+        emit_message(out, msg)
+    out.append("#ifdef __cplusplus")
+    out.append("}")
+    out.append("#endif")
+    emit_cpp(out, messages)
+    out.append("")
+    out.append("#endif /* CAN_SIGNALS_H */")
+    return "\n".join(out) + "\n"
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Generate CAN pack/unpack code from a DBC file.")
+    ap.add_argument("dbc", help="DBC file")
+    ap.add_argument("-o", "--output", required=True, help="header to write")
+    ap.add_argument("--check", action="store_true",
+                    help="only verify that the header is up to date")
+    args = ap.parse_args()
+
+    messages = parse(args.dbc)
+    text = generate(messages, args.dbc)
+
+    if args.check:
+        try:
+            with open(args.output) as f:
+                current = f.read()
+        except IOError:
+            current = None
+        if current != text:
+            print("%s: out of date with %s, run \"make dbc\"" % (args.output, args.dbc))
+            sys.exit(1)
+        print("%s: up to date" % args.output)
+        return
+
+    with open(args.output, "w") as f:
+        f.write(text)
+    print("%s: %u messages from %s" % (args.output, len(messages), args.dbc))
+
+
+if __name__ == "__main__":
+    main()
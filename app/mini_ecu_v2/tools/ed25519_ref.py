@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""
+ed25519_ref.py - Ed25519 (RFC 8032) in plain Python for image signing.
+
+The bootloader only verifies (boot_ed25519.c); image_stamp.py signs with
+this module so no crypto package has to be installed:
+
+    seed = ed25519_ref.new_seed()                 # 32 random bytes
+    key = ed25519_ref.public_key(seed)
+    sig = ed25519_ref.sign(seed, message)
+    assert ed25519_ref.verify(key, message, sig)
+
+Extended coordinates on Python integers; signing a 256 KB image takes
+well under a second, most of it in hashlib.sha512. Variable time
+throughout: fine on a build machine, not for a device holding a key.
+
+    ed25519_ref.py --selftest      # RFC 8032 section 7.1 test vectors
+"""
+
+import hashlib
+import os
+import sys
+
+P = 2 ** 255 - 19
+L = 2 ** 252 + 27742317777372353535851937790883648493
+D = -121665 * pow(121666, P - 2, P) % P
+SQRT_M1 = pow(2, (P - 1) // 4, P)
+
+
+def _add(a, b):
+    x1, y1, z1, t1 = a
+    x2, y2, z2, t2 = b
+    pa = (y1 - x1) * (y2 - x2) % P
+    pb = (y1 + x1) * (y2 + x2) % P
+    pc = 2 * D * t1 * t2 % P
+    pd = 2 * z1 * z2 % P
+    e, f, g, h = pb - pa, pd - pc, pd + pc, pb + pa
+    return (e * f % P, g * h % P, f * g % P, e * h % P)
+
+
+def _mul(s, pt):
+    q = (0, 1, 1, 0)
+    while s:
+        if s & 1:
+            q = _add(q, pt)
+        pt = _add(pt, pt)
+        s >>= 1
+    return q
+
+
+def _encode(pt):
+    x, y, z, _ = pt
+    zi = pow(z, P - 2, P)
+    x, y = x * zi % P, y * zi % P
+    return (y | ((x & 1) << 255)).to_bytes(32, "little")
+
+
+def _decode(s):
+    if len(s) != 32:
+        return None
+    y = int.from_bytes(s, "little")
+    sign, y = y >> 255, y & ((1 << 255) - 1)
+    if y >= P:
+        return None
+    xx = (y * y - 1) * pow(D * y * y + 1, P - 2, P) % P
+    x = pow(xx, (P + 3) // 8, P)
+    if (x * x - xx) % P:
+        x = x * SQRT_M1 % P
+    if (x * x - xx) % P or (x == 0 and sign):
+        return None
+    if (x & 1) != sign:
+        x = P - x
+    return (x, y, 1, x * y % P)
+
+
+_BY = 4 * pow(5, P - 2, P) % P
+B = _decode(_BY.to_bytes(32, "little"))
+
+
+def _h(*parts):
+    return int.from_bytes(hashlib.sha512(b"".join(parts)).digest(), "little")
+
+
+def _expand(seed):
+    d = hashlib.sha512(seed).digest()
+    a = int.from_bytes(d[:32], "little")
+    a &= (1 << 254) - 8
+    a |= 1 << 254
+    return a, d[32:]
+
+
+def new_seed():
+    return os.urandom(32)
+
+
+def public_key(seed):
+    return _encode(_mul(_expand(seed)[0], B))
+
+
+def sign(seed, message):
+    a, prefix = _expand(seed)
+    key = _encode(_mul(a, B))
+    r = _h(prefix, message) % L
+    rb = _encode(_mul(r, B))
+    s = (r + _h(rb, key, message) * a) % L
+    return rb + s.to_bytes(32, "little")
+
+
+def verify(key, message, sig):
+    a = _decode(key)
+    if a is None or len(sig) != 64:
+        return False
+    s = int.from_bytes(sig[32:], "little")
+    if s >= L:
+        return False
+    r = _decode(sig[:32])
+    if r is None:
+        return False
+    k = _h(sig[:32], key, message) % L
+    return _encode(_mul(s, B)) == _encode(_add(r, _mul(k, a)))
+
+
+# RFC 8032 7.1, tests 1-3: secret key, public key, message, signature (hex).
+_VECTORS = [
+    ("9d61b19deffd5a60ba844af492ec2cc44449c5697b326919703bac031cae7f60",
+     "d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a", "",
+     "e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e06522490155"
+     "5fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b"),
+    ("4ccd089b28ff96da9db6c346ec114e0f5b8a319f35aba624da8cf6ed4fb8a6fb",
+     "3d4017c3e843895a92b70aa74d1b7ebc9c982ccf2ec4968cc0cd55f12af4660c", "72",
+     "92a009a9f0d4cab8720e820b5f642540a2b27b5416503f8fb3762223ebdb69da"
+     "085ac1e43e15996e458f3613d0f11d8c387b2eaeb4302aeeb00d291612bb0c00"),
+    ("c5aa8df43f9f837bedb7442f31dcb7b166d38535076f094b85ce3a2e0b4458f7",
+     "fc51cd8e6218a1a38da47ed00230f0580816ed13ba3303ac5deb911548908025", "af82",
+     "6291d657deec24024827e69c3abe01a30ce548a284743a445e3680d7db5ac3ac"
+     "18ff9b538d16f290ae67f760984dc6594a7c15e9716ed28dc027beceea1ec40a"),
+]
+
+
+def main():
+    if sys.argv[1:] != ["--selftest"]:
+        raise SystemExit(__doc__.strip())
+    for seed, key, msg, sig in _VECTORS:
+        seed, key, msg, sig = (bytes.fromhex(v) for v in (seed, key, msg, sig))
+        assert public_key(seed) == key
+        assert sign(seed, msg) == sig
+        assert verify(key, msg, sig)
+        assert not verify(key, msg + b"x", sig)
+    print("%u RFC 8032 vectors ok" % len(_VECTORS))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+"""
+fw_proxy.py - Flash the nodes on CAN2 through the Mini ECU's flashing proxy.
+
+The ECU side is described in Core/Inc/fw_proxy.h. The image goes to the ECU
+once, over the console RPC (cli_rpc.h: STAGE_BEGIN, STAGE_DATA, STAGE_END),
+into the slot it is not running from; the ECU checks it there and then
+updates the bootloaders on CAN2 itself, all nodes at once:
+
+    1. STAGE_BEGIN without a length names the slot; the image linked for it
+       is picked (the .bin or its _b sibling, as fw_update.py does),
+    2. STAGE_BEGIN, the image in STAGE_DATA pieces of --piece bytes (a full
+       ring is retried), STAGE_END until StageTask has verified it,
+    3. "fwp start <nodes> [req] [nogo]" through EXEC, then "fwp" until the
+       job is finished; its node table is printed at the end.
+
+A node is flashed only if its bootloader writes the slot the image was
+staged for: the nodes writing the other slot are skipped and need a second
+run with the other image of the pair. The ECU stages into the slot it is
+not running from (stage.h), so that run needs the ECU on its other slot.
+
+Usage:
+    fw_proxy.py --port /dev/ttyACM0 build/release/node.bin --nodes 0,1,2
+    fw_proxy.py --port /dev/ttyACM0 node.bin --nodes 0-7 --request
+    fw_proxy.py --port /dev/ttyACM0 node.bin --nodes 3 --no-go
+    fw_proxy.py --port /dev/ttyACM0 --status
+
+Needs pyserial.
+"""
+
+import argparse
+import os
+import struct
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import fw_update  # noqa: E402
+from cli_rpc import (EXEC, PING, STAGE_BEGIN, STAGE_DATA, STAGE_END, STATUS,  # noqa: E402
+                     Rpc, tlv, u32)
+
+REFUSED = 3
+
+
+def nodes_arg(text):
+    """"0,2,4-7" as the comma list "fwp start" takes."""
+    nodes = set()
+    for part in text.split(","):
+        lo, _, hi = part.partition("-")
+        nodes.update(range(int(lo), int(hi or lo) + 1))
+    if not nodes or min(nodes) < 0 or max(nodes) > 7:
+        raise argparse.ArgumentTypeError("nodes 0..7")
+    return ",".join(str(n) for n in sorted(nodes))
+
+
+def call(rpc, cmd, args=b"", retry_for=0.0):
+    """(status, tags); refused is retried for up to retry_for seconds."""
+    deadline = time.monotonic() + retry_for
+    while True:
+        status, tags = rpc.call(cmd, args)
+        if status != REFUSED or time.monotonic() >= deadline:
+            return status, tags
+        time.sleep(0.01)
+
+
+def exec_line(rpc, line):
+    status, tags = rpc.call(EXEC, tlv(1, line.encode()))
+    if status != 0:
+        raise SystemExit("fw_proxy: \"%s\": %s" % (line, STATUS.get(status, status)))
+    return b"".join(tags.get(1, [])).decode(errors="replace")
+
+
+def stage(rpc, path, piece, erase_timeout):
+    status, tags = rpc.call(STAGE_BEGIN)
+    if status != 0:
+        raise SystemExit("fw_proxy: STAGE_BEGIN: %s" % STATUS.get(status, status))
+    base = struct.unpack("<I", tags[1][0])[0]
+    path, slot = fw_update.slot_image(path, base)
+    image, version, crc = fw_update.load_image(path)
+    print("staging %s (%s, %u B, CRC 0x%08X) into slot %s at 0x%08X"
+          % (path, fw_update.version_str(version), len(image), crc, slot, base))
+
+    status, _ = call(rpc, STAGE_BEGIN, tlv(1, u32(len(image))), retry_for=5.0)
+    if status != 0:
+        raise SystemExit("fw_proxy: the ECU refused to stage %u B: %s"
+                         % (len(image), STATUS.get(status, status)))
+
+    t0 = time.monotonic()
+    offset = 0
+    while offset < len(image):
+        data = image[offset:offset + piece]
+        # The first pieces wait for the erase (at standstill only).
+        status, tags = call(rpc, STAGE_DATA, tlv(1, u32(offset)) + tlv(2, data),
+                            retry_for=erase_timeout)
+        if status != 0:
+            raise SystemExit("fw_proxy: STAGE_DATA at %u: %s" % (offset, STATUS.get(status, status)))
+        offset = struct.unpack("<I", tags[1][0])[0]
+        sys.stdout.write("\r%6.1f %%" % (100.0 * offset / len(image)))
+        sys.stdout.flush()
+
+    status, _ = call(rpc, STAGE_END, retry_for=erase_timeout)
+    sys.stdout.write("\n")
+    if status != 0:
+        raise SystemExit("fw_proxy: staging failed (\"stage\" on the console tells why)")
+    print("staged in %.1f s" % (time.monotonic() - t0))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Flash the CAN2 nodes through the Mini ECU.")
+    ap.add_argument("image", nargs="?", help="node image (.bin); its _b sibling is picked "
+                    "if that one is linked for the staging slot")
+    ap.add_argument("--port", required=True, help="ECU console (needs pyserial)")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("--nodes", type=nodes_arg, help="nodes to flash, e.g. 0,1,4-7")
+    ap.add_argument("--request", action="store_true",
+                    help="ask the running applications to enter their bootloaders first")
+    ap.add_argument("--no-go", action="store_true", help="leave the nodes in the bootloader")
+    ap.add_argument("--piece", type=int, default=248, help="bytes per STAGE_DATA (max 248)")
+    ap.add_argument("--erase-timeout", type=float, default=60.0,
+                    help="seconds the staging may wait for its erase (default 60)")
+    ap.add_argument("--status", action="store_true", help="print the proxy job and exit")
+    args = ap.parse_args()
+
+    if not args.status and (args.image is None or args.nodes is None):
+        ap.error("an image and --nodes are needed")
+
+    import serial  # pylint: disable=import-outside-toplevel
+    with serial.Serial(args.port, args.baud, timeout=0.01) as ser:
+        rpc = Rpc(ser)
+
+        if args.status:
+            sys.stdout.write(exec_line(rpc, "fwp"))
+            return 0
+
+        status, tags = rpc.call(PING)
+        if status != 0 or tags[2][0][0] < 2:
+            raise SystemExit("fw_proxy: the ECU has no STAGE requests (RPC protocol 2)")
+
+        stage(rpc, args.image, min(args.piece, 248), args.erase_timeout)
+
+        line = "fwp start %s%s%s" % (args.nodes, " req" if args.request else "",
+                                     " nogo" if args.no_go else "")
+        out = exec_line(rpc, line)
+        sys.stdout.write(out)
+        if not out.startswith("Flashing"):
+            return 1
+
+        while True:
+            time.sleep(0.5)
+            out = exec_line(rpc, "fwp")
+            head = out.split("\r\n", 1)[0]
+            sys.stdout.write("\r%-79s" % head[:79])
+            sys.stdout.flush()
+            if head.startswith("Proxy finished"):
+                break
+        sys.stdout.write("\n" + out)
+        summary = [l for l in out.splitlines() if l.startswith("Nodes ")]
+        return 0 if summary and " 0 failed" in summary[0] else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,578 @@
+#!/usr/bin/env python3
+"""
+fw_update.py - Flash the application through the bootloader's UART protocol.
+
+Reset the board with B1 held (or with no valid application) so the
+bootloader enters update mode, then:
+
+    fw_update.py /dev/ttyACM0 build/release/mini_ecu_v2.bin
+    fw_update.py COM5 mini_ecu_v2.bin --baud 2000000      # BOOT_UPDATE_BAUD
+    fw_update.py /dev/ttyACM0 mini_ecu_v2.bin --speed 3000000  # BAUD switch
+    fw_update.py /dev/ttyACM0 --info                      # query only
+    fw_update.py /dev/ttyACM0 mini_ecu_v2.bin --full      # no delta
+
+Sequence: INFO, HASH of every application sector, ERASE (only the sectors
+whose flash content differs from the image), WRITE their chunks with up to
+WINDOW unacknowledged frames in flight, selective resend of chunks that
+are NAKed or time out, DONE (the bootloader re-checks the image CRC), GO
+(reset into the new image). The frame layout is described in the
+bootloader's boot_update.h. Protocol 1 bootloaders have no HASH; they get
+the whole image.
+
+Protocol 3 bootloaders write the A/B slot that is not running and report
+its address in INFO. The image must be linked for that slot: given
+mini_ecu_v2.bin the tool sends mini_ecu_v2_b.bin (or the other way round)
+when the target is the other slot.
+
+Protocol 5 bootloaders take the image LZ4-compressed (ZWRITE, see
+lz4_block.py): one stream from the first sector to rewrite to the end of
+the image, cut into chunks and sent with the same window. The stream has
+to arrive in order, so after a NAK or a timeout the tool goes back to the
+chunk the bootloader expects next. The plain chunks are sent instead when
+the stream would not be smaller, or with --no-compress.
+
+Protocol 7 bootloaders record the transfer in the target slot, so one
+that was interrupted (reset, unplugged harness, tool killed) resumes: the
+ERASE carries the image CRC as a tag, INFO reports the recorded length,
+sector mask, tag and a bitmap of the chunks in flash, and when they match
+the image the tool repeats that ERASE, which erases nothing, and sends
+only the missing chunks. --full starts over.
+
+With --speed (protocol 4) the tool asks the bootloader to switch to a
+faster rate after INFO and confirms it with a second INFO at that rate;
+without the confirmation the bootloader goes back to --baud after
+BOOT_UPDATE_BAUD_CONFIRM_MS and so does the tool.
+
+An unstamped .bin (length/CRC erased) is stamped in memory first, see
+image_stamp.py. That drops a signature, and protocol 6 bootloaders built
+for release refuse unsigned images at DONE; sign with image_stamp.py
+--key (the build does) before flashing.
+
+Uses pyserial when installed, otherwise the POSIX termios module.
+"""
+
+import argparse
+import os
+import select
+import struct
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import image_stamp  # noqa: E402
+import lz4_block  # noqa: E402
+
+SYNC_HOST = 0xA5
+SYNC_ECU = 0x5A
+HDR_FMT = "<BBHHB"
+
+CMD_INFO, CMD_ERASE, CMD_WRITE, CMD_DONE, CMD_GO, CMD_HASH, CMD_BAUD = 1, 2, 3, 4, 5, 6, 7
+CMD_ZWRITE = 8
+
+PROTO_DELTA = 2          # first protocol with HASH and the ERASE sector mask
+PROTO_SLOTS = 3          # first protocol with A/B slots (INFO reports the target)
+PROTO_BAUD = 4           # first protocol with BAUD
+PROTO_ZWRITE = 5         # first protocol with ZWRITE (LZ4 stream)
+PROTO_SIGNED = 6         # first protocol checking image signatures
+PROTO_RESUME = 7         # first protocol with transfer records (ERASE tag, INFO bitmap)
+
+ALL_SECTORS = 0xFFFFFFFF
+
+BAUD_CONFIRM_S = 1.0     # BOOT_UPDATE_BAUD_CONFIRM_MS
+
+STATUS = ["ok", "CRC error", "bad frame", "out of range", "not erased",
+          "flash error", "incomplete", "image invalid", "unknown command",
+          "no erase", "out of sequence", "stream corrupt"]
+ST_OK, ST_CRC, ST_SEQ = 0, 1, 10
+
+IMAGE_RESULT = ["ok", "no image header", "header not stamped", "bad image length",
+                "CRC mismatch", "CRC DMA error", "linked for the other slot",
+                "no signature", "signature invalid"]
+
+
+# ---------------------------------------------------------------------------
+# Serial port
+# ---------------------------------------------------------------------------
+
+class Port:
+    """Raw serial port: write(bytes), read() -> bytes available within timeout."""
+
+    def __init__(self, name, baud):
+        try:
+            import serial
+            self._ser = serial.Serial(name, baud, timeout=0)
+            self._fd = None
+        except ImportError:
+            import termios
+            self._ser = None
+            self._fd = os.open(name, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+            speed = self._speed(baud)
+            attr = termios.tcgetattr(self._fd)
+            attr[0] = 0                                             # iflag
+            attr[1] = 0                                             # oflag
+            attr[2] = termios.CS8 | termios.CREAD | termios.CLOCAL  # cflag
+            attr[3] = 0                                             # lflag
+            attr[4] = attr[5] = speed
+            attr[6][termios.VMIN] = 0
+            attr[6][termios.VTIME] = 0
+            termios.tcsetattr(self._fd, termios.TCSANOW, attr)
+            termios.tcflush(self._fd, termios.TCIOFLUSH)
+
+    @staticmethod
+    def _speed(baud):
+        import termios
+        speed = getattr(termios, "B%d" % baud, None)
+        if speed is None:
+            raise SystemExit("baud %d not supported by termios; install pyserial" % baud)
+        return speed
+
+    def set_baud(self, baud):
+        """Change the rate once everything written has been sent."""
+        if self._ser is not None:
+            self._ser.flush()
+            self._ser.baudrate = baud
+            return
+        import termios
+        attr = termios.tcgetattr(self._fd)
+        attr[4] = attr[5] = self._speed(baud)
+        termios.tcsetattr(self._fd, termios.TCSADRAIN, attr)
+
+    def write(self, data):
+        if self._ser is not None:
+            self._ser.write(data)
+            return
+        view = memoryview(data)
+        while view:
+            select.select([], [self._fd], [])
+            view = view[os.write(self._fd, view):]
+
+    def read(self, timeout):
+        if self._ser is not None:
+            self._ser.timeout = timeout
+            first = self._ser.read(1)
+            return first + self._ser.read(self._ser.in_waiting) if first else b""
+        ready, _, _ = select.select([self._fd], [], [], timeout)
+        return os.read(self._fd, 4096) if ready else b""
+
+
+# ---------------------------------------------------------------------------
+# Framing
+# ---------------------------------------------------------------------------
+
+def _check(hdr):
+    x = 0
+    for b in hdr:
+        x ^= b
+    return x
+
+
+def frame(cmd, seq, payload=b""):
+    hdr = struct.pack(HDR_FMT, SYNC_HOST, cmd, seq, len(payload), SYNC_HOST ^ 0xFF)
+    body = hdr + bytes([_check(hdr)]) + payload
+    return body + struct.pack("<I", image_stamp.stm32_crc(body))
+
+
+class Link:
+    def __init__(self, port):
+        self.port = port
+        self.buf = bytearray()
+
+    def send(self, cmd, seq=0, payload=b""):
+        self.port.write(frame(cmd, seq, payload))
+
+    def recv(self, timeout):
+        """Next valid reply as (cmd, seq, [u32 words]) or None on timeout."""
+        deadline = time.monotonic() + timeout
+        while True:
+            reply = self._parse()
+            if reply is not None:
+                return reply
+            left = deadline - time.monotonic()
+            if left <= 0:
+                return None
+            self.buf += self.port.read(left)
+
+    def _parse(self):
+        while True:
+            start = self.buf.find(bytes([SYNC_ECU]))
+            if start < 0:
+                self.buf.clear()
+                return None
+            del self.buf[:start]
+            if len(self.buf) < 8:
+                return None
+            sync, cmd, seq, length, nsync = struct.unpack_from(HDR_FMT, self.buf)
+            if nsync != SYNC_ECU ^ 0xFF or self.buf[7] != _check(self.buf[:7]) or length % 4:
+                del self.buf[0]
+                continue
+            total = 8 + length + 4
+            if len(self.buf) < total:
+                return None
+            body = bytes(self.buf[:8 + length])
+            crc, = struct.unpack_from("<I", self.buf, 8 + length)
+            del self.buf[:total]
+            if crc != image_stamp.stm32_crc(body):
+                continue
+            return cmd, seq, list(struct.unpack_from("<%dI" % (length // 4), body, 8))
+
+    def call(self, cmd, payload=b"", timeout=1.0, retries=3, seq=0):
+        for _ in range(retries):
+            self.send(cmd, seq, payload)
+            while True:
+                reply = self.recv(timeout)
+                if reply is None:
+                    break
+                if reply[0] == cmd and reply[1] == seq:
+                    if reply[2][0] == ST_CRC:
+                        break
+                    return reply[2]
+        raise SystemExit("no reply to command %d" % cmd)
+
+
+# ---------------------------------------------------------------------------
+# Update
+# ---------------------------------------------------------------------------
+
+def switch_baud(link, base, speed):
+    """BAUD: move the link to speed; INFO at the new rate confirms it."""
+    status, actual, _ = link.call(CMD_BAUD, struct.pack("<I", speed))
+    if status != ST_OK:
+        print("bootloader cannot run %u baud (%s, nearest %u), staying at %u"
+              % (speed, status_str(status), actual, base))
+        return
+    link.port.set_baud(speed)
+    link.buf.clear()
+    try:
+        link.call(CMD_INFO, timeout=0.2)
+    except SystemExit:
+        # The bootloader goes back on its own once the confirmation is due.
+        time.sleep(BAUD_CONFIRM_S + 0.1)
+        link.port.set_baud(base)
+        link.buf.clear()
+        link.call(CMD_INFO)
+        print("no reply at %u baud, back at %u" % (speed, base))
+        return
+    print("link at %u baud (ECU %u, %+.2f %%)" % (speed, actual, (actual - speed) * 100.0 / speed))
+
+
+def version_str(v):
+    return "v%u.%u.%u" % ((v >> 16) & 0xFF, (v >> 8) & 0xFF, v & 0xFF)
+
+
+def status_str(s):
+    return STATUS[s] if s < len(STATUS) else "status %d" % s
+
+
+def load_image(path):
+    with open(path, "rb") as f:
+        image = bytearray(f.read())
+    image += b"\xFF" * (-len(image) % 4)
+    magic, version, length, crc = struct.unpack_from(image_stamp.HEADER_FMT, image,
+                                                     image_stamp.HEADER_OFFSET)
+    if magic != image_stamp.HEADER_MAGIC:
+        raise SystemExit("%s: no image header" % path)
+    image, trailer = image_stamp.split(image)
+    if length != len(image) or crc != image_stamp.image_crc(image):
+        crc = image_stamp.image_crc(image)
+        struct.pack_into(image_stamp.HEADER_FMT, image, image_stamp.HEADER_OFFSET,
+                         magic, version, len(image), crc)
+        print("stamped %s in memory: %u B, CRC 0x%08X%s"
+              % (path, len(image), crc, ", signature dropped" if trailer else ""))
+        trailer = None
+    if trailer is None:
+        print("%s is unsigned: release bootloaders from protocol %u on refuse it"
+              % (path, PROTO_SIGNED))
+    return bytes(image + (trailer or b"")), version, crc
+
+
+def slot_image(path, base):
+    """The .bin linked for the slot at base: path itself or its A/B sibling."""
+    stem, ext = os.path.splitext(path)
+    sibling = stem[:-2] + ext if stem.endswith("_b") else stem + "_b" + ext
+    for candidate in (path, sibling):
+        if not os.path.exists(candidate):
+            continue
+        with open(candidate, "rb") as f:
+            slot = image_stamp.slot_of(f.read(8))
+        if slot is not None and slot[1] == base:
+            return candidate, slot[0]
+    raise SystemExit("%s: neither it nor %s is linked for the target slot at 0x%08X"
+                     % (path, sibling, base))
+
+
+def erase_payload(proto, length, mask, tag):
+    """ERASE data: length, then the sector mask (protocol 2) and tag (7)."""
+    if proto >= PROTO_RESUME:
+        return struct.pack("<III", length, mask, tag)
+    if proto >= PROTO_DELTA and mask != ALL_SECTORS:
+        return struct.pack("<II", length, mask)
+    return struct.pack("<I", length)
+
+
+def resume_plan(info, image, chunk):
+    """(ERASE mask, missing chunks) of an interrupted transfer of image, or None.
+
+    info is the INFO reply; from protocol 7 it ends in the transfer record
+    of the target slot: length, mask, tag and the bitmap of the chunks in
+    flash.
+    """
+    if info[1] < PROTO_RESUME or len(info) < 11:
+        return None
+    length, mask, tag, bitmap = info[8], info[9], info[10], info[11:]
+    if length != len(image) or tag != image_stamp.stm32_crc(image):
+        return None
+    count = (len(image) + chunk - 1) // chunk
+    return mask, [i for i in range(count) if not (bitmap[i // 32] >> (i % 32)) & 1]
+
+
+def sector_plan(hash_of, image, chunk):
+    """Sectors whose flash content differs from the image.
+
+    hash_of(i) returns the HASH reply words (status, address, size, CRC) of
+    application sector i. Returns (ERASE mask, chunks to write, sectors
+    compared).
+    """
+    mask, chunks, sector, base = 0, [], 0, None
+    while True:
+        status, addr, size, crc = (list(hash_of(sector)) + [0, 0, 0])[:4]
+        if status != ST_OK:
+            break                       # past the last sector
+        base = addr if base is None else base
+        off = addr - base
+        if off >= len(image):
+            break
+        want = image[off:off + size]
+        if image_stamp.stm32_crc(want + b"\xFF" * (size - len(want))) != crc:
+            mask |= 1 << sector
+            chunks += range(off // chunk, (off + len(want) + chunk - 1) // chunk)
+        sector += 1
+    return mask, chunks, sector
+
+
+def write_chunks(link, image, chunk, chunks, window, ack_timeout, max_retries):
+    """Pipelined WRITE with selective resend; returns (seconds, resent chunks)."""
+    count = len(chunks)
+    pending = list(chunks)              # chunks still to send, lowest first
+    inflight = {}                       # seq -> send time
+    retries = {}
+    done = 0
+    t0 = time.monotonic()
+
+    def requeue(seq, why):
+        retries[seq] = retries.get(seq, 0) + 1
+        if retries[seq] > max_retries:
+            raise SystemExit("\nchunk %u: giving up after %u retries (%s)"
+                             % (seq, max_retries, why))
+        pending.insert(0, seq)
+
+    while done < count:
+        while pending and len(inflight) < window:
+            seq = pending.pop(0)
+            link.send(CMD_WRITE, seq, image[seq * chunk:(seq + 1) * chunk])
+            inflight[seq] = time.monotonic()
+
+        reply = link.recv(ack_timeout / 4)
+        now = time.monotonic()
+
+        if reply is not None and reply[0] == CMD_WRITE and reply[1] in inflight:
+            seq, status = reply[1], reply[2][0]
+            del inflight[seq]
+            if status == ST_CRC:
+                requeue(seq, "CRC error")
+            elif status != ST_OK:
+                raise SystemExit("\nchunk %u: %s" % (seq, status_str(status)))
+            else:
+                done += 1
+                if done % 32 == 0 or done == count:
+                    rate = done * chunk / 1024.0 / max(now - t0, 1e-6)
+                    sys.stdout.write("\r  %3u %%  %u/%u chunks  %.1f KB/s"
+                                     % (100 * done // count, done, count, rate))
+                    sys.stdout.flush()
+
+        for seq, sent in list(inflight.items()):
+            if now - sent > ack_timeout:
+                del inflight[seq]
+                requeue(seq, "timeout")
+
+    print()
+    return time.monotonic() - t0, sum(retries.values())
+
+
+def zstream(image, chunk, chunks):
+    """ZWRITE pieces for the chunks to write, or None if not smaller.
+
+    The bootloader decodes from the first chunk it erased (a sector start)
+    to the end of the image; the bytes in front of it are in its flash.
+    """
+    if not chunks:
+        return None
+    begin = min(chunks) * chunk
+    stream = lz4_block.compress(image, begin)
+    stream += b"\0" * (-len(stream) % 4)
+    if len(stream) >= min(len(chunks) * chunk, len(image) - begin):
+        return None
+    return [stream[i:i + chunk] for i in range(0, len(stream), chunk)]
+
+
+def write_stream(link, pieces, window, ack_timeout, max_retries):
+    """Pipelined ZWRITE, back to the expected piece on any loss; returns
+    (seconds, resent pieces)."""
+    count = len(pieces)
+    base = 0                            # next piece the bootloader expects
+    nxt = 0                             # next piece to send
+    sent = {}                           # seq -> send time
+    retries = 0
+    t0 = time.monotonic()
+
+    def rewind(to, why):
+        nonlocal nxt, retries
+        if to < nxt:
+            retries += nxt - to
+            if retries > max_retries * max(window, 1) * 4:
+                raise SystemExit("\npiece %u: giving up (%s)" % (to, why))
+            nxt = to
+            sent.clear()
+
+    while base < count:
+        while nxt < count and nxt < base + window:
+            link.send(CMD_ZWRITE, nxt, pieces[nxt])
+            sent[nxt] = time.monotonic()
+            nxt += 1
+
+        reply = link.recv(ack_timeout / 4)
+        now = time.monotonic()
+
+        if reply is not None and reply[0] == CMD_ZWRITE:
+            seq, words = reply[1], reply[2]
+            status = words[0]
+            sent.pop(seq, None)
+            if status == ST_OK:
+                if words[1] > base:
+                    base = words[1]
+                    if base % 32 == 0 or base == count:
+                        rate = base * len(pieces[0]) / 1024.0 / max(now - t0, 1e-6)
+                        sys.stdout.write("\r  %3u %%  %u/%u pieces  %.1f KB/s"
+                                         % (100 * base // count, base, count, rate))
+                        sys.stdout.flush()
+            elif status == ST_CRC:
+                rewind(max(base, min(seq, nxt)), "CRC error")
+            elif status == ST_SEQ:
+                base = max(base, words[1])
+                rewind(words[1], "out of sequence")
+            else:
+                raise SystemExit("\npiece %u: %s" % (seq, status_str(status)))
+
+        if sent and now - min(sent.values()) > ack_timeout:
+            rewind(base, "timeout")
+
+    print()
+    return time.monotonic() - t0, retries
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Update the Mini ECU application over UART.")
+    ap.add_argument("port", help="serial port, e.g. /dev/ttyACM0 or COM5")
+    ap.add_argument("bin", nargs="?", help="application .bin")
+    ap.add_argument("--baud", type=int, default=921600,
+                    help="bootloader BOOT_UPDATE_BAUD (default 921600)")
+    ap.add_argument("--speed", type=int, default=0,
+                    help="switch to this rate after INFO (protocol 4, e.g. 3000000)")
+    ap.add_argument("--window", type=int, default=0,
+                    help="frames in flight (default: what the bootloader reports)")
+    ap.add_argument("--ack-timeout", type=float, default=0.5,
+                    help="seconds before an unacknowledged chunk is resent")
+    ap.add_argument("--retries", type=int, default=8, help="resends per chunk")
+    ap.add_argument("--full", action="store_true",
+                    help="erase and write every sector, not only the changed ones")
+    ap.add_argument("--no-compress", action="store_true",
+                    help="send plain chunks even to a protocol 5 bootloader")
+    ap.add_argument("--info", action="store_true", help="only print bootloader info")
+    ap.add_argument("--no-go", action="store_true", help="do not reset into the new image")
+    args = ap.parse_args()
+
+    if not args.info and not args.bin:
+        ap.error("an image is required unless --info is given")
+
+    link = Link(Port(args.port, args.baud))
+
+    info = link.call(CMD_INFO)
+    _, proto, chunk, window, app_max, app_version, state = info[:7]
+    target = info[7] if proto >= PROTO_SLOTS else image_stamp.SLOTS[0][1]
+    print("bootloader protocol %u, %u B chunks, window %u, target 0x%08X, %u KB"
+          % (proto, chunk, window, target, app_max // 1024))
+    print("current image: %s (%s)"
+          % (version_str(app_version) if app_version else "none",
+             IMAGE_RESULT[state] if state < len(IMAGE_RESULT) else state))
+    if args.speed and args.speed != args.baud:
+        if proto >= PROTO_BAUD:
+            switch_baud(link, args.baud, args.speed)
+        else:
+            print("protocol %u has no BAUD, staying at %u" % (proto, args.baud))
+    if args.info:
+        return
+
+    if proto >= PROTO_SLOTS:
+        args.bin, slot = slot_image(args.bin, target)
+        print("target slot %s: %s" % (slot, args.bin))
+    image, version, crc = load_image(args.bin)
+    if len(image) > app_max:
+        raise SystemExit("%s: %u B does not fit the %u B app area" % (args.bin, len(image), app_max))
+    window = min(args.window, window) if args.window > 0 else window
+
+    t_start = time.monotonic()
+
+    mask, chunks = ALL_SECTORS, list(range((len(image) + chunk - 1) // chunk))
+    resume = None if args.full else resume_plan(info, image, chunk)
+    if resume is not None:
+        mask, chunks = resume
+        print("resuming an interrupted transfer of this image, %u of %u chunks missing"
+              % (len(chunks), (len(image) + chunk - 1) // chunk))
+    elif proto >= PROTO_DELTA and not args.full:
+        mask, chunks, compared = sector_plan(
+            lambda sector: link.call(CMD_HASH, seq=sector), image, chunk)
+        print("%u of %u sectors differ from the image in flash"
+              % (bin(mask).count("1"), compared))
+
+    erase = erase_payload(proto, len(image), mask, image_stamp.stm32_crc(image))
+    status, erase_ms, sectors = link.call(CMD_ERASE, erase, timeout=15.0, retries=1)
+    if status != ST_OK:
+        raise SystemExit("erase: %s" % status_str(status))
+    if resume is None:
+        print("erased %u sectors in %.2f s" % (sectors, erase_ms / 1000.0))
+
+    pieces = None
+    if proto >= PROTO_ZWRITE and not args.no_compress:
+        pieces = zstream(image, chunk, chunks)
+    if pieces:
+        size = min(len(chunks) * chunk, len(image))
+        sent = sum(len(p) for p in pieces)
+        print("writing %s %s, %u of %u B as %u B LZ4 (%.0f %%)"
+              % (args.bin, version_str(version), size, len(image), sent, 100.0 * sent / size))
+        seconds, resent = write_stream(link, pieces, window, args.ack_timeout, args.retries)
+        print("wrote %u B in %.2f s (%.1f KB/s), %u pieces resent"
+              % (size, seconds, size / 1024.0 / seconds, resent))
+    elif chunks:
+        size = min(len(chunks) * chunk, len(image))
+        print("writing %s %s, %u of %u B" % (args.bin, version_str(version), size, len(image)))
+        seconds, resent = write_chunks(link, image, chunk, chunks, window,
+                                       args.ack_timeout, args.retries)
+        print("wrote %u B in %.2f s (%.1f KB/s), %u chunks resent"
+              % (size, seconds, size / 1024.0 / seconds, resent))
+
+    status, result, ecu_crc = link.call(CMD_DONE, timeout=2.0)
+    if status != ST_OK:
+        raise SystemExit("done: %s (%s, CRC 0x%08X, expected 0x%08X)"
+                         % (status_str(status),
+                            IMAGE_RESULT[result] if result < len(IMAGE_RESULT) else result,
+                            ecu_crc, crc))
+    print("image verified by the bootloader: CRC 0x%08X" % ecu_crc)
+    print("total %.2f s" % (time.monotonic() - t_start))
+
+    if not args.no_go:
+        link.call(CMD_GO)
+        print("reset into the new image" + (" (on trial until it confirms itself)"
+                                            if proto >= PROTO_SLOTS else ""))
+
+
+if __name__ == "__main__":
+    main()
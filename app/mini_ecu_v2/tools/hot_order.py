@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""
+hot_order.py - Order the hot and cold functions in the linker script from a
+PC profile.
+
+The application is compiled with -ffunction-sections, so every function is
+an input section .text.<name> the linker script can place on its own.
+STM32F446RETX_FLASH.ld starts .text with two generated blocks:
+
+    /* COLD_ORDER_BEGIN ... */    init-only and error-path functions,
+    /* COLD_ORDER_END */          linked first, out of the way
+    /* HOT_ORDER_BEGIN ... */     the hot functions, hottest first and
+    /* HOT_ORDER_END */           contiguous (_shottext.._ehottext)
+
+followed by everything else in link order. Code in .ramfunc (the interrupt
+paths, ramfunc.h) is placed there before .text is filled and is left out.
+
+This tool reads a "prof dump" capture (see tools/pc_prof.py) of the same
+image as --elf, shares the samples out per function, and rewrites both
+blocks:
+
+  - hot: the flash functions by samples, until --cover percent of the
+    samples in flash code or --max-bytes of code is reached, each with at
+    least --min-samples,
+  - cold: start-up and fault functions (COLD_NAMES, and --cold NAME) the
+    profile never saw. The *_Init and *_MspInit functions and what GCC
+    itself marks cold (.text.unlikely, .text.startup) are placed with them
+    by patterns in the script.
+
+Clones of a function (LTO .lto_priv.N, .constprop.N, .isra.N, .part.N) are
+one entry: the pattern .text.<name>.* takes them too.
+
+Profile the image that is linked again (usually "make release"), under the
+load that matters, then:
+
+Usage:
+    hot_order.py capture.txt --elf build/release/mini_ecu_v2.elf
+    hot_order.py capture.txt --elf mini_ecu_v2.elf --cover 95 --max-bytes 24576
+    hot_order.py capture.txt --elf mini_ecu_v2.elf --dry-run
+
+Only the Python standard library is needed.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from crash_decode import Symbols  # noqa: E402
+from pc_prof import by_function, read_profile  # noqa: E402
+
+SRAM_START = 0x20000000
+
+# Start-up and fault paths worth moving out even when not named *_Init.
+COLD_NAMES = re.compile(r"^(main|SystemClock_Config|Error_Handler|assert_failed|"
+                        r"vApplicationStackOverflowHook|vApplicationMallocFailedHook|"
+                        r"CrashDump_\w+|HardFault_\w+|MemManage_\w+|BusFault_\w+|"
+                        r"UsageFault_\w+|NMI_Handler|\w+_DeInit)$")
+
+# Already placed by the patterns in the script.
+COVERED = re.compile(r"(_Init|_MspInit)$")
+
+BLOCK = re.compile(r"(?P<head>[ \t]*/\* (?P<tag>HOT|COLD)_ORDER_BEGIN[^\n]*\*/\n)"
+                   r"(?P<body>.*?)"
+                   r"(?P<tail>[ \t]*/\* (?P=tag)_ORDER_END \*/\n)", re.S)
+
+
+def base_name(name):
+    """Function name without the clone suffixes GCC appends."""
+    return name.split(".")[0]
+
+
+def hot_functions(prof, syms, cover, max_bytes, min_samples):
+    sizes = {}
+    for addr, size, name in syms.syms:
+        if addr < SRAM_START:
+            base = base_name(name)
+            sizes[base] = sizes.get(base, 0) + size
+
+    counts = {}
+    for name, n in by_function(prof, syms).items():
+        base = base_name(name)
+        if base in sizes:
+            counts[base] = counts.get(base, 0.0) + n
+
+    total = sum(counts.values())
+    hot, cum, size = [], 0.0, 0
+    for name, n in sorted(counts.items(), key=lambda kv: -kv[1]):
+        if n < min_samples or cum >= total * cover / 100.0 or size + sizes[name] > max_bytes:
+            break
+        hot.append(name)
+        cum += n
+        size += sizes[name]
+    return hot, counts, cum, total, size
+
+
+def cold_functions(syms, counts, extra):
+    cold = []
+    for addr, _, name in syms.syms:
+        base = base_name(name)
+        if (addr < SRAM_START and base not in cold and counts.get(base, 0.0) == 0.0
+                and (COLD_NAMES.match(base) or base in extra) and not COVERED.search(base)):
+            cold.append(base)
+    return cold
+
+
+def rewrite(text, blocks):
+    def body(m):
+        lines = "".join("    *(.text.%s .text.%s.*)\n" % (n, n) for n in blocks[m.group("tag")])
+        return m.group("head") + lines + m.group("tail")
+
+    new, n = BLOCK.subn(body, text)
+    if n != 2:
+        raise SystemExit("linker script: expected the HOT_ORDER and COLD_ORDER blocks")
+    return new
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Hot/cold function order for the linker script.")
+    ap.add_argument("input", help="console capture with a \"prof dump\"")
+    ap.add_argument("--elf", required=True, help="firmware ELF the profile was taken on")
+    ap.add_argument("--ld", default="STM32F446RETX_FLASH.ld", help="linker script to rewrite")
+    ap.add_argument("--cover", type=float, default=90.0,
+                    help="percent of the flash samples the hot block covers (default 90)")
+    ap.add_argument("--max-bytes", type=int, default=16384,
+                    help="largest hot block (default 16384)")
+    ap.add_argument("--min-samples", type=float, default=2.0,
+                    help="fewest samples of a hot function (default 2)")
+    ap.add_argument("--cold", action="append", default=[], metavar="NAME",
+                    help="also place NAME with the cold functions")
+    ap.add_argument("--dry-run", action="store_true", help="print the blocks, change nothing")
+    args = ap.parse_args()
+
+    with open(args.input, errors="replace") as src:
+        prof = read_profile(src)
+    syms = Symbols(args.elf)
+
+    hot, counts, cum, total, size = hot_functions(prof, syms, args.cover, args.max_bytes,
+                                                  args.min_samples)
+    cold = cold_functions(syms, counts, set(args.cold))
+
+    sys.stderr.write("hot_order: %u hot functions, %u bytes, %.1f %% of the %.0f samples in "
+                     "flash code; %u cold\n"
+                     % (len(hot), size, 100.0 * cum / total if total else 0.0, total, len(cold)))
+
+    if args.dry_run:
+        for tag, names in (("COLD", cold), ("HOT", hot)):
+            sys.stdout.write("%s:\n" % tag)
+            for n in names:
+                sys.stdout.write("    %s\n" % n)
+        return 0
+
+    with open(args.ld) as f:
+        text = f.read()
+    new = rewrite(text, {"HOT": hot, "COLD": cold})
+    if new != text:
+        with open(args.ld, "w") as f:
+            f.write(new)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
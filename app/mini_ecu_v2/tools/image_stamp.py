@@ -0,0 +1,234 @@
+#!/usr/bin/env python3
+"""
+image_stamp.py - Write length and CRC into the application image header,
+and sign the image.
+
+The linked application carries an ImageHeader_t (image_header.h) at offset
+0x200 with the magic and version set and length/CRC erased. This script:
+  - pads the .bin with 0xFF to a multiple of 4 bytes,
+  - stores the padded length,
+  - stamps the CRC of the calibration image at 0x240 (cal_image.py), so
+    a dataset put in with "cal_image.py set" is covered as well,
+  - computes the CRC the STM32 CRC unit produces over the image without
+    the header (CRC-32/MPEG-2 on 32-bit little-endian words) and stores it,
+  - with --key, appends the signature trailer (ImageSig_t, boot_image.h):
+    "SIGN" and the Ed25519 signature of the stamped image, boot-control
+    words erased (ed25519_ref.py).
+
+The bootloader refuses to start an image whose CRC does not match, and a
+release bootloader one without a valid signature (boot_sig.h), so the
+stamped .bin is the file to flash. The image must fit the bootloader slot
+it is linked for (mini_ecu_v2.bin: A, mini_ecu_v2_b.bin: B), which is
+taken from its reset vector, less the transfer records and signature
+check log the bootloader keeps at the slot end. The header's boot-control words (generation, confirmed, revoked) stay
+erased; the device programs them.
+
+A key file holds the 32-byte Ed25519 seed in hex ('#' starts a comment).
+dev_signing.key is the development key the bootloader trusts by default;
+it is public, so production images need a key of their own, made with
+--genkey, whose public half goes into the bootloader's
+BOOT_SIG_PUBLIC_KEY.
+
+Usage:
+    image_stamp.py build/release/mini_ecu_v2.bin            # in place
+    image_stamp.py mini_ecu_v2.bin -o mini_ecu_v2_stamped.bin
+    image_stamp.py mini_ecu_v2.bin --key dev_signing.key    # stamp and sign
+    image_stamp.py mini_ecu_v2.bin --check [--key KEY]      # verify only
+    image_stamp.py --genkey release.key                     # new key pair
+
+Only the Python standard library is needed.
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import cal_image  # noqa: E402
+import ed25519_ref  # noqa: E402
+
+HEADER_OFFSET = 0x200
+HEADER_MAGIC = 0x5543454D       # "MECU"
+HEADER_FMT = "<IIII"            # magic, version, length, crc32
+HEADER_SIZE = struct.calcsize(HEADER_FMT) + 3 * 4   # + boot-control words
+
+# Bootloader slots (boot_slot.h): name, base, size.
+SLOTS = [("A", 0x08010000, 192 * 1024),
+         ("B", 0x08040000, 256 * 1024)]
+
+# Signature trailer behind the image (ImageSig_t), the boot-control words
+# it signs as erased, and what the bootloader keeps at the end of every
+# slot (BOOT_SLOT_TAIL_SIZE): 4 transfer records of 16 + 256 B, then the
+# 64 B check log.
+SIG_MAGIC = 0x4E474953          # "SIGN"
+SIG_SIZE = 4 + 64
+CTRL_OFFSET = HEADER_OFFSET + 16
+CTRL_SIZE = 3 * 4
+SLOT_TAIL = 4 * (16 + 256) + 64
+
+POLY = 0x04C11DB7
+
+
+def _table():
+    table = []
+    for b in range(256):
+        c = b << 24
+        for _ in range(8):
+            c = ((c << 1) ^ POLY) if c & 0x80000000 else (c << 1)
+        table.append(c & 0xFFFFFFFF)
+    return table
+
+
+TABLE = _table()
+
+
+def stm32_crc(data, crc=0xFFFFFFFF):
+    """CRC of the STM32 CRC unit fed with little-endian words of data."""
+    for (word,) in struct.iter_unpack("<I", data):
+        for shift in (24, 16, 8, 0):
+            crc = ((crc << 8) & 0xFFFFFFFF) ^ TABLE[((crc >> 24) ^ (word >> shift)) & 0xFF]
+    return crc
+
+
+def image_crc(image):
+    crc = stm32_crc(image[:HEADER_OFFSET])
+    return stm32_crc(image[HEADER_OFFSET + HEADER_SIZE:], crc)
+
+
+def split(image):
+    """(image, trailer): the stamped image and its signature trailer or None."""
+    length = struct.unpack_from(HEADER_FMT, image, HEADER_OFFSET)[2]
+    if (len(image) == length + SIG_SIZE and
+            struct.unpack_from("<I", image, length)[0] == SIG_MAGIC):
+        return image[:length], image[length:]
+    return image, None
+
+
+def signed_message(image):
+    """What the signature covers: the image with erased boot-control words."""
+    return (bytes(image[:CTRL_OFFSET]) + b"\xFF" * CTRL_SIZE
+            + bytes(image[CTRL_OFFSET + CTRL_SIZE:]))
+
+
+def sign(image, seed):
+    """Signature trailer for a stamped image."""
+    return struct.pack("<I", SIG_MAGIC) + ed25519_ref.sign(seed, signed_message(image))
+
+
+def signature_ok(image, trailer, key):
+    return ed25519_ref.verify(key, signed_message(image), bytes(trailer[4:]))
+
+
+def load_seed(path):
+    with open(path) as f:
+        text = "".join(line.split("#")[0] for line in f).split()
+    seed = bytes.fromhex("".join(text))
+    if len(seed) != 32:
+        raise SystemExit("%s: want 32 bytes of hex, found %u" % (path, len(seed)))
+    return seed
+
+
+def key_initializer(key):
+    """The public key as the bootloader's BOOT_SIG_PUBLIC_KEY."""
+    rows = [", ".join("0x%02XU" % b for b in key[i:i + 8]) for i in range(0, 32, 8)]
+    return "{ " + ",\n  ".join(rows) + " }"
+
+
+def genkey(path):
+    if os.path.exists(path):
+        raise SystemExit("%s exists; not overwriting a key" % path)
+    seed = ed25519_ref.new_seed()
+    with open(path, "w") as f:
+        f.write("# Ed25519 image signing key (seed), see image_stamp.py\n%s\n" % seed.hex())
+    print("%s: new key; public key for BOOT_SIG_PUBLIC_KEY:\n%s"
+          % (path, key_initializer(ed25519_ref.public_key(seed))))
+
+
+def slot_of(image):
+    """Slot (name, base, size) the image's reset vector points into, or None."""
+    (reset,) = struct.unpack_from("<I", image, 4)
+    for slot in SLOTS:
+        if slot[1] <= reset < slot[1] + slot[2]:
+            return slot
+    return None
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Stamp length/CRC into the app image header.")
+    ap.add_argument("bin", nargs="?", help="application binary (objcopy -O binary)")
+    ap.add_argument("-o", "--output", help="output file (default: in place)")
+    ap.add_argument("--key", help="sign with this key file (hex Ed25519 seed)")
+    ap.add_argument("--check", action="store_true",
+                    help="only verify an already stamped image (and its signature with --key)")
+    ap.add_argument("--genkey", metavar="FILE", help="write a new key file and print its public key")
+    args = ap.parse_args()
+
+    if args.genkey:
+        genkey(args.genkey)
+        return
+    if not args.bin:
+        ap.error("no image given")
+
+    seed = load_seed(args.key) if args.key else None
+
+    with open(args.bin, "rb") as f:
+        image = bytearray(f.read())
+
+    if len(image) < HEADER_OFFSET + HEADER_SIZE:
+        raise SystemExit("%s: too short for an image header" % args.bin)
+
+    magic, version, length, crc = struct.unpack_from(HEADER_FMT, image, HEADER_OFFSET)
+    if magic != HEADER_MAGIC:
+        raise SystemExit("%s: no image header at 0x%X (magic 0x%08X)"
+                         % (args.bin, HEADER_OFFSET, magic))
+
+    image, trailer = split(image)
+
+    if args.check:
+        ok = length == len(image) and crc == image_crc(image)
+        cal = cal_image.check(image)
+        if cal not in (None, "ok"):
+            ok = False
+        if trailer is None:
+            sig = "unsigned"
+        elif seed is None:
+            sig = "signed (no --key to check against)"
+        elif signature_ok(image, trailer, ed25519_ref.public_key(seed)):
+            sig = "signature ok"
+        else:
+            sig, ok = "signature MISMATCH", False
+        print("%s: v%u.%u.%u, %u B, CRC 0x%08X %s, calibration %s, %s"
+              % (args.bin, (version >> 16) & 0xFF, (version >> 8) & 0xFF, version & 0xFF,
+                 length, crc, "ok" if crc == image_crc(image) else "MISMATCH",
+                 cal or "none", sig))
+        sys.exit(0 if ok else 1)
+
+    slot = slot_of(image)
+    if slot is None:
+        raise SystemExit("%s: reset vector 0x%08X is in neither bootloader slot"
+                         % (args.bin, struct.unpack_from("<I", image, 4)[0]))
+
+    image += b"\xFF" * (-len(image) % 4)
+    room = slot[2] - SLOT_TAIL - (SIG_SIZE if seed else 0)
+    if len(image) > room:
+        raise SystemExit("%s: %u B does not fit the %u B of slot %s"
+                         % (args.bin, len(image), room, slot[0]))
+
+    cal_image.stamp(image)
+    crc = image_crc(image)
+    struct.pack_into(HEADER_FMT, image, HEADER_OFFSET, magic, version, len(image), crc)
+    if seed:
+        image += sign(image, seed)
+
+    with open(args.output or args.bin, "wb") as f:
+        f.write(image)
+
+    print("%s: v%u.%u.%u, slot %s, %u B, CRC 0x%08X, %s"
+          % (args.output or args.bin, (version >> 16) & 0xFF, (version >> 8) & 0xFF,
+             version & 0xFF, slot[0], len(image) - (SIG_SIZE if seed else 0), crc,
+             "signed" if seed else "unsigned"))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,228 @@
+#!/usr/bin/env python3
+"""
+log_decode.py - Rebuild Mini ECU tokenized log output on the host.
+
+With LOG_TOKENIZED=1 the firmware sends binary frames instead of text
+lines (see Core/Inc/log.h):
+
+    0xFE | len | token (u32 LE) | stamp us (u64 LE) | args...
+
+The token is the offset of a "<L>\\x1f<module>\\x1f<format>" record in the
+ELF section ".log_fmt". This tool reads that section from the firmware ELF
+and turns each frame back into the text the firmware would have printed,
+the stamp (local time since boot) in seconds:
+
+    [12.345678][I][CAN] RX StdId=0x100 DLC=8
+
+The ELF marks that layout with a "V\\x1fLOG\\x1fstamp-us64" record; an ELF
+without it is from before, when frames carried the global time as u32
+milliseconds, and is decoded that way ("[I][CAN] ...  (@ 1234 ms)").
+
+Bytes outside frames (CLI prompts, echo, dashboard) are passed through.
+
+Usage:
+    log_decode.py mini_ecu_v2.elf capture.bin
+    log_decode.py mini_ecu_v2.elf --port /dev/ttyACM0 [--baud 115200]
+    cat capture.bin | log_decode.py mini_ecu_v2.elf
+
+A capture of the ITM stimulus port (log transport "itm", SWO) works the
+same as a UART capture.
+
+Only the Python standard library is needed; --port requires pyserial.
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+SYNC = 0xFE
+LAYOUT_US64 = b"V\x1fLOG\x1fstamp-us64\0"
+STR_SPECS = "s"
+FLOAT_SPECS = "fFeEgGaA"
+SIGNED_SPECS = "di"
+
+# printf conversion: flags, width, precision, length, conversion
+SPEC_RE = re.compile(r"%([-+ #0]*)(\d+|\*)?(\.\d+)?(hh|h|ll|l|j|z|t|L)?([diouxXcsfFeEgGaAp%])")
+
+
+# ---------------------------------------------------------------------------
+# ELF
+# ---------------------------------------------------------------------------
+
+def load_fmt_section(path):
+    """Return the raw bytes of the .log_fmt section of a 32-bit LE ELF."""
+    with open(path, "rb") as f:
+        elf = f.read()
+
+    if elf[:4] != b"\x7fELF" or elf[4] != 1 or elf[5] != 1:
+        raise SystemExit("%s: not a 32-bit little-endian ELF" % path)
+
+    e_shoff, = struct.unpack_from("<I", elf, 0x20)
+    e_shentsize, e_shnum, e_shstrndx = struct.unpack_from("<HHH", elf, 0x2E)
+
+    def section(i):
+        return struct.unpack_from("<IIIIIIIIII", elf, e_shoff + i * e_shentsize)
+
+    shstr = section(e_shstrndx)
+    names = elf[shstr[4]:shstr[4] + shstr[5]]
+
+    for i in range(e_shnum):
+        sh = section(i)
+        name = names[sh[0]:names.index(b"\0", sh[0])].decode()
+        if name == ".log_fmt":
+            return elf[sh[4]:sh[4] + sh[5]]
+
+    raise SystemExit("%s: no .log_fmt section (built without LOG_TOKENIZED?)" % path)
+
+
+def lookup(fmt_section, token):
+    """Return (level, module, format) for a token, or None."""
+    if token >= len(fmt_section):
+        return None
+    end = fmt_section.find(b"\0", token)
+    parts = fmt_section[token:end].decode(errors="replace").split("\x1f", 2)
+    if len(parts) != 3:
+        return None
+    return parts[0], parts[1], parts[2]
+
+
+# ---------------------------------------------------------------------------
+# Formatting
+# ---------------------------------------------------------------------------
+
+def render(fmt, payload):
+    """Apply the argument words in payload to a C format string."""
+    out = []
+    pos = 0
+    last = 0
+
+    for m in SPEC_RE.finditer(fmt):
+        out.append(fmt[last:m.start()])
+        last = m.end()
+        flags, width, prec, _length, conv = m.groups()
+
+        if conv == "%":
+            out.append("%")
+            continue
+
+        spec = "%" + flags + (width or "") + (prec or "")
+
+        try:
+            if conv in STR_SPECS:
+                n = payload[pos]
+                text = payload[pos + 1:pos + 1 + n].decode(errors="replace")
+                pos += 1 + n
+                out.append((spec + "s") % text)
+                continue
+
+            word, = struct.unpack_from("<I", payload, pos)
+            pos += 4
+        except (IndexError, struct.error):
+            out.append("<missing>")
+            continue
+
+        if conv in FLOAT_SPECS:
+            out.append((spec + conv) % struct.unpack("<f", struct.pack("<I", word))[0])
+        elif conv in SIGNED_SPECS:
+            out.append((spec + "d") % struct.unpack("<i", struct.pack("<I", word))[0])
+        elif conv == "c":
+            out.append((spec + "c") % chr(word & 0xFF))
+        elif conv == "p":
+            out.append("0x%08x" % word)
+        else:
+            out.append((spec + conv) % word)
+
+    out.append(fmt[last:])
+    return "".join(out)
+
+
+# ---------------------------------------------------------------------------
+# Stream decoder
+# ---------------------------------------------------------------------------
+
+class Decoder:
+    def __init__(self, fmt_section, out):
+        self.fmt = fmt_section
+        self.out = out
+        self.us64 = LAYOUT_US64 in fmt_section
+        self.head = 12 if self.us64 else 8
+        self.buf = bytearray()
+
+    def feed(self, data):
+        self.buf += data
+
+        while self.buf:
+            sync = self.buf.find(bytes([SYNC]))
+            if sync < 0:
+                self.text(self.buf)
+                self.buf.clear()
+                return
+            if sync > 0:
+                self.text(self.buf[:sync])
+                del self.buf[:sync]
+
+            if len(self.buf) < 2 or len(self.buf) < 2 + self.buf[1]:
+                return  # wait for the rest of the frame
+
+            n = self.buf[1]
+            frame = bytes(self.buf[2:2 + n])
+            del self.buf[:2 + n]
+            self.frame(frame)
+
+    def text(self, data):
+        self.out.write(data.decode(errors="replace"))
+        self.out.flush()
+
+    def frame(self, frame):
+        if len(frame) < self.head:
+            self.out.write("[?][LOG] short frame\r\n")
+            return
+
+        if self.us64:
+            token, us = struct.unpack_from("<IQ", frame, 0)
+            stamp, suffix = "[%u.%06u]" % (us // 1000000, us % 1000000), ""
+        else:
+            token, ms = struct.unpack_from("<II", frame, 0)
+            stamp, suffix = "", "  (@ %u ms)" % ms
+        entry = lookup(self.fmt, token)
+        if entry is None:
+            self.out.write("%s[?][LOG] unknown token 0x%x%s\r\n" % (stamp, token, suffix))
+            return
+
+        level, module, fmt = entry
+        self.out.write("%s[%s][%s] %s%s\r\n"
+                       % (stamp, level, module, render(fmt, frame[self.head:]), suffix))
+        self.out.flush()
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Decode Mini ECU tokenized logs.")
+    ap.add_argument("elf", help="firmware ELF built with LOG_TOKENIZED=1")
+    ap.add_argument("input", nargs="?", help="captured UART stream (default: stdin)")
+    ap.add_argument("--port", help="read live from a serial port (needs pyserial)")
+    ap.add_argument("--baud", type=int, default=115200)
+    args = ap.parse_args()
+
+    dec = Decoder(load_fmt_section(args.elf), sys.stdout)
+
+    if args.port:
+        import serial  # pylint: disable=import-outside-toplevel
+        with serial.Serial(args.port, args.baud, timeout=0.1) as ser:
+            while True:
+                dec.feed(ser.read(256))
+    else:
+        src = open(args.input, "rb") if args.input else sys.stdin.buffer
+        with src:
+            while True:
+                chunk = src.read(256)
+                if not chunk:
+                    break
+                dec.feed(chunk)
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except KeyboardInterrupt:
+        pass
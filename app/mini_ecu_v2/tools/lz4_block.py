@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""
+lz4_block.py - LZ4 block format (no frame header) for compressed updates.
+
+The bootloader's ZWRITE decodes the stream into the slot it is writing
+(boot_update.h): a match may reach back to any byte already in the slot,
+including the kept sectors in front of the first rewritten one, so the
+compressor takes those as a dictionary:
+
+    stream = lz4_block.compress(image, begin)      # encodes image[begin:]
+    assert lz4_block.decompress(stream, len(image) - begin, image[:begin]) \\
+        == image[begin:]
+
+Greedy parse over hash chains of 4-byte sequences (CHAIN candidates per
+position), offsets up to 65535, the end rules of the format (the last 5
+bytes are literals, no match starts in the last 12). Pure Python, so any
+LZ4 block decoder reads the output and no module has to be installed.
+
+    lz4_block.py mini_ecu_v2.bin        # ratio and time of one image
+"""
+
+import sys
+import time
+
+MIN_MATCH = 4
+MAX_DIST = 65535
+LAST_LITERALS = 5
+MF_LIMIT = 12
+CHAIN = 32
+
+
+def _length(out, n):
+    """Extra length bytes after a nibble of 15."""
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+
+def _sequence(out, lit, match_len, dist):
+    """One sequence: token, literals, and (match_len > 0) offset and length."""
+    ml = match_len - MIN_MATCH if match_len else 0
+    out.append((min(len(lit), 15) << 4) | min(ml, 15))
+    if len(lit) >= 15:
+        _length(out, len(lit) - 15)
+    out += lit
+    if match_len:
+        out += bytes((dist & 0xFF, dist >> 8))
+        if ml >= 15:
+            _length(out, ml - 15)
+
+
+def compress(data, begin=0, chain=CHAIN):
+    """LZ4 block of data[begin:]; data[:begin] may be matched against."""
+    data = bytes(data)
+    end = len(data)
+    limit = end - MF_LIMIT          # last position a match may start at
+    heads = {}                      # 4-byte key -> positions, newest last
+    out = bytearray()
+
+    def insert(p):
+        key = data[p:p + 4]
+        bucket = heads.get(key)
+        if bucket is None:
+            heads[key] = [p]
+        else:
+            bucket.append(p)
+            if len(bucket) > chain:
+                del bucket[0]
+
+    for p in range(max(0, begin - MAX_DIST), begin):
+        if p + 4 <= end:
+            insert(p)
+
+    anchor = pos = begin
+    while pos < limit:
+        best_len, best_dist = 0, 0
+        for cand in reversed(heads.get(data[pos:pos + 4], ())):
+            dist = pos - cand
+            if dist > MAX_DIST:
+                break
+            n = 0
+            top = end - LAST_LITERALS - pos
+            while n < top and data[cand + n] == data[pos + n]:
+                n += 1
+            if n > best_len:
+                best_len, best_dist = n, dist
+        if best_len < MIN_MATCH:
+            insert(pos)
+            pos += 1
+            continue
+        _sequence(out, data[anchor:pos], best_len, best_dist)
+        for p in range(pos, min(pos + best_len, limit)):
+            insert(p)
+        pos += best_len
+        anchor = pos
+
+    _sequence(out, data[anchor:end], 0, 0)
+    return bytes(out)
+
+
+def decompress(stream, size, history=b""):
+    """Decode size bytes of an LZ4 block; matches may reach into history."""
+    out = bytearray(history)
+    start = len(out)
+    i = 0
+    while len(out) - start < size:
+        token = stream[i]
+        i += 1
+        lit = token >> 4
+        if lit == 15:
+            while True:
+                lit += stream[i]
+                i += 1
+                if stream[i - 1] != 255:
+                    break
+        out += stream[i:i + lit]
+        i += lit
+        if len(out) - start >= size:
+            break
+        dist = stream[i] | (stream[i + 1] << 8)
+        i += 2
+        n = token & 15
+        if n == 15:
+            while True:
+                n += stream[i]
+                i += 1
+                if stream[i - 1] != 255:
+                    break
+        n += MIN_MATCH
+        if dist == 0 or dist > len(out):
+            raise ValueError("offset %u at stream byte %u" % (dist, i))
+        for _ in range(n):
+            out.append(out[-dist])
+    if len(out) - start != size:
+        raise ValueError("decoded %u of %u bytes" % (len(out) - start, size))
+    return bytes(out[start:])
+
+
+def main():
+    for path in sys.argv[1:]:
+        with open(path, "rb") as f:
+            data = f.read()
+        t0 = time.monotonic()
+        stream = compress(data)
+        seconds = time.monotonic() - t0
+        assert decompress(stream, len(data)) == data
+        print("%s: %u -> %u B (%.1f %%) in %.2f s"
+              % (path, len(data), len(stream), 100.0 * len(stream) / max(len(data), 1), seconds))
+
+
+if __name__ == "__main__":
+    main()
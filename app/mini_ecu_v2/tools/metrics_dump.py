@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+"""
+metrics_dump.py - Decode a Mini ECU "metrics dump" from the console UART.
+
+"metrics dump" (see Core/Inc/metrics.h) sends the metrics registry as
+binary frames on the telemetry stream, framed like "tlm" (tlm_plot.py):
+
+    0x00 | COBS(type | payload | CRC-16/CCITT-FALSE, little-endian) | 0x00
+
+    'N'  version (u8), index (u8), count (u8), kind (u8: 0 counter,
+         1 gauge, 2 histogram), words (u8), shift (u8), name (u8 length +
+         text), unit (u8 length + text); one per metric
+    'V'  tick ms (u32), first word (u16), total words (u16), then the
+         words (u32) of the snapshot from the first one on
+
+The metric words follow each other in 'N' order. This tool prints each
+metric once a dump is complete: a counter, a gauge with its peak, a
+histogram with its buckets ("<8:12" = 12 values below 8, ">=512:1" the last
+bucket).
+
+Usage:
+    metrics_dump.py --port /dev/ttyACM0
+    metrics_dump.py capture.bin --json metrics.json
+
+Console text and other frames in the capture are ignored. Only the Python
+standard library is needed; --port requires pyserial.
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from tlm_plot import cobs_decode, crc16  # noqa: E402
+
+NAME = b"N"
+VALUES = b"V"
+DUMP_VERSION = 1
+KINDS = ("counter", "gauge", "hist")
+
+
+class Dump:
+    def __init__(self):
+        self.buf = bytearray()
+        self.names = {}
+        self.count = None
+        self.words = None
+        self.tick = None
+        self.done = []          # complete dumps: (tick, [metric dict])
+
+    def feed(self, data):
+        self.buf += data
+        while True:
+            end = self.buf.find(b"\x00")
+            if end < 0:
+                return
+            chunk = bytes(self.buf[:end])
+            del self.buf[:end + 1]
+            if chunk:
+                self.chunk(chunk)
+
+    def chunk(self, chunk):
+        raw = cobs_decode(chunk)
+        if raw is None or len(raw) < 3 or crc16(raw[:-2]) != struct.unpack_from("<H", raw, len(raw) - 2)[0]:
+            return
+        kind, body = raw[:1], raw[1:-2]
+        if kind == NAME:
+            self.name(body)
+        elif kind == VALUES:
+            self.values(body)
+
+    def name(self, body):
+        version, index, count, kind, words, shift = struct.unpack_from("<6B", body)
+        if version != DUMP_VERSION:
+            raise SystemExit("unsupported metrics dump version %u" % version)
+        pos = 6
+        name = body[pos + 1:pos + 1 + body[pos]].decode()
+        pos += 1 + body[pos]
+        unit = body[pos + 1:pos + 1 + body[pos]].decode()
+        if index == 0 or count != self.count:
+            self.names, self.count, self.words = {}, count, None
+        self.names[index] = {"name": name, "kind": KINDS[kind] if kind < len(KINDS) else str(kind),
+                             "unit": unit, "words": words, "shift": shift}
+
+    def values(self, body):
+        tick, first, total = struct.unpack_from("<IHH", body)
+        n = (len(body) - 8) // 4
+        if first == 0 or self.words is None or len(self.words) != total or tick != self.tick:
+            self.words, self.tick, self.have = [None] * total, tick, 0
+            if first != 0:
+                return
+        for i, w in enumerate(struct.unpack_from("<%uI" % n, body, 8)):
+            if first + i < total and self.words[first + i] is None:
+                self.words[first + i] = w
+                self.have += 1
+        if self.have == total and self.count is not None and len(self.names) == self.count:
+            self.done.append((tick, self.metrics()))
+            self.words = None
+
+    def metrics(self):
+        out = []
+        slot = 0
+        for i in range(self.count):
+            m = dict(self.names[i])
+            w = self.words[slot:slot + m["words"]]
+            slot += m["words"]
+            if m["kind"] == "gauge":
+                m["value"], m["peak"] = w[0], w[1]
+            elif m["kind"] == "hist":
+                m["buckets"] = w
+            else:
+                m["value"] = w[0]
+            out.append(m)
+        return out
+
+
+def bucket_text(m):
+    parts = []
+    last = len(m["buckets"]) - 1
+    for b, n in enumerate(m["buckets"]):
+        if n == 0:
+            continue
+        if b == last:
+            parts.append(">=%u:%u" % (1 << (m["shift"] + b - 1), n))
+        else:
+            parts.append("<%u:%u" % (1 << (m["shift"] + b), n))
+    return " ".join(parts)
+
+
+def show(tick, metrics):
+    print("metrics at %u ms" % tick)
+    for m in metrics:
+        if m["kind"] == "gauge":
+            print("  %-20s gauge   %10u  %s, peak %u" % (m["name"], m["value"], m["unit"], m["peak"]))
+        elif m["kind"] == "hist":
+            print("  %-20s hist    %10u  samples of %s  %s"
+                  % (m["name"], sum(m["buckets"]), m["unit"], bucket_text(m)))
+        else:
+            print("  %-20s %-7s %10u  %s" % (m["name"], m["kind"], m["value"], m["unit"]))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Decode a Mini ECU \"metrics dump\".")
+    ap.add_argument("input", nargs="?", help="captured UART stream (default: stdin)")
+    ap.add_argument("--port", help="send \"metrics dump\" on a serial port (needs pyserial)")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("--wait", type=float, default=2.0, help="seconds to wait for the dump")
+    ap.add_argument("--json", help="write the last dump as JSON")
+    args = ap.parse_args()
+
+    dump = Dump()
+    if args.port:
+        import serial  # pylint: disable=import-outside-toplevel
+        with serial.Serial(args.port, args.baud, timeout=0.05) as ser:
+            ser.write(b"\r\nmetrics dump\r\n")
+            end = time.monotonic() + args.wait
+            while not dump.done and time.monotonic() < end:
+                dump.feed(ser.read(1024))
+    else:
+        src = open(args.input, "rb") if args.input else sys.stdin.buffer
+        with src:
+            dump.feed(src.read())
+
+    if not dump.done:
+        sys.stderr.write("metrics_dump: no complete dump\n")
+        return 1
+    for tick, metrics in dump.done:
+        show(tick, metrics)
+    if args.json:
+        tick, metrics = dump.done[-1]
+        with open(args.json, "w") as f:
+            json.dump({"tick_ms": tick, "metrics": metrics}, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
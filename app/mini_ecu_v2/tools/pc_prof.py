@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+"""
+pc_prof.py - Turn a Mini ECU "prof dump" into a flat profile per function.
+
+The PC-sampling profiler (see Core/Inc/pc_prof.h) counts the interrupted
+PC in bins of code addresses. "prof dump" prints them as text lines:
+
+    prof dump <period us> <samples> <thread> <other>
+    prof region <name> <base hex> <bin bytes> <bins>
+    prof bin <address hex> <samples>
+    prof exc <exception number> <samples>
+    prof end <lines>
+
+This tool reads those lines from a console capture and, given the firmware
+ELF, shares every bin out among the functions it overlaps (by bytes, so a
+bin across two small functions is split between them) and prints the
+functions by share of the samples, HAL, FreeRTOS and libc included, then
+the share of every interrupt. Without the ELF it prints the bins by
+address. --bins N also lists the N hottest bins, with file:line when
+arm-none-eabi-addr2line is on the PATH.
+
+Capture "prof start", the load, "prof stop" and "prof dump" on the
+console, then:
+
+Usage:
+    pc_prof.py capture.txt --elf build/debug/mini_ecu_v2.elf
+    pc_prof.py capture.txt --elf mini_ecu_v2.elf --top 40 --bins 10
+    cat capture.txt | pc_prof.py
+
+Other lines in the capture are ignored. Only the Python standard library
+is needed.
+"""
+
+import argparse
+import bisect
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from crash_decode import Symbols  # noqa: E402
+from rtos_trace import IRQ_NAMES  # noqa: E402
+
+EXC_NAMES = {2: "NMI", 3: "HardFault", 4: "MemManage", 5: "BusFault", 6: "UsageFault",
+             11: "SVCall", 12: "DebugMon", 14: "PendSV", 15: "SysTick"}
+EXC_NAMES.update(IRQ_NAMES)
+
+
+class Profile:
+    def __init__(self):
+        self.period_us = 0
+        self.samples = 0
+        self.thread = 0
+        self.other = 0
+        self.regions = []       # (name, base, width)
+        self.bins = []          # (address, width, region, samples)
+        self.exc = {}
+        self.lines = 0
+        self.end = None
+
+    def line(self, words):
+        kind = words[1]
+        self.lines += 1
+        if kind == "dump":
+            self.__init__()
+            self.lines = 1
+            self.period_us, self.samples, self.thread, self.other = map(int, words[2:6])
+        elif kind == "region":
+            self.regions.append((words[2], int(words[3], 16), int(words[4])))
+        elif kind == "bin" and self.regions:
+            name, _, width = self.regions[-1]
+            self.bins.append((int(words[2], 16), width, name, int(words[3])))
+        elif kind == "exc":
+            self.exc[int(words[2])] = int(words[3])
+        elif kind == "end":
+            self.end = int(words[2])
+
+
+def read_profile(src):
+    prof = Profile()
+    for raw in src:
+        words = raw.strip().split()
+        if len(words) < 3 or words[0] != "prof":
+            continue
+        try:
+            prof.line(words)
+        except (ValueError, IndexError):
+            continue
+    if prof.samples == 0:
+        raise SystemExit("no \"prof dump\" with samples in the input")
+    if prof.end != prof.lines:
+        sys.stderr.write("pc_prof: dump incomplete (%u of %s lines); the totals are short\n"
+                         % (prof.lines, prof.end if prof.end is not None else "?"))
+    return prof
+
+
+def by_function(prof, syms):
+    """Samples per function name, shared out by the bytes each bin overlaps."""
+    counts = {}
+    for addr, width, region, samples in prof.bins:
+        end = addr + width
+        parts = []
+        i = max(bisect.bisect_right(syms.addrs, addr) - 1, 0)
+        while i < len(syms.syms) and syms.syms[i][0] < end:
+            start, size, name = syms.syms[i]
+            lo, hi = max(start, addr), min(start + max(size, 2), end)
+            if hi > lo:
+                parts.append((name, hi - lo))
+            i += 1
+        if not parts:
+            parts = [("(%s 0x%08x, no symbol)" % (region, addr), width)]
+        total = sum(n for _, n in parts)
+        for name, n in parts:
+            counts[name] = counts.get(name, 0.0) + samples * n / total
+    return counts
+
+
+def pct(n, total):
+    return 100.0 * n / total if total else 0.0
+
+
+def report(prof, syms, top, bins, out):
+    hz = 1e6 / prof.period_us if prof.period_us else 0
+    out.write("%u samples at %.0f Hz (%.1f s); tasks %.1f %%, interrupts %.1f %%, "
+              "outside the code %.1f %%\n\n"
+              % (prof.samples, hz, prof.samples / hz if hz else 0, pct(prof.thread, prof.samples),
+                 pct(prof.samples - prof.thread, prof.samples), pct(prof.other, prof.samples)))
+
+    if syms is not None:
+        rows = sorted(by_function(prof, syms).items(), key=lambda kv: -kv[1])
+        out.write("     %    cum %   samples  function\n")
+        cum = 0.0
+        for name, n in rows[:top]:
+            cum += n
+            out.write("%6.2f  %6.2f  %8.0f  %s\n" % (pct(n, prof.samples), pct(cum, prof.samples),
+                                                     n, name))
+        if len(rows) > top:
+            out.write("  ... %u more functions\n" % (len(rows) - top))
+    else:
+        out.write("     %   samples  region   bin\n")
+        for addr, width, region, n in sorted(prof.bins, key=lambda b: -b[3])[:top]:
+            out.write("%6.2f  %8u  %-7s  0x%08x..0x%08x\n" % (pct(n, prof.samples), n, region,
+                                                            addr, addr + width - 1))
+
+    if bins:
+        out.write("\nHottest bins:\n")
+        for addr, width, region, n in sorted(prof.bins, key=lambda b: -b[3])[:bins]:
+            where = syms.name(addr + width // 2) if syms is not None else None
+            out.write("%6.2f  %8u  0x%08x +%-4u %s\n" % (pct(n, prof.samples), n, addr, width,
+                                                         where or region))
+
+    irqs = sorted(((n, e) for e, n in prof.exc.items() if e != 0), reverse=True)
+    if irqs:
+        out.write("\nInterrupts and exceptions:\n")
+        for n, e in irqs:
+            name = EXC_NAMES.get(e, "IRQ %u" % (e - 16) if e >= 16 else "exception %u" % e)
+            out.write("%6.2f  %8u  %s\n" % (pct(n, prof.samples), n, name))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Flat profile from a Mini ECU \"prof dump\".")
+    ap.add_argument("input", nargs="?", help="console capture (default: stdin)")
+    ap.add_argument("--elf", help="firmware ELF, to name the functions")
+    ap.add_argument("--top", type=int, default=30, help="functions (or bins) listed (default 30)")
+    ap.add_argument("--bins", type=int, default=0, help="also list the N hottest bins")
+    args = ap.parse_args()
+
+    src = open(args.input, errors="replace") if args.input else sys.stdin
+    with src:
+        prof = read_profile(src)
+
+    syms = Symbols(args.elf) if args.elf else None
+    report(prof, syms, args.top, args.bins, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
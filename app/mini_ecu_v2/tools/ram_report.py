@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""
+ram_report.py - Link-time RAM usage report for the Mini ECU firmware.
+
+Reads the linked ELF and prints:
+  - every RAM section (.data, .bss, ._user_heap_stack, ...) and the total
+    against the device SRAM size,
+  - the statically allocated RTOS objects (task control blocks and stacks,
+    queue storage, the idle/timer task memory and the heap_4 pool if present),
+  - optionally the largest other RAM objects (--top N).
+
+With RTOS_STATIC_ALLOC=1 the "FreeRTOS heap" line should read 0 B: every
+kernel object is then visible here as its own symbol.
+
+Usage:
+    ram_report.py Debug/mini_ecu_v2.elf [--ram 131072] [--top 10]
+
+Only the Python standard library is needed.
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+SHF_WRITE = 0x1
+SHF_ALLOC = 0x2
+SHT_SYMTAB = 2
+STT_OBJECT = 1
+
+# Symbols that hold RTOS kernel memory.
+RTOS_RE = re.compile(r"(_cb|_stack|Stack|_TCB|ucHeap|QueueCb|QueueMem|xQueueRegistry)$")
+
+
+# ---------------------------------------------------------------------------
+# ELF
+# ---------------------------------------------------------------------------
+
+def load_elf(path):
+    """Return (RAM sections, RAM object symbols) of a 32-bit LE ELF."""
+    with open(path, "rb") as f:
+        elf = f.read()
+
+    if elf[:4] != b"\x7fELF" or elf[4] != 1 or elf[5] != 1:
+        raise SystemExit("%s: not a 32-bit little-endian ELF" % path)
+
+    e_shoff, = struct.unpack_from("<I", elf, 0x20)
+    e_shentsize, e_shnum, e_shstrndx = struct.unpack_from("<HHH", elf, 0x2E)
+
+    def section(i):
+        return struct.unpack_from("<IIIIIIIIII", elf, e_shoff + i * e_shentsize)
+
+    def cstr(table, off):
+        return table[off:table.index(b"\0", off)].decode(errors="replace")
+
+    shdrs = [section(i) for i in range(e_shnum)]
+    shstr = shdrs[e_shstrndx]
+    names = elf[shstr[4]:shstr[4] + shstr[5]]
+
+    ram = {}
+    for i, sh in enumerate(shdrs):
+        flags, size = sh[2], sh[5]
+        if (flags & SHF_ALLOC) and (flags & SHF_WRITE) and size > 0:
+            ram[i] = (cstr(names, sh[0]), sh[3], size)
+
+    symbols = []
+    for sh in shdrs:
+        if sh[1] != SHT_SYMTAB:
+            continue
+        strtab = shdrs[sh[6]]
+        strs = elf[strtab[4]:strtab[4] + strtab[5]]
+        for off in range(sh[4], sh[4] + sh[5], sh[9]):
+            st_name, st_value, st_size, st_info, _, st_shndx = \
+                struct.unpack_from("<IIIBBH", elf, off)
+            if (st_info & 0xF) == STT_OBJECT and st_shndx in ram and st_size > 0:
+                symbols.append((cstr(strs, st_name), st_value, st_size))
+
+    return list(ram.values()), symbols
+
+
+# ---------------------------------------------------------------------------
+# Report
+# ---------------------------------------------------------------------------
+
+def report(sections, symbols, ram_size, top, out):
+    total = sum(size for _, _, size in sections)
+
+    out.write("RAM sections\n")
+    for name, addr, size in sorted(sections, key=lambda s: s[1]):
+        out.write("  %-20s 0x%08X %8u B\n" % (name, addr, size))
+    out.write("  %-20s %10s %8u B of %u B (%.1f %%)\n\n"
+              % ("total", "", total, ram_size, 100.0 * total / ram_size))
+
+    rtos = sorted((s for s in symbols if RTOS_RE.search(s[0])), key=lambda s: -s[2])
+    heap = sum(size for name, _, size in rtos if name == "ucHeap")
+
+    out.write("RTOS objects\n")
+    for name, addr, size in rtos:
+        out.write("  %-28s 0x%08X %8u B\n" % (name, addr, size))
+    out.write("  %-28s %10s %8u B\n" % ("total", "", sum(s[2] for s in rtos)))
+    out.write("  %-28s %10s %8u B\n" % ("FreeRTOS heap (ucHeap)", "", heap))
+
+    if top > 0:
+        others = sorted((s for s in symbols if not RTOS_RE.search(s[0])),
+                        key=lambda s: -s[2])[:top]
+        out.write("\nLargest other RAM objects\n")
+        for name, addr, size in others:
+            out.write("  %-28s 0x%08X %8u B\n" % (name, addr, size))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Report Mini ECU RAM usage from the ELF.")
+    ap.add_argument("elf", help="linked firmware ELF")
+    ap.add_argument("--ram", type=int, default=128 * 1024,
+                    help="device SRAM size in bytes (STM32F446RE: 131072)")
+    ap.add_argument("--top", type=int, default=10,
+                    help="also list the N largest non-RTOS objects (0 = off)")
+    args = ap.parse_args()
+
+    sections, symbols = load_elf(args.elf)
+    report(sections, symbols, args.ram, args.top, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
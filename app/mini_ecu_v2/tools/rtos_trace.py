@@ -0,0 +1,302 @@
+#!/usr/bin/env python3
+"""
+rtos_trace.py - Turn a Mini ECU "rtos trace dump" capture into a timeline.
+
+The dump (see Core/Inc/rtos_trace.h) is a sequence of frames mixed into
+the normal console output, over the UART, SWO or the RAM log capture:
+
+    0xFC | len | type | payload
+
+    'H'  version (u8), record size (u16), records (u32), overwritten (u32),
+         core clock Hz (u32), tick Hz (u32)
+    'T'  task number (u8), priority (u8), name
+    'Q'  queue number (u8), type (u8), length (u16), name
+    'R'  records: cycles (u32), event (u8), obj (u8), arg (u16)
+    'E'  records sent (u32)
+
+Everything outside the frames (CLI prompt, log lines, the 0xFD frames of
+"can trace dump bin" and the 0xFE frames of tokenized logging) is skipped.
+
+The output is Chrome trace event JSON; open it in https://ui.perfetto.dev
+or chrome://tracing. It has a "CPU" track with the running task, one track
+per task with its running and ready (waiting for the CPU) times and its
+kernel calls, an "Interrupts" track and a counter per queue. A summary of
+CPU share, switches, ready latency and interrupt times goes to stderr.
+
+Usage:
+    rtos_trace.py capture.bin [-o trace.json]
+    rtos_trace.py --port /dev/ttyACM0 [--baud 115200] -o trace.json
+    cat capture.bin | rtos_trace.py > trace.json
+
+Only the Python standard library is needed; --port requires pyserial.
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+SYNC = 0xFC
+OTHER_SYNCS = (0xFD, 0xFE)  # can_trace, tokenized log
+
+REC = struct.Struct("<IBBH")
+HDR = struct.Struct("<BHIIII")
+
+# RTOS_TRACE_EVENT_TABLE
+EVENTS = ["SWITCH_IN", "READY", "DELAY", "NOTIFY", "NOTIFY_ISR", "NOTIFY_WAIT",
+          "QUEUE_SEND", "QUEUE_SEND_ISR", "QUEUE_RECV", "QUEUE_RECV_ISR",
+          "QUEUE_BLOCK_SEND", "QUEUE_BLOCK_RECV", "QUEUE_FAIL",
+          "ISR_ENTER", "ISR_EXIT", "TICK"]
+EV = {name: i for i, name in enumerate(EVENTS)}
+
+# queueQUEUE_TYPE_*
+QUEUE_TYPES = ["queue", "mutex", "counting semaphore", "binary semaphore",
+               "recursive mutex"]
+
+# Exception numbers (IPSR) of the handlers in stm32f4xx_it.c
+IRQ_NAMES = {
+    15: "SysTick", 19: "RTC_WKUP", 32: "DMA1_Stream5 (USART2 RX)",
+    33: "DMA1_Stream6 (USART2 TX)", 35: "CAN1_TX", 36: "CAN1_RX0", 37: "CAN1_RX1",
+    38: "CAN1_SCE", 54: "USART2", 56: "EXTI15_10", 66: "TIM5", 71: "TIM7",
+    72: "DMA2_Stream0 (ADC1)",
+}
+
+PID = 1
+TID_CPU = 1
+TID_IRQ = 2
+TID_TASK = 100
+
+
+class Decoder:
+    def __init__(self):
+        self.buf = bytearray()
+        self.header = None
+        self.tasks = {}
+        self.queues = {}
+        self.recs = []
+        self.sent = None
+        self.done = False
+
+    def feed(self, data):
+        self.buf += data
+        while self.buf:
+            starts = [self.buf.find(bytes([s])) for s in (SYNC,) + OTHER_SYNCS]
+            starts = [i for i in starts if i >= 0]
+            if not starts:
+                self.buf.clear()
+                return
+            del self.buf[:min(starts)]
+
+            if len(self.buf) < 2 or len(self.buf) < 2 + self.buf[1]:
+                return  # wait for the rest of the frame
+
+            sync, n = self.buf[0], self.buf[1]
+            frame = bytes(self.buf[2:2 + n])
+            del self.buf[:2 + n]
+            if sync == SYNC and frame:
+                self.frame(frame[0:1], frame[1:])
+
+    def frame(self, kind, payload):
+        if kind == b"H" and len(payload) >= HDR.size:
+            version, rec_size, count, overwritten, clock, tick = HDR.unpack_from(payload)
+            if version != 1 or rec_size != REC.size:
+                raise SystemExit("unsupported trace format (version %u, %u-byte records)"
+                                 % (version, rec_size))
+            self.header = {"count": count, "overwritten": overwritten,
+                           "clock": clock, "tick": tick}
+            self.tasks, self.queues, self.recs = {}, {}, []
+        elif kind == b"T" and len(payload) >= 2:
+            self.tasks[payload[0]] = (payload[2:].decode(errors="replace"), payload[1])
+        elif kind == b"Q" and len(payload) >= 4:
+            length, = struct.unpack_from("<H", payload, 2)
+            self.queues[payload[0]] = (payload[4:].decode(errors="replace"), payload[1], length)
+        elif kind == b"R":
+            for off in range(0, len(payload) - REC.size + 1, REC.size):
+                self.recs.append(REC.unpack_from(payload, off))
+        elif kind == b"E" and len(payload) >= 4:
+            self.sent, = struct.unpack_from("<I", payload)
+            self.done = True
+
+
+class Timeline:
+    """Build the trace events and the summary from the records."""
+
+    def __init__(self, dec):
+        self.dec = dec
+        self.clock = dec.header["clock"] or 180000000
+        self.events = []
+        self.run = {}         # task -> cycles running
+        self.switches = {}    # task -> times switched in
+        self.ready_max = {}   # task -> longest ready -> running (cycles)
+        self.irq = {}         # exception -> [count, cycles, max cycles]
+
+    def task_name(self, num):
+        name = self.dec.tasks.get(num, ("task %u" % num, 0))[0]
+        return name or ("task %u" % num)
+
+    def queue_name(self, num):
+        if num == 0:
+            return "queue ?"
+        name, qtype, _ = self.dec.queues.get(num, ("", 0, 0))
+        if name:
+            return name
+        kind = QUEUE_TYPES[qtype] if qtype < len(QUEUE_TYPES) else "queue"
+        return "%s %u" % (kind, num)
+
+    def us(self, cycles):
+        return cycles * 1e6 / self.clock
+
+    def add(self, **ev):
+        ev.setdefault("pid", PID)
+        self.events.append(ev)
+
+    def build(self):
+        tasks = self.dec.tasks
+        self.add(ph="M", name="process_name", args={"name": "Mini ECU"})
+        self.add(ph="M", name="thread_name", tid=TID_CPU, args={"name": "CPU"})
+        self.add(ph="M", name="thread_name", tid=TID_IRQ, args={"name": "Interrupts"})
+        for num, (name, prio) in tasks.items():
+            self.add(ph="M", name="thread_name", tid=TID_TASK + num,
+                     args={"name": "%s (prio %u)" % (name, prio)})
+            self.add(ph="M", name="thread_sort_index", tid=TID_TASK + num, args={"sort_index": -prio})
+
+        now = 0
+        prev = None
+        running = None        # (task, since)
+        ready = {}            # task -> since
+        irq_stack = []        # (exception, since)
+
+        for cycles, event, obj, arg in self.dec.recs:
+            if prev is not None:
+                now += (cycles - prev) & 0xFFFFFFFF
+            prev = cycles
+            ts = self.us(now)
+            name = EVENTS[event] if event < len(EVENTS) else "event %u" % event
+            cur = running[0] if running else None
+
+            if event == EV["SWITCH_IN"]:
+                if running:
+                    self.slice(TID_CPU, self.task_name(running[0]), running[1], now)
+                    self.slice(TID_TASK + running[0], "running", running[1], now)
+                    self.run[running[0]] = self.run.get(running[0], 0) + now - running[1]
+                if obj in ready:
+                    self.slice(TID_TASK + obj, "ready", ready[obj], now)
+                    wait = now - ready.pop(obj)
+                    self.ready_max[obj] = max(self.ready_max.get(obj, 0), wait)
+                self.switches[obj] = self.switches.get(obj, 0) + 1
+                running = (obj, now)
+            elif event == EV["READY"]:
+                if obj != cur:
+                    ready.setdefault(obj, now)
+            elif event == EV["ISR_ENTER"]:
+                irq_stack.append((obj, now))
+            elif event == EV["ISR_EXIT"]:
+                if irq_stack and irq_stack[-1][0] == obj:
+                    exc, since = irq_stack.pop()
+                    self.slice(TID_IRQ, IRQ_NAMES.get(exc, "exception %u" % exc), since, now)
+                    st = self.irq.setdefault(exc, [0, 0, 0])
+                    st[0] += 1
+                    st[1] += now - since
+                    st[2] = max(st[2], now - since)
+            elif event == EV["TICK"]:
+                pass
+            else:
+                self.kernel_call(event, name, obj, arg, ts, cur, bool(irq_stack))
+
+        if running:
+            self.slice(TID_CPU, self.task_name(running[0]), running[1], now)
+            self.slice(TID_TASK + running[0], "running", running[1], now)
+            self.run[running[0]] = self.run.get(running[0], 0) + now - running[1]
+        self.total = now
+
+    def slice(self, tid, name, start, end):
+        self.add(ph="X", tid=tid, name=name, ts=self.us(start), dur=self.us(end - start))
+
+    def kernel_call(self, event, name, obj, arg, ts, cur, in_isr):
+        tid = TID_IRQ if (in_isr or name.endswith("_ISR") or cur is None) else TID_TASK + cur
+        label = name.lower().replace("_", " ")
+        args = {}
+
+        if name.startswith("QUEUE"):
+            qname = self.queue_name(obj)
+            label += " " + qname
+            args["items before"] = arg
+            if name in ("QUEUE_SEND", "QUEUE_SEND_ISR"):
+                self.add(ph="C", name=qname, ts=ts, args={"items": arg + 1})
+            elif name in ("QUEUE_RECV", "QUEUE_RECV_ISR"):
+                self.add(ph="C", name=qname, ts=ts, args={"items": max(arg - 1, 0)})
+        elif name.startswith("NOTIFY"):
+            label += " " + self.task_name(obj)
+            if name == "NOTIFY_WAIT":
+                tid = TID_TASK + obj
+        elif name == "DELAY":
+            label += " %u ticks" % arg
+            tid = TID_TASK + obj
+
+        self.add(ph="i", s="t", tid=tid, name=label, ts=ts, args=args)
+
+    def summary(self, out):
+        total = self.total or 1
+        out.write("trace: %.3f ms, %u events\n" % (self.us(self.total) / 1000.0, len(self.dec.recs)))
+        out.write("  %-16s %6s %9s %14s\n" % ("task", "cpu %", "switches", "max ready us"))
+        for num in sorted(set(self.run) | set(self.switches)):
+            out.write("  %-16s %6.1f %9u %14.1f\n"
+                      % (self.task_name(num), 100.0 * self.run.get(num, 0) / total,
+                         self.switches.get(num, 0), self.us(self.ready_max.get(num, 0))))
+        if self.irq:
+            out.write("  %-26s %7s %8s %9s\n" % ("interrupt", "count", "cpu %", "max us"))
+            for exc in sorted(self.irq):
+                count, cycles, longest = self.irq[exc]
+                out.write("  %-26s %7u %8.2f %9.1f\n"
+                          % (IRQ_NAMES.get(exc, "exception %u" % exc), count,
+                             100.0 * cycles / total, self.us(longest)))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Decode a Mini ECU kernel trace dump.")
+    ap.add_argument("input", nargs="?", help="captured console stream (default: stdin)")
+    ap.add_argument("-o", "--output", help="Chrome trace JSON file (default: stdout)")
+    ap.add_argument("--port", help="read live from a serial port (needs pyserial)")
+    ap.add_argument("--baud", type=int, default=115200)
+    args = ap.parse_args()
+
+    dec = Decoder()
+    if args.port:
+        import serial  # pylint: disable=import-outside-toplevel
+        with serial.Serial(args.port, args.baud, timeout=0.1) as ser:
+            while not dec.done:
+                dec.feed(ser.read(256))
+    else:
+        src = open(args.input, "rb") if args.input else sys.stdin.buffer
+        with src:
+            while not dec.done:
+                chunk = src.read(256)
+                if not chunk:
+                    break
+                dec.feed(chunk)
+
+    if dec.header is None:
+        raise SystemExit("no trace header in the input")
+    if not dec.done:
+        sys.stderr.write("trace: no end frame, dump incomplete\n")
+    elif dec.sent != len(dec.recs):
+        sys.stderr.write("trace: %u of %u records received\n" % (len(dec.recs), dec.sent))
+    if dec.header["overwritten"]:
+        sys.stderr.write("trace: %u older events overwritten\n" % dec.header["overwritten"])
+
+    tl = Timeline(dec)
+    tl.build()
+
+    out = open(args.output, "w") if args.output else sys.stdout
+    with out:
+        json.dump({"traceEvents": tl.events, "displayTimeUnit": "ns"}, out)
+        out.write("\n")
+    tl.summary(sys.stderr)
+    return 0 if dec.done else 1
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(main())
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+"""
+size_report.py - Flash/RAM footprint and per-symbol breakdown of a firmware ELF.
+
+Reads a linked 32-bit ARM ELF (application or bootloader) and prints:
+  - flash use: every allocated section with contents (.isr_vector, .text,
+    .rodata, ..., and the .data initialisation image),
+  - RAM use: every writable allocated section (.data, .bss, heap/stack)
+    and code linked into SRAM (.ramfunc),
+  - the largest functions and objects in flash and in RAM (--top N), or all
+    of them (--top 0).
+
+With --flash-budget / --ram-budget the script exits with status 1 when the
+image is larger, so a Makefile can fail the build (the bootloader has to
+fit its 32 KB sector).
+
+Usage:
+    size_report.py build/release/mini_ecu_v2.elf [--top 25]
+    size_report.py build/size/mini_ecu_boot.elf --flash-budget 32768
+
+Only the Python standard library is needed.
+"""
+
+import argparse
+import struct
+import sys
+
+SHF_WRITE = 0x1
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+SHT_SYMTAB = 2
+STT_OBJECT = 1
+STT_FUNC = 2
+
+SRAM_START = 0x20000000
+SRAM_END = 0x20020000
+
+
+# ---------------------------------------------------------------------------
+# ELF
+# ---------------------------------------------------------------------------
+
+def load_elf(path):
+    """Return (sections, symbols) of a 32-bit LE ELF.
+
+    sections: (name, addr, size, in_flash, in_ram)
+    symbols:  (name, size, in_flash, in_ram, is_func)
+    """
+    with open(path, "rb") as f:
+        elf = f.read()
+
+    if elf[:4] != b"\x7fELF" or elf[4] != 1 or elf[5] != 1:
+        raise SystemExit("%s: not a 32-bit little-endian ELF" % path)
+
+    e_shoff, = struct.unpack_from("<I", elf, 0x20)
+    e_shentsize, e_shnum, e_shstrndx = struct.unpack_from("<HHH", elf, 0x2E)
+
+    def cstr(table, off):
+        return table[off:table.index(b"\0", off)].decode(errors="replace")
+
+    shdrs = [struct.unpack_from("<IIIIIIIIII", elf, e_shoff + i * e_shentsize)
+             for i in range(e_shnum)]
+    shstr = shdrs[e_shstrndx]
+    names = elf[shstr[4]:shstr[4] + shstr[5]]
+
+    sections = {}
+    for i, sh in enumerate(shdrs):
+        sh_type, flags, addr, size = sh[1], sh[2], sh[3], sh[5]
+        if not (flags & SHF_ALLOC) or size == 0:
+            continue
+        in_flash = sh_type != SHT_NOBITS          # contents are programmed
+        # .ramfunc is code (not writable) but linked into SRAM
+        in_ram = bool(flags & SHF_WRITE) or SRAM_START <= addr < SRAM_END
+        sections[i] = (cstr(names, sh[0]), addr, size, in_flash, in_ram)
+
+    symbols = []
+    for sh in shdrs:
+        if sh[1] != SHT_SYMTAB:
+            continue
+        strtab = shdrs[sh[6]]
+        strs = elf[strtab[4]:strtab[4] + strtab[5]]
+        for off in range(sh[4], sh[4] + sh[5], sh[9]):
+            st_name, _, st_size, st_info, _, st_shndx = \
+                struct.unpack_from("<IIIBBH", elf, off)
+            kind = st_info & 0xF
+            if kind not in (STT_OBJECT, STT_FUNC) or st_size == 0 or st_shndx not in sections:
+                continue
+            _, _, _, in_flash, in_ram = sections[st_shndx]
+            symbols.append((cstr(strs, st_name), st_size, in_flash, in_ram,
+                            kind == STT_FUNC))
+
+    return list(sections.values()), symbols
+
+
+# ---------------------------------------------------------------------------
+# Report
+# ---------------------------------------------------------------------------
+
+def report(path, sections, symbols, top, out):
+    flash = sum(s[2] for s in sections if s[3])
+    ram = sum(s[2] for s in sections if s[4])
+
+    out.write("%s\n\n" % path)
+    out.write("Sections                          addr       size  flash  ram\n")
+    for name, addr, size, in_flash, in_ram in sorted(sections, key=lambda s: s[1]):
+        out.write("  %-26s 0x%08X %9u  %-5s  %s\n"
+                  % (name, addr, size, "x" if in_flash else "", "x" if in_ram else ""))
+    out.write("  %-26s %10s %9u B flash, %u B RAM\n\n" % ("total", "", flash, ram))
+
+    def table(title, rows):
+        rows = sorted(rows, key=lambda s: (-s[1], s[0]))
+        if top > 0:
+            rows = rows[:top]
+        out.write("%s\n" % title)
+        for name, size, _, _, is_func in rows:
+            out.write("  %8u  %-4s %s\n" % (size, "func" if is_func else "obj", name))
+        out.write("\n")
+
+    table("Largest flash symbols (code, constants, .data images)",
+          [s for s in symbols if s[2]])
+    table("Largest RAM symbols", [s for s in symbols if s[3]])
+
+    return flash, ram
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Report firmware flash/RAM use from the ELF.")
+    ap.add_argument("elf", help="linked firmware ELF")
+    ap.add_argument("--top", type=int, default=25,
+                    help="symbols listed per table (0 = all)")
+    ap.add_argument("--flash-budget", type=int, default=0,
+                    help="fail if flash use exceeds this many bytes")
+    ap.add_argument("--ram-budget", type=int, default=0,
+                    help="fail if RAM use exceeds this many bytes")
+    args = ap.parse_args()
+
+    sections, symbols = load_elf(args.elf)
+    flash, ram = report(args.elf, sections, symbols, args.top, sys.stdout)
+
+    failed = False
+    if args.flash_budget and flash > args.flash_budget:
+        sys.stderr.write("%s: flash %u B exceeds budget %u B by %u B\n"
+                         % (args.elf, flash, args.flash_budget, flash - args.flash_budget))
+        failed = True
+    if args.ram_budget and ram > args.ram_budget:
+        sys.stderr.write("%s: RAM %u B exceeds budget %u B by %u B\n"
+                         % (args.elf, ram, args.ram_budget, ram - args.ram_budget))
+        failed = True
+
+    if failed:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
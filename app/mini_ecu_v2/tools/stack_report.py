@@ -0,0 +1,355 @@
+#!/usr/bin/env python3
+"""
+stack_report.py - Worst-case stack depth of every task and of the
+interrupts, from the compiler's call graph.
+
+GCC with -fcallgraph-info=su writes a .ci file next to each object: the
+functions it defines with their frame size, and the calls they make. This
+script joins the .ci files of a build, follows the calls from each task
+entry point (TASKS) and from the interrupt handlers, and prints the
+deepest path against the stack the task was given (read from the ELF):
+
+  Task         Entry          Stack  Worst   Free  Deepest path
+  CliTask      CliTask         1024    912    112  CliTask > CLI_IF_Task > ...
+
+"Worst" includes what a context switch stores on the task stack
+(SWITCH_BYTES). Calls through pointers are followed to the functions of
+the matching table in INDIRECT (CLI handlers, log transports, timer
+callbacks, ...). A row is marked
+
+  +  it reaches functions without stack data (newlib, the HAL objects of
+     another build), listed below the table; the figure is a lower bound,
+     "--assume vsnprintf=400" adds a cost for one,
+  ?  it makes a pointer call INDIRECT does not cover,
+  R  recursion; each cycle is counted once,
+  D  a frame of unbounded size (alloca, VLA).
+
+This is the static half of stack sizing; "stack" on the target shows the
+peaks actually reached (rtos_stack.h). The figures are those of the build
+the .ci files come from: "make debug" (-O0) writes them, LTO builds have
+none.
+
+With --check the script exits with status 1 when a task or the interrupts
+need more than they have.
+
+Usage:
+    stack_report.py build/debug [--elf build/debug/mini_ecu_v2.elf] [--check]
+
+Only the Python standard library is needed.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+SHT_SYMTAB = 2
+SHN_ABS = 0xFFF1
+
+# Stored on a task stack by a switch: the exception frame with the FPU
+# state (26 words) and what PendSV saves, R4-R11, EXC_RETURN and S16-S31
+# (25 words).
+SWITCH_BYTES = 4 * (26 + 25)
+
+# Stacked on the MSP by each nested interrupt: a frame with the FPU state.
+ISR_FRAME_BYTES = 4 * 26
+
+# Task name, entry function, stack symbol, TCB symbol (main.c, raster.c,
+# watchdog.c, the cmsis_os2.c idle and timer task memory). One symbol may
+# hold the stacks of several tasks with the same entry; the TCB array
+# tells how many.
+TASKS = [
+    ("VehicleTask", "VehicleTask",  "vehicleTask_stack", "vehicleTask_cb"),
+    ("CliTask",     "CliTask",      "cliTask_stack",     "cliTask_cb"),
+    ("CanRxTask",   "CanRxTask",    "canRxTask_stack",   "canRxTask_cb"),
+    ("CanTxTask",   "CanTxTask",    "canTxTask_stack",   "canTxTask_cb"),
+    ("LogTask",     "LogTask",      "logTask_stack",     "logTask_cb"),
+    ("SensorTask",  "SensorTask",   "sensorTask_stack",  "sensorTask_cb"),
+    ("NvmTask",     "NvmTask",      "nvmTask_stack",     "nvmTask_cb"),
+    ("BgTask",      "BgTask",       "bgTask_stack",      "bgTask_cb"),
+    ("IrqBenchTask", "IrqBenchTask", "irqBenchTask_stack", "irqBenchTask_cb"),
+    ("MicroBenchTask", "MicroBenchTask", "microBenchTask_stack", "microBenchTask_cb"),
+    ("defaultTask", "StartDefaultTask", "-",             "-"),
+    ("Raster*",     "raster_task",  "s_rsStack",         "s_rsTaskCb"),
+    ("WdgTask",     "wd_task",      "s_wdStack",         "s_wdTaskCb"),
+    ("IDLE",        "prvIdleTask",  "Idle_Stack",        "Idle_TCB"),
+    ("Tmr Svc",     "prvTimerTask", "Timer_Stack",       "Timer_TCB"),
+]
+
+# Pointer calls: caller -> the functions it may call, both as regular
+# expressions on function names, with the table they come from.
+INDIRECT = [
+    (r"cli_execute",                       r"\w+_cmd_\w+"),                      # CliCommand_t
+    (r"raster_task",                       r"App_\w+|Xcp_Event\w+|TlmStream_Event\w+|UartBaud_Event\w+|ExtLog_Event\w+|SigHist_Event\w+|FreezeFrame_Event\w+|TimerWheel_Event\w+|Crank_Event\w+|AngleSched_Event\w+|PerfLife_Event\w+"),  # RASTER_RUNNABLE_TABLE
+    (r"log_flush_blocking|Log_Service|Log_SetTransport",
+                                           r"log_\w+_(open|write|start)|Rtt_Init"),  # s_logTransports
+    (r"CanSched_Run",                      r"can_\w+_(changed|send)"),           # CanSched_Frame_t
+    (r"CAN_IF_ProcessRxMsg",               r"\w+_on_(frame|telemetry)"),         # CAN_IF_RegisterHandler
+    (r"can_isr_decode",                    r"\w+_isr_telemetry"),                # CAN_IF_RegisterIsrDecoder decode
+    (r"can_isr_wakeups",                   r"\w+_isr_wake"),                     # CAN_IF_RegisterIsrDecoder wake
+    (r"CAN_IF_DeliverPdu",                 r"\w+_on_pdu"),                       # CAN_IF_RegisterPduHandler
+    (r"j1939_dispatch",                    r"\w+_on_pgn"),                       # J1939_RegisterPgn onRx
+    (r"j1939_rx_request",                  r"\w+_on_request"),                   # J1939_RegisterPgn onRequest
+    (r"uds_on_pdu",                        r"uds_(session_control|tester_present|read_dids|"
+                                           r"write_did|read_dtc|clear_dtc|routine_control)"),  # s_udsServices
+    (r"nvm_\w+|NvmLog_Service",               r"(cal|dtc)_(restore|take|retry)"),   # NvmLog_Client_t
+    (r"co_turn",                           r"\w+_Coop"),                         # COOP_TABLE
+    (r"TimerWheel_Event1ms",               r"\w+_expired"),                      # TimerWheel_Setup
+    (r"prvProcessExpiredTimer|prvProcessReceivedCommands|prvSwitchTimerLists|TimerCallback",
+                                           r"stats_sample|br_confirm_timer|lp_lse_poll|"
+                                           r"vsensor_sim_fill"),                 # xTimerCreateStatic
+    (r"HAL_DMA_IRQHandler",                r"UART_DMA\w+|ADC_DMA\w+"),           # hdma->Xfer*Callback
+]
+
+NODE_RE = re.compile(r'^node: \{ title: "([^"]+)" label: "([^"]*)"')
+EDGE_RE = re.compile(r'^edge: \{ sourcename: "([^"]+)" targetname: "([^"]+)"')
+BYTES_RE = re.compile(r"\\n(\d+) bytes \(([\w,]+)\)")
+
+INDIRECT_CALL = "__indirect_call"
+
+
+# ---------------------------------------------------------------------------
+# Inputs
+# ---------------------------------------------------------------------------
+
+def load_graph(root):
+    """Return ({title: [name, bytes or None, dynamic]}, {title: set(callees)})."""
+    nodes = {}
+    calls = {}
+
+    for dirpath, _, files in os.walk(root):
+        for fname in sorted(files):
+            if not fname.endswith(".ci"):
+                continue
+            with open(os.path.join(dirpath, fname), errors="replace") as f:
+                for line in f:
+                    m = NODE_RE.match(line)
+                    if m:
+                        title, label = m.groups()
+                        size = BYTES_RE.search(label)
+                        node = nodes.setdefault(title, [label.split("\\n")[0], None, False])
+                        if size:
+                            # Weak and strong definitions: keep the larger frame.
+                            node[1] = max(node[1] or 0, int(size.group(1)))
+                            node[2] = node[2] or ("dynamic" in size.group(2)
+                                                  and "bounded" not in size.group(2))
+                        continue
+                    m = EDGE_RE.match(line)
+                    if m:
+                        calls.setdefault(m.group(1), set()).add(m.group(2))
+
+    if not nodes:
+        raise SystemExit("%s: no .ci files (build with -fcallgraph-info=su)" % root)
+    return nodes, calls
+
+
+def load_symbols(path):
+    """Return {name: (value, size)} of a 32-bit LE ELF, local ones included."""
+    with open(path, "rb") as f:
+        elf = f.read()
+
+    if elf[:4] != b"\x7fELF" or elf[4] != 1 or elf[5] != 1:
+        raise SystemExit("%s: not a 32-bit little-endian ELF" % path)
+
+    e_shoff, = struct.unpack_from("<I", elf, 0x20)
+    e_shentsize, e_shnum = struct.unpack_from("<HH", elf, 0x2E)
+
+    def section(i):
+        return struct.unpack_from("<IIIIIIIIII", elf, e_shoff + i * e_shentsize)
+
+    shdrs = [section(i) for i in range(e_shnum)]
+    symbols = {}
+
+    for sh in shdrs:
+        if sh[1] != SHT_SYMTAB:
+            continue
+        strtab = shdrs[sh[6]]
+        strings = elf[strtab[4]:strtab[4] + strtab[5]]
+        for off in range(sh[4], sh[4] + sh[5], sh[9]):
+            st_name, st_value, st_size, _, _, st_shndx = struct.unpack_from("<IIIBBH", elf, off)
+            name = strings[st_name:strings.index(b"\0", st_name)].decode(errors="replace")
+            # Function-local statics: "Idle_Stack.0"
+            name = name.split(".")[0]
+            if name and (st_size or st_shndx == SHN_ABS):
+                symbols.setdefault(name, (st_value, st_size))
+    return symbols
+
+
+# ---------------------------------------------------------------------------
+# Call graph
+# ---------------------------------------------------------------------------
+
+class Graph:
+    def __init__(self, nodes, calls, assume, indirect):
+        self.nodes = nodes
+        self.calls = calls
+        self.assume = assume
+        self.by_name = {}
+        for title, node in nodes.items():
+            if node[1] is not None:
+                self.by_name.setdefault(node[0], []).append(title)
+        self.indirect = [(re.compile(c + r"$"), re.compile(t + r"$")) for c, t in indirect]
+        self.memo = {}
+
+    def name(self, title):
+        return self.nodes[title][0] if title in self.nodes else title
+
+    def callees(self, title):
+        out = set()
+        for t in self.calls.get(title, ()):
+            if t != INDIRECT_CALL:
+                out.add(t)
+                continue
+            caller = self.name(title)
+            targets = [titles for c, names in self.indirect if c.match(caller)
+                       for n, titles in self.by_name.items() if names.match(n)]
+            if not any(c.match(caller) for c, _ in self.indirect):
+                out.add(INDIRECT_CALL)
+            for titles in targets:
+                out.update(titles)
+        return out
+
+    def depth(self, title, active=None):
+        """Return (bytes, path, flags, unmeasured) of the deepest call chain."""
+        if title in self.memo:
+            return self.memo[title]
+        active = active if active is not None else set()
+
+        node = self.nodes.get(title)
+        name = self.name(title)
+        if title == INDIRECT_CALL:
+            return 0, [], {"?"}, set()
+        if node is None or node[1] is None:
+            if name in self.assume:
+                return self.assume[name], [name], set(), set()
+            return 0, [name], {"+"}, {name}
+
+        active.add(title)
+        best, best_path, flags, unmeasured = 0, [], set(), set()
+        for callee in sorted(self.callees(title)):
+            if callee in active:
+                flags.add("R")
+                continue
+            d, path, f, u = self.depth(callee, active)
+            flags |= f
+            unmeasured |= u
+            if d > best or not best_path:
+                best, best_path = d, path
+        active.discard(title)
+
+        if node[2]:
+            flags.add("D")
+        result = (node[1] + best, [name] + best_path, flags, unmeasured)
+        self.memo[title] = result
+        return result
+
+    def entry(self, name):
+        """Deepest of the functions called @p name (statics may repeat)."""
+        titles = self.by_name.get(name)
+        if not titles:
+            return None
+        return max((self.depth(t) for t in titles), key=lambda r: r[0])
+
+
+# ---------------------------------------------------------------------------
+# Report
+# ---------------------------------------------------------------------------
+
+def path_text(path, width=72):
+    text = " > ".join(path)
+    return text if len(text) <= width else text[:width - 3] + "..."
+
+
+def report(graph, symbols, out):
+    """Print the tables; return the rows that do not fit."""
+    over = []
+    unmeasured = set()
+
+    tcb = symbols.get(TASKS[0][3], (0, 0))[1] if symbols else 0
+
+    out.write("Task         Entry           Stack  Worst   Free  Deepest path\n")
+    for task, entry, stack_sym, cb_sym in TASKS:
+        r = graph.entry(entry)
+        if r is None:
+            continue
+        worst = r[0] + SWITCH_BYTES
+
+        stack = None
+        if symbols and stack_sym in symbols and cb_sym in symbols and tcb:
+            count = symbols[cb_sym][1] // tcb
+            stack = symbols[stack_sym][1] // count if count else None
+
+        flags = "".join(sorted(r[2]))
+        if stack is None:
+            out.write("%-12s %-14s %6s %6u %6s %-3s %s\n"
+                      % (task, entry, "-", worst, "-", flags, path_text(r[1])))
+        else:
+            out.write("%-12s %-14s %6u %6u %6d %-3s %s\n"
+                      % (task, entry, stack, worst, stack - worst, flags, path_text(r[1])))
+            if worst > stack:
+                over.append("%s needs %u B of its %u B stack" % (task, worst, stack))
+        unmeasured |= r[3]
+
+    # Interrupts: the deepest handler, and all of them nested (an upper
+    # bound; only handlers of different priority nest).
+    handlers = [(graph.entry(n), n) for n in graph.by_name
+                if n.endswith("_IRQHandler") or (n.endswith("_Handler") and n != "Reset_Handler")]
+    handlers = [(r, n) for r, n in handlers if r is not None]
+    msp = symbols.get("_Min_Stack_Size", (0, 0))[0] if symbols else 0
+    if handlers:
+        deepest, name = max(handlers, key=lambda h: h[0][0])
+        nested = sum(r[0] + ISR_FRAME_BYTES for r, _ in handlers)
+        startup = graph.entry("main")
+        out.write("\nMSP %s B: deepest handler %u B (%s), all nested %u B, main() %s B\n"
+                  % (msp or "-", deepest[0] + ISR_FRAME_BYTES, path_text(deepest[1], 48),
+                     nested, startup[0] if startup else "-"))
+        if msp and deepest[0] + ISR_FRAME_BYTES > msp:
+            over.append("%s needs %u B of the %u B main stack"
+                        % (name, deepest[0] + ISR_FRAME_BYTES, msp))
+        for r, _ in handlers:
+            unmeasured |= r[3]
+
+    if unmeasured:
+        out.write("\nNo stack data (+), not counted:\n")
+        line = " "
+        for name in sorted(unmeasured):
+            if len(line) + len(name) > 76:
+                out.write(line + "\n")
+                line = " "
+            line += " " + name
+        out.write(line + "\n")
+
+    return over
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Worst-case task stack depth from GCC call graphs.")
+    ap.add_argument("dir", help="build directory with the .ci files")
+    ap.add_argument("--elf", help="linked firmware ELF, for the stack sizes")
+    ap.add_argument("--assume", action="append", default=[], metavar="FN=BYTES",
+                    help="stack use of a function without stack data")
+    ap.add_argument("--indirect", action="append", default=[], metavar="CALLER=TARGETS",
+                    help="regular expressions: pointer calls of CALLER go to TARGETS")
+    ap.add_argument("--check", action="store_true",
+                    help="fail if a task or the interrupts need more stack than they have")
+    args = ap.parse_args()
+
+    assume = {}
+    for a in args.assume:
+        name, _, size = a.partition("=")
+        assume[name] = int(size, 0)
+    indirect = INDIRECT + [tuple(i.split("=", 1)) for i in args.indirect]
+
+    nodes, calls = load_graph(args.dir)
+    symbols = load_symbols(args.elf) if args.elf else {}
+    over = report(Graph(nodes, calls, assume, indirect), symbols, sys.stdout)
+
+    if args.check and over:
+        for o in over:
+            sys.stderr.write("%s: %s\n" % (args.dir, o))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
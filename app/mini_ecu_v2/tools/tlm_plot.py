@@ -0,0 +1,261 @@
+#!/usr/bin/env python3
+"""
+tlm_plot.py - Decode and plot the Mini ECU binary telemetry stream ("tlm").
+
+The stream (see Core/Inc/tlm_stream.h) shares the console UART with the CLI:
+
+    0x00 | COBS(type | payload | CRC-16/CCITT-FALSE, little-endian) | 0x00
+
+    'D'  version (u8), index (u8), count (u8), signal id (u8), period ms
+         (u16), scale (f32), name (u8 length + text), unit (u8 length + text)
+    'S'  sequence (u16), tick ms (u32), count x raw (i16), value = raw * scale
+
+Chunks between zero bytes that do not decode with a good CRC are console
+text and are passed to stderr with --text. Samples are decoded once all
+descriptors of the layout have been seen (they repeat every 2 s).
+
+Usage:
+    tlm_plot.py --port /dev/ttyACM0 --start "100 speed,rpm,throttle" --plot
+    tlm_plot.py --port /dev/ttyACM0 --start "200 all" --csv run.csv
+    tlm_plot.py capture.bin --csv run.csv
+
+Without --csv or --plot a line per second shows the rate, the samples lost
+(sequence gaps) and the last values. Only the Python standard library is
+needed; --port requires pyserial and --plot matplotlib.
+"""
+
+import argparse
+import collections
+import struct
+import sys
+import time
+
+DESC = b"D"
+SAMPLE = b"S"
+DESC_VERSION = 1
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+class Decoder:
+    def __init__(self, on_sample, text=None):
+        self.on_sample = on_sample
+        self.text = text
+        self.buf = bytearray()
+        self.desc = {}
+        self.layout = None      # [(id, name, unit, scale)], in sample order
+        self.period = None
+        self.last_seq = None
+        self.samples = 0
+        self.lost = 0
+        self.bad = 0
+        self.waiting = 0
+
+    def feed(self, data):
+        self.buf += data
+        while True:
+            end = self.buf.find(b"\x00")
+            if end < 0:
+                return
+            chunk = bytes(self.buf[:end])
+            del self.buf[:end + 1]
+            if chunk:
+                self.chunk(chunk)
+
+    def chunk(self, chunk):
+        raw = cobs_decode(chunk)
+        if raw is None or len(raw) < 3 or crc16(raw[:-2]) != struct.unpack_from("<H", raw, len(raw) - 2)[0]:
+            if all(b >= 0x09 for b in chunk):
+                if self.text is not None:
+                    self.text.write(chunk.decode(errors="replace"))
+                    self.text.flush()
+            elif raw is not None and raw[:1] in (DESC, SAMPLE):
+                self.bad += 1
+            return
+        kind, body = raw[:1], raw[1:-2]
+        if kind == DESC:
+            self.descriptor(body)
+        elif kind == SAMPLE:
+            self.sample(body)
+
+    def descriptor(self, body):
+        version, index, count, sig, period, scale = struct.unpack_from("<BBBBHf", body)
+        if version != DESC_VERSION:
+            raise SystemExit("unsupported stream version %u" % version)
+        pos = 10
+        name = body[pos + 1:pos + 1 + body[pos]].decode()
+        pos += 1 + body[pos]
+        unit = body[pos + 1:pos + 1 + body[pos]].decode()
+
+        key = (count, period)
+        if any(k != key for k in (v[0] for v in self.desc.values())):
+            self.desc = {}      # new "tlm start"
+        self.desc[index] = (key, (sig, name, unit, scale))
+        if len(self.desc) == count:
+            layout = [self.desc[i][1] for i in range(count)]
+            if layout != self.layout:
+                self.layout, self.period, self.last_seq = layout, period, None
+                sys.stderr.write("tlm: %u signals every %u ms: %s\n"
+                                 % (count, period, " ".join(s[1] for s in layout)))
+
+    def sample(self, body):
+        if self.layout is None or len(body) != 6 + 2 * len(self.layout):
+            self.waiting += 1
+            return
+        seq, tick = struct.unpack_from("<HI", body)
+        raw = struct.unpack_from("<%uh" % len(self.layout), body, 6)
+        if self.last_seq is not None:
+            self.lost += (seq - self.last_seq - 1) & 0xFFFF
+        self.last_seq = seq
+        self.samples += 1
+        self.on_sample(seq, tick, [r * s[3] for r, s in zip(raw, self.layout)])
+
+
+class Plot:
+    def __init__(self, window_s):
+        import matplotlib.pyplot as plt  # pylint: disable=import-outside-toplevel
+        self.plt = plt
+        self.window_ms = window_s * 1000.0
+        self.fig = None
+        self.lines = []
+        self.axes = []
+        self.data = None
+        self.layout = None
+        self.next_draw = 0.0
+
+    def setup(self, layout):
+        self.plt.close("all")
+        self.fig, axes = self.plt.subplots(len(layout), 1, sharex=True, squeeze=False)
+        self.axes = [a[0] for a in axes]
+        self.lines = []
+        for ax, (_, name, unit, _) in zip(self.axes, layout):
+            line, = ax.plot([], [])
+            ax.set_ylabel("%s\n%s" % (name, unit) if unit else name)
+            self.lines.append(line)
+        self.axes[-1].set_xlabel("s")
+        self.data = [collections.deque() for _ in layout] + [collections.deque()]
+        self.layout = layout
+        self.plt.ion()
+        self.plt.show()
+
+    def add(self, layout, tick, values):
+        if layout is not self.layout:
+            self.setup(layout)
+        t = self.data[-1]
+        t.append(tick)
+        for d, v in zip(self.data, values):
+            d.append(v)
+        while t and t[0] < tick - self.window_ms:
+            for d in self.data:
+                d.popleft()
+        now = time.monotonic()
+        if now >= self.next_draw:
+            self.next_draw = now + 0.1
+            xs = [x / 1000.0 for x in t]
+            for line, ax, d in zip(self.lines, self.axes, self.data):
+                line.set_data(xs, list(d))
+                ax.relim()
+                ax.autoscale_view()
+            self.plt.pause(0.001)
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Decode the Mini ECU binary telemetry stream.")
+    ap.add_argument("input", nargs="?", help="captured UART stream (default: stdin)")
+    ap.add_argument("--port", help="read live from a serial port (needs pyserial)")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("--start", metavar="ARGS",
+                    help="send \"tlm start ARGS\" first and \"tlm stop\" at the end")
+    ap.add_argument("--csv", help="write the samples as CSV")
+    ap.add_argument("--plot", action="store_true", help="live plot (needs matplotlib)")
+    ap.add_argument("--window", type=float, default=10.0, help="plot window in s")
+    ap.add_argument("--text", action="store_true", help="pass console text to stderr")
+    args = ap.parse_args()
+
+    csv = open(args.csv, "w") if args.csv else None
+    plot = Plot(args.window) if args.plot else None
+    status = {"next": time.monotonic() + 1.0, "count": 0, "values": None}
+    dec = None
+
+    def on_sample(seq, tick, values):
+        if csv is not None:
+            if status.get("layout") is not dec.layout:
+                csv.write("tick_ms,seq,%s\n" % ",".join(s[1] for s in dec.layout))
+                status["layout"] = dec.layout
+            csv.write("%u,%u,%s\n" % (tick, seq, ",".join("%g" % v for v in values)))
+        if plot is not None:
+            plot.add(dec.layout, tick, values)
+        status["count"] += 1
+        status["values"] = values
+
+    def report():
+        now = time.monotonic()
+        if csv is not None or plot is not None or now < status["next"]:
+            return
+        status["next"] = now + 1.0
+        vals = ""
+        if status["values"] is not None:
+            vals = " ".join("%s=%g" % (s[1], v) for s, v in zip(dec.layout, status["values"]))
+        sys.stderr.write("%4u samples/s, %u lost, %u bad: %s\n"
+                         % (status["count"], dec.lost, dec.bad, vals))
+        status["count"] = 0
+
+    dec = Decoder(on_sample, sys.stderr if args.text else None)
+
+    try:
+        if args.port:
+            import serial  # pylint: disable=import-outside-toplevel
+            with serial.Serial(args.port, args.baud, timeout=0.05) as ser:
+                if args.start:
+                    ser.write(("\r\ntlm start %s\r\n" % args.start).encode())
+                try:
+                    while True:
+                        dec.feed(ser.read(1024))
+                        report()
+                finally:
+                    if args.start:
+                        ser.write(b"tlm stop\r\n")
+        else:
+            src = open(args.input, "rb") if args.input else sys.stdin.buffer
+            with src:
+                while True:
+                    chunk = src.read(4096)
+                    if not chunk:
+                        break
+                    dec.feed(chunk)
+                    report()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if csv is not None:
+            csv.close()
+
+    sys.stderr.write("tlm: %u samples, %u lost, %u bad frames, %u before the layout\n"
+                     % (dec.samples, dec.lost, dec.bad, dec.waiting))
+    return 0 if dec.samples else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+"""
+trace_map.py - Memory-mapped CAN trace reader for the host replay and decoder tools.
+
+Field traces run to gigabytes, so can_replay.py and can_log.py do not read
+them into memory. A TraceMap maps the file read-only and decodes records
+lazily, straight from the mapping (the regular expressions run on it, so
+nothing is split into lines or copied first), in either text format the
+bench produces:
+
+    candump log    (1436509052.249713) can0 123#1122334455667788
+    Vector ASC     0.012345 1  18DAF110x       Rx   d 8 11 22 33 44 55 66 77 88
+
+Seeking to a time is a bisection over the byte offsets: a probe steps to
+the next record and reads its time. Every probe is kept as a checkpoint
+(time -> offset), so a later seek starts from the two checkpoints around
+its time; seeks are O(log n) and a window costs a few dozen probes,
+whatever the size. The index needs the trace in time order, as candump and
+CANoe write it.
+
+    tm = trace_map.TraceMap("field.log")
+    start, end = tm.window(3600.0, 3660.0)      # seconds after the first record
+    for us, ident, dlc, data in tm.records(start, end):
+        ...
+
+Records are (time in us, id | ID_EXT | ID_RTR, dlc, data), as can_trace.py
+defines the flags. Only the Python standard library is needed.
+"""
+
+import bisect
+import mmap
+import os
+import re
+
+import can_trace
+
+ID_EXT = can_trace.ID_EXT
+ID_RTR = can_trace.ID_RTR
+
+CANDUMP_RE = re.compile(rb"^\((\d+)\.(\d{6})\)[ \t]+\S+[ \t]+([0-9A-Fa-f]{1,8})#(R\d?|[0-9A-Fa-f.]*)[ \t]*\r?$",
+                        re.M)
+ASC_RE = re.compile(rb"^[ \t]*(\d+\.\d+)[ \t]+\d+[ \t]+([0-9A-Fa-f]+)(x?)[ \t]+(Rx|Tx)[ \t]+([dr])"
+                    rb"[ \t]*(\d*)[ \t]*([^\r\n]*)\r?$", re.M)
+
+# Bytes the format is guessed from, and that hold the ASC "base" header.
+HEAD = 65536
+
+
+def guess(head):
+    """Format of a trace from its first bytes: "bin", "candump" or "asc"."""
+    if bytes([can_trace.SYNC]) in head and b"H" in head:
+        return "bin"
+    if re.search(rb"^\(\d+\.\d{6}\)", head, re.M):
+        return "candump"
+    return "asc"
+
+
+class TraceMap:
+    """A candump log or Vector ASC file, mapped, with a lazy time index."""
+
+    def __init__(self, path=None, fmt=None, data=None):
+        self._file = None
+        if data is not None:
+            self.buf = data
+        else:
+            self._file = open(path, "rb")
+            size = os.fstat(self._file.fileno()).st_size
+            self.buf = (mmap.mmap(self._file.fileno(), 0, access=mmap.ACCESS_READ)
+                        if size else b"")
+        self.size = len(self.buf)
+        head = bytes(self.buf[:HEAD])
+        self.fmt = fmt or guess(head)
+        if self.fmt not in ("candump", "asc"):
+            raise ValueError("trace_map: %s traces are not mapped" % self.fmt)
+        self.regex = CANDUMP_RE if self.fmt == "candump" else ASC_RE
+        self.base = 10 if re.search(rb"^base[^\r\n]* dec", head, re.M) else 16
+
+        # Checkpoints: record offsets and their times, both ascending.
+        self._cp_off = []
+        self._cp_us = []
+        self.probes = 0
+
+        m = self.regex.search(self.buf)
+        self.first = m.start() if m else self.size
+        self.first_us = self._time(m) if m else None
+
+    def close(self):
+        if isinstance(self.buf, mmap.mmap):
+            self.buf.close()
+        if self._file:
+            self._file.close()
+            self._file = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    # -----------------------------------------------------------------------
+    # Decoding
+    # -----------------------------------------------------------------------
+
+    def _time(self, m):
+        if self.fmt == "candump":
+            return int(m.group(1)) * 1000000 + int(m.group(2))
+        return int(round(float(m.group(1)) * 1e6))
+
+    def _record(self, m):
+        if self.fmt == "candump":
+            sec, usec, sid, body = m.groups()
+            us = int(sec) * 1000000 + int(usec)
+            ident = int(sid, 16)
+            if len(sid) == 8 or ident > 0x7FF:
+                ident |= ID_EXT
+            if body.startswith(b"R"):
+                return us, ident | ID_RTR, int(body[1:]) if len(body) > 1 else 0, b""
+            data = bytes.fromhex(body.replace(b".", b"").decode())[:8]
+            return us, ident, len(data), data
+
+        stamp, sid, ext, _, kind, dlc, rest = m.groups()
+        ident = int(sid, self.base) | (ID_EXT if ext else 0)
+        us = int(round(float(stamp) * 1e6))
+        dlc = min(int(dlc or b"0"), 8)
+        if kind == b"r":
+            return us, ident | ID_RTR, dlc, b""
+        data = bytes(int(b, self.base) for b in rest.split()[:dlc])
+        return us, ident, len(data), data
+
+    def records(self, start=0, end=None):
+        """Decode the records from offset start (a line start) to end."""
+        for m in self.regex.finditer(self.buf, start, self.size if end is None else end):
+            yield self._record(m)
+
+    # -----------------------------------------------------------------------
+    # Index
+    # -----------------------------------------------------------------------
+
+    def _line_start(self, off):
+        if off <= 0 or off >= self.size or self.buf[off - 1] == 0x0A:
+            return min(max(off, 0), self.size)
+        nl = self.buf.find(b"\n", off)
+        return self.size if nl < 0 else nl + 1
+
+    def _probe(self, off, lim):
+        """First record in [off, lim): (offset, time), kept as a checkpoint."""
+        self.probes += 1
+        m = self.regex.search(self.buf, off, lim)
+        if not m:
+            return lim, None
+        us = self._time(m)
+        i = bisect.bisect_left(self._cp_off, m.start())
+        if i == len(self._cp_off) or self._cp_off[i] != m.start():
+            self._cp_off.insert(i, m.start())
+            self._cp_us.insert(i, us)
+        return m.start(), us
+
+    def seek(self, us):
+        """Offset of the first record at us or later (size if none)."""
+        # Records before lo are earlier than us, those from hi on are not.
+        i = bisect.bisect_left(self._cp_us, us)
+        lo = self._cp_off[i - 1] + 1 if i > 0 else 0
+        hi = self._cp_off[i] if i < len(self._cp_off) else self.size
+
+        while lo < hi:
+            mid = (lo + hi) // 2
+            line = self._line_start(mid)
+            rec, at = self._probe(line, hi) if line < hi else (hi, None)
+            if at is None:
+                hi = mid            # no record starts in [mid, hi)
+            elif at >= us:
+                hi = rec
+            else:
+                lo = rec + 1
+        return self._line_start(hi)
+
+    def window(self, from_s=None, to_s=None):
+        """(start, end) offsets of the records from_s..to_s seconds after
+        the first record; None is the start or the end of the trace."""
+        if self.first_us is None:
+            return self.size, self.size
+        start = self.first if not from_s else self.seek(self.first_us + int(from_s * 1e6))
+        end = self.size if to_s is None else self.seek(self.first_us + int(to_s * 1e6))
+        return start, max(start, end)
+
+    def last_us(self, start=0, end=None):
+        """Time of the last record before end, reading back line by line."""
+        off = self.size if end is None else end
+        while off > start:
+            prev = max(self.buf.rfind(b"\n", start, max(off - 1, start)) + 1, start)
+            m = self.regex.search(self.buf, prev, off)
+            if m:
+                return self._time(m)
+            off = prev
+        return None
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""
+uart_mux.py - Split the Mini ECU console UART into its channels ("log mux").
+
+With "log mux on" (see Core/Inc/log.h) every chunk the ECU sends on the
+UART is one frame
+
+    0x00 | COBS(channel (u8) | data) | 0x00
+
+    channel 0  log lines          (Log_Write(), tokenized frames)
+    channel 1  CLI output         (prompts, replies, dashboard)
+    channel 2  binary telemetry   ("tlm", decoded by tlm_plot.py)
+
+The tool switches the mux on, prints the CLI output to stdout and the log
+lines to stderr (or --lines FILE), and writes the telemetry channel as is
+to --tlm FILE, which tlm_plot.py reads like a UART capture. With --csv the
+telemetry is decoded live instead. Lines typed on stdin are sent to the
+CLI; the mux is switched off again on exit. --speed first moves the
+console to a faster rate (baud_switch.py). Bytes outside a frame (the
+echo of typed characters, output from before the switch) are passed to
+stdout.
+
+Usage:
+    uart_mux.py --port /dev/ttyACM0
+    uart_mux.py --port /dev/ttyACM0 --send "tlm start 200 all" --tlm run.tlm
+    uart_mux.py --port /dev/ttyACM0 --speed 921600 --send "tlm start 10 all" --tlm run.tlm
+    uart_mux.py --port /dev/ttyACM0 --send "tlm start 100 speed,rpm" --csv run.csv
+    uart_mux.py capture.bin --lines log.txt --tlm run.tlm
+
+Only the Python standard library is needed; --port requires pyserial.
+"""
+
+import argparse
+import select
+import sys
+
+from baud_switch import switch
+from tlm_plot import Decoder, cobs_decode
+
+CH_LINES = 0
+CH_CLI = 1
+CH_TLM = 2
+
+
+class Demux:
+    def __init__(self, sinks, plain):
+        self.sinks = sinks      # channel -> callable(bytes)
+        self.plain = plain      # callable(bytes) for bytes outside frames
+        self.buf = bytearray()
+        self.frames = [0, 0, 0]
+        self.bad = 0
+
+    def feed(self, data):
+        self.buf += data
+        while True:
+            end = self.buf.find(b"\x00")
+            if end < 0:
+                return
+            chunk = bytes(self.buf[:end])
+            del self.buf[:end + 1]
+            if chunk:
+                self.chunk(chunk)
+
+    def chunk(self, chunk):
+        raw = cobs_decode(chunk)
+        if raw is None or not raw or raw[0] not in self.sinks:
+            # Text sent unframed never contains a zero byte.
+            if all(b >= 0x09 for b in chunk):
+                self.plain(chunk)
+            else:
+                self.bad += 1
+            return
+        self.frames[raw[0]] += 1
+        self.sinks[raw[0]](raw[1:])
+
+    def flush(self):
+        if self.buf:
+            self.plain(bytes(self.buf))
+            self.buf.clear()
+
+
+def writer(stream):
+    def write(data):
+        stream.write(data.decode(errors="replace"))
+        stream.flush()
+    return write
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Split the Mini ECU console UART channels.")
+    ap.add_argument("input", nargs="?", help="captured UART stream (default: stdin)")
+    ap.add_argument("--port", help="read live from a serial port (needs pyserial)")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("--speed", type=int, help="switch the console to this rate first")
+    ap.add_argument("--send", action="append", default=[], metavar="CMD",
+                    help="CLI command to send after \"log mux on\" (repeatable)")
+    ap.add_argument("--lines", help="write the log lines to FILE instead of stderr")
+    ap.add_argument("--tlm", help="write the telemetry channel to FILE")
+    ap.add_argument("--csv", help="decode the telemetry channel into a CSV file")
+    args = ap.parse_args()
+
+    lines = open(args.lines, "w") if args.lines else sys.stderr
+    tlm = open(args.tlm, "wb") if args.tlm else None
+    csv = open(args.csv, "w") if args.csv else None
+    dec = None
+    state = {"layout": None}
+
+    def on_sample(seq, tick, values):
+        if state["layout"] is not dec.layout:
+            csv.write("tick_ms,seq,%s\n" % ",".join(s[1] for s in dec.layout))
+            state["layout"] = dec.layout
+        csv.write("%u,%u,%s\n" % (tick, seq, ",".join("%g" % v for v in values)))
+
+    if csv is not None:
+        dec = Decoder(on_sample)
+
+    def on_tlm(data):
+        if tlm is not None:
+            tlm.write(data)
+        if dec is not None:
+            dec.feed(data)
+
+    mux = Demux({CH_LINES: writer(lines), CH_CLI: writer(sys.stdout), CH_TLM: on_tlm},
+                writer(sys.stdout))
+
+    try:
+        if args.port:
+            import serial  # pylint: disable=import-outside-toplevel
+            with serial.Serial(args.port, args.baud, timeout=0.05) as ser:
+                if args.speed:
+                    switch(ser, args.speed)
+                ser.write(b"\r\nlog mux on\r\n")
+                for cmd in args.send:
+                    ser.write(("%s\r\n" % cmd).encode())
+                try:
+                    while True:
+                        mux.feed(ser.read(1024))
+                        if sys.stdin.isatty() and select.select([sys.stdin], [], [], 0)[0]:
+                            line = sys.stdin.readline()
+                            if not line:
+                                break
+                            ser.write(line.rstrip("\r\n").encode() + b"\r\n")
+                finally:
+                    ser.write(b"\r\nlog mux off\r\n")
+        else:
+            src = open(args.input, "rb") if args.input else sys.stdin.buffer
+            with src:
+                while True:
+                    chunk = src.read(4096)
+                    if not chunk:
+                        break
+                    mux.feed(chunk)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        mux.flush()
+        for f in (tlm, csv):
+            if f is not None:
+                f.close()
+        if args.lines:
+            lines.close()
+
+    sys.stderr.write("\nmux: %u log, %u cli, %u tlm frames, %u bad\n"
+                     % (mux.frames[CH_LINES], mux.frames[CH_CLI], mux.frames[CH_TLM], mux.bad))
+    if dec is not None:
+        sys.stderr.write("tlm: %u samples, %u lost, %u bad frames\n"
+                         % (dec.samples, dec.lost, dec.bad))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""
+uds_stage.py - Stage an update into the other slot of a running ECU over UDS.
+
+The application keeps running while it receives the image (stage.h): the
+extended session, RequestDownload (0x34) to the slot it does not run from,
+TransferData (0x36) blocks, RequestTransferExit (0x37), then routine
+0x0203 activates the image and the ECU resets into it on trial.
+
+    uds_stage.py can0 build/release/mini_ecu_v2.bin               # node 0
+    uds_stage.py can0 mini_ecu_v2.bin --node 2 --no-activate
+    uds_stage.py can0 --status
+
+The image linked for the target slot is picked as in fw_update.py (the
+.bin or its _b sibling). NRC 0x21 (busy) is answered by repeating the same
+request: the ECU's ring is full while it erases a sector, which it does
+only at standstill, and 0x37 is busy until the image is checked. A sector
+erase also stalls the ECU's CAN tasks for one or two seconds, so missing
+responses are repeated too; a repeated block is not written twice.
+
+--status reads UDS_DID_STAGE: target slot, state, sectors erased, bytes
+programmed and the longest scheduler stalls of program slices and erases.
+"""
+
+import argparse
+import os
+import struct
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import can_update  # noqa: E402
+import fw_update  # noqa: E402
+
+REQ_BASE = 0x7E0
+RESP_BASE = 0x7E8
+
+DID_STAGE = 0x0150
+RID_STAGE_ACTIVATE = 0x0203
+
+NRC_BUSY = 0x21
+NRC_PENDING = 0x78
+NRC_NAMES = {0x13: "incorrect length", 0x21: "busy", 0x22: "conditions not correct",
+             0x24: "request sequence error", 0x31: "request out of range",
+             0x70: "download not accepted", 0x71: "transfer suspended",
+             0x72: "programming failure", 0x73: "wrong block sequence counter",
+             0x7F: "service not supported in session"}
+
+STATES = ["idle", "erasing", "writing", "verifying", "ready", "failed"]
+
+
+class Uds:
+    """Physical requests to one node; request() returns the positive response."""
+
+    def __init__(self, iface, node, timeout, deadline):
+        self.req = REQ_BASE + node
+        self.resp = RESP_BASE + node
+        self.timeout = timeout
+        self.deadline = deadline
+        self.tp = can_update.IsoTp(can_update.Bus(iface, [self.resp]), 0, 0.0)
+        self.busy = 0
+
+    def _tx_of(self, resp_id):
+        return self.req
+
+    def request(self, pdu):
+        give_up = time.monotonic() + self.deadline
+        while time.monotonic() < give_up:
+            if not self.tp.send(self.req, pdu, self._tx_of, fc_id=self.resp):
+                continue                          # no FC: the ECU is erasing
+            got = self.tp.poll(self.timeout, self._tx_of)
+            if got is None:
+                continue
+            rsp = got[1]
+            if rsp[0] == pdu[0] + 0x40:
+                return rsp
+            if rsp[0] == 0x7F and len(rsp) >= 3 and rsp[1] == pdu[0]:
+                if rsp[2] == NRC_PENDING:
+                    continue
+                if rsp[2] == NRC_BUSY:
+                    self.busy += 1
+                    time.sleep(0.02)
+                    continue
+                raise SystemExit("service 0x%02X: NRC 0x%02X (%s)"
+                                 % (pdu[0], rsp[2], NRC_NAMES.get(rsp[2], "?")))
+        raise SystemExit("service 0x%02X: no response within %.0f s" % (pdu[0], self.deadline))
+
+
+def read_stage(uds):
+    rsp = uds.request(struct.pack(">BH", 0x22, DID_STAGE))
+    return struct.unpack(">IBBIII", rsp[3:21])
+
+
+def print_stage(values):
+    base, state, erased, written, slice_us, erase_us = values
+    print("slot at 0x%08X: %s, %u sectors erased, %u B programmed"
+          % (base, STATES[state] if state < len(STATES) else "?", erased, written))
+    print("longest stall: program slice %u us, sector erase %.0f ms" % (slice_us, erase_us / 1000.0))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Stage an update on a running Mini ECU over UDS.")
+    ap.add_argument("iface", help="SocketCAN interface, e.g. can0")
+    ap.add_argument("bin", nargs="?", help="application .bin")
+    ap.add_argument("--node", type=int, default=0, help="CAN_NODE_ID of the ECU")
+    ap.add_argument("--timeout", type=float, default=0.5, help="response timeout per try (s)")
+    ap.add_argument("--deadline", type=float, default=30.0,
+                    help="give up on one request after this long (s); an erase waits for "
+                         "standstill")
+    ap.add_argument("--no-activate", action="store_true", help="stage only, keep running")
+    ap.add_argument("--status", action="store_true", help="only print the staging figures")
+    args = ap.parse_args()
+
+    if not args.status and not args.bin:
+        ap.error("an image is required unless --status is given")
+
+    can_update.N_TIMEOUT = max(can_update.N_TIMEOUT, args.timeout)
+    uds = Uds(args.iface, args.node, args.timeout, args.deadline)
+
+    if args.status:
+        print_stage(read_stage(uds))
+        return
+
+    uds.request(bytes([0x10, 0x03]))
+    base = read_stage(uds)[0]
+    path, slot = fw_update.slot_image(args.bin, base)
+    image, version, crc = fw_update.load_image(path)
+    print("%s: %s, %u B, CRC 0x%08X -> slot %s at 0x%08X"
+          % (path, fw_update.version_str(version), len(image), crc, slot, base))
+
+    rsp = uds.request(struct.pack(">BBBII", 0x34, 0x00, 0x44, base, len(image)))
+    block = struct.unpack(">H", rsp[2:4])[0] - 2
+    block -= block % 4
+
+    t0 = time.monotonic()
+    counter = 1
+    for pos in range(0, len(image), block):
+        uds.request(bytes([0x36, counter]) + image[pos:pos + block])
+        counter = (counter + 1) & 0xFF
+        if (pos // block) % 64 == 0:
+            sys.stdout.write("\r%u/%u B" % (min(pos + block, len(image)), len(image)))
+            sys.stdout.flush()
+    uds.request(bytes([0x37]))
+    print("\r%u B staged in %.1f s, %u busy answers" % (len(image), time.monotonic() - t0, uds.busy))
+    print_stage(read_stage(uds))
+
+    if not args.no_activate:
+        uds.request(struct.pack(">BBH", 0x31, 0x01, RID_STAGE_ACTIVATE))
+        print("activated, the ECU resets into slot %s on trial" % slot)
+
+
+if __name__ == "__main__":
+    main()
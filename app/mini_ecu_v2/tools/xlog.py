@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+"""
+xlog.py - Unpack a Mini ECU "xlog dump bin" capture of the QSPI flash store.
+
+The dump (see Core/Inc/ext_log.h) is a sequence of frames mixed into the
+normal console output:
+
+    0xFB | len | type | payload
+
+    'H'  version (u8), page size (u16), pages (u32), first sequence (u32)
+    'P'  sequence (u32), offset (u8, 0 or 128), 128 page bytes
+    'E'  pages sent (u32)
+
+Each page is a 16-byte header, magic 0x4C58 (u16), used (u16), sequence
+(u32), time ms (u32), time us (u16), CRC-16/CCITT-FALSE (u16), followed by
+records type (u8) | len (u8) | dt us (u16) | payload:
+
+    0x01        absolute time: ms (u32), us (u16)
+    0x02        CAN frame: id (u32, bit 31 = 29-bit, bit 30 = remote),
+                dlc (u8), data
+    0x10 + n    bytes of log stream n (0 lines, 1 cli, 2 tlm)
+
+The CAN frames become a candump log (canplayer, log2asc); each stream's
+bytes are written to <prefix>.<stream>.bin, the format the live tools
+read: log_decode.py for tokenized lines, tlm_plot.py for telemetry.
+
+Usage:
+    xlog.py capture.bin [-o trace.log] [--streams run] [--iface can0]
+    xlog.py --port /dev/ttyACM0 [--baud 115200] -o trace.log --streams run
+
+Only the Python standard library is needed; --port requires pyserial.
+"""
+
+import argparse
+import struct
+import sys
+
+SYNC = 0xFB
+OTHER_SYNCS = (0xFC, 0xFD, 0xFE)    # rtos trace, can trace, tokenized log
+
+PAGE_MAGIC = 0x4C58
+PAGE_HDR = struct.Struct("<HHIIHH")
+HDR = struct.Struct("<BHII")
+
+REC_TIME = 0x01
+REC_CAN = 0x02
+REC_STREAM = 0x10
+STREAM_NAMES = ("lines", "cli", "tlm")
+
+ID_EXT = 0x80000000
+ID_RTR = 0x40000000
+ID_MASK = 0x1FFFFFFF
+
+
+def crc16(data, crc=0xFFFF):
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+class Decoder:
+    def __init__(self, out, iface, streams):
+        self.out = out
+        self.iface = iface
+        self.streams = streams
+        self.files = {}
+        self.buf = bytearray()
+        self.page_size = 256
+        self.pages = {}
+        self.expected = None
+        self.frames = 0
+        self.sent = 0
+        self.bad = 0
+        self.done = False
+
+    def feed(self, data):
+        self.buf += data
+        while self.buf:
+            starts = [i for i in [self.buf.find(bytes([SYNC]))] +
+                      [self.buf.find(bytes([s])) for s in OTHER_SYNCS] if i >= 0]
+            if not starts:
+                self.buf.clear()
+                return
+            del self.buf[:min(starts)]
+
+            if len(self.buf) < 2 or len(self.buf) < 2 + self.buf[1]:
+                return  # wait for the rest of the frame
+
+            sync, n = self.buf[0], self.buf[1]
+            frame = bytes(self.buf[2:2 + n])
+            del self.buf[:2 + n]
+            if sync == SYNC and frame:
+                self.frame(frame[0:1], frame[1:])
+
+    def frame(self, kind, payload):
+        if kind == b"H" and len(payload) >= HDR.size:
+            version, self.page_size, count, first = HDR.unpack_from(payload)
+            if version != 1:
+                raise SystemExit("unsupported store format (version %u)" % version)
+            self.expected = count
+            sys.stderr.write("xlog: %u pages from sequence %u\n" % (count, first))
+        elif kind == b"P" and len(payload) >= 5:
+            seq, off = struct.unpack_from("<IB", payload)
+            part = self.pages.setdefault(seq, {})
+            part[off] = payload[5:]
+            if sum(len(p) for p in part.values()) >= self.page_size:
+                del self.pages[seq]
+                self.page(seq, b"".join(part[o] for o in sorted(part)))
+        elif kind == b"E" and len(payload) >= 4:
+            sent, = struct.unpack_from("<I", payload)
+            if self.sent != sent:
+                sys.stderr.write("xlog: %u of %u pages received\n" % (self.sent, sent))
+            self.done = True
+
+    def page(self, seq, data):
+        magic, used, pseq, ms, us, crc = PAGE_HDR.unpack_from(data)
+        if (magic != PAGE_MAGIC or pseq != seq or PAGE_HDR.size + used > len(data) or
+                crc16(data[PAGE_HDR.size:PAGE_HDR.size + used], crc16(data[:14])) != crc):
+            self.bad += 1
+            return
+        self.sent += 1
+
+        t = ms * 1000 + us
+        pos, end = PAGE_HDR.size, PAGE_HDR.size + used
+        while pos + 4 <= end:
+            kind, n, dt = struct.unpack_from("<BBH", data, pos)
+            body = data[pos + 4:pos + 4 + n]
+            pos += 4 + n
+            if pos > end:
+                break
+            t += dt
+            if kind == REC_TIME and n == 6:
+                ms, us = struct.unpack_from("<IH", body)
+                t = ms * 1000 + us
+            elif kind == REC_CAN and n >= 5:
+                self.can(t, *struct.unpack_from("<IB", body), body[5:])
+            elif REC_STREAM <= kind < REC_STREAM + len(STREAM_NAMES):
+                self.stream(STREAM_NAMES[kind - REC_STREAM], body)
+
+    def can(self, t, ident, dlc, data):
+        sid = ident & ID_MASK
+        name = ("%08X" % sid) if ident & ID_EXT else ("%03X" % sid)
+        body = "R" if ident & ID_RTR else data[:min(dlc, 8)].hex().upper()
+        self.out.write("(%u.%06u) %s %s#%s\n" % (t // 1000000, t % 1000000, self.iface, name, body))
+        self.frames += 1
+
+    def stream(self, name, data):
+        if self.streams is None:
+            return
+        f = self.files.get(name)
+        if f is None:
+            f = self.files[name] = open("%s.%s.bin" % (self.streams, name), "wb")
+        f.write(data)
+
+    def close(self):
+        for f in self.files.values():
+            f.close()
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Unpack a Mini ECU QSPI flash store dump.")
+    ap.add_argument("input", nargs="?", help="captured console stream (default: stdin)")
+    ap.add_argument("-o", "--output", help="candump log file (default: stdout)")
+    ap.add_argument("--streams", metavar="PREFIX", help="write the log streams to PREFIX.<stream>.bin")
+    ap.add_argument("--iface", default="can0", help="interface name in the log")
+    ap.add_argument("--port", help="read live from a serial port (needs pyserial)")
+    ap.add_argument("--baud", type=int, default=115200)
+    args = ap.parse_args()
+
+    out = open(args.output, "w") if args.output else sys.stdout
+    dec = Decoder(out, args.iface, args.streams)
+
+    with out:
+        if args.port:
+            import serial  # pylint: disable=import-outside-toplevel
+            with serial.Serial(args.port, args.baud, timeout=0.1) as ser:
+                ser.write(b"\r\nxlog dump bin\r\n")
+                while not dec.done:
+                    dec.feed(ser.read(4096))
+        else:
+            src = open(args.input, "rb") if args.input else sys.stdin.buffer
+            with src:
+                while not dec.done:
+                    chunk = src.read(4096)
+                    if not chunk:
+                        break
+                    dec.feed(chunk)
+    dec.close()
+
+    sys.stderr.write("xlog: %u pages, %u CAN frames" % (dec.sent, dec.frames))
+    sys.stderr.write(", %u pages failed the check\n" % dec.bad if dec.bad else "\n")
+    if not dec.done:
+        sys.stderr.write("xlog: no end frame, dump incomplete\n")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(main())
+    except KeyboardInterrupt:
+        pass
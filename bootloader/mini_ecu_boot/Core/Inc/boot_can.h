@@ -0,0 +1,123 @@
+/**
+ * @file    boot_can.h
+ * @brief   Polled CAN1 + ISO-TP (ISO 15765-2) transport for firmware update.
+ *
+ * Carries the boot_update.h command set over CAN on the usual diagnostic
+ * identifiers (11-bit, normal addressing, DLC 8 with padding):
+ *
+ *   | ID                       | Direction  | Use                            |
+ *   |--------------------------|------------|--------------------------------|
+ *   | 0x7E0 + BOOT_CAN_NODE    | host -> ECU| physical requests              |
+ *   | 0x7E8 + BOOT_CAN_NODE    | ECU -> host| responses                      |
+ *   | 0x7DF                    | host -> all| functional (multicast) requests|
+ *
+ * Request PDU:  | cmd | 0 | seq (u16) | data ... |
+ * Response PDU: | cmd | status | seq (u16) | values (u32) ... |
+ *
+ * The 4-byte request header keeps WRITE data word-aligned for flash
+ * programming. Integrity comes from the CAN CRC and the ISO-TP sequence
+ * numbers; the image CRC is checked on DONE as over UART.
+ *
+ * Flow control: a physical First Frame is answered with FC(CTS) carrying
+ * BOOT_CAN_BS / BOOT_CAN_STMIN. Functional addressing extends ISO 15765-2
+ * (which allows only Single Frames there): a functional First Frame gets
+ * no FC from any receiver and the sender streams every Consecutive Frame
+ * with a block size and STmin agreed in advance, so one transfer reaches
+ * all ECUs on the bus. A receiver that loses a frame drops the PDU; the
+ * host finds the gap through a physical DONE and resends it physically.
+ *
+ * Everything is polled from the update loop: the RX FIFO is only read
+ * between commands, never while the CPU is stalled by flash programming,
+ * so the sender must not start a new PDU before the previous one was
+ * consumed (physical: FC of the next FF is sent only then; functional:
+ * the host leaves a gap after each chunk).
+ */
+
+#ifndef BOOT_CAN_H
+#define BOOT_CAN_H
+
+#include "main.h"
+#include "boot_update.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+#ifndef BOOT_CAN_BITRATE
+#define BOOT_CAN_BITRATE      500000U
+#endif
+
+/** Node number on the bus; selects the physical request/response IDs. */
+#ifndef BOOT_CAN_NODE
+#define BOOT_CAN_NODE         0U
+#endif
+
+#define BOOT_CAN_REQ_ID       (0x7E0U + BOOT_CAN_NODE)
+#define BOOT_CAN_RESP_ID      (0x7E8U + BOOT_CAN_NODE)
+#define BOOT_CAN_FUNC_ID      0x7DFU
+
+/** Block size sent in our FC frames (0 = whole PDU without further FC). */
+#ifndef BOOT_CAN_BS
+#define BOOT_CAN_BS           0U
+#endif
+
+/** STmin sent in our FC frames (ISO-TP encoding: 0..127 ms, 0xF1..0xF9 = 100..900 us). */
+#ifndef BOOT_CAN_STMIN
+#define BOOT_CAN_STMIN        0U
+#endif
+
+/** N_Cr / N_Bs: longest gap between frames of one PDU (ms). */
+#ifndef BOOT_CAN_TIMEOUT_MS
+#define BOOT_CAN_TIMEOUT_MS   1000U
+#endif
+
+#define BOOT_CAN_PAD          0xCCU
+
+/** Request/response PDU header (cmd, 0 or status, seq). */
+#define BOOT_CAN_HDR_SIZE     4U
+
+/** Largest request PDU: header + one WRITE chunk. */
+#define BOOT_CAN_PDU_MAX      (BOOT_CAN_HDR_SIZE + BOOT_UPDATE_CHUNK)
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start CAN1 at BOOT_CAN_BITRATE (normal mode, polled).
+ *
+ * Call after the clock switch: the bit timing is derived from the current
+ * PCLK1.
+ *
+ * @return HAL_OK, or HAL_ERROR if the bitrate cannot be reached exactly.
+ */
+HAL_StatusTypeDef BootCan_Init(void);
+
+/**
+ * @brief Poll the RX FIFO and reassemble ISO-TP frames.
+ *
+ * @param[out] len        PDU length.
+ * @param[out] functional 1 if the PDU came on BOOT_CAN_FUNC_ID.
+ * @return The complete PDU (word-aligned, valid until the next call), or
+ *         NULL if none is complete yet.
+ */
+const uint8_t *BootCan_Poll(uint32_t *len, uint8_t *functional);
+
+/**
+ * @brief Send a PDU on BOOT_CAN_RESP_ID (segmented, blocking).
+ *
+ * Multi-frame PDUs wait for the host's FC and honour its BS and STmin.
+ *
+ * @return HAL_OK, or HAL_TIMEOUT / HAL_ERROR if the host did not take it.
+ */
+HAL_StatusTypeDef BootCan_Send(const uint8_t *data, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOOT_CAN_H */
@@ -0,0 +1,55 @@
+/**
+ * @file    boot_fast.h
+ * @brief   Fast boot path: jump to the application straight out of reset.
+ *
+ * Reset_Handler calls BootFast_Entry() right after SystemInit(), before
+ * .data/.bss are set up, HAL_Init(), the clock configuration, GPIO/UART
+ * init and the boot banner. It jumps to the application when nothing
+ * needs the full bootloader:
+ *   - B1 is not pressed (read from GPIOC->IDR),
+ *   - the application left no update request (hand-off block or backup
+ *     SRAM),
+ *   - the slot that boots first is not on trial (boot_slot.h),
+ *   - its header checks out and its CRC was verified since the last power
+ *     loss (backup-SRAM record, BootImage_IsVerified()).
+ *
+ * Otherwise it returns and main() takes the normal, logged path, which
+ * also runs the CRC and records it, so the next reset is fast again. The
+ * application starts on the HSI 16 MHz with every peripheral in its reset
+ * state, as after the normal path, and finds the hand-off block
+ * (boot_handoff.h) filled in; BootFast_Entry() starts that block on every
+ * boot, fast or not.
+ *
+ * Everything called from here may only use the stack, const data and the
+ * hand-off block.
+ */
+
+#ifndef BOOT_FAST_H
+#define BOOT_FAST_H
+
+#include "main.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** 0: always take the full, logged boot path (e.g. to see the banner). */
+#ifndef BOOT_FAST_PATH
+#define BOOT_FAST_PATH         1
+#endif
+
+/** B1 level at reset, shared by the fast path and main.c. */
+#define BOOT_BUTTON_PRESSED()  ((B1_GPIO_Port->IDR & B1_Pin) != 0U)
+
+/**
+ * @brief Jump to the application if the fast path applies, else return.
+ *
+ * Called from Reset_Handler (startup_stm32f446retx.s) only.
+ */
+void BootFast_Entry(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOOT_FAST_H */
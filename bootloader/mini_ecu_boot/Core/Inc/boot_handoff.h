@@ -0,0 +1,119 @@
+/**
+ * @file    boot_handoff.h
+ * @brief   Bootloader-to-application hand-off block in no-init RAM.
+ *
+ * The last 64 bytes of SRAM (BOOT_HANDOFF_ADDR) belong to neither image:
+ * both linker scripts end RAM below them, so no startup code clears them
+ * and they survive a system reset (not a power loss). The bootloader fills
+ * the block on every boot; the application reads what the bootloader did
+ * instead of finding out again, and leaves requests for the next boot:
+ *
+ *   - reset cause: the RCC->CSR reset flags, which the bootloader clears,
+ *   - clock: the CLOCK_PROFILE_xxx (app clock_cfg.h) the core runs with,
+ *     so the application can skip its own switch when it matches,
+ *   - boot time: microseconds from Reset_Handler to the jump, which path
+ *     (fast or logged), slot and trial attempt,
+ *   - update status: the outcome of the last update session, carried over
+ *     the reset that ends it,
+ *   - request: BOOT_HANDOFF_REQ_UPDATE from the application makes the next
+ *     boot stay in update mode.
+ *
+ * The block is valid when magic, version and check match; power-up RAM
+ * contents never are. The application has its own copy of this layout in
+ * boot_handoff.h; keep the two in sync.
+ */
+
+#ifndef BOOT_HANDOFF_H
+#define BOOT_HANDOFF_H
+
+#include "main.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Layout                                                                     */
+/* -------------------------------------------------------------------------- */
+
+#define BOOT_HANDOFF_ADDR        0x2001FFC0U   /* last 64 B of SRAM */
+#define BOOT_HANDOFF_MAGIC       0x46464F48U   /* "HOFF" */
+#define BOOT_HANDOFF_VERSION     1U
+
+/** clock: the reset state, no profile (the app must configure). */
+#define BOOT_HANDOFF_CLOCK_NONE  0xFFFFFFFFU
+/** clock: CLOCK_PROFILE_HSI16 (HSI, APB1 = HCLK / 2, VOS scale 3). */
+#define BOOT_HANDOFF_CLOCK_HSI16 0U
+
+/** flags */
+#define BOOT_HANDOFF_FAST        0x01U         /**< Fast path (boot_fast.c). */
+
+/** updateStatus */
+#define BOOT_HANDOFF_UPDATE_NONE      0U       /**< No update since the last report. */
+#define BOOT_HANDOFF_UPDATE_INSTALLED 1U       /**< New image verified and activated. */
+#define BOOT_HANDOFF_UPDATE_ABORTED   2U       /**< Session reset before DONE passed. */
+#define BOOT_HANDOFF_UPDATE_IDLE      3U       /**< Update mode timed out, no session. */
+
+/** request */
+#define BOOT_HANDOFF_REQ_NONE    0U
+#define BOOT_HANDOFF_REQ_UPDATE  0x54445055U   /* "UPDT" */
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;        /**< BOOT_HANDOFF_VERSION */
+    uint32_t resetCause;     /**< RCC->CSR bits 31..24 at reset */
+    uint32_t clock;          /**< BOOT_HANDOFF_CLOCK_xxx */
+    uint32_t bootUs;         /**< Reset_Handler to the jump; CYCCNT keeps running */
+    uint32_t flags;          /**< BOOT_HANDOFF_FAST */
+    uint32_t slot;           /**< 'A' or 'B' */
+    uint32_t attempt;        /**< Trial boot number, 0 if not on trial */
+    uint32_t updateStatus;   /**< BOOT_HANDOFF_UPDATE_xxx */
+    uint32_t updateVersion;  /**< Image version for UPDATE_INSTALLED */
+    uint32_t request;        /**< BOOT_HANDOFF_REQ_xxx, application -> bootloader */
+    uint32_t check;          /**< ~XOR of the words above */
+} BootHandoff_t;
+
+#define BOOT_HANDOFF             ((BootHandoff_t *)BOOT_HANDOFF_ADDR)
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start a boot: take the reset cause, start the boot timer and
+ *        reset the block, keeping the update status and request of the
+ *        previous one.
+ *
+ * First thing in BootFast_Entry(); uses no RAM but the block itself.
+ */
+void BootHandoff_Begin(void);
+
+/**
+ * @brief Read and clear the application's update request.
+ */
+uint8_t BootHandoff_TakeRequest(void);
+
+/**
+ * @brief Record the outcome of an update session for the next boot.
+ */
+void BootHandoff_SetUpdate(uint32_t status, uint32_t version);
+
+/**
+ * @brief Complete the block just before the jump.
+ *
+ * Switches the clock tree from the reset state to the application's
+ * HSI16 profile (APB1 prescaler, voltage scale), then records it with the
+ * boot time.
+ *
+ * @param slot    Slot name ('A', 'B').
+ * @param attempt BootSlot_CountAttempt() result.
+ * @param flags   BOOT_HANDOFF_FAST or 0.
+ */
+void BootHandoff_Finish(char slot, uint32_t attempt, uint32_t flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOOT_HANDOFF_H */
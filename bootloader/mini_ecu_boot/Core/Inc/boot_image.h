@@ -0,0 +1,192 @@
+/**
+ * @file    boot_image.h
+ * @brief   Application image header and CRC verification.
+ *
+ * Every application slot (boot_slot.h) starts with an image whose
+ * ImageHeader_t sits at IMAGE_HEADER_OFFSET, right behind its vector table
+ * (see the app's image_header.h, which must match this layout). Its CRC
+ * covers the image from the slot base to base + length with the header
+ * skipped, so the boot-control words at its end can be programmed later
+ * without touching the CRC.
+ *
+ * BootImage_Verify() recomputes the CRC with the CRC unit, fed by DMA2 so
+ * the CPU only waits for the transfer, and records a successful check in
+ * backup SRAM. The next reset of the same image (same CRC and length) then
+ * skips the flash scan.
+ *
+ * A good CRC is followed by the signature check (boot_sig.h) on the
+ * ImageSig_t trailer behind the image; that result is recorded in flash,
+ * so it costs the software SHA-512 once per image.
+ */
+
+#ifndef BOOT_IMAGE_H
+#define BOOT_IMAGE_H
+
+#include "main.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Image layout                                                               */
+/* -------------------------------------------------------------------------- */
+
+/** Offset of the header from the image start (vector table is 0x1C4 B). */
+#define IMAGE_HEADER_OFFSET    0x200U
+
+#define IMAGE_HEADER_MAGIC     0x5543454DU   /* "MECU" */
+
+/** Erased flash word: header field not stamped / boot-control flag not set. */
+#define IMAGE_ERASED           0xFFFFFFFFU
+
+typedef struct
+{
+    uint32_t magic;       /**< IMAGE_HEADER_MAGIC. */
+    uint32_t version;     /**< Firmware version, 0x00MMmmpp. */
+    uint32_t length;      /**< Image bytes from the slot base, multiple of 4. */
+    uint32_t crc32;       /**< STM32 CRC of the image without the header. */
+
+    /* Boot control: linked erased, each programmed once in place. */
+    uint32_t generation;  /**< Activation count, set by the bootloader on GO. */
+    uint32_t confirmed;   /**< 0 once the application accepted the image. */
+    uint32_t revoked;     /**< 0 once the image was rolled back. */
+} ImageHeader_t;
+
+#define BOOT_IMAGE_HEADER(base)  ((const ImageHeader_t *)((base) + IMAGE_HEADER_OFFSET))
+
+#define IMAGE_SIG_MAGIC        0x4E474953U   /* "SIGN" */
+
+/** Signature trailer at slot base + header length (tools/image_stamp.py --key). */
+typedef struct
+{
+    uint32_t magic;          /**< IMAGE_SIG_MAGIC. */
+    uint8_t  signature[64];  /**< Ed25519 (R, S) of the image, see boot_sig.h. */
+} ImageSig_t;
+
+/* -------------------------------------------------------------------------- */
+/* Backup SRAM                                                                */
+/* -------------------------------------------------------------------------- */
+
+/*
+ * BKPSRAM_BASE + 0x00: "verified" record of the last good CRC check (16 B).
+ * BKPSRAM_BASE + 0x10: update request word of older application images;
+ *                      current ones use the hand-off block (boot_handoff.h).
+ * BKPSRAM_BASE + 0x14: boot-attempt counter of a slot on trial (boot_slot.c).
+ */
+#define BOOT_REQUEST_ADDR      (BKPSRAM_BASE + 0x10U)
+#define BOOT_REQUEST_UPDATE    0x54445055U   /* "UPDT" */
+#define BOOT_TRIAL_ADDR        (BKPSRAM_BASE + 0x14U)
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Start images without a header or with erased length/CRC (linked but not
+ * run through tools/image_stamp.py, e.g. flashed from the IDE). On by
+ * default only in debug builds.
+ */
+#ifndef BOOT_ALLOW_UNSTAMPED
+#ifdef DEBUG
+#define BOOT_ALLOW_UNSTAMPED   1
+#else
+#define BOOT_ALLOW_UNSTAMPED   0
+#endif
+#endif
+
+/** Upper bound for one DMA pass over the image (ms). */
+#ifndef BOOT_CRC_TIMEOUT_MS
+#define BOOT_CRC_TIMEOUT_MS    1000U
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    BOOT_IMAGE_OK = 0,       /**< CRC matches (or matched at an earlier reset). */
+    BOOT_IMAGE_NO_HEADER,    /**< No header magic at the expected address. */
+    BOOT_IMAGE_UNSTAMPED,    /**< Header present, length/CRC still erased. */
+    BOOT_IMAGE_BAD_LENGTH,   /**< Length unaligned, too small or too large. */
+    BOOT_IMAGE_BAD_CRC,      /**< Image does not match its CRC. */
+    BOOT_IMAGE_DMA_ERROR,    /**< CRC transfer failed or timed out. */
+    BOOT_IMAGE_WRONG_SLOT,   /**< Reset vector outside the slot: linked for the other one. */
+    BOOT_IMAGE_UNSIGNED,     /**< No signature trailer (and BOOT_ALLOW_UNSIGNED is 0). */
+    BOOT_IMAGE_BAD_SIGNATURE /**< Signature trailer does not verify. */
+} BootImage_Result_t;
+
+typedef struct
+{
+    uint32_t version;      /**< From the header (0 without one). */
+    uint32_t length;
+    uint32_t crcStored;
+    uint32_t crcComputed;  /**< Equals crcStored on the fast path. */
+    uint32_t elapsedMs;    /**< Time spent in BootImage_Verify(). */
+    uint8_t  cached;       /**< 1 if the backup-SRAM record was used. */
+    uint8_t  sig;          /**< BootSig_Result_t after a good CRC. */
+} BootImage_Info_t;
+
+/**
+ * @brief Check the image in the slot at @p base against its header, then
+ *        its signature.
+ *
+ * @param base Slot start (vector table).
+ * @param size Slot size, upper bound for the image length.
+ * @param[out] info Details for the boot log (may be NULL).
+ */
+BootImage_Result_t BootImage_Verify(uint32_t base, uint32_t size, BootImage_Info_t *info);
+
+/**
+ * @brief Header checks of BootImage_Verify() plus the backup-SRAM record,
+ *        without a CRC run.
+ *
+ * Uses no HAL timebase and no RAM state, so it also works before HAL_Init()
+ * and before .data/.bss are set up (boot_fast.c).
+ *
+ * @return 1 if the image at @p base was verified since the last power loss.
+ */
+uint8_t BootImage_IsVerified(uint32_t base, uint32_t size);
+
+/**
+ * @brief STM32 CRC over [addr, addr + len) in flash or RAM.
+ *
+ * @p addr and @p len must be 4-byte aligned.
+ *
+ * @param[out] crc Result (CRC unit started from its reset value).
+ */
+HAL_StatusTypeDef BootImage_Crc(uint32_t addr, uint32_t len, uint32_t *crc);
+
+/**
+ * @brief Drop the "verified" record, e.g. before the app area is erased.
+ */
+void BootImage_Invalidate(void);
+
+/**
+ * @brief Enable access to backup SRAM (PWR clock, DBP, BKPSRAM clock).
+ */
+void BootImage_BackupEnable(void);
+
+/**
+ * @brief Read and clear the application's update request.
+ *
+ * @return 1 if the application asked to stay in update mode.
+ */
+uint8_t BootImage_TakeUpdateRequest(void);
+
+/**
+ * @brief Check for the application's update request without clearing it.
+ */
+uint8_t BootImage_UpdateRequested(void);
+
+/**
+ * @brief Short text for a result code.
+ */
+const char *BootImage_ResultName(BootImage_Result_t result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOOT_IMAGE_H */
@@ -0,0 +1,104 @@
+/**
+ * @file    boot_resume.h
+ * @brief   Transfer records at the slot end, so an interrupted update resumes.
+ *
+ * ERASE with a tag (protocol 7, boot_update.h) starts a record in the slot
+ * it erases: image length, sector mask and the host's tag (its CRC of the
+ * image). Behind that header the record has one flag byte per chunk,
+ * programmed from erased to 0 once the chunk was programmed and read back.
+ * Every flag is written once, so nothing is ever programmed twice, and a
+ * reset at any point leaves the record describing exactly the chunks that
+ * are in flash.
+ *
+ * INFO reports the live record; a later ERASE with the same length, mask
+ * and tag takes it over instead of erasing, and the host sends only the
+ * chunks still missing. DONE retires the record once every chunk is in.
+ *
+ * BOOT_RESUME_RECORDS records sit in front of the signature check log
+ * (boot_sig.h). ERASE retires the previous record and appends the next;
+ * once none is free the slot's last sector is erased with the others,
+ * like the full check log.
+ *
+ * All functions but BootResume_Current() program flash and expect it
+ * unlocked, as the update session keeps it from ERASE to DONE.
+ */
+
+#ifndef BOOT_RESUME_H
+#define BOOT_RESUME_H
+
+#include "boot_sig.h"
+#include "boot_slot.h"
+#include "boot_update.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Transfer records per slot. */
+#ifndef BOOT_RESUME_RECORDS
+#define BOOT_RESUME_RECORDS    4U
+#endif
+
+/** Chunks of the largest slot: one flag byte each. */
+#define BOOT_RESUME_CHUNKS     ((BOOT_SLOT_MAX_SIZE + BOOT_UPDATE_CHUNK - 1U) / BOOT_UPDATE_CHUNK)
+
+#define BOOT_RESUME_SIZE       (BOOT_RESUME_RECORDS * sizeof(BootResume_Record_t))
+
+/**
+ * Bytes at the end of each slot that belong to the bootloader, not to the
+ * image: the transfer records, then the signature check log.
+ */
+#define BOOT_SLOT_TAIL_SIZE    (BOOT_RESUME_SIZE + BOOT_SIG_CACHE_SIZE)
+
+#if (BOOT_RESUME_CHUNKS % 4U) != 0U
+#error "BOOT_RESUME_CHUNKS must be a multiple of 4"
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    uint32_t length;                     /**< Image bytes from ERASE; erased = free. */
+    uint32_t mask;                       /**< ERASE sector mask. */
+    uint32_t tag;                        /**< Host tag of the image. */
+    uint32_t retired;                    /**< 0 once the transfer is over. */
+    uint8_t  chunk[BOOT_RESUME_CHUNKS];  /**< 0 once chunk n is in flash. */
+} BootResume_Record_t;
+
+/**
+ * @brief The live record of the slot at @p base, or NULL.
+ */
+const BootResume_Record_t *BootResume_Current(uint32_t base, uint32_t size);
+
+/**
+ * @brief Start a record for a transfer; NULL if no record is free.
+ *
+ * The slot's live record must have been retired (BootResume_Retire()).
+ */
+const BootResume_Record_t *BootResume_Begin(uint32_t base, uint32_t size, uint32_t length,
+                                            uint32_t mask, uint32_t tag);
+
+/**
+ * @brief Note that chunk @p chunk of the transfer is in flash.
+ */
+void BootResume_Mark(const BootResume_Record_t *rec, uint32_t chunk);
+
+/**
+ * @brief Retire the slot's live record.
+ *
+ * @return 1 if no record is free, so the next transfer cannot be recorded
+ *         until the slot's last sector is erased.
+ */
+uint8_t BootResume_Retire(uint32_t base, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOOT_RESUME_H */
@@ -0,0 +1,118 @@
+/**
+ * @file    boot_sig.h
+ * @brief   Ed25519 image signature and the per-slot record of its check.
+ *
+ * A signed image carries an ImageSig_t (boot_image.h) right behind its
+ * last byte, written by tools/image_stamp.py --key. The signature covers
+ * the image from the slot base up to the header length with the three
+ * boot-control words taken as erased, i.e. the stamped .bin as built:
+ * magic, version, length and CRC are all signed.
+ *
+ * Checking it means SHA-512 over the whole image in software, far slower
+ * than the DMA CRC, so the result is recorded once per image. The last
+ * BOOT_SIG_CACHE_SIZE bytes of each slot are a log of flash words the
+ * update protocol cannot write (ERASE refuses images that reach into
+ * them). A word goes from erased to the image CRC (folded with the public
+ * key) when a signature checks out, and to 0 when ERASE starts rewriting
+ * the slot, before any of the new image is programmed. The live entry
+ * therefore always describes the image programmed after it, and a boot
+ * with the CRC matching it skips the signature: the CRC run is the only
+ * scan of the image, as without signatures.
+ *
+ * The log fills up only if ERASE never erases the slot's last sector
+ * (images that end before it); ERASE then erases that sector as well.
+ * Option-byte write protection of sectors 0..1 (the key) is up to the
+ * production setup.
+ */
+
+#ifndef BOOT_SIG_H
+#define BOOT_SIG_H
+
+#include "boot_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Start images without a signature trailer. A trailer that does not verify
+ * is always refused. On by default only in debug builds, like
+ * BOOT_ALLOW_UNSTAMPED.
+ */
+#ifndef BOOT_ALLOW_UNSIGNED
+#ifdef DEBUG
+#define BOOT_ALLOW_UNSIGNED    1
+#else
+#define BOOT_ALLOW_UNSIGNED    0
+#endif
+#endif
+
+/**
+ * Public key images are signed with. The default is the development key
+ * (app tools/dev_signing.key), which every checkout has: production builds
+ * pass their own with -DBOOT_SIG_PUBLIC_KEY="{ ... }"; image_stamp.py
+ * --genkey prints one in this form.
+ */
+#ifndef BOOT_SIG_PUBLIC_KEY
+#define BOOT_SIG_PUBLIC_KEY                                                     \
+    { 0x4EU, 0xFAU, 0x43U, 0x62U, 0x4FU, 0x26U, 0xD8U, 0x10U,                   \
+      0xF1U, 0xDEU, 0x3FU, 0xA4U, 0x27U, 0xB1U, 0x16U, 0x0BU,                   \
+      0xA3U, 0xA5U, 0x18U, 0x8AU, 0x28U, 0x39U, 0x49U, 0xBFU,                   \
+      0x91U, 0xC7U, 0x0BU, 0x50U, 0xD0U, 0xC4U, 0x77U, 0xC4U }
+#endif
+
+/** Check log at the end of every slot: one word per image. */
+#ifndef BOOT_SIG_CACHE_SIZE
+#define BOOT_SIG_CACHE_SIZE    64U
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    BOOT_SIG_OK = 0,     /**< Signature verified now (and recorded). */
+    BOOT_SIG_CACHED,     /**< Verified for this image earlier. */
+    BOOT_SIG_NONE,       /**< No signature trailer. */
+    BOOT_SIG_BAD         /**< Trailer present, signature does not verify. */
+} BootSig_Result_t;
+
+/**
+ * @brief The signature trailer of the image at @p base, or NULL.
+ *
+ * The header must have passed the checks of BootImage_Verify().
+ */
+const ImageSig_t *BootSig_Trailer(uint32_t base, uint32_t size);
+
+/**
+ * @brief Check the signature of the image at @p base, from the log if its
+ *        CRC was recorded, else with Ed25519 (then recorded).
+ *
+ * For an image whose header and CRC checked out (BootImage_Verify()).
+ * Programs flash, so the flash must not be in use by anything else.
+ */
+BootSig_Result_t BootSig_Check(uint32_t base, uint32_t size);
+
+/**
+ * @brief Retire the slot's live entry; before the slot is rewritten.
+ *
+ * @return 1 if the log has no free word left, so the next check could
+ *         not be recorded until the slot's last sector is erased.
+ */
+uint8_t BootSig_Forget(uint32_t base, uint32_t size);
+
+/**
+ * @brief Short text for a result code.
+ */
+const char *BootSig_ResultName(BootSig_Result_t result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOOT_SIG_H */
@@ -0,0 +1,143 @@
+/**
+ * @file    boot_slot.h
+ * @brief   A/B application slots: selection, activation and rollback.
+ *
+ * The 448 KB behind the bootloader and the application's DTC log (sectors
+ * 2..3, 0x08008000) hold two slots, each a complete image with its own
+ * header (boot_image.h), linked for that slot's address:
+ *
+ *   | Slot | Address    | Sectors | Size   | App build        |
+ *   |------|------------|---------|--------|------------------|
+ *   | A    | 0x08010000 | 4..5    | 192 KB | mini_ecu_v2.bin  |
+ *   | B    | 0x08040000 | 6..7    | 256 KB | mini_ecu_v2_b.bin|
+ *
+ * The header's boot-control words are linked erased and programmed in
+ * place, without an erase:
+ *   - generation: written on activation (update GO) as one more than the
+ *     other slot's. The slot with the highest generation boots first; an
+ *     image that never went through an update (flashed by the debugger)
+ *     counts as generation 0.
+ *   - confirmed: programmed to 0 by the application once it runs fine.
+ *     Until then the slot is on trial and every boot of it is counted in
+ *     backup SRAM (BOOT_TRIAL_ADDR).
+ *   - revoked: programmed to 0 when a trial runs out of attempts (or the
+ *     application asks for a rollback); the slot is never booted again
+ *     until it is rewritten.
+ *
+ * The last BOOT_SLOT_TAIL_SIZE bytes of each slot belong to the bootloader
+ * (boot_resume.h), not to the image.
+ *
+ * Updates always go to the slot that is not booting (BootSlot_Target()),
+ * so the running image stays intact until the new one is verified and
+ * activated; switching over or rolling back is one word program.
+ */
+
+#ifndef BOOT_SLOT_H
+#define BOOT_SLOT_H
+
+#include "main.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Boots of an unconfirmed slot before it is rolled back. */
+#ifndef BOOT_MAX_ATTEMPTS
+#define BOOT_MAX_ATTEMPTS      3U
+#endif
+
+#define BOOT_SLOT_COUNT        2U
+#define BOOT_SLOT_NONE         0xFFU
+
+#define BOOT_SLOT_A_ADDR       APP_START_ADDR
+#define BOOT_SLOT_B_ADDR       0x08040000U
+
+/** Largest slot (B); sizes buffers that cover a whole slot. */
+#define BOOT_SLOT_MAX_SIZE     (256U * 1024U)
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    uint32_t sector;   /**< FLASH_SECTOR_x */
+    uint32_t start;
+    uint32_t size;
+} BootSlot_Sector_t;
+
+typedef struct
+{
+    char                     name;         /**< 'A' or 'B' */
+    uint32_t                 base;
+    uint32_t                 size;
+    const BootSlot_Sector_t *sectors;
+    uint32_t                 sectorCount;
+} BootSlot_t;
+
+/**
+ * @brief Slot @p slot (0 = A, 1 = B), or NULL.
+ */
+const BootSlot_t *BootSlot_Get(uint32_t slot);
+
+/**
+ * @brief Bootable slots in boot order (highest generation first).
+ *
+ * A slot qualifies with a header magic and without the revoked flag; the
+ * CRC is not checked here.
+ *
+ * @param[out] order Slot numbers, BOOT_SLOT_COUNT entries.
+ * @return Number of entries filled in.
+ */
+uint32_t BootSlot_Candidates(uint32_t order[BOOT_SLOT_COUNT]);
+
+/**
+ * @brief The slot that boots next: the first candidate whose image checks
+ *        out (BootImage_Verify()), or BOOT_SLOT_NONE.
+ */
+uint32_t BootSlot_Active(void);
+
+/**
+ * @brief The slot updates are written to: the one that does not boot.
+ */
+uint32_t BootSlot_Target(void);
+
+/**
+ * @brief Count a boot of @p slot if it is on trial.
+ *
+ * @return 0 for a confirmed (or never activated) image, otherwise the
+ *         number of this attempt, 1 .. BOOT_MAX_ATTEMPTS + 1.
+ */
+uint32_t BootSlot_CountAttempt(uint32_t slot);
+
+/**
+ * @brief The slot boot_fast.c may start without further work, or
+ *        BOOT_SLOT_NONE.
+ *
+ * That is the first candidate if it is not on trial and its image was
+ * verified since the last power loss (BootImage_IsVerified()). Safe to call
+ * before HAL_Init() and before .data/.bss are initialized.
+ */
+uint32_t BootSlot_FastBoot(void);
+
+/**
+ * @brief Make @p slot boot next: program its generation, start its trial.
+ *
+ * @return HAL_OK, or HAL_ERROR if the generation word is already written.
+ */
+HAL_StatusTypeDef BootSlot_Activate(uint32_t slot);
+
+/**
+ * @brief Program the revoked flag of @p slot.
+ */
+HAL_StatusTypeDef BootSlot_Revoke(uint32_t slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOOT_SLOT_H */
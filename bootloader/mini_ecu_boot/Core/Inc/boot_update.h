@@ -0,0 +1,184 @@
+/**
+ * @file    boot_update.h
+ * @brief   Windowed UART firmware update protocol of the bootloader.
+ *
+ * Binary frames in both directions (little-endian):
+ *
+ *   | Offset | Size | Field                                             |
+ *   |--------|------|---------------------------------------------------|
+ *   | 0      | 1    | sync: 0xA5 host -> ECU, 0x5A ECU -> host          |
+ *   | 1      | 1    | cmd (BootUpdate_Cmd_t; replies echo it)           |
+ *   | 2      | 2    | seq: chunk number for WRITE, echoed in the reply  |
+ *   | 4      | 2    | len: payload bytes, multiple of 4, <= CHUNK       |
+ *   | 6      | 1    | ~sync                                             |
+ *   | 7      | 1    | XOR of bytes 0..6                                 |
+ *   | 8      | len  | payload                                           |
+ *   | 8+len  | 4    | STM32 CRC of bytes 0 .. 8+len-1                   |
+ *
+ * Every host frame gets one reply whose payload starts with a
+ * BootUpdate_Status_t word. WRITE chunk n covers image bytes
+ * [n * CHUNK, n * CHUNK + len); the host keeps up to WINDOW chunks in
+ * flight and resends only the ones that are NAKed or time out. Chunks may
+ * arrive in any order and duplicates are acknowledged without
+ * reprogramming.
+ *
+ * RX runs on a circular DMA ring, so the next frames keep arriving while
+ * the current chunk is programmed (32-bit words, VOLTAGE_RANGE_3).
+ *
+ * A session writes the slot that is not booting (boot_slot.h); INFO
+ * reports its base address, and the host sends the image linked for it.
+ * GO after a successful DONE activates that slot, so the old image keeps
+ * booting until the new one is complete and verified.
+ *
+ * Delta updates: HASH returns the CRC of one sector of that slot as it is
+ * in flash. The host compares it with the same range of the new image
+ * (padded with 0xFF) and passes ERASE a mask of the sectors that differ;
+ * only those are erased and written, the rest count as written already.
+ * A release that changes a few KB then rewrites one or two sectors.
+ *
+ * Compressed updates: ZWRITE carries the image as one LZ4 block (raw
+ * block format, no frame header) cut into CHUNK-sized pieces, zero-padded
+ * to a multiple of 4. The stream decodes into the slot from the first
+ * sector ERASE erased (0 for a full update) to the image length; chunk n
+ * of the stream must follow chunk n - 1, so the host goes back to the
+ * chunk the reply asks for after any loss (ERR_SEQ). The decoder keeps
+ * only the output chunk being assembled in RAM: matches further back are
+ * read from the slot, which holds the image up to there (written, or kept
+ * by the delta). Output in kept sectors is not programmed. A session uses
+ * either WRITE or ZWRITE.
+ *
+ * Signed images (protocol 6): DONE checks the Ed25519 signature behind
+ * the image as well (boot_sig.h) and records the result, so the first boot
+ * of the new image does not repeat it. The last BOOT_SIG_CACHE_SIZE bytes
+ * of the slot hold that record; INFO reports the slot size without them
+ * and ERASE refuses a longer image.
+ *
+ * Resumed transfers (protocol 7): ERASE may carry a tag, the host's CRC of
+ * the image. The bootloader then records the transfer in the slot
+ * (boot_resume.h), with a flag per chunk programmed as the chunk is. INFO
+ * reports that record after its first eight words: length, mask and tag,
+ * then a bitmap of the chunks in flash (kept sectors included), one bit
+ * per chunk from bit 0 of the first word. After a reset or a broken link
+ * the host compares it with its image, sends ERASE again with the same
+ * length, mask and tag, which erases nothing and takes the bitmap over,
+ * and then only the chunks missing. A ZWRITE stream then starts at the
+ * first missing chunk. DONE retires the record, and ERASE with anything
+ * else starts a new one. The tail of the slot holds the records in front
+ * of the check log; INFO reports the slot size without either.
+ *
+ * BAUD moves the UART to a faster rate: the reply goes out at the old
+ * rate, then the divider is reprogrammed. The host switches its port and
+ * sends any frame (INFO) at the new rate; if no frame with a good CRC
+ * arrives within BOOT_UPDATE_BAUD_CONFIRM_MS the old rate comes back. At
+ * PCLK1 = 42 MHz 2000000 and 3000000 (8x oversampling) are exact.
+ *
+ * The same commands are served over CAN as ISO-TP PDUs, see boot_can.h.
+ */
+
+#ifndef BOOT_UPDATE_H
+#define BOOT_UPDATE_H
+
+#include "main.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Configuration                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Update-mode baud rate; USART2 runs from PCLK1 = 42 MHz (max 2625000). */
+#ifndef BOOT_UPDATE_BAUD
+#define BOOT_UPDATE_BAUD              921600U
+#endif
+
+/** Time the host has to send a frame at the rate set by BAUD (ms). */
+#ifndef BOOT_UPDATE_BAUD_CONFIRM_MS
+#define BOOT_UPDATE_BAUD_CONFIRM_MS   1000U
+#endif
+
+/** WRITE payload size; the image is split into chunks of this size. */
+#ifndef BOOT_UPDATE_CHUNK
+#define BOOT_UPDATE_CHUNK             1024U
+#endif
+
+/** Chunks the host may send ahead of the acknowledgements. */
+#ifndef BOOT_UPDATE_WINDOW
+#define BOOT_UPDATE_WINDOW            4U
+#endif
+
+/** RX DMA ring; must hold the whole window. */
+#ifndef BOOT_UPDATE_RX_RING
+#define BOOT_UPDATE_RX_RING           8192U
+#endif
+
+/**
+ * Update mode entered on request of the application resets back into it
+ * when no command arrives for this long (ms) and nothing was erased.
+ */
+#ifndef BOOT_UPDATE_IDLE_TIMEOUT_MS
+#define BOOT_UPDATE_IDLE_TIMEOUT_MS   30000U
+#endif
+
+/** A started frame that stalls this long is dropped (ms). */
+#ifndef BOOT_UPDATE_FRAME_TIMEOUT_MS
+#define BOOT_UPDATE_FRAME_TIMEOUT_MS  50U
+#endif
+
+#define BOOT_UPDATE_PROTOCOL          7U   /* 2: HASH, ERASE sector mask; 3: A/B slots; 4: BAUD; 5: ZWRITE; 6: signatures; 7: resume */
+
+#define BOOT_UPDATE_SYNC_HOST         0xA5U
+#define BOOT_UPDATE_SYNC_ECU          0x5AU
+#define BOOT_UPDATE_HDR_SIZE          8U
+#define BOOT_UPDATE_CRC_SIZE          4U
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    BOOT_UPDATE_CMD_INFO   = 0x01, /**< -> status, protocol, chunk, window, slot size, app version, image state, slot base, record length, mask, tag, chunk bitmap */
+    BOOT_UPDATE_CMD_ERASE  = 0x02, /**< u32 length [, u32 sector mask [, u32 tag]] -> status, erase time (ms), sectors erased */
+    BOOT_UPDATE_CMD_WRITE  = 0x03, /**< seq = chunk, data -> status */
+    BOOT_UPDATE_CMD_DONE   = 0x04, /**< -> status, BootImage_Result_t, CRC (or first missing chunk) */
+    BOOT_UPDATE_CMD_GO     = 0x05, /**< -> status, then activate the verified slot and reset */
+    BOOT_UPDATE_CMD_HASH   = 0x06, /**< seq = slot sector -> status, address, size, CRC of the sector */
+    BOOT_UPDATE_CMD_BAUD   = 0x07, /**< u32 baud -> status, actual baud; then switch (UART only) */
+    BOOT_UPDATE_CMD_ZWRITE = 0x08  /**< seq = stream chunk, LZ4 data -> status, next chunk expected, bytes decoded */
+} BootUpdate_Cmd_t;
+
+typedef enum
+{
+    BOOT_UPDATE_OK = 0,
+    BOOT_UPDATE_ERR_CRC,         /**< Frame CRC mismatch; resend. */
+    BOOT_UPDATE_ERR_FRAME,       /**< Bad payload length for the command. */
+    BOOT_UPDATE_ERR_RANGE,       /**< Chunk outside the erased area, image larger than the slot, baud out of reach. */
+    BOOT_UPDATE_ERR_NOT_ERASED,  /**< Target flash not blank. */
+    BOOT_UPDATE_ERR_FLASH,       /**< Erase/program/read-back failed. */
+    BOOT_UPDATE_ERR_INCOMPLETE,  /**< DONE before every chunk was written. */
+    BOOT_UPDATE_ERR_IMAGE,       /**< Written image fails BootImage_Verify(). */
+    BOOT_UPDATE_ERR_CMD,         /**< Unknown command. */
+    BOOT_UPDATE_ERR_STATE,       /**< WRITE/DONE without ERASE. */
+    BOOT_UPDATE_ERR_SEQ,         /**< ZWRITE chunk ahead of the stream; resend from the one replied. */
+    BOOT_UPDATE_ERR_STREAM       /**< ZWRITE stream corrupt or longer than the image; ERASE again. */
+} BootUpdate_Status_t;
+
+/**
+ * @brief Run the update server on @p huart and CAN1; does not return.
+ *
+ * Switches the core to 84 MHz (PLL from HSI) and the UART to
+ * BOOT_UPDATE_BAUD, starts CAN1 (boot_can.h), then serves frames from
+ * both. GO resets the MCU.
+ *
+ * @param idleTimeoutMs Reset after this long without a command while no
+ *                      ERASE has been done (0 = wait forever).
+ */
+void BootUpdate_Run(UART_HandleTypeDef *huart, uint32_t idleTimeoutMs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOOT_UPDATE_H */
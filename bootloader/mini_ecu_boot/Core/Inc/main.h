@@ -74,16 +74,20 @@ void Error_Handler(void);
 
 /* USER CODE BEGIN Private defines */
 /**
-  * @brief Start address of the user application image in flash.
+  * @brief Start address of the first application slot in flash.
   *
   * The bootloader occupies the first 32 KB of flash:
   *   - FLASH origin:  0x08000000
   *   - FLASH length:  0x00008000 (32 KB)
   *
-  * The application is linked to start at:
-  *   - APP_START_ADDR: 0x08008000
+  * Sectors 2 and 3 (0x08008000, 2 x 16 KB) hold the application's DTC
+  * log and are never erased by the bootloader.
+  *
+  * The application is linked for one of two slots (boot_slot.h):
+  *   - slot A: 0x08010000 (APP_START_ADDR), 192 KB
+  *   - slot B: 0x08040000, 256 KB
   */
-#define APP_START_ADDR   0x08008000U
+#define APP_START_ADDR   0x08010000U
 
 /* USER CODE END Private defines */
 
@@ -0,0 +1,390 @@
+/**
+ * @file    boot_can.c
+ * @brief   Polled CAN1 + ISO-TP transport of the update server (see boot_can.h).
+ *
+ * No interrupts and no RTOS: BootCan_Poll() drains the single RX FIFO from
+ * the update loop and reassembles one PDU at a time into a word-aligned
+ * buffer; BootCan_Send() segments a response and waits for the host's FC
+ * in place. Frames on the request ID other than the expected FC are
+ * ignored while a response is being sent, the host never overlaps them.
+ *
+ * The three TX mailboxes run in FIFO order (TXFP): all Consecutive Frames
+ * share one identifier and bxCAN would otherwise send equal IDs lowest
+ * mailbox first, which can reorder them.
+ */
+
+#include "boot_can.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* Protocol control information, high nibble of byte 0. */
+#define BC_PCI_SF        0x0U
+#define BC_PCI_FF        0x1U
+#define BC_PCI_CF        0x2U
+#define BC_PCI_FC        0x3U
+
+/* Flow status, low nibble of an FC. */
+#define BC_FS_CTS        0x0U
+#define BC_FS_WAIT       0x1U
+#define BC_FS_OVFLW      0x2U
+
+#define BC_SF_MAX        7U
+#define BC_FF_DATA       6U
+#define BC_CF_DATA       7U
+#define BC_PDU_LIMIT     4095U
+
+/** Wait for a free TX mailbox (ms); a bus without ACK never frees one. */
+#define BC_TX_TIMEOUT_MS 10U
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static CAN_HandleTypeDef s_hcan;
+
+/** Reassembly buffer; word-aligned so WRITE data can be programmed from it. */
+static uint32_t s_pdu[(BOOT_CAN_PDU_MAX + 3U) / 4U];
+static uint32_t s_pduLen;     /**< Length announced by the First Frame. */
+static uint32_t s_pduPos;     /**< Bytes received, 0 = no PDU in progress. */
+static uint32_t s_pduTick;
+static uint8_t  s_pduSn;
+static uint8_t  s_pduFunc;
+static uint8_t  s_pduBlock;   /**< CFs left before the next FC (BS > 0). */
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 8..16 time quanta, sample point near 87.5 %, exact bitrate only. */
+static HAL_StatusTypeDef bc_timing(uint32_t pclk, uint32_t bitrate)
+{
+    for (uint32_t tq = 16U; tq >= 8U; --tq)
+    {
+        uint32_t bs1 = ((tq * 7U) / 8U) - 1U;
+        uint32_t bs2 = tq - 1U - bs1;
+
+        if (((pclk % (bitrate * tq)) == 0U) && ((pclk / (bitrate * tq)) <= 1024U))
+        {
+            s_hcan.Init.Prescaler     = pclk / (bitrate * tq);
+            s_hcan.Init.SyncJumpWidth = CAN_SJW_1TQ;
+            s_hcan.Init.TimeSeg1      = (bs1 - 1U) << CAN_BTR_TS1_Pos;
+            s_hcan.Init.TimeSeg2      = (bs2 - 1U) << CAN_BTR_TS2_Pos;
+            return HAL_OK;
+        }
+    }
+    return HAL_ERROR;
+}
+
+static void bc_delay_us(uint32_t us)
+{
+    uint32_t t0     = DWT->CYCCNT;
+    uint32_t cycles = us * (SystemCoreClock / 1000000U);
+
+    while ((DWT->CYCCNT - t0) < cycles)
+    {
+    }
+}
+
+/** ISO-TP STmin byte to microseconds (reserved values count as 127 ms). */
+static uint32_t bc_stmin_us(uint8_t stmin)
+{
+    if (stmin <= 0x7FU)
+    {
+        return (uint32_t)stmin * 1000U;
+    }
+    if ((stmin >= 0xF1U) && (stmin <= 0xF9U))
+    {
+        return (uint32_t)(stmin - 0xF0U) * 100U;
+    }
+    return 127000U;
+}
+
+static HAL_StatusTypeDef bc_tx(const uint8_t *frame)
+{
+    CAN_TxHeaderTypeDef hdr =
+    {
+        .StdId              = BOOT_CAN_RESP_ID,
+        .ExtId              = 0U,
+        .IDE                = CAN_ID_STD,
+        .RTR                = CAN_RTR_DATA,
+        .DLC                = 8U,
+        .TransmitGlobalTime = DISABLE,
+    };
+    uint32_t mailbox;
+    uint32_t t0 = HAL_GetTick();
+
+    while (HAL_CAN_GetTxMailboxesFreeLevel(&s_hcan) == 0U)
+    {
+        if ((HAL_GetTick() - t0) > BC_TX_TIMEOUT_MS)
+        {
+            (void)HAL_CAN_AbortTxRequest(&s_hcan, CAN_TX_MAILBOX0 | CAN_TX_MAILBOX1 |
+                                                  CAN_TX_MAILBOX2);
+            return HAL_TIMEOUT;
+        }
+    }
+    return HAL_CAN_AddTxMessage(&s_hcan, &hdr, (uint8_t *)frame, &mailbox);
+}
+
+static void bc_fc(uint8_t status)
+{
+    uint8_t f[8];
+
+    memset(f, BOOT_CAN_PAD, sizeof(f));
+    f[0] = (uint8_t)((BC_PCI_FC << 4) | status);
+    f[1] = (uint8_t)BOOT_CAN_BS;
+    f[2] = (uint8_t)BOOT_CAN_STMIN;
+    (void)bc_tx(f);
+}
+
+static uint8_t bc_rx(CAN_RxHeaderTypeDef *hdr, uint8_t *data)
+{
+    if (HAL_CAN_GetRxFifoFillLevel(&s_hcan, CAN_RX_FIFO0) == 0U)
+    {
+        return 0U;
+    }
+    return (HAL_CAN_GetRxMessage(&s_hcan, CAN_RX_FIFO0, hdr, data) == HAL_OK) ? 1U : 0U;
+}
+
+/** Wait for the host's FC(CTS) on the request ID. */
+static HAL_StatusTypeDef bc_wait_fc(uint8_t *bs, uint32_t *stminUs)
+{
+    CAN_RxHeaderTypeDef hdr;
+    uint8_t  d[8];
+    uint32_t t0 = HAL_GetTick();
+
+    while ((HAL_GetTick() - t0) <= BOOT_CAN_TIMEOUT_MS)
+    {
+        if ((bc_rx(&hdr, d) == 0U) || (hdr.StdId != BOOT_CAN_REQ_ID) ||
+            (hdr.DLC < 3U) || ((d[0] >> 4) != BC_PCI_FC))
+        {
+            continue;
+        }
+
+        switch (d[0] & 0x0FU)
+        {
+            case BC_FS_CTS:
+                *bs      = d[1];
+                *stminUs = bc_stmin_us(d[2]);
+                return HAL_OK;
+
+            case BC_FS_WAIT:
+                t0 = HAL_GetTick();
+                break;
+
+            default:
+                return HAL_ERROR;    /* overflow or invalid flow status */
+        }
+    }
+    return HAL_TIMEOUT;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef BootCan_Init(void)
+{
+    CAN_FilterTypeDef filter = { 0 };
+
+    /* Cycle counter for STmin pacing. */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+
+    s_hcan.Instance                  = CAN1;
+    s_hcan.Init.Mode                 = CAN_MODE_NORMAL;
+    s_hcan.Init.TimeTriggeredMode    = DISABLE;
+    s_hcan.Init.AutoBusOff           = ENABLE;
+    s_hcan.Init.AutoWakeUp           = DISABLE;
+    s_hcan.Init.AutoRetransmission   = ENABLE;
+    s_hcan.Init.ReceiveFifoLocked    = DISABLE;
+    s_hcan.Init.TransmitFifoPriority = ENABLE;
+    if ((bc_timing(HAL_RCC_GetPCLK1Freq(), BOOT_CAN_BITRATE) != HAL_OK) ||
+        (HAL_CAN_Init(&s_hcan) != HAL_OK))
+    {
+        return HAL_ERROR;
+    }
+
+    /* One 16-bit list bank: request ID and functional ID, FIFO0. */
+    filter.FilterBank           = 0U;
+    filter.FilterMode           = CAN_FILTERMODE_IDLIST;
+    filter.FilterScale          = CAN_FILTERSCALE_16BIT;
+    filter.FilterIdHigh         = BOOT_CAN_REQ_ID << 5;
+    filter.FilterIdLow          = BOOT_CAN_FUNC_ID << 5;
+    filter.FilterMaskIdHigh     = BOOT_CAN_REQ_ID << 5;
+    filter.FilterMaskIdLow      = BOOT_CAN_FUNC_ID << 5;
+    filter.FilterFIFOAssignment = CAN_FILTER_FIFO0;
+    filter.FilterActivation     = ENABLE;
+    filter.SlaveStartFilterBank = 14U;
+    if (HAL_CAN_ConfigFilter(&s_hcan, &filter) != HAL_OK)
+    {
+        return HAL_ERROR;
+    }
+
+    s_pduPos = 0U;
+    return HAL_CAN_Start(&s_hcan);
+}
+
+const uint8_t *BootCan_Poll(uint32_t *len, uint8_t *functional)
+{
+    CAN_RxHeaderTypeDef hdr;
+    uint8_t  d[8];
+    uint8_t *pdu = (uint8_t *)s_pdu;
+    uint32_t n;
+
+    /* N_Cr: the rest of a started PDU never came. */
+    if ((s_pduPos != 0U) && ((HAL_GetTick() - s_pduTick) > BOOT_CAN_TIMEOUT_MS))
+    {
+        s_pduPos = 0U;
+    }
+
+    while (bc_rx(&hdr, d) != 0U)
+    {
+        uint8_t func = (hdr.StdId == BOOT_CAN_FUNC_ID) ? 1U : 0U;
+
+        if ((hdr.IDE != CAN_ID_STD) || (hdr.RTR != CAN_RTR_DATA) || (hdr.DLC == 0U))
+        {
+            continue;
+        }
+
+        switch (d[0] >> 4)
+        {
+            case BC_PCI_SF:
+                n = d[0] & 0x0FU;
+                if ((n == 0U) || (n > BC_SF_MAX) || (n > hdr.DLC - 1U))
+                {
+                    break;
+                }
+                memcpy(pdu, &d[1], n);
+                s_pduPos    = 0U;
+                *len        = n;
+                *functional = func;
+                return pdu;
+
+            case BC_PCI_FF:
+                n = ((uint32_t)(d[0] & 0x0FU) << 8) | d[1];
+                if ((hdr.DLC != 8U) || (n <= BC_SF_MAX))
+                {
+                    break;
+                }
+                if (n > BOOT_CAN_PDU_MAX)
+                {
+                    s_pduPos = 0U;
+                    if (func == 0U)
+                    {
+                        bc_fc(BC_FS_OVFLW);
+                    }
+                    break;
+                }
+                memcpy(pdu, &d[2], BC_FF_DATA);
+                s_pduLen   = n;
+                s_pduPos   = BC_FF_DATA;
+                s_pduSn    = 1U;
+                s_pduFunc  = func;
+                s_pduBlock = (uint8_t)BOOT_CAN_BS;
+                s_pduTick  = HAL_GetTick();
+                if (func == 0U)
+                {
+                    bc_fc(BC_FS_CTS);
+                }
+                break;
+
+            case BC_PCI_CF:
+                if ((s_pduPos == 0U) || (func != s_pduFunc))
+                {
+                    break;
+                }
+                if ((d[0] & 0x0FU) != s_pduSn)
+                {
+                    s_pduPos = 0U;    /* lost frame: drop the PDU, the host resends */
+                    break;
+                }
+                n = s_pduLen - s_pduPos;
+                if (n > BC_CF_DATA)
+                {
+                    n = BC_CF_DATA;
+                }
+                if (hdr.DLC < n + 1U)
+                {
+                    s_pduPos = 0U;
+                    break;
+                }
+                memcpy(pdu + s_pduPos, &d[1], n);
+                s_pduPos += n;
+                s_pduSn   = (uint8_t)((s_pduSn + 1U) & 0x0FU);
+                s_pduTick = HAL_GetTick();
+
+                if (s_pduPos == s_pduLen)
+                {
+                    s_pduPos    = 0U;
+                    *len        = s_pduLen;
+                    *functional = func;
+                    return pdu;
+                }
+                if ((func == 0U) && (BOOT_CAN_BS != 0U) && (--s_pduBlock == 0U))
+                {
+                    s_pduBlock = (uint8_t)BOOT_CAN_BS;
+                    bc_fc(BC_FS_CTS);
+                }
+                break;
+
+            default:
+                break;    /* FC outside a send, or reserved PCI */
+        }
+    }
+    return NULL;
+}
+
+HAL_StatusTypeDef BootCan_Send(const uint8_t *data, uint32_t len)
+{
+    uint8_t  f[8];
+    uint32_t pos;
+    uint8_t  sn = 1U;
+    HAL_StatusTypeDef status;
+
+    if (len > BC_PDU_LIMIT)
+    {
+        return HAL_ERROR;
+    }
+
+    memset(f, BOOT_CAN_PAD, sizeof(f));
+    if (len <= BC_SF_MAX)
+    {
+        f[0] = (uint8_t)len;
+        memcpy(&f[1], data, len);
+        return bc_tx(f);
+    }
+
+    f[0] = (uint8_t)((BC_PCI_FF << 4) | (len >> 8));
+    f[1] = (uint8_t)len;
+    memcpy(&f[2], data, BC_FF_DATA);
+    pos = BC_FF_DATA;
+    status = bc_tx(f);
+
+    while ((status == HAL_OK) && (pos < len))
+    {
+        uint8_t  bs;
+        uint32_t stminUs;
+
+        status = bc_wait_fc(&bs, &stminUs);
+
+        for (uint32_t i = 0U; (status == HAL_OK) && (pos < len) && ((bs == 0U) || (i < bs)); ++i)
+        {
+            uint32_t n = ((len - pos) < BC_CF_DATA) ? (len - pos) : BC_CF_DATA;
+
+            if (i > 0U)
+            {
+                bc_delay_us(stminUs);
+            }
+            memset(f, BOOT_CAN_PAD, sizeof(f));
+            f[0] = (uint8_t)((BC_PCI_CF << 4) | sn);
+            memcpy(&f[1], data + pos, n);
+            status = bc_tx(f);
+            pos += n;
+            sn = (uint8_t)((sn + 1U) & 0x0FU);
+        }
+    }
+    return status;
+}
@@ -0,0 +1,686 @@
+/**
+ * @file    boot_ed25519.c
+ * @brief   SHA-512 (FIPS 180-4) and Ed25519 verification over GF(2^255 - 19).
+ *
+ * Field elements are carried after every product only: sums and
+ * differences of two products stay below 2^26.75 per limb, which keeps
+ * 19 x g in 32 bits and a whole product sum below 2^63. Every operand of
+ * be_fe_mul() is such a sum or difference at most.
+ */
+
+#include "boot_ed25519.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/** Limbs of 26, 25, 26, ... bits; limb i starts at bit ceil(25.5 i). */
+typedef int32_t BeFe_t[10];
+
+/** Extended coordinates: x = X/Z, y = Y/Z, x y = T/Z. */
+typedef struct
+{
+    BeFe_t x;
+    BeFe_t y;
+    BeFe_t z;
+    BeFe_t t;
+} BePoint_t;
+
+#define BE_ROTR(v, n)   (((v) >> (n)) | ((v) << (64U - (n))))
+#define BE_BIT(s, i)    (((uint32_t)(s)[(i) >> 3] >> ((i) & 7U)) & 1U)
+
+static const uint64_t s_beK[80] =
+{
+    0x428A2F98D728AE22ULL, 0x7137449123EF65CDULL,
+    0xB5C0FBCFEC4D3B2FULL, 0xE9B5DBA58189DBBCULL,
+    0x3956C25BF348B538ULL, 0x59F111F1B605D019ULL,
+    0x923F82A4AF194F9BULL, 0xAB1C5ED5DA6D8118ULL,
+    0xD807AA98A3030242ULL, 0x12835B0145706FBEULL,
+    0x243185BE4EE4B28CULL, 0x550C7DC3D5FFB4E2ULL,
+    0x72BE5D74F27B896FULL, 0x80DEB1FE3B1696B1ULL,
+    0x9BDC06A725C71235ULL, 0xC19BF174CF692694ULL,
+    0xE49B69C19EF14AD2ULL, 0xEFBE4786384F25E3ULL,
+    0x0FC19DC68B8CD5B5ULL, 0x240CA1CC77AC9C65ULL,
+    0x2DE92C6F592B0275ULL, 0x4A7484AA6EA6E483ULL,
+    0x5CB0A9DCBD41FBD4ULL, 0x76F988DA831153B5ULL,
+    0x983E5152EE66DFABULL, 0xA831C66D2DB43210ULL,
+    0xB00327C898FB213FULL, 0xBF597FC7BEEF0EE4ULL,
+    0xC6E00BF33DA88FC2ULL, 0xD5A79147930AA725ULL,
+    0x06CA6351E003826FULL, 0x142929670A0E6E70ULL,
+    0x27B70A8546D22FFCULL, 0x2E1B21385C26C926ULL,
+    0x4D2C6DFC5AC42AEDULL, 0x53380D139D95B3DFULL,
+    0x650A73548BAF63DEULL, 0x766A0ABB3C77B2A8ULL,
+    0x81C2C92E47EDAEE6ULL, 0x92722C851482353BULL,
+    0xA2BFE8A14CF10364ULL, 0xA81A664BBC423001ULL,
+    0xC24B8B70D0F89791ULL, 0xC76C51A30654BE30ULL,
+    0xD192E819D6EF5218ULL, 0xD69906245565A910ULL,
+    0xF40E35855771202AULL, 0x106AA07032BBD1B8ULL,
+    0x19A4C116B8D2D0C8ULL, 0x1E376C085141AB53ULL,
+    0x2748774CDF8EEB99ULL, 0x34B0BCB5E19B48A8ULL,
+    0x391C0CB3C5C95A63ULL, 0x4ED8AA4AE3418ACBULL,
+    0x5B9CCA4F7763E373ULL, 0x682E6FF3D6B2B8A3ULL,
+    0x748F82EE5DEFB2FCULL, 0x78A5636F43172F60ULL,
+    0x84C87814A1F0AB72ULL, 0x8CC702081A6439ECULL,
+    0x90BEFFFA23631E28ULL, 0xA4506CEBDE82BDE9ULL,
+    0xBEF9A3F7B2C67915ULL, 0xC67178F2E372532BULL,
+    0xCA273ECEEA26619CULL, 0xD186B8C721C0C207ULL,
+    0xEADA7DD6CDE0EB1EULL, 0xF57D4F7FEE6ED178ULL,
+    0x06F067AA72176FBAULL, 0x0A637DC5A2C898A6ULL,
+    0x113F9804BEF90DAEULL, 0x1B710B35131C471BULL,
+    0x28DB77F523047D84ULL, 0x32CAAB7B40C72493ULL,
+    0x3C9EBE0A15C9BEBCULL, 0x431D67C49C100D4CULL,
+    0x4CC5D4BECB3E42B6ULL, 0x597F299CFC657E2AULL,
+    0x5FCB6FAB3AD6FAECULL, 0x6C44198C4A475817ULL,
+};
+
+static const uint64_t s_beIv[8] =
+{
+    0x6A09E667F3BCC908ULL, 0xBB67AE8584CAA73BULL,
+    0x3C6EF372FE94F82BULL, 0xA54FF53A5F1D36F1ULL,
+    0x510E527FADE682D1ULL, 0x9B05688C2B3E6C1FULL,
+    0x1F83D9ABFB41BD6BULL, 0x5BE0CD19137E2179ULL,
+};
+
+/* Little-endian encodings; decoded on use. */
+static const uint8_t s_beD[32] =          /* d = -121665 / 121666 */
+{
+    0xA3, 0x78, 0x59, 0x13, 0xCA, 0x4D, 0xEB, 0x75,
+    0xAB, 0xD8, 0x41, 0x41, 0x4D, 0x0A, 0x70, 0x00,
+    0x98, 0xE8, 0x79, 0x77, 0x79, 0x40, 0xC7, 0x8C,
+    0x73, 0xFE, 0x6F, 0x2B, 0xEE, 0x6C, 0x03, 0x52
+};
+
+static const uint8_t s_beSqrtM1[32] =     /* 2^((p - 1) / 4), a root of -1 */
+{
+    0xB0, 0xA0, 0x0E, 0x4A, 0x27, 0x1B, 0xEE, 0xC4,
+    0x78, 0xE4, 0x2F, 0xAD, 0x06, 0x18, 0x43, 0x2F,
+    0xA7, 0xD7, 0xFB, 0x3D, 0x99, 0x00, 0x4D, 0x2B,
+    0x0B, 0xDF, 0xC1, 0x4F, 0x80, 0x24, 0x83, 0x2B
+};
+
+static const uint8_t s_beBx[32] =         /* base point B */
+{
+    0x1A, 0xD5, 0x25, 0x8F, 0x60, 0x2D, 0x56, 0xC9,
+    0xB2, 0xA7, 0x25, 0x95, 0x60, 0xC7, 0x2C, 0x69,
+    0x5C, 0xDC, 0xD6, 0xFD, 0x31, 0xE2, 0xA4, 0xC0,
+    0xFE, 0x53, 0x6E, 0xCD, 0xD3, 0x36, 0x69, 0x21
+};
+
+static const uint8_t s_beBy[32] =
+{
+    0x58, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+    0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+    0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+    0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66
+};
+
+static const uint8_t s_beL[32] =          /* group order 2^252 + 2774...8493 */
+{
+    0xED, 0xD3, 0xF5, 0x5C, 0x1A, 0x63, 0x12, 0x58,
+    0xD6, 0x9C, 0xF7, 0xA2, 0xDE, 0xF9, 0xDE, 0x14,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
+};
+
+static const uint8_t s_beLimbPos[10] = { 0U, 26U, 51U, 77U, 102U, 128U, 153U, 179U, 204U, 230U };
+
+/* -------------------------------------------------------------------------- */
+/* SHA-512                                                                    */
+/* -------------------------------------------------------------------------- */
+
+static uint64_t be_load64_be(const uint8_t *p)
+{
+    uint64_t v = 0U;
+
+    for (uint32_t i = 0U; i < 8U; ++i)
+    {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static void be_store64_be(uint8_t *p, uint64_t v)
+{
+    for (uint32_t i = 0U; i < 8U; ++i)
+    {
+        p[7U - i] = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+/** One 128-byte block; the schedule is kept as a 16-word ring. */
+static void be_sha_block(uint64_t st[8], const uint8_t *p)
+{
+    uint64_t w[16];
+    uint64_t v[8];
+
+    for (uint32_t i = 0U; i < 16U; ++i)
+    {
+        w[i] = be_load64_be(p + (i * 8U));
+    }
+    memcpy(v, st, sizeof(v));
+
+    for (uint32_t i = 0U; i < 80U; ++i)
+    {
+        if (i >= 16U)
+        {
+            uint64_t w1  = w[(i + 1U) & 15U];
+            uint64_t w14 = w[(i + 14U) & 15U];
+
+            w[i & 15U] += (BE_ROTR(w1, 1U) ^ BE_ROTR(w1, 8U) ^ (w1 >> 7)) +
+                          w[(i + 9U) & 15U] +
+                          (BE_ROTR(w14, 19U) ^ BE_ROTR(w14, 61U) ^ (w14 >> 6));
+        }
+
+        uint64_t t1 = v[7] + (BE_ROTR(v[4], 14U) ^ BE_ROTR(v[4], 18U) ^ BE_ROTR(v[4], 41U)) +
+                      ((v[4] & v[5]) ^ (~v[4] & v[6])) + s_beK[i] + w[i & 15U];
+        uint64_t t2 = (BE_ROTR(v[0], 28U) ^ BE_ROTR(v[0], 34U) ^ BE_ROTR(v[0], 39U)) +
+                      ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+
+        v[7] = v[6];
+        v[6] = v[5];
+        v[5] = v[4];
+        v[4] = v[3] + t1;
+        v[3] = v[2];
+        v[2] = v[1];
+        v[1] = v[0];
+        v[0] = t1 + t2;
+    }
+
+    for (uint32_t i = 0U; i < 8U; ++i)
+    {
+        st[i] += v[i];
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* Field arithmetic mod p = 2^255 - 19                                        */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t be_limb_bits(uint32_t i)
+{
+    return ((i & 1U) != 0U) ? 25U : 26U;
+}
+
+/**
+ * Rounded carries 0 -> 9, 9 -> 0 (times 19, as 2^255 = 19) and once more
+ * 0 -> 1: limbs end up within +-2^25 (+-2^24 for the odd ones) but limb 1,
+ * which may be a little over.
+ */
+static void be_fe_carry(BeFe_t h, int64_t t[10])
+{
+    int64_t c;
+
+    for (uint32_t i = 0U; i < 10U; ++i)
+    {
+        uint32_t bits = be_limb_bits(i);
+
+        c     = (t[i] + ((int64_t)1 << (bits - 1U))) >> bits;
+        t[i] -= c * ((int64_t)1 << bits);
+        if (i < 9U)
+        {
+            t[i + 1U] += c;
+        }
+        else
+        {
+            t[0] += c * 19;
+        }
+    }
+    c     = (t[0] + ((int64_t)1 << 25)) >> 26;
+    t[0] -= c * ((int64_t)1 << 26);
+    t[1] += c;
+
+    for (uint32_t i = 0U; i < 10U; ++i)
+    {
+        h[i] = (int32_t)t[i];
+    }
+}
+
+/** h = f g; h may alias either operand. */
+static void be_fe_mul(BeFe_t h, const BeFe_t f, const BeFe_t g)
+{
+    int32_t f2[10];
+    int32_t g19[10];
+    int64_t t[10] = { 0 };
+
+    for (uint32_t i = 0U; i < 10U; ++i)
+    {
+        f2[i]  = 2 * f[i];
+        g19[i] = 19 * g[i];
+    }
+
+    /*
+     * Two odd limbs start half a bit late each: their product is worth
+     * twice its place. A product past limb 9 wraps around times 19.
+     */
+    for (uint32_t i = 0U; i < 10U; ++i)
+    {
+        int32_t fi = ((i & 1U) != 0U) ? f2[i] : f[i];
+
+        for (uint32_t j = 0U; j < 10U; ++j)
+        {
+            int32_t a = ((j & 1U) != 0U) ? fi : f[i];
+            int32_t b = ((i + j) >= 10U) ? g19[j] : g[j];
+
+            t[(i + j) % 10U] += (int64_t)a * b;
+        }
+    }
+
+    be_fe_carry(h, t);
+}
+
+static void be_fe_add(BeFe_t h, const BeFe_t f, const BeFe_t g)
+{
+    for (uint32_t i = 0U; i < 10U; ++i)
+    {
+        h[i] = f[i] + g[i];
+    }
+}
+
+static void be_fe_sub(BeFe_t h, const BeFe_t f, const BeFe_t g)
+{
+    for (uint32_t i = 0U; i < 10U; ++i)
+    {
+        h[i] = f[i] - g[i];
+    }
+}
+
+static void be_fe_set(BeFe_t h, int32_t v)
+{
+    memset(h, 0, sizeof(BeFe_t));
+    h[0] = v;
+}
+
+static void be_fe_frombytes(BeFe_t h, const uint8_t s[32])
+{
+    int64_t t[10];
+
+    /* The top bit (bit 255) is not part of the number. */
+    for (uint32_t i = 0U; i < 10U; ++i)
+    {
+        const uint8_t *p = s + (s_beLimbPos[i] / 8U);
+        uint32_t       v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+
+        t[i] = (v >> (s_beLimbPos[i] % 8U)) & ((1UL << be_limb_bits(i)) - 1U);
+    }
+    be_fe_carry(h, t);
+}
+
+/** Canonical (fully reduced) encoding of @p f. */
+static void be_fe_tobytes(uint8_t s[32], const BeFe_t f)
+{
+    int64_t  t[10];
+    BeFe_t   h;
+    int32_t  q;
+    uint64_t acc  = 0U;
+    uint32_t bits = 0U;
+    uint32_t n    = 0U;
+
+    for (uint32_t i = 0U; i < 10U; ++i)
+    {
+        t[i] = f[i];
+    }
+    be_fe_carry(h, t);
+
+    /* q = floor(h / p), 0 or 1 here; then h - q p by floored carries. */
+    q = (19 * h[9] + (1 << 24)) >> 25;
+    for (uint32_t i = 0U; i < 10U; ++i)
+    {
+        q = (h[i] + q) >> be_limb_bits(i);
+    }
+    h[0] += 19 * q;
+    for (uint32_t i = 0U; i < 9U; ++i)
+    {
+        int32_t c = h[i] >> be_limb_bits(i);
+
+        h[i + 1U] += c;
+        h[i]      -= c * (1 << be_limb_bits(i));
+    }
+    h[9] &= (1 << 25) - 1;
+
+    for (uint32_t i = 0U; i < 10U; ++i)
+    {
+        acc  |= (uint64_t)(uint32_t)h[i] << bits;
+        bits += be_limb_bits(i);
+        while ((bits >= 8U) && (n < 32U))
+        {
+            s[n++] = (uint8_t)acc;
+            acc  >>= 8;
+            bits  -= 8U;
+        }
+    }
+    s[31] = (uint8_t)acc;
+}
+
+static uint8_t be_fe_iszero(const BeFe_t f)
+{
+    uint8_t s[32];
+    uint8_t any = 0U;
+
+    be_fe_tobytes(s, f);
+    for (uint32_t i = 0U; i < 32U; ++i)
+    {
+        any |= s[i];
+    }
+    return (any == 0U) ? 1U : 0U;
+}
+
+static uint32_t be_fe_isodd(const BeFe_t f)
+{
+    uint8_t s[32];
+
+    be_fe_tobytes(s, f);
+    return s[0] & 1U;
+}
+
+/**
+ * h = z^e for the e with bits top - 1 .. 8 set and @p low as its low byte:
+ * p - 2 (top 255, low 0xEB) inverts, (p - 5) / 8 (252, 0xFD) is the
+ * square-root exponent. Plain square-and-multiply; runs twice per check.
+ */
+static void be_fe_pow(BeFe_t h, const BeFe_t z, uint32_t top, uint8_t low)
+{
+    BeFe_t r;
+
+    be_fe_set(r, 1);
+    for (uint32_t i = top; i-- > 0U; )
+    {
+        be_fe_mul(r, r, r);
+        if ((i >= 8U) || (((low >> i) & 1U) != 0U))
+        {
+            be_fe_mul(r, r, z);
+        }
+    }
+    memcpy(h, r, sizeof(r));
+}
+
+/* -------------------------------------------------------------------------- */
+/* Points                                                                     */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * r = p + q (add-2008-hwcd-3 for a = -1: complete, so it also doubles).
+ * @p d2 is 2d. r may alias p or q.
+ */
+static void be_pt_add(BePoint_t *r, const BePoint_t *p, const BePoint_t *q, const BeFe_t d2)
+{
+    BeFe_t a, b, c, d, e, f, g, h;
+
+    be_fe_sub(a, p->y, p->x);
+    be_fe_sub(e, q->y, q->x);
+    be_fe_mul(a, a, e);
+    be_fe_add(b, p->y, p->x);
+    be_fe_add(e, q->y, q->x);
+    be_fe_mul(b, b, e);
+    be_fe_mul(c, p->t, q->t);
+    be_fe_mul(c, c, d2);
+    be_fe_mul(d, p->z, q->z);
+    be_fe_add(d, d, d);
+
+    be_fe_sub(e, b, a);
+    be_fe_sub(f, d, c);
+    be_fe_add(g, d, c);
+    be_fe_add(h, b, a);
+
+    be_fe_mul(r->x, e, f);
+    be_fe_mul(r->y, g, h);
+    be_fe_mul(r->t, e, h);
+    be_fe_mul(r->z, f, g);
+}
+
+/**
+ * -A from its encoding (x recovered from y, then given the other sign).
+ *
+ * @return 0 if @p s encodes no point.
+ */
+static uint8_t be_pt_decode_neg(BePoint_t *r, const uint8_t s[32], const BeFe_t d)
+{
+    BeFe_t u, v, v3, x, chk;
+
+    be_fe_frombytes(r->y, s);
+    be_fe_set(r->z, 1);
+
+    /* x^2 = u / v with u = y^2 - 1, v = d y^2 + 1. */
+    be_fe_mul(u, r->y, r->y);
+    be_fe_mul(v, u, d);
+    be_fe_set(chk, 1);
+    be_fe_sub(u, u, chk);
+    be_fe_add(v, v, chk);
+
+    /* x = u v^3 (u v^7)^((p - 5) / 8) */
+    be_fe_mul(v3, v, v);
+    be_fe_mul(v3, v3, v);
+    be_fe_mul(x, v3, v3);
+    be_fe_mul(x, x, v);
+    be_fe_mul(x, x, u);
+    be_fe_pow(x, x, 252U, 0xFDU);
+    be_fe_mul(x, x, v3);
+    be_fe_mul(x, x, u);
+
+    /* v x^2 is u, or -u and x needs a factor sqrt(-1), or there is no root. */
+    be_fe_mul(chk, x, x);
+    be_fe_mul(chk, chk, v);
+    be_fe_sub(v3, chk, u);
+    if (be_fe_iszero(v3) == 0U)
+    {
+        be_fe_add(v3, chk, u);
+        if (be_fe_iszero(v3) == 0U)
+        {
+            return 0U;
+        }
+        be_fe_frombytes(chk, s_beSqrtM1);
+        be_fe_mul(x, x, chk);
+    }
+
+    if (be_fe_iszero(x) && ((s[31] >> 7) != 0U))
+    {
+        return 0U;      /* -0 is no valid encoding */
+    }
+    if (be_fe_isodd(x) == ((uint32_t)s[31] >> 7))
+    {
+        be_fe_set(chk, 0);
+        be_fe_sub(x, chk, x);
+    }
+
+    memcpy(r->x, x, sizeof(x));
+    be_fe_mul(r->t, r->x, r->y);
+    return 1U;
+}
+
+static void be_pt_encode(uint8_t s[32], const BePoint_t *p)
+{
+    BeFe_t zi, x, y;
+
+    be_fe_pow(zi, p->z, 255U, 0xEBU);
+    be_fe_mul(x, p->x, zi);
+    be_fe_mul(y, p->y, zi);
+    be_fe_tobytes(s, y);
+    s[31] |= (uint8_t)(be_fe_isodd(x) << 7);
+}
+
+/* -------------------------------------------------------------------------- */
+/* Scalars mod L                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** S < L (RFC 8032 5.1.7: a larger S makes the signature malleable). */
+static uint8_t be_sc_canonical(const uint8_t s[32])
+{
+    for (uint32_t i = 32U; i-- > 0U; )
+    {
+        if (s[i] != s_beL[i])
+        {
+            return (s[i] < s_beL[i]) ? 1U : 0U;
+        }
+    }
+    return 0U;
+}
+
+/**
+ * r = x mod L for a 512-bit x in byte limbs, folding from the top with
+ * 2^252 = -(L - 2^252) mod L (the TweetNaCl reduction).
+ */
+static void be_sc_reduce(uint8_t r[32], int64_t x[64])
+{
+    int64_t carry;
+
+    for (uint32_t i = 63U; i >= 32U; --i)
+    {
+        uint32_t j;
+
+        carry = 0;
+        for (j = i - 32U; j < i - 12U; ++j)
+        {
+            x[j] += carry - 16 * x[i] * s_beL[j - (i - 32U)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+        x[j] += carry;
+        x[i]  = 0;
+    }
+
+    carry = 0;
+    for (uint32_t j = 0U; j < 32U; ++j)
+    {
+        x[j] += carry - (x[31] >> 4) * s_beL[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+    for (uint32_t j = 0U; j < 32U; ++j)
+    {
+        x[j] -= carry * s_beL[j];
+    }
+    for (uint32_t i = 0U; i < 32U; ++i)
+    {
+        x[i + 1U] += x[i] >> 8;
+        r[i] = (uint8_t)(x[i] & 255);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void BootSha512_Init(BootSha512_t *sha)
+{
+    memcpy(sha->state, s_beIv, sizeof(sha->state));
+    sha->bytes = 0U;
+}
+
+void BootSha512_Update(BootSha512_t *sha, const void *data, uint32_t len)
+{
+    const uint8_t *p    = (const uint8_t *)data;
+    uint32_t       fill = (uint32_t)(sha->bytes % 128U);
+
+    sha->bytes += len;
+
+    if (fill != 0U)
+    {
+        uint32_t n = ((128U - fill) < len) ? (128U - fill) : len;
+
+        memcpy(sha->block + fill, p, n);
+        p   += n;
+        len -= n;
+        if ((fill + n) < 128U)
+        {
+            return;
+        }
+        be_sha_block(sha->state, sha->block);
+    }
+
+    while (len >= 128U)
+    {
+        be_sha_block(sha->state, p);
+        p   += 128U;
+        len -= 128U;
+    }
+    memcpy(sha->block, p, len);
+}
+
+void BootSha512_Final(BootSha512_t *sha, uint8_t digest[BOOT_SHA512_SIZE])
+{
+    uint32_t fill = (uint32_t)(sha->bytes % 128U);
+
+    sha->block[fill++] = 0x80U;
+    if (fill > 112U)
+    {
+        memset(sha->block + fill, 0, 128U - fill);
+        be_sha_block(sha->state, sha->block);
+        fill = 0U;
+    }
+    memset(sha->block + fill, 0, 120U - fill);
+    be_store64_be(sha->block + 120U, sha->bytes * 8U);
+    be_sha_block(sha->state, sha->block);
+
+    for (uint32_t i = 0U; i < 8U; ++i)
+    {
+        be_store64_be(digest + (i * 8U), sha->state[i]);
+    }
+}
+
+void BootEd25519_Start(BootSha512_t *sha, const uint8_t sig[BOOT_ED25519_SIG_SIZE],
+                       const uint8_t key[BOOT_ED25519_KEY_SIZE])
+{
+    BootSha512_Init(sha);
+    BootSha512_Update(sha, sig, 32U);
+    BootSha512_Update(sha, key, BOOT_ED25519_KEY_SIZE);
+}
+
+uint8_t BootEd25519_Finish(BootSha512_t *sha, const uint8_t sig[BOOT_ED25519_SIG_SIZE],
+                           const uint8_t key[BOOT_ED25519_KEY_SIZE])
+{
+    uint8_t   digest[BOOT_SHA512_SIZE];
+    int64_t   wide[64];
+    uint8_t   k[32];
+    uint8_t   check[32];
+    BeFe_t    d, d2;
+    BePoint_t tab[3];     /* B, -A, B - A */
+    BePoint_t r;
+
+    BootSha512_Final(sha, digest);
+
+    if (be_sc_canonical(sig + 32) == 0U)
+    {
+        return 0U;
+    }
+
+    be_fe_frombytes(d, s_beD);
+    be_fe_add(d2, d, d);
+    if (be_pt_decode_neg(&tab[1], key, d) == 0U)
+    {
+        return 0U;
+    }
+
+    /* k = SHA-512(R || A || M) mod L */
+    for (uint32_t i = 0U; i < 64U; ++i)
+    {
+        wide[i] = digest[i];
+    }
+    be_sc_reduce(k, wide);
+
+    be_fe_frombytes(tab[0].x, s_beBx);
+    be_fe_frombytes(tab[0].y, s_beBy);
+    be_fe_set(tab[0].z, 1);
+    be_fe_mul(tab[0].t, tab[0].x, tab[0].y);
+    be_pt_add(&tab[2], &tab[0], &tab[1], d2);
+
+    /* [S]B + [k](-A), both scalars below 2^253. */
+    be_fe_set(r.x, 0);
+    be_fe_set(r.y, 1);
+    be_fe_set(r.z, 1);
+    be_fe_set(r.t, 0);
+    for (uint32_t i = 253U; i-- > 0U; )
+    {
+        uint32_t idx = BE_BIT(sig + 32, i) | (BE_BIT(k, i) << 1);
+
+        be_pt_add(&r, &r, &r, d2);
+        if (idx != 0U)
+        {
+            be_pt_add(&r, &r, &tab[idx - 1U], d2);
+        }
+    }
+
+    be_pt_encode(check, &r);
+    return (memcmp(check, sig, 32U) == 0) ? 1U : 0U;
+}
@@ -0,0 +1,135 @@
+/**
+ * @file    boot_handoff.c
+ * @brief   Fill the no-init RAM hand-off block for the application.
+ *
+ * BootHandoff_Begin() runs from Reset_Handler before .data/.bss exist, so
+ * this file keeps no state of its own: everything lives in the block.
+ * The boot time comes from the DWT cycle counter, started in Begin; the
+ * bootloader runs from the 16 MHz HSI on both paths up to the jump. The
+ * counter is left running, so the application's boot profile goes on
+ * counting from reset.
+ */
+
+#include "boot_handoff.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define BH_WORDS          ((sizeof(BootHandoff_t) / 4U) - 1U)   /* without check */
+
+#define BH_RESET_FLAGS    0xFE000000U   /* LPWR, WWDG, IWDG, SFT, POR, PIN, BOR */
+
+_Static_assert(sizeof(BootHandoff_t) <= 64U, "hand-off block outgrows its 64 B");
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t bh_sum(const BootHandoff_t *ho)
+{
+    const uint32_t *w = (const uint32_t *)ho;
+    uint32_t sum = 0U;
+
+    for (uint32_t i = 0U; i < BH_WORDS; ++i)
+    {
+        sum ^= w[i];
+    }
+    return ~sum;
+}
+
+static uint8_t bh_valid(const BootHandoff_t *ho)
+{
+    return ((ho->magic == BOOT_HANDOFF_MAGIC) && (ho->version == BOOT_HANDOFF_VERSION) &&
+            (ho->check == bh_sum(ho))) ? 1U : 0U;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void BootHandoff_Begin(void)
+{
+    BootHandoff_t *ho = BOOT_HANDOFF;
+    uint32_t status  = BOOT_HANDOFF_UPDATE_NONE;
+    uint32_t version = 0U;
+    uint32_t request = BOOT_HANDOFF_REQ_NONE;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0U;
+    DWT->CTRL  |= DWT_CTRL_CYCCNTENA_Msk;
+
+    if (bh_valid(ho) != 0U)
+    {
+        status  = ho->updateStatus;
+        version = ho->updateVersion;
+        request = ho->request;
+    }
+
+    ho->magic         = BOOT_HANDOFF_MAGIC;
+    ho->version       = BOOT_HANDOFF_VERSION;
+    ho->resetCause    = RCC->CSR & BH_RESET_FLAGS;
+    ho->clock         = BOOT_HANDOFF_CLOCK_NONE;
+    ho->bootUs        = 0U;
+    ho->flags         = 0U;
+    ho->slot          = 0U;
+    ho->attempt       = 0U;
+    ho->updateStatus  = status;
+    ho->updateVersion = version;
+    ho->request       = request;
+    ho->check         = bh_sum(ho);
+
+    /* The next reset reports only its own cause. */
+    RCC->CSR |= RCC_CSR_RMVF;
+}
+
+uint8_t BootHandoff_TakeRequest(void)
+{
+    BootHandoff_t *ho = BOOT_HANDOFF;
+
+    if ((bh_valid(ho) == 0U) || (ho->request != BOOT_HANDOFF_REQ_UPDATE))
+    {
+        return 0U;
+    }
+
+    ho->request = BOOT_HANDOFF_REQ_NONE;
+    ho->check   = bh_sum(ho);
+    return 1U;
+}
+
+void BootHandoff_SetUpdate(uint32_t status, uint32_t version)
+{
+    BootHandoff_t *ho = BOOT_HANDOFF;
+
+    if (bh_valid(ho) == 0U)
+    {
+        return;
+    }
+
+    ho->updateStatus  = status;
+    ho->updateVersion = version;
+    ho->check         = bh_sum(ho);
+}
+
+void BootHandoff_Finish(char slot, uint32_t attempt, uint32_t flags)
+{
+    BootHandoff_t *ho = BOOT_HANDOFF;
+    uint32_t cycles = DWT->CYCCNT;
+
+    /* Reset state -> HSI16 profile: HSI and 0 wait states already hold. */
+    __HAL_RCC_PWR_CLK_ENABLE();
+    __HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE3);
+    MODIFY_REG(RCC->CFGR, RCC_CFGR_PPRE1, RCC_HCLK_DIV2);
+
+    if (bh_valid(ho) == 0U)
+    {
+        return;
+    }
+
+    ho->clock   = BOOT_HANDOFF_CLOCK_HSI16;
+    ho->bootUs  = cycles / (HSI_VALUE / 1000000U);
+    ho->flags   = flags;
+    ho->slot    = (uint32_t)slot;
+    ho->attempt = attempt;
+    ho->check   = bh_sum(ho);
+}
@@ -0,0 +1,305 @@
+/**
+ * @file    boot_image.c
+ * @brief   Image check with the CRC unit fed by DMA, cached in backup SRAM.
+ *
+ * The CRC unit has no DMA request line, so DMA2 Stream0 runs in
+ * memory-to-memory mode (software triggered): the "peripheral" port walks
+ * the image, the "memory" port writes every word to the fixed CRC->DR.
+ * That mode needs the stream FIFO. One transfer moves at most 65535 words,
+ * so the image is fed in passes without resetting the CRC unit in between.
+ *
+ * The "verified" record in backup SRAM survives resets (not a power loss
+ * without VBAT). It only says "this CRC/length was checked in this slot";
+ * anything that rewrites an app slot must call BootImage_Invalidate() first.
+ * It is only written once the signature checked out too, so the fast path
+ * (BootImage_IsVerified()) needs no signature check of its own.
+ */
+
+#include "boot_image.h"
+#include "boot_sig.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define BI_VERIFIED_MAGIC   0x56455249U   /* "VERI" */
+
+#define BI_DMA_MAX_WORDS    0xFFFFU
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t crc32;
+    uint32_t length;
+    uint32_t check;     /**< ~(crc32 ^ slot base): the slot, and rejects a half-written record. */
+} BootVerified_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static DMA_HandleTypeDef s_crcDma;
+
+/** Start of the 4 KB backup SRAM. */
+static volatile BootVerified_t *const s_verified = (volatile BootVerified_t *)BKPSRAM_BASE;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Header and vector checks; BOOT_IMAGE_OK means "CRC still to be checked". */
+static BootImage_Result_t bi_check_header(uint32_t base, uint32_t size, BootImage_Info_t *info)
+{
+    const ImageHeader_t *hdr = BOOT_IMAGE_HEADER(base);
+
+    if (hdr->magic != IMAGE_HEADER_MAGIC)
+    {
+        return BOOT_IMAGE_NO_HEADER;
+    }
+
+    info->version   = hdr->version;
+    info->length    = hdr->length;
+    info->crcStored = hdr->crc32;
+
+    /* Images are linked per slot; a copy in the wrong one would jump across. */
+    uint32_t reset = *(const uint32_t *)(base + 4U);
+    if ((reset < base) || (reset >= base + size))
+    {
+        return BOOT_IMAGE_WRONG_SLOT;
+    }
+
+    if ((hdr->length == IMAGE_ERASED) || (hdr->crc32 == IMAGE_ERASED))
+    {
+        return BOOT_IMAGE_UNSTAMPED;
+    }
+
+    /* The end of the slot holds the signature check log. */
+    if (((hdr->length & 3U) != 0U) ||
+        (hdr->length < IMAGE_HEADER_OFFSET + sizeof(ImageHeader_t)) ||
+        (hdr->length > size - BOOT_SIG_CACHE_SIZE))
+    {
+        return BOOT_IMAGE_BAD_LENGTH;
+    }
+
+    return BOOT_IMAGE_OK;
+}
+
+/** The backup-SRAM record matches the header at @p base. */
+static uint8_t bi_recorded(uint32_t base)
+{
+    const ImageHeader_t *hdr = BOOT_IMAGE_HEADER(base);
+
+    BootImage_BackupEnable();
+
+    return ((s_verified->magic  == BI_VERIFIED_MAGIC) &&
+            (s_verified->crc32  == hdr->crc32) &&
+            (s_verified->length == hdr->length) &&
+            (s_verified->check  == ~(hdr->crc32 ^ base))) ? 1U : 0U;
+}
+
+static HAL_StatusTypeDef bi_crc_start(void)
+{
+    __HAL_RCC_CRC_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+
+    if (s_crcDma.Instance == NULL)
+    {
+        s_crcDma.Instance                 = DMA2_Stream0;
+        s_crcDma.Init.Channel             = DMA_CHANNEL_0;
+        s_crcDma.Init.Direction           = DMA_MEMORY_TO_MEMORY;
+        s_crcDma.Init.PeriphInc           = DMA_PINC_ENABLE;
+        s_crcDma.Init.MemInc              = DMA_MINC_DISABLE;
+        s_crcDma.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+        s_crcDma.Init.MemDataAlignment    = DMA_MDATAALIGN_WORD;
+        s_crcDma.Init.Mode                = DMA_NORMAL;
+        s_crcDma.Init.Priority            = DMA_PRIORITY_HIGH;
+        s_crcDma.Init.FIFOMode            = DMA_FIFOMODE_ENABLE;
+        s_crcDma.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
+        s_crcDma.Init.MemBurst            = DMA_MBURST_SINGLE;
+        s_crcDma.Init.PeriphBurst         = DMA_PBURST_SINGLE;
+
+        if (HAL_DMA_Init(&s_crcDma) != HAL_OK)
+        {
+            s_crcDma.Instance = NULL;
+            return HAL_ERROR;
+        }
+    }
+
+    CRC->CR = CRC_CR_RESET;
+    return HAL_OK;
+}
+
+/** Feed [addr, addr + len) into the CRC unit; len is a multiple of 4. */
+static HAL_StatusTypeDef bi_crc_feed(uint32_t addr, uint32_t len)
+{
+    uint32_t words = len / 4U;
+
+    while (words > 0U)
+    {
+        uint32_t n = (words > BI_DMA_MAX_WORDS) ? BI_DMA_MAX_WORDS : words;
+
+        if (HAL_DMA_Start(&s_crcDma, addr, (uint32_t)&CRC->DR, n) != HAL_OK)
+        {
+            return HAL_ERROR;
+        }
+        if (HAL_DMA_PollForTransfer(&s_crcDma, HAL_DMA_FULL_TRANSFER,
+                                    BOOT_CRC_TIMEOUT_MS) != HAL_OK)
+        {
+            (void)HAL_DMA_Abort(&s_crcDma);
+            return HAL_ERROR;
+        }
+
+        addr  += n * 4U;
+        words -= n;
+    }
+
+    return HAL_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+HAL_StatusTypeDef BootImage_Crc(uint32_t addr, uint32_t len, uint32_t *crc)
+{
+    if ((crc == NULL) || (((addr | len) & 3U) != 0U))
+    {
+        return HAL_ERROR;
+    }
+    if ((bi_crc_start() != HAL_OK) || (bi_crc_feed(addr, len) != HAL_OK))
+    {
+        return HAL_ERROR;
+    }
+
+    *crc = CRC->DR;
+    return HAL_OK;
+}
+
+BootImage_Result_t BootImage_Verify(uint32_t base, uint32_t size, BootImage_Info_t *info)
+{
+    const ImageHeader_t *hdr = BOOT_IMAGE_HEADER(base);
+    BootImage_Info_t     tmp = { 0 };
+    BootImage_Result_t   result;
+    uint32_t             t0 = HAL_GetTick();
+
+    if (info == NULL)
+    {
+        info = &tmp;
+    }
+    *info = tmp;
+
+    result = bi_check_header(base, size, info);
+    if (result != BOOT_IMAGE_OK)
+    {
+        return result;
+    }
+
+    if (bi_recorded(base) != 0U)
+    {
+        info->crcComputed = hdr->crc32;
+        info->cached      = 1U;
+        info->sig         = (BootSig_Trailer(base, size) != NULL) ? BOOT_SIG_CACHED
+                                                                  : BOOT_SIG_NONE;
+        info->elapsedMs   = HAL_GetTick() - t0;
+        return BOOT_IMAGE_OK;
+    }
+
+    /* Vector table, then everything behind the header, in one CRC run. */
+    if ((bi_crc_start() != HAL_OK) ||
+        (bi_crc_feed(base, IMAGE_HEADER_OFFSET) != HAL_OK) ||
+        (bi_crc_feed(base + IMAGE_HEADER_OFFSET + sizeof(ImageHeader_t),
+                     hdr->length - IMAGE_HEADER_OFFSET - sizeof(ImageHeader_t)) != HAL_OK))
+    {
+        result = BOOT_IMAGE_DMA_ERROR;
+    }
+    else
+    {
+        info->crcComputed = CRC->DR;
+        result = (info->crcComputed == hdr->crc32) ? BOOT_IMAGE_OK : BOOT_IMAGE_BAD_CRC;
+    }
+
+    if (result == BOOT_IMAGE_OK)
+    {
+        info->sig = (uint8_t)BootSig_Check(base, size);
+        if (info->sig == BOOT_SIG_BAD)
+        {
+            result = BOOT_IMAGE_BAD_SIGNATURE;
+        }
+        else if ((info->sig == BOOT_SIG_NONE) && (BOOT_ALLOW_UNSIGNED == 0))
+        {
+            result = BOOT_IMAGE_UNSIGNED;
+        }
+    }
+
+    if (result == BOOT_IMAGE_OK)
+    {
+        s_verified->magic  = 0U;
+        s_verified->crc32  = hdr->crc32;
+        s_verified->length = hdr->length;
+        s_verified->check  = ~(hdr->crc32 ^ base);
+        s_verified->magic  = BI_VERIFIED_MAGIC;
+    }
+    else
+    {
+        s_verified->magic = 0U;
+    }
+
+    info->elapsedMs = HAL_GetTick() - t0;
+    return result;
+}
+
+uint8_t BootImage_IsVerified(uint32_t base, uint32_t size)
+{
+    BootImage_Info_t info;
+
+    return ((bi_check_header(base, size, &info) == BOOT_IMAGE_OK) &&
+            (bi_recorded(base) != 0U)) ? 1U : 0U;
+}
+
+uint8_t BootImage_UpdateRequested(void)
+{
+    BootImage_BackupEnable();
+
+    return (*(volatile uint32_t *)BOOT_REQUEST_ADDR == BOOT_REQUEST_UPDATE) ? 1U : 0U;
+}
+
+void BootImage_BackupEnable(void)
+{
+    __HAL_RCC_PWR_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+    __HAL_RCC_BKPSRAM_CLK_ENABLE();
+}
+
+void BootImage_Invalidate(void)
+{
+    BootImage_BackupEnable();
+    s_verified->magic = 0U;
+}
+
+uint8_t BootImage_TakeUpdateRequest(void)
+{
+    volatile uint32_t *req = (volatile uint32_t *)BOOT_REQUEST_ADDR;
+    uint8_t requested;
+
+    BootImage_BackupEnable();
+    requested = (*req == BOOT_REQUEST_UPDATE) ? 1U : 0U;
+    *req = 0U;
+    return requested;
+}
+
+const char *BootImage_ResultName(BootImage_Result_t result)
+{
+    switch (result)
+    {
+        case BOOT_IMAGE_OK:            return "ok";
+        case BOOT_IMAGE_NO_HEADER:     return "no image header";
+        case BOOT_IMAGE_UNSTAMPED:     return "header not stamped";
+        case BOOT_IMAGE_BAD_LENGTH:    return "bad image length";
+        case BOOT_IMAGE_BAD_CRC:       return "CRC mismatch";
+        case BOOT_IMAGE_DMA_ERROR:     return "CRC DMA error";
+        case BOOT_IMAGE_WRONG_SLOT:    return "linked for the other slot";
+        case BOOT_IMAGE_UNSIGNED:      return "no signature";
+        case BOOT_IMAGE_BAD_SIGNATURE: return "signature invalid";
+        default:                       return "?";
+    }
+}
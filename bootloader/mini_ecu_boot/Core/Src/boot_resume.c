@@ -0,0 +1,118 @@
+/**
+ * @file    boot_resume.c
+ * @brief   Transfer records of interrupted updates (see boot_resume.h).
+ *
+ * Records are used in order. A record is free while its whole header is
+ * erased; Begin programs mask and tag first and the length last, so one
+ * cut short in between is neither free nor live and is passed over. The
+ * current record is the last one that is not free, live while it is not
+ * retired.
+ */
+
+#include "boot_resume.h"
+#include <stddef.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static const volatile BootResume_Record_t *br_records(uint32_t base, uint32_t size)
+{
+    return (const volatile BootResume_Record_t *)(base + size - BOOT_SLOT_TAIL_SIZE);
+}
+
+static uint8_t br_free(const volatile BootResume_Record_t *rec)
+{
+    return ((rec->length == IMAGE_ERASED) && (rec->mask == IMAGE_ERASED) &&
+            (rec->tag == IMAGE_ERASED) && (rec->retired == IMAGE_ERASED)) ? 1U : 0U;
+}
+
+/** Index of the first free record, BOOT_RESUME_RECORDS if none. */
+static uint32_t br_first_free(const volatile BootResume_Record_t *recs)
+{
+    uint32_t i = 0U;
+
+    while ((i < BOOT_RESUME_RECORDS) && (br_free(&recs[i]) == 0U))
+    {
+        i++;
+    }
+    return i;
+}
+
+static HAL_StatusTypeDef br_word(const volatile uint32_t *word, uint32_t value)
+{
+    if ((HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, (uint32_t)word, value) != HAL_OK) ||
+        (*word != value))
+    {
+        return HAL_ERROR;
+    }
+    return HAL_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+const BootResume_Record_t *BootResume_Current(uint32_t base, uint32_t size)
+{
+    const volatile BootResume_Record_t *recs = br_records(base, size);
+    uint32_t                            i    = br_first_free(recs);
+
+    if (i == 0U)
+    {
+        return NULL;
+    }
+
+    const volatile BootResume_Record_t *rec = &recs[i - 1U];
+
+    if ((rec->length == IMAGE_ERASED) || (rec->retired != IMAGE_ERASED) ||
+        (rec->length > size - BOOT_SLOT_TAIL_SIZE))
+    {
+        return NULL;
+    }
+    return (const BootResume_Record_t *)rec;
+}
+
+const BootResume_Record_t *BootResume_Begin(uint32_t base, uint32_t size, uint32_t length,
+                                            uint32_t mask, uint32_t tag)
+{
+    const volatile BootResume_Record_t *recs = br_records(base, size);
+    uint32_t                            i    = br_first_free(recs);
+
+    /* An erased value would read back as a free or unfinished record. */
+    if ((i >= BOOT_RESUME_RECORDS) || (mask == IMAGE_ERASED) || (tag == IMAGE_ERASED))
+    {
+        return NULL;
+    }
+
+    const volatile BootResume_Record_t *rec = &recs[i];
+
+    if ((br_word(&rec->mask, mask) != HAL_OK) || (br_word(&rec->tag, tag) != HAL_OK) ||
+        (br_word(&rec->length, length) != HAL_OK))
+    {
+        return NULL;
+    }
+    return (const BootResume_Record_t *)rec;
+}
+
+void BootResume_Mark(const BootResume_Record_t *rec, uint32_t chunk)
+{
+    const volatile uint8_t *flag = &rec->chunk[chunk];
+
+    if ((chunk < BOOT_RESUME_CHUNKS) && (*flag == 0xFFU))
+    {
+        (void)HAL_FLASH_Program(FLASH_TYPEPROGRAM_BYTE, (uint32_t)flag, 0U);
+    }
+}
+
+uint8_t BootResume_Retire(uint32_t base, uint32_t size)
+{
+    const volatile BootResume_Record_t *recs = br_records(base, size);
+    const BootResume_Record_t          *rec  = BootResume_Current(base, size);
+
+    if (rec != NULL)
+    {
+        (void)br_word(&((const volatile BootResume_Record_t *)rec)->retired, 0U);
+    }
+    return (br_first_free(recs) >= BOOT_RESUME_RECORDS) ? 1U : 0U;
+}
@@ -0,0 +1,182 @@
+/**
+ * @file    boot_sig.c
+ * @brief   Signature check of an image and the check log at the slot end.
+ *
+ * Log words, from the start of the log:
+ *   0           retired entry (an image that was since rewritten)
+ *   0xFFFFFFFF  free; everything behind the first free word is free too
+ *   other       live entry: the CRC of the image, folded with the key
+ * At most one entry is live: the first word that is not 0. Every change is
+ * one word program from erased or to 0, so an interrupted one leaves
+ * either the old state or a retired entry.
+ */
+
+#include "boot_sig.h"
+#include "boot_ed25519.h"
+#include <stddef.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define BSIG_LOG_WORDS   (BOOT_SIG_CACHE_SIZE / 4U)
+
+/* The boot-control words, signed as erased. */
+#define BSIG_CTRL_START  (IMAGE_HEADER_OFFSET + offsetof(ImageHeader_t, generation))
+#define BSIG_CTRL_SIZE   (sizeof(ImageHeader_t) - offsetof(ImageHeader_t, generation))
+
+#if (BOOT_SIG_CACHE_SIZE % 4U) != 0U
+#error "BOOT_SIG_CACHE_SIZE must be a multiple of 4"
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static const uint8_t s_bsigKey[BOOT_ED25519_KEY_SIZE] = BOOT_SIG_PUBLIC_KEY;
+
+static const uint8_t s_bsigErased[BSIG_CTRL_SIZE] =
+{
+    0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static const volatile uint32_t *bsig_log(uint32_t base, uint32_t size)
+{
+    return (const volatile uint32_t *)(base + size - BOOT_SIG_CACHE_SIZE);
+}
+
+/** First word that is not retired: the live entry, a free word or the end. */
+static uint32_t bsig_current(const volatile uint32_t *log)
+{
+    uint32_t i = 0U;
+
+    while ((i < BSIG_LOG_WORDS) && (log[i] == 0U))
+    {
+        i++;
+    }
+    return i;
+}
+
+/** Log entry for an image CRC; a key change invalidates every entry. */
+static uint32_t bsig_entry(uint32_t crc)
+{
+    return crc ^ ((uint32_t)s_bsigKey[0] | ((uint32_t)s_bsigKey[1] << 8) |
+                  ((uint32_t)s_bsigKey[2] << 16) | ((uint32_t)s_bsigKey[3] << 24));
+}
+
+static HAL_StatusTypeDef bsig_program(const volatile uint32_t *word, uint32_t value)
+{
+    HAL_StatusTypeDef status;
+
+    (void)HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                           FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+    status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, (uint32_t)word, value);
+    (void)HAL_FLASH_Lock();
+
+    if ((status == HAL_OK) && (*word != value))
+    {
+        status = HAL_ERROR;
+    }
+    return status;
+}
+
+/** Ed25519 over the image as built: boot-control words erased. */
+static uint8_t bsig_verify(uint32_t base, const ImageSig_t *sig)
+{
+    const ImageHeader_t *hdr = BOOT_IMAGE_HEADER(base);
+    uint32_t             end = BSIG_CTRL_START + BSIG_CTRL_SIZE;
+    BootSha512_t         sha;
+
+    BootEd25519_Start(&sha, sig->signature, s_bsigKey);
+    BootSha512_Update(&sha, (const void *)base, BSIG_CTRL_START);
+    BootSha512_Update(&sha, s_bsigErased, BSIG_CTRL_SIZE);
+    BootSha512_Update(&sha, (const void *)(base + end), hdr->length - end);
+
+    return BootEd25519_Finish(&sha, sig->signature, s_bsigKey);
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+const ImageSig_t *BootSig_Trailer(uint32_t base, uint32_t size)
+{
+    uint32_t length = BOOT_IMAGE_HEADER(base)->length;
+
+    if (length + sizeof(ImageSig_t) > size - BOOT_SIG_CACHE_SIZE)
+    {
+        return NULL;
+    }
+
+    const ImageSig_t *sig = (const ImageSig_t *)(base + length);
+
+    return (sig->magic == IMAGE_SIG_MAGIC) ? sig : NULL;
+}
+
+BootSig_Result_t BootSig_Check(uint32_t base, uint32_t size)
+{
+    const ImageSig_t        *sig   = BootSig_Trailer(base, size);
+    const volatile uint32_t *log   = bsig_log(base, size);
+    uint32_t                 entry = bsig_entry(BOOT_IMAGE_HEADER(base)->crc32);
+    uint32_t                 i     = bsig_current(log);
+
+    if (sig == NULL)
+    {
+        return BOOT_SIG_NONE;
+    }
+    if ((i < BSIG_LOG_WORDS) && (log[i] == entry))
+    {
+        return BOOT_SIG_CACHED;
+    }
+
+    if (bsig_verify(base, sig) == 0U)
+    {
+        return BOOT_SIG_BAD;
+    }
+
+    /* Only the two values with a meaning of their own cannot be recorded. */
+    if ((entry == 0U) || (entry == IMAGE_ERASED))
+    {
+        return BOOT_SIG_OK;
+    }
+    if ((i < BSIG_LOG_WORDS) && (log[i] != IMAGE_ERASED))
+    {
+        (void)bsig_program(&log[i], 0U);    /* entry of an earlier image */
+        i++;
+    }
+    if (i < BSIG_LOG_WORDS)
+    {
+        (void)bsig_program(&log[i], entry);
+    }
+    return BOOT_SIG_OK;
+}
+
+uint8_t BootSig_Forget(uint32_t base, uint32_t size)
+{
+    const volatile uint32_t *log = bsig_log(base, size);
+    uint32_t                 i   = bsig_current(log);
+
+    if ((i < BSIG_LOG_WORDS) && (log[i] != IMAGE_ERASED))
+    {
+        (void)bsig_program(&log[i], 0U);
+        i++;
+    }
+    return (i >= BSIG_LOG_WORDS) ? 1U : 0U;
+}
+
+const char *BootSig_ResultName(BootSig_Result_t result)
+{
+    switch (result)
+    {
+        case BOOT_SIG_OK:     return "signature ok";
+        case BOOT_SIG_CACHED: return "signature checked earlier";
+        case BOOT_SIG_NONE:   return "unsigned";
+        case BOOT_SIG_BAD:    return "signature invalid";
+        default:              return "?";
+    }
+}
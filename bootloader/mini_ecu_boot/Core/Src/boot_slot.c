@@ -0,0 +1,225 @@
+/**
+ * @file    boot_slot.c
+ * @brief   A/B slot table, boot order and the trial/rollback bookkeeping.
+ *
+ * Boot-control words only ever go from erased to 0 (or to a generation),
+ * so each change is a single 32-bit flash program of a few microseconds
+ * and any interrupted change leaves the previous state.
+ */
+
+#include "boot_slot.h"
+#include "boot_image.h"
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+/* Trial word in backup SRAM: "TR", slot, attempts. */
+#define BS_TRIAL_MAGIC      0x54520000U
+
+#define BS_TRIAL(slot, attempts)  (BS_TRIAL_MAGIC | ((uint32_t)(slot) << 8) | (attempts))
+
+static const BootSlot_Sector_t s_sectorsA[] =
+{
+    { FLASH_SECTOR_4, 0x08010000U,  64U * 1024U },
+    { FLASH_SECTOR_5, 0x08020000U, 128U * 1024U },
+};
+
+static const BootSlot_Sector_t s_sectorsB[] =
+{
+    { FLASH_SECTOR_6, 0x08040000U, 128U * 1024U },
+    { FLASH_SECTOR_7, 0x08060000U, 128U * 1024U },
+};
+
+static const BootSlot_t s_slots[BOOT_SLOT_COUNT] =
+{
+    { 'A', BOOT_SLOT_A_ADDR, 192U * 1024U, s_sectorsA, sizeof(s_sectorsA) / sizeof(s_sectorsA[0]) },
+    { 'B', BOOT_SLOT_B_ADDR, 256U * 1024U, s_sectorsB, sizeof(s_sectorsB) / sizeof(s_sectorsB[0]) },
+};
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+static const ImageHeader_t *bs_header(uint32_t slot)
+{
+    return BOOT_IMAGE_HEADER(s_slots[slot].base);
+}
+
+/** Generation for the boot order: never activated counts as 0. */
+static uint32_t bs_generation(uint32_t slot)
+{
+    uint32_t gen = bs_header(slot)->generation;
+
+    return (gen == IMAGE_ERASED) ? 0U : gen;
+}
+
+static uint8_t bs_bootable(uint32_t slot)
+{
+    const ImageHeader_t *hdr = bs_header(slot);
+
+    return ((hdr->magic == IMAGE_HEADER_MAGIC) && (hdr->revoked == IMAGE_ERASED)) ? 1U : 0U;
+}
+
+/** Activated by an update and not confirmed yet: its boots are counted. */
+static uint8_t bs_on_trial(uint32_t slot)
+{
+    const ImageHeader_t *hdr = bs_header(slot);
+
+    return ((hdr->generation != IMAGE_ERASED) && (hdr->confirmed == IMAGE_ERASED)) ? 1U : 0U;
+}
+
+static HAL_StatusTypeDef bs_program(const volatile uint32_t *word, uint32_t value)
+{
+    HAL_StatusTypeDef status;
+
+    (void)HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                           FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+    status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, (uint32_t)word, value);
+    (void)HAL_FLASH_Lock();
+
+    if ((status == HAL_OK) && (*word != value))
+    {
+        status = HAL_ERROR;
+    }
+    return status;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+const BootSlot_t *BootSlot_Get(uint32_t slot)
+{
+    return (slot < BOOT_SLOT_COUNT) ? &s_slots[slot] : NULL;
+}
+
+uint32_t BootSlot_Candidates(uint32_t order[BOOT_SLOT_COUNT])
+{
+    uint32_t n = 0U;
+
+    for (uint32_t slot = 0U; slot < BOOT_SLOT_COUNT; ++slot)
+    {
+        if (bs_bootable(slot) == 0U)
+        {
+            continue;
+        }
+
+        /* Insertion by generation; A wins a tie. */
+        uint32_t i = n;
+        while ((i > 0U) && (bs_generation(order[i - 1U]) < bs_generation(slot)))
+        {
+            order[i] = order[i - 1U];
+            i--;
+        }
+        order[i] = slot;
+        n++;
+    }
+
+    return n;
+}
+
+uint32_t BootSlot_Active(void)
+{
+    uint32_t order[BOOT_SLOT_COUNT];
+    uint32_t n = BootSlot_Candidates(order);
+
+    for (uint32_t i = 0U; i < n; ++i)
+    {
+        BootImage_Result_t result = BootImage_Verify(s_slots[order[i]].base,
+                                                     s_slots[order[i]].size, NULL);
+
+        if ((result == BOOT_IMAGE_OK) ||
+            ((BOOT_ALLOW_UNSTAMPED != 0) && (result == BOOT_IMAGE_UNSTAMPED)))
+        {
+            return order[i];
+        }
+    }
+
+    return BOOT_SLOT_NONE;
+}
+
+uint32_t BootSlot_Target(void)
+{
+    uint32_t active = BootSlot_Active();
+
+    return (active == 0U) ? 1U : 0U;
+}
+
+uint32_t BootSlot_CountAttempt(uint32_t slot)
+{
+    volatile uint32_t *trial    = (volatile uint32_t *)BOOT_TRIAL_ADDR;
+    uint32_t           attempts = 0U;
+
+    BootImage_BackupEnable();
+
+    if (bs_on_trial(slot) == 0U)
+    {
+        if ((*trial & ~0xFFU) == BS_TRIAL(slot, 0U))
+        {
+            *trial = 0U;    /* trial passed */
+        }
+        return 0U;
+    }
+
+    /* A lost counter (backup domain reset) starts the count again. */
+    if ((*trial & ~0xFFU) == BS_TRIAL(slot, 0U))
+    {
+        attempts = *trial & 0xFFU;
+    }
+    if (attempts <= BOOT_MAX_ATTEMPTS)
+    {
+        attempts++;
+    }
+    *trial = BS_TRIAL(slot, attempts);
+
+    return attempts;
+}
+
+uint32_t BootSlot_FastBoot(void)
+{
+    uint32_t order[BOOT_SLOT_COUNT];
+
+    if ((BootSlot_Candidates(order) == 0U) || (bs_on_trial(order[0]) != 0U) ||
+        (BootImage_IsVerified(s_slots[order[0]].base, s_slots[order[0]].size) == 0U))
+    {
+        return BOOT_SLOT_NONE;
+    }
+
+    return order[0];
+}
+
+HAL_StatusTypeDef BootSlot_Activate(uint32_t slot)
+{
+    const ImageHeader_t *hdr = bs_header(slot);
+    uint32_t gen = 0U;
+
+    if (hdr->generation != IMAGE_ERASED)
+    {
+        return HAL_ERROR;
+    }
+
+    for (uint32_t other = 0U; other < BOOT_SLOT_COUNT; ++other)
+    {
+        if ((other != slot) && (bs_header(other)->magic == IMAGE_HEADER_MAGIC) &&
+            (bs_generation(other) > gen))
+        {
+            gen = bs_generation(other);
+        }
+    }
+
+    if (bs_program(&hdr->generation, gen + 1U) != HAL_OK)
+    {
+        return HAL_ERROR;
+    }
+
+    BootImage_BackupEnable();
+    *(volatile uint32_t *)BOOT_TRIAL_ADDR = BS_TRIAL(slot, 0U);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef BootSlot_Revoke(uint32_t slot)
+{
+    return bs_program(&bs_header(slot)->revoked, 0U);
+}
@@ -0,0 +1,1107 @@
+/**
+ * @file    boot_update.c
+ * @brief   UART firmware update server (see boot_update.h for the framing).
+ *
+ * Throughput comes from keeping the link busy:
+ *   - USART2 RX is a circular DMA ring polled through NDTR. No interrupt is
+ *     involved, so the flash stalls during programming cannot cause an
+ *     overrun; the ring simply holds the frames behind the current one.
+ *   - The current frame is copied out of the ring into a word-aligned
+ *     staging buffer, checked with the CRC unit and programmed from there
+ *     while the ring keeps receiving.
+ *   - The host pipelines WINDOW chunks and only resends what failed.
+ * At 921600 baud one 1 KB chunk takes ~11 ms on the wire against ~4 ms to
+ * program 256 words, so the link and not the flash sets the pace.
+ *
+ * ZWRITE cuts the bytes on the link further: an LZ4 stream decoded one
+ * byte at a time into a one-chunk output buffer that is programmed through
+ * the same path as WRITE whenever it fills.
+ *
+ * A tagged ERASE keeps a transfer record in the slot (boot_resume.c): one
+ * byte program per chunk, after its read-back, so an interrupted transfer
+ * resumes with the chunks still missing.
+ *
+ * The same commands arrive over CAN as ISO-TP PDUs (boot_can.c); the loop
+ * polls both links and a reply goes back on the one the request came from.
+ * WRITE and ZWRITE on the functional (multicast) ID are not acknowledged.
+ */
+
+#include "boot_update.h"
+#include "boot_image.h"
+#include "boot_can.h"
+#include "boot_slot.h"
+#include "boot_handoff.h"
+#include "boot_sig.h"
+#include "boot_resume.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Local definitions                                                          */
+/* -------------------------------------------------------------------------- */
+
+#define BU_FRAME_MAX    (BOOT_UPDATE_HDR_SIZE + BOOT_UPDATE_CHUNK + BOOT_UPDATE_CRC_SIZE)
+#define BU_MAX_CHUNKS   ((BOOT_SLOT_MAX_SIZE + BOOT_UPDATE_CHUNK - 1U) / BOOT_UPDATE_CHUNK)
+#define BU_MAP_WORDS    ((BU_MAX_CHUNKS + 31U) / 32U)
+
+/** INFO payload: 8 words, the transfer record (3) and its chunk bitmap. */
+#define BU_INFO_WORDS   (11U + BU_MAP_WORDS)
+
+#define BU_BLINK_MS     300U
+
+/** BAUD refuses a rate more than this far off after rounding (1/1000). */
+#define BU_BAUD_MAX_ERR 20U
+
+#if (BOOT_UPDATE_CHUNK % 4U) != 0U
+#error "BOOT_UPDATE_CHUNK must be a multiple of 4"
+#endif
+
+/* Delta updates keep whole sectors, so chunks must not straddle one. */
+#if ((16U * 1024U) % BOOT_UPDATE_CHUNK) != 0U
+#error "BOOT_UPDATE_CHUNK must divide the 16 KB sector size"
+#endif
+
+#if BOOT_UPDATE_RX_RING < (BOOT_UPDATE_WINDOW + 1U) * BU_FRAME_MAX
+#error "BOOT_UPDATE_RX_RING must hold BOOT_UPDATE_WINDOW + 1 frames"
+#endif
+
+typedef struct
+{
+    uint8_t  sync;
+    uint8_t  cmd;
+    uint16_t seq;
+    uint16_t len;
+    uint8_t  nsync;
+    uint8_t  check;
+} BuHeader_t;
+
+/** LZ4 block decoder states (ZWRITE). */
+typedef enum
+{
+    BU_Z_TOKEN = 0,     /**< next byte is a sequence token */
+    BU_Z_LIT_LEN,       /**< literal length continues */
+    BU_Z_LIT,           /**< literal bytes */
+    BU_Z_OFF_LO,        /**< match offset, low byte */
+    BU_Z_OFF_HI,        /**< match offset, high byte */
+    BU_Z_MATCH_LEN,     /**< match length continues */
+    BU_Z_END            /**< image complete; the rest is padding */
+} BuZState_t;
+
+typedef struct
+{
+    uint32_t            out;    /**< image bytes decoded (offset in the slot) */
+    uint32_t            lit;    /**< literal bytes still to copy */
+    uint32_t            match;  /**< match length so far (without the 4) */
+    uint32_t            dist;   /**< match offset */
+    uint16_t            seq;    /**< next stream chunk expected */
+    uint8_t             state;  /**< BuZState_t */
+    BootUpdate_Status_t err;    /**< sticky: the stream cannot continue */
+} BuZ_t;
+
+/** Where bu_send() delivers the reply to the command being handled. */
+typedef enum
+{
+    BU_LINK_NONE = 0,   /**< Functional WRITE: no reply. */
+    BU_LINK_UART,
+    BU_LINK_CAN
+} BuLink_t;
+
+/* -------------------------------------------------------------------------- */
+/* Local state                                                                */
+/* -------------------------------------------------------------------------- */
+
+static UART_HandleTypeDef *s_huart;
+static DMA_HandleTypeDef   s_rxDma;
+
+static uint8_t  s_rx[BOOT_UPDATE_RX_RING];
+static uint32_t s_rxRd;
+static uint32_t s_rxLastAvail;
+static uint32_t s_rxLastTick;
+
+/** Staging buffer for one frame (word-aligned for the CRC DMA). */
+static uint32_t s_frame[BU_FRAME_MAX / 4U];
+
+/** Reply frame: header, up to BU_INFO_WORDS payload words, CRC. */
+static uint32_t s_reply[(BOOT_UPDATE_HDR_SIZE + (BU_INFO_WORDS * 4U) + BOOT_UPDATE_CRC_SIZE) / 4U];
+
+static BuLink_t s_link;
+static uint8_t  s_canUp;
+static uint32_t s_lastCmdTick;
+
+/** Slot the session writes to: the one that is not booting. */
+static uint32_t          s_target;
+static const BootSlot_t *s_slot;
+
+/** Bytes erased from the slot base by the last ERASE; 0 = no session. */
+static uint32_t s_eraseLen;
+static uint32_t s_written[BU_MAP_WORDS];
+static uint8_t  s_doneOk;      /**< DONE passed: GO activates the slot. */
+
+/** Record of the session in the slot (tagged ERASE), NULL if none. */
+static const BootResume_Record_t *s_rec;
+
+/* ZWRITE: decoder state and the output chunk being assembled. */
+static BuZ_t    s_z;
+static uint32_t s_zChunk[BOOT_UPDATE_CHUNK / 4U];
+
+/* BAUD: the rate to go back to until a frame arrives at the new one. */
+static uint8_t  s_baudPending;
+static uint32_t s_baudTick;
+static uint32_t s_baudPrev;
+
+/* -------------------------------------------------------------------------- */
+/* Local helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** 84 MHz from the HSI PLL (scale 3, 2 wait states); PCLK1 = 42 MHz. */
+static void bu_clock_fast(void)
+{
+    RCC_OscInitTypeDef osc = { 0 };
+    RCC_ClkInitTypeDef clk = { 0 };
+
+    osc.OscillatorType      = RCC_OSCILLATORTYPE_HSI;
+    osc.HSIState            = RCC_HSI_ON;
+    osc.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
+    osc.PLL.PLLState        = RCC_PLL_ON;
+    osc.PLL.PLLSource       = RCC_PLLSOURCE_HSI;
+    osc.PLL.PLLM            = 16U;
+    osc.PLL.PLLN            = 336U;
+    osc.PLL.PLLP            = RCC_PLLP_DIV4;
+    osc.PLL.PLLQ            = 7U;
+    osc.PLL.PLLR            = 2U;
+    if (HAL_RCC_OscConfig(&osc) != HAL_OK)
+    {
+        Error_Handler();
+    }
+
+    clk.ClockType      = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK
+                       | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+    clk.SYSCLKSource   = RCC_SYSCLKSOURCE_PLLCLK;
+    clk.AHBCLKDivider  = RCC_SYSCLK_DIV1;
+    clk.APB1CLKDivider = RCC_HCLK_DIV2;
+    clk.APB2CLKDivider = RCC_HCLK_DIV1;
+    if (HAL_RCC_ClockConfig(&clk, FLASH_LATENCY_2) != HAL_OK)
+    {
+        Error_Handler();
+    }
+
+    __HAL_FLASH_PREFETCH_BUFFER_ENABLE();
+    __HAL_FLASH_INSTRUCTION_CACHE_ENABLE();
+    __HAL_FLASH_DATA_CACHE_ENABLE();
+}
+
+/** Reprogram the baud rate and start circular RX DMA (DMA1 Stream5 Ch4). */
+static void bu_uart_start(void)
+{
+    s_huart->Init.BaudRate = BOOT_UPDATE_BAUD;
+    if (HAL_UART_Init(s_huart) != HAL_OK)
+    {
+        Error_Handler();
+    }
+
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    s_rxDma.Instance                 = DMA1_Stream5;
+    s_rxDma.Init.Channel             = DMA_CHANNEL_4;
+    s_rxDma.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+    s_rxDma.Init.PeriphInc           = DMA_PINC_DISABLE;
+    s_rxDma.Init.MemInc              = DMA_MINC_ENABLE;
+    s_rxDma.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    s_rxDma.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+    s_rxDma.Init.Mode                = DMA_CIRCULAR;
+    s_rxDma.Init.Priority            = DMA_PRIORITY_VERY_HIGH;
+    s_rxDma.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+    if ((HAL_DMA_Init(&s_rxDma) != HAL_OK) ||
+        (HAL_DMA_Start(&s_rxDma, (uint32_t)&s_huart->Instance->DR,
+                       (uint32_t)s_rx, BOOT_UPDATE_RX_RING) != HAL_OK))
+    {
+        Error_Handler();
+    }
+
+    __HAL_UART_CLEAR_OREFLAG(s_huart);
+    SET_BIT(s_huart->Instance->CR3, USART_CR3_DMAR);
+
+    s_rxRd        = 0U;
+    s_rxLastAvail = 0U;
+    s_rxLastTick  = HAL_GetTick();
+}
+
+/**
+ * @brief BRR and OVER8 for @p baud from PCLK1; 0 if out of reach or more
+ *        than BU_BAUD_MAX_ERR off. @p actual gets the rate it would run at.
+ */
+static uint32_t bu_baud_brr(uint32_t baud, uint8_t *over8, uint32_t *actual)
+{
+    uint32_t pclk = HAL_RCC_GetPCLK1Freq();
+    uint32_t div;
+    uint32_t diff;
+
+    *over8  = 0U;
+    *actual = 0U;
+    if ((baud == 0U) || (baud > (pclk / 8U)))
+    {
+        return 0U;
+    }
+
+    /* Whole UART clocks per bit: 16x oversampling down to 16, then 8x. */
+    div     = (pclk + (baud / 2U)) / baud;
+    *actual = pclk / div;
+    diff    = (*actual > baud) ? (*actual - baud) : (baud - *actual);
+    if ((div < 8U) || (((uint64_t)diff * 1000U) > ((uint64_t)baud * BU_BAUD_MAX_ERR)))
+    {
+        return 0U;
+    }
+    if (div >= 16U)
+    {
+        return div;
+    }
+    *over8 = 1U;
+    return ((div & ~7U) << 1U) | (div & 7U);
+}
+
+/** Switch the UART to @p baud (valid, see bu_baud_brr()) once TX is idle. */
+static void bu_baud_apply(uint32_t baud)
+{
+    USART_TypeDef *u = s_huart->Instance;
+    uint8_t        over8;
+    uint32_t       actual;
+    uint32_t       brr   = bu_baud_brr(baud, &over8, &actual);
+    uint32_t       start = HAL_GetTick();
+
+    while ((__HAL_UART_GET_FLAG(s_huart, UART_FLAG_TC) == 0U) && ((HAL_GetTick() - start) < 10U))
+    {
+    }
+
+    CLEAR_BIT(u->CR1, USART_CR1_UE);
+    if (over8 != 0U)
+    {
+        SET_BIT(u->CR1, USART_CR1_OVER8);
+    }
+    else
+    {
+        CLEAR_BIT(u->CR1, USART_CR1_OVER8);
+    }
+    u->BRR = brr;
+    SET_BIT(u->CR1, USART_CR1_UE);
+
+    s_huart->Init.BaudRate     = baud;
+    s_huart->Init.OverSampling = (over8 != 0U) ? UART_OVERSAMPLING_8 : UART_OVERSAMPLING_16;
+
+    /* Whatever arrived during the switch is noise; resync on the next frame. */
+    __HAL_UART_CLEAR_OREFLAG(s_huart);
+    s_rxRd        = BOOT_UPDATE_RX_RING - __HAL_DMA_GET_COUNTER(&s_rxDma);
+    s_rxRd       %= BOOT_UPDATE_RX_RING;
+    s_rxLastAvail = 0U;
+    s_rxLastTick  = HAL_GetTick();
+}
+
+static uint32_t bu_rx_avail(void)
+{
+    uint32_t wr = BOOT_UPDATE_RX_RING - __HAL_DMA_GET_COUNTER(&s_rxDma);
+
+    return (wr + BOOT_UPDATE_RX_RING - s_rxRd) % BOOT_UPDATE_RX_RING;
+}
+
+static void bu_rx_copy(void *dst, uint32_t n)
+{
+    uint32_t first = BOOT_UPDATE_RX_RING - s_rxRd;
+
+    if (first > n)
+    {
+        first = n;
+    }
+    memcpy(dst, &s_rx[s_rxRd], first);
+    memcpy((uint8_t *)dst + first, s_rx, n - first);
+}
+
+static void bu_rx_skip(uint32_t n)
+{
+    s_rxRd = (s_rxRd + n) % BOOT_UPDATE_RX_RING;
+}
+
+static uint8_t bu_hdr_check(const uint8_t *h)
+{
+    uint8_t x = 0U;
+
+    for (uint32_t i = 0U; i < BOOT_UPDATE_HDR_SIZE - 1U; ++i)
+    {
+        x ^= h[i];
+    }
+    return x;
+}
+
+/** UART reply frame with @p words payload words. */
+static void bu_uart_send(uint8_t cmd, uint16_t seq, const uint32_t *payload, uint32_t words)
+{
+    uint8_t  *p   = (uint8_t *)s_reply;
+    uint32_t  len = words * 4U;
+    uint32_t  crc = 0U;
+
+    BuHeader_t hdr =
+    {
+        .sync  = BOOT_UPDATE_SYNC_ECU,
+        .cmd   = cmd,
+        .seq   = seq,
+        .len   = (uint16_t)len,
+        .nsync = (uint8_t)~BOOT_UPDATE_SYNC_ECU,
+        .check = 0U,
+    };
+
+    memcpy(p, &hdr, sizeof(hdr));
+    p[BOOT_UPDATE_HDR_SIZE - 1U] = bu_hdr_check(p);
+    memcpy(p + BOOT_UPDATE_HDR_SIZE, payload, len);
+
+    (void)BootImage_Crc((uint32_t)s_reply, BOOT_UPDATE_HDR_SIZE + len, &crc);
+    memcpy(p + BOOT_UPDATE_HDR_SIZE + len, &crc, sizeof(crc));
+
+    (void)HAL_UART_Transmit(s_huart, p, (uint16_t)(BOOT_UPDATE_HDR_SIZE + len + 4U), 100U);
+}
+
+/** CAN reply PDU: cmd, status byte, seq, then the remaining words. */
+static void bu_can_send(uint8_t cmd, uint16_t seq, const uint32_t *payload, uint32_t words)
+{
+    uint8_t *p = (uint8_t *)s_reply;
+
+    p[0] = cmd;
+    p[1] = (uint8_t)payload[0];
+    p[2] = (uint8_t)seq;
+    p[3] = (uint8_t)(seq >> 8);
+    memcpy(p + BOOT_CAN_HDR_SIZE, &payload[1], (words - 1U) * 4U);
+
+    (void)BootCan_Send(p, BOOT_CAN_HDR_SIZE + (words - 1U) * 4U);
+}
+
+/** Reply on the link the current command came from; payload[0] is the status. */
+static void bu_send(uint8_t cmd, uint16_t seq, const uint32_t *payload, uint32_t words)
+{
+    switch (s_link)
+    {
+        case BU_LINK_UART:
+            bu_uart_send(cmd, seq, payload, words);
+            break;
+
+        case BU_LINK_CAN:
+            bu_can_send(cmd, seq, payload, words);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void bu_reply(uint8_t cmd, uint16_t seq, BootUpdate_Status_t status,
+                     uint32_t v0, uint32_t v1)
+{
+    uint32_t payload[3] = { (uint32_t)status, v0, v1 };
+
+    bu_send(cmd, seq, payload, 3U);
+}
+
+/** Status-only reply (WRITE, GO, errors without details). */
+static void bu_reply_status(uint8_t cmd, uint16_t seq, BootUpdate_Status_t status)
+{
+    uint32_t payload = (uint32_t)status;
+
+    bu_send(cmd, seq, &payload, 1U);
+}
+
+/* ---- Commands ------------------------------------------------------------ */
+
+/** Mark the chunks of a sector that is kept as written (sectors are chunk-aligned). */
+static void bu_keep_sector(uint32_t *map, const BootSlot_Sector_t *sec, uint32_t imageLen)
+{
+    uint32_t first = (sec->start - s_slot->base) / BOOT_UPDATE_CHUNK;
+    uint32_t end   = sec->start - s_slot->base + sec->size;
+
+    if (end > imageLen)
+    {
+        end = imageLen;
+    }
+    for (uint32_t i = first; i < (end + BOOT_UPDATE_CHUNK - 1U) / BOOT_UPDATE_CHUNK; ++i)
+    {
+        map[i / 32U] |= 1UL << (i % 32U);
+    }
+}
+
+/**
+ * @brief Chunks of a recorded transfer that are in flash: those of the
+ *        kept sectors and the marked ones.
+ *
+ * @return The first chunk missing, the chunk count if none is.
+ */
+static uint32_t bu_record_map(const BootResume_Record_t *rec, uint32_t *map)
+{
+    const volatile uint8_t *flag   = rec->chunk;
+    uint32_t                chunks = (rec->length + BOOT_UPDATE_CHUNK - 1U) / BOOT_UPDATE_CHUNK;
+    uint32_t                first  = chunks;
+
+    memset(map, 0, BU_MAP_WORDS * 4U);
+    for (uint32_t i = 0U; (i < s_slot->sectorCount) &&
+                          (s_slot->sectors[i].start < s_slot->base + rec->length); ++i)
+    {
+        if ((rec->mask & (1UL << i)) == 0U)
+        {
+            bu_keep_sector(map, &s_slot->sectors[i], rec->length);
+        }
+    }
+    for (uint32_t i = 0U; i < chunks; ++i)
+    {
+        if (flag[i] != 0xFFU)
+        {
+            map[i / 32U] |= 1UL << (i % 32U);
+        }
+        if ((first == chunks) && ((map[i / 32U] & (1UL << (i % 32U))) == 0U))
+        {
+            first = i;
+        }
+    }
+    return first;
+}
+
+static void bu_cmd_info(uint16_t seq)
+{
+    uint32_t                   active = BootSlot_Active();
+    const BootSlot_t          *slot   = BootSlot_Get((active != BOOT_SLOT_NONE) ? active : s_target);
+    const ImageHeader_t       *hdr    = BOOT_IMAGE_HEADER(slot->base);
+    BootImage_Result_t         state  = BootImage_Verify(slot->base, slot->size, NULL);
+    const BootResume_Record_t *rec    = BootResume_Current(s_slot->base, s_slot->size);
+
+    uint32_t payload[BU_INFO_WORDS] =
+    {
+        BOOT_UPDATE_OK,
+        BOOT_UPDATE_PROTOCOL,
+        BOOT_UPDATE_CHUNK,
+        BOOT_UPDATE_WINDOW,
+        s_slot->size - BOOT_SLOT_TAIL_SIZE,
+        (hdr->magic == IMAGE_HEADER_MAGIC) ? hdr->version : 0U,
+        (uint32_t)state,
+        s_slot->base,
+        (rec != NULL) ? rec->length : 0U,
+        (rec != NULL) ? rec->mask : 0U,
+        (rec != NULL) ? rec->tag : 0U,
+    };
+
+    if (rec != NULL)
+    {
+        (void)bu_record_map(rec, &payload[11]);
+    }
+    bu_send(BOOT_UPDATE_CMD_INFO, seq, payload, BU_INFO_WORDS);
+}
+
+static void bu_cmd_hash(uint16_t seq)
+{
+    uint32_t crc = 0U;
+
+    if (seq >= s_slot->sectorCount)
+    {
+        bu_reply_status(BOOT_UPDATE_CMD_HASH, seq, BOOT_UPDATE_ERR_RANGE);
+        return;
+    }
+
+    const BootSlot_Sector_t *sec = &s_slot->sectors[seq];
+    if (BootImage_Crc(sec->start, sec->size, &crc) != HAL_OK)
+    {
+        bu_reply_status(BOOT_UPDATE_CMD_HASH, seq, BOOT_UPDATE_ERR_FLASH);
+        return;
+    }
+
+    uint32_t payload[4] = { BOOT_UPDATE_OK, sec->start, sec->size, crc };
+
+    bu_send(BOOT_UPDATE_CMD_HASH, seq, payload, 4U);
+}
+
+static void bu_cmd_erase(uint16_t seq, const uint8_t *data, uint32_t len)
+{
+    FLASH_EraseInitTypeDef erase = { 0 };
+    uint32_t imageLen;
+    uint32_t mask = 0xFFFFFFFFU;
+    uint32_t tag = IMAGE_ERASED;
+    uint32_t sectorError = 0U;
+    uint32_t erased = 0U;
+    uint32_t end;
+    uint32_t t0;
+    uint8_t  logFull;
+    uint8_t  recFull;
+
+    if ((len != 4U) && (len != 8U) && (len != 12U))
+    {
+        bu_reply(BOOT_UPDATE_CMD_ERASE, seq, BOOT_UPDATE_ERR_FRAME, 0U, 0U);
+        return;
+    }
+    memcpy(&imageLen, data, sizeof(imageLen));
+    if (len >= 8U)
+    {
+        memcpy(&mask, data + 4U, sizeof(mask));
+    }
+    if (len == 12U)
+    {
+        memcpy(&tag, data + 8U, sizeof(tag));
+    }
+    mask &= (1UL << s_slot->sectorCount) - 1U;
+    /* The records and the check log at the slot end are the bootloader's own. */
+    if ((imageLen == 0U) || (imageLen > s_slot->size - BOOT_SLOT_TAIL_SIZE) ||
+        ((imageLen & 3U) != 0U))
+    {
+        bu_reply(BOOT_UPDATE_CMD_ERASE, seq, BOOT_UPDATE_ERR_RANGE, 0U, 0U);
+        return;
+    }
+
+    BootImage_Invalidate();
+    memset(s_written, 0, sizeof(s_written));
+    memset(&s_z, 0, sizeof(s_z));
+    s_eraseLen = 0U;
+    s_doneOk = 0U;
+
+    t0 = HAL_GetTick();
+    (void)HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                           FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+
+    /* The image of an interrupted transfer: keep what arrived, erase nothing. */
+    s_rec = BootResume_Current(s_slot->base, s_slot->size);
+    if ((s_rec != NULL) && (tag != IMAGE_ERASED) && (s_rec->length == imageLen) &&
+        (s_rec->mask == mask) && (s_rec->tag == tag))
+    {
+        uint32_t first = bu_record_map(s_rec, s_written) * BOOT_UPDATE_CHUNK;
+
+        s_z.out = (first < imageLen) ? first : imageLen;
+        s_eraseLen = imageLen;
+        bu_reply(BOOT_UPDATE_CMD_ERASE, seq, BOOT_UPDATE_OK, 0U, 0U);
+        return;
+    }
+
+    logFull = BootSig_Forget(s_slot->base, s_slot->size);
+    recFull = BootResume_Retire(s_slot->base, s_slot->size);
+    s_rec = NULL;
+    s_z.out = imageLen;
+
+    /*
+     * Only the sectors the new image touches, and of those only the ones in
+     * the mask. The others keep their content, which the host found equal
+     * to the new image (HASH), and count as written.
+     */
+    end = s_slot->base + imageLen;
+    erase.TypeErase    = FLASH_TYPEERASE_SECTORS;
+    erase.NbSectors    = 1U;
+    erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+    for (uint32_t i = 0U; (i < s_slot->sectorCount) && (s_slot->sectors[i].start < end); ++i)
+    {
+        if ((mask & (1UL << i)) == 0U)
+        {
+            bu_keep_sector(s_written, &s_slot->sectors[i], imageLen);
+            continue;
+        }
+
+        /* A ZWRITE stream starts at the first sector it rewrites. */
+        if (s_z.out > (s_slot->sectors[i].start - s_slot->base))
+        {
+            s_z.out = s_slot->sectors[i].start - s_slot->base;
+        }
+
+        erase.Sector = s_slot->sectors[i].sector;
+        if (HAL_FLASHEx_Erase(&erase, &sectorError) != HAL_OK)
+        {
+            (void)HAL_FLASH_Lock();
+            bu_reply(BOOT_UPDATE_CMD_ERASE, seq, BOOT_UPDATE_ERR_FLASH, sectorError, 0U);
+            return;
+        }
+        erased++;
+    }
+
+    /* A full log is only cleared with a last sector the image leaves alone. */
+    const BootSlot_Sector_t *last = &s_slot->sectors[s_slot->sectorCount - 1U];
+    if (((logFull != 0U) || (recFull != 0U)) && (last->start >= end))
+    {
+        erase.Sector = last->sector;
+        if (HAL_FLASHEx_Erase(&erase, &sectorError) != HAL_OK)
+        {
+            (void)HAL_FLASH_Lock();
+            bu_reply(BOOT_UPDATE_CMD_ERASE, seq, BOOT_UPDATE_ERR_FLASH, sectorError, 0U);
+            return;
+        }
+        erased++;
+    }
+
+    /* Flash stays unlocked for WRITE until DONE. */
+    if (tag != IMAGE_ERASED)
+    {
+        s_rec = BootResume_Begin(s_slot->base, s_slot->size, imageLen, mask, tag);
+    }
+    s_eraseLen = imageLen;
+    bu_reply(BOOT_UPDATE_CMD_ERASE, seq, BOOT_UPDATE_OK, HAL_GetTick() - t0, erased);
+}
+
+static BootUpdate_Status_t bu_write(uint16_t seq, const uint32_t *data, uint32_t len)
+{
+    uint32_t off = (uint32_t)seq * BOOT_UPDATE_CHUNK;
+    uint32_t addr = s_slot->base + off;
+    const volatile uint32_t *dst = (const volatile uint32_t *)addr;
+
+    if (s_eraseLen == 0U)
+    {
+        return BOOT_UPDATE_ERR_STATE;
+    }
+    if (off >= s_eraseLen)
+    {
+        return BOOT_UPDATE_ERR_RANGE;
+    }
+    /* Full chunks except for the tail of the image. */
+    if (len != (((s_eraseLen - off) < BOOT_UPDATE_CHUNK) ? (s_eraseLen - off) : BOOT_UPDATE_CHUNK))
+    {
+        return BOOT_UPDATE_ERR_FRAME;
+    }
+    if ((s_written[seq / 32U] & (1UL << (seq % 32U))) != 0U)
+    {
+        return BOOT_UPDATE_OK;    /* lost ACK, chunk already programmed */
+    }
+
+    /*
+     * Words that already hold the data are left alone: 0xFF padding, or
+     * the part of a chunk programmed before a reset cut it short.
+     */
+    for (uint32_t i = 0U; i < len / 4U; ++i)
+    {
+        if ((dst[i] != data[i]) && (dst[i] != 0xFFFFFFFFU))
+        {
+            return BOOT_UPDATE_ERR_NOT_ERASED;
+        }
+    }
+
+    for (uint32_t i = 0U; i < len / 4U; ++i)
+    {
+        if ((dst[i] != data[i]) &&
+            (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr + i * 4U, data[i]) != HAL_OK))
+        {
+            return BOOT_UPDATE_ERR_FLASH;
+        }
+    }
+
+    if (memcmp((const void *)addr, data, len) != 0)
+    {
+        return BOOT_UPDATE_ERR_FLASH;
+    }
+
+    s_written[seq / 32U] |= 1UL << (seq % 32U);
+    if (s_rec != NULL)
+    {
+        BootResume_Mark(s_rec, seq);
+    }
+    HAL_GPIO_TogglePin(LD2_GPIO_Port, LD2_Pin);
+    return BOOT_UPDATE_OK;
+}
+
+/** Append one decoded byte; a full chunk (or the image tail) is programmed. */
+static BootUpdate_Status_t bu_z_put(uint8_t b)
+{
+    uint32_t at = s_z.out % BOOT_UPDATE_CHUNK;
+
+    ((uint8_t *)s_zChunk)[at] = b;
+    s_z.out++;
+    if ((at == (BOOT_UPDATE_CHUNK - 1U)) || (s_z.out == s_eraseLen))
+    {
+        return bu_write((uint16_t)((s_z.out - 1U) / BOOT_UPDATE_CHUNK), s_zChunk, at + 1U);
+    }
+    return BOOT_UPDATE_OK;
+}
+
+/** Copy a match: from the output chunk, or from the slot for older bytes. */
+static BootUpdate_Status_t bu_z_match(void)
+{
+    uint32_t            n      = s_z.match + 4U;
+    BootUpdate_Status_t status = BOOT_UPDATE_OK;
+
+    if ((s_z.dist == 0U) || (s_z.dist > s_z.out) || (n > (s_eraseLen - s_z.out)))
+    {
+        return BOOT_UPDATE_ERR_STREAM;
+    }
+    while ((n-- > 0U) && (status == BOOT_UPDATE_OK))
+    {
+        uint32_t from  = s_z.out - s_z.dist;
+        uint32_t begin = s_z.out - (s_z.out % BOOT_UPDATE_CHUNK);
+        uint8_t  b     = (from >= begin) ? ((const uint8_t *)s_zChunk)[from - begin]
+                                         : *(const volatile uint8_t *)(s_slot->base + from);
+
+        status = bu_z_put(b);
+    }
+    return status;
+}
+
+/** Feed one stream byte to the LZ4 block decoder. */
+static BootUpdate_Status_t bu_z_byte(uint8_t b)
+{
+    BootUpdate_Status_t status = BOOT_UPDATE_OK;
+
+    switch (s_z.state)
+    {
+        case BU_Z_TOKEN:
+            s_z.lit   = b >> 4;
+            s_z.match = b & 0x0FU;
+            s_z.state = (s_z.lit == 15U) ? BU_Z_LIT_LEN : ((s_z.lit != 0U) ? BU_Z_LIT : BU_Z_OFF_LO);
+            break;
+
+        case BU_Z_LIT_LEN:
+            s_z.lit += b;
+            if (b != 255U)
+            {
+                s_z.state = BU_Z_LIT;
+            }
+            break;
+
+        case BU_Z_LIT:
+            if (s_z.out >= s_eraseLen)
+            {
+                return BOOT_UPDATE_ERR_STREAM;
+            }
+            status = bu_z_put(b);
+            if (--s_z.lit == 0U)
+            {
+                /* The last sequence has literals only. */
+                s_z.state = (s_z.out == s_eraseLen) ? BU_Z_END : BU_Z_OFF_LO;
+            }
+            break;
+
+        case BU_Z_OFF_LO:
+            s_z.dist  = b;
+            s_z.state = BU_Z_OFF_HI;
+            break;
+
+        case BU_Z_OFF_HI:
+            s_z.dist |= (uint32_t)b << 8;
+            if (s_z.match == 15U)
+            {
+                s_z.state = BU_Z_MATCH_LEN;
+                break;
+            }
+            status    = bu_z_match();
+            s_z.state = BU_Z_TOKEN;
+            break;
+
+        case BU_Z_MATCH_LEN:
+            s_z.match += b;
+            if (b != 255U)
+            {
+                status    = bu_z_match();
+                s_z.state = BU_Z_TOKEN;
+            }
+            break;
+
+        default:
+            break;      /* padding after the image */
+    }
+
+    if ((status == BOOT_UPDATE_OK) && (s_z.state == BU_Z_TOKEN) && (s_z.out == s_eraseLen))
+    {
+        s_z.state = BU_Z_END;
+    }
+    return status;
+}
+
+static void bu_cmd_zwrite(uint16_t seq, const uint8_t *data, uint32_t len)
+{
+    BootUpdate_Status_t status = BOOT_UPDATE_OK;
+
+    if (s_eraseLen == 0U)
+    {
+        status = BOOT_UPDATE_ERR_STATE;
+    }
+    else if (s_z.err != BOOT_UPDATE_OK)
+    {
+        status = s_z.err;
+    }
+    else if (seq > s_z.seq)
+    {
+        status = BOOT_UPDATE_ERR_SEQ;
+    }
+    else if (seq == s_z.seq)
+    {
+        for (uint32_t i = 0U; (i < len) && (status == BOOT_UPDATE_OK); ++i)
+        {
+            status = bu_z_byte(data[i]);
+        }
+        if (status != BOOT_UPDATE_OK)
+        {
+            s_z.err = status;
+        }
+        else
+        {
+            s_z.seq++;
+        }
+    }
+    /* else: a resend of a chunk already decoded (lost reply) */
+
+    bu_reply(BOOT_UPDATE_CMD_ZWRITE, seq, status, s_z.seq, s_z.out);
+}
+
+static void bu_cmd_done(uint16_t seq)
+{
+    BootImage_Info_t   info;
+    BootImage_Result_t result;
+    uint32_t           chunks = (s_eraseLen + BOOT_UPDATE_CHUNK - 1U) / BOOT_UPDATE_CHUNK;
+
+    if (s_eraseLen == 0U)
+    {
+        bu_reply(BOOT_UPDATE_CMD_DONE, seq, BOOT_UPDATE_ERR_STATE, 0U, 0U);
+        return;
+    }
+
+    for (uint32_t i = 0U; i < chunks; ++i)
+    {
+        if ((s_written[i / 32U] & (1UL << (i % 32U))) == 0U)
+        {
+            bu_reply(BOOT_UPDATE_CMD_DONE, seq, BOOT_UPDATE_ERR_INCOMPLETE, 0U, i);
+            return;
+        }
+    }
+
+    /* Everything arrived: nothing left to resume. */
+    (void)BootResume_Retire(s_slot->base, s_slot->size);
+    s_rec = NULL;
+    (void)HAL_FLASH_Lock();
+
+    result = BootImage_Verify(s_slot->base, s_slot->size, &info);
+    s_doneOk = (result == BOOT_IMAGE_OK) ? 1U : 0U;
+    bu_reply(BOOT_UPDATE_CMD_DONE, seq,
+             (result == BOOT_IMAGE_OK) ? BOOT_UPDATE_OK : BOOT_UPDATE_ERR_IMAGE,
+             (uint32_t)result, info.crcComputed);
+}
+
+static void bu_cmd_baud(uint16_t seq, const uint8_t *data, uint32_t len)
+{
+    uint32_t baud;
+    uint32_t actual;
+    uint8_t  over8;
+
+    if (s_link != BU_LINK_UART)
+    {
+        bu_reply_status(BOOT_UPDATE_CMD_BAUD, seq, BOOT_UPDATE_ERR_CMD);
+        return;
+    }
+    if (len != 4U)
+    {
+        bu_reply_status(BOOT_UPDATE_CMD_BAUD, seq, BOOT_UPDATE_ERR_FRAME);
+        return;
+    }
+
+    memcpy(&baud, data, sizeof(baud));
+    if (bu_baud_brr(baud, &over8, &actual) == 0U)
+    {
+        bu_reply(BOOT_UPDATE_CMD_BAUD, seq, BOOT_UPDATE_ERR_RANGE, actual, 0U);
+        return;
+    }
+
+    /* The reply still goes out at the old rate. */
+    bu_reply(BOOT_UPDATE_CMD_BAUD, seq, BOOT_UPDATE_OK, actual, 0U);
+    if (s_baudPending == 0U)
+    {
+        s_baudPrev = s_huart->Init.BaudRate;
+    }
+    bu_baud_apply(baud);
+    s_baudPending = 1U;
+    s_baudTick    = HAL_GetTick();
+}
+
+static void bu_dispatch(const BuHeader_t *hdr, const uint8_t *data)
+{
+    s_lastCmdTick = HAL_GetTick();
+
+    switch (hdr->cmd)
+    {
+        case BOOT_UPDATE_CMD_INFO:
+            bu_cmd_info(hdr->seq);
+            break;
+
+        case BOOT_UPDATE_CMD_ERASE:
+            bu_cmd_erase(hdr->seq, data, hdr->len);
+            break;
+
+        case BOOT_UPDATE_CMD_WRITE:
+            bu_reply_status(BOOT_UPDATE_CMD_WRITE, hdr->seq,
+                            bu_write(hdr->seq, (const uint32_t *)data, hdr->len));
+            break;
+
+        case BOOT_UPDATE_CMD_ZWRITE:
+            bu_cmd_zwrite(hdr->seq, data, hdr->len);
+            break;
+
+        case BOOT_UPDATE_CMD_DONE:
+            bu_cmd_done(hdr->seq);
+            break;
+
+        case BOOT_UPDATE_CMD_HASH:
+            bu_cmd_hash(hdr->seq);
+            break;
+
+        case BOOT_UPDATE_CMD_BAUD:
+            bu_cmd_baud(hdr->seq, data, hdr->len);
+            break;
+
+        case BOOT_UPDATE_CMD_GO:
+            /* A verified image takes over by its generation word; else just reset. */
+            if ((s_doneOk != 0U) && (BootSlot_Activate(s_target) != HAL_OK))
+            {
+                bu_reply_status(BOOT_UPDATE_CMD_GO, hdr->seq, BOOT_UPDATE_ERR_FLASH);
+                break;
+            }
+            if (s_doneOk != 0U)
+            {
+                BootHandoff_SetUpdate(BOOT_HANDOFF_UPDATE_INSTALLED,
+                                      BOOT_IMAGE_HEADER(s_slot->base)->version);
+            }
+            else if (s_eraseLen != 0U)
+            {
+                BootHandoff_SetUpdate(BOOT_HANDOFF_UPDATE_ABORTED, 0U);
+            }
+            bu_reply_status(BOOT_UPDATE_CMD_GO, hdr->seq, BOOT_UPDATE_OK);
+            HAL_Delay(2U);    /* let the reply leave the UART / TX mailbox */
+            NVIC_SystemReset();
+            break;
+
+        default:
+            bu_reply_status(hdr->cmd, hdr->seq, BOOT_UPDATE_ERR_CMD);
+            break;
+    }
+}
+
+/** Take at most one frame out of the RX ring. */
+static void bu_poll(void)
+{
+    uint32_t   avail = bu_rx_avail();
+    uint32_t   now   = HAL_GetTick();
+    BuHeader_t hdr;
+    uint32_t   total;
+    uint32_t   crc = 0U;
+    uint32_t   rxCrc;
+
+    /* Resynchronise on the next sync byte. */
+    while ((avail > 0U) && (s_rx[s_rxRd] != BOOT_UPDATE_SYNC_HOST))
+    {
+        bu_rx_skip(1U);
+        avail--;
+    }
+
+    if (avail != s_rxLastAvail)
+    {
+        s_rxLastAvail = avail;
+        s_rxLastTick  = now;
+    }
+
+    if (avail < BOOT_UPDATE_HDR_SIZE)
+    {
+        if ((avail > 0U) && ((now - s_rxLastTick) > BOOT_UPDATE_FRAME_TIMEOUT_MS))
+        {
+            bu_rx_skip(1U);
+        }
+        return;
+    }
+
+    bu_rx_copy(s_frame, BOOT_UPDATE_HDR_SIZE);
+    memcpy(&hdr, s_frame, sizeof(hdr));
+    if ((hdr.nsync != (uint8_t)~BOOT_UPDATE_SYNC_HOST) ||
+        (hdr.check != bu_hdr_check((const uint8_t *)s_frame)) ||
+        (hdr.len > BOOT_UPDATE_CHUNK) || ((hdr.len & 3U) != 0U))
+    {
+        bu_rx_skip(1U);
+        return;
+    }
+
+    total = BOOT_UPDATE_HDR_SIZE + hdr.len + BOOT_UPDATE_CRC_SIZE;
+    if (avail < total)
+    {
+        if ((now - s_rxLastTick) > BOOT_UPDATE_FRAME_TIMEOUT_MS)
+        {
+            bu_rx_skip(1U);    /* truncated frame */
+        }
+        return;
+    }
+
+    bu_rx_copy(s_frame, total);
+    bu_rx_skip(total);
+    s_rxLastAvail -= total;
+
+    memcpy(&rxCrc, (const uint8_t *)s_frame + BOOT_UPDATE_HDR_SIZE + hdr.len, sizeof(rxCrc));
+    if ((BootImage_Crc((uint32_t)s_frame, BOOT_UPDATE_HDR_SIZE + hdr.len, &crc) != HAL_OK) ||
+        (crc != rxCrc))
+    {
+        bu_reply_status(hdr.cmd, hdr.seq, BOOT_UPDATE_ERR_CRC);
+        return;
+    }
+
+    s_baudPending = 0U;    /* a good frame: the host follows the new rate */
+    bu_dispatch(&hdr, (const uint8_t *)s_frame + BOOT_UPDATE_HDR_SIZE);
+}
+
+/** Serve at most one complete ISO-TP PDU. */
+static void bu_can_poll(void)
+{
+    BuHeader_t     hdr = { 0 };
+    uint32_t       len;
+    uint8_t        functional;
+    const uint8_t *pdu = BootCan_Poll(&len, &functional);
+
+    if ((pdu == NULL) || (len < BOOT_CAN_HDR_SIZE))
+    {
+        return;
+    }
+
+    hdr.cmd = pdu[0];
+    hdr.seq = (uint16_t)(pdu[2] | ((uint16_t)pdu[3] << 8));
+    hdr.len = (uint16_t)(len - BOOT_CAN_HDR_SIZE);
+
+    s_link = ((functional != 0U) &&
+              ((hdr.cmd == BOOT_UPDATE_CMD_WRITE) || (hdr.cmd == BOOT_UPDATE_CMD_ZWRITE)))
+             ? BU_LINK_NONE : BU_LINK_CAN;
+    bu_dispatch(&hdr, pdu + BOOT_CAN_HDR_SIZE);
+    s_link = BU_LINK_UART;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void BootUpdate_Run(UART_HandleTypeDef *huart, uint32_t idleTimeoutMs)
+{
+    uint32_t lastBlink = HAL_GetTick();
+
+    s_huart       = huart;
+    s_eraseLen    = 0U;
+    s_doneOk      = 0U;
+    s_rec         = NULL;
+    s_target      = BootSlot_Target();
+    s_slot        = BootSlot_Get(s_target);
+    s_link        = BU_LINK_UART;
+    s_lastCmdTick = lastBlink;
+    s_baudPending = 0U;
+
+    bu_clock_fast();
+    bu_uart_start();
+    s_canUp = (BootCan_Init() == HAL_OK) ? 1U : 0U;
+
+    for (;;)
+    {
+        bu_poll();
+        if (s_canUp != 0U)
+        {
+            bu_can_poll();
+        }
+
+        /* The host did not follow a BAUD switch: go back to the old rate. */
+        if ((s_baudPending != 0U) && ((HAL_GetTick() - s_baudTick) >= BOOT_UPDATE_BAUD_CONFIRM_MS))
+        {
+            s_baudPending = 0U;
+            bu_baud_apply(s_baudPrev);
+        }
+
+        /* Nobody started a session: give the (untouched) image back. */
+        if ((idleTimeoutMs != 0U) && (s_eraseLen == 0U) &&
+            ((HAL_GetTick() - s_lastCmdTick) >= idleTimeoutMs))
+        {
+            BootHandoff_SetUpdate(BOOT_HANDOFF_UPDATE_IDLE, 0U);
+            NVIC_SystemReset();
+        }
+
+        if ((s_eraseLen == 0U) && ((HAL_GetTick() - lastBlink) >= BU_BLINK_MS))
+        {
+            lastBlink = HAL_GetTick();
+            HAL_GPIO_TogglePin(LD2_GPIO_Port, LD2_Pin);
+        }
+    }
+}
@@ -8,22 +8,32 @@
   * "Mini ECU v2" project. It is intended to live in the first 32 KB of
   * flash (sectors 0 and 1) and to:
   *
+  *   0. Out of reset, jump straight to an application that was already
+  *      verified, with B1 released and no update request (boot_fast.c,
+  *      called from Reset_Handler before main()). Everything below only
+  *      runs when that fast path does not apply.
   *   1. Initialize the HAL and basic peripherals (clock, GPIO, USART2).
-  *   2. Check whether a user application appears to be present at
-  *      APP_START_ADDR (0x08008000).
+  *   2. Pick the application slot to start (boot_slot.c): slot A at
+  *      0x08010000 or slot B at 0x08040000, newest activation first, and
+  *      check its image header and CRC32. A slot still on trial that used
+  *      up its boot attempts is rolled back to the other one.
   *   3. If a valid app is detected:
   *        - Clean up interrupts and SysTick.
-  *        - Remap the vector table to the app base.
+  *        - Remap the vector table to the slot base.
   *        - Set MSP and PC from the app's vector table.
   *        - Jump to the application's Reset_Handler.
-  *   4. If no valid app is found:
-  *        - Stay in a simple error loop, blinking the LD2 LED.
+  *   4. If no valid app is found (or B1 is held, or the app asked for it):
+  *        - Serve firmware updates over USART2 and CAN1, blinking LD2.
   *
-  * The bootloader currently does not implement any update protocol; it is
-  * only a clean "chain loader". Future phases will add:
-  *   - Boot decision logic (e.g., hold B1 at reset to stay in bootloader).
-  *   - UART- or CAN-based firmware update protocol.
-  *   - Image validation (checksums, signatures).
+  * Before the jump the image header (length, CRC32) behind the app's vector
+  * table is checked with the CRC unit (boot_image.c), then the Ed25519
+  * signature behind the image (boot_sig.c), once per image: the result is
+  * recorded at the end of the slot.
+  *
+  * With B1 held, or without a valid image, it runs the windowed UART
+  * update protocol instead (boot_update.c), with the same commands over
+  * CAN/ISO-TP (boot_can.c). The application can request update mode
+  * through a backup-SRAM word before it resets.
   *
   ******************************************************************************
   * @attention
@@ -43,6 +53,13 @@
 /* USER CODE BEGIN Includes */
 #include <stdio.h>
 #include <string.h>
+#include "boot_image.h"
+#include "boot_sig.h"
+#include "boot_update.h"
+#include "boot_can.h"
+#include "boot_slot.h"
+#include "boot_fast.h"
+#include "boot_handoff.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -78,11 +95,13 @@ static void MX_USART2_UART_Init(void);
   *
   * @details
   * This function:
-  *   - Reads the initial stack pointer and reset vector from APP_START_ADDR.
+  *   - Reads the initial stack pointer and reset vector from @p slot.
   *   - Performs a basic sanity check on the stack pointer (must be in SRAM).
   *   - De-initializes HAL, RCC, and SysTick.
   *   - Disables all interrupts.
-  *   - Sets the vector table offset (VTOR) to APP_START_ADDR.
+  *   - Sets the vector table offset (VTOR) to the base of @p slot, which
+  *     the image was linked for.
+  *   - Completes the hand-off block (boot_handoff.h) with @p attempt.
   *   - Sets MSP to the application's initial stack pointer.
   *   - Calls the application's Reset_Handler (never returns on success).
   *
@@ -90,7 +109,7 @@ static void MX_USART2_UART_Init(void);
   * bootloader can take appropriate fallback action (e.g., stay in an error
   * loop or enter update mode).
   */
-static void JumpToApplication(void);
+static void JumpToApplication(const BootSlot_t *slot, uint32_t attempt);
 
 /**
   * @brief Check if the user button (B1) is currently pressed.
@@ -98,12 +117,12 @@ static void JumpToApplication(void);
   * @retval 1 if pressed, 0 otherwise.
   *
   * @note On NUCLEO-F446RE, B1 is active-high on PC13 when using the default
-  *       board configuration. Adjust the logic if your hardware differs.
+  *       board configuration. Adjust BOOT_BUTTON_PRESSED() (boot_fast.h),
+  *       which the fast path reads as well, if your hardware differs.
   */
 static uint8_t Boot_IsButtonPressed(void)
 {
-  GPIO_PinState state = HAL_GPIO_ReadPin(B1_GPIO_Port, B1_Pin);
-  return (state == GPIO_PIN_SET) ? 1U : 0U;
+  return BOOT_BUTTON_PRESSED() ? 1U : 0U;
 }
 
 /**
@@ -125,15 +144,154 @@ static void Boot_Print(const char *msg)
   (void)HAL_UART_Transmit(&huart2, (uint8_t *)msg, (uint16_t)len, 100);
 }
 
+/**
+  * @brief Verify the image header, CRC and signature of @p slot before a
+  *        jump.
+  *
+  * @retval 1 if the image may be started, 0 otherwise.
+  *
+  * @details
+  * The CRC check runs on the CRC unit fed by DMA (see boot_image.c); an
+  * image already verified since the last power-up is accepted from the
+  * backup-SRAM record without rescanning flash. The signature is checked
+  * in software only for an image not seen before (an update checks it at
+  * DONE already). Unstamped images (no header, or length/CRC still erased)
+  * only start when BOOT_ALLOW_UNSTAMPED is set and unsigned ones when
+  * BOOT_ALLOW_UNSIGNED is, the defaults in debug builds.
+  */
+static uint8_t Boot_CheckApplication(const BootSlot_t *slot)
+{
+  BootImage_Info_t info;
+  char line[128];
+  BootImage_Result_t result = BootImage_Verify(slot->base, slot->size, &info);
+
+  if (result == BOOT_IMAGE_OK)
+  {
+    (void)snprintf(line, sizeof(line),
+                   "[BOOT] Slot %c: image v%lu.%lu.%lu, %lu B, CRC 0x%08lX %s, %s (%lu ms)\r\n",
+                   slot->name,
+                   (unsigned long)((info.version >> 16) & 0xFFU),
+                   (unsigned long)((info.version >> 8) & 0xFFU),
+                   (unsigned long)(info.version & 0xFFU),
+                   (unsigned long)info.length, (unsigned long)info.crcStored,
+                   info.cached ? "verified earlier" : "ok",
+                   BootSig_ResultName((BootSig_Result_t)info.sig),
+                   (unsigned long)info.elapsedMs);
+    Boot_Print(line);
+    return 1U;
+  }
+
+  if ((result == BOOT_IMAGE_BAD_CRC) || (result == BOOT_IMAGE_DMA_ERROR))
+  {
+    (void)snprintf(line, sizeof(line),
+                   "[BOOT] Slot %c: image check failed: %s (stored 0x%08lX, computed 0x%08lX)\r\n",
+                   slot->name, BootImage_ResultName(result),
+                   (unsigned long)info.crcStored, (unsigned long)info.crcComputed);
+  }
+  else
+  {
+    (void)snprintf(line, sizeof(line), "[BOOT] Slot %c: image check failed: %s\r\n",
+                   slot->name, BootImage_ResultName(result));
+  }
+  Boot_Print(line);
+
+#if BOOT_ALLOW_UNSTAMPED
+  if ((result == BOOT_IMAGE_NO_HEADER) || (result == BOOT_IMAGE_UNSTAMPED))
+  {
+    Boot_Print("[BOOT] Starting unstamped image (BOOT_ALLOW_UNSTAMPED).\r\n");
+    return 1U;
+  }
+#endif
+
+  return 0U;
+}
+
+/**
+  * @brief Announce and run the firmware update server (never returns).
+  *
+  * @param idleTimeoutMs Reset back into the application after this long
+  *                      without a command (0 = stay until GO).
+  *
+  * @details
+  * The banner still goes out at 115200; the server then switches the core
+  * to 84 MHz and USART2 to BOOT_UPDATE_BAUD and starts CAN1 (see
+  * boot_update.h, boot_can.h, tools/fw_update.py and tools/can_update.py).
+  */
+static void Boot_EnterUpdateMode(uint32_t idleTimeoutMs)
+{
+  char line[96];
+
+  (void)snprintf(line, sizeof(line),
+                 "[BOOT] Update mode: %lu baud 8N1, %u B chunks, window %u\r\n",
+                 (unsigned long)BOOT_UPDATE_BAUD, (unsigned)BOOT_UPDATE_CHUNK,
+                 (unsigned)BOOT_UPDATE_WINDOW);
+  Boot_Print(line);
+  (void)snprintf(line, sizeof(line),
+                 "[BOOT] CAN update: %lu kbit/s, request 0x%03X, response 0x%03X, functional 0x%03X\r\n",
+                 (unsigned long)(BOOT_CAN_BITRATE / 1000U), (unsigned)BOOT_CAN_REQ_ID,
+                 (unsigned)BOOT_CAN_RESP_ID, (unsigned)BOOT_CAN_FUNC_ID);
+  Boot_Print(line);
+  (void)snprintf(line, sizeof(line), "[BOOT] Writing slot %c at 0x%08lX\r\n",
+                 BootSlot_Get(BootSlot_Target())->name,
+                 (unsigned long)BootSlot_Get(BootSlot_Target())->base);
+  Boot_Print(line);
+
+  BootUpdate_Run(&huart2, idleTimeoutMs);
+}
+
+/**
+  * @brief Try the bootable slots in order and jump to the first good one.
+  *
+  * @details
+  * Returns only if no slot could be started. A slot on trial (activated by
+  * an update but not yet confirmed by the application) gets
+  * BOOT_MAX_ATTEMPTS boots; after that it is revoked and the previous
+  * image, still intact in the other slot, starts instead.
+  */
+static void Boot_StartApplication(void)
+{
+  uint32_t order[BOOT_SLOT_COUNT];
+  uint32_t count = BootSlot_Candidates(order);
+  char line[96];
+
+  for (uint32_t i = 0U; i < count; ++i)
+  {
+    const BootSlot_t *slot = BootSlot_Get(order[i]);
+    uint32_t attempt = BootSlot_CountAttempt(order[i]);
+
+    if (attempt > BOOT_MAX_ATTEMPTS)
+    {
+      (void)snprintf(line, sizeof(line),
+                     "[BOOT] Slot %c: not confirmed after %u boots, rolling back.\r\n",
+                     slot->name, (unsigned)BOOT_MAX_ATTEMPTS);
+      Boot_Print(line);
+      (void)BootSlot_Revoke(order[i]);
+      continue;
+    }
+    if (attempt != 0U)
+    {
+      (void)snprintf(line, sizeof(line), "[BOOT] Slot %c: trial boot %lu of %u\r\n",
+                     slot->name, (unsigned long)attempt, (unsigned)BOOT_MAX_ATTEMPTS);
+      Boot_Print(line);
+    }
+
+    if (Boot_CheckApplication(slot))
+    {
+      JumpToApplication(slot, attempt);
+    }
+  }
+}
+
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
 
-static void JumpToApplication(void)
+static void JumpToApplication(const BootSlot_t *slot, uint32_t attempt)
 {
-  uint32_t appStack = *(__IO uint32_t *)APP_START_ADDR;
-  uint32_t appReset = *(__IO uint32_t *)(APP_START_ADDR + 4U);
+  uint32_t base     = slot->base;
+  uint32_t appStack = *(__IO uint32_t *)base;
+  uint32_t appReset = *(__IO uint32_t *)(base + 4U);
 
   /*-------------------------------------------------------------------------
    * Sanity check: the initial stack pointer should point into SRAM.
@@ -163,8 +321,11 @@ static void JumpToApplication(void)
     NVIC->ICPR[i] = 0xFFFFFFFFU;
   }
 
-  /* Remap vector table to the application base address. */
-  SCB->VTOR = APP_START_ADDR;
+  /* Boot time, slot and clock state for the application. */
+  BootHandoff_Finish(slot->name, attempt, 0U);
+
+  /* Remap vector table to the slot base address. */
+  SCB->VTOR = base;
 
   /* Set the main stack pointer to the application's initial stack. */
   __set_MSP(appStack);
@@ -213,34 +374,35 @@ int main(void)
     HAL_Delay(10);
 
     /* Decide boot mode:
-     *  - If B1 is pressed at startup  -> stay in bootloader (future update mode).
-     *  - Otherwise                    -> attempt to jump to application.
+     *  - If the application requested it -> update mode, back to the app
+     *                                       if no host shows up.
+     *  - If B1 is pressed at startup     -> stay in bootloader (update mode).
+     *  - Otherwise                       -> attempt to jump to application.
      */
+    /* Hand-off block request, or the backup-SRAM word of older images. */
+    uint8_t requested = BootHandoff_TakeRequest();
+    requested |= BootImage_TakeUpdateRequest();
+    if (requested)
+    {
+      Boot_Print("[BOOT] Update requested by the application.\r\n");
+      Boot_EnterUpdateMode(BOOT_UPDATE_IDLE_TIMEOUT_MS);
+    }
+
     if (Boot_IsButtonPressed())
     {
       Boot_Print("[BOOT] B1 is pressed: staying in bootloader.\r\n");
-      Boot_Print("[BOOT] (Future) OTA / firmware update mode.\r\n");
-
-      /* Phase 2: no update protocol yet, just blink LED + print messages. */
-      while (1)
-      {
-        HAL_GPIO_TogglePin(LD2_GPIO_Port, LD2_Pin);
-        HAL_Delay(300);
-      }
     }
     else
     {
       Boot_Print("[BOOT] B1 not pressed: attempting to jump to application...\r\n");
-      JumpToApplication();
-    }
+      Boot_StartApplication();
 
-    /* If we reach this point, the application was not considered valid. */
-    Boot_Print("[BOOT] No valid application found. Staying in error loop.\r\n");
-    while (1)
-    {
-      HAL_GPIO_TogglePin(LD2_GPIO_Port, LD2_Pin);
-      HAL_Delay(500);
+      /* If we reach this point, the application was not considered valid. */
+      Boot_Print("[BOOT] No valid application found.\r\n");
     }
+
+    /* Update mode: served until a GO command resets into the new image. */
+    Boot_EnterUpdateMode(0U);
   /* USER CODE END 2 */
 }
 
@@ -63,6 +63,10 @@ Reset_Handler:
 /* Call the clock system initialization function.*/
   bl  SystemInit  
 
+/* Jump straight to a verified application when possible (boot_fast.c);
+   returns for the full bootloader. Runs before .data/.bss exist. */
+  bl  BootFast_Entry
+
 /* Copy the data segment initializers from flash to SRAM */  
   ldr r0, =_sdata
   ldr r1, =_edata